@@ -13,6 +13,10 @@ import faiss  # @manual=//faiss/python:pyfaiss
 
 import numpy as np
 
+from faiss.contrib.evaluation import (  # @manual=//faiss/contrib:faiss_contrib
+    OperatingPoints,
+)
+
 from scipy.optimize import curve_fit
 
 from .benchmark_io import BenchmarkIO
@@ -614,6 +618,51 @@ class SearchOperator(IndexOperator):
             index=knn_desc.index,
         )
 
+    def load_benchmark(self, results: Dict[str, Any], knn_desc: KnnDescriptor):
+        """Open-loop load test of the search parameters that are Pareto
+        optimal (knn_intersection vs. batch time) in the knn search
+        experiments, for each target QPS of knn_desc.load_qps"""
+        index = knn_desc.index
+        index_name = index.get_index_name()
+        logger.info(f"load_benchmark: begin {index_name}")
+        op = OperatingPoints()
+        for key, v in results["experiments"].items():
+            if (
+                v.get("index") != index_name or
+                v.get("knn_intersection") is None or
+                key != index.get_knn_search_name(
+                    search_parameters=v["search_params"],
+                    query_vectors=knn_desc.query_dataset,
+                    k=knn_desc.k,
+                )
+            ):
+                continue
+            op.add_operating_point(
+                v["search_params"], v["knn_intersection"], v["time"]
+            )
+        gt_knn_I = getattr(self, "gt_knn_I", None)
+        for search_params, _, _ in op.operating_points:
+            for target_qps in knn_desc.load_qps:
+                key = index.get_knn_load_name(
+                    search_params,
+                    knn_desc.query_dataset,
+                    knn_desc.k,
+                    target_qps,
+                    knn_desc.load_clients,
+                )
+                if key in results["experiments"]:
+                    continue
+                results["experiments"][key] = index.knn_search_open_loop(
+                    search_params,
+                    knn_desc.query_dataset,
+                    knn_desc.k,
+                    target_qps,
+                    knn_desc.load_clients,
+                    gt_knn_I,
+                )
+        logger.info("load_benchmark: end")
+        return results
+
     def reconstruct_benchmark(
         self, dry_run, results: Dict[str, Any], knn_desc: KnnDescriptor
     ):
@@ -715,6 +764,9 @@ class SearchOperator(IndexOperator):
                 )
                 assert requires is None
 
+        if knn_desc.load_qps and not dry_run:
+            results = self.load_benchmark(results, knn_desc)
+
         if (
             knn_desc.range_ref_index_desc is None or
             not knn_desc.index.supports_range_search()
@@ -1008,6 +1060,9 @@ class Benchmark:
     range_ref_index_desc: Optional[str] = None
     k: int = 1
     distance_metric: str = "L2"
+    # open-loop load test, see KnnDescriptor.load_qps
+    load_qps: Optional[List[float]] = None
+    load_clients: int = 1
 
     def set_io(self, benchmark_io):
         self.io = benchmark_io
@@ -1077,6 +1132,8 @@ class Benchmark:
                 range_metrics=ci_desc.range_metrics,
                 radius=ci_desc.radius,
                 k=self.k,
+                load_qps=self.load_qps,
+                load_clients=self.load_clients,
             )
 
         return codec_desc, index_desc, knn_desc
@@ -346,6 +346,12 @@ class KnnDescriptor(IndexBaseDescriptor):
 
     range_ref_index_desc: Optional[str] = None
 
+    # open-loop load test of the Pareto-optimal search parameters:
+    # single-query searches with Poisson arrivals at each of these target
+    # QPS, issued by load_clients threads (see faiss.open_loop_search)
+    load_qps: Optional[List[float]] = None
+    load_clients: int = 1
+
     def __hash__(self):
         return hash(str(self))
 
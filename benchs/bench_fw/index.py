@@ -31,6 +31,7 @@ from .descriptors import DatasetDescriptor
 from .utils import (
     distance_ratio_measure,
     get_cpu_info,
+    latency_percentiles,
     refine_distances_knn,
     refine_distances_range,
     timer,
@@ -384,6 +385,77 @@ class IndexBase:
         logger.info("knn_search: end")
         return D, I, R, P, None
 
+    def get_knn_load_name(
+        self,
+        search_parameters: Optional[Dict[str, int]],
+        query_vectors: DatasetDescriptor,
+        k: int,
+        target_qps: float,
+        num_clients: int,
+    ):
+        name = self.get_knn_search_name(search_parameters, query_vectors, k)
+        assert name.endswith("knn.")
+        name = name[: -len("knn.")]
+        name += f"qps_{target_qps:g}.c_{num_clients}.load."
+        return name
+
+    def knn_search_open_loop(
+        self,
+        search_parameters: Optional[Dict[str, int]],
+        query_vectors: DatasetDescriptor,
+        k: int,
+        target_qps: float,
+        num_clients: int,
+        I_gt=None,
+    ):
+        """Single-query searches arriving as a Poisson process at
+        target_qps. The searches are issued from C++ threads by
+        faiss.open_loop_search, so the GIL does not serialize them.
+        The latencies include the queueing delay. The results are not
+        cached, as they depend on the machine load."""
+        logger.info("knn_search_open_loop: begin")
+        index = self.get_index()
+        Index.set_index_param_dict(index, search_parameters)
+        xq = np.ascontiguousarray(
+            self.io.get_dataset(query_vectors), dtype="float32"
+        )
+        nq = xq.shape[0]
+        D = np.empty((nq, k), dtype="float32")
+        I = np.empty((nq, k), dtype="int64")
+        latencies = np.empty(nq, dtype="float64")
+        stats = faiss.open_loop_search(
+            index,
+            nq,
+            faiss.swig_ptr(xq),
+            k,
+            target_qps,
+            num_clients,
+            faiss.swig_ptr(D),
+            faiss.swig_ptr(I),
+            faiss.swig_ptr(latencies),
+        )
+        P = {
+            "target_qps": target_qps,
+            "num_clients": num_clients,
+            "achieved_qps": stats.achieved_qps,
+            "duration": stats.duration,
+            "mean_service_time": stats.mean_service_time,
+            "n_late": int(stats.n_late),
+            "k": k,
+            "index": self.get_index_name(),
+            "codec": self.get_codec_name(),
+            "factory": self.get_model_name(),
+            "search_params": search_parameters,
+            "knn_intersection": (
+                knn_intersection_measure(I, I_gt)
+                if I_gt is not None
+                else None
+            ),
+        }
+        P |= latency_percentiles(latencies)
+        logger.info("knn_search_open_loop: end")
+        return P
+
     def reconstruct(
         self,
         dry_run,
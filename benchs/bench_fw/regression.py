@@ -0,0 +1,301 @@
+# Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""Recall / latency regression tracking.
+
+A RegressionJob is a reproducible benchmark definition: the datasets and
+index descriptors of bench_fw, the search parameter sweep and the hardware
+tags of the machines it is run on. run_job measures it with the python
+runner (in process) or the C++ runner (benchs/bench_regression), and
+write_results stores the results with the commit they were measured on. The
+results of a change are then compared to those of a baseline with
+compare_results, under the given tolerances.
+"""
+
+import datetime
+import itertools
+import json
+import logging
+import os
+import platform
+import subprocess
+import tempfile
+from dataclasses import asdict, dataclass, field
+from typing import Any, Dict, List, Optional
+
+import faiss  # @manual=//faiss/python:pyfaiss
+import numpy as np
+
+from faiss.contrib.evaluation import (  # @manual=//faiss/contrib:faiss_contrib
+    knn_intersection_measure,
+)
+
+from .benchmark_io import BenchmarkIO
+from .descriptors import DatasetDescriptor, IndexDescriptorClassic
+from .utils import get_cpu_info
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass
+class RegressionJob:
+    name: str
+    training_vectors: DatasetDescriptor
+    database_vectors: DatasetDescriptor
+    query_vectors: DatasetDescriptor
+    # factory + search_params. A search_params value may be a list, the
+    # cartesian product of the lists is measured
+    index_descs: List[IndexDescriptorClassic]
+    k: int = 10
+    distance_metric: str = "L2"
+    num_threads: int = 1
+    # the time of a search is the best of repeats runs
+    repeats: int = 3
+    # eg. {"cpu": "skylake", "host_type": "bench"}: latencies are only
+    # compared between results with the same tags
+    hardware_tags: Dict[str, str] = field(default_factory=dict)
+
+    @staticmethod
+    def from_dict(d: Dict[str, Any]) -> "RegressionJob":
+        d = dict(d)
+        for key in ["training_vectors", "database_vectors", "query_vectors"]:
+            d[key] = DatasetDescriptor(**d[key])
+        d["index_descs"] = [
+            IndexDescriptorClassic(**desc) for desc in d["index_descs"]
+        ]
+        return RegressionJob(**d)
+
+    @staticmethod
+    def from_json(filename: str) -> "RegressionJob":
+        with open(filename) as f:
+            return RegressionJob.from_dict(json.load(f))
+
+    def to_dict(self) -> Dict[str, Any]:
+        return asdict(self)
+
+
+@dataclass
+class Tolerance:
+    # max absolute drop of the recall
+    recall_abs: float = 0.01
+    # max relative increase of the time per query
+    latency_rel: float = 0.10
+    # latencies below this (ms per query) are too noisy to be compared
+    min_latency_ms: float = 0.001
+
+
+def search_param_sets(desc: IndexDescriptorClassic) -> List[str]:
+    """ParameterSpace strings of the sweep of an index descriptor"""
+    if not desc.search_params:
+        return [""]
+    keys = sorted(desc.search_params)
+    values = [
+        v if isinstance(v, list) else [v]
+        for v in (desc.search_params[key] for key in keys)
+    ]
+    return [
+        ",".join(f"{key}={v}" for key, v in zip(keys, combination))
+        for combination in itertools.product(*values)
+    ]
+
+
+def result_key(result: Dict[str, Any]):
+    return (result["index"], result["search_params"])
+
+
+def get_metadata(job: RegressionJob, runner: str) -> Dict[str, Any]:
+    try:
+        commit = subprocess.check_output(
+            ["git", "rev-parse", "HEAD"],
+            cwd=os.path.dirname(os.path.abspath(__file__)),
+            stderr=subprocess.DEVNULL,
+        ).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        commit = None
+    return {
+        "job": job.name,
+        "commit": commit,
+        "faiss_version": faiss.__version__,
+        "runner": runner,
+        "num_threads": job.num_threads,
+        "cpu": get_cpu_info(),
+        "machine": platform.machine(),
+        "hardware_tags": job.hardware_tags,
+        "timestamp": datetime.datetime.now(datetime.timezone.utc).isoformat(),
+    }
+
+
+def ground_truth(xb, xq, k, metric):
+    index = faiss.IndexFlat(xb.shape[1], metric)
+    index.add(xb)
+    _, I = index.search(xq, k)
+    return I
+
+
+def run_python(job: RegressionJob, xt, xb, xq, metric) -> List[Dict[str, Any]]:
+    gt = ground_truth(xb, xq, job.k, metric)
+    ps = faiss.ParameterSpace()
+    results = []
+    faiss.omp_set_num_threads(job.num_threads)
+    for desc in job.index_descs:
+        index = faiss.index_factory(xb.shape[1], desc.factory, metric)
+        t0 = faiss.getmillisecs()
+        index.train(xt)
+        t1 = faiss.getmillisecs()
+        index.add(xb)
+        t2 = faiss.getmillisecs()
+        for params in search_param_sets(desc):
+            if params:
+                ps.set_index_parameters(index, params)
+            best = float("inf")
+            for _ in range(job.repeats):
+                t3 = faiss.getmillisecs()
+                _, I = index.search(xq, job.k)
+                best = min(best, faiss.getmillisecs() - t3)
+            ms_per_query = best / len(xq)
+            results.append({
+                "index": desc.factory,
+                "search_params": params,
+                "recall": float(knn_intersection_measure(I, gt)),
+                "ms_per_query": ms_per_query,
+                "qps": 1000 / ms_per_query,
+                "train_ms": t1 - t0,
+                "add_ms": t2 - t1,
+            })
+            logger.info(f"{result_key(results[-1])}: {results[-1]}")
+    return results
+
+
+def fvecs_write(filename, x):
+    n, d = x.shape
+    m = np.empty((n, d + 1), dtype="int32")
+    m[:, 0] = d
+    m[:, 1:] = x.view("int32")
+    m.tofile(filename)
+
+
+def run_cpp(
+    job: RegressionJob, xt, xb, xq, binary: str
+) -> List[Dict[str, Any]]:
+    results = []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        files = []
+        for name, x in [("xt", xt), ("xb", xb), ("xq", xq)]:
+            fname = os.path.join(tmpdir, name + ".fvecs")
+            fvecs_write(fname, np.ascontiguousarray(x, dtype="float32"))
+            files.append(fname)
+        for desc in job.index_descs:
+            cmd = [
+                binary,
+                desc.factory,
+                job.distance_metric,
+                str(job.k),
+                str(job.num_threads),
+                str(job.repeats),
+            ] + files + search_param_sets(desc)
+            logger.info(f"running {' '.join(cmd)}")
+            out = subprocess.check_output(cmd).decode()
+            # the lines that are not JSON are logs of the library
+            for line in out.splitlines():
+                if line.startswith("{"):
+                    results.append(json.loads(line))
+    return results
+
+
+def run_job(
+    job: RegressionJob,
+    bio: BenchmarkIO,
+    runner: str = "python",
+    cpp_binary: Optional[str] = None,
+) -> Dict[str, Any]:
+    """Measure the job, returns the results with their metadata"""
+    metric = faiss.METRIC_L2 if job.distance_metric == "L2" else (
+        faiss.METRIC_INNER_PRODUCT
+    )
+    xt = bio.get_dataset(job.training_vectors)
+    xb = bio.get_dataset(job.database_vectors)
+    xq = bio.get_dataset(job.query_vectors)
+    if runner == "python":
+        results = run_python(job, xt, xb, xq, metric)
+    elif runner == "cpp":
+        assert cpp_binary is not None, "the C++ runner needs cpp_binary"
+        results = run_cpp(job, xt, xb, xq, cpp_binary)
+    else:
+        raise ValueError(f"unknown runner {runner}")
+    return {"metadata": get_metadata(job, runner), "results": results}
+
+
+def write_results(filename: str, results: Dict[str, Any]):
+    with open(filename, "w") as f:
+        json.dump(results, f, indent=1, sort_keys=True)
+
+
+def read_results(filename: str) -> Dict[str, Any]:
+    with open(filename) as f:
+        return json.load(f)
+
+
+@dataclass
+class Regression:
+    index: str
+    search_params: str
+    # "recall", "latency" or "missing"
+    metric: str
+    baseline: Optional[float]
+    current: Optional[float]
+
+    def __str__(self):
+        return (
+            f"{self.index} [{self.search_params}] {self.metric}: "
+            f"{self.baseline} -> {self.current}"
+        )
+
+
+def compare_results(
+    baseline: Dict[str, Any],
+    current: Dict[str, Any],
+    tolerance: Tolerance = Tolerance(),
+) -> List[Regression]:
+    """The configurations of the baseline that regressed in current. The
+    latencies are only compared when the hardware tags, the runner and the
+    nb of threads of both runs match."""
+    mb, mc = baseline["metadata"], current["metadata"]
+    compare_latency = all(
+        mb.get(key) == mc.get(key)
+        for key in ["hardware_tags", "runner", "num_threads"]
+    )
+    if not compare_latency:
+        logger.warning(
+            "different hardware tags, runners or threads: "
+            "only the recalls are compared"
+        )
+    current_results = {result_key(r): r for r in current["results"]}
+    regressions = []
+    for b in baseline["results"]:
+        c = current_results.get(result_key(b))
+        if c is None:
+            regressions.append(
+                Regression(*result_key(b), "missing", None, None)
+            )
+            continue
+        if c["recall"] < b["recall"] - tolerance.recall_abs:
+            regressions.append(
+                Regression(*result_key(b), "recall", b["recall"], c["recall"])
+            )
+        if (
+            compare_latency
+            and b["ms_per_query"] >= tolerance.min_latency_ms
+            and c["ms_per_query"]
+            > b["ms_per_query"] * (1 + tolerance.latency_rel)
+        ):
+            regressions.append(
+                Regression(
+                    *result_key(b),
+                    "latency",
+                    b["ms_per_query"],
+                    c["ms_per_query"],
+                )
+            )
+    return regressions
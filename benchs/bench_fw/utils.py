@@ -40,6 +40,14 @@ def timer(name, func, once=False) -> float:
     return res, t, repeat
 
 
+def latency_percentiles(latencies):
+    """Latency percentiles in milliseconds, from latencies in seconds"""
+    return {
+        f"latency_p{name}": float(np.percentile(latencies, q) * 1000)
+        for name, q in [("50", 50), ("90", 90), ("99", 99), ("999", 99.9)]
+    }
+
+
 def refine_distances_knn(
     xq: np.ndarray,
     xb: np.ndarray,
@@ -0,0 +1,96 @@
+# Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import argparse
+import logging
+import sys
+
+from faiss.benchs.bench_fw.benchmark_io import BenchmarkIO
+from faiss.benchs.bench_fw.regression import (
+    compare_results,
+    read_results,
+    RegressionJob,
+    run_job,
+    Tolerance,
+    write_results,
+)
+
+logging.basicConfig(level=logging.INFO)
+
+# example of a job file:
+#
+# {
+#   "name": "sift1M_ivf",
+#   "training_vectors": {"namespace": "std_t", "tablename": "sift1M"},
+#   "database_vectors": {"namespace": "std_d", "tablename": "sift1M"},
+#   "query_vectors": {"namespace": "std_q", "tablename": "sift1M"},
+#   "index_descs": [
+#     {"factory": "IVF1024,Flat", "search_params": {"nprobe": [1, 4, 16]}},
+#     {"factory": "HNSW32", "search_params": {"efSearch": [16, 64]}}
+#   ],
+#   "k": 10,
+#   "num_threads": 1,
+#   "hardware_tags": {"cpu": "skylake"}
+# }
+
+
+def run(args):
+    job = RegressionJob.from_json(args.job)
+    bio = BenchmarkIO(path=args.path)
+    results = run_job(job, bio, runner=args.runner, cpp_binary=args.cpp_binary)
+    write_results(args.output, results)
+
+
+def diff(args):
+    regressions = compare_results(
+        read_results(args.baseline),
+        read_results(args.current),
+        Tolerance(
+            recall_abs=args.recall_tolerance,
+            latency_rel=args.latency_tolerance,
+        ),
+    )
+    for r in regressions:
+        print(f"REGRESSION {r}")
+    if regressions:
+        sys.exit(1)
+    print("no regression")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    parser_run = subparsers.add_parser("run", help="measure a job")
+    parser_run.add_argument("job", help="job definition (JSON)")
+    parser_run.add_argument("output", help="results file (JSON)")
+    parser_run.add_argument("--path", default=".", help="dataset path")
+    parser_run.add_argument(
+        "--runner", choices=["python", "cpp"], default="python"
+    )
+    parser_run.add_argument(
+        "--cpp-binary",
+        default="build/benchs/bench_regression",
+        help="bench_regression executable, for --runner cpp",
+    )
+    parser_run.set_defaults(func=run)
+
+    parser_diff = subparsers.add_parser(
+        "diff", help="compare results to a baseline, exit 1 on regression"
+    )
+    parser_diff.add_argument("baseline")
+    parser_diff.add_argument("current")
+    parser_diff.add_argument(
+        "--recall-tolerance", type=float, default=0.01,
+        help="max absolute drop of the recall",
+    )
+    parser_diff.add_argument(
+        "--latency-tolerance", type=float, default=0.10,
+        help="max relative increase of the time per query",
+    )
+    parser_diff.set_defaults(func=diff)
+
+    args = parser.parse_args()
+    args.func(args)
@@ -66,6 +66,25 @@ void addn_func(
     minheap_reorder(k, heap_val, heap_ids);
 }
 
+void addn_buffered(
+        size_t n,
+        size_t k,
+        const float* x,
+        int64_t* heap_ids,
+        float* heap_val) {
+    minheap_heapify(k, heap_val, heap_ids);
+
+    HeapBuffer<CMin<float, int64_t>> heap(k, heap_val, heap_ids);
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] > heap.threshold) {
+            heap.push(x[i], i);
+        }
+    }
+    heap.flush();
+
+    minheap_reorder(k, heap_val, heap_ids);
+}
+
 int main() {
     size_t n = 10 * 1000 * 1000;
 
@@ -79,20 +98,22 @@ int main() {
         printf("benchmark with k=%zd n=%zd nrun=%d\n", k, n, nrun);
         FAISS_THROW_IF_NOT(k < n);
 
-        double tot_t1 = 0, tot_t2 = 0, tot_t3 = 0;
-#pragma omp parallel reduction(+ : tot_t1, tot_t2, tot_t3)
+        double tot_t1 = 0, tot_t2 = 0, tot_t3 = 0, tot_t4 = 0;
+#pragma omp parallel reduction(+ : tot_t1, tot_t2, tot_t3, tot_t4)
         {
             std::vector<float> heap_dis(k);
             std::vector<float> heap_dis_2(k);
             std::vector<float> heap_dis_3(k);
+            std::vector<float> heap_dis_4(k);
 
             std::vector<int64_t> heap_ids(k);
             std::vector<int64_t> heap_ids_2(k);
             std::vector<int64_t> heap_ids_3(k);
+            std::vector<int64_t> heap_ids_4(k);
 
 #pragma omp for
             for (int run = 0; run < nrun; run++) {
-                double t0, t1, t2, t3;
+                double t0, t1, t2, t3, t4;
 
                 t0 = getmillisecs();
 
@@ -109,9 +130,15 @@ int main() {
                 addn_func(n, k, x.data(), heap_ids_3.data(), heap_dis_3.data());
                 t3 = getmillisecs();
 
+                // with a HeapBuffer
+                addn_buffered(
+                        n, k, x.data(), heap_ids_4.data(), heap_dis_4.data());
+                t4 = getmillisecs();
+
                 tot_t1 += t1 - t0;
                 tot_t2 += t2 - t1;
                 tot_t3 += t3 - t2;
+                tot_t4 += t4 - t3;
             }
 
             for (size_t i = 0; i < k; i++) {
@@ -130,10 +157,16 @@ int main() {
                 FAISS_THROW_IF_NOT(heap_ids[i] == heap_ids_3[i]);
                 FAISS_THROW_IF_NOT(heap_dis[i] == heap_dis_3[i]);
             }
+
+            for (size_t i = 0; i < k; i++) {
+                FAISS_THROW_IF_NOT(heap_ids[i] == heap_ids_4[i]);
+                FAISS_THROW_IF_NOT(heap_dis[i] == heap_dis_4[i]);
+            }
         }
         printf("default implem: %.3f ms\n", tot_t1 / nrun);
         printf("replace implem: %.3f ms\n", tot_t2 / nrun);
         printf("addn    implem: %.3f ms\n", tot_t3 / nrun);
+        printf("buffer  implem: %.3f ms\n", tot_t4 / nrun);
     }
     return 0;
 }
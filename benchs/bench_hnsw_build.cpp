@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/utils.h>
+
+/************************
+ * Measures the HNSW build throughput as a function of the number of threads,
+ * with the default OpenMP locks + static scheduling and with the concurrent
+ * mode (spinlocks + chunked scheduling). The recall@1 of the resulting
+ * graphs is reported to check that they are of the same quality.
+ *
+ * usage: bench_hnsw_build [nb] [d] [M]
+ */
+
+namespace {
+
+double recall_at_1(
+        faiss::Index& index,
+        size_t nq,
+        const float* xq,
+        const std::vector<faiss::idx_t>& gt) {
+    std::vector<float> D(nq);
+    std::vector<faiss::idx_t> I(nq);
+    index.search(nq, xq, 1, D.data(), I.data());
+    size_t n_ok = 0;
+    for (size_t i = 0; i < nq; i++) {
+        n_ok += I[i] == gt[i];
+    }
+    return n_ok / double(nq);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t nb = argc > 1 ? atoi(argv[1]) : 200 * 1000;
+    int d = argc > 2 ? atoi(argv[2]) : 64;
+    int M = argc > 3 ? atoi(argv[3]) : 32;
+    size_t nq = 1000;
+
+    std::vector<float> data((nb + nq) * d);
+    float* xb = data.data();
+    float* xq = data.data() + nb * d;
+    faiss::rand_smooth_vectors(nb + nq, d, data.data(), 1234);
+
+    std::vector<faiss::idx_t> gt(nq);
+    {
+        faiss::IndexFlatL2 index_flat(d);
+        index_flat.add(nb, xb);
+        std::vector<float> D(nq);
+        index_flat.search(nq, xq, 1, D.data(), gt.data());
+    }
+
+    int max_threads = omp_get_max_threads();
+    printf("nb=%zd d=%d M=%d max_threads=%d\n", nb, d, M, max_threads);
+
+    for (int concurrent = 0; concurrent < 2; concurrent++) {
+        printf("concurrent_add=%d\n", concurrent);
+        double t_1thread = 0;
+        for (int nt = 1;; nt = std::min(nt * 2, max_threads)) {
+            omp_set_num_threads(nt);
+            faiss::IndexHNSWFlat index(d, M);
+            index.concurrent_add = concurrent;
+
+            double t0 = faiss::getmillisecs();
+            index.add(nb, xb);
+            double t1 = faiss::getmillisecs() - t0;
+            if (nt == 1) {
+                t_1thread = t1;
+            }
+
+            omp_set_num_threads(max_threads);
+            printf("  threads=%3d build %9.1f ms  %8.0f vectors/s  "
+                   "speedup %5.2f  R@1 %.4f\n",
+                   nt,
+                   t1,
+                   nb * 1000.0 / t1,
+                   t_1thread / t1,
+                   recall_at_1(index, nq, xq, gt));
+            if (nt == max_threads) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
@@ -86,7 +86,8 @@ class SeparateCoarseQuantizationIndex:
     Separately manage the coarse quantizer and the IVF index.
     """
 
-    def __init__(self, quantizer, index, bs=-1, seq_tiling=False):
+    def __init__(self, quantizer, index, bs=-1, seq_tiling=False,
+                 pipelined=False):
         self.index = index
         self.index_ivf = extract_index_ivf(index)
         if isinstance(self.index_ivf, faiss.IndexIVF):
@@ -105,6 +106,12 @@ class SeparateCoarseQuantizationIndex:
             quantizer.add(centroids)
         self.bs = bs
         self.seq_tiling = seq_tiling
+        # the tiling is done in C++ by IndexIVFIndependentQuantizer
+        self.pipelined_index = None
+        if pipelined:
+            self.pipelined_index = faiss.IndexIVFIndependentQuantizer(
+                quantizer, self.index_ivf)
+            self.pipelined_index.search_chunk_size = max(bs, 0)
 
     def search(self, xq, k):
         # perform coarse quantization
@@ -112,6 +119,8 @@ class SeparateCoarseQuantizationIndex:
             # print("applying pre-transform")
             assert self.index.chain.size() == 1
             xq = self.index.chain.at(0).apply(xq)
+        if self.pipelined_index is not None:
+            return self.pipelined_index.search(xq, k)
         if self.bs <= 0:
             # non batched
             nprobe = self.index_ivf.nprobe
@@ -300,7 +309,8 @@ def main():
     aa('--search_type', default="cpu",
         choices=[
             "cpu", "gpu", "gpu_flat_quantizer",
-            "cpu_flat_gpu_quantizer", "gpu_tiled", "gpu_ivf_quantizer",
+            "cpu_flat_gpu_quantizer", "cpu_flat_gpu_quantizer_pipelined",
+            "gpu_tiled", "gpu_ivf_quantizer",
             "multi_gpu", "multi_gpu_flat_quantizer",
             "multi_gpu_sharded", "multi_gpu_flat_quantizer_sharded",
             "multi_gpu_sharded1", "multi_gpu_sharded1_flat",
@@ -432,13 +442,15 @@ def main():
         res = faiss.StandardGpuResources()
         index = faiss.index_cpu_to_gpu(res, 0, index, co)
         op.restrict_range("nprobe", 2049)
-    elif args.search_type == "cpu_flat_gpu_quantizer":
+    elif args.search_type in (
+            "cpu_flat_gpu_quantizer", "cpu_flat_gpu_quantizer_pipelined"):
         index_ivf = faiss.extract_index_ivf(index)
         quantizer = faiss.IndexFlatL2(index_ivf.d)
         res = faiss.StandardGpuResources()
         quantizer = faiss.index_cpu_to_gpu(res, 0, quantizer, co)
         index = SeparateCoarseQuantizationIndex(
-            quantizer, index, bs=args.batch_size)
+            quantizer, index, bs=args.batch_size,
+            pipelined="pipelined" in args.search_type)
         op.restrict_range("nprobe", 2049)
     elif args.search_type in ("multi_gpu", "multi_gpu_sharded"):
         print(f"move index to {faiss.get_num_gpus()} GPU")
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <faiss/utils/NeuralNet.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/utils.h>
+
+/************************
+ * Measures the QINCo decode throughput (vectors / s) as a function of the
+ * block size, with fp32, fp16 and bf16 weights. The weights are random, the
+ * throughput does not depend on them.
+ *
+ * usage: bench_qinco_decode [n] [d] [M] [L] [h]
+ */
+
+namespace {
+
+void random_weights(faiss::nn::Linear& linear, int64_t seed) {
+    faiss::float_randn(linear.weight.data(), linear.weight.size(), seed);
+    for (float& w : linear.weight) {
+        w *= 0.1;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? atoi(argv[1]) : 100 * 1000;
+    int d = argc > 2 ? atoi(argv[2]) : 128;
+    int M = argc > 3 ? atoi(argv[3]) : 8;
+    int L = argc > 4 ? atoi(argv[4]) : 2;
+    int h = argc > 5 ? atoi(argv[5]) : 256;
+    int K = 256;
+
+    faiss::QINCo qinco(d, K, L, M, h);
+    faiss::float_randn(
+            qinco.codebook0.weight.data(), qinco.codebook0.weight.size(), 1);
+    for (int m = 0; m < M - 1; m++) {
+        faiss::QINCoStep& step = qinco.get_step(m);
+        faiss::float_randn(
+                step.codebook.weight.data(), step.codebook.weight.size(), m);
+        random_weights(step.MLPconcat, 100 + m);
+        for (int l = 0; l < L; l++) {
+            random_weights(step.get_residual_block(l).linear1, 200 + m * L + l);
+            random_weights(step.get_residual_block(l).linear2, 300 + m * L + l);
+        }
+    }
+
+    std::vector<int32_t> codes(n * M);
+    for (size_t i = 0; i < codes.size(); i++) {
+        codes[i] = (i * 7919) % K;
+    }
+    std::vector<float> x(n * d);
+
+    printf("n=%zd d=%d M=%d L=%d h=%d, %d threads\n",
+           n,
+           d,
+           M,
+           L,
+           h,
+           omp_get_max_threads());
+
+    const char* type_names[] = {"fp32", "fp16", "bf16"};
+    for (auto weight_type :
+         {faiss::nn::WeightType::FP32,
+          faiss::nn::WeightType::FP16,
+          faiss::nn::WeightType::BF16}) {
+        qinco.set_weight_type(weight_type);
+        for (size_t bs : {16, 256, 1024, 4096, 16384}) {
+            qinco.block_size = bs;
+            double t0 = faiss::getmillisecs();
+            qinco.decode_codes(n, codes.data(), x.data());
+            double t1 = faiss::getmillisecs();
+            printf("%s block_size=%6zd decode: %.3f s, %.0f vectors/s\n",
+                   type_names[int(weight_type)],
+                   bs,
+                   (t1 - t0) / 1000,
+                   n / ((t1 - t0) / 1000));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <omp.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/AutoTune.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/utils.h>
+
+/************************
+ * C++ runner of the regression jobs of bench_fw (see
+ * benchs/bench_fw/regression.py, that drives it with --runner cpp). Builds
+ * one index and measures the search with each set of search parameters.
+ * The results are printed as one JSON object per line, with the same
+ * fields as the python runner:
+ *
+ *   {"index": ..., "search_params": ..., "recall": ..., "ms_per_query": ...,
+ *    "qps": ..., "add_ms": ..., "train_ms": ...}
+ *
+ * recall is the k-NN intersection with the exact search, ms_per_query the
+ * best of repeats searches of all the queries.
+ *
+ * usage: bench_regression factory metric k nthreads repeats
+ *                         xt.fvecs xb.fvecs xq.fvecs [params ...]
+ *
+ * metric is L2 or IP, a params string is given to
+ * ParameterSpace::set_index_parameters (eg. "nprobe=16,quantizer_efSearch=64"),
+ * without params the defaults of the index are measured.
+ */
+
+namespace {
+
+std::vector<float> fvecs_read(const char* fname, size_t* d_out, size_t* n_out) {
+    FILE* f = fopen(fname, "rb");
+    if (!f) {
+        fprintf(stderr, "could not open %s\n", fname);
+        exit(1);
+    }
+    int d;
+    if (fread(&d, sizeof(int), 1, f) != 1 || d <= 0 || d > 1000000) {
+        fprintf(stderr, "%s: invalid fvecs header\n", fname);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    size_t sz = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    size_t n = sz / ((d + 1) * 4);
+    std::vector<float> x(n * (d + 1));
+    if (fread(x.data(), sizeof(float), x.size(), f) != x.size()) {
+        fprintf(stderr, "%s: short read\n", fname);
+        exit(1);
+    }
+    fclose(f);
+    // drop the dimension headers
+    for (size_t i = 0; i < n; i++) {
+        memmove(x.data() + i * d, x.data() + 1 + i * (d + 1), d * sizeof(float));
+    }
+    x.resize(n * d);
+    *d_out = d;
+    *n_out = n;
+    return x;
+}
+
+double knn_intersection(
+        size_t nq,
+        int k,
+        const std::vector<faiss::idx_t>& I,
+        const std::vector<faiss::idx_t>& gt) {
+    size_t ninter = 0;
+    for (size_t q = 0; q < nq; q++) {
+        std::unordered_set<faiss::idx_t> ref(
+                gt.begin() + q * k, gt.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            ninter += I[q * k + j] >= 0 && ref.count(I[q * k + j]);
+        }
+    }
+    return ninter / double(nq * k);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 9) {
+        fprintf(stderr,
+                "usage: %s factory metric k nthreads repeats "
+                "xt.fvecs xb.fvecs xq.fvecs [params ...]\n",
+                argv[0]);
+        return 1;
+    }
+    const char* factory = argv[1];
+    faiss::MetricType metric = strcmp(argv[2], "IP") == 0
+            ? faiss::METRIC_INNER_PRODUCT
+            : faiss::METRIC_L2;
+    int k = atoi(argv[3]);
+    int nthreads = atoi(argv[4]);
+    int repeats = std::max(atoi(argv[5]), 1);
+
+    size_t d, dt, dq, nt, nb, nq;
+    std::vector<float> xt = fvecs_read(argv[6], &dt, &nt);
+    std::vector<float> xb = fvecs_read(argv[7], &d, &nb);
+    std::vector<float> xq = fvecs_read(argv[8], &dq, &nq);
+    if (dt != d || dq != d) {
+        fprintf(stderr, "inconsistent dimensions %zd %zd %zd\n", dt, d, dq);
+        return 1;
+    }
+    std::vector<std::string> param_sets;
+    for (int i = 9; i < argc; i++) {
+        param_sets.push_back(argv[i]);
+    }
+    if (param_sets.empty()) {
+        param_sets.push_back("");
+    }
+
+    std::vector<faiss::idx_t> gt(nq * k);
+    {
+        faiss::IndexFlat index_flat(d, metric);
+        index_flat.add(nb, xb.data());
+        std::vector<float> D(nq * k);
+        index_flat.search(nq, xq.data(), k, D.data(), gt.data());
+    }
+
+    omp_set_num_threads(nthreads);
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, factory, metric));
+    double t0 = faiss::getmillisecs();
+    index->train(nt, xt.data());
+    double t1 = faiss::getmillisecs();
+    index->add(nb, xb.data());
+    double t2 = faiss::getmillisecs();
+
+    faiss::ParameterSpace ps;
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    for (const std::string& params : param_sets) {
+        if (!params.empty()) {
+            ps.set_index_parameters(index.get(), params.c_str());
+        }
+        double best = 1e50;
+        for (int r = 0; r < repeats; r++) {
+            double t3 = faiss::getmillisecs();
+            index->search(nq, xq.data(), k, D.data(), I.data());
+            best = std::min(best, faiss::getmillisecs() - t3);
+        }
+        double ms_per_query = best / nq;
+        printf("{\"index\": \"%s\", \"search_params\": \"%s\", "
+               "\"recall\": %.6f, \"ms_per_query\": %.6g, \"qps\": %.6g, "
+               "\"train_ms\": %.6g, \"add_ms\": %.6g}\n",
+               factory,
+               params.c_str(),
+               knn_intersection(nq, k, I, gt),
+               ms_per_query,
+               1000 / ms_per_query,
+               t1 - t0,
+               t2 - t1);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include "IndexHNSW_c.h"
+#include <faiss/IndexHNSW.h>
+#include "macros_impl.h"
+
+using faiss::IndexHNSW;
+using faiss::IndexHNSWFlat;
+using faiss::SearchParametersHNSW;
+
+/// SearchParametersHNSW definitions
+
+DEFINE_DESTRUCTOR(SearchParametersHNSW)
+DEFINE_SEARCH_PARAMETERS_DOWNCAST(SearchParametersHNSW)
+
+int faiss_SearchParametersHNSW_new(FaissSearchParametersHNSW** p_sp) {
+    try {
+        SearchParametersHNSW* sp = new SearchParametersHNSW;
+        *p_sp = reinterpret_cast<FaissSearchParametersHNSW*>(sp);
+    }
+    CATCH_AND_HANDLE
+}
+
+int faiss_SearchParametersHNSW_new_with(
+        FaissSearchParametersHNSW** p_sp,
+        FaissIDSelector* sel,
+        int efSearch) {
+    try {
+        SearchParametersHNSW* sp = new SearchParametersHNSW;
+        sp->sel = reinterpret_cast<faiss::IDSelector*>(sel);
+        sp->efSearch = efSearch;
+        *p_sp = reinterpret_cast<FaissSearchParametersHNSW*>(sp);
+    }
+    CATCH_AND_HANDLE
+}
+
+DEFINE_GETTER_PERMISSIVE(SearchParametersHNSW, const FaissIDSelector*, sel)
+
+DEFINE_GETTER(SearchParametersHNSW, int, efSearch)
+DEFINE_SETTER(SearchParametersHNSW, int, efSearch)
+
+DEFINE_GETTER(SearchParametersHNSW, int, check_relative_distance)
+DEFINE_SETTER(SearchParametersHNSW, int, check_relative_distance)
+
+DEFINE_GETTER(SearchParametersHNSW, int, bounded_queue)
+DEFINE_SETTER(SearchParametersHNSW, int, bounded_queue)
+
+DEFINE_GETTER(SearchParametersHNSW, int, beam_size)
+DEFINE_SETTER(SearchParametersHNSW, int, beam_size)
+
+DEFINE_GETTER(SearchParametersHNSW, int, batch_size)
+DEFINE_SETTER(SearchParametersHNSW, int, batch_size)
+
+DEFINE_GETTER(SearchParametersHNSW, float, pq_pruning_ratio)
+DEFINE_SETTER(SearchParametersHNSW, float, pq_pruning_ratio)
+
+DEFINE_GETTER(SearchParametersHNSW, int, local_prune)
+DEFINE_SETTER(SearchParametersHNSW, int, local_prune)
+
+DEFINE_GETTER(SearchParametersHNSW, float, send_neigh_times_ratio)
+DEFINE_SETTER(SearchParametersHNSW, float, send_neigh_times_ratio)
+
+DEFINE_GETTER(SearchParametersHNSW, int, zmq_port)
+DEFINE_SETTER(SearchParametersHNSW, int, zmq_port)
+
+DEFINE_GETTER(SearchParametersHNSW, int, pipeline_depth)
+DEFINE_SETTER(SearchParametersHNSW, int, pipeline_depth)
+
+DEFINE_GETTER(SearchParametersHNSW, int, coalesce_requests)
+DEFINE_SETTER(SearchParametersHNSW, int, coalesce_requests)
+
+DEFINE_GETTER(SearchParametersHNSW, int, server_side_distances)
+DEFINE_SETTER(SearchParametersHNSW, int, server_side_distances)
+
+DEFINE_GETTER(SearchParametersHNSW, int, early_stop_patience)
+DEFINE_SETTER(SearchParametersHNSW, int, early_stop_patience)
+
+/// IndexHNSW definitions
+
+DEFINE_DESTRUCTOR(IndexHNSW)
+DEFINE_INDEX_DOWNCAST(IndexHNSW)
+
+DEFINE_GETTER(IndexHNSW, int, is_recompute)
+DEFINE_SETTER(IndexHNSW, int, is_recompute)
+
+int faiss_IndexHNSW_efSearch(const FaissIndexHNSW* index) {
+    return reinterpret_cast<const IndexHNSW*>(index)->hnsw.efSearch;
+}
+
+void faiss_IndexHNSW_set_efSearch(FaissIndexHNSW* index, int efSearch) {
+    reinterpret_cast<IndexHNSW*>(index)->hnsw.efSearch = efSearch;
+}
+
+int faiss_IndexHNSW_efConstruction(const FaissIndexHNSW* index) {
+    return reinterpret_cast<const IndexHNSW*>(index)->hnsw.efConstruction;
+}
+
+void faiss_IndexHNSW_set_efConstruction(
+        FaissIndexHNSW* index,
+        int efConstruction) {
+    reinterpret_cast<IndexHNSW*>(index)->hnsw.efConstruction = efConstruction;
+}
+
+/// IndexHNSWFlat definitions
+
+DEFINE_DESTRUCTOR(IndexHNSWFlat)
+DEFINE_INDEX_DOWNCAST(IndexHNSWFlat)
+
+int faiss_IndexHNSWFlat_new_with(
+        FaissIndexHNSWFlat** p_index,
+        int d,
+        int M,
+        FaissMetricType metric) {
+    try {
+        IndexHNSWFlat* index = new IndexHNSWFlat(
+                d, M, static_cast<faiss::MetricType>(metric));
+        *p_index = reinterpret_cast<FaissIndexHNSWFlat*>(index);
+    }
+    CATCH_AND_HANDLE
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c -*-
+
+#ifndef FAISS_INDEX_HNSW_C_H
+#define FAISS_INDEX_HNSW_C_H
+
+#include "Index_c.h"
+#include "faiss_c.h"
+#include "impl/AuxIndexStructures_c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Search parameters of IndexHNSW, including the recompute and pruning
+ * options. The boolean fields are set with 0 / 1.
+ */
+FAISS_DECLARE_CLASS_INHERITED(SearchParametersHNSW, SearchParameters)
+FAISS_DECLARE_DESTRUCTOR(SearchParametersHNSW)
+FAISS_DECLARE_SEARCH_PARAMETERS_DOWNCAST(SearchParametersHNSW)
+
+int faiss_SearchParametersHNSW_new(FaissSearchParametersHNSW** p_sp);
+int faiss_SearchParametersHNSW_new_with(
+        FaissSearchParametersHNSW** p_sp,
+        FaissIDSelector* sel,
+        int efSearch);
+
+FAISS_DECLARE_GETTER(SearchParametersHNSW, const FaissIDSelector*, sel)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, efSearch)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, check_relative_distance)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, bounded_queue)
+/// nb of nodes expanded per round, and nb of neighbors per batch (0 = off)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, beam_size)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, batch_size)
+/// PQ-instructed pruning of the neighbors
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, float, pq_pruning_ratio)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, local_prune)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, float, send_neigh_times_ratio)
+/// recompute mode: embedding server port and request options
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, zmq_port)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, pipeline_depth)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, coalesce_requests)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, server_side_distances)
+FAISS_DECLARE_GETTER_SETTER(SearchParametersHNSW, int, early_stop_patience)
+
+/** Hierarchical navigable small world graph index, see IndexHNSW.h */
+FAISS_DECLARE_CLASS_INHERITED(IndexHNSW, Index)
+FAISS_DECLARE_DESTRUCTOR(IndexHNSW)
+FAISS_DECLARE_INDEX_DOWNCAST(IndexHNSW)
+
+/// the distances are recomputed from embeddings fetched from a server
+FAISS_DECLARE_GETTER_SETTER(IndexHNSW, int, is_recompute)
+
+/// default efSearch of the graph (hnsw.efSearch)
+int faiss_IndexHNSW_efSearch(const FaissIndexHNSW* index);
+void faiss_IndexHNSW_set_efSearch(FaissIndexHNSW* index, int efSearch);
+
+/// default efConstruction of the graph (hnsw.efConstruction)
+int faiss_IndexHNSW_efConstruction(const FaissIndexHNSW* index);
+void faiss_IndexHNSW_set_efConstruction(
+        FaissIndexHNSW* index,
+        int efConstruction);
+
+FAISS_DECLARE_CLASS_INHERITED(IndexHNSWFlat, IndexHNSW)
+FAISS_DECLARE_DESTRUCTOR(IndexHNSWFlat)
+FAISS_DECLARE_INDEX_DOWNCAST(IndexHNSWFlat)
+
+int faiss_IndexHNSWFlat_new_with(
+        FaissIndexHNSWFlat** p_index,
+        int d,
+        int M,
+        FaissMetricType metric);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,8 +10,63 @@
 #include "Index_c.h"
 #include <faiss/Index.h>
 #include <faiss/impl/IDSelector.h>
+#include <omp.h>
+#include <chrono>
+#include <future>
+#include <vector>
 #include "macros_impl.h"
 
+namespace {
+
+/// sets the nb of OpenMP threads of the calling thread in a scope
+struct ScopedOmpThreads {
+    int prev_nthreads;
+
+    explicit ScopedOmpThreads(int nthreads)
+            : prev_nthreads(omp_get_max_threads()) {
+        if (nthreads > 0) {
+            omp_set_num_threads(nthreads);
+        }
+    }
+
+    ~ScopedOmpThreads() {
+        omp_set_num_threads(prev_nthreads);
+    }
+};
+
+void search_requests(
+        const faiss::Index* index,
+        size_t nreq,
+        const FaissSearchRequest* requests,
+        int nthreads) {
+    ScopedOmpThreads scoped_threads(nthreads);
+    for (size_t i = 0; i < nreq; i++) {
+        const FaissSearchRequest& req = requests[i];
+        index->search(
+                req.n,
+                req.x,
+                req.k,
+                req.distances,
+                req.labels,
+                reinterpret_cast<const faiss::SearchParameters*>(req.params));
+    }
+}
+
+struct SearchFuture {
+    std::vector<FaissSearchRequest> requests;
+    std::future<void> future;
+    int status = 0; ///< error code, once waited for
+};
+
+int get_search_future(SearchFuture* f) {
+    try {
+        f->future.get();
+    }
+    CATCH_AND_HANDLE
+}
+
+} // namespace
+
 extern "C" {
 
 DEFINE_DESTRUCTOR(SearchParameters)
@@ -100,6 +155,82 @@ int faiss_Index_search_with_params(
     CATCH_AND_HANDLE
 }
 
+int faiss_Index_search_with_threads(
+        const FaissIndex* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        const FaissSearchParameters* params,
+        int nthreads,
+        float* distances,
+        idx_t* labels) {
+    try {
+        ScopedOmpThreads scoped_threads(nthreads);
+        reinterpret_cast<const faiss::Index*>(index)->search(
+                n,
+                x,
+                k,
+                distances,
+                labels,
+                reinterpret_cast<const faiss::SearchParameters*>(params));
+    }
+    CATCH_AND_HANDLE
+}
+
+int faiss_Index_search_batch(
+        const FaissIndex* index,
+        size_t nreq,
+        const FaissSearchRequest* requests,
+        int nthreads) {
+    try {
+        search_requests(
+                reinterpret_cast<const faiss::Index*>(index),
+                nreq,
+                requests,
+                nthreads);
+    }
+    CATCH_AND_HANDLE
+}
+
+int faiss_Index_search_async(
+        const FaissIndex* index,
+        size_t nreq,
+        const FaissSearchRequest* requests,
+        int nthreads,
+        FaissSearchFuture** p_future) {
+    try {
+        SearchFuture* f = new SearchFuture;
+        f->requests.assign(requests, requests + nreq);
+        const faiss::Index* idx = reinterpret_cast<const faiss::Index*>(index);
+        f->future = std::async(std::launch::async, [f, idx, nthreads]() {
+            search_requests(
+                    idx, f->requests.size(), f->requests.data(), nthreads);
+        });
+        *p_future = reinterpret_cast<FaissSearchFuture*>(f);
+    }
+    CATCH_AND_HANDLE
+}
+
+int faiss_SearchFuture_is_ready(const FaissSearchFuture* future) {
+    const SearchFuture* f = reinterpret_cast<const SearchFuture*>(future);
+    return !f->future.valid() ||
+            f->future.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready;
+}
+
+int faiss_SearchFuture_wait(FaissSearchFuture* future) {
+    SearchFuture* f = reinterpret_cast<SearchFuture*>(future);
+    if (f->future.valid()) {
+        f->status = get_search_future(f);
+    }
+    return f->status;
+}
+
+void faiss_SearchFuture_free(FaissSearchFuture* future) {
+    // the destructor of the future waits for the searches
+    delete reinterpret_cast<SearchFuture*>(future);
+}
+
 int faiss_Index_range_search(
         const FaissIndex* index,
         idx_t n,
@@ -134,6 +134,77 @@ int faiss_Index_search_with_params(
         float* distances,
         idx_t* labels);
 
+/** same as faiss_Index_search_with_params, with nthreads OpenMP threads.
+ *
+ * The nb of threads is set for the calling thread only, for the duration
+ * of the call, so concurrent calls can use different values. nthreads <= 0
+ * uses the current setting.
+ */
+int faiss_Index_search_with_threads(
+        const FaissIndex* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        const FaissSearchParameters* params,
+        int nthreads,
+        float* distances,
+        idx_t* labels);
+
+/// one search of a batch, the results are written to the caller's buffers
+typedef struct FaissSearchRequest {
+    idx_t n;        ///< nb of queries
+    const float* x; ///< queries, size n * d
+    idx_t k;        ///< nb of results per query
+    /// search parameters, NULL for the defaults of the index
+    const FaissSearchParameters* params;
+    float* distances; ///< output distances, size n * k
+    idx_t* labels;    ///< output labels, size n * k
+} FaissSearchRequest;
+
+/** run several searches, each with its own parameters, in one call.
+ *
+ * The searches run one after the other, each parallelized with nthreads
+ * threads (<= 0: current setting). Stops at the first failed search.
+ *
+ * @param requests    the searches, size nreq
+ */
+int faiss_Index_search_batch(
+        const FaissIndex* index,
+        size_t nreq,
+        const FaissSearchRequest* requests,
+        int nthreads);
+
+/// Opaque type for the searches started by faiss_Index_search_async
+FAISS_DECLARE_CLASS(SearchFuture)
+
+/** start the searches of faiss_Index_search_batch in a background thread.
+ *
+ * The requests are copied, but the index, the query vectors, the search
+ * parameters and the output buffers must remain valid until the searches
+ * are waited for.
+ *
+ * @param p_future    output, free with faiss_SearchFuture_free
+ */
+int faiss_Index_search_async(
+        const FaissIndex* index,
+        size_t nreq,
+        const FaissSearchRequest* requests,
+        int nthreads,
+        FaissSearchFuture** p_future);
+
+/// 1 if the searches are done, 0 otherwise
+int faiss_SearchFuture_is_ready(const FaissSearchFuture* future);
+
+/** wait for the searches to complete.
+ *
+ * @return 0 or the error code of the failed search. The error is also
+ *         available with faiss_get_last_error in the waiting thread.
+ */
+int faiss_SearchFuture_wait(FaissSearchFuture* future);
+
+/// wait for the searches if needed, then free the future
+void faiss_SearchFuture_free(FaissSearchFuture* future);
+
 /** query n vectors of dimension d to the index.
  *
  * return all vectors with distance < radius. Note that many
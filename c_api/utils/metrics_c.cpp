@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include "metrics_c.h"
+#include <faiss/utils/metrics.h>
+
+void faiss_metrics_set_enabled(int enabled) {
+    faiss::metrics_set_enabled(enabled != 0);
+}
+
+int faiss_metrics_is_enabled(void) {
+    return faiss::metrics_enabled() ? 1 : 0;
+}
+
+void faiss_metrics_reset(void) {
+    faiss::metrics_reset();
+}
+
+void faiss_metrics_scrape(FaissMetricsVisitor visitor, void* opaque) {
+    faiss::metrics_visit(
+            [&](const char* name, const char* labels, double value) {
+                visitor(name, labels, value, opaque);
+            });
+}
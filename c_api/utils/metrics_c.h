@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c -*-
+
+#ifndef FAISS_METRICS_C_H
+#define FAISS_METRICS_C_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************
+ * Process-wide search / add metrics (see faiss/utils/metrics.h)
+ *********************************************************/
+
+/// called once per sample by faiss_metrics_scrape. name is a Prometheus
+/// metric name, labels is empty or of the form le="0.001"
+typedef void (*FaissMetricsVisitor)(
+        const char* name,
+        const char* labels,
+        double value,
+        void* opaque);
+
+/// enable (1) or disable (0) the recording of the metrics
+void faiss_metrics_set_enabled(int enabled);
+
+/// whether the metrics are recorded
+int faiss_metrics_is_enabled(void);
+
+/// zero all metrics
+void faiss_metrics_reset(void);
+
+/// call visitor on all the samples of the metrics
+void faiss_metrics_scrape(FaissMetricsVisitor visitor, void* opaque);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
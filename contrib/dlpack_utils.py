@@ -0,0 +1,262 @@
+# Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""
+Zero-copy interoperability between Faiss indexes and any array library that
+supports the DLPack protocol (pytorch, cupy, jax, numpy >= 1.22...).
+
+The arrays are accessed through their DLPack capsule: the pointer to their
+data is passed to the C++ index, without conversion to numpy and without a
+copy. The inputs and the caller-provided outputs must be C-contiguous.
+
+For a GPU index, the work is enqueued on the CUDA stream given by the
+caller (eg. torch.cuda.current_stream().cuda_stream or
+cupy.cuda.get_current_stream().ptr), so that the results are written to
+device arrays in order with the caller's other work on that stream, without
+host synchronization. The producers of the arrays order their pending work
+before this stream, as specified by the DLPack protocol.
+
+    from faiss.contrib import dlpack_utils
+    dlpack_utils.search(gpu_index, xq, k, D=D, I=I, stream=stream)
+"""
+
+import contextlib
+import ctypes
+import sys
+
+import faiss
+import numpy as np
+
+##################################################################
+# DLPack structures (dlpack.h, unversioned ABI)
+##################################################################
+
+
+class DLDevice(ctypes.Structure):
+    _fields_ = [("device_type", ctypes.c_int), ("device_id", ctypes.c_int)]
+
+
+class DLDataType(ctypes.Structure):
+    _fields_ = [
+        ("code", ctypes.c_uint8),
+        ("bits", ctypes.c_uint8),
+        ("lanes", ctypes.c_uint16),
+    ]
+
+
+class DLTensor(ctypes.Structure):
+    _fields_ = [
+        ("data", ctypes.c_void_p),
+        ("device", DLDevice),
+        ("ndim", ctypes.c_int),
+        ("dtype", DLDataType),
+        ("shape", ctypes.POINTER(ctypes.c_int64)),
+        ("strides", ctypes.POINTER(ctypes.c_int64)),
+        ("byte_offset", ctypes.c_uint64),
+    ]
+
+
+class DLManagedTensor(ctypes.Structure):
+    pass
+
+
+DLManagedTensor._fields_ = [
+    ("dl_tensor", DLTensor),
+    ("manager_ctx", ctypes.c_void_p),
+    ("deleter", ctypes.CFUNCTYPE(None, ctypes.POINTER(DLManagedTensor))),
+]
+
+kDLCPU = 1
+kDLCUDA = 2
+kDLCUDAHost = 3
+kDLROCM = 10
+kDLROCMHost = 11
+kDLCUDAManaged = 13
+
+_device_types = (kDLCUDA, kDLROCM)
+_host_types = (kDLCPU, kDLCUDAHost, kDLROCMHost, kDLCUDAManaged)
+
+# (DLDataTypeCode, bits)
+_dtypes = {
+    "float32": (2, 32),
+    "int64": (0, 64),
+    "uint8": (1, 8),
+}
+
+_PyCapsule_GetPointer = ctypes.pythonapi.PyCapsule_GetPointer
+_PyCapsule_GetPointer.restype = ctypes.c_void_p
+_PyCapsule_GetPointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+
+_PyCapsule_SetName = ctypes.pythonapi.PyCapsule_SetName
+_PyCapsule_SetName.restype = ctypes.c_int
+_PyCapsule_SetName.argtypes = [ctypes.py_object, ctypes.c_char_p]
+
+# the capsule keeps a pointer to its name: it must outlive it
+_USED_DLTENSOR = b"used_dltensor"
+
+
+class DLPackTensor:
+    """ Zero-copy view of an array that supports the DLPack protocol.
+    The capsule is consumed: the memory of the array is held until release()
+    is called (or the view is collected). """
+
+    def __init__(self, x, stream=None):
+        self.obj = x
+        device_type, device_id = x.__dlpack_device__()
+        if device_type in _device_types:
+            # None / 0 = the legacy default stream (1 in DLPack)
+            capsule = x.__dlpack__(stream=stream or 1)
+        else:
+            capsule = x.__dlpack__()
+        ptr = _PyCapsule_GetPointer(capsule, b"dltensor")
+        self.managed = ctypes.cast(ptr, ctypes.POINTER(DLManagedTensor))
+        # from now on, the deleter is called by release()
+        _PyCapsule_SetName(capsule, _USED_DLTENSOR)
+
+        t = self.managed.contents.dl_tensor
+        self.device_type = t.device.device_type
+        self.device_id = t.device.device_id
+        self.shape = tuple(t.shape[i] for i in range(t.ndim))
+        self.dtype = (t.dtype.code, t.dtype.bits, t.dtype.lanes)
+        self.ptr = (t.data or 0) + t.byte_offset
+        if t.strides:
+            expected = 1
+            for i in reversed(range(t.ndim)):
+                if self.shape[i] != 1 and t.strides[i] != expected:
+                    self.release()
+                    raise ValueError(
+                        "zero-copy access needs a C-contiguous array")
+                expected *= self.shape[i]
+
+    @property
+    def is_device(self):
+        return self.device_type in _device_types
+
+    def check(self, dtype, shape, name):
+        assert self.dtype == _dtypes[dtype] + (1, ), \
+            "%s: expected dtype %s, got DLPack dtype %s" % (
+                name, dtype, self.dtype)
+        assert self.shape == tuple(shape), \
+            "%s: expected shape %s, got %s" % (name, shape, self.shape)
+
+    def release(self):
+        if self.managed is not None:
+            deleter = self.managed.contents.deleter
+            if deleter:
+                deleter(self.managed)
+            self.managed = None
+            self.obj = None
+
+    def __del__(self):
+        self.release()
+
+
+##################################################################
+# utilities
+##################################################################
+
+def _is_gpu_index(index):
+    return hasattr(index, 'getDevice')
+
+
+def _empty_like(x, shape, dtype):
+    """ array of the same library and device as x """
+    if type(x) is np.ndarray:
+        return np.empty(shape, dtype=dtype)
+    if hasattr(x, "new_empty"):
+        # pytorch
+        torch = sys.modules["torch"]
+        return x.new_empty(shape, dtype=getattr(torch, dtype))
+    if hasattr(x, "__array_namespace__"):
+        xp = x.__array_namespace__()
+        return xp.empty(shape, dtype=getattr(xp, dtype), device=x.device)
+    raise TypeError(
+        "cannot allocate an output like %s, pass it explicitly" % type(x))
+
+
+@contextlib.contextmanager
+def _views(index, stream, arrays):
+    """ DLPack views of the arrays, checked against the index device. For a
+    GPU index, the index runs on stream within the context. """
+    views = []
+    try:
+        for x in arrays:
+            views.append(DLPackTensor(x, stream))
+        for v in views:
+            if v.is_device:
+                assert _is_gpu_index(index), \
+                    'GPU tensor on CPU index not allowed'
+                assert v.device_id == index.getDevice(), \
+                    'tensor on device %d, index on device %d' % (
+                        v.device_id, index.getDevice())
+            else:
+                assert v.device_type in _host_types, \
+                    'unsupported DLPack device type %d' % v.device_type
+        if _is_gpu_index(index):
+            res = index.getResources()
+            device = index.getDevice()
+            prior_stream = res.getDefaultStream(device)
+            res.setDefaultStream(
+                device, faiss.cast_integer_to_cudastream_t(stream or 0))
+            try:
+                yield views
+            finally:
+                res.setDefaultStream(device, prior_stream)
+        else:
+            yield views
+    finally:
+        for v in views:
+            v.release()
+
+
+##################################################################
+# Index methods
+##################################################################
+
+def add(index, x, stream=None):
+    """ index.add(x) for a DLPack array x of size (n, d) """
+    n = len(x)
+    with _views(index, stream, [x]) as (xv, ):
+        xv.check("float32", (n, index.d), "x")
+        index.add_c(n, faiss.cast_integer_to_float_ptr(xv.ptr))
+
+
+def search(index, x, k, D=None, I=None, stream=None, params=None):
+    """ index.search(x, k) for a DLPack array x of size (n, d). The results
+    are written to D (float32) and I (int64) of size (n, k), allocated on
+    the device of x if not provided. """
+    n = len(x)
+    if D is None:
+        D = _empty_like(x, (n, k), "float32")
+    if I is None:
+        I = _empty_like(x, (n, k), "int64")
+    with _views(index, stream, [x, D, I]) as (xv, Dv, Iv):
+        xv.check("float32", (n, index.d), "x")
+        Dv.check("float32", (n, k), "D")
+        Iv.check("int64", (n, k), "I")
+        index.search_c(
+            n, faiss.cast_integer_to_float_ptr(xv.ptr), k,
+            faiss.cast_integer_to_float_ptr(Dv.ptr),
+            faiss.cast_integer_to_idx_t_ptr(Iv.ptr),
+            params
+        )
+    return D, I
+
+
+def reconstruct_batch(index, keys, x=None, stream=None):
+    """ index.reconstruct_batch(keys) for a DLPack array of int64 keys. The
+    vectors are written to x of size (n, d), allocated on the device of keys
+    if not provided. """
+    n = len(keys)
+    if x is None:
+        x = _empty_like(keys, (n, index.d), "float32")
+    with _views(index, stream, [keys, x]) as (kv, xv):
+        kv.check("int64", (n, ), "keys")
+        xv.check("float32", (n, index.d), "x")
+        index.reconstruct_batch_c(
+            n, faiss.cast_integer_to_idx_t_ptr(kv.ptr),
+            faiss.cast_integer_to_float_ptr(xv.ptr)
+        )
+    return x
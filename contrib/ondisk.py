@@ -51,7 +51,9 @@ def merge_ondisk(
         ivf_vector.push_back(ivf)
 
     LOG.info("merge %d inverted lists " % ivf_vector.size())
-    ntotal = invlists.merge_from_multiple(ivf_vector.data(), ivf_vector.size(), shift_ids)
+    ntotal = invlists.merge_from_multiple_streaming(
+        ivf_vector.data(), ivf_vector.size(), shift_ids
+    )
 
     # now replace the inverted lists in the output index
     index.ntotal = index_ivf.ntotal = ntotal
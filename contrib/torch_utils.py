@@ -370,6 +370,35 @@ def handle_torch_Index(the_class):
 
         return x
 
+    def torch_replacement_reconstruct_batch(self, key, x=None):
+        if type(key) is np.ndarray:
+            # Forward to faiss __init__.py base method
+            return self.reconstruct_batch_numpy(key, x)
+
+        assert type(key) is torch.Tensor
+        (n, ) = key.shape
+        key = key.contiguous()
+        key_ptr = swig_ptr_from_IndicesTensor(key)
+
+        if x is None:
+            x = torch.empty(n, self.d, device=key.device, dtype=torch.float32)
+        else:
+            assert type(x) is torch.Tensor
+            assert x.shape == (n, self.d)
+        x_ptr = swig_ptr_from_FloatTensor(x)
+
+        if x.is_cuda:
+            assert hasattr(self, 'getDevice'), 'GPU tensor on CPU index not allowed'
+
+            # On the GPU, use proper stream ordering
+            with using_stream(self.getResources()):
+                self.reconstruct_batch_c(n, key_ptr, x_ptr)
+        else:
+            # CPU torch
+            self.reconstruct_batch_c(n, key_ptr, x_ptr)
+
+        return x
+
     def torch_replacement_reconstruct_n(self, n0=0, ni=-1, x=None):
         if ni == -1:
             ni = self.ntotal
@@ -525,6 +554,8 @@ def handle_torch_Index(the_class):
     torch_replace_method(the_class, 'remove_ids', torch_replacement_remove_ids)
     torch_replace_method(the_class, 'reconstruct', torch_replacement_reconstruct)
     torch_replace_method(the_class, 'reconstruct_n', torch_replacement_reconstruct_n)
+    torch_replace_method(the_class, 'reconstruct_batch',
+                         torch_replacement_reconstruct_batch)
     torch_replace_method(the_class, 'range_search', torch_replacement_range_search)
     torch_replace_method(the_class, 'update_vectors', torch_replacement_update_vectors,
                          ignore_missing=True)
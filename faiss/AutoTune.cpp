@@ -13,6 +13,7 @@
 
 #include <faiss/AutoTune.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <cmath>
 
@@ -255,7 +256,9 @@ ParameterSpace::ParameterSpace()
           n_experiments(500),
           batchsize(1 << 30),
           thread_over_batches(false),
-          min_test_duration(0) {}
+          min_test_duration(0),
+          cost(COST_TIME),
+          latency_budget(0) {}
 
 /* not keeping this constructor as inheritors will call the parent
    initialize()
@@ -400,11 +403,30 @@ void ParameterSpace::initialize(const Index* index) {
             pr.values.push_back(1 << i);
         }
     }
-    if (dynamic_cast<const IndexHNSW*>(index)) {
+    if (DC(IndexHNSW)) {
         ParameterRange& pr = add_range("efSearch");
         for (int i = 2; i <= 9; i++) {
             pr.values.push_back(1 << i);
         }
+        if (ix->is_recompute) {
+            // fewer, larger round trips to the embedding server
+            ParameterRange& pr_beam = add_range("beam_size");
+            for (int i = 0; i <= 3; i++) {
+                pr_beam.values.push_back(1 << i);
+            }
+            ParameterRange& pr_batch = add_range("batch_size");
+            pr_batch.values.push_back(0);
+            for (int i = 4; i <= 6; i++) {
+                pr_batch.values.push_back(1 << i);
+            }
+        }
+        if (ix->hnsw.pruning_pq || ix->hnsw.pq_data_loader) {
+            // from the most to the least pruned
+            ParameterRange& pr_ratio = add_range("pq_pruning_ratio");
+            pr_ratio.values = {0.9, 0.75, 0.5, 0.25, 0};
+            add_range("local_prune").values = {0, 1};
+            add_range("send_neigh_times_ratio").values = {0, 1};
+        }
     }
 }
 
@@ -561,6 +583,38 @@ void ParameterSpace::set_index_parameter(
         }
     }
 
+    // defaults of the corresponding SearchParametersHNSW fields
+    if (name == "beam_size") {
+        if (DC(IndexHNSW)) {
+            ix->hnsw.beam_size = int(val);
+            return;
+        }
+    }
+    if (name == "batch_size") {
+        if (DC(IndexHNSW)) {
+            ix->hnsw.batch_size = int(val);
+            return;
+        }
+    }
+    if (name == "pq_pruning_ratio") {
+        if (DC(IndexHNSW)) {
+            ix->hnsw.pq_pruning_ratio = val;
+            return;
+        }
+    }
+    if (name == "local_prune") {
+        if (DC(IndexHNSW)) {
+            ix->hnsw.local_prune = val != 0;
+            return;
+        }
+    }
+    if (name == "send_neigh_times_ratio") {
+        if (DC(IndexHNSW)) {
+            ix->hnsw.send_neigh_times_ratio = val;
+            return;
+        }
+    }
+
     if (name.find("quantizer_") == 0) {
         if (DC(IndexIVF)) {
             std::string sub_name = name.substr(strlen("quantizer_"));
@@ -619,22 +673,62 @@ void ParameterSpace::explore(
 
     size_t n_comb = n_combinations();
 
+    // search all queries and return the cost if it is not the time
+    auto search_cost = [&](float* D, idx_t* I) {
+        size_t k = crit.nnn;
+        if (cost == COST_P99) {
+            std::vector<double> latencies(nq);
+            for (size_t q = 0; q < nq; q++) {
+                double t0 = getmillisecs();
+                index->search(1, xq + q * index->d, k, D + q * k, I + q * k);
+                latencies[q] = (getmillisecs() - t0) / 1e3;
+            }
+            size_t i = std::min(nq - 1, size_t(0.99 * nq));
+            std::nth_element(
+                    latencies.begin(), latencies.begin() + i, latencies.end());
+            return latencies[i];
+        }
+        hnsw_stats.reset();
+        index->search(nq, xq, k, D, I);
+        size_t n = cost == COST_NDIS ? hnsw_stats.ndis : hnsw_stats.nfetch;
+        return n / double(nq);
+    };
+
+    auto over_budget = [&](double t) {
+        return cost == COST_P99 && latency_budget > 0 && t > latency_budget;
+    };
+
     if (n_experiments == 0) {
         for (size_t cno = 0; cno < n_comb; cno++) {
             set_index_parameters(index, cno);
             std::vector<idx_t> I(nq * crit.nnn);
             std::vector<float> D(nq * crit.nnn);
 
-            double t0 = getmillisecs();
-            index->search(nq, xq, crit.nnn, D.data(), I.data());
-            double t_search = (getmillisecs() - t0) / 1e3;
+            double t_search;
+            if (cost == COST_TIME) {
+                double t0 = getmillisecs();
+                index->search(nq, xq, crit.nnn, D.data(), I.data());
+                t_search = (getmillisecs() - t0) / 1e3;
+            } else {
+                t_search = search_cost(D.data(), I.data());
+            }
+
+            if (over_budget(t_search)) {
+                if (verbose)
+                    printf("  %zd/%zd: %s t=%.3g over budget\n",
+                           cno,
+                           n_comb,
+                           combination_name(cno).c_str(),
+                           t_search);
+                continue;
+            }
 
             double perf = crit.evaluate(D.data(), I.data());
 
             bool keep = ops->add(perf, t_search, combination_name(cno), cno);
 
             if (verbose)
-                printf("  %zd/%zd: %s perf=%.3f t=%.3f s %s\n",
+                printf("  %zd/%zd: %s perf=%.3f t=%.3g %s\n",
                        cno,
                        n_comb,
                        combination_name(cno).c_str(),
@@ -699,39 +793,49 @@ void ParameterSpace::explore(
         int nrun = 0;
         double t_search;
 
-        do {
-            if (thread_over_batches) {
+        if (cost != COST_TIME) {
+            t_search = search_cost(D.data(), I.data());
+            nrun = 1;
+            if (over_budget(t_search)) {
+                if (verbose)
+                    printf(" t %.3g over budget\n", t_search);
+                continue;
+            }
+        } else {
+            do {
+                if (thread_over_batches) {
 #pragma omp parallel for
-                for (idx_t q0 = 0; q0 < nq; q0 += batchsize) {
-                    size_t q1 = q0 + batchsize;
-                    if (q1 > nq)
-                        q1 = nq;
-                    index->search(
-                            q1 - q0,
-                            xq + q0 * index->d,
-                            crit.nnn,
-                            D.data() + q0 * crit.nnn,
-                            I.data() + q0 * crit.nnn);
-                }
-            } else {
-                for (size_t q0 = 0; q0 < nq; q0 += batchsize) {
-                    size_t q1 = q0 + batchsize;
-                    if (q1 > nq)
-                        q1 = nq;
-                    index->search(
-                            q1 - q0,
-                            xq + q0 * index->d,
-                            crit.nnn,
-                            D.data() + q0 * crit.nnn,
-                            I.data() + q0 * crit.nnn);
+                    for (idx_t q0 = 0; q0 < nq; q0 += batchsize) {
+                        size_t q1 = q0 + batchsize;
+                        if (q1 > nq)
+                            q1 = nq;
+                        index->search(
+                                q1 - q0,
+                                xq + q0 * index->d,
+                                crit.nnn,
+                                D.data() + q0 * crit.nnn,
+                                I.data() + q0 * crit.nnn);
+                    }
+                } else {
+                    for (size_t q0 = 0; q0 < nq; q0 += batchsize) {
+                        size_t q1 = q0 + batchsize;
+                        if (q1 > nq)
+                            q1 = nq;
+                        index->search(
+                                q1 - q0,
+                                xq + q0 * index->d,
+                                crit.nnn,
+                                D.data() + q0 * crit.nnn,
+                                I.data() + q0 * crit.nnn);
+                    }
                 }
-            }
-            nrun++;
-            t_search = (getmillisecs() - t0) / 1e3;
+                nrun++;
+                t_search = (getmillisecs() - t0) / 1e3;
 
-        } while (t_search < min_test_duration);
+            } while (t_search < min_test_duration);
 
-        t_search /= nrun;
+            t_search /= nrun;
+        }
 
         double perf = crit.evaluate(D.data(), I.data());
 
@@ -151,6 +151,19 @@ struct ParameterSpace {
     /// duration (to avoid jittering in MT mode)
     double min_test_duration;
 
+    /// cost that explore() minimizes for a given performance
+    enum ExploreCost {
+        COST_TIME,    ///< wall-clock time of the batch search (s)
+        COST_NDIS,    ///< HNSW distance computations per query
+        COST_FETCHES, ///< HNSW neighbors fetched per query (recompute mode)
+        COST_P99,     ///< 99th percentile of the single-query latency (s)
+    };
+    ExploreCost cost;
+
+    /// with COST_P99, configurations whose p99 latency exceeds this budget
+    /// (in s) are not added to the operating points (0 = no budget)
+    double latency_budget;
+
     ParameterSpace();
 
     /// nb of combinations, = product of values sizes
@@ -191,7 +204,8 @@ struct ParameterSpace {
             double* upper_bound_perf,
             double* lower_bound_t) const;
 
-    /** explore operating points
+    /** explore operating points. The t of the operating points is the
+     * cost selected by the cost field.
      * @param index   index to run on
      * @param xq      query vectors (size nq * index.d)
      * @param crit    selection criterion
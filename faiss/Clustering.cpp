@@ -11,6 +11,7 @@
 #include <faiss/VectorTransform.h>
 #include <faiss/impl/AuxIndexStructures.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cinttypes>
 #include <cmath>
@@ -20,9 +21,11 @@
 #include <omp.h>
 
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/kmeans1d.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/executor.h>
 #include <faiss/utils/random.h>
 #include <faiss/utils/utils.h>
 
@@ -49,6 +52,10 @@ void Clustering::train(
         const float* x_in,
         Index& index,
         const float* weights) {
+    if (hierarchical_nc1 > 0) {
+        train_hierarchical(nx, x_in, index, weights);
+        return;
+    }
     train_encoded(
             nx,
             reinterpret_cast<const uint8_t*>(x_in),
@@ -150,11 +157,8 @@ void compute_centroids(
 
     size_t line_size = codec ? codec->sa_code_size() : d * sizeof(float);
 
-#pragma omp parallel
-    {
-        int nt = omp_get_num_threads();
-        int rank = omp_get_thread_num();
-
+    int nt = parallel_workers(k);
+    parallel_run(nt, [&](int rank) {
         // this thread is taking care of centroids c0:c1
         size_t c0 = (k * rank) / nt;
         size_t c1 = (k * (rank + 1)) / nt;
@@ -188,19 +192,22 @@ void compute_centroids(
                 }
             }
         }
-    }
-
-#pragma omp parallel for
-    for (idx_t ci = 0; ci < k; ci++) {
-        if (hassign[ci] == 0) {
-            continue;
-        }
-        float norm = 1 / hassign[ci];
-        float* c = centroids + ci * d;
-        for (size_t j = 0; j < d; j++) {
-            c[j] *= norm;
-        }
-    }
+    });
+
+    parallel_for(
+            nt,
+            k,
+            [&](int, size_t ci) {
+                if (hassign[ci] == 0) {
+                    return;
+                }
+                float norm = 1 / hassign[ci];
+                float* c = centroids + ci * d;
+                for (size_t j = 0; j < d; j++) {
+                    c[j] *= norm;
+                }
+            },
+            64);
 }
 
 // a bit above machine epsilon for float16
@@ -262,6 +269,105 @@ int split_clusters(
     return nsplit;
 }
 
+/** Balanced assignment: choose for each point the one of its kb nearest
+ * centroids with the best distance penalized by the size of the centroid's
+ * cluster at the previous iteration.
+ *
+ * @param dis_kb       distances to the kb nearest centroids, size n * kb
+ * @param assign_kb    kb nearest centroids, size n * kb
+ * @param hassign      previous cluster sizes, size k
+ * @param dis          output distance to the chosen centroid, size n
+ * @param assign       output chosen centroid, size n
+ */
+void balance_assign(
+        size_t n,
+        size_t k,
+        size_t kb,
+        bool is_similarity,
+        float penalty,
+        const float* dis_kb,
+        const idx_t* assign_kb,
+        const float* hassign,
+        float* dis,
+        idx_t* assign) {
+    double sum_dis = 0, sum_size = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum_dis += std::fabs(dis_kb[i * kb]);
+    }
+    for (size_t c = 0; c < k; c++) {
+        sum_size += hassign[c];
+    }
+    // penalty per point in a cluster, so that an average size cluster
+    // costs penalty * mean distance
+    float unit = penalty * (sum_dis / n) / (sum_size / k);
+    if (is_similarity) {
+        unit = -unit;
+    }
+
+#pragma omp parallel for if (n > 1000)
+    for (int64_t i = 0; i < n; i++) {
+        size_t best = 0;
+        float best_cost = 0;
+        for (size_t j = 0; j < kb; j++) {
+            idx_t c = assign_kb[i * kb + j];
+            if (c < 0) {
+                break;
+            }
+            float cost = dis_kb[i * kb + j] + unit * hassign[c];
+            if (j == 0 ||
+                (is_similarity ? cost > best_cost : cost < best_cost)) {
+                best = j;
+                best_cost = cost;
+            }
+        }
+        dis[i] = dis_kb[i * kb + best];
+        assign[i] = assign_kb[i * kb + best];
+    }
+}
+
+/** fraction of the sampled points for which the approximate nearest
+ * centroid (first of the kb results) is at the exact nearest distance
+ *
+ * @param xsample   sampled points, size nsample * d
+ * @param isample   their indices in the training set, size nsample
+ * @param dis_kb    approximate search results of the training set,
+ *                  size n * kb
+ */
+float assign_recall(
+        size_t d,
+        size_t k,
+        size_t nsample,
+        bool is_similarity,
+        const float* xsample,
+        const idx_t* isample,
+        const float* centroids,
+        const float* dis_kb,
+        const idx_t* assign_kb,
+        size_t kb) {
+    if (nsample == 0) {
+        return 1;
+    }
+    std::vector<float> D(nsample);
+    std::vector<idx_t> I(nsample);
+    if (is_similarity) {
+        knn_inner_product(
+                xsample, centroids, d, nsample, k, 1, D.data(), I.data());
+    } else {
+        knn_L2sqr(xsample, centroids, d, nsample, k, 1, D.data(), I.data());
+    }
+    size_t nok = 0;
+    for (size_t j = 0; j < nsample; j++) {
+        idx_t i = isample[j];
+        float dis = dis_kb[i * kb];
+        // ties are counted as correct
+        float tol = 1e-5 * std::max(std::fabs(D[j]), 1.0f);
+        if (assign_kb[i * kb] == I[j] || std::fabs(dis - D[j]) <= tol) {
+            nok++;
+        }
+    }
+    return nok / float(nsample);
+}
+
 } // namespace
 
 void Clustering::train_encoded(
@@ -401,6 +507,35 @@ void Clustering::train_encoded(
     // temporary buffer to decode vectors during the optimization
     std::vector<float> decode_buffer(codec ? d * decode_block_size : 0);
 
+    // for the balanced assignment, search kb candidate centroids
+    size_t kb = balance_penalty > 0 ? std::min(size_t(balance_k), k) : 1;
+    std::unique_ptr<idx_t[]> assign_kb;
+    std::unique_ptr<float[]> dis_kb;
+    if (kb > 1) {
+        assign_kb.reset(new idx_t[nx * kb]);
+        dis_kb.reset(new float[nx * kb]);
+    }
+    float* search_dis = kb > 1 ? dis_kb.get() : dis.get();
+    idx_t* search_assign = kb > 1 ? assign_kb.get() : assign.get();
+
+    // approximate assignment with an HNSW graph on the centroids
+    bool approx = approx_assign_min_k > 0 && k >= approx_assign_min_k;
+    std::unique_ptr<IndexHNSWFlat> hnsw;
+    if (approx) {
+        hnsw.reset(new IndexHNSWFlat(d, approx_hnsw_M, index.metric_type));
+        hnsw->hnsw.efSearch = approx_efSearch;
+        if (verbose) {
+            printf("  Approximate assignment with HNSW M=%d efSearch=%d\n",
+                   approx_hnsw_M,
+                   approx_efSearch);
+        }
+    }
+    Index& assign_index = approx ? *hnsw : index;
+    size_t nsample =
+            approx ? std::min(size_t(approx_recall_sample), size_t(nx)) : 0;
+    std::vector<float> xsample(nsample * d);
+    std::vector<idx_t> isample(nsample);
+
     for (int redo = 0; redo < nredo; redo++) {
         if (verbose && nredo > 1) {
             printf("Outer iteration %d / %d\n", redo, nredo);
@@ -426,29 +561,50 @@ void Clustering::train_encoded(
 
         // prepare the index
 
-        if (index.ntotal != 0) {
-            index.reset();
-        }
+        if (approx) {
+            hnsw->reset();
+            hnsw->add(k, centroids.data());
 
-        if (!index.is_trained) {
-            index.train(k, centroids.data());
-        }
+            // sample of points to measure the recall, distinct from the
+            // initial centroids if possible
+            for (size_t j = 0; j < nsample; j++) {
+                isample[j] = perm[nx - 1 - j];
+                if (!codec) {
+                    memcpy(&xsample[j * d],
+                           x + isample[j] * line_size,
+                           line_size);
+                } else {
+                    codec->sa_decode(
+                            1, x + isample[j] * line_size, &xsample[j * d]);
+                }
+            }
+        } else {
+            if (index.ntotal != 0) {
+                index.reset();
+            }
 
-        index.add(k, centroids.data());
+            if (!index.is_trained) {
+                index.train(k, centroids.data());
+            }
+
+            index.add(k, centroids.data());
+        }
 
         // k-means iterations
 
         float obj = 0;
+        // cluster sizes of the previous iteration, for balance_assign
+        std::vector<float> prev_hassign;
         for (int i = 0; i < niter; i++) {
             double t0s = getmillisecs();
 
             if (!codec) {
-                index.search(
+                assign_index.search(
                         nx,
                         reinterpret_cast<const float*>(x),
-                        1,
-                        dis.get(),
-                        assign.get());
+                        kb,
+                        search_dis,
+                        search_assign);
             } else {
                 // search by blocks of decode_block_size vectors
                 size_t code_size = codec->sa_code_size();
@@ -459,18 +615,64 @@ void Clustering::train_encoded(
                     }
                     codec->sa_decode(
                             i1 - i0, x + code_size * i0, decode_buffer.data());
-                    index.search(
+                    assign_index.search(
                             i1 - i0,
                             decode_buffer.data(),
-                            1,
-                            dis.get() + i0,
-                            assign.get() + i0);
+                            kb,
+                            search_dis + i0 * kb,
+                            search_assign + i0 * kb);
+                }
+            }
+
+            if (kb > 1) {
+                if (prev_hassign.empty()) {
+                    // first iteration: plain assignment
+                    for (size_t j = 0; j < nx; j++) {
+                        dis[j] = dis_kb[j * kb];
+                        assign[j] = assign_kb[j * kb];
+                    }
+                } else {
+                    balance_assign(
+                            nx,
+                            k,
+                            kb,
+                            !lower_is_better,
+                            balance_penalty,
+                            dis_kb.get(),
+                            assign_kb.get(),
+                            prev_hassign.data(),
+                            dis.get(),
+                            assign.get());
                 }
             }
 
             InterruptCallback::check();
             t_search_tot += getmillisecs() - t0s;
 
+            float recall = -1;
+            if (approx) {
+                recall = assign_recall(
+                        d,
+                        k,
+                        nsample,
+                        !lower_is_better,
+                        xsample.data(),
+                        isample.data(),
+                        centroids.data(),
+                        search_dis,
+                        search_assign,
+                        kb);
+                if (recall < approx_min_recall &&
+                    hnsw->hnsw.efSearch < 4096) {
+                    hnsw->hnsw.efSearch *= 2;
+                    if (verbose) {
+                        printf("\n  recall %.3f, increase efSearch to %d\n",
+                               recall,
+                               hnsw->hnsw.efSearch);
+                    }
+                }
+            }
+
             // accumulate objective
             obj = 0;
             for (int j = 0; j < nx; j++) {
@@ -495,6 +697,16 @@ void Clustering::train_encoded(
 
             int nsplit = split_clusters(
                     d, k, nx, k_frozen, hassign.data(), centroids.data());
+            if (kb > 1) {
+                // smooth the sizes to avoid oscillations
+                if (prev_hassign.empty()) {
+                    prev_hassign = hassign;
+                } else {
+                    for (size_t c = 0; c < k; c++) {
+                        prev_hassign[c] = (prev_hassign[c] + hassign[c]) / 2;
+                    }
+                }
+            }
 
             // collect statistics
             ClusteringIterationStats stats = {
@@ -502,18 +714,23 @@ void Clustering::train_encoded(
                     (getmillisecs() - t0) / 1000.0,
                     t_search_tot / 1000,
                     imbalance_factor(nx, k, assign.get()),
-                    nsplit};
+                    nsplit,
+                    recall};
             iteration_stats.push_back(stats);
 
             if (verbose) {
                 printf("  Iteration %d (%.2f s, search %.2f s): "
-                       "objective=%g imbalance=%.3f nsplit=%d       \r",
+                       "objective=%g imbalance=%.3f nsplit=%d",
                        i,
                        stats.time,
                        stats.time_search,
                        stats.obj,
                        stats.imbalance_factor,
                        nsplit);
+                if (approx) {
+                    printf(" recall=%.3f", recall);
+                }
+                printf("       \r");
                 fflush(stdout);
             }
 
@@ -521,12 +738,26 @@ void Clustering::train_encoded(
 
             // add centroids to index for the next iteration (or for output)
 
-            index.reset();
-            if (update_index) {
-                index.train(k, centroids.data());
-            }
+            if (approx) {
+                if ((i + 1) % approx_rebuild_period == 0) {
+                    hnsw->reset();
+                    hnsw->add(k, centroids.data());
+                } else {
+                    // keep the graph, update the vectors
+                    IndexFlat* storage =
+                            dynamic_cast<IndexFlat*>(hnsw->storage);
+                    memcpy(storage->get_xb(),
+                           centroids.data(),
+                           sizeof(float) * d * k);
+                }
+            } else {
+                index.reset();
+                if (update_index) {
+                    index.train(k, centroids.data());
+                }
 
-            index.add(k, centroids.data());
+                index.add(k, centroids.data());
+            }
             InterruptCallback::check();
         }
 
@@ -548,11 +779,361 @@ void Clustering::train_encoded(
     if (nredo > 1) {
         centroids = best_centroids;
         iteration_stats = best_iteration_stats;
+    }
+    if (approx) {
+        // the user-supplied index was not used for the iterations
+        if (index.ntotal != 0) {
+            index.reset();
+        }
+        if (!index.is_trained || update_index) {
+            index.train(k, centroids.data());
+        }
+        index.add(k, centroids.data());
+    } else if (nredo > 1) {
         index.reset();
         index.add(k, best_centroids.data());
     }
 }
 
+/****************************************************************
+ * Mini-batch k-means
+ ****************************************************************/
+
+ArrayClusteringDataSource::ArrayClusteringDataSource(
+        size_t d,
+        size_t n,
+        const float* x)
+        : d(d), n(n), x(x) {}
+
+size_t ArrayClusteringDataSource::read(size_t nr, float* xr) {
+    nr = std::min(nr, n - pos);
+    memcpy(xr, x + pos * d, sizeof(float) * d * nr);
+    pos += nr;
+    return nr;
+}
+
+void ArrayClusteringDataSource::rewind() {
+    pos = 0;
+}
+
+void Clustering::train_minibatch(ClusteringDataSource& source, Index& index) {
+    FAISS_THROW_IF_NOT_FMT(
+            index.d == d,
+            "Index dimension %d not the same as data dimension %d",
+            int(index.d),
+            int(d));
+    FAISS_THROW_IF_NOT(minibatch_size > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            centroids.size() % d == 0,
+            "size of provided input centroids not a multiple of dimension");
+
+    double t0 = getmillisecs();
+    size_t n_input_centroids = std::min(centroids.size() / d, k);
+    size_t k_frozen = frozen_centroids ? n_input_centroids : 0;
+
+    std::vector<float> batch(minibatch_size * d);
+
+    auto read_batch = [&]() {
+        size_t nb = source.read(minibatch_size, batch.data());
+        if (check_input_data_for_NaNs) {
+            for (size_t i = 0; i < nb * d; i++) {
+                FAISS_THROW_IF_NOT_MSG(
+                        std::isfinite(batch[i]),
+                        "input contains NaN's or Inf's");
+            }
+        }
+        return nb;
+    };
+
+    // initialize the remaining centroids with the first vectors
+    source.rewind();
+    centroids.resize(k * d);
+    for (size_t i = n_input_centroids; i < k;) {
+        size_t nb = read_batch();
+        FAISS_THROW_IF_NOT_FMT(
+                nb > 0,
+                "Number of training points (%zd) should be at least "
+                "as large as number of clusters (%zd)",
+                i - n_input_centroids,
+                k);
+        nb = std::min(nb, k - i);
+        memcpy(&centroids[i * d], batch.data(), sizeof(float) * d * nb);
+        i += nb;
+    }
+    post_process_centroids();
+
+    if (verbose) {
+        printf("Mini-batch clustering in %zdD to %zd clusters, "
+               "%d passes, batches of %zd vectors\n",
+               d,
+               k,
+               minibatch_passes,
+               minibatch_size);
+    }
+
+    if (index.ntotal != 0) {
+        index.reset();
+    }
+    if (!index.is_trained) {
+        index.train(k, centroids.data());
+    }
+    index.add(k, centroids.data());
+
+    // nb of points assigned to each centroid since the beginning
+    std::vector<int64_t> counts(k);
+    std::vector<idx_t> assign(minibatch_size);
+    std::vector<float> dis(minibatch_size);
+    // (centroid, point) pairs of the batch, sorted by centroid
+    std::vector<std::pair<idx_t, idx_t>> order(minibatch_size);
+    std::vector<size_t> run_begin;
+    RandomGenerator rng(get_actual_rng_seed(seed));
+    double t_search_tot = 0;
+
+    for (int pass = 0; pass < minibatch_passes; pass++) {
+        std::vector<int64_t> hist(k);
+        float obj = 0;
+        size_t nb = 0, ntot = 0;
+        source.rewind();
+
+        while (true) {
+            size_t nb_read = read_batch();
+            if (nb_read == 0) {
+                break;
+            }
+            nb = nb_read;
+            ntot += nb;
+
+            double t0s = getmillisecs();
+            index.search(nb, batch.data(), 1, dis.data(), assign.data());
+            InterruptCallback::check();
+            t_search_tot += getmillisecs() - t0s;
+
+            for (size_t i = 0; i < nb; i++) {
+                obj += dis[i];
+                hist[assign[i]]++;
+                order[i] = {assign[i], idx_t(i)};
+            }
+            std::sort(order.begin(), order.begin() + nb);
+            run_begin.clear();
+            for (size_t i = 0; i < nb; i++) {
+                if (i == 0 || order[i].first != order[i - 1].first) {
+                    run_begin.push_back(i);
+                }
+            }
+            run_begin.push_back(nb);
+
+            // each centroid is updated by a single thread
+#pragma omp parallel for schedule(dynamic, 16)
+            for (int64_t r = 0; r < int64_t(run_begin.size()) - 1; r++) {
+                idx_t c = order[run_begin[r]].first;
+                if (size_t(c) < k_frozen) {
+                    continue;
+                }
+                float* cent = &centroids[c * d];
+                for (size_t i = run_begin[r]; i < run_begin[r + 1]; i++) {
+                    const float* xi = &batch[order[i].second * d];
+                    float eta = 1.0f / ++counts[c];
+                    for (size_t j = 0; j < d; j++) {
+                        cent[j] += eta * (xi[j] - cent[j]);
+                    }
+                }
+            }
+
+            index.reset();
+            if (update_index) {
+                index.train(k, centroids.data());
+            }
+            index.add(k, centroids.data());
+        }
+
+        FAISS_THROW_IF_NOT_MSG(ntot > 0, "empty clustering data source");
+
+        // reset the centroids without points to points of the last batch
+        int nsplit = 0;
+        for (size_t c = k_frozen; c < k; c++) {
+            if (hist[c] == 0) {
+                size_t i = rng.rand_int(nb);
+                memcpy(&centroids[c * d], &batch[i * d], sizeof(float) * d);
+                counts[c] = 0;
+                nsplit++;
+            }
+        }
+        post_process_centroids();
+
+        ClusteringIterationStats stats = {
+                obj,
+                (getmillisecs() - t0) / 1000.0,
+                t_search_tot / 1000,
+                imbalance_factor(k, hist.data()),
+                nsplit};
+        iteration_stats.push_back(stats);
+
+        if (verbose) {
+            printf("  Pass %d (%.2f s, search %.2f s): %zd points "
+                   "objective=%g imbalance=%.3f nreset=%d\n",
+                   pass,
+                   stats.time,
+                   stats.time_search,
+                   ntot,
+                   stats.obj,
+                   stats.imbalance_factor,
+                   nsplit);
+        }
+
+        index.reset();
+        if (update_index) {
+            index.train(k, centroids.data());
+        }
+        index.add(k, centroids.data());
+    }
+}
+
+/****************************************************************
+ * Hierarchical k-means
+ ****************************************************************/
+
+void Clustering::train_hierarchical(
+        idx_t n,
+        const float* x,
+        Index& index,
+        const float* weights) {
+    size_t nc1 = hierarchical_nc1;
+    FAISS_THROW_IF_NOT_FMT(
+            nc1 <= k,
+            "nb of first level clusters (%zd) larger than k (%zd)",
+            nc1,
+            k);
+    FAISS_THROW_IF_NOT_FMT(
+            n >= k,
+            "Number of training points (%" PRId64
+            ") should be at least "
+            "as large as number of clusters (%zd)",
+            n,
+            k);
+    FAISS_THROW_IF_NOT_MSG(
+            centroids.empty(),
+            "input centroids not supported by hierarchical clustering");
+    FAISS_THROW_IF_NOT_FMT(
+            index.d == d,
+            "Index dimension %d not the same as data dimension %d",
+            int(index.d),
+            int(d));
+
+    double t0 = getmillisecs();
+    ClusteringParameters cp = *this;
+    cp.hierarchical_nc1 = 0;
+    cp.verbose = false;
+
+    if (verbose) {
+        printf("2-level clustering of %" PRId64
+               " points in %zdD to %zd first level clusters, %zd total\n",
+               n,
+               d,
+               nc1,
+               k);
+    }
+
+    // first level
+    IndexFlat index1(d, index.metric_type);
+    Clustering clus1(d, nc1, cp);
+    clus1.train(n, x, index1, weights);
+    iteration_stats = clus1.iteration_stats;
+
+    std::vector<idx_t> assign1(n);
+    {
+        std::vector<float> dis1(n);
+        index1.search(n, x, 1, dis1.data(), assign1.data());
+    }
+
+    // sort the points by cluster
+    std::vector<size_t> lims(nc1 + 1);
+    for (idx_t i = 0; i < n; i++) {
+        lims[assign1[i] + 1]++;
+    }
+    for (size_t c = 0; c < nc1; c++) {
+        lims[c + 1] += lims[c];
+    }
+    std::vector<idx_t> perm(n);
+    {
+        std::vector<size_t> ofs(lims.begin(), lims.end() - 1);
+        for (idx_t i = 0; i < n; i++) {
+            perm[ofs[assign1[i]]++] = i;
+        }
+    }
+
+    if (verbose) {
+        size_t min_size = n, max_size = 0;
+        for (size_t c = 0; c < nc1; c++) {
+            min_size = std::min(min_size, lims[c + 1] - lims[c]);
+            max_size = std::max(max_size, lims[c + 1] - lims[c]);
+        }
+        printf("  first level in %.2f s, cluster sizes %zd-%zd\n",
+               (getmillisecs() - t0) / 1000.0,
+               min_size,
+               max_size);
+    }
+
+    // second level, with a nb of centroids proportional to the cluster size
+    centroids.resize(k * d);
+    std::vector<float> xsub, wsub;
+    size_t k0 = 0;
+    for (size_t c = 0; c < nc1; c++) {
+        size_t k1 = lims[c + 1] * k / n;
+        size_t nsub = lims[c + 1] - lims[c];
+        size_t ksub = k1 - k0;
+        if (ksub == 0) {
+            continue;
+        }
+        xsub.resize(nsub * d);
+        for (size_t i = 0; i < nsub; i++) {
+            memcpy(&xsub[i * d], x + perm[lims[c] + i] * d, sizeof(float) * d);
+        }
+        if (weights) {
+            wsub.resize(nsub);
+            for (size_t i = 0; i < nsub; i++) {
+                wsub[i] = weights[perm[lims[c] + i]];
+            }
+        }
+        Clustering clus2(d, ksub, cp);
+        if (seed >= 0) {
+            clus2.seed = seed + 1 + c;
+        }
+        IndexFlat index2(d, index.metric_type);
+        clus2.train(nsub, xsub.data(), index2, weights ? wsub.data() : nullptr);
+        memcpy(&centroids[k0 * d],
+               clus2.centroids.data(),
+               sizeof(float) * d * ksub);
+        iteration_stats.insert(
+                iteration_stats.end(),
+                clus2.iteration_stats.begin(),
+                clus2.iteration_stats.end());
+        k0 = k1;
+        if (verbose) {
+            printf("  [%.2f s] second level cluster %zd/%zd: "
+                   "%zd points to %zd centroids\r",
+                   (getmillisecs() - t0) / 1000.0,
+                   c,
+                   nc1,
+                   nsub,
+                   ksub);
+            fflush(stdout);
+        }
+        InterruptCallback::check();
+    }
+    FAISS_THROW_IF_NOT(k0 == k);
+    if (verbose) {
+        printf("\n");
+    }
+
+    if (index.ntotal != 0) {
+        index.reset();
+    }
+    if (!index.is_trained) {
+        index.train(k, centroids.data());
+    }
+    index.add(k, centroids.data());
+}
+
 Clustering1D::Clustering1D(int k) : Clustering(1, k) {}
 
 Clustering1D::Clustering1D(int k, const ClusteringParameters& cp)
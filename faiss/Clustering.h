@@ -57,6 +57,40 @@ struct ClusteringParameters {
     /// Whether to use splitmix64-based random number generator for subsampling,
     /// which is faster, but may pick duplicate points.
     bool use_faster_subsampling = false;
+
+    /// if > 0, train() runs a two-level k-means: the training set is
+    /// clustered into hierarchical_nc1 clusters, then each of them is
+    /// clustered into a nb of centroids proportional to its size
+    int hierarchical_nc1 = 0;
+
+    /// if > 0, balanced assignment: each training point is assigned to the
+    /// one of its balance_k nearest centroids that minimizes
+    /// dis + balance_penalty * mean_dis * size / (n / k), where size is the
+    /// (smoothed) nb of points of the centroid at the previous iterations.
+    /// Values around 0.1 - 0.3 reduce the imbalance, large values oscillate
+    float balance_penalty = 0;
+    int balance_k = 8;
+
+    /// if > 0 and k >= approx_assign_min_k, the assignment is done with an
+    /// HNSW index on the centroids instead of the index passed to train(),
+    /// which only receives the final centroids
+    int approx_assign_min_k = 0;
+    /// HNSW graph degree and initial efSearch for the approximate assignment
+    int approx_hnsw_M = 32;
+    int approx_efSearch = 64;
+    /// rebuild the graph every this many iterations, in between the
+    /// centroids are updated in place in the graph
+    int approx_rebuild_period = 5;
+    /// nb of training points for which the approximate assignment is
+    /// checked against the exact one at each iteration
+    int approx_recall_sample = 1000;
+    /// efSearch is doubled when the assignment recall is below this
+    float approx_min_recall = 0.95;
+
+    /// mini-batch k-means (train_minibatch): nb of vectors per batch
+    size_t minibatch_size = 1 << 16;
+    /// mini-batch k-means: nb of passes over the data source
+    int minibatch_passes = 1;
 };
 
 struct ClusteringIterationStats {
@@ -65,6 +99,38 @@ struct ClusteringIterationStats {
     double time_search;      ///< seconds for just search
     double imbalance_factor; ///< imbalance factor of iteration
     int nsplit;              ///< number of cluster splits
+    /// fraction of the sampled points assigned to their exact nearest
+    /// centroid, with approximate assignment (-1 = not measured)
+    float assign_recall = -1;
+};
+
+/** Source of training vectors for Clustering::train_minibatch, read by
+ * chunks so that the training set does not need to fit in RAM. The
+ * vectors are expected to be in random order.
+ */
+struct ClusteringDataSource {
+    /// copy up to n vectors to x (size n * d), return the nb of vectors
+    /// copied, 0 at the end of the data
+    virtual size_t read(size_t n, float* x) = 0;
+
+    /// restart from the first vector
+    virtual void rewind() = 0;
+
+    virtual ~ClusteringDataSource() {}
+};
+
+/// data source over an array of vectors in RAM
+struct ArrayClusteringDataSource : ClusteringDataSource {
+    size_t d;
+    size_t n;
+    const float* x; ///< size n * d, not owned
+    size_t pos = 0; ///< next vector to read
+
+    ArrayClusteringDataSource(size_t d, size_t n, const float* x);
+
+    size_t read(size_t n, float* x) override;
+
+    void rewind() override;
 };
 
 /** K-means clustering based on assignment - centroid update iterations
@@ -122,6 +188,32 @@ struct Clustering : ClusteringParameters {
             Index& index,
             const float* weights = nullptr);
 
+    /** two-level k-means, called by train() when hierarchical_nc1 > 0.
+     * The clusterings of both levels are done with flat indexes and
+     * iteration_stats contains the stats of all of them. Input centroids
+     * are not supported. */
+    void train_hierarchical(
+            idx_t n,
+            const float* x,
+            faiss::Index& index,
+            const float* x_weights = nullptr);
+
+    /** mini-batch k-means (Sculley, "Web-scale k-means clustering",
+     * WWW'10)
+     *
+     * The vectors are read from the source by batches of minibatch_size,
+     * minibatch_passes times. Each batch is assigned to the centroids and
+     * each centroid moves towards its points with a learning rate of
+     * 1 / (nb of points assigned to it so far), ie. it is the running mean
+     * of its points. The memory used is the batch and the centroids.
+     *
+     * The missing centroids are initialized with the first vectors of the
+     * source. The centroids that are not assigned any point during a pass
+     * are reset to random points of the last batch. There is one
+     * iteration_stats entry per pass, with the objective of the pass.
+     */
+    void train_minibatch(ClusteringDataSource& source, Index& index);
+
     /// Post-process the centroids after each centroid update.
     /// includes optional L2 normalization and nearest integer rounding
     void post_process_centroids();
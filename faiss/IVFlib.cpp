@@ -8,18 +8,28 @@
 #include <faiss/IVFlib.h>
 #include <omp.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <memory>
 #include <numeric>
 
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexIVFAdditiveQuantizer.h>
+#include <faiss/IndexIVFFlat.h>
 #include <faiss/IndexIVFIndependentQuantizer.h>
+#include <faiss/IndexIVFPQR.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexRefine.h>
+#include <faiss/IndexScalarQuantizer.h>
 #include <faiss/MetaIndexes.h>
 #include <faiss/clone_index.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/SearchEffortPredictor.h>
 #include <faiss/index_io.h>
+#include <faiss/invlists/DirectMap.h>
+#include <faiss/invlists/OnDiskInvertedLists.h>
 #include <faiss/utils/distances.h>
 #include <faiss/utils/hamming.h>
 #include <faiss/utils/utils.h>
@@ -238,7 +248,11 @@ void SlidingIndexWindow::step(const Index* sub_index, bool remove_oldest) {
         ils2 = dynamic_cast<const ArrayInvertedLists*>(
                 extract_index_ivf(sub_index)->invlists);
         FAISS_THROW_IF_NOT_MSG(ils2, "supports only ArrayInvertedLists");
+        FAISS_THROW_IF_NOT_MSG(
+                !ils2->has_compressed_ids(), "compressed ids not supported");
     }
+    FAISS_THROW_IF_NOT_MSG(
+            !ils->has_compressed_ids(), "compressed ids not supported");
     IndexIVF* index_ivf = extract_index_ivf(index);
 
     if (remove_oldest && ils2) {
@@ -542,6 +556,82 @@ void ivf_residual_add_from_flat_codes(
     index->ntotal += nb;
 }
 
+IndexIVFScalarQuantizer* ivf_flat_to_scalar_quantizer(
+        const IndexIVFFlat* index,
+        ScalarQuantizer::QuantizerType qtype,
+        bool by_residual) {
+    FAISS_THROW_IF_NOT(index->is_trained);
+    const InvertedLists* invlists = index->invlists;
+    FAISS_THROW_IF_NOT(invlists->code_size == sizeof(float) * index->d);
+    size_t d = index->d, nlist = index->nlist;
+
+    std::unique_ptr<IndexIVFScalarQuantizer> index_sq(
+            new IndexIVFScalarQuantizer(
+                    clone_index(index->quantizer),
+                    d,
+                    nlist,
+                    qtype,
+                    index->metric_type,
+                    by_residual));
+    index_sq->own_fields = true;
+    index_sq->nprobe = index->nprobe;
+    index_sq->max_codes = index->max_codes;
+    index_sq->parallel_mode = index->parallel_mode;
+
+    // train the scalar quantizer on a regular sample of the stored vectors
+    size_t ntotal = invlists->compute_ntotal();
+    size_t nsample = std::min(
+            ntotal, size_t(index_sq->train_encoder_num_vectors()));
+    size_t stride = nsample > 0 ? (ntotal + nsample - 1) / nsample : 1;
+    std::vector<float> xs;
+    std::vector<idx_t> assign;
+    for (size_t list_no = 0, ofs0 = 0; list_no < nlist; list_no++) {
+        size_t ls = invlists->list_size(list_no);
+        if (ls == 0) {
+            continue;
+        }
+        InvertedLists::ScopedCodes codes(invlists, list_no);
+        const float* xl = (const float*)codes.get();
+        // ofs0 is the first sample offset of the list
+        for (; ofs0 < ls; ofs0 += stride) {
+            xs.insert(xs.end(), xl + ofs0 * d, xl + (ofs0 + 1) * d);
+            assign.push_back(list_no);
+        }
+        ofs0 -= ls;
+    }
+    if (by_residual && !assign.empty()) {
+        std::vector<float> residuals(xs.size());
+        index_sq->quantizer->compute_residual_n(
+                assign.size(), xs.data(), residuals.data(), assign.data());
+        xs.swap(residuals);
+    }
+    index_sq->train_encoder(assign.size(), xs.data(), assign.data());
+    index_sq->is_trained = true;
+
+    // encode the lists
+    InvertedLists* invlists_sq = index_sq->invlists;
+#pragma omp parallel for schedule(dynamic)
+    for (idx_t list_no = 0; list_no < nlist; list_no++) {
+        size_t ls = invlists->list_size(list_no);
+        if (ls == 0) {
+            continue;
+        }
+        InvertedLists::ScopedCodes codes(invlists, list_no);
+        InvertedLists::ScopedIds ids(invlists, list_no);
+        std::vector<idx_t> list_nos(ls, list_no);
+        std::vector<uint8_t> codes_sq(ls * index_sq->code_size);
+        index_sq->encode_vectors(
+                ls,
+                (const float*)codes.get(),
+                list_nos.data(),
+                codes_sq.data());
+        invlists_sq->add_entries(list_no, ls, ids.get(), codes_sq.data());
+    }
+    index_sq->ntotal = index->ntotal;
+    index_sq->set_direct_map_type(index->direct_map.type);
+    return index_sq.release();
+}
+
 int64_t DefaultShardingFunction::operator()(int64_t i, int64_t shard_count) {
     return i % shard_count;
 }
@@ -732,5 +822,508 @@ void shard_binary_ivf_index_centroids(
             generate_ids);
 }
 
+size_t merge_ondisk(
+        Index* trained_index,
+        const std::vector<std::string>& shard_fnames,
+        const char* ivfdata_fname,
+        bool shift_ids,
+        size_t buffer_size) {
+    FAISS_THROW_IF_NOT_MSG(
+            !dynamic_cast<IndexIVFPQR*>(trained_index),
+            "IndexIVFPQR is not supported as an on disk index");
+    FAISS_THROW_IF_NOT_MSG(
+            trained_index->ntotal == 0, "works only on an empty index");
+    IndexIVF* index_ivf = extract_index_ivf(trained_index);
+
+    // the shard indexes own their mmapped inverted lists
+    std::vector<std::unique_ptr<Index>> shards;
+    std::vector<const InvertedLists*> ils;
+    for (const std::string& fname : shard_fnames) {
+        shards.emplace_back(read_index(fname.c_str(), IO_FLAG_MMAP));
+        const IndexIVF* shard_ivf = extract_index_ivf(shards.back().get());
+        FAISS_THROW_IF_NOT_FMT(
+                shard_ivf->nlist == index_ivf->nlist &&
+                        shard_ivf->code_size == index_ivf->code_size,
+                "shard %s is not compatible with the trained index",
+                fname.c_str());
+        ils.push_back(shard_ivf->invlists);
+    }
+
+    std::unique_ptr<OnDiskInvertedLists> invlists(new OnDiskInvertedLists(
+            index_ivf->nlist, index_ivf->code_size, ivfdata_fname));
+    size_t ntotal = invlists->merge_from_multiple_streaming(
+            ils.data(), ils.size(), shift_ids, buffer_size);
+
+    index_ivf->replace_invlists(invlists.release(), true);
+    index_ivf->ntotal = trained_index->ntotal = ntotal;
+    return ntotal;
+}
+
+TieredInvertedLists* tier_inverted_lists(
+        Index* index,
+        size_t hot_budget,
+        const char* cold_fname) {
+    IndexIVF* index_ivf = extract_index_ivf(index);
+    const InvertedLists* il = index_ivf->invlists;
+    std::unique_ptr<TieredInvertedLists> tiered(
+            new TieredInvertedLists(il, hot_budget));
+
+    if (cold_fname) {
+        // the cold lists by decreasing access count, the hot lists are
+        // empty in the cold tier
+        std::vector<idx_t> cold_lists;
+        for (size_t list_no = 0; list_no < il->nlist; list_no++) {
+            if (!tiered->is_hot(list_no)) {
+                cold_lists.push_back(list_no);
+            }
+        }
+        const std::vector<uint64_t>& counts = il->access_counts;
+        std::stable_sort(
+                cold_lists.begin(), cold_lists.end(), [&](idx_t a, idx_t b) {
+                    return counts[a] > counts[b];
+                });
+        OnDiskInvertedLists* ondisk =
+                new OnDiskInvertedLists(il->nlist, il->code_size, cold_fname);
+        tiered->cold = ondisk;
+        tiered->own_cold = true;
+        ondisk->merge_from_1_ordered(il, cold_lists.data(), cold_lists.size());
+    } else {
+        // the current inverted lists become the cold tier
+        tiered->own_cold = index_ivf->own_invlists;
+        index_ivf->own_invlists = false;
+    }
+
+    TieredInvertedLists* result = tiered.release();
+    index_ivf->replace_invlists(result, true);
+    return result;
+}
+
+RebalanceListsStats rebalance_lists(
+        Index* index,
+        const RebalanceListsParameters& params) {
+    IndexIVF* index_ivf = extract_index_ivf(index);
+    InvertedLists* invlists = index_ivf->invlists;
+    Index* quantizer = index_ivf->quantizer;
+    size_t nlist = index_ivf->nlist;
+    size_t d = index_ivf->d;
+    size_t code_size = index_ivf->code_size;
+    FAISS_THROW_IF_NOT(quantizer->ntotal == nlist);
+
+    RebalanceListsStats stats;
+    if (index_ivf->ntotal == 0) {
+        return stats;
+    }
+
+    // find the lists to split and the slots to reuse
+    double avg_size = index_ivf->ntotal / double(nlist);
+    std::vector<std::pair<size_t, idx_t>> big, small;
+    for (idx_t list_no = 0; list_no < nlist; list_no++) {
+        size_t list_size = invlists->list_size(list_no);
+        if (list_size > params.max_list_size_factor * avg_size &&
+            list_size >= 2) {
+            big.emplace_back(list_size, list_no);
+        } else if (list_size < params.min_list_size_factor * avg_size) {
+            small.emplace_back(list_size, list_no);
+        }
+    }
+    // largest lists are split first, smallest lists are merged first
+    std::sort(big.begin(), big.end(), std::greater<>());
+    std::sort(small.begin(), small.end());
+
+    size_t nsplit = std::min(big.size(), small.size());
+    if (params.max_nsplit > 0) {
+        nsplit = std::min(nsplit, params.max_nsplit);
+    }
+    if (nsplit == 0) {
+        return stats;
+    }
+
+    std::vector<float> centroids(nlist * d);
+    quantizer->reconstruct_n(0, nlist, centroids.data());
+
+    // collect and remove the contents of the affected lists
+    std::vector<idx_t> ids;
+    std::vector<idx_t> old_list_nos;
+    std::vector<float> x;
+
+    auto collect_list = [&](idx_t list_no) {
+        size_t list_size = invlists->list_size(list_no);
+        size_t n0 = ids.size();
+        ids.resize(n0 + list_size);
+        old_list_nos.resize(n0 + list_size, list_no);
+        x.resize((n0 + list_size) * d);
+        InvertedLists::ScopedIds sids(invlists, list_no);
+        for (size_t ofs = 0; ofs < list_size; ofs++) {
+            ids[n0 + ofs] = sids[ofs];
+        }
+#pragma omp parallel for if (list_size > 1000)
+        for (int64_t ofs = 0; ofs < list_size; ofs++) {
+            index_ivf->reconstruct_from_offset(
+                    list_no, ofs, x.data() + (n0 + ofs) * d);
+        }
+    };
+
+    for (size_t s = 0; s < nsplit; s++) {
+        idx_t list_big = big[s].second;
+        idx_t list_small = small[s].second;
+
+        size_t i0 = ids.size();
+        collect_list(list_big);
+        size_t i1 = ids.size();
+        collect_list(list_small);
+
+        // split the big list in 2
+        Clustering clus(d, 2, params.cp);
+        IndexFlatL2 assign_index(d);
+        clus.train(i1 - i0, x.data() + i0 * d, assign_index);
+        memcpy(centroids.data() + list_big * d,
+               clus.centroids.data(),
+               sizeof(float) * d);
+        memcpy(centroids.data() + list_small * d,
+               clus.centroids.data() + d,
+               sizeof(float) * d);
+
+        invlists->resize(list_big, 0);
+        invlists->resize(list_small, 0);
+    }
+
+    quantizer->reset();
+    quantizer->add(nlist, centroids.data());
+    if (auto index_ivfpq = dynamic_cast<IndexIVFPQ*>(index_ivf)) {
+        if (index_ivfpq->use_precomputed_table) {
+            index_ivfpq->precompute_table();
+        }
+    }
+
+    // reassign and re-encode the collected vectors
+    size_t n = ids.size();
+    std::vector<idx_t> list_nos(n);
+    quantizer->assign(n, x.data(), list_nos.data());
+    std::vector<uint8_t> codes(n * code_size);
+    index_ivf->encode_vectors(n, x.data(), list_nos.data(), codes.data());
+
+    DirectMap& direct_map = index_ivf->direct_map;
+    for (size_t i = 0; i < n; i++) {
+        size_t ofs = invlists->add_entry(
+                list_nos[i], ids[i], codes.data() + i * code_size);
+        direct_map.update_single_id(ids[i], list_nos[i], ofs);
+        if (list_nos[i] != old_list_nos[i]) {
+            stats.nmoved++;
+        }
+    }
+
+    stats.nsplit = nsplit;
+    stats.nreassign = n;
+    return stats;
+}
+
+SearchEffortPredictor train_ivf_nprobe_predictor(
+        const Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float target_recall,
+        size_t max_nprobe,
+        int nfeatures,
+        const IVFSearchParameters* params) {
+    FAISS_THROW_IF_NOT(n > 0 && k > 0);
+    FAISS_THROW_IF_NOT(target_recall > 0 && target_recall <= 1);
+    const float* prev_x = x;
+    std::unique_ptr<const float[]> del;
+    if (auto ip = dynamic_cast<const IndexPreTransform*>(index)) {
+        x = ip->apply_chain(n, x);
+        if (x != prev_x) {
+            del.reset(x);
+        }
+        index = ip->index;
+    }
+    const IndexIVF* index_ivf = dynamic_cast<const IndexIVF*>(index);
+    FAISS_THROW_IF_NOT_MSG(index_ivf, "expected an IndexIVF");
+    max_nprobe = std::min(max_nprobe, index_ivf->nlist);
+    FAISS_THROW_IF_NOT_MSG(
+            nfeatures >= 0 && nfeatures < max_nprobe,
+            "nfeatures should be less than max_nprobe");
+
+    SearchParametersIVF search_params;
+    if (params) {
+        search_params = *params;
+    }
+    search_params.nprobe = max_nprobe;
+    search_params.nprobe_predictor = nullptr;
+
+    std::vector<idx_t> keys(n * max_nprobe);
+    std::vector<float> coarse_dis(n * max_nprobe);
+    index_ivf->quantizer->search(
+            n,
+            x,
+            max_nprobe,
+            coarse_dis.data(),
+            keys.data(),
+            search_params.quantizer_params);
+
+    // the results as (list, offset) pairs, to find the probe that each of
+    // them comes from
+    std::vector<idx_t> I(n * k);
+    std::vector<float> D(n * k);
+    index_ivf->search_preassigned(
+            n,
+            x,
+            k,
+            keys.data(),
+            coarse_dis.data(),
+            D.data(),
+            I.data(),
+            true,
+            &search_params);
+
+    std::vector<float> features(n * nfeatures), efforts(n);
+#pragma omp parallel for
+    for (idx_t q = 0; q < n; q++) {
+        const idx_t* keys_q = keys.data() + q * max_nprobe;
+        std::vector<size_t> ranks;
+        for (idx_t j = 0; j < k; j++) {
+            idx_t lo = I[q * k + j];
+            if (lo < 0) {
+                continue;
+            }
+            idx_t list_no = lo_listno(lo);
+            size_t rank = std::find(keys_q, keys_q + max_nprobe, list_no) -
+                    keys_q;
+            ranks.push_back(rank);
+        }
+        size_t needed = 1;
+        if (!ranks.empty()) {
+            std::sort(ranks.begin(), ranks.end());
+            size_t nfound = std::max(
+                    (size_t)std::ceil(target_recall * ranks.size()), (size_t)1);
+            needed = ranks[nfound - 1] + 1;
+        }
+        efforts[q] = needed;
+        SearchEffortPredictor::ivf_features(
+                nfeatures,
+                keys_q,
+                coarse_dis.data() + q * max_nprobe,
+                features.data() + q * nfeatures);
+    }
+
+    SearchEffortPredictor predictor(nfeatures);
+    predictor.train(n, features.data(), efforts.data());
+    predictor.max_effort = max_nprobe;
+    return predictor;
+}
+
+/*************************************************************
+ * Shared coarse quantization
+ *************************************************************/
+
+CoarseAssignmentCache::CoarseAssignmentCache(
+        const Index* quantizer,
+        size_t capacity)
+        : quantizer(quantizer), capacity(capacity) {}
+
+const CoarseAssignmentCache::Entry* CoarseAssignmentCache::lookup(
+        uint64_t hash,
+        const float* x,
+        idx_t nprobe) {
+    auto range = map.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& e = *it->second;
+        if (e.keys.size() >= nprobe &&
+            memcmp(e.x.data(), x, sizeof(float) * quantizer->d) == 0) {
+            lru.splice(lru.begin(), lru, it->second);
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+void CoarseAssignmentCache::assign(
+        idx_t n,
+        const float* x,
+        idx_t nprobe,
+        float* coarse_dis,
+        idx_t* keys,
+        const SearchParameters* quantizer_params) {
+    size_t d = quantizer->d;
+    if (capacity == 0) {
+        quantizer->search(n, x, nprobe, coarse_dis, keys, quantizer_params);
+        n_misses += n;
+        return;
+    }
+    std::vector<uint64_t> hashes(n);
+#pragma omp parallel for if (n > 1000)
+    for (idx_t i = 0; i < n; i++) {
+        hashes[i] = hash_bytes((const uint8_t*)(x + i * d), sizeof(float) * d);
+    }
+
+    std::vector<idx_t> missing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (idx_t i = 0; i < n; i++) {
+            const Entry* e = lookup(hashes[i], x + i * d, nprobe);
+            if (e) {
+                memcpy(coarse_dis + i * nprobe,
+                       e->coarse_dis.data(),
+                       sizeof(float) * nprobe);
+                memcpy(keys + i * nprobe,
+                       e->keys.data(),
+                       sizeof(idx_t) * nprobe);
+            } else {
+                missing.push_back(i);
+            }
+        }
+    }
+    n_hits += n - missing.size();
+    n_misses += missing.size();
+    if (missing.empty()) {
+        return;
+    }
+
+    // quantize the missing queries in one batch
+    size_t nm = missing.size();
+    std::vector<float> xm(nm * d);
+    for (size_t j = 0; j < nm; j++) {
+        memcpy(xm.data() + j * d, x + missing[j] * d, sizeof(float) * d);
+    }
+    std::vector<float> dis_m(nm * nprobe);
+    std::vector<idx_t> keys_m(nm * nprobe);
+    quantizer->search(
+            nm,
+            xm.data(),
+            nprobe,
+            dis_m.data(),
+            keys_m.data(),
+            quantizer_params);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t j = 0; j < nm; j++) {
+        idx_t i = missing[j];
+        const float* dis_j = dis_m.data() + j * nprobe;
+        const idx_t* keys_j = keys_m.data() + j * nprobe;
+        memcpy(coarse_dis + i * nprobe, dis_j, sizeof(float) * nprobe);
+        memcpy(keys + i * nprobe, keys_j, sizeof(idx_t) * nprobe);
+        // the query may be repeated in the batch or added by another thread
+        if (lookup(hashes[i], x + i * d, nprobe)) {
+            continue;
+        }
+        lru.push_front(Entry{
+                hashes[i],
+                std::vector<float>(x + i * d, x + (i + 1) * d),
+                std::vector<float>(dis_j, dis_j + nprobe),
+                std::vector<idx_t>(keys_j, keys_j + nprobe)});
+        map.emplace(hashes[i], lru.begin());
+        while (lru.size() > capacity) {
+            auto last = std::prev(lru.end());
+            auto range = map.equal_range(last->hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == last) {
+                    map.erase(it);
+                    break;
+                }
+            }
+            lru.pop_back();
+        }
+    }
+}
+
+size_t CoarseAssignmentCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+}
+
+void CoarseAssignmentCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    map.clear();
+}
+
+void search_preassigned_multi(
+        size_t nindex,
+        const IndexIVF* const* indexes,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const IVFSearchParameters* params,
+        CoarseAssignmentCache* cache) {
+    FAISS_THROW_IF_NOT(nindex > 0 && k > 0);
+    const IndexIVF* ivf0 = indexes[0];
+    std::vector<idx_t> nprobes(nindex);
+    idx_t max_nprobe = 0;
+    for (size_t i = 0; i < nindex; i++) {
+        const IndexIVF* ivf = indexes[i];
+        FAISS_THROW_IF_NOT_MSG(
+                ivf->d == ivf0->d && ivf->nlist == ivf0->nlist,
+                "the indexes do not have the same coarse quantizer");
+        FAISS_THROW_IF_NOT_MSG(
+                ivf->n_spill == 0, "spilled lists are not supported");
+        idx_t nprobe = params ? params->nprobe : ivf->nprobe;
+        nprobes[i] = std::min((idx_t)ivf->nlist, nprobe);
+        max_nprobe = std::max(max_nprobe, nprobes[i]);
+    }
+    FAISS_THROW_IF_NOT(max_nprobe > 0);
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<float> coarse_dis(n * max_nprobe);
+    std::vector<idx_t> keys(n * max_nprobe);
+    const SearchParameters* quantizer_params =
+            params ? params->quantizer_params : nullptr;
+    if (cache) {
+        FAISS_THROW_IF_NOT(cache->quantizer->d == ivf0->d);
+        cache->assign(
+                n,
+                x,
+                max_nprobe,
+                coarse_dis.data(),
+                keys.data(),
+                quantizer_params);
+    } else {
+        ivf0->quantizer->search(
+                n,
+                x,
+                max_nprobe,
+                coarse_dis.data(),
+                keys.data(),
+                quantizer_params);
+    }
+
+    std::vector<float> coarse_dis_i;
+    std::vector<idx_t> keys_i;
+    for (size_t i = 0; i < nindex; i++) {
+        idx_t nprobe = nprobes[i];
+        const float* dis_i = coarse_dis.data();
+        const idx_t* ki = keys.data();
+        if (nprobe != max_nprobe) {
+            // the nprobe first centroids of each query
+            coarse_dis_i.resize(n * nprobe);
+            keys_i.resize(n * nprobe);
+            for (idx_t q = 0; q < n; q++) {
+                memcpy(coarse_dis_i.data() + q * nprobe,
+                       coarse_dis.data() + q * max_nprobe,
+                       sizeof(float) * nprobe);
+                memcpy(keys_i.data() + q * nprobe,
+                       keys.data() + q * max_nprobe,
+                       sizeof(idx_t) * nprobe);
+            }
+            dis_i = coarse_dis_i.data();
+            ki = keys_i.data();
+        }
+        indexes[i]->invlists->prefetch_lists(ki, n * nprobe);
+        indexes[i]->search_preassigned(
+                n,
+                x,
+                k,
+                ki,
+                dis_i,
+                distances + i * n * k,
+                labels + i * n * k,
+                false,
+                params);
+    }
+}
+
 } // namespace ivflib
 } // namespace faiss
@@ -16,11 +16,20 @@
 
 #include <faiss/IndexBinaryIVF.h>
 #include <faiss/IndexIVF.h>
+#include <faiss/impl/ScalarQuantizer.h>
+#include <faiss/impl/SearchEffortPredictor.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace faiss {
 
+struct IndexIVFFlat;
 struct IndexIVFResidualQuantizer;
+struct IndexIVFScalarQuantizer;
 struct IndexResidualQuantizer;
 struct ResidualQuantizer;
 
@@ -168,6 +177,25 @@ void ivf_residual_add_from_flat_codes(
         const uint8_t* codes,
         int64_t code_size = -1);
 
+/** Compress the inverted lists of an IndexIVFFlat, that stores the
+ * vectors in float32, into an IndexIVFScalarQuantizer with the same
+ * coarse quantizer (copied), lists, ids and direct map type.
+ *
+ * With QT_fp16 or QT_bf16 and by_residual, the residuals to the centroid
+ * are stored in 16 bits: half the memory and bandwidth of the scan, with
+ * a negligible loss of accuracy since the residuals have a much smaller
+ * dynamic range than the vectors. The scan decodes the codes on the fly
+ * with the SIMD scalar quantizer kernels. The quantizer types that need
+ * training are trained on a sample of the stored vectors.
+ *
+ * The lists are encoded one at a time from the stored vectors, without
+ * re-assignment, so the source index can be freed afterwards.
+ */
+IndexIVFScalarQuantizer* ivf_flat_to_scalar_quantizer(
+        const IndexIVFFlat* index,
+        ScalarQuantizer::QuantizerType qtype = ScalarQuantizer::QT_fp16,
+        bool by_residual = true);
+
 struct ShardingFunction {
     virtual int64_t operator()(int64_t i, int64_t shard_count) = 0;
     virtual ~ShardingFunction() = default;
@@ -209,6 +237,174 @@ void shard_binary_ivf_index_centroids(
         ShardingFunction* sharding_function = nullptr,
         bool generate_ids = false);
 
+/** Fill the empty trained_index with the contents of the IVF indexes
+ * stored in shard_fnames (same as contrib/ondisk.py). The shards are read
+ * with IO_FLAG_MMAP, so their total size can exceed the RAM. The merged
+ * inverted lists are written sequentially to an OnDiskInvertedLists
+ * stored in ivfdata_fname, with at most buffer_size bytes in memory.
+ *
+ * @param shift_ids  translate the ids of each shard so that they follow
+ *                   the ones of the previous shards
+ * @return           the total number of vectors
+ */
+size_t merge_ondisk(
+        Index* trained_index,
+        const std::vector<std::string>& shard_fnames,
+        const char* ivfdata_fname,
+        bool shift_ids = false,
+        size_t buffer_size = size_t(1) << 28);
+
+/** Reorder the storage of the inverted lists of an IVF index by access
+ * frequency, counted by the searches after
+ * invlists->enable_access_counts(). The most accessed lists that fit in
+ * hot_budget bytes are packed contiguously in memory, see
+ * TieredInvertedLists. If cold_fname is set, the other lists are written
+ * to an mmapped OnDiskInvertedLists stored in this file, by decreasing
+ * access count, otherwise they stay in the current inverted lists. The
+ * result is not serializable.
+ *
+ * @return  the new inverted lists of the index, owned by it
+ */
+TieredInvertedLists* tier_inverted_lists(
+        Index* index,
+        size_t hot_budget,
+        const char* cold_fname = nullptr);
+
+/// parameters of rebalance_lists
+struct RebalanceListsParameters {
+    /// lists larger than this factor times the average list size are split
+    float max_list_size_factor = 4;
+    /// lists smaller than this factor times the average list size are
+    /// merged into their neighbors, which frees their slot for a split
+    float min_list_size_factor = 0.25;
+    /// max nb of lists to split in one call (0 = no limit)
+    size_t max_nsplit = 0;
+    /// k-means parameters for the split of a list in 2
+    ClusteringParameters cp;
+};
+
+/// statistics returned by rebalance_lists
+struct RebalanceListsStats {
+    size_t nsplit = 0;    ///< nb of lists split (= nb of lists merged)
+    size_t nreassign = 0; ///< nb of vectors that were re-encoded
+    size_t nmoved = 0;    ///< nb of vectors that changed list
+};
+
+/** Rebalance the inverted lists of an IVF index in place, without a
+ * full rebuild, eg. when the data distribution drifted after training.
+ *
+ * The oversized lists are split in 2 with a local k-means over their
+ * contents. To keep nlist constant, each split is paired with the merge of
+ * an empty or tiny list: its vectors are reassigned to the nearest
+ * centroids, and its slot receives one of the 2 new centroids. The
+ * coarse quantizer (which must support reconstruct_n, reset and add),
+ * the direct map and the precomputed tables of IndexIVFPQ are updated.
+ * The vectors of the affected lists are reconstructed with
+ * reconstruct_from_offset and re-encoded for their new list, all other
+ * lists are left untouched.
+ *
+ * The index must not be searched concurrently. Call repeatedly to split
+ * lists that are still oversized after one call.
+ */
+RebalanceListsStats rebalance_lists(
+        Index* index,
+        const RebalanceListsParameters& params = RebalanceListsParameters());
+
+/** Train a query-adaptive nprobe predictor (set in
+ * SearchParametersIVF::nprobe_predictor) on a set of training queries. The
+ * target of a query is the smallest nprobe whose lists contain
+ * target_recall of the k results of the search with max_nprobe.
+ *
+ * @param index      an IndexIVF, possibly embedded in an IndexPreTransform
+ * @param nfeatures  nb of coarse distance gaps used as features (<
+ *                   max_nprobe)
+ * @param params     search parameters the predictor is valid for, its
+ *                   nprobe is ignored
+ */
+SearchEffortPredictor train_ivf_nprobe_predictor(
+        const Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float target_recall,
+        size_t max_nprobe,
+        int nfeatures = 4,
+        const IVFSearchParameters* params = nullptr);
+
+/** Coarse assignments of queries, to search several IVF indexes that share
+ * the same coarse quantizer (eg. different codecs or tenants) with a single
+ * quantizer->search per query batch, see search_preassigned_multi.
+ *
+ * With capacity > 0, the assignments of the last capacity distinct queries
+ * are kept in an LRU cache keyed by a hash of the query vector, so that
+ * repeated queries are not quantized again. An entry computed with a
+ * larger nprobe is reused for a smaller one. The cached assignments are
+ * only valid for the current centroids and quantizer_params: call clear()
+ * when they change. Thread-safe.
+ */
+struct CoarseAssignmentCache {
+    const Index* quantizer; ///< not owned
+    size_t capacity;
+
+    /// statistics
+    std::atomic<size_t> n_hits{0};
+    std::atomic<size_t> n_misses{0};
+
+    explicit CoarseAssignmentCache(
+            const Index* quantizer,
+            size_t capacity = 0);
+
+    /** assign the n queries x to their nprobe nearest centroids
+     * @param coarse_dis  output distances, size n * nprobe
+     * @param keys        output centroid ids, size n * nprobe */
+    void assign(
+            idx_t n,
+            const float* x,
+            idx_t nprobe,
+            float* coarse_dis,
+            idx_t* keys,
+            const SearchParameters* quantizer_params = nullptr);
+
+    /// nb of queries in the cache
+    size_t size() const;
+
+    void clear();
+
+   private:
+    struct Entry {
+        uint64_t hash;
+        std::vector<float> x;
+        std::vector<float> coarse_dis;
+        std::vector<idx_t> keys;
+    };
+    mutable std::mutex mutex;
+    std::list<Entry> lru; ///< most recently used first
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> map;
+
+    /// returns nullptr if not found, moves the entry to the front
+    const Entry* lookup(uint64_t hash, const float* x, idx_t nprobe);
+};
+
+/** Search several IVF indexes that have the same coarse quantizer
+ * (same d, nlist and centroids) with one coarse quantization of the
+ * queries, performed by cache (or by the quantizer of indexes[0] if
+ * nullptr). The indexes must be IndexIVFs, not wrapped in a transform. The
+ * nprobe of each index is params->nprobe if set, otherwise its own.
+ *
+ * @param distances  output distances, size nindex * n * k
+ * @param labels     output labels, size nindex * n * k
+ */
+void search_preassigned_multi(
+        size_t nindex,
+        const IndexIVF* const* indexes,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const IVFSearchParameters* params = nullptr,
+        CoarseAssignmentCache* cache = nullptr);
+
 } // namespace ivflib
 } // namespace faiss
 
@@ -12,9 +12,13 @@
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/DistanceComputer.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/bf16.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/fp16.h>
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 namespace faiss {
 
@@ -38,6 +42,12 @@ void Index::assign(idx_t n, const float* x, idx_t* labels, idx_t k) const {
     search(n, x, k, distances.data(), labels);
 }
 
+SearchIterator* Index::search_iterator(
+        const float* /* x */,
+        const SearchParameters* /* params */) const {
+    FAISS_THROW_MSG("search_iterator not implemented for this type of index");
+}
+
 void Index::add_with_ids(
         idx_t /*n*/,
         const float* /*x*/,
@@ -45,6 +55,92 @@ void Index::add_with_ids(
     FAISS_THROW_MSG("add_with_ids not implemented for this type of index");
 }
 
+size_t get_numeric_type_size(NumericType numeric_type) {
+    switch (numeric_type) {
+        case Float32:
+            return 4;
+        case Float16:
+        case BFloat16:
+            return 2;
+        default:
+            FAISS_THROW_FMT("unknown numeric type %d", int(numeric_type));
+    }
+}
+
+void numeric_type_to_float(
+        NumericType numeric_type,
+        size_t n,
+        const void* x,
+        float* out) {
+    const uint16_t* x16 = (const uint16_t*)x;
+    switch (numeric_type) {
+        case Float32:
+            memcpy(out, x, n * sizeof(float));
+            break;
+        case Float16:
+#pragma omp parallel for if (n > 100000)
+            for (int64_t i = 0; i < int64_t(n); i++) {
+                out[i] = decode_fp16(x16[i]);
+            }
+            break;
+        case BFloat16:
+#pragma omp parallel for if (n > 100000)
+            for (int64_t i = 0; i < int64_t(n); i++) {
+                out[i] = decode_bf16(x16[i]);
+            }
+            break;
+        default:
+            FAISS_THROW_FMT("unknown numeric type %d", int(numeric_type));
+    }
+}
+
+void Index::train_ex(idx_t n, const void* x, NumericType numeric_type) {
+    if (numeric_type == Float32) {
+        train(n, (const float*)x);
+        return;
+    }
+    std::vector<float> xf(n * d);
+    numeric_type_to_float(numeric_type, n * d, x, xf.data());
+    train(n, xf.data());
+}
+
+void Index::add_ex(idx_t n, const void* x, NumericType numeric_type) {
+    if (numeric_type == Float32) {
+        add(n, (const float*)x);
+        return;
+    }
+    // convert by blocks, the float32 copy of the whole batch may be large
+    const idx_t bs = 32768;
+    size_t elt_size = get_numeric_type_size(numeric_type);
+    std::vector<float> xf(std::min(n, bs) * d);
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(n, i0 + bs);
+        numeric_type_to_float(
+                numeric_type,
+                (i1 - i0) * d,
+                (const uint8_t*)x + i0 * d * elt_size,
+                xf.data());
+        add(i1 - i0, xf.data());
+    }
+}
+
+void Index::search_ex(
+        idx_t n,
+        const void* x,
+        NumericType numeric_type,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    if (numeric_type == Float32) {
+        search(n, (const float*)x, k, distances, labels, params);
+        return;
+    }
+    std::vector<float> xf(n * d);
+    numeric_type_to_float(numeric_type, n * d, x, xf.data());
+    search(n, xf.data(), k, distances, labels, params);
+}
+
 size_t Index::remove_ids(const IDSelector& /*sel*/) {
     FAISS_THROW_MSG("remove_ids not implemented for this type of index");
     return -1;
@@ -138,6 +234,10 @@ void Index::add_sa_codes(idx_t, const uint8_t*, const idx_t*) {
     FAISS_THROW_MSG("add_sa_codes not implemented for this type of index");
 }
 
+size_t Index::warmup(const WarmupPolicy&) const {
+    return 0;
+}
+
 namespace {
 
 // storage that explicitly reconstructs vectors before computing distances
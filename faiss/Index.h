@@ -55,6 +55,7 @@ namespace faiss {
 struct IDSelector;
 struct RangeSearchResult;
 struct DistanceComputer;
+struct SearchBudget;
 
 /** Parent class for the optional search paramenters.
  *
@@ -64,15 +65,75 @@ struct DistanceComputer;
 struct SearchParameters {
     /// if non-null, only these IDs will be considered during search.
     IDSelector* sel = nullptr;
+    /// if non-null, limits on the work per query, supported by IndexIVF,
+    /// IndexHNSW and IndexRefine
+    const SearchBudget* budget = nullptr;
     /// make sure we can dynamic_cast this
     virtual ~SearchParameters() {}
 };
 
+/** What Index::warmup loads. Sub-classes add the settings of specific
+ * index types.
+ */
+struct WarmupPolicy {
+    /// warm all the data, not only the structures that most queries read
+    bool all = false;
+    /// IVF: nb of inverted lists to warm, the most accessed first if the
+    /// access counts are enabled (see InvertedLists::enable_access_counts),
+    /// otherwise the largest
+    size_t n_hot_lists = 0;
+    /// HNSW: nodes known to be visited often (eg. saved from
+    /// HNSWVisitProfiler::top_ids), their neighbor lists, vectors and
+    /// cached embeddings are warmed
+    const idx_t* hot_ids = nullptr;
+    size_t n_hot_ids = 0;
+
+    virtual ~WarmupPolicy() {}
+};
+
+/** Resumable k-NN search of a single query, see Index::search_iterator.
+ *
+ * Each call to next() returns the results that follow the ones already
+ * returned, so that fetching the next page of results costs only the
+ * incremental work, instead of a new search with a larger k.
+ */
+struct SearchIterator {
+    /** get the next results, sorted by increasing distance (decreasing
+     * similarity for inner product) within the batch
+     *
+     * @param k           max number of results to return
+     * @param distances   output distances, size k
+     * @param labels      output labels, size k
+     * @return number of results returned, < k once the search is exhausted
+     */
+    virtual size_t next(idx_t k, float* distances, idx_t* labels) = 0;
+
+    virtual ~SearchIterator() {}
+};
+
+/// type of the vector components passed to Index::add_ex and search_ex
+enum NumericType {
+    Float32 = 0,
+    Float16 = 1,  ///< IEEE half precision, stored as uint16_t
+    BFloat16 = 2, ///< bfloat16, stored as uint16_t
+};
+
+/// size in bytes of a vector component of type numeric_type
+size_t get_numeric_type_size(NumericType numeric_type);
+
+/// convert n components of type numeric_type to float32
+void numeric_type_to_float(
+        NumericType numeric_type,
+        size_t n,
+        const void* x,
+        float* out);
+
 /** Abstract structure for an index, supports adding vectors and searching
  * them.
  *
- * All vectors provided at add or search time are 32-bit float arrays,
- * although the internal representation may vary.
+ * The vectors provided at add or search time are 32-bit float arrays
+ * (or fp16 / bf16 arrays for the *_ex variants), although the internal
+ * representation may vary.
  */
 struct Index {
     using component_t = float;
@@ -128,6 +189,24 @@ struct Index {
      */
     virtual void add_with_ids(idx_t n, const float* x, const idx_t* xids);
 
+    /** Same as train, add and search, for vectors whose components are of
+     * type numeric_type (size n * d). The default implementations convert
+     * the vectors to float32 (by blocks for add). Indexes that store the
+     * vectors in that type copy them directly.
+     */
+    virtual void train_ex(idx_t n, const void* x, NumericType numeric_type);
+
+    virtual void add_ex(idx_t n, const void* x, NumericType numeric_type);
+
+    virtual void search_ex(
+            idx_t n,
+            const void* x,
+            NumericType numeric_type,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const;
+
     /** query n vectors of dimension d to the index.
      *
      * return at most k vectors. If there are not enough results for a
@@ -177,6 +256,18 @@ struct Index {
     virtual void assign(idx_t n, const float* x, idx_t* labels, idx_t k = 1)
             const;
 
+    /** start a resumable search of the query x (size d). Not supported by
+     * all indexes.
+     *
+     * The iterator refers to the index, that must not be modified while
+     * the iterator is in use. The caller owns the returned object.
+     *
+     * @param x           input vector to search, size d
+     */
+    virtual SearchIterator* search_iterator(
+            const float* x,
+            const SearchParameters* params = nullptr) const;
+
     /// removes all elements from the database.
     virtual void reset() = 0;
 
@@ -314,6 +405,16 @@ struct Index {
      * @param xids   corresponding ids, size n
      */
     virtual void add_sa_codes(idx_t n, const uint8_t* codes, const idx_t* xids);
+
+    /** Bring the data that the searches read into memory before serving
+     * traffic, to avoid the page faults of the first queries on mmap-ed
+     * (IO_FLAG_MMAP_IFC) or on-disk data: the pages are prefetched with
+     * madvise(MADV_WILLNEED) and touched by several threads, which also
+     * primes the caches. The default implementation does nothing.
+     *
+     * @return nb of bytes warmed
+     */
+    virtual size_t warmup(const WarmupPolicy& policy = WarmupPolicy()) const;
 };
 
 } // namespace faiss
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexAdaptiveQuantizer.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexPQFastScan.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+IndexAdaptiveQuantizer::IndexAdaptiveQuantizer(idx_t d, MetricType metric)
+        : IndexFlat(d, metric) {}
+
+void IndexAdaptiveQuantizer::add(idx_t n, const float* x) {
+    IndexFlat::add(n, x);
+    build_accel();
+}
+
+void IndexAdaptiveQuantizer::reset() {
+    IndexFlat::reset();
+    delete accel;
+    accel = nullptr;
+}
+
+void IndexAdaptiveQuantizer::build_accel() {
+    delete accel;
+    accel = nullptr;
+
+    AccelType type = accel_type;
+    if (type == ACCEL_AUTO) {
+        type = ntotal < min_accel_size ? ACCEL_NONE
+                : ntotal < hnsw_min_size ? ACCEL_PQ_FASTSCAN
+                                         : ACCEL_HNSW;
+    }
+    if (type == ACCEL_NONE || ntotal == 0) {
+        return;
+    }
+
+    double t0 = getmillisecs();
+    if (type == ACCEL_HNSW) {
+        std::unique_ptr<IndexHNSWFlat> index(
+                new IndexHNSWFlat(d, hnsw_M, metric_type));
+        index->add(ntotal, get_xb());
+        accel = index.release();
+    } else if (type == ACCEL_PQ_FASTSCAN) {
+        FAISS_THROW_IF_NOT(pq_dsub > 0);
+        int dsub = d % pq_dsub == 0 ? pq_dsub : 1;
+        std::unique_ptr<IndexPQFastScan> index(
+                new IndexPQFastScan(d, d / dsub, 4, metric_type));
+        index->train(ntotal, get_xb());
+        index->add(ntotal, get_xb());
+        accel = index.release();
+    } else {
+        FAISS_THROW_FMT("accel_type %d not supported", int(type));
+    }
+    if (verbose) {
+        printf("IndexAdaptiveQuantizer: built %s on %" PRId64
+               " centroids in %.3f s\n",
+               type == ACCEL_HNSW ? "HNSW" : "fast-scan PQ",
+               ntotal,
+               (getmillisecs() - t0) / 1000);
+    }
+}
+
+namespace {
+
+template <class C>
+void recheck_candidates(
+        const IndexAdaptiveQuantizer& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        idx_t kc,
+        const idx_t* cand_ids,
+        float* distances,
+        idx_t* labels) {
+    const float* xb = index.get_xb();
+    size_t d = index.d;
+#pragma omp parallel if (n > 1)
+    {
+        std::vector<float> cand_dis(kc);
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            const float* xi = x + i * d;
+            const idx_t* idsi = cand_ids + i * kc;
+            for (idx_t j = 0; j < kc; j++) {
+                idx_t id = idsi[j];
+                if (id < 0) {
+                    cand_dis[j] = C::neutral();
+                } else if (index.metric_type == METRIC_INNER_PRODUCT) {
+                    cand_dis[j] = fvec_inner_product(xi, xb + id * d, d);
+                } else {
+                    cand_dis[j] = fvec_L2sqr(xi, xb + id * d, d);
+                }
+            }
+            float* disi = distances + i * k;
+            idx_t* labi = labels + i * k;
+            idx_t k0 = std::min(k, kc);
+            heap_heapify<C>(k, disi, labi, cand_dis.data(), idsi, k0);
+            if (kc > k0) {
+                heap_addn<C>(
+                        k,
+                        disi,
+                        labi,
+                        cand_dis.data() + k0,
+                        idsi + k0,
+                        kc - k0);
+            }
+            heap_reorder<C>(k, disi, labi);
+        }
+    }
+}
+
+} // namespace
+
+void IndexAdaptiveQuantizer::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    if (!accel || (params && params->sel)) {
+        IndexFlat::search(n, x, k, distances, labels, params);
+        return;
+    }
+    FAISS_THROW_IF_NOT(batch_size > 0);
+
+    idx_t kc = std::min(ntotal, k * std::max(k_factor, 1));
+    SearchParametersHNSW hnsw_params;
+    hnsw_params.efSearch = std::max(efSearch, int(kc));
+    const SearchParameters* accel_params =
+            dynamic_cast<const IndexHNSW*>(accel) ? &hnsw_params : nullptr;
+
+    idx_t bs = std::min(n, batch_size);
+    std::vector<float> cand_dis(bs * kc);
+    std::vector<idx_t> cand_ids(bs * kc);
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(n, i0 + bs);
+        accel->search(
+                i1 - i0,
+                x + i0 * d,
+                kc,
+                cand_dis.data(),
+                cand_ids.data(),
+                accel_params);
+        if (metric_type == METRIC_INNER_PRODUCT) {
+            recheck_candidates<CMin<float, idx_t>>(
+                    *this,
+                    i1 - i0,
+                    x + i0 * d,
+                    k,
+                    kc,
+                    cand_ids.data(),
+                    distances + i0 * k,
+                    labels + i0 * k);
+        } else {
+            recheck_candidates<CMax<float, idx_t>>(
+                    *this,
+                    i1 - i0,
+                    x + i0 * d,
+                    k,
+                    kc,
+                    cand_ids.data(),
+                    distances + i0 * k,
+                    labels + i0 * k);
+        }
+    }
+}
+
+double IndexAdaptiveQuantizer::assignment_accuracy(idx_t n, const float* x)
+        const {
+    if (n == 0) {
+        return 1;
+    }
+    std::vector<float> dis(n);
+    std::vector<idx_t> ref(n), assigned(n);
+    IndexFlat::search(n, x, 1, dis.data(), ref.data());
+    search(n, x, 1, dis.data(), assigned.data());
+    size_t n_ok = 0;
+    for (idx_t i = 0; i < n; i++) {
+        n_ok += ref[i] == assigned[i];
+    }
+    return n_ok / double(n);
+}
+
+IndexAdaptiveQuantizer::~IndexAdaptiveQuantizer() {
+    delete accel;
+}
+
+} // namespace faiss
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/IndexFlat.h>
+
+namespace faiss {
+
+/** Coarse quantizer for an IndexIVF with a large nlist.
+ *
+ * With a flat quantizer, the assignment of the added vectors costs nlist
+ * distances per vector and dominates the add. This quantizer stores the
+ * centroids like an IndexFlat and, when they are added, builds an
+ * approximate index on them: an IndexHNSWFlat, or a 4-bit fast-scan PQ
+ * for moderate sizes. A search takes k * k_factor candidates from it and
+ * re-checks them with exact distances, so the assignment cost grows much
+ * slower than nlist.
+ *
+ * The approximate index is rebuilt at each add, so it should not be used
+ * as the index of the k-means (use quantizer_trains_alone = 2, as set by
+ * the index_factory for "IVF65536_ADAPT").
+ */
+struct IndexAdaptiveQuantizer : IndexFlat {
+    enum AccelType {
+        ACCEL_AUTO,        ///< selected from ntotal
+        ACCEL_NONE,        ///< exact search
+        ACCEL_HNSW,        ///< IndexHNSWFlat
+        ACCEL_PQ_FASTSCAN, ///< IndexPQFastScan with 4-bit codes
+    };
+    AccelType accel_type = ACCEL_AUTO;
+
+    /// with ACCEL_AUTO, exact search below this size
+    idx_t min_accel_size = 16384;
+    /// with ACCEL_AUTO, fast-scan PQ below this size and HNSW above
+    idx_t hnsw_min_size = 65536;
+
+    int hnsw_M = 32;         ///< graph degree of the HNSW
+    int efSearch = 128;      ///< at least k * k_factor
+    int k_factor = 16;       ///< candidates re-checked per result
+    int pq_dsub = 2;         ///< dimension of the fast-scan sub-vectors
+    idx_t batch_size = 4096; ///< queries searched per block
+
+    /// approximate index on the centroids, owned (nullptr = exact)
+    Index* accel = nullptr;
+
+    explicit IndexAdaptiveQuantizer(idx_t d, MetricType metric = METRIC_L2);
+
+    IndexAdaptiveQuantizer() {}
+
+    /// adds the centroids and rebuilds the approximate index
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    /// (re)build accel from the stored centroids
+    void build_accel();
+
+    /// search with the approximate index and re-check exactly, exact
+    /// search if there is no approximate index or with an IDSelector
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    /// fraction of the n vectors x assigned to their exact nearest
+    /// centroid, to check the accuracy on a sample of the data
+    double assignment_accuracy(idx_t n, const float* x) const;
+
+    ~IndexAdaptiveQuantizer() override;
+};
+
+} // namespace faiss
@@ -17,6 +17,29 @@
 #include <faiss/utils/distances.h>
 #include <faiss/utils/extra_distances.h>
 
+#ifndef FINTEGER
+#define FINTEGER long
+#endif
+
+extern "C" {
+
+// general matrix multiplication
+int sgemm_(
+        const char* transa,
+        const char* transb,
+        FINTEGER* m,
+        FINTEGER* n,
+        FINTEGER* k,
+        const float* alpha,
+        const float* a,
+        FINTEGER* lda,
+        const float* b,
+        FINTEGER* ldb,
+        float* beta,
+        float* c,
+        FINTEGER* ldc);
+}
+
 namespace faiss {
 
 /**************************************************************************************
@@ -581,8 +604,52 @@ void ResidualCoarseQuantizer::search(
     std::vector<int32_t> codes(beam_size * rq.M * n);
     std::vector<float> beam_distances(n * beam_size);
 
-    rq.refine_beam(
-            n, 1, x, beam_size, codes.data(), nullptr, beam_distances.data());
+    if (rq.use_beam_LUT &&
+        (rq.M == 1 || rq.codebook_cross_products.size() > 0)) {
+        // table-based beam search: the distances are computed from the dot
+        // products of the queries with the codebook entries and the
+        // cross-products between codebook entries, without residuals
+        size_t tot = rq.total_codebook_size;
+        std::vector<float> query_norms(n), query_cp(n * tot);
+        fvec_norms_L2sqr(query_norms.data(), x, d, n);
+        if (n == 1) {
+            // avoid the BLAS overhead for a single query
+            fvec_inner_products_ny(
+                    query_cp.data(), x, rq.codebooks.data(), d, tot);
+        } else {
+            FINTEGER ti = tot, di = d, ni = n;
+            float zero = 0, one = 1;
+            sgemm_("Transposed",
+                   "Not transposed",
+                   &ti,
+                   &ni,
+                   &di,
+                   &one,
+                   rq.codebooks.data(),
+                   &di,
+                   x,
+                   &di,
+                   &zero,
+                   query_cp.data(),
+                   &ti);
+        }
+        rq.refine_beam_LUT(
+                n,
+                query_norms.data(),
+                query_cp.data(),
+                beam_size,
+                codes.data(),
+                beam_distances.data());
+    } else {
+        rq.refine_beam(
+                n,
+                1,
+                x,
+                beam_size,
+                codes.data(),
+                nullptr,
+                beam_distances.data());
+    }
 
     // pack int32 table
 #pragma omp parallel for if (n > 4000)
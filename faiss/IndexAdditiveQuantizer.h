@@ -223,6 +223,9 @@ struct ResidualCoarseQuantizer : AdditiveCoarseQuantizer {
             const std::vector<size_t>& nbits,
             MetricType metric = METRIC_L2);
 
+    /** With rq.use_beam_LUT set, the beam search computes the distances
+     * from the codebook cross-products (see set_beam_factor) instead of
+     * materializing residuals, which is faster for small batches. */
     void search(
             idx_t n,
             const float* x,
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexAdditiveQuantizerWideFastScan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/pq_wide_fast_scan.h>
+#include <faiss/impl/simd_result_handlers.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/quantize_lut.h>
+
+namespace faiss {
+
+using namespace simd_result_handlers;
+
+namespace {
+
+inline size_t roundup(size_t a, size_t b) {
+    return (a + b - 1) / b * b;
+}
+
+template <class C>
+SIMDResultHandlerToFloat* make_knn_handler_fixC(
+        idx_t n,
+        idx_t k,
+        size_t ntotal,
+        float* distances,
+        idx_t* labels,
+        const IDSelector* sel) {
+    if (k == 1) {
+        return new SingleResultHandler<C, false>(
+                n, ntotal, distances, labels, sel);
+    } else if (k <= 20) {
+        return new HeapHandler<C, false>(
+                n, ntotal, k, distances, labels, sel);
+    } else {
+        return new ReservoirHandler<C, false>(
+                n, ntotal, k, 2 * k, distances, labels, sel);
+    }
+}
+
+/// same as in AdditiveQuantizer.cpp
+float decode_qint8(uint8_t i, float amin, float amax) {
+    return (i + 0.5) / 256 * (amax - amin) + amin;
+}
+
+} // namespace
+
+IndexAdditiveQuantizerWideFastScan::IndexAdditiveQuantizerWideFastScan(
+        AdditiveQuantizer* aq,
+        MetricType metric) {
+    init(aq, metric);
+}
+
+void IndexAdditiveQuantizerWideFastScan::init(
+        AdditiveQuantizer* aq,
+        MetricType metric) {
+    FAISS_THROW_IF_NOT(aq != nullptr);
+    for (size_t m = 0; m < aq->M; m++) {
+        FAISS_THROW_IF_NOT_MSG(
+                aq->nbits[m] == 8, "only 8-bit codebooks are supported");
+    }
+    if (metric == METRIC_L2) {
+        Search_type_t st = aq->search_type;
+        FAISS_THROW_IF_NOT_MSG(
+                st == AdditiveQuantizer::ST_norm_qint8 ||
+                        st == AdditiveQuantizer::ST_norm_cqint8 ||
+                        st == AdditiveQuantizer::ST_norm_lsq2x4 ||
+                        st == AdditiveQuantizer::ST_norm_rq2x4,
+                "L2 search needs an 8-bit norm");
+    } else {
+        FAISS_THROW_IF_NOT(metric == METRIC_INNER_PRODUCT);
+        FAISS_THROW_IF_NOT_MSG(
+                aq->search_type == AdditiveQuantizer::ST_LUT_nonorm,
+                "inner product search does not store the norm");
+    }
+    M2 = aq->M + (metric == METRIC_L2 ? 1 : 0);
+    FAISS_THROW_IF_NOT(aq->code_size == M2);
+    FAISS_THROW_IF_NOT_MSG(M2 <= 256, "at most 256 codes per vector");
+
+    this->aq = aq;
+    this->d = aq->d;
+    this->metric_type = metric;
+    is_trained = aq->is_trained;
+}
+
+IndexAdditiveQuantizerWideFastScan::IndexAdditiveQuantizerWideFastScan() {}
+
+void IndexAdditiveQuantizerWideFastScan::train(idx_t n, const float* x) {
+    if (is_trained) {
+        return;
+    }
+    aq->train(n, x);
+    is_trained = true;
+}
+
+void IndexAdditiveQuantizerWideFastScan::add(idx_t n, const float* x) {
+    FAISS_THROW_IF_NOT(is_trained);
+
+    // do some blocking to avoid excessive allocs
+    constexpr idx_t bs = 65536;
+    if (n > bs) {
+        for (idx_t i0 = 0; i0 < n; i0 += bs) {
+            idx_t i1 = std::min(n, i0 + bs);
+            add(i1 - i0, x + i0 * d);
+        }
+        return;
+    }
+
+    std::vector<uint8_t> tmp_codes(n * M2);
+    aq->compute_codes(x, tmp_codes.data(), n);
+
+    ntotal2 = roundup(ntotal + n, pqwide_bbs);
+    size_t new_size = ntotal2 / pqwide_bbs * pqwide_block_size(M2, 8);
+    size_t old_size = codes.size();
+    if (new_size > old_size) {
+        codes.resize(new_size);
+        memset(codes.get() + old_size, 0, new_size - old_size);
+    }
+    pqwide_pack_codes_range(
+            tmp_codes.data(), M2, 8, ntotal, ntotal + n, codes.get());
+    ntotal += n;
+}
+
+void IndexAdditiveQuantizerWideFastScan::reset() {
+    codes.resize(0);
+    ntotal = ntotal2 = 0;
+}
+
+void IndexAdditiveQuantizerWideFastScan::compute_quantized_LUT(
+        idx_t n,
+        const float* x,
+        uint8_t* lut,
+        float* normalizers) const {
+    constexpr size_t ksub = 256;
+    size_t M = aq->M;
+    bool is_L2 = metric_type == METRIC_L2;
+
+    // the norm table is the last column
+    std::unique_ptr<float[]> dis_tables(new float[n * M2 * ksub]);
+    aq->compute_LUT(n, x, dis_tables.get(), is_L2 ? -2.0f : 1.0f, M2 * ksub);
+
+    std::vector<float> qnorms;
+    if (is_L2) {
+        float norm_tab[ksub];
+        for (size_t j = 0; j < ksub; j++) {
+            norm_tab[j] = aq->search_type == AdditiveQuantizer::ST_norm_qint8
+                    ? decode_qint8(j, aq->norm_min, aq->norm_max)
+                    : aq->decode_qcint(j);
+        }
+        for (idx_t i = 0; i < n; i++) {
+            memcpy(dis_tables.get() + (i * M2 + M) * ksub,
+                   norm_tab,
+                   sizeof(norm_tab));
+        }
+        qnorms.resize(n);
+        fvec_norms_L2sqr(qnorms.data(), x, d, n);
+    }
+
+    for (idx_t i = 0; i < n; i++) {
+        float* t = dis_tables.get() + i * M2 * ksub;
+        quantize_lut::round_uint8_per_column(
+                t, M2, ksub, &normalizers[2 * i], &normalizers[2 * i + 1]);
+        if (is_L2) {
+            normalizers[2 * i + 1] += qnorms[i];
+        }
+        uint8_t* t_out = lut + i * M2 * ksub;
+        for (size_t j = 0; j < M2 * ksub; j++) {
+            t_out[j] = int(t[j]);
+        }
+    }
+}
+
+void IndexAdditiveQuantizerWideFastScan::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    const IDSelector* sel = params ? params->sel : nullptr;
+    bool is_max = !is_similarity_metric(metric_type);
+    idx_t bs = qbs == 0 ? 4 : qbs;
+    size_t lut_size = M2 * pqwide_lut_stride(8);
+
+#pragma omp parallel for schedule(dynamic) if (n > bs)
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(i0 + bs, n);
+        AlignedTable<uint8_t> LUT((i1 - i0) * lut_size);
+        std::vector<float> normalizers(2 * (i1 - i0));
+        compute_quantized_LUT(
+                i1 - i0, x + i0 * d, LUT.get(), normalizers.data());
+
+        std::unique_ptr<SIMDResultHandlerToFloat> handler;
+        if (is_max) {
+            handler.reset(make_knn_handler_fixC<CMax<uint16_t, int64_t>>(
+                    i1 - i0,
+                    k,
+                    ntotal,
+                    distances + i0 * k,
+                    labels + i0 * k,
+                    sel));
+        } else {
+            handler.reset(make_knn_handler_fixC<CMin<uint16_t, int64_t>>(
+                    i1 - i0,
+                    k,
+                    ntotal,
+                    distances + i0 * k,
+                    labels + i0 * k,
+                    sel));
+        }
+        handler->begin(normalizers.data());
+        pqwide_accumulate_loop(
+                i1 - i0, ntotal2, M2, 8, codes.get(), LUT.get(), *handler);
+        handler->end();
+    }
+}
+
+void IndexAdditiveQuantizerWideFastScan::reconstruct(idx_t key, float* recons)
+        const {
+    FAISS_THROW_IF_NOT(key >= 0 && key < ntotal);
+    std::vector<uint8_t> code(M2);
+    for (size_t m = 0; m < M2; m++) {
+        code[m] = pqwide_get_packed_element(codes.get(), M2, 8, key, m);
+    }
+    aq->decode(code.data(), recons, 1);
+}
+
+size_t IndexAdditiveQuantizerWideFastScan::sa_code_size() const {
+    return M2;
+}
+
+void IndexAdditiveQuantizerWideFastScan::sa_encode(
+        idx_t n,
+        const float* x,
+        uint8_t* bytes) const {
+    aq->compute_codes(x, bytes, n);
+}
+
+void IndexAdditiveQuantizerWideFastScan::sa_decode(
+        idx_t n,
+        const uint8_t* bytes,
+        float* x) const {
+    aq->decode(bytes, x, n);
+}
+
+/**************************************************************************************
+ * IndexResidualQuantizerWideFastScan
+ **************************************************************************************/
+
+IndexResidualQuantizerWideFastScan::IndexResidualQuantizerWideFastScan(
+        int d,
+        size_t M,
+        MetricType metric,
+        Search_type_t search_type)
+        : rq(d, M, 8, search_type) {
+    init(&rq, metric);
+}
+
+IndexResidualQuantizerWideFastScan::IndexResidualQuantizerWideFastScan() {
+    aq = &rq;
+}
+
+/**************************************************************************************
+ * IndexLocalSearchQuantizerWideFastScan
+ **************************************************************************************/
+
+IndexLocalSearchQuantizerWideFastScan::IndexLocalSearchQuantizerWideFastScan(
+        int d,
+        size_t M,
+        MetricType metric,
+        Search_type_t search_type)
+        : lsq(d, M, 8, search_type) {
+    init(&lsq, metric);
+}
+
+IndexLocalSearchQuantizerWideFastScan::IndexLocalSearchQuantizerWideFastScan() {
+    aq = &lsq;
+}
+
+/**************************************************************************************
+ * IndexProductResidualQuantizerWideFastScan
+ **************************************************************************************/
+
+IndexProductResidualQuantizerWideFastScan::
+        IndexProductResidualQuantizerWideFastScan(
+                int d,
+                size_t nsplits,
+                size_t Msub,
+                MetricType metric,
+                Search_type_t search_type)
+        : prq(d, nsplits, Msub, 8, search_type) {
+    init(&prq, metric);
+}
+
+IndexProductResidualQuantizerWideFastScan::
+        IndexProductResidualQuantizerWideFastScan() {
+    aq = &prq;
+}
+
+/**************************************************************************************
+ * IndexProductLocalSearchQuantizerWideFastScan
+ **************************************************************************************/
+
+IndexProductLocalSearchQuantizerWideFastScan::
+        IndexProductLocalSearchQuantizerWideFastScan(
+                int d,
+                size_t nsplits,
+                size_t Msub,
+                MetricType metric,
+                Search_type_t search_type)
+        : plsq(d, nsplits, Msub, 8, search_type) {
+    init(&plsq, metric);
+}
+
+IndexProductLocalSearchQuantizerWideFastScan::
+        IndexProductLocalSearchQuantizerWideFastScan() {
+    aq = &plsq;
+}
+
+} // namespace faiss
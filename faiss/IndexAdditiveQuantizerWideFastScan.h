@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/Index.h>
+#include <faiss/impl/AdditiveQuantizer.h>
+#include <faiss/impl/LocalSearchQuantizer.h>
+#include <faiss/impl/ProductAdditiveQuantizer.h>
+#include <faiss/impl/ResidualQuantizer.h>
+#include <faiss/utils/AlignedTable.h>
+
+namespace faiss {
+
+/** Fast scan version of IndexAdditiveQuantizer for 8-bit codebooks.
+ *
+ * The M 8-bit codes of a vector, plus the 8-bit code of its norm for L2,
+ * are stored as the M2 = M + 1 sub-quantizer codes of the wide fast-scan
+ * blocks (see pq_wide_fast_scan.h). The search quantizes the inner product
+ * tables of compute_LUT and the table of the decoded norms to uint8, and
+ * accumulates them with AVX512-VBMI byte permutations when available. The
+ * norm is a full 8-bit table, not the 2x4-bit tables of the 4-bit
+ * IndexAdditiveQuantizerFastScan.
+ *
+ * L2 needs an 8-bit norm search type (ST_norm_qint8, ST_norm_cqint8,
+ * ST_norm_lsq2x4 or ST_norm_rq2x4), inner product needs ST_LUT_nonorm.
+ * The L2 distances include the query norm.
+ */
+struct IndexAdditiveQuantizerWideFastScan : Index {
+    AdditiveQuantizer* aq = nullptr;
+    using Search_type_t = AdditiveQuantizer::Search_type_t;
+
+    /// nb of 8-bit codes per vector, aq->M plus the norm for L2
+    size_t M2 = 0;
+
+    /// ntotal rounded up to a multiple of 64
+    size_t ntotal2 = 0;
+
+    /// the blocks of codes
+    AlignedTable<uint8_t> codes;
+
+    /// nb of queries scanned together, 0 = default (4)
+    int qbs = 0;
+
+    explicit IndexAdditiveQuantizerWideFastScan(
+            AdditiveQuantizer* aq,
+            MetricType metric = METRIC_L2);
+
+    void init(AdditiveQuantizer* aq, MetricType metric = METRIC_L2);
+
+    IndexAdditiveQuantizerWideFastScan();
+
+    void train(idx_t n, const float* x) override;
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    /// supports an IDSelector in the SearchParameters
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /// quantized look-up tables of n queries, size n * M2 * 256
+    void compute_quantized_LUT(
+            idx_t n,
+            const float* x,
+            uint8_t* lut,
+            float* normalizers) const;
+
+    size_t sa_code_size() const override;
+
+    void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
+
+    void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+};
+
+/// Wide fast-scan index with a residual quantizer
+struct IndexResidualQuantizerWideFastScan : IndexAdditiveQuantizerWideFastScan {
+    ResidualQuantizer rq;
+
+    IndexResidualQuantizerWideFastScan(
+            int d,
+            size_t M,
+            MetricType metric = METRIC_L2,
+            Search_type_t search_type = AdditiveQuantizer::ST_norm_cqint8);
+
+    IndexResidualQuantizerWideFastScan();
+};
+
+/// Wide fast-scan index with a local search quantizer
+struct IndexLocalSearchQuantizerWideFastScan
+        : IndexAdditiveQuantizerWideFastScan {
+    LocalSearchQuantizer lsq;
+
+    IndexLocalSearchQuantizerWideFastScan(
+            int d,
+            size_t M,
+            MetricType metric = METRIC_L2,
+            Search_type_t search_type = AdditiveQuantizer::ST_norm_cqint8);
+
+    IndexLocalSearchQuantizerWideFastScan();
+};
+
+/// Wide fast-scan index with a product residual quantizer
+struct IndexProductResidualQuantizerWideFastScan
+        : IndexAdditiveQuantizerWideFastScan {
+    ProductResidualQuantizer prq;
+
+    IndexProductResidualQuantizerWideFastScan(
+            int d,
+            size_t nsplits,
+            size_t Msub,
+            MetricType metric = METRIC_L2,
+            Search_type_t search_type = AdditiveQuantizer::ST_norm_cqint8);
+
+    IndexProductResidualQuantizerWideFastScan();
+};
+
+/// Wide fast-scan index with a product local search quantizer
+struct IndexProductLocalSearchQuantizerWideFastScan
+        : IndexAdditiveQuantizerWideFastScan {
+    ProductLocalSearchQuantizer plsq;
+
+    IndexProductLocalSearchQuantizerWideFastScan(
+            int d,
+            size_t nsplits,
+            size_t Msub,
+            MetricType metric = METRIC_L2,
+            Search_type_t search_type = AdditiveQuantizer::ST_norm_cqint8);
+
+    IndexProductLocalSearchQuantizerWideFastScan();
+};
+
+} // namespace faiss
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexBatching.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+/// queries of the callers that joined a batch, and their results
+struct IndexBatching::Batch {
+    idx_t k = 0;
+    const SearchParameters* params = nullptr;
+    std::vector<float> x;
+    idx_t nq = 0;
+    std::vector<float> distances;
+    std::vector<idx_t> labels;
+    bool done = false;
+    /// the batched search threw an exception, rethrown by all the callers
+    bool failed = false;
+    std::string error;
+};
+
+IndexBatching::IndexBatching(Index* index, idx_t max_batch_size)
+        : Index(index->d, index->metric_type),
+          index(index),
+          max_batch_size(max_batch_size) {
+    metric_arg = index->metric_arg;
+    ntotal = index->ntotal;
+    is_trained = index->is_trained;
+}
+
+IndexBatching::IndexBatching() = default;
+
+void IndexBatching::train(idx_t n, const float* x) {
+    index->train(n, x);
+    is_trained = index->is_trained;
+}
+
+void IndexBatching::add(idx_t n, const float* x) {
+    index->add(n, x);
+    ntotal = index->ntotal;
+}
+
+void IndexBatching::add_with_ids(idx_t n, const float* x, const idx_t* xids) {
+    index->add_with_ids(n, x, xids);
+    ntotal = index->ntotal;
+}
+
+void IndexBatching::reset() {
+    index->reset();
+    ntotal = 0;
+}
+
+void IndexBatching::reconstruct(idx_t key, float* recons) const {
+    index->reconstruct(key, recons);
+}
+
+int IndexBatching::window_us() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return current_window_us < 0 ? max_window_us : current_window_us;
+}
+
+void IndexBatching::update_window(const Batch& batch, bool timed_out) const {
+    if (!adaptive_window) {
+        current_window_us = max_window_us;
+    } else if (batch.nq == 1) {
+        // nobody joined: waiting was useless
+        current_window_us = std::max(current_window_us / 2, min_window_us);
+    } else if (timed_out) {
+        // the batch was still filling up
+        current_window_us = std::min(
+                std::max(current_window_us * 2, min_window_us), max_window_us);
+    }
+}
+
+void IndexBatching::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    if (n == 0) {
+        return;
+    }
+    if (n >= max_batch_size) {
+        index->search(n, x, k, distances, labels, params);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (current_window_us < 0) {
+        current_window_us = max_window_us;
+    }
+    std::shared_ptr<Batch> batch = open_batch;
+    bool is_leader = false;
+    if (!batch) {
+        batch = std::make_shared<Batch>();
+        batch->k = k;
+        batch->params = params;
+        open_batch = batch;
+        is_leader = true;
+    } else if (
+            batch->k != k || batch->params != params ||
+            batch->nq + n > max_batch_size) {
+        // cannot be merged: the open batch is left to its leader
+        lock.unlock();
+        index->search(n, x, k, distances, labels, params);
+        return;
+    }
+    idx_t q0 = batch->nq;
+    batch->x.insert(batch->x.end(), x, x + n * d);
+    batch->nq += n;
+
+    if (is_leader) {
+        auto deadline = std::chrono::steady_clock::now() +
+                std::chrono::microseconds(current_window_us);
+        bool full = cv.wait_until(lock, deadline, [&] {
+            return batch->nq >= max_batch_size;
+        });
+        // seal the batch: later callers open a new one
+        if (open_batch == batch) {
+            open_batch.reset();
+        }
+        update_window(*batch, !full);
+        lock.unlock();
+
+        batch->distances.resize(batch->nq * k);
+        batch->labels.resize(batch->nq * k);
+        try {
+            index->search(
+                    batch->nq,
+                    batch->x.data(),
+                    k,
+                    batch->distances.data(),
+                    batch->labels.data(),
+                    params);
+        } catch (const std::exception& e) {
+            batch->failed = true;
+            batch->error = e.what();
+        }
+        n_batches++;
+        n_batched_queries += batch->nq;
+
+        lock.lock();
+        batch->done = true;
+        cv.notify_all();
+    } else {
+        if (batch->nq >= max_batch_size) {
+            cv.notify_all();
+        }
+        cv.wait(lock, [&] { return batch->done; });
+    }
+    lock.unlock();
+
+    FAISS_THROW_IF_NOT_FMT(
+            !batch->failed,
+            "batched search failed: %s",
+            batch->error.c_str());
+    memcpy(distances,
+           batch->distances.data() + q0 * k,
+           sizeof(float) * n * k);
+    memcpy(labels, batch->labels.data() + q0 * k, sizeof(idx_t) * n * k);
+}
+
+double IndexBatching::average_batch_size() const {
+    size_t nb = n_batches;
+    return nb == 0 ? 0 : double(n_batched_queries) / nb;
+}
+
+void IndexBatching::reset_stats() {
+    n_batches = 0;
+    n_batched_queries = 0;
+}
+
+IndexBatching::~IndexBatching() {
+    if (own_fields) {
+        delete index;
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/** Merges the concurrent searches of a few queries into batched searches
+ * of the wrapped index, for serving workloads that receive the queries one
+ * at a time: the batched searches of IndexFlat (GEMM) or IndexIVF (one
+ * scan per inverted list) amortize their fixed costs and the OpenMP
+ * overhead over the whole batch.
+ *
+ * The first thread that calls search opens a batch and becomes its
+ * leader. The calls made while the batch is open append their queries to
+ * it, if they have the same k and search parameters (the other ones search
+ * the index directly). The leader searches the batch when it holds
+ * max_batch_size queries or when the window has elapsed, then every caller
+ * copies its results. There is no background thread.
+ *
+ * With adaptive_window, the window shrinks (down to min_window_us) when
+ * the batches hold a single query, ie. when waiting only adds latency, and
+ * grows back (up to max_window_us) when the batches close on the timeout
+ * with several queries.
+ */
+struct IndexBatching : Index {
+    Index* index = nullptr;
+    bool own_fields = false;
+
+    /// a batch is searched as soon as it holds that many queries. Calls
+    /// with at least as many queries search the index directly.
+    idx_t max_batch_size = 64;
+
+    /// max time the leader waits for other queries (us)
+    int max_window_us = 200;
+
+    /// lower bound of the adaptive window (us)
+    int min_window_us = 10;
+
+    bool adaptive_window = true;
+
+    /// statistics
+    mutable std::atomic<size_t> n_batches{0};
+    mutable std::atomic<size_t> n_batched_queries{0};
+
+    explicit IndexBatching(Index* index, idx_t max_batch_size = 64);
+
+    IndexBatching();
+
+    void train(idx_t n, const float* x) override;
+    void add(idx_t n, const float* x) override;
+    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
+    void reset() override;
+
+    /// may be merged with concurrent calls, see above
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /// current window of the leaders (us)
+    int window_us() const;
+
+    /// n_batched_queries / n_batches
+    double average_batch_size() const;
+
+    void reset_stats();
+
+    ~IndexBatching() override;
+
+   private:
+    struct Batch;
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable cv;
+    /// batch accepting queries, null if none
+    mutable std::shared_ptr<Batch> open_batch;
+    mutable int current_window_us = -1;
+
+    void update_window(const Batch& batch, bool timed_out) const;
+};
+
+} // namespace faiss
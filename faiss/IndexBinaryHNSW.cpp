@@ -8,11 +8,13 @@
 #include <faiss/IndexBinaryHNSW.h>
 
 #include <omp.h>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <memory>
 
 #include <cstdint>
@@ -99,6 +101,12 @@ void hnsw_add_vertices(
         int i1 = n;
 
         for (int pt_level = hist.size() - 1; pt_level >= 0; pt_level--) {
+            // max nb of links kept per node by shrink_neighbor_list, as in
+            // IndexHNSW: the level 0 size, no limit on the upper levels
+            hnsw.ems = std::vector<int>(
+                    ntotal,
+                    pt_level == 0 ? hnsw.nb_neighbors(0)
+                                  : std::numeric_limits<int>::max());
             int i0 = i1 - hist[pt_level];
 
             if (verbose) {
@@ -191,9 +199,15 @@ void IndexBinaryHNSW::search(
         int32_t* distances,
         idx_t* labels,
         const SearchParameters* params) const {
-    FAISS_THROW_IF_NOT_MSG(
-            !params, "search params not supported for this index");
     FAISS_THROW_IF_NOT(k > 0);
+    int efSearch = hnsw.efSearch;
+    if (params) {
+        const SearchParametersHNSW* hnsw_params =
+                dynamic_cast<const SearchParametersHNSW*>(params);
+        FAISS_THROW_IF_NOT_MSG(
+                hnsw_params, "IndexBinaryHNSW params have incorrect type");
+        efSearch = hnsw_params->efSearch;
+    }
 
     // we use the buffer for distances as float but convert them back
     // to int in the end
@@ -202,20 +216,29 @@ void IndexBinaryHNSW::search(
     using RH = HeapBlockResultHandler<HNSW::C>;
     RH bres(n, distances_f, labels, k);
 
+    size_t nvisit = (size_t)std::max((idx_t)efSearch, k) * hnsw.nb_neighbors(0);
+    VisitedTableMode vt_mode = VisitedTable::auto_mode(ntotal, nvisit);
+    HNSWStats search_stats;
+
 #pragma omp parallel
     {
-        VisitedTable vt(ntotal);
+        ThreadVisitedTable tvt(ntotal, vt_mode, nvisit);
+        VisitedTable& vt = *tvt;
         std::unique_ptr<DistanceComputer> dis(get_distance_computer());
         RH::SingleResultHandler res(bres);
+        HNSWStats thread_stats;
 
 #pragma omp for
         for (idx_t i = 0; i < n; i++) {
             res.begin(i);
             dis->set_query((float*)(x + i * code_size));
-            hnsw.search(*dis, res, vt);
+            thread_stats.combine(hnsw.search(*dis, res, vt, params));
             res.end();
         }
+#pragma omp critical
+        { search_stats.combine(thread_stats); }
     }
+    hnsw_stats.combine(search_stats);
 
 #pragma omp parallel for
     for (int i = 0; i < n * k; ++i) {
@@ -225,6 +248,9 @@ void IndexBinaryHNSW::search(
 
 void IndexBinaryHNSW::add(idx_t n, const uint8_t* x) {
     FAISS_THROW_IF_NOT(is_trained);
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.storage_is_compact && !hnsw.neighbors_on_disk,
+            "cannot add to a compact or on-disk IndexBinaryHNSW");
     int n0 = ntotal;
     storage->add(n, x);
     ntotal = storage->ntotal;
@@ -248,11 +274,9 @@ template <class HammingComputer>
 struct FlatHammingDis : DistanceComputer {
     const int code_size;
     const uint8_t* b;
-    size_t ndis;
     HammingComputer hc;
 
     float operator()(idx_t i) override {
-        ndis++;
         return hc.hamming(b + i * code_size);
     }
 
@@ -264,7 +288,6 @@ struct FlatHammingDis : DistanceComputer {
     explicit FlatHammingDis(const IndexBinaryFlat& storage)
             : code_size(storage.code_size),
               b(storage.xb.data()),
-              ndis(0),
               hc() {}
 
     // NOTE: Pointers are cast from float in order to reuse the floating-point
@@ -272,11 +295,6 @@ struct FlatHammingDis : DistanceComputer {
     void set_query(const float* x) override {
         hc.set((uint8_t*)x, code_size);
     }
-
-    ~FlatHammingDis() override {
-#pragma omp critical
-        { hnsw_stats.ndis += ndis; }
-    }
 };
 
 struct BuildDistanceComputer {
@@ -16,7 +16,17 @@
 namespace faiss {
 
 /** The HNSW index is a normal random-access index with a HNSW
- * link structure built on top */
+ * link structure built on top
+ *
+ * The graph is the same HNSW structure as for IndexHNSW and is traversed
+ * by the same search code through the Hamming DistanceComputer, so it
+ * supports the same storage modes: after hnsw.convert_to_compact() the
+ * index is written in the compact CSR format, and it can be read back with
+ * the neighbor lists left on disk (read with pread once
+ * hnsw.initialize_graph is called, or through the mapping with
+ * IO_FLAG_MMAP_IFC), see HNSWIndexConfig. The graph cannot be extended in
+ * these modes.
+ */
 
 struct IndexBinaryHNSW : IndexBinary {
     typedef HNSW::storage_idx_t storage_idx_t;
@@ -41,7 +51,8 @@ struct IndexBinaryHNSW : IndexBinary {
     /// Trains the storage if needed
     void train(idx_t n, const uint8_t* x) override;
 
-    /// entry point for search
+    /// entry point for search, params can be a SearchParametersHNSW (eg.
+    /// for the beam search and batching settings)
     void search(
             idx_t n,
             const uint8_t* x,
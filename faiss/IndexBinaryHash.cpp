@@ -9,10 +9,14 @@
 
 #include <faiss/IndexBinaryHash.h>
 
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <unordered_set>
+#include <utility>
 
 #include <faiss/utils/hamming.h>
 #include <faiss/utils/utils.h>
@@ -478,4 +482,447 @@ size_t IndexBinaryMultiHash::hashtable_size() const {
     return tot;
 }
 
+/*******************************************************
+ * IndexBinaryMIH implementation
+ ******************************************************/
+
+IndexBinaryMIH::IndexBinaryMIH(int d, int nhash)
+        : IndexBinary(d), nhash(nhash), tables(nhash) {
+    FAISS_THROW_IF_NOT(nhash > 0 && nhash <= d);
+    FAISS_THROW_IF_NOT_FMT(
+            (d + nhash - 1) / nhash <= 32,
+            "substrings of %d bits are too long, the max is 32",
+            (d + nhash - 1) / nhash);
+    is_trained = true;
+}
+
+IndexBinaryMIH::IndexBinaryMIH() {
+    is_trained = true;
+}
+
+int IndexBinaryMIH::substring_start(int h) const {
+    return (int)((int64_t)h * d / nhash);
+}
+
+int IndexBinaryMIH::substring_length(int h) const {
+    return substring_start(h + 1) - substring_start(h);
+}
+
+void IndexBinaryMIH::reset() {
+    xb.clear();
+    tables.assign(nhash, Table());
+    ntotal = 0;
+}
+
+namespace {
+
+/// read len <= 32 bits of code starting at bit start
+inline uint32_t get_substring(const uint8_t* code, int start, int len) {
+    const uint8_t* p = code + (start >> 3);
+    int shift = start & 7;
+    int nbytes = (shift + len + 7) >> 3;
+    uint64_t v = 0;
+    for (int i = 0; i < nbytes; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return (v >> shift) & (((uint64_t)1 << len) - 1);
+}
+
+/// merge the sorted (key, id) pairs into the table
+void merge_into_table(
+        IndexBinaryMIH::Table& t,
+        const std::vector<std::pair<uint32_t, idx_t>>& pairs) {
+    IndexBinaryMIH::Table nt;
+    nt.keys.reserve(t.keys.size() + pairs.size());
+    nt.ids.reserve(t.ids.size() + pairs.size());
+    nt.offsets.push_back(0);
+
+    size_t i = 0, j = 0;
+    while (i < t.keys.size() || j < pairs.size()) {
+        uint32_t key;
+        if (j == pairs.size() ||
+            (i < t.keys.size() && t.keys[i] <= pairs[j].first)) {
+            key = t.keys[i];
+        } else {
+            key = pairs[j].first;
+        }
+        nt.keys.push_back(key);
+        if (i < t.keys.size() && t.keys[i] == key) {
+            nt.ids.insert(
+                    nt.ids.end(),
+                    t.ids.begin() + t.offsets[i],
+                    t.ids.begin() + t.offsets[i + 1]);
+            i++;
+        }
+        while (j < pairs.size() && pairs[j].first == key) {
+            nt.ids.push_back(pairs[j].second);
+            j++;
+        }
+        nt.offsets.push_back(nt.ids.size());
+    }
+    t = std::move(nt);
+}
+
+} // anonymous namespace
+
+void IndexBinaryMIH::add_to_tables(idx_t n, const uint8_t* x, idx_t i0) {
+    tables.resize(nhash);
+
+#pragma omp parallel for if (nhash > 1)
+    for (int h = 0; h < nhash; h++) {
+        int start = substring_start(h), len = substring_length(h);
+        std::vector<std::pair<uint32_t, idx_t>> pairs(n);
+        for (idx_t i = 0; i < n; i++) {
+            pairs[i] = {get_substring(x + i * code_size, start, len), i0 + i};
+        }
+        std::sort(pairs.begin(), pairs.end());
+        merge_into_table(tables[h], pairs);
+    }
+}
+
+void IndexBinaryMIH::add(idx_t n, const uint8_t* x) {
+    if (n == 0) {
+        return;
+    }
+    xb.insert(xb.end(), x, x + n * code_size);
+    add_to_tables(n, x, ntotal);
+    ntotal += n;
+}
+
+void IndexBinaryMIH::rebuild_tables() {
+    FAISS_THROW_IF_NOT(xb.size() == ntotal * code_size);
+    tables.assign(nhash, Table());
+    add_to_tables(ntotal, xb.data(), 0);
+}
+
+void IndexBinaryMIH::reconstruct(idx_t key, uint8_t* recons) const {
+    FAISS_THROW_IF_NOT(key >= 0 && key < ntotal);
+    memcpy(recons, xb.data() + key * code_size, code_size);
+}
+
+size_t IndexBinaryMIH::hashtable_size() const {
+    size_t tot = 0;
+    for (const Table& t : tables) {
+        tot += t.keys.size();
+    }
+    return tot;
+}
+
+namespace {
+
+double binomial(int n, int k) {
+    double c = 1;
+    for (int i = 0; i < k; i++) {
+        c = c * (n - i) / (i + 1);
+    }
+    return c;
+}
+
+/// per-query state of the MIH search
+struct MIHQuery {
+    const IndexBinaryMIH& index;
+    std::vector<int> starts, lens;
+    std::vector<uint32_t> qsub; ///< substrings of the query
+    std::vector<idx_t> candidates;
+    /// nb of keys and ids visited for the current query
+    size_t nvisit = 0;
+    size_t n0 = 0, nlist = 0, ndis = 0;
+
+    explicit MIHQuery(const IndexBinaryMIH& index)
+            : index(index),
+              starts(index.nhash),
+              lens(index.nhash),
+              qsub(index.nhash) {
+        for (int h = 0; h < index.nhash; h++) {
+            starts[h] = index.substring_start(h);
+            lens[h] = index.substring_length(h);
+        }
+    }
+
+    void set_query(const uint8_t* q) {
+        for (int h = 0; h < index.nhash; h++) {
+            qsub[h] = get_substring(q, starts[h], lens[h]);
+        }
+        nvisit = 0;
+    }
+
+    /// a linear scan would be cheaper than going on with the tables
+    bool should_scan() const {
+        return nvisit > (size_t)index.ntotal;
+    }
+
+    /// distance between the query and code on substring h
+    int substring_dis(const uint8_t* code, int h) const {
+        return popcount64(get_substring(code, starts[h], lens[h]) ^ qsub[h]);
+    }
+
+    /** call f(id) for the vectors whose substring h is at distance s of
+     * the query. When there are fewer keys than key values to enumerate,
+     * the keys are scanned linearly. */
+    template <class F>
+    void visit_buckets(int h, int s, F f) {
+        const IndexBinaryMIH::Table& t = index.tables[h];
+        size_t nkeys = t.keys.size();
+        if (nkeys == 0 || s > lens[h]) {
+            return;
+        }
+        auto visit = [&](size_t b) {
+            for (idx_t j = t.offsets[b]; j < t.offsets[b + 1]; j++) {
+                f(t.ids[j]);
+            }
+            nvisit += t.offsets[b + 1] - t.offsets[b];
+            nlist++;
+        };
+        uint32_t qh = qsub[h];
+        if (binomial(lens[h], s) * std::log2(nkeys + 1.0) > nkeys) {
+            nvisit += nkeys;
+            for (size_t b = 0; b < nkeys; b++) {
+                if (popcount64(t.keys[b] ^ qh) == s) {
+                    visit(b);
+                }
+            }
+            return;
+        }
+        // enumerate the masks of s bits among lens[h] (Gosper's hack)
+        uint64_t limit = (uint64_t)1 << lens[h];
+        for (uint64_t x = ((uint64_t)1 << s) - 1; x < limit;) {
+            uint32_t key = qh ^ (uint32_t)x;
+            nvisit++;
+            auto it = std::lower_bound(t.keys.begin(), t.keys.end(), key);
+            if (it != t.keys.end() && *it == key) {
+                visit(it - t.keys.begin());
+            } else {
+                n0++;
+            }
+            if (x == 0) {
+                break;
+            }
+            uint64_t c = x & -x, r = x + c;
+            x = (((r ^ x) >> 2) / c) | r;
+        }
+    }
+
+    /// compute the distances of the candidates, in the order of the codes
+    template <class HammingComputer, class F>
+    void verify_candidates(const HammingComputer& hc, F f) {
+        std::sort(candidates.begin(), candidates.end());
+        const uint8_t* codes = index.xb.data();
+        size_t code_size = index.code_size;
+        for (idx_t id : candidates) {
+            f(hc.hamming(codes + id * code_size), id);
+        }
+        ndis += candidates.size();
+        candidates.clear();
+    }
+
+    /// compute the distances to all the vectors instead
+    template <class HammingComputer, class F>
+    void scan_all(const HammingComputer& hc, F f) {
+        const uint8_t* codes = index.xb.data();
+        size_t code_size = index.code_size;
+        for (idx_t i = 0; i < index.ntotal; i++) {
+            f(hc.hamming(codes + i * code_size), i);
+        }
+        ndis += index.ntotal;
+        candidates.clear();
+    }
+};
+
+template <class HammingComputer>
+void mih_range_search_1(
+        MIHQuery* mqp,
+        const uint8_t* q,
+        int radius,
+        RangeQueryResult* qres) {
+    MIHQuery& mq = *mqp;
+    // max distance of the results
+    int r = radius - 1;
+    if (r < 0) {
+        return;
+    }
+    int m = mq.index.nhash;
+    mq.set_query(q);
+
+    // if all substrings were at distance > rh[h], the total distance would
+    // be >= r + 1
+    int r0 = r / m, a = r - m * r0 + 1;
+    std::vector<int> rh(m);
+    for (int h = 0; h < m; h++) {
+        rh[h] = h < a ? r0 : r0 - 1;
+    }
+
+    const uint8_t* codes = mq.index.xb.data();
+    size_t code_size = mq.index.code_size;
+    for (int h = 0; h < m; h++) {
+        for (int s = 0; s <= rh[h]; s++) {
+            mq.visit_buckets(h, s, [&](idx_t id) {
+                // skip the vectors already found in a previous table
+                const uint8_t* code = codes + id * code_size;
+                for (int h2 = 0; h2 < h; h2++) {
+                    if (mq.substring_dis(code, h2) <= rh[h2]) {
+                        return;
+                    }
+                }
+                mq.candidates.push_back(id);
+            });
+        }
+        if (mq.should_scan()) {
+            break;
+        }
+    }
+
+    HammingComputer hc(q, code_size);
+    auto add_result = [&](int dis, idx_t id) {
+        if (dis < radius) {
+            qres->add(dis, id);
+        }
+    };
+    if (mq.should_scan()) {
+        mq.scan_all(hc, add_result);
+    } else {
+        mq.verify_candidates(hc, add_result);
+    }
+}
+
+template <class HammingComputer>
+void mih_knn_1(
+        MIHQuery* mqp,
+        const uint8_t* q,
+        idx_t k,
+        int32_t* simi,
+        idx_t* idxi) {
+    using C = CMax<int32_t, idx_t>;
+    MIHQuery& mq = *mqp;
+    int m = mq.index.nhash;
+    mq.set_query(q);
+    HammingComputer hc(q, mq.index.code_size);
+
+    const uint8_t* codes = mq.index.xb.data();
+    size_t code_size = mq.index.code_size;
+    int maxlen = *std::max_element(mq.lens.begin(), mq.lens.end());
+
+    // visit table h at substring radius s in the order (s, h)
+    for (int s = 0; s <= maxlen; s++) {
+        for (int h = 0; h < m; h++) {
+            mq.visit_buckets(h, s, [&](idx_t id) {
+                // skip the vectors found at a previous (s, h)
+                const uint8_t* code = codes + id * code_size;
+                for (int h2 = 0; h2 < m; h2++) {
+                    if (h2 != h &&
+                        mq.substring_dis(code, h2) <= (h2 < h ? s : s - 1)) {
+                        return;
+                    }
+                }
+                mq.candidates.push_back(id);
+            });
+            auto add_result = [&](int dis, idx_t id) {
+                if (dis < simi[0]) {
+                    heap_replace_top<C>(k, simi, idxi, dis, id);
+                }
+            };
+            if (mq.should_scan()) {
+                // restart from scratch with all the vectors
+                heap_heapify<C>(k, simi, idxi);
+                mq.scan_all(hc, add_result);
+                return;
+            }
+            mq.verify_candidates(hc, add_result);
+            // all the vectors at distance <= m * s + h have been found
+            if (simi[0] <= m * s + h) {
+                return;
+            }
+        }
+    }
+}
+
+struct Run_mih_range_search_1 {
+    using T = void;
+    template <class HammingComputer, class... Types>
+    void f(Types... args) {
+        mih_range_search_1<HammingComputer>(args...);
+    }
+};
+
+struct Run_mih_knn_1 {
+    using T = void;
+    template <class HammingComputer, class... Types>
+    void f(Types... args) {
+        mih_knn_1<HammingComputer>(args...);
+    }
+};
+
+} // anonymous namespace
+
+void IndexBinaryMIH::range_search(
+        idx_t n,
+        const uint8_t* x,
+        int radius,
+        RangeSearchResult* result,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT_MSG(
+            !params, "search params not supported for this index");
+    size_t nlist = 0, ndis = 0, n0 = 0;
+
+#pragma omp parallel if (n > 100) reduction(+ : ndis, n0, nlist)
+    {
+        RangeSearchPartialResult pres(result);
+        MIHQuery mq(*this);
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            RangeQueryResult& qres = pres.new_result(i);
+            const uint8_t* q = x + i * code_size;
+            Run_mih_range_search_1 r;
+            dispatch_HammingComputer(code_size, r, &mq, q, radius, &qres);
+        }
+        pres.finalize();
+        n0 += mq.n0;
+        nlist += mq.nlist;
+        ndis += mq.ndis;
+    }
+    indexBinaryHash_stats.nq += n;
+    indexBinaryHash_stats.n0 += n0;
+    indexBinaryHash_stats.nlist += nlist;
+    indexBinaryHash_stats.ndis += ndis;
+}
+
+void IndexBinaryMIH::search(
+        idx_t n,
+        const uint8_t* x,
+        idx_t k,
+        int32_t* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT_MSG(
+            !params, "search params not supported for this index");
+    FAISS_THROW_IF_NOT(k > 0);
+
+    using HeapForL2 = CMax<int32_t, idx_t>;
+    size_t nlist = 0, ndis = 0, n0 = 0;
+
+#pragma omp parallel if (n > 100) reduction(+ : nlist, ndis, n0)
+    {
+        MIHQuery mq(*this);
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            int32_t* simi = distances + k * i;
+            idx_t* idxi = labels + k * i;
+
+            heap_heapify<HeapForL2>(k, simi, idxi);
+            const uint8_t* q = x + i * code_size;
+            Run_mih_knn_1 r;
+            dispatch_HammingComputer(code_size, r, &mq, q, k, simi, idxi);
+            heap_reorder<HeapForL2>(k, simi, idxi);
+        }
+        n0 += mq.n0;
+        nlist += mq.nlist;
+        ndis += mq.ndis;
+    }
+    indexBinaryHash_stats.nq += n;
+    indexBinaryHash_stats.n0 += n0;
+    indexBinaryHash_stats.nlist += nlist;
+    indexBinaryHash_stats.ndis += ndis;
+}
+
 } // namespace faiss
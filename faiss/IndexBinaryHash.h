@@ -123,6 +123,80 @@ struct IndexBinaryMultiHash : IndexBinary {
     size_t hashtable_size() const;
 };
 
+/** Multi-index hashing (MIH), see "Fast exact search in Hamming space with
+ * multi-index hashing", Norouzi et al., TPAMI'14.
+ *
+ * The d bits of the codes are split into nhash contiguous substrings of
+ * d / nhash or d / nhash + 1 bits. Each substring is indexed in a table
+ * that stores the ids of the vectors sorted by substring value, in a
+ * compressed sparse row (CSR) layout.
+ *
+ * Unlike IndexBinaryMultiHash, the search is exact: by the pigeonhole
+ * principle, a vector at Hamming distance <= r from the query is at
+ * distance <= r / nhash from it on at least one substring, so it is
+ * sufficient to look up the buckets within this radius in each table. The
+ * k-NN search increases the radius until the k-th result is guaranteed.
+ */
+struct IndexBinaryMIH : IndexBinary {
+    /// the codes, size ntotal * code_size
+    std::vector<uint8_t> xb;
+
+    /// nb of substrings (= nb of tables)
+    int nhash = 0;
+
+    /// bucket table of one substring
+    struct Table {
+        /// distinct values of the substring, sorted
+        std::vector<uint32_t> keys;
+        /// bucket i is ids[offsets[i]] .. ids[offsets[i + 1] - 1]
+        std::vector<idx_t> offsets;
+        /// ids of the vectors, sorted by key
+        std::vector<idx_t> ids;
+    };
+
+    /// the tables, size nhash
+    std::vector<Table> tables;
+
+    IndexBinaryMIH(int d, int nhash);
+
+    IndexBinaryMIH();
+
+    /// first bit and nb of bits of substring h
+    int substring_start(int h) const;
+    int substring_length(int h) const;
+
+    void reset() override;
+
+    void add(idx_t n, const uint8_t* x) override;
+
+    /// rebuild the tables from the codes, eg. after deserialization
+    void rebuild_tables();
+
+    void range_search(
+            idx_t n,
+            const uint8_t* x,
+            int radius,
+            RangeSearchResult* result,
+            const SearchParameters* params = nullptr) const override;
+
+    void search(
+            idx_t n,
+            const uint8_t* x,
+            idx_t k,
+            int32_t* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, uint8_t* recons) const override;
+
+    /// total nb of buckets over all tables
+    size_t hashtable_size() const;
+
+   private:
+    /// add the vectors x, with ids i0.. to the tables
+    void add_to_tables(idx_t n, const uint8_t* x, idx_t i0);
+};
+
 } // namespace faiss
 
 #endif
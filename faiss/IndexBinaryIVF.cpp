@@ -145,7 +145,8 @@ void IndexBinaryIVF::reconstruct_n(idx_t i0, idx_t ni, uint8_t* recons) const {
 
     for (idx_t list_no = 0; list_no < nlist; list_no++) {
         size_t list_size = invlists->list_size(list_no);
-        const idx_t* idlist = invlists->get_ids(list_no);
+        InvertedLists::ScopedIds sids(invlists, list_no);
+        const idx_t* idlist = sids.get();
 
         for (idx_t offset = 0; offset < list_size; offset++) {
             idx_t id = idlist[offset];
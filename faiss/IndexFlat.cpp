@@ -12,8 +12,12 @@
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/bf16.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/distances_bf16.h>
+#include <faiss/utils/distances_int8.h>
 #include <faiss/utils/extra_distances.h>
+#include <faiss/utils/metrics.h>
 #include <faiss/utils/prefetch.h>
 #include <faiss/utils/sorting.h>
 #include <cstring>
@@ -32,6 +36,8 @@ void IndexFlat::search(
         const SearchParameters* params) const {
     IDSelector* sel = params ? params->sel : nullptr;
     FAISS_THROW_IF_NOT(k > 0);
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
+    metrics_add(METRIC_NDIS, n * ntotal);
 
     // we see the distances and labels as heaps
     if (metric_type == METRIC_INNER_PRODUCT) {
@@ -127,6 +133,10 @@ struct FlatL2Dis : FlatCodesDistanceComputer {
         q = x;
     }
 
+    const float* get_query() override {
+        return q;
+    }
+
     // compute four distances
     void distances_batch_4(
             const idx_t idx0,
@@ -191,6 +201,10 @@ struct FlatIPDis : FlatCodesDistanceComputer {
         q = x;
     }
 
+    const float* get_query() override {
+        return q;
+    }
+
     // compute four distances
     void distances_batch_4(
             const idx_t idx0,
@@ -314,6 +328,10 @@ struct FlatL2WithNormsDis : FlatCodesDistanceComputer {
         query_l2norm = fvec_norm_L2sqr(q, d);
     }
 
+    const float* get_query() override {
+        return q;
+    }
+
     // compute four distances
     void distances_batch_4(
             const idx_t idx0,
@@ -517,4 +535,243 @@ void IndexFlat1D::search(
     }
 }
 
+/***************************************************
+ * IndexFlatBF16
+ ***************************************************/
+
+IndexFlatBF16::IndexFlatBF16(idx_t d, MetricType metric)
+        : IndexFlatCodes(sizeof(uint16_t) * d, d, metric) {}
+
+IndexFlatBF16::IndexFlatBF16() = default;
+
+void IndexFlatBF16::add_ex(idx_t n, const void* x, NumericType numeric_type) {
+    if (numeric_type == BFloat16) {
+        add_sa_codes(n, (const uint8_t*)x, nullptr);
+    } else {
+        IndexFlatCodes::add_ex(n, x, numeric_type);
+    }
+}
+
+void IndexFlatBF16::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    IDSelector* sel = params ? params->sel : nullptr;
+    FAISS_THROW_IF_NOT(k > 0);
+
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        knn_inner_product_bf16(
+                x, get_xb(), d, n, ntotal, k, distances, labels, sel);
+    } else if (metric_type == METRIC_L2) {
+        knn_L2sqr_bf16(x, get_xb(), d, n, ntotal, k, distances, labels, sel);
+    } else {
+        IndexFlatCodes::search(n, x, k, distances, labels, params);
+    }
+}
+
+void IndexFlatBF16::range_search(
+        idx_t n,
+        const float* x,
+        float radius,
+        RangeSearchResult* result,
+        const SearchParameters* params) const {
+    IDSelector* sel = params ? params->sel : nullptr;
+
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        range_search_inner_product_bf16(
+                x, get_xb(), d, n, ntotal, radius, result, sel);
+    } else if (metric_type == METRIC_L2) {
+        range_search_L2sqr_bf16(x, get_xb(), d, n, ntotal, radius, result, sel);
+    } else {
+        IndexFlatCodes::range_search(n, x, radius, result, params);
+    }
+}
+
+namespace {
+
+template <bool is_l2>
+struct FlatBF16Dis : FlatCodesDistanceComputer {
+    size_t d;
+    const float* q = nullptr;
+    std::vector<float> tmp;
+
+    explicit FlatBF16Dis(const IndexFlatBF16& storage)
+            : FlatCodesDistanceComputer(
+                      storage.codes.data(),
+                      storage.code_size),
+              d(storage.d),
+              tmp(storage.d) {}
+
+    float distance(const float* x, const uint8_t* code) const {
+        const uint16_t* y = (const uint16_t*)code;
+        return is_l2 ? fvec_L2sqr_bf16(x, y, d)
+                     : fvec_inner_product_bf16(x, y, d);
+    }
+
+    float distance_to_code(const uint8_t* code) final {
+        return distance(q, code);
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) final {
+        const uint16_t* xi = (const uint16_t*)(codes + i * code_size);
+        for (size_t l = 0; l < d; l++) {
+            tmp[l] = decode_bf16(xi[l]);
+        }
+        return distance(tmp.data(), codes + j * code_size);
+    }
+
+    void set_query(const float* x) final {
+        q = x;
+    }
+
+    const float* get_query() final {
+        return q;
+    }
+};
+
+} // namespace
+
+FlatCodesDistanceComputer* IndexFlatBF16::get_FlatCodesDistanceComputer()
+        const {
+    if (metric_type == METRIC_L2) {
+        return new FlatBF16Dis<true>(*this);
+    } else if (metric_type == METRIC_INNER_PRODUCT) {
+        return new FlatBF16Dis<false>(*this);
+    } else {
+        return IndexFlatCodes::get_FlatCodesDistanceComputer();
+    }
+}
+
+void IndexFlatBF16::sa_encode(idx_t n, const float* x, uint8_t* bytes)
+        const {
+    uint16_t* y = (uint16_t*)bytes;
+    for (size_t i = 0; i < n * d; i++) {
+        y[i] = encode_bf16(x[i]);
+    }
+}
+
+void IndexFlatBF16::sa_decode(idx_t n, const uint8_t* bytes, float* x)
+        const {
+    const uint16_t* y = (const uint16_t*)bytes;
+#pragma omp parallel for if (n > 1000)
+    for (idx_t i = 0; i < n; i++) {
+        for (size_t j = i * d; j < (i + 1) * d; j++) {
+            x[j] = decode_bf16(y[j]);
+        }
+    }
+}
+
+/***************************************************
+ * IndexFlatInt8
+ ***************************************************/
+
+IndexFlatInt8::IndexFlatInt8(idx_t d, MetricType metric)
+        : IndexFlatCodes(int8_code_size(d), d, metric) {}
+
+IndexFlatInt8::IndexFlatInt8() = default;
+
+void IndexFlatInt8::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    IDSelector* sel = params ? params->sel : nullptr;
+    FAISS_THROW_IF_NOT(k > 0);
+
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        knn_inner_product_int8(
+                x, codes.data(), d, n, ntotal, k, distances, labels, sel);
+    } else if (metric_type == METRIC_L2) {
+        knn_L2sqr_int8(
+                x, codes.data(), d, n, ntotal, k, distances, labels, sel);
+    } else {
+        IndexFlatCodes::search(n, x, k, distances, labels, params);
+    }
+}
+
+void IndexFlatInt8::range_search(
+        idx_t n,
+        const float* x,
+        float radius,
+        RangeSearchResult* result,
+        const SearchParameters* params) const {
+    IDSelector* sel = params ? params->sel : nullptr;
+
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        range_search_inner_product_int8(
+                x, codes.data(), d, n, ntotal, radius, result, sel);
+    } else if (metric_type == METRIC_L2) {
+        range_search_L2sqr_int8(
+                x, codes.data(), d, n, ntotal, radius, result, sel);
+    } else {
+        IndexFlatCodes::range_search(n, x, radius, result, params);
+    }
+}
+
+namespace {
+
+template <bool is_l2>
+struct FlatInt8Dis : FlatCodesDistanceComputer {
+    size_t d;
+    const float* q = nullptr;
+    std::vector<float> tmp;
+
+    explicit FlatInt8Dis(const IndexFlatInt8& storage)
+            : FlatCodesDistanceComputer(
+                      storage.codes.data(),
+                      storage.code_size),
+              d(storage.d),
+              tmp(storage.d) {}
+
+    float distance(const float* x, const uint8_t* code) const {
+        return is_l2 ? fvec_L2sqr_int8(x, code, d)
+                     : fvec_inner_product_int8(x, code, d);
+    }
+
+    float distance_to_code(const uint8_t* code) final {
+        return distance(q, code);
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) final {
+        int8_decode(codes + i * code_size, d, 1, tmp.data());
+        return distance(tmp.data(), codes + j * code_size);
+    }
+
+    void set_query(const float* x) final {
+        q = x;
+    }
+
+    const float* get_query() final {
+        return q;
+    }
+};
+
+} // namespace
+
+FlatCodesDistanceComputer* IndexFlatInt8::get_FlatCodesDistanceComputer()
+        const {
+    if (metric_type == METRIC_L2) {
+        return new FlatInt8Dis<true>(*this);
+    } else if (metric_type == METRIC_INNER_PRODUCT) {
+        return new FlatInt8Dis<false>(*this);
+    } else {
+        return IndexFlatCodes::get_FlatCodesDistanceComputer();
+    }
+}
+
+void IndexFlatInt8::sa_encode(idx_t n, const float* x, uint8_t* bytes)
+        const {
+    int8_encode(x, d, n, bytes);
+}
+
+void IndexFlatInt8::sa_decode(idx_t n, const uint8_t* bytes, float* x)
+        const {
+    int8_decode(bytes, d, n, x);
+}
+
 } // namespace faiss
@@ -125,6 +125,81 @@ struct IndexFlat1D : IndexFlatL2 {
             const SearchParameters* params = nullptr) const override;
 };
 
+/** Flat index that stores the vectors in bf16, half the memory of
+ * IndexFlat. The knn and range searches for METRIC_L2 and
+ * METRIC_INNER_PRODUCT run on blocks of queries x database vectors, see
+ * distances_bf16.h. The other metrics use the generic IndexFlatCodes
+ * search on the decoded vectors.
+ */
+struct IndexFlatBF16 : IndexFlatCodes {
+    explicit IndexFlatBF16(idx_t d, MetricType metric = METRIC_L2);
+
+    IndexFlatBF16();
+
+    /// bf16 vectors are copied as is
+    void add_ex(idx_t n, const void* x, NumericType numeric_type) override;
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void range_search(
+            idx_t n,
+            const float* x,
+            float radius,
+            RangeSearchResult* result,
+            const SearchParameters* params = nullptr) const override;
+
+    FlatCodesDistanceComputer* get_FlatCodesDistanceComputer() const override;
+
+    /// the bf16 vectors, size ntotal * d
+    const uint16_t* get_xb() const {
+        return (const uint16_t*)codes.data();
+    }
+
+    void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
+
+    void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+};
+
+/** Flat index that stores the vectors quantized to int8 with one scale per
+ * vector (see distances_int8.h), about a quarter of the memory of
+ * IndexFlat. The knn and range searches for METRIC_L2 and
+ * METRIC_INNER_PRODUCT quantize the queries as well and compute the
+ * distances with int8 dot products. The other metrics use the generic
+ * IndexFlatCodes search on the decoded vectors.
+ */
+struct IndexFlatInt8 : IndexFlatCodes {
+    explicit IndexFlatInt8(idx_t d, MetricType metric = METRIC_L2);
+
+    IndexFlatInt8();
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void range_search(
+            idx_t n,
+            const float* x,
+            float radius,
+            RangeSearchResult* result,
+            const SearchParameters* params = nullptr) const override;
+
+    FlatCodesDistanceComputer* get_FlatCodesDistanceComputer() const override;
+
+    void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
+
+    void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+};
+
 } // namespace faiss
 
 #endif
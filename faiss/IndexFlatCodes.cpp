@@ -7,6 +7,9 @@
 
 #include <faiss/IndexFlatCodes.h>
 
+#include <algorithm>
+#include <cstring>
+
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/CodePacker.h>
 #include <faiss/impl/DistanceComputer.h>
@@ -14,6 +17,8 @@
 #include <faiss/impl/IDSelector.h>
 #include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/extra_distances.h>
+#include <faiss/utils/metrics.h>
+#include <faiss/utils/utils.h>
 
 namespace faiss {
 
@@ -27,6 +32,7 @@ void IndexFlatCodes::add(idx_t n, const float* x) {
     if (n == 0) {
         return;
     }
+    MetricsCallTimer timer(METRIC_ADD_VECTORS, METRIC_ADD_LATENCY, n);
     codes.resize((ntotal + n) * code_size);
     sa_encode(n, x, codes.data() + (ntotal * code_size));
     ntotal += n;
@@ -81,6 +87,25 @@ void IndexFlatCodes::reconstruct(idx_t key, float* recons) const {
     reconstruct_n(key, 1, recons);
 }
 
+void IndexFlatCodes::reconstruct_batch(
+        idx_t n,
+        const idx_t* keys,
+        float* recons) const {
+    const idx_t bs = 4096;
+    std::vector<uint8_t> gathered(std::min(n, bs) * code_size);
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(i0 + bs, n);
+        for (idx_t i = i0; i < i1; i++) {
+            FAISS_THROW_IF_NOT_MSG(
+                    keys[i] >= 0 && keys[i] < ntotal, "invalid key");
+            memcpy(gathered.data() + (i - i0) * code_size,
+                   codes.data() + keys[i] * code_size,
+                   code_size);
+        }
+        sa_decode(i1 - i0, gathered.data(), recons + i0 * d);
+    }
+}
+
 void IndexFlatCodes::check_compatible_for_merge(const Index& otherIndex) const {
     // minimal sanity checks
     const IndexFlatCodes* other =
@@ -93,6 +118,10 @@ void IndexFlatCodes::check_compatible_for_merge(const Index& otherIndex) const {
             "can only merge indexes of the same type");
 }
 
+size_t IndexFlatCodes::warmup(const WarmupPolicy&) const {
+    return warmup_memory(codes.data(), ntotal * code_size);
+}
+
 void IndexFlatCodes::merge_from(Index& otherIndex, idx_t add_id) {
     FAISS_THROW_IF_NOT_MSG(add_id == 0, "cannot set ids in FlatCodes index");
     check_compatible_for_merge(otherIndex);
@@ -180,6 +209,28 @@ struct GenericFlatCodesDistanceComputer : FlatCodesDistanceComputer {
         dis2 = vd(query, vec_buffer.data() + 2 * vd.d);
         dis3 = vd(query, vec_buffer.data() + 3 * vd.d);
     }
+    // decode the codes with one sa_decode call per block of ids, which is
+    // much faster for codecs with batched decoders (eg. neural nets)
+    void distances_batch(
+            const std::vector<idx_t>& ids,
+            std::vector<float>& distances_out) override {
+        constexpr size_t bs = 256;
+        code_buffer.resize(bs * code_size);
+        vec_buffer.resize(bs * vd.d);
+        for (size_t i0 = 0; i0 < ids.size(); i0 += bs) {
+            size_t i1 = std::min(ids.size(), i0 + bs);
+            for (size_t i = i0; i < i1; i++) {
+                memcpy(code_buffer.data() + (i - i0) * code_size,
+                       codes + ids[i] * code_size,
+                       code_size);
+            }
+            codec.sa_decode(i1 - i0, code_buffer.data(), vec_buffer.data());
+            for (size_t i = i0; i < i1; i++) {
+                distances_out[i] =
+                        vd(query, vec_buffer.data() + (i - i0) * vd.d);
+            }
+        }
+    }
 };
 
 struct Run_get_distance_computer {
@@ -260,6 +311,8 @@ void IndexFlatCodes::search(
         float* distances,
         idx_t* labels,
         const SearchParameters* params) const {
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
+    metrics_add(METRIC_NDIS, n * ntotal);
     Run_search_with_decompress_res r;
     const IDSelector* sel = params ? params->sel : nullptr;
     dispatch_knn_ResultHandler(
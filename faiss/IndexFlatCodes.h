@@ -38,6 +38,10 @@ struct IndexFlatCodes : Index {
 
     void reconstruct(idx_t key, float* recons) const override;
 
+    /// gathers the codes of the keys and decodes them with sa_decode
+    void reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+            const override;
+
     size_t sa_code_size() const override;
 
     /** remove some ids. NB that because of the structure of the
@@ -83,6 +87,9 @@ struct IndexFlatCodes : Index {
 
     // permute_entries. perm of size ntotal maps new to old positions
     void permute_entries(const idx_t* perm);
+
+    /// warms all the codes: the searches scan them all
+    size_t warmup(const WarmupPolicy& policy = WarmupPolicy()) const override;
 };
 
 } // namespace faiss
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexFlatOnDisk.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <faiss/impl/BatchedFileReader.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+IndexFlatOnDisk::IndexFlatOnDisk(
+        idx_t d,
+        const std::string& filename,
+        MetricType metric,
+        off_t data_offset,
+        bool truncate)
+        : Index(d, metric), filename(filename), data_offset(data_offset) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+            "IndexFlatOnDisk supports only L2 and inner product");
+    FAISS_THROW_IF_NOT_FMT(
+            data_offset >= 0, "data offset (%ld) invalid", (long)data_offset);
+
+    int wfd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    FAISS_THROW_IF_NOT_FMT(
+            wfd >= 0,
+            "cannot open vector file %s: %s",
+            filename.c_str(),
+            strerror(errno));
+    if (truncate) {
+        FAISS_THROW_IF_NOT_FMT(
+                ftruncate(wfd, data_offset) == 0,
+                "cannot truncate %s: %s",
+                filename.c_str(),
+                strerror(errno));
+    }
+    struct stat file_stat;
+    int ret = fstat(wfd, &file_stat);
+    close(wfd);
+    FAISS_THROW_IF_NOT_FMT(
+            ret == 0,
+            "cannot stat vector file %s: %s",
+            filename.c_str(),
+            strerror(errno));
+
+    size_t row_bytes = d * sizeof(float);
+    ntotal = file_stat.st_size > data_offset
+            ? (file_stat.st_size - data_offset) / row_bytes
+            : 0;
+    cache_slots.assign(ntotal, -1);
+    is_trained = true;
+}
+
+IndexFlatOnDisk::IndexFlatOnDisk() = default;
+
+IndexFlatOnDisk::~IndexFlatOnDisk() {
+    close_fd();
+}
+
+int IndexFlatOnDisk::get_fd() const {
+    std::lock_guard<std::mutex> lock(fd_mutex);
+    if (fd >= 0) {
+        return fd;
+    }
+#ifdef __linux__
+    if (use_direct_io) {
+        fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    }
+#endif
+    if (fd < 0) {
+        fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0,
+            "cannot open vector file %s: %s",
+            filename.c_str(),
+            strerror(errno));
+    return fd;
+}
+
+void IndexFlatOnDisk::close_fd() {
+    std::lock_guard<std::mutex> lock(fd_mutex);
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void IndexFlatOnDisk::add(idx_t n, const float* x) {
+    if (n == 0) {
+        return;
+    }
+    int wfd = open(filename.c_str(), O_WRONLY | O_CLOEXEC);
+    FAISS_THROW_IF_NOT_FMT(
+            wfd >= 0,
+            "cannot open vector file %s: %s",
+            filename.c_str(),
+            strerror(errno));
+    size_t row_bytes = d * sizeof(float);
+    off_t offset = data_offset + (off_t)(ntotal * row_bytes);
+    size_t nbytes = n * row_bytes;
+    size_t done = 0;
+    while (done < nbytes) {
+        ssize_t ret =
+                pwrite(wfd, (const char*)x + done, nbytes - done, offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            int err = errno;
+            close(wfd);
+            FAISS_THROW_FMT(
+                    "write error in %s at offset %ld: %s",
+                    filename.c_str(),
+                    (long)(offset + done),
+                    strerror(err));
+        }
+        done += ret;
+    }
+    close(wfd);
+    ntotal += n;
+    cache_slots.resize(ntotal, -1);
+}
+
+void IndexFlatOnDisk::reset() {
+    FAISS_THROW_IF_NOT_FMT(
+            truncate(filename.c_str(), data_offset) == 0,
+            "cannot truncate %s: %s",
+            filename.c_str(),
+            strerror(errno));
+    ntotal = 0;
+    cache_slots.clear();
+    cached_ids.clear();
+    cache_data.clear();
+}
+
+size_t IndexFlatOnDisk::read_vectors(size_t n, const idx_t* ids, float* out)
+        const {
+    size_t row_bytes = d * sizeof(float);
+    std::vector<BatchedFileReader::Request> requests;
+    for (size_t i = 0; i < n; i++) {
+        idx_t id = ids[i];
+        FAISS_THROW_IF_NOT_FMT(
+                id >= 0 && id < ntotal,
+                "id %ld out of range [0, %ld)",
+                (long)id,
+                (long)ntotal);
+        if (cache_slots[id] >= 0) {
+            memcpy(out + i * d,
+                   cache_data.data() + (size_t)cache_slots[id] * d,
+                   row_bytes);
+        } else {
+            requests.push_back(
+                    {data_offset + (off_t)(id * row_bytes),
+                     row_bytes,
+                     out + i * d});
+        }
+    }
+    if (!requests.empty()) {
+        BatchedFileReader::thread_local_reader().read(get_fd(), requests);
+    }
+    return requests.size();
+}
+
+void IndexFlatOnDisk::cache_vectors(const std::vector<idx_t>& ids) {
+    std::vector<idx_t> sorted_ids = ids;
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(
+            std::unique(sorted_ids.begin(), sorted_ids.end()),
+            sorted_ids.end());
+
+    std::fill(cache_slots.begin(), cache_slots.end(), -1);
+    cached_ids.clear();
+    cache_data.resize(sorted_ids.size() * d);
+    read_vectors(sorted_ids.size(), sorted_ids.data(), cache_data.data());
+
+    cached_ids = std::move(sorted_ids);
+    for (size_t i = 0; i < cached_ids.size(); i++) {
+        cache_slots[cached_ids[i]] = i;
+    }
+}
+
+void IndexFlatOnDisk::reconstruct(idx_t key, float* recons) const {
+    read_vectors(1, &key, recons);
+}
+
+void IndexFlatOnDisk::reconstruct_batch(
+        idx_t n,
+        const idx_t* keys,
+        float* recons) const {
+    read_vectors(n, keys, recons);
+}
+
+namespace {
+
+template <class HeapArray>
+void search_blocks(
+        const IndexFlatOnDisk& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels) {
+    size_t d = index.d;
+    HeapArray res = {size_t(n), size_t(k), labels, distances};
+    res.heapify();
+
+    size_t bs = std::max(index.search_block_size, size_t(1));
+    std::vector<float> block;
+    std::vector<idx_t> ids;
+    std::vector<float> D(n * k);
+    std::vector<idx_t> I(n * k);
+    for (idx_t i0 = 0; i0 < index.ntotal; i0 += bs) {
+        idx_t i1 = std::min(index.ntotal, idx_t(i0 + bs));
+        ids.resize(i1 - i0);
+        for (idx_t i = i0; i < i1; i++) {
+            ids[i - i0] = i;
+        }
+        block.resize((i1 - i0) * d);
+        index.read_vectors(i1 - i0, ids.data(), block.data());
+
+        if (index.metric_type == METRIC_L2) {
+            knn_L2sqr(x, block.data(), d, n, i1 - i0, k, D.data(), I.data());
+        } else {
+            knn_inner_product(
+                    x, block.data(), d, n, i1 - i0, k, D.data(), I.data());
+        }
+        for (idx_t& id : I) {
+            if (id >= 0) {
+                id += i0;
+            }
+        }
+        res.addn_with_ids(k, D.data(), I.data(), k);
+    }
+    res.reorder();
+}
+
+struct FlatOnDiskDistanceComputer : DistanceComputer {
+    const IndexFlatOnDisk& index;
+    size_t d;
+    const float* q = nullptr;
+    std::vector<float> buf;
+    size_t nfetch = 0;
+
+    explicit FlatOnDiskDistanceComputer(const IndexFlatOnDisk& index)
+            : index(index), d(index.d), buf(2 * index.d) {}
+
+    float dis(const float* x, const float* y) const {
+        return index.metric_type == METRIC_INNER_PRODUCT
+                ? fvec_inner_product(x, y, d)
+                : fvec_L2sqr(x, y, d);
+    }
+
+    void set_query(const float* x) override {
+        q = x;
+    }
+
+    const float* get_query() override {
+        return q;
+    }
+
+    float operator()(idx_t i) override {
+        nfetch += index.read_vectors(1, &i, buf.data());
+        return dis(q, buf.data());
+    }
+
+    void distances_batch(
+            const std::vector<idx_t>& ids,
+            std::vector<float>& distances_out) override {
+        buf.resize(std::max(ids.size(), size_t(2)) * d);
+        nfetch += index.read_vectors(ids.size(), ids.data(), buf.data());
+        for (size_t i = 0; i < ids.size(); i++) {
+            distances_out[i] = dis(q, buf.data() + i * d);
+        }
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        idx_t ij[2] = {i, j};
+        nfetch += index.read_vectors(2, ij, buf.data());
+        return dis(buf.data(), buf.data() + d);
+    }
+
+    size_t get_fetch_count() const override {
+        return nfetch;
+    }
+
+    void reset_fetch_count() override {
+        nfetch = 0;
+    }
+};
+
+} // anonymous namespace
+
+void IndexFlatOnDisk::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            !params || !params->sel,
+            "IndexFlatOnDisk does not support search with an IDSelector");
+    if (metric_type == METRIC_L2) {
+        search_blocks<float_maxheap_array_t>(
+                *this, n, x, k, distances, labels);
+    } else {
+        search_blocks<float_minheap_array_t>(
+                *this, n, x, k, distances, labels);
+    }
+}
+
+DistanceComputer* IndexFlatOnDisk::get_distance_computer() const {
+    return new FlatOnDiskDistanceComputer(*this);
+}
+
+} // namespace faiss
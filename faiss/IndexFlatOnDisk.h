@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <sys/types.h> // For off_t
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/** Full-precision vectors stored in a flat file rather than in RAM.
+ *
+ * It is meant to be the refine_index of an IndexRefine, when the compressed
+ * codes of the base index fit in RAM but the full-precision vectors do not:
+ *
+ *     IndexRefine index(base_index, new IndexFlatOnDisk(d, "vectors.bin"));
+ *
+ * The file holds ntotal rows of d floats starting at data_offset and up to
+ * the end of the file, so an existing file can be used as is (eg. the
+ * output of write_index for an IndexFlat, see
+ * HybridEmbeddingStore::flat_storage_data_offset). add() appends rows to it.
+ *
+ * The distance computer reads the candidates of a query with a single batch
+ * of block-aligned reads (BatchedFileReader: io_uring when available, the
+ * file is opened with O_DIRECT by default), and IndexRefine processes the
+ * queries of a search in parallel. A set of frequently accessed vectors can
+ * be kept in RAM with cache_vectors.
+ *
+ * Only the file name and the configuration are serialized, not the vectors.
+ */
+struct IndexFlatOnDisk : Index {
+    std::string filename;
+    off_t data_offset = 0;
+
+    /// open the file with O_DIRECT (Linux only) to bypass the page cache
+    bool use_direct_io = true;
+
+    /// size of the blocks of vectors read by search()
+    size_t search_block_size = 16384;
+
+    /** opens or creates the file. ntotal is derived from the file size.
+     *
+     * @param truncate  drop the vectors stored in the file
+     */
+    IndexFlatOnDisk(
+            idx_t d,
+            const std::string& filename,
+            MetricType metric = METRIC_L2,
+            off_t data_offset = 0,
+            bool truncate = false);
+
+    IndexFlatOnDisk();
+
+    ~IndexFlatOnDisk() override;
+
+    /// appends the vectors to the file
+    void add(idx_t n, const float* x) override;
+
+    /// truncates the file to data_offset
+    void reset() override;
+
+    /// exhaustive search, the file is read sequentially
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    void reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+            const override;
+
+    /// the distances_batch of this distance computer reads all the vectors
+    /// at once
+    DistanceComputer* get_distance_computer() const override;
+
+    /// keep these vectors in RAM (replaces the previous set)
+    void cache_vectors(const std::vector<idx_t>& ids);
+
+    const std::vector<idx_t>& get_cached_ids() const {
+        return cached_ids;
+    }
+
+    /** read n vectors from the cache or the file into out (size n * d).
+     * @return nb of vectors read from the file */
+    size_t read_vectors(size_t n, const idx_t* ids, float* out) const;
+
+    IndexFlatOnDisk(const IndexFlatOnDisk&) = delete;
+    IndexFlatOnDisk& operator=(const IndexFlatOnDisk&) = delete;
+
+   private:
+    /// slot of each id in cache_data, -1 if not cached
+    std::vector<int32_t> cache_slots;
+    std::vector<idx_t> cached_ids;
+    std::vector<float> cache_data;
+
+    /// opened on first read
+    mutable int fd = -1;
+    mutable std::mutex fd_mutex;
+
+    int get_fd() const;
+    void close_fd();
+};
+
+} // namespace faiss
@@ -8,7 +8,10 @@
 #include <faiss/IndexHNSW.h>
 
 #include <omp.h>
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -18,16 +21,30 @@
 #include <memory>
 #include <queue>
 #include <random>
+#include <set>
+#include <type_traits>
+#include <unordered_set>
 
 #include <cstdint>
 
+#include <faiss/Clustering.h>
 #include <faiss/Index2Layer.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexIDMap.h>
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPQ.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/HNSWSpecializedSearch.h>
+#include <faiss/impl/HNSWTrace.h>
+#include <faiss/impl/IDSelector.h>
 #include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/SearchEffortPredictor.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/AlignedTable.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/executor.h>
+#include <faiss/utils/metrics.h>
 #include <faiss/utils/random.h>
 #include <faiss/utils/sorting.h>
 
@@ -85,9 +102,16 @@ void hnsw_add_vertices(
         printf("  max_level = %d\n", max_level);
     }
 
-    std::vector<omp_lock_t> locks(ntotal);
-    for (int i = 0; i < ntotal; i++)
-        omp_init_lock(&locks[i]);
+    bool concurrent = index_hnsw.concurrent_add;
+    std::vector<omp_lock_t> locks;
+    std::vector<HNSWSpinLock> spinlocks;
+    if (concurrent) {
+        spinlocks = std::vector<HNSWSpinLock>(ntotal);
+    } else {
+        locks.resize(ntotal);
+        for (int i = 0; i < ntotal; i++)
+            omp_init_lock(&locks[i]);
+    }
 
     // add vectors from highest to lowest level
     std::vector<int> hist;
@@ -121,6 +145,16 @@ void hnsw_add_vertices(
     idx_t check_period = InterruptCallback::get_period_hint(
             max_level * index_hnsw.d * hnsw.efConstruction);
 
+    // nb of vectors grabbed at a time by a thread in concurrent mode
+    const int add_chunk_size = 16;
+
+    // the distances are computed from the recomputed embeddings, the
+    // per-thread distance computers keep their buffers across the levels
+    bool recompute_build =
+            index_hnsw.is_recompute && index_hnsw.recompute_build;
+    std::vector<std::unique_ptr<RecomputeBuildDistanceComputer>> build_dis(
+            recompute_build ? omp_get_max_threads() : 0);
+
     { // perform add
         RandomGenerator rng2(789);
 
@@ -182,21 +216,36 @@ void hnsw_add_vertices(
                 printf("Degree threshold: %d\n", degree_threshold);
             }
 
+            std::atomic<int> next_chunk(i0);
 #pragma omp parallel if (i1 > i0 + 100)
             {
                 VisitedTable vt(ntotal);
 
-                std::unique_ptr<DistanceComputer> dis(
-                        storage_distance_computer(index_hnsw.storage));
+                std::unique_ptr<DistanceComputer> storage_dis;
+                DistanceComputer* dis;
+                if (recompute_build) {
+                    auto& rdis = build_dis[omp_get_thread_num()];
+                    if (!rdis) {
+                        rdis.reset(new RecomputeBuildDistanceComputer(
+                                d,
+                                index_hnsw.metric_type,
+                                index_hnsw.build_buffer_size,
+                                index_hnsw.build_zmq_port));
+                        rdis->fetcher.provider =
+                                index_hnsw.embedding_provider.get();
+                        rdis->set_local_vectors(n0, n, x);
+                    }
+                    dis = rdis.get();
+                } else {
+                    storage_dis.reset(
+                            storage_distance_computer(index_hnsw.storage));
+                    dis = storage_dis.get();
+                }
                 int prev_display =
                         verbose && omp_get_thread_num() == 0 ? 0 : -1;
                 size_t counter = 0;
 
-                // here we should do schedule(dynamic) but this segfaults for
-                // some versions of LLVM. The performance impact should not be
-                // too large when (i1 - i0) / num_threads >> 1
-#pragma omp for schedule(static)
-                for (int i = i0; i < i1; i++) {
+                auto add_vertex = [&](int i) {
                     storage_idx_t pt_id = order[i];
                     bool prune = false;
                     if (pt_level == 0 && prune) {
@@ -228,16 +277,28 @@ void hnsw_add_vertices(
 
                     // cannot break
                     if (interrupt) {
-                        continue;
+                        return;
                     }
 
-                    hnsw.add_with_locks(
-                            *dis,
-                            pt_level,
-                            pt_id,
-                            locks,
-                            vt,
-                            index_hnsw.keep_max_size_level0 && (pt_level == 0));
+                    bool keep_max_size =
+                            index_hnsw.keep_max_size_level0 && (pt_level == 0);
+                    if (concurrent) {
+                        hnsw.add_with_locks(
+                                *dis,
+                                pt_level,
+                                pt_id,
+                                spinlocks,
+                                vt,
+                                keep_max_size);
+                    } else {
+                        hnsw.add_with_locks(
+                                *dis,
+                                pt_level,
+                                pt_id,
+                                locks,
+                                vt,
+                                keep_max_size);
+                    }
 
                     if (prev_display >= 0 && i - i0 > prev_display + 10000) {
                         prev_display = i - i0;
@@ -250,6 +311,31 @@ void hnsw_add_vertices(
                         }
                     }
                     counter++;
+                };
+
+                if (concurrent) {
+                    // threads that are done with their chunk grab the next
+                    // one, which balances the load without omp dynamic
+                    // scheduling
+                    for (;;) {
+                        int c0 = next_chunk.fetch_add(add_chunk_size);
+                        if (c0 >= i1) {
+                            break;
+                        }
+                        int c1 = std::min(c0 + add_chunk_size, i1);
+                        for (int i = c0; i < c1; i++) {
+                            add_vertex(i);
+                        }
+                    }
+                } else {
+                    // here we should do schedule(dynamic) but this segfaults
+                    // for some versions of LLVM. The performance impact
+                    // should not be too large when (i1 - i0) / num_threads
+                    // >> 1
+#pragma omp for schedule(static)
+                    for (int i = i0; i < i1; i++) {
+                        add_vertex(i);
+                    }
                 }
             }
             if (interrupt) {
@@ -263,11 +349,19 @@ void hnsw_add_vertices(
             FAISS_ASSERT((i1 - hist[0]) == 0);
         }
     }
+    size_t n_failed_fetches = 0;
+    for (auto& rdis : build_dis) {
+        n_failed_fetches += rdis ? rdis->n_failed : 0;
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            n_failed_fetches == 0,
+            "%zd embeddings could not be fetched during the construction",
+            n_failed_fetches);
     if (verbose) {
         printf("Done in %.3f ms\n", getmillisecs() - t0);
     }
 
-    for (int i = 0; i < ntotal; i++) {
+    for (int i = 0; i < locks.size(); i++) {
         omp_destroy_lock(&locks[i]);
     }
 
@@ -315,6 +409,67 @@ void IndexHNSW::train(idx_t n, const float* x) {
 
 namespace {
 
+/// exhaustive search of the ids, for FILTER_BRUTE_FORCE
+HNSWStats search_selected(
+        DistanceComputer& dis,
+        ResultHandler<HNSW::C>& res,
+        const std::vector<idx_t>& ids) {
+    HNSWStats stats;
+    const size_t bs = 1024;
+    std::vector<idx_t> block;
+    std::vector<float> distances;
+    for (size_t j0 = 0; j0 < ids.size(); j0 += bs) {
+        size_t j1 = std::min(j0 + bs, ids.size());
+        block.assign(ids.begin() + j0, ids.begin() + j1);
+        distances.resize(block.size());
+        dis.distances_batch(block, distances);
+        res.add_results(block.size(), distances.data(), block.data());
+    }
+    stats.n1 = 1;
+    stats.ndis = ids.size();
+    return stats;
+}
+
+/// whether the search settings are those of the classic HNSW search, that
+/// the specialized searchers implement
+bool specialized_search_applies(
+        const IndexHNSW& index,
+        const SearchParameters* params,
+        SearchParametersHNSW::FilterStrategy filter_strategy,
+        int n_entry) {
+    const HNSW& hnsw = index.hnsw;
+    if (!index.specialized_search || index.is_recompute || index.node_blocks ||
+        index.upper_level_codes || n_entry > 0 || hnsw.neighbors_on_disk ||
+        hnsw.pruning_pq ||
+        (hnsw.pq_data_loader && hnsw.pq_data_loader->is_initialized()) ||
+        filter_strategy != SearchParametersHNSW::FILTER_POST) {
+        return false;
+    }
+    int beam_size = hnsw.beam_size;
+    bool batching = hnsw.batch_size > 0;
+    bool bounded_queue = hnsw.search_bounded_queue;
+    int early_stop_patience = hnsw.early_stop_patience;
+    if (params && params->budget) {
+        return false;
+    }
+    if (auto hnsw_params = dynamic_cast<const SearchParametersHNSW*>(params)) {
+        if (hnsw_params->beam_size > 0) {
+            beam_size = hnsw_params->beam_size;
+        }
+        batching = hnsw_params->batch_size > 0;
+        bounded_queue = hnsw_params->bounded_queue;
+        if (hnsw_params->early_stop_patience >= 0) {
+            early_stop_patience = hnsw_params->early_stop_patience;
+        }
+        if (hnsw_params->pipeline_depth > 0 || hnsw_params->visit_profiler ||
+            hnsw_params->effort_predictor) {
+            return false;
+        }
+    }
+    return beam_size <= 1 && !batching && bounded_queue &&
+            early_stop_patience <= 0;
+}
+
 template <class BlockResultHandler>
 void hnsw_search(
         const IndexHNSW* index,
@@ -337,66 +492,274 @@ void hnsw_search(
 
     int efSearch = hnsw.efSearch;
     int zmq_port = 5557;
+    bool coalesce_requests = false;
+    ZmqEmbeddingCache* embedding_cache = nullptr;
+    bool server_side_distances = false;
     if (params) {
         if (const SearchParametersHNSW* hnsw_params =
                     dynamic_cast<const SearchParametersHNSW*>(params)) {
             efSearch = hnsw_params->efSearch;
             zmq_port = hnsw_params->zmq_port;
+            coalesce_requests = hnsw_params->coalesce_requests;
+            embedding_cache = hnsw_params->embedding_cache;
+            server_side_distances = hnsw_params->server_side_distances;
         }
     }
-    size_t n1 = 0, n2 = 0, ndis = 0, nhops = 0;
-
-    std::unordered_map<idx_t, size_t> node_visit_counts;
-
-    // ---- Addition: Accumulator for fetch counts ----
-    size_t total_fetches_accum = 0;
-    // ---- End Addition ----
+    FAISS_THROW_IF_NOT_MSG(
+            !server_side_distances || !index->is_recompute ||
+                    ZmqConnectionPool::instance().uses_raw_frames(zmq_port),
+            "server side distances require a raw frame endpoint");
+    FAISS_THROW_IF_NOT_MSG(
+            !embedding_cache || embedding_cache->d == index->d,
+            "embedding cache dimension does not match the index");
+    FAISS_THROW_IF_NOT_MSG(
+            !index->embedding_provider ||
+                    index->embedding_provider->d == index->d,
+            "embedding provider dimension does not match the index");
+
+    // resolve FILTER_AUTO once for all the queries
+    SearchParametersHNSW::FilterStrategy filter_strategy =
+            hnsw_filter_strategy(params, index->ntotal);
+    SearchParametersHNSW resolved_params;
+    if (filter_strategy != SearchParametersHNSW::FILTER_POST) {
+        resolved_params = *dynamic_cast<const SearchParametersHNSW*>(params);
+        resolved_params.filter_strategy = filter_strategy;
+        params = &resolved_params;
+    }
+    const SearchBudget* budget = params ? params->budget : nullptr;
+    FAISS_THROW_IF_NOT_MSG(
+            !budget || dynamic_cast<const SearchParametersHNSW*>(params),
+            "IndexHNSW search budget requires SearchParametersHNSW");
+    // the features of query i are stored at effort_features + i * nfeatures
+    float* effort_features = nullptr;
+    int nfeatures = 0;
+    if (auto hnsw_params = dynamic_cast<const SearchParametersHNSW*>(params)) {
+        if (hnsw_params->effort_features) {
+            FAISS_THROW_IF_NOT_MSG(
+                    hnsw_params->effort_predictor,
+                    "effort_features requires an effort_predictor");
+            effort_features = hnsw_params->effort_features;
+            nfeatures = hnsw_params->effort_predictor->nfeatures;
+        }
+    }
+    // level 0 entry points selected from the table instead of the upper
+    // levels
+    int n_entry = 0;
+    if (index->entry_points) {
+        n_entry = index->entry_points->nprobe;
+        if (auto hnsw_params =
+                    dynamic_cast<const SearchParametersHNSW*>(params)) {
+            if (hnsw_params->n_entry_points >= 0) {
+                n_entry = hnsw_params->n_entry_points;
+            }
+        }
+    }
+    // the neighbor lists read on demand are charged at full size
+    size_t list_bytes = hnsw.nb_neighbors(0) * sizeof(HNSW::storage_idx_t);
+    std::vector<idx_t> selected_ids;
+    if (filter_strategy == SearchParametersHNSW::FILTER_BRUTE_FORCE) {
+        for (idx_t j = 0; j < index->ntotal; j++) {
+            if (params->sel->is_member(j) && !hnsw.is_deleted(j)) {
+                selected_ids.push_back(j);
+            }
+        }
+    }
+    // the range traversal (HNSW::range_slack) is not implemented by the
+    // specialized searchers
+    bool range_traversal = false;
+    if (std::is_same<
+                BlockResultHandler,
+                RangeSearchBlockResultHandler<HNSW::C>>::value) {
+        range_traversal = hnsw.range_slack >= 0;
+        if (auto hnsw_params =
+                    dynamic_cast<const SearchParametersHNSW*>(params)) {
+            if (hnsw_params->range_slack >= 0) {
+                range_traversal = true;
+            }
+        }
+    }
+    bool use_specialized = !range_traversal &&
+            specialized_search_applies(
+                    *index, params, filter_strategy, n_entry);
+    bool check_relative_distance = hnsw.check_relative_distance;
+    if (auto hnsw_params = dynamic_cast<const SearchParametersHNSW*>(params)) {
+        check_relative_distance = hnsw_params->check_relative_distance;
+    }
+    HNSWStats search_stats;
 
     idx_t check_period = InterruptCallback::get_period_hint(
             hnsw.max_level * index->d * efSearch);
+    // the visited set is chosen from the expected nb of visited nodes
+    size_t nvisit = (size_t)efSearch * hnsw.nb_neighbors(0);
+    VisitedTableMode vt_mode = VisitedTable::auto_mode(index->ntotal, nvisit);
 
     for (idx_t i0 = 0; i0 < n; i0 += check_period) {
         idx_t i1 = std::min(i0 + check_period, n);
-
-#pragma omp parallel if (i1 - i0 > 1)
-        {
-            VisitedTable vt(index->ntotal);
+        int nworkers = parallel_workers(i1 - i0);
+        std::vector<HNSWStats> worker_stats(nworkers);
+        std::vector<size_t> worker_fetches(nworkers);
+        std::atomic<idx_t> next_query(i0);
+
+        parallel_run(nworkers, [&](int rank) {
+            ThreadVisitedTable tvt(index->ntotal, vt_mode, nvisit);
+            VisitedTable& vt = *tvt;
             typename BlockResultHandler::SingleResultHandler res(bres);
 
             // Select the appropriate distance computer based on use_recompute
             // flag
             std::unique_ptr<DistanceComputer> dis;
+            ZmqDistanceComputer* zdis = nullptr;
+            NodeBlockDistanceComputer* bdis = nullptr;
             if (index->is_recompute) {
                 // Use ZmqDistanceComputer for recomputation
-                dis.reset(new ZmqDistanceComputer(
+                zdis = new ZmqDistanceComputer(
                         index->d,
                         index->metric_type,
                         index->metric_arg,
-                        zmq_port));
+                        zmq_port);
+                dis.reset(zdis);
+                if (coalesce_requests) {
+                    zdis->set_coalescer(&ZmqRequestCoalescer::instance());
+                }
+                zdis->cache = embedding_cache;
+                zdis->hybrid_store = index->hybrid_store.get();
+                zdis->provider = index->embedding_provider.get();
+                zdis->server_distances = server_side_distances &&
+                        !coalesce_requests && !embedding_cache &&
+                        !zdis->provider;
+            } else if (index->node_blocks) {
+                bdis = new NodeBlockDistanceComputer(
+                        *index->node_blocks, index->metric_type);
+                dis.reset(bdis);
             } else {
                 // Use standard distance computer
                 dis.reset(storage_distance_computer(index->storage));
             }
 
-#pragma omp for reduction(+ : n1, n2, ndis, nhops, total_fetches_accum) \
-        schedule(guided)
-            for (idx_t i = i0; i < i1; i++) {
+            // the search parameters point to the budget left to the query
+            SearchParametersHNSW query_params;
+            SearchBudget query_budget;
+            const SearchParameters* search_params = params;
+            if (budget || effort_features) {
+                query_params =
+                        *dynamic_cast<const SearchParametersHNSW*>(params);
+                query_params.budget = &query_budget;
+                search_params = &query_params;
+            }
+            // nullptr if the storage is not supported
+            std::unique_ptr<HNSWSpecializedSearcher> specialized;
+            if (use_specialized) {
+                specialized.reset(
+                        make_hnsw_specialized_searcher(index->storage));
+            }
+            HNSWStats& wstats = worker_stats[rank];
+            std::vector<HNSW::storage_idx_t> entries(n_entry);
+            std::unique_ptr<DistanceComputer> upper_dis;
+            if (n_entry == 0 && index->upper_level_codes) {
+                upper_dis.reset(
+                        index->upper_level_codes->get_distance_computer());
+            }
+
+            for (idx_t i; (i = next_query++) < i1;) {
                 res.begin(i);
                 dis->set_query(x + i * index->d);
+                if (budget) {
+                    query_budget = budget->query_budget(i);
+                }
+                if (effort_features) {
+                    query_params.effort_features =
+                            effort_features + i * nfeatures;
+                }
 
-                HNSWStats stats = hnsw.search(*dis, res, vt, params, index);
-                n1 += stats.n1;
-                n2 += stats.n2;
-                ndis += stats.ndis;
-                nhops += stats.nhops;
+                HNSWStats stats;
+                {
+                    FAISS_HNSW_TRACE_QUERY(i);
+                    FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_QUERY);
+                    if (specialized) {
+                        specialized->set_query(x + i * index->d);
+                        stats = specialized->search(
+                                hnsw,
+                                res,
+                                vt,
+                                efSearch,
+                                check_relative_distance,
+                                params ? params->sel : nullptr);
+                    } else if (
+                            filter_strategy ==
+                            SearchParametersHNSW::FILTER_BRUTE_FORCE) {
+                        stats = search_selected(*dis, res, selected_ids);
+                    } else if (n_entry > 0) {
+                        index->entry_points->select(
+                                x + i * index->d, n_entry, entries.data());
+                        stats = hnsw.search_from_entry_points(
+                                *dis,
+                                res,
+                                vt,
+                                n_entry,
+                                entries.data(),
+                                search_params,
+                                index);
+                    } else if (upper_dis && hnsw.entry_point >= 0) {
+                        // descend the upper levels with the codes, only
+                        // the level 0 entry point is evaluated exactly
+                        upper_dis->set_query(x + i * index->d);
+                        HNSW::storage_idx_t nearest = hnsw.entry_point;
+                        float d_nearest = (*upper_dis)(nearest);
+                        for (int level = hnsw.max_level; level >= 1;
+                             level--) {
+                            stats.combine(greedy_update_nearest(
+                                    hnsw,
+                                    *upper_dis,
+                                    level,
+                                    nearest,
+                                    d_nearest));
+                        }
+                        stats.combine(hnsw.search_from_entry_points(
+                                *dis,
+                                res,
+                                vt,
+                                1,
+                                &nearest,
+                                search_params,
+                                index));
+                    } else {
+                        stats = hnsw.search(
+                                *dis, res, vt, search_params, index);
+                    }
+                }
+                if (budget) {
+                    SearchCost cost;
+                    cost.ndis = stats.ndis;
+                    cost.bytes = stats.n_ios * list_bytes;
+                    cost.fetches = dis->get_fetch_count();
+                    cost.truncated = stats.n_budget_stops > 0;
+                    budget->add_cost(i, cost);
+                }
+                if (bdis) {
+                    // the vector reads also bring the neighbor lists
+                    stats.n_ios += bdis->n_reads;
+                }
 
                 // ---- Addition: Accumulate fetch count ----
-                total_fetches_accum += dis->get_fetch_count();
+                worker_fetches[rank] += dis->get_fetch_count();
+                if (zdis) {
+                    stats.ncache_hits += zdis->cache_hits;
+                    stats.ncache_misses += zdis->cache_misses;
+                }
                 // ---- End Addition ----
+                wstats.combine(stats);
 
                 res.end();
             }
+        });
+
+        // ---- Addition: Accumulator for fetch counts ----
+        size_t total_fetches_accum = 0;
+        for (int rank = 0; rank < nworkers; rank++) {
+            search_stats.combine(worker_stats[rank]);
+            total_fetches_accum += worker_fetches[rank];
         }
+        // ---- End Addition ----
 
         // ---- Addition: Update the index's total count ----
         // Use += because the search might be split over multiple check_period
@@ -410,10 +773,359 @@ void hnsw_search(
         InterruptCallback::check();
     }
 
-    HNSWStats hnsw_stats{n1, n2, ndis, nhops};
-    hnsw_stats.combine(hnsw_stats);
+    hnsw_stats.combine(search_stats);
+    if (metrics_enabled()) {
+        metrics_add_search_counters(n, search_stats.ndis, 0);
+        metrics_add_counter(METRIC_CACHE_HITS, search_stats.ncache_hits);
+        metrics_add_counter(METRIC_CACHE_MISSES, search_stats.ncache_misses);
+    }
 }
 
+/* Evaluates the nodes requested by the queries of a lockstep group: the
+ * union of the requests is fetched once and compared to all the queries. */
+struct LockstepEvaluator {
+    using storage_idx_t = HNSW::storage_idx_t;
+
+    const IndexHNSW& index;
+    std::unique_ptr<ZmqDistanceComputer> zdis; // recompute mode
+    size_t nreconstruct = 0; // vectors reconstructed from the storage
+    size_t ndis = 0;
+
+    std::vector<storage_idx_t> ids; // union of the requests, sorted
+    std::vector<float> vectors;
+    std::vector<uint8_t> ok;
+    std::vector<float> dis_row;
+
+    LockstepEvaluator(
+            const IndexHNSW& index,
+            const SearchParametersHNSW& params)
+            : index(index) {
+        if (index.is_recompute) {
+            zdis.reset(new ZmqDistanceComputer(
+                    index.d,
+                    index.metric_type,
+                    index.metric_arg,
+                    params.zmq_port));
+            if (params.coalesce_requests) {
+                zdis->set_coalescer(&ZmqRequestCoalescer::instance());
+            }
+            zdis->cache = params.embedding_cache;
+            zdis->provider = index.embedding_provider.get();
+        } else {
+            FAISS_THROW_IF_NOT_MSG(
+                    index.storage, "lockstep search requires a storage");
+        }
+    }
+
+    /// out[q][j] = distance of query xq + q * d to node requests[q][j],
+    /// with the HNSW convention (smaller is better)
+    void evaluate(
+            const float* xq,
+            const std::vector<std::vector<storage_idx_t>>& requests,
+            std::vector<std::vector<float>>& out) {
+        size_t d = index.d;
+        ids.clear();
+        for (const auto& r : requests) {
+            ids.insert(ids.end(), r.begin(), r.end());
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        size_t nu = ids.size();
+        out.resize(requests.size());
+        if (nu == 0) {
+            for (auto& o : out) {
+                o.clear();
+            }
+            return;
+        }
+
+        // one fetch per unique node
+        vectors.resize(nu * d);
+        ok.assign(nu, 1);
+        if (zdis) {
+            std::vector<uint32_t> ids32(ids.begin(), ids.end());
+            if (zdis->cache) {
+                zdis->get_vectors_cached(ids32, vectors.data(), ok);
+            } else if (!zdis->fetch_embeddings(ids32, vectors.data())) {
+                ok.assign(nu, 0);
+            }
+        } else {
+            std::vector<idx_t> keys(ids.begin(), ids.end());
+            index.storage->reconstruct_batch(nu, keys.data(), vectors.data());
+            nreconstruct += nu;
+        }
+
+        // query x union distance matrix, one row at a time
+        dis_row.resize(nu);
+        for (size_t q = 0; q < requests.size(); q++) {
+            const auto& r = requests[q];
+            out[q].resize(r.size());
+            if (r.empty()) {
+                continue;
+            }
+            if (index.metric_type == METRIC_INNER_PRODUCT) {
+                fvec_inner_products_ny(
+                        dis_row.data(), xq + q * d, vectors.data(), d, nu);
+                for (size_t j = 0; j < nu; j++) {
+                    dis_row[j] = -dis_row[j];
+                }
+            } else {
+                fvec_L2sqr_ny(
+                        dis_row.data(), xq + q * d, vectors.data(), d, nu);
+            }
+            for (size_t j = 0; j < r.size(); j++) {
+                size_t pos = std::lower_bound(ids.begin(), ids.end(), r[j]) -
+                        ids.begin();
+                out[q][j] = ok[pos] ? dis_row[pos] : HUGE_VALF;
+            }
+            ndis += r.size();
+        }
+    }
+
+    size_t get_fetch_count() const {
+        return zdis ? zdis->get_fetch_count() : nreconstruct;
+    }
+};
+
+/* Search with SearchParametersHNSW::lockstep_queries: the queries of a
+ * group descend the upper levels and run their level 0 beams step by step
+ * together, so that the nodes on the paths of several queries are fetched
+ * once per step. */
+void hnsw_search_lockstep(
+        const IndexHNSW* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParametersHNSW& params) {
+    using storage_idx_t = HNSW::storage_idx_t;
+    using Node = std::pair<float, storage_idx_t>;
+    const HNSW& hnsw = index->hnsw;
+    size_t d = index->d;
+    FAISS_THROW_IF_NOT_MSG(
+            index->metric_type == METRIC_L2 ||
+                    index->metric_type == METRIC_INNER_PRODUCT,
+            "lockstep search supports only L2 and inner product");
+    FAISS_THROW_IF_NOT_MSG(
+            !params.budget && !params.effort_features,
+            "lockstep search does not support search budgets");
+
+    if (index->fetch_count_ptr) {
+        index->fetch_count_ptr->store(0, std::memory_order_relaxed);
+    }
+    size_t ef = std::max<size_t>(params.efSearch, k);
+    int beam_size = std::max(params.beam_size, 1);
+    idx_t group_size = params.lockstep_queries;
+    int n_entry = 0;
+    if (index->entry_points) {
+        n_entry = params.n_entry_points >= 0 ? params.n_entry_points
+                                             : index->entry_points->nprobe;
+    }
+
+    idx_t ngroups = (n + group_size - 1) / group_size;
+    int nworkers = parallel_workers(ngroups);
+    std::vector<HNSWStats> worker_stats(nworkers);
+    std::vector<size_t> worker_fetches(nworkers);
+    std::atomic<idx_t> next_group(0);
+
+    parallel_run(nworkers, [&](int rank) {
+        LockstepEvaluator eval(*index, params);
+        std::unique_ptr<DistanceComputer> upper_dis;
+        if (n_entry == 0 && index->upper_level_codes) {
+            upper_dis.reset(index->upper_level_codes->get_distance_computer());
+        }
+        HNSWStats& stats = worker_stats[rank];
+        std::vector<storage_idx_t> neighbors;
+
+        for (idx_t g; (g = next_group++) < ngroups;) {
+            idx_t i0 = g * group_size;
+            size_t nq = std::min(i0 + group_size, n) - i0;
+            const float* xq = x + i0 * d;
+            std::vector<std::vector<storage_idx_t>> requests(nq);
+            std::vector<std::vector<float>> out;
+
+            // level 0 entry points of each query
+            if (n_entry > 0) {
+                for (size_t q = 0; q < nq; q++) {
+                    requests[q].resize(n_entry);
+                    index->entry_points->select(
+                            xq + q * d, n_entry, requests[q].data());
+                    auto& r = requests[q];
+                    r.erase(std::remove(r.begin(), r.end(), -1), r.end());
+                }
+            } else if (hnsw.entry_point >= 0) {
+                std::vector<storage_idx_t> nearest(nq, hnsw.entry_point);
+                std::vector<float> d_nearest(nq);
+                if (upper_dis) {
+                    // the codes are in RAM, no need to share the descent
+                    for (size_t q = 0; q < nq; q++) {
+                        upper_dis->set_query(xq + q * d);
+                        d_nearest[q] = (*upper_dis)(nearest[q]);
+                        for (int level = hnsw.max_level; level >= 1;
+                             level--) {
+                            stats.combine(greedy_update_nearest(
+                                    hnsw,
+                                    *upper_dis,
+                                    level,
+                                    nearest[q],
+                                    d_nearest[q]));
+                        }
+                    }
+                } else {
+                    // greedy descent, one hop of all the queries per step
+                    for (size_t q = 0; q < nq; q++) {
+                        requests[q].assign(1, hnsw.entry_point);
+                    }
+                    eval.evaluate(xq, requests, out);
+                    for (size_t q = 0; q < nq; q++) {
+                        d_nearest[q] = out[q][0];
+                    }
+                    for (int level = hnsw.max_level; level >= 1; level--) {
+                        std::vector<bool> moving(nq, true);
+                        size_t nmoving = nq;
+                        while (nmoving > 0) {
+                            for (size_t q = 0; q < nq; q++) {
+                                requests[q].clear();
+                                if (moving[q]) {
+                                    hnsw.fetch_neighbors(
+                                            nearest[q],
+                                            level,
+                                            requests[q],
+                                            &stats.n_ios);
+                                }
+                            }
+                            eval.evaluate(xq, requests, out);
+                            nmoving = 0;
+                            for (size_t q = 0; q < nq; q++) {
+                                if (!moving[q]) {
+                                    continue;
+                                }
+                                stats.nhops++;
+                                moving[q] = false;
+                                for (size_t j = 0; j < out[q].size(); j++) {
+                                    if (out[q][j] < d_nearest[q]) {
+                                        nearest[q] = requests[q][j];
+                                        d_nearest[q] = out[q][j];
+                                        moving[q] = true;
+                                    }
+                                }
+                                nmoving += moving[q];
+                            }
+                        }
+                    }
+                }
+                for (size_t q = 0; q < nq; q++) {
+                    requests[q].assign(1, nearest[q]);
+                }
+            }
+
+            // level 0 beams
+            std::vector<std::priority_queue<
+                    Node,
+                    std::vector<Node>,
+                    std::greater<Node>>>
+                    candidates(nq);
+            std::vector<std::priority_queue<Node>> top(nq);
+            std::vector<std::unordered_set<storage_idx_t>> visited(nq);
+            for (size_t q = 0; q < nq; q++) {
+                visited[q].insert(requests[q].begin(), requests[q].end());
+            }
+            size_t nactive = nq;
+            while (nactive > 0) {
+                eval.evaluate(xq, requests, out);
+                for (size_t q = 0; q < nq; q++) {
+                    for (size_t j = 0; j < out[q].size(); j++) {
+                        float dis = out[q][j];
+                        if (top[q].size() < ef || dis < top[q].top().first) {
+                            candidates[q].emplace(dis, requests[q][j]);
+                            top[q].emplace(dis, requests[q][j]);
+                            if (top[q].size() > ef) {
+                                top[q].pop();
+                            }
+                        }
+                    }
+                }
+                // expand the beam of each query that can still improve
+                nactive = 0;
+                for (size_t q = 0; q < nq; q++) {
+                    requests[q].clear();
+                    for (int b = 0; b < beam_size && !candidates[q].empty();
+                         b++) {
+                        Node c = candidates[q].top();
+                        if (top[q].size() >= ef &&
+                            c.first > top[q].top().first) {
+                            break;
+                        }
+                        candidates[q].pop();
+                        stats.nhops++;
+                        hnsw.fetch_neighbors(
+                                c.second, 0, neighbors, &stats.n_ios);
+                        for (storage_idx_t v : neighbors) {
+                            if (visited[q].insert(v).second) {
+                                requests[q].push_back(v);
+                            }
+                        }
+                    }
+                    nactive += !requests[q].empty();
+                }
+            }
+
+            // k best results that are selected and not deleted
+            for (size_t q = 0; q < nq; q++) {
+                std::vector<Node> res;
+                res.reserve(top[q].size());
+                for (; !top[q].empty(); top[q].pop()) {
+                    res.push_back(top[q].top());
+                }
+                std::sort(res.begin(), res.end());
+                float* D = distances + (i0 + q) * k;
+                idx_t* I = labels + (i0 + q) * k;
+                idx_t nres = 0;
+                for (const Node& r : res) {
+                    if (nres == k) {
+                        break;
+                    }
+                    if (hnsw.is_deleted(r.second) ||
+                        (params.sel && !params.sel->is_member(r.second))) {
+                        continue;
+                    }
+                    D[nres] = r.first;
+                    I[nres] = r.second;
+                    nres++;
+                }
+                for (; nres < k; nres++) {
+                    D[nres] = HNSW::C::neutral();
+                    I[nres] = -1;
+                }
+                stats.n1++;
+            }
+        }
+        stats.ndis += eval.ndis;
+        worker_fetches[rank] = eval.get_fetch_count();
+        if (eval.zdis) {
+            stats.ncache_hits += eval.zdis->cache_hits;
+            stats.ncache_misses += eval.zdis->cache_misses;
+        }
+    });
+
+    HNSWStats search_stats;
+    size_t total_fetches = 0;
+    for (int rank = 0; rank < nworkers; rank++) {
+        search_stats.combine(worker_stats[rank]);
+        total_fetches += worker_fetches[rank];
+    }
+    if (index->fetch_count_ptr) {
+        index->fetch_count_ptr->fetch_add(
+                total_fetches, std::memory_order_relaxed);
+    }
+    hnsw_stats.combine(search_stats);
+    if (metrics_enabled()) {
+        metrics_add_search_counters(n, search_stats.ndis, 0);
+        metrics_add_counter(METRIC_CACHE_HITS, search_stats.ncache_hits);
+        metrics_add_counter(METRIC_CACHE_MISSES, search_stats.ncache_misses);
+    }
+}
 } // anonymous namespace
 
 void IndexHNSW::search(
@@ -424,9 +1136,41 @@ void IndexHNSW::search(
         idx_t* labels,
         const SearchParameters* params) const {
     FAISS_THROW_IF_NOT(k > 0);
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
 
-    using RH = HeapBlockResultHandler<HNSW::C>;
-    RH bres(n, distances, labels, k);
+    auto hnsw_params = dynamic_cast<const SearchParametersHNSW*>(params);
+    if (hnsw_params && hnsw_params->lockstep_queries > 1) {
+        hnsw_search_lockstep(
+                this, n, x, k, distances, labels, *hnsw_params);
+    } else {
+        using RH = HeapBlockResultHandler<HNSW::C>;
+        RH bres(n, distances, labels, k);
+
+        hnsw_search(this, n, x, bres, params);
+    }
+
+    if (is_similarity_metric(this->metric_type)) {
+        // we need to revert the negated distances
+        for (size_t i = 0; i < k * n; i++) {
+            distances[i] = -distances[i];
+        }
+    }
+}
+
+void IndexHNSW::search_grouped(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        const idx_t* group_ids,
+        float* distances,
+        idx_t* labels,
+        idx_t* best_ids,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(group_ids);
+
+    using RH = GroupedHeapBlockResultHandler<HNSW::C>;
+    RH bres(n, distances, labels, best_ids, k, group_ids);
 
     hnsw_search(this, n, x, bres, params);
 
@@ -457,14 +1201,132 @@ void IndexHNSW::range_search(
     }
 }
 
+namespace {
+
+/* Level 0 search that resumes where the previous batch stopped. The
+ * visited nodes that are not returned yet are kept in found, the ones whose
+ * neighbors are not expanded yet in the frontier. As in HNSW::search, a
+ * batch expands the frontier until its closest node is farther than the
+ * ef-th closest found node, with ef = max(efSearch, k), then returns the k
+ * closest found nodes. The next batch continues the traversal from there. */
+struct HNSWSearchIterator : SearchIterator {
+    using storage_idx_t = HNSW::storage_idx_t;
+    using Node = std::pair<float, storage_idx_t>;
+    using MinHeap =
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>>;
+
+    const IndexHNSW& index;
+    std::vector<float> query;
+    std::unique_ptr<DistanceComputer> qdis;
+    const IDSelector* sel;
+    int efSearch;
+
+    MinHeap frontier;
+    std::set<Node> found; // only the nodes that can be returned
+    std::unordered_set<storage_idx_t> visited;
+    std::vector<storage_idx_t> neighbors;
+    HNSWStats stats;
+
+    HNSWSearchIterator(
+            const IndexHNSW& index,
+            const float* x,
+            const SearchParameters* params)
+            : index(index),
+              query(x, x + index.d),
+              qdis(storage_distance_computer(index.storage)),
+              sel(params ? params->sel : nullptr),
+              efSearch(index.hnsw.efSearch) {
+        if (auto hnsw_params =
+                    dynamic_cast<const SearchParametersHNSW*>(params)) {
+            efSearch = hnsw_params->efSearch;
+        }
+        const HNSW& hnsw = index.hnsw;
+        qdis->set_query(query.data());
+        if (hnsw.entry_point < 0) {
+            return;
+        }
+        storage_idx_t nearest = hnsw.entry_point;
+        float d_nearest = (*qdis)(nearest);
+        stats.ndis++;
+        for (int level = hnsw.max_level; level >= 1; level--) {
+            stats.combine(greedy_update_nearest(
+                    hnsw, *qdis, level, nearest, d_nearest));
+        }
+        visit(nearest, d_nearest);
+    }
+
+    void visit(storage_idx_t no, float dis) {
+        visited.insert(no);
+        frontier.emplace(dis, no);
+        if (!index.hnsw.is_deleted(no) && (!sel || sel->is_member(no))) {
+            found.emplace(dis, no);
+        }
+    }
+
+    void expand(storage_idx_t no) {
+        index.hnsw.fetch_neighbors(no, 0, neighbors, &stats.n_ios);
+        for (storage_idx_t v : neighbors) {
+            if (!visited.count(v)) {
+                visit(v, (*qdis)(v));
+                stats.ndis++;
+            }
+        }
+        stats.nhops++;
+    }
+
+    size_t next(idx_t k, float* distances, idx_t* labels) override {
+        size_t ef = std::max((size_t)efSearch, (size_t)k);
+        while (!frontier.empty()) {
+            if (found.size() >= ef) {
+                // the frontier cannot improve the ef closest found nodes
+                float d_ef = std::next(found.begin(), ef - 1)->first;
+                if (frontier.top().first > d_ef) {
+                    break;
+                }
+            }
+            storage_idx_t no = frontier.top().second;
+            frontier.pop();
+            expand(no);
+        }
+
+        bool is_similarity = is_similarity_metric(index.metric_type);
+        size_t nres = 0;
+        while (nres < (size_t)k && !found.empty()) {
+            Node node = *found.begin();
+            found.erase(found.begin());
+            distances[nres] = is_similarity ? -node.first : node.first;
+            labels[nres] = node.second;
+            nres++;
+        }
+        hnsw_stats.combine(stats);
+        stats = HNSWStats();
+        return nres;
+    }
+};
+
+} // namespace
+
+SearchIterator* IndexHNSW::search_iterator(
+        const float* x,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT_MSG(
+            storage && !is_recompute,
+            "search_iterator requires the vectors in the storage");
+    return new HNSWSearchIterator(*this, x, params);
+}
+
 void IndexHNSW::add(idx_t n, const float* x) {
     FAISS_THROW_IF_NOT_MSG(
             storage,
             "Please use IndexHNSWFlat (or variants) instead of IndexHNSW directly");
     FAISS_THROW_IF_NOT(is_trained);
+    MetricsCallTimer timer(METRIC_ADD_VECTORS, METRIC_ADD_LATENCY, n);
     int n0 = ntotal;
     storage->add(n, x);
     ntotal = storage->ntotal;
+    if (!hnsw.deleted.empty()) {
+        hnsw.deleted.resize(ntotal, 0);
+    }
 
     hnsw_add_vertices(*this, n0, n, x, verbose, hnsw.levels.size() == ntotal);
 }
@@ -472,12 +1334,63 @@ void IndexHNSW::add(idx_t n, const float* x) {
 void IndexHNSW::reset() {
     hnsw.reset();
     storage->reset();
+    entry_points.reset();
+    upper_level_codes.reset();
     ntotal = 0;
 }
 
+void IndexHNSW::build_upper_level_codes(const char* codec_key) {
+    std::vector<storage_idx_t> nodes;
+    for (idx_t i = 0; i < ntotal; i++) {
+        if (hnsw.levels[i] > 1) {
+            nodes.push_back(i);
+        }
+    }
+    FAISS_THROW_IF_NOT_MSG(!nodes.empty(), "the graph has no upper levels");
+    std::vector<float> x(nodes.size() * d);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        reconstruct(nodes[i], x.data() + i * d);
+    }
+    auto codes = std::make_shared<HNSWUpperLevelCodes>(
+            index_factory(d, codec_key, metric_type));
+    codes->codec->train(nodes.size(), x.data());
+    codes->add(nodes.size(), x.data(), nodes.data());
+    upper_level_codes = codes;
+}
+
+void IndexHNSW::train_entry_points(
+        idx_t n,
+        const float* x,
+        size_t nentries,
+        int nprobe) {
+    FAISS_THROW_IF_NOT(ntotal > 0);
+    FAISS_THROW_IF_NOT(nentries > 0 && nprobe > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            n >= nentries, "need at least nentries training vectors");
+    std::vector<float> centroids(nentries * d);
+    kmeans_clustering(d, n, nentries, x, centroids.data());
+
+    // the centroids are mapped to nodes through the upper levels
+    entry_points.reset();
+    std::vector<float> D(nentries);
+    std::vector<idx_t> I(nentries);
+    search(nentries, centroids.data(), 1, D.data(), I.data());
+
+    auto table = std::make_shared<HNSWEntryPoints>(d, metric_type);
+    table->nprobe = nprobe;
+    for (size_t i = 0; i < nentries; i++) {
+        if (I[i] >= 0) {
+            storage_idx_t node = I[i];
+            table->add(1, centroids.data() + i * d, &node);
+        }
+    }
+    entry_points = table;
+}
+
 void IndexHNSW::reconstruct(idx_t key, float* recons) const {
     if (is_recompute) {
         ZmqDistanceComputer fetcher(storage);
+        fetcher.provider = embedding_provider.get();
         const float* vec = fetcher.get_vector_zmq(key);
         assert(vec);
         memcpy(recons, vec, d * sizeof(float));
@@ -533,6 +1446,129 @@ void IndexHNSW::shrink_level_0_neighbors(int new_size) {
     }
 }
 
+size_t IndexHNSW::prune_neighbors(int new_size, int level, float alpha) {
+    FAISS_THROW_IF_NOT(new_size > 0);
+    FAISS_THROW_IF_NOT(level >= 0 && level <= hnsw.max_level);
+    FAISS_THROW_IF_NOT_MSG(
+            alpha == 1 || metric_type == METRIC_L2,
+            "alpha != 1 is only supported for L2");
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.storage_is_compact && !hnsw.neighbors_on_disk,
+            "the graph must be in the default in-memory format");
+    FAISS_THROW_IF_NOT_MSG(
+            !(hnsw.pruning_pq && hnsw.pruning_pq->nbits == 4),
+            "the 4-bit PQ pruning codes embed the neighbor lists, "
+            "reset them before pruning the graph");
+    FAISS_THROW_IF_NOT_MSG(
+            is_recompute || storage, "no vectors to compute distances");
+    bool is_l2 = !is_similarity_metric(metric_type);
+    // alpha applies to the distances, the L2 distances are squared
+    float alpha2 = alpha * alpha;
+    size_t n_removed = 0;
+
+#pragma omp parallel reduction(+ : n_removed)
+    {
+        std::unique_ptr<ZmqDistanceComputer> zmq_dis;
+        if (is_recompute) {
+            zmq_dis.reset(dynamic_cast<ZmqDistanceComputer*>(
+                    get_distance_computer()));
+        }
+        std::vector<uint32_t> ids;
+        std::vector<idx_t> keys;
+        std::vector<float> vecs, ip, norms, dis_q;
+        std::vector<int> order, kept;
+
+#pragma omp for schedule(dynamic, 64)
+        for (idx_t i = 0; i < ntotal; i++) {
+            if (hnsw.levels[i] <= level) {
+                continue;
+            }
+            size_t begin, end;
+            hnsw.neighbor_range(i, level, &begin, &end);
+            // row 0 is the node, rows 1..m its neighbors
+            ids.assign(1, i);
+            for (size_t j = begin; j < end && hnsw.neighbors[j] >= 0; j++) {
+                ids.push_back(hnsw.neighbors[j]);
+            }
+            size_t m = ids.size() - 1;
+            if (m == 0) {
+                continue;
+            }
+
+            vecs.resize(ids.size() * d);
+            if (zmq_dis) {
+                FAISS_THROW_IF_NOT_MSG(
+                        zmq_dis->fetch_embeddings(ids, vecs.data()),
+                        "could not fetch the embeddings");
+            } else {
+                keys.assign(ids.begin(), ids.end());
+                storage->reconstruct_batch(
+                        keys.size(), keys.data(), vecs.data());
+            }
+
+            // Gram matrix of the block
+            size_t nv = m + 1;
+            ip.resize(nv * nv);
+            for (size_t a = 0; a < nv; a++) {
+                fvec_inner_products_ny(
+                        ip.data() + a * nv,
+                        vecs.data() + a * d,
+                        vecs.data(),
+                        d,
+                        nv);
+            }
+            norms.resize(nv);
+            for (size_t a = 0; a < nv; a++) {
+                norms[a] = ip[a * nv + a];
+            }
+            // HNSW distance: squared L2 or negated inner product
+            auto dis = [&](size_t a, size_t b) {
+                float g = ip[a * nv + b];
+                return is_l2 ? std::max(norms[a] + norms[b] - 2 * g, 0.0f)
+                             : -g;
+            };
+
+            // enumerate the neighbors from nearest to farthest, keep a
+            // neighbor if no kept neighbor is closer to it than the node
+            order.resize(m);
+            dis_q.resize(nv);
+            for (size_t a = 1; a < nv; a++) {
+                order[a - 1] = a;
+                dis_q[a] = dis(0, a);
+            }
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return dis_q[a] < dis_q[b];
+            });
+            kept.clear();
+            for (int a : order) {
+                bool good = true;
+                for (int b : kept) {
+                    if (alpha2 * dis(a, b) < dis_q[a]) {
+                        good = false;
+                        break;
+                    }
+                }
+                if (good) {
+                    kept.push_back(a);
+                    if (kept.size() >= new_size) {
+                        break;
+                    }
+                }
+            }
+
+            size_t j = begin;
+            for (int a : kept) {
+                hnsw.neighbors[j++] = ids[a];
+            }
+            while (j < end) {
+                hnsw.neighbors[j++] = -1;
+            }
+            n_removed += m - kept.size();
+        }
+    }
+    return n_removed;
+}
+
 void IndexHNSW::search_level_0(
         idx_t n,
         const float* x,
@@ -557,7 +1593,8 @@ void IndexHNSW::search_level_0(
         std::unique_ptr<DistanceComputer> qdis(
                 storage_distance_computer(storage));
         HNSWStats search_stats;
-        VisitedTable vt(ntotal);
+        ThreadVisitedTable tvt(ntotal);
+        VisitedTable& vt = *tvt;
         RH::SingleResultHandler res(bres);
 
 #pragma omp for
@@ -742,18 +1779,420 @@ void IndexHNSW::link_singletons() {
     }
 }
 
+namespace {
+
+template <class T>
+size_t warmup_vector(const MaybeOwnedVector<T>& v) {
+    return warmup_memory(v.data(), v.size() * sizeof(T));
+}
+
+} // namespace
+
+size_t IndexHNSW::warmup(const WarmupPolicy& policy) const {
+    size_t nbytes = warmup_vector(hnsw.levels) + warmup_vector(hnsw.offsets);
+    if (policy.all) {
+        nbytes += warmup_vector(hnsw.neighbors);
+        nbytes += warmup_vector(hnsw.compact_neighbors_data);
+        nbytes += warmup_vector(hnsw.compact_level_ptr);
+        nbytes += warmup_vector(hnsw.compact_node_offsets);
+        if (storage) {
+            WarmupPolicy storage_policy;
+            storage_policy.all = true;
+            nbytes += storage->warmup(storage_policy);
+        }
+    }
+
+    std::vector<storage_idx_t> nodes;
+    if (!policy.all) {
+        for (idx_t i = 0; i < hnsw.levels.size(); i++) {
+            if (hnsw.levels[i] > 1) {
+                nodes.push_back(i);
+            }
+        }
+    }
+    for (size_t i = 0; i < policy.n_hot_ids; i++) {
+        idx_t id = policy.hot_ids[i];
+        FAISS_THROW_IF_NOT_FMT(
+                id >= 0 && id < ntotal, "hot id %" PRId64 " out of range", id);
+        nodes.push_back(id);
+    }
+
+    // the neighbor lists are read with fetch_neighbors so that the graphs
+    // read on demand (mmap, pread, page cache) are warmed as well
+    auto flat = dynamic_cast<const IndexFlatCodes*>(storage);
+    if (!policy.all) {
+#pragma omp parallel reduction(+ : nbytes)
+        {
+            std::vector<storage_idx_t> buffer;
+#pragma omp for schedule(dynamic, 64)
+            for (int64_t i = 0; i < nodes.size(); i++) {
+                storage_idx_t node = nodes[i];
+                for (int level = 0; level < hnsw.levels[node]; level++) {
+                    buffer.clear();
+                    hnsw.fetch_neighbors(node, level, buffer);
+                    nbytes += buffer.size() * sizeof(storage_idx_t);
+                }
+                if (flat && node < flat->ntotal) {
+                    // madvise is too expensive for a single row
+                    nbytes += warmup_memory(
+                            flat->codes.data() + node * flat->code_size,
+                            flat->code_size,
+                            false);
+                }
+            }
+        }
+    }
+
+    auto hpolicy = dynamic_cast<const WarmupPolicyHNSW*>(&policy);
+    ZmqEmbeddingCache* cache = hpolicy ? hpolicy->embedding_cache : nullptr;
+    if (is_recompute && cache && policy.n_hot_ids > 0) {
+        ZmqDistanceComputer dc(
+                d, metric_type, metric_arg, hpolicy->zmq_port);
+        dc.provider = embedding_provider.get();
+        dc.hybrid_store = hybrid_store.get();
+        const size_t bs = 1024;
+        std::vector<float> embeddings(bs * d);
+        for (size_t i0 = 0; i0 < policy.n_hot_ids; i0 += bs) {
+            size_t i1 = std::min(i0 + bs, policy.n_hot_ids);
+            std::vector<uint32_t> ids(
+                    policy.hot_ids + i0, policy.hot_ids + i1);
+            FAISS_THROW_IF_NOT_MSG(
+                    dc.fetch_embeddings(ids, embeddings.data()),
+                    "could not fetch the embeddings of the hot ids");
+            for (size_t i = 0; i < ids.size(); i++) {
+                cache->insert(ids[i], embeddings.data() + i * d, true);
+            }
+            nbytes += ids.size() * d * sizeof(float);
+        }
+    }
+    return nbytes;
+}
+
 void IndexHNSW::permute_entries(const idx_t* perm) {
-    auto flat_storage = dynamic_cast<IndexFlatCodes*>(storage);
     FAISS_THROW_IF_NOT_MSG(
-            flat_storage, "don't know how to permute this index");
-    flat_storage->permute_entries(perm);
+            !hybrid_store,
+            "the hybrid embedding store is indexed by the old ids");
+    if (storage || !is_recompute) {
+        auto flat_storage = dynamic_cast<IndexFlatCodes*>(storage);
+        FAISS_THROW_IF_NOT_MSG(
+                flat_storage, "don't know how to permute this index");
+        flat_storage->permute_entries(perm);
+    }
+    // in recompute mode without storage, the embedding server is queried
+    // with the new ids
     hnsw.permute_entries(perm);
+    if (entry_points) {
+        std::vector<idx_t> new_ids(ntotal);
+        for (idx_t i = 0; i < ntotal; i++) {
+            new_ids[perm[i]] = i;
+        }
+        entry_points->renumber_nodes(new_ids.data());
+    }
+    if (upper_level_codes) {
+        std::vector<idx_t> new_ids(ntotal);
+        for (idx_t i = 0; i < ntotal; i++) {
+            new_ids[perm[i]] = i;
+        }
+        upper_level_codes->renumber_nodes(new_ids.data());
+    }
+}
+
+size_t IndexHNSW::mark_deleted(const IDSelector& sel) {
+    if (hnsw.deleted.empty()) {
+        hnsw.deleted.resize(ntotal, 0);
+    }
+    size_t n_new = 0;
+    for (idx_t i = 0; i < ntotal; i++) {
+        if (!hnsw.deleted[i] && sel.is_member(i)) {
+            hnsw.deleted[i] = 1;
+            n_new++;
+        }
+    }
+    hnsw.n_deleted += n_new;
+    return n_new;
+}
+
+size_t IndexHNSW::repair_deleted() {
+    if (hnsw.n_deleted == 0) {
+        return 0;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            storage, "the graph repair needs the stored vectors");
+    FAISS_THROW_IF_NOT_MSG(
+            !(hnsw.pruning_pq && hnsw.pruning_pq->nbits == 4),
+            "the 4-bit PQ pruning codes embed the neighbor lists, "
+            "reset them before repairing the graph");
+    size_t n_repaired = 0;
+
+#pragma omp parallel reduction(+ : n_repaired)
+    {
+        std::unique_ptr<DistanceComputer> dis(
+                storage_distance_computer(storage));
+        // each node only modifies its own lists and reads the lists of
+        // deleted nodes, that are never modified
+#pragma omp for schedule(dynamic, 64)
+        for (idx_t i = 0; i < ntotal; i++) {
+            if (hnsw.deleted[i]) {
+                continue;
+            }
+            for (int level = 0; level < hnsw.levels[i]; level++) {
+                n_repaired += hnsw.repair_links(*dis, i, level);
+            }
+        }
+    }
+    hnsw.update_entry_point_after_delete();
+    return n_repaired;
+}
+
+size_t IndexHNSW::compact_deleted() {
+    size_t n_removed = hnsw.n_deleted;
+    if (n_removed == 0) {
+        return 0;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            !hybrid_store && !hnsw.pq_data_loader,
+            "the hybrid embedding store and the PQ data loader are indexed "
+            "by the old ids");
+    auto flat_storage = dynamic_cast<IndexFlatCodes*>(storage);
+    FAISS_THROW_IF_NOT_MSG(
+            flat_storage, "don't know how to remove vectors from this index");
+    repair_deleted();
+
+    std::vector<idx_t> removed;
+    removed.reserve(n_removed);
+    for (idx_t i = 0; i < ntotal; i++) {
+        if (hnsw.deleted[i]) {
+            removed.push_back(i);
+        }
+    }
+    if (entry_points || upper_level_codes) {
+        std::vector<idx_t> new_ids(ntotal);
+        for (idx_t i = 0, j = 0; i < ntotal; i++) {
+            new_ids[i] = hnsw.deleted[i] ? -1 : j++;
+        }
+        if (entry_points) {
+            entry_points->renumber_nodes(new_ids.data());
+        }
+        if (upper_level_codes) {
+            upper_level_codes->renumber_nodes(new_ids.data());
+        }
+    }
+    IDSelectorBatch sel(removed.size(), removed.data());
+    FAISS_THROW_IF_NOT(flat_storage->remove_ids(sel) == n_removed);
+    hnsw.remove_deleted();
+    ntotal = storage->ntotal;
+    return n_removed;
+}
+
+size_t IndexHNSW::remove_ids(const IDSelector& sel) {
+    mark_deleted(sel);
+    return compact_deleted();
+}
+
+std::vector<idx_t> reorder_hnsw_for_locality(
+        Index* index,
+        HNSW::ReorderType type,
+        const std::unordered_map<idx_t, size_t>* visit_counts) {
+    IndexIDMap* idmap = dynamic_cast<IndexIDMap*>(index);
+    IndexHNSW* index_hnsw =
+            dynamic_cast<IndexHNSW*>(idmap ? idmap->index : index);
+    FAISS_THROW_IF_NOT_MSG(
+            index_hnsw, "expected an IndexHNSW, possibly in an IndexIDMap");
+
+    std::vector<idx_t> perm =
+            index_hnsw->hnsw.locality_order(type, visit_counts);
+    index_hnsw->permute_entries(perm.data());
+    if (idmap) {
+        std::vector<idx_t> new_id_map(perm.size());
+        for (size_t i = 0; i < perm.size(); i++) {
+            new_id_map[i] = idmap->id_map[perm[i]];
+        }
+        idmap->id_map = MaybeOwnedVector<idx_t>(std::move(new_id_map));
+        if (auto idmap2 = dynamic_cast<IndexIDMap2*>(idmap)) {
+            idmap2->construct_rev_map();
+        }
+    }
+    return perm;
+}
+
+int calibrate_hnsw_early_stop(
+        Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float target_recall,
+        const SearchParametersHNSW* params,
+        int max_patience) {
+    IndexIDMap* idmap = dynamic_cast<IndexIDMap*>(index);
+    IndexHNSW* index_hnsw =
+            dynamic_cast<IndexHNSW*>(idmap ? idmap->index : index);
+    FAISS_THROW_IF_NOT_MSG(
+            index_hnsw, "expected an IndexHNSW, possibly in an IndexIDMap");
+    FAISS_THROW_IF_NOT(n > 0 && k > 0 && max_patience > 0);
+    FAISS_THROW_IF_NOT(target_recall > 0 && target_recall <= 1);
+
+    SearchParametersHNSW search_params;
+    if (params) {
+        search_params = *params;
+    } else {
+        search_params.efSearch = index_hnsw->hnsw.efSearch;
+    }
+
+    // reference: the results without early termination
+    search_params.early_stop_patience = 0;
+    std::vector<idx_t> I_ref(n * k), I(n * k);
+    std::vector<float> D(n * k);
+    index->search(n, x, k, D.data(), I_ref.data(), &search_params);
+
+    // fraction of the reference results found with a given patience
+    auto recall_at = [&](int patience) {
+        search_params.early_stop_patience = patience;
+        index->search(n, x, k, D.data(), I.data(), &search_params);
+        size_t n_found = 0, n_ref = 0;
+        for (idx_t q = 0; q < n; q++) {
+            std::unordered_set<idx_t> ref;
+            for (idx_t j = 0; j < k; j++) {
+                if (I_ref[q * k + j] >= 0) {
+                    ref.insert(I_ref[q * k + j]);
+                }
+            }
+            n_ref += ref.size();
+            for (idx_t j = 0; j < k; j++) {
+                n_found += ref.count(I[q * k + j]);
+            }
+        }
+        return n_ref == 0 ? 1.0f : float(n_found) / n_ref;
+    };
+
+    // the recall grows with the patience: find the smallest one that
+    // reaches the target with an exponential then a binary search
+    int patience = 0;
+    int hi = 1;
+    while (hi < max_patience && recall_at(hi) < target_recall) {
+        hi *= 2;
+    }
+    hi = std::min(hi, max_patience);
+    if (recall_at(hi) >= target_recall) {
+        int lo = hi / 2; // does not reach the target (or 0)
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (recall_at(mid) >= target_recall) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        patience = hi;
+    }
+
+    index_hnsw->hnsw.early_stop_patience = patience;
+    index_hnsw->hnsw.early_stop_target_recall = target_recall;
+    return patience;
+}
+
+SearchEffortPredictor train_hnsw_effort_predictor(
+        Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float target_recall,
+        int nfeatures,
+        const SearchParametersHNSW* params,
+        int max_steps) {
+    IndexIDMap* idmap = dynamic_cast<IndexIDMap*>(index);
+    IndexHNSW* index_hnsw =
+            dynamic_cast<IndexHNSW*>(idmap ? idmap->index : index);
+    FAISS_THROW_IF_NOT_MSG(
+            index_hnsw, "expected an IndexHNSW, possibly in an IndexIDMap");
+    FAISS_THROW_IF_NOT(n > 0 && k > 0 && nfeatures > 0);
+    FAISS_THROW_IF_NOT(max_steps > nfeatures);
+    FAISS_THROW_IF_NOT(target_recall > 0 && target_recall <= 1);
+
+    SearchParametersHNSW search_params;
+    if (params) {
+        search_params = *params;
+    } else {
+        search_params.efSearch = index_hnsw->hnsw.efSearch;
+    }
+    search_params.effort_features = nullptr;
+
+    // a constant predictor caps all the queries to the same nb of steps
+    SearchEffortPredictor cap(nfeatures);
+    cap.max_effort = max_steps;
+    auto set_cap = [&](int steps) {
+        cap.weights[nfeatures] = std::log((float)steps);
+    };
+
+    // reference results and features, without a cap
+    std::vector<float> features(n * nfeatures);
+    std::vector<idx_t> I_ref(n * k);
+    std::vector<float> D(n * k);
+    set_cap(max_steps);
+    search_params.effort_predictor = &cap;
+    search_params.effort_features = features.data();
+    index->search(n, x, k, D.data(), I_ref.data(), &search_params);
+    search_params.effort_features = nullptr;
+
+    // grid of caps, only the queries that did not reach the target yet are
+    // searched again
+    std::vector<float> efforts(n, max_steps);
+    std::vector<idx_t> todo(n);
+    for (idx_t q = 0; q < n; q++) {
+        todo[q] = q;
+    }
+    std::vector<float> xsub;
+    std::vector<idx_t> I;
+    for (int steps = nfeatures + 1; steps < max_steps && !todo.empty();
+         steps = std::max(steps + 1, (int)(steps * 1.25))) {
+        size_t nsub = todo.size();
+        xsub.resize(nsub * index->d);
+        for (size_t j = 0; j < nsub; j++) {
+            memcpy(xsub.data() + j * index->d,
+                   x + todo[j] * index->d,
+                   sizeof(float) * index->d);
+        }
+        I.resize(nsub * k);
+        D.resize(nsub * k);
+        set_cap(steps);
+        index->search(nsub, xsub.data(), k, D.data(), I.data(), &search_params);
+
+        std::vector<idx_t> still_todo;
+        for (size_t j = 0; j < nsub; j++) {
+            idx_t q = todo[j];
+            std::unordered_set<idx_t> ref;
+            for (idx_t l = 0; l < k; l++) {
+                if (I_ref[q * k + l] >= 0) {
+                    ref.insert(I_ref[q * k + l]);
+                }
+            }
+            size_t n_found = 0;
+            for (idx_t l = 0; l < k; l++) {
+                n_found += ref.count(I[j * k + l]);
+            }
+            if (n_found >= target_recall * ref.size()) {
+                efforts[q] = steps;
+            } else {
+                still_todo.push_back(q);
+            }
+        }
+        todo.swap(still_todo);
+    }
+
+    SearchEffortPredictor predictor(nfeatures);
+    predictor.train(n, features.data(), efforts.data());
+    predictor.max_effort = max_steps;
+    return predictor;
 }
 
 DistanceComputer* IndexHNSW::get_distance_computer() const {
     if (is_recompute) {
-        return new ZmqDistanceComputer(
+        ZmqDistanceComputer* dc = new ZmqDistanceComputer(
                 this->d, this->metric_type, this->metric_arg);
+        dc->hybrid_store = hybrid_store.get();
+        dc->provider = embedding_provider.get();
+        return dc;
+    } else if (node_blocks) {
+        return new NodeBlockDistanceComputer(*node_blocks, metric_type);
     } else {
         return storage->get_distance_computer();
     }
@@ -811,6 +2250,181 @@ void IndexHNSWPQ::train(idx_t n, const float* x) {
     (dynamic_cast<IndexPQ*>(storage))->pq.compute_sdc_table();
 }
 
+/**************************************************************
+ * IndexHNSWPQFastScan implementation
+ **************************************************************/
+
+IndexHNSWPQFastScan::IndexHNSWPQFastScan() = default;
+
+IndexHNSWPQFastScan::IndexHNSWPQFastScan(
+        int d,
+        int pq_m,
+        int M,
+        MetricType metric)
+        : IndexHNSWPQ(d, pq_m, M, 4, metric) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+            "only L2 and inner product are supported");
+}
+
+void IndexHNSWPQFastScan::add(idx_t n, const float* x) {
+    IndexHNSWPQ::add(n, x);
+    build_neighbor_blocks();
+}
+
+void IndexHNSWPQFastScan::build_neighbor_blocks() {
+    auto index_pq = dynamic_cast<const IndexPQ*>(storage);
+    FAISS_THROW_IF_NOT_MSG(
+            index_pq && index_pq->pq.nbits == 4,
+            "IndexHNSWPQFastScan requires a 4-bit IndexPQ storage");
+    hnsw.set_pq_pruning_codes(
+            index_pq->pq, index_pq->codes.data(), metric_type);
+}
+
+void IndexHNSWPQFastScan::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params_in) const {
+    using storage_idx_t = HNSW::storage_idx_t;
+    using Node = std::pair<float, storage_idx_t>;
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            hnsw.pruning_pq && hnsw.pruning_pq->nbits == 4 &&
+                    hnsw.pq_codes.size() == hnsw.code_size * ntotal,
+            "the neighbor blocks are not built");
+    FAISS_THROW_IF_NOT_MSG(storage, "search requires the storage");
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
+
+    size_t ef = hnsw.efSearch;
+    const IDSelector* sel = nullptr;
+    if (params_in) {
+        auto params = dynamic_cast<const SearchParametersHNSW*>(params_in);
+        FAISS_THROW_IF_NOT_MSG(
+                params, "IndexHNSWPQFastScan params have incorrect type");
+        ef = params->efSearch;
+        sel = params->sel;
+    }
+    ef = std::max(ef, size_t(k));
+    size_t lut_size = (hnsw.pruning_pq->M + 1) / 2 * 2 * 16;
+    HNSWStats search_stats;
+
+#pragma omp parallel
+    {
+        VisitedTable vt(ntotal);
+        std::unique_ptr<DistanceComputer> dis(
+                storage_distance_computer(storage));
+        AlignedTable<uint8_t> lut(lut_size);
+        std::vector<storage_idx_t> neighbors;
+        std::vector<float> neighbor_dis(hnsw.nb_neighbors(0));
+        HNSWStats stats;
+
+#pragma omp for schedule(dynamic)
+        for (idx_t i = 0; i < n; i++) {
+            const float* xi = x + i * d;
+            float* D = distances + i * k;
+            idx_t* I = labels + i * k;
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>>
+                    candidates;
+            std::priority_queue<Node> top;
+
+            if (hnsw.entry_point >= 0) {
+                // descend the upper levels with the PQ distances
+                dis->set_query(xi);
+                storage_idx_t nearest = hnsw.entry_point;
+                float d_nearest = (*dis)(nearest);
+                for (int level = hnsw.max_level; level >= 1; level--) {
+                    stats.combine(greedy_update_nearest(
+                            hnsw, *dis, level, nearest, d_nearest));
+                }
+
+                // level 0: one fast-scan pass per expanded node
+                float a, b;
+                hnsw.pq4_compute_lut(xi, lut.get(), &a, &b);
+                candidates.emplace(d_nearest, nearest);
+                top.emplace(d_nearest, nearest);
+                vt.set(nearest);
+                while (!candidates.empty()) {
+                    Node c = candidates.top();
+                    if (top.size() >= ef && c.first > top.top().first) {
+                        break;
+                    }
+                    candidates.pop();
+                    hnsw.fetch_neighbors(c.second, 0, neighbors, &stats.n_ios);
+                    hnsw.pq4_neighbor_distances(
+                            c.second,
+                            neighbors.size(),
+                            lut.get(),
+                            a,
+                            b,
+                            neighbor_dis.data());
+                    stats.nhops++;
+                    stats.ndis += neighbors.size();
+                    for (size_t j = 0; j < neighbors.size(); j++) {
+                        storage_idx_t v = neighbors[j];
+                        if (vt.get(v)) {
+                            continue;
+                        }
+                        vt.set(v);
+                        float dv = neighbor_dis[j];
+                        if (top.size() < ef || dv < top.top().first) {
+                            candidates.emplace(dv, v);
+                            top.emplace(dv, v);
+                            if (top.size() > ef) {
+                                top.pop();
+                            }
+                        }
+                    }
+                }
+                vt.advance();
+            }
+
+            // k best results that are selected and not deleted
+            std::vector<Node> res;
+            res.reserve(top.size());
+            for (; !top.empty(); top.pop()) {
+                res.push_back(top.top());
+            }
+            std::sort(res.begin(), res.end());
+            idx_t nres = 0;
+            for (const Node& r : res) {
+                if (nres == k) {
+                    break;
+                }
+                if (hnsw.is_deleted(r.second) ||
+                    (sel && !sel->is_member(r.second))) {
+                    continue;
+                }
+                D[nres] = r.first;
+                I[nres] = r.second;
+                nres++;
+            }
+            for (; nres < k; nres++) {
+                D[nres] = HNSW::C::neutral();
+                I[nres] = -1;
+            }
+            stats.n1++;
+        }
+
+#pragma omp critical
+        { search_stats.combine(stats); }
+    }
+
+    hnsw_stats.combine(search_stats);
+    if (metrics_enabled()) {
+        metrics_add_search_counters(n, search_stats.ndis, 0);
+    }
+
+    if (is_similarity_metric(metric_type)) {
+        // we need to revert the negated distances
+        for (size_t i = 0; i < k * n; i++) {
+            distances[i] = -distances[i];
+        }
+    }
+}
+
 /**************************************************************
  * IndexHNSWSQ implementation
  **************************************************************/
@@ -952,7 +2566,8 @@ void IndexHNSW2Level::search(
 
 #pragma omp parallel
         {
-            VisitedTable vt(ntotal);
+            ThreadVisitedTable tvt(ntotal);
+            VisitedTable& vt = *tvt;
             std::unique_ptr<DistanceComputer> dis(
                     storage_distance_computer(storage));
 
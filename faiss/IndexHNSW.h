@@ -10,18 +10,34 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <vector>
 
 #include <faiss/IndexFlat.h>
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexScalarQuantizer.h>
 #include <faiss/impl/HNSW.h>
+#include <faiss/impl/HNSWEntryPoints.h>
+#include <faiss/impl/HNSWNodeBlocks.h>
+#include <faiss/impl/HNSWUpperLevels.h>
+#include <faiss/impl/HybridEmbeddingStore.h>
+#include <faiss/impl/SearchEffortPredictor.h>
 #include <faiss/utils/utils.h>
 
 namespace faiss {
 
 struct IndexHNSW;
 
+/// warmup settings specific to IndexHNSW
+struct WarmupPolicyHNSW : WarmupPolicy {
+    /// in recompute mode, the embeddings of the hot_ids are fetched into
+    /// this cache (not owned), to be passed to the searches in
+    /// SearchParametersHNSW::embedding_cache
+    ZmqEmbeddingCache* embedding_cache = nullptr;
+    /// embedding server, if the index has no embedding_provider
+    int zmq_port = 5557;
+};
+
 /** The HNSW index is a normal random-access index with a HNSW
  * link structure built on top */
 
@@ -47,6 +63,12 @@ struct IndexHNSW : Index {
     // used when GpuIndexCagra::copyFrom(IndexHNSWCagra*) is invoked.
     bool keep_max_size_level0 = false;
 
+    // When set to true, add() protects the neighbor lists with spinlocks
+    // instead of OpenMP locks and threads grab the vectors to insert in
+    // small chunks, so that the threads stay busy when the insertion cost
+    // varies (eg. around hub nodes). The graph is built the same way.
+    bool concurrent_add = false;
+
     // ---- Modifications for atomic counter ----
     // Instead of a direct std::atomic member (which can't be copied),
     // use a pointer to an atomic. The pointer can be copied, and each
@@ -55,9 +77,42 @@ struct IndexHNSW : Index {
 
     bool is_recompute = false;
 
-    // ---- Experimental top degree disk read feature ----
-    std::string experimental_disk_storage_path = "";
-    off_t experimental_disk_data_offset = -1;
+    /// in recompute mode, nodes pinned in this store are served from RAM
+    /// or SSD instead of being recomputed (see HybridEmbeddingStore)
+    std::shared_ptr<HybridEmbeddingStore> hybrid_store;
+
+    /// in recompute mode, if set, the embeddings are computed in process by
+    /// this provider instead of the embedding server
+    std::shared_ptr<EmbeddingProvider> embedding_provider;
+
+    /// in recompute mode, add() computes the distances of the construction
+    /// from the added vectors and the recomputed embeddings of the vectors
+    /// already in the index (embedding_provider or the embedding server on
+    /// build_zmq_port) instead of the storage, with batched fetches (see
+    /// RecomputeBuildDistanceComputer)
+    bool recompute_build = false;
+    /// max nb of embeddings buffered per thread by a recompute build
+    size_t build_buffer_size = 1 << 16;
+    int build_zmq_port = 5557;
+
+    /** search with a loop specialized for the storage (IndexFlat or 8-bit
+     * IndexScalarQuantizer, see HNSWSpecializedSearcher) when no extension
+     * of the HNSW search is enabled */
+    bool specialized_search = true;
+
+    /// if set, the vectors and level 0 neighbor lists are read from these
+    /// node blocks during search instead of the storage and the graph
+    std::shared_ptr<HNSWNodeBlocks> node_blocks;
+
+    /// if set, the level 0 search starts from the entry points selected in
+    /// this table and the upper levels are not traversed (see
+    /// SearchParametersHNSW::n_entry_points)
+    std::shared_ptr<HNSWEntryPoints> entry_points;
+
+    /// if set, the upper levels are traversed with these in-RAM codes and
+    /// only the level 0 search uses the storage (or recomputes). Ignored
+    /// when entry_points is used.
+    std::shared_ptr<HNSWUpperLevelCodes> upper_level_codes;
 
     explicit IndexHNSW(
             int d = 0,
@@ -89,12 +144,69 @@ struct IndexHNSW : Index {
             RangeSearchResult* result,
             const SearchParameters* params = nullptr) const override;
 
+    /** Each batch continues the level 0 search of the previous one: the
+     * visited nodes and the frontier are kept, and the frontier is
+     * expanded until it cannot improve the max(efSearch, k) closest nodes
+     * not returned yet. Only the params->sel members are returned, but
+     * all nodes are traversed. */
+    SearchIterator* search_iterator(
+            const float* x,
+            const SearchParameters* params = nullptr) const override;
+
+    /** Search for the k nearest groups, when several stored vectors
+     * belong to the same group (eg. the chunks of a document).
+     *
+     * group_ids (size ntotal) maps each stored vector to its group. A
+     * group appears at most once in labels, with the distance of its best
+     * vector, which is returned in best_ids (size n * k) if not null. The
+     * candidates that belong to groups already in the result do not count
+     * as improvements, so with early_stop_patience the search stops once
+     * the k groups are stable. */
+    void search_grouped(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            const idx_t* group_ids,
+            float* distances,
+            idx_t* labels,
+            idx_t* best_ids = nullptr,
+            const SearchParameters* params = nullptr) const;
+
     void reconstruct(idx_t key, float* recons) const override;
 
     void reset() override;
 
     void shrink_level_0_neighbors(int size);
 
+    /** Prune the neighbor lists of a level to at most new_size links with
+     * the HNSW neighbor selection rule. With alpha > 1 (L2 only), a link is
+     * kept unless a closer kept neighbor is alpha times closer to it, as in
+     * the DiskANN RobustPrune. Unlike shrink_level_0_neighbors, the vectors
+     * of each list are fetched once (a single request in recompute mode)
+     * and the pairwise distances are computed as one block.
+     *
+     * @return nb of removed links */
+    size_t prune_neighbors(int new_size, int level = 0, float alpha = 1.0);
+
+    /** Build the entry_points table: k-means with nentries centroids on
+     * the training vectors x (typically a sample of the database), each
+     * centroid is mapped to its nearest node by a regular search.
+     *
+     * @param nprobe  default nb of entry points per query
+     */
+    void train_entry_points(
+            idx_t n,
+            const float* x,
+            size_t nentries,
+            int nprobe = 4);
+
+    /** Build upper_level_codes: the vectors of the nodes on levels >= 1
+     * are encoded with an index_factory codec (eg. "SQ8", "PQ16"), trained
+     * on these vectors. In recompute mode the vectors are fetched once.
+     * The nodes added to the upper levels afterwards are not in the table
+     * until it is rebuilt. */
+    void build_upper_level_codes(const char* codec_key = "SQ8");
+
     /** Perform search only on level 0, given the starting points for
      * each vertex.
      *
@@ -129,8 +241,43 @@ struct IndexHNSW : Index {
 
     void permute_entries(const idx_t* perm);
 
+    /** Mark the selected vectors as deleted. They are not returned by the
+     * searches anymore but stay in the graph, where they remain traversed,
+     * until compact_deleted() is called. ntotal is unchanged.
+     *
+     * @return nb of newly deleted vectors */
+    size_t mark_deleted(const IDSelector& sel);
+
+    /** Reconnect the live nodes that link to deleted nodes: the deleted
+     * neighbors are replaced by their own live neighbors and the list is
+     * pruned with the usual heuristic. Afterwards the deleted nodes are not
+     * reachable anymore (except from the entry point, which is moved to a
+     * live node). Can be called between batches of deletions.
+     *
+     * @return nb of repaired neighbor lists */
+    size_t repair_deleted();
+
+    /** repair the graph, then remove the deleted vectors from the graph and
+     * the storage. The remaining vectors are renumbered in order, as in
+     * remove_ids.
+     *
+     * @return nb of removed vectors */
+    size_t compact_deleted();
+
+    /** mark_deleted + compact_deleted. Vectors deleted earlier with
+     * mark_deleted are removed as well, so in an IndexIDMap only remove_ids
+     * should be used. */
+    size_t remove_ids(const IDSelector& sel) override;
+
     DistanceComputer* get_distance_computer() const override;
 
+    /** warms the level and offset tables, the neighbor lists and vectors
+     * of the nodes on levels > 0 (all the searches traverse them) and of
+     * policy.hot_ids. In recompute mode, the embeddings of policy.hot_ids
+     * are fetched into the embedding cache of a WarmupPolicyHNSW. With
+     * policy.all, the whole graph and storage are warmed. */
+    size_t warmup(const WarmupPolicy& policy = WarmupPolicy()) const override;
+
     /// Get the total number of vector fetches performed during the last search.
     size_t get_last_total_fetch_count() const;
 
@@ -160,6 +307,42 @@ struct IndexHNSWPQ : IndexHNSW {
     void train(idx_t n, const float* x) override;
 };
 
+/** 4-bit PQ index topped with a HNSW structure, whose level 0 search
+ * scores the neighbors with fast-scan blocks. Each node stores the codes
+ * of its level 0 neighbors next to its adjacency list, packed in blocks of
+ * 32 (see HNSW::set_pq_pruning_codes), so the ADC distances of a whole
+ * neighbor list come from one pass of the pq4_fast_scan kernel instead of
+ * one DistanceComputer call per neighbor. The distances are approximate:
+ * wrap the index in an IndexRefineFlat (factory suffix ",RFlat") to re-rank
+ * the results exactly.
+ */
+struct IndexHNSWPQFastScan : IndexHNSWPQ {
+    IndexHNSWPQFastScan();
+    IndexHNSWPQFastScan(
+            int d,
+            int pq_m,
+            int M,
+            MetricType metric = METRIC_L2);
+
+    /// adds to the graph and rebuilds the neighbor blocks of all nodes
+    void add(idx_t n, const float* x) override;
+
+    /// build the neighbor blocks from the graph and the PQ codes, to call
+    /// if the graph is modified after add
+    void build_neighbor_blocks();
+
+    /// the upper levels are descended with the PQ distances of the
+    /// storage, the selector of SearchParametersHNSW is applied as a
+    /// post-filter
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+};
+
 /** SQ index topped with a HNSW structure to access elements
  *  more efficiently.
  */
@@ -229,4 +412,61 @@ struct IndexHNSWCagra : IndexHNSW {
             const SearchParameters* params = nullptr) const override;
 };
 
+/** Renumber the nodes of an HNSW index so that the nodes traversed together
+ * are close on disk (see HNSW::locality_order), before writing it in compact
+ * format. The storage and the PQ pruning codes follow the permutation.
+ *
+ * If index is an IndexIDMap or IndexIDMap2 around an IndexHNSW, the id map
+ * is permuted as well and the search results do not change. Otherwise the
+ * labels returned by search are the new ids.
+ *
+ * @return the permutation (new id -> old id)
+ */
+std::vector<idx_t> reorder_hnsw_for_locality(
+        Index* index,
+        HNSW::ReorderType type = HNSW::REORDER_BFS,
+        const std::unordered_map<idx_t, size_t>* visit_counts = nullptr);
+
+/** Calibrate the adaptive early termination of an HNSW index (see
+ * HNSW::early_stop_patience) on a set of training queries: the smallest
+ * patience such that the search finds target_recall of the results of the
+ * search without early termination.
+ *
+ * @param index   an IndexHNSW, possibly in an IndexIDMap
+ * @param params  search parameters the calibration is valid for, default
+ *                is the efSearch of the index
+ * @return the patience, also set in the index (0 if max_patience does not
+ *         reach the target)
+ */
+int calibrate_hnsw_early_stop(
+        Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float target_recall,
+        const SearchParametersHNSW* params = nullptr,
+        int max_patience = 256);
+
+/** Train a query-adaptive termination predictor (set in
+ * SearchParametersHNSW::effort_predictor) on a set of training queries.
+ * The target of a query is the smallest nb of level 0 expansions (on a
+ * geometric grid) that finds target_recall of the results of the search
+ * without a cap.
+ *
+ * @param index      an IndexHNSW, possibly in an IndexIDMap
+ * @param nfeatures  nb of expansion rounds observed before the prediction
+ * @param params     search parameters the predictor is valid for, default
+ *                   is the efSearch of the index
+ * @param max_steps  upper bound of the predicted nb of expansions
+ */
+SearchEffortPredictor train_hnsw_effort_predictor(
+        Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float target_recall,
+        int nfeatures = 4,
+        const SearchParametersHNSW* params = nullptr,
+        int max_steps = 1024);
+
 } // namespace faiss
@@ -242,8 +242,9 @@ void IndexIDMap2Template<IndexT>::add_with_ids(
         const idx_t* xids) {
     size_t prev_ntotal = this->ntotal;
     IndexIDMapTemplate<IndexT>::add_with_ids(n, x, xids);
+    rev_map.reserve(this->ntotal);
     for (size_t i = prev_ntotal; i < this->ntotal; i++) {
-        rev_map[this->id_map[i]] = i;
+        rev_map.set(this->id_map[i], i);
     }
 }
 
@@ -261,8 +262,9 @@ template <typename IndexT>
 void IndexIDMap2Template<IndexT>::merge_from(IndexT& otherIndex, idx_t add_id) {
     size_t prev_ntotal = this->ntotal;
     IndexIDMapTemplate<IndexT>::merge_from(otherIndex, add_id);
+    rev_map.reserve(this->ntotal);
     for (size_t i = prev_ntotal; i < this->ntotal; i++) {
-        rev_map[this->id_map[i]] = i;
+        rev_map.set(this->id_map[i], i);
     }
     static_cast<IndexIDMap2Template<IndexT>&>(otherIndex).rev_map.clear();
 }
@@ -270,8 +272,9 @@ void IndexIDMap2Template<IndexT>::merge_from(IndexT& otherIndex, idx_t add_id) {
 template <typename IndexT>
 void IndexIDMap2Template<IndexT>::construct_rev_map() {
     rev_map.clear();
+    rev_map.reserve(this->ntotal);
     for (size_t i = 0; i < this->ntotal; i++) {
-        rev_map[this->id_map[i]] = i;
+        rev_map.set(this->id_map[i], i);
     }
 }
 
@@ -287,11 +290,10 @@ template <typename IndexT>
 void IndexIDMap2Template<IndexT>::reconstruct(
         idx_t key,
         typename IndexT::component_t* recons) const {
-    try {
-        this->index->reconstruct(rev_map.at(key), recons);
-    } catch (const std::out_of_range&) {
-        FAISS_THROW_FMT("key %" PRId64 " not found", key);
-    }
+    idx_t i;
+    FAISS_THROW_IF_NOT_FMT(
+            rev_map.get(key, i), "key %" PRId64 " not found", key);
+    this->index->reconstruct(i, recons);
 }
 
 // explicit template instantiations
@@ -10,6 +10,8 @@
 #include <faiss/Index.h>
 #include <faiss/IndexBinary.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/IdHashMap.h>
+#include <faiss/impl/maybe_owned_vector.h>
 
 #include <unordered_map>
 #include <vector>
@@ -24,7 +26,7 @@ struct IndexIDMapTemplate : IndexT {
 
     IndexT* index = nullptr; ///! the sub-index
     bool own_fields = false; ///! whether pointers are deleted in destructo
-    std::vector<idx_t> id_map;
+    MaybeOwnedVector<idx_t> id_map;
 
     explicit IndexIDMapTemplate(IndexT* index);
 
@@ -74,13 +76,15 @@ using IndexIDMap = IndexIDMapTemplate<Index>;
 using IndexBinaryIDMap = IndexIDMapTemplate<IndexBinary>;
 
 /** same as IndexIDMap but also provides an efficient reconstruction
- *  implementation via a 2-way index */
+ *  implementation via a 2-way index. The reverse map is serialized, so it
+ *  is not rebuilt when the index is loaded (and it can be mmapped). */
 template <typename IndexT>
 struct IndexIDMap2Template : IndexIDMapTemplate<IndexT> {
     using component_t = typename IndexT::component_t;
     using distance_t = typename IndexT::distance_t;
 
-    std::unordered_map<idx_t, idx_t> rev_map;
+    /// maps the ids to their position in id_map
+    IdHashMap rev_map;
 
     explicit IndexIDMap2Template(IndexT* index);
 
@@ -108,11 +112,11 @@ using IndexBinaryIDMap2 = IndexIDMap2Template<IndexBinary>;
 
 // IDSelector that translates the ids using an IDMap
 struct IDSelectorTranslated : IDSelector {
-    const std::vector<int64_t>& id_map;
+    const MaybeOwnedVector<int64_t>& id_map;
     const IDSelector* sel;
 
     IDSelectorTranslated(
-            const std::vector<int64_t>& id_map,
+            const MaybeOwnedVector<int64_t>& id_map,
             const IDSelector* sel)
             : id_map(id_map), sel(sel) {}
 
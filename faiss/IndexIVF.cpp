@@ -10,16 +10,24 @@
 #include <faiss/IndexIVF.h>
 
 #include <omp.h>
+#include <atomic>
 #include <cstdint>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <algorithm>
 #include <cinttypes>
 #include <cstdio>
 #include <limits>
 
+#include <faiss/utils/distances.h>
+#include <faiss/utils/executor.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/metrics.h>
 #include <faiss/utils/utils.h>
 
 #include <faiss/IndexFlat.h>
@@ -27,6 +35,8 @@
 #include <faiss/impl/CodePacker.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/SearchEffortPredictor.h>
 
 namespace faiss {
 
@@ -179,9 +189,121 @@ void IndexIVF::add(idx_t n, const float* x) {
 }
 
 void IndexIVF::add_with_ids(idx_t n, const float* x, const idx_t* xids) {
-    std::unique_ptr<idx_t[]> coarse_idx(new idx_t[n]);
-    quantizer->assign(n, x, coarse_idx.get());
-    add_core(n, x, xids, coarse_idx.get());
+    MetricsCallTimer timer(METRIC_ADD_VECTORS, METRIC_ADD_LATENCY, n);
+    if (n_spill > 0) {
+        FAISS_THROW_IF_NOT_MSG(
+                direct_map.no(),
+                "spilled assignment is not compatible with a direct map");
+        int ns = n_spill + 1;
+        std::vector<idx_t> list_nos(n * ns);
+        assign_spilled(n, x, list_nos.data());
+        // all the copies of a vector get the same id
+        std::vector<idx_t> ids;
+        if (!xids) {
+            ids.resize(n);
+            for (idx_t i = 0; i < n; i++) {
+                ids[i] = ntotal + i;
+            }
+            xids = ids.data();
+        }
+        std::vector<idx_t> lists(n);
+        for (int s = 0; s < ns; s++) {
+            for (idx_t i = 0; i < n; i++) {
+                lists[i] = list_nos[i * ns + s];
+            }
+            add_core(n, x, xids, lists.data());
+            if (s > 0) {
+                ntotal -= n;
+            }
+        }
+        return;
+    }
+    idx_t bs = add_chunk_size;
+    if (bs <= 0 || n <= bs) {
+        std::unique_ptr<idx_t[]> coarse_idx(new idx_t[n]);
+        quantizer->assign(n, x, coarse_idx.get());
+        add_core(n, x, xids, coarse_idx.get());
+        return;
+    }
+
+    // the assignment of a chunk overlaps with the add_core of the previous
+    // one, that runs in another thread. The chunks are added in order, so
+    // the ids and the order in the lists are the same as without chunks
+    std::vector<idx_t> coarse_idx[2] = {
+            std::vector<idx_t>(bs), std::vector<idx_t>(bs)};
+    std::future<void> adding;
+    for (idx_t i0 = 0, c = 0; i0 < n; i0 += bs, c ^= 1) {
+        idx_t i1 = std::min(n, i0 + bs);
+        if (verbose) {
+            printf("   IndexIVF::add_with_ids %" PRId64 ":%" PRId64 "\n",
+                   i0,
+                   i1);
+        }
+        quantizer->assign(i1 - i0, x + i0 * d, coarse_idx[c].data());
+        if (adding.valid()) {
+            adding.get();
+        }
+        const idx_t* chunk_idx = coarse_idx[c].data();
+        adding = std::async(std::launch::async, [=]() {
+            add_core(
+                    i1 - i0,
+                    x + i0 * d,
+                    xids ? xids + i0 : nullptr,
+                    chunk_idx);
+        });
+    }
+    adding.get();
+}
+
+void IndexIVF::assign_spilled(idx_t n, const float* x, idx_t* list_nos)
+        const {
+    FAISS_THROW_IF_NOT(n_spill > 0);
+    int ns = n_spill + 1;
+    // the secondary lists are chosen among the nearest centroids
+    idx_t kc = std::min(idx_t(nlist), idx_t(4 * ns));
+    std::vector<float> coarse_dis(n * kc);
+    std::vector<idx_t> coarse_idx(n * kc);
+    quantizer->search(n, x, kc, coarse_dis.data(), coarse_idx.data());
+    std::vector<float> centroids(nlist * d);
+    quantizer->reconstruct_n(0, nlist, centroids.data());
+
+#pragma omp parallel for if (n > 100)
+    for (idx_t i = 0; i < n; i++) {
+        const float* xi = x + i * d;
+        const idx_t* ci = coarse_idx.data() + i * kc;
+        idx_t* out = list_nos + i * ns;
+        std::fill(out, out + ns, idx_t(-1));
+        out[0] = ci[0];
+        if (ci[0] < 0) {
+            continue;
+        }
+        std::vector<float> r(d);
+        fvec_sub(d, xi, centroids.data() + ci[0] * d, r.data());
+        float r_norm2 = fvec_norm_L2sqr(r.data(), d);
+        float r_x = fvec_inner_product(r.data(), xi, d);
+
+        std::vector<float> loss(kc, std::numeric_limits<float>::infinity());
+        for (idx_t j = 1; j < kc; j++) {
+            if (ci[j] < 0) {
+                continue;
+            }
+            const float* c = centroids.data() + ci[j] * d;
+            loss[j] = fvec_L2sqr(xi, c, d);
+            if (r_norm2 > 0) {
+                float ip = r_x - fvec_inner_product(r.data(), c, d);
+                loss[j] += spill_lambda * ip * ip / r_norm2;
+            }
+        }
+        for (int s = 1; s < ns; s++) {
+            idx_t best = std::min_element(loss.begin(), loss.end()) -
+                    loss.begin();
+            if (!(loss[best] < std::numeric_limits<float>::infinity())) {
+                break;
+            }
+            out[s] = ci[best];
+            loss[best] = std::numeric_limits<float>::infinity();
+        }
+    }
 }
 
 void IndexIVF::add_sa_codes(idx_t n, const uint8_t* codes, const idx_t* xids) {
@@ -239,11 +361,10 @@ void IndexIVF::add_core(
 
     DirectMapAdd dm_adder(direct_map, n, xids);
 
-#pragma omp parallel reduction(+ : nadd)
-    {
-        int nt = omp_get_num_threads();
-        int rank = omp_get_thread_num();
-
+    std::atomic<size_t> nadd_atomic(0);
+    int nt = parallel_workers(n);
+    parallel_run(nt, [&](int rank) {
+        size_t nadd_rank = 0;
         // each thread takes care of a subset of lists
         for (size_t i = 0; i < n; i++) {
             idx_t list_no = coarse_idx[i];
@@ -257,12 +378,14 @@ void IndexIVF::add_core(
 
                 dm_adder.add(i, list_no, ofs);
 
-                nadd++;
+                nadd_rank++;
             } else if (rank == 0 && list_no == -1) {
                 dm_adder.add(i, -1, 0);
             }
         }
-    }
+        nadd_atomic += nadd_rank;
+    });
+    nadd = nadd_atomic;
 
     if (verbose) {
         printf("    added %zd / %" PRId64 " vectors (%zd -1s)\n",
@@ -274,6 +397,98 @@ void IndexIVF::add_core(
     ntotal += n;
 }
 
+void IndexIVF::add_with_attributes(
+        idx_t n,
+        const float* x,
+        const int32_t* attributes,
+        const idx_t* xids) {
+    int na = invlists->n_attributes;
+    FAISS_THROW_IF_NOT_MSG(
+            na > 0, "the attribute ranges of the invlists are not enabled");
+    FAISS_THROW_IF_NOT_MSG(
+            direct_map.no(),
+            "add_with_attributes does not support direct maps");
+    for (idx_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT_FMT(
+                attributes[i] >= 0 && attributes[i] < na,
+                "attribute %d out of range [0, %d)",
+                attributes[i],
+                na);
+    }
+    std::vector<size_t> old_sizes(nlist);
+    for (size_t l = 0; l < nlist; l++) {
+        FAISS_THROW_IF_NOT_FMT(
+                invlists->has_attribute_ranges(l),
+                "list %zd is not sorted by attribute",
+                l);
+        old_sizes[l] = invlists->list_size(l);
+    }
+
+    // the vectors are added with their rank in the batch as id, so that the
+    // new entries of each list can be matched with their attribute
+    std::vector<idx_t> ranks(n);
+    for (idx_t i = 0; i < n; i++) {
+        ranks[i] = i;
+    }
+    idx_t ntotal0 = ntotal;
+    add_with_ids(n, x, ranks.data());
+
+    // rewrite the lists that grew, with the new entries of attribute a
+    // after the old ones
+    std::unique_ptr<CodePacker> packer(get_CodePacker());
+    size_t cs = packer->code_size;
+#pragma omp parallel for schedule(dynamic)
+    for (idx_t l = 0; l < nlist; l++) {
+        size_t o = old_sizes[l], ls = invlists->list_size(l);
+        if (ls == o) {
+            continue;
+        }
+        std::vector<size_t>& ofs = invlists->attribute_offsets[l];
+        std::vector<size_t> new_ofs(na + 1);
+        std::vector<idx_t> new_ids(ls);
+        std::vector<uint8_t> codes(ls * cs);
+        {
+            InvertedLists::ScopedIds sids(invlists, l);
+            InvertedLists::ScopedCodes scodes(invlists, l);
+            for (size_t j = o; j < ls; j++) {
+                new_ofs[attributes[sids[j]] + 1]++;
+            }
+            for (int a = 0; a < na; a++) {
+                new_ofs[a + 1] += new_ofs[a] + ofs[a + 1] - ofs[a];
+            }
+            std::vector<size_t> wp(new_ofs.begin(), new_ofs.end() - 1);
+            auto put = [&](size_t a, size_t j, idx_t id) {
+                size_t dst = wp[a]++;
+                new_ids[dst] = id;
+                packer->unpack_1(
+                        scodes.get() + j / packer->nvec * packer->block_size,
+                        j % packer->nvec,
+                        codes.data() + dst * cs);
+            };
+            for (int a = 0; a < na; a++) {
+                for (size_t j = ofs[a]; j < ofs[a + 1]; j++) {
+                    put(a, j, sids[j]);
+                }
+            }
+            for (size_t j = o; j < ls; j++) {
+                idx_t rank = sids[j];
+                put(attributes[rank], j, xids ? xids[rank] : ntotal0 + rank);
+            }
+        }
+        std::vector<uint8_t> packed(
+                (ls + packer->nvec - 1) / packer->nvec * packer->block_size);
+        for (size_t j = 0; j < ls; j++) {
+            packer->pack_1(
+                    codes.data() + j * cs,
+                    j % packer->nvec,
+                    packed.data() + j / packer->nvec * packer->block_size);
+        }
+        invlists->resize(l, 0);
+        invlists->add_entries(l, ls, new_ids.data(), packed.data());
+        ofs = new_ofs;
+    }
+}
+
 void IndexIVF::make_direct_map(bool b) {
     if (b) {
         direct_map.set_type(DirectMap::Array, invlists, ntotal);
@@ -286,6 +501,71 @@ void IndexIVF::set_direct_map_type(DirectMap::Type type) {
     direct_map.set_type(type, invlists, ntotal);
 }
 
+namespace {
+
+/// keep the first (best) occurrence of each id in the sorted results
+void dedup_spilled_results(
+        idx_t n,
+        idx_t k_in,
+        const float* dis_in,
+        const idx_t* labels_in,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        bool is_similarity) {
+    float worst = is_similarity ? -std::numeric_limits<float>::max()
+                                : std::numeric_limits<float>::max();
+#pragma omp parallel for if (n > 100)
+    for (idx_t i = 0; i < n; i++) {
+        std::unordered_set<idx_t> seen;
+        idx_t j = 0;
+        for (idx_t l = 0; l < k_in && j < k; l++) {
+            idx_t id = labels_in[i * k_in + l];
+            if (id < 0 || !seen.insert(id).second) {
+                continue;
+            }
+            distances[i * k + j] = dis_in[i * k_in + l];
+            labels[i * k + j] = id;
+            j++;
+        }
+        for (; j < k; j++) {
+            distances[i * k + j] = worst;
+            labels[i * k + j] = -1;
+        }
+    }
+}
+
+/// keep the best result of each id in the range search results
+void dedup_spilled_results(RangeSearchResult* result, bool is_similarity) {
+    size_t j = 0;
+    size_t begin = 0;
+    for (size_t q = 0; q < result->nq; q++) {
+        size_t end = result->lims[q + 1];
+        size_t q0 = j;
+        std::unordered_map<idx_t, size_t> pos;
+        for (size_t l = begin; l < end; l++) {
+            idx_t id = result->labels[l];
+            float dis = result->distances[l];
+            auto it = pos.find(id);
+            if (it == pos.end()) {
+                pos[id] = j;
+                result->labels[j] = id;
+                result->distances[j] = dis;
+                j++;
+            } else if (
+                    is_similarity ? dis > result->distances[it->second]
+                                  : dis < result->distances[it->second]) {
+                result->distances[it->second] = dis;
+            }
+        }
+        begin = end;
+        result->lims[q] = q0;
+    }
+    result->lims[result->nq] = j;
+}
+
+} // namespace
+
 /** It is a sad fact of software that a conceptually simple function like this
  * becomes very complex when you factor in several ways of parallelizing +
  * interrupt/error handling + collecting stats + min/max collection. The
@@ -306,14 +586,32 @@ void IndexIVF::search(
     const size_t nprobe =
             std::min(nlist, params ? params->nprobe : this->nprobe);
     FAISS_THROW_IF_NOT(nprobe > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            n_spill == 0 || !(parallel_mode & PARALLEL_MODE_NO_HEAP_INIT),
+            "spilled lists need the heap initialization");
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
+
+    // with spilled lists, a vector can come back once per copy: search more
+    // results and keep the first occurrence of each id
+    const idx_t k2 = k * (n_spill + 1);
 
     // search function for a subset of queries
-    auto sub_search_func = [this, k, nprobe, params](
+    auto sub_search_func = [this, k, k2, nprobe, params](
                                    idx_t n,
                                    const float* x,
                                    float* distances,
                                    idx_t* labels,
                                    IndexIVFStats* ivf_stats) {
+        std::unique_ptr<float[]> spill_dis;
+        std::unique_ptr<idx_t[]> spill_labels;
+        float* out_dis = distances;
+        idx_t* out_labels = labels;
+        if (k2 != k) {
+            spill_dis.reset(new float[n * k2]);
+            spill_labels.reset(new idx_t[n * k2]);
+            out_dis = spill_dis.get();
+            out_labels = spill_labels.get();
+        }
         std::unique_ptr<idx_t[]> idx(new idx_t[n * nprobe]);
         std::unique_ptr<float[]> coarse_dis(new float[n * nprobe]);
 
@@ -332,48 +630,50 @@ void IndexIVF::search(
         search_preassigned(
                 n,
                 x,
-                k,
+                k2,
                 idx.get(),
                 coarse_dis.get(),
-                distances,
-                labels,
+                out_dis,
+                out_labels,
                 false,
                 params,
                 ivf_stats);
+        if (k2 != k) {
+            dedup_spilled_results(
+                    n,
+                    k2,
+                    out_dis,
+                    out_labels,
+                    k,
+                    distances,
+                    labels,
+                    is_similarity_metric(metric_type));
+        }
         double t2 = getmillisecs();
         ivf_stats->quantization_time += t1 - t0;
         ivf_stats->search_time += t2 - t0;
     };
 
-    if ((parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT) == 0) {
-        int nt = std::min(omp_get_max_threads(), int(n));
+    // the costs of a budget are indexed by query, so the queries are not
+    // sliced (search_preassigned parallelizes over them instead)
+    if ((parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT) == 0 &&
+        !(params && params->budget)) {
+        int nt = parallel_workers(n);
         std::vector<IndexIVFStats> stats(nt);
-        std::mutex exception_mutex;
-        std::string exception_string;
 
-#pragma omp parallel for if (nt > 1)
-        for (idx_t slice = 0; slice < nt; slice++) {
-            IndexIVFStats local_stats;
+        parallel_run(nt, [&](int slice) {
+            MetricsNested nested(timer);
             idx_t i0 = n * slice / nt;
             idx_t i1 = n * (slice + 1) / nt;
             if (i1 > i0) {
-                try {
-                    sub_search_func(
-                            i1 - i0,
-                            x + i0 * d,
-                            distances + i0 * k,
-                            labels + i0 * k,
-                            &stats[slice]);
-                } catch (const std::exception& e) {
-                    std::lock_guard<std::mutex> lock(exception_mutex);
-                    exception_string = e.what();
-                }
+                sub_search_func(
+                        i1 - i0,
+                        x + i0 * d,
+                        distances + i0 * k,
+                        labels + i0 * k,
+                        &stats[slice]);
             }
-        }
-
-        if (!exception_string.empty()) {
-            FAISS_THROW_MSG(exception_string.c_str());
-        }
+        });
 
         // collect stats
         for (idx_t slice = 0; slice < nt; slice++) {
@@ -407,10 +707,16 @@ void IndexIVF::search_preassigned(
     idx_t max_codes = params ? params->max_codes : this->max_codes;
     IDSelector* sel = params ? params->sel : nullptr;
     const IDSelectorRange* selr = dynamic_cast<const IDSelectorRange*>(sel);
+    // unsorted range: the zone maps of the lists skip the blocks outside
+    // the range, the selector is applied to the other ones
+    const IDSelectorRange* sel_zones = nullptr;
     if (selr) {
         if (selr->assume_sorted) {
             sel = nullptr; // use special IDSelectorRange processing
         } else {
+            if (invlists->zone_map_block_size > 0) {
+                sel_zones = selr;
+            }
             selr = nullptr; // use generic processing
         }
     }
@@ -423,6 +729,27 @@ void IndexIVF::search_preassigned(
             !invlists->use_iterator || (max_codes == 0 && store_pairs == false),
             "iterable inverted lists don't support max_codes and store_pairs");
 
+    const int attribute = params ? params->attribute : -1;
+    FAISS_THROW_IF_NOT_MSG(
+            attribute < 0 || (!store_pairs && !invlists->use_iterator),
+            "attribute filtering is not supported with store_pairs and "
+            "iterable inverted lists");
+    FAISS_THROW_IF_NOT_FMT(
+            attribute < invlists->n_attributes,
+            "attribute %d out of range [0, %d)",
+            attribute,
+            invlists->n_attributes);
+
+    // with compressed ids, the scan stores the (list, offset) pairs and only
+    // the ids of the results are decoded (the attribute ranges are scanned
+    // with their ids)
+    bool decode_result_ids = !store_pairs && !(params && params->sel) &&
+            attribute < 0 && !invlists->use_iterator &&
+            invlists->has_compressed_ids();
+    if (decode_result_ids) {
+        store_pairs = true;
+    }
+
     size_t nlistv = 0, ndis = 0, nheap = 0;
 
     using HeapForIP = CMin<float, idx_t>;
@@ -439,18 +766,186 @@ void IndexIVF::search_preassigned(
             max_codes == 0 || pmode == 0 || pmode == 3,
             "max_codes supported only for parallel_mode = 0 or 3");
 
+    const SearchBudget* budget = params ? params->budget : nullptr;
+    FAISS_THROW_IF_NOT_MSG(
+            !budget || pmode == 0 || pmode == 3,
+            "search budget supported only for parallel_mode = 0 or 3");
+    const SearchEffortPredictor* nprobe_predictor =
+            params ? params->nprobe_predictor : nullptr;
+    FAISS_THROW_IF_NOT_MSG(
+            !nprobe_predictor || pmode == 0 || pmode == 3,
+            "nprobe predictor supported only for parallel_mode = 0 or 3");
+    FAISS_THROW_IF_NOT_MSG(
+            !nprobe_predictor || nprobe_predictor->nfeatures < nprobe,
+            "the nprobe predictor needs more than nfeatures probes");
+
     if (max_codes == 0) {
         max_codes = unlimited_list_size;
     }
 
+    invlists->count_accesses(keys, n * nprobe);
+
     [[maybe_unused]] bool do_parallel = omp_get_max_threads() >= 2 &&
-            (pmode == 0           ? false
+            (pmode == 0           ? budget && n > 1
                      : pmode == 3 ? n > 1
                      : pmode == 1 ? nprobe > 1
                                   : nprobe * n > 1);
 
     void* inverted_list_context =
             params ? params->inverted_list_context : nullptr;
+    SharedThresholds* shared_thresholds =
+            params ? params->shared_thresholds : nullptr;
+
+    // the lists of a query are scanned as they are fetched (parallel_mode 0
+    // and 3 only, the other modes use the synchronous accessors)
+    bool use_fetcher = invlists->use_fetcher && !invlists->use_iterator &&
+            (pmode == 0 || pmode == 3);
+
+    // parallel_mode 4: the (query, list) work items grouped by NUMA node of
+    // the list, each node has its queue and a cursor into it
+    std::vector<std::vector<idx_t>> node_items;
+    std::unique_ptr<std::atomic<size_t>[]> node_cursor;
+    if (pmode == 4) {
+        auto ails = dynamic_cast<const ArrayInvertedLists*>(invlists);
+        FAISS_THROW_IF_NOT_MSG(
+                ails && !ails->list_node.empty(),
+                "parallel_mode 4 requires ArrayInvertedLists placed with "
+                "place_on_numa_nodes");
+        int n_groups = std::min(ails->numa_n_nodes, omp_get_max_threads());
+        node_items.resize(n_groups);
+        node_cursor.reset(new std::atomic<size_t>[n_groups]);
+        for (int g = 0; g < n_groups; g++) {
+            node_cursor[g] = 0;
+        }
+        for (idx_t ij = 0; ij < n * nprobe; ij++) {
+            if (keys[ij] >= 0) {
+                node_items[ails->list_node[keys[ij]] % n_groups].push_back(
+                        ij);
+            }
+        }
+    }
+
+    // parallel_mode 5: the (query, list) work items split in chunks of
+    // similar sizes. Each thread has a range of chunks, that it consumes
+    // from the front while idle threads steal from the back. The begin and
+    // end of a range are packed in one atomic.
+    struct WorkChunk {
+        idx_t ij;
+        size_t j0, j1; // section of the list
+    };
+    std::vector<WorkChunk> chunks;
+    std::unique_ptr<std::atomic<uint64_t>[]> chunk_ranges;
+    if (pmode == 5) {
+        int nt = omp_get_max_threads();
+        bool can_split = !invlists->use_iterator && !store_pairs && !sel_zones;
+        size_t total_size = 0;
+        for (idx_t ij = 0; ij < n * nprobe; ij++) {
+            if (keys[ij] >= 0) {
+                total_size += invlists->list_size(keys[ij]);
+            }
+        }
+        size_t chunk_size = std::max(size_t(1024), total_size / (8 * nt));
+        std::vector<size_t> chunk_cost;
+        for (idx_t ij = 0; ij < n * nprobe; ij++) {
+            if (keys[ij] < 0) {
+                continue;
+            }
+            size_t list_size = invlists->list_size(keys[ij]);
+            if (!can_split || list_size <= chunk_size) {
+                chunks.push_back({ij, 0, size_t(unlimited_list_size)});
+                chunk_cost.push_back(list_size + 1);
+                continue;
+            }
+            for (size_t j0 = 0; j0 < list_size; j0 += chunk_size) {
+                size_t j1 = std::min(j0 + chunk_size, list_size);
+                chunks.push_back({ij, j0, j1});
+                chunk_cost.push_back(j1 - j0 + 1);
+            }
+        }
+        FAISS_THROW_IF_NOT(chunks.size() < (size_t(1) << 32));
+        // contiguous ranges of equal costs
+        size_t total_cost = 0;
+        for (size_t c : chunk_cost) {
+            total_cost += c;
+        }
+        chunk_ranges.reset(new std::atomic<uint64_t>[nt]);
+        size_t c = 0, cum_cost = 0;
+        for (int t = 0; t < nt; t++) {
+            size_t c0 = c;
+            while (c < chunks.size() &&
+                   (t == nt - 1 || cum_cost < total_cost * (t + 1) / nt)) {
+                cum_cost += chunk_cost[c++];
+            }
+            chunk_ranges[t] = (uint64_t(c0) << 32) | c;
+        }
+    }
+
+    // take a chunk from the front of range t, or from its back when
+    // stealing. Returns -1 if the range is empty.
+    auto pop_chunk = [&](int t, bool steal) -> int64_t {
+        std::atomic<uint64_t>& range = chunk_ranges[t];
+        uint64_t r = range.load();
+        for (;;) {
+            uint64_t begin = r >> 32, end = r & 0xffffffff;
+            if (begin >= end) {
+                return -1;
+            }
+            uint64_t new_r = steal ? (begin << 32) | (end - 1)
+                                   : ((begin + 1) << 32) | end;
+            if (range.compare_exchange_weak(r, new_r)) {
+                return steal ? end - 1 : begin;
+            }
+        }
+    };
+
+    // parallel_mode 6: the queries of each list, list_queries[list_ptr[l]]
+    // to list_queries[list_ptr[l + 1]] with their coarse distances
+    std::vector<size_t> list_ptr;
+    std::vector<idx_t> list_queries;
+    std::vector<float> list_coarse_dis;
+    std::vector<idx_t> batch_lists; // non-empty lists, largest work first
+    if (pmode == 6) {
+        FAISS_THROW_IF_NOT_MSG(
+                !invlists->use_iterator,
+                "parallel_mode 6 does not support iterable inverted lists");
+        list_ptr.resize(nlist + 1);
+        for (idx_t ij = 0; ij < n * nprobe; ij++) {
+            if (keys[ij] >= 0) {
+                FAISS_THROW_IF_NOT_FMT(
+                        keys[ij] < (idx_t)nlist,
+                        "Invalid key=%" PRId64 " nlist=%zd\n",
+                        keys[ij],
+                        nlist);
+                list_ptr[keys[ij] + 1]++;
+            }
+        }
+        for (size_t l = 0; l < nlist; l++) {
+            list_ptr[l + 1] += list_ptr[l];
+        }
+        list_queries.resize(list_ptr[nlist]);
+        list_coarse_dis.resize(list_ptr[nlist]);
+        std::vector<size_t> fill(list_ptr.begin(), list_ptr.end() - 1);
+        for (idx_t ij = 0; ij < n * nprobe; ij++) {
+            if (keys[ij] >= 0) {
+                size_t pos = fill[keys[ij]]++;
+                list_queries[pos] = ij / nprobe;
+                list_coarse_dis[pos] = coarse_dis[ij];
+            }
+        }
+        std::vector<size_t> work(nlist);
+        for (size_t l = 0; l < nlist; l++) {
+            if (list_ptr[l + 1] > list_ptr[l] &&
+                !invlists->is_empty(l, inverted_list_context)) {
+                batch_lists.push_back(l);
+                work[l] = (list_ptr[l + 1] - list_ptr[l]) *
+                        invlists->list_size(l);
+            }
+        }
+        std::stable_sort(
+                batch_lists.begin(), batch_lists.end(), [&](idx_t a, idx_t b) {
+                    return work[a] > work[b];
+                });
+    }
 
 #pragma omp parallel if (do_parallel) reduction(+ : nlistv, ndis, nheap)
     {
@@ -496,13 +991,221 @@ void IndexIVF::search_preassigned(
             }
         };
 
+        // for a large k, the results of a query are collected in a
+        // reservoir that is partitioned when full, instead of a heap
+        // (parallel_mode 0 and 3, scanners that compute distances in blocks)
+        const bool use_reservoir = do_heap_init && (pmode == 0 || pmode == 3) &&
+                k >= distance_compute_min_k_reservoir &&
+                !invlists->use_iterator &&
+                scanner->distances_to_codes(0, nullptr, nullptr);
+        const size_t capacity = (2 * k + 15) & ~15;
+        std::vector<float> reservoir_dis(use_reservoir ? capacity : 0);
+        std::vector<idx_t> reservoir_ids(use_reservoir ? capacity : 0);
+        ReservoirTopN<HeapForIP> reservoir_ip;
+        ReservoirTopN<HeapForL2> reservoir_l2;
+
+        auto init_reservoir = [&]() {
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                reservoir_ip = ReservoirTopN<HeapForIP>(
+                        k,
+                        capacity,
+                        reservoir_dis.data(),
+                        reservoir_ids.data());
+            } else {
+                reservoir_l2 = ReservoirTopN<HeapForL2>(
+                        k,
+                        capacity,
+                        reservoir_dis.data(),
+                        reservoir_ids.data());
+            }
+        };
+
+        auto reservoir_to_result = [&](float* simi, idx_t* idxi) {
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                reservoir_ip.to_result(simi, idxi);
+            } else {
+                reservoir_l2.to_result(simi, idxi);
+            }
+        };
+
+        // exchange the k-th distance of query i with the other searches
+        const bool share_thresholds =
+                shared_thresholds && do_heap_init && !use_reservoir;
+        auto share_threshold = [&](idx_t i, float* simi, idx_t* idxi) {
+            idx_t q = shared_thresholds->query_no(x + i * d);
+            if (q < 0) {
+                return;
+            }
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                shared_thresholds->exchange<HeapForIP>(q, k, simi, idxi);
+            } else {
+                shared_thresholds->exchange<HeapForL2>(q, k, simi, idxi);
+            }
+        };
+
+        auto remove_placeholders = [&](float* simi, idx_t* idxi) {
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                SharedThresholds::remove_placeholders<HeapForIP>(
+                        k, simi, idxi);
+            } else {
+                SharedThresholds::remove_placeholders<HeapForL2>(
+                        k, simi, idxi);
+            }
+        };
+
+        // compute the distances by blocks and add them to the reservoir
+        auto scan_codes_reservoir = [&](size_t list_size,
+                                        const uint8_t* codes,
+                                        const idx_t* ids) {
+            constexpr size_t bs = 256;
+            float block_dis[bs];
+            idx_t block_ids[bs];
+            uint8_t block_mask[bs];
+            const float excluded = metric_type == METRIC_INNER_PRODUCT
+                    ? -HUGE_VALF
+                    : HUGE_VALF;
+            for (size_t j0 = 0; j0 < list_size; j0 += bs) {
+                size_t nb = std::min(bs, list_size - j0);
+                const idx_t* bids = block_ids;
+                if (store_pairs) {
+                    for (size_t j = 0; j < nb; j++) {
+                        block_ids[j] = lo_build(scanner->list_no, j0 + j);
+                    }
+                } else {
+                    bids = ids + j0;
+                }
+                scanner->distances_to_codes(
+                        nb, codes + j0 * code_size, block_dis);
+                if (sel) {
+                    sel->is_member_batch(nb, bids, block_mask);
+                    for (size_t j = 0; j < nb; j++) {
+                        if (!block_mask[j]) {
+                            block_dis[j] = excluded;
+                        }
+                    }
+                }
+                if (metric_type == METRIC_INNER_PRODUCT) {
+                    reservoir_ip.add_results(nb, block_dis, bids);
+                } else {
+                    reservoir_l2.add_results(nb, block_dis, bids);
+                }
+            }
+            return (size_t)0;
+        };
+
+        // scan codes into the heap simi, idxi or the reservoir
+        auto scan_codes = [&](size_t list_size,
+                              const uint8_t* codes,
+                              const idx_t* ids,
+                              float* simi,
+                              idx_t* idxi) {
+            if (use_reservoir) {
+                return scan_codes_reservoir(list_size, codes, ids);
+            }
+            return scanner->scan_codes(list_size, codes, ids, simi, idxi, k);
+        };
+
+        // scan the runs of blocks of a list whose ids may be in the range
+        // of sel_zones, according to the zone map of the list
+        auto scan_zones = [&](idx_t key,
+                              size_t list_size,
+                              const uint8_t* codes,
+                              const idx_t* ids,
+                              float* simi,
+                              idx_t* idxi) {
+            const idx_t* zm = invlists->zone_maps[key].data();
+            size_t bs = invlists->zone_map_block_size;
+            auto in_range = [&](size_t b) {
+                return zm[2 * b + 1] >= sel_zones->imin &&
+                        zm[2 * b] < sel_zones->imax;
+            };
+            size_t nscan = 0;
+            for (size_t j0 = 0; j0 < list_size;) {
+                if (!in_range(j0 / bs)) {
+                    j0 += bs;
+                    continue;
+                }
+                size_t j1 = j0 + bs;
+                while (j1 < list_size && in_range(j1 / bs)) {
+                    j1 += bs;
+                }
+                j1 = std::min(j1, list_size);
+                nheap += scan_codes(
+                        j1 - j0, codes + j0 * code_size, ids + j0, simi, idxi);
+                nscan += j1 - j0;
+                j0 = j1;
+            }
+            return nscan;
+        };
+
+        // scan the codes of list key, that are in memory
+        auto scan_list_codes = [&](idx_t key,
+                                   size_t list_size,
+                                   const uint8_t* codes,
+                                   const idx_t* ids,
+                                   float* simi,
+                                   idx_t* idxi,
+                                   idx_t list_size_max,
+                                   size_t j0) {
+            if (attribute >= 0) {
+                // the range of the attribute is scanned as if it were the
+                // whole list
+                FAISS_THROW_IF_NOT_FMT(
+                        invlists->has_attribute_ranges(key),
+                        "list %" PRId64 " is not sorted by attribute",
+                        key);
+                const std::vector<size_t>& ofs =
+                        invlists->attribute_offsets[key];
+                codes += ofs[attribute] * code_size;
+                ids += ofs[attribute];
+                list_size = ofs[attribute + 1] - ofs[attribute];
+                if (j0 >= list_size && j0 > 0) {
+                    return (size_t)0;
+                }
+            }
+
+            if (list_size > list_size_max) {
+                list_size = list_size_max;
+            }
+
+            if (j0 > 0) {
+                FAISS_ASSERT(ids && j0 < list_size);
+                list_size -= j0;
+                codes += j0 * code_size;
+                ids += j0;
+            }
+
+            if (selr) { // IDSelectorRange
+                // restrict search to a section of the inverted list
+                size_t jmin, jmax;
+                selr->find_sorted_ids_bounds(list_size, ids, &jmin, &jmax);
+                list_size = jmax - jmin;
+                if (list_size == 0) {
+                    return (size_t)0;
+                }
+                codes += jmin * code_size;
+                ids += jmin;
+            }
+
+            if (sel_zones && attribute < 0 && invlists->has_zone_map(key)) {
+                return scan_zones(key, list_size, codes, ids, simi, idxi);
+            }
+
+            nheap += scan_codes(list_size, codes, ids, simi, idxi);
+
+            return list_size;
+        };
+
         // single list scan using the current scanner (with query
-        // set porperly) and storing results in simi and idxi
+        // set porperly) and storing results in simi and idxi. A section
+        // [j0, list_size_max) of the list can be scanned if the list is
+        // not iterable and there are no zone maps
         auto scan_one_list = [&](idx_t key,
                                  float coarse_dis_i,
                                  float* simi,
                                  idx_t* idxi,
-                                 idx_t list_size_max) {
+                                 idx_t list_size_max,
+                                 size_t j0 = 0) {
             if (key < 0) {
                 // not enough centroids for multiprobe
                 return (size_t)0;
@@ -520,7 +1223,9 @@ void IndexIVF::search_preassigned(
 
             scanner->set_list(key, coarse_dis_i);
 
-            nlistv++;
+            if (j0 == 0) {
+                nlistv++;
+            }
 
             try {
                 if (invlists->use_iterator) {
@@ -534,13 +1239,7 @@ void IndexIVF::search_preassigned(
 
                     return list_size;
                 } else {
-                    size_t list_size = invlists->list_size(key);
-                    if (list_size > list_size_max) {
-                        list_size = list_size_max;
-                    }
-
                     InvertedLists::ScopedCodes scodes(invlists, key);
-                    const uint8_t* codes = scodes.get();
 
                     std::unique_ptr<InvertedLists::ScopedIds> sids;
                     const idx_t* ids = nullptr;
@@ -551,31 +1250,118 @@ void IndexIVF::search_preassigned(
                         ids = sids->get();
                     }
 
-                    if (selr) { // IDSelectorRange
-                        // restrict search to a section of the inverted list
-                        size_t jmin, jmax;
-                        selr->find_sorted_ids_bounds(
-                                list_size, ids, &jmin, &jmax);
-                        list_size = jmax - jmin;
-                        if (list_size == 0) {
-                            return (size_t)0;
-                        }
-                        codes += jmin * code_size;
-                        ids += jmin;
-                    }
+                    return scan_list_codes(
+                            key,
+                            invlists->list_size(key),
+                            scodes.get(),
+                            ids,
+                            simi,
+                            idxi,
+                            list_size_max,
+                            j0);
+                }
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                exception_string =
+                        demangle_cpp_symbol(typeid(e).name()) + "  " + e.what();
+                interrupt = true;
+                return size_t(0);
+            }
+        };
 
-                    nheap += scanner->scan_codes(
-                            list_size, codes, ids, simi, idxi, k);
+        // nb of codes of a list that can be scanned within the budget qb
+        // of a query, given its cost so far. Marks the cost as truncated
+        // if the list does not fit
+        auto budget_list_size = [&](const SearchBudget& qb,
+                                    SearchCost& cost,
+                                    size_t list_size) {
+            size_t max_size = std::min(
+                    SearchBudget::remaining(
+                            qb.max_ndis, qb.spent.ndis + cost.ndis),
+                    SearchBudget::remaining(
+                            qb.max_bytes, qb.spent.bytes + cost.bytes) /
+                            std::max(code_size, size_t(1)));
+            if (list_size > max_size) {
+                cost.truncated = true;
+                return (idx_t)max_size;
+            }
+            return unlimited_list_size;
+        };
 
-                    return list_size;
+        std::vector<float> effort_features(
+                nprobe_predictor ? nprobe_predictor->nfeatures : 0);
+        auto predict_nprobe = [&](idx_t i) -> idx_t {
+            SearchEffortPredictor::ivf_features(
+                    nprobe_predictor->nfeatures,
+                    keys + i * nprobe,
+                    coarse_dis + i * nprobe,
+                    effort_features.data());
+            float pred = nprobe_predictor->predict(effort_features.data());
+            return std::min(nprobe, (idx_t)std::max(std::lround(pred), 1L));
+        };
+
+        // scan the lists of query i in the order in which the fetcher of
+        // the invlists delivers them
+        auto scan_fetched_lists = [&](idx_t i,
+                                      size_t nprobe_i,
+                                      float* simi,
+                                      idx_t* idxi,
+                                      const SearchBudget* qb,
+                                      SearchCost& cost) {
+            idx_t nscan = 0;
+            try {
+                std::unique_ptr<InvertedListsFetcher> fetcher(
+                        invlists->fetch_lists(keys + i * nprobe, nprobe_i));
+                FetchedList fl;
+                while (nscan < max_codes && fetcher->next(fl)) {
+                    FAISS_THROW_IF_NOT_FMT(
+                            fl.list_no < (idx_t)nlist,
+                            "Invalid key=%" PRId64 " nlist=%zd\n",
+                            fl.list_no,
+                            nlist);
+                    if (fl.list_size == 0) {
+                        continue;
+                    }
+                    idx_t list_size_max = max_codes - nscan;
+                    if (qb) {
+                        if (qb->exhausted(cost)) {
+                            cost.truncated = true;
+                            break;
+                        }
+                        list_size_max = std::min(
+                                list_size_max,
+                                budget_list_size(*qb, cost, fl.list_size));
+                    }
+                    scanner->set_list(
+                            fl.list_no, coarse_dis[i * nprobe + fl.rank]);
+                    nlistv++;
+                    size_t nscan_list = scan_list_codes(
+                            fl.list_no,
+                            fl.list_size,
+                            fl.codes,
+                            fl.ids,
+                            simi,
+                            idxi,
+                            list_size_max,
+                            0);
+                    nscan += nscan_list;
+                    cost.ndis += nscan_list;
+                    cost.bytes += nscan_list * code_size;
+                    cost.fetches++;
+                    if (cost.truncated) {
+                        break;
+                    }
+                    if (share_thresholds) {
+                        share_threshold(i, simi, idxi);
+                    }
                 }
             } catch (const std::exception& e) {
                 std::lock_guard<std::mutex> lock(exception_mutex);
                 exception_string =
                         demangle_cpp_symbol(typeid(e).name()) + "  " + e.what();
                 interrupt = true;
-                return size_t(0);
             }
+            return nscan;
         };
 
         /****************************************************
@@ -594,25 +1380,79 @@ void IndexIVF::search_preassigned(
                 float* simi = distances + i * k;
                 idx_t* idxi = labels + i * k;
 
-                init_result(simi, idxi);
+                if (use_reservoir) {
+                    init_reservoir();
+                } else {
+                    init_result(simi, idxi);
+                }
 
                 idx_t nscan = 0;
+                SearchBudget qb;
+                if (budget) {
+                    qb = budget->query_budget(i);
+                }
+                SearchCost cost;
+                size_t nprobe_i = nprobe;
+                if (nprobe_predictor) {
+                    nprobe_i = predict_nprobe(i);
+                }
 
-                // loop over probes
-                for (size_t ik = 0; ik < nprobe; ik++) {
-                    nscan += scan_one_list(
-                            keys[i * nprobe + ik],
-                            coarse_dis[i * nprobe + ik],
+                if (use_fetcher) {
+                    nscan = scan_fetched_lists(
+                            i,
+                            nprobe_i,
                             simi,
                             idxi,
-                            max_codes - nscan);
-                    if (nscan >= max_codes) {
-                        break;
+                            budget ? &qb : nullptr,
+                            cost);
+                } else {
+                    // loop over probes
+                    for (size_t ik = 0; ik < nprobe_i; ik++) {
+                        idx_t key = keys[i * nprobe + ik];
+                        idx_t list_size_max = max_codes - nscan;
+                        if (budget && key >= 0) {
+                            if (qb.exhausted(cost)) {
+                                cost.truncated = true;
+                                break;
+                            }
+                            list_size_max = std::min(
+                                    list_size_max,
+                                    budget_list_size(
+                                            qb, cost, invlists->list_size(key)));
+                        }
+                        size_t nscan_list = scan_one_list(
+                                key,
+                                coarse_dis[i * nprobe + ik],
+                                simi,
+                                idxi,
+                                list_size_max);
+                        nscan += nscan_list;
+                        if (key >= 0) {
+                            cost.ndis += nscan_list;
+                            cost.bytes += nscan_list * code_size;
+                            cost.fetches++;
+                        }
+                        if (nscan >= max_codes || cost.truncated) {
+                            break;
+                        }
+                        if (share_thresholds) {
+                            share_threshold(i, simi, idxi);
+                        }
                     }
                 }
 
                 ndis += nscan;
-                reorder_result(simi, idxi);
+                if (budget) {
+                    budget->add_cost(i, cost);
+                }
+                if (use_reservoir) {
+                    reservoir_to_result(simi, idxi);
+                } else {
+                    reorder_result(simi, idxi);
+                    if (share_thresholds) {
+                        remove_placeholders(simi, idxi);
+                    }
+                }
 
                 if (InterruptCallback::is_interrupted()) {
                     interrupt = true;
@@ -635,6 +1475,9 @@ void IndexIVF::search_preassigned(
                             local_dis.data(),
                             local_idx.data(),
                             unlimited_list_size);
+                    if (share_thresholds) {
+                        share_threshold(i, local_dis.data(), local_idx.data());
+                    }
 
                     // can't do the test on max_codes
                 }
@@ -653,7 +1496,12 @@ void IndexIVF::search_preassigned(
                 }
 #pragma omp barrier
 #pragma omp single
-                reorder_result(simi, idxi);
+                {
+                    reorder_result(simi, idxi);
+                    if (share_thresholds) {
+                        remove_placeholders(simi, idxi);
+                    }
+                }
             }
         } else if (pmode == 2) {
             std::vector<idx_t> local_idx(k);
@@ -685,6 +1533,169 @@ void IndexIVF::search_preassigned(
                             labels + i * k);
                 }
             }
+#pragma omp single
+            for (int64_t i = 0; i < n; i++) {
+                reorder_result(distances + i * k, labels + i * k);
+            }
+        } else if (pmode == 4) {
+            std::vector<idx_t> local_idx(k);
+            std::vector<float> local_dis(k);
+            int n_groups = node_items.size();
+            int g0 = ArrayInvertedLists::numa_node_of_thread(
+                    omp_get_thread_num(), omp_get_num_threads(), n_groups);
+
+#pragma omp single
+            for (int64_t i = 0; i < n; i++) {
+                init_result(distances + i * k, labels + i * k);
+            }
+
+            // the items of the thread's node first, then help the others
+            for (int dg = 0; dg < n_groups; dg++) {
+                int g = (g0 + dg) % n_groups;
+                const std::vector<idx_t>& items = node_items[g];
+                for (;;) {
+                    size_t it = node_cursor[g]++;
+                    if (it >= items.size()) {
+                        break;
+                    }
+                    idx_t ij = items[it];
+                    size_t i = ij / nprobe;
+
+                    scanner->set_query(x + i * d);
+                    init_result(local_dis.data(), local_idx.data());
+                    ndis += scan_one_list(
+                            keys[ij],
+                            coarse_dis[ij],
+                            local_dis.data(),
+                            local_idx.data(),
+                            unlimited_list_size);
+#pragma omp critical
+                    {
+                        add_local_results(
+                                local_dis.data(),
+                                local_idx.data(),
+                                distances + i * k,
+                                labels + i * k);
+                    }
+                }
+            }
+#pragma omp barrier
+#pragma omp single
+            for (int64_t i = 0; i < n; i++) {
+                reorder_result(distances + i * k, labels + i * k);
+            }
+        } else if (pmode == 5) {
+            std::vector<idx_t> local_idx(k);
+            std::vector<float> local_dis(k);
+            int rank = omp_get_thread_num();
+            int nt = omp_get_num_threads();
+            int max_nt = omp_get_max_threads();
+
+#pragma omp single
+            for (int64_t i = 0; i < n; i++) {
+                init_result(distances + i * k, labels + i * k);
+            }
+
+            // results of the current query, merged when it changes
+            int64_t cur_i = -1;
+            auto flush = [&]() {
+                if (cur_i < 0) {
+                    return;
+                }
+#pragma omp critical
+                {
+                    add_local_results(
+                            local_dis.data(),
+                            local_idx.data(),
+                            distances + cur_i * k,
+                            labels + cur_i * k);
+                }
+                cur_i = -1;
+            };
+
+            // the own range first. There are max_nt ranges, distributed
+            // over the nt threads of the team
+            for (int dt = 0; dt < max_nt; dt++) {
+                int t = (rank + dt) % max_nt;
+                bool steal = t % nt != rank;
+                int64_t c;
+                while ((c = pop_chunk(t, steal)) >= 0) {
+                    const WorkChunk& chunk = chunks[c];
+                    int64_t i = chunk.ij / nprobe;
+                    if (i != cur_i) {
+                        flush();
+                        cur_i = i;
+                        scanner->set_query(x + i * d);
+                        init_result(local_dis.data(), local_idx.data());
+                    }
+                    ndis += scan_one_list(
+                            keys[chunk.ij],
+                            coarse_dis[chunk.ij],
+                            local_dis.data(),
+                            local_idx.data(),
+                            chunk.j1,
+                            chunk.j0);
+                }
+            }
+            flush();
+#pragma omp barrier
+#pragma omp single
+            for (int64_t i = 0; i < n; i++) {
+                reorder_result(distances + i * k, labels + i * k);
+            }
+        } else if (pmode == 6) {
+            std::vector<idx_t> local_idx;
+            std::vector<float> local_dis;
+            const IDSelector* sel_batch = params ? params->sel : nullptr;
+
+#pragma omp single
+            for (int64_t i = 0; i < n; i++) {
+                init_result(distances + i * k, labels + i * k);
+            }
+
+#pragma omp for schedule(dynamic)
+            for (idx_t il = 0; il < batch_lists.size(); il++) {
+                idx_t l = batch_lists[il];
+                size_t nq_list = list_ptr[l + 1] - list_ptr[l];
+                const idx_t* qnos = list_queries.data() + list_ptr[l];
+                local_dis.resize(nq_list * k);
+                local_idx.resize(nq_list * k);
+                for (size_t q = 0; q < nq_list; q++) {
+                    init_result(
+                            local_dis.data() + q * k, local_idx.data() + q * k);
+                }
+                try {
+                    ndis += scan_list_batch(
+                            l,
+                            nq_list,
+                            qnos,
+                            x,
+                            list_coarse_dis.data() + list_ptr[l],
+                            k,
+                            local_dis.data(),
+                            local_idx.data(),
+                            store_pairs,
+                            sel_batch,
+                            params);
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    exception_string = demangle_cpp_symbol(typeid(e).name()) +
+                            "  " + e.what();
+                    interrupt = true;
+                    continue;
+                }
+                nlistv += nq_list;
+#pragma omp critical
+                {
+                    for (size_t q = 0; q < nq_list; q++) {
+                        add_local_results(
+                                local_dis.data() + q * k,
+                                local_idx.data() + q * k,
+                                distances + qnos[q] * k,
+                                labels + qnos[q] * k);
+                    }
+                }
+            }
 #pragma omp single
             for (int64_t i = 0; i < n; i++) {
                 reorder_result(distances + i * k, labels + i * k);
@@ -710,6 +1721,18 @@ void IndexIVF::search_preassigned(
     ivf_stats->nlist += nlistv;
     ivf_stats->ndis += ndis;
     ivf_stats->nheap_updates += nheap;
+    metrics_add_search(n, ndis, nlistv);
+
+    if (decode_result_ids) {
+#pragma omp parallel for if (n * k > 1000)
+        for (idx_t i = 0; i < n * k; i++) {
+            idx_t lo = labels[i];
+            if (lo >= 0) {
+                labels[i] = invlists->get_single_id(
+                        lo_listno(lo), lo_offset(lo));
+            }
+        }
+    }
 }
 
 void IndexIVF::range_search(
@@ -748,10 +1771,194 @@ void IndexIVF::range_search(
             false,
             params,
             &indexIVF_stats);
+    if (n_spill > 0) {
+        dedup_spilled_results(result, is_similarity_metric(metric_type));
+    }
 
     indexIVF_stats.search_time += getmillisecs() - t0;
 }
 
+namespace {
+
+/* The lists are scanned in the order of the coarse quantizer, the first
+ * nprobe of them at construction, as in search. The results of the
+ * scanned lists that are not returned yet wait in a heap. More lists are
+ * scanned only when the heap runs short of results: the probe list is
+ * extended by querying the quantizer again for twice as many lists. */
+struct IVFSearchIterator : SearchIterator {
+    using Result = std::pair<float, idx_t>;
+    using MinHeap = std::priority_queue<
+            Result,
+            std::vector<Result>,
+            std::greater<Result>>;
+
+    const IndexIVF& index;
+    std::vector<float> query;
+    const SearchParameters* quantizer_params;
+    void* inverted_list_context;
+    std::unique_ptr<InvertedListScanner> scanner;
+
+    /// lists to scan and their coarse distances
+    std::vector<idx_t> keys;
+    std::vector<float> coarse_dis;
+    size_t next_key = 0;
+    /// nb of lists requested from the quantizer so far
+    size_t nprobe_requested = 0;
+    std::vector<bool> scanned;
+
+    /// distances are negated when keep_max, to have a min-heap in all cases
+    MinHeap results;
+    std::vector<float> list_dis;
+    std::vector<idx_t> list_ids;
+    IndexIVFStats stats;
+
+    IVFSearchIterator(
+            const IndexIVF& index,
+            const float* x,
+            const SearchParametersIVF* params)
+            : index(index),
+              query(x, x + index.d),
+              quantizer_params(params ? params->quantizer_params : nullptr),
+              inverted_list_context(
+                      params ? params->inverted_list_context : nullptr),
+              scanner(index.get_InvertedListScanner(
+                      false,
+                      params ? params->sel : nullptr,
+                      params)),
+              scanned(index.nlist) {
+        FAISS_THROW_IF_NOT(scanner.get());
+        scanner->set_query(query.data());
+        size_t nprobe =
+                std::min(index.nlist, params ? params->nprobe : index.nprobe);
+        FAISS_THROW_IF_NOT(nprobe > 0);
+        request_lists(nprobe);
+        for (size_t i = 0; i < nprobe; i++) {
+            if (!scan_next_list()) {
+                break;
+            }
+        }
+    }
+
+    /// fetch the nprobe nearest lists, keep the ones not scanned yet
+    void request_lists(size_t nprobe) {
+        std::vector<idx_t> all_keys(nprobe);
+        std::vector<float> all_dis(nprobe);
+        index.quantizer->search(
+                1,
+                query.data(),
+                nprobe,
+                all_dis.data(),
+                all_keys.data(),
+                quantizer_params);
+        keys.clear();
+        coarse_dis.clear();
+        next_key = 0;
+        for (size_t i = 0; i < nprobe; i++) {
+            idx_t key = all_keys[i];
+            if (key >= 0 && !scanned[key]) {
+                keys.push_back(key);
+                coarse_dis.push_back(all_dis[i]);
+            }
+        }
+        nprobe_requested = nprobe;
+    }
+
+    /// scan the next list, returns false if all lists are scanned
+    bool scan_next_list() {
+        while (next_key == keys.size()) {
+            if (nprobe_requested >= index.nlist) {
+                return false;
+            }
+            request_lists(std::min(2 * nprobe_requested, index.nlist));
+        }
+        idx_t key = keys[next_key];
+        float cdis = coarse_dis[next_key];
+        next_key++;
+        scanned[key] = true;
+
+        const InvertedLists* invlists = index.invlists;
+        if (invlists->is_empty(key, inverted_list_context)) {
+            return true;
+        }
+        // a heap as large as the list keeps all its results
+        size_t list_size = invlists->list_size(key);
+        list_dis.resize(list_size);
+        list_ids.resize(list_size);
+        if (scanner->keep_max) {
+            heap_heapify<CMin<float, idx_t>>(
+                    list_size, list_dis.data(), list_ids.data());
+        } else {
+            heap_heapify<CMax<float, idx_t>>(
+                    list_size, list_dis.data(), list_ids.data());
+        }
+        scanner->set_list(key, cdis);
+        if (invlists->use_iterator) {
+            std::unique_ptr<InvertedListsIterator> it(
+                    invlists->get_iterator(key, inverted_list_context));
+            size_t nscan = 0;
+            scanner->iterate_codes(
+                    it.get(),
+                    list_dis.data(),
+                    list_ids.data(),
+                    list_size,
+                    nscan);
+        } else {
+            InvertedLists::ScopedCodes scodes(invlists, key);
+            InvertedLists::ScopedIds ids(invlists, key);
+            scanner->scan_codes(
+                    list_size,
+                    scodes.get(),
+                    ids.get(),
+                    list_dis.data(),
+                    list_ids.data(),
+                    list_size);
+        }
+        for (size_t j = 0; j < list_size; j++) {
+            // the entries left empty are the ones filtered out
+            if (list_ids[j] >= 0) {
+                results.emplace(
+                        scanner->keep_max ? -list_dis[j] : list_dis[j],
+                        list_ids[j]);
+            }
+        }
+        stats.nlist++;
+        stats.ndis += list_size;
+        return true;
+    }
+
+    size_t next(idx_t k, float* distances, idx_t* labels) override {
+        while (results.size() < (size_t)k) {
+            if (!scan_next_list()) {
+                break;
+            }
+        }
+        size_t nres = 0;
+        while (nres < (size_t)k && !results.empty()) {
+            distances[nres] = scanner->keep_max ? -results.top().first
+                                                : results.top().first;
+            labels[nres] = results.top().second;
+            results.pop();
+            nres++;
+        }
+        indexIVF_stats.add(stats);
+        stats.reset();
+        return nres;
+    }
+};
+
+} // namespace
+
+SearchIterator* IndexIVF::search_iterator(
+        const float* x,
+        const SearchParameters* params_in) const {
+    const SearchParametersIVF* params = nullptr;
+    if (params_in) {
+        params = dynamic_cast<const SearchParametersIVF*>(params_in);
+        FAISS_THROW_IF_NOT_MSG(params, "IndexIVF params have incorrect type");
+    }
+    return new IVFSearchIterator(*this, x, params);
+}
+
 void IndexIVF::range_search_preassigned(
         idx_t nx,
         const float* x,
@@ -779,6 +1986,8 @@ void IndexIVF::range_search_preassigned(
     std::mutex exception_mutex;
     std::string exception_string;
 
+    // allocated in the parallel section but merged after it, so that the
+    // merge can run in parallel
     std::vector<RangeSearchPartialResult*> all_pres(omp_get_max_threads());
 
     int pmode = this->parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT;
@@ -794,11 +2003,11 @@ void IndexIVF::range_search_preassigned(
 
 #pragma omp parallel if (do_parallel) reduction(+ : nlistv, ndis)
     {
-        RangeSearchPartialResult pres(result);
+        all_pres[omp_get_thread_num()] = new RangeSearchPartialResult(result);
+        RangeSearchPartialResult& pres = *all_pres[omp_get_thread_num()];
         std::unique_ptr<InvertedListScanner> scanner(
                 get_InvertedListScanner(store_pairs, sel, params));
         FAISS_THROW_IF_NOT(scanner.get());
-        all_pres[omp_get_thread_num()] = &pres;
 
         // prepare the list scanning function
 
@@ -885,14 +2094,16 @@ void IndexIVF::range_search_preassigned(
         }
         if (parallel_mode == 0) {
             pres.finalize();
-        } else {
-#pragma omp barrier
-#pragma omp single
-            RangeSearchPartialResult::merge(all_pres, false);
-#pragma omp barrier
         }
     }
 
+    if (parallel_mode != 0) {
+        RangeSearchPartialResult::merge(all_pres);
+    }
+    for (RangeSearchPartialResult* pres : all_pres) {
+        delete pres;
+    }
+
     if (interrupt) {
         if (!exception_string.empty()) {
             FAISS_THROW_FMT(
@@ -917,28 +2128,203 @@ InvertedListScanner* IndexIVF::get_InvertedListScanner(
     FAISS_THROW_MSG("get_InvertedListScanner not implemented");
 }
 
+size_t IndexIVF::scan_list_batch(
+        idx_t list_no,
+        size_t nq_list,
+        const idx_t* qnos,
+        const float* x,
+        const float* coarse_dis,
+        idx_t k,
+        float* local_dis,
+        idx_t* local_idx,
+        bool store_pairs,
+        const IDSelector* sel,
+        const IVFSearchParameters* params) const {
+    size_t list_size = invlists->list_size(list_no);
+    if (list_size == 0) {
+        return 0;
+    }
+    InvertedLists::ScopedCodes scodes(invlists, list_no);
+    std::unique_ptr<InvertedLists::ScopedIds> sids;
+    const idx_t* ids = nullptr;
+    if (!store_pairs) {
+        sids = std::make_unique<InvertedLists::ScopedIds>(invlists, list_no);
+        ids = sids->get();
+    }
+
+    // tiles of queries x blocks of codes. With store_pairs, the labels are
+    // the offsets from the start of the codes, so the list is not split.
+    const size_t qtile = 16;
+    size_t bs = store_pairs ? list_size : 4096;
+    std::vector<std::unique_ptr<InvertedListScanner>> scanners;
+    for (size_t t = 0; t < std::min(qtile, nq_list); t++) {
+        scanners.emplace_back(
+                get_InvertedListScanner(store_pairs, sel, params));
+    }
+    for (size_t q0 = 0; q0 < nq_list; q0 += qtile) {
+        size_t q1 = std::min(q0 + qtile, nq_list);
+        for (size_t q = q0; q < q1; q++) {
+            scanners[q - q0]->set_query(x + qnos[q] * d);
+            scanners[q - q0]->set_list(list_no, coarse_dis[q]);
+        }
+        for (size_t j0 = 0; j0 < list_size; j0 += bs) {
+            size_t j1 = std::min(j0 + bs, list_size);
+            for (size_t q = q0; q < q1; q++) {
+                scanners[q - q0]->scan_codes(
+                        j1 - j0,
+                        scodes.get() + j0 * code_size,
+                        ids ? ids + j0 : nullptr,
+                        local_dis + q * k,
+                        local_idx + q * k,
+                        k);
+            }
+        }
+    }
+    return list_size * nq_list;
+}
+
 void IndexIVF::reconstruct(idx_t key, float* recons) const {
     idx_t lo = direct_map.get(key);
     reconstruct_from_offset(lo_listno(lo), lo_offset(lo), recons);
 }
 
-void IndexIVF::reconstruct_n(idx_t i0, idx_t ni, float* recons) const {
-    FAISS_THROW_IF_NOT(ni == 0 || (i0 >= 0 && i0 + ni <= ntotal));
+namespace {
 
-    for (idx_t list_no = 0; list_no < nlist; list_no++) {
-        size_t list_size = invlists->list_size(list_no);
-        ScopedIds idlist(invlists, list_no);
+/* Reconstructs the vectors at offsets[i] of list list_no, by blocks, and
+ * writes vector i to recons + dest[i] * d. buf is a work buffer. */
+void reconstruct_to_rows(
+        const IndexIVF& index,
+        idx_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        const idx_t* dest,
+        float* recons,
+        std::vector<float>& buf) {
+    const size_t bs = 256;
+    size_t d = index.d;
+    buf.resize(std::min(n, bs) * d);
+    for (size_t j0 = 0; j0 < n; j0 += bs) {
+        size_t j1 = std::min(j0 + bs, n);
+        index.reconstruct_from_offsets(
+                list_no, j1 - j0, offsets + j0, buf.data());
+        for (size_t j = j0; j < j1; j++) {
+            memcpy(recons + dest[j] * d,
+                   buf.data() + (j - j0) * d,
+                   sizeof(float) * d);
+        }
+    }
+}
 
-        for (idx_t offset = 0; offset < list_size; offset++) {
-            idx_t id = idlist[offset];
-            if (!(id >= i0 && id < i0 + ni)) {
+} // namespace
+
+void IndexIVF::reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+        const {
+    // sort the (offset, destination) pairs by list, then by offset
+    std::vector<idx_t> lo(n);
+    std::vector<size_t> lims(nlist + 1, 0);
+    for (idx_t i = 0; i < n; i++) {
+        lo[i] = direct_map.get(keys[i]);
+        lims[lo_listno(lo[i]) + 1]++;
+    }
+    for (size_t l = 0; l < nlist; l++) {
+        lims[l + 1] += lims[l];
+    }
+    std::vector<std::pair<idx_t, idx_t>> entries(n);
+    {
+        std::vector<size_t> pos(lims.begin(), lims.end() - 1);
+        for (idx_t i = 0; i < n; i++) {
+            entries[pos[lo_listno(lo[i])]++] = {lo_offset(lo[i]), i};
+        }
+    }
+
+    std::mutex exception_mutex;
+    std::string exception_string;
+
+#pragma omp parallel if (n > 1000)
+    {
+        std::vector<idx_t> offsets, dest;
+        std::vector<float> buf;
+
+#pragma omp for schedule(dynamic)
+        for (idx_t list_no = 0; list_no < nlist; list_no++) {
+            size_t begin = lims[list_no], end = lims[list_no + 1];
+            if (begin == end) {
                 continue;
             }
+            std::sort(entries.begin() + begin, entries.begin() + end);
+            offsets.resize(end - begin);
+            dest.resize(end - begin);
+            for (size_t j = begin; j < end; j++) {
+                offsets[j - begin] = entries[j].first;
+                dest[j - begin] = entries[j].second;
+            }
+            try {
+                reconstruct_to_rows(
+                        *this,
+                        list_no,
+                        end - begin,
+                        offsets.data(),
+                        dest.data(),
+                        recons,
+                        buf);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                exception_string = e.what();
+            }
+        }
+    }
+    if (!exception_string.empty()) {
+        FAISS_THROW_MSG(exception_string.c_str());
+    }
+}
 
-            float* reconstructed = recons + (id - i0) * d;
-            reconstruct_from_offset(list_no, offset, reconstructed);
+void IndexIVF::reconstruct_n(idx_t i0, idx_t ni, float* recons) const {
+    FAISS_THROW_IF_NOT(ni == 0 || (i0 >= 0 && i0 + ni <= ntotal));
+
+    std::mutex exception_mutex;
+    std::string exception_string;
+
+#pragma omp parallel if (ni > 1000)
+    {
+        std::vector<idx_t> offsets, dest;
+        std::vector<float> buf;
+
+#pragma omp for schedule(dynamic)
+        for (idx_t list_no = 0; list_no < nlist; list_no++) {
+            try {
+                size_t list_size = invlists->list_size(list_no);
+                if (list_size == 0) {
+                    continue;
+                }
+                offsets.clear();
+                dest.clear();
+                {
+                    ScopedIds idlist(invlists, list_no);
+                    for (idx_t offset = 0; offset < list_size; offset++) {
+                        idx_t id = idlist[offset];
+                        if (id >= i0 && id < i0 + ni) {
+                            offsets.push_back(offset);
+                            dest.push_back(id - i0);
+                        }
+                    }
+                }
+                reconstruct_to_rows(
+                        *this,
+                        list_no,
+                        offsets.size(),
+                        offsets.data(),
+                        dest.data(),
+                        recons,
+                        buf);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                exception_string = e.what();
+            }
         }
     }
+    if (!exception_string.empty()) {
+        FAISS_THROW_MSG(exception_string.c_str());
+    }
 }
 
 bool IndexIVF::check_ids_sorted() const {
@@ -1098,6 +2484,16 @@ void IndexIVF::reconstruct_from_offset(
     FAISS_THROW_MSG("reconstruct_from_offset not implemented");
 }
 
+void IndexIVF::reconstruct_from_offsets(
+        int64_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        float* recons) const {
+    for (size_t i = 0; i < n; i++) {
+        reconstruct_from_offset(list_no, offsets[i], recons + i * d);
+    }
+}
+
 void IndexIVF::reset() {
     direct_map.clear();
     invlists->reset();
@@ -1105,6 +2501,22 @@ void IndexIVF::reset() {
 }
 
 size_t IndexIVF::remove_ids(const IDSelector& sel) {
+    if (n_spill > 0) {
+        // the copies of a vector are removed together but count once
+        std::unordered_set<idx_t> removed;
+        for (size_t list_no = 0; list_no < nlist; list_no++) {
+            InvertedLists::ScopedIds ids(invlists, list_no);
+            size_t ls = invlists->list_size(list_no);
+            for (size_t j = 0; j < ls; j++) {
+                if (sel.is_member(ids[j])) {
+                    removed.insert(ids[j]);
+                }
+            }
+        }
+        direct_map.remove_ids(sel, invlists);
+        ntotal -= removed.size();
+        return removed.size();
+    }
     size_t nremove = direct_map.remove_ids(sel, invlists);
     ntotal -= nremove;
     return nremove;
@@ -1213,6 +2625,42 @@ void IndexIVF::check_compatible_for_merge(const Index& otherIndex) const {
     }
 }
 
+size_t IndexIVF::warmup(const WarmupPolicy& policy) const {
+    WarmupPolicy quantizer_policy;
+    quantizer_policy.all = true;
+    size_t nbytes = quantizer->warmup(quantizer_policy);
+
+    std::vector<idx_t> lists;
+    if (policy.all) {
+        lists.resize(nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            lists[i] = i;
+        }
+    } else if (policy.n_hot_lists > 0) {
+        const std::vector<uint64_t>& counts = invlists->access_counts;
+        bool use_counts = counts.size() == nlist;
+        std::vector<std::pair<uint64_t, idx_t>> order(nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            order[i] = {use_counts ? counts[i] : invlists->list_size(i), i};
+        }
+        size_t n_hot = std::min(policy.n_hot_lists, nlist);
+        std::partial_sort(
+                order.begin(),
+                order.begin() + n_hot,
+                order.end(),
+                std::greater<std::pair<uint64_t, idx_t>>());
+        for (size_t i = 0; i < n_hot; i++) {
+            lists.push_back(order[i].second);
+        }
+    }
+
+#pragma omp parallel for reduction(+ : nbytes) schedule(dynamic)
+    for (int64_t i = 0; i < lists.size(); i++) {
+        nbytes += invlists->warmup_list(lists[i]);
+    }
+    return nbytes;
+}
+
 void IndexIVF::merge_from(Index& otherIndex, idx_t add_id) {
     check_compatible_for_merge(otherIndex);
     IndexIVF* other = static_cast<IndexIVF*>(&otherIndex);
@@ -1288,12 +2736,29 @@ size_t InvertedListScanner::scan_codes(
         idx_t* idxi,
         size_t k) const {
     size_t nup = 0;
+    // membership of a block of ids at a time, see IDSelector::is_member_batch
+    constexpr size_t bs = 256;
+    idx_t block_ids[bs];
+    uint8_t block_mask[bs];
+    auto select_block = [&](size_t j0) {
+        size_t j1 = std::min(j0 + bs, list_size);
+        const idx_t* bids = ids + j0;
+        if (store_pairs) {
+            for (size_t j = j0; j < j1; j++) {
+                block_ids[j - j0] = lo_build(list_no, j);
+            }
+            bids = block_ids;
+        }
+        sel->is_member_batch(j1 - j0, bids, block_mask);
+    };
 
     if (!keep_max) {
         for (size_t j = 0; j < list_size; j++) {
             if (sel != nullptr) {
-                int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
-                if (!sel->is_member(id)) {
+                if (j % bs == 0) {
+                    select_block(j);
+                }
+                if (!block_mask[j % bs]) {
                     codes += code_size;
                     continue;
                 }
@@ -1310,8 +2775,10 @@ size_t InvertedListScanner::scan_codes(
     } else {
         for (size_t j = 0; j < list_size; j++) {
             if (sel != nullptr) {
-                int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
-                if (!sel->is_member(id)) {
+                if (j % bs == 0) {
+                    select_block(j);
+                }
+                if (!block_mask[j % bs]) {
                     codes += code_size;
                     continue;
                 }
@@ -1329,6 +2796,20 @@ size_t InvertedListScanner::scan_codes(
     return nup;
 }
 
+bool InvertedListScanner::distances_to_codes(
+        size_t n,
+        const uint8_t* codes,
+        float* distances) const {
+    if (code_size == 0) {
+        // the stride of the codes is not known
+        return false;
+    }
+    for (size_t j = 0; j < n; j++) {
+        distances[j] = distance_to_code(codes + j * code_size);
+    }
+    return true;
+}
+
 size_t InvertedListScanner::iterate_codes(
         InvertedListsIterator* it,
         float* simi,
@@ -68,12 +68,26 @@ struct Level1Quantizer {
     ~Level1Quantizer();
 };
 
+struct SharedThresholds;
+struct SearchEffortPredictor;
+
 struct SearchParametersIVF : SearchParameters {
     size_t nprobe = 1;    ///< number of probes at query time
     size_t max_codes = 0; ///< max nb of codes to visit to do a query
     SearchParameters* quantizer_params = nullptr;
     /// context object to pass to InvertedLists
     void* inverted_list_context = nullptr;
+    /// k-th distances shared with other searches of the same queries
+    /// (parallel_mode 0, 1 and 3, not with a reservoir for large k)
+    SharedThresholds* shared_thresholds = nullptr;
+    /// query-adaptive nprobe: the nb of lists scanned for each query is
+    /// predicted from its coarse distances, at most nprobe (parallel_mode
+    /// 0 and 3, not owned)
+    const SearchEffortPredictor* nprobe_predictor = nullptr;
+    /// if >= 0, only scan the entries with this attribute, which are
+    /// contiguous in the lists sorted by attribute (see
+    /// IndexIVF::add_with_attributes)
+    int attribute = -1;
 
     virtual ~SearchParametersIVF() {}
 };
@@ -186,6 +200,13 @@ struct IndexIVF : Index, IndexIVFInterface {
      * 1: parallelize over inverted lists
      * 2: parallelize over both
      * 3: split over queries with a finer granularity
+     * 4: NUMA aware: each (query, list) pair is processed by a thread of
+     *    the node that holds the list, requires ArrayInvertedLists placed
+     *    with place_on_numa_nodes
+     * 5: dynamic: the (query, list) pairs are split in chunks of similar
+     *    sizes, that the threads consume with work stealing
+     * 6: big batch: the queries are grouped by list and each list is
+     *    scanned once for all its queries, see scan_list_batch
      *
      * PARALLEL_MODE_NO_HEAP_INIT: binary or with the previous to
      * prevent the heap to be initialized and finalized
@@ -193,6 +214,14 @@ struct IndexIVF : Index, IndexIVFInterface {
     int parallel_mode = 0;
     const int PARALLEL_MODE_NO_HEAP_INIT = 1024;
 
+    /** add_with_ids processes the vectors by chunks of this size, as a
+     * pipeline: the coarse assignment (and for the fast-scan indexes, the
+     * encoding) of a chunk runs while the previous one is appended to the
+     * inverted lists. This bounds the memory used for the codes of a large
+     * batch. 0 = the whole batch at once.
+     */
+    idx_t add_chunk_size = 65536;
+
     /** optional map that maps back ids to invlist entries. This
      *  enables reconstruct() */
     DirectMap direct_map;
@@ -201,6 +230,19 @@ struct IndexIVF : Index, IndexIVFInterface {
     /// centroids?
     bool by_residual = true;
 
+    /** spilled assignment (SOAR): add_with_ids also stores each vector in
+     * n_spill secondary lists, so that a query whose neighbor sits near a
+     * cell boundary finds it at a smaller nprobe. The secondary lists
+     * minimize ||x - c'||^2 + spill_lambda * <r, x - c'>^2 / ||r||^2,
+     * where r is the residual to the primary centroid: they favor the
+     * centroids whose residual is orthogonal to r, that fail on other
+     * queries than the primary list. search and range_search return each
+     * id once. ntotal counts the vectors, not the list entries. Not
+     * compatible with a direct map, and not stored with the index: set it
+     * again after loading. */
+    int n_spill = 0;
+    float spill_lambda = 1.0f;
+
     /** The Inverted file takes a quantizer (an Index) on input,
      * which implements the function mapping a vector to a list
      * identifier.
@@ -223,6 +265,13 @@ struct IndexIVF : Index, IndexIVFInterface {
     /// default implementation that calls encode_vectors
     void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
 
+    /** primary and secondary lists of the vectors for n_spill > 0
+     *
+     * @param list_nos  output, size n * (n_spill + 1), the primary list of
+     *                  each vector first, -1 if there are not enough lists
+     */
+    void assign_spilled(idx_t n, const float* x, idx_t* list_nos) const;
+
     /** Implementation of vector addition where the vector assignments are
      * predefined. The default implementation hands over the code extraction to
      * encode_vectors.
@@ -237,6 +286,22 @@ struct IndexIVF : Index, IndexIVFInterface {
             const idx_t* precomputed_idx,
             void* inverted_list_context = nullptr);
 
+    /** add vectors with an attribute each, keeping the inverted lists
+     * sorted by attribute (see InvertedLists::enable_attribute_ranges,
+     * that must be called first). The lists that receive vectors are
+     * rewritten, so the vectors should be added by large batches. Not
+     * compatible with a direct map.
+     *
+     * @param attributes  attribute of each vector, size n, in
+     *                    [0, invlists->n_attributes)
+     * @param xids        ids of the vectors, if null: ntotal..ntotal + n - 1
+     */
+    void add_with_attributes(
+            idx_t n,
+            const float* x,
+            const int32_t* attributes,
+            const idx_t* xids = nullptr);
+
     /** Encodes a set of vectors as they would appear in the inverted lists
      *
      * @param list_nos   inverted list ids as returned by the
@@ -310,6 +375,14 @@ struct IndexIVF : Index, IndexIVFInterface {
             RangeSearchResult* result,
             const SearchParameters* params = nullptr) const override;
 
+    /** The first batch of results comes from the nprobe nearest lists, as
+     * in search. The results of the scanned lists are kept, and more lists
+     * are scanned only when they run short, so the next batches are
+     * approximate in the same way as a search with a larger nprobe. */
+    SearchIterator* search_iterator(
+            const float* x,
+            const SearchParameters* params = nullptr) const override;
+
     /** Get a scanner for this index (store_pairs means ignore labels)
      *
      * The default search implementation uses this to compute the distances.
@@ -321,10 +394,42 @@ struct IndexIVF : Index, IndexIVFInterface {
             const IDSelector* sel = nullptr,
             const IVFSearchParameters* params = nullptr) const;
 
+    /** Scan list_no for the nq_list queries qnos, used by parallel_mode 6.
+     *
+     * The default implementation sets the list on a tile of scanners and
+     * scans the list block by block, so that each block of codes is read
+     * once for all the queries of the tile.
+     *
+     * @param qnos        query numbers in x, size nq_list
+     * @param coarse_dis  distances of the queries to the centroid
+     * @param local_dis   heaps of the queries, size (nq_list, k), the
+     *                    results of the list are added to them
+     * @return            nb of distances computed
+     */
+    virtual size_t scan_list_batch(
+            idx_t list_no,
+            size_t nq_list,
+            const idx_t* qnos,
+            const float* x,
+            const float* coarse_dis,
+            idx_t k,
+            float* local_dis,
+            idx_t* local_idx,
+            bool store_pairs,
+            const IDSelector* sel,
+            const IVFSearchParameters* params) const;
+
     /** reconstruct a vector. Works only if maintain_direct_map is set to 1 or 2
      */
     void reconstruct(idx_t key, float* recons) const override;
 
+    /** Reconstruct vectors given their ids. The ids are looked up in the
+     * direct_map and grouped by inverted list, the lists are decoded in
+     * parallel with reconstruct_from_offsets.
+     */
+    void reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+            const override;
+
     /** Update a subset of vectors.
      *
      * The index must have a direct_map
@@ -394,6 +499,21 @@ struct IndexIVF : Index, IndexIVFInterface {
             int64_t offset,
             float* recons) const;
 
+    /** Reconstruct the vectors at n offsets of the same inverted list.
+     *
+     * The default implementation calls reconstruct_from_offset for each
+     * offset. The subclasses decode the codes in one pass and reconstruct
+     * the centroid of the list only once.
+     *
+     * @param offsets  offsets in the list, size n
+     * @param recons   output vectors, size n * d
+     */
+    virtual void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const;
+
     /// Dataset manipulation functions
 
     size_t remove_ids(const IDSelector& sel) override;
@@ -402,6 +522,11 @@ struct IndexIVF : Index, IndexIVFInterface {
 
     virtual void merge_from(Index& otherIndex, idx_t add_id) override;
 
+    /** warms the quantizer, and the inverted lists: all of them with
+     * policy.all, otherwise the policy.n_hot_lists most accessed lists
+     * (the largest ones if the access counts are not enabled) */
+    size_t warmup(const WarmupPolicy& policy = WarmupPolicy()) const override;
+
     // returns a new instance of a CodePacker
     virtual CodePacker* get_CodePacker() const;
 
@@ -502,6 +627,19 @@ struct InvertedListScanner {
             idx_t* labels,
             size_t k) const;
 
+    /** compute the distances to n codes, for the searches with a large k
+     * that collect the results in a reservoir rather than a heap. Default
+     * implementation calls distance_to_code.
+     *
+     * @return false if the scanner does not support it (because its
+     *         scan_codes does more than computing the distances), the
+     *         distances are then not computed. This is checked with n = 0.
+     */
+    virtual bool distances_to_codes(
+            size_t n,
+            const uint8_t* codes,
+            float* distances) const;
+
     // same as scan_codes, using an iterator
     virtual size_t iterate_codes(
             InvertedListsIterator* iterator,
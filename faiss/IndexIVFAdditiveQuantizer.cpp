@@ -130,6 +130,30 @@ void IndexIVFAdditiveQuantizer::reconstruct_from_offset(
     }
 }
 
+void IndexIVFAdditiveQuantizer::reconstruct_from_offsets(
+        int64_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        float* recons) const {
+    std::vector<uint8_t> gathered(n * code_size);
+    {
+        InvertedLists::ScopedCodes codes(invlists, list_no);
+        for (size_t i = 0; i < n; i++) {
+            memcpy(gathered.data() + i * code_size,
+                   codes.get() + offsets[i] * code_size,
+                   code_size);
+        }
+    }
+    aq->decode(gathered.data(), recons, n);
+    if (by_residual) {
+        std::vector<float> centroid(d);
+        quantizer->reconstruct(list_no, centroid.data());
+        for (size_t i = 0; i < n; i++) {
+            fvec_add(d, recons + i * d, centroid.data(), recons + i * d);
+        }
+    }
+}
+
 IndexIVFAdditiveQuantizer::~IndexIVFAdditiveQuantizer() = default;
 
 /*********************************************
@@ -60,6 +60,12 @@ struct IndexIVFAdditiveQuantizer : IndexIVF {
     void reconstruct_from_offset(int64_t list_no, int64_t offset, float* recons)
             const override;
 
+    void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const override;
+
     ~IndexIVFAdditiveQuantizer() override;
 };
 
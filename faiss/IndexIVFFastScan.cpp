@@ -14,6 +14,7 @@
 
 #include <omp.h>
 
+#include <future>
 #include <memory>
 
 #include <faiss/IndexIVFPQ.h>
@@ -23,7 +24,9 @@
 #include <faiss/impl/pq4_fast_scan.h>
 #include <faiss/impl/simd_result_handlers.h>
 #include <faiss/invlists/BlockInvertedLists.h>
+#include <faiss/utils/executor.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/metrics.h>
 #include <faiss/utils/quantize_lut.h>
 #include <faiss/utils/utils.h>
 
@@ -91,104 +94,135 @@ IndexIVFFastScan::~IndexIVFFastScan() = default;
  * Code management functions
  *********************************************************/
 
-void IndexIVFFastScan::add_with_ids(
+namespace {
+
+/// append a chunk of encoded vectors to the block inverted lists, the
+/// lists are packed in parallel
+void add_packed_chunk(
+        IndexIVFFastScan& index,
+        BlockInvertedLists* bil,
         idx_t n,
-        const float* x,
+        const idx_t* idx,
+        const uint8_t* flat_codes,
         const idx_t* xids) {
-    FAISS_THROW_IF_NOT(is_trained);
-
-    // do some blocking to avoid excessive allocs
-    constexpr idx_t bs = 65536;
-    if (n > bs) {
-        double t0 = getmillisecs();
-        for (idx_t i0 = 0; i0 < n; i0 += bs) {
-            idx_t i1 = std::min(n, i0 + bs);
-            if (verbose) {
-                double t1 = getmillisecs();
-                double elapsed_time = (t1 - t0) / 1000;
-                double total_time = 0;
-                if (i0 != 0) {
-                    total_time = elapsed_time / i0 * n;
-                }
-                size_t mem = get_mem_usage_kb() / (1 << 10);
-
-                printf("IndexIVFFastScan::add_with_ids %zd/%zd, time %.2f/%.2f, RSS %zdMB\n",
-                       size_t(i1),
-                       size_t(n),
-                       elapsed_time,
-                       total_time,
-                       mem);
-            }
-            add_with_ids(i1 - i0, x + i0 * d, xids ? xids + i0 : nullptr);
-        }
-        return;
-    }
-    InterruptCallback::check();
-
-    direct_map.check_can_add(xids);
-    std::unique_ptr<idx_t[]> idx(new idx_t[n]);
-    quantizer->assign(n, x, idx.get());
-
-    AlignedTable<uint8_t> flat_codes(n * code_size);
-    encode_vectors(n, x, idx.get(), flat_codes.get());
-
-    DirectMapAdd dm_adder(direct_map, n, xids);
-    BlockInvertedLists* bil = dynamic_cast<BlockInvertedLists*>(invlists);
-    FAISS_THROW_IF_NOT_MSG(bil, "only block inverted lists supported");
+    size_t code_size = index.code_size;
+    DirectMapAdd dm_adder(index.direct_map, n, xids);
 
-    // prepare batches
+    // group the vectors by list
     std::vector<idx_t> order(n);
     for (idx_t i = 0; i < n; i++) {
         order[i] = i;
     }
-
-    // TODO should not need stable
-    std::stable_sort(order.begin(), order.end(), [&idx](idx_t a, idx_t b) {
+    // stable to keep the order of the vectors in each list
+    std::stable_sort(order.begin(), order.end(), [idx](idx_t a, idx_t b) {
         return idx[a] < idx[b];
     });
-
-    // TODO parallelize
-    idx_t i0 = 0;
-    while (i0 < n) {
-        idx_t list_no = idx[order[i0]];
-        idx_t i1 = i0 + 1;
-        while (i1 < n && idx[order[i1]] == list_no) {
-            i1++;
+    std::vector<idx_t> group_begin;
+    for (idx_t i = 0; i < n; i++) {
+        idx_t list_no = idx[order[i]];
+        if (list_no >= 0 && (i == 0 || list_no != idx[order[i - 1]])) {
+            group_begin.push_back(i);
         }
+    }
+    group_begin.push_back(n);
+
+    // each list is resized and packed by a single worker
+    parallel_for(
+            parallel_workers(group_begin.size() - 1),
+            group_begin.size() - 1,
+            [&](int, size_t g) {
+                idx_t i0 = group_begin[g], i1 = i0 + 1;
+                idx_t list_no = idx[order[i0]];
+                while (i1 < n && idx[order[i1]] == list_no) {
+                    i1++;
+                }
 
-        if (list_no == -1) {
-            i0 = i1;
-            continue;
-        }
+                // make linear array
+                AlignedTable<uint8_t> list_codes((i1 - i0) * code_size);
+                size_t list_size = bil->list_size(list_no);
 
-        // make linear array
-        AlignedTable<uint8_t> list_codes((i1 - i0) * code_size);
-        size_t list_size = bil->list_size(list_no);
+                bil->resize(list_no, list_size + i1 - i0);
 
-        bil->resize(list_no, list_size + i1 - i0);
+                for (idx_t i = i0; i < i1; i++) {
+                    size_t ofs = list_size + i - i0;
+                    idx_t id = xids ? xids[order[i]] : index.ntotal + order[i];
+                    dm_adder.add(order[i], list_no, ofs);
+                    bil->ids[list_no][ofs] = id;
+                    memcpy(list_codes.data() + (i - i0) * code_size,
+                           flat_codes + order[i] * code_size,
+                           code_size);
+                }
+                pq4_pack_codes_range(
+                        list_codes.data(),
+                        index.M,
+                        list_size,
+                        list_size + i1 - i0,
+                        index.bbs,
+                        index.M2,
+                        bil->codes[list_no].data());
+            });
+
+    index.ntotal += n;
+}
+
+} // namespace
+
+void IndexIVFFastScan::add_with_ids(
+        idx_t n,
+        const float* x,
+        const idx_t* xids) {
+    FAISS_THROW_IF_NOT(is_trained);
+    direct_map.check_can_add(xids);
+    BlockInvertedLists* bil = dynamic_cast<BlockInvertedLists*>(invlists);
+    FAISS_THROW_IF_NOT_MSG(bil, "only block inverted lists supported");
 
-        for (idx_t i = i0; i < i1; i++) {
-            size_t ofs = list_size + i - i0;
-            idx_t id = xids ? xids[order[i]] : ntotal + order[i];
-            dm_adder.add(order[i], list_no, ofs);
-            bil->ids[list_no][ofs] = id;
-            memcpy(list_codes.data() + (i - i0) * code_size,
-                   flat_codes.data() + order[i] * code_size,
-                   code_size);
+    // the assignment and encoding of a chunk overlap with the packing of
+    // the previous one, that runs in another thread
+    idx_t bs = add_chunk_size > 0 ? std::min(n, add_chunk_size) : n;
+    std::vector<idx_t> idx[2];
+    AlignedTable<uint8_t> flat_codes[2];
+    std::future<void> packing;
+    double t0 = getmillisecs();
+    for (idx_t i0 = 0, c = 0; i0 < n; i0 += bs, c ^= 1) {
+        idx_t i1 = std::min(n, i0 + bs);
+        if (verbose && bs < n) {
+            double t1 = getmillisecs();
+            double elapsed_time = (t1 - t0) / 1000;
+            double total_time = 0;
+            if (i0 != 0) {
+                total_time = elapsed_time / i0 * n;
+            }
+            size_t mem = get_mem_usage_kb() / (1 << 10);
+
+            printf("IndexIVFFastScan::add_with_ids %zd/%zd, time %.2f/%.2f, RSS %zdMB\n",
+                   size_t(i1),
+                   size_t(n),
+                   elapsed_time,
+                   total_time,
+                   mem);
         }
-        pq4_pack_codes_range(
-                list_codes.data(),
-                M,
-                list_size,
-                list_size + i1 - i0,
-                bbs,
-                M2,
-                bil->codes[list_no].data());
+        InterruptCallback::check();
 
-        i0 = i1;
-    }
+        idx[c].resize(i1 - i0);
+        flat_codes[c].resize((i1 - i0) * code_size);
+        quantizer->assign(i1 - i0, x + i0 * d, idx[c].data());
+        encode_vectors(
+                i1 - i0, x + i0 * d, idx[c].data(), flat_codes[c].get());
 
-    ntotal += n;
+        if (packing.valid()) {
+            packing.get();
+        }
+        const idx_t* chunk_idx = idx[c].data();
+        const uint8_t* chunk_codes = flat_codes[c].get();
+        const idx_t* chunk_xids = xids ? xids + i0 : nullptr;
+        packing = std::async(std::launch::async, [=]() {
+            add_packed_chunk(
+                    *this, bil, i1 - i0, chunk_idx, chunk_codes, chunk_xids);
+        });
+    }
+    if (packing.valid()) {
+        packing.get();
+    }
 }
 
 CodePacker* IndexIVFFastScan::get_CodePacker() const {
@@ -317,6 +351,7 @@ void IndexIVFFastScan::search(
         FAISS_THROW_IF_NOT_MSG(
                 params, "IndexIVFFastScan params have incorrect type");
     }
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
 
     search_preassigned(
             n, x, k, nullptr, nullptr, distances, labels, false, params);
@@ -397,14 +432,51 @@ SIMDResultHandlerToFloat* make_knn_handler(
         idx_t k,
         float* distances,
         idx_t* labels,
-        const IDSelector* sel) {
+        const IDSelector* sel,
+        bool lazy_ids = false) {
+    SIMDResultHandlerToFloat* handler;
     if (is_max) {
-        return make_knn_handler_fixC<CMax<uint16_t, int64_t>>(
+        handler = make_knn_handler_fixC<CMax<uint16_t, int64_t>>(
                 impl, n, k, distances, labels, sel);
     } else {
-        return make_knn_handler_fixC<CMin<uint16_t, int64_t>>(
+        handler = make_knn_handler_fixC<CMin<uint16_t, int64_t>>(
                 impl, n, k, distances, labels, sel);
     }
+    handler->lazy_ids = lazy_ids;
+    return handler;
+}
+
+/// whether the knn search keeps (list_no, offset) pairs in the handlers
+bool use_lazy_ids(const IndexIVFFastScan& index, const IDSelector* sel) {
+    // the selector is applied to the actual ids
+    return index.lazy_ids && !sel;
+}
+
+/// points the handler to the ids of list_no, ids keeps them alive
+void set_handler_ids(
+        SIMDResultHandlerToFloat& handler,
+        const InvertedLists* invlists,
+        idx_t list_no,
+        std::unique_ptr<InvertedLists::ScopedIds>& ids) {
+    handler.list_no = list_no;
+    if (handler.lazy_ids) {
+        ids.reset();
+        handler.id_map = nullptr;
+    } else {
+        ids.reset(new InvertedLists::ScopedIds(invlists, list_no));
+        handler.id_map = ids->get();
+    }
+}
+
+/// replace the lo_build(list_no, offset) labels with the actual ids
+void resolve_lazy_ids(const InvertedLists* invlists, size_t n, idx_t* labels) {
+#pragma omp parallel for if (n > 1000)
+    for (int64_t i = 0; i < n; i++) {
+        if (labels[i] >= 0) {
+            labels[i] = invlists->get_single_id(
+                    lo_listno(labels[i]), lo_offset(labels[i]));
+        }
+    }
 }
 
 using CoarseQuantized = IndexIVFFastScan::CoarseQuantized;
@@ -496,6 +568,10 @@ void IndexIVFFastScan::search_dispatch_implem(
     const IDSelector* sel = (params) ? params->sel : nullptr;
     const SearchParameters* quantizer_params =
             params ? params->quantizer_params : nullptr;
+    // the attribute ranges do not start on block boundaries
+    FAISS_THROW_IF_NOT_MSG(
+            !params || params->attribute < 0,
+            "attribute filtering not supported for fast-scan indexes");
 
     bool is_max = !is_similarity_metric(metric_type);
     using RH = SIMDResultHandlerToFloat;
@@ -554,6 +630,7 @@ void IndexIVFFastScan::search_dispatch_implem(
         }
     } else if (impl >= 10 && impl <= 15) {
         size_t ndis = 0, nlist_visited = 0;
+        bool lazy = use_lazy_ids(*this, sel);
 
         if (!multiple_threads) {
             // clang-format off
@@ -565,7 +642,9 @@ void IndexIVFFastScan::search_dispatch_implem(
                         n, 
                         k, 
                         distances, 
-                        labels, sel
+                        labels,
+                        sel,
+                        lazy
                     )
                 );
                 search_implem_12(
@@ -584,7 +663,8 @@ void IndexIVFFastScan::search_dispatch_implem(
                         k, 
                         distances, 
                         labels,
-                        sel
+                        sel,
+                        lazy
                     )
                 );
                 search_implem_10(
@@ -612,7 +692,14 @@ void IndexIVFFastScan::search_dispatch_implem(
                         cq_i.quantize_slice(quantizer, x, quantizer_params);
                     }
                     std::unique_ptr<RH> handler(make_knn_handler(
-                            is_max, impl, i1 - i0, k, dis_i, lab_i, sel));
+                            is_max,
+                            impl,
+                            i1 - i0,
+                            k,
+                            dis_i,
+                            lab_i,
+                            sel,
+                            lazy));
                     // clang-format off
                     if (impl == 12 || impl == 13) {
                         search_implem_12(
@@ -627,9 +714,13 @@ void IndexIVFFastScan::search_dispatch_implem(
                 }
             }
         }
+        if (lazy) {
+            resolve_lazy_ids(invlists, n * k, labels);
+        }
         indexIVF_stats.nq += n;
         indexIVF_stats.ndis += ndis;
         indexIVF_stats.nlist += nlist_visited;
+        metrics_add_search(n, ndis, nlist_visited);
     } else {
         FAISS_THROW_FMT("implem %d does not exist", implem);
     }
@@ -754,6 +845,7 @@ void IndexIVFFastScan::range_search_dispatch_implem(
     indexIVF_stats.nq += n;
     indexIVF_stats.ndis += ndis;
     indexIVF_stats.nlist += nlist_visited;
+    metrics_add_search(n, ndis, nlist_visited);
 }
 
 template <class C>
@@ -822,6 +914,7 @@ void IndexIVFFastScan::search_implem_1(
     indexIVF_stats.nq += n;
     indexIVF_stats.ndis += ndis;
     indexIVF_stats.nlist += nlist_visited;
+    metrics_add_search(n, ndis, nlist_visited);
 }
 
 template <class C>
@@ -906,6 +999,7 @@ void IndexIVFFastScan::search_implem_2(
     indexIVF_stats.nq += n;
     indexIVF_stats.ndis += ndis;
     indexIVF_stats.nlist += nlist_visited;
+    metrics_add_search(n, ndis, nlist_visited);
 }
 
 void IndexIVFFastScan::search_implem_10(
@@ -959,10 +1053,10 @@ void IndexIVFFastScan::search_implem_10(
             }
 
             InvertedLists::ScopedCodes codes(invlists, list_no);
-            InvertedLists::ScopedIds ids(invlists, list_no);
+            std::unique_ptr<InvertedLists::ScopedIds> ids;
+            set_handler_ids(handler, invlists, list_no, ids);
 
             handler.ntotal = ls;
-            handler.id_map = ids.get();
 
             pq4_accumulate_loop(
                     1,
@@ -1092,13 +1186,13 @@ void IndexIVFFastScan::search_implem_12(
         ndis += (i1 - i0) * list_size;
 
         InvertedLists::ScopedCodes codes(invlists, list_no);
-        InvertedLists::ScopedIds ids(invlists, list_no);
+        std::unique_ptr<InvertedLists::ScopedIds> ids;
+        set_handler_ids(handler, invlists, list_no, ids);
 
         // prepare the handler
 
         handler.ntotal = list_size;
         handler.q_map = q_map.data();
-        handler.id_map = ids.get();
 
         pq4_accumulate_loop_qbs(
                 qbs_for_list,
@@ -1242,7 +1336,14 @@ void IndexIVFFastScan::search_implem_14(
 
         // prepare the result handlers
         std::unique_ptr<SIMDResultHandlerToFloat> handler(make_knn_handler(
-                is_max, impl, n, k, local_dis.data(), local_idx.data(), sel));
+                is_max,
+                impl,
+                n,
+                k,
+                local_dis.data(),
+                local_idx.data(),
+                sel,
+                use_lazy_ids(*this, sel)));
         handler->begin(normalizers.get());
 
         int actual_qbs2 = this->qbs2 ? this->qbs2 : 11;
@@ -1293,13 +1394,13 @@ void IndexIVFFastScan::search_implem_14(
             ndis += (i1 - i0) * list_size;
 
             InvertedLists::ScopedCodes codes(invlists, list_no);
-            InvertedLists::ScopedIds ids(invlists, list_no);
+            std::unique_ptr<InvertedLists::ScopedIds> ids;
+            set_handler_ids(*handler, invlists, list_no, ids);
 
             // prepare the handler
 
             handler->ntotal = list_size;
             handler->q_map = q_map.data();
-            handler->id_map = ids.get();
 
             pq4_accumulate_loop_qbs(
                     qbs_for_list,
@@ -1350,6 +1451,7 @@ void IndexIVFFastScan::search_implem_14(
     indexIVF_stats.nq += n;
     indexIVF_stats.ndis += ndis;
     indexIVF_stats.nlist += nlist_visited;
+    metrics_add_search(n, ndis, nlist_visited);
 }
 
 void IndexIVFFastScan::reconstruct_from_offset(
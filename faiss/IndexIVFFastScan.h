@@ -60,6 +60,15 @@ struct IndexIVFFastScan : IndexIVF {
     int qbs = 0;
     size_t qbs2 = 0;
 
+    /** the result handlers keep (list_no, offset) pairs during the knn
+     * search and the ids are resolved only for the final k results of each
+     * query. This avoids accessing the ids of all the visited lists, which
+     * is useful when they are compressed or on disk. The results with tied
+     * distances may differ from the default because the heaps break ties
+     * on the pairs. Not used with an IDSelector, which is applied to the
+     * actual ids, nor for range search. */
+    bool lazy_ids = false;
+
     // quantizer used to pack the codes
     Quantizer* fine_quantizer = nullptr;
 
@@ -11,6 +11,7 @@
 
 #include <omp.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstdio>
 
@@ -21,6 +22,7 @@
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/extra_distances-inl.h>
 #include <faiss/utils/utils.h>
 
 namespace faiss {
@@ -117,7 +119,8 @@ void IndexIVFFlat::encode_vectors(
 
 void IndexIVFFlat::sa_decode(idx_t n, const uint8_t* bytes, float* x) const {
     size_t coarse_size = coarse_code_size();
-    for (size_t i = 0; i < n; i++) {
+#pragma omp parallel for if (n > 1000)
+    for (idx_t i = 0; i < n; i++) {
         const uint8_t* code = bytes + i * (code_size + coarse_size);
         float* xi = x + i * d;
         memcpy(xi, code + coarse_size, code_size);
@@ -126,13 +129,16 @@ void IndexIVFFlat::sa_decode(idx_t n, const uint8_t* bytes, float* x) const {
 
 namespace {
 
-template <MetricType metric, class C, bool use_sel>
+template <class VD, bool use_sel>
 struct IVFFlatScanner : InvertedListScanner {
+    using C = typename VD::C;
+    VD vd;
     size_t d;
 
-    IVFFlatScanner(size_t d, bool store_pairs, const IDSelector* sel)
-            : InvertedListScanner(store_pairs, sel), d(d) {
-        keep_max = is_similarity_metric(metric);
+    IVFFlatScanner(const VD& vd, bool store_pairs, const IDSelector* sel)
+            : InvertedListScanner(store_pairs, sel), vd(vd), d(vd.d) {
+        keep_max = VD::is_similarity;
+        code_size = sizeof(float) * d;
     }
 
     const float* xi;
@@ -144,12 +150,24 @@ struct IVFFlatScanner : InvertedListScanner {
         this->list_no = list_no;
     }
 
+    /// the selector is applied per block of ids, see
+    /// IDSelector::is_member_batch
+    static constexpr size_t sel_block_size = 256;
+
+    bool selected(
+            const idx_t* ids,
+            size_t list_size,
+            size_t j,
+            uint8_t* block_mask) const {
+        if (j % sel_block_size == 0) {
+            size_t n = std::min(list_size - j, sel_block_size);
+            sel->is_member_batch(n, ids + j, block_mask);
+        }
+        return block_mask[j % sel_block_size];
+    }
+
     float distance_to_code(const uint8_t* code) const override {
-        const float* yj = (float*)code;
-        float dis = metric == METRIC_INNER_PRODUCT
-                ? fvec_inner_product(xi, yj, d)
-                : fvec_L2sqr(xi, yj, d);
-        return dis;
+        return vd(xi, (const float*)code);
     }
 
     size_t scan_codes(
@@ -161,20 +179,21 @@ struct IVFFlatScanner : InvertedListScanner {
             size_t k) const override {
         const float* list_vecs = (const float*)codes;
         size_t nup = 0;
+        uint8_t block_mask[sel_block_size];
+        HeapBuffer<C> heap(k, simi, idxi);
         for (size_t j = 0; j < list_size; j++) {
             const float* yj = list_vecs + d * j;
-            if (use_sel && !sel->is_member(ids[j])) {
+            if (use_sel && !selected(ids, list_size, j, block_mask)) {
                 continue;
             }
-            float dis = metric == METRIC_INNER_PRODUCT
-                    ? fvec_inner_product(xi, yj, d)
-                    : fvec_L2sqr(xi, yj, d);
-            if (C::cmp(simi[0], dis)) {
+            float dis = vd(xi, yj);
+            if (C::cmp(heap.threshold, dis)) {
                 int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
-                heap_replace_top<C>(k, simi, idxi, dis, id);
+                heap.push(dis, id);
                 nup++;
             }
         }
+        heap.flush();
         return nup;
     }
 
@@ -185,14 +204,13 @@ struct IVFFlatScanner : InvertedListScanner {
             float radius,
             RangeQueryResult& res) const override {
         const float* list_vecs = (const float*)codes;
+        uint8_t block_mask[sel_block_size];
         for (size_t j = 0; j < list_size; j++) {
             const float* yj = list_vecs + d * j;
-            if (use_sel && !sel->is_member(ids[j])) {
+            if (use_sel && !selected(ids, list_size, j, block_mask)) {
                 continue;
             }
-            float dis = metric == METRIC_INNER_PRODUCT
-                    ? fvec_inner_product(xi, yj, d)
-                    : fvec_L2sqr(xi, yj, d);
+            float dis = vd(xi, yj);
             if (C::cmp(radius, dis)) {
                 int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
                 res.add(dis, id);
@@ -201,23 +219,18 @@ struct IVFFlatScanner : InvertedListScanner {
     }
 };
 
-template <bool use_sel>
-InvertedListScanner* get_InvertedListScanner1(
-        const IndexIVFFlat* ivf,
-        bool store_pairs,
-        const IDSelector* sel) {
-    if (ivf->metric_type == METRIC_INNER_PRODUCT) {
-        return new IVFFlatScanner<
-                METRIC_INNER_PRODUCT,
-                CMin<float, int64_t>,
-                use_sel>(ivf->d, store_pairs, sel);
-    } else if (ivf->metric_type == METRIC_L2) {
-        return new IVFFlatScanner<METRIC_L2, CMax<float, int64_t>, use_sel>(
-                ivf->d, store_pairs, sel);
-    } else {
-        FAISS_THROW_MSG("metric type not supported");
+struct Run_get_InvertedListScanner {
+    using T = InvertedListScanner*;
+
+    template <class VD>
+    InvertedListScanner* f(VD& vd, bool store_pairs, const IDSelector* sel) {
+        if (sel) {
+            return new IVFFlatScanner<VD, true>(vd, store_pairs, sel);
+        } else {
+            return new IVFFlatScanner<VD, false>(vd, store_pairs, sel);
+        }
     }
-}
+};
 
 } // anonymous namespace
 
@@ -225,11 +238,84 @@ InvertedListScanner* IndexIVFFlat::get_InvertedListScanner(
         bool store_pairs,
         const IDSelector* sel,
         const IVFSearchParameters*) const {
-    if (sel) {
-        return get_InvertedListScanner1<true>(this, store_pairs, sel);
+    Run_get_InvertedListScanner run;
+    return dispatch_VectorDistance(
+            d, metric_type, metric_arg, run, store_pairs, sel);
+}
+
+size_t IndexIVFFlat::scan_list_batch(
+        idx_t list_no,
+        size_t nq_list,
+        const idx_t* qnos,
+        const float* x,
+        const float* coarse_dis,
+        idx_t k,
+        float* local_dis,
+        idx_t* local_idx,
+        bool store_pairs,
+        const IDSelector* sel,
+        const IVFSearchParameters* params) const {
+    if (sel || store_pairs ||
+        (metric_type != METRIC_L2 && metric_type != METRIC_INNER_PRODUCT)) {
+        return IndexIVF::scan_list_batch(
+                list_no,
+                nq_list,
+                qnos,
+                x,
+                coarse_dis,
+                k,
+                local_dis,
+                local_idx,
+                store_pairs,
+                sel,
+                params);
+    }
+    size_t list_size = invlists->list_size(list_no);
+    if (list_size == 0) {
+        return 0;
+    }
+    InvertedLists::ScopedCodes scodes(invlists, list_no);
+    InvertedLists::ScopedIds sids(invlists, list_no);
+    const float* xb = (const float*)scodes.get();
+
+    std::vector<float> xq(nq_list * d);
+    for (size_t q = 0; q < nq_list; q++) {
+        memcpy(xq.data() + q * d, x + qnos[q] * d, sizeof(float) * d);
+    }
+    std::vector<float> D(nq_list * k);
+    std::vector<idx_t> I(nq_list * k);
+    if (metric_type == METRIC_L2) {
+        knn_L2sqr(
+                xq.data(), xb, d, nq_list, list_size, k, D.data(), I.data());
     } else {
-        return get_InvertedListScanner1<false>(this, store_pairs, sel);
+        knn_inner_product(
+                xq.data(), xb, d, nq_list, list_size, k, D.data(), I.data());
+    }
+    for (size_t j = 0; j < nq_list * k; j++) {
+        if (I[j] >= 0) {
+            I[j] = sids.get()[I[j]];
+        }
+    }
+    for (size_t q = 0; q < nq_list; q++) {
+        if (metric_type == METRIC_L2) {
+            heap_addn<CMax<float, idx_t>>(
+                    k,
+                    local_dis + q * k,
+                    local_idx + q * k,
+                    D.data() + q * k,
+                    I.data() + q * k,
+                    k);
+        } else {
+            heap_addn<CMin<float, idx_t>>(
+                    k,
+                    local_dis + q * k,
+                    local_idx + q * k,
+                    D.data() + q * k,
+                    I.data() + q * k,
+                    k);
+        }
     }
+    return list_size * nq_list;
 }
 
 void IndexIVFFlat::reconstruct_from_offset(
@@ -239,6 +325,17 @@ void IndexIVFFlat::reconstruct_from_offset(
     memcpy(recons, invlists->get_single_code(list_no, offset), code_size);
 }
 
+void IndexIVFFlat::reconstruct_from_offsets(
+        int64_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        float* recons) const {
+    InvertedLists::ScopedCodes codes(invlists, list_no);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(recons + i * d, codes.get() + offsets[i] * code_size, code_size);
+    }
+}
+
 /*****************************************
  * IndexIVFFlatDedup implementation
  ******************************************/
@@ -491,4 +588,12 @@ void IndexIVFFlatDedup::reconstruct_from_offset(int64_t, int64_t, float*)
     FAISS_THROW_MSG("not implemented");
 }
 
+void IndexIVFFlatDedup::reconstruct_from_offsets(
+        int64_t,
+        size_t,
+        const idx_t*,
+        float*) const {
+    FAISS_THROW_MSG("not implemented");
+}
+
 } // namespace faiss
@@ -47,9 +47,29 @@ struct IndexIVFFlat : IndexIVF {
             const IDSelector* sel,
             const IVFSearchParameters* params) const override;
 
+    /// computes the distances of the queries to the list with a GEMM
+    size_t scan_list_batch(
+            idx_t list_no,
+            size_t nq_list,
+            const idx_t* qnos,
+            const float* x,
+            const float* coarse_dis,
+            idx_t k,
+            float* local_dis,
+            idx_t* local_idx,
+            bool store_pairs,
+            const IDSelector* sel,
+            const IVFSearchParameters* params) const override;
+
     void reconstruct_from_offset(int64_t list_no, int64_t offset, float* recons)
             const override;
 
+    void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const override;
+
     void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
 
     IndexIVFFlat();
@@ -102,6 +122,13 @@ struct IndexIVFFlatDedup : IndexIVFFlat {
     void reconstruct_from_offset(int64_t list_no, int64_t offset, float* recons)
             const override;
 
+    /// not implemented
+    void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const override;
+
     IndexIVFFlatDedup() {}
 };
 
@@ -6,6 +6,10 @@
  */
 
 #include <faiss/IndexIVFIndependentQuantizer.h>
+
+#include <algorithm>
+#include <future>
+
 #include <faiss/IndexIVFPQ.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/utils.h>
@@ -89,14 +93,50 @@ void IndexIVFIndependentQuantizer::search(
         const SearchParameters* params) const {
     FAISS_THROW_IF_NOT_MSG(!params, "search parameters not supported");
     int nprobe = index_ivf->nprobe;
-    std::vector<float> D(n * nprobe);
-    std::vector<idx_t> I(n * nprobe);
-    quantizer->search(n, x, nprobe, D.data(), I.data());
+    idx_t bs = search_chunk_size;
+    if (bs <= 0 || n <= bs) {
+        std::vector<float> D(n * nprobe);
+        std::vector<idx_t> I(n * nprobe);
+        quantizer->search(n, x, nprobe, D.data(), I.data());
 
-    VTransformedVectors tv(vt, n, x);
+        VTransformedVectors tv(vt, n, x);
 
-    index_ivf->search_preassigned(
-            n, tv.x, k, I.data(), D.data(), distances, labels, false);
+        index_ivf->search_preassigned(
+                n, tv.x, k, I.data(), D.data(), distances, labels, false);
+        return;
+    }
+
+    // the coarse quantization of chunk i + 1 runs in another thread while
+    // chunk i is scanned. There are 2 buffers, so at most one chunk is
+    // quantized ahead.
+    std::vector<float> D[2] = {
+            std::vector<float>(bs * nprobe), std::vector<float>(bs * nprobe)};
+    std::vector<idx_t> I[2] = {
+            std::vector<idx_t>(bs * nprobe), std::vector<idx_t>(bs * nprobe)};
+    auto quantize = [&](idx_t i0, int c) {
+        idx_t i1 = std::min(n, i0 + bs);
+        quantizer->search(
+                i1 - i0, x + i0 * d, nprobe, D[c].data(), I[c].data());
+    };
+    std::future<void> quantizing =
+            std::async(std::launch::async, quantize, 0, 0);
+    for (idx_t i0 = 0, c = 0; i0 < n; i0 += bs, c ^= 1) {
+        idx_t i1 = std::min(n, i0 + bs);
+        quantizing.get();
+        if (i1 < n) {
+            quantizing = std::async(std::launch::async, quantize, i1, c ^ 1);
+        }
+        VTransformedVectors tv(vt, i1 - i0, x + i0 * d);
+        index_ivf->search_preassigned(
+                i1 - i0,
+                tv.x,
+                k,
+                I[c].data(),
+                D[c].data(),
+                distances + i0 * k,
+                labels + i0 * k,
+                false);
+    }
 }
 
 void IndexIVFIndependentQuantizer::reset() {
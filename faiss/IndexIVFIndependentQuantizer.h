@@ -29,6 +29,14 @@ struct IndexIVFIndependentQuantizer : Index {
     /// whether *this owns the 3 fields
     bool own_fields = false;
 
+    /** search processes the queries by chunks of this size, as a pipeline:
+     * the coarse quantization of a chunk (eg. on GPU) runs in another
+     * thread while the lists of the previous chunk are scanned. The
+     * throughput of large batches approaches the one of the slowest of
+     * the two stages. 0 = the whole batch at once.
+     */
+    idx_t search_chunk_size = 0;
+
     IndexIVFIndependentQuantizer(
             Index* quantizer,
             IndexIVF* index_ivf,
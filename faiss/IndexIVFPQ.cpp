@@ -14,11 +14,13 @@
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <memory>
 
 #include <algorithm>
 
 #include <faiss/utils/Heap.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/fp16.h>
 #include <faiss/utils/utils.h>
 
 #include <faiss/Clustering.h>
@@ -31,6 +33,7 @@
 #include <faiss/impl/IDSelector.h>
 
 #include <faiss/impl/ProductQuantizer.h>
+#include <faiss/impl/sa_decode_kernels.h>
 
 #include <faiss/impl/code_distance/code_distance.h>
 
@@ -183,6 +186,11 @@ void IndexIVFPQ::encode_vectors(
 
 void IndexIVFPQ::sa_decode(idx_t n, const uint8_t* codes, float* x) const {
     size_t coarse_size = coarse_code_size();
+    SaDecodeKernel kernel(this);
+    if (kernel.is_available()) {
+        kernel.decode(n, codes, code_size + coarse_size, x);
+        return;
+    }
 
 #pragma omp parallel
     {
@@ -328,9 +336,67 @@ void IndexIVFPQ::reconstruct_from_offset(
     }
 }
 
+void IndexIVFPQ::reconstruct_from_offsets(
+        int64_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        float* recons) const {
+    SaDecodeKernel kernel(this);
+    InvertedLists::ScopedCodes codes(invlists, list_no);
+    if (kernel.is_available()) {
+        // the kernel decodes standalone codes, that include the list number
+        size_t coarse_size = coarse_code_size();
+        size_t sa_size = coarse_size + code_size;
+        std::vector<uint8_t> sa_codes(n * sa_size);
+        for (size_t i = 0; i < n; i++) {
+            uint8_t* sa_code = sa_codes.data() + i * sa_size;
+            encode_listno(list_no, sa_code);
+            memcpy(sa_code + coarse_size,
+                   codes.get() + offsets[i] * code_size,
+                   code_size);
+        }
+        kernel.decode(n, sa_codes.data(), sa_size, recons);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        pq.decode(codes.get() + offsets[i] * code_size, recons + i * d);
+    }
+    if (by_residual) {
+        std::vector<float> centroid(d);
+        quantizer->reconstruct(list_no, centroid.data());
+        for (size_t i = 0; i < n; i++) {
+            fvec_add(d, recons + i * d, centroid.data(), recons + i * d);
+        }
+    }
+}
+
+void IndexIVFPQ::reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+        const {
+    SaDecodeKernel kernel(this);
+    if (!kernel.is_available()) {
+        IndexIVF::reconstruct_batch(n, keys, recons);
+        return;
+    }
+    size_t coarse_size = coarse_code_size();
+    size_t sa_size = coarse_size + code_size;
+    std::vector<uint8_t> codes(n * sa_size);
+    for (idx_t i = 0; i < n; i++) {
+        idx_t lo = direct_map.get(keys[i]);
+        idx_t list_no = lo_listno(lo);
+        InvertedLists::ScopedCodes code(invlists, list_no, lo_offset(lo));
+        uint8_t* sa_code = codes.data() + i * sa_size;
+        encode_listno(list_no, sa_code);
+        memcpy(sa_code + coarse_size, code.get(), code_size);
+    }
+    kernel.decode(n, codes.data(), sa_size, recons);
+}
+
 /// 2G by default, accommodates tables up to PQ32 w/ 65536 centroids
 size_t precomputed_table_max_bytes = ((size_t)1) << 31;
 
+/// 64M by default, 256 queries for PQ64 with 8 bits
+size_t index_ivfpq_query_tables_max_bytes = ((size_t)1) << 26;
+
 /** Precomputed tables for residuals
  *
  * During IVFPQ search with by_residual, we compute
@@ -358,7 +424,17 @@ size_t precomputed_table_max_bytes = ((size_t)1) << 31;
  * more compactly.
  *
  * At search time, the tables for term 2 and term 3 are added up. This
- * is faster when the length of the lists is > ksub * M.
+ * is faster when the length of the lists is > ksub * M. Term 3 does not
+ * depend on the list either, so it is computed once per query, for a
+ * block of queries at a time (see IndexIVFPQ::search_preassigned). Only
+ * the addition of the tables remains per (query, list) pair, and with a
+ * float16 table of term 2 it reads half the memory.
+ *
+ * For the inner product, the similarity is (x|y_C) + (x|y_R): term 3 does
+ * not depend on the list and (x|y_C) is the coarse similarity. The table
+ * is used only for polysemous filtering, where term 2 - 2 * term 3 is the
+ * distance table of the query residual x - y_C. It is built only if
+ * use_precomputed_table is set to 1 explicitly.
  */
 
 void initialize_IVFPQ_precomputed_table(
@@ -367,11 +443,15 @@ void initialize_IVFPQ_precomputed_table(
         const ProductQuantizer& pq,
         AlignedTable<float>& precomputed_table,
         bool by_residual,
-        bool verbose) {
+        bool verbose,
+        AlignedTable<uint16_t>* precomputed_table_fp16) {
     size_t nlist = quantizer->ntotal;
     size_t d = quantizer->d;
     FAISS_THROW_IF_NOT(d == pq.d);
 
+    if (precomputed_table_fp16) {
+        precomputed_table_fp16->resize(0);
+    }
     if (use_precomputed_table == -1) {
         precomputed_table.resize(0);
         return;
@@ -392,7 +472,13 @@ void initialize_IVFPQ_precomputed_table(
             use_precomputed_table = 2;
         else {
             size_t table_size = pq.M * pq.ksub * nlist * sizeof(float);
-            if (table_size > precomputed_table_max_bytes) {
+            if (table_size <= precomputed_table_max_bytes) {
+                use_precomputed_table = 1;
+            } else if (
+                    precomputed_table_fp16 &&
+                    table_size / 2 <= precomputed_table_max_bytes) {
+                use_precomputed_table = 3;
+            } else {
                 if (verbose) {
                     printf("IndexIVFPQ::precompute_table: not precomputing table, "
                            "it would be too big: %zd bytes (max %zd)\n",
@@ -402,7 +488,6 @@ void initialize_IVFPQ_precomputed_table(
                 }
                 return;
             }
-            use_precomputed_table = 1;
         }
     } // otherwise assume user has set appropriate flag on input
 
@@ -428,6 +513,28 @@ void initialize_IVFPQ_precomputed_table(
             pq.compute_inner_prod_table(centroid.data(), tab);
             fvec_madd(pq.M * pq.ksub, r_norms.data(), 2.0, tab, tab);
         }
+    } else if (use_precomputed_table == 3) {
+        FAISS_THROW_IF_NOT_MSG(
+                precomputed_table_fp16,
+                "float16 precomputed tables not supported by this index");
+        precomputed_table.resize(0);
+        precomputed_table_fp16->resize(nlist * pq.M * pq.ksub);
+        std::vector<float> centroid(d), tab(pq.M * pq.ksub);
+
+        for (size_t i = 0; i < nlist; i++) {
+            quantizer->reconstruct(i, centroid.data());
+            pq.compute_inner_prod_table(centroid.data(), tab.data());
+            fvec_madd(
+                    pq.M * pq.ksub,
+                    r_norms.data(),
+                    2.0,
+                    tab.data(),
+                    tab.data());
+            uint16_t* tab16 = &(*precomputed_table_fp16)[i * pq.M * pq.ksub];
+            for (size_t j = 0; j < pq.M * pq.ksub; j++) {
+                tab16[j] = encode_fp16(tab[j]);
+            }
+        }
     } else if (use_precomputed_table == 2) {
         const MultiIndexQuantizer* miq =
                 dynamic_cast<const MultiIndexQuantizer*>(quantizer);
@@ -465,7 +572,23 @@ void IndexIVFPQ::precompute_table() {
             pq,
             precomputed_table,
             by_residual,
-            verbose);
+            verbose,
+            &precomputed_table_fp16);
+}
+
+size_t IndexIVFPQ::warmup(const WarmupPolicy& policy) const {
+    size_t nbytes = IndexIVF::warmup(policy);
+    nbytes += warmup_memory(
+            pq.centroids.data(), pq.centroids.size() * sizeof(float), false);
+    nbytes += warmup_memory(
+            precomputed_table.data(),
+            precomputed_table.size() * sizeof(float),
+            false);
+    nbytes += warmup_memory(
+            precomputed_table_fp16.data(),
+            precomputed_table_fp16.size() * sizeof(uint16_t),
+            false);
+    return nbytes;
 }
 
 namespace {
@@ -473,6 +596,23 @@ namespace {
 #define TIC t0 = get_cycles()
 #define TOC get_cycles() - t0
 
+/// search parameters that also carry the query tables of a block of
+/// queries, computed by IndexIVFPQ::search_preassigned
+struct IVFPQQueryTablesParams : IVFSearchParameters {
+    const float* x = nullptr; ///< the queries of the block
+    idx_t n = 0;
+    const float* tables = nullptr; ///< size n * M * ksub
+
+    /// table of the query, nullptr if it is not in the block
+    const float* get_table(const float* qi, size_t d, size_t table_size)
+            const {
+        if (qi < x || qi >= x + n * d) {
+            return nullptr;
+        }
+        return tables + (qi - x) / d * table_size;
+    }
+};
+
 /** QueryTables manages the various ways of searching an
  * IndexIVFPQ. The code contains a lot of branches, depending on:
  * - metric_type: are we computing L2 or Inner product similarity?
@@ -506,6 +646,9 @@ struct QueryTables {
     // for table pointers
     std::vector<const float*> sim_table_ptrs;
 
+    // inner product tables of a block of queries (optional)
+    const IVFPQQueryTablesParams* query_tables = nullptr;
+
     explicit QueryTables(
             const IndexIVFPQ& ivfpq,
             const IVFSearchParameters* params)
@@ -540,10 +683,14 @@ struct QueryTables {
 
     // field specific to query
     const float* qi;
+    const float* qi_table = nullptr; // precomputed inner product table
 
     // query-specific initialization
     void init_query(const float* qi) {
         this->qi = qi;
+        qi_table = query_tables
+                ? query_tables->get_table(qi, d, pq.M * pq.ksub)
+                : nullptr;
         if (metric_type == METRIC_INNER_PRODUCT)
             init_query_IP();
         else
@@ -552,16 +699,24 @@ struct QueryTables {
             pq.compute_code(qi, q_code.data());
     }
 
+    void compute_inner_prod_table(float* tab) const {
+        if (qi_table) {
+            memcpy(tab, qi_table, sizeof(float) * pq.M * pq.ksub);
+        } else {
+            pq.compute_inner_prod_table(qi, tab);
+        }
+    }
+
     void init_query_IP() {
         // precompute some tables specific to the query qi
-        pq.compute_inner_prod_table(qi, sim_table);
+        compute_inner_prod_table(sim_table);
     }
 
     void init_query_L2() {
         if (!by_residual) {
             pq.compute_distance_table(qi, sim_table);
         } else if (use_precomputed_table) {
-            pq.compute_inner_prod_table(qi, sim_table_2);
+            compute_inner_prod_table(sim_table_2);
         }
     }
 
@@ -607,6 +762,26 @@ struct QueryTables {
         return dis0;
     }
 
+    /// out = precomputed term 2 of the list - 2 * qtab, with the float
+    /// (use_precomputed_table = 1) or float16 (= 3) table
+    void add_list_table(const float* qtab, float* out) const {
+        size_t table_size = pq.M * pq.ksub;
+        if (use_precomputed_table == 3) {
+            const uint16_t* tab16 =
+                    ivfpq.precomputed_table_fp16.data() + key * table_size;
+            for (size_t i = 0; i < table_size; i++) {
+                out[i] = decode_fp16(tab16[i]) - 2 * qtab[i];
+            }
+        } else {
+            fvec_madd(
+                    table_size,
+                    ivfpq.precomputed_table.data() + key * table_size,
+                    -2.0,
+                    qtab,
+                    out);
+        }
+    }
+
     /*****************************************************
      * compute tables for inner prod
      *****************************************************/
@@ -614,6 +789,16 @@ struct QueryTables {
     float precompute_list_tables_IP() {
         // prepare the sim_table that will be used for accumulation
         // and dis0, the initial value
+        if (use_precomputed_table == 1 || use_precomputed_table == 3) {
+            // coarse_dis = (x|y_C), and the precomputed term 2 gives the
+            // distance table of the residual x - y_C without decoding y_C
+            if (polysemous_ht) {
+                add_list_table(sim_table, sim_table_2);
+                pq.compute_code_from_distance_table(
+                        sim_table_2, q_code.data());
+            }
+            return coarse_dis;
+        }
         ivfpq.quantizer->reconstruct(key, decoded_vec);
         // decoded_vec = centroid
         float dis0 = fvec_inner_product(qi, decoded_vec, d);
@@ -642,19 +827,15 @@ struct QueryTables {
                 pq.compute_code(residual_vec, q_code.data());
             }
 
-        } else if (use_precomputed_table == 1) {
+        } else if (use_precomputed_table == 1 || use_precomputed_table == 3) {
             dis0 = coarse_dis;
 
-            fvec_madd(
-                    pq.M * pq.ksub,
-                    ivfpq.precomputed_table.data() + key * pq.ksub * pq.M,
-                    -2.0,
-                    sim_table_2,
-                    sim_table);
+            add_list_table(sim_table_2, sim_table);
 
             if (polysemous_ht != 0) {
-                ivfpq.quantizer->compute_residual(qi, residual_vec, key);
-                pq.compute_code(residual_vec, q_code.data());
+                // sim_table is the distance table of the residual, up to
+                // a constant per sub-quantizer
+                pq.compute_code_from_distance_table(sim_table, q_code.data());
             }
 
         } else if (use_precomputed_table == 2) {
@@ -758,24 +939,35 @@ struct KnnSearchResults {
     const idx_t* ids;
     const IDSelector* sel;
 
-    // heap params
-    size_t k;
-    float* heap_sim;
-    idx_t* heap_ids;
+    // the results are merged into the heap by flush()
+    HeapBuffer<C> heap;
 
-    size_t nup;
+    size_t nup = 0;
+
+    KnnSearchResults(
+            idx_t key,
+            const idx_t* ids,
+            const IDSelector* sel,
+            size_t k,
+            float* heap_sim,
+            idx_t* heap_ids)
+            : key(key), ids(ids), sel(sel), heap(k, heap_sim, heap_ids) {}
 
     inline bool skip_entry(idx_t j) {
         return use_sel && !sel->is_member(ids[j]);
     }
 
     inline void add(idx_t j, float dis) {
-        if (C::cmp(heap_sim[0], dis)) {
+        if (C::cmp(heap.threshold, dis)) {
             idx_t id = ids ? ids[j] : lo_build(key, j);
-            heap_replace_top<C>(k, heap_sim, heap_ids, dis, id);
+            heap.push(dis, id);
             nup++;
         }
     }
+
+    void flush() {
+        heap.flush();
+    }
 };
 
 template <class C, bool use_sel>
@@ -1195,12 +1387,16 @@ struct IVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE, PQDecoder>,
             const IndexIVFPQ& ivfpq,
             bool store_pairs,
             int precompute_mode,
-            const IDSelector* sel)
+            const IDSelector* sel,
+            const IVFSearchParameters* params)
             : IVFPQScannerT<idx_t, METRIC_TYPE, PQDecoder>(ivfpq, nullptr),
               precompute_mode(precompute_mode),
               sel(sel) {
+        this->query_tables =
+                dynamic_cast<const IVFPQQueryTablesParams*>(params);
         this->store_pairs = store_pairs;
         this->keep_max = is_similarity_metric(METRIC_TYPE);
+        this->code_size = this->pq.code_size;
     }
 
     void set_query(const float* query) override {
@@ -1220,6 +1416,16 @@ struct IVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE, PQDecoder>,
         return dis;
     }
 
+    bool distances_to_codes(size_t n, const uint8_t* codes, float* dis)
+            const override {
+        // distance_to_code does neither the polysemous filtering nor the
+        // other precompute modes
+        if (this->polysemous_ht > 0 || precompute_mode != 2) {
+            return false;
+        }
+        return InvertedListScanner::distances_to_codes(n, codes, dis);
+    }
+
     size_t scan_codes(
             size_t ncode,
             const uint8_t* codes,
@@ -1227,14 +1433,13 @@ struct IVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE, PQDecoder>,
             float* heap_sim,
             idx_t* heap_ids,
             size_t k) const override {
-        KnnSearchResults<C, use_sel> res = {
-                /* key */ this->key,
-                /* ids */ this->store_pairs ? nullptr : ids,
-                /* sel */ this->sel,
-                /* k */ k,
-                /* heap_sim */ heap_sim,
-                /* heap_ids */ heap_ids,
-                /* nup */ 0};
+        KnnSearchResults<C, use_sel> res(
+                this->key,
+                this->store_pairs ? nullptr : ids,
+                this->sel,
+                k,
+                heap_sim,
+                heap_ids);
 
         if (this->polysemous_ht > 0) {
             assert(precompute_mode == 2);
@@ -1248,6 +1453,7 @@ struct IVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE, PQDecoder>,
         } else {
             FAISS_THROW_MSG("bad precomp mode");
         }
+        res.flush();
         return res.nup;
     }
 
@@ -1283,19 +1489,20 @@ template <class PQDecoder, bool use_sel>
 InvertedListScanner* get_InvertedListScanner1(
         const IndexIVFPQ& index,
         bool store_pairs,
-        const IDSelector* sel) {
+        const IDSelector* sel,
+        const IVFSearchParameters* params) {
     if (index.metric_type == METRIC_INNER_PRODUCT) {
         return new IVFPQScanner<
                 METRIC_INNER_PRODUCT,
                 CMin<float, idx_t>,
                 PQDecoder,
-                use_sel>(index, store_pairs, 2, sel);
+                use_sel>(index, store_pairs, 2, sel, params);
     } else if (index.metric_type == METRIC_L2) {
         return new IVFPQScanner<
                 METRIC_L2,
                 CMax<float, idx_t>,
                 PQDecoder,
-                use_sel>(index, store_pairs, 2, sel);
+                use_sel>(index, store_pairs, 2, sel, params);
     }
     return nullptr;
 }
@@ -1304,16 +1511,17 @@ template <bool use_sel>
 InvertedListScanner* get_InvertedListScanner2(
         const IndexIVFPQ& index,
         bool store_pairs,
-        const IDSelector* sel) {
+        const IDSelector* sel,
+        const IVFSearchParameters* params) {
     if (index.pq.nbits == 8) {
         return get_InvertedListScanner1<PQDecoder8, use_sel>(
-                index, store_pairs, sel);
+                index, store_pairs, sel, params);
     } else if (index.pq.nbits == 16) {
         return get_InvertedListScanner1<PQDecoder16, use_sel>(
-                index, store_pairs, sel);
+                index, store_pairs, sel, params);
     } else {
         return get_InvertedListScanner1<PQDecoderGeneric, use_sel>(
-                index, store_pairs, sel);
+                index, store_pairs, sel, params);
     }
 }
 
@@ -1322,15 +1530,83 @@ InvertedListScanner* get_InvertedListScanner2(
 InvertedListScanner* IndexIVFPQ::get_InvertedListScanner(
         bool store_pairs,
         const IDSelector* sel,
-        const IVFSearchParameters*) const {
+        const IVFSearchParameters* params) const {
     if (sel) {
-        return get_InvertedListScanner2<true>(*this, store_pairs, sel);
+        return get_InvertedListScanner2<true>(*this, store_pairs, sel, params);
     } else {
-        return get_InvertedListScanner2<false>(*this, store_pairs, sel);
+        return get_InvertedListScanner2<false>(
+                *this, store_pairs, sel, params);
     }
     return nullptr;
 }
 
+void IndexIVFPQ::search_preassigned(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        const idx_t* keys,
+        const float* coarse_dis,
+        float* distances,
+        idx_t* labels,
+        bool store_pairs,
+        const IVFSearchParameters* params,
+        IndexIVFStats* ivf_stats) const {
+    // the tables that do not depend on the list
+    bool list_independent_tables = metric_type == METRIC_INNER_PRODUCT ||
+            (by_residual && use_precomputed_table > 0);
+    size_t table_size = pq.M * pq.ksub;
+    // the shared thresholds are indexed by query, blocks would shift them
+    if (n <= 1 || !list_independent_tables ||
+        index_ivfpq_query_tables_max_bytes < table_size * sizeof(float) ||
+        (params && params->shared_thresholds)) {
+        IndexIVF::search_preassigned(
+                n,
+                x,
+                k,
+                keys,
+                coarse_dis,
+                distances,
+                labels,
+                store_pairs,
+                params,
+                ivf_stats);
+        return;
+    }
+
+    IVFPQQueryTablesParams qt_params;
+    if (params) {
+        static_cast<IVFSearchParameters&>(qt_params) = *params;
+    } else {
+        qt_params.nprobe = nprobe;
+        qt_params.max_codes = max_codes;
+    }
+    idx_t nprobe_2 = std::min((idx_t)nlist, (idx_t)qt_params.nprobe);
+    idx_t bs = std::min(
+            n,
+            idx_t(index_ivfpq_query_tables_max_bytes /
+                  (table_size * sizeof(float))));
+    std::unique_ptr<float[]> tables(new float[bs * table_size]);
+
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(n, i0 + bs);
+        pq.compute_inner_prod_tables(i1 - i0, x + i0 * d, tables.get());
+        qt_params.x = x + i0 * d;
+        qt_params.n = i1 - i0;
+        qt_params.tables = tables.get();
+        IndexIVF::search_preassigned(
+                i1 - i0,
+                x + i0 * d,
+                k,
+                keys + i0 * nprobe_2,
+                coarse_dis + i0 * nprobe_2,
+                distances + i0 * k,
+                labels + i0 * k,
+                store_pairs,
+                &qt_params,
+                ivf_stats);
+    }
+}
+
 IndexIVFPQStats indexIVFPQ_stats;
 
 void IndexIVFPQStats::reset() {
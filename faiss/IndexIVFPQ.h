@@ -28,6 +28,10 @@ struct IVFPQSearchParameters : IVFSearchParameters {
 
 FAISS_API extern size_t precomputed_table_max_bytes;
 
+/** Max size of the query distance tables that IndexIVFPQ::search_preassigned
+ * computes for a block of queries at once (0 = one query at a time) */
+FAISS_API extern size_t index_ivfpq_query_tables_max_bytes;
+
 /** Inverted file with Product Quantizer encoding. Each residual
  * vector is encoded as a product quantizer code.
  */
@@ -42,7 +46,12 @@ struct IndexIVFPQ : IndexIVF {
     int polysemous_ht;           ///< Hamming thresh for polysemous filtering
 
     /** Precompute table that speed up query preprocessing at some
-     * memory cost (used only for by_residual with L2 metric)
+     * memory cost (used only for by_residual). With the inner product,
+     * it is not selected automatically: setting it to 1 makes the scan
+     * use the coarse similarity instead of decoding the centroid for each
+     * list, and the table is used to compute the polysemous code of the
+     * query residual. Setting it to 3 stores the same table as 1 in
+     * float16, which halves its size for a small loss of accuracy.
      */
     int use_precomputed_table;
 
@@ -50,6 +59,9 @@ struct IndexIVFPQ : IndexIVF {
     /// size nlist * pq.M * pq.ksub
     AlignedTable<float> precomputed_table;
 
+    /// if use_precomputed_table == 3, the table of 1 in float16
+    AlignedTable<uint16_t> precomputed_table_fp16;
+
     IndexIVFPQ(
             Index* quantizer,
             size_t d,
@@ -93,6 +105,19 @@ struct IndexIVFPQ : IndexIVF {
     void reconstruct_from_offset(int64_t list_no, int64_t offset, float* recons)
             const override;
 
+    /// uses the kernel of SaDecodeKernel when there is one
+    void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const override;
+
+    /** Gathers the codes of the keys and decodes them with the specialized
+     * kernel of SaDecodeKernel when there is one for (d, M, nbits).
+     * Requires the direct map. */
+    void reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+            const override;
+
     /** Find exact duplicates in the dataset.
      *
      * the duplicates are returned in pre-allocated arrays (see the
@@ -137,9 +162,28 @@ struct IndexIVFPQ : IndexIVF {
             const IDSelector* sel,
             const IVFSearchParameters* params) const override;
 
+    /** When the query distance tables do not depend on the list (inner
+     * product, or L2 with a precomputed table), they are computed for a
+     * block of queries with a single matrix multiplication instead of one
+     * query at a time by the scanners. */
+    void search_preassigned(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            const idx_t* assign,
+            const float* centroid_dis,
+            float* distances,
+            idx_t* labels,
+            bool store_pairs,
+            const IVFSearchParameters* params = nullptr,
+            IndexIVFStats* stats = nullptr) const override;
+
     /// build precomputed table
     void precompute_table();
 
+    /// also warms the PQ centroids and the precomputed tables
+    size_t warmup(const WarmupPolicy& policy = WarmupPolicy()) const override;
+
     IndexIVFPQ();
 };
 
@@ -153,8 +197,11 @@ FAISS_API extern int index_ivfpq_add_core_o_bs;
  *        =0: decide heuristically (default: use tables only if they are
  *            < precomputed_tables_max_bytes), set use_precomputed_table on
  * output =1: tables that work for all quantizers (size 256 * nlist * M) =2:
- * specific version for MultiIndexQuantizer (much more compact)
+ * specific version for MultiIndexQuantizer (much more compact) =3: table
+ * of 1 in float16 (selected if the table of 1 is too big but fits in
+ * float16, and precomputed_table_fp16 is provided)
  * @param precomputed_table precomputed table to initialize
+ * @param precomputed_table_fp16 float16 table to initialize (optional)
  */
 
 void initialize_IVFPQ_precomputed_table(
@@ -163,7 +210,8 @@ void initialize_IVFPQ_precomputed_table(
         const ProductQuantizer& pq,
         AlignedTable<float>& precomputed_table,
         bool by_residual,
-        bool verbose);
+        bool verbose,
+        AlignedTable<uint16_t>* precomputed_table_fp16 = nullptr);
 
 /// statistics are robust to internal threading, but not if
 /// IndexIVFPQ::search_preassigned is called by multiple threads
@@ -30,6 +30,11 @@ namespace faiss {
  * 11: idem, collect results in reservoir
  * 12: optimizer int16 search, collect results in heap, uses qbs
  * 13: idem, collect results in reservoir
+ *
+ * For inner product search, setting pq.anisotropic_eta > 1 before training
+ * trains and encodes with the score-aware loss of ProductQuantizer. The
+ * loss is relative to the encoded vectors, so by_residual = false is
+ * preferable in that case.
  */
 
 struct IndexIVFPQFastScan : IndexIVFFastScan {
@@ -217,6 +217,19 @@ void IndexIVFPQR::reconstruct_from_offset(
     }
 }
 
+void IndexIVFPQR::reconstruct_from_offsets(
+        int64_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        float* recons) const {
+    IndexIVF::reconstruct_from_offsets(list_no, n, offsets, recons);
+}
+
+void IndexIVFPQR::reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+        const {
+    Index::reconstruct_batch(n, keys, recons);
+}
+
 void IndexIVFPQR::merge_from(Index& otherIndex, idx_t add_id) {
     IndexIVFPQR* other = dynamic_cast<IndexIVFPQR*>(&otherIndex);
     FAISS_THROW_IF_NOT(other);
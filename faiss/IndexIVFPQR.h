@@ -12,13 +12,14 @@
 #include <vector>
 
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/impl/maybe_owned_vector.h>
 
 namespace faiss {
 
 /** Index with an additional level of PQ refinement */
 struct IndexIVFPQR : IndexIVFPQ {
     ProductQuantizer refine_pq;        ///< 3rd level quantizer
-    std::vector<uint8_t> refine_codes; ///< corresponding codes
+    MaybeOwnedVector<uint8_t> refine_codes; ///< corresponding codes
 
     /// factor between k requested in search and the k requested from the IVFPQ
     float k_factor;
@@ -54,6 +55,17 @@ struct IndexIVFPQR : IndexIVFPQ {
     void reconstruct_from_offset(int64_t list_no, int64_t offset, float* recons)
             const override;
 
+    /// one by one, with the refinement codes
+    void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const override;
+
+    /// one by one, the refinement codes are not part of the IVFPQ codes
+    void reconstruct_batch(idx_t n, const idx_t* keys, float* recons)
+            const override;
+
     void merge_from(Index& otherIndex, idx_t add_id) override;
 
     void search_preassigned(
@@ -16,6 +16,7 @@
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/RaBitQuantizer.h>
+#include <faiss/utils/Heap.h>
 
 namespace faiss {
 
@@ -23,8 +24,10 @@ IndexIVFRaBitQ::IndexIVFRaBitQ(
         Index* quantizer,
         const size_t d,
         const size_t nlist,
-        MetricType metric)
-        : IndexIVF(quantizer, d, nlist, 0, metric), rabitq(d, metric) {
+        MetricType metric,
+        size_t nb_bits)
+        : IndexIVF(quantizer, d, nlist, 0, metric),
+          rabitq(d, metric, nb_bits) {
     code_size = rabitq.code_size;
     invlists->code_size = code_size;
     is_trained = false;
@@ -127,7 +130,7 @@ struct RaBitInvertedListScanner : InvertedListScanner {
     std::vector<float> reconstructed_centroid;
     std::vector<float> query_vector;
 
-    std::unique_ptr<FlatCodesDistanceComputer> dc;
+    std::unique_ptr<RaBitQDistanceComputer> dc;
 
     uint8_t qb = 0;
 
@@ -166,6 +169,40 @@ struct RaBitInvertedListScanner : InvertedListScanner {
         return dc->distance_to_code(code);
     }
 
+    /// with multi-bit codes, only the codes whose 1-bit estimate may beat
+    /// the current k-th result are refined with the other bits
+    size_t scan_codes(
+            size_t list_size,
+            const uint8_t* codes,
+            const idx_t* ids,
+            float* simi,
+            idx_t* idxi,
+            size_t k) const override {
+        if (ivf_rabitq.rabitq.nb_bits == 1) {
+            return InvertedListScanner::scan_codes(
+                    list_size, codes, ids, simi, idxi, k);
+        }
+
+        size_t nup = 0;
+        for (size_t j = 0; j < list_size; j++, codes += code_size) {
+            const int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
+            if (sel != nullptr && !sel->is_member(id)) {
+                continue;
+            }
+
+            const float dis = dc->distance_to_code_pruned(codes, simi[0]);
+            if (keep_max ? dis > simi[0] : dis < simi[0]) {
+                if (keep_max) {
+                    minheap_replace_top(k, simi, idxi, dis, id);
+                } else {
+                    maxheap_replace_top(k, simi, idxi, dis, id);
+                }
+                nup++;
+            }
+        }
+        return nup;
+    }
+
     void internal_try_setup_dc() {
         if (!query_vector.empty() && !reconstructed_centroid.empty()) {
             // both query_vector and centroid are available!
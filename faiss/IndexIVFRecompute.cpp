@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexIVFRecompute.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/utils/Heap.h>
+
+namespace faiss {
+
+/*************************************************************
+ * IndexIVFIDOnly
+ *************************************************************/
+
+IndexIVFIDOnly::IndexIVFIDOnly(
+        Index* quantizer,
+        size_t d,
+        size_t nlist,
+        MetricType metric)
+        : IndexIVF(quantizer, d, nlist, 0, metric) {}
+
+IndexIVFIDOnly::IndexIVFIDOnly() = default;
+
+void IndexIVFIDOnly::encode_vectors(
+        idx_t n,
+        const float*,
+        const idx_t* list_nos,
+        uint8_t* codes,
+        bool include_listnos) const {
+    if (include_listnos) {
+        size_t coarse_size = coarse_code_size();
+        for (idx_t i = 0; i < n; i++) {
+            uint8_t* code = codes + i * coarse_size;
+            if (list_nos[i] >= 0) {
+                encode_listno(list_nos[i], code);
+            } else {
+                memset(code, 0, coarse_size);
+            }
+        }
+    }
+}
+
+namespace {
+
+const char* id_only_search_error =
+        "IndexIVFIDOnly stores no codes, search it through IndexIVFRecompute";
+
+} // anonymous namespace
+
+void IndexIVFIDOnly::search(
+        idx_t,
+        const float*,
+        idx_t,
+        float*,
+        idx_t*,
+        const SearchParameters*) const {
+    FAISS_THROW_MSG(id_only_search_error);
+}
+
+void IndexIVFIDOnly::range_search(
+        idx_t,
+        const float*,
+        float,
+        RangeSearchResult*,
+        const SearchParameters*) const {
+    FAISS_THROW_MSG(id_only_search_error);
+}
+
+InvertedListScanner* IndexIVFIDOnly::get_InvertedListScanner(
+        bool,
+        const IDSelector*,
+        const IVFSearchParameters*) const {
+    FAISS_THROW_MSG(id_only_search_error);
+}
+
+/*************************************************************
+ * IndexIVFRecompute
+ *************************************************************/
+
+IndexIVFRecompute::IndexIVFRecompute(IndexIVF* base_index)
+        : Index(base_index->d, base_index->metric_type),
+          base_index(base_index) {
+    FAISS_THROW_IF_NOT(
+            metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT);
+    metric_arg = base_index->metric_arg;
+    is_trained = base_index->is_trained;
+    ntotal = base_index->ntotal;
+}
+
+IndexIVFRecompute::IndexIVFRecompute() = default;
+
+void IndexIVFRecompute::train(idx_t n, const float* x) {
+    base_index->train(n, x);
+    is_trained = base_index->is_trained;
+}
+
+void IndexIVFRecompute::add(idx_t n, const float* x) {
+    add_with_ids(n, x, nullptr);
+}
+
+void IndexIVFRecompute::add_with_ids(
+        idx_t n,
+        const float* x,
+        const idx_t* xids) {
+    base_index->add_with_ids(n, x, xids);
+    ntotal = base_index->ntotal;
+}
+
+void IndexIVFRecompute::reset() {
+    base_index->reset();
+    ntotal = 0;
+}
+
+namespace {
+
+/// the ids of the probed lists of one query, closest lists first
+void gather_list_ids(
+        const IndexIVF& ivf,
+        const idx_t* list_nos,
+        size_t nprobe,
+        size_t max_rerank,
+        std::vector<idx_t>& ids) {
+    ids.clear();
+    for (size_t j = 0; j < nprobe; j++) {
+        idx_t list_no = list_nos[j];
+        if (list_no < 0) {
+            continue;
+        }
+        size_t list_size = ivf.invlists->list_size(list_no);
+        if (list_size == 0) {
+            continue;
+        }
+        InvertedLists::ScopedIds list_ids(ivf.invlists, list_no);
+        if (max_rerank > 0) {
+            list_size = std::min(list_size, max_rerank - ids.size());
+        }
+        ids.insert(ids.end(), list_ids.get(), list_ids.get() + list_size);
+        if (max_rerank > 0 && ids.size() >= max_rerank) {
+            break;
+        }
+    }
+}
+
+} // anonymous namespace
+
+void IndexIVFRecompute::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params_in) const {
+    const IndexRefineSearchParameters* params = nullptr;
+    if (params_in) {
+        params = dynamic_cast<const IndexRefineSearchParameters*>(params_in);
+        FAISS_THROW_IF_NOT_MSG(
+                params, "IndexIVFRecompute params have incorrect type");
+    }
+    const SearchParameters* base_params =
+            params ? params->base_index_params : nullptr;
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(is_trained);
+
+    // first pass: approximate search in the codes, or the probed lists
+    bool id_only = base_index->code_size == 0;
+    idx_t k_base = 0;
+    size_t nprobe = 0;
+    std::vector<float> base_distances;
+    std::vector<idx_t> base_labels;
+    if (!id_only) {
+        k_base = idx_t(k * (params ? params->k_factor : k_factor));
+        FAISS_THROW_IF_NOT(k_base >= k);
+        base_distances.resize(n * k_base);
+        base_labels.resize(n * k_base);
+        base_index->search(
+                n,
+                x,
+                k_base,
+                base_distances.data(),
+                base_labels.data(),
+                base_params);
+    } else {
+        nprobe = base_index->nprobe;
+        const SearchParameters* quantizer_params = nullptr;
+        if (base_params) {
+            auto ivf_params =
+                    dynamic_cast<const IVFSearchParameters*>(base_params);
+            FAISS_THROW_IF_NOT_MSG(
+                    ivf_params, "IndexIVF params have incorrect type");
+            nprobe = ivf_params->nprobe;
+            quantizer_params = ivf_params->quantizer_params;
+        }
+        nprobe = std::min(nprobe, base_index->nlist);
+        FAISS_THROW_IF_NOT(nprobe > 0);
+        base_distances.resize(n * nprobe);
+        base_labels.resize(n * nprobe);
+        base_index->quantizer->search(
+                n,
+                x,
+                nprobe,
+                base_distances.data(),
+                base_labels.data(),
+                quantizer_params);
+    }
+
+    // second pass: one batched fetch of the embeddings per query. The
+    // distances of the ZmqDistanceComputer are negated for inner products
+#pragma omp parallel if (n > 1)
+    {
+        ZmqDistanceComputer dc(d, metric_type, metric_arg, zmq_port);
+        if (coalesce_requests) {
+            dc.set_coalescer(&ZmqRequestCoalescer::instance());
+        }
+        dc.cache = embedding_cache;
+        dc.provider = embedding_provider.get();
+        dc.server_distances = server_side_distances && !coalesce_requests &&
+                !embedding_cache && !dc.provider;
+        std::vector<idx_t> ids;
+        std::vector<float> dis;
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            if (id_only) {
+                gather_list_ids(
+                        *base_index,
+                        base_labels.data() + i * nprobe,
+                        nprobe,
+                        max_rerank,
+                        ids);
+            } else {
+                const idx_t* li = base_labels.data() + i * k_base;
+                ids.assign(li, li + k_base);
+                ids.erase(std::remove(ids.begin(), ids.end(), -1), ids.end());
+            }
+            // sorted for the locality of the embedding storage, and
+            // without the duplicates of spilled assignments
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+            float* Di = distances + i * k;
+            idx_t* Ii = labels + i * k;
+            using C = CMax<float, idx_t>;
+            heap_heapify<C>(k, Di, Ii);
+            if (!ids.empty()) {
+                dc.set_query(x + i * d);
+                dc.distances_batch(ids, dis);
+                heap_addn<C>(k, Di, Ii, dis.data(), ids.data(), ids.size());
+            }
+            heap_reorder<C>(k, Di, Ii);
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                for (idx_t j = 0; j < k; j++) {
+                    Di[j] = Ii[j] < 0 ? -HUGE_VALF : -Di[j];
+                }
+            }
+        }
+    }
+}
+
+IndexIVFRecompute::~IndexIVFRecompute() {
+    if (own_fields) {
+        delete base_index;
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <faiss/IndexIVF.h>
+
+namespace faiss {
+
+struct EmbeddingProvider;
+struct ZmqEmbeddingCache;
+
+/** IVF whose inverted lists store only the ids (code_size = 0). It cannot
+ * be searched by itself: IndexIVFRecompute re-ranks the ids of the probed
+ * lists with recomputed embeddings.
+ */
+struct IndexIVFIDOnly : IndexIVF {
+    IndexIVFIDOnly(
+            Index* quantizer,
+            size_t d,
+            size_t nlist,
+            MetricType metric = METRIC_L2);
+
+    IndexIVFIDOnly();
+
+    /// writes only the list numbers, if include_listnos
+    void encode_vectors(
+            idx_t n,
+            const float* x,
+            const idx_t* list_nos,
+            uint8_t* codes,
+            bool include_listnos = false) const override;
+
+    /// the searches throw: there are no codes to scan
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void range_search(
+            idx_t n,
+            const float* x,
+            float radius,
+            RangeSearchResult* result,
+            const SearchParameters* params = nullptr) const override;
+
+    InvertedListScanner* get_InvertedListScanner(
+            bool store_pairs,
+            const IDSelector* sel,
+            const IVFSearchParameters* params) const override;
+};
+
+/** Recompute mode of the IVF indexes: no full vectors are stored, the
+ * embeddings of the candidates are fetched for re-ranking, as IndexHNSW
+ * does with is_recompute.
+ *
+ * The first pass depends on the inverted lists of base_index:
+ *  - with small codes (eg. IndexIVFPQ with a few bytes per vector or
+ *    IndexIVFRaBitQ), base_index is searched for the k * k_factor best
+ *    approximate candidates over the probed lists;
+ *  - with the ids only (IndexIVFIDOnly), the candidates are the ids of the
+ *    nprobe probed lists, at most max_rerank of them (0 = no limit) taken
+ *    from the closest lists first.
+ *
+ * The candidates of a query are then re-ranked with one batched fetch
+ * through a ZmqDistanceComputer: from the embedding_provider if set,
+ * otherwise from the embedding server on zmq_port, optionally through the
+ * embedding_cache or the request coalescer. The ids of the inverted lists
+ * are those of the embedding server (< 2^32).
+ */
+struct IndexIVFRecompute : Index {
+    IndexIVF* base_index = nullptr;
+    bool own_fields = false;
+
+    /// nb of candidates re-ranked per result when base_index has codes
+    float k_factor = 4;
+
+    /// max nb of candidates re-ranked per query when base_index stores
+    /// only the ids (0 = all the ids of the probed lists)
+    size_t max_rerank = 0;
+
+    /// embedding server, if there is no embedding_provider
+    int zmq_port = 5557;
+
+    /// merge the fetches of the searching threads (ZmqRequestCoalescer)
+    bool coalesce_requests = false;
+
+    /// cache of the fetched embeddings (not owned)
+    ZmqEmbeddingCache* embedding_cache = nullptr;
+
+    /// compute the distances on the embedding server instead of fetching
+    /// the embeddings, when no cache, coalescer or provider is used
+    bool server_side_distances = false;
+
+    /// if set, the embeddings are computed in process by this provider
+    /// instead of the embedding server (not serialized)
+    std::shared_ptr<EmbeddingProvider> embedding_provider;
+
+    explicit IndexIVFRecompute(IndexIVF* base_index);
+
+    IndexIVFRecompute();
+
+    void train(idx_t n, const float* x) override;
+    void add(idx_t n, const float* x) override;
+    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
+    void reset() override;
+
+    /// params can be IndexRefineSearchParameters, whose base_index_params
+    /// are passed to base_index (or give the nprobe of the ID-only search)
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    ~IndexIVFRecompute() override;
+};
+
+} // namespace faiss
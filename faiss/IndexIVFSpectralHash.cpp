@@ -18,6 +18,7 @@
 #include <faiss/VectorTransform.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
 #include <faiss/utils/hamming.h>
 
 namespace faiss {
@@ -212,8 +213,12 @@ struct IVFScanner : InvertedListScanner {
     std::vector<uint8_t> qcode;
     HammingComputer hc;
 
-    IVFScanner(const IndexIVFSpectralHash* index, bool store_pairs)
-            : index(index),
+    IVFScanner(
+            const IndexIVFSpectralHash* index,
+            bool store_pairs,
+            const IDSelector* sel)
+            : InvertedListScanner(store_pairs, sel),
+              index(index),
               nbit(index->nbit),
               period(index->period),
               freq(2.0 / index->period),
@@ -221,7 +226,6 @@ struct IVFScanner : InvertedListScanner {
               zero(nbit),
               qcode(index->code_size),
               hc(qcode.data(), index->code_size) {
-        this->store_pairs = store_pairs;
         this->code_size = index->code_size;
         this->keep_max = is_similarity_metric(index->metric_type);
     }
@@ -250,6 +254,17 @@ struct IVFScanner : InvertedListScanner {
         return hc.hamming(code);
     }
 
+    /// the distances of a block of codes are computed in a tight popcount
+    /// loop, then compared with the threshold
+    static constexpr size_t scan_bs = 64;
+
+    void block_distances(const uint8_t* codes, size_t n, hamdis_t* dis)
+            const {
+        for (size_t j = 0; j < n; j++) {
+            dis[j] = hc.hamming(codes + j * code_size);
+        }
+    }
+
     size_t scan_codes(
             size_t list_size,
             const uint8_t* codes,
@@ -258,15 +273,21 @@ struct IVFScanner : InvertedListScanner {
             idx_t* idxi,
             size_t k) const override {
         size_t nup = 0;
-        for (size_t j = 0; j < list_size; j++) {
-            float dis = hc.hamming(codes);
-
-            if (dis < simi[0]) {
-                int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
-                maxheap_replace_top(k, simi, idxi, dis, id);
-                nup++;
+        hamdis_t dis[scan_bs];
+        for (size_t j0 = 0; j0 < list_size; j0 += scan_bs) {
+            size_t n = std::min(scan_bs, list_size - j0);
+            block_distances(codes + j0 * code_size, n, dis);
+            for (size_t j = j0; j < j0 + n; j++) {
+                if (dis[j - j0] < simi[0]) {
+                    if (sel && !sel->is_member(ids[j])) {
+                        continue;
+                    }
+                    int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
+                    maxheap_replace_top(
+                            k, simi, idxi, float(dis[j - j0]), id);
+                    nup++;
+                }
             }
-            codes += code_size;
         }
         return nup;
     }
@@ -277,13 +298,19 @@ struct IVFScanner : InvertedListScanner {
             const idx_t* ids,
             float radius,
             RangeQueryResult& res) const override {
-        for (size_t j = 0; j < list_size; j++) {
-            float dis = hc.hamming(codes);
-            if (dis < radius) {
-                int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
-                res.add(dis, id);
+        hamdis_t dis[scan_bs];
+        for (size_t j0 = 0; j0 < list_size; j0 += scan_bs) {
+            size_t n = std::min(scan_bs, list_size - j0);
+            block_distances(codes + j0 * code_size, n, dis);
+            for (size_t j = j0; j < j0 + n; j++) {
+                if (dis[j - j0] < radius) {
+                    if (sel && !sel->is_member(ids[j])) {
+                        continue;
+                    }
+                    int64_t id = store_pairs ? lo_build(list_no, j) : ids[j];
+                    res.add(float(dis[j - j0]), id);
+                }
             }
-            codes += code_size;
         }
     }
 };
@@ -292,8 +319,11 @@ struct BuildScanner {
     using T = InvertedListScanner*;
 
     template <class HammingComputer>
-    static T f(const IndexIVFSpectralHash* index, bool store_pairs) {
-        return new IVFScanner<HammingComputer>(index, store_pairs);
+    static T f(
+            const IndexIVFSpectralHash* index,
+            bool store_pairs,
+            const IDSelector* sel) {
+        return new IVFScanner<HammingComputer>(index, store_pairs, sel);
     }
 };
 
@@ -303,9 +333,8 @@ InvertedListScanner* IndexIVFSpectralHash::get_InvertedListScanner(
         bool store_pairs,
         const IDSelector* sel,
         const IVFSearchParameters*) const {
-    FAISS_THROW_IF_NOT(!sel);
     BuildScanner bs;
-    return dispatch_HammingComputer(code_size, bs, this, store_pairs);
+    return dispatch_HammingComputer(code_size, bs, this, store_pairs, sel);
 }
 
 void IndexIVFSpectralHash::replace_vt(VectorTransform* vt_in, bool own) {
@@ -27,6 +27,9 @@ struct IndexPreTransform;
  * threshold_type, and split into intervals of size period. Half of
  * the interval is a 0 bit, the other half a 1.
  *
+ * The lists are scanned by blocks of codes with popcounts, an IDSelector
+ * is supported. Exact float re-ranking of the Hamming-ranked candidates
+ * is obtained by wrapping the index in an IndexRefineFlat.
  */
 struct IndexIVFSpectralHash : IndexIVF {
     /// transformation from d to nbit dim
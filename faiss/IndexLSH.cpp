@@ -104,10 +104,9 @@ void IndexLSH::search(
         float* distances,
         idx_t* labels,
         const SearchParameters* params) const {
-    FAISS_THROW_IF_NOT_MSG(
-            !params, "search params not supported for this index");
     FAISS_THROW_IF_NOT(k > 0);
     FAISS_THROW_IF_NOT(is_trained);
+    const IDSelector* sel = params ? params->sel : nullptr;
     const float* xt = apply_preprocess(n, x);
     std::unique_ptr<const float[]> del(xt == x ? nullptr : xt);
 
@@ -119,7 +118,15 @@ void IndexLSH::search(
 
     int_maxheap_array_t res = {size_t(n), size_t(k), labels, idistances.get()};
 
-    hammings_knn_hc(&res, qcodes.get(), codes.data(), ntotal, code_size, true);
+    hammings_knn_hc(
+            &res,
+            qcodes.get(),
+            codes.data(),
+            ntotal,
+            code_size,
+            true,
+            ApproxTopK_mode_t::EXACT_TOPK,
+            sel);
 
     // convert distances to floats
     for (int i = 0; i < k * n; i++)
@@ -17,7 +17,12 @@
 
 namespace faiss {
 
-/** The sign of each vector component is put in a binary signature */
+/** The sign of each vector component is put in a binary signature
+ *
+ * The search compares the codes directly with popcounts. To use it as a
+ * first stage that returns Hamming-ranked candidates re-ranked with exact
+ * float distances, wrap it in an IndexRefineFlat ("LSH,RFlat").
+ */
 struct IndexLSH : IndexFlatCodes {
     int nbits;             ///< nb of bits per vector
     bool rotate_data;      ///< whether to apply a random rotation to input
@@ -44,6 +49,7 @@ struct IndexLSH : IndexFlatCodes {
 
     void train(idx_t n, const float* x) override;
 
+    /// Hamming search on the codes, supports an IDSelector in params
     void search(
             idx_t n,
             const float* x,
@@ -9,9 +9,12 @@
 
 #include <faiss/IndexLattice.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/distances.h>
 #include <faiss/utils/hamming.h> // for the bitstring routines
 
+#include <memory>
+
 namespace faiss {
 
 IndexLattice::IndexLattice(idx_t d, int nsq, int scale_nbit, int r2)
@@ -31,6 +34,15 @@ IndexLattice::IndexLattice(idx_t d, int nsq, int scale_nbit, int r2)
 
     code_size = (total_nbit + 7) / 8;
 
+    uint64_t nv = zn_sphere_codec.nv;
+    if (nv <= max_decode_table_size / dsq) {
+        decode_table.resize(nv * dsq);
+#pragma omp parallel for if (nv > 1000)
+        for (int64_t i = 0; i < nv; i++) {
+            zn_sphere_codec.decode(i, decode_table.data() + i * dsq);
+        }
+    }
+
     is_trained = false;
 }
 
@@ -91,9 +103,6 @@ void IndexLattice::sa_encode(idx_t n, const float* x, uint8_t* codes) const {
 }
 
 void IndexLattice::sa_decode(idx_t n, const uint8_t* codes, float* x) const {
-    const float* mins = trained.data();
-    const float* maxs = mins + nsq;
-    float sc = int64_t(1) << scale_nbit;
     float r = sqrtf(zn_sphere_codec.r2);
 
 #pragma omp parallel for
@@ -101,11 +110,8 @@ void IndexLattice::sa_decode(idx_t n, const uint8_t* codes, float* x) const {
         BitstringReader rd(codes + i * code_size, code_size);
         float* xi = x + i * d;
         for (int j = 0; j < nsq; j++) {
-            float norm =
-                    (rd.read(scale_nbit) + 0.5) * (maxs[j] - mins[j]) / sc +
-                    mins[j];
-            norm /= r;
-            zn_sphere_codec.decode(rd.read(lattice_nbit), xi);
+            float norm = decode_scale(j, rd.read(scale_nbit)) / r;
+            decode_lattice_point(rd.read(lattice_nbit), xi);
             for (int l = 0; l < dsq; l++) {
                 xi[l] *= norm;
             }
@@ -114,4 +120,126 @@ void IndexLattice::sa_decode(idx_t n, const uint8_t* codes, float* x) const {
     }
 }
 
+namespace {
+
+/* With the decoded sub-vector y = s / r * c, where s is the decoded
+ * scale and c a lattice point of squared norm r2,
+ *
+ *    || q - y ||^2 = || q ||^2 - 2 * s / r * <q, c> + s^2
+ */
+struct LatticeDistanceComputer : FlatCodesDistanceComputer {
+    const IndexLattice& index;
+    float inv_r;
+    const float* q = nullptr;
+    float q_norm2 = 0;
+    std::vector<float> tmp;
+
+    explicit LatticeDistanceComputer(const IndexLattice& index)
+            : FlatCodesDistanceComputer(index.codes.data(), index.code_size),
+              index(index),
+              inv_r(1 / sqrtf(index.zn_sphere_codec.r2)),
+              tmp(index.d * 2) {}
+
+    void set_query(const float* x) override {
+        q = x;
+        q_norm2 = fvec_norm_L2sqr(x, index.d);
+    }
+
+    float distance_to_code(const uint8_t* code) override {
+        BitstringReader rd(code, code_size);
+        const float* qj = q;
+        float dis = q_norm2;
+        for (int j = 0; j < index.nsq; j++) {
+            float s = index.decode_scale(j, rd.read(index.scale_nbit));
+            uint64_t lcode = rd.read(index.lattice_nbit);
+            const float* c;
+            if (!index.decode_table.empty()) {
+                c = index.decode_table.data() + lcode * index.dsq;
+            } else {
+                index.zn_sphere_codec.decode(lcode, tmp.data());
+                c = tmp.data();
+            }
+            float ip = fvec_inner_product(qj, c, index.dsq);
+            dis += s * (s - 2 * inv_r * ip);
+            qj += index.dsq;
+        }
+        return dis;
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        index.sa_decode(1, codes + i * code_size, tmp.data());
+        index.sa_decode(1, codes + j * code_size, tmp.data() + index.d);
+        return fvec_L2sqr(tmp.data(), tmp.data() + index.d, index.d);
+    }
+};
+
+struct Run_search_with_dc_res {
+    using T = void;
+
+    template <class BlockResultHandler>
+    void f(BlockResultHandler& res,
+           const IndexLattice* index,
+           const float* xq) {
+        size_t ntotal = index->ntotal;
+        using SingleResultHandler =
+                typename BlockResultHandler::SingleResultHandler;
+        const int d = index->d;
+        const uint8_t* codes = index->codes.data();
+        const size_t code_size = index->code_size;
+
+#pragma omp parallel // if (res.nq > 100)
+        {
+            LatticeDistanceComputer dc(*index);
+            SingleResultHandler resi(res);
+#pragma omp for
+            for (int64_t q = 0; q < res.nq; q++) {
+                resi.begin(q);
+                dc.set_query(xq + d * q);
+                for (size_t i = 0; i < ntotal; i++) {
+                    if (res.is_in_selection(i)) {
+                        float dis = dc.distance_to_code(codes + i * code_size);
+                        resi.add_result(dis, i);
+                    }
+                }
+                resi.end();
+            }
+        }
+    }
+};
+
+} // namespace
+
+FlatCodesDistanceComputer* IndexLattice::get_FlatCodesDistanceComputer()
+        const {
+    FAISS_THROW_IF_NOT(is_trained);
+    return new LatticeDistanceComputer(*this);
+}
+
+void IndexLattice::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(is_trained);
+    const IDSelector* sel = params ? params->sel : nullptr;
+    Run_search_with_dc_res r;
+    dispatch_knn_ResultHandler(
+            n, distances, labels, k, metric_type, sel, r, this, x);
+}
+
+void IndexLattice::range_search(
+        idx_t n,
+        const float* x,
+        float radius,
+        RangeSearchResult* result,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(is_trained);
+    const IDSelector* sel = params ? params->sel : nullptr;
+    Run_search_with_dc_res r;
+    dispatch_range_ResultHandler(result, radius, metric_type, sel, r, this, x);
+}
+
 } // namespace faiss
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstring>
 #include <vector>
 
 #include <faiss/IndexFlatCodes.h>
@@ -15,6 +16,11 @@
 namespace faiss {
 
 /** Index that encodes a vector with a series of Zn lattice quantizers
+ *
+ * The search does not decode the vectors: since the lattice points of a
+ * sub-vector all have squared norm r2, the distance to a code only needs
+ * the dot product between the query sub-vector and the lattice point,
+ * looked up in decode_table when it fits.
  */
 struct IndexLattice : IndexFlatCodes {
     /// number of sub-vectors
@@ -31,16 +37,58 @@ struct IndexLattice : IndexFlatCodes {
     /// mins and maxes of the vector norms, per subquantizer
     std::vector<float> trained;
 
+    /// all the lattice points, size nv * dsq, filled by the constructor
+    /// if nv * dsq <= max_decode_table_size, otherwise empty
+    std::vector<float> decode_table;
+
+    static constexpr size_t max_decode_table_size = size_t(1) << 22;
+
     IndexLattice(idx_t d, int nsq, int scale_nbit, int r2);
 
     void train(idx_t n, const float* x) override;
 
+    /// decode one lattice point (squared norm r2) to c, size dsq
+    void decode_lattice_point(uint64_t code, float* c) const {
+        if (!decode_table.empty()) {
+            memcpy(c, decode_table.data() + code * dsq, sizeof(float) * dsq);
+        } else {
+            zn_sphere_codec.decode(code, c);
+        }
+    }
+
+    /// norm of the sub-vector sq for a quantized scale
+    float decode_scale(int sq, uint64_t scale) const {
+        const float* mins = trained.data();
+        const float* maxs = mins + nsq;
+        return (scale + 0.5) * (maxs[sq] - mins[sq]) /
+                (int64_t(1) << scale_nbit) +
+                mins[sq];
+    }
+
     /* The standalone codec interface */
     size_t sa_code_size() const override;
 
     void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
 
     void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+
+    /// computes the distances from the codes without decoding them
+    FlatCodesDistanceComputer* get_FlatCodesDistanceComputer() const override;
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void range_search(
+            idx_t n,
+            const float* x,
+            float radius,
+            RangeSearchResult* result,
+            const SearchParameters* params = nullptr) const override;
 };
 
 } // namespace faiss
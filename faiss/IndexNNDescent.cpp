@@ -127,7 +127,8 @@ void IndexNNDescent::search(
 
 #pragma omp parallel
         {
-            VisitedTable vt(ntotal);
+            ThreadVisitedTable tvt(ntotal);
+            VisitedTable& vt = *tvt;
 
             std::unique_ptr<DistanceComputer> dis(
                     storage_distance_computer(storage));
@@ -169,7 +170,16 @@ void IndexNNDescent::add(idx_t n, const float* x) {
     ntotal = storage->ntotal;
 
     std::unique_ptr<DistanceComputer> dis(storage_distance_computer(storage));
-    nndescent.build(*dis, ntotal, verbose);
+    // with a flat storage, the local join works on blocks of raw vectors
+    const IndexFlat* flat = dynamic_cast<const IndexFlat*>(storage);
+    if (flat &&
+        (flat->metric_type == METRIC_L2 ||
+         flat->metric_type == METRIC_INNER_PRODUCT)) {
+        nndescent.build(
+                *dis, ntotal, verbose, flat->get_xb(), flat->metric_type);
+    } else {
+        nndescent.build(*dis, ntotal, verbose);
+    }
 }
 
 void IndexNNDescent::reset() {
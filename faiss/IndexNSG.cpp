@@ -67,6 +67,9 @@ void IndexNSG::search(
             "Please use IndexNSGFlat (or variants) instead of IndexNSG directly");
 
     int L = std::max(nsg.search_L, (int)k); // in case of search L = -1
+    // the visited set is chosen from the expected nb of visited nodes
+    size_t nvisit = (size_t)L * nsg.R;
+    VisitedTableMode vt_mode = VisitedTable::auto_mode(ntotal, nvisit);
     idx_t check_period = InterruptCallback::get_period_hint(d * L);
 
     int ndis = 0;
@@ -76,7 +79,8 @@ void IndexNSG::search(
 
 #pragma omp parallel
         {
-            VisitedTable vt(ntotal);
+            ThreadVisitedTable tvt(ntotal, vt_mode, nvisit);
+            VisitedTable& vt = *tvt;
 
             std::unique_ptr<DistanceComputer> dis(
                     storage_distance_computer(storage));
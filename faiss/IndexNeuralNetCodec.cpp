@@ -6,7 +6,13 @@
  */
 
 #include <faiss/IndexNeuralNetCodec.h>
+
+#include <algorithm>
+#include <cstring>
+
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
 #include <faiss/utils/hamming.h>
 
 namespace faiss {
@@ -30,17 +36,82 @@ void IndexNeuralNetCodec::train(idx_t n, const float* x) {
 
 void IndexNeuralNetCodec::sa_encode(idx_t n, const float* x, uint8_t* codes)
         const {
-    nn::Tensor2D x_tensor(n, d, x);
-    nn::Int32Tensor2D codes_tensor = net->encode(x_tensor);
-    pack_bitstrings(n, M, nbits, codes_tensor.data(), codes, code_size);
+    std::vector<int32_t> codes_int(n * M);
+    net->encode_vectors(n, x, codes_int.data());
+    pack_bitstrings(n, M, nbits, codes_int.data(), codes, code_size);
 }
 
 void IndexNeuralNetCodec::sa_decode(idx_t n, const uint8_t* codes, float* x)
         const {
-    nn::Int32Tensor2D codes_tensor(n, M);
-    unpack_bitstrings(n, M, nbits, codes, code_size, codes_tensor.data());
-    nn::Tensor2D x_tensor = net->decode(codes_tensor);
-    memcpy(x, x_tensor.data(), d * n * sizeof(float));
+    std::vector<int32_t> codes_int(n * M);
+    unpack_bitstrings(n, M, nbits, codes, code_size, codes_int.data());
+    net->decode_codes(n, codes_int.data(), x);
+}
+
+namespace {
+
+template <class HeapArray>
+void search_decoded_blocks(
+        const IndexNeuralNetCodec& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels) {
+    size_t d = index.d;
+    HeapArray res = {size_t(n), size_t(k), labels, distances};
+    res.heapify();
+
+    size_t bs = std::max(index.search_block_size, size_t(1));
+    std::vector<float> block;
+    std::vector<float> D(n * k);
+    std::vector<idx_t> I(n * k);
+    for (idx_t i0 = 0; i0 < index.ntotal; i0 += bs) {
+        idx_t i1 = std::min(index.ntotal, idx_t(i0 + bs));
+        block.resize((i1 - i0) * d);
+        index.sa_decode(
+                i1 - i0,
+                index.codes.data() + i0 * index.code_size,
+                block.data());
+
+        if (index.metric_type == METRIC_L2) {
+            knn_L2sqr(x, block.data(), d, n, i1 - i0, k, D.data(), I.data());
+        } else {
+            knn_inner_product(
+                    x, block.data(), d, n, i1 - i0, k, D.data(), I.data());
+        }
+        for (idx_t& id : I) {
+            if (id >= 0) {
+                id += i0;
+            }
+        }
+        res.addn_with_ids(k, D.data(), I.data(), k);
+    }
+    res.reorder();
+}
+
+} // anonymous namespace
+
+void IndexNeuralNetCodec::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    if ((params && params->sel) ||
+        (metric_type != METRIC_L2 && metric_type != METRIC_INNER_PRODUCT)) {
+        IndexFlatCodes::search(n, x, k, distances, labels, params);
+        return;
+    }
+    FAISS_THROW_IF_NOT(k > 0);
+    if (metric_type == METRIC_L2) {
+        search_decoded_blocks<float_maxheap_array_t>(
+                *this, n, x, k, distances, labels);
+    } else {
+        search_decoded_blocks<float_minheap_array_t>(
+                *this, n, x, k, distances, labels);
+    }
 }
 
 /*********************************************************
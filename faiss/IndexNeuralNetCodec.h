@@ -18,6 +18,9 @@ struct IndexNeuralNetCodec : IndexFlatCodes {
     NeuralNetCodec* net = nullptr;
     size_t M, nbits;
 
+    /// nb of database vectors decoded at a time by search
+    size_t search_block_size = 16384;
+
     explicit IndexNeuralNetCodec(
             int d = 0,
             int M = 0,
@@ -29,6 +32,16 @@ struct IndexNeuralNetCodec : IndexFlatCodes {
     void sa_encode(idx_t n, const float* x, uint8_t* codes) const override;
     void sa_decode(idx_t n, const uint8_t* codes, float* x) const override;
 
+    /** decodes the database by blocks of search_block_size and compares
+     * them to all the queries at once (L2 and inner product only) */
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
     ~IndexNeuralNetCodec() {}
 };
 
@@ -18,7 +18,9 @@
 
 #include <faiss/impl/DistanceComputer.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/sa_decode_kernels.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/metrics.h>
 
 #include <faiss/impl/code_distance/code_distance.h>
 
@@ -157,6 +159,8 @@ void IndexPQ::search(
         const SearchParameters* iparams) const {
     FAISS_THROW_IF_NOT(k > 0);
     FAISS_THROW_IF_NOT(is_trained);
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
+    metrics_add(METRIC_NDIS, n * ntotal);
 
     const SearchParametersPQ* params = nullptr;
     Search_type_t param_search_type = this->search_type;
@@ -429,7 +433,12 @@ void IndexPQ::sa_encode(idx_t n, const float* x, uint8_t* bytes) const {
 }
 
 void IndexPQ::sa_decode(idx_t n, const uint8_t* bytes, float* x) const {
-    pq.decode(bytes, x, n);
+    SaDecodeKernel kernel(this);
+    if (kernel.is_available()) {
+        kernel.decode(n, bytes, code_size, x);
+    } else {
+        pq.decode(bytes, x, n);
+    }
 }
 
 /*****************************************
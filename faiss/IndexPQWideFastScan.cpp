@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexPQWideFastScan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/pq_wide_fast_scan.h>
+#include <faiss/impl/simd_result_handlers.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/quantize_lut.h>
+
+namespace faiss {
+
+using namespace simd_result_handlers;
+
+namespace {
+
+inline size_t roundup(size_t a, size_t b) {
+    return (a + b - 1) / b * b;
+}
+
+template <class C>
+SIMDResultHandlerToFloat* make_knn_handler_fixC(
+        idx_t n,
+        idx_t k,
+        size_t ntotal,
+        float* distances,
+        idx_t* labels,
+        const IDSelector* sel) {
+    if (k == 1) {
+        return new SingleResultHandler<C, false>(
+                n, ntotal, distances, labels, sel);
+    } else if (k <= 20) {
+        return new HeapHandler<C, false>(
+                n, ntotal, k, distances, labels, sel);
+    } else {
+        return new ReservoirHandler<C, false>(
+                n, ntotal, k, 2 * k, distances, labels, sel);
+    }
+}
+
+} // namespace
+
+IndexPQWideFastScan::IndexPQWideFastScan(
+        int d,
+        size_t M,
+        size_t nbits,
+        MetricType metric)
+        : Index(d, metric), pq(d, M, nbits) {
+    FAISS_THROW_IF_NOT_MSG(
+            nbits >= 5 && nbits <= 8, "only 5 to 8-bit PQ is supported");
+    FAISS_THROW_IF_NOT_MSG(M <= 256, "at most 256 sub-quantizers");
+    FAISS_THROW_IF_NOT(metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT);
+    is_trained = false;
+}
+
+IndexPQWideFastScan::IndexPQWideFastScan() {}
+
+void IndexPQWideFastScan::train(idx_t n, const float* x) {
+    if (is_trained) {
+        return;
+    }
+    pq.train(n, x);
+    is_trained = true;
+}
+
+void IndexPQWideFastScan::add(idx_t n, const float* x) {
+    FAISS_THROW_IF_NOT(is_trained);
+
+    // do some blocking to avoid excessive allocs
+    constexpr idx_t bs = 65536;
+    if (n > bs) {
+        for (idx_t i0 = 0; i0 < n; i0 += bs) {
+            idx_t i1 = std::min(n, i0 + bs);
+            add(i1 - i0, x + i0 * d);
+        }
+        return;
+    }
+
+    std::vector<uint8_t> tmp_codes(n * pq.code_size);
+    pq.compute_codes(x, tmp_codes.data(), n);
+
+    ntotal2 = roundup(ntotal + n, pqwide_bbs);
+    size_t new_size = ntotal2 / pqwide_bbs * pqwide_block_size(pq.M, pq.nbits);
+    size_t old_size = codes.size();
+    if (new_size > old_size) {
+        codes.resize(new_size);
+        memset(codes.get() + old_size, 0, new_size - old_size);
+    }
+    pqwide_pack_codes_range(
+            tmp_codes.data(), pq.M, pq.nbits, ntotal, ntotal + n, codes.get());
+    ntotal += n;
+}
+
+void IndexPQWideFastScan::reset() {
+    codes.resize(0);
+    ntotal = ntotal2 = 0;
+}
+
+void IndexPQWideFastScan::compute_quantized_LUT(
+        idx_t n,
+        const float* x,
+        uint8_t* lut,
+        float* normalizers) const {
+    size_t M = pq.M, ksub = pq.ksub;
+    size_t stride = pqwide_lut_stride(pq.nbits);
+    std::unique_ptr<float[]> dis_tables(new float[n * M * ksub]);
+    if (metric_type == METRIC_L2) {
+        pq.compute_distance_tables(n, x, dis_tables.get());
+    } else {
+        pq.compute_inner_prod_tables(n, x, dis_tables.get());
+    }
+
+    memset(lut, 0, n * M * stride);
+    for (idx_t i = 0; i < n; i++) {
+        float* t_in = dis_tables.get() + i * M * ksub;
+        quantize_lut::round_uint8_per_column(
+                t_in, M, ksub, &normalizers[2 * i], &normalizers[2 * i + 1]);
+        for (size_t m = 0; m < M; m++) {
+            uint8_t* t_out = lut + (i * M + m) * stride;
+            for (size_t j = 0; j < ksub; j++) {
+                t_out[j] = int(t_in[m * ksub + j]);
+            }
+        }
+    }
+}
+
+void IndexPQWideFastScan::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    const IDSelector* sel = params ? params->sel : nullptr;
+    bool is_max = !is_similarity_metric(metric_type);
+    idx_t bs = qbs == 0 ? 4 : qbs;
+    size_t lut_size = pq.M * pqwide_lut_stride(pq.nbits);
+
+#pragma omp parallel for schedule(dynamic) if (n > bs)
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(i0 + bs, n);
+        AlignedTable<uint8_t> LUT((i1 - i0) * lut_size);
+        std::vector<float> normalizers(2 * (i1 - i0));
+        compute_quantized_LUT(
+                i1 - i0, x + i0 * d, LUT.get(), normalizers.data());
+
+        std::unique_ptr<SIMDResultHandlerToFloat> handler;
+        if (is_max) {
+            handler.reset(make_knn_handler_fixC<CMax<uint16_t, int64_t>>(
+                    i1 - i0,
+                    k,
+                    ntotal,
+                    distances + i0 * k,
+                    labels + i0 * k,
+                    sel));
+        } else {
+            handler.reset(make_knn_handler_fixC<CMin<uint16_t, int64_t>>(
+                    i1 - i0,
+                    k,
+                    ntotal,
+                    distances + i0 * k,
+                    labels + i0 * k,
+                    sel));
+        }
+        handler->begin(normalizers.data());
+        pqwide_accumulate_loop(
+                i1 - i0,
+                ntotal2,
+                pq.M,
+                pq.nbits,
+                codes.get(),
+                LUT.get(),
+                *handler);
+        handler->end();
+    }
+}
+
+void IndexPQWideFastScan::reconstruct(idx_t key, float* recons) const {
+    FAISS_THROW_IF_NOT(key >= 0 && key < ntotal);
+    std::vector<uint8_t> code(pq.code_size, 0);
+    BitstringWriter bsw(code.data(), pq.code_size);
+    for (size_t m = 0; m < pq.M; m++) {
+        bsw.write(
+                pqwide_get_packed_element(
+                        codes.get(), pq.M, pq.nbits, key, m),
+                pq.nbits);
+    }
+    pq.decode(code.data(), recons);
+}
+
+size_t IndexPQWideFastScan::sa_code_size() const {
+    return pq.code_size;
+}
+
+void IndexPQWideFastScan::sa_encode(idx_t n, const float* x, uint8_t* bytes)
+        const {
+    pq.compute_codes(x, bytes, n);
+}
+
+void IndexPQWideFastScan::sa_decode(idx_t n, const uint8_t* bytes, float* x)
+        const {
+    pq.decode(bytes, x, n);
+}
+
+} // namespace faiss
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/Index.h>
+#include <faiss/impl/ProductQuantizer.h>
+#include <faiss/utils/AlignedTable.h>
+
+namespace faiss {
+
+/** Fast scan version of IndexPQ for 5 to 8-bit PQ.
+ *
+ * The codes are stored by blocks of 64 vectors, bit-packed per
+ * sub-quantizer (see pq_wide_fast_scan.h), so the memory use is the one of
+ * IndexPQ. The distances are computed from uint8 look-up tables of 32 to
+ * 256 entries, with AVX512-VBMI byte permutations when available. This
+ * gives a better accuracy per byte than the 4-bit IndexPQFastScan, at a
+ * higher scan cost. Index factory string: PQ{M}x{nbits}fs, nbits = 5..8.
+ */
+struct IndexPQWideFastScan : Index {
+    ProductQuantizer pq;
+
+    /// ntotal rounded up to a multiple of 64
+    size_t ntotal2 = 0;
+
+    /// the blocks of codes
+    AlignedTable<uint8_t> codes;
+
+    /// nb of queries scanned together, 0 = default (4)
+    int qbs = 0;
+
+    IndexPQWideFastScan(
+            int d,
+            size_t M,
+            size_t nbits,
+            MetricType metric = METRIC_L2);
+
+    IndexPQWideFastScan();
+
+    void train(idx_t n, const float* x) override;
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    /// supports an IDSelector in the SearchParameters
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /// quantized look-up tables of n queries, see pq_wide_fast_scan.h
+    void compute_quantized_LUT(
+            idx_t n,
+            const float* x,
+            uint8_t* lut,
+            float* normalizers) const;
+
+    size_t sa_code_size() const override;
+
+    void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
+
+    void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+};
+
+} // namespace faiss
@@ -14,9 +14,37 @@
 #include <cstring>
 #include <memory>
 
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/DistanceComputer.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+
+#ifndef FINTEGER
+#define FINTEGER long
+#endif
+
+extern "C" {
+
+/* declare BLAS functions, see http://www.netlib.org/clapack/cblas/ */
+
+int sgemm_(
+        const char* transa,
+        const char* transb,
+        FINTEGER* m,
+        FINTEGER* n,
+        FINTEGER* k,
+        const float* alpha,
+        const float* a,
+        FINTEGER* lda,
+        const float* b,
+        FINTEGER* ldb,
+        float* beta,
+        float* c,
+        FINTEGER* ldc);
+}
 
 namespace faiss {
 
@@ -111,6 +139,9 @@ void IndexPreTransform::train(idx_t n, const float* x) {
     }
 
     is_trained = true;
+    fused_matrix.clear();
+    fused_bias.clear();
+    fused_centroid_norms.clear();
 }
 
 const float* IndexPreTransform::apply_chain(idx_t n, const float* x) const {
@@ -127,6 +158,31 @@ const float* IndexPreTransform::apply_chain(idx_t n, const float* x) const {
     return prev_x;
 }
 
+const float* IndexPreTransform::apply_chain_noalloc(
+        idx_t n,
+        const float* x,
+        std::vector<float>& buf,
+        int n_transforms) const {
+    size_t nt = n_transforms < 0 ? chain.size() : n_transforms;
+    FAISS_THROW_IF_NOT(nt <= chain.size());
+    if (nt == 0) {
+        return x;
+    }
+    // two halves of buf are used alternately as input and output
+    size_t max_d = 0;
+    for (size_t i = 0; i < nt; i++) {
+        max_d = std::max(max_d, size_t(chain[i]->d_out));
+    }
+    buf.resize(2 * n * max_d);
+    const float* prev_x = x;
+    for (size_t i = 0; i < nt; i++) {
+        float* xt = buf.data() + (i % 2) * n * max_d;
+        chain[i]->apply_noalloc(n, prev_x, xt);
+        prev_x = xt;
+    }
+    return prev_x;
+}
+
 void IndexPreTransform::reverse_chain(idx_t n, const float* xt, float* x)
         const {
     const float* next_x = xt;
@@ -142,10 +198,7 @@ void IndexPreTransform::reverse_chain(idx_t n, const float* xt, float* x)
 }
 
 void IndexPreTransform::add(idx_t n, const float* x) {
-    FAISS_THROW_IF_NOT(is_trained);
-    TransformedVectors tv(x, apply_chain(n, x));
-    index->add(n, tv.x);
-    ntotal = index->ntotal;
+    add_with_ids(n, x, nullptr);
 }
 
 void IndexPreTransform::add_with_ids(
@@ -153,13 +206,115 @@ void IndexPreTransform::add_with_ids(
         const float* x,
         const idx_t* xids) {
     FAISS_THROW_IF_NOT(is_trained);
-    TransformedVectors tv(x, apply_chain(n, x));
-    index->add_with_ids(n, tv.x, xids);
+    // only one block of transformed vectors is in memory at a time
+    std::vector<float> buf;
+    idx_t bs = std::max(add_block_size, idx_t(1));
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(n, i0 + bs);
+        const float* xt = apply_chain_noalloc(i1 - i0, x + i0 * d, buf);
+        if (xids) {
+            index->add_with_ids(i1 - i0, xt, xids + i0);
+        } else {
+            index->add(i1 - i0, xt);
+        }
+    }
     ntotal = index->ntotal;
 }
 
 namespace {
 
+/// the components of the fused search, nullptr if it does not apply
+struct FusedSearchComponents {
+    const LinearTransform* lt = nullptr;
+    const IndexIVF* ivf = nullptr;
+    const IndexFlat* quantizer = nullptr;
+};
+
+FusedSearchComponents get_fused_search_components(
+        const IndexPreTransform& index) {
+    FusedSearchComponents fc;
+    if (index.chain.empty()) {
+        return fc;
+    }
+    auto lt = dynamic_cast<const LinearTransform*>(index.chain.back());
+    auto ivf = dynamic_cast<const IndexIVF*>(index.index);
+    if (!lt || !lt->is_trained || !ivf) {
+        return fc;
+    }
+    auto quantizer = dynamic_cast<const IndexFlat*>(ivf->quantizer);
+    if (!quantizer || quantizer->ntotal != ivf->nlist ||
+        (quantizer->metric_type != METRIC_L2 &&
+         quantizer->metric_type != METRIC_INNER_PRODUCT)) {
+        return fc;
+    }
+    fc.lt = lt;
+    fc.ivf = ivf;
+    fc.quantizer = quantizer;
+    return fc;
+}
+
+} // namespace
+
+void IndexPreTransform::prepare_fused_search() {
+    FusedSearchComponents fc = get_fused_search_components(*this);
+    FAISS_THROW_IF_NOT_MSG(
+            fc.lt,
+            "fused search needs a trained LinearTransform as last transform "
+            "and an IndexIVF with a flat coarse quantizer");
+    const LinearTransform& lt = *fc.lt;
+    FINTEGER d_in = lt.d_in, d_out = lt.d_out, nlist = fc.ivf->nlist;
+    const float* centroids = fc.quantizer->get_xb();
+
+    fused_matrix.resize((d_out + nlist) * d_in);
+    memcpy(fused_matrix.data(), lt.A.data(), sizeof(float) * d_out * d_in);
+    // centroids * A, so that <A x + b, c> = <x, A^T c> + <b, c>
+    if (nlist > 0) {
+        float one = 1, zero = 0;
+        sgemm_("Not transposed",
+               "Not transposed",
+               &d_in,
+               &nlist,
+               &d_out,
+               &one,
+               lt.A.data(),
+               &d_in,
+               centroids,
+               &d_out,
+               &zero,
+               fused_matrix.data() + d_out * d_in,
+               &d_in);
+    }
+
+    fused_bias.assign(d_out + nlist, 0);
+    if (lt.have_bias) {
+        memcpy(fused_bias.data(), lt.b.data(), sizeof(float) * d_out);
+        for (idx_t i = 0; i < nlist; i++) {
+            fused_bias[d_out + i] = fvec_inner_product(
+                    lt.b.data(), centroids + i * d_out, d_out);
+        }
+    }
+
+    fused_centroid_norms.clear();
+    if (fc.quantizer->metric_type == METRIC_L2) {
+        fused_centroid_norms.resize(nlist);
+        fvec_norms_L2sqr(fused_centroid_norms.data(), centroids, d_out, nlist);
+    }
+}
+
+bool IndexPreTransform::can_use_fused_search() const {
+    FusedSearchComponents fc = get_fused_search_components(*this);
+    if (!fc.lt) {
+        return false;
+    }
+    size_t nrow = fc.lt->d_out + fc.ivf->nlist;
+    return fused_matrix.size() == nrow * fc.lt->d_in &&
+            fused_bias.size() == nrow &&
+            fused_centroid_norms.size() ==
+            (fc.quantizer->metric_type == METRIC_L2 ? fc.ivf->nlist : 0);
+}
+
+namespace {
+
 const SearchParameters* extract_index_search_params(
         const SearchParameters* params_in) {
     auto params = dynamic_cast<const SearchParametersPreTransform*>(params_in);
@@ -168,6 +323,110 @@ const SearchParameters* extract_index_search_params(
 
 } // namespace
 
+namespace {
+
+/// search with the fused transform + coarse quantization GEMM
+void search_fused(
+        const IndexPreTransform& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params_in) {
+    FusedSearchComponents fc = get_fused_search_components(index);
+    const IndexIVF& ivf = *fc.ivf;
+    const IVFSearchParameters* params = nullptr;
+    if (params_in) {
+        params = dynamic_cast<const IVFSearchParameters*>(params_in);
+        FAISS_THROW_IF_NOT_MSG(params, "IndexIVF params have incorrect type");
+    }
+    const size_t nprobe =
+            std::min(ivf.nlist, params ? params->nprobe : ivf.nprobe);
+    FAISS_THROW_IF_NOT(nprobe > 0);
+    const bool is_l2 = fc.quantizer->metric_type == METRIC_L2;
+
+    // the transforms before the last one
+    std::vector<float> buf;
+    const float* x0 =
+            index.apply_chain_noalloc(n, x, buf, index.chain.size() - 1);
+
+    FINTEGER d_in = fc.lt->d_in, d_out = fc.lt->d_out;
+    FINTEGER nrow = d_out + ivf.nlist;
+    // bound the size of the GEMM output to 64 MiB
+    idx_t bs = std::max(idx_t(1), idx_t((1 << 24) / nrow));
+    bs = std::min(bs, n);
+
+    std::vector<float> y(bs * nrow), xt(bs * d_out), coarse_dis(bs * nprobe);
+    std::vector<idx_t> assign(bs * nprobe);
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(n, i0 + bs);
+        FINTEGER nb = i1 - i0;
+        float one = 1, zero = 0;
+        sgemm_("Transposed",
+               "Not transposed",
+               &nrow,
+               &nb,
+               &d_in,
+               &one,
+               index.fused_matrix.data(),
+               &d_in,
+               x0 + i0 * d_in,
+               &d_in,
+               &zero,
+               y.data(),
+               &nrow);
+
+#pragma omp parallel for if (nb > 1)
+        for (idx_t i = 0; i < nb; i++) {
+            float* yi = y.data() + i * nrow;
+            for (idx_t j = 0; j < nrow; j++) {
+                yi[j] += index.fused_bias[j];
+            }
+            float* xti = xt.data() + i * d_out;
+            memcpy(xti, yi, sizeof(float) * d_out);
+            const float* ips = yi + d_out;
+
+            float* di = coarse_dis.data() + i * nprobe;
+            idx_t* ai = assign.data() + i * nprobe;
+            if (is_l2) {
+                float qnorm = fvec_norm_L2sqr(xti, d_out);
+                maxheap_heapify(nprobe, di, ai);
+                for (size_t c = 0; c < ivf.nlist; c++) {
+                    float dis = qnorm + index.fused_centroid_norms[c] -
+                            2 * ips[c];
+                    if (dis < di[0]) {
+                        maxheap_replace_top(nprobe, di, ai, dis, idx_t(c));
+                    }
+                }
+                maxheap_reorder(nprobe, di, ai);
+            } else {
+                minheap_heapify(nprobe, di, ai);
+                for (size_t c = 0; c < ivf.nlist; c++) {
+                    if (ips[c] > di[0]) {
+                        minheap_replace_top(nprobe, di, ai, ips[c], idx_t(c));
+                    }
+                }
+                minheap_reorder(nprobe, di, ai);
+            }
+        }
+
+        ivf.invlists->prefetch_lists(assign.data(), nb * nprobe);
+        ivf.search_preassigned(
+                nb,
+                xt.data(),
+                k,
+                assign.data(),
+                coarse_dis.data(),
+                distances + i0 * k,
+                labels + i0 * k,
+                false,
+                params);
+    }
+}
+
+} // namespace
+
 void IndexPreTransform::search(
         idx_t n,
         const float* x,
@@ -177,8 +436,19 @@ void IndexPreTransform::search(
         const SearchParameters* params) const {
     FAISS_THROW_IF_NOT(k > 0);
     FAISS_THROW_IF_NOT(is_trained);
-    const float* xt = apply_chain(n, x);
-    std::unique_ptr<const float[]> del(xt == x ? nullptr : xt);
+    if (can_use_fused_search()) {
+        search_fused(
+                *this,
+                n,
+                x,
+                k,
+                distances,
+                labels,
+                extract_index_search_params(params));
+        return;
+    }
+    std::vector<float> buf;
+    const float* xt = apply_chain_noalloc(n, x, buf);
     index->search(
             n, xt, k, distances, labels, extract_index_search_params(params));
 }
@@ -277,6 +547,10 @@ void IndexPreTransform::sa_decode(idx_t n, const uint8_t* bytes, float* x)
     }
 }
 
+size_t IndexPreTransform::warmup(const WarmupPolicy& policy) const {
+    return index->warmup(policy);
+}
+
 void IndexPreTransform::merge_from(Index& otherIndex, idx_t add_id) {
     check_compatible_for_merge(otherIndex);
     auto other = static_cast<const IndexPreTransform*>(&otherIndex);
@@ -28,6 +28,18 @@ struct IndexPreTransform : Index {
 
     bool own_fields; ///! whether pointers are deleted in destructor
 
+    /// add() transforms and adds the vectors by blocks of this size
+    idx_t add_block_size = 65536;
+
+    /** Fused search, see prepare_fused_search. Rows: the matrix of the last
+     * transform (d_out rows), then the coarse centroids mapped back
+     * through it (nlist rows). Size (d_out + nlist) * d_in */
+    std::vector<float> fused_matrix;
+    /// bias of the rows of fused_matrix, size d_out + nlist
+    std::vector<float> fused_bias;
+    /// squared norms of the coarse centroids (L2 coarse quantizer only)
+    std::vector<float> fused_centroid_norms;
+
     explicit IndexPreTransform(Index* index);
 
     IndexPreTransform();
@@ -82,6 +94,30 @@ struct IndexPreTransform : Index {
     /// equal to x, otherwise it should be deallocated.
     const float* apply_chain(idx_t n, const float* x) const;
 
+    /** apply the first n_transforms transforms of the chain (all if -1)
+     * with buf as the only storage for the intermediate results.
+     * @return x if there is no transform to apply, a pointer in buf
+     *         otherwise */
+    const float* apply_chain_noalloc(
+            idx_t n,
+            const float* x,
+            std::vector<float>& buf,
+            int n_transforms = -1) const;
+
+    /** When the sub-index is an IndexIVF with a flat coarse quantizer and
+     * the last transform is a LinearTransform (OPQ, PCA, rotation), search
+     * computes the transformed queries and their inner products with the
+     * coarse centroids with a single GEMM on the input queries, instead of
+     * one for the transform and one in the coarse quantizer.
+     *
+     * This precomputes the fused matrix. It should be called after
+     * training, and again if the coarse quantizer is modified. Not
+     * serialized, train() clears it. */
+    void prepare_fused_search();
+
+    /// whether search will use the fused matrix
+    bool can_use_fused_search() const;
+
     /// Reverse the transforms in the chain. May not be implemented for
     /// all transforms in the chain or may return approximate results.
     void reverse_chain(idx_t n, const float* xt, float* x) const;
@@ -96,6 +132,8 @@ struct IndexPreTransform : Index {
     void merge_from(Index& otherIndex, idx_t add_id = 0) override;
     void check_compatible_for_merge(const Index& otherIndex) const override;
 
+    size_t warmup(const WarmupPolicy& policy = WarmupPolicy()) const override;
+
     ~IndexPreTransform() override;
 };
 
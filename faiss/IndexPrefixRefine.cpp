@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexPrefixRefine.h>
+
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace faiss {
+
+IndexPrefixRefine::IndexPrefixRefine(Index* base_index, Index* suffix_index)
+        : Index(base_index->d + suffix_index->d, base_index->metric_type),
+          d_prefix(base_index->d),
+          base_index(base_index),
+          suffix_index(suffix_index) {
+    FAISS_THROW_IF_NOT(base_index->metric_type == suffix_index->metric_type);
+    FAISS_THROW_IF_NOT(
+            metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT);
+    FAISS_THROW_IF_NOT(base_index->ntotal == suffix_index->ntotal);
+    is_trained = base_index->is_trained && suffix_index->is_trained;
+    ntotal = base_index->ntotal;
+}
+
+IndexPrefixRefine::IndexPrefixRefine() = default;
+
+void IndexPrefixRefine::split_vectors(
+        idx_t n,
+        const float* x,
+        float* prefixes,
+        float* suffixes) const {
+    size_t d_suffix = d - d_prefix;
+    for (idx_t i = 0; i < n; i++) {
+        memcpy(prefixes + i * d_prefix, x + i * d, sizeof(float) * d_prefix);
+        memcpy(suffixes + i * d_suffix,
+               x + i * d + d_prefix,
+               sizeof(float) * d_suffix);
+    }
+}
+
+namespace {
+
+// nb of vectors split at a time by train and add
+const idx_t split_block_size = 65536;
+
+} // anonymous namespace
+
+void IndexPrefixRefine::train(idx_t n, const float* x) {
+    std::vector<float> prefixes(n * d_prefix), suffixes(n * (d - d_prefix));
+    split_vectors(n, x, prefixes.data(), suffixes.data());
+    if (!base_index->is_trained) {
+        base_index->train(n, prefixes.data());
+    }
+    if (!suffix_index->is_trained) {
+        suffix_index->train(n, suffixes.data());
+    }
+    is_trained = true;
+}
+
+void IndexPrefixRefine::add(idx_t n, const float* x) {
+    FAISS_THROW_IF_NOT(is_trained);
+    std::vector<float> prefixes, suffixes;
+    for (idx_t i0 = 0; i0 < n; i0 += split_block_size) {
+        idx_t i1 = std::min(i0 + split_block_size, n);
+        prefixes.resize((i1 - i0) * d_prefix);
+        suffixes.resize((i1 - i0) * (d - d_prefix));
+        split_vectors(i1 - i0, x + i0 * d, prefixes.data(), suffixes.data());
+        base_index->add(i1 - i0, prefixes.data());
+        suffix_index->add(i1 - i0, suffixes.data());
+    }
+    ntotal = base_index->ntotal;
+}
+
+void IndexPrefixRefine::reset() {
+    base_index->reset();
+    suffix_index->reset();
+    ntotal = 0;
+}
+
+namespace {
+
+/// adds the suffix distances to the base distances of the candidates of
+/// one query, and keeps the k best
+template <class C>
+struct PrefixRerank {
+    std::vector<std::pair<idx_t, size_t>> order;
+    std::vector<idx_t> ids;
+    std::vector<float> dis;
+
+    void rerank(
+            DistanceComputer& dc,
+            idx_t k,
+            idx_t k_base,
+            const float* base_distances,
+            const idx_t* base_labels,
+            float* distances,
+            idx_t* labels) {
+        // candidates sorted by id, for the locality of the suffix storage
+        order.clear();
+        for (idx_t j = 0; j < k_base && base_labels[j] >= 0; j++) {
+            order.emplace_back(base_labels[j], j);
+        }
+        std::sort(order.begin(), order.end());
+        size_t nvalid = order.size();
+        ids.resize(nvalid);
+        dis.resize(nvalid);
+        for (size_t j = 0; j < nvalid; j++) {
+            ids[j] = order[j].first;
+        }
+        dc.distances_batch(ids, dis);
+        for (size_t j = 0; j < nvalid; j++) {
+            dis[j] += base_distances[order[j].second];
+        }
+        heap_heapify<C>(k, distances, labels);
+        heap_addn<C>(k, distances, labels, dis.data(), ids.data(), nvalid);
+        heap_reorder<C>(k, distances, labels);
+    }
+};
+
+template <class C>
+void search_and_rerank(
+        const IndexPrefixRefine& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        idx_t k_base,
+        const float* base_distances,
+        const idx_t* base_labels,
+        float* distances,
+        idx_t* labels) {
+#pragma omp parallel if (n > 1)
+    {
+        std::unique_ptr<DistanceComputer> dc(
+                index.suffix_index->get_distance_computer());
+        PrefixRerank<C> rr;
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            dc->set_query(x + i * index.d + index.d_prefix);
+            rr.rerank(
+                    *dc,
+                    k,
+                    k_base,
+                    base_distances + i * k_base,
+                    base_labels + i * k_base,
+                    distances + i * k,
+                    labels + i * k);
+        }
+    }
+}
+
+} // anonymous namespace
+
+void IndexPrefixRefine::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params_in) const {
+    const IndexRefineSearchParameters* params = nullptr;
+    if (params_in) {
+        params = dynamic_cast<const IndexRefineSearchParameters*>(params_in);
+        FAISS_THROW_IF_NOT_MSG(
+                params, "IndexPrefixRefine params have incorrect type");
+    }
+    idx_t k_base = idx_t(k * (params ? params->k_factor : k_factor));
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(k_base >= k);
+    FAISS_THROW_IF_NOT(is_trained);
+
+    std::vector<float> prefixes(n * d_prefix);
+    for (idx_t i = 0; i < n; i++) {
+        memcpy(prefixes.data() + i * d_prefix,
+               x + i * d,
+               sizeof(float) * d_prefix);
+    }
+    std::vector<float> base_distances(n * k_base);
+    std::vector<idx_t> base_labels(n * k_base);
+    base_index->search(
+            n,
+            prefixes.data(),
+            k_base,
+            base_distances.data(),
+            base_labels.data(),
+            params ? params->base_index_params : nullptr);
+
+    if (metric_type == METRIC_L2) {
+        search_and_rerank<CMax<float, idx_t>>(
+                *this,
+                n,
+                x,
+                k,
+                k_base,
+                base_distances.data(),
+                base_labels.data(),
+                distances,
+                labels);
+    } else {
+        search_and_rerank<CMin<float, idx_t>>(
+                *this,
+                n,
+                x,
+                k,
+                k_base,
+                base_distances.data(),
+                base_labels.data(),
+                distances,
+                labels);
+    }
+}
+
+void IndexPrefixRefine::reconstruct(idx_t key, float* recons) const {
+    std::vector<float> suffix(d - d_prefix);
+    base_index->reconstruct(key, recons);
+    suffix_index->reconstruct(key, suffix.data());
+    memcpy(recons + d_prefix, suffix.data(), sizeof(float) * suffix.size());
+}
+
+IndexPrefixRefine::~IndexPrefixRefine() {
+    if (own_fields) {
+        delete base_index;
+        delete suffix_index;
+    }
+}
+
+} // namespace faiss
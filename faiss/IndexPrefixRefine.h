@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/** Coarse-to-fine search for embeddings whose leading dimensions are
+ * meaningful by themselves (Matryoshka-trained models).
+ *
+ * The vectors are split by column: the first d_prefix components are
+ * stored in base_index, the d - d_prefix other ones in suffix_index. The
+ * search runs in base_index with the query prefixes, which reads d_prefix
+ * / d of the data, then re-ranks the k * k_factor candidates by adding
+ * their suffix distances to the base distances (L2 and inner product are
+ * both sums over the components).
+ *
+ * The re-ranking distances are exact when base_index returns exact
+ * distances on the prefixes (IndexFlat, IndexHNSWFlat, IndexIVFFlat...).
+ * suffix_index can be any index with a distance computer, eg. an
+ * IndexFlat or a compressed IndexFlatCodes.
+ */
+struct IndexPrefixRefine : Index {
+    /// nb of leading dimensions stored in base_index
+    int d_prefix = 0;
+
+    /// index of the prefixes, of dimension d_prefix
+    Index* base_index = nullptr;
+
+    /// index of the suffixes, of dimension d - d_prefix
+    Index* suffix_index = nullptr;
+
+    bool own_fields = false; ///< delete base_index and suffix_index
+
+    /// factor between k requested in search and the k requested from
+    /// the base_index (should be >= 1). Can be overridden by
+    /// IndexRefineSearchParameters.
+    float k_factor = 1;
+
+    IndexPrefixRefine(Index* base_index, Index* suffix_index);
+
+    IndexPrefixRefine();
+
+    /// train the indexes that are not trained with the split vectors
+    void train(idx_t n, const float* x) override;
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    /// concatenation of the base and suffix reconstructions
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /// copy the prefixes and the suffixes of n vectors of dimension d
+    void split_vectors(
+            idx_t n,
+            const float* x,
+            float* prefixes,
+            float* suffixes) const;
+
+    ~IndexPrefixRefine() override;
+};
+
+} // namespace faiss
@@ -14,8 +14,8 @@ namespace faiss {
 
 IndexRaBitQ::IndexRaBitQ() = default;
 
-IndexRaBitQ::IndexRaBitQ(idx_t d, MetricType metric)
-        : IndexFlatCodes(0, d, metric), rabitq(d, metric) {
+IndexRaBitQ::IndexRaBitQ(idx_t d, MetricType metric, size_t nb_bits)
+        : IndexFlatCodes(0, d, metric), rabitq(d, metric, nb_bits) {
     code_size = rabitq.code_size;
 
     is_trained = false;
@@ -61,9 +61,9 @@ FlatCodesDistanceComputer* IndexRaBitQ::get_FlatCodesDistanceComputer() const {
     return dc;
 }
 
-FlatCodesDistanceComputer* IndexRaBitQ::get_quantized_distance_computer(
+RaBitQDistanceComputer* IndexRaBitQ::get_quantized_distance_computer(
         const uint8_t qb) const {
-    FlatCodesDistanceComputer* dc =
+    RaBitQDistanceComputer* dc =
             rabitq.get_distance_computer(qb, center.data());
     dc->code_size = rabitq.code_size;
     dc->codes = codes.data();
@@ -83,10 +83,12 @@ struct Run_search_with_dc_res {
         using SingleResultHandler =
                 typename BlockResultHandler::SingleResultHandler;
         const int d = index->d;
+        const uint8_t* codes = index->codes.data();
+        const size_t code_size = index->code_size;
 
 #pragma omp parallel // if (res.nq > 100)
         {
-            std::unique_ptr<FlatCodesDistanceComputer> dc(
+            std::unique_ptr<RaBitQDistanceComputer> dc(
                     index->get_quantized_distance_computer(qb));
             SingleResultHandler resi(res);
 #pragma omp for
@@ -95,7 +97,10 @@ struct Run_search_with_dc_res {
                 dc->set_query(xq + d * q);
                 for (size_t i = 0; i < ntotal; i++) {
                     if (res.is_in_selection(i)) {
-                        float dis = (*dc)(i);
+                        // with multi-bit codes, the codes that cannot
+                        // beat the current threshold are not refined
+                        float dis = dc->distance_to_code_pruned(
+                                codes + i * code_size, resi.threshold);
                         resi.add_result(dis, i);
                     }
                 }
@@ -28,7 +28,10 @@ struct IndexRaBitQ : IndexFlatCodes {
 
     IndexRaBitQ();
 
-    IndexRaBitQ(idx_t d, MetricType metric = METRIC_L2);
+    IndexRaBitQ(
+            idx_t d,
+            MetricType metric = METRIC_L2,
+            size_t nb_bits = 1);
 
     void train(idx_t n, const float* x) override;
 
@@ -41,7 +44,7 @@ struct IndexRaBitQ : IndexFlatCodes {
 
     // returns a quantized-to-qb bits DC if qb_in > 0
     // returns a default fp32-based DC if qb_in == 0
-    FlatCodesDistanceComputer* get_quantized_distance_computer(
+    RaBitQDistanceComputer* get_quantized_distance_computer(
             const uint8_t qb_in) const;
 
     // Don't rely on sa_decode(), bcz it is good for IP, but not for L2.
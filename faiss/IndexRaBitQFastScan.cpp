@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexRaBitQFastScan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/RaBitQuantizer.h>
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/Heap.h>
+
+namespace faiss {
+
+namespace {
+
+// the kernels process the database vectors by blocks of 32
+constexpr size_t kBlockSize = 32;
+
+inline size_t roundup(size_t a, size_t b) {
+    return (a + b - 1) / b * b;
+}
+
+} // anonymous namespace
+
+IndexRaBitQFastScan::IndexRaBitQFastScan() = default;
+
+IndexRaBitQFastScan::IndexRaBitQFastScan(
+        idx_t d,
+        MetricType metric,
+        size_t nb_bits)
+        : IndexRaBitQ(d, metric, nb_bits) {}
+
+size_t IndexRaBitQFastScan::get_nsq() const {
+    return roundup((d + 3) / 4, 2);
+}
+
+void IndexRaBitQFastScan::pack_codes_from(idx_t i0) {
+    const size_t M = (d + 3) / 4;
+    const size_t nsq = get_nsq();
+    const size_t new_size = roundup(ntotal, kBlockSize) * nsq / 2;
+    const size_t old_size = packed_codes.size();
+    if (new_size > old_size) {
+        packed_codes.resize(new_size);
+        memset(packed_codes.get() + old_size, 0, new_size - old_size);
+    }
+    if (ntotal == i0) {
+        return;
+    }
+
+    // the sign bits of a code, read 4 at a time, are the sub-quantizer codes
+    const size_t sign_size = (M + 1) / 2;
+    std::vector<uint8_t> sign_codes((ntotal - i0) * sign_size);
+    for (idx_t i = i0; i < ntotal; i++) {
+        memcpy(sign_codes.data() + (i - i0) * sign_size,
+               codes.data() + i * code_size,
+               sign_size);
+    }
+    pq4_pack_codes_range(
+            sign_codes.data(),
+            M,
+            i0,
+            ntotal,
+            kBlockSize,
+            nsq,
+            packed_codes.get());
+}
+
+void IndexRaBitQFastScan::repack() {
+    packed_codes.clear();
+    pack_codes_from(0);
+}
+
+void IndexRaBitQFastScan::add(idx_t n, const float* x) {
+    idx_t i0 = ntotal;
+    IndexRaBitQ::add(n, x);
+    pack_codes_from(i0);
+}
+
+void IndexRaBitQFastScan::add_sa_codes(
+        idx_t n,
+        const uint8_t* x,
+        const idx_t* xids) {
+    idx_t i0 = ntotal;
+    IndexRaBitQ::add_sa_codes(n, x, xids);
+    pack_codes_from(i0);
+}
+
+void IndexRaBitQFastScan::reset() {
+    IndexRaBitQ::reset();
+    packed_codes.clear();
+}
+
+size_t IndexRaBitQFastScan::remove_ids(const IDSelector& sel) {
+    size_t nremove = IndexRaBitQ::remove_ids(sel);
+    if (nremove > 0) {
+        repack();
+    }
+    return nremove;
+}
+
+void IndexRaBitQFastScan::merge_from(Index& otherIndex, idx_t add_id) {
+    idx_t i0 = ntotal;
+    IndexRaBitQ::merge_from(otherIndex, add_id);
+    pack_codes_from(i0);
+}
+
+namespace {
+
+template <class C>
+void search_fast_scan(
+        const IndexRaBitQFastScan& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const IDSelector* sel) {
+    const size_t d = index.d;
+    const size_t M = (d + 3) / 4;
+    const size_t nsq = index.get_nsq();
+    const size_t ntotal = index.ntotal;
+    const size_t ntotal2 = roundup(ntotal, kBlockSize);
+    const uint8_t* codes = index.codes.data();
+    const size_t code_size = index.code_size;
+    const float* center = index.center.empty() ? nullptr : index.center.data();
+
+    // the largest entry of the quantized LUT, so that the sum of the M
+    // entries fits in the 16-bit accumulators
+    const float max_entry = std::min(255.0f, 65535.0f / M);
+
+#pragma omp parallel if (n > 1)
+    {
+        std::unique_ptr<RaBitQDistanceComputer> dc(
+                index.get_quantized_distance_computer(0));
+        std::vector<float> rotated_q(M * 4, 0);
+        std::vector<float> lut_float(M * 16);
+        std::vector<uint8_t> lut_u8(nsq * 16, 0);
+        AlignedTable<uint8_t> lut(nsq * 16);
+        AlignedTable<uint16_t> accu(ntotal2);
+
+#pragma omp for
+        for (idx_t q = 0; q < n; q++) {
+            const float* xq = x + q * d;
+            float* simi = distances + q * k;
+            idx_t* idxi = labels + q * k;
+            heap_heapify<C>(k, simi, idxi);
+            if (ntotal == 0) {
+                continue;
+            }
+            dc->set_query(xq);
+
+            for (size_t j = 0; j < d; j++) {
+                rotated_q[j] = xq[j] - (center ? center[j] : 0);
+            }
+
+            // lut_float[m * 16 + v] = sum of the components of the query
+            // for which the bit of v is set in the 4 dimensions of group m
+            float bias = 0;
+            float max_span = 0;
+            for (size_t m = 0; m < M; m++) {
+                const float* qm = rotated_q.data() + m * 4;
+                float* tab = lut_float.data() + m * 16;
+                float vmin = 0, vmax = 0;
+                for (int v = 0; v < 16; v++) {
+                    float s = 0;
+                    for (int b = 0; b < 4; b++) {
+                        s += (v >> b & 1) ? qm[b] : 0;
+                    }
+                    tab[v] = s;
+                    vmin = std::min(vmin, s);
+                    vmax = std::max(vmax, s);
+                }
+                for (int v = 0; v < 16; v++) {
+                    tab[v] -= vmin;
+                }
+                bias += vmin;
+                max_span = std::max(max_span, vmax - vmin);
+            }
+
+            // bit_dot = bias + accu / a, with a rounding error of at most
+            // 0.5 / a per sub-quantizer
+            const float a = max_span > 0 ? max_entry / max_span : 1.0f;
+            const float bit_dot_error = 0.5f * M / a;
+            for (size_t j = 0; j < M * 16; j++) {
+                lut_u8[j] = (uint8_t)std::min(
+                        max_entry, std::round(lut_float[j] * a));
+            }
+            pq4_pack_LUT(1, nsq, lut_u8.data(), lut.get());
+            accumulate_to_mem(
+                    1,
+                    ntotal2,
+                    nsq,
+                    index.packed_codes.get(),
+                    lut.get(),
+                    accu.get());
+
+            for (size_t i = 0; i < ntotal; i++) {
+                if (sel && !sel->is_member(i)) {
+                    continue;
+                }
+                const float bit_dot = bias + accu[i] / a;
+                const float dis = dc->distance_to_code_pruned_with_bit_dot(
+                        codes + i * code_size, bit_dot, bit_dot_error, simi[0]);
+                if (C::cmp(simi[0], dis)) {
+                    heap_replace_top<C>(k, simi, idxi, dis, i);
+                }
+            }
+            heap_reorder<C>(k, simi, idxi);
+        }
+    }
+}
+
+} // anonymous namespace
+
+void IndexRaBitQFastScan::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params_in) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(is_trained);
+    uint8_t used_qb = qb;
+    if (auto params = dynamic_cast<const RaBitQSearchParameters*>(params_in)) {
+        used_qb = params->qb;
+    }
+    if (used_qb != 0) {
+        // the first pass uses the fp32 query
+        IndexRaBitQ::search(n, x, k, distances, labels, params_in);
+        return;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            packed_codes.size() >= roundup(ntotal, kBlockSize) * get_nsq() / 2,
+            "packed codes out of sync with the codes, call repack()");
+
+    const IDSelector* sel = (params_in != nullptr) ? params_in->sel : nullptr;
+    if (metric_type == METRIC_L2) {
+        search_fast_scan<CMax<float, idx_t>>(
+                *this, n, x, k, distances, labels, sel);
+    } else {
+        search_fast_scan<CMin<float, idx_t>>(
+                *this, n, x, k, distances, labels, sel);
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/IndexRaBitQ.h>
+#include <faiss/utils/AlignedTable.h>
+
+namespace faiss {
+
+/** IndexRaBitQ with a SIMD first pass over the 1-bit codes.
+ *
+ * The sign bits of the codes are read as (d + 3) / 4 4-bit sub-quantizer
+ * codes, and are additionally stored in the layout of the 4-bit PQ
+ * fast-scan kernels (pq4_fast_scan.h). For each query, the dot products
+ * with the 1-bit codes are computed for all the vectors with an 8-bit
+ * quantized look-up table. Only the vectors whose estimate may beat the
+ * current k-th result, given the error bound of the look-up table
+ * quantization and of RaBitQ, are refined with the full codes.
+ *
+ * With nb_bits = 1, the results are the same as those of IndexRaBitQ with
+ * qb = 0. Queries with qb > 0 and range searches use IndexRaBitQ.
+ */
+struct IndexRaBitQFastScan : IndexRaBitQ {
+    /// the sign bits in the fast-scan layout, for blocks of 32 vectors
+    AlignedTable<uint8_t> packed_codes;
+
+    IndexRaBitQFastScan();
+
+    IndexRaBitQFastScan(
+            idx_t d,
+            MetricType metric = METRIC_L2,
+            size_t nb_bits = 1);
+
+    /// nb of 4-bit sub-quantizers of the packed codes (a multiple of 2)
+    size_t get_nsq() const;
+
+    void add(idx_t n, const float* x) override;
+
+    void add_sa_codes(idx_t n, const uint8_t* x, const idx_t* xids) override;
+
+    void reset() override;
+
+    size_t remove_ids(const IDSelector& sel) override;
+
+    void merge_from(Index& otherIndex, idx_t add_id = 0) override;
+
+    /// rebuild packed_codes from codes, eg. after the codes were modified
+    void repack();
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+   private:
+    /// pack the codes from i0 to ntotal
+    void pack_codes_from(idx_t i0);
+};
+
+} // namespace faiss
@@ -10,7 +10,18 @@
 #include <faiss/IndexFlat.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/sa_decode_kernels.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace faiss {
 
@@ -86,6 +97,118 @@ static void reorder_2_heaps(
     }
 }
 
+/* Computes the distances of the current query to a set of candidates
+ * through a single DistanceComputer::distances_batch call, with the
+ * candidates sorted by id. This gives locality to in-memory storage and
+ * lets the distance computers that fetch the vectors (eg. from a remote
+ * or on-disk storage) issue batched reads. */
+struct RefineBatch {
+    std::vector<std::pair<idx_t, size_t>> order;
+    std::vector<idx_t> ids;
+    std::vector<float> dis;
+
+    void compute(
+            DistanceComputer& dc,
+            const idx_t* labels,
+            size_t n,
+            float* distances) {
+        order.resize(n);
+        for (size_t j = 0; j < n; j++) {
+            order[j] = {labels[j], j};
+        }
+        std::sort(order.begin(), order.end());
+        ids.resize(n);
+        dis.resize(n);
+        for (size_t j = 0; j < n; j++) {
+            ids[j] = order[j].first;
+        }
+        dc.distances_batch(ids, dis);
+        for (size_t j = 0; j < n; j++) {
+            distances[order[j].second] = dis[j];
+        }
+    }
+};
+
+/* With an 8-bit PQ refine index, the distance computer builds a table of
+ * 256 * d flops per query, a decoded candidate costs about 2 * d flops: for
+ * few candidates, decode them with the specialized SaDecodeKernel and
+ * compare them to the query. The distances are the same up to rounding. */
+const idx_t refine_decode_max_candidates = 128;
+
+struct RefineDecodeBatch {
+    const IndexFlatCodes& index;
+    const SaDecodeKernel& kernel;
+    std::vector<uint8_t> codes;
+    std::vector<float> recons;
+
+    RefineDecodeBatch(const IndexFlatCodes& index, const SaDecodeKernel& kernel)
+            : index(index), kernel(kernel) {}
+
+    void compute(
+            const float* x,
+            const idx_t* labels,
+            size_t n,
+            float* distances) {
+        size_t code_size = index.code_size;
+        size_t d = index.d;
+        codes.resize(n * code_size);
+        for (size_t j = 0; j < n; j++) {
+            memcpy(codes.data() + j * code_size,
+                   index.codes.data() + labels[j] * code_size,
+                   code_size);
+        }
+        recons.resize(n * d);
+        kernel.decode(n, codes.data(), code_size, recons.data());
+        if (index.metric_type == METRIC_L2) {
+            fvec_L2sqr_ny(distances, x, recons.data(), d, n);
+        } else {
+            fvec_inner_products_ny(distances, x, recons.data(), d, n);
+        }
+    }
+};
+
+/* When the vectors of an IndexFlat are not owned (eg. mmapped from the
+ * index file), ask the kernel to start reading the pages of all
+ * candidates before the distances are computed, rather than taking one
+ * synchronous page fault per candidate. */
+void prefetch_unowned_vectors(
+        const IndexFlat& index,
+        size_t n,
+        const idx_t* labels) {
+#ifndef _WIN32
+    if (index.codes.is_owned || n == 0) {
+        return;
+    }
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const uintptr_t base = (uintptr_t)index.codes.data();
+    const size_t code_size = index.code_size;
+    std::vector<uintptr_t> pages;
+    pages.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (labels[i] < 0) {
+            continue;
+        }
+        uintptr_t begin = base + labels[i] * code_size;
+        uintptr_t end = begin + code_size;
+        for (uintptr_t p = begin / page_size; p * page_size < end; p++) {
+            pages.push_back(p);
+        }
+    }
+    std::sort(pages.begin(), pages.end());
+    // one call per run of consecutive pages
+    for (size_t i = 0; i < pages.size();) {
+        size_t j = i + 1;
+        while (j < pages.size() && pages[j] <= pages[j - 1] + 1) {
+            j++;
+        }
+        madvise((void*)(pages[i] * page_size),
+                (pages[j - 1] - pages[i] + 1) * page_size,
+                MADV_WILLNEED);
+        i = j;
+    }
+#endif
+}
+
 } // anonymous namespace
 
 void IndexRefine::search(
@@ -132,22 +255,73 @@ void IndexRefine::search(
     for (int i = 0; i < n * k_base; i++)
         assert(base_labels[i] >= -1 && base_labels[i] < ntotal);
 
+    SaDecodeKernel kernel(refine_index);
+    const IndexFlatCodes* refine_codes =
+            dynamic_cast<const IndexFlatCodes*>(refine_index);
+    bool decode_candidates = kernel.is_available() && refine_codes &&
+            k_base <= refine_decode_max_candidates &&
+            (metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT);
+    // the refinement continues the budget of the base search: the
+    // candidates that do not fit keep their base distances
+    const SearchBudget* budget = params ? params->budget : nullptr;
+    // bytes read per refined candidate, the refine index may not have a
+    // standalone codec (eg. IndexFlatOnDisk)
+    size_t refine_code_size =
+            refine_codes ? refine_codes->code_size : sizeof(float) * d;
+
         // parallelize over queries
 #pragma omp parallel if (n > 1)
     {
         std::unique_ptr<DistanceComputer> dc(
-                refine_index->get_distance_computer());
+                decode_candidates ? nullptr
+                                  : refine_index->get_distance_computer());
+        RefineBatch batch;
+        std::unique_ptr<RefineDecodeBatch> decode_batch(
+                decode_candidates
+                        ? new RefineDecodeBatch(*refine_codes, kernel)
+                        : nullptr);
 #pragma omp for
         for (idx_t i = 0; i < n; i++) {
-            dc->set_query(x + i * d);
-            idx_t ij = i * k_base;
-            for (idx_t j = 0; j < k_base; j++) {
-                idx_t idx = base_labels[ij];
-                if (idx < 0)
-                    break;
-                base_distances[ij] = (*dc)(idx);
-                ij++;
+            idx_t nvalid = 0;
+            while (nvalid < k_base && base_labels[i * k_base + nvalid] >= 0) {
+                nvalid++;
+            }
+            if (budget) {
+                SearchBudget qb = budget->query_budget(i);
+                SearchCost cost;
+                idx_t nrefine = 0;
+                if (!qb.exhausted(cost)) {
+                    size_t max_refine = std::min(
+                            SearchBudget::remaining(
+                                    qb.max_ndis, qb.spent.ndis),
+                            SearchBudget::remaining(
+                                    qb.max_bytes, qb.spent.bytes) /
+                                    std::max(refine_code_size, size_t(1)));
+                    nrefine = std::min((size_t)nvalid, max_refine);
+                }
+                cost.ndis = nrefine;
+                cost.bytes = nrefine * refine_code_size;
+                cost.truncated = nrefine < nvalid;
+                budget->add_cost(i, cost);
+                nvalid = nrefine;
+                if (nvalid == 0) {
+                    continue;
+                }
             }
+            if (decode_batch) {
+                decode_batch->compute(
+                        x + i * d,
+                        base_labels + i * k_base,
+                        nvalid,
+                        base_distances + i * k_base);
+                continue;
+            }
+            dc->set_query(x + i * d);
+            batch.compute(
+                    *dc,
+                    base_labels + i * k_base,
+                    nvalid,
+                    base_distances + i * k_base);
         }
     }
 
@@ -188,6 +362,7 @@ void IndexRefine::range_search(
     {
         std::unique_ptr<DistanceComputer> dc(
                 refine_index->get_distance_computer());
+        RefineBatch batch;
 
 #pragma omp for
         for (idx_t i = 0; i < n; i++) {
@@ -197,10 +372,11 @@ void IndexRefine::range_search(
             const size_t idx_start = result->lims[i];
             const size_t idx_end = result->lims[i + 1];
 
-            for (size_t j = idx_start; j < idx_end; j++) {
-                const auto label = result->labels[j];
-                result->distances[j] = (*dc)(label);
-            }
+            batch.compute(
+                    *dc,
+                    result->labels + idx_start,
+                    idx_end - idx_start,
+                    result->distances + idx_start);
         }
     }
 }
@@ -319,6 +495,7 @@ void IndexRefineFlat::search(
     auto rf = dynamic_cast<const IndexFlat*>(refine_index);
     FAISS_THROW_IF_NOT(rf);
 
+    prefetch_unowned_vectors(*rf, n * k_base, base_labels);
     rf->compute_distance_subset(n, x, k_base, base_distances, base_labels);
 
     // sort and store result
@@ -11,6 +11,9 @@
 
 namespace faiss {
 
+/** The budget of these parameters limits the refinement, the one of
+ * base_index_params the base search. Set both to the same budget, with
+ * costs, to limit the total work per query. */
 struct IndexRefineSearchParameters : SearchParameters {
     float k_factor = 1;
     SearchParameters* base_index_params = nullptr; // non-owning
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
 #include <cinttypes>
 
 #include <faiss/IndexReplicas.h>
@@ -139,6 +140,28 @@ void IndexReplicasTemplate<IndexT>::search(
     auto dim = this->d;
     size_t componentsPerVec = sizeof(component_t) == 1 ? (dim + 7) / 8 : dim;
 
+    if (search_block_size > 0) {
+        idx_t bs = search_block_size;
+        std::atomic<idx_t> next_block(0);
+        auto fn = [&](int i, const IndexT* index) {
+            for (;;) {
+                idx_t i0 = next_block++ * bs;
+                if (i0 >= n) {
+                    break;
+                }
+                idx_t i1 = std::min(i0 + bs, n);
+                index->search(
+                        i1 - i0,
+                        x + i0 * componentsPerVec,
+                        k,
+                        distances + i0 * k,
+                        labels + i0 * k);
+            }
+        };
+        this->runOnIndex(fn);
+        return;
+    }
+
     // Partition the query by the number of indices we have
     faiss::idx_t queriesPerIndex =
             (faiss::idx_t)(n + this->count() - 1) / (faiss::idx_t)this->count();
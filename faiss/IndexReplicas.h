@@ -67,6 +67,12 @@ class IndexReplicasTemplate : public ThreadedIndex<IndexT> {
             idx_t* labels,
             const SearchParameters* params = nullptr) const override;
 
+    /** if > 0, the queries are split in blocks of this size that the
+     * replicas take from a shared counter when they are ready, instead of
+     * one fixed slice per replica. This balances the load when the
+     * replicas have different speeds. */
+    idx_t search_block_size = 0;
+
     /// reconstructs from the first index
     void reconstruct(idx_t, component_t* v) const override;
 
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexResultCache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_memory_usage.h>
+
+namespace faiss {
+
+IndexResultCache::IndexResultCache(Index* index, float threshold)
+        : Index(index->d, index->metric_type),
+          index(index),
+          threshold(threshold) {
+    metric_arg = index->metric_arg;
+    ntotal = index->ntotal;
+    is_trained = index->is_trained;
+}
+
+IndexResultCache::IndexResultCache() = default;
+
+void IndexResultCache::train(idx_t n, const float* x) {
+    index->train(n, x);
+    is_trained = index->is_trained;
+}
+
+void IndexResultCache::add(idx_t n, const float* x) {
+    index->add(n, x);
+    ntotal = index->ntotal;
+    clear_cache();
+}
+
+void IndexResultCache::add_with_ids(
+        idx_t n,
+        const float* x,
+        const idx_t* xids) {
+    index->add_with_ids(n, x, xids);
+    ntotal = index->ntotal;
+    clear_cache();
+}
+
+void IndexResultCache::reset() {
+    index->reset();
+    ntotal = 0;
+    clear_cache();
+}
+
+void IndexResultCache::reconstruct(idx_t key, float* recons) const {
+    index->reconstruct(key, recons);
+}
+
+void IndexResultCache::new_generation() const {
+    generations[1] = std::move(generations[0]);
+    Generation& gen = generations[0];
+    gen.queries.reset(index_factory(d, cache_index_type.c_str(), metric_type));
+    FAISS_THROW_IF_NOT_MSG(
+            gen.queries->is_trained, "the cache index must not need training");
+    gen.distances.clear();
+    gen.labels.clear();
+}
+
+void IndexResultCache::insert(
+        idx_t n,
+        const float* x,
+        const float* D,
+        const idx_t* I) const {
+    size_t gen_capacity = std::max(capacity / 2, size_t(1));
+    idx_t i0 = 0;
+    while (i0 < n) {
+        if (!generations[0].queries ||
+            generations[0].queries->ntotal >= gen_capacity) {
+            new_generation();
+        }
+        Generation& gen = generations[0];
+        idx_t room = gen_capacity - gen.queries->ntotal;
+        idx_t i1 = std::min(n, i0 + room);
+        gen.queries->add(i1 - i0, x + i0 * d);
+        gen.distances.insert(
+                gen.distances.end(), D + i0 * cache_k, D + i1 * cache_k);
+        gen.labels.insert(
+                gen.labels.end(), I + i0 * cache_k, I + i1 * cache_k);
+        i0 = i1;
+    }
+}
+
+void IndexResultCache::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT_MSG(k <= cache_k, "k should be at most cache_k");
+    FAISS_THROW_IF_NOT(is_trained);
+    if (n == 0) {
+        return;
+    }
+    bool is_sim = is_similarity_metric(metric_type);
+    auto is_hit = [&](float dis) {
+        return is_sim ? dis >= threshold : dis <= threshold;
+    };
+
+    // nearest cached query of each query, and its candidates if it is a hit
+    std::vector<idx_t> hits, misses;
+    std::vector<float> cand_dis;
+    std::vector<idx_t> cand_labels;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<float> best_dis(n);
+        std::vector<const Generation*> best_gen(n, nullptr);
+        std::vector<idx_t> best_slot(n);
+        std::vector<float> D1(n);
+        std::vector<idx_t> I1(n);
+        for (const Generation& gen : generations) {
+            if (!gen.queries || gen.queries->ntotal == 0) {
+                continue;
+            }
+            gen.queries->search(n, x, 1, D1.data(), I1.data());
+            for (idx_t i = 0; i < n; i++) {
+                if (I1[i] < 0 || !is_hit(D1[i])) {
+                    continue;
+                }
+                bool better = is_sim ? D1[i] > best_dis[i]
+                                     : D1[i] < best_dis[i];
+                if (!best_gen[i] || better) {
+                    best_dis[i] = D1[i];
+                    best_gen[i] = &gen;
+                    best_slot[i] = I1[i];
+                }
+            }
+        }
+        for (idx_t i = 0; i < n; i++) {
+            if (!best_gen[i]) {
+                misses.push_back(i);
+                continue;
+            }
+            hits.push_back(i);
+            size_t ofs = best_slot[i] * cache_k;
+            const Generation& gen = *best_gen[i];
+            cand_dis.insert(
+                    cand_dis.end(),
+                    gen.distances.begin() + ofs,
+                    gen.distances.begin() + ofs + cache_k);
+            cand_labels.insert(
+                    cand_labels.end(),
+                    gen.labels.begin() + ofs,
+                    gen.labels.begin() + ofs + cache_k);
+        }
+    }
+    n_queries += n;
+    n_hits += hits.size();
+
+    if (!misses.empty()) {
+        size_t nm = misses.size();
+        std::vector<float> xm(nm * d);
+        for (size_t j = 0; j < nm; j++) {
+            memcpy(xm.data() + j * d, x + misses[j] * d, sizeof(float) * d);
+        }
+        std::vector<float> Dm(nm * cache_k);
+        std::vector<idx_t> Im(nm * cache_k);
+        index->search(nm, xm.data(), cache_k, Dm.data(), Im.data(), params);
+        for (size_t j = 0; j < nm; j++) {
+            memcpy(distances + misses[j] * k,
+                   Dm.data() + j * cache_k,
+                   sizeof(float) * k);
+            memcpy(labels + misses[j] * k,
+                   Im.data() + j * cache_k,
+                   sizeof(idx_t) * k);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        insert(nm, xm.data(), Dm.data(), Im.data());
+    }
+
+    if (hits.empty()) {
+        return;
+    }
+
+    if (rerank_index) {
+        // throws here rather than in the parallel section
+        std::unique_ptr<DistanceComputer> dc(
+                rerank_index->get_distance_computer());
+    }
+    float worst = is_sim ? -std::numeric_limits<float>::infinity()
+                         : std::numeric_limits<float>::infinity();
+#pragma omp parallel if (hits.size() > 10)
+    {
+        std::unique_ptr<DistanceComputer> dc;
+        if (rerank_index) {
+            dc.reset(rerank_index->get_distance_computer());
+        }
+        std::vector<std::pair<float, idx_t>> cands;
+#pragma omp for
+        for (idx_t j = 0; j < idx_t(hits.size()); j++) {
+            idx_t i = hits[j];
+            const idx_t* cl = cand_labels.data() + j * cache_k;
+            const float* cd = cand_dis.data() + j * cache_k;
+            float* D = distances + i * k;
+            idx_t* I = labels + i * k;
+            if (!dc) {
+                memcpy(D, cd, sizeof(float) * k);
+                memcpy(I, cl, sizeof(idx_t) * k);
+                continue;
+            }
+            dc->set_query(x + i * d);
+            cands.clear();
+            for (idx_t l = 0; l < cache_k; l++) {
+                if (cl[l] >= 0) {
+                    cands.emplace_back((*dc)(cl[l]), cl[l]);
+                }
+            }
+            size_t nres = std::min(size_t(k), cands.size());
+            auto cmp = [is_sim](const std::pair<float, idx_t>& a,
+                                const std::pair<float, idx_t>& b) {
+                return is_sim ? a > b : a < b;
+            };
+            std::partial_sort(
+                    cands.begin(), cands.begin() + nres, cands.end(), cmp);
+            for (size_t l = 0; l < k; l++) {
+                D[l] = l < nres ? cands[l].first : worst;
+                I[l] = l < nres ? cands[l].second : -1;
+            }
+        }
+    }
+
+    if (verify_fraction <= 0) {
+        return;
+    }
+    // search a sample of the hits in the index to measure the recall
+    std::vector<idx_t> verify;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (idx_t i : hits) {
+            size_t c = verify_counter++;
+            if (std::floor((c + 1) * verify_fraction) >
+                std::floor(c * verify_fraction)) {
+                verify.push_back(i);
+            }
+        }
+    }
+    if (verify.empty()) {
+        return;
+    }
+    size_t nv = verify.size();
+    std::vector<float> xv(nv * d), Dv(nv * k);
+    std::vector<idx_t> Iv(nv * k);
+    for (size_t j = 0; j < nv; j++) {
+        memcpy(xv.data() + j * d, x + verify[j] * d, sizeof(float) * d);
+    }
+    index->search(nv, xv.data(), k, Dv.data(), Iv.data(), params);
+    double sum = 0;
+    for (size_t j = 0; j < nv; j++) {
+        const idx_t* ref = Iv.data() + j * k;
+        const idx_t* res = labels + verify[j] * k;
+        size_t nref = 0, nfound = 0;
+        for (idx_t l = 0; l < k; l++) {
+            if (ref[l] < 0) {
+                continue;
+            }
+            nref++;
+            nfound += std::find(res, res + k, ref[l]) != res + k;
+        }
+        sum += nref ? double(nfound) / nref : 1.0;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    recall_sum += sum;
+    n_verified += nv;
+}
+
+void IndexResultCache::clear_cache() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Generation& gen : generations) {
+        // release the memory, not only the contents
+        gen = Generation();
+    }
+}
+
+size_t IndexResultCache::cache_size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = 0;
+    for (const Generation& gen : generations) {
+        n += gen.queries ? gen.queries->ntotal : 0;
+    }
+    return n;
+}
+
+size_t IndexResultCache::cache_nbytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t nbytes = 0;
+    for (const Generation& gen : generations) {
+        nbytes += gen.distances.capacity() * sizeof(float) +
+                gen.labels.capacity() * sizeof(idx_t);
+        if (gen.queries) {
+            nbytes += get_index_memory_usage(gen.queries.get()).total();
+        }
+    }
+    return nbytes;
+}
+
+double IndexResultCache::hit_rate() const {
+    return n_queries ? double(n_hits) / n_queries : 0.0;
+}
+
+double IndexResultCache::verified_recall() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return n_verified ? recall_sum / n_verified : 0.0;
+}
+
+void IndexResultCache::reset_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    n_queries = 0;
+    n_hits = 0;
+    n_verified = 0;
+    recall_sum = 0;
+    verify_counter = 0;
+}
+
+IndexResultCache::~IndexResultCache() {
+    if (own_fields) {
+        delete index;
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/** Cache of the results of recent queries in front of an index, for
+ * workloads with many near-duplicate queries.
+ *
+ * The query vectors are added to a small cache index (built with
+ * index_factory from cache_index_type, eg. "Flat" or "HNSW32,Flat") along
+ * with their cache_k nearest neighbors in the index. A query whose nearest
+ * cached query is within threshold is a hit: its results are taken from
+ * the cached candidates instead of searching the index. If rerank_index is
+ * set, the candidates are re-ranked against the new query with its
+ * distance computer, otherwise the cached results are returned as is.
+ *
+ * The cache keeps 2 generations of at most capacity / 2 queries: when the
+ * current one is full, the previous one is dropped. Adding to or resetting
+ * the index clears the cache.
+ */
+struct IndexResultCache : Index {
+    Index* index = nullptr;
+    bool own_fields = false;
+
+    /** computes the distances of new queries to the cached candidates, with
+     * the same ids as index (eg. the index itself if it supports
+     * get_distance_computer, or an IndexFlat of the same vectors). Not
+     * owned. */
+    const Index* rerank_index = nullptr;
+
+    /** a query hits a cached query at distance <= threshold (similarity >=
+     * threshold for inner product), in the metric of the index */
+    float threshold = 0;
+
+    /// nb of candidates stored per cached query, the max k of a search
+    idx_t cache_k = 100;
+
+    /// max nb of cached queries
+    size_t capacity = 10000;
+
+    /// index_factory string of the indexes that store the cached queries
+    std::string cache_index_type = "Flat";
+
+    /** fraction of the hits that are also searched in the index to measure
+     * the accuracy of the cached results (see verified_recall) */
+    float verify_fraction = 0;
+
+    /// statistics
+    mutable std::atomic<size_t> n_queries{0};
+    mutable std::atomic<size_t> n_hits{0};
+    mutable std::atomic<size_t> n_verified{0};
+
+    explicit IndexResultCache(Index* index, float threshold = 0);
+
+    IndexResultCache();
+
+    void train(idx_t n, const float* x) override;
+    void add(idx_t n, const float* x) override;
+    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
+    void reset() override;
+
+    /// misses are searched in the index with params
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    void clear_cache();
+
+    /// nb of queries in the cache
+    size_t cache_size() const;
+
+    /// memory used by the cached queries and results, in bytes
+    size_t cache_nbytes() const;
+
+    /// n_hits / n_queries
+    double hit_rate() const;
+
+    /// average fraction of the k results of the index found by the
+    /// verified hits
+    double verified_recall() const;
+
+    void reset_stats();
+
+    ~IndexResultCache() override;
+
+   private:
+    /// a set of cached queries, with cache_k results each
+    struct Generation {
+        std::unique_ptr<Index> queries;
+        std::vector<float> distances;
+        std::vector<idx_t> labels;
+    };
+    mutable std::mutex mutex;
+    mutable Generation generations[2]; ///< [0] = current
+    mutable double recall_sum = 0;
+    mutable size_t verify_counter = 0;
+
+    void new_generation() const;
+    void insert(idx_t n, const float* x, const float* D, const idx_t* I)
+            const;
+};
+
+} // namespace faiss
@@ -10,8 +10,12 @@
 #include <cstdint>
 #include <cstring>
 #include <limits>
+#include <memory>
 
+#include <faiss/IndexFlatCodes.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/sa_decode_kernels.h>
+#include <faiss/utils/distances.h>
 #include <faiss/utils/fp16.h>
 
 namespace faiss {
@@ -160,9 +164,15 @@ void sa_decode_impl(
     // the code size of the index
     const size_t new_code_size = index->sa_code_size();
 
+    // the specialized kernel decodes the sub-codes where they are
+    SaDecodeKernel kernel(sub_index);
+
     // allocate tmp buffers
     std::vector<uint8_t> tmp(
-            (chunk_size < n_input ? chunk_size : n_input) * old_code_size);
+            kernel.is_available()
+                    ? 0
+                    : (chunk_size < n_input ? chunk_size : n_input) *
+                            old_code_size);
     std::vector<StorageMinMaxFP16> minmax(
             (chunk_size < n_input ? chunk_size : n_input));
 
@@ -176,16 +186,25 @@ void sa_decode_impl(
         // current portion to be processed
         const idx_t n = std::min(n_left, chunk_size);
 
-        // rearrange
-        for (idx_t i = 0; i < n; i++) {
-            std::memcpy(
-                    tmp.data() + i * old_code_size,
-                    bytes + i * new_code_size + (new_code_size - old_code_size),
-                    old_code_size);
-        }
+        if (kernel.is_available()) {
+            kernel.decode(
+                    n,
+                    bytes + (new_code_size - old_code_size),
+                    new_code_size,
+                    x);
+        } else {
+            // rearrange
+            for (idx_t i = 0; i < n; i++) {
+                std::memcpy(
+                        tmp.data() + i * old_code_size,
+                        bytes + i * new_code_size +
+                                (new_code_size - old_code_size),
+                        old_code_size);
+            }
 
-        // decode
-        sub_index->sa_decode(n, tmp.data(), x);
+            // decode
+            sub_index->sa_decode(n, tmp.data(), x);
+        }
 
         // scale back
         for (idx_t i = 0; i < n; i++) {
@@ -329,6 +348,99 @@ void train_impl(IndexRowwiseMinMaxBase* const index, idx_t n, const float* x) {
     sub_index->train(n, tmp.data());
 }
 
+/* The decoded vector is x = scaler * y + minv * 1, where y is decoded
+ * by the sub-index. With IP:
+ *
+ *    <q, x> = scaler * <q, y> + minv * sum(q)
+ *
+ * With L2:
+ *
+ *    ||q - x||^2 = ||q||^2 + scaler^2 ||y||^2 + d minv^2
+ *                  - 2 scaler <q, y> - 2 minv sum(q) + 2 scaler minv sum(y)
+ *
+ * where ||y||^2, <q, y> and sum(y) are derived from the L2 distances of y
+ * to 0, q and 1. */
+template <typename StorageMinMaxT>
+struct RowwiseMinMaxDistanceComputer : FlatCodesDistanceComputer {
+    const IndexRowwiseMinMaxBase& index;
+    const size_t d;
+    const bool is_ip;
+
+    // sub-index distances to the query, to 0 and to 1 (L2 only)
+    std::unique_ptr<FlatCodesDistanceComputer> dc_q, dc_0, dc_1;
+    std::vector<float> zeros, ones;
+
+    float q_norm2 = 0;
+    float q_sum = 0;
+
+    // for symmetric_dis
+    std::vector<float> tmp;
+
+    RowwiseMinMaxDistanceComputer(
+            const IndexRowwiseMinMaxBase& index,
+            const uint8_t* codes)
+            : FlatCodesDistanceComputer(codes, index.sa_code_size()),
+              index(index),
+              d(index.d),
+              is_ip(index.metric_type == METRIC_INNER_PRODUCT) {
+        auto sub_index = dynamic_cast<const IndexFlatCodes*>(index.index);
+        FAISS_THROW_IF_NOT_MSG(
+                sub_index, "the sub-index must be an IndexFlatCodes");
+        FAISS_THROW_IF_NOT(
+                index.metric_type == METRIC_L2 ||
+                index.metric_type == METRIC_INNER_PRODUCT);
+        FAISS_THROW_IF_NOT(sub_index->metric_type == index.metric_type);
+        dc_q.reset(sub_index->get_FlatCodesDistanceComputer());
+        if (!is_ip) {
+            zeros.resize(d, 0);
+            ones.resize(d, 1);
+            dc_0.reset(sub_index->get_FlatCodesDistanceComputer());
+            dc_0->set_query(zeros.data());
+            dc_1.reset(sub_index->get_FlatCodesDistanceComputer());
+            dc_1->set_query(ones.data());
+        }
+    }
+
+    void set_query(const float* x) override {
+        dc_q->set_query(x);
+        q_norm2 = fvec_norm_L2sqr(x, d);
+        q_sum = 0;
+        for (size_t j = 0; j < d; j++) {
+            q_sum += x[j];
+        }
+    }
+
+    float distance_to_code(const uint8_t* code) override {
+        StorageMinMaxT fpv;
+        std::memcpy(&fpv, code, sizeof(fpv));
+        float scaler = 0;
+        float minv = 0;
+        fpv.to_floats(scaler, minv);
+        const uint8_t* sub_code = code + sizeof(StorageMinMaxT);
+
+        float dq = dc_q->distance_to_code(sub_code);
+        if (is_ip) {
+            return scaler * dq + minv * q_sum;
+        }
+        float y_norm2 = dc_0->distance_to_code(sub_code);
+        float y_sum = (d + y_norm2 - dc_1->distance_to_code(sub_code)) / 2;
+        float qy = (q_norm2 + y_norm2 - dq) / 2;
+        return q_norm2 + scaler * scaler * y_norm2 + d * minv * minv -
+                2 * scaler * qy - 2 * minv * q_sum +
+                2 * scaler * minv * y_sum;
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        tmp.resize(2 * d);
+        index.sa_decode(1, codes + i * code_size, tmp.data());
+        index.sa_decode(1, codes + j * code_size, tmp.data() + d);
+        if (is_ip) {
+            return fvec_inner_product(tmp.data(), tmp.data() + d, d);
+        }
+        return fvec_L2sqr(tmp.data(), tmp.data() + d, d);
+    }
+};
+
 } // namespace
 
 // block size for performing sa_encode and sa_decode
@@ -399,6 +511,11 @@ void IndexRowwiseMinMaxFP16::sa_decode(
     sa_decode_impl<StorageMinMaxFP16>(this, n_input, bytes_input, x_output);
 }
 
+FlatCodesDistanceComputer* IndexRowwiseMinMaxFP16::
+        get_FlatCodesDistanceComputer(const uint8_t* codes) const {
+    return new RowwiseMinMaxDistanceComputer<StorageMinMaxFP16>(*this, codes);
+}
+
 void IndexRowwiseMinMaxFP16::train(idx_t n, const float* x) {
     train_impl<StorageMinMaxFP16>(this, n, x);
 }
@@ -434,6 +551,11 @@ void IndexRowwiseMinMax::sa_decode(
     sa_decode_impl<StorageMinMaxFP32>(this, n_input, bytes_input, x_output);
 }
 
+FlatCodesDistanceComputer* IndexRowwiseMinMax::get_FlatCodesDistanceComputer(
+        const uint8_t* codes) const {
+    return new RowwiseMinMaxDistanceComputer<StorageMinMaxFP32>(*this, codes);
+}
+
 void IndexRowwiseMinMax::train(idx_t n, const float* x) {
     train_impl<StorageMinMaxFP32>(this, n, x);
 }
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include <faiss/Index.h>
+#include <faiss/impl/DistanceComputer.h>
 #include <faiss/impl/platform_macros.h>
 
 namespace faiss {
@@ -62,6 +63,16 @@ struct IndexRowwiseMinMaxBase : Index {
     void reset() override;
 
     virtual void train_inplace(idx_t n, float* x) = 0;
+
+    /** distance computer on codes produced by sa_encode, the code of
+     * vector i being at codes + i * sa_code_size(). The codes are not
+     * decoded: the scaler and minv are applied analytically to the
+     * distances computed by the sub-index, that must be an IndexFlatCodes
+     * (eg. SQ or PQ). With METRIC_L2, 3 sub-distances are computed per
+     * code (to the query, to the all-0 and to the all-1 vectors).
+     */
+    virtual FlatCodesDistanceComputer* get_FlatCodesDistanceComputer(
+            const uint8_t* codes) const = 0;
 };
 
 /// Stores scaling coefficients as fp16 values.
@@ -76,6 +87,9 @@ struct IndexRowwiseMinMaxFP16 : IndexRowwiseMinMaxBase {
     size_t sa_code_size() const override;
     void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
     void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+
+    FlatCodesDistanceComputer* get_FlatCodesDistanceComputer(
+            const uint8_t* codes) const override;
 };
 
 /// Stores scaling coefficients as fp32 values.
@@ -90,6 +104,9 @@ struct IndexRowwiseMinMax : IndexRowwiseMinMaxBase {
     size_t sa_code_size() const override;
     void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
     void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+
+    FlatCodesDistanceComputer* get_FlatCodesDistanceComputer(
+            const uint8_t* codes) const override;
 };
 
 /// block size for performing sa_encode and sa_decode
@@ -17,6 +17,8 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
 #include <faiss/impl/ScalarQuantizer.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/metrics.h>
 #include <faiss/utils/utils.h>
 
 namespace faiss {
@@ -45,6 +47,20 @@ void IndexScalarQuantizer::train(idx_t n, const float* x) {
     is_trained = true;
 }
 
+void IndexScalarQuantizer::add_ex(
+        idx_t n,
+        const void* x,
+        NumericType numeric_type) {
+    if ((numeric_type == Float16 && sq.qtype == ScalarQuantizer::QT_fp16) ||
+        (numeric_type == BFloat16 && sq.qtype == ScalarQuantizer::QT_bf16)) {
+        // the codes are the input vectors
+        FAISS_THROW_IF_NOT(is_trained);
+        add_sa_codes(n, (const uint8_t*)x, nullptr);
+    } else {
+        IndexFlatCodes::add_ex(n, x, numeric_type);
+    }
+}
+
 void IndexScalarQuantizer::search(
         idx_t n,
         const float* x,
@@ -58,6 +74,8 @@ void IndexScalarQuantizer::search(
     FAISS_THROW_IF_NOT(is_trained);
     FAISS_THROW_IF_NOT(
             metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT);
+    MetricsCallTimer timer(METRIC_SEARCH_QUERIES, METRIC_SEARCH_LATENCY, n);
+    metrics_add(METRIC_NDIS, n * ntotal);
 
 #pragma omp parallel
     {
@@ -279,4 +297,24 @@ void IndexIVFScalarQuantizer::reconstruct_from_offset(
     }
 }
 
+void IndexIVFScalarQuantizer::reconstruct_from_offsets(
+        int64_t list_no,
+        size_t n,
+        const idx_t* offsets,
+        float* recons) const {
+    std::unique_ptr<ScalarQuantizer::SQuantizer> squant(sq.select_quantizer());
+    InvertedLists::ScopedCodes codes(invlists, list_no);
+    for (size_t i = 0; i < n; i++) {
+        squant->decode_vector(
+                codes.get() + offsets[i] * code_size, recons + i * d);
+    }
+    if (by_residual) {
+        std::vector<float> centroid(d);
+        quantizer->reconstruct(list_no, centroid.data());
+        for (size_t i = 0; i < n; i++) {
+            fvec_add(d, recons + i * d, centroid.data(), recons + i * d);
+        }
+    }
+}
+
 } // namespace faiss
@@ -41,6 +41,9 @@ struct IndexScalarQuantizer : IndexFlatCodes {
 
     void train(idx_t n, const float* x) override;
 
+    /// fp16 vectors are copied as is for QT_fp16, bf16 ones for QT_bf16
+    void add_ex(idx_t n, const void* x, NumericType numeric_type) override;
+
     void search(
             idx_t n,
             const float* x,
@@ -102,6 +105,12 @@ struct IndexIVFScalarQuantizer : IndexIVF {
     void reconstruct_from_offset(int64_t list_no, int64_t offset, float* recons)
             const override;
 
+    void reconstruct_from_offsets(
+            int64_t list_no,
+            size_t n,
+            const idx_t* offsets,
+            float* recons) const override;
+
     /* standalone codec interface */
     void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
 };
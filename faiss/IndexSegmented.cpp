@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexSegmented.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/Heap.h>
+
+namespace faiss {
+
+namespace {
+
+/// call f on all the ids stored in a segment
+template <class F>
+void for_each_id(const Index* index, F f) {
+    if (auto idmap = dynamic_cast<const IndexIDMap*>(index)) {
+        for (idx_t i = 0; i < idmap->ntotal; i++) {
+            f(idmap->id_map[i]);
+        }
+    } else if (const IndexIVF* ivf = ivflib::try_extract_index_ivf(index)) {
+        for (size_t list_no = 0; list_no < ivf->nlist; list_no++) {
+            size_t list_size = ivf->invlists->list_size(list_no);
+            InvertedLists::ScopedIds ids(ivf->invlists, list_no);
+            for (size_t j = 0; j < list_size; j++) {
+                f(ids[j]);
+            }
+        }
+    } else {
+        FAISS_THROW_MSG("cannot enumerate the ids of this segment");
+    }
+}
+
+} // namespace
+
+IndexSegmented::IndexSegmented(
+        Index* sealed_template,
+        size_t mutable_capacity,
+        bool background)
+        : Index(sealed_template->d, sealed_template->metric_type),
+          sealed_template(sealed_template),
+          mutable_capacity(mutable_capacity),
+          background(background) {
+    FAISS_THROW_IF_NOT(mutable_capacity > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            sealed_template->ntotal == 0, "the template should be empty");
+    metric_arg = sealed_template->metric_arg;
+    is_trained = true;
+    mutable_segment = new_mutable_segment();
+    if (background) {
+        worker = std::thread(&IndexSegmented::background_loop, this);
+    }
+}
+
+std::shared_ptr<IndexIDMap> IndexSegmented::new_mutable_segment() const {
+    auto idmap = std::make_shared<IndexIDMap>(new IndexFlat(d, metric_type));
+    idmap->own_fields = true;
+    return idmap;
+}
+
+Index* IndexSegmented::new_sealed_segment() const {
+    Index* index = clone_index(sealed_template);
+    if (ivflib::try_extract_index_ivf(index)) {
+        // stores the ids itself
+        return index;
+    }
+    IndexIDMap* idmap = new IndexIDMap(index);
+    idmap->own_fields = true;
+    return idmap;
+}
+
+void IndexSegmented::train(idx_t n, const float* x) {
+    std::lock_guard<std::mutex> lock(template_mutex);
+    if (!sealed_template->is_trained) {
+        sealed_template->train(n, x);
+    }
+}
+
+void IndexSegmented::add(idx_t n, const float* x) {
+    add_core(n, x, nullptr);
+}
+
+void IndexSegmented::add_with_ids(idx_t n, const float* x, const idx_t* xids) {
+    FAISS_THROW_IF_NOT(xids);
+    add_core(n, x, xids);
+}
+
+void IndexSegmented::add_core(idx_t n, const float* x, const idx_t* xids) {
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        FAISS_THROW_IF_NOT_FMT(
+                work_error.empty(),
+                "background work failed: %s",
+                work_error.c_str());
+    }
+    bool need_work = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(segments_mutex);
+        std::vector<idx_t> ids;
+        if (!xids) {
+            ids.resize(n);
+            for (idx_t i = 0; i < n; i++) {
+                ids[i] = next_id + i;
+            }
+            next_id += n;
+            xids = ids.data();
+        }
+        idx_t i0 = 0;
+        while (i0 < n) {
+            idx_t room = mutable_capacity - mutable_segment->ntotal;
+            idx_t i1 = std::min(n, i0 + room);
+            mutable_segment->add_with_ids(i1 - i0, x + i0 * d, xids + i0);
+            if (mutable_segment->ntotal == mutable_capacity) {
+                frozen.push_back(Segment{mutable_segment, 0});
+                mutable_segment = new_mutable_segment();
+                need_work = true;
+            }
+            i0 = i1;
+        }
+        ntotal += n;
+    }
+    if (need_work) {
+        notify_work();
+    }
+}
+
+void IndexSegmented::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    std::shared_lock<std::shared_mutex> lock(segments_mutex);
+
+    std::vector<Segment> segments;
+    segments.push_back(Segment{mutable_segment, 0});
+    segments.insert(segments.end(), frozen.begin(), frozen.end());
+    segments.insert(segments.end(), sealed.begin(), sealed.end());
+    size_t nseg = segments.size();
+
+    std::vector<float> all_distances(nseg * n * k);
+    std::vector<idx_t> all_labels(nseg * n * k);
+    float neutral = is_similarity_metric(metric_type) ? -HUGE_VALF : HUGE_VALF;
+
+    for (size_t s = 0; s < nseg; s++) {
+        const Segment& seg = segments[s];
+        float* D = all_distances.data() + s * n * k;
+        idx_t* I = all_labels.data() + s * n * k;
+        if (seg.ndeleted == 0) {
+            seg.index->search(n, x, k, D, I, params);
+            continue;
+        }
+        // ask for enough results to fill k after the tombstones are removed
+        idx_t k2 = k + seg.ndeleted;
+        std::vector<float> D2(n * k2);
+        std::vector<idx_t> I2(n * k2);
+        seg.index->search(n, x, k2, D2.data(), I2.data(), params);
+        for (idx_t i = 0; i < n; i++) {
+            idx_t j = 0;
+            for (idx_t j2 = 0; j2 < k2 && j < k; j2++) {
+                idx_t id = I2[i * k2 + j2];
+                if (id < 0 || tombstones.count(id)) {
+                    continue;
+                }
+                D[i * k + j] = D2[i * k2 + j2];
+                I[i * k + j] = id;
+                j++;
+            }
+            for (; j < k; j++) {
+                D[i * k + j] = neutral;
+                I[i * k + j] = -1;
+            }
+        }
+    }
+
+    if (metric_type == METRIC_L2) {
+        merge_knn_results<idx_t, CMin<float, int>>(
+                n,
+                k,
+                nseg,
+                all_distances.data(),
+                all_labels.data(),
+                distances,
+                labels);
+    } else {
+        merge_knn_results<idx_t, CMax<float, int>>(
+                n,
+                k,
+                nseg,
+                all_distances.data(),
+                all_labels.data(),
+                distances,
+                labels);
+    }
+}
+
+size_t IndexSegmented::remove_ids(const IDSelector& sel) {
+    std::unique_lock<std::shared_mutex> lock(segments_mutex);
+    size_t nremove = mutable_segment->remove_ids(sel);
+    auto tombstone = [&](Segment& seg) {
+        for_each_id(seg.index.get(), [&](idx_t id) {
+            if (sel.is_member(id) && tombstones.insert(id).second) {
+                seg.ndeleted++;
+                nremove++;
+            }
+        });
+    };
+    for (Segment& seg : frozen) {
+        tombstone(seg);
+    }
+    for (Segment& seg : sealed) {
+        tombstone(seg);
+    }
+    ntotal -= nremove;
+    return nremove;
+}
+
+void IndexSegmented::reset() {
+    wait_background();
+    std::unique_lock<std::shared_mutex> lock(segments_mutex);
+    mutable_segment = new_mutable_segment();
+    frozen.clear();
+    sealed.clear();
+    tombstones.clear();
+    ntotal = 0;
+}
+
+void IndexSegmented::flush() {
+    bool need_work = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(segments_mutex);
+        if (mutable_segment->ntotal > 0) {
+            frozen.push_back(Segment{mutable_segment, 0});
+            mutable_segment = new_mutable_segment();
+            need_work = true;
+        }
+    }
+    if (need_work) {
+        notify_work();
+    }
+    wait_background();
+}
+
+size_t IndexSegmented::nb_sealed_segments() const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex);
+    return sealed.size();
+}
+
+size_t IndexSegmented::nb_frozen_segments() const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex);
+    return frozen.size();
+}
+
+size_t IndexSegmented::nb_tombstones() const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex);
+    return tombstones.size();
+}
+
+/***************************************************************
+ * Background work
+ ***************************************************************/
+
+void IndexSegmented::notify_work() {
+    if (!background) {
+        do_work();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        work_pending = true;
+    }
+    work_cv.notify_all();
+}
+
+void IndexSegmented::wait_background() const {
+    std::unique_lock<std::mutex> lock(work_mutex);
+    work_cv.wait(lock, [&] { return !work_pending && !work_running; });
+    FAISS_THROW_IF_NOT_FMT(
+            work_error.empty(),
+            "background work failed: %s",
+            work_error.c_str());
+}
+
+void IndexSegmented::background_loop() {
+    std::unique_lock<std::mutex> lock(work_mutex);
+    for (;;) {
+        work_cv.wait(lock, [&] { return stop || work_pending; });
+        if (!work_pending) {
+            break;
+        }
+        work_pending = false;
+        work_running = true;
+        lock.unlock();
+        std::string error;
+        try {
+            do_work();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        lock.lock();
+        if (!error.empty()) {
+            work_error = error;
+        }
+        work_running = false;
+        work_cv.notify_all();
+    }
+}
+
+void IndexSegmented::do_work() {
+    std::lock_guard<std::mutex> lock(do_work_mutex);
+    seal_frozen_segments();
+    compact_sealed_segments();
+}
+
+void IndexSegmented::seal_frozen_segments() {
+    for (;;) {
+        std::shared_ptr<Index> to_seal;
+        {
+            std::shared_lock<std::shared_mutex> lock(segments_mutex);
+            if (frozen.empty()) {
+                return;
+            }
+            to_seal = frozen.front().index;
+        }
+
+        // the frozen segment is not modified anymore, it can be read
+        // without lock
+        auto idmap = static_cast<const IndexIDMap*>(to_seal.get());
+        auto flat = dynamic_cast<const IndexFlat*>(idmap->index);
+        {
+            std::lock_guard<std::mutex> lock(template_mutex);
+            if (!sealed_template->is_trained) {
+                sealed_template->train(idmap->ntotal, flat->get_xb());
+            }
+        }
+        std::shared_ptr<Index> index(new_sealed_segment());
+        index->add_with_ids(
+                idmap->ntotal, flat->get_xb(), idmap->id_map.data());
+
+        std::unique_lock<std::shared_mutex> lock(segments_mutex);
+        // the tombstones of the frozen segment carry over
+        sealed.push_back(Segment{index, frozen.front().ndeleted});
+        frozen.erase(frozen.begin());
+    }
+}
+
+void IndexSegmented::compact_sealed_segments() {
+    while (compaction_supported) {
+        std::vector<std::shared_ptr<Index>> to_merge;
+        {
+            std::shared_lock<std::shared_mutex> lock(segments_mutex);
+            if (sealed.size() <= max_sealed_segments) {
+                return;
+            }
+            // merge the smallest segments
+            std::vector<std::pair<idx_t, size_t>> sizes;
+            for (size_t s = 0; s < sealed.size(); s++) {
+                sizes.emplace_back(sealed[s].index->ntotal, s);
+            }
+            std::sort(sizes.begin(), sizes.end());
+            size_t nmerge = sealed.size() - max_sealed_segments + 1;
+            for (size_t i = 0; i < nmerge; i++) {
+                to_merge.push_back(sealed[sizes[i].second].index);
+            }
+        }
+
+        // the sealed segments are not modified, they are copied so that
+        // the searches can use them until the merged one is swapped in
+        try {
+            to_merge[0]->check_compatible_for_merge(*to_merge[1]);
+        } catch (const FaissException&) {
+            compaction_supported = false;
+            return;
+        }
+        std::shared_ptr<Index> merged(clone_index(to_merge[0].get()));
+        for (size_t i = 1; i < to_merge.size(); i++) {
+            std::unique_ptr<Index> other(clone_index(to_merge[i].get()));
+            merged->merge_from(*other, 0);
+        }
+
+        // purge the tombstones of the merged segments
+        std::vector<idx_t> purged;
+        {
+            std::shared_lock<std::shared_mutex> lock(segments_mutex);
+            for_each_id(merged.get(), [&](idx_t id) {
+                if (tombstones.count(id)) {
+                    purged.push_back(id);
+                }
+            });
+        }
+        if (!purged.empty()) {
+            IDSelectorBatch sel(purged.size(), purged.data());
+            merged->remove_ids(sel);
+        }
+
+        std::unique_lock<std::shared_mutex> lock(segments_mutex);
+        size_t ndeleted = 0;
+        for (const std::shared_ptr<Index>& index : to_merge) {
+            auto it = std::find_if(
+                    sealed.begin(), sealed.end(), [&](const Segment& seg) {
+                        return seg.index == index;
+                    });
+            FAISS_ASSERT(it != sealed.end());
+            ndeleted += it->ndeleted;
+            sealed.erase(it);
+        }
+        // tombstones added during the merge are still counted
+        sealed.push_back(Segment{merged, ndeleted - purged.size()});
+        for (idx_t id : purged) {
+            tombstones.erase(id);
+        }
+    }
+}
+
+IndexSegmented::~IndexSegmented() {
+    if (background) {
+        {
+            std::lock_guard<std::mutex> lock(work_mutex);
+            stop = true;
+        }
+        work_cv.notify_all();
+        worker.join();
+    }
+    if (own_fields) {
+        delete sealed_template;
+    }
+}
+
+} // namespace faiss
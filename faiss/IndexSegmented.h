@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/Index.h>
+#include <faiss/IndexIDMap.h>
+
+namespace faiss {
+
+/** Index made of segments, for high ingest rates (LSM-tree style).
+ *
+ * The vectors are added to a small mutable segment (an IndexFlat). When it
+ * reaches mutable_capacity vectors, it is frozen and sealed: its vectors
+ * are added to a clone of sealed_template (eg. built with index_factory).
+ * When there are more than max_sealed_segments sealed segments, the
+ * smallest ones are compacted into one with merge_from, so the template
+ * type must support merge_from (IndexIVF, IndexFlatCodes, ...) for the
+ * compaction to happen. Sealing and compaction run in a background thread
+ * and the frozen segments remain searchable until they are replaced.
+ *
+ * The searches fan out over all the segments and merge the results.
+ * remove_ids deletes from the mutable segment directly and records
+ * tombstones for the other segments: their results are filtered out at
+ * search time and they are purged from the index by the compaction.
+ *
+ * add, remove_ids and search can be called concurrently. The searches are
+ * only blocked while the mutable segment is written to and while a sealed
+ * or compacted segment is swapped in. The ids are assumed to be unique.
+ */
+struct IndexSegmented : Index {
+    /// sealed segments are clones of this index. If it is not trained, it
+    /// is trained on the first segment that is sealed
+    Index* sealed_template;
+    bool own_fields = false; ///< whether sealed_template is deleted
+
+    /// the mutable segment is sealed when it reaches this size
+    size_t mutable_capacity;
+    /// the sealed segments are compacted when there are more than this
+    size_t max_sealed_segments = 4;
+
+    /// seal and compact in a background thread (otherwise in add)
+    const bool background;
+
+    explicit IndexSegmented(
+            Index* sealed_template,
+            size_t mutable_capacity = 1 << 16,
+            bool background = true);
+
+    /// trains sealed_template if needed
+    void train(idx_t n, const float* x) override;
+
+    /// the ids are sequential, starting after the largest id added so far
+    /// by this function
+    void add(idx_t n, const float* x) override;
+
+    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    size_t remove_ids(const IDSelector& sel) override;
+
+    void reset() override;
+
+    /// seal the mutable segment and wait until the background work is done
+    void flush();
+
+    /// wait until the background work is done, rethrows its errors
+    void wait_background() const;
+
+    /// nb of sealed segments and of frozen segments waiting to be sealed
+    size_t nb_sealed_segments() const;
+    size_t nb_frozen_segments() const;
+
+    /// nb of ids removed from the segments that are not purged yet
+    size_t nb_tombstones() const;
+
+    ~IndexSegmented() override;
+
+   private:
+    struct Segment {
+        std::shared_ptr<Index> index;
+        size_t ndeleted = 0; ///< nb of its vectors that are tombstoned
+    };
+
+    /// protects the segments and the tombstones
+    mutable std::shared_mutex segments_mutex;
+    std::shared_ptr<IndexIDMap> mutable_segment;
+    std::vector<Segment> frozen;
+    std::vector<Segment> sealed;
+    std::unordered_set<idx_t> tombstones;
+    idx_t next_id = 0;
+    bool compaction_supported = true;
+
+    /// protects the sealed_template (trained at the first seal)
+    std::mutex template_mutex;
+
+    // background work
+    mutable std::mutex work_mutex;
+    mutable std::condition_variable work_cv;
+    bool work_pending = false;
+    bool work_running = false;
+    bool stop = false;
+    std::string work_error;
+    std::thread worker;
+    /// serializes the calls to do_work
+    std::mutex do_work_mutex;
+
+    std::shared_ptr<IndexIDMap> new_mutable_segment() const;
+    Index* new_sealed_segment() const;
+    void add_core(idx_t n, const float* x, const idx_t* xids);
+    void notify_work();
+    void background_loop();
+    void do_work();
+    void seal_frozen_segments();
+    void compact_sealed_segments();
+};
+
+} // namespace faiss
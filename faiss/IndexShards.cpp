@@ -9,9 +9,13 @@
 
 #include <cinttypes>
 #include <cstdio>
+#include <exception>
 #include <functional>
+#include <mutex>
 
+#include <faiss/IndexIVF.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/Heap.h>
 #include <faiss/utils/WorkerThread.h>
 
@@ -40,6 +44,153 @@ void translate_labels(int64_t n, idx_t* labels, int64_t translation) {
     }
 }
 
+SharedThresholds* new_shared_thresholds(
+        const float* x,
+        idx_t n,
+        const Index* index) {
+    return new SharedThresholds(
+            x, n, index->d, is_similarity_metric(index->metric_type));
+}
+
+SharedThresholds* new_shared_thresholds(
+        const uint8_t*,
+        idx_t,
+        const IndexBinary*) {
+    return nullptr;
+}
+
+// search a shard, with the shared thresholds if it is an IndexIVF
+void search_shard(
+        const Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        SharedThresholds* shared_thresholds) {
+    const IndexIVF* ivf = shared_thresholds
+            ? dynamic_cast<const IndexIVF*>(index)
+            : nullptr;
+    if (!ivf) {
+        index->search(n, x, k, distances, labels);
+        return;
+    }
+    SearchParametersIVF params;
+    params.nprobe = ivf->nprobe;
+    params.max_codes = ivf->max_codes;
+    params.shared_thresholds = shared_thresholds;
+    ivf->search(n, x, k, distances, labels, &params);
+}
+
+void search_shard(
+        const IndexBinary* index,
+        idx_t n,
+        const uint8_t* x,
+        idx_t k,
+        int32_t* distances,
+        idx_t* labels,
+        SharedThresholds*) {
+    index->search(n, x, k, distances, labels);
+}
+
+/** search the queries block by block, and merge the results of each
+ * (shard, block) into the result heaps as soon as they are available */
+template <class C, typename IndexT>
+void search_blocks(
+        const IndexShardsTemplate<IndexT>& shards,
+        bool threaded,
+        idx_t n,
+        const typename IndexT::component_t* x,
+        idx_t k,
+        typename C::T* distances,
+        idx_t* labels,
+        const std::vector<int64_t>& translations,
+        SharedThresholds* shared_thresholds) {
+    using T = typename C::T;
+    idx_t nshard = shards.count();
+    idx_t bs = shards.search_block_size;
+    idx_t nblock = (n + bs - 1) / bs;
+    size_t components_per_vec = sizeof(typename IndexT::component_t) == 1
+            ? (shards.d + 7) / 8
+            : shards.d;
+
+    for (idx_t i = 0; i < n; i++) {
+        heap_heapify<C>(k, distances + i * k, labels + i * k);
+    }
+    std::vector<std::mutex> block_locks(nblock);
+
+    // the buffers of the results of one block are reused by the tasks
+    auto run_task = [&](int no,
+                        const IndexT* index,
+                        idx_t b,
+                        std::vector<T>& D,
+                        std::vector<idx_t>& I) {
+        idx_t i0 = b * bs, i1 = std::min(i0 + bs, n);
+        D.resize((i1 - i0) * k);
+        I.resize((i1 - i0) * k);
+        search_shard(
+                index,
+                i1 - i0,
+                x + i0 * components_per_vec,
+                k,
+                D.data(),
+                I.data(),
+                shared_thresholds);
+        translate_labels((i1 - i0) * k, I.data(), translations[no]);
+
+        std::lock_guard<std::mutex> lock(block_locks[b]);
+        for (idx_t i = i0; i < i1; i++) {
+            T* heap_dis = distances + i * k;
+            idx_t* heap_ids = labels + i * k;
+            const T* Di = D.data() + (i - i0) * k;
+            const idx_t* Ii = I.data() + (i - i0) * k;
+            // the results of the shard are sorted
+            for (idx_t j = 0; j < k && Ii[j] >= 0; j++) {
+                if (!C::cmp(heap_dis[0], Di[j])) {
+                    break;
+                }
+                heap_replace_top<C>(k, heap_dis, heap_ids, Di[j], Ii[j]);
+            }
+        }
+    };
+
+    if (threaded) {
+        // each shard searches the blocks in order in its own thread
+        shards.runOnIndex([&](int no, const IndexT* index) {
+            std::vector<T> D;
+            std::vector<idx_t> I;
+            for (idx_t b = 0; b < nblock; b++) {
+                run_task(no, index, b, D, I);
+            }
+        });
+    } else {
+        std::vector<std::pair<int, std::exception_ptr>> exceptions;
+        std::mutex exceptions_mutex;
+#pragma omp parallel
+        {
+            std::vector<T> D;
+            std::vector<idx_t> I;
+            // block-major order, so that the blocks complete one after the
+            // other
+#pragma omp for schedule(dynamic)
+            for (idx_t t = 0; t < nshard * nblock; t++) {
+                int no = t % nshard;
+                try {
+                    run_task(no, shards.at(no), t / nshard, D, I);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(exceptions_mutex);
+                    exceptions.emplace_back(no, std::current_exception());
+                }
+            }
+        }
+        handleExceptions(exceptions);
+    }
+
+    for (idx_t i = 0; i < n; i++) {
+        heap_reorder<C>(k, distances + i * k, labels + i * k);
+    }
+}
+
 } // anonymous namespace
 
 template <typename IndexT>
@@ -205,9 +356,11 @@ void IndexShardsTemplate<IndexT>::search(
 
     int64_t nshard = this->count();
 
-    std::vector<distance_t> all_distances(nshard * k * n);
-    std::vector<idx_t> all_labels(nshard * k * n);
     std::vector<int64_t> translations(nshard, 0);
+    std::unique_ptr<SharedThresholds> shared_thresholds;
+    if (share_thresholds) {
+        shared_thresholds.reset(new_shared_thresholds(x, n, this));
+    }
 
     // Because we just called runOnIndex above, it is safe to access the
     // sub-index ntotal here
@@ -219,18 +372,52 @@ void IndexShardsTemplate<IndexT>::search(
         }
     }
 
-    auto fn = [n, k, x, &all_distances, &all_labels, &translations](
-                      int no, const IndexT* index) {
+    if (search_block_size > 0) {
+        if (n == 0) {
+            return;
+        }
+        if (this->metric_type == METRIC_L2) {
+            search_blocks<CMax<distance_t, idx_t>>(
+                    *this,
+                    this->isThreaded_,
+                    n,
+                    x,
+                    k,
+                    distances,
+                    labels,
+                    translations,
+                    shared_thresholds.get());
+        } else {
+            search_blocks<CMin<distance_t, idx_t>>(
+                    *this,
+                    this->isThreaded_,
+                    n,
+                    x,
+                    k,
+                    distances,
+                    labels,
+                    translations,
+                    shared_thresholds.get());
+        }
+        return;
+    }
+
+    std::vector<distance_t> all_distances(nshard * k * n);
+    std::vector<idx_t> all_labels(nshard * k * n);
+
+    auto fn = [&](int no, const IndexT* index) {
         if (index->verbose) {
             printf("begin query shard %d on %" PRId64 " points\n", no, n);
         }
 
-        index->search(
+        search_shard(
+                index,
                 n,
                 x,
                 k,
                 all_distances.data() + no * k * n,
-                all_labels.data() + no * k * n);
+                all_labels.data() + no * k * n,
+                shared_thresholds.get());
 
         translate_labels(
                 n * k, all_labels.data() + no * k * n, translations[no]);
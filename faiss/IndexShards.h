@@ -93,6 +93,21 @@ struct IndexShardsTemplate : public ThreadedIndex<IndexT> {
 
     bool successive_ids;
 
+    /** if > 0, the queries are searched in blocks of this size, and the
+     * results of each (shard, block) are merged into the output as soon as
+     * they are available, instead of keeping the results of all the shards
+     * for a final merge. Without threads, the (shard, block) tasks are
+     * dynamically distributed over the OpenMP threads, so that the fast
+     * shards do not wait for the slow ones. With threads, each shard
+     * processes its blocks in its own thread. */
+    idx_t search_block_size = 0;
+
+    /** the IndexIVF shards share the k-th distance of each query while they
+     * search (see SharedThresholds), so that they skip the candidates that
+     * are beaten by the results of the other shards. The shards are
+     * searched with their own nprobe and max_codes. */
+    bool share_thresholds = false;
+
     /// Synchronize the top-level index (IndexShards) with data in the
     /// sub-indices
     virtual void syncWithSubIndexes();
@@ -12,8 +12,10 @@
 #include <cinttypes>
 #include <cstdio>
 #include <functional>
+#include <memory>
 
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/Heap.h>
 #include <faiss/utils/WorkerThread.h>
 #include <faiss/utils/utils.h>
@@ -184,6 +186,11 @@ void IndexShardsIVF::search(
     std::vector<distance_t> all_distances(nshard * k * n);
     std::vector<idx_t> all_labels(nshard * k * n);
     std::vector<int64_t> translations(nshard, 0);
+    std::unique_ptr<SharedThresholds> shared_thresholds;
+    if (share_thresholds) {
+        shared_thresholds = std::make_unique<SharedThresholds>(
+                x, n, d, is_similarity_metric(metric_type));
+    }
 
     if (successive_ids) {
         translations[0] = 0;
@@ -201,6 +208,11 @@ void IndexShardsIVF::search(
 
         FAISS_THROW_IF_NOT_MSG(index->nprobe == nprobe, "inconsistent nprobe");
 
+        SearchParametersIVF sub_params;
+        sub_params.nprobe = nprobe;
+        sub_params.max_codes = index->max_codes;
+        sub_params.shared_thresholds = shared_thresholds.get();
+
         index->search_preassigned(
                 n,
                 x,
@@ -209,7 +221,8 @@ void IndexShardsIVF::search(
                 Dq.data(),
                 all_distances.data() + no * k * n,
                 all_labels.data() + no * k * n,
-                false);
+                false,
+                shared_thresholds ? &sub_params : nullptr);
 
         translate_labels(
                 n * k, all_labels.data() + no * k * n, translations[no]);
@@ -0,0 +1,600 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexSparseInverted.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+
+namespace faiss {
+
+namespace {
+
+typedef std::vector<std::pair<int32_t, float>> TermWeights;
+
+/// terms of vector i sorted by term, the weights of duplicate terms are
+/// summed
+void sorted_terms(
+        const size_t* lims,
+        const int32_t* terms,
+        const float* weights,
+        idx_t i,
+        TermWeights& out) {
+    out.clear();
+    for (size_t j = lims[i]; j < lims[i + 1]; j++) {
+        out.emplace_back(terms[j], weights[j]);
+    }
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    size_t nout = 0;
+    for (size_t j = 0; j < out.size(); j++) {
+        if (nout > 0 && out[nout - 1].first == out[j].first) {
+            out[nout - 1].second += out[j].second;
+        } else {
+            out[nout++] = out[j];
+        }
+    }
+    out.resize(nout);
+}
+
+/// posting list of a query term during the search
+struct Cursor {
+    const idx_t* ids;
+    const float* weights;
+    const float* block_max;
+    size_t size;
+    size_t pos;
+    float qw; // query weight
+    float ub; // upper bound of the contribution
+};
+
+} // namespace
+
+IndexSparseInverted::IndexSparseInverted(size_t nterms)
+        : nterms(nterms),
+          invlists(nterms, sizeof(float)),
+          max_weights(nterms, 0),
+          block_max_weights(nterms) {}
+
+void IndexSparseInverted::add(
+        idx_t n,
+        const size_t* lims,
+        const int32_t* terms,
+        const float* weights) {
+    FAISS_THROW_IF_NOT(block_size > 0);
+    if (n == 0) {
+        return;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            !keep_forward || forward_lims.size() == ntotal + 1,
+            "keep_forward was changed after adding");
+
+    // sort the terms of each vector, bucket the postings by term
+    std::vector<size_t> counts(nterms + 1);
+    std::vector<size_t> v_lims(n + 1);
+    std::vector<int32_t> v_terms;
+    std::vector<float> v_weights;
+    TermWeights tw;
+    for (idx_t i = 0; i < n; i++) {
+        sorted_terms(lims, terms, weights, i, tw);
+        for (const auto& [t, w] : tw) {
+            FAISS_THROW_IF_NOT_FMT(
+                    t >= 0 && t < nterms,
+                    "term %d out of range [0, %zd)",
+                    t,
+                    nterms);
+            v_terms.push_back(t);
+            v_weights.push_back(w);
+            counts[t + 1]++;
+        }
+        v_lims[i + 1] = v_terms.size();
+    }
+    for (size_t t = 0; t < nterms; t++) {
+        counts[t + 1] += counts[t];
+    }
+    std::vector<idx_t> p_ids(v_terms.size());
+    std::vector<float> p_weights(v_terms.size());
+    {
+        std::vector<size_t> ofs(counts.begin(), counts.end() - 1);
+        for (idx_t i = 0; i < n; i++) {
+            for (size_t j = v_lims[i]; j < v_lims[i + 1]; j++) {
+                size_t o = ofs[v_terms[j]]++;
+                p_ids[o] = ntotal + i;
+                p_weights[o] = v_weights[j];
+            }
+        }
+    }
+
+    for (size_t t = 0; t < nterms; t++) {
+        size_t np = counts[t + 1] - counts[t];
+        if (np == 0) {
+            continue;
+        }
+        size_t old_size = invlists.list_size(t);
+        invlists.add_entries(
+                t,
+                np,
+                p_ids.data() + counts[t],
+                (const uint8_t*)(p_weights.data() + counts[t]));
+
+        // update the upper bounds of the blocks that changed
+        InvertedLists::ScopedCodes codes(&invlists, t);
+        const float* w = (const float*)codes.get();
+        size_t size = old_size + np;
+        std::vector<float>& bmax = block_max_weights[t];
+        size_t b0 = old_size / block_size;
+        bmax.resize((size + block_size - 1) / block_size);
+        for (size_t b = b0; b < bmax.size(); b++) {
+            size_t j1 = std::min(size, (b + 1) * block_size);
+            float m = w[b * block_size];
+            for (size_t j = b * block_size + 1; j < j1; j++) {
+                m = std::max(m, w[j]);
+            }
+            bmax[b] = m;
+        }
+        max_weights[t] = *std::max_element(bmax.begin(), bmax.end());
+    }
+
+    if (keep_forward) {
+        for (idx_t i = 0; i < n; i++) {
+            forward_lims.push_back(
+                    forward_lims.back() + v_lims[i + 1] - v_lims[i]);
+        }
+        forward_terms.insert(
+                forward_terms.end(), v_terms.begin(), v_terms.end());
+        forward_weights.insert(
+                forward_weights.end(), v_weights.begin(), v_weights.end());
+    }
+    ntotal += n;
+}
+
+void IndexSparseInverted::search(
+        idx_t n,
+        const size_t* lims,
+        const int32_t* terms,
+        const float* weights,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParametersSparse* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    bool exhaustive = params && params->exhaustive;
+    size_t npostings = 0, nskipped = 0;
+
+#pragma omp parallel if (n > 1) reduction(+ : npostings, nskipped)
+    {
+        TermWeights tw;
+        std::vector<Cursor> cursors;
+        std::vector<std::unique_ptr<InvertedLists::ScopedIds>> scoped_ids;
+        std::vector<float> cum_ub;
+        // accumulator of the exhaustive search
+        std::vector<float> acc;
+        std::vector<idx_t> touched;
+
+#pragma omp for
+        for (idx_t q = 0; q < n; q++) {
+            float* D = distances + q * k;
+            idx_t* I = labels + q * k;
+            minheap_heapify(k, D, I);
+
+            sorted_terms(lims, terms, weights, q, tw);
+            cursors.clear();
+            scoped_ids.clear();
+            bool negative = false;
+            for (const auto& [t, qw] : tw) {
+                if (t < 0 || t >= nterms || qw == 0 ||
+                    invlists.list_size(t) == 0) {
+                    continue;
+                }
+                negative |= qw < 0;
+                scoped_ids.emplace_back(
+                        new InvertedLists::ScopedIds(&invlists, t));
+                Cursor c;
+                c.ids = scoped_ids.back()->get();
+                c.weights = (const float*)invlists.get_codes(t);
+                c.block_max = block_max_weights[t].data();
+                c.size = invlists.list_size(t);
+                c.pos = 0;
+                c.qw = qw;
+                c.ub = std::max(qw * max_weights[t], 0.0f);
+                cursors.push_back(c);
+            }
+
+            if (exhaustive || negative) {
+                acc.resize(ntotal);
+                touched.clear();
+                for (const Cursor& c : cursors) {
+                    for (size_t j = 0; j < c.size; j++) {
+                        idx_t id = c.ids[j];
+                        touched.push_back(id);
+                        acc[id] += c.qw * c.weights[j];
+                    }
+                    npostings += c.size;
+                }
+                std::sort(touched.begin(), touched.end());
+                touched.erase(
+                        std::unique(touched.begin(), touched.end()),
+                        touched.end());
+                for (idx_t id : touched) {
+                    if (acc[id] > D[0]) {
+                        minheap_replace_top(k, D, I, acc[id], id);
+                    }
+                    acc[id] = 0;
+                }
+                minheap_reorder(k, D, I);
+                continue;
+            }
+
+            // MaxScore: terms [0, p) are non-essential
+            std::sort(
+                    cursors.begin(),
+                    cursors.end(),
+                    [](const Cursor& a, const Cursor& b) {
+                        return a.ub < b.ub;
+                    });
+            size_t m = cursors.size();
+            cum_ub.resize(m);
+            float s = 0;
+            for (size_t i = 0; i < m; i++) {
+                s += cursors[i].ub;
+                cum_ub[i] = s;
+            }
+            float threshold = D[0];
+            size_t p = 0;
+
+            while (p < m) {
+                idx_t cur = std::numeric_limits<idx_t>::max();
+                for (size_t i = p; i < m; i++) {
+                    const Cursor& c = cursors[i];
+                    if (c.pos < c.size) {
+                        cur = std::min(cur, c.ids[c.pos]);
+                    }
+                }
+                if (cur == std::numeric_limits<idx_t>::max()) {
+                    break;
+                }
+                float score = 0;
+                for (size_t i = p; i < m; i++) {
+                    Cursor& c = cursors[i];
+                    if (c.pos < c.size && c.ids[c.pos] == cur) {
+                        score += c.qw * c.weights[c.pos];
+                        c.pos++;
+                        npostings++;
+                    }
+                }
+                bool pruned = false;
+                for (size_t i = p; i-- > 0;) {
+                    if (score + cum_ub[i] <= threshold) {
+                        pruned = true;
+                        break;
+                    }
+                    Cursor& c = cursors[i];
+                    // block that may contain cur
+                    size_t b = c.pos / block_size;
+                    size_t nblocks = (c.size + block_size - 1) / block_size;
+                    while (b < nblocks &&
+                           c.ids[std::min(c.size, (b + 1) * block_size) - 1] <
+                                   cur) {
+                        b++;
+                    }
+                    if (b == nblocks) {
+                        c.pos = c.size;
+                        continue;
+                    }
+                    float rest = i > 0 ? cum_ub[i - 1] : 0;
+                    if (score + rest + c.qw * c.block_max[b] <= threshold) {
+                        pruned = true;
+                        break;
+                    }
+                    const idx_t* begin =
+                            c.ids + std::max(c.pos, b * block_size);
+                    const idx_t* end =
+                            c.ids + std::min(c.size, (b + 1) * block_size);
+                    const idx_t* it = std::lower_bound(begin, end, cur);
+                    c.pos = it - c.ids;
+                    if (it != end && *it == cur) {
+                        score += c.qw * c.weights[c.pos];
+                        c.pos++;
+                        npostings++;
+                    }
+                }
+                if (pruned) {
+                    nskipped++;
+                    continue;
+                }
+                if (score > threshold) {
+                    minheap_replace_top(k, D, I, score, cur);
+                    threshold = D[0];
+                    while (p < m && cum_ub[p] <= threshold) {
+                        p++;
+                    }
+                }
+            }
+            minheap_reorder(k, D, I);
+        }
+    }
+
+    sparse_search_stats.nq += n;
+    sparse_search_stats.npostings += npostings;
+    sparse_search_stats.nskipped += nskipped;
+}
+
+void IndexSparseInverted::compute_scores(
+        const size_t* lims,
+        const int32_t* terms,
+        const float* weights,
+        idx_t q,
+        size_t nid,
+        const idx_t* ids,
+        float* scores) const {
+    FAISS_THROW_IF_NOT_MSG(
+            keep_forward && forward_lims.size() == ntotal + 1,
+            "the forward vectors are not stored");
+    TermWeights tw;
+    sorted_terms(lims, terms, weights, q, tw);
+    for (size_t i = 0; i < nid; i++) {
+        scores[i] = 0;
+        idx_t id = ids[i];
+        if (id < 0) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT(id < ntotal);
+        // merge of the two sorted term lists
+        size_t j = forward_lims[id], j1 = forward_lims[id + 1];
+        size_t l = 0;
+        float s = 0;
+        while (j < j1 && l < tw.size()) {
+            if (forward_terms[j] < tw[l].first) {
+                j++;
+            } else if (forward_terms[j] > tw[l].first) {
+                l++;
+            } else {
+                s += forward_weights[j++] * tw[l++].second;
+            }
+        }
+        scores[i] = s;
+    }
+}
+
+void IndexSparseInverted::reset() {
+    invlists.reset();
+    std::fill(max_weights.begin(), max_weights.end(), 0);
+    for (auto& bmax : block_max_weights) {
+        bmax.clear();
+    }
+    forward_lims.resize(1);
+    forward_terms.clear();
+    forward_weights.clear();
+    ntotal = 0;
+}
+
+void SparseSearchStats::reset() {
+    memset(this, 0, sizeof(*this));
+}
+
+SparseSearchStats sparse_search_stats;
+
+/*************************************************************
+ * Hybrid dense + sparse search
+ *************************************************************/
+
+HybridFusionHandler::HybridFusionHandler(const HybridSearchParameters& params)
+        : params(params) {
+    begin();
+}
+
+void HybridFusionHandler::begin() {
+    candidates.clear();
+    dense_worst = sparse_worst = 0;
+}
+
+namespace {
+
+void add_leg_results(
+        std::vector<HybridFusionHandler::Candidate>& candidates,
+        bool dense,
+        size_t n,
+        const float* scores,
+        const idx_t* ids,
+        float& worst) {
+    std::unordered_map<idx_t, size_t> pos;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        pos[candidates[i].id] = i;
+    }
+    int rank = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (ids[i] < 0) {
+            continue;
+        }
+        auto it = pos.find(ids[i]);
+        if (it == pos.end()) {
+            HybridFusionHandler::Candidate c;
+            c.id = ids[i];
+            c.dense_score = c.sparse_score = 0;
+            c.dense_rank = c.sparse_rank = -1;
+            c.dense_scored = c.sparse_scored = false;
+            it = pos.emplace(ids[i], candidates.size()).first;
+            candidates.push_back(c);
+        }
+        HybridFusionHandler::Candidate& c = candidates[it->second];
+        if (dense) {
+            c.dense_score = scores[i];
+            c.dense_rank = rank;
+            c.dense_scored = true;
+        } else {
+            c.sparse_score = scores[i];
+            c.sparse_rank = rank;
+            c.sparse_scored = true;
+        }
+        worst = rank == 0 ? scores[i] : std::min(worst, scores[i]);
+        rank++;
+    }
+}
+
+} // namespace
+
+void HybridFusionHandler::add_dense_results(
+        size_t n,
+        const float* scores,
+        const idx_t* ids) {
+    add_leg_results(candidates, true, n, scores, ids, dense_worst);
+}
+
+void HybridFusionHandler::add_sparse_results(
+        size_t n,
+        const float* scores,
+        const idx_t* ids) {
+    add_leg_results(candidates, false, n, scores, ids, sparse_worst);
+}
+
+float HybridFusionHandler::fused_score(const Candidate& c) const {
+    if (params.fusion == HYBRID_RRF) {
+        float s = 0;
+        if (c.dense_rank >= 0) {
+            s += params.dense_weight / (params.rrf_k + c.dense_rank + 1);
+        }
+        if (c.sparse_rank >= 0) {
+            s += params.sparse_weight / (params.rrf_k + c.sparse_rank + 1);
+        }
+        return s;
+    }
+    FAISS_THROW_IF_NOT(params.fusion == HYBRID_WEIGHTED);
+    float ds = c.dense_scored ? c.dense_score : dense_worst;
+    float ss = c.sparse_scored ? c.sparse_score : sparse_worst;
+    return params.dense_weight * ds + params.sparse_weight * ss;
+}
+
+void HybridFusionHandler::end(idx_t k, float* distances, idx_t* labels) {
+    minheap_heapify(k, distances, labels);
+    for (const Candidate& c : candidates) {
+        float s = fused_score(c);
+        if (s > distances[0]) {
+            minheap_replace_top(k, distances, labels, s, c.id);
+        }
+    }
+    minheap_reorder(k, distances, labels);
+}
+
+void hybrid_search(
+        const Index& dense,
+        const IndexSparseInverted& sparse,
+        idx_t n,
+        const float* xq,
+        const size_t* lims,
+        const int32_t* terms,
+        const float* weights,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const HybridSearchParameters* params) {
+    HybridSearchParameters default_params;
+    if (!params) {
+        params = &default_params;
+    }
+    idx_t kd = params->k_dense > 0 ? params->k_dense : k;
+    idx_t ks = params->k_sparse > 0 ? params->k_sparse : k;
+    bool similarity = is_similarity_metric(dense.metric_type);
+
+    std::vector<float> Dd(n * kd), Ds(n * ks);
+    std::vector<idx_t> Id(n * kd), Is(n * ks);
+    dense.search(n, xq, kd, Dd.data(), Id.data(), params->dense_params);
+    if (!similarity) {
+        for (float& d : Dd) {
+            d = -d;
+        }
+    }
+    sparse.search(
+            n,
+            lims,
+            terms,
+            weights,
+            ks,
+            Ds.data(),
+            Is.data(),
+            params->sparse_params);
+
+    bool weighted = params->fusion == HYBRID_WEIGHTED;
+    bool rescore_sparse = weighted && params->rescore && sparse.keep_forward;
+    // the dense index is rescored only if it supports distance computations
+    bool rescore_dense = false;
+    if (weighted && params->rescore && dense.ntotal > 0) {
+        try {
+            std::unique_ptr<DistanceComputer> dc(
+                    dense.get_distance_computer());
+            dc->set_query(xq);
+            (*dc)(0);
+            rescore_dense = true;
+        } catch (const FaissException&) {
+        }
+    }
+
+#pragma omp parallel if (n > 1)
+    {
+        HybridFusionHandler handler(*params);
+        std::unique_ptr<DistanceComputer> dc(
+                rescore_dense ? dense.get_distance_computer() : nullptr);
+        std::vector<idx_t> missing;
+        std::vector<float> scores;
+
+#pragma omp for
+        for (idx_t q = 0; q < n; q++) {
+            handler.begin();
+            handler.add_dense_results(
+                    kd, Dd.data() + q * kd, Id.data() + q * kd);
+            handler.add_sparse_results(
+                    ks, Ds.data() + q * ks, Is.data() + q * ks);
+            auto& candidates = handler.candidates;
+
+            if (rescore_sparse) {
+                missing.clear();
+                for (const auto& c : candidates) {
+                    if (!c.sparse_scored) {
+                        missing.push_back(c.id);
+                    }
+                }
+                scores.resize(missing.size());
+                sparse.compute_scores(
+                        lims,
+                        terms,
+                        weights,
+                        q,
+                        missing.size(),
+                        missing.data(),
+                        scores.data());
+                size_t j = 0;
+                for (auto& c : candidates) {
+                    if (!c.sparse_scored) {
+                        c.sparse_score = scores[j++];
+                        c.sparse_scored = true;
+                    }
+                }
+            }
+            if (rescore_dense) {
+                dc->set_query(xq + q * dense.d);
+                for (auto& c : candidates) {
+                    if (!c.dense_scored && c.id < dense.ntotal) {
+                        float d = (*dc)(c.id);
+                        c.dense_score = similarity ? d : -d;
+                        c.dense_scored = true;
+                    }
+                }
+            }
+            handler.end(k, distances + q * k, labels + q * k);
+        }
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <faiss/Index.h>
+#include <faiss/invlists/InvertedLists.h>
+
+namespace faiss {
+
+/** The sparse vectors (eg. SPLADE or BM25 term weights) are given in CSR
+ * format: vector i has the terms terms[lims[i]..lims[i + 1]) with weights
+ * weights[lims[i]..lims[i + 1]). */
+
+struct SearchParametersSparse : SearchParameters {
+    /// score all the postings of the query terms instead of pruning with
+    /// MaxScore (the results are the same, for reference)
+    bool exhaustive = false;
+};
+
+/** Inverted index of sparse vectors, searched by inner product.
+ *
+ * The posting list of term t is list t of an ArrayInvertedLists, with the
+ * ids of the vectors that contain t and their weight for t as a 4-byte
+ * code. The ids are sequential, so the posting lists are sorted by id.
+ *
+ * The search is document-at-a-time with MaxScore pruning: the query terms
+ * are sorted by upper bound of their contribution (query weight times the
+ * max weight of the posting list). The terms whose cumulated upper bounds
+ * cannot reach the current k-th score are non-essential: they are only
+ * looked up for the candidates of the essential terms, and only while the
+ * candidate can still enter the top-k. The upper bounds are refined with
+ * the max weight of the block of block_size postings that contains the
+ * candidate. The pruning is safe when the weights are non-negative, which
+ * is checked: otherwise the query is searched exhaustively.
+ */
+struct IndexSparseInverted {
+    /// vocabulary size, the terms are in [0, nterms)
+    size_t nterms;
+    idx_t ntotal = 0;
+
+    /// posting lists, codes are float weights
+    ArrayInvertedLists invlists;
+
+    /// nb of postings per block for the block-max upper bounds
+    size_t block_size = 64;
+    /// max weight of each posting list
+    std::vector<float> max_weights;
+    /// max weight of each block of each posting list
+    std::vector<std::vector<float>> block_max_weights;
+
+    /// whether to keep a copy of the vectors sorted by term, used to score
+    /// given ids (compute_scores). Set before adding.
+    bool keep_forward = true;
+    std::vector<size_t> forward_lims{0};
+    std::vector<int32_t> forward_terms;
+    std::vector<float> forward_weights;
+
+    explicit IndexSparseInverted(size_t nterms = 0);
+
+    /// add n vectors, with ids ntotal..ntotal + n - 1
+    void add(
+            idx_t n,
+            const size_t* lims,
+            const int32_t* terms,
+            const float* weights);
+
+    /** search the k vectors with the largest inner products
+     *
+     * @param distances  output scores, size n * k, by decreasing order
+     * @param labels     output ids, size n * k, -1 if missing
+     */
+    void search(
+            idx_t n,
+            const size_t* lims,
+            const int32_t* terms,
+            const float* weights,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParametersSparse* params = nullptr) const;
+
+    /** inner products of query q (in the CSR arrays) with the vectors
+     * ids[0..nid), requires keep_forward. Negative ids get a 0 score. */
+    void compute_scores(
+            const size_t* lims,
+            const int32_t* terms,
+            const float* weights,
+            idx_t q,
+            size_t nid,
+            const idx_t* ids,
+            float* scores) const;
+
+    void reset();
+};
+
+struct SparseSearchStats {
+    size_t nq;        ///< nb of queries run
+    size_t npostings; ///< nb of postings scored
+    size_t nskipped;  ///< nb of candidates dropped by the upper bounds
+
+    SparseSearchStats() {
+        reset();
+    }
+    void reset();
+};
+
+FAISS_API extern SparseSearchStats sparse_search_stats;
+
+/*************************************************************
+ * Hybrid dense + sparse search
+ *************************************************************/
+
+enum HybridFusion {
+    /// dense_weight * dense score + sparse_weight * sparse score, where the
+    /// dense score is the inner product or minus the L2 distance
+    HYBRID_WEIGHTED = 0,
+    /// reciprocal rank fusion: sum of weight / (rrf_k + rank)
+    HYBRID_RRF = 1,
+};
+
+struct HybridSearchParameters {
+    HybridFusion fusion = HYBRID_RRF;
+    float dense_weight = 1;
+    float sparse_weight = 1;
+    float rrf_k = 60;
+
+    /// nb of results fetched from each index, 0 = k
+    idx_t k_dense = 0;
+    idx_t k_sparse = 0;
+
+    /** HYBRID_WEIGHTED: the results found by one index only are scored
+     * exactly by the other one (the sparse index if it keeps the forward
+     * vectors, the dense index if it has a distance computer), so that it
+     * is not necessary to fetch many more than k results from each.
+     * Otherwise the missing score is the worst score returned by that
+     * index. */
+    bool rescore = true;
+
+    /// given to the dense search
+    const SearchParameters* dense_params = nullptr;
+    const SearchParametersSparse* sparse_params = nullptr;
+};
+
+/** Fuses the results of the dense and sparse searches of one query into a
+ * top-k. The results are submitted per index, with their rank. */
+struct HybridFusionHandler {
+    const HybridSearchParameters& params;
+
+    struct Candidate {
+        idx_t id;
+        float dense_score, sparse_score;
+        int dense_rank, sparse_rank; // -1 if not found by that index
+        bool dense_scored, sparse_scored; // whether the score is known
+    };
+    std::vector<Candidate> candidates;
+    /// worst score returned by each index, for the missing scores
+    float dense_worst, sparse_worst;
+
+    explicit HybridFusionHandler(const HybridSearchParameters& params);
+
+    void begin();
+
+    /// results by decreasing score, ids -1 are ignored
+    void add_dense_results(size_t n, const float* scores, const idx_t* ids);
+    void add_sparse_results(size_t n, const float* scores, const idx_t* ids);
+
+    /// fused top-k, by decreasing fused score
+    void end(idx_t k, float* distances, idx_t* labels);
+
+    /// fused score of a candidate
+    float fused_score(const Candidate& c) const;
+};
+
+/** search the k best results of the fusion of a dense index and a sparse
+ * index that share the same ids (ie. the sparse index and dense storage
+ * contain the same documents in the same order).
+ *
+ * @param xq         dense queries, size n * dense.d
+ * @param lims, terms, weights  sparse queries in CSR format
+ * @param distances  output fused scores, size n * k
+ * @param labels     output ids, size n * k
+ */
+void hybrid_search(
+        const Index& dense,
+        const IndexSparseInverted& sparse,
+        idx_t n,
+        const float* xq,
+        const size_t* lims,
+        const int32_t* terms,
+        const float* weights,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const HybridSearchParameters* params = nullptr);
+
+} // namespace faiss
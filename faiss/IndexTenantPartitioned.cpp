@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexTenantPartitioned.h>
+
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+#include <faiss/clone_index.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+IndexTenantPartitioned::IndexTenantPartitioned(
+        Index* large_template,
+        size_t large_tenant_threshold)
+        : Index(large_template->d, large_template->metric_type),
+          large_template(large_template),
+          large_tenant_threshold(large_tenant_threshold) {
+    FAISS_THROW_IF_NOT(
+            metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT);
+    is_trained = true;
+}
+
+void IndexTenantPartitioned::train(idx_t n, const float* x) {
+    if (!large_template->is_trained) {
+        large_template->train(n, x);
+    }
+}
+
+void IndexTenantPartitioned::add(idx_t, const float*) {
+    FAISS_THROW_MSG("use add_with_tenants");
+}
+
+void IndexTenantPartitioned::add_with_ids(idx_t, const float*, const idx_t*) {
+    FAISS_THROW_MSG("use add_with_tenants");
+}
+
+void IndexTenantPartitioned::promote(Partition& p) const {
+    std::unique_ptr<Index> index(clone_index(large_template));
+    idx_t nt = p.ids.size();
+    if (!index->is_trained) {
+        index->train(nt, p.x.data());
+    }
+    index->add(nt, p.x.data());
+    p.index = std::move(index);
+    p.x.clear();
+    p.x.shrink_to_fit();
+}
+
+void IndexTenantPartitioned::add_with_tenants(
+        idx_t n,
+        const float* x,
+        const idx_t* tenants,
+        const idx_t* xids) {
+    // group the vectors per tenant, to add them by batches
+    std::map<idx_t, std::vector<idx_t>> groups;
+    for (idx_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT_FMT(
+                tenants[i] >= 0, "invalid tenant %" PRId64, tenants[i]);
+        groups[tenants[i]].push_back(i);
+    }
+    std::vector<float> xg;
+    for (const auto& [tenant, idx] : groups) {
+        Partition& p = partitions[tenant];
+        xg.resize(idx.size() * d);
+        for (size_t j = 0; j < idx.size(); j++) {
+            memcpy(xg.data() + j * d, x + idx[j] * d, sizeof(float) * d);
+            p.ids.push_back(xids ? xids[idx[j]] : ntotal + idx[j]);
+        }
+        if (p.index) {
+            p.index->add(idx.size(), xg.data());
+        } else {
+            p.x.insert(p.x.end(), xg.begin(), xg.end());
+            if (p.ids.size() >= large_tenant_threshold) {
+                promote(p);
+            }
+        }
+    }
+    ntotal += n;
+}
+
+void IndexTenantPartitioned::search_partition(
+        const Partition& p,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* sub_params) const {
+    if (p.index) {
+        p.index->search(n, x, k, distances, labels, sub_params);
+    } else if (metric_type == METRIC_L2) {
+        knn_L2sqr(x, p.x.data(), d, n, p.ids.size(), k, distances, labels);
+    } else {
+        knn_inner_product(
+                x, p.x.data(), d, n, p.ids.size(), k, distances, labels);
+    }
+    for (idx_t i = 0; i < n * k; i++) {
+        if (labels[i] >= 0) {
+            labels[i] = p.ids[labels[i]];
+        }
+    }
+}
+
+namespace {
+
+template <class C>
+void merge_into_heaps(
+        idx_t n,
+        idx_t k,
+        const float* D,
+        const idx_t* I,
+        float* distances,
+        idx_t* labels) {
+    for (idx_t q = 0; q < n; q++) {
+        float* hd = distances + q * k;
+        idx_t* hi = labels + q * k;
+        for (idx_t j = 0; j < k; j++) {
+            idx_t id = I[q * k + j];
+            // the results are sorted, the next ones are not better
+            if (id < 0 || !C::cmp(hd[0], D[q * k + j])) {
+                break;
+            }
+            heap_replace_top<C>(k, hd, hi, D[q * k + j], id);
+        }
+    }
+}
+
+} // namespace
+
+void IndexTenantPartitioned::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params_in) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    const SearchParametersTenant* params = nullptr;
+    if (params_in) {
+        params = dynamic_cast<const SearchParametersTenant*>(params_in);
+        FAISS_THROW_IF_NOT_MSG(
+                params, "IndexTenantPartitioned params have incorrect type");
+    }
+    const SearchParameters* sub_params = params ? params->sub_params : nullptr;
+    bool is_max = is_similarity_metric(metric_type);
+
+    // initialize the result tables
+    for (idx_t i = 0; i < n * k; i++) {
+        distances[i] = is_max ? -HUGE_VALF : HUGE_VALF;
+        labels[i] = -1;
+    }
+
+    std::vector<float> D;
+    std::vector<idx_t> I;
+    if (!params || (params->tenant < 0 && !params->query_tenants)) {
+        // all the tenants: merge the results of the partitions
+        for (idx_t q = 0; q < n; q++) {
+            if (is_max) {
+                minheap_heapify(k, distances + q * k, labels + q * k);
+            } else {
+                maxheap_heapify(k, distances + q * k, labels + q * k);
+            }
+        }
+        D.resize(n * k);
+        I.resize(n * k);
+        for (const auto& [tenant, p] : partitions) {
+            search_partition(p, n, x, k, D.data(), I.data(), sub_params);
+            if (is_max) {
+                merge_into_heaps<CMin<float, idx_t>>(
+                        n, k, D.data(), I.data(), distances, labels);
+            } else {
+                merge_into_heaps<CMax<float, idx_t>>(
+                        n, k, D.data(), I.data(), distances, labels);
+            }
+        }
+        for (idx_t q = 0; q < n; q++) {
+            if (is_max) {
+                minheap_reorder(k, distances + q * k, labels + q * k);
+            } else {
+                maxheap_reorder(k, distances + q * k, labels + q * k);
+            }
+        }
+        return;
+    }
+
+    // group the queries per tenant
+    std::map<idx_t, std::vector<idx_t>> groups;
+    for (idx_t q = 0; q < n; q++) {
+        groups[params->query_tenants ? params->query_tenants[q]
+                                     : params->tenant]
+                .push_back(q);
+    }
+    std::vector<float> xg;
+    for (const auto& [tenant, queries] : groups) {
+        auto it = partitions.find(tenant);
+        if (it == partitions.end()) {
+            continue; // unknown tenant: no results
+        }
+        idx_t nq = queries.size();
+        const float* xq = x;
+        float* Dq = distances;
+        idx_t* Iq = labels;
+        if (groups.size() > 1) {
+            xg.resize(nq * d);
+            for (idx_t j = 0; j < nq; j++) {
+                memcpy(xg.data() + j * d,
+                       x + queries[j] * d,
+                       sizeof(float) * d);
+            }
+            D.resize(nq * k);
+            I.resize(nq * k);
+            xq = xg.data();
+            Dq = D.data();
+            Iq = I.data();
+        }
+        search_partition(it->second, nq, xq, k, Dq, Iq, sub_params);
+        if (groups.size() > 1) {
+            for (idx_t j = 0; j < nq; j++) {
+                memcpy(distances + queries[j] * k,
+                       Dq + j * k,
+                       sizeof(float) * k);
+                memcpy(labels + queries[j] * k, Iq + j * k, sizeof(idx_t) * k);
+            }
+        }
+    }
+}
+
+void IndexTenantPartitioned::reset() {
+    partitions.clear();
+    ntotal = 0;
+}
+
+size_t IndexTenantPartitioned::tenant_size(idx_t tenant) const {
+    auto it = partitions.find(tenant);
+    return it == partitions.end() ? 0 : it->second.ids.size();
+}
+
+bool IndexTenantPartitioned::is_large_tenant(idx_t tenant) const {
+    auto it = partitions.find(tenant);
+    return it != partitions.end() && it->second.index;
+}
+
+size_t IndexTenantPartitioned::nb_tenants() const {
+    return partitions.size();
+}
+
+IndexTenantPartitioned::~IndexTenantPartitioned() {
+    if (own_fields) {
+        delete large_template;
+    }
+}
+
+} // namespace faiss
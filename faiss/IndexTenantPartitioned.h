@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/// selects the tenant(s) searched by IndexTenantPartitioned
+struct SearchParametersTenant : SearchParameters {
+    /// tenant searched by all the queries, -1 = all the tenants
+    idx_t tenant = -1;
+    /// if not null, tenant of each query (size n), overrides tenant
+    const idx_t* query_tenants = nullptr;
+    /// given to the sub-indexes of the large tenants
+    const SearchParameters* sub_params = nullptr;
+};
+
+/** Index partitioned by tenant, to replace a single index filtered with an
+ * IDSelector per tenant, which is slow for the small tenants: the index is
+ * searched almost exhaustively to find the few vectors of the tenant.
+ *
+ * The vectors of a small tenant are stored contiguously and searched by
+ * brute force. When a tenant reaches large_tenant_threshold vectors, its
+ * vectors are moved to its own sub-index, a clone of large_template (eg.
+ * an IVF or HNSW index built by index_factory). The searches are routed
+ * to the tenants given in SearchParametersTenant.
+ *
+ * The vectors are added with add_with_tenants. The ids are global: they
+ * are given by the caller, or sequential.
+ */
+struct IndexTenantPartitioned : Index {
+    /// sub-indexes of the large tenants are clones of this index. If it
+    /// is not trained, each clone is trained on the vectors of its tenant
+    Index* large_template;
+    bool own_fields = false; ///< whether large_template is deleted
+
+    /// tenants with at least this many vectors get their own sub-index
+    size_t large_tenant_threshold;
+
+    explicit IndexTenantPartitioned(
+            Index* large_template,
+            size_t large_tenant_threshold = 10000);
+
+    /// trains large_template
+    void train(idx_t n, const float* x) override;
+
+    /// not supported, the tenants must be given (use add_with_tenants)
+    void add(idx_t n, const float* x) override;
+    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
+
+    /** add vectors to their tenants
+     *
+     * @param tenants  tenant of each vector, size n (>= 0)
+     * @param xids     ids of the vectors, if null: ntotal..ntotal + n - 1
+     */
+    void add_with_tenants(
+            idx_t n,
+            const float* x,
+            const idx_t* tenants,
+            const idx_t* xids = nullptr);
+
+    /// params must be a SearchParametersTenant or null (search all tenants)
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    void reset() override;
+
+    /// nb of vectors of a tenant
+    size_t tenant_size(idx_t tenant) const;
+
+    /// whether the tenant has its own sub-index
+    bool is_large_tenant(idx_t tenant) const;
+
+    size_t nb_tenants() const;
+
+    ~IndexTenantPartitioned() override;
+
+   private:
+    struct Partition {
+        /// vectors of a small tenant (empty for a large tenant)
+        std::vector<float> x;
+        /// global ids of the vectors of the tenant, in the order of x or of
+        /// the sub-index
+        std::vector<idx_t> ids;
+        /// sub-index of a large tenant
+        std::unique_ptr<Index> index;
+    };
+    std::unordered_map<idx_t, Partition> partitions;
+
+    void promote(Partition& p) const;
+
+    /// search the queries of one partition, with global ids
+    void search_partition(
+            const Partition& p,
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* sub_params) const;
+};
+
+} // namespace faiss
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexVamana.h>
+
+#include <cstring>
+#include <limits>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/Vamana.h>
+
+namespace faiss {
+
+IndexVamana::IndexVamana() = default;
+
+IndexVamana::IndexVamana(int d, int R, int pq_m, MetricType metric)
+        : IndexHNSW(new IndexFlatL2(d), std::max(R / 2, 2), R), pq_m(pq_m) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2, "IndexVamana supports only METRIC_L2");
+    FAISS_THROW_IF_NOT(R > 0 && pq_m >= 0);
+    own_fields = true;
+    if (pq_m > 0) {
+        hnsw.pruning_pq = std::make_shared<ProductQuantizer>(d, pq_m, 8);
+        hnsw.pruning_metric = METRIC_L2;
+        is_trained = false;
+    } else {
+        is_trained = true;
+    }
+}
+
+void IndexVamana::train(idx_t n, const float* x) {
+    if (hnsw.pruning_pq) {
+        hnsw.pruning_pq->train(n, x);
+    }
+    is_trained = true;
+}
+
+void IndexVamana::add(idx_t n, const float* x) {
+    FAISS_THROW_IF_NOT(is_trained);
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.storage_is_compact && !hnsw.neighbors_on_disk &&
+                    !is_recompute,
+            "cannot add to a compact, on-disk or recompute IndexVamana");
+    FAISS_THROW_IF_NOT_MSG(
+            ntotal + n <= std::numeric_limits<storage_idx_t>::max(),
+            "too many vectors for the HNSW storage_idx_t");
+    if (n == 0) {
+        return;
+    }
+    idx_t n0 = ntotal;
+    storage->add(n, x);
+    ntotal = storage->ntotal;
+
+    int R = hnsw.nb_neighbors(0);
+    for (idx_t i = 0; i < n; i++) {
+        hnsw.levels.push_back(1);
+        hnsw.offsets.push_back(hnsw.offsets.back() + R);
+    }
+    hnsw.neighbors.resize(hnsw.offsets.back(), -1);
+    if (!hnsw.deleted.empty()) {
+        hnsw.deleted.resize(ntotal, 0);
+    }
+    if (n0 == 0) {
+        hnsw.entry_point = vamana::find_medoid(*storage, n, x);
+        hnsw.max_level = 0;
+    }
+    vamana::build_graph(
+            *storage,
+            n0,
+            R,
+            build_L,
+            alpha,
+            build_batch_size,
+            hnsw.entry_point,
+            hnsw.neighbors.data());
+
+    if (hnsw.pruning_pq) {
+        const ProductQuantizer& pq = *hnsw.pruning_pq;
+        std::vector<uint8_t> codes(ntotal * pq.code_size);
+        if (n0 > 0) {
+            FAISS_THROW_IF_NOT(hnsw.pq_codes.size() == n0 * pq.code_size);
+            memcpy(codes.data(), hnsw.pq_codes.data(), hnsw.pq_codes.size());
+        }
+        pq.compute_codes(x, codes.data() + n0 * pq.code_size, n);
+        hnsw.set_pq_pruning_codes(pq, codes.data(), METRIC_L2);
+    }
+}
+
+void IndexVamana::reset() {
+    IndexHNSW::reset();
+    hnsw.pq_codes.clear();
+}
+
+} // namespace faiss
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <faiss/IndexHNSW.h>
+
+namespace faiss {
+
+/** The Vamana graph index of DiskANN: a single-layer graph of out-degree
+ * <= R, built with RobustPrune (alpha > 1 keeps long-range links), and
+ * searched from the medoid.
+ *
+ * The graph is stored as the level 0 of an HNSW whose nodes all have one
+ * level, so all the IndexHNSW search machinery applies: compact and on-disk
+ * (pread / mmap) neighbor lists after hnsw.convert_to_compact(), and the
+ * sector-aligned node blocks of HNSWNodeBlocks, which store each vector
+ * with its neighbor list as in the DiskANN disk layout.
+ *
+ * With pq_m > 0, an 8-bit PQ of pq_m sub-quantizers is trained and its
+ * codes are kept in memory (hnsw.pruning_pq). The search then ranks the
+ * unvisited neighbors with the PQ distances and only computes the exact
+ * distances, ie. reads the vectors, of the best 1 - pq_pruning_ratio
+ * fraction of them (set hnsw.pq_pruning_ratio or
+ * SearchParametersHNSW::pq_pruning_ratio).
+ *
+ * Only METRIC_L2 is supported.
+ */
+struct IndexVamana : IndexHNSW {
+    /// size of the candidate list of the greedy search during add
+    int build_L = 100;
+    /// pruning parameter, >= 1
+    float alpha = 1.2;
+    /// nb of nodes inserted in parallel against the same graph
+    size_t build_batch_size = 4096;
+    /// nb of sub-quantizers of the PQ that guides the search, 0 = no PQ
+    int pq_m = 0;
+
+    IndexVamana();
+    IndexVamana(int d, int R, int pq_m = 0, MetricType metric = METRIC_L2);
+
+    /// trains the PQ if any
+    void train(idx_t n, const float* x) override;
+
+    /** The first add builds the graph in two passes and sets the entry
+     * point to the medoid, the next ones insert the vectors in the graph
+     * with alpha, as in FreshDiskANN. */
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+};
+
+} // namespace faiss
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/RemoteIndex.h>
+
+#include <zmq.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/HNSW_zmq.h>
+
+namespace faiss {
+
+/**********************************************************
+ * Transport
+ **********************************************************/
+
+bool ZmqRemoteIndexTransport::request(
+        const void* req,
+        size_t req_size,
+        const std::function<bool(const char*, size_t)>& on_reply) {
+    return ZmqConnectionPool::instance().request(
+            zmq_port, req, req_size, on_reply);
+}
+
+/**********************************************************
+ * Server
+ **********************************************************/
+
+namespace {
+
+void error_reply(const std::string& msg, std::vector<uint8_t>& reply) {
+    RemoteIndexReply header{remote_index_reply_magic, 1, 0, 0};
+    reply.resize(sizeof(header) + msg.size());
+    memcpy(reply.data(), &header, sizeof(header));
+    memcpy(reply.data() + sizeof(header), msg.data(), msg.size());
+}
+
+} // namespace
+
+RemoteIndexServer::RemoteIndexServer(const Index* index) : index(index) {}
+
+void RemoteIndexServer::handle_request(
+        const char* req,
+        size_t req_size,
+        std::vector<uint8_t>& reply) const {
+    try {
+        RemoteIndexRequest header;
+        FAISS_THROW_IF_NOT_MSG(
+                req_size >= sizeof(header), "remote index: short request");
+        memcpy(&header, req, sizeof(header));
+        FAISS_THROW_IF_NOT_MSG(
+                header.magic == remote_index_request_magic,
+                "remote index: bad request magic");
+        RemoteIndexReply rh{remote_index_reply_magic, 0, 0, 0};
+        if (header.op == RemoteIndexRequest::op_info) {
+            RemoteIndexInfo info{
+                    index->d,
+                    index->ntotal,
+                    int32_t(index->metric_type),
+                    index->metric_arg};
+            reply.resize(sizeof(rh) + sizeof(info));
+            memcpy(reply.data(), &rh, sizeof(rh));
+            memcpy(reply.data() + sizeof(rh), &info, sizeof(info));
+        } else if (header.op == RemoteIndexRequest::op_search) {
+            size_t n = header.n, k = header.k;
+            FAISS_THROW_IF_NOT_FMT(
+                    header.d == index->d,
+                    "remote index: query dimension %zd != %zd",
+                    size_t(header.d),
+                    size_t(index->d));
+            FAISS_THROW_IF_NOT_MSG(
+                    req_size == sizeof(header) + n * index->d * sizeof(float),
+                    "remote index: bad request size");
+            std::vector<float> x(n * index->d);
+            memcpy(x.data(), req + sizeof(header), x.size() * sizeof(float));
+            std::vector<float> D(n * k);
+            std::vector<idx_t> I(n * k);
+            index->search(n, x.data(), k, D.data(), I.data());
+            rh.n = n;
+            rh.k = k;
+            reply.resize(sizeof(rh) + n * k * (sizeof(float) + sizeof(idx_t)));
+            uint8_t* p = reply.data();
+            memcpy(p, &rh, sizeof(rh));
+            p += sizeof(rh);
+            memcpy(p, D.data(), D.size() * sizeof(float));
+            p += D.size() * sizeof(float);
+            memcpy(p, I.data(), I.size() * sizeof(idx_t));
+        } else {
+            FAISS_THROW_FMT("remote index: unknown op %d", int(header.op));
+        }
+    } catch (const std::exception& e) {
+        error_reply(e.what(), reply);
+    }
+}
+
+void RemoteIndexServer::serve_zmq(const char* endpoint) {
+    stopped = false;
+    void* context = zmq_ctx_new();
+    void* socket = zmq_socket(context, ZMQ_REP);
+    if (zmq_bind(socket, endpoint) != 0) {
+        zmq_close(socket);
+        zmq_ctx_term(context);
+        FAISS_THROW_FMT(
+                "could not bind %s: %s", endpoint, zmq_strerror(zmq_errno()));
+    }
+    std::vector<uint8_t> reply;
+    while (!stopped) {
+        zmq_pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+        if (zmq_poll(&item, 1, poll_ms) <= 0 || !(item.revents & ZMQ_POLLIN)) {
+            continue;
+        }
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        if (zmq_msg_recv(&msg, socket, 0) < 0) {
+            zmq_msg_close(&msg);
+            continue;
+        }
+        handle_request(
+                (const char*)zmq_msg_data(&msg), zmq_msg_size(&msg), reply);
+        zmq_msg_close(&msg);
+        zmq_send(socket, reply.data(), reply.size(), 0);
+    }
+    zmq_close(socket);
+    zmq_ctx_term(context);
+}
+
+void RemoteIndexServer::stop() {
+    stopped = true;
+}
+
+/**********************************************************
+ * Client
+ **********************************************************/
+
+namespace {
+
+/// throws if the reply is an error or does not have the expected header
+RemoteIndexReply check_reply(const char* data, size_t size) {
+    RemoteIndexReply header;
+    FAISS_THROW_IF_NOT_MSG(
+            size >= sizeof(header), "remote index: short reply");
+    memcpy(&header, data, sizeof(header));
+    FAISS_THROW_IF_NOT_MSG(
+            header.magic == remote_index_reply_magic,
+            "remote index: bad reply magic");
+    if (header.status != 0) {
+        std::string msg(data + sizeof(header), size - sizeof(header));
+        FAISS_THROW_FMT("remote index error: %s", msg.c_str());
+    }
+    return header;
+}
+
+/** state of a search, shared with the threads that send the requests:
+ * after a timeout, the late threads write to it, not to the caller's
+ * buffers */
+struct RemoteSearchState {
+    idx_t n, k, d, bs;
+    std::vector<float> x;
+    std::vector<float> D;
+    std::vector<idx_t> I;
+    std::atomic<idx_t> next_batch{0};
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<uint8_t> batch_done;
+    size_t n_done = 0;
+    std::string error;
+};
+
+void run_batches(
+        std::shared_ptr<RemoteSearchState> st,
+        std::shared_ptr<RemoteIndexTransport> transport,
+        std::atomic<size_t>* n_requests) {
+    idx_t nbatch = st->batch_done.size();
+    std::vector<uint8_t> req;
+    for (;;) {
+        idx_t b = st->next_batch++;
+        if (b >= nbatch) {
+            return;
+        }
+        idx_t i0 = b * st->bs, i1 = std::min(i0 + st->bs, st->n);
+        size_t nk = (i1 - i0) * st->k;
+        RemoteIndexRequest header{
+                remote_index_request_magic,
+                RemoteIndexRequest::op_search,
+                uint64_t(i1 - i0),
+                uint64_t(st->k),
+                uint64_t(st->d)};
+        size_t xbytes = (i1 - i0) * st->d * sizeof(float);
+        req.resize(sizeof(header) + xbytes);
+        memcpy(req.data(), &header, sizeof(header));
+        memcpy(req.data() + sizeof(header), st->x.data() + i0 * st->d, xbytes);
+
+        std::string error;
+        (*n_requests)++;
+        bool ok = transport->request(
+                req.data(), req.size(), [&](const char* data, size_t size) {
+                    try {
+                        RemoteIndexReply rh = check_reply(data, size);
+                        size_t expected = sizeof(rh) +
+                                nk * (sizeof(float) + sizeof(idx_t));
+                        FAISS_THROW_IF_NOT_MSG(
+                                rh.n == i1 - i0 && rh.k == st->k &&
+                                        size == expected,
+                                "remote index: bad reply size");
+                        const char* p = data + sizeof(rh);
+                        memcpy(st->D.data() + i0 * st->k,
+                               p,
+                               nk * sizeof(float));
+                        memcpy(st->I.data() + i0 * st->k,
+                               p + nk * sizeof(float),
+                               nk * sizeof(idx_t));
+                    } catch (const std::exception& e) {
+                        error = e.what();
+                    }
+                    return error.empty();
+                });
+        if (!ok && error.empty()) {
+            error = "remote index: request failed";
+        }
+        {
+            std::lock_guard<std::mutex> lock(st->mutex);
+            if (!error.empty() && st->error.empty()) {
+                st->error = error;
+            }
+            st->batch_done[b] = ok;
+            st->n_done++;
+        }
+        st->cv.notify_all();
+    }
+}
+
+} // namespace
+
+RemoteIndex::RemoteIndex(std::shared_ptr<RemoteIndexTransport> transport)
+        : transport(transport) {
+    sync();
+}
+
+void RemoteIndex::sync() {
+    RemoteIndexRequest header{
+            remote_index_request_magic, RemoteIndexRequest::op_info, 0, 0, 0};
+    RemoteIndexInfo info;
+    std::string error;
+    bool ok = transport->request(
+            &header, sizeof(header), [&](const char* data, size_t size) {
+                try {
+                    check_reply(data, size);
+                    FAISS_THROW_IF_NOT_MSG(
+                            size == sizeof(RemoteIndexReply) + sizeof(info),
+                            "remote index: bad info reply");
+                    memcpy(&info,
+                           data + sizeof(RemoteIndexReply),
+                           sizeof(info));
+                } catch (const std::exception& e) {
+                    error = e.what();
+                }
+                return error.empty();
+            });
+    FAISS_THROW_IF_NOT_FMT(
+            ok,
+            "could not reach the remote index%s%s",
+            error.empty() ? "" : ": ",
+            error.c_str());
+    d = info.d;
+    ntotal = info.ntotal;
+    metric_type = MetricType(info.metric_type);
+    metric_arg = info.metric_arg;
+    is_trained = true;
+}
+
+void RemoteIndex::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT_MSG(
+            !params, "search parameters are not sent to remote indexes");
+    FAISS_THROW_IF_NOT(k > 0 && batch_size > 0 && max_inflight > 0);
+    if (n == 0) {
+        return;
+    }
+    auto st = std::make_shared<RemoteSearchState>();
+    st->n = n;
+    st->k = k;
+    st->d = d;
+    st->bs = batch_size;
+    st->x.assign(x, x + n * d);
+    st->D.resize(n * k);
+    st->I.resize(n * k);
+    idx_t nbatch = (n + batch_size - 1) / batch_size;
+    st->batch_done.resize(nbatch);
+
+    // the threads are detached so that a timed out search returns without
+    // waiting for them
+    int nt = std::min(idx_t(max_inflight), nbatch);
+    auto n_req = const_cast<std::atomic<size_t>*>(&n_requests);
+    for (int t = 0; t < nt; t++) {
+        std::thread(run_batches, st, transport, n_req).detach();
+    }
+
+    std::unique_lock<std::mutex> lock(st->mutex);
+    auto all_done = [&] { return st->n_done == nbatch; };
+    bool timed_out = false;
+    if (timeout_ms > 0) {
+        timed_out = !st->cv.wait_for(
+                lock, std::chrono::milliseconds(timeout_ms), all_done);
+    } else {
+        st->cv.wait(lock, all_done);
+    }
+    if (timed_out) {
+        const_cast<std::atomic<size_t>&>(n_timeouts)++;
+        FAISS_THROW_IF_NOT_FMT(
+                !throw_on_timeout,
+                "remote index: search timed out after %d ms",
+                timeout_ms);
+    }
+    FAISS_THROW_IF_NOT_FMT(st->error.empty(), "%s", st->error.c_str());
+
+    float worst = is_similarity_metric(metric_type)
+            ? -std::numeric_limits<float>::infinity()
+            : std::numeric_limits<float>::infinity();
+    for (idx_t b = 0; b < nbatch; b++) {
+        idx_t i0 = b * batch_size, i1 = std::min(i0 + batch_size, n);
+        size_t nk = (i1 - i0) * k;
+        if (st->batch_done[b]) {
+            memcpy(distances + i0 * k,
+                   st->D.data() + i0 * k,
+                   nk * sizeof(float));
+            memcpy(labels + i0 * k, st->I.data() + i0 * k, nk * sizeof(idx_t));
+        } else {
+            std::fill(distances + i0 * k, distances + i1 * k, worst);
+            std::fill(labels + i0 * k, labels + i1 * k, idx_t(-1));
+        }
+    }
+}
+
+std::future<void> RemoteIndex::search_async(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels) const {
+    return std::async(std::launch::async, [=] {
+        search(n, x, k, distances, labels);
+    });
+}
+
+void RemoteIndex::add(idx_t, const float*) {
+    FAISS_THROW_MSG("RemoteIndex is read-only, add to the served index");
+}
+
+void RemoteIndex::reset() {
+    FAISS_THROW_MSG("RemoteIndex is read-only");
+}
+
+} // namespace faiss
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/Index.h>
+
+/***********************************************************
+ * Search of indexes served by other processes or nodes
+ *
+ * A RemoteIndexServer answers the search requests for an index, a
+ * RemoteIndex is the client-side Index that sends them. Combined with an
+ * IndexShards (threaded, with search_block_size for the streaming merge)
+ * whose shards are RemoteIndex objects, the queries are searched on all
+ * the nodes concurrently:
+ *
+ *   // on each node
+ *   RemoteIndexServer server(index);
+ *   server.serve_zmq("tcp://0.0.0.0:7000");
+ *
+ *   // on the coordinator
+ *   ZmqConnectionPool::instance().set_endpoint(7000, "tcp://node0:7000");
+ *   IndexShards shards(d, true, false);
+ *   shards.add_shard(new RemoteIndex(
+ *           std::make_shared<ZmqRemoteIndexTransport>(7000)));
+ *
+ * Binary protocol: a request is one frame
+ *
+ *   RemoteIndexRequest, then n * d float queries (op_search)
+ *
+ * and the reply is one frame
+ *
+ *   RemoteIndexReply, then
+ *   - op_search: n * k float distances and n * k int64 labels
+ *   - op_info: RemoteIndexInfo
+ *   - on error (status != 0): the error message
+ ***********************************************************/
+
+namespace faiss {
+
+constexpr uint32_t remote_index_request_magic = 0x51524952; // "RIRQ"
+constexpr uint32_t remote_index_reply_magic = 0x50524952;   // "RIRP"
+
+struct RemoteIndexRequest {
+    enum Op : uint32_t {
+        op_info = 0,
+        op_search = 1,
+    };
+    uint32_t magic;
+    uint32_t op;
+    uint64_t n;
+    uint64_t k;
+    uint64_t d;
+};
+
+struct RemoteIndexReply {
+    uint32_t magic;
+    int32_t status; ///< 0 = ok
+    uint64_t n;
+    uint64_t k;
+};
+
+struct RemoteIndexInfo {
+    int64_t d;
+    int64_t ntotal;
+    int32_t metric_type;
+    float metric_arg;
+};
+
+/** Sends a request frame and passes the reply frame to on_reply. Returns
+ * false if the round trip failed or on_reply returned false. Called
+ * concurrently. */
+struct RemoteIndexTransport {
+    virtual bool request(
+            const void* req,
+            size_t req_size,
+            const std::function<bool(const char*, size_t)>& on_reply) = 0;
+
+    virtual ~RemoteIndexTransport() {}
+};
+
+/** Transport over the ZMQ connections of ZmqConnectionPool: the sockets
+ * are reused across requests, and the endpoint, timeout and replicas of
+ * the port are configured on the pool. */
+struct ZmqRemoteIndexTransport : RemoteIndexTransport {
+    int zmq_port;
+
+    explicit ZmqRemoteIndexTransport(int zmq_port) : zmq_port(zmq_port) {}
+
+    bool request(
+            const void* req,
+            size_t req_size,
+            const std::function<bool(const char*, size_t)>& on_reply)
+            override;
+};
+
+/// answers the requests of RemoteIndex for an index
+struct RemoteIndexServer {
+    const Index* index; ///< not owned
+
+    explicit RemoteIndexServer(const Index* index);
+
+    /// decode a request frame, search and encode the reply frame
+    void handle_request(
+            const char* req,
+            size_t req_size,
+            std::vector<uint8_t>& reply) const;
+
+    /** answer the requests received on a ZMQ REP socket bound to endpoint
+     * until stop() is called. The searches of a request are parallelized
+     * with OpenMP. */
+    void serve_zmq(const char* endpoint);
+
+    /// make serve_zmq return (after at most poll_ms)
+    void stop();
+
+    int poll_ms = 100;
+
+   private:
+    std::atomic<bool> stopped{false};
+};
+
+/** Index whose searches are sent to a RemoteIndexServer. It is read-only:
+ * d, ntotal and the metric are those of the remote index (see sync).
+ *
+ * The queries are sent in requests of at most batch_size queries, up to
+ * max_inflight of them concurrently, so that the transfers overlap with
+ * the searches on the server.
+ */
+struct RemoteIndex : Index {
+    std::shared_ptr<RemoteIndexTransport> transport;
+
+    /// max nb of queries per request
+    idx_t batch_size = 1024;
+    /// max nb of requests in flight for one search
+    int max_inflight = 4;
+
+    /** if > 0, a search that did not get all its replies after timeout_ms
+     * returns the results received so far: the other queries have no
+     * results (label -1). The late replies are discarded. With
+     * throw_on_timeout, the search throws instead. */
+    int timeout_ms = 0;
+    bool throw_on_timeout = false;
+
+    /// statistics
+    std::atomic<size_t> n_requests{0};
+    std::atomic<size_t> n_timeouts{0};
+
+    /// fetches the dimension, size and metric of the remote index
+    explicit RemoteIndex(std::shared_ptr<RemoteIndexTransport> transport);
+
+    /// refresh ntotal (and the other properties) from the remote index
+    void sync();
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    /** search in the background: distances and labels are filled when the
+     * future is ready. x, distances and labels must remain valid until
+     * then. */
+    std::future<void> search_async(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels) const;
+
+    /// not supported: the remote index is updated on its server
+    void add(idx_t n, const float* x) override;
+    void reset() override;
+};
+
+} // namespace faiss
@@ -352,6 +352,129 @@ void RandomRotationMatrix::train(idx_t /*n*/, const float* /*x*/) {
     init(12345);
 }
 
+/*********************************************
+ * HadamardRotation
+ *********************************************/
+
+namespace {
+
+// in-place unnormalized Walsh-Hadamard transform, n is a power of 2. The
+// inner loops are over contiguous elements so that they are vectorized.
+void fwht_inplace(size_t n, float* x) {
+    size_t h = 1;
+    // the first levels work within groups of 4 elements
+    if (n >= 4) {
+        for (size_t i = 0; i < n; i += 4) {
+            float a = x[i], b = x[i + 1], c = x[i + 2], e = x[i + 3];
+            float s0 = a + b, d0 = a - b, s1 = c + e, d1 = c - e;
+            x[i] = s0 + s1;
+            x[i + 1] = d0 + d1;
+            x[i + 2] = s0 - s1;
+            x[i + 3] = d0 - d1;
+        }
+        h = 4;
+    }
+    for (; h < n; h *= 2) {
+        for (size_t i = 0; i < n; i += 2 * h) {
+            float* __restrict u = x + i;
+            float* __restrict v = x + i + h;
+            for (size_t j = 0; j < h; j++) {
+                float a = u[j], b = v[j];
+                u[j] = a + b;
+                v[j] = a - b;
+            }
+        }
+    }
+}
+
+} // anonymous namespace
+
+HadamardRotation::HadamardRotation(int d, int seed, int nrounds)
+        : VectorTransform(d, padded_dim(d)), nrounds(nrounds), seed(seed) {
+    FAISS_THROW_IF_NOT(nrounds > 0);
+    init();
+}
+
+int HadamardRotation::padded_dim(int d) {
+    int p = 1;
+    while (p < d) {
+        p *= 2;
+    }
+    return p;
+}
+
+void HadamardRotation::init() {
+    FAISS_THROW_IF_NOT_MSG(
+            d_out == padded_dim(d_in),
+            "HadamardRotation output dimension should be a power of 2");
+    signs.resize(size_t(nrounds) * d_out);
+    RandomGenerator rng(seed);
+    for (float& s : signs) {
+        s = (rng.rand_int() & 1) ? 1.0f : -1.0f;
+    }
+    is_trained = true;
+}
+
+void HadamardRotation::apply_noalloc(idx_t n, const float* x, float* xt)
+        const {
+    FAISS_THROW_IF_NOT(is_trained);
+    const size_t dp = d_out;
+    // each round multiplies the norm by sqrt(dp)
+    const float scale = std::pow(float(dp), -0.5f * nrounds);
+
+#pragma omp parallel for if (n > 1000)
+    for (idx_t i = 0; i < n; i++) {
+        float* y = xt + i * dp;
+        memcpy(y, x + i * d_in, sizeof(float) * d_in);
+        memset(y + d_in, 0, sizeof(float) * (dp - d_in));
+        for (int r = 0; r < nrounds; r++) {
+            const float* sr = signs.data() + r * dp;
+            for (size_t j = 0; j < dp; j++) {
+                y[j] *= sr[j];
+            }
+            fwht_inplace(dp, y);
+        }
+        for (size_t j = 0; j < dp; j++) {
+            y[j] *= scale;
+        }
+    }
+}
+
+void HadamardRotation::reverse_transform(idx_t n, const float* xt, float* x)
+        const {
+    FAISS_THROW_IF_NOT(is_trained);
+    const size_t dp = d_out;
+    const float scale = std::pow(float(dp), -0.5f * nrounds);
+
+#pragma omp parallel if (n > 1000)
+    {
+        std::vector<float> y(dp);
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            memcpy(y.data(), xt + i * dp, sizeof(float) * dp);
+            // H is symmetric, so the inverse of a round is H then the signs
+            for (int r = nrounds - 1; r >= 0; r--) {
+                fwht_inplace(dp, y.data());
+                const float* sr = signs.data() + r * dp;
+                for (size_t j = 0; j < dp; j++) {
+                    y[j] *= sr[j];
+                }
+            }
+            for (int j = 0; j < d_in; j++) {
+                x[i * d_in + j] = y[j] * scale;
+            }
+        }
+    }
+}
+
+void HadamardRotation::check_identical(const VectorTransform& other_in) const {
+    VectorTransform::check_identical(other_in);
+    auto other = dynamic_cast<const HadamardRotation*>(&other_in);
+    FAISS_THROW_IF_NOT(other);
+    FAISS_THROW_IF_NOT(other->nrounds == nrounds);
+    FAISS_THROW_IF_NOT(other->signs == signs);
+}
+
 /*********************************************
  * PCAMatrix
  *********************************************/
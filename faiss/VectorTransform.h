@@ -126,6 +126,41 @@ struct RandomRotationMatrix : LinearTransform {
     RandomRotationMatrix() {}
 };
 
+/** Randomized Hadamard rotation, a structured alternative to
+ * RandomRotationMatrix that costs O(d log d) per vector instead of O(d^2)
+ * and does not store a matrix.
+ *
+ * The input is zero-padded to d_out, the smallest power of 2 >= d_in, then
+ * nrounds times multiplied by random signs and transformed with a fast
+ * Walsh-Hadamard transform. The result is scaled so that the transform is
+ * orthonormal: norms and distances are preserved.
+ */
+struct HadamardRotation : VectorTransform {
+    /// nb of (random signs, Hadamard transform) rounds
+    int nrounds = 3;
+
+    /// seed of the random signs
+    int seed = 12345;
+
+    /// the random signs, size nrounds * d_out, set by init
+    std::vector<float> signs;
+
+    explicit HadamardRotation(int d = 0, int seed = 12345, int nrounds = 3);
+
+    /// draw the random signs, called by the constructor and after loading
+    void init();
+
+    /// smallest power of 2 >= d
+    static int padded_dim(int d);
+
+    void apply_noalloc(idx_t n, const float* x, float* xt) const override;
+
+    /// exact inverse, the padding components are dropped
+    void reverse_transform(idx_t n, const float* xt, float* x) const override;
+
+    void check_identical(const VectorTransform& other) const override;
+};
+
 /** Applies a principal component analysis on a set of vectors,
  *  with optionally whitening and random rotation. */
 struct PCAMatrix : LinearTransform {
@@ -15,8 +15,10 @@
 #include <faiss/impl/FaissAssert.h>
 
 #include <faiss/Index2Layer.h>
+#include <faiss/IndexAdaptiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
+#include <faiss/IndexAdditiveQuantizerWideFastScan.h>
 #include <faiss/IndexBinary.h>
 #include <faiss/IndexBinaryFlat.h>
 #include <faiss/IndexBinaryHNSW.h>
@@ -29,6 +31,7 @@
 #include <faiss/IndexIVFPQ.h>
 #include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
+#include <faiss/IndexIVFRecompute.h>
 #include <faiss/IndexIVFSpectralHash.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexLattice.h>
@@ -36,9 +39,11 @@
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexPreTransform.h>
+#include <faiss/IndexPrefixRefine.h>
 #include <faiss/IndexRefine.h>
 #include <faiss/IndexRowwiseMinMax.h>
 #include <faiss/IndexScalarQuantizer.h>
+#include <faiss/IndexVamana.h>
 
 #include <faiss/MetaIndexes.h>
 #include <faiss/VectorTransform.h>
@@ -77,6 +82,7 @@ VectorTransform* Cloner::clone_VectorTransform(const VectorTransform* vt) {
     TRYCLONE(PCAMatrix, vt)
     TRYCLONE(ITQMatrix, vt)
     TRYCLONE(RandomRotationMatrix, vt)
+    TRYCLONE(HadamardRotation, vt)
     TRYCLONE(LinearTransform, vt) {
         FAISS_THROW_MSG("clone not supported for this type of VectorTransform");
     }
@@ -102,6 +108,7 @@ IndexIVF* Cloner::clone_IndexIVF(const IndexIVF* ivf) {
     TRYCLONE(IndexIVFFlat, ivf)
 
     TRYCLONE(IndexIVFSpectralHash, ivf)
+    TRYCLONE(IndexIVFIDOnly, ivf)
 
     TRYCLONE(IndexIVFScalarQuantizer, ivf) {
         FAISS_THROW_MSG("clone not supported for this type of IndexIVF");
@@ -130,7 +137,9 @@ IndexIDMap* clone_IndexIDMap(const IndexIDMap* im) {
 
 IndexHNSW* clone_IndexHNSW(const IndexHNSW* ihnsw) {
     TRYCLONE(IndexHNSW2Level, ihnsw)
+    TRYCLONE(IndexVamana, ihnsw)
     TRYCLONE(IndexHNSWFlat, ihnsw)
+    TRYCLONE(IndexHNSWPQFastScan, ihnsw)
     TRYCLONE(IndexHNSWPQ, ihnsw)
     TRYCLONE(IndexHNSWSQ, ihnsw)
     TRYCLONE(IndexHNSW, ihnsw) {
@@ -207,6 +216,16 @@ void reset_AdditiveQuantizerIndex(Index* index) {
     } else if (TRYCAST(IndexProductResidualQuantizerFastScan)) {
         res->aq = &res->prq;
         clone_ProductQuantizers(res->prq.quantizers);
+    } else if (TRYCAST(IndexLocalSearchQuantizerWideFastScan)) {
+        res->aq = &res->lsq;
+    } else if (TRYCAST(IndexResidualQuantizerWideFastScan)) {
+        res->aq = &res->rq;
+    } else if (TRYCAST(IndexProductLocalSearchQuantizerWideFastScan)) {
+        res->aq = &res->plsq;
+        clone_ProductQuantizers(res->plsq.quantizers);
+    } else if (TRYCAST(IndexProductResidualQuantizerWideFastScan)) {
+        res->aq = &res->prq;
+        clone_ProductQuantizers(res->prq.quantizers);
     } else if (TRYCAST(IndexLocalSearchQuantizer)) {
         res->aq = &res->lsq;
     } else if (TRYCAST(IndexResidualQuantizer)) {
@@ -240,6 +259,12 @@ Index* clone_AdditiveQuantizerIndex(const Index* index) {
     TRYCLONE(IndexProductResidualQuantizerFastScan, index)
     TRYCLONE(IndexProductLocalSearchQuantizerFastScan, index)
 
+    // IndexAdditiveQuantizerWideFastScan
+    TRYCLONE(IndexResidualQuantizerWideFastScan, index)
+    TRYCLONE(IndexLocalSearchQuantizerWideFastScan, index)
+    TRYCLONE(IndexProductResidualQuantizerWideFastScan, index)
+    TRYCLONE(IndexProductLocalSearchQuantizerWideFastScan, index)
+
     // AdditiveCoarseQuantizer
     TRYCLONE(ResidualCoarseQuantizer, index)
     TRYCLONE(LocalSearchCoarseQuantizer, index) {
@@ -274,11 +299,20 @@ Index* Cloner::clone_Index(const Index* index) {
     TRYCLONE(IndexPQ, index)
     TRYCLONE(IndexLSH, index)
 
+    if (const IndexAdaptiveQuantizer* iaq =
+                dynamic_cast<const IndexAdaptiveQuantizer*>(index)) {
+        IndexAdaptiveQuantizer* res = new IndexAdaptiveQuantizer(*iaq);
+        res->accel = iaq->accel ? clone_Index(iaq->accel) : nullptr;
+        return res;
+    }
+
     // IndexFlat
     TRYCLONE(IndexFlat1D, index)
     TRYCLONE(IndexFlatL2, index)
     TRYCLONE(IndexFlatIP, index)
     TRYCLONE(IndexFlat, index)
+    TRYCLONE(IndexFlatBF16, index)
+    TRYCLONE(IndexFlatInt8, index)
 
     TRYCLONE(IndexLattice, index)
     TRYCLONE(IndexRandom, index)
@@ -330,6 +364,8 @@ Index* Cloner::clone_Index(const Index* index) {
         res->own_fields = true;
         // make sure we don't get a GPU index here
         res->storage = Cloner::clone_Index(ihnsw->storage);
+        // the copy must not share the fetch counter of the original
+        res->fetch_count_ptr = new std::atomic<size_t>(0);
         return res;
     } else if (const IndexNSG* insg = dynamic_cast<const IndexNSG*>(index)) {
         IndexNSG* res = clone_IndexNSG(insg);
@@ -366,6 +402,21 @@ Index* Cloner::clone_Index(const Index* index) {
             res->refine_index = clone_Index(ir->refine_index);
         }
         return res;
+    } else if (
+            const IndexPrefixRefine* ipr =
+                    dynamic_cast<const IndexPrefixRefine*>(index)) {
+        IndexPrefixRefine* res = new IndexPrefixRefine(*ipr);
+        res->own_fields = true;
+        res->base_index = clone_Index(ipr->base_index);
+        res->suffix_index = clone_Index(ipr->suffix_index);
+        return res;
+    } else if (
+            const IndexIVFRecompute* irc =
+                    dynamic_cast<const IndexIVFRecompute*>(index)) {
+        IndexIVFRecompute* res = new IndexIVFRecompute(*irc);
+        res->own_fields = true;
+        res->base_index = dynamic_cast<IndexIVF*>(clone_Index(irc->base_index));
+        return res;
     } else if (
             const IndexRowwiseMinMaxBase* irmmb =
                     dynamic_cast<const IndexRowwiseMinMaxBase*>(index)) {
@@ -374,6 +425,7 @@ Index* Cloner::clone_Index(const Index* index) {
         res->index = clone_Index(irmmb->index);
     } else if (
             dynamic_cast<const IndexAdditiveQuantizerFastScan*>(index) ||
+            dynamic_cast<const IndexAdditiveQuantizerWideFastScan*>(index) ||
             dynamic_cast<const IndexAdditiveQuantizer*>(index) ||
             dynamic_cast<const AdditiveCoarseQuantizer*>(index)) {
         Index* res = clone_AdditiveQuantizerIndex(index);
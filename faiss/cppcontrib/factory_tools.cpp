@@ -36,6 +36,8 @@ const std::map<faiss::ScalarQuantizer::QuantizerType, std::string> sq_types = {
         {faiss::ScalarQuantizer::QT_bf16, "SQbf16"},
         {faiss::ScalarQuantizer::QT_8bit_direct_signed, "SQ8_direct_signed"},
         {faiss::ScalarQuantizer::QT_8bit_direct, "SQ8_direct"},
+        {faiss::ScalarQuantizer::QT_4bit_nonuniform, "SQ4_nonuniform"},
+        {faiss::ScalarQuantizer::QT_8bit_nonuniform, "SQ8_nonuniform"},
 };
 
 int get_hnsw_M(const faiss::IndexHNSW* index) {
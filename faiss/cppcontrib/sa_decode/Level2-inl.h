@@ -17,7 +17,7 @@
 namespace faiss {
 namespace cppcontrib {
 
-bool isBigEndian() {
+inline bool isBigEndian() {
 #ifdef FAISS_BIG_ENDIAN
     return true;
 #else
@@ -13,6 +13,7 @@
 #include <faiss/gpu/StandardGpuResources.h>
 
 #include <faiss/IndexBinaryFlat.h>
+#include <faiss/IndexBinaryIVF.h>
 #include <faiss/IndexFlat.h>
 #if defined USE_NVIDIA_CUVS
 #include <faiss/IndexHNSW.h>
@@ -20,6 +21,7 @@
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFFlat.h>
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFRaBitQ.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexReplicas.h>
 #include <faiss/IndexScalarQuantizer.h>
@@ -27,12 +29,14 @@
 #include <faiss/MetaIndexes.h>
 #include <faiss/gpu/GpuIndex.h>
 #include <faiss/gpu/GpuIndexBinaryFlat.h>
+#include <faiss/gpu/GpuIndexBinaryIVF.h>
 #if defined USE_NVIDIA_CUVS
 #include <faiss/gpu/GpuIndexCagra.h>
 #endif
 #include <faiss/gpu/GpuIndexFlat.h>
 #include <faiss/gpu/GpuIndexIVFFlat.h>
 #include <faiss/gpu/GpuIndexIVFPQ.h>
+#include <faiss/gpu/GpuIndexIVFRaBitQ.h>
 #include <faiss/gpu/GpuIndexIVFScalarQuantizer.h>
 #include <faiss/gpu/utils/DeviceUtils.h>
 #include <faiss/impl/FaissAssert.h>
@@ -63,6 +67,10 @@ void ToCPUCloner::merge_index(Index* dst, Index* src, bool successive_ids) {
         auto ifl2 = dynamic_cast<IndexIVFPQ*>(src);
         FAISS_ASSERT(ifl2);
         ifl->merge_from(*ifl2, successive_ids ? ifl->ntotal : 0);
+    } else if (auto ifl = dynamic_cast<IndexIVFRaBitQ*>(dst)) {
+        auto ifl2 = dynamic_cast<IndexIVFRaBitQ*>(src);
+        FAISS_ASSERT(ifl2);
+        ifl->merge_from(*ifl2, successive_ids ? ifl->ntotal : 0);
     } else {
         FAISS_ASSERT(!"merging not implemented for this type of class");
     }
@@ -86,6 +94,10 @@ Index* ToCPUCloner::clone_Index(const Index* index) {
         IndexIVFPQ* res = new IndexIVFPQ();
         ipq->copyTo(res);
         return res;
+    } else if (auto irq = dynamic_cast<const GpuIndexIVFRaBitQ*>(index)) {
+        IndexIVFRaBitQ* res = new IndexIVFRaBitQ();
+        irq->copyTo(res);
+        return res;
 
         // for IndexShards and IndexReplicas we assume that the
         // objective is to make a single component out of them
@@ -166,6 +178,8 @@ Index* ToGpuCloner::clone_Index(const Index* index) {
         config.device = device;
         config.indicesOptions = indicesOptions;
         config.flatConfig.useFloat16 = useFloat16CoarseQuantizer;
+        // cuVS keeps its own float32 lists
+        config.useFloat16IVFStorage = useFloat16 && !use_cuvs;
         config.use_cuvs = use_cuvs;
         config.allowCpuCoarseQuantizer = allowCpuCoarseQuantizer;
 
@@ -201,6 +215,23 @@ Index* ToGpuCloner::clone_Index(const Index* index) {
 
         res->copyFrom(ifl);
         return res;
+    } else if (
+            auto irq = dynamic_cast<const faiss::IndexIVFRaBitQ*>(index)) {
+        GpuIndexIVFRaBitQConfig config;
+        config.device = device;
+        config.indicesOptions = indicesOptions;
+        config.flatConfig.useFloat16 = useFloat16CoarseQuantizer;
+        FAISS_THROW_IF_NOT_MSG(
+                !use_cuvs, "this type of index is not implemented for cuVS");
+
+        GpuIndexIVFRaBitQ* res = new GpuIndexIVFRaBitQ(
+                provider, irq->d, irq->nlist, irq->metric_type, config);
+        if (reserveVecs > 0 && irq->ntotal == 0) {
+            res->reserveMemory(reserveVecs);
+        }
+
+        res->copyFrom(irq);
+        return res;
     } else if (auto ipq = dynamic_cast<const faiss::IndexIVFPQ*>(index)) {
         if (verbose) {
             printf("  IndexIVFPQ size %ld -> GpuIndexIVFPQ "
@@ -441,7 +472,8 @@ Index* ToGpuClonerMultiple::clone_Index(const Index* index) {
     if (dynamic_cast<const IndexFlat*>(index) ||
         dynamic_cast<const IndexIVFFlat*>(index) ||
         dynamic_cast<const IndexIVFScalarQuantizer*>(index) ||
-        dynamic_cast<const IndexIVFPQ*>(index)) {
+        dynamic_cast<const IndexIVFPQ*>(index) ||
+        (dynamic_cast<const IndexIVFRaBitQ*>(index) && !shard)) {
         if (!shard) {
             IndexReplicas* res = new IndexReplicas();
             for (auto& sub_cloner : sub_cloners) {
@@ -503,11 +535,23 @@ GpuProgressiveDimIndexFactory::GpuProgressiveDimIndexFactory(int ngpu) {
         devices[i] = i;
     }
     ncall = 0;
+    own_resources = true;
+}
+
+GpuProgressiveDimIndexFactory::GpuProgressiveDimIndexFactory(
+        const std::vector<GpuResourcesProvider*>& vres,
+        const std::vector<int>& devices)
+        : vres(vres), devices(devices) {
+    FAISS_THROW_IF_NOT(vres.size() == devices.size());
+    FAISS_THROW_IF_NOT(!vres.empty());
+    ncall = 0;
 }
 
 GpuProgressiveDimIndexFactory::~GpuProgressiveDimIndexFactory() {
-    for (int i = 0; i < vres.size(); i++) {
-        delete vres[i];
+    if (own_resources) {
+        for (int i = 0; i < vres.size(); i++) {
+            delete vres[i];
+        }
     }
 }
 
@@ -527,6 +571,10 @@ faiss::IndexBinary* index_binary_gpu_to_cpu(
         IndexBinaryFlat* ret = new IndexBinaryFlat();
         ii->copyTo(ret);
         return ret;
+    } else if (auto ii = dynamic_cast<const GpuIndexBinaryIVF*>(gpu_index)) {
+        IndexBinaryIVF* ret = new IndexBinaryIVF();
+        ii->copyTo(ret);
+        return ret;
     } else {
         FAISS_THROW_MSG("cannot clone this type of index");
     }
@@ -544,6 +592,10 @@ faiss::IndexBinary* index_binary_cpu_to_gpu(
             config.use_cuvs = options->use_cuvs;
         }
         return new GpuIndexBinaryFlat(provider, ii, config);
+    } else if (auto ii = dynamic_cast<const IndexBinaryIVF*>(index)) {
+        GpuIndexBinaryIVFConfig config;
+        config.device = device;
+        return new GpuIndexBinaryIVF(provider, ii, config);
     } else {
         FAISS_THROW_MSG("cannot clone this type of index");
     }
@@ -89,9 +89,18 @@ struct GpuProgressiveDimIndexFactory : ProgressiveDimIndexFactory {
     std::vector<GpuResourcesProvider*> vres;
     std::vector<int> devices;
     int ncall;
+    bool own_resources = false;
 
+    /// allocate one StandardGpuResources per GPU, owned by the factory
     explicit GpuProgressiveDimIndexFactory(int ngpu);
 
+    /// use existing resources (not owned), so that the k-means and beam
+    /// search of ResidualQuantizer training share them with other GPU
+    /// objects, eg. a GpuIcmEncoderFactory
+    GpuProgressiveDimIndexFactory(
+            const std::vector<GpuResourcesProvider*>& vres,
+            const std::vector<int>& devices);
+
     Index* operator()(int dim) override;
 
     virtual ~GpuProgressiveDimIndexFactory() override;
@@ -29,6 +29,8 @@
 #include <faiss/gpu/impl/Distance.cuh>
 #include <faiss/gpu/utils/ConversionOperators.cuh>
 #include <faiss/gpu/utils/CopyUtils.cuh>
+#include <faiss/gpu/utils/BlockSelectKernel.cuh>
+#include <faiss/gpu/utils/DeviceDefs.cuh>
 #include <faiss/gpu/utils/DeviceTensor.cuh>
 #include <faiss/gpu/utils/Float16.cuh>
 #include <optional>
@@ -555,6 +557,174 @@ void bfKnn_tiling(
     }
 }
 
+// Adds to the labels of each shard's k columns the offset of the shard,
+// keeping -1 (no result) as is
+__global__ void addShardOffsets(
+        Tensor<idx_t, 2, true> indices,
+        int k,
+        Tensor<idx_t, 1, true> offsets) {
+    for (idx_t i = blockIdx.y; i < indices.getSize(0); i += gridDim.y) {
+        for (auto j = threadIdx.x; j < k; j += blockDim.x) {
+            idx_t& label = indices[i][idx_t(blockIdx.x) * k + j];
+            if (label >= 0) {
+                label += offsets[blockIdx.x];
+            }
+        }
+    }
+}
+
+void bfKnnSharded(
+        const std::vector<GpuResourcesProvider*>& resources,
+        const std::vector<GpuDistanceShard>& shards,
+        const GpuDistanceParams& args) {
+    FAISS_THROW_IF_NOT_MSG(
+            !shards.empty() && resources.size() == shards.size(),
+            "bfKnnSharded: need one resources object per shard");
+    FAISS_THROW_IF_NOT_MSG(
+            args.k > 0 && args.k <= GPU_MAX_SELECTION_K,
+            "bfKnnSharded: k must be in (0, GPU_MAX_SELECTION_K]");
+    FAISS_THROW_IF_NOT_MSG(
+            args.queriesRowMajor && args.vectorsRowMajor,
+            "bfKnnSharded: only row major data is supported");
+    FAISS_THROW_IF_NOT_MSG(
+            args.outIndicesType == IndicesDataType::I64,
+            "bfKnnSharded: only int64 output indices are supported");
+    FAISS_THROW_IF_NOT_MSG(
+            args.outDistances && args.outIndices,
+            "bfKnnSharded: outDistances and outIndices must be provided");
+
+    int root = args.device >= 0 ? args.device : getCurrentDevice();
+    int nshard = shards.size();
+    idx_t nq = args.numQueries;
+    int k = args.k;
+
+    // Don't let the resources go out of scope
+    std::vector<std::shared_ptr<GpuResources>> resImpls;
+    for (auto prov : resources) {
+        resImpls.push_back(prov->getResources());
+    }
+
+    // Search each shard on its device. The searches are queued on the
+    // default stream of each device and run concurrently
+    std::vector<DeviceTensor<float, 2, true>> shardDistances(nshard);
+    std::vector<DeviceTensor<idx_t, 2, true>> shardIndices(nshard);
+    std::vector<CudaEvent> shardDone;
+    std::vector<idx_t> offsets(nshard);
+    idx_t ntotal = 0;
+
+    for (int i = 0; i < nshard; ++i) {
+        const GpuDistanceShard& shard = shards[i];
+        FAISS_THROW_IF_NOT_FMT(
+                shard.numVectors > 0 && shard.vectors,
+                "bfKnnSharded: shard %d is empty",
+                i);
+        offsets[i] = ntotal;
+        ntotal += shard.numVectors;
+
+        DeviceScope scope(shard.device);
+        auto res = resImpls[i].get();
+        auto stream = res->getDefaultStreamCurrentDevice();
+
+        shardDistances[i] = DeviceTensor<float, 2, true>(
+                res, makeDevAlloc(AllocType::Other, stream), {nq, k});
+        shardIndices[i] = DeviceTensor<idx_t, 2, true>(
+                res, makeDevAlloc(AllocType::Other, stream), {nq, k});
+
+        GpuDistanceParams shardArgs = args;
+        shardArgs.device = shard.device;
+        shardArgs.vectors = shard.vectors;
+        shardArgs.numVectors = shard.numVectors;
+        shardArgs.vectorNorms = shard.vectorNorms;
+        shardArgs.outDistances = shardDistances[i].data();
+        shardArgs.outIndices = shardIndices[i].data();
+        shardArgs.ignoreOutDistances = false;
+        bfKnn(resources[i], shardArgs);
+
+        shardDone.emplace_back(stream);
+    }
+
+    // Gather the partial results on the root device, shard i in columns
+    // [i * k, (i + 1) * k)
+    DeviceScope scope(root);
+    auto rootRes = resImpls[0].get();
+    auto stream = rootRes->getDefaultStreamCurrentDevice();
+
+    DeviceTensor<float, 2, true> allDistances(
+            rootRes,
+            makeTempAlloc(AllocType::Other, stream),
+            {nq, (idx_t)nshard * k});
+    DeviceTensor<idx_t, 2, true> allIndices(
+            rootRes,
+            makeTempAlloc(AllocType::Other, stream),
+            {nq, (idx_t)nshard * k});
+
+    for (int i = 0; i < nshard; ++i) {
+        int dev = shards[i].device;
+        if (dev != root) {
+            int canAccess = 0;
+            CUDA_VERIFY(cudaDeviceCanAccessPeer(&canAccess, root, dev));
+            if (canAccess) {
+                auto err = cudaDeviceEnablePeerAccess(dev, 0);
+                if (err == cudaErrorPeerAccessAlreadyEnabled) {
+                    // clear the sticky error
+                    cudaGetLastError();
+                } else {
+                    CUDA_VERIFY(err);
+                }
+            }
+        }
+
+        shardDone[i].streamWaitOnEvent(stream);
+        CUDA_VERIFY(cudaMemcpy2DAsync(
+                allDistances.data() + (idx_t)i * k,
+                nshard * k * sizeof(float),
+                shardDistances[i].data(),
+                k * sizeof(float),
+                k * sizeof(float),
+                nq,
+                cudaMemcpyDefault,
+                stream));
+        CUDA_VERIFY(cudaMemcpy2DAsync(
+                allIndices.data() + (idx_t)i * k,
+                nshard * k * sizeof(idx_t),
+                shardIndices[i].data(),
+                k * sizeof(idx_t),
+                k * sizeof(idx_t),
+                nq,
+                cudaMemcpyDefault,
+                stream));
+    }
+
+    // Make the labels global and merge
+    auto tOffsets = toDeviceTemporary<idx_t, 1>(
+            rootRes, root, offsets.data(), stream, {(idx_t)nshard});
+    dim3 grid(nshard, std::min(nq, (idx_t)getMaxGridCurrentDevice().y));
+    auto block = std::min(k, getMaxThreadsCurrentDevice());
+    addShardOffsets<<<grid, block, 0, stream>>>(allIndices, k, tOffsets);
+    CUDA_TEST_ERROR();
+
+    auto tOutDistances = toDeviceTemporary<float, 2>(
+            rootRes, root, args.outDistances, stream, {nq, k});
+    auto tOutIndices = toDeviceTemporary<idx_t, 2>(
+            rootRes, root, (idx_t*)args.outIndices, stream, {nq, k});
+
+    runBlockSelectPair(
+            allDistances,
+            allIndices,
+            tOutDistances,
+            tOutIndices,
+            is_similarity_metric(args.metric),
+            k,
+            stream);
+
+    fromDevice<float, 2>(tOutDistances, args.outDistances, stream);
+    fromDevice<idx_t, 2>(tOutIndices, (idx_t*)args.outIndices, stream);
+
+    // The shard buffers are released on their devices once the copies are
+    // done
+    CUDA_VERIFY(cudaStreamSynchronize(stream));
+}
+
 // legacy version
 void bruteForceKnn(
         GpuResourcesProvider* res,
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <faiss/Index.h>
+#include <vector>
 
 #pragma GCC visibility push(default)
 namespace faiss {
@@ -151,6 +152,34 @@ void bfKnn_tiling(
         size_t vectorsMemoryLimit,
         size_t queriesMemoryLimit);
 
+/// A shard of the database searched by bfKnnSharded
+struct GpuDistanceShard {
+    /// GPU device on which the shard is searched
+    int device = 0;
+
+    /// numVectors x dims, row major, in the GpuDistanceParams vectorType.
+    /// Either on `device` (best, searched in place) or on the CPU
+    const void* vectors = nullptr;
+    idx_t numVectors = 0;
+
+    /// Optional precomputed L2 norms of `vectors`
+    const float* vectorNorms = nullptr;
+};
+
+/// Brute-force k-nearest neighbor search of a database split over several
+/// GPUs. Shard i is searched on shards[i].device with resources[i]; its
+/// vector j is reported as label (sum of the sizes of shards < i) + j.
+/// The per-shard top-k results are copied device to device (peer to peer
+/// when available) to the device of `args` (args.device, or the current
+/// device if -1) where they are merged, so the host only sees the final
+/// results. args.vectors, args.numVectors and args.vectorNorms are
+/// ignored; requires row major data, 0 < k <= GPU_MAX_SELECTION_K and
+/// int64 output indices
+void bfKnnSharded(
+        const std::vector<GpuResourcesProvider*>& resources,
+        const std::vector<GpuDistanceShard>& shards,
+        const GpuDistanceParams& args);
+
 /// Deprecated legacy implementation
 void bruteForceKnn(
         GpuResourcesProvider* resources,
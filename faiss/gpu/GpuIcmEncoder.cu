@@ -8,6 +8,7 @@
 #include <faiss/gpu/GpuIcmEncoder.h>
 
 #include <faiss/gpu/StandardGpuResources.h>
+#include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/WorkerThread.h>
 #include <faiss/gpu/impl/IcmEncoder.cuh>
 
@@ -116,6 +117,23 @@ GpuIcmEncoderFactory::GpuIcmEncoderFactory(int ngpus) {
         provs.push_back(new StandardGpuResources());
         devices.push_back(i);
     }
+    own_resources = true;
+}
+
+GpuIcmEncoderFactory::GpuIcmEncoderFactory(
+        const std::vector<GpuResourcesProvider*>& provs,
+        const std::vector<int>& devices)
+        : provs(provs), devices(devices) {
+    FAISS_THROW_IF_NOT(provs.size() == devices.size());
+    FAISS_THROW_IF_NOT(!provs.empty());
+}
+
+GpuIcmEncoderFactory::~GpuIcmEncoderFactory() {
+    if (own_resources) {
+        for (auto prov : provs) {
+            delete prov;
+        }
+    }
 }
 
 lsq::IcmEncoder* GpuIcmEncoderFactory::get(const LocalSearchQuantizer* lsq) {
@@ -48,12 +48,22 @@ class GpuIcmEncoder : public lsq::IcmEncoder {
 };
 
 struct GpuIcmEncoderFactory : public lsq::IcmEncoderFactory {
+    /// allocate one StandardGpuResources per GPU, owned by the factory
     explicit GpuIcmEncoderFactory(int ngpus = 1);
 
+    /// use existing resources (not owned), eg. shared with the GPU indexes
+    /// of a ResidualQuantizer assign_index_factory
+    GpuIcmEncoderFactory(
+            const std::vector<GpuResourcesProvider*>& provs,
+            const std::vector<int>& devices);
+
+    ~GpuIcmEncoderFactory() override;
+
     lsq::IcmEncoder* get(const LocalSearchQuantizer* lsq) override;
 
     std::vector<GpuResourcesProvider*> provs;
     std::vector<int> devices;
+    bool own_resources = false;
 };
 
 } // namespace gpu
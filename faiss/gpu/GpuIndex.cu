@@ -16,6 +16,7 @@
 #include <faiss/gpu/utils/StaticUtils.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/gpu/utils/CopyUtils.cuh>
+#include <faiss/gpu/utils/DeviceTensor.cuh>
 
 #include <algorithm>
 #include <limits>
@@ -42,6 +43,36 @@ constexpr idx_t kAddVecSize = (idx_t)512 * 1024;
 // FIXME: parameterize based on algorithm need
 constexpr idx_t kSearchVecSize = (idx_t)32 * 1024;
 
+// Maximum number of search shapes for which we keep a CUDA graph
+constexpr size_t kMaxSearchGraphs = 64;
+
+struct GpuIndex::SearchGraph {
+    SearchGraph(
+            GpuResources* res,
+            cudaStream_t stream,
+            idx_t n,
+            int dim,
+            int k)
+            : queries(res, makeDevAlloc(AllocType::Other, stream), {n, dim}),
+              distances(res, makeDevAlloc(AllocType::Other, stream), {n, k}),
+              labels(res, makeDevAlloc(AllocType::Other, stream), {n, k}),
+              exec(nullptr) {}
+
+    ~SearchGraph() {
+        if (exec) {
+            cudaGraphExecDestroy(exec);
+        }
+    }
+
+    /// The graph reads and writes these buffers, which stay allocated for
+    /// as long as the graph exists
+    DeviceTensor<float, 2, true> queries;
+    DeviceTensor<float, 2, true> distances;
+    DeviceTensor<idx_t, 2, true> labels;
+
+    cudaGraphExec_t exec;
+};
+
 bool should_use_cuvs(GpuIndexConfig config_) {
     auto prop = getDeviceProperties(config_.device);
 
@@ -227,6 +258,11 @@ void GpuIndex::search(
         return;
     }
 
+    if (config_.useCudaGraphs && n <= config_.cudaGraphMaxQueries &&
+        searchWithGraph_(n, x, k, distances, labels, params)) {
+        return;
+    }
+
     auto stream = resources_->getDefaultStream(config_.device);
 
     // We guarantee that the searchImpl_ will be called with device-resident
@@ -271,6 +307,260 @@ void GpuIndex::search(
     fromDevice<idx_t, 2>(outLabels, labels, stream);
 }
 
+bool GpuIndex::getSearchGraphKey(
+        const SearchParameters* /* params */,
+        std::vector<int64_t>& /* key */) const {
+    return false;
+}
+
+void GpuIndex::resetSearchGraphs() const {
+    DeviceScope scope(config_.device);
+    std::lock_guard<std::mutex> lock(searchGraphsMutex_);
+
+    // The buffers may still be in use by a replayed graph
+    resources_->syncDefaultStream(config_.device);
+    searchGraphs_.clear();
+}
+
+bool GpuIndex::searchWithGraph_(
+        idx_t n,
+        const float* x,
+        int k,
+        float* outDistancesData,
+        idx_t* outIndicesData,
+        const SearchParameters* params) const {
+    std::vector<int64_t> key;
+    if (!getSearchGraphKey(params, key)) {
+        return false;
+    }
+    key.push_back(n);
+    key.push_back(k);
+
+    auto stream = resources_->getDefaultStream(config_.device);
+
+    // The caller may be capturing the search in a graph of its own
+    if (isStreamCapturing(stream)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(searchGraphsMutex_);
+
+    std::shared_ptr<SearchGraph> graph;
+    auto it = searchGraphs_.find(key);
+
+    if (it != searchGraphs_.end()) {
+        if (!it->second) {
+            // A previous capture of this shape failed
+            return false;
+        }
+        graph = it->second;
+    } else {
+        if (searchGraphs_.size() >= kMaxSearchGraphs) {
+            resources_->syncDefaultStream(config_.device);
+            searchGraphs_.clear();
+        }
+
+        graph = std::make_shared<SearchGraph>(
+                resources_.get(), stream, n, this->d, k);
+    }
+
+    CUDA_VERIFY(cudaMemcpyAsync(
+            graph->queries.data(),
+            x,
+            graph->queries.getSizeInBytes(),
+            cudaMemcpyDefault,
+            stream));
+
+    if (graph->exec) {
+        CUDA_VERIFY(cudaGraphLaunch(graph->exec, stream));
+    } else {
+        // The first search of this shape runs normally and provides the
+        // results; it also sizes the temporary memory and the library
+        // handles exactly as the capture below will find them
+        searchImpl_(
+                n,
+                graph->queries.data(),
+                k,
+                graph->distances.data(),
+                graph->labels.data(),
+                params);
+
+        // The capture may only depend on work ordered on our stream (see
+        // StackDeviceMemory::Stack::getAlloc)
+        CUDA_VERIFY(cudaDeviceSynchronize());
+
+        // Capture fails on the legacy null stream
+        cudaGraph_t cudaGraph = nullptr;
+        bool captured = cudaStreamBeginCapture(
+                                stream, cudaStreamCaptureModeThreadLocal) ==
+                cudaSuccess;
+
+        if (captured) {
+            try {
+                searchImpl_(
+                        n,
+                        graph->queries.data(),
+                        k,
+                        graph->distances.data(),
+                        graph->labels.data(),
+                        params);
+            } catch (const std::exception&) {
+                // e.g., temporary memory exhausted, which would require a
+                // cudaMalloc that cannot be captured
+                captured = false;
+            }
+
+            captured = cudaStreamEndCapture(stream, &cudaGraph) ==
+                            cudaSuccess &&
+                    captured;
+        }
+
+        if (captured) {
+            captured = cudaGraphInstantiateWithFlags(
+                               &graph->exec, cudaGraph, 0) == cudaSuccess;
+        }
+        if (cudaGraph) {
+            cudaGraphDestroy(cudaGraph);
+        }
+
+        if (!captured) {
+            // Clear the error state left by the failed capture
+            cudaGetLastError();
+            graph->exec = nullptr;
+        }
+
+        searchGraphs_[key] = captured ? graph : nullptr;
+    }
+
+    fromDevice<float, 2>(graph->distances, outDistancesData, stream);
+    fromDevice<idx_t, 2>(graph->labels, outIndicesData, stream);
+
+    return true;
+}
+
+GpuSearchFuture::GpuSearchFuture(cudaStream_t stream) {
+    cudaEvent_t event;
+    CUDA_VERIFY(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+    event_.reset(event, [](cudaEvent_t e) { cudaEventDestroy(e); });
+
+    CUDA_VERIFY(cudaEventRecord(event, stream));
+}
+
+bool GpuSearchFuture::isReady() const {
+    if (!event_) {
+        return true;
+    }
+
+    auto err = cudaEventQuery(event_.get());
+    FAISS_ASSERT_FMT(
+            err == cudaSuccess || err == cudaErrorNotReady,
+            "cudaEventQuery failed (error %d %s)",
+            (int)err,
+            cudaGetErrorString(err));
+
+    return err == cudaSuccess;
+}
+
+void GpuSearchFuture::wait() const {
+    if (event_) {
+        CUDA_VERIFY(cudaEventSynchronize(event_.get()));
+    }
+}
+
+cudaEvent_t GpuSearchFuture::getEvent() const {
+    return event_.get();
+}
+
+GpuSearchFuture GpuIndex::searchAsync(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        cudaStream_t stream,
+        const SearchParameters* params) const {
+    DeviceScope scope(config_.device);
+    FAISS_THROW_IF_NOT_MSG(this->is_trained, "Index not trained");
+
+    validateKSelect(k);
+
+    if (n == 0 || k == 0) {
+        // nothing to search
+        return GpuSearchFuture(stream);
+    }
+
+    // Pageable host memory would require synchronous staging copies
+    auto onDevice = [this](const void* p) {
+        return getDeviceForAddress(p) == config_.device;
+    };
+    for (const void* p : {(const void*)x, (const void*)distances,
+                          (const void*)labels}) {
+        FAISS_THROW_IF_NOT_FMT(
+                onDevice(p) || isPinnedHostMemory(p),
+                "GpuIndex::searchAsync: buffers must be resident on "
+                "device %d or in page-locked host memory",
+                config_.device);
+    }
+
+    auto indexStream = resources_->getDefaultStream(config_.device);
+
+    // Our work follows what was enqueued on the user stream so far
+    if (stream != indexStream) {
+        streamWait({indexStream}, {stream});
+    }
+
+    // Copies from page-locked memory are asynchronous
+    auto queries = toDeviceTemporary<float, 2>(
+            resources_.get(),
+            config_.device,
+            const_cast<float*>(x),
+            indexStream,
+            {n, this->d});
+
+    auto outDistances = onDevice(distances)
+            ? DeviceTensor<float, 2, true>(distances, {n, k})
+            : DeviceTensor<float, 2, true>(
+                      resources_.get(),
+                      makeTempAlloc(AllocType::Other, indexStream),
+                      {n, k});
+
+    auto outLabels = onDevice(labels)
+            ? DeviceTensor<idx_t, 2, true>(labels, {n, k})
+            : DeviceTensor<idx_t, 2, true>(
+                      resources_.get(),
+                      makeTempAlloc(AllocType::Other, indexStream),
+                      {n, k});
+
+    searchImpl_(
+            n, queries.data(), k, outDistances.data(), outLabels.data(), params);
+
+    // Unlike fromDevice, don't synchronize on copies to the host
+    if (outDistances.data() != distances) {
+        CUDA_VERIFY(cudaMemcpyAsync(
+                distances,
+                outDistances.data(),
+                outDistances.getSizeInBytes(),
+                cudaMemcpyDeviceToHost,
+                indexStream));
+    }
+
+    if (outLabels.data() != labels) {
+        CUDA_VERIFY(cudaMemcpyAsync(
+                labels,
+                outLabels.data(),
+                outLabels.getSizeInBytes(),
+                cudaMemcpyDeviceToHost,
+                indexStream));
+    }
+
+    // Work enqueued on the user stream from now on sees the results
+    if (stream != indexStream) {
+        streamWait({stream}, {indexStream});
+    }
+
+    return GpuSearchFuture(stream);
+}
+
 void GpuIndex::search_and_reconstruct(
         idx_t n,
         const float* x,
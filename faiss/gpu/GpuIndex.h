@@ -25,6 +25,11 @@
 
 #include <faiss/Index.h>
 #include <faiss/gpu/GpuResources.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 namespace faiss {
 namespace gpu {
@@ -44,12 +49,46 @@ struct GpuIndexConfig {
 #else
     bool use_cuvs = false;
 #endif
+
+    /// Should searches of at most cudaGraphMaxQueries queries be replayed
+    /// as CUDA graphs? A graph is captured on the first search of each
+    /// (nq, k, search parameters) shape, and replaces the many kernel
+    /// launches of later searches of that shape by a single graph launch.
+    /// Only some index types support this (see
+    /// GpuIndex::getSearchGraphKey); other searches run as usual
+    bool useCudaGraphs = false;
+
+    /// Maximum number of queries of a search replayed as a CUDA graph
+    idx_t cudaGraphMaxQueries = 16;
 };
 
 /// A centralized function that determines whether cuVS should
 /// be used based on various conditions (such as unsupported architecture)
 bool should_use_cuvs(GpuIndexConfig config_);
 
+/// Completion handle of a search enqueued with GpuIndex::searchAsync.
+/// Copies refer to the same search
+class GpuSearchFuture {
+   public:
+    GpuSearchFuture() = default;
+
+    /// Records the completion event on `stream`
+    explicit GpuSearchFuture(cudaStream_t stream);
+
+    /// Has the search completed? Does not block
+    bool isReady() const;
+
+    /// Blocks the calling thread until the search has completed
+    void wait() const;
+
+    /// Event that is complete once the results are available, for other
+    /// streams to wait on; nullptr if nothing was enqueued
+    cudaEvent_t getEvent() const;
+
+   private:
+    std::shared_ptr<std::remove_pointer<cudaEvent_t>::type> event_;
+};
+
 class GpuIndex : public faiss::Index {
    public:
     GpuIndex(
@@ -98,6 +137,24 @@ class GpuIndex : public faiss::Index {
             idx_t* labels,
             const SearchParameters* params = nullptr) const override;
 
+    /// Enqueues a search on the user stream `stream` and returns without
+    /// waiting for its results: the search runs after the work previously
+    /// enqueued on `stream`, and work enqueued on `stream` afterwards sees
+    /// its results. `x`, `distances` and `labels` must be resident on our
+    /// device or in page-locked host memory (cudaHostAlloc or
+    /// cudaHostRegister), which is then copied asynchronously; they must
+    /// stay valid until the returned future is ready. The calling thread
+    /// may still block for the CPU-side steps of some indices (e.g.,
+    /// INDICES_CPU), and searches are not paged
+    GpuSearchFuture searchAsync(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            cudaStream_t stream,
+            const SearchParameters* params = nullptr) const;
+
     /// `x`, `distances` and `labels` and `recons` can be resident on the CPU or
     /// any GPU; copies are performed as needed
     void search_and_reconstruct(
@@ -122,6 +179,19 @@ class GpuIndex : public faiss::Index {
             float* residuals,
             const idx_t* keys) const override;
 
+    /// Fills `key` with everything a search with `params` depends on
+    /// besides the queries, nq and k: the search parameters, and the
+    /// device pointers and sizes of the data structures scanned. A search
+    /// captured as a CUDA graph is replayed as long as the key is
+    /// unchanged. Returns false if such searches cannot be captured (the
+    /// default)
+    virtual bool getSearchGraphKey(
+            const SearchParameters* params,
+            std::vector<int64_t>& key) const;
+
+    /// Releases the CUDA graphs captured by previous searches
+    void resetSearchGraphs() const;
+
    protected:
     /// Copy what we need from the CPU equivalent
     void copyFrom(const faiss::Index* index);
@@ -174,6 +244,28 @@ class GpuIndex : public faiss::Index {
             idx_t* outIndicesData,
             const SearchParameters* params) const;
 
+    /// Performs the search by replaying a CUDA graph captured for this
+    /// shape, capturing it first if needed. Returns false if the search
+    /// cannot be captured and must run as usual
+    bool searchWithGraph_(
+            idx_t n,
+            const float* x,
+            int k,
+            float* outDistancesData,
+            idx_t* outIndicesData,
+            const SearchParameters* params) const;
+
+    /// Instantiated search graph with its input and output buffers
+    struct SearchGraph;
+
+    /// Search graphs by key (see getSearchGraphKey); a null entry marks a
+    /// shape that could not be captured
+    mutable std::map<std::vector<int64_t>, std::shared_ptr<SearchGraph>>
+            searchGraphs_;
+
+    /// Protects searchGraphs_ and the buffers of the graphs
+    mutable std::mutex searchGraphsMutex_;
+
    protected:
     /// Manages streams, cuBLAS handles and scratch memory for devices
     std::shared_ptr<GpuResources> resources_;
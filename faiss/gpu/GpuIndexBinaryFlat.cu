@@ -10,6 +10,7 @@
 #include <faiss/gpu/GpuResources.h>
 #include <faiss/gpu/impl/IndexUtils.h>
 #include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/gpu/impl/BinaryFlatIndex.cuh>
 #include <faiss/gpu/utils/ConversionOperators.cuh>
 #include <faiss/gpu/utils/CopyUtils.cuh>
@@ -193,6 +194,32 @@ void GpuIndexBinaryFlat::search(
     fromDevice<idx_t, 2>(outIndices, labels, stream);
 }
 
+void GpuIndexBinaryFlat::range_search(
+        idx_t n,
+        const uint8_t* x,
+        int radius,
+        RangeSearchResult* result,
+        const SearchParameters* params) const {
+    DeviceScope scope(binaryFlatConfig_.device);
+    auto stream = resources_->getDefaultStream(binaryFlatConfig_.device);
+
+    FAISS_THROW_IF_NOT(result->nq == n);
+    if (n == 0) {
+        return;
+    }
+
+    FAISS_THROW_IF_NOT_MSG(!params, "params not implemented");
+
+    auto vecs = toDeviceTemporary<uint8_t, 2>(
+            resources_.get(),
+            binaryFlatConfig_.device,
+            const_cast<uint8_t*>(x),
+            stream,
+            {n, (this->d / 8)});
+
+    data_->rangeQuery(vecs, radius, result);
+}
+
 void GpuIndexBinaryFlat::searchNonPaged_(
         idx_t n,
         const uint8_t* x,
@@ -66,6 +66,14 @@ class GpuIndexBinaryFlat : public IndexBinary {
             faiss::idx_t* labels,
             const faiss::SearchParameters* params = nullptr) const override;
 
+    /// Returns the vectors at a Hamming distance < radius of the queries
+    void range_search(
+            idx_t n,
+            const uint8_t* x,
+            int radius,
+            RangeSearchResult* result,
+            const faiss::SearchParameters* params = nullptr) const override;
+
     void reconstruct(faiss::idx_t key, uint8_t* recons) const override;
 
    protected:
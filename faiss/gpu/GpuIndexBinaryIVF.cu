@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/gpu/GpuIndexBinaryIVF.h>
+
+#include <faiss/IndexBinaryFlat.h>
+#include <faiss/gpu/GpuResources.h>
+#include <faiss/gpu/impl/IndexUtils.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/gpu/impl/BinaryIVFIndex.cuh>
+#include <faiss/gpu/utils/CopyUtils.cuh>
+
+#include <algorithm>
+
+namespace faiss {
+namespace gpu {
+
+namespace {
+
+/// Computes the nprobe closest lists of the queries, which are on the device
+DeviceTensor<idx_t, 2, true> searchCoarse(
+        GpuResources* res,
+        GpuIndexBinaryFlat* quantizer,
+        Tensor<unsigned char, 2, true>& queries,
+        idx_t nprobe,
+        cudaStream_t stream) {
+    idx_t n = queries.getSize(0);
+
+    DeviceTensor<int, 2, true> coarseDistances(
+            res, makeTempAlloc(AllocType::Other, stream), {n, nprobe});
+    DeviceTensor<idx_t, 2, true> coarseIndices(
+            res, makeTempAlloc(AllocType::Other, stream), {n, nprobe});
+
+    quantizer->search(
+            n,
+            queries.data(),
+            nprobe,
+            coarseDistances.data(),
+            coarseIndices.data());
+
+    return coarseIndices;
+}
+
+} // namespace
+
+GpuIndexBinaryIVF::GpuIndexBinaryIVF(
+        GpuResourcesProvider* provider,
+        const faiss::IndexBinaryIVF* index,
+        GpuIndexBinaryIVFConfig config)
+        : IndexBinary(index->d),
+          nlist(index->nlist),
+          resources_(provider->getResources()),
+          binaryIVFConfig_(config) {
+    FAISS_THROW_IF_NOT_FMT(
+            this->d % 8 == 0,
+            "vector dimension (number of bits) "
+            "must be divisible by 8 (passed %d)",
+            this->d);
+
+    copyFrom(index);
+}
+
+GpuIndexBinaryIVF::GpuIndexBinaryIVF(
+        GpuResourcesProvider* provider,
+        int dims,
+        idx_t nlist,
+        GpuIndexBinaryIVFConfig config)
+        : IndexBinary(dims),
+          nlist(nlist),
+          resources_(provider->getResources()),
+          binaryIVFConfig_(std::move(config)) {
+    DeviceScope scope(binaryIVFConfig_.device);
+    FAISS_THROW_IF_NOT_FMT(
+            this->d % 8 == 0,
+            "vector dimension (number of bits) "
+            "must be divisible by 8 (passed %d)",
+            this->d);
+    FAISS_THROW_IF_NOT_MSG(nlist > 0, "nlist must be > 0");
+
+    this->is_trained = false;
+
+    GpuIndexBinaryFlatConfig quantizerConfig;
+    quantizerConfig.device = binaryIVFConfig_.device;
+    quantizerConfig.memorySpace = binaryIVFConfig_.memorySpace;
+
+    GpuResourcesProviderFromInstance pfi(resources_);
+    quantizer_.reset(new GpuIndexBinaryFlat(&pfi, this->d, quantizerConfig));
+
+    index_.reset(new BinaryIVFIndex(
+            resources_.get(), this->d, nlist, binaryIVFConfig_.memorySpace));
+}
+
+GpuIndexBinaryIVF::~GpuIndexBinaryIVF() {}
+
+int GpuIndexBinaryIVF::getDevice() const {
+    return binaryIVFConfig_.device;
+}
+
+std::shared_ptr<GpuResources> GpuIndexBinaryIVF::getResources() {
+    return resources_;
+}
+
+GpuIndexBinaryFlat* GpuIndexBinaryIVF::getQuantizer() {
+    return quantizer_.get();
+}
+
+void GpuIndexBinaryIVF::copyFrom(const faiss::IndexBinaryIVF* index) {
+    DeviceScope scope(binaryIVFConfig_.device);
+    auto stream = resources_->getDefaultStream(binaryIVFConfig_.device);
+
+    FAISS_THROW_IF_NOT(index->nlist > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            index->quantizer, "the CPU index must have a coarse quantizer");
+    FAISS_THROW_IF_NOT_MSG(
+            index->quantizer->ntotal == index->nlist,
+            "the coarse quantizer must contain nlist centroids");
+    FAISS_THROW_IF_NOT_MSG(index->invlists, "the CPU index has no invlists");
+
+    this->d = index->d;
+    this->code_size = index->code_size;
+    this->is_trained = index->is_trained;
+    nlist = index->nlist;
+    validateNProbe(index->nprobe);
+    nprobe = index->nprobe;
+    cp = index->cp;
+
+    // The coarse quantizer can be of any type, its centroids are copied to a
+    // GpuIndexBinaryFlat
+    std::vector<uint8_t> centroids(nlist * code_size);
+    index->quantizer->reconstruct_n(0, nlist, centroids.data());
+
+    GpuIndexBinaryFlatConfig quantizerConfig;
+    quantizerConfig.device = binaryIVFConfig_.device;
+    quantizerConfig.memorySpace = binaryIVFConfig_.memorySpace;
+
+    // destroy old first before allocating new
+    quantizer_.reset();
+    index_.reset();
+
+    GpuResourcesProviderFromInstance pfi(resources_);
+    quantizer_.reset(new GpuIndexBinaryFlat(&pfi, this->d, quantizerConfig));
+    quantizer_->add(nlist, centroids.data());
+
+    index_.reset(new BinaryIVFIndex(
+            resources_.get(), this->d, nlist, binaryIVFConfig_.memorySpace));
+
+    this->ntotal = 0;
+    for (idx_t l = 0; l < nlist; ++l) {
+        size_t listSize = index->invlists->list_size(l);
+        if (listSize == 0) {
+            continue;
+        }
+
+        InvertedLists::ScopedCodes codes(index->invlists, l);
+        InvertedLists::ScopedIds ids(index->invlists, l);
+        index_->appendVectors(l, codes.get(), ids.get(), listSize, stream);
+        this->ntotal += listSize;
+    }
+
+    FAISS_ASSERT(this->ntotal == index->ntotal);
+}
+
+void GpuIndexBinaryIVF::copyTo(faiss::IndexBinaryIVF* index) const {
+    DeviceScope scope(binaryIVFConfig_.device);
+
+    index->d = this->d;
+    index->code_size = this->code_size;
+    index->ntotal = this->ntotal;
+    index->is_trained = this->is_trained;
+    index->nlist = nlist;
+    index->nprobe = nprobe;
+    index->cp = cp;
+
+    if (index->own_fields) {
+        delete index->quantizer;
+    }
+    auto quantizer = new IndexBinaryFlat(this->d);
+    quantizer_->copyTo(quantizer);
+    index->quantizer = quantizer;
+    index->own_fields = true;
+
+    auto invlists = new ArrayInvertedLists(nlist, this->code_size);
+    for (idx_t l = 0; l < nlist; ++l) {
+        idx_t listSize = index_->getListLength(l);
+        if (listSize == 0) {
+            continue;
+        }
+
+        auto codes = index_->getListVectors(l);
+        auto ids = index_->getListIndices(l);
+        invlists->add_entries(l, listSize, ids.data(), codes.data());
+    }
+    index->replace_invlists(invlists, true);
+    index->make_direct_map(false);
+}
+
+idx_t GpuIndexBinaryIVF::getListLength(idx_t listId) const {
+    DeviceScope scope(binaryIVFConfig_.device);
+    FAISS_THROW_IF_NOT(listId >= 0 && listId < nlist);
+
+    return index_->getListLength(listId);
+}
+
+std::vector<uint8_t> GpuIndexBinaryIVF::getListVectorData(
+        idx_t listId) const {
+    DeviceScope scope(binaryIVFConfig_.device);
+    FAISS_THROW_IF_NOT(listId >= 0 && listId < nlist);
+
+    return index_->getListVectors(listId);
+}
+
+std::vector<idx_t> GpuIndexBinaryIVF::getListIndices(idx_t listId) const {
+    DeviceScope scope(binaryIVFConfig_.device);
+    FAISS_THROW_IF_NOT(listId >= 0 && listId < nlist);
+
+    return index_->getListIndices(listId);
+}
+
+void GpuIndexBinaryIVF::train(idx_t n, const uint8_t* x) {
+    DeviceScope scope(binaryIVFConfig_.device);
+    auto stream = resources_->getDefaultStream(binaryIVFConfig_.device);
+
+    if (this->is_trained) {
+        FAISS_ASSERT(quantizer_->ntotal == nlist);
+        return;
+    }
+
+    // The binary k-means is the one of the CPU index
+    auto hostX = toHost<uint8_t, 2>(
+            const_cast<uint8_t*>(x), stream, {n, (idx_t)this->code_size});
+
+    IndexBinaryFlat cpuQuantizer(this->d);
+    IndexBinaryIVF cpuIndex(&cpuQuantizer, this->d, nlist);
+    cpuIndex.cp = cp;
+    cpuIndex.train(n, hostX.data());
+
+    quantizer_->copyFrom(&cpuQuantizer);
+    this->is_trained = true;
+}
+
+void GpuIndexBinaryIVF::add(idx_t n, const uint8_t* x) {
+    add_with_ids(n, x, nullptr);
+}
+
+void GpuIndexBinaryIVF::add_with_ids(
+        idx_t n,
+        const uint8_t* x,
+        const idx_t* xids) {
+    DeviceScope scope(binaryIVFConfig_.device);
+    auto stream = resources_->getDefaultStream(binaryIVFConfig_.device);
+
+    FAISS_THROW_IF_NOT_MSG(this->is_trained, "index not trained");
+
+    if (n == 0) {
+        return;
+    }
+
+    // Assign on the GPU, then group the vectors by list on the host
+    std::vector<int32_t> assignDistances(n);
+    std::vector<idx_t> assign(n);
+    quantizer_->search(n, x, 1, assignDistances.data(), assign.data());
+
+    auto hostX = toHost<uint8_t, 2>(
+            const_cast<uint8_t*>(x), stream, {n, (idx_t)this->code_size});
+
+    std::vector<idx_t> listCounts(nlist, 0);
+    for (idx_t i = 0; i < n; ++i) {
+        FAISS_ASSERT(assign[i] >= 0 && assign[i] < nlist);
+        listCounts[assign[i]]++;
+    }
+
+    std::vector<idx_t> listOffsets(nlist + 1, 0);
+    for (idx_t l = 0; l < nlist; ++l) {
+        listOffsets[l + 1] = listOffsets[l] + listCounts[l];
+    }
+
+    std::vector<uint8_t> sortedCodes(n * this->code_size);
+    std::vector<idx_t> sortedIds(n);
+    std::vector<idx_t> cursor(listOffsets.begin(), listOffsets.end() - 1);
+    for (idx_t i = 0; i < n; ++i) {
+        idx_t pos = cursor[assign[i]]++;
+        std::copy_n(
+                hostX.data() + i * this->code_size,
+                this->code_size,
+                sortedCodes.data() + pos * this->code_size);
+        sortedIds[pos] = xids ? xids[i] : this->ntotal + i;
+    }
+
+    for (idx_t l = 0; l < nlist; ++l) {
+        index_->appendVectors(
+                l,
+                sortedCodes.data() + listOffsets[l] * this->code_size,
+                sortedIds.data() + listOffsets[l],
+                listCounts[l],
+                stream);
+    }
+
+    this->ntotal += n;
+}
+
+void GpuIndexBinaryIVF::reset() {
+    DeviceScope scope(binaryIVFConfig_.device);
+
+    // Free the list storage but keep the coarse quantizer
+    index_->reset();
+    this->ntotal = 0;
+}
+
+idx_t GpuIndexBinaryIVF::getCurrentNProbe_(
+        const faiss::SearchParameters* params) const {
+    size_t use_nprobe = nprobe;
+    if (params) {
+        auto ivfParams = dynamic_cast<const SearchParametersIVF*>(params);
+        FAISS_THROW_IF_NOT_MSG(
+                ivfParams,
+                "GpuIndexBinaryIVF: only SearchParametersIVF "
+                "implemented at present");
+        FAISS_THROW_IF_NOT_MSG(
+                !ivfParams->sel, "GpuIndexBinaryIVF: IDSelector not supported");
+        FAISS_THROW_IF_NOT_FMT(
+                ivfParams->max_codes == 0,
+                "GpuIndexBinaryIVF does not support "
+                "SearchParametersIVF::max_codes (passed %zu, must be 0)",
+                ivfParams->max_codes);
+        use_nprobe = ivfParams->nprobe;
+    }
+
+    validateNProbe(use_nprobe);
+    return std::min((idx_t)use_nprobe, nlist);
+}
+
+void GpuIndexBinaryIVF::search(
+        idx_t n,
+        const uint8_t* x,
+        idx_t k,
+        int32_t* distances,
+        faiss::idx_t* labels,
+        const SearchParameters* params) const {
+    DeviceScope scope(binaryIVFConfig_.device);
+    auto stream = resources_->getDefaultStream(binaryIVFConfig_.device);
+
+    if (n == 0) {
+        return;
+    }
+
+    FAISS_THROW_IF_NOT_MSG(this->is_trained, "index not trained");
+    validateKSelect(k);
+    idx_t use_nprobe = getCurrentNProbe_(params);
+
+    auto queries = toDeviceTemporary<uint8_t, 2>(
+            resources_.get(),
+            binaryIVFConfig_.device,
+            const_cast<uint8_t*>(x),
+            stream,
+            {n, (idx_t)this->code_size});
+
+    auto coarseIndices = searchCoarse(
+            resources_.get(), quantizer_.get(), queries, use_nprobe, stream);
+
+    auto outDistances = toDeviceTemporary<int32_t, 2>(
+            resources_.get(),
+            binaryIVFConfig_.device,
+            distances,
+            stream,
+            {n, k});
+
+    auto outIndices = toDeviceTemporary<idx_t, 2>(
+            resources_.get(), binaryIVFConfig_.device, labels, stream, {n, k});
+
+    index_->query(queries, coarseIndices, k, outDistances, outIndices);
+
+    // Copy back if necessary
+    fromDevice<int32_t, 2>(outDistances, distances, stream);
+    fromDevice<idx_t, 2>(outIndices, labels, stream);
+}
+
+void GpuIndexBinaryIVF::range_search(
+        idx_t n,
+        const uint8_t* x,
+        int radius,
+        RangeSearchResult* result,
+        const SearchParameters* params) const {
+    DeviceScope scope(binaryIVFConfig_.device);
+    auto stream = resources_->getDefaultStream(binaryIVFConfig_.device);
+
+    FAISS_THROW_IF_NOT(result->nq == n);
+    if (n == 0) {
+        return;
+    }
+
+    FAISS_THROW_IF_NOT_MSG(this->is_trained, "index not trained");
+    idx_t use_nprobe = getCurrentNProbe_(params);
+
+    auto queries = toDeviceTemporary<uint8_t, 2>(
+            resources_.get(),
+            binaryIVFConfig_.device,
+            const_cast<uint8_t*>(x),
+            stream,
+            {n, (idx_t)this->code_size});
+
+    auto coarseIndices = searchCoarse(
+            resources_.get(), quantizer_.get(), queries, use_nprobe, stream);
+
+    index_->rangeQuery(queries, coarseIndices, radius, result);
+}
+
+} // namespace gpu
+} // namespace faiss
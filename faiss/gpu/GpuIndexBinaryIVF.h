@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexBinaryIVF.h>
+#include <faiss/gpu/GpuIndex.h>
+#include <faiss/gpu/GpuIndexBinaryFlat.h>
+#include <faiss/gpu/GpuResources.h>
+#include <memory>
+#include <vector>
+
+namespace faiss {
+namespace gpu {
+
+class BinaryIVFIndex;
+
+struct GpuIndexBinaryIVFConfig : public GpuIndexConfig {};
+
+/// A GPU version of IndexBinaryIVF: the binary vectors are assigned to nlist
+/// inverted lists by a GpuIndexBinaryFlat coarse quantizer, and the nprobe
+/// lists closest to a query are scanned with Hamming distance. Supports k-NN
+/// and range search.
+class GpuIndexBinaryIVF : public IndexBinary {
+   public:
+    /// Construct from a pre-existing faiss::IndexBinaryIVF instance, copying
+    /// the coarse centroids and inverted lists over to the given GPU
+    GpuIndexBinaryIVF(
+            GpuResourcesProvider* provider,
+            const faiss::IndexBinaryIVF* index,
+            GpuIndexBinaryIVFConfig config = GpuIndexBinaryIVFConfig());
+
+    /// Construct an empty instance that must be trained before adding
+    GpuIndexBinaryIVF(
+            GpuResourcesProvider* provider,
+            int dims,
+            idx_t nlist,
+            GpuIndexBinaryIVFConfig config = GpuIndexBinaryIVFConfig());
+
+    ~GpuIndexBinaryIVF() override;
+
+    /// Returns the device that this index is resident on
+    int getDevice() const;
+
+    /// Returns a reference to our GpuResources object that manages memory,
+    /// stream and handle resources on the GPU
+    std::shared_ptr<GpuResources> getResources();
+
+    /// Initialize ourselves from the given CPU index; will overwrite
+    /// all data in ourselves
+    void copyFrom(const faiss::IndexBinaryIVF* index);
+
+    /// Copy ourselves to the given CPU index; will overwrite all data
+    /// in the index instance. The CPU index gets an IndexBinaryFlat
+    /// quantizer and ArrayInvertedLists.
+    void copyTo(faiss::IndexBinaryIVF* index) const;
+
+    /// Returns the coarse quantizer holding the nlist centroids
+    GpuIndexBinaryFlat* getQuantizer();
+
+    /// Returns the number of vectors in a list
+    idx_t getListLength(idx_t listId) const;
+
+    /// Returns the codes of a list, copied to the host
+    std::vector<uint8_t> getListVectorData(idx_t listId) const;
+
+    /// Returns the ids of a list, copied to the host
+    std::vector<idx_t> getListIndices(idx_t listId) const;
+
+    /// Trains the coarse quantizer with binary k-means, on the CPU
+    void train(idx_t n, const uint8_t* x) override;
+
+    void add(idx_t n, const uint8_t* x) override;
+
+    void add_with_ids(idx_t n, const uint8_t* x, const idx_t* xids) override;
+
+    void reset() override;
+
+    /// nprobe can be overridden with a SearchParametersIVF
+    void search(
+            idx_t n,
+            const uint8_t* x,
+            // faiss::IndexBinary has idx_t for k
+            idx_t k,
+            int32_t* distances,
+            faiss::idx_t* labels,
+            const faiss::SearchParameters* params = nullptr) const override;
+
+    /// Returns the vectors of the nprobe closest lists at a Hamming distance
+    /// < radius of the queries
+    void range_search(
+            idx_t n,
+            const uint8_t* x,
+            int radius,
+            RangeSearchResult* result,
+            const faiss::SearchParameters* params = nullptr) const override;
+
+    /// number of inverted lists
+    idx_t nlist;
+
+    /// number of lists visited per query
+    size_t nprobe = 1;
+
+    /// clustering parameters used by train
+    ClusteringParameters cp;
+
+   protected:
+    /// Returns the number of lists to visit for the search parameters
+    idx_t getCurrentNProbe_(const faiss::SearchParameters* params) const;
+
+   protected:
+    /// Manages streams, cuBLAS handles and scratch memory for devices
+    std::shared_ptr<GpuResources> resources_;
+
+    /// Configuration options
+    const GpuIndexBinaryIVFConfig binaryIVFConfig_;
+
+    /// Coarse quantizer holding the nlist centroids
+    std::unique_ptr<GpuIndexBinaryFlat> quantizer_;
+
+    /// Holds our GPU inverted lists
+    std::unique_ptr<BinaryIVFIndex> index_;
+};
+
+} // namespace gpu
+} // namespace faiss
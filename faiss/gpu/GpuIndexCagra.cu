@@ -31,6 +31,25 @@
 namespace faiss {
 namespace gpu {
 
+namespace {
+
+std::optional<cuvs::neighbors::vpq_params> toCuvsVpqParams(
+        const VPQCompressionCagraConfig* config) {
+    if (config == nullptr) {
+        return std::nullopt;
+    }
+    cuvs::neighbors::vpq_params params;
+    params.pq_bits = config->pq_bits;
+    params.pq_dim = config->pq_dim;
+    params.vq_n_centers = config->vq_n_centers;
+    params.kmeans_n_iters = config->kmeans_n_iters;
+    params.vq_kmeans_trainset_fraction = config->vq_kmeans_trainset_fraction;
+    params.pq_kmeans_trainset_fraction = config->pq_kmeans_trainset_fraction;
+    return params;
+}
+
+} // namespace
+
 GpuIndexCagra::GpuIndexCagra(
         GpuResourcesProvider* provider,
         int dims,
@@ -95,7 +114,8 @@ void GpuIndexCagra::train(idx_t n, const float* x) {
             INDICES_64_BIT,
             ivf_pq_params,
             ivf_pq_search_params,
-            cagraConfig_.refine_rate);
+            cagraConfig_.refine_rate,
+            toCuvsVpqParams(cagraConfig_.compression_params));
 
     index_->train(n, x);
 
@@ -154,7 +174,8 @@ void GpuIndexCagra::searchImpl_(
             params->hashmap_min_bitlen,
             params->hashmap_max_fill_rate,
             params->num_random_samplings,
-            params->seed);
+            params->seed,
+            params->refine_k_factor);
 
     if (not search_params) {
         delete params;
@@ -197,7 +218,8 @@ void GpuIndexCagra::copyFrom(const faiss::IndexHNSWCagra* index) {
             knn_graph.data(),
             this->metric_type,
             this->metric_arg,
-            INDICES_64_BIT);
+            INDICES_64_BIT,
+            toCuvsVpqParams(cagraConfig_.compression_params));
 
     this->is_trained = true;
 }
@@ -277,6 +299,21 @@ void GpuIndexCagra::copyTo(faiss::IndexHNSWCagra* index) const {
     index->init_level0 = true;
 }
 
+void GpuIndexCagra::copyToCompact(
+        faiss::IndexHNSWCagra* index,
+        int max_degree,
+        float alpha) const {
+    copyTo(index);
+
+    if (max_degree > 0) {
+        index->prune_neighbors(max_degree, 0, alpha);
+    }
+
+    // the compact lists only hold the valid links, so the index can no
+    // longer be added to
+    index->hnsw.convert_to_compact();
+}
+
 void GpuIndexCagra::reset() {
     DeviceScope scope(config_.device);
 
@@ -163,6 +163,28 @@ struct IVFPQSearchCagraConfig {
     double preferred_shmem_carveout = 1.0;
 };
 
+/// Parameters of the VPQ (vector + product quantization) compression of the
+/// device dataset. The vectors are stored on the device as a coarse
+/// centroid id and a PQ code of the residual, instead of dim floats.
+struct VPQCompressionCagraConfig {
+    /// The bit length of the PQ codes. Possible values: [4, 5, 6, 7, 8].
+    uint32_t pq_bits = 8;
+    /// The dimensionality of the PQ codes. When zero, an optimal value is
+    /// selected using a heuristic (dim / 2 or dim / 4).
+    uint32_t pq_dim = 0;
+    /// The number of coarse (VQ) centroids. When zero, an optimal value is
+    /// selected using a heuristic.
+    uint32_t vq_n_centers = 0;
+    /// The number of iterations searching for kmeans centers.
+    uint32_t kmeans_n_iters = 25;
+    /// The fraction of data to use to train the VQ centroids. When zero, an
+    /// optimal value is selected using a heuristic.
+    double vq_kmeans_trainset_fraction = 0;
+    /// The fraction of data to use to train the PQ codebooks. When zero, an
+    /// optimal value is selected using a heuristic.
+    double pq_kmeans_trainset_fraction = 0;
+};
+
 struct GpuIndexCagraConfig : public GpuIndexConfig {
     /// Degree of input graph for pruning.
     size_t intermediate_graph_degree = 128;
@@ -177,6 +199,14 @@ struct GpuIndexCagraConfig : public GpuIndexConfig {
     IVFPQSearchCagraConfig* ivf_pq_search_params = nullptr;
     float refine_rate = 2.0f;
     bool store_dataset = true;
+
+    /// If set, the dataset is stored on the device in compressed form (L2
+    /// only, requires store_dataset), so that larger graphs fit per GPU.
+    /// The full-precision vectors passed to train / copyFrom are not
+    /// copied; they are used by the refinement of the search results
+    /// (SearchParametersCagra::refine_k_factor), so they must stay
+    /// allocated in that case.
+    VPQCompressionCagraConfig* compression_params = nullptr;
 };
 
 enum class search_algo {
@@ -235,6 +265,11 @@ struct SearchParametersCagra : SearchParameters {
     uint32_t num_random_samplings = 1;
     /// Bit mask used for initial random seed node selection.
     uint64_t seed = 0x128394;
+
+    /// With a compressed dataset: search k * refine_k_factor neighbors and
+    /// re-rank them with the full-precision vectors, on the device or on
+    /// the CPU depending on where these vectors are.
+    float refine_k_factor = 1;
 };
 
 struct GpuIndexCagra : public GpuIndex {
@@ -259,13 +294,25 @@ struct GpuIndexCagra : public GpuIndex {
     void train(idx_t n, const float* x) override;
 
     /// Initialize ourselves from the given CPU index; will overwrite
-    /// all data in ourselves
+    /// all data in ourselves. With compression_params, the device dataset
+    /// is compressed and the CPU index storage is used for the refinement.
     void copyFrom(const faiss::IndexHNSWCagra* index);
 
     /// Copy ourselves to the given CPU index; will overwrite all data
     /// in the index instance
     void copyTo(faiss::IndexHNSWCagra* index) const;
 
+    /// Same as copyTo, but the CPU index gets the compact CSR neighbor
+    /// layout (storage_is_compact) that write_index stores for the serving
+    /// side. If max_degree > 0, the level 0 lists are first pruned to
+    /// max_degree links with IndexHNSW::prune_neighbors(max_degree, 0,
+    /// alpha). For recompute serving, write the index with
+    /// IO_FLAG_SKIP_STORAGE
+    void copyToCompact(
+            faiss::IndexHNSWCagra* index,
+            int max_degree = 0,
+            float alpha = 1.0) const;
+
     void reset() override;
 
     std::vector<idx_t> get_knngraph() const;
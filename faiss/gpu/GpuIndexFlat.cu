@@ -16,6 +16,7 @@
 #include <faiss/gpu/utils/ConversionOperators.cuh>
 #include <faiss/gpu/utils/CopyUtils.cuh>
 #include <faiss/gpu/utils/Float16.cuh>
+#include <cstring>
 #include <limits>
 
 #if defined USE_NVIDIA_CUVS
@@ -228,6 +229,29 @@ void GpuIndexFlat::searchImpl_(
             queries, k, metric_type, metric_arg, outDistances, outLabels, true);
 }
 
+bool GpuIndexFlat::getSearchGraphKey(
+        const SearchParameters* /* params */,
+        std::vector<int64_t>& key) const {
+    if (!data_ || should_use_cuvs(config_) || this->ntotal == 0) {
+        return false;
+    }
+
+    // The search bakes in the location and size of our data
+    key.push_back(
+            data_->getUseFloat16()
+                    ? (int64_t)data_->getVectorsFloat16Ref().data()
+                    : (int64_t)data_->getVectorsFloat32Ref().data());
+    key.push_back((int64_t)data_->getNormsRef().data());
+    key.push_back(data_->getSize());
+    key.push_back(this->metric_type);
+
+    uint32_t metricArgBits;
+    std::memcpy(&metricArgBits, &this->metric_arg, sizeof(metricArgBits));
+    key.push_back(metricArgBits);
+
+    return true;
+}
+
 void GpuIndexFlat::reconstruct(idx_t key, float* out) const {
     DeviceScope scope(config_.device);
 
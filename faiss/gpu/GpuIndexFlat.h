@@ -107,6 +107,11 @@ class GpuIndexFlat : public GpuIndex {
             float* residuals,
             const idx_t* keys) const override;
 
+    /// Searches can be replayed as CUDA graphs (not with cuVS)
+    bool getSearchGraphKey(
+            const SearchParameters* params,
+            std::vector<int64_t>& key) const override;
+
     /// For internal access
     inline FlatIndex* getGpuData() {
         return data_.get();
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/gpu/GpuIndexHNSW.h>
+#include <faiss/gpu/GpuResources.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/HNSWEntryPoints.h>
+#include <faiss/impl/HNSWUpperLevels.h>
+#include <faiss/impl/NSG.h>
+#include <faiss/utils/random.h>
+#include <faiss/gpu/impl/HNSWGraph.cuh>
+#include <faiss/gpu/utils/CopyUtils.cuh>
+
+#include <algorithm>
+#include <memory>
+
+namespace faiss {
+namespace gpu {
+
+GpuIndexHNSW::GpuIndexHNSW(
+        GpuResourcesProvider* provider,
+        const faiss::IndexHNSW* index,
+        GpuIndexHNSWConfig config)
+        : GpuIndex(
+                  provider->getResources(),
+                  index->d,
+                  index->metric_type,
+                  index->metric_arg,
+                  config),
+          hnswConfig_(config) {
+    copyFrom(index);
+}
+
+GpuIndexHNSW::GpuIndexHNSW(
+        GpuResourcesProvider* provider,
+        int dims,
+        faiss::MetricType metric,
+        GpuIndexHNSWConfig config)
+        : GpuIndex(provider->getResources(), dims, metric, 0, config),
+          hnswConfig_(config) {
+    DeviceScope scope(config_.device);
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+            "GpuIndexHNSW supports only L2 and inner product");
+
+    this->is_trained = true;
+    sampledEntryPoints_.assign(1, -1);
+
+    data_.reset(new HNSWGraph(
+            resources_.get(),
+            dims,
+            metric == METRIC_INNER_PRODUCT,
+            config_.memorySpace));
+}
+
+GpuIndexHNSW::~GpuIndexHNSW() {}
+
+void GpuIndexHNSW::copyFrom(const faiss::IndexHNSW* index) {
+    DeviceScope scope(config_.device);
+    auto stream = resources_->getDefaultStream(config_.device);
+
+    FAISS_THROW_IF_NOT_MSG(
+            index->metric_type == METRIC_L2 ||
+                    index->metric_type == METRIC_INNER_PRODUCT,
+            "GpuIndexHNSW supports only L2 and inner product");
+    FAISS_THROW_IF_NOT_MSG(
+            index->storage && !index->is_recompute,
+            "GpuIndexHNSW needs the vectors of the storage of the index");
+
+    GpuIndex::copyFrom(index);
+    this->is_trained = true;
+
+    const HNSW& hnsw = index->hnsw;
+    idx_t n = index->ntotal;
+
+    std::vector<float> vectors(n * this->d);
+    if (n > 0) {
+        index->storage->reconstruct_n(0, n, vectors.data());
+    }
+
+    // Level 0 lists in CSR form, read through fetch_neighbors whatever the
+    // storage of the CPU graph
+    std::vector<idx_t> offsets(n + 1, 0);
+    std::vector<int> neighbors;
+    std::vector<HNSW::storage_idx_t> list;
+    for (idx_t i = 0; i < n; ++i) {
+        FAISS_THROW_IF_NOT_MSG(
+                !hnsw.is_deleted(i),
+                "GpuIndexHNSW does not support deleted nodes, "
+                "call compact_deleted first");
+        hnsw.fetch_neighbors(i, 0, list);
+        neighbors.insert(neighbors.end(), list.begin(), list.end());
+        offsets[i + 1] = neighbors.size();
+    }
+
+    // destroy old first before allocating new
+    data_.reset();
+    data_.reset(new HNSWGraph(
+            resources_.get(),
+            this->d,
+            this->metric_type == METRIC_INNER_PRODUCT,
+            config_.memorySpace));
+    data_->set(n, vectors.data(), offsets, neighbors, stream);
+
+    // Entry points of search(); the duplicates are dropped by the visited
+    // set of the search
+    sampledEntryPoints_.clear();
+    if (hnsw.entry_point >= 0) {
+        sampledEntryPoints_.push_back(hnsw.entry_point);
+    }
+    RandomGenerator rng(hnswConfig_.seed);
+    for (int i = 0; n > 0 && i < hnswConfig_.numRandomEntryPoints; ++i) {
+        sampledEntryPoints_.push_back(rng.rand_int64() % n);
+    }
+    if (sampledEntryPoints_.empty()) {
+        sampledEntryPoints_.push_back(-1);
+    }
+}
+
+void GpuIndexHNSW::reset() {
+    DeviceScope scope(config_.device);
+
+    data_->reset();
+    sampledEntryPoints_.assign(1, -1);
+    this->ntotal = 0;
+}
+
+bool GpuIndexHNSW::addImplRequiresIDs_() const {
+    return false;
+}
+
+void GpuIndexHNSW::addImpl_(idx_t n, const float* x, const idx_t* ids) {
+    FAISS_THROW_MSG(
+            "GpuIndexHNSW: the graph is built on the CPU, "
+            "add to the IndexHNSW and call copyFrom");
+}
+
+void GpuIndexHNSW::searchImpl_(
+        idx_t n,
+        const float* x,
+        int k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* search_params) const {
+    auto stream = resources_->getDefaultStream(config_.device);
+
+    auto entryPoints = toDeviceTemporary<int, 2>(
+            resources_.get(),
+            config_.device,
+            const_cast<int*>(sampledEntryPoints_.data()),
+            stream,
+            {1, idx_t(sampledEntryPoints_.size())});
+
+    searchFromDeviceEntryPoints_(
+            n,
+            x,
+            k,
+            sampledEntryPoints_.size(),
+            entryPoints.data(),
+            true,
+            distances,
+            labels,
+            search_params);
+}
+
+void GpuIndexHNSW::searchFromEntryPoints(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        int numEntryPoints,
+        const idx_t* entryPoints,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    DeviceScope scope(config_.device);
+    auto stream = resources_->getDefaultStream(config_.device);
+
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(numEntryPoints > 0);
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<int> entryPoints32(
+            entryPoints, entryPoints + n * numEntryPoints);
+
+    auto devEntryPoints = toDeviceTemporary<int, 2>(
+            resources_.get(),
+            config_.device,
+            entryPoints32.data(),
+            stream,
+            {n, numEntryPoints});
+
+    auto devX = toDeviceTemporary<float, 2>(
+            resources_.get(),
+            config_.device,
+            const_cast<float*>(x),
+            stream,
+            {n, this->d});
+
+    auto outDistances = toDeviceTemporary<float, 2>(
+            resources_.get(), config_.device, distances, stream, {n, k});
+
+    auto outLabels = toDeviceTemporary<idx_t, 2>(
+            resources_.get(), config_.device, labels, stream, {n, k});
+
+    searchFromDeviceEntryPoints_(
+            n,
+            devX.data(),
+            k,
+            numEntryPoints,
+            devEntryPoints.data(),
+            false,
+            outDistances.data(),
+            outLabels.data(),
+            params);
+
+    // Copy back if necessary
+    fromDevice<float, 2>(outDistances, distances, stream);
+    fromDevice<idx_t, 2>(outLabels, labels, stream);
+}
+
+void GpuIndexHNSW::searchFromDeviceEntryPoints_(
+        idx_t n,
+        const float* x,
+        int k,
+        int numEntryPoints,
+        const int* entryPoints,
+        bool sharedEntryPoints,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* search_params) const {
+    int beamSize = SearchParametersGpuHNSW().beamSize;
+    int maxIterations = 0;
+    if (search_params) {
+        auto params =
+                dynamic_cast<const SearchParametersGpuHNSW*>(search_params);
+        FAISS_THROW_IF_NOT_MSG(
+                params, "GpuIndexHNSW params have incorrect type");
+        FAISS_THROW_IF_NOT_MSG(
+                !params->sel, "GpuIndexHNSW does not support IDSelector");
+        beamSize = params->beamSize;
+        maxIterations = params->maxIterations;
+    }
+    beamSize = std::max(beamSize, k);
+    if (maxIterations <= 0) {
+        maxIterations = 4 * beamSize;
+    }
+
+    Tensor<float, 2, true> queries(const_cast<float*>(x), {n, this->d});
+    Tensor<int, 2, true> entries(
+            const_cast<int*>(entryPoints),
+            {sharedEntryPoints ? 1 : n, idx_t(numEntryPoints)});
+    Tensor<float, 2, true> outDistances(distances, {n, k});
+    Tensor<idx_t, 2, true> outLabels(labels, {n, k});
+
+    data_->query(
+            queries, entries, beamSize, maxIterations, outDistances, outLabels);
+}
+
+void GpuIndexHNSW::getEntryPoints(
+        const faiss::IndexHNSW* index,
+        idx_t n,
+        const float* x,
+        int numEntryPoints,
+        idx_t* entryPoints) {
+    FAISS_THROW_IF_NOT(numEntryPoints > 0);
+    const HNSW& hnsw = index->hnsw;
+    int d = index->d;
+
+    std::fill(entryPoints, entryPoints + n * numEntryPoints, idx_t(-1));
+
+    if (index->entry_points) {
+#pragma omp parallel
+        {
+            std::vector<HNSW::storage_idx_t> nodes(numEntryPoints);
+#pragma omp for
+            for (idx_t i = 0; i < n; ++i) {
+                index->entry_points->select(
+                        x + i * d, numEntryPoints, nodes.data());
+                std::copy(
+                        nodes.begin(),
+                        nodes.end(),
+                        entryPoints + i * numEntryPoints);
+            }
+        }
+        return;
+    }
+
+    if (hnsw.entry_point < 0) {
+        return;
+    }
+
+    FAISS_THROW_IF_NOT_MSG(
+            index->upper_level_codes || index->storage,
+            "the descent of the upper levels needs their vectors");
+
+#pragma omp parallel
+    {
+        // upper level codes or storage, smaller is better
+        std::unique_ptr<DistanceComputer> dis(
+                index->upper_level_codes
+                        ? index->upper_level_codes->get_distance_computer()
+                        : storage_distance_computer(index->storage));
+#pragma omp for
+        for (idx_t i = 0; i < n; ++i) {
+            dis->set_query(x + i * d);
+            HNSW::storage_idx_t nearest = hnsw.entry_point;
+            float dNearest = (*dis)(nearest);
+
+            for (int level = hnsw.max_level; level >= 1; --level) {
+                greedy_update_nearest(hnsw, *dis, level, nearest, dNearest);
+            }
+
+            entryPoints[i * numEntryPoints] = nearest;
+        }
+    }
+}
+
+} // namespace gpu
+} // namespace faiss
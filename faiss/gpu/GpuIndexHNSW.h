@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/gpu/GpuIndex.h>
+#include <memory>
+#include <vector>
+
+namespace faiss {
+
+struct IndexHNSW;
+
+} // namespace faiss
+
+namespace faiss {
+namespace gpu {
+
+class HNSWGraph;
+
+struct GpuIndexHNSWConfig : public GpuIndexConfig {
+    /// Number of graph nodes sampled at random as entry points of search(),
+    /// shared by all the queries, in addition to the HNSW entry point
+    int numRandomEntryPoints = 32;
+
+    /// Seed of the entry point sampling
+    int64_t seed = 1234;
+};
+
+struct SearchParametersGpuHNSW : SearchParameters {
+    /// Number of best nodes kept per query (the efSearch of the GPU
+    /// search); must be >= k
+    int beamSize = 64;
+
+    /// Maximum number of nodes expanded per query; 0 selects 4 * beamSize
+    int maxIterations = 0;
+};
+
+/// Searches the level 0 graph of a CPU-built IndexHNSW on the GPU, for
+/// large query batches. The graph (in CSR form, whatever the storage of
+/// the CPU graph: regular, compact or on disk) and the vectors are copied
+/// to the GPU, so the graph need not be rebuilt as for CAGRA. Each query
+/// runs a beam search of fixed size in shared memory, starting from
+/// sampled entry points, or from entry points computed on the CPU (see
+/// searchFromEntryPoints). The upper levels are not copied, and the index
+/// cannot be modified on the GPU.
+class GpuIndexHNSW : public GpuIndex {
+   public:
+    /// Construct from a pre-existing faiss::IndexHNSW instance, copying
+    /// data over to the given GPU
+    GpuIndexHNSW(
+            GpuResourcesProvider* provider,
+            const faiss::IndexHNSW* index,
+            GpuIndexHNSWConfig config = GpuIndexHNSWConfig());
+
+    /// Construct an empty instance that can be filled with copyFrom
+    GpuIndexHNSW(
+            GpuResourcesProvider* provider,
+            int dims,
+            faiss::MetricType metric = faiss::METRIC_L2,
+            GpuIndexHNSWConfig config = GpuIndexHNSWConfig());
+
+    ~GpuIndexHNSW() override;
+
+    /// Initialize ourselves from the given CPU index; will overwrite
+    /// all data in ourselves. The vectors are reconstructed from its
+    /// storage, so it cannot be in recompute mode
+    void copyFrom(const faiss::IndexHNSW* index);
+
+    /// Clears all vectors and the graph from this index
+    void reset() override;
+
+    /// Same as search, starting from per-query entry points instead of the
+    /// sampled ones. entryPoints is n x numEntryPoints on the CPU (-1
+    /// entries are ignored), eg. from getEntryPoints. `x`, `distances` and
+    /// `labels` can be resident on the CPU or any GPU; copies are performed
+    /// as needed
+    void searchFromEntryPoints(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            int numEntryPoints,
+            const idx_t* entryPoints,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const;
+
+    /// Level 0 entry points of n queries, computed on the CPU with `index`:
+    /// the nodes of its entry point table (IndexHNSW::entry_points) closest
+    /// to the queries if it has one, else the node found by the greedy
+    /// descent of the upper levels. entryPoints is n x numEntryPoints,
+    /// padded with -1
+    static void getEntryPoints(
+            const faiss::IndexHNSW* index,
+            idx_t n,
+            const float* x,
+            int numEntryPoints,
+            idx_t* entryPoints);
+
+   protected:
+    /// The ids are the node ids of the CPU index
+    bool addImplRequiresIDs_() const override;
+
+    /// The graph is built on the CPU: not supported
+    void addImpl_(idx_t n, const float* x, const idx_t* ids) override;
+
+    /// Called from GpuIndex for search
+    void searchImpl_(
+            idx_t n,
+            const float* x,
+            int k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* search_params) const override;
+
+    /// Runs the search of device-resident queries from device-resident
+    /// entry points
+    void searchFromDeviceEntryPoints_(
+            idx_t n,
+            const float* x,
+            int k,
+            int numEntryPoints,
+            const int* entryPoints,
+            bool sharedEntryPoints,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* search_params) const;
+
+    /// Our configuration options
+    const GpuIndexHNSWConfig hnswConfig_;
+
+    /// Entry points of search(): the HNSW entry point and the sampled nodes
+    std::vector<int> sampledEntryPoints_;
+
+    /// Holds our graph and vectors
+    std::unique_ptr<HNSWGraph> data_;
+};
+
+} // namespace gpu
+} // namespace faiss
@@ -280,6 +280,24 @@ std::vector<idx_t> GpuIndexIVF::getListIndices(idx_t listId) const {
     return baseIndex_->getListIndices(listId);
 }
 
+void GpuIndexIVF::setStreamingInvertedLists(
+        const InvertedLists* ivf,
+        size_t cacheBytes) {
+    DeviceScope scope(config_.device);
+    FAISS_THROW_IF_NOT_MSG(
+            !should_use_cuvs(config_),
+            "streamed inverted lists are not supported with cuVS");
+    FAISS_THROW_IF_NOT_MSG(
+            baseIndex_, "the index must be trained before streaming lists");
+
+    baseIndex_->setStreamingLists(ivf, cacheBytes);
+
+    ntotal = 0;
+    for (idx_t i = 0; i < nlist; ++i) {
+        ntotal += ivf->list_size(i);
+    }
+}
+
 void GpuIndexIVF::addImpl_(idx_t n, const float* x, const idx_t* xids) {
     // Device is already set in GpuIndex::add
     FAISS_ASSERT(baseIndex_);
@@ -322,6 +340,30 @@ int GpuIndexIVF::getCurrentNProbe_(const SearchParameters* params) const {
     return int(use_nprobe);
 }
 
+bool GpuIndexIVF::getSearchGraphKey(
+        const SearchParameters* params,
+        std::vector<int64_t>& key) const {
+    if (!is_trained || !baseIndex_ || should_use_cuvs(config_) ||
+        this->ntotal == 0 || ivfConfig_.indicesOptions == INDICES_CPU ||
+        baseIndex_->isStreaming()) {
+        return false;
+    }
+
+    // The coarse quantizer search is part of the graph
+    auto gpuQuantizer = tryCastGpuIndex(quantizer);
+    if (!gpuQuantizer || gpuQuantizer->getResources() != resources_ ||
+        gpuQuantizer->getDevice() != config_.device ||
+        !gpuQuantizer->getSearchGraphKey(nullptr, key)) {
+        return false;
+    }
+
+    key.push_back(getCurrentNProbe_(params));
+    key.push_back((int64_t)baseIndex_.get());
+    key.push_back((int64_t)baseIndex_->getVersion());
+
+    return true;
+}
+
 void GpuIndexIVF::searchImpl_(
         idx_t n,
         const float* x,
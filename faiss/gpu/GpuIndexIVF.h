@@ -98,6 +98,21 @@ class GpuIndexIVF : public GpuIndex, public IndexIVFInterface {
     /// debugging purposes.
     virtual std::vector<idx_t> getListIndices(idx_t listId) const;
 
+    /// Search the inverted lists of `ivf` (eg. the invlists of the CPU index
+    /// this index was copied from, or OnDiskInvertedLists) without copying
+    /// them all to the GPU: each search copies the lists it probes to a
+    /// device-side LRU cache of at most `cacheBytes`. `ivf` is not owned and
+    /// must outlive this index; the index cannot be added to in this mode.
+    /// The lists currently on the GPU are released; reset() leaves the mode
+    void setStreamingInvertedLists(const InvertedLists* ivf, size_t cacheBytes);
+
+    /// Searches can be replayed as CUDA graphs when the lists are resident
+    /// on the device with their indices, and the coarse quantizer is a GPU
+    /// index sharing our resources that supports it as well
+    bool getSearchGraphKey(
+            const SearchParameters* params,
+            std::vector<int64_t>& key) const override;
+
     void search_preassigned(
             idx_t n,
             const float* x,
@@ -39,6 +39,7 @@ GpuIndexIVFFlat::GpuIndexIVFFlat(
                   config),
           ivfFlatConfig_(config),
           reserveMemoryVecs_(0) {
+    initIVFStorage_();
     copyFrom(index);
 }
 
@@ -51,6 +52,8 @@ GpuIndexIVFFlat::GpuIndexIVFFlat(
         : GpuIndexIVF(provider, dims, metric, 0, nlist, config),
           ivfFlatConfig_(config),
           reserveMemoryVecs_(0) {
+    initIVFStorage_();
+
     // We haven't trained ourselves, so don't construct the IVFFlat
     // index yet
 }
@@ -72,6 +75,8 @@ GpuIndexIVFFlat::GpuIndexIVFFlat(
                   config),
           ivfFlatConfig_(config),
           reserveMemoryVecs_(0) {
+    initIVFStorage_();
+
     // We could have been passed an already trained coarse quantizer. There is
     // no other quantizer that we need to train, so this is sufficient
     if (this->is_trained) {
@@ -82,8 +87,8 @@ GpuIndexIVFFlat::GpuIndexIVFFlat(
                 this->nlist,
                 this->metric_type,
                 this->metric_arg,
-                false,   // no residual
-                nullptr, // no scalar quantizer
+                false, // no residual
+                storageSQ_.get(),
                 ivfFlatConfig_.interleavedLayout,
                 ivfFlatConfig_.indicesOptions,
                 config_.memorySpace);
@@ -94,6 +99,27 @@ GpuIndexIVFFlat::GpuIndexIVFFlat(
 
 GpuIndexIVFFlat::~GpuIndexIVFFlat() {}
 
+void GpuIndexIVFFlat::initIVFStorage_() {
+    FAISS_THROW_IF_NOT_MSG(
+            !(ivfFlatConfig_.useFloat16IVFStorage &&
+              ivfFlatConfig_.useBFloat16IVFStorage),
+            "useFloat16IVFStorage and useBFloat16IVFStorage are exclusive");
+
+    if (ivfFlatConfig_.useFloat16IVFStorage) {
+        storageSQ_.reset(
+                new ScalarQuantizer(this->d, ScalarQuantizer::QT_fp16));
+    } else if (ivfFlatConfig_.useBFloat16IVFStorage) {
+        storageSQ_.reset(
+                new ScalarQuantizer(this->d, ScalarQuantizer::QT_bf16));
+    } else {
+        return;
+    }
+
+    FAISS_THROW_IF_NOT_MSG(
+            !should_use_cuvs(config_),
+            "half-precision IVF storage is not supported with cuVS");
+}
+
 void GpuIndexIVFFlat::reserveMemory(size_t numVecs) {
     DeviceScope scope(config_.device);
 
@@ -138,8 +164,8 @@ void GpuIndexIVFFlat::copyFrom(const faiss::IndexIVFFlat* index) {
             nlist,
             index->metric_type,
             index->metric_arg,
-            false,   // no residual
-            nullptr, // no scalar quantizer
+            false, // no residual
+            storageSQ_.get(),
             ivfFlatConfig_.interleavedLayout,
             ivfFlatConfig_.indicesOptions,
             config_.memorySpace);
@@ -147,7 +173,27 @@ void GpuIndexIVFFlat::copyFrom(const faiss::IndexIVFFlat* index) {
     updateQuantizer();
 
     // Copy all of the IVF data
-    index_->copyInvertedListsFrom(index->invlists);
+    if (!storageSQ_) {
+        index_->copyInvertedListsFrom(index->invlists);
+        return;
+    }
+
+    // The CPU lists hold float32 vectors, convert them to our storage
+    ArrayInvertedLists halfLists(nlist, storageSQ_->code_size);
+    for (idx_t i = 0; i < nlist; ++i) {
+        size_t listSize = index->invlists->list_size(i);
+        if (listSize == 0) {
+            continue;
+        }
+
+        InvertedLists::ScopedCodes codes(index->invlists, i);
+        InvertedLists::ScopedIds ids(index->invlists, i);
+        std::vector<uint8_t> halfCodes(listSize * storageSQ_->code_size);
+        storageSQ_->compute_codes(
+                (const float*)codes.get(), halfCodes.data(), listSize);
+        halfLists.add_entries(i, listSize, ids.get(), halfCodes.data());
+    }
+    index_->copyInvertedListsFrom(&halfLists);
 }
 
 void GpuIndexIVFFlat::copyTo(faiss::IndexIVFFlat* index) const {
@@ -165,9 +211,33 @@ void GpuIndexIVFFlat::copyTo(faiss::IndexIVFFlat* index) const {
     auto ivf = new ArrayInvertedLists(nlist, index->code_size);
     index->replace_invlists(ivf, true);
 
-    if (index_) {
+    if (!index_) {
+        return;
+    }
+
+    if (!storageSQ_) {
         // Copy IVF lists
         index_->copyInvertedListsTo(ivf);
+        return;
+    }
+
+    // Expand our half-precision lists to float32
+    ArrayInvertedLists halfLists(nlist, storageSQ_->code_size);
+    index_->copyInvertedListsTo(&halfLists);
+
+    for (idx_t i = 0; i < nlist; ++i) {
+        size_t listSize = halfLists.list_size(i);
+        if (listSize == 0) {
+            continue;
+        }
+
+        std::vector<float> vecs(listSize * this->d);
+        storageSQ_->decode(halfLists.get_codes(i), vecs.data(), listSize);
+        ivf->add_entries(
+                i,
+                listSize,
+                halfLists.get_ids(i),
+                (const uint8_t*)vecs.data());
     }
 }
 
@@ -231,8 +301,8 @@ void GpuIndexIVFFlat::train(idx_t n, const float* x) {
                 this->nlist,
                 this->metric_type,
                 this->metric_arg,
-                false,   // no residual
-                nullptr, // no scalar quantizer
+                false, // no residual
+                storageSQ_.get(),
                 ivfFlatConfig_.interleavedLayout,
                 ivfFlatConfig_.indicesOptions,
                 config_.memorySpace);
@@ -293,8 +363,8 @@ void GpuIndexIVFFlat::train(idx_t n, const float* x) {
                 this->nlist,
                 this->metric_type,
                 this->metric_arg,
-                false,   // no residual
-                nullptr, // no scalar quantizer
+                false, // no residual
+                storageSQ_.get(),
                 ivfFlatConfig_.interleavedLayout,
                 ivfFlatConfig_.indicesOptions,
                 config_.memorySpace);
@@ -385,7 +455,29 @@ void GpuIndexIVFFlat::reconstruct_n(idx_t i0, idx_t ni, float* out) const {
             i0 + ni - 1,
             this->ntotal);
 
-    index_->reconstruct_n(i0, ni, out);
+    if (!storageSQ_) {
+        index_->reconstruct_n(i0, ni, out);
+        return;
+    }
+
+    // The lists are decoded on the CPU
+    for (idx_t i = 0; i < nlist; ++i) {
+        auto ids = index_->getListIndices(i);
+        std::vector<uint8_t> codes;
+
+        for (size_t j = 0; j < ids.size(); ++j) {
+            if (ids[j] < i0 || ids[j] >= i0 + ni) {
+                continue;
+            }
+            if (codes.empty()) {
+                codes = index_->getListVectorData(i, false);
+            }
+            storageSQ_->decode(
+                    codes.data() + j * storageSQ_->code_size,
+                    out + (ids[j] - i0) * this->d,
+                    1);
+        }
+    }
 }
 
 } // namespace gpu
@@ -26,6 +26,16 @@ struct GpuIndexIVFFlatConfig : public GpuIndexIVFConfig {
     /// Use the alternative memory layout for the IVF lists
     /// (currently the default)
     bool interleavedLayout = true;
+
+    /// Store the vectors of the IVF lists as float16 on the GPU. This halves
+    /// the memory used by the lists and the bandwidth needed to scan them;
+    /// the vectors are converted from / to float32 when copying from / to a
+    /// CPU IndexIVFFlat. Queries and distance accumulation remain float32
+    bool useFloat16IVFStorage = false;
+
+    /// Same as useFloat16IVFStorage with bfloat16, which keeps the float32
+    /// exponent range at the cost of a shorter mantissa
+    bool useBFloat16IVFStorage = false;
 };
 
 /// Wrapper around the GPU implementation that looks like
@@ -104,6 +114,9 @@ class GpuIndexIVFFlat : public GpuIndexIVF {
             IndicesOptions indicesOptions,
             MemorySpace space);
 
+    /// Sets up storageSQ_ from the config and validates it
+    void initIVFStorage_();
+
    protected:
     /// Our configuration options
     const GpuIndexIVFFlatConfig ivfFlatConfig_;
@@ -113,6 +126,10 @@ class GpuIndexIVFFlat : public GpuIndexIVF {
 
     /// Instance that we own; contains the inverted lists
     std::shared_ptr<IVFFlat> index_;
+
+    /// 16-bit encoding of the list vectors, if half-precision storage is
+    /// requested
+    std::unique_ptr<faiss::ScalarQuantizer> storageSQ_;
 };
 
 } // namespace gpu
@@ -586,7 +586,9 @@ void GpuIndexIVFPQ::verifyPQSettings_() const {
                 this->d);
 
         // We must have enough shared memory on the current device to store
-        // our lookup distances
+        // our lookup distances. The interleaved layout processes the lookup
+        // tables by tiles of sub-quantizers (in registers for 4-bit codes),
+        // so it supports any number of sub-quantizers
         int lookupTableSize = sizeof(float);
         if (ivfpqConfig_.useFloat16LookupTables) {
             lookupTableSize = sizeof(half);
@@ -599,11 +601,13 @@ void GpuIndexIVFPQ::verifyPQSettings_() const {
         size_t smemPerBlock = getMaxSharedMemPerBlock(config_.device);
 
         FAISS_THROW_IF_NOT_FMT(
-                requiredSmemSize <= getMaxSharedMemPerBlock(config_.device),
+                ivfpqConfig_.interleavedLayout ||
+                        requiredSmemSize <=
+                                getMaxSharedMemPerBlock(config_.device),
                 "Device %d has %zu bytes of shared memory, while "
                 "%d bits per code and %d sub-quantizers requires %zu "
-                "bytes. Consider useFloat16LookupTables and/or "
-                "reduce parameters",
+                "bytes. Consider useFloat16LookupTables, interleavedLayout "
+                "and/or reduce parameters",
                 config_.device,
                 smemPerBlock,
                 bitsPerCode_,
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/gpu/GpuIndexFlat.h>
+#include <faiss/gpu/GpuIndexIVFRaBitQ.h>
+#include <faiss/gpu/GpuResources.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/gpu/impl/IVFRaBitQ.cuh>
+#include <faiss/gpu/utils/CopyUtils.cuh>
+
+namespace faiss {
+namespace gpu {
+
+GpuIndexIVFRaBitQ::GpuIndexIVFRaBitQ(
+        GpuResourcesProvider* provider,
+        const faiss::IndexIVFRaBitQ* index,
+        GpuIndexIVFRaBitQConfig config)
+        : GpuIndexIVF(
+                  provider,
+                  index->d,
+                  index->metric_type,
+                  index->metric_arg,
+                  index->nlist,
+                  config),
+          ivfRaBitQConfig_(config),
+          reserveMemoryVecs_(0) {
+    copyFrom(index);
+}
+
+GpuIndexIVFRaBitQ::GpuIndexIVFRaBitQ(
+        GpuResourcesProvider* provider,
+        int dims,
+        idx_t nlist,
+        faiss::MetricType metric,
+        GpuIndexIVFRaBitQConfig config)
+        : GpuIndexIVF(provider, dims, metric, 0, nlist, config),
+          ivfRaBitQConfig_(config),
+          reserveMemoryVecs_(0) {
+    // We haven't trained ourselves, so don't construct the IVFRaBitQ
+    // index yet
+}
+
+GpuIndexIVFRaBitQ::GpuIndexIVFRaBitQ(
+        GpuResourcesProvider* provider,
+        Index* coarseQuantizer,
+        int dims,
+        idx_t nlist,
+        faiss::MetricType metric,
+        GpuIndexIVFRaBitQConfig config)
+        : GpuIndexIVF(
+                  provider,
+                  coarseQuantizer,
+                  dims,
+                  metric,
+                  0,
+                  nlist,
+                  config),
+          ivfRaBitQConfig_(config),
+          reserveMemoryVecs_(0) {
+    // There is nothing to train beyond the coarse quantizer
+    if (this->is_trained) {
+        setIndex_();
+    }
+}
+
+GpuIndexIVFRaBitQ::~GpuIndexIVFRaBitQ() {}
+
+void GpuIndexIVFRaBitQ::setIndex_() {
+    FAISS_THROW_IF_NOT_MSG(
+            !should_use_cuvs(config_),
+            "GpuIndexIVFRaBitQ does not support cuVS");
+
+    index_.reset(new IVFRaBitQ(
+            resources_.get(),
+            this->d,
+            this->nlist,
+            this->metric_type,
+            qb,
+            ivfRaBitQConfig_.indicesOptions,
+            config_.memorySpace));
+    baseIndex_ = std::static_pointer_cast<IVFBase, IVFRaBitQ>(index_);
+    updateQuantizer();
+
+    if (reserveMemoryVecs_) {
+        index_->reserveMemory(reserveMemoryVecs_);
+    }
+}
+
+void GpuIndexIVFRaBitQ::reserveMemory(size_t numVecs) {
+    DeviceScope scope(config_.device);
+
+    reserveMemoryVecs_ = numVecs;
+    if (index_) {
+        index_->reserveMemory(numVecs);
+    }
+}
+
+void GpuIndexIVFRaBitQ::copyFrom(const faiss::IndexIVFRaBitQ* index) {
+    DeviceScope scope(config_.device);
+
+    FAISS_THROW_IF_NOT_MSG(
+            index->rabitq.nb_bits == 1,
+            "GPU: only 1-bit RaBitQ codes are supported");
+
+    // Clear out our old data
+    index_.reset();
+    baseIndex_.reset();
+
+    // Copy what we need from the CPU index
+    GpuIndexIVF::copyFrom(index);
+    qb = index->qb;
+
+    // The other index might not be trained, in which case we don't need to copy
+    // over the lists
+    if (!index->is_trained) {
+        return;
+    }
+
+    // Otherwise, we can populate ourselves from the other index
+    this->is_trained = true;
+    setIndex_();
+
+    // Copy all of the IVF data
+    index_->copyInvertedListsFrom(index->invlists);
+}
+
+void GpuIndexIVFRaBitQ::copyTo(faiss::IndexIVFRaBitQ* index) const {
+    DeviceScope scope(config_.device);
+
+    // We must have the indices in order to copy to ourselves
+    FAISS_THROW_IF_NOT_MSG(
+            ivfRaBitQConfig_.indicesOptions != INDICES_IVF,
+            "Cannot copy to CPU as GPU index doesn't retain "
+            "indices (INDICES_IVF)");
+
+    GpuIndexIVF::copyTo(index);
+    index->rabitq = RaBitQuantizer(this->d, this->metric_type);
+    index->code_size = index->rabitq.code_size;
+    index->qb = qb;
+    index->by_residual = true;
+
+    auto ivf = new ArrayInvertedLists(nlist, index->code_size);
+    index->replace_invlists(ivf, true);
+
+    if (index_) {
+        // Copy IVF lists
+        index_->copyInvertedListsTo(ivf);
+    }
+}
+
+size_t GpuIndexIVFRaBitQ::reclaimMemory() {
+    DeviceScope scope(config_.device);
+
+    if (index_) {
+        return index_->reclaimMemory();
+    }
+
+    return 0;
+}
+
+void GpuIndexIVFRaBitQ::updateQuantizer() {
+    FAISS_THROW_IF_NOT_MSG(
+            quantizer, "Calling updateQuantizer without a quantizer instance");
+
+    // Only need to do something if we are already initialized
+    if (index_) {
+        index_->updateQuantizer(quantizer);
+    }
+}
+
+void GpuIndexIVFRaBitQ::reset() {
+    DeviceScope scope(config_.device);
+
+    if (index_) {
+        index_->reset();
+        this->ntotal = 0;
+    } else {
+        FAISS_ASSERT(this->ntotal == 0);
+    }
+}
+
+void GpuIndexIVFRaBitQ::train(idx_t n, const float* x) {
+    DeviceScope scope(config_.device);
+
+    // just in case someone changed us
+    verifyIVFSettings_();
+
+    if (this->is_trained) {
+        FAISS_ASSERT(index_);
+        return;
+    }
+
+    FAISS_ASSERT(!index_);
+
+    // FIXME: GPUize more of this
+    // First, make sure that the data is resident on the CPU, if it is not on
+    // the CPU, as we depend upon parts of the CPU code
+    auto hostData = toHost<float, 2>(
+            (float*)x,
+            resources_->getDefaultStream(config_.device),
+            {n, this->d});
+
+    trainQuantizer_(n, hostData.data());
+
+    // The quantizer is now trained; construct the IVF index
+    setIndex_();
+    this->is_trained = true;
+}
+
+bool GpuIndexIVFRaBitQ::getSearchGraphKey(
+        const SearchParameters* params,
+        std::vector<int64_t>& key) const {
+    if (!GpuIndexIVF::getSearchGraphKey(params, key)) {
+        return false;
+    }
+
+    int use_qb = qb;
+    if (auto rbqParams =
+                dynamic_cast<const IVFRaBitQSearchParameters*>(params)) {
+        use_qb = rbqParams->qb;
+    }
+    key.push_back(use_qb);
+
+    return true;
+}
+
+void GpuIndexIVFRaBitQ::searchImpl_(
+        idx_t n,
+        const float* x,
+        int k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_ASSERT(index_);
+
+    int use_qb = qb;
+    if (auto rbqParams =
+                dynamic_cast<const IVFRaBitQSearchParameters*>(params)) {
+        use_qb = rbqParams->qb;
+    }
+    index_->setQb(use_qb);
+
+    GpuIndexIVF::searchImpl_(n, x, k, distances, labels, params);
+}
+
+} // namespace gpu
+} // namespace faiss
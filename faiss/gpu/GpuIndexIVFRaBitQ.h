@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/IndexIVFRaBitQ.h>
+#include <faiss/gpu/GpuIndexIVF.h>
+#include <memory>
+
+namespace faiss {
+namespace gpu {
+
+class IVFRaBitQ;
+class GpuIndexFlat;
+
+struct GpuIndexIVFRaBitQConfig : public GpuIndexIVFConfig {};
+
+/// Wrapper around the GPU implementation that looks like
+/// faiss::IndexIVFRaBitQ. The distances are estimated with popcounts
+/// between the 1-bit codes and the (optionally qb-bit quantized) query
+/// residual, and are the same estimates as the CPU version
+class GpuIndexIVFRaBitQ : public GpuIndexIVF {
+   public:
+    /// Construct from a pre-existing faiss::IndexIVFRaBitQ instance, copying
+    /// data over to the given GPU, if the input index is trained.
+    GpuIndexIVFRaBitQ(
+            GpuResourcesProvider* provider,
+            const faiss::IndexIVFRaBitQ* index,
+            GpuIndexIVFRaBitQConfig config = GpuIndexIVFRaBitQConfig());
+
+    /// Constructs a new instance with an empty flat quantizer; the user
+    /// provides the number of IVF lists desired.
+    GpuIndexIVFRaBitQ(
+            GpuResourcesProvider* provider,
+            int dims,
+            idx_t nlist,
+            faiss::MetricType metric = faiss::METRIC_L2,
+            GpuIndexIVFRaBitQConfig config = GpuIndexIVFRaBitQConfig());
+
+    /// Constructs a new instance with a provided CPU or GPU coarse quantizer;
+    /// the user provides the number of IVF lists desired.
+    GpuIndexIVFRaBitQ(
+            GpuResourcesProvider* provider,
+            Index* coarseQuantizer,
+            int dims,
+            idx_t nlist,
+            faiss::MetricType metric = faiss::METRIC_L2,
+            GpuIndexIVFRaBitQConfig config = GpuIndexIVFRaBitQConfig());
+
+    ~GpuIndexIVFRaBitQ() override;
+
+    /// Reserve GPU memory in our inverted lists for this number of vectors
+    void reserveMemory(size_t numVecs);
+
+    /// Initialize ourselves from the given CPU index; will overwrite
+    /// all data in ourselves
+    void copyFrom(const faiss::IndexIVFRaBitQ* index);
+
+    /// Copy ourselves to the given CPU index; will overwrite all data
+    /// in the index instance
+    void copyTo(faiss::IndexIVFRaBitQ* index) const;
+
+    /// After adding vectors, one can call this to reclaim device memory
+    /// to exactly the amount needed. Returns space reclaimed in bytes
+    size_t reclaimMemory();
+
+    /// Clears out all inverted lists, but retains the coarse quantizer
+    void reset() override;
+
+    /// Should be called if the user ever changes the state of the IVF coarse
+    /// quantizer manually (e.g., substitutes a new instance or changes vectors
+    /// in the coarse quantizer outside the scope of training)
+    void updateQuantizer() override;
+
+    /// Trains the coarse quantizer based on the given vector data; RaBitQ
+    /// itself has no trained parameters
+    void train(idx_t n, const float* x) override;
+
+    /// The graph depends on qb as well
+    bool getSearchGraphKey(
+            const SearchParameters* params,
+            std::vector<int64_t>& key) const override;
+
+   protected:
+    /// Picks up the qb of IVFRaBitQSearchParameters
+    void searchImpl_(
+            idx_t n,
+            const float* x,
+            int k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params) const override;
+
+    /// Constructs index_ once the coarse quantizer is trained
+    void setIndex_();
+
+   public:
+    /// Exposed like the CPU version: number of bits the query residual is
+    /// quantized to, 0 to use the fp32 query
+    uint8_t qb = 0;
+
+   protected:
+    /// Our configuration options
+    const GpuIndexIVFRaBitQConfig ivfRaBitQConfig_;
+
+    /// Desired inverted list memory reservation
+    size_t reserveMemoryVecs_;
+
+    /// Instance that we own; contains the inverted list
+    std::shared_ptr<IVFRaBitQ> index_;
+};
+
+} // namespace gpu
+} // namespace faiss
@@ -544,6 +544,14 @@ void* StandardGpuResourcesImpl::allocMemory(const AllocRequest& req) {
         // Otherwise, we can handle this locally
         p = tempMemory_[adjReq.device]->allocMemory(adjReq.stream, adjReq.size);
     } else if (adjReq.space == MemorySpace::Device) {
+        // The allocation would be released before a captured CUDA graph
+        // using it is replayed
+        FAISS_THROW_IF_NOT_FMT(
+                !isStreamCapturing(adjReq.stream),
+                "StandardGpuResources: alloc fail %s "
+                "(stream is capturing a CUDA graph)",
+                adjReq.toString().c_str());
+
 #if defined USE_NVIDIA_CUVS
         try {
             rmm::mr::device_memory_resource* current_mr =
@@ -5,11 +5,18 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <faiss/gpu/GpuResources.h>
 #include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/gpu/utils/StaticUtils.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/gpu/impl/BinaryDistance.cuh>
+#include <faiss/gpu/utils/CopyUtils.cuh>
 #include <faiss/gpu/utils/DeviceDefs.cuh>
 #include <faiss/gpu/utils/DeviceTensor.cuh>
 #include <faiss/gpu/utils/Select.cuh>
 
+#include <vector>
+
 namespace faiss {
 namespace gpu {
 
@@ -326,5 +333,397 @@ void runBinaryDistance(
     }
 }
 
+//
+// Binary IVF list scanning
+//
+
+// Threads per block for the list scanning kernels; each block handles a
+// single query
+constexpr int kIVFScanThreads = 128;
+
+template <typename BinaryType>
+__device__ __forceinline__ int binaryHamming(
+        const BinaryType* a,
+        const BinaryType* b,
+        int numWords) {
+    int dist = 0;
+    for (int i = 0; i < numWords; ++i) {
+        dist += __popc(a[i] ^ b[i]);
+    }
+    return dist;
+}
+
+// Loads the query handled by this block into shared memory
+template <typename BinaryType>
+__device__ __forceinline__ const BinaryType* loadQueryToSmem(
+        const Tensor<unsigned char, 2, true>& queries,
+        idx_t queryId,
+        int numWords) {
+    extern __shared__ __align__(8) unsigned char smemQuery[];
+
+    auto query = (BinaryType*)smemQuery;
+    auto queryData = (const BinaryType*)queries[queryId].data();
+
+    for (int i = threadIdx.x; i < numWords; i += blockDim.x) {
+        query[i] = queryData[i];
+    }
+
+    __syncthreads();
+
+    return query;
+}
+
+// Scans the nprobe lists assigned to a query, keeping the k smallest Hamming
+// distances. A null entry in `listIndices` means that the ids are the offsets
+// in the list.
+template <
+        int NumWarpQ,
+        int NumThreadQ,
+        int ThreadsPerBlock,
+        typename BinaryType>
+__global__ void binaryIVFScanSelect(
+        Tensor<unsigned char, 2, true> queries,
+        Tensor<idx_t, 2, true> coarseIndices,
+        void** listCodes,
+        void** listIndices,
+        idx_t* listLengths,
+        Tensor<int, 2, true> outK,
+        Tensor<idx_t, 2, true> outV,
+        int k) {
+    if constexpr ((NumWarpQ == 1 && NumThreadQ == 1) || NumWarpQ >= kWarpSize) {
+        constexpr int kNumWarps = ThreadsPerBlock / kWarpSize;
+
+        __shared__ int smemK[kNumWarps * NumWarpQ];
+        __shared__ idx_t smemV[kNumWarps * NumWarpQ];
+
+        BlockSelect<
+                int,
+                idx_t,
+                false,
+                Comparator<int>,
+                NumWarpQ,
+                NumThreadQ,
+                ThreadsPerBlock>
+                heap(kMaxDistance, -1, smemK, smemV, k);
+
+        idx_t queryId = blockIdx.x;
+        int numWords = queries.getSize(1) / sizeof(BinaryType);
+        auto query = loadQueryToSmem<BinaryType>(queries, queryId, numWords);
+
+        for (idx_t p = 0; p < coarseIndices.getSize(1); ++p) {
+            idx_t listId = coarseIndices[queryId][p];
+            if (listId < 0) {
+                continue;
+            }
+
+            idx_t numVecs = listLengths[listId];
+            auto codes = (const BinaryType*)listCodes[listId];
+            auto ids = (const idx_t*)listIndices[listId];
+
+            // Whole warps must participate in the selection, so the list is
+            // padded to a multiple of the warp size with dummy entries
+            idx_t limit = utils::roundUp(numVecs, idx_t(kWarpSize));
+
+            for (idx_t i = threadIdx.x; i < limit; i += blockDim.x) {
+                int dist = kMaxDistance;
+                idx_t id = -1;
+
+                if (i < numVecs) {
+                    dist = binaryHamming(query, codes + i * numWords, numWords);
+                    id = ids ? ids[i] : i;
+                }
+
+                heap.add(dist, id);
+            }
+        }
+
+        heap.reduce();
+
+        for (int i = threadIdx.x; i < k; i += blockDim.x) {
+            outK[queryId][i] = smemK[i];
+            outV[queryId][i] = smemV[i];
+        }
+    }
+}
+
+// Range search over the nprobe lists assigned to a query, in two passes:
+// if `outOffsets` is null, only the number of results per query is
+// accumulated in `counts`. Otherwise the results are written at
+// outOffsets[query] + counts[query], with counts starting at zero.
+template <typename BinaryType>
+__global__ void binaryIVFScanRange(
+        Tensor<unsigned char, 2, true> queries,
+        Tensor<idx_t, 2, true> coarseIndices,
+        void** listCodes,
+        void** listIndices,
+        idx_t* listLengths,
+        int radius,
+        unsigned long long* counts,
+        const idx_t* outOffsets,
+        int* outDistances,
+        idx_t* outIndices) {
+    idx_t queryId = blockIdx.x;
+    int numWords = queries.getSize(1) / sizeof(BinaryType);
+    auto query = loadQueryToSmem<BinaryType>(queries, queryId, numWords);
+
+    unsigned long long numFound = 0;
+
+    for (idx_t p = 0; p < coarseIndices.getSize(1); ++p) {
+        idx_t listId = coarseIndices[queryId][p];
+        if (listId < 0) {
+            continue;
+        }
+
+        idx_t numVecs = listLengths[listId];
+        auto codes = (const BinaryType*)listCodes[listId];
+        auto ids = (const idx_t*)listIndices[listId];
+
+        for (idx_t i = threadIdx.x; i < numVecs; i += blockDim.x) {
+            int dist = binaryHamming(query, codes + i * numWords, numWords);
+
+            // Like the CPU version, the comparison is strict
+            if (dist < radius) {
+                if (outOffsets) {
+                    idx_t pos = outOffsets[queryId] +
+                            (idx_t)atomicAdd(&counts[queryId], 1ULL);
+                    outDistances[pos] = dist;
+                    outIndices[pos] = ids ? ids[i] : i;
+                } else {
+                    ++numFound;
+                }
+            }
+        }
+    }
+
+    if (!outOffsets && numFound > 0) {
+        atomicAdd(&counts[queryId], numFound);
+    }
+}
+
+template <typename BinaryType>
+void runBinaryIVFScan(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        DeviceVector<void*>& listCodes,
+        DeviceVector<void*>& listIndices,
+        DeviceVector<idx_t>& listLengths,
+        int k,
+        Tensor<int, 2, true>& outK,
+        Tensor<idx_t, 2, true>& outV,
+        cudaStream_t stream) {
+    auto grid = dim3(queries.getSize(0));
+    auto block = dim3(kIVFScanThreads);
+    size_t smem = queries.getSize(1);
+
+#define BINARY_IVF_SCAN(NUM_WARP_Q, NUM_THREAD_Q)                    \
+    binaryIVFScanSelect<                                             \
+            NUM_WARP_Q,                                              \
+            NUM_THREAD_Q,                                            \
+            kIVFScanThreads,                                         \
+            BinaryType><<<grid, block, smem, stream>>>(              \
+            queries,                                                 \
+            coarseIndices,                                           \
+            listCodes.data(),                                        \
+            listIndices.data(),                                      \
+            listLengths.data(),                                      \
+            outK,                                                    \
+            outV,                                                    \
+            k)
+
+    if (k == 1) {
+        BINARY_IVF_SCAN(1, 1);
+    } else if (k <= 32 && getWarpSizeCurrentDevice() == 32) {
+        BINARY_IVF_SCAN(32, 2);
+    } else if (k <= 64) {
+        BINARY_IVF_SCAN(64, 3);
+    } else if (k <= 128) {
+        BINARY_IVF_SCAN(128, 3);
+    } else if (k <= 256) {
+        BINARY_IVF_SCAN(256, 4);
+    } else if (k <= 512) {
+        BINARY_IVF_SCAN(512, 8);
+    } else if (k <= 1024) {
+        BINARY_IVF_SCAN(1024, 8);
+    }
+#if GPU_MAX_SELECTION_K >= 2048
+    else if (k <= 2048) {
+        BINARY_IVF_SCAN(2048, 8);
+    }
+#endif
+
+#undef BINARY_IVF_SCAN
+
+    CUDA_TEST_ERROR();
+}
+
+void runBinaryIVFDistance(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        DeviceVector<void*>& listCodes,
+        DeviceVector<void*>& listIndices,
+        DeviceVector<idx_t>& listLengths,
+        int k,
+        Tensor<int, 2, true>& outK,
+        Tensor<idx_t, 2, true>& outV,
+        cudaStream_t stream) {
+    FAISS_ASSERT(k <= GPU_MAX_SELECTION_K);
+    FAISS_ASSERT(queries.getSize(0) == coarseIndices.getSize(0));
+    FAISS_ASSERT(outK.getSize(0) == queries.getSize(0));
+    FAISS_ASSERT(outK.getSize(1) == k);
+    FAISS_ASSERT(outV.getSize(1) == k);
+
+    if (queries.getSize(0) == 0) {
+        return;
+    }
+
+    // The list codes are stored back to back, so they can be read by 32-bit
+    // words only if the code size is a multiple of 4
+    if (queries.getSize(1) % sizeof(unsigned int) == 0) {
+        runBinaryIVFScan<unsigned int>(
+                queries,
+                coarseIndices,
+                listCodes,
+                listIndices,
+                listLengths,
+                k,
+                outK,
+                outV,
+                stream);
+    } else {
+        runBinaryIVFScan<unsigned char>(
+                queries,
+                coarseIndices,
+                listCodes,
+                listIndices,
+                listLengths,
+                k,
+                outK,
+                outV,
+                stream);
+    }
+}
+
+template <typename BinaryType>
+void runBinaryIVFRangeScan(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        DeviceVector<void*>& listCodes,
+        DeviceVector<void*>& listIndices,
+        DeviceVector<idx_t>& listLengths,
+        int radius,
+        RangeSearchResult* result,
+        GpuResources* res,
+        cudaStream_t stream) {
+    idx_t numQueries = queries.getSize(0);
+    auto grid = dim3(numQueries);
+    auto block = dim3(kIVFScanThreads);
+    size_t smem = queries.getSize(1);
+
+    DeviceTensor<unsigned long long, 1, true> counts(
+            res, makeTempAlloc(AllocType::Other, stream), {numQueries});
+    counts.zero(stream);
+
+    // First pass: count the results of each query
+    binaryIVFScanRange<BinaryType><<<grid, block, smem, stream>>>(
+            queries,
+            coarseIndices,
+            listCodes.data(),
+            listIndices.data(),
+            listLengths.data(),
+            radius,
+            counts.data(),
+            nullptr,
+            nullptr,
+            nullptr);
+    CUDA_TEST_ERROR();
+
+    std::vector<unsigned long long> hostCounts(numQueries);
+    fromDevice(counts.data(), hostCounts.data(), numQueries, stream);
+
+    result->lims[0] = 0;
+    for (idx_t i = 0; i < numQueries; ++i) {
+        result->lims[i + 1] = result->lims[i] + hostCounts[i];
+    }
+    result->do_allocation();
+
+    idx_t total = result->lims[numQueries];
+    if (total == 0) {
+        return;
+    }
+
+    auto offsets = toDeviceTemporary<idx_t, 1>(
+            res,
+            getCurrentDevice(),
+            (idx_t*)result->lims,
+            stream,
+            {numQueries + 1});
+    DeviceTensor<int, 1, true> outDistances(
+            res, makeTempAlloc(AllocType::Other, stream), {total});
+    DeviceTensor<idx_t, 1, true> outIndices(
+            res, makeTempAlloc(AllocType::Other, stream), {total});
+
+    // Second pass: write the results, using the counts as cursors
+    counts.zero(stream);
+    binaryIVFScanRange<BinaryType><<<grid, block, smem, stream>>>(
+            queries,
+            coarseIndices,
+            listCodes.data(),
+            listIndices.data(),
+            listLengths.data(),
+            radius,
+            counts.data(),
+            offsets.data(),
+            outDistances.data(),
+            outIndices.data());
+    CUDA_TEST_ERROR();
+
+    std::vector<int> hostDistances(total);
+    fromDevice(outDistances.data(), hostDistances.data(), total, stream);
+    fromDevice(outIndices.data(), result->labels, total, stream);
+
+    // The distances are integers stored as floats, as on the CPU
+    for (idx_t i = 0; i < total; ++i) {
+        result->distances[i] = hostDistances[i];
+    }
+}
+
+void runBinaryIVFRangeDistance(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        DeviceVector<void*>& listCodes,
+        DeviceVector<void*>& listIndices,
+        DeviceVector<idx_t>& listLengths,
+        int radius,
+        RangeSearchResult* result,
+        GpuResources* res,
+        cudaStream_t stream) {
+    FAISS_ASSERT(queries.getSize(0) == coarseIndices.getSize(0));
+    FAISS_ASSERT(result->nq == queries.getSize(0));
+
+    if (queries.getSize(1) % sizeof(unsigned int) == 0) {
+        runBinaryIVFRangeScan<unsigned int>(
+                queries,
+                coarseIndices,
+                listCodes,
+                listIndices,
+                listLengths,
+                radius,
+                result,
+                res,
+                stream);
+    } else {
+        runBinaryIVFRangeScan<unsigned char>(
+                queries,
+                coarseIndices,
+                listCodes,
+                listIndices,
+                listLengths,
+                radius,
+                result,
+                res,
+                stream);
+    }
+}
+
 } // namespace gpu
 } // namespace faiss
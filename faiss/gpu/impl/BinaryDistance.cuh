@@ -6,8 +6,12 @@
  */
 
 #include <faiss/gpu/utils/DeviceTensor.cuh>
+#include <faiss/gpu/utils/DeviceVector.cuh>
 
 namespace faiss {
+
+struct RangeSearchResult;
+
 namespace gpu {
 
 // Performs brute-force k-NN comparison between `vecs` and `query`, where they
@@ -20,5 +24,35 @@ void runBinaryDistance(
         int k,
         cudaStream_t stream);
 
+// Scans the inverted lists of a binary IVF index. For each query, the lists
+// given in `coarseIndices` (-1 entries are skipped) are compared to the query
+// and the k smallest Hamming distances are kept. The list arrays hold, for
+// each list, a pointer to its codes, a pointer to its ids (or null if the ids
+// are the offsets in the list) and its length.
+void runBinaryIVFDistance(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        DeviceVector<void*>& listCodes,
+        DeviceVector<void*>& listIndices,
+        DeviceVector<idx_t>& listLengths,
+        int k,
+        Tensor<int, 2, true>& outK,
+        Tensor<idx_t, 2, true>& outV,
+        cudaStream_t stream);
+
+// Same as runBinaryIVFDistance, but returns all the vectors at a Hamming
+// distance < radius in a RangeSearchResult on the host, of size
+// queries.getSize(0)
+void runBinaryIVFRangeDistance(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        DeviceVector<void*>& listCodes,
+        DeviceVector<void*>& listIndices,
+        DeviceVector<idx_t>& listLengths,
+        int radius,
+        RangeSearchResult* result,
+        GpuResources* res,
+        cudaStream_t stream);
+
 } // namespace gpu
 } // namespace faiss
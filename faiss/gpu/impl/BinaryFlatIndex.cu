@@ -60,6 +60,46 @@ void BinaryFlatIndex::query(
     runBinaryDistance(vectors_, input, outDistances, outIndices, k, stream);
 }
 
+void BinaryFlatIndex::rangeQuery(
+        Tensor<unsigned char, 2, true>& input,
+        int radius,
+        RangeSearchResult* result) {
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+    idx_t n = input.getSize(0);
+
+    // The vectors are scanned as a single inverted list, whose ids are the
+    // offsets in the list
+    auto info = AllocInfo(
+            AllocType::Other, getCurrentDevice(), MemorySpace::Device, stream);
+
+    DeviceVector<void*> listCodes(resources_, info);
+    listCodes.resize(1, stream);
+    listCodes.setAt(0, (void*)vectors_.data(), stream);
+
+    DeviceVector<void*> listIndices(resources_, info);
+    listIndices.resize(1, stream);
+    listIndices.setAt(0, nullptr, stream);
+
+    DeviceVector<idx_t> listLengths(resources_, info);
+    listLengths.resize(1, stream);
+    listLengths.setAt(0, num_, stream);
+
+    DeviceTensor<idx_t, 2, true> coarseIndices(
+            resources_, makeTempAlloc(AllocType::Other, stream), {n, 1});
+    coarseIndices.zero(stream);
+
+    runBinaryIVFRangeDistance(
+            input,
+            coarseIndices,
+            listCodes,
+            listIndices,
+            listLengths,
+            radius,
+            result,
+            resources_,
+            stream);
+}
+
 void BinaryFlatIndex::add(
         const unsigned char* data,
         idx_t numVecs,
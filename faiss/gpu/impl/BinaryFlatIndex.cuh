@@ -11,6 +11,9 @@
 #include <faiss/gpu/utils/DeviceVector.cuh>
 
 namespace faiss {
+
+struct RangeSearchResult;
+
 namespace gpu {
 
 class GpuResources;
@@ -37,6 +40,13 @@ class BinaryFlatIndex {
             Tensor<int, 2, true>& outDistances,
             Tensor<idx_t, 2, true>& outIndices);
 
+    /// Finds the vectors at a Hamming distance < radius of the queries; the
+    /// result is on the host
+    void rangeQuery(
+            Tensor<unsigned char, 2, true>& vecs,
+            int radius,
+            RangeSearchResult* result);
+
     /// Add vectors to ourselves; the pointer passed can be on the host
     /// or the device
     void add(const unsigned char* data, idx_t numVecs, cudaStream_t stream);
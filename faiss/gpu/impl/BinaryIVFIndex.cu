@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/gpu/GpuResources.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/gpu/impl/BinaryDistance.cuh>
+#include <faiss/gpu/impl/BinaryIVFIndex.cuh>
+
+namespace faiss {
+namespace gpu {
+
+constexpr int kBitsPerByte = 8;
+
+BinaryIVFIndex::BinaryIVFIndex(
+        GpuResources* res,
+        int dim,
+        idx_t nlist,
+        MemorySpace space)
+        : resources_(res),
+          dim_(dim),
+          codeSize_(dim / kBitsPerByte),
+          numLists_(nlist),
+          space_(space),
+          deviceListCodePointers_(
+                  res,
+                  AllocInfo(
+                          AllocType::IVFLists,
+                          getCurrentDevice(),
+                          space,
+                          res->getDefaultStreamCurrentDevice())),
+          deviceListIndexPointers_(
+                  res,
+                  AllocInfo(
+                          AllocType::IVFLists,
+                          getCurrentDevice(),
+                          space,
+                          res->getDefaultStreamCurrentDevice())),
+          deviceListLengths_(
+                  res,
+                  AllocInfo(
+                          AllocType::IVFLists,
+                          getCurrentDevice(),
+                          space,
+                          res->getDefaultStreamCurrentDevice())) {
+    FAISS_ASSERT(dim % kBitsPerByte == 0);
+
+    reset();
+}
+
+idx_t BinaryIVFIndex::getDim() const {
+    return dim_;
+}
+
+idx_t BinaryIVFIndex::getNumLists() const {
+    return numLists_;
+}
+
+idx_t BinaryIVFIndex::getListLength(idx_t listId) const {
+    FAISS_ASSERT(listId < numLists_);
+    return listLengths_[listId];
+}
+
+std::vector<uint8_t> BinaryIVFIndex::getListVectors(idx_t listId) const {
+    FAISS_ASSERT(listId < numLists_);
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+
+    return listCodes_[listId]->copyToHost<uint8_t>(stream);
+}
+
+std::vector<idx_t> BinaryIVFIndex::getListIndices(idx_t listId) const {
+    FAISS_ASSERT(listId < numLists_);
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+
+    return listIndices_[listId]->copyToHost<idx_t>(stream);
+}
+
+void BinaryIVFIndex::appendVectors(
+        idx_t listId,
+        const uint8_t* codes,
+        const idx_t* ids,
+        idx_t numVecs,
+        cudaStream_t stream) {
+    FAISS_ASSERT(listId < numLists_);
+
+    if (numVecs == 0) {
+        return;
+    }
+
+    listCodes_[listId]->append(codes, numVecs * codeSize_, stream);
+    listIndices_[listId]->append(ids, numVecs, stream);
+    listLengths_[listId] += numVecs;
+
+    // The append may have reallocated the list
+    updateListInfo_(listId, stream);
+}
+
+void BinaryIVFIndex::updateListInfo_(idx_t listId, cudaStream_t stream) {
+    deviceListCodePointers_.setAt(
+            listId, (void*)listCodes_[listId]->data(), stream);
+    deviceListIndexPointers_.setAt(
+            listId, (void*)listIndices_[listId]->data(), stream);
+    deviceListLengths_.setAt(listId, listLengths_[listId], stream);
+}
+
+void BinaryIVFIndex::query(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        int k,
+        Tensor<int, 2, true>& outDistances,
+        Tensor<idx_t, 2, true>& outIndices) {
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+
+    runBinaryIVFDistance(
+            queries,
+            coarseIndices,
+            deviceListCodePointers_,
+            deviceListIndexPointers_,
+            deviceListLengths_,
+            k,
+            outDistances,
+            outIndices,
+            stream);
+}
+
+void BinaryIVFIndex::rangeQuery(
+        Tensor<unsigned char, 2, true>& queries,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        int radius,
+        RangeSearchResult* result) {
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+
+    runBinaryIVFRangeDistance(
+            queries,
+            coarseIndices,
+            deviceListCodePointers_,
+            deviceListIndexPointers_,
+            deviceListLengths_,
+            radius,
+            result,
+            resources_,
+            stream);
+}
+
+void BinaryIVFIndex::reset() {
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+
+    listCodes_.clear();
+    listIndices_.clear();
+    listLengths_.assign(numLists_, 0);
+
+    auto info =
+            AllocInfo(AllocType::IVFLists, getCurrentDevice(), space_, stream);
+
+    for (idx_t i = 0; i < numLists_; ++i) {
+        listCodes_.emplace_back(
+                std::make_unique<DeviceVector<uint8_t>>(resources_, info));
+        listIndices_.emplace_back(
+                std::make_unique<DeviceVector<idx_t>>(resources_, info));
+    }
+
+    deviceListCodePointers_.resize(numLists_, stream);
+    deviceListCodePointers_.setAll(nullptr, stream);
+
+    deviceListIndexPointers_.resize(numLists_, stream);
+    deviceListIndexPointers_.setAll(nullptr, stream);
+
+    deviceListLengths_.resize(numLists_, stream);
+    deviceListLengths_.setAll(0, stream);
+}
+
+} // namespace gpu
+} // namespace faiss
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/gpu/utils/DeviceTensor.cuh>
+#include <faiss/gpu/utils/DeviceVector.cuh>
+#include <memory>
+#include <vector>
+
+namespace faiss {
+
+struct RangeSearchResult;
+
+namespace gpu {
+
+class GpuResources;
+
+/// Holder of the GPU inverted lists of a binary IVF index. Each list stores
+/// its codes and ids back to back in its own allocation.
+class BinaryIVFIndex {
+   public:
+    BinaryIVFIndex(
+            GpuResources* res,
+            int dim,
+            idx_t nlist,
+            MemorySpace space);
+
+    /// Returns the number of bits of the vectors
+    idx_t getDim() const;
+
+    /// Returns the number of inverted lists
+    idx_t getNumLists() const;
+
+    /// Returns the number of vectors in a list
+    idx_t getListLength(idx_t listId) const;
+
+    /// Returns the codes of a list, copied to the host
+    std::vector<uint8_t> getListVectors(idx_t listId) const;
+
+    /// Returns the ids of a list, copied to the host
+    std::vector<idx_t> getListIndices(idx_t listId) const;
+
+    /// Appends vectors to a list; the codes and ids can be on the host or
+    /// the device
+    void appendVectors(
+            idx_t listId,
+            const uint8_t* codes,
+            const idx_t* ids,
+            idx_t numVecs,
+            cudaStream_t stream);
+
+    /// Finds the k nearest neighbors of the queries among the lists given
+    /// in coarseIndices (size numQueries x nprobe)
+    void query(
+            Tensor<unsigned char, 2, true>& queries,
+            Tensor<idx_t, 2, true>& coarseIndices,
+            int k,
+            Tensor<int, 2, true>& outDistances,
+            Tensor<idx_t, 2, true>& outIndices);
+
+    /// Finds the vectors at a Hamming distance < radius of the queries among
+    /// the lists given in coarseIndices; the result is on the host
+    void rangeQuery(
+            Tensor<unsigned char, 2, true>& queries,
+            Tensor<idx_t, 2, true>& coarseIndices,
+            int radius,
+            RangeSearchResult* result);
+
+    /// Free all storage, leaving nlist empty lists
+    void reset();
+
+   private:
+    /// Updates the device pointer and length of a list
+    void updateListInfo_(idx_t listId, cudaStream_t stream);
+
+   private:
+    /// Collection of GPU resources that we use
+    GpuResources* resources_;
+
+    /// Number of bits of the vectors
+    const int dim_;
+
+    /// Number of bytes per code
+    const int codeSize_;
+
+    /// Number of inverted lists
+    const idx_t numLists_;
+
+    /// Memory space of the lists
+    const MemorySpace space_;
+
+    /// Codes and ids of each list
+    std::vector<std::unique_ptr<DeviceVector<uint8_t>>> listCodes_;
+    std::vector<std::unique_ptr<DeviceVector<idx_t>>> listIndices_;
+
+    /// Host copy of the list lengths
+    std::vector<idx_t> listLengths_;
+
+    /// Device arrays of the list code and id pointers and lengths, as read
+    /// by the scanning kernels
+    DeviceVector<void*> deviceListCodePointers_;
+    DeviceVector<void*> deviceListIndexPointers_;
+    DeviceVector<idx_t> deviceListLengths_;
+};
+
+} // namespace gpu
+} // namespace faiss
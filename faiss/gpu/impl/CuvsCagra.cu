@@ -27,6 +27,8 @@
 #include <faiss/gpu/impl/CuvsCagra.cuh>
 
 #include <cuvs/neighbors/cagra.hpp>
+#include <cuvs/neighbors/refine.hpp>
+#include <raft/core/copy.hpp>
 #include <raft/core/device_mdspan.hpp>
 #include <raft/core/device_resources.hpp>
 #include <raft/core/resource/thrust_policy.hpp>
@@ -48,7 +50,8 @@ CuvsCagra::CuvsCagra(
         std::optional<cuvs::neighbors::ivf_pq::index_params> ivf_pq_params,
         std::optional<cuvs::neighbors::ivf_pq::search_params>
                 ivf_pq_search_params,
-        float refine_rate)
+        float refine_rate,
+        std::optional<cuvs::neighbors::vpq_params> vpq_params)
         : resources_(resources),
           dim_(dim),
           graph_build_algo_(graph_build_algo),
@@ -59,17 +62,27 @@ CuvsCagra::CuvsCagra(
           index_params_(),
           ivf_pq_params_(ivf_pq_params),
           ivf_pq_search_params_(ivf_pq_search_params),
-          refine_rate_(refine_rate) {
+          refine_rate_(refine_rate),
+          vpq_params_(vpq_params) {
     FAISS_THROW_IF_NOT_MSG(
             metric == faiss::METRIC_L2 || metric == faiss::METRIC_INNER_PRODUCT,
             "CAGRA currently only supports L2 or Inner Product metric.");
     FAISS_THROW_IF_NOT_MSG(
             indicesOptions == faiss::gpu::INDICES_64_BIT,
             "only INDICES_64_BIT is supported for cuVS CAGRA index");
+    if (vpq_params_) {
+        FAISS_THROW_IF_NOT_MSG(
+                metric == faiss::METRIC_L2,
+                "the compressed CAGRA dataset only supports the L2 metric");
+        FAISS_THROW_IF_NOT_MSG(
+                store_dataset,
+                "the compressed CAGRA dataset requires store_dataset");
+    }
 
     index_params_.intermediate_graph_degree = intermediate_graph_degree;
     index_params_.graph_degree = graph_degree;
     index_params_.attach_dataset_on_build = store_dataset;
+    index_params_.compression = vpq_params_;
 
     if (!ivf_pq_search_params_) {
         ivf_pq_search_params_ =
@@ -89,17 +102,22 @@ CuvsCagra::CuvsCagra(
         const idx_t* knn_graph,
         faiss::MetricType metric,
         float metricArg,
-        IndicesOptions indicesOptions)
+        IndicesOptions indicesOptions,
+        std::optional<cuvs::neighbors::vpq_params> vpq_params)
         : resources_(resources),
           dim_(dim),
           metric_(metric),
-          metricArg_(metricArg) {
+          metricArg_(metricArg),
+          vpq_params_(vpq_params) {
     FAISS_THROW_IF_NOT_MSG(
             metric == faiss::METRIC_L2 || metric == faiss::METRIC_INNER_PRODUCT,
             "CAGRA currently only supports L2 or Inner Product metric.");
     FAISS_THROW_IF_NOT_MSG(
             indicesOptions == faiss::gpu::INDICES_64_BIT,
             "only INDICES_64_BIT is supported for cuVS CAGRA index");
+    FAISS_THROW_IF_NOT_MSG(
+            !vpq_params_ || metric == faiss::METRIC_L2,
+            "the compressed CAGRA dataset only supports the L2 metric");
 
     auto distances_on_gpu = getDeviceForAddress(distances) >= 0;
     auto knn_graph_on_gpu = getDeviceForAddress(knn_graph) >= 0;
@@ -133,6 +151,13 @@ CuvsCagra::CuvsCagra(
                 metricFaissToCuvs(metric_, false),
                 distances_mds,
                 raft::make_const_mdspan(knn_graph_copy.view()));
+        if (vpq_params_) {
+            // replaces the float dataset on the device
+            cuvs_index->update_dataset(
+                    raft_handle,
+                    cuvs::neighbors::vpq_build(
+                            raft_handle, *vpq_params_, distances_mds));
+        }
     } else if (!distances_on_gpu && !knn_graph_on_gpu) {
         // copy idx_t (int64_t) host knn_graph to uint32_t host knn_graph
         auto knn_graph_copy =
@@ -145,12 +170,26 @@ CuvsCagra::CuvsCagra(
         auto distances_mds = raft::make_host_matrix_view<const float, int64_t>(
                 distances, n, dim);
 
-        cuvs_index = std::make_shared<
-                cuvs::neighbors::cagra::index<float, uint32_t>>(
-                raft_handle,
-                metricFaissToCuvs(metric_, false),
-                distances_mds,
-                raft::make_const_mdspan(knn_graph_copy.view()));
+        if (vpq_params_) {
+            // only the graph and the compressed dataset go to the device
+            cuvs_index = std::make_shared<
+                    cuvs::neighbors::cagra::index<float, uint32_t>>(
+                    raft_handle, metricFaissToCuvs(metric_, false));
+            cuvs_index->update_graph(
+                    raft_handle,
+                    raft::make_const_mdspan(knn_graph_copy.view()));
+            cuvs_index->update_dataset(
+                    raft_handle,
+                    cuvs::neighbors::vpq_build(
+                            raft_handle, *vpq_params_, distances_mds));
+        } else {
+            cuvs_index = std::make_shared<
+                    cuvs::neighbors::cagra::index<float, uint32_t>>(
+                    raft_handle,
+                    metricFaissToCuvs(metric_, false),
+                    distances_mds,
+                    raft::make_const_mdspan(knn_graph_copy.view()));
+        }
     } else {
         FAISS_THROW_MSG(
                 "distances and knn_graph must both be in device or host memory");
@@ -223,7 +262,8 @@ void CuvsCagra::search(
         idx_t hashmap_min_bitlen,
         float hashmap_max_fill_rate,
         idx_t num_random_samplings,
-        idx_t rand_xor_mask) {
+        idx_t rand_xor_mask,
+        float refine_k_factor) {
     const raft::device_resources& raft_handle =
             resources_->getRaftHandleCurrentDevice();
     idx_t numQueries = queries.getSize(0);
@@ -271,6 +311,41 @@ void CuvsCagra::search(
     search_pams.num_random_samplings = num_random_samplings;
     search_pams.rand_xor_mask = rand_xor_mask;
 
+    if (vpq_params_ && refine_k_factor > 1) {
+        // search more candidates in the compressed dataset and re-rank
+        // them with the full-precision vectors
+        FAISS_THROW_IF_NOT_MSG(
+                storage_, "refinement requires the full-precision vectors");
+        idx_t k_base = std::min(idx_t(k_ * refine_k_factor), idx_t(n_));
+        k_base = std::max(k_base, k_);
+
+        auto base_indices = raft::make_device_matrix<uint32_t, int64_t>(
+                raft_handle, numQueries, k_base);
+        auto base_distances = raft::make_device_matrix<float, int64_t>(
+                raft_handle, numQueries, k_base);
+        cuvs::neighbors::cagra::search(
+                raft_handle,
+                search_pams,
+                *cuvs_index,
+                queries_view,
+                base_indices.view(),
+                base_distances.view());
+
+        auto candidates = raft::make_device_matrix<idx_t, int64_t>(
+                raft_handle, numQueries, k_base);
+        thrust::copy(
+                raft::resource::get_thrust_policy(raft_handle),
+                base_indices.data_handle(),
+                base_indices.data_handle() + base_indices.size(),
+                candidates.data_handle());
+
+        refine(queries_view,
+               raft::make_const_mdspan(candidates.view()),
+               indices_view,
+               distances_view);
+        return;
+    }
+
     auto indices_copy = raft::make_device_matrix<uint32_t, int64_t>(
             raft_handle, numQueries, k_);
 
@@ -288,6 +363,62 @@ void CuvsCagra::search(
             indices_view.data_handle());
 }
 
+void CuvsCagra::refine(
+        raft::device_matrix_view<const float, int64_t> queries,
+        raft::device_matrix_view<const idx_t, int64_t> candidates,
+        raft::device_matrix_view<idx_t, int64_t> indices,
+        raft::device_matrix_view<float, int64_t> distances) {
+    const raft::device_resources& raft_handle =
+            resources_->getRaftHandleCurrentDevice();
+    auto metric = metricFaissToCuvs(metric_, false);
+
+    if (getDeviceForAddress(storage_) >= 0) {
+        auto dataset = raft::make_device_matrix_view<const float, int64_t>(
+                storage_, n_, dim_);
+        cuvs::neighbors::refine(
+                raft_handle,
+                dataset,
+                queries,
+                candidates,
+                indices,
+                distances,
+                metric);
+        return;
+    }
+
+    // the full-precision vectors are on the CPU: re-rank there
+    idx_t nq = queries.extent(0);
+    idx_t k = indices.extent(1);
+    auto queries_host = raft::make_host_matrix<float, int64_t>(nq, dim_);
+    auto candidates_host =
+            raft::make_host_matrix<idx_t, int64_t>(nq, candidates.extent(1));
+    auto indices_host = raft::make_host_matrix<idx_t, int64_t>(nq, k);
+    auto distances_host = raft::make_host_matrix<float, int64_t>(nq, k);
+    raft::copy(raft_handle, queries_host.view(), queries);
+    raft::copy(raft_handle, candidates_host.view(), candidates);
+    raft_handle.sync_stream();
+
+    auto dataset = raft::make_host_matrix_view<const float, int64_t>(
+            storage_, n_, dim_);
+    cuvs::neighbors::refine(
+            raft_handle,
+            dataset,
+            raft::make_const_mdspan(queries_host.view()),
+            raft::make_const_mdspan(candidates_host.view()),
+            indices_host.view(),
+            distances_host.view(),
+            metric);
+
+    raft::copy(
+            raft_handle, indices, raft::make_const_mdspan(indices_host.view()));
+    raft::copy(
+            raft_handle,
+            distances,
+            raft::make_const_mdspan(distances_host.view()));
+    // the host buffers are released on return
+    raft_handle.sync_stream();
+}
+
 void CuvsCagra::reset() {
     cuvs_index.reset();
 }
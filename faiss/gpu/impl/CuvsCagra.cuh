@@ -62,7 +62,9 @@ class CuvsCagra {
                     std::nullopt,
             std::optional<cuvs::neighbors::ivf_pq::search_params>
                     ivf_pq_search_params = std::nullopt,
-            float refine_rate = 2.0f);
+            float refine_rate = 2.0f,
+            std::optional<cuvs::neighbors::vpq_params> vpq_params =
+                    std::nullopt);
 
     CuvsCagra(
             GpuResources* resources,
@@ -73,7 +75,9 @@ class CuvsCagra {
             const idx_t* knn_graph,
             faiss::MetricType metric,
             float metricArg,
-            IndicesOptions indicesOptions);
+            IndicesOptions indicesOptions,
+            std::optional<cuvs::neighbors::vpq_params> vpq_params =
+                    std::nullopt);
 
     ~CuvsCagra() = default;
 
@@ -96,7 +100,8 @@ class CuvsCagra {
             idx_t hashmap_min_bitlen,
             float hashmap_max_fill_rate,
             idx_t num_random_samplings,
-            idx_t rand_xor_mask);
+            idx_t rand_xor_mask,
+            float refine_k_factor = 1);
 
     void reset();
 
@@ -107,6 +112,13 @@ class CuvsCagra {
     const float* get_training_dataset() const;
 
    private:
+    /// re-rank the candidates with the full-precision vectors of storage_
+    void refine(
+            raft::device_matrix_view<const float, int64_t> queries,
+            raft::device_matrix_view<const idx_t, int64_t> candidates,
+            raft::device_matrix_view<idx_t, int64_t> indices,
+            raft::device_matrix_view<float, int64_t> distances);
+
     /// Collection of GPU resources that we use
     GpuResources* resources_;
 
@@ -139,6 +151,9 @@ class CuvsCagra {
     std::optional<cuvs::neighbors::ivf_pq::search_params> ivf_pq_search_params_;
     std::optional<float> refine_rate_;
 
+    /// If set, the device dataset is VPQ-compressed
+    std::optional<cuvs::neighbors::vpq_params> vpq_params_;
+
     /// Parameters to build CAGRA graph using NN Descent
     size_t nn_descent_niter_ = 20;
 
@@ -109,6 +109,10 @@ Tensor<half, 2, true>& FlatIndex::getVectorsFloat16Ref() {
     return vectorsHalf_;
 }
 
+Tensor<float, 1, true>& FlatIndex::getNormsRef() {
+    return norms_;
+}
+
 void FlatIndex::query(
         Tensor<float, 2, true>& input,
         int k,
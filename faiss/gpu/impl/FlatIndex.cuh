@@ -60,6 +60,9 @@ class FlatIndex {
     /// Returns a reference to our vectors currently in use (if useFloat16 mode)
     Tensor<half, 2, true>& getVectorsFloat16Ref();
 
+    /// Returns a reference to the L2 norms of our vectors
+    Tensor<float, 1, true>& getNormsRef();
+
     virtual void query(
             Tensor<float, 2, true>& vecs,
             int k,
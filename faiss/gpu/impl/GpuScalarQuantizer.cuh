@@ -26,6 +26,7 @@ inline bool isSQSupported(ScalarQuantizer::QuantizerType qtype) {
         case ScalarQuantizer::QuantizerType::QT_4bit_uniform:
         case ScalarQuantizer::QuantizerType::QT_6bit:
         case ScalarQuantizer::QuantizerType::QT_fp16:
+        case ScalarQuantizer::QuantizerType::QT_bf16:
             return true;
         default:
             return false;
@@ -201,6 +202,70 @@ struct Codec<ScalarQuantizer::QuantizerType::QT_fp16, 1> {
     int bytesPerVec;
 };
 
+// Arbitrary dimension bf16
+template <>
+struct Codec<ScalarQuantizer::QuantizerType::QT_bf16, 1> {
+    /// How many dimensions per iteration we are handling for encoding or
+    /// decoding
+    static constexpr int kDimPerIter = 1;
+
+    Codec(int vecBytes) : bytesPerVec(vecBytes) {}
+
+    size_t getSmemSize(int dim) {
+        return 0;
+    }
+    inline __device__ void initKernel(float* smem, int dim) {}
+
+    inline __device__ void decode(void* data, idx_t vec, int d, float* out)
+            const {
+        auto p = (__nv_bfloat16*)&((uint8_t*)data)[vec * bytesPerVec];
+        out[0] = ConvertTo<float>::to(p[d]);
+    }
+
+    inline __device__ float decodePartial(
+            void* data,
+            idx_t vec,
+            int d,
+            int subD) const {
+        // doesn't need implementing (kDimPerIter == 1)
+        return 0.0f;
+    }
+
+    inline __device__ void encode(
+            void* data,
+            idx_t vec,
+            int d,
+            float v[kDimPerIter]) const {
+        auto p = (__nv_bfloat16*)&((uint8_t*)data)[vec * bytesPerVec];
+        p[d] = ConvertTo<__nv_bfloat16>::to(v[0]);
+    }
+
+    inline __device__ void encodePartial(
+            void* data,
+            idx_t vec,
+            int d,
+            int remaining,
+            float v[kDimPerIter]) const {
+        // doesn't need implementing (kDimPerIter == 1)
+    }
+
+    //
+    // new implementation
+    //
+    using EncodeT = __nv_bfloat16;
+    static constexpr int kEncodeBits = 16;
+
+    inline __device__ EncodeT encodeNew(int dim, float v) const {
+        return ConvertTo<__nv_bfloat16>::to(v);
+    }
+
+    inline __device__ float decodeNew(int dim, EncodeT v) const {
+        return ConvertTo<float>::to(v);
+    }
+
+    int bytesPerVec;
+};
+
 /////
 //
 // 8 bit encodings
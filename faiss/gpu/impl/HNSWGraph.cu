@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/gpu/impl/HNSWGraph.cuh>
+#include <faiss/gpu/utils/DeviceDefs.cuh>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/gpu/utils/Limits.cuh>
+#include <faiss/gpu/utils/Reductions.cuh>
+#include <faiss/gpu/utils/StaticUtils.h>
+#include <faiss/impl/FaissAssert.h>
+
+#include <algorithm>
+
+namespace faiss {
+namespace gpu {
+
+namespace {
+
+constexpr int kHNSWSearchThreads = 256;
+
+/// Empty slot of the beam and of the visited set
+constexpr unsigned kEmptyNode = 0xffffffffu;
+
+/// Set on the beam entries that were expanded
+constexpr unsigned kExpandedBit = 0x80000000u;
+
+/// Linear probes in the visited set before a node is considered new
+constexpr int kMaxProbes = 32;
+
+/// Inserts node in the open addressing visited set; returns false if it
+/// was already there. When the set is saturated the node is evaluated again
+__device__ bool insertVisited(unsigned* table, int hashBits, unsigned node) {
+    unsigned mask = (1u << hashBits) - 1;
+    unsigned slot = (node * 0x9e3779b1u) >> (32 - hashBits);
+
+    for (int i = 0; i < kMaxProbes; ++i) {
+        unsigned prev = atomicCAS(&table[slot], kEmptyNode, node);
+        if (prev == kEmptyNode) {
+            return true;
+        } else if (prev == node) {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return true;
+}
+
+/// Block-wide bitonic sort of n (a power of 2) (distance, node) pairs by
+/// increasing distance
+__device__ void bitonicSortBlock(float* dis, unsigned* ids, int n) {
+    for (int size = 2; size <= n; size <<= 1) {
+        for (int stride = size / 2; stride > 0; stride >>= 1) {
+            for (int i = threadIdx.x; i < n; i += blockDim.x) {
+                int j = i ^ stride;
+
+                if (j > i) {
+                    bool ascending = (i & size) == 0;
+
+                    if ((dis[i] > dis[j]) == ascending) {
+                        float d = dis[i];
+                        dis[i] = dis[j];
+                        dis[j] = d;
+                        unsigned id = ids[i];
+                        ids[i] = ids[j];
+                        ids[j] = id;
+                    }
+                }
+            }
+
+            __syncthreads();
+        }
+    }
+}
+
+// Shared memory layout: the query, then sortSize (distance, node) pairs
+// (the beam followed by the candidates of the current iteration), then the
+// visited set
+template <bool InnerProduct>
+__global__ void hnswGraphSearch(
+        Tensor<float, 2, true> vectors,
+        Tensor<idx_t, 1, true> offsets,
+        Tensor<int, 1, true> neighbors,
+        int maxDegree,
+        Tensor<float, 2, true> queries,
+        Tensor<int, 2, true> entryPoints,
+        int beamSize,
+        int sortSize,
+        int maxIterations,
+        int hashBits,
+        Tensor<float, 2, true> outDistances,
+        Tensor<idx_t, 2, true> outIndices) {
+    extern __shared__ char smemByte[];
+    __shared__ int expandNode;
+
+    int dim = queries.getSize(1);
+    float* query = (float*)smemByte;
+    float* sortDis = query + dim;
+    unsigned* sortIds = (unsigned*)(sortDis + sortSize);
+    unsigned* visited = sortIds + sortSize;
+
+    idx_t queryId = blockIdx.x;
+    int laneId = threadIdx.x % kWarpSize;
+    int warpId = threadIdx.x / kWarpSize;
+    int numWarps = blockDim.x / kWarpSize;
+
+    for (int i = threadIdx.x; i < dim; i += blockDim.x) {
+        query[i] = queries[queryId][i];
+    }
+
+    for (int i = threadIdx.x; i < sortSize; i += blockDim.x) {
+        sortDis[i] = Limits<float>::getMax();
+        sortIds[i] = kEmptyNode;
+    }
+
+    for (int i = threadIdx.x; i < (1 << hashBits); i += blockDim.x) {
+        visited[i] = kEmptyNode;
+    }
+
+    __syncthreads();
+
+    // The first list evaluated is that of the entry points
+    const int* list =
+            entryPoints[entryPoints.getSize(0) == 1 ? 0 : queryId].data();
+    int listSize = entryPoints.getSize(1);
+
+    for (int iter = 0;; ++iter) {
+        // The new nodes of the list become candidates after the beam
+        for (int i = threadIdx.x; i < listSize; i += blockDim.x) {
+            int node = list[i];
+
+            if (node >= 0 && insertVisited(visited, hashBits, node)) {
+                sortIds[beamSize + i] = node;
+            }
+        }
+
+        __syncthreads();
+
+        // One warp per candidate distance
+        for (int i = warpId; i < listSize; i += numWarps) {
+            unsigned node = sortIds[beamSize + i];
+            if (node == kEmptyNode) {
+                continue;
+            }
+
+            const float* vec = vectors[node].data();
+            float acc = 0;
+
+            for (int j = laneId; j < dim; j += kWarpSize) {
+                if (InnerProduct) {
+                    acc += query[j] * vec[j];
+                } else {
+                    float diff = query[j] - vec[j];
+                    acc += diff * diff;
+                }
+            }
+
+            acc = warpReduceAllSum(acc);
+
+            // The beam is sorted by increasing distance
+            if (laneId == 0) {
+                sortDis[beamSize + i] = InnerProduct ? -acc : acc;
+            }
+        }
+
+        __syncthreads();
+
+        bitonicSortBlock(sortDis, sortIds, sortSize);
+
+        // The candidates that did not enter the beam are dropped
+        for (int i = beamSize + threadIdx.x; i < sortSize; i += blockDim.x) {
+            sortDis[i] = Limits<float>::getMax();
+            sortIds[i] = kEmptyNode;
+        }
+
+        // Expand the best node of the beam that was not expanded yet
+        if (threadIdx.x == 0) {
+            expandNode = -1;
+
+            for (int i = 0; iter < maxIterations && i < beamSize; ++i) {
+                unsigned node = sortIds[i];
+                if (node == kEmptyNode) {
+                    break;
+                }
+
+                if (!(node & kExpandedBit)) {
+                    sortIds[i] = node | kExpandedBit;
+                    expandNode = node;
+                    break;
+                }
+            }
+        }
+
+        __syncthreads();
+
+        if (expandNode < 0) {
+            break;
+        }
+
+        idx_t begin = offsets[expandNode];
+        list = neighbors.data() + begin;
+        listSize = min(int(offsets[expandNode + 1] - begin), maxDegree);
+    }
+
+    if (threadIdx.x == 0) {
+        int k = outDistances.getSize(1);
+        int numOut = 0;
+
+        for (int i = 0; i < beamSize && numOut < k; ++i) {
+            unsigned node = sortIds[i];
+            if (node == kEmptyNode) {
+                break;
+            }
+            node &= ~kExpandedBit;
+
+            // A saturated visited set may let a node in the beam twice
+            if (numOut > 0 && outIndices[queryId][numOut - 1] == idx_t(node)) {
+                continue;
+            }
+
+            outDistances[queryId][numOut] =
+                    InnerProduct ? -sortDis[i] : sortDis[i];
+            outIndices[queryId][numOut] = node;
+            ++numOut;
+        }
+
+        for (; numOut < k; ++numOut) {
+            outDistances[queryId][numOut] = InnerProduct
+                    ? -Limits<float>::getMax()
+                    : Limits<float>::getMax();
+            outIndices[queryId][numOut] = -1;
+        }
+    }
+}
+
+} // namespace
+
+HNSWGraph::HNSWGraph(
+        GpuResources* res,
+        int dim,
+        bool innerProduct,
+        MemorySpace space)
+        : resources_(res),
+          dim_(dim),
+          innerProduct_(innerProduct),
+          space_(space),
+          maxDegree_(0) {}
+
+void HNSWGraph::set(
+        idx_t n,
+        const float* vectors,
+        const std::vector<idx_t>& offsets,
+        const std::vector<int>& neighbors,
+        cudaStream_t stream) {
+    FAISS_ASSERT(offsets.size() == size_t(n + 1));
+    FAISS_ASSERT(offsets[n] == idx_t(neighbors.size()));
+    // The high bit of the node ids flags the expanded nodes of the beam
+    FAISS_THROW_IF_NOT_MSG(
+            n < idx_t(kExpandedBit) - 1, "too many nodes for the GPU graph");
+
+    reset();
+
+    maxDegree_ = 0;
+    for (idx_t i = 0; i < n; ++i) {
+        maxDegree_ = std::max(maxDegree_, int(offsets[i + 1] - offsets[i]));
+    }
+
+    vectors_ = DeviceTensor<float, 2, true>(
+            resources_,
+            makeSpaceAlloc(AllocType::FlatData, space_, stream),
+            {n, dim_});
+    vectors_.copyFrom(std::vector<float>(vectors, vectors + n * dim_), stream);
+
+    offsets_ = DeviceTensor<idx_t, 1, true>(
+            resources_,
+            makeSpaceAlloc(AllocType::FlatData, space_, stream),
+            {n + 1});
+    offsets_.copyFrom(offsets, stream);
+
+    // An empty graph still needs a valid neighbor array
+    neighbors_ = DeviceTensor<int, 1, true>(
+            resources_,
+            makeSpaceAlloc(AllocType::FlatData, space_, stream),
+            {std::max(idx_t(neighbors.size()), idx_t(1))});
+    if (!neighbors.empty()) {
+        neighbors_.copyFrom(neighbors, stream);
+    }
+}
+
+void HNSWGraph::reset() {
+    vectors_ = DeviceTensor<float, 2, true>();
+    offsets_ = DeviceTensor<idx_t, 1, true>();
+    neighbors_ = DeviceTensor<int, 1, true>();
+    maxDegree_ = 0;
+}
+
+idx_t HNSWGraph::getSize() const {
+    return vectors_.getSize(0);
+}
+
+int HNSWGraph::getMaxDegree() const {
+    return maxDegree_;
+}
+
+void HNSWGraph::query(
+        Tensor<float, 2, true>& queries,
+        Tensor<int, 2, true>& entryPoints,
+        int beamSize,
+        int maxIterations,
+        Tensor<float, 2, true>& outDistances,
+        Tensor<idx_t, 2, true>& outIndices) {
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+    idx_t nq = queries.getSize(0);
+    int k = outDistances.getSize(1);
+
+    FAISS_ASSERT(queries.getSize(1) == dim_);
+    FAISS_ASSERT(outIndices.getSize(0) == nq && outIndices.getSize(1) == k);
+    FAISS_ASSERT(
+            entryPoints.getSize(0) == 1 || entryPoints.getSize(0) == nq);
+    FAISS_THROW_IF_NOT_FMT(
+            k <= beamSize, "k (%d) must be <= the beam size (%d)", k, beamSize);
+
+    if (nq == 0) {
+        return;
+    }
+
+    // The candidate slots hold a neighbor list or the entry points
+    int numCandidates = std::max(maxDegree_, int(entryPoints.getSize(1)));
+    int sortSize = beamSize + numCandidates;
+    if (!utils::isPowerOf2(sortSize)) {
+        sortSize = utils::nextHighestPowerOf2(sortSize);
+    }
+
+    size_t maxSmem = getMaxSharedMemPerBlockCurrentDevice();
+    size_t fixedSmem = (dim_ + 2 * size_t(sortSize)) * sizeof(float);
+
+    // The visited set is sized for a load factor of 1/2 of the nodes that
+    // may be evaluated, within the shared memory left
+    size_t maxVisited = size_t(numCandidates) * (maxIterations + 1);
+    int hashBits = 8;
+    while (hashBits < 24 && (size_t(1) << hashBits) < 2 * maxVisited &&
+           fixedSmem + (sizeof(unsigned) << (hashBits + 1)) <= maxSmem) {
+        ++hashBits;
+    }
+    size_t smem = fixedSmem + (sizeof(unsigned) << hashBits);
+    FAISS_THROW_IF_NOT_FMT(
+            smem <= maxSmem,
+            "HNSW graph search needs %zu bytes of shared memory, "
+            "reduce the dimension or the beam size",
+            smem);
+
+    auto grid = dim3(nq);
+    auto block = dim3(kHNSWSearchThreads);
+
+    if (innerProduct_) {
+        hnswGraphSearch<true><<<grid, block, smem, stream>>>(
+                vectors_,
+                offsets_,
+                neighbors_,
+                maxDegree_,
+                queries,
+                entryPoints,
+                beamSize,
+                sortSize,
+                maxIterations,
+                hashBits,
+                outDistances,
+                outIndices);
+    } else {
+        hnswGraphSearch<false><<<grid, block, smem, stream>>>(
+                vectors_,
+                offsets_,
+                neighbors_,
+                maxDegree_,
+                queries,
+                entryPoints,
+                beamSize,
+                sortSize,
+                maxIterations,
+                hashBits,
+                outDistances,
+                outIndices);
+    }
+
+    CUDA_TEST_ERROR();
+}
+
+} // namespace gpu
+} // namespace faiss
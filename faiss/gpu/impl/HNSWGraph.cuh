@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/gpu/GpuResources.h>
+#include <faiss/gpu/utils/DeviceTensor.cuh>
+
+#include <vector>
+
+namespace faiss {
+namespace gpu {
+
+/// Level 0 graph of an HNSW index and its vectors, resident on the GPU.
+/// The neighbor lists are stored in CSR form: the neighbors of node i are
+/// neighbors[offsets[i]] .. neighbors[offsets[i + 1] - 1]
+class HNSWGraph {
+   public:
+    HNSWGraph(
+            GpuResources* res,
+            int dim,
+            bool innerProduct,
+            MemorySpace space);
+
+    /// Replaces the graph with n vectors (n x dim) and their neighbor
+    /// lists; offsets is of size n + 1
+    void set(
+            idx_t n,
+            const float* vectors,
+            const std::vector<idx_t>& offsets,
+            const std::vector<int>& neighbors,
+            cudaStream_t stream);
+
+    /// Free all storage
+    void reset();
+
+    /// Returns the number of nodes
+    idx_t getSize() const;
+
+    /// Returns the length of the longest neighbor list
+    int getMaxDegree() const;
+
+    /// Beam search of the graph, one thread block per query. The beam
+    /// (beamSize best nodes) and the visited set are in shared memory.
+    /// entryPoints is (nq x num) for per-query entry points, or (1 x num)
+    /// for entry points shared by all the queries; -1 entries are ignored.
+    /// At most maxIterations nodes are expanded per query. The k <=
+    /// beamSize results are sorted by increasing L2 distance or decreasing
+    /// inner product, padded with -1
+    void query(
+            Tensor<float, 2, true>& queries,
+            Tensor<int, 2, true>& entryPoints,
+            int beamSize,
+            int maxIterations,
+            Tensor<float, 2, true>& outDistances,
+            Tensor<idx_t, 2, true>& outIndices);
+
+   private:
+    /// Collection of GPU resources that we use
+    GpuResources* resources_;
+
+    /// Dimensionality of our vectors
+    const int dim_;
+
+    /// Metric of the graph (L2 otherwise)
+    const bool innerProduct_;
+
+    /// Memory space for our allocations
+    const MemorySpace space_;
+
+    /// Length of the longest neighbor list
+    int maxDegree_;
+
+    /// Vectors of the nodes
+    DeviceTensor<float, 2, true> vectors_;
+
+    /// Start of the neighbor list of each node, plus the end of the last
+    DeviceTensor<idx_t, 1, true> offsets_;
+
+    /// Concatenated neighbor lists
+    DeviceTensor<int, 1, true> neighbors_;
+};
+
+} // namespace gpu
+} // namespace faiss
@@ -232,6 +232,11 @@ void runIVFFlatAppend(
                         scalarQ->code_size);
                 RUN_APPEND;
             } break;
+            case ScalarQuantizer::QuantizerType::QT_bf16: {
+                Codec<ScalarQuantizer::QuantizerType::QT_bf16, 1> codec(
+                        scalarQ->code_size);
+                RUN_APPEND;
+            } break;
             case ScalarQuantizer::QuantizerType::QT_8bit_direct: {
                 Codec<ScalarQuantizer::QuantizerType::QT_8bit_direct, 1> codec(
                         scalarQ->code_size);
@@ -489,11 +494,9 @@ void runIVFFlatInterleavedAppend(
     // only implemented at the moment
     FAISS_ASSERT(scalarQ->bits == 16 || scalarQ->bits <= 8);
 
-    if (scalarQ->bits == 16) {
-        FAISS_ASSERT(scalarQ->qtype == ScalarQuantizer::QuantizerType::QT_fp16);
-
+    if (scalarQ->qtype == ScalarQuantizer::QuantizerType::QT_fp16) {
         using CodecT = Codec<ScalarQuantizer::QuantizerType::QT_fp16, 1>;
-        CodecT codec(scalarQ->qtype);
+        CodecT codec(scalarQ->code_size);
 
         DeviceTensor<half, 2, true> encodedVecs(
                 res,
@@ -503,6 +506,18 @@ void runIVFFlatInterleavedAppend(
         runSQEncode(vecs, encodedVecs, codec, stream);
         RUN_APPEND(CodecT::EncodeT, CodecT::kEncodeBits, encodedVecs);
 
+    } else if (scalarQ->qtype == ScalarQuantizer::QuantizerType::QT_bf16) {
+        using CodecT = Codec<ScalarQuantizer::QuantizerType::QT_bf16, 1>;
+        CodecT codec(scalarQ->code_size);
+
+        DeviceTensor<__nv_bfloat16, 2, true> encodedVecs(
+                res,
+                makeTempAlloc(AllocType::Other, stream),
+                {vecs.getSize(0), vecs.getSize(1)});
+
+        runSQEncode(vecs, encodedVecs, codec, stream);
+        RUN_APPEND(CodecT::EncodeT, CodecT::kEncodeBits, encodedVecs);
+
     } else if (scalarQ->bits <= 8) {
         DeviceTensor<uint8_t, 2, true> encodedVecs(
                 res,
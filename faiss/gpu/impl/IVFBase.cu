@@ -19,6 +19,9 @@
 #include <faiss/gpu/utils/DeviceDefs.cuh>
 #include <faiss/gpu/utils/HostTensor.cuh>
 #include <faiss/gpu/utils/ThrustUtils.cuh>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <limits>
 #include <unordered_map>
 
@@ -68,11 +71,23 @@ IVFBase::IVFBase(
                           getCurrentDevice(),
                           space,
                           resources->getDefaultStreamCurrentDevice())),
-          maxListLength_(0) {
+          maxListLength_(0),
+          hostLists_(nullptr),
+          listCacheBytes_(0),
+          listCacheUsed_(0),
+          numBatches_(0),
+          numListUploads_(0),
+          pinnedStaging_(nullptr),
+          pinnedStagingBytes_(0),
+          version_(0) {
     reset();
 }
 
-IVFBase::~IVFBase() {}
+IVFBase::~IVFBase() {
+    if (pinnedStaging_) {
+        cudaFreeHost(pinnedStaging_);
+    }
+}
 
 void IVFBase::reserveMemory(idx_t numVecs) {
     auto stream = resources_->getDefaultStreamCurrentDevice();
@@ -138,6 +153,18 @@ void IVFBase::reset() {
     deviceListLengths_.setAll(0, stream);
 
     maxListLength_ = 0;
+
+    hostLists_ = nullptr;
+    listCacheBytes_ = 0;
+    listCacheUsed_ = 0;
+    residentLists_.clear();
+    residentPos_.clear();
+    listResident_.clear();
+    listLastBatch_.clear();
+    numBatches_ = 0;
+    numListUploads_ = 0;
+
+    updateVersion_();
 }
 
 idx_t IVFBase::getDim() const {
@@ -187,6 +214,8 @@ void IVFBase::updateDeviceListInfo_(cudaStream_t stream) {
 void IVFBase::updateDeviceListInfo_(
         const std::vector<idx_t>& listIds,
         cudaStream_t stream) {
+    updateVersion_();
+
     idx_t listSize = listIds.size();
     HostTensor<idx_t, 1, true> hostListsToUpdate({listSize});
     HostTensor<idx_t, 1, true> hostNewListLength({listSize});
@@ -248,6 +277,10 @@ idx_t IVFBase::getListLength(idx_t listId) const {
     FAISS_ASSERT(listId < deviceListLengths_.size());
     FAISS_ASSERT(listId < deviceListData_.size());
 
+    if (hostLists_) {
+        return hostLists_->list_size(listId);
+    }
+
     return deviceListData_[listId]->numVecs;
 }
 
@@ -262,6 +295,12 @@ std::vector<idx_t> IVFBase::getListIndices(idx_t listId) const {
 
     auto stream = resources_->getDefaultStreamCurrentDevice();
 
+    if (hostLists_) {
+        size_t n = hostLists_->list_size(listId);
+        InvertedLists::ScopedIds ids(hostLists_, listId);
+        return std::vector<idx_t>(ids.get(), ids.get() + n);
+    }
+
     if (indicesOptions_ == INDICES_32_BIT) {
         // The data is stored as int32 on the GPU
         FAISS_ASSERT(listId < deviceListIndices_.size());
@@ -310,6 +349,15 @@ std::vector<uint8_t> IVFBase::getListVectorData(idx_t listId, bool gpuFormat)
 
     auto stream = resources_->getDefaultStreamCurrentDevice();
 
+    if (hostLists_) {
+        idx_t n = hostLists_->list_size(listId);
+        InvertedLists::ScopedCodes codes(hostLists_, listId);
+        std::vector<uint8_t> cpuCodes(
+                codes.get(), codes.get() + getCpuVectorsEncodingSize_(n));
+        return gpuFormat ? translateCodesToGpu_(std::move(cpuCodes), n)
+                         : cpuCodes;
+    }
+
     auto& list = deviceListData_[listId];
     auto gpuCodes = list->data.copyToHost<uint8_t>(stream);
 
@@ -344,6 +392,209 @@ void IVFBase::reconstruct_n(idx_t i0, idx_t n, float* out) {
     FAISS_THROW_MSG("not implemented");
 }
 
+void IVFBase::setStreamingLists(const InvertedLists* ivf, size_t cacheBytes) {
+    FAISS_THROW_IF_NOT(ivf);
+    FAISS_THROW_IF_NOT_FMT(
+            ivf->nlist == numLists_,
+            "streamed inverted lists have %zd lists, expected %zd",
+            ivf->nlist,
+            numLists_);
+    FAISS_THROW_IF_NOT_MSG(
+            ivf->code_size == getCpuVectorsEncodingSize_(1),
+            "streamed inverted lists have an unexpected code size");
+    FAISS_THROW_IF_NOT_MSG(
+            indicesOptions_ != INDICES_IVF,
+            "streamed inverted lists require stored indices");
+
+    // Free the lists currently on the device
+    reset();
+
+    hostLists_ = ivf;
+    listCacheBytes_ = cacheBytes;
+    residentPos_.resize(numLists_);
+    listResident_.resize(numLists_, false);
+    listLastBatch_.resize(numLists_, 0);
+
+    // The scan kernels size their buffers from the longest list, which
+    // may be resident at any time
+    for (idx_t i = 0; i < numLists_; ++i) {
+        maxListLength_ = std::max(maxListLength_, (idx_t)ivf->list_size(i));
+    }
+
+    if (!pinnedStaging_) {
+        constexpr size_t kPinnedStagingBytes = (size_t)64 * 1024 * 1024;
+        if (cudaHostAlloc(
+                    &pinnedStaging_,
+                    kPinnedStagingBytes,
+                    cudaHostAllocDefault) == cudaSuccess) {
+            pinnedStagingBytes_ = kPinnedStagingBytes;
+        } else {
+            // copies go through pageable memory
+            pinnedStaging_ = nullptr;
+        }
+    }
+}
+
+uint64_t IVFBase::getVersion() const {
+    return version_;
+}
+
+void IVFBase::updateVersion_() {
+    static std::atomic<uint64_t> nextVersion(1);
+    version_ = nextVersion++;
+}
+
+bool IVFBase::isStreaming() const {
+    return hostLists_ != nullptr;
+}
+
+size_t IVFBase::getNumListUploads() const {
+    return numListUploads_;
+}
+
+size_t IVFBase::streamedListBytes_(idx_t listId) const {
+    idx_t numVecs = hostLists_->list_size(listId);
+    size_t indexBytes = 0;
+    if (indicesOptions_ == INDICES_32_BIT) {
+        indexBytes = numVecs * sizeof(int);
+    } else if (indicesOptions_ == INDICES_64_BIT) {
+        indexBytes = numVecs * sizeof(idx_t);
+    }
+    return getGpuVectorsEncodingSize_(numVecs) + indexBytes;
+}
+
+void IVFBase::evictList_(idx_t listId) {
+    deviceListData_[listId]->data.clear();
+    deviceListData_[listId]->numVecs = 0;
+    deviceListIndices_[listId]->data.clear();
+    deviceListIndices_[listId]->numVecs = 0;
+    listOffsetToUserIndex_[listId].clear();
+
+    listCacheUsed_ -= streamedListBytes_(listId);
+    residentLists_.erase(residentPos_[listId]);
+    listResident_[listId] = false;
+}
+
+void IVFBase::makeListsResident_(
+        Tensor<idx_t, 2, true>& ivfAssignments,
+        cudaStream_t stream) {
+    if (!hostLists_) {
+        return;
+    }
+
+    numBatches_++;
+    auto assignments = ivfAssignments.copyToVector(stream);
+
+    // Lists probed by this batch that are not on the device. The resident
+    // ones move to the most recently used end
+    std::vector<idx_t> missing;
+    size_t missingBytes = 0;
+    for (auto listId : assignments) {
+        if (listId < 0 || listLastBatch_[listId] == numBatches_) {
+            continue;
+        }
+        listLastBatch_[listId] = numBatches_;
+        if (listResident_[listId]) {
+            residentLists_.splice(
+                    residentLists_.end(),
+                    residentLists_,
+                    residentPos_[listId]);
+        } else {
+            missing.push_back(listId);
+            missingBytes += streamedListBytes_(listId);
+        }
+    }
+
+    if (missing.empty()) {
+        return;
+    }
+
+    // Evict the least recently used lists that this batch does not probe.
+    // If the lists probed by the batch exceed the budget, they are all
+    // kept until the next batch
+    std::vector<idx_t> updated;
+    while (listCacheUsed_ + missingBytes > listCacheBytes_ &&
+           !residentLists_.empty() &&
+           listLastBatch_[residentLists_.front()] != numBatches_) {
+        idx_t listId = residentLists_.front();
+        evictList_(listId);
+        updated.push_back(listId);
+    }
+
+    // The codes are translated on the CPU into one half of the pinned
+    // buffer while the other half is copied to the device on the
+    // alternate streams
+    auto altStreams = resources_->getAlternateStreamsCurrentDevice();
+    FAISS_ASSERT(!altStreams.empty());
+    streamWait(altStreams, {stream});
+
+    size_t halfBytes = pinnedStagingBytes_ / 2;
+    // events marking the end of the copies out of each half
+    std::vector<CudaEvent> halfCopied[2];
+    int half = 0;
+    size_t halfUsed = 0;
+
+    for (size_t i = 0; i < missing.size(); ++i) {
+        idx_t listId = missing[i];
+        idx_t numVecs = hostLists_->list_size(listId);
+        auto& listCodes = deviceListData_[listId];
+        FAISS_ASSERT(listCodes->numVecs == 0);
+
+        if (numVecs > 0) {
+            size_t cpuBytes = getCpuVectorsEncodingSize_(numVecs);
+            size_t gpuBytes = getGpuVectorsEncodingSize_(numVecs);
+
+            std::vector<uint8_t> codes(cpuBytes);
+            {
+                InvertedLists::ScopedCodes sc(hostLists_, listId);
+                std::memcpy(codes.data(), sc.get(), cpuBytes);
+            }
+            auto gpuCodes = translateCodesToGpu_(std::move(codes), numVecs);
+            auto copyStream = altStreams[i % altStreams.size()];
+
+            if (gpuBytes <= halfBytes) {
+                if (halfUsed + gpuBytes > halfBytes) {
+                    // switch halves, the other one must be copied out
+                    for (auto s : altStreams) {
+                        halfCopied[half].emplace_back(s);
+                    }
+                    half = 1 - half;
+                    halfUsed = 0;
+                    for (auto& e : halfCopied[half]) {
+                        e.cpuWaitOnEvent();
+                    }
+                    halfCopied[half].clear();
+                }
+                uint8_t* staging = (uint8_t*)pinnedStaging_ +
+                        half * halfBytes + halfUsed;
+                std::memcpy(staging, gpuCodes.data(), gpuBytes);
+                halfUsed += gpuBytes;
+                listCodes->data.append(staging, gpuBytes, copyStream, true);
+            } else {
+                // no pinned staging for this list, the copy is synchronous
+                listCodes->data.append(
+                        gpuCodes.data(), gpuBytes, stream, true);
+            }
+            listCodes->numVecs = numVecs;
+
+            InvertedLists::ScopedIds ids(hostLists_, listId);
+            addIndicesFromCpu_(listId, ids.get(), numVecs);
+        }
+
+        residentPos_[listId] =
+                residentLists_.insert(residentLists_.end(), listId);
+        listResident_[listId] = true;
+        listCacheUsed_ += streamedListBytes_(listId);
+        updated.push_back(listId);
+        numListUploads_++;
+    }
+
+    // The scan on the default stream waits for all copies
+    streamWait({stream}, altStreams);
+
+    updateDeviceListInfo_(updated, stream);
+}
+
 void IVFBase::addEncodedVectorsToList_(
         idx_t listId,
         const void* codes,
@@ -389,6 +640,8 @@ void IVFBase::addEncodedVectorsToList_(
 
     // We update this as well, since the multi-pass algorithm uses it
     maxListLength_ = std::max(maxListLength_, numVecs);
+
+    updateVersion_();
 }
 
 void IVFBase::addIndicesFromCpu_(
@@ -449,6 +702,7 @@ void IVFBase::addIndicesFromCpu_(
 
 void IVFBase::updateQuantizer(Index* quantizer) {
     FAISS_THROW_IF_NOT(quantizer->is_trained);
+    updateVersion_();
 
     // Must match our basic IVF parameters
     FAISS_THROW_IF_NOT(quantizer->d == getDim());
@@ -595,6 +849,8 @@ idx_t IVFBase::addVectors(
         Tensor<idx_t, 1, true>& indices) {
     FAISS_ASSERT(vecs.getSize(0) == indices.getSize(0));
     FAISS_ASSERT(vecs.getSize(1) == dim_);
+    FAISS_THROW_IF_NOT_MSG(
+            !hostLists_, "cannot add to streamed inverted lists");
 
     auto stream = resources_->getDefaultStreamCurrentDevice();
 
@@ -12,6 +12,7 @@
 #include <faiss/gpu/GpuIndicesOptions.h>
 #include <faiss/gpu/utils/DeviceTensor.cuh>
 #include <faiss/gpu/utils/DeviceVector.cuh>
+#include <list>
 #include <memory>
 #include <vector>
 
@@ -118,7 +119,30 @@ class IVFBase {
      */
     virtual void reconstruct_n(idx_t i0, idx_t n, float* out);
 
+    /// Keep the inverted lists in `ivf` (host memory, or on disk with
+    /// OnDiskInvertedLists) rather than on the device. Before each search,
+    /// the probed lists are copied to a device-side cache of at most
+    /// `cacheBytes`, the least recently used lists being evicted. `ivf` is
+    /// not owned and must not be modified while in use. Clears the lists
+    /// currently on the device; reset() leaves this mode
+    void setStreamingLists(const InvertedLists* ivf, size_t cacheBytes);
+
+    /// Are the lists streamed from a host InvertedLists?
+    bool isStreaming() const;
+
+    /// Number of lists copied to the device by the streaming mode since
+    /// setStreamingLists
+    size_t getNumListUploads() const;
+
+    /// Identifies the current state of the lists and of the coarse
+    /// centroids; changes whenever device pointers or sizes used by search
+    /// may have changed. Values are never reused, even across instances
+    uint64_t getVersion() const;
+
    protected:
+    /// Assigns a new version (see getVersion)
+    void updateVersion_();
+
     /// Adds a set of codes and indices to a list, with the
     /// representation coming from the CPU equivalent
     virtual void addEncodedVectorsToList_(
@@ -198,6 +222,18 @@ class IVFBase {
     /// Shared function to copy indices from CPU to GPU
     void addIndicesFromCpu_(idx_t listId, const idx_t* indices, idx_t numVecs);
 
+    /// In streaming mode, make all lists referenced in `ivfAssignments`
+    /// resident on the device before they are scanned; no-op otherwise
+    void makeListsResident_(
+            Tensor<idx_t, 2, true>& ivfAssignments,
+            cudaStream_t stream);
+
+    /// Device bytes used by list `listId` of the streamed lists
+    size_t streamedListBytes_(idx_t listId) const;
+
+    /// Releases the device memory of a list (streaming mode)
+    void evictList_(idx_t listId);
+
    protected:
     /// Collection of GPU resources that we use
     GpuResources* resources_;
@@ -274,6 +310,35 @@ class IVFBase {
     /// INDICES_CPU), then this maintains a CPU-side map of what
     /// (inverted list id, offset) maps to which user index
     std::vector<std::vector<idx_t>> listOffsetToUserIndex_;
+
+    /// Streaming mode: the source of the inverted lists (not owned), or
+    /// nullptr if all lists are resident on the device
+    const InvertedLists* hostLists_;
+
+    /// Streaming mode: device byte budget of the cached lists, and bytes
+    /// currently used
+    size_t listCacheBytes_;
+    size_t listCacheUsed_;
+
+    /// Streaming mode: resident lists, least recently used first
+    std::list<idx_t> residentLists_;
+    std::vector<std::list<idx_t>::iterator> residentPos_;
+    std::vector<bool> listResident_;
+
+    /// Streaming mode: search batch in which each list was last probed
+    std::vector<size_t> listLastBatch_;
+    size_t numBatches_;
+
+    /// Streaming mode: number of lists copied to the device
+    size_t numListUploads_;
+
+    /// Streaming mode: pinned host buffer through which the lists are
+    /// copied, split in two halves that are filled alternately
+    void* pinnedStaging_;
+    size_t pinnedStagingBytes_;
+
+    /// See getVersion
+    uint64_t version_;
 };
 
 } // namespace gpu
@@ -286,6 +286,8 @@ void IVFFlat::searchPreassigned(
 }
 
 void IVFFlat::reconstruct_n(idx_t i0, idx_t ni, float* out) {
+    FAISS_THROW_IF_NOT_MSG(
+            !hostLists_, "reconstruct_n not supported with streamed lists");
     if (ni == 0) {
         // nothing to do
         return;
@@ -346,6 +348,9 @@ void IVFFlat::searchImpl_(
 
     auto stream = resources_->getDefaultStreamCurrentDevice();
 
+    // Streamed lists are copied to the device first
+    makeListsResident_(coarseIndices, stream);
+
     if (interleavedLayout_) {
         runIVFInterleavedScan(
                 queries,
@@ -16,6 +16,7 @@
 #include <faiss/gpu/utils/DeviceDefs.cuh>
 #include <faiss/gpu/utils/DeviceTensor.cuh>
 #include <faiss/gpu/utils/Float16.cuh>
+#include <faiss/gpu/utils/Limits.cuh>
 #include <faiss/gpu/utils/MathOperators.cuh>
 #include <faiss/gpu/utils/PtxUtils.cuh>
 #include <faiss/gpu/utils/Reductions.cuh>
@@ -182,6 +183,155 @@ __global__ void ivfFlatScan(
             distanceOut);
 }
 
+/// Number of 32-bit words of the sign bits of a RaBitQ code
+__host__ __device__ inline int rabitqWords(int dim) {
+    return (dim + 31) / 32;
+}
+
+// RaBitQ distance estimator (see RaBitQuantizer.cpp) between each query
+// and the codes of one of its probed lists. The query residual relative to
+// the list centroid is computed in shared memory. If qb > 0, it is
+// quantized to qb bits and stored as qb bit planes, so that the dot
+// products with the sign bits of the codes are popcounts
+__global__ void ivfRaBitQScan(
+        Tensor<float, 2, true> queries,
+        Tensor<float, 3, true> residualBase,
+        Tensor<idx_t, 2, true> listIds,
+        void** allListData,
+        idx_t* listLengths,
+        bool isIP,
+        int qb,
+        Tensor<idx_t, 2, true> prefixSumOffsets,
+        Tensor<float, 1, true> distance) {
+    extern __shared__ float smem[];
+
+    auto queryId = blockIdx.y;
+    auto probeId = blockIdx.x;
+
+    auto outBase = *(prefixSumOffsets[queryId][probeId].data() - 1);
+
+    idx_t listId = listIds[queryId][probeId];
+    if (listId == -1) {
+        return;
+    }
+
+    int dim = queries.getSize(1);
+    int words = rabitqWords(dim);
+    auto query = queries[queryId].data();
+    auto centroid = residualBase[queryId][probeId].data();
+
+    // query residual, then its bit planes if quantized
+    float* qc = smem;
+    uint32_t* qPlanes = (uint32_t*)(smem + dim);
+
+    for (int i = threadIdx.x; i < dim; i += blockDim.x) {
+        qc[i] = query[i] - centroid[i];
+    }
+    __syncthreads();
+
+    // every warp computes the query factors for itself
+    auto laneId = threadIdx.x % kWarpSize;
+    float sumQ = 0, qToC = 0, qNorm = 0;
+    float vMin = Limits<float>::getMax(), vMax = Limits<float>::getMin();
+    for (int i = laneId; i < dim; i += kWarpSize) {
+        float v = qc[i];
+        sumQ += v;
+        qToC += v * v;
+        qNorm += query[i] * query[i];
+        vMin = min(vMin, v);
+        vMax = max(vMax, v);
+    }
+    sumQ = warpReduceAllSum(sumQ);
+    qToC = warpReduceAllSum(qToC);
+    qNorm = warpReduceAllSum(qNorm);
+    vMin = warpReduceAll<float, Min<float>>(vMin, Min<float>());
+    vMax = warpReduceAll<float, Max<float>>(vMax, Max<float>());
+
+    float invSqrtD = rsqrtf((float)dim);
+    float c1, c2, c34;
+
+    if (qb > 0) {
+        float delta = (vMax - vMin) / ((1 << qb) - 1);
+        float invDelta = 1.0f / delta;
+        int maxQ = (1 << qb) - 1;
+
+        float sumQQ = 0;
+        for (int i = laneId; i < dim; i += kWarpSize) {
+            sumQQ += roundf((qc[i] - vMin) * invDelta);
+        }
+        sumQQ = warpReduceAllSum(sumQQ);
+
+        for (int i = threadIdx.x; i < qb * words; i += blockDim.x) {
+            int plane = i / words;
+            int word = i % words;
+            uint32_t bits = 0;
+            for (int j = 0; j < 32; ++j) {
+                int d = word * 32 + j;
+                if (d < dim) {
+                    int v = (int)roundf((qc[d] - vMin) * invDelta);
+                    v = min(max(v, 0), maxQ);
+                    bits |= ((v >> plane) & 1) << j;
+                }
+            }
+            qPlanes[i] = bits;
+        }
+
+        c1 = 2 * delta * invSqrtD;
+        c2 = 2 * vMin * invSqrtD;
+        c34 = invSqrtD * (delta * sumQQ + dim * vMin);
+    } else {
+        c1 = 2 * invSqrtD;
+        c2 = 0;
+        c34 = sumQ * invSqrtD;
+    }
+    __syncthreads();
+
+    // each warp handles a separate chunk of the codes
+    auto warpId = threadIdx.x / kWarpSize;
+    auto numVecs = listLengths[listId];
+    auto codes = (const uint8_t*)allListData[listId];
+    size_t codeSize = words * sizeof(uint32_t) + 2 * sizeof(float);
+    auto distanceOut = distance[outBase].data();
+
+    idx_t vecsPerWarp = utils::divUp(numVecs, kIVFFlatScanWarps);
+    idx_t vecStart = vecsPerWarp * warpId;
+    idx_t vecEnd = min(vecsPerWarp * (warpId + 1), numVecs);
+
+    for (idx_t vec = vecStart; vec < vecEnd; ++vec) {
+        auto code = codes + vec * codeSize;
+        auto signs = (const uint32_t*)code;
+
+        float dot = 0;
+        float sumBits = 0;
+        for (int w = laneId; w < words; w += kWarpSize) {
+            uint32_t s = signs[w];
+            sumBits += __popc(s);
+            if (qb > 0) {
+                for (int plane = 0; plane < qb; ++plane) {
+                    dot += (float)(__popc(s & qPlanes[plane * words + w])
+                                   << plane);
+                }
+            } else {
+                while (s) {
+                    int j = __ffs(s) - 1;
+                    dot += qc[w * 32 + j];
+                    s &= s - 1;
+                }
+            }
+        }
+        dot = warpReduceAllSum(dot);
+        sumBits = warpReduceAllSum(sumBits);
+
+        if (laneId == 0) {
+            // ||or - c||^2 - (IP ? ||or||^2 : 0), dp_multiplier
+            auto factors = (const float*)(code + words * sizeof(uint32_t));
+            float finalDot = c1 * dot + c2 * sumBits - c34;
+            float preDist = factors[0] + qToC - 2 * factors[1] * finalDot;
+            distanceOut[vec] = isIP ? -0.5f * (preDist - qNorm) : preDist;
+        }
+    }
+}
+
 void runIVFFlatScanTile(
         GpuResources* res,
         Tensor<float, 2, true>& queries,
@@ -201,6 +351,7 @@ void runIVFFlatScanTile(
         bool useResidual,
         Tensor<float, 3, true>& residualBase,
         GpuScalarQuantizer* scalarQ,
+        const IVFRaBitQScanParams* rabitq,
         Tensor<float, 2, true>& outDistances,
         Tensor<idx_t, 2, true>& outIndices,
         cudaStream_t stream) {
@@ -241,7 +392,21 @@ void runIVFFlatScanTile(
         }                                          \
     } while (0)
 
-    if (!scalarQ) {
+    if (rabitq) {
+        FAISS_ASSERT(useResidual);
+        size_t smemSize = dim * sizeof(float) +
+                rabitq->qb * rabitqWords(dim) * sizeof(uint32_t);
+        ivfRaBitQScan<<<grid, block, smemSize, stream>>>(
+                queries,
+                residualBase,
+                listIds,
+                listData.data(),
+                listLengths.data(),
+                metricType == MetricType::METRIC_INNER_PRODUCT,
+                rabitq->qb,
+                prefixSumOffsets,
+                allDistances);
+    } else if (!scalarQ) {
         CodecFloat codec(dim * sizeof(float));
         HANDLE_METRICS;
     } else {
@@ -265,6 +430,11 @@ void runIVFFlatScanTile(
                         scalarQ->code_size);
                 HANDLE_METRICS;
             } break;
+            case ScalarQuantizer::QuantizerType::QT_bf16: {
+                Codec<ScalarQuantizer::QuantizerType::QT_bf16, 1> codec(
+                        scalarQ->code_size);
+                HANDLE_METRICS;
+            } break;
             case ScalarQuantizer::QuantizerType::QT_8bit_direct: {
                 Codec<ScalarQuantizer::QuantizerType::QT_8bit_direct, 1> codec(
                         scalarQ->code_size);
@@ -343,7 +513,8 @@ void runIVFFlatScan(
         Tensor<float, 2, true>& outDistances,
         // output
         Tensor<idx_t, 2, true>& outIndices,
-        GpuResources* res) {
+        GpuResources* res,
+        const IVFRaBitQScanParams* rabitq) {
     auto stream = res->getDefaultStreamCurrentDevice();
 
     auto nprobe = listIds.getSize(1);
@@ -480,6 +651,7 @@ void runIVFFlatScan(
                 useResidual,
                 residualBaseView,
                 scalarQ,
+                rabitq,
                 outDistanceView,
                 outIndicesView,
                 streams[curStream]);
@@ -19,6 +19,13 @@ namespace gpu {
 
 class GpuResources;
 
+/// Scan parameters of the IVFRaBitQ lists, whose vectors are RaBitQ codes
+/// in the layout of IVFRaBitQ (padded sign words, then 2 float factors)
+struct IVFRaBitQScanParams {
+    /// number of bits the query residuals are quantized to, 0 = fp32
+    int qb = 0;
+};
+
 void runIVFFlatScan(
         Tensor<float, 2, true>& queries,
         Tensor<idx_t, 2, true>& listIds,
@@ -36,7 +43,9 @@ void runIVFFlatScan(
         Tensor<float, 2, true>& outDistances,
         // output
         Tensor<idx_t, 2, true>& outIndices,
-        GpuResources* res);
+        GpuResources* res,
+        // if set, the lists hold RaBitQ codes (scalarQ is then ignored)
+        const IVFRaBitQScanParams* rabitq = nullptr);
 
 } // namespace gpu
 } // namespace faiss
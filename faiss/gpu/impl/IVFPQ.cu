@@ -119,6 +119,8 @@ void IVFPQ::setPrecomputedCodes(Index* quantizer, bool enable) {
             precomputedCode_ = DeviceTensor<float, 3, true>();
             precomputedCodeHalf_ = DeviceTensor<half, 3, true>();
         }
+
+        updateVersion_();
     }
 }
 
@@ -576,6 +578,9 @@ void IVFPQ::searchImpl_(
 
     auto stream = resources_->getDefaultStreamCurrentDevice();
 
+    // Streamed lists are copied to the device first
+    makeListsResident_(coarseIndices, stream);
+
     if (precomputedCodes_) {
         FAISS_ASSERT(metric_ == MetricType::METRIC_L2);
 
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/gpu/GpuResources.h>
+#include <faiss/gpu/impl/RemapIndices.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/gpu/utils/StaticUtils.h>
+#include <faiss/gpu/impl/IVFAppend.cuh>
+#include <faiss/gpu/impl/IVFRaBitQ.cuh>
+#include <faiss/gpu/utils/DeviceDefs.cuh>
+#include <faiss/gpu/utils/HostTensor.cuh>
+#include <faiss/gpu/utils/WarpShuffles.cuh>
+#include <faiss/gpu/utils/Reductions.cuh>
+
+#include <cstring>
+
+namespace faiss {
+namespace gpu {
+
+// Each warp encodes one vector, the same way as
+// RaBitQuantizer::compute_codes_core
+__global__ void ivfRaBitQAppend(
+        Tensor<idx_t, 1, true> listIds,
+        Tensor<idx_t, 1, true> listOffset,
+        Tensor<float, 2, true> vecs,
+        Tensor<float, 2, true> residuals,
+        bool isIP,
+        void** listData) {
+    int warpsPerBlock = blockDim.x / kWarpSize;
+    idx_t vec = idx_t(blockIdx.x) * warpsPerBlock + threadIdx.x / kWarpSize;
+    if (vec >= vecs.getSize(0)) {
+        return;
+    }
+
+    idx_t listId = listIds[vec];
+    idx_t offset = listOffset[vec];
+    // Add vector could be invalid (contains NaNs etc)
+    if (listId == -1 || offset == -1) {
+        return;
+    }
+
+    int dim = vecs.getSize(1);
+    int words = utils::divUp(dim, 32);
+    size_t codeSize = words * sizeof(uint32_t) + 2 * sizeof(float);
+    auto code = (uint8_t*)listData[listId] + offset * codeSize;
+    auto signs = (uint32_t*)code;
+    auto laneId = threadIdx.x % kWarpSize;
+
+    auto x = vecs[vec].data();
+    auto r = residuals[vec].data();
+
+    // ||or - c||^2, ||or||^2 and sum |or - c|
+    float normL2sqr = 0, orL2sqr = 0, dpOO = 0;
+    for (int w = laneId; w < words; w += kWarpSize) {
+        uint32_t bits = 0;
+        for (int j = 0; j < 32; ++j) {
+            int d = w * 32 + j;
+            if (d < dim) {
+                float v = r[d];
+                normL2sqr += v * v;
+                orL2sqr += x[d] * x[d];
+                dpOO += fabsf(v);
+                bits |= (v > 0 ? 1u : 0u) << j;
+            }
+        }
+        signs[w] = bits;
+    }
+    normL2sqr = warpReduceAllSum(normL2sqr);
+    orL2sqr = warpReduceAllSum(orL2sqr);
+    dpOO = warpReduceAllSum(dpOO);
+
+    if (laneId == 0) {
+        constexpr float kEps = 1.1920929e-07f; // FLT_EPSILON
+        float invNorm = fabsf(normL2sqr) < kEps ? 1.0f : rsqrtf(normL2sqr);
+        dpOO *= invNorm * rsqrtf((float)dim);
+        float invDpOO = fabsf(dpOO) < kEps ? 1.0f : 1.0f / dpOO;
+
+        auto factors = (float*)(code + words * sizeof(uint32_t));
+        factors[0] = isIP ? normL2sqr - orL2sqr : normL2sqr;
+        factors[1] = invDpOO * sqrtf(normL2sqr);
+    }
+}
+
+IVFRaBitQ::IVFRaBitQ(
+        GpuResources* res,
+        int dim,
+        idx_t nlist,
+        faiss::MetricType metric,
+        int qb,
+        IndicesOptions indicesOptions,
+        MemorySpace space)
+        : IVFFlat(res,
+                  dim,
+                  nlist,
+                  metric,
+                  0,
+                  true, // the codes are relative to the list centroid
+                  nullptr,
+                  false, // no interleaved layout
+                  indicesOptions,
+                  space) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric == MetricType::METRIC_L2 ||
+                    metric == MetricType::METRIC_INNER_PRODUCT,
+            "IVFRaBitQ: only L2 and inner product are supported");
+    setQb(qb);
+}
+
+IVFRaBitQ::~IVFRaBitQ() {}
+
+void IVFRaBitQ::setQb(int qb) {
+    FAISS_THROW_IF_NOT_MSG(qb >= 0 && qb <= 8, "IVFRaBitQ: qb must be <= 8");
+    scanParams_.qb = qb;
+}
+
+int IVFRaBitQ::getQb() const {
+    return scanParams_.qb;
+}
+
+void IVFRaBitQ::reconstruct_n(idx_t i0, idx_t n, float* out) {
+    FAISS_THROW_MSG("IVFRaBitQ: reconstruct_n not implemented");
+}
+
+size_t IVFRaBitQ::cpuBitsSize_() const {
+    return utils::divUp(dim_, 8);
+}
+
+size_t IVFRaBitQ::gpuBitsSize_() const {
+    return utils::divUp(dim_, 32) * sizeof(uint32_t);
+}
+
+size_t IVFRaBitQ::getGpuVectorsEncodingSize_(idx_t numVecs) const {
+    return (size_t)numVecs * (gpuBitsSize_() + 2 * sizeof(float));
+}
+
+size_t IVFRaBitQ::getCpuVectorsEncodingSize_(idx_t numVecs) const {
+    return (size_t)numVecs * (cpuBitsSize_() + 2 * sizeof(float));
+}
+
+std::vector<uint8_t> IVFRaBitQ::translateCodesToGpu_(
+        std::vector<uint8_t> codes,
+        idx_t numVecs) const {
+    // pad the sign bits to 32-bit words (little endian, so that bit j of
+    // word w is dimension 32 * w + j as in the CPU bytes)
+    size_t cpuSize = cpuBitsSize_() + 2 * sizeof(float);
+    size_t gpuSize = gpuBitsSize_() + 2 * sizeof(float);
+    std::vector<uint8_t> out(numVecs * gpuSize, 0);
+
+    for (idx_t i = 0; i < numVecs; ++i) {
+        const uint8_t* src = codes.data() + i * cpuSize;
+        uint8_t* dst = out.data() + i * gpuSize;
+        std::memcpy(dst, src, cpuBitsSize_());
+        std::memcpy(
+                dst + gpuBitsSize_(),
+                src + cpuBitsSize_(),
+                2 * sizeof(float));
+    }
+
+    return out;
+}
+
+std::vector<uint8_t> IVFRaBitQ::translateCodesFromGpu_(
+        std::vector<uint8_t> codes,
+        idx_t numVecs) const {
+    size_t cpuSize = cpuBitsSize_() + 2 * sizeof(float);
+    size_t gpuSize = gpuBitsSize_() + 2 * sizeof(float);
+    std::vector<uint8_t> out(numVecs * cpuSize);
+
+    for (idx_t i = 0; i < numVecs; ++i) {
+        const uint8_t* src = codes.data() + i * gpuSize;
+        uint8_t* dst = out.data() + i * cpuSize;
+        std::memcpy(dst, src, cpuBitsSize_());
+        std::memcpy(
+                dst + cpuBitsSize_(),
+                src + gpuBitsSize_(),
+                2 * sizeof(float));
+    }
+
+    return out;
+}
+
+void IVFRaBitQ::appendVectors_(
+        Tensor<float, 2, true>& vecs,
+        Tensor<float, 2, true>& ivfCentroidResiduals,
+        Tensor<idx_t, 1, true>& indices,
+        Tensor<idx_t, 1, true>& uniqueLists,
+        Tensor<idx_t, 1, true>& vectorsByUniqueList,
+        Tensor<idx_t, 1, true>& uniqueListVectorStart,
+        Tensor<idx_t, 1, true>& uniqueListStartOffset,
+        Tensor<idx_t, 1, true>& listIds,
+        Tensor<idx_t, 1, true>& listOffset,
+        cudaStream_t stream) {
+    // Append indices to the IVF lists
+    runIVFIndicesAppend(
+            listIds,
+            listOffset,
+            indices,
+            indicesOptions_,
+            deviceListIndexPointers_,
+            stream);
+
+    // Encode the residuals into the IVF lists
+    constexpr int kWarpsPerBlock = 4;
+    dim3 grid(utils::divUp(vecs.getSize(0), kWarpsPerBlock));
+    dim3 block(kWarpSize * kWarpsPerBlock);
+
+    ivfRaBitQAppend<<<grid, block, 0, stream>>>(
+            listIds,
+            listOffset,
+            vecs,
+            ivfCentroidResiduals,
+            metric_ == MetricType::METRIC_INNER_PRODUCT,
+            deviceListDataPointers_.data());
+    CUDA_TEST_ERROR();
+}
+
+void IVFRaBitQ::searchImpl_(
+        Tensor<float, 2, true>& queries,
+        Tensor<float, 2, true>& coarseDistances,
+        Tensor<idx_t, 2, true>& coarseIndices,
+        Tensor<float, 3, true>& ivfCentroids,
+        int k,
+        Tensor<float, 2, true>& outDistances,
+        Tensor<idx_t, 2, true>& outIndices,
+        bool storePairs) {
+    FAISS_ASSERT(storePairs == false);
+
+    auto stream = resources_->getDefaultStreamCurrentDevice();
+
+    // Streamed lists are copied to the device first
+    makeListsResident_(coarseIndices, stream);
+
+    runIVFFlatScan(
+            queries,
+            coarseIndices,
+            deviceListDataPointers_,
+            deviceListIndexPointers_,
+            indicesOptions_,
+            deviceListLengths_,
+            maxListLength_,
+            k,
+            metric_,
+            true,
+            ivfCentroids,
+            nullptr,
+            outDistances,
+            outIndices,
+            resources_,
+            &scanParams_);
+
+    // If the GPU isn't storing indices (they are on the CPU side), we
+    // need to perform the re-mapping here
+    // FIXME: we might ultimately be calling this function with inputs
+    // from the CPU, these are unnecessary copies
+    if (indicesOptions_ == INDICES_CPU) {
+        HostTensor<idx_t, 2, true> hostOutIndices(outIndices, stream);
+
+        ivfOffsetToUserIndex(
+                hostOutIndices.data(),
+                numLists_,
+                hostOutIndices.getSize(0),
+                hostOutIndices.getSize(1),
+                listOffsetToUserIndex_);
+
+        // Copy back to GPU, since the input to this function is on the
+        // GPU
+        outIndices.copyFrom(hostOutIndices, stream);
+    }
+}
+
+} // namespace gpu
+} // namespace faiss
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/gpu/impl/IVFFlat.cuh>
+#include <faiss/gpu/impl/IVFFlatScan.cuh>
+
+namespace faiss {
+namespace gpu {
+
+/// IVF lists of RaBitQ codes (faiss::IndexIVFRaBitQ). The codes of a list
+/// are stored on the GPU as the sign bits of the residual padded to 32-bit
+/// words, followed by the 2 float factors of the CPU code. The search shares
+/// the IVFFlat scan and k-selection, with a popcount based distance kernel
+class IVFRaBitQ : public IVFFlat {
+   public:
+    IVFRaBitQ(
+            GpuResources* resources,
+            int dim,
+            idx_t nlist,
+            faiss::MetricType metric,
+            int qb,
+            IndicesOptions indicesOptions,
+            MemorySpace space);
+
+    ~IVFRaBitQ() override;
+
+    /// Number of bits the query residuals are quantized to (0 = fp32)
+    void setQb(int qb);
+    int getQb() const;
+
+    void reconstruct_n(idx_t i0, idx_t n, float* out) override;
+
+   protected:
+    size_t getGpuVectorsEncodingSize_(idx_t numVecs) const override;
+    size_t getCpuVectorsEncodingSize_(idx_t numVecs) const override;
+
+    std::vector<uint8_t> translateCodesToGpu_(
+            std::vector<uint8_t> codes,
+            idx_t numVecs) const override;
+
+    std::vector<uint8_t> translateCodesFromGpu_(
+            std::vector<uint8_t> codes,
+            idx_t numVecs) const override;
+
+    void appendVectors_(
+            Tensor<float, 2, true>& vecs,
+            Tensor<float, 2, true>& ivfCentroidResiduals,
+            Tensor<idx_t, 1, true>& indices,
+            Tensor<idx_t, 1, true>& uniqueLists,
+            Tensor<idx_t, 1, true>& vectorsByUniqueList,
+            Tensor<idx_t, 1, true>& uniqueListVectorStart,
+            Tensor<idx_t, 1, true>& uniqueListStartOffset,
+            Tensor<idx_t, 1, true>& listIds,
+            Tensor<idx_t, 1, true>& listOffset,
+            cudaStream_t stream) override;
+
+    void searchImpl_(
+            Tensor<float, 2, true>& queries,
+            Tensor<float, 2, true>& coarseDistances,
+            Tensor<idx_t, 2, true>& coarseIndices,
+            Tensor<float, 3, true>& ivfCentroids,
+            int k,
+            Tensor<float, 2, true>& outDistances,
+            Tensor<idx_t, 2, true>& outIndices,
+            bool storePairs) override;
+
+    /// Bytes of the sign bits of a code on the CPU / on the GPU
+    size_t cpuBitsSize_() const;
+    size_t gpuBitsSize_() const;
+
+   protected:
+    IVFRaBitQScanParams scanParams_;
+};
+
+} // namespace gpu
+} // namespace faiss
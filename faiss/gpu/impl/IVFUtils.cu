@@ -177,11 +177,21 @@ void runCalcListOffsets(
     ThrustAllocator alloc(
             res, stream, thrustMem.data(), thrustMem.getSizeInBytes());
 
+    // par_nosync avoids synchronizing the stream after the scan, which is
+    // not needed and not allowed while capturing a CUDA graph
+#if THRUST_VERSION >= 101600
+    thrust::inclusive_scan(
+            thrust::cuda::par_nosync(alloc).on(stream),
+            prefixSumOffsets.data(),
+            prefixSumOffsets.data() + totalSize,
+            prefixSumOffsets.data());
+#else
     thrust::inclusive_scan(
             thrust::cuda::par(alloc).on(stream),
             prefixSumOffsets.data(),
             prefixSumOffsets.data() + totalSize,
             prefixSumOffsets.data());
+#endif
     CUDA_TEST_ERROR();
 }
 
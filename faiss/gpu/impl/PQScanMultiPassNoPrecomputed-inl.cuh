@@ -22,8 +22,11 @@
 namespace faiss {
 namespace gpu {
 
-// A basic implementation that works for the interleaved by vector layout for
-// any number of sub-quantizers
+// Implementation for the interleaved by vector layout for any number of
+// sub-quantizers. The look-up table is loaded in shared memory by tiles of
+// subQPerTile sub-quantizers, and the partial distances of a tile are
+// accumulated in the output, so that large numbers of sub-quantizers do not
+// limit the occupancy
 template <typename EncodeT, int EncodeBits, typename CodeDistanceT>
 __global__ void pqScanInterleaved(
         Tensor<float, 2, true> queries,
@@ -33,7 +36,11 @@ __global__ void pqScanInterleaved(
         void** listCodes,
         idx_t* listLengths,
         Tensor<idx_t, 2, true> prefixSumOffsets,
-        Tensor<float, 1, true> distance) {
+        Tensor<float, 1, true> distance,
+        int subQPerTile) {
+    extern __shared__ char smemCodeDistances[];
+    CodeDistanceT* tileCodeDist = (CodeDistanceT*)smemCodeDistances;
+
     // Each block handles a single query
     auto queryId = blockIdx.y;
     auto probeId = blockIdx.x;
@@ -50,6 +57,7 @@ __global__ void pqScanInterleaved(
     int warpId = threadIdx.x / kWarpSize;
 
     int numSubQuantizers = codeDistances.getSize(2);
+    int codesPerSubQuantizer = codeDistances.getSize(3);
 
     // This is where we start writing out data
     // We ensure that before the array (at offset -1), there is a 0 value
@@ -70,28 +78,145 @@ __global__ void pqScanInterleaved(
             bytesPerVectorBlockDim / sizeof(EncodeT);
     int wordsPerVectorBlock = wordsPerVectorBlockDim * numSubQuantizers;
 
-    for (idx_t block = warpId; block < numBlocks; block += numWarps) {
-        float dist = 0;
+    for (int sq0 = 0; sq0 < numSubQuantizers; sq0 += subQPerTile) {
+        int sq1 = min(numSubQuantizers, sq0 + subQPerTile);
+
+        // Prevent WAR dependencies on the previous tile
+        __syncthreads();
+        const CodeDistanceT* tileSrc = localCodeDistances[sq0].data();
+        for (int i = threadIdx.x; i < (sq1 - sq0) * codesPerSubQuantizer;
+             i += blockDim.x) {
+            tileCodeDist[i] = tileSrc[i];
+        }
+        __syncthreads();
+
+        for (idx_t block = warpId; block < numBlocks; block += numWarps) {
+            // This is the vector a given lane/thread handles
+            idx_t vec = block * kWarpSize + laneId;
+            bool valid = vec < numVecs;
+
+            // Each lane accumulates in the output the distances of its own
+            // vector, so the tiles do not need synchronization
+            float dist = (sq0 > 0 && valid) ? distanceOut[vec] : 0;
+
+            EncodeT* data = vecsBase + block * wordsPerVectorBlock +
+                    sq0 * wordsPerVectorBlockDim;
+            const CodeDistanceT* codeDist = tileCodeDist;
+
+            for (int sq = sq0; sq < sq1; ++sq) {
+                EncodeT enc =
+                        WarpPackedBits<EncodeT, EncodeBits>::read(laneId, data);
+                EncodeT code = WarpPackedBits<EncodeT, EncodeBits>::postRead(
+                        laneId, enc);
+
+                dist += valid ? ConvertTo<float>::to(codeDist[code]) : 0;
+                data += wordsPerVectorBlockDim;
+                codeDist += codesPerSubQuantizer;
+            }
+
+            if (valid) {
+                distanceOut[vec] = dist;
+            }
+        }
+    }
+}
+
+// Implementation for the interleaved by vector layout with 4-bit codes. The
+// 16-entry look-up tables are held in registers, each register of a warp
+// holding the tables of kWarpSize / 16 sub-quantizers, and are read with warp
+// shuffles. The sub-quantizers are processed by tiles of kTileRegs registers
+// per lane, the partial distances being accumulated in the output
+template <typename CodeDistanceT>
+__global__ void pqScanInterleaved4Bit(
+        Tensor<float, 2, true> queries,
+        Tensor<float, 3, true> pqCentroids,
+        Tensor<idx_t, 2, true> ivfListIds,
+        Tensor<CodeDistanceT, 4, true> codeDistances,
+        void** listCodes,
+        idx_t* listLengths,
+        Tensor<idx_t, 2, true> prefixSumOffsets,
+        Tensor<float, 1, true> distance) {
+    constexpr int kCodes = 16;
+    constexpr int kSubQPerReg = kWarpSize / kCodes;
+    constexpr int kTileRegs = 16;
+    constexpr int kSubQPerTile = kTileRegs * kSubQPerReg;
+
+    // Each block handles a single query
+    auto queryId = blockIdx.y;
+    auto probeId = blockIdx.x;
+
+    idx_t listId = ivfListIds[queryId][probeId];
+    // Safety guard in case NaNs in input cause no list ID to be generated
+    if (listId == -1) {
+        return;
+    }
+
+    int numWarps = blockDim.x / kWarpSize;
+    int laneId = threadIdx.x % kWarpSize;
+    int warpId = threadIdx.x / kWarpSize;
+
+    int numSubQuantizers = codeDistances.getSize(2);
+
+    // This is where we start writing out data
+    // We ensure that before the array (at offset -1), there is a 0 value
+    auto outBase = *(prefixSumOffsets[queryId][probeId].data() - 1);
+    float* distanceOut = distance[outBase].data();
+    auto localCodeDistances = codeDistances[queryId][probeId];
 
-        // This is the vector a given lane/thread handles
-        idx_t vec = block * kWarpSize + laneId;
-        bool valid = vec < numVecs;
+    // This is where the codes for our list start
+    auto vecsBase = (uint8_t*)listCodes[listId];
+    auto numVecs = listLengths[listId];
 
-        EncodeT* data = vecsBase + block * wordsPerVectorBlock;
+    // How many vector blocks of kWarpSize are in this list?
+    idx_t numBlocks = utils::divUp(numVecs, (idx_t)kWarpSize);
 
-        for (int sq = 0; sq < numSubQuantizers; ++sq) {
-            EncodeT enc =
-                    WarpPackedBits<EncodeT, EncodeBits>::read(laneId, data);
-            EncodeT code =
-                    WarpPackedBits<EncodeT, EncodeBits>::postRead(laneId, enc);
+    // 4 bits per vector in a block of kWarpSize vecs
+    constexpr int bytesPerVectorBlockDim = 4 * kWarpSize / 8;
+    int bytesPerVectorBlock = bytesPerVectorBlockDim * numSubQuantizers;
 
-            dist += valid ? ConvertTo<float>::to(localCodeDistances[sq][code])
-                          : 0;
-            data += wordsPerVectorBlockDim;
+    for (int sq0 = 0; sq0 < numSubQuantizers; sq0 += kSubQPerTile) {
+        // Lane l holds entry l % 16 of sub-quantizer
+        // sq0 + reg * kSubQPerReg + l / 16
+        float lut[kTileRegs];
+#pragma unroll
+        for (int reg = 0; reg < kTileRegs; ++reg) {
+            int sq = sq0 + reg * kSubQPerReg + laneId / kCodes;
+            lut[reg] = sq < numSubQuantizers
+                    ? ConvertTo<float>::to(
+                              localCodeDistances[sq][laneId % kCodes])
+                    : 0;
         }
 
-        if (valid) {
-            distanceOut[vec] = dist;
+        for (idx_t block = warpId; block < numBlocks; block += numWarps) {
+            // This is the vector a given lane/thread handles
+            idx_t vec = block * kWarpSize + laneId;
+            bool valid = vec < numVecs;
+
+            float dist = (sq0 > 0 && valid) ? distanceOut[vec] : 0;
+
+            uint8_t* data = vecsBase + block * bytesPerVectorBlock +
+                    sq0 * bytesPerVectorBlockDim;
+
+#pragma unroll
+            for (int reg = 0; reg < kTileRegs; ++reg) {
+#pragma unroll
+                for (int sub = 0; sub < kSubQPerReg; ++sub) {
+                    // warp-uniform condition, all lanes take part in the
+                    // shuffles
+                    if (sq0 + reg * kSubQPerReg + sub < numSubQuantizers) {
+                        uint8_t enc = WarpPackedBits<uint8_t, 4>::read(
+                                laneId, data);
+                        uint8_t code = WarpPackedBits<uint8_t, 4>::postRead(
+                                laneId, enc);
+                        dist += shfl(lut[reg], sub * kCodes + code);
+                        data += bytesPerVectorBlockDim;
+                    }
+                }
+            }
+
+            if (valid) {
+                distanceOut[vec] = dist;
+            }
         }
     }
 }
@@ -338,10 +463,20 @@ void runMultiPassTile(
         auto grid = dim3(coarseIndices.getSize(1), coarseIndices.getSize(0));
         auto block = dim3(kThreadsPerBlock);
 
+        // The look-up table is processed by tiles of sub-quantizers that fit
+        // in shared memory
+        size_t lookupSize = (useFloat16Lookup ? sizeof(half) : sizeof(float)) *
+                numSubQuantizerCodes;
+        int subQPerTile = std::min(
+                numSubQuantizers,
+                int(getMaxSharedMemPerBlockCurrentDevice() / lookupSize));
+        FAISS_ASSERT(subQPerTile > 0);
+        size_t smem = subQPerTile * lookupSize;
+
 #define RUN_INTERLEAVED(BITS_PER_CODE, CODE_DIST_T)            \
     do {                                                       \
         pqScanInterleaved<uint8_t, BITS_PER_CODE, CODE_DIST_T> \
-                <<<grid, block, 0, stream>>>(                  \
+                <<<grid, block, smem, stream>>>(               \
                         queries,                               \
                         pqCentroidsInnermostCode,              \
                         coarseIndices,                         \
@@ -349,7 +484,22 @@ void runMultiPassTile(
                         listCodes.data(),                      \
                         listLengths.data(),                    \
                         prefixSumOffsets,                      \
-                        allDistances);                         \
+                        allDistances,                          \
+                        subQPerTile);                          \
+    } while (0)
+
+        // 4-bit look-up tables are read from registers
+#define RUN_INTERLEAVED_4BIT(CODE_DIST_T)                               \
+    do {                                                                \
+        pqScanInterleaved4Bit<CODE_DIST_T><<<grid, block, 0, stream>>>( \
+                queries,                                                \
+                pqCentroidsInnermostCode,                               \
+                coarseIndices,                                          \
+                codeDistancesT,                                         \
+                listCodes.data(),                                       \
+                listLengths.data(),                                     \
+                prefixSumOffsets,                                       \
+                allDistances);                                          \
     } while (0)
 
         if (useFloat16Lookup) {
@@ -357,7 +507,7 @@ void runMultiPassTile(
 
             switch (bitsPerSubQuantizer) {
                 case 4: {
-                    RUN_INTERLEAVED(4, half);
+                    RUN_INTERLEAVED_4BIT(half);
                 } break;
                 case 5: {
                     RUN_INTERLEAVED(5, half);
@@ -377,7 +527,7 @@ void runMultiPassTile(
 
             switch (bitsPerSubQuantizer) {
                 case 4: {
-                    RUN_INTERLEAVED(4, float);
+                    RUN_INTERLEAVED_4BIT(float);
                 } break;
                 case 5: {
                     RUN_INTERLEAVED(5, float);
@@ -393,6 +543,9 @@ void runMultiPassTile(
                     break;
             }
         }
+
+#undef RUN_INTERLEAVED_4BIT
+#undef RUN_INTERLEAVED
     } else {
         // Convert all codes to a distance, and write out (distance,
         // index) values for all intermediate results
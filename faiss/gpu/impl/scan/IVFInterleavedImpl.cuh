@@ -133,6 +133,19 @@ void IVFINT_CODECS(
                                 NUM_THREAD_Q>,
                         codec);
             } break;
+            case ScalarQuantizer::QuantizerType::QT_bf16: {
+                using CodecT =
+                        Codec<ScalarQuantizer::QuantizerType::QT_bf16, 1>;
+                CodecT codec(scalarQ->code_size);
+                call_ivfint_run(
+                        IVFINT_RUN<
+                                CodecT,
+                                METRIC_TYPE,
+                                THREADS,
+                                NUM_WARP_Q,
+                                NUM_THREAD_Q>,
+                        codec);
+            } break;
             case ScalarQuantizer::QuantizerType::QT_8bit_direct: {
                 using CodecT =
                         Codec<ScalarQuantizer::QuantizerType::QT_8bit_direct,
@@ -28,7 +28,9 @@
 #include <faiss/gpu/utils/DeviceUtils.h>
 #include <gtest/gtest.h>
 #include <faiss/gpu/utils/CopyUtils.cuh>
+#include <faiss/gpu/utils/DeviceDefs.cuh>
 #include <faiss/gpu/utils/Transpose.cuh>
+#include <memory>
 #include <sstream>
 #include <vector>
 
@@ -561,6 +563,80 @@ TEST(TestGpuDistance, Jaccard_BF16) {
     testTransposition_bf16(false, false, faiss::MetricType::METRIC_Jaccard);
 }
 
+TEST(TestGpuDistance, Sharded) {
+    using namespace faiss::gpu;
+
+    int numDevices = getNumDevices();
+    int numShards = std::max(numDevices, 3);
+    int dim = randVal(20, 150);
+    int numQuery = randVal(1, 300);
+    int k = std::min(randVal(10, 100), GPU_MAX_SELECTION_K);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexFlat cpuIndex(dim, metric);
+        std::vector<std::vector<float>> shardVecs;
+        for (int i = 0; i < numShards; ++i) {
+            // shards of different sizes, the last ones may be smaller than k
+            int numVecs = i < 2 ? randVal(1000, 5000) : randVal(1, 2 * k);
+            shardVecs.push_back(randVecs(numVecs, dim));
+            cpuIndex.add(numVecs, shardVecs.back().data());
+        }
+        auto queries = randVecs(numQuery, dim);
+
+        std::vector<float> cpuDistance(numQuery * k);
+        std::vector<faiss::idx_t> cpuIndices(numQuery * k);
+        cpuIndex.search(
+                numQuery,
+                queries.data(),
+                k,
+                cpuDistance.data(),
+                cpuIndices.data());
+
+        // one resources object per shard, the shards being round-robin on
+        // the devices
+        std::vector<std::unique_ptr<StandardGpuResources>> res;
+        std::vector<GpuResourcesProvider*> provs;
+        std::vector<GpuDistanceShard> shards(numShards);
+        for (int i = 0; i < numShards; ++i) {
+            res.emplace_back(new StandardGpuResources);
+            res.back()->noTempMemory();
+            provs.push_back(res.back().get());
+            shards[i].device = i % numDevices;
+            shards[i].vectors = shardVecs[i].data();
+            shards[i].numVectors = shardVecs[i].size() / dim;
+        }
+
+        std::vector<float> gpuDistance(numQuery * k);
+        std::vector<faiss::idx_t> gpuIndices(numQuery * k);
+
+        GpuDistanceParams args;
+        args.metric = metric;
+        args.k = k;
+        args.dims = dim;
+        args.queries = queries.data();
+        args.numQueries = numQuery;
+        args.outDistances = gpuDistance.data();
+        args.outIndices = gpuIndices.data();
+        args.device = numDevices - 1;
+        bfKnnSharded(provs, shards, args);
+
+        compareLists(
+                cpuDistance.data(),
+                cpuIndices.data(),
+                gpuDistance.data(),
+                gpuIndices.data(),
+                numQuery,
+                k,
+                "sharded bfKnn",
+                false,
+                false,
+                true,
+                6e-3f,
+                0.1f,
+                0.015f);
+    }
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexBinaryFlat.h>
+#include <faiss/IndexBinaryIVF.h>
+#include <faiss/gpu/GpuCloner.h>
+#include <faiss/gpu/GpuIndexBinaryFlat.h>
+#include <faiss/gpu/GpuIndexBinaryIVF.h>
+#include <faiss/gpu/StandardGpuResources.h>
+#include <faiss/gpu/test/TestUtils.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Ties at the k-th distance may be broken differently, so only the groups of
+// equal distances below it are compared
+void compareBinaryResults(
+        const std::vector<int>& cpuDist,
+        const std::vector<faiss::idx_t>& cpuLabels,
+        const std::vector<int>& gpuDist,
+        const std::vector<faiss::idx_t>& gpuLabels,
+        int numQuery,
+        int k) {
+    for (int i = 0; i < numQuery; ++i) {
+        std::set<faiss::idx_t> cpuLabelSet;
+        std::set<faiss::idx_t> gpuLabelSet;
+        int curDist = cpuDist[i * k];
+
+        for (int j = 0; j < k; ++j) {
+            int idx = i * k + j;
+
+            // Because the distances are reproducible, they must be exactly
+            // the same
+            EXPECT_EQ(cpuDist[idx], gpuDist[idx]);
+
+            if (curDist != cpuDist[idx]) {
+                EXPECT_EQ(cpuLabelSet, gpuLabelSet);
+                curDist = cpuDist[idx];
+                cpuLabelSet.clear();
+                gpuLabelSet.clear();
+            }
+
+            cpuLabelSet.insert(cpuLabels[idx]);
+            gpuLabelSet.insert(gpuLabels[idx]);
+        }
+    }
+}
+
+// The order of the results of a query is not specified
+void compareRangeResults(
+        const faiss::RangeSearchResult& cpuRes,
+        const faiss::RangeSearchResult& gpuRes) {
+    ASSERT_EQ(cpuRes.nq, gpuRes.nq);
+
+    for (size_t i = 0; i < cpuRes.nq; ++i) {
+        std::vector<std::pair<faiss::idx_t, float>> cpuQ, gpuQ;
+        for (size_t j = cpuRes.lims[i]; j < cpuRes.lims[i + 1]; ++j) {
+            cpuQ.emplace_back(cpuRes.labels[j], cpuRes.distances[j]);
+        }
+        for (size_t j = gpuRes.lims[i]; j < gpuRes.lims[i + 1]; ++j) {
+            gpuQ.emplace_back(gpuRes.labels[j], gpuRes.distances[j]);
+        }
+        std::sort(cpuQ.begin(), cpuQ.end());
+        std::sort(gpuQ.begin(), gpuQ.end());
+        EXPECT_EQ(cpuQ, gpuQ);
+    }
+}
+
+void testGpuIndexBinaryIVF(int dims) {
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+
+    faiss::gpu::GpuIndexBinaryIVFConfig config;
+    config.device = faiss::gpu::randVal(0, faiss::gpu::getNumDevices() - 1);
+
+    int nlist = faiss::gpu::randVal(16, 64);
+    int numVecs = faiss::gpu::randVal(5000, 20000);
+    int numQuery = faiss::gpu::randVal(1, 500);
+    int k = faiss::gpu::randVal(1, 100);
+    int nprobe = faiss::gpu::randVal(1, nlist);
+
+    auto data = faiss::gpu::randBinaryVecs(numVecs, dims);
+    auto query = faiss::gpu::randBinaryVecs(numQuery, dims);
+
+    faiss::IndexBinaryFlat cpuQuantizer(dims);
+    faiss::IndexBinaryIVF cpuIndex(&cpuQuantizer, dims, nlist);
+    cpuIndex.train(numVecs, data.data());
+    cpuIndex.add(numVecs, data.data());
+    cpuIndex.nprobe = nprobe;
+
+    faiss::gpu::GpuIndexBinaryIVF gpuIndex(&res, &cpuIndex, config);
+    EXPECT_EQ(gpuIndex.ntotal, numVecs);
+    EXPECT_EQ(gpuIndex.nprobe, nprobe);
+
+    std::vector<int> cpuDist(numQuery * k);
+    std::vector<faiss::idx_t> cpuLabels(numQuery * k);
+    cpuIndex.search(
+            numQuery, query.data(), k, cpuDist.data(), cpuLabels.data());
+
+    std::vector<int> gpuDist(numQuery * k);
+    std::vector<faiss::idx_t> gpuLabels(numQuery * k);
+    gpuIndex.search(
+            numQuery, query.data(), k, gpuDist.data(), gpuLabels.data());
+
+    compareBinaryResults(cpuDist, cpuLabels, gpuDist, gpuLabels, numQuery, k);
+
+    // Range search with a radius that returns a few results per query
+    int radius = dims / 2 - dims / 8;
+    faiss::RangeSearchResult cpuRes(numQuery), gpuRes(numQuery);
+    cpuIndex.range_search(numQuery, query.data(), radius, &cpuRes);
+    gpuIndex.range_search(numQuery, query.data(), radius, &gpuRes);
+    compareRangeResults(cpuRes, gpuRes);
+}
+
+} // namespace
+
+TEST(TestGpuIndexBinaryIVF, Test8) {
+    for (int tries = 0; tries < 3; ++tries) {
+        testGpuIndexBinaryIVF(faiss::gpu::randVal(1, 20) * 8);
+    }
+}
+
+TEST(TestGpuIndexBinaryIVF, Test32) {
+    for (int tries = 0; tries < 3; ++tries) {
+        testGpuIndexBinaryIVF(faiss::gpu::randVal(1, 10) * 32);
+    }
+}
+
+TEST(TestGpuIndexBinaryIVF, TrainAddCopyTo) {
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+
+    int dims = 128;
+    int nlist = 32;
+    int numVecs = 10000;
+    int numQuery = 100;
+    int k = 10;
+
+    auto data = faiss::gpu::randBinaryVecs(numVecs, dims);
+    auto query = faiss::gpu::randBinaryVecs(numQuery, dims);
+
+    faiss::gpu::GpuIndexBinaryIVF gpuIndex(&res, dims, nlist);
+    gpuIndex.train(numVecs, data.data());
+    EXPECT_TRUE(gpuIndex.is_trained);
+    EXPECT_EQ(gpuIndex.getQuantizer()->ntotal, nlist);
+
+    // Incremental adds
+    gpuIndex.add(numVecs / 3, data.data());
+    gpuIndex.add(
+            numVecs - numVecs / 3, data.data() + numVecs / 3 * dims / 8);
+    gpuIndex.nprobe = 4;
+
+    faiss::idx_t total = 0;
+    for (int l = 0; l < nlist; ++l) {
+        total += gpuIndex.getListLength(l);
+    }
+    EXPECT_EQ(total, numVecs);
+
+    // The GPU -> CPU cloner copies the quantizer and the lists
+    std::unique_ptr<faiss::IndexBinary> cpuIndex(
+            faiss::gpu::index_binary_gpu_to_cpu(&gpuIndex));
+    auto cpuIVF = dynamic_cast<faiss::IndexBinaryIVF*>(cpuIndex.get());
+    ASSERT_TRUE(cpuIVF);
+    EXPECT_EQ(cpuIVF->ntotal, numVecs);
+    EXPECT_EQ(cpuIVF->nprobe, 4);
+
+    std::vector<int> cpuDist(numQuery * k), gpuDist(numQuery * k);
+    std::vector<faiss::idx_t> cpuLabels(numQuery * k);
+    std::vector<faiss::idx_t> gpuLabels(numQuery * k);
+    cpuIVF->search(
+            numQuery, query.data(), k, cpuDist.data(), cpuLabels.data());
+    gpuIndex.search(
+            numQuery, query.data(), k, gpuDist.data(), gpuLabels.data());
+    compareBinaryResults(cpuDist, cpuLabels, gpuDist, gpuLabels, numQuery, k);
+
+    // And back to the GPU
+    std::unique_ptr<faiss::IndexBinary> gpuIndex2(
+            faiss::gpu::index_binary_cpu_to_gpu(&res, 0, cpuIVF));
+    ASSERT_TRUE(
+            dynamic_cast<faiss::gpu::GpuIndexBinaryIVF*>(gpuIndex2.get()));
+    std::vector<int> gpuDist2(numQuery * k);
+    std::vector<faiss::idx_t> gpuLabels2(numQuery * k);
+    gpuIndex2->search(
+            numQuery, query.data(), k, gpuDist2.data(), gpuLabels2.data());
+    EXPECT_EQ(gpuDist2, gpuDist);
+}
+
+TEST(TestGpuIndexBinaryIVF, FlatRangeSearch) {
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+
+    for (int dims : {24, 64, 256}) {
+        int numVecs = 5000;
+        int numQuery = 200;
+
+        auto data = faiss::gpu::randBinaryVecs(numVecs, dims);
+        auto query = faiss::gpu::randBinaryVecs(numQuery, dims);
+
+        faiss::IndexBinaryFlat cpuIndex(dims);
+        cpuIndex.add(numVecs, data.data());
+        faiss::gpu::GpuIndexBinaryFlat gpuIndex(&res, &cpuIndex);
+
+        int radius = dims / 2 - dims / 8;
+        faiss::RangeSearchResult cpuRes(numQuery), gpuRes(numQuery);
+        cpuIndex.range_search(numQuery, query.data(), radius, &cpuRes);
+        gpuIndex.range_search(numQuery, query.data(), radius, &gpuRes);
+        compareRangeResults(cpuRes, gpuRes);
+    }
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // just run with a fixed test seed
+    faiss::gpu::setTestSeed(100);
+
+    return RUN_ALL_TESTS();
+}
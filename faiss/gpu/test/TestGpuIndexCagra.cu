@@ -21,17 +21,22 @@
  * limitations under the License.
  */
 
+#include <faiss/IndexFlat.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/MetricType.h>
 #include <faiss/gpu/GpuIndexCagra.h>
 #include <faiss/gpu/GpuResources.h>
 #include <faiss/gpu/StandardGpuResources.h>
 #include <faiss/gpu/test/TestUtils.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
 #include <faiss/utils/distances.h>
 #include <cstddef>
 #include <faiss/gpu/utils/CopyUtils.cuh>
 #include <faiss/gpu/utils/DeviceTensor.cuh>
+#include <memory>
 #include <optional>
+#include <set>
 #include <vector>
 
 #include <raft/core/resource/cuda_stream.hpp>
@@ -77,7 +82,10 @@ struct Options {
     int device;
 };
 
-void queryTest(faiss::MetricType metric, double expected_recall) {
+void queryTest(
+        faiss::MetricType metric,
+        double expected_recall,
+        bool compressed = false) {
     for (int tries = 0; tries < 5; ++tries) {
         Options opt;
         if (opt.buildAlgo == faiss::gpu::graph_build_algo::NN_DESCENT &&
@@ -105,6 +113,10 @@ void queryTest(faiss::MetricType metric, double expected_recall) {
         config.graph_degree = opt.graphDegree;
         config.intermediate_graph_degree = opt.intermediateGraphDegree;
         config.build_algo = opt.buildAlgo;
+        faiss::gpu::VPQCompressionCagraConfig compressionConfig;
+        if (compressed) {
+            config.compression_params = &compressionConfig;
+        }
 
         faiss::gpu::GpuIndexCagra gpuIndex(&res, cpuIndex.d, metric, config);
         gpuIndex.train(opt.numTrain, trainVecs.data());
@@ -136,12 +148,16 @@ void queryTest(faiss::MetricType metric, double expected_recall) {
                 gpuRes.get(), devAlloc, {opt.numQuery, opt.k});
         faiss::gpu::DeviceTensor<faiss::idx_t, 2, true> testIndices(
                 gpuRes.get(), devAlloc, {opt.numQuery, opt.k});
+        // re-rank the results of the compressed dataset on the CPU
+        faiss::gpu::SearchParametersCagra searchParams;
+        searchParams.refine_k_factor = compressed ? 4 : 1;
         gpuIndex.search(
                 opt.numQuery,
                 queryVecs.data(),
                 opt.k,
                 testDistance.data(),
-                testIndices.data());
+                testIndices.data(),
+                &searchParams);
 
         auto refDistanceDev = faiss::gpu::toDeviceTemporary(
                 gpuRes.get(),
@@ -195,6 +211,10 @@ TEST(TestGpuIndexCagra, Float32_Query_IP) {
     queryTest(faiss::METRIC_INNER_PRODUCT, 0.98);
 }
 
+TEST(TestGpuIndexCagra, Float32_Query_L2_Compressed) {
+    queryTest(faiss::METRIC_L2, 0.95, true);
+}
+
 void copyToTest(
         faiss::MetricType metric,
         double expected_recall,
@@ -351,6 +371,107 @@ TEST(TestGpuIndexCagra, Float32_CopyTo_IP_BaseLevelOnly) {
     copyToTest(faiss::METRIC_INNER_PRODUCT, 0.98, true);
 }
 
+TEST(TestGpuIndexCagra, Float32_CopyToCompact) {
+    Options opt;
+    std::vector<float> trainVecs = faiss::gpu::randVecs(opt.numTrain, opt.dim);
+
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+
+    faiss::gpu::GpuIndexCagraConfig config;
+    config.device = opt.device;
+    config.graph_degree = opt.graphDegree;
+    config.intermediate_graph_degree = opt.intermediateGraphDegree;
+    config.build_algo = opt.buildAlgo;
+
+    faiss::gpu::GpuIndexCagra gpuIndex(&res, opt.dim, faiss::METRIC_L2, config);
+    gpuIndex.train(opt.numTrain, trainVecs.data());
+    auto graph = gpuIndex.get_knngraph();
+
+    // without pruning, level 0 holds the valid links of the CAGRA graph
+    faiss::IndexHNSWCagra compactIndex(opt.dim, opt.graphDegree / 2);
+    compactIndex.base_level_only = true;
+    gpuIndex.copyToCompact(&compactIndex);
+    ASSERT_TRUE(compactIndex.hnsw.storage_is_compact);
+    ASSERT_EQ(compactIndex.ntotal, opt.numTrain);
+
+    for (faiss::idx_t i = 0; i < opt.numTrain; i++) {
+        size_t begin, end;
+        compactIndex.hnsw.neighbor_range(i, 0, &begin, &end);
+        std::vector<faiss::idx_t> ref;
+        for (size_t j = 0; j < opt.graphDegree; j++) {
+            auto v = graph[i * opt.graphDegree + j];
+            if (v < 0) {
+                break;
+            }
+            ref.push_back(v);
+        }
+        ASSERT_EQ(end - begin, ref.size());
+        for (size_t j = begin; j < end; j++) {
+            EXPECT_EQ(
+                    compactIndex.hnsw.compact_neighbors_data[j],
+                    ref[j - begin]);
+        }
+    }
+
+    // pruned export for serving: the lists are capped, and the index
+    // searches like the full one
+    int maxDegree = opt.graphDegree / 2;
+    faiss::IndexHNSWCagra prunedIndex(opt.dim, opt.graphDegree / 2);
+    gpuIndex.copyToCompact(&prunedIndex, maxDegree);
+    ASSERT_TRUE(prunedIndex.hnsw.storage_is_compact);
+    auto degrees = prunedIndex.hnsw.get_degrees(0);
+    for (auto deg : degrees) {
+        EXPECT_LE(deg, maxDegree);
+    }
+
+    faiss::IndexFlatL2 flatIndex(opt.dim);
+    flatIndex.add(opt.numTrain, trainVecs.data());
+    auto queryVecs = faiss::gpu::randVecs(opt.numQuery, opt.dim);
+    std::vector<float> refDistance(opt.numQuery * opt.k);
+    std::vector<faiss::idx_t> refIndices(opt.numQuery * opt.k);
+    flatIndex.search(
+            opt.numQuery,
+            queryVecs.data(),
+            opt.k,
+            refDistance.data(),
+            refIndices.data());
+
+    std::vector<float> distance(opt.numQuery * opt.k);
+    std::vector<faiss::idx_t> indices(opt.numQuery * opt.k);
+    faiss::SearchParametersHNSW params;
+    params.efSearch = opt.k * 4;
+    prunedIndex.search(
+            opt.numQuery,
+            queryVecs.data(),
+            opt.k,
+            distance.data(),
+            indices.data(),
+            &params);
+
+    size_t nfound = 0;
+    for (int q = 0; q < opt.numQuery; q++) {
+        std::set<faiss::idx_t> ref(
+                refIndices.begin() + q * opt.k,
+                refIndices.begin() + (q + 1) * opt.k);
+        for (int j = 0; j < opt.k; j++) {
+            nfound += ref.count(indices[q * opt.k + j]);
+        }
+    }
+    EXPECT_GT(nfound, 0.9 * opt.numQuery * opt.k);
+
+    // and round-trips through the index I/O
+    faiss::VectorIOWriter writer;
+    faiss::write_index(&prunedIndex, &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> readIndex(faiss::read_index(&reader));
+    auto readHNSW = dynamic_cast<faiss::IndexHNSWCagra*>(readIndex.get());
+    ASSERT_TRUE(readHNSW);
+    EXPECT_TRUE(readHNSW->hnsw.storage_is_compact);
+    EXPECT_EQ(readHNSW->hnsw.get_degrees(0), degrees);
+}
+
 void copyFromTest(faiss::MetricType metric, double expected_recall) {
     for (int tries = 0; tries < 5; ++tries) {
         Options opt;
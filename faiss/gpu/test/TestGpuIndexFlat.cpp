@@ -12,6 +12,7 @@
 #include <faiss/gpu/test/TestUtils.h>
 #include <faiss/gpu/utils/DeviceUtils.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
@@ -760,6 +761,101 @@ TEST(TestCuvsGpuIndexFlat, SearchAndReconstruct) {
 }
 #endif
 
+TEST(TestGpuIndexFlat, SearchAsync) {
+    int device = faiss::gpu::randVal(0, faiss::gpu::getNumDevices() - 1);
+    faiss::gpu::DeviceScope scope(device);
+
+    int dim = faiss::gpu::randVal(20, 150);
+    int numVecs = faiss::gpu::randVal(1000, 5000);
+    int numQuery = faiss::gpu::randVal(1, 100);
+    int k = faiss::gpu::randVal(1, 100);
+    int numBatches = 4;
+
+    std::vector<float> vecs = faiss::gpu::randVecs(numVecs, dim);
+
+    faiss::gpu::StandardGpuResources res;
+
+    faiss::gpu::GpuIndexFlatConfig config;
+    config.device = device;
+    config.use_cuvs = false;
+
+    faiss::gpu::GpuIndexFlatL2 gpuIndex(&res, dim, config);
+    gpuIndex.add(numVecs, vecs.data());
+
+    // Page-locked input and output buffers for all batches in flight
+    size_t queryCount = (size_t)numBatches * numQuery * dim;
+    size_t resultCount = (size_t)numBatches * numQuery * k;
+
+    float* queries;
+    float* distances;
+    faiss::idx_t* labels;
+    CUDA_VERIFY(cudaHostAlloc(
+            (void**)&queries, queryCount * sizeof(float), cudaHostAllocDefault));
+    CUDA_VERIFY(cudaHostAlloc(
+            (void**)&distances,
+            resultCount * sizeof(float),
+            cudaHostAllocDefault));
+    CUDA_VERIFY(cudaHostAlloc(
+            (void**)&labels,
+            resultCount * sizeof(faiss::idx_t),
+            cudaHostAllocDefault));
+
+    auto queryVecs = faiss::gpu::randVecs(numBatches * numQuery, dim);
+    std::copy(queryVecs.begin(), queryVecs.end(), queries);
+
+    cudaStream_t stream;
+    CUDA_VERIFY(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+
+    std::vector<faiss::gpu::GpuSearchFuture> futures;
+    for (int b = 0; b < numBatches; ++b) {
+        futures.push_back(gpuIndex.searchAsync(
+                numQuery,
+                queries + (size_t)b * numQuery * dim,
+                k,
+                distances + (size_t)b * numQuery * k,
+                labels + (size_t)b * numQuery * k,
+                stream));
+    }
+
+    for (auto& f : futures) {
+        f.wait();
+        EXPECT_TRUE(f.isReady());
+    }
+
+    // Same batches as the asynchronous searches, for identical results
+    std::vector<float> refDistances(resultCount);
+    std::vector<faiss::idx_t> refLabels(resultCount);
+    for (int b = 0; b < numBatches; ++b) {
+        gpuIndex.search(
+                numQuery,
+                queryVecs.data() + (size_t)b * numQuery * dim,
+                k,
+                refDistances.data() + (size_t)b * numQuery * k,
+                refLabels.data() + (size_t)b * numQuery * k);
+    }
+
+    for (size_t i = 0; i < resultCount; ++i) {
+        EXPECT_EQ(refLabels[i], labels[i]);
+        EXPECT_EQ(refDistances[i], distances[i]);
+    }
+
+    // Pageable host memory is refused
+    EXPECT_THROW(
+            gpuIndex.searchAsync(
+                    numQuery,
+                    queryVecs.data(),
+                    k,
+                    distances,
+                    labels,
+                    stream),
+            faiss::FaissException);
+
+    CUDA_VERIFY(cudaStreamDestroy(stream));
+    CUDA_VERIFY(cudaFreeHost(queries));
+    CUDA_VERIFY(cudaFreeHost(distances));
+    CUDA_VERIFY(cudaFreeHost(labels));
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
 
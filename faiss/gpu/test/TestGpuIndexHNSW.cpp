@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/gpu/GpuIndexHNSW.h>
+#include <faiss/gpu/StandardGpuResources.h>
+#include <faiss/gpu/test/TestUtils.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+constexpr int kDim = 64;
+constexpr int kNumVecs = 20000;
+constexpr int kNumQuery = 500;
+constexpr int kK = 10;
+
+/// Fraction of the ground truth found in the results
+float recall(
+        const std::vector<faiss::idx_t>& gt,
+        const std::vector<faiss::idx_t>& labels) {
+    int found = 0;
+    for (int q = 0; q < kNumQuery; ++q) {
+        std::unordered_set<faiss::idx_t> gtq(
+                gt.begin() + q * kK, gt.begin() + (q + 1) * kK);
+        for (int j = 0; j < kK; ++j) {
+            found += gtq.count(labels[q * kK + j]);
+        }
+    }
+    return float(found) / (kNumQuery * kK);
+}
+
+void testHNSW(faiss::MetricType metric) {
+    std::vector<float> xb(kNumVecs * kDim), xq(kNumQuery * kDim);
+    faiss::rand_smooth_vectors(kNumVecs, kDim, xb.data(), 1);
+    faiss::rand_smooth_vectors(kNumQuery, kDim, xq.data(), 2);
+
+    faiss::IndexFlat flat(kDim, metric);
+    flat.add(kNumVecs, xb.data());
+    std::vector<float> gtDistances(kNumQuery * kK);
+    std::vector<faiss::idx_t> gt(kNumQuery * kK);
+    flat.search(kNumQuery, xq.data(), kK, gtDistances.data(), gt.data());
+
+    faiss::IndexHNSWFlat cpuIndex(kDim, 16, metric);
+    cpuIndex.add(kNumVecs, xb.data());
+
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+    faiss::gpu::GpuIndexHNSW gpuIndex(&res, &cpuIndex);
+    EXPECT_EQ(gpuIndex.ntotal, kNumVecs);
+
+    faiss::gpu::SearchParametersGpuHNSW params;
+    params.beamSize = 64;
+    std::vector<float> distances(kNumQuery * kK);
+    std::vector<faiss::idx_t> labels(kNumQuery * kK);
+    gpuIndex.search(
+            kNumQuery, xq.data(), kK, distances.data(), labels.data(), &params);
+    EXPECT_GT(recall(gt, labels), 0.9);
+
+    // the distances are exact, sorted from the best result
+    for (int q = 0; q < kNumQuery; ++q) {
+        for (int j = 0; j < kK; ++j) {
+            faiss::idx_t id = labels[q * kK + j];
+            ASSERT_GE(id, 0);
+            const float* xqi = xq.data() + q * kDim;
+            const float* xbi = xb.data() + id * kDim;
+            float ref = metric == faiss::METRIC_L2
+                    ? faiss::fvec_L2sqr(xqi, xbi, kDim)
+                    : faiss::fvec_inner_product(xqi, xbi, kDim);
+            EXPECT_NEAR(distances[q * kK + j], ref, 1e-3 * std::abs(ref));
+            if (j > 0) {
+                float prev = distances[q * kK + j - 1];
+                if (metric == faiss::METRIC_L2) {
+                    EXPECT_LE(prev, distances[q * kK + j]);
+                } else {
+                    EXPECT_GE(prev, distances[q * kK + j]);
+                }
+            }
+        }
+    }
+
+    // entry points from the descent of the upper levels on the CPU
+    std::vector<faiss::idx_t> entryPoints(kNumQuery);
+    faiss::gpu::GpuIndexHNSW::getEntryPoints(
+            &cpuIndex, kNumQuery, xq.data(), 1, entryPoints.data());
+    gpuIndex.searchFromEntryPoints(
+            kNumQuery,
+            xq.data(),
+            kK,
+            1,
+            entryPoints.data(),
+            distances.data(),
+            labels.data(),
+            &params);
+    EXPECT_GT(recall(gt, labels), 0.9);
+
+    // the compact CSR graph gives the same results
+    std::vector<faiss::idx_t> compactLabels(kNumQuery * kK);
+    cpuIndex.hnsw.convert_to_compact();
+    faiss::gpu::GpuIndexHNSW compactIndex(&res, &cpuIndex);
+    compactIndex.search(
+            kNumQuery,
+            xq.data(),
+            kK,
+            distances.data(),
+            compactLabels.data(),
+            &params);
+    gpuIndex.search(
+            kNumQuery, xq.data(), kK, distances.data(), labels.data(), &params);
+    EXPECT_EQ(labels, compactLabels);
+}
+
+} // namespace
+
+TEST(TestGpuIndexHNSW, L2) {
+    testHNSW(faiss::METRIC_L2);
+}
+
+TEST(TestGpuIndexHNSW, InnerProduct) {
+    testHNSW(faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(TestGpuIndexHNSW, AddNotSupported) {
+    faiss::gpu::StandardGpuResources res;
+    faiss::gpu::GpuIndexHNSW gpuIndex(&res, kDim);
+    std::vector<float> x(kDim);
+    EXPECT_THROW(gpuIndex.add(1, x.data()), faiss::FaissException);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // just run with a fixed test seed
+    faiss::gpu::setTestSeed(100);
+
+    return RUN_ALL_TESTS();
+}
@@ -909,6 +909,153 @@ TEST(TestGpuIndexIVFFlat, Reconstruct_n) {
     EXPECT_EQ(gpuVals, cpuVals);
 }
 
+TEST(TestGpuIndexIVFFlat, StreamingLists) {
+    Options opt;
+
+    std::vector<float> trainVecs = faiss::gpu::randVecs(opt.numTrain, opt.dim);
+    std::vector<float> addVecs = faiss::gpu::randVecs(opt.numAdd, opt.dim);
+    std::vector<float> queryVecs = faiss::gpu::randVecs(opt.numQuery, opt.dim);
+
+    faiss::IndexFlatL2 cpuQuantizer(opt.dim);
+    faiss::IndexIVFFlat cpuIndex(
+            &cpuQuantizer, opt.dim, opt.numCentroids, faiss::METRIC_L2);
+    cpuIndex.nprobe = opt.nprobe;
+    cpuIndex.train(opt.numTrain, trainVecs.data());
+    cpuIndex.add(opt.numAdd, addVecs.data());
+
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+
+    faiss::gpu::GpuIndexIVFFlatConfig config;
+    config.device = opt.device;
+    config.indicesOptions = opt.indicesOpt;
+    config.use_cuvs = false;
+
+    faiss::gpu::GpuIndexIVFFlat gpuIndex(
+            &res, opt.dim, opt.numCentroids, faiss::METRIC_L2, config);
+    gpuIndex.copyFrom(&cpuIndex);
+    gpuIndex.nprobe = opt.nprobe;
+
+    std::vector<float> refDistances(opt.numQuery * opt.k);
+    std::vector<faiss::idx_t> refLabels(opt.numQuery * opt.k);
+    gpuIndex.search(
+            opt.numQuery,
+            queryVecs.data(),
+            opt.k,
+            refDistances.data(),
+            refLabels.data());
+
+    // a cache of about a quarter of the lists: batches of queries evict
+    // the lists of the previous ones
+    size_t cacheBytes = opt.numAdd * opt.dim * sizeof(float) / 4;
+    gpuIndex.setStreamingInvertedLists(cpuIndex.invlists, cacheBytes);
+    EXPECT_EQ(gpuIndex.ntotal, cpuIndex.ntotal);
+    for (int i = 0; i < opt.numCentroids; ++i) {
+        EXPECT_EQ(
+                (size_t)gpuIndex.getListLength(i),
+                cpuIndex.invlists->list_size(i));
+    }
+
+    std::vector<float> distances(opt.numQuery * opt.k);
+    std::vector<faiss::idx_t> labels(opt.numQuery * opt.k);
+    for (int rep = 0; rep < 2; ++rep) {
+        // one query per batch
+        for (int q = 0; q < opt.numQuery; ++q) {
+            gpuIndex.search(
+                    1,
+                    queryVecs.data() + q * opt.dim,
+                    opt.k,
+                    distances.data() + q * opt.k,
+                    labels.data() + q * opt.k);
+        }
+        EXPECT_EQ(labels, refLabels);
+        for (size_t i = 0; i < distances.size(); ++i) {
+            EXPECT_NEAR(distances[i], refDistances[i], 1e-4);
+        }
+    }
+
+    EXPECT_THROW(
+            gpuIndex.add(opt.numAdd, addVecs.data()), faiss::FaissException);
+}
+
+void halfStorageTest(faiss::MetricType metricType, bool bf16) {
+    Options opt;
+    std::vector<float> trainVecs = faiss::gpu::randVecs(opt.numTrain, opt.dim);
+    std::vector<float> addVecs = faiss::gpu::randVecs(opt.numAdd, opt.dim);
+
+    faiss::IndexFlat cpuQuantizer(opt.dim, metricType);
+    faiss::IndexIVFFlat cpuIndex(
+            &cpuQuantizer, opt.dim, opt.numCentroids, metricType);
+    cpuIndex.nprobe = opt.nprobe;
+    cpuIndex.train(opt.numTrain, trainVecs.data());
+    cpuIndex.add(opt.numAdd / 2, addVecs.data());
+
+    faiss::gpu::StandardGpuResources res;
+    res.noTempMemory();
+
+    faiss::gpu::GpuIndexIVFFlatConfig config;
+    config.device = opt.device;
+    config.indicesOptions = opt.indicesOpt;
+    config.use_cuvs = false;
+    config.useFloat16IVFStorage = !bf16;
+    config.useBFloat16IVFStorage = bf16;
+
+    // half of the vectors are converted from the CPU lists, the other half
+    // is encoded on the GPU
+    faiss::gpu::GpuIndexIVFFlat gpuIndex(&res, &cpuIndex, config);
+    gpuIndex.nprobe = opt.nprobe;
+    cpuIndex.add(opt.numAdd / 2, addVecs.data() + opt.numAdd / 2 * opt.dim);
+    gpuIndex.add(opt.numAdd / 2, addVecs.data() + opt.numAdd / 2 * opt.dim);
+    EXPECT_EQ(cpuIndex.ntotal, gpuIndex.ntotal);
+
+    faiss::gpu::compareIndices(
+            cpuIndex,
+            gpuIndex,
+            opt.numQuery,
+            opt.dim,
+            opt.k,
+            opt.toString(),
+            kF16MaxRelErr,
+            0.70f,
+            0.30f);
+
+    // the lists come back as float32, within the storage precision
+    faiss::IndexFlatL2 cpuQuantizer2(1);
+    faiss::IndexIVFFlat cpuIndex2(&cpuQuantizer2, 1, 1, faiss::METRIC_L2);
+    gpuIndex.copyTo(&cpuIndex2);
+    EXPECT_EQ(cpuIndex2.ntotal, cpuIndex.ntotal);
+    EXPECT_EQ(cpuIndex2.code_size, opt.dim * sizeof(float));
+
+    std::vector<float> ref(opt.numAdd * opt.dim);
+    std::vector<float> rec(opt.numAdd * opt.dim);
+    cpuIndex.make_direct_map();
+    cpuIndex2.make_direct_map();
+    cpuIndex.reconstruct_n(0, opt.numAdd, ref.data());
+    cpuIndex2.reconstruct_n(0, opt.numAdd, rec.data());
+
+    std::vector<float> gpuRec(opt.numAdd * opt.dim);
+    gpuIndex.reconstruct_n(0, opt.numAdd, gpuRec.data());
+    EXPECT_EQ(gpuRec, rec);
+
+    // 8 / 11 bits of mantissa
+    float relErr = bf16 ? 1.0f / 256 : 1.0f / 2048;
+    for (size_t i = 0; i < ref.size(); ++i) {
+        EXPECT_NEAR(rec[i], ref[i], std::abs(ref[i]) * relErr + 1e-6f);
+    }
+}
+
+TEST(TestGpuIndexIVFFlat, Float16Storage_L2) {
+    halfStorageTest(faiss::METRIC_L2, false);
+}
+
+TEST(TestGpuIndexIVFFlat, Float16Storage_IP) {
+    halfStorageTest(faiss::METRIC_INNER_PRODUCT, false);
+}
+
+TEST(TestGpuIndexIVFFlat, BFloat16Storage_L2) {
+    halfStorageTest(faiss::METRIC_L2, true);
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
 
@@ -204,6 +204,24 @@ TEST(TestGpuIndexIVFPQ, LargeBatch) {
     }
 }
 
+// 4-bit codes (look-up tables in registers) and 8-bit codes with more
+// sub-quantizers than the shared memory holds (tiled look-up tables)
+TEST(TestGpuIndexIVFPQ, Query_Interleaved_WideCodes) {
+    for (int bitsPerCode : {4, 8}) {
+        for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+            Options opt;
+            opt.interleavedLayout = true;
+            opt.bitsPerCode = bitsPerCode;
+            opt.codes = bitsPerCode == 4 ? 64 : 128;
+            opt.dim = opt.codes * 2;
+            opt.usePrecomputed = false;
+            opt.useFloat16 = false;
+
+            queryTest(opt, metric);
+        }
+    }
+}
+
 void testMMCodeDistance(faiss::MetricType mt) {
     // Explicitly test the code distance via batch matrix multiplication route
     // (even for dimension sizes that would otherwise be handled by the
@@ -784,6 +802,78 @@ TEST(TestGpuIndexIVFPQ, CopyTo_Cuvs) {
 }
 #endif
 
+TEST(TestGpuIndexIVFPQ, CudaGraphs) {
+    Options opt;
+    opt.indicesOpt = faiss::gpu::INDICES_64_BIT;
+
+    std::vector<float> trainVecs = faiss::gpu::randVecs(opt.numTrain, opt.dim);
+    std::vector<float> addVecs = faiss::gpu::randVecs(opt.numAdd, opt.dim);
+
+    faiss::IndexFlatL2 coarseQuantizer(opt.dim);
+    faiss::IndexIVFPQ cpuIndex(
+            &coarseQuantizer,
+            opt.dim,
+            opt.numCentroids,
+            opt.codes,
+            opt.bitsPerCode);
+    cpuIndex.train(opt.numTrain, trainVecs.data());
+    cpuIndex.add(opt.numAdd, addVecs.data());
+
+    // Use the default temporary memory management, from which the captured
+    // searches take their scratch space
+    faiss::gpu::StandardGpuResources res;
+
+    faiss::gpu::GpuIndexIVFPQConfig config;
+    config.device = opt.device;
+    config.usePrecomputedTables = opt.usePrecomputed;
+    config.useFloat16LookupTables = opt.useFloat16;
+    config.use_cuvs = false;
+
+    faiss::gpu::GpuIndexIVFPQ gpuIndex(&res, &cpuIndex, config);
+
+    config.useCudaGraphs = true;
+    faiss::gpu::GpuIndexIVFPQ graphIndex(&res, &cpuIndex, config);
+
+    auto compareSearches = [&](int nq, int nprobe) {
+        std::vector<float> queries = faiss::gpu::randVecs(nq, opt.dim);
+        std::vector<float> refDist(nq * opt.k), dist(nq * opt.k);
+        std::vector<faiss::idx_t> refIds(nq * opt.k), ids(nq * opt.k);
+
+        gpuIndex.nprobe = nprobe;
+        graphIndex.nprobe = nprobe;
+        gpuIndex.search(
+                nq, queries.data(), opt.k, refDist.data(), refIds.data());
+
+        // capture, then replays
+        for (int i = 0; i < 3; ++i) {
+            graphIndex.search(
+                    nq, queries.data(), opt.k, dist.data(), ids.data());
+
+            EXPECT_EQ(refIds, ids) << opt.toString();
+            EXPECT_EQ(refDist, dist) << opt.toString();
+        }
+    };
+
+    for (int nq : {1, 4, 16}) {
+        compareSearches(nq, opt.nprobe);
+    }
+    compareSearches(1, opt.nprobe * 2);
+
+    // Adding to the index must invalidate the captured searches
+    std::vector<float> moreVecs = faiss::gpu::randVecs(opt.numAdd, opt.dim);
+    gpuIndex.add(opt.numAdd, moreVecs.data());
+    graphIndex.add(opt.numAdd, moreVecs.data());
+
+    compareSearches(1, opt.nprobe);
+    compareSearches(4, opt.nprobe);
+
+    // Larger batches are searched as usual
+    compareSearches(config.cudaGraphMaxQueries + 1, opt.nprobe);
+
+    graphIndex.resetSearchGraphs();
+    compareSearches(1, opt.nprobe);
+}
+
 TEST(TestGpuIndexIVFPQ, UnifiedMemory) {
     // Construct on a random device to test multi-device, if we have
     // multiple devices
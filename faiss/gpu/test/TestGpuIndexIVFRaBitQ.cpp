@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFRaBitQ.h>
+#include <faiss/gpu/GpuCloner.h>
+#include <faiss/gpu/GpuIndexIVFRaBitQ.h>
+#include <faiss/gpu/StandardGpuResources.h>
+#include <faiss/gpu/test/TestUtils.h>
+#include <faiss/gpu/utils/DeviceUtils.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// The estimated distances are the same as on the CPU up to float rounding,
+// but a few near ties may be ordered differently
+constexpr float kF32MaxRelErr = 0.03f;
+
+struct Options {
+    Options() {
+        numAdd = 2 * faiss::gpu::randVal(2000, 5000);
+        dim = faiss::gpu::randVal(64, 200);
+
+        numCentroids = std::sqrt((float)numAdd / 2);
+        numTrain = numCentroids * 40;
+        nprobe = faiss::gpu::randVal(std::min(10, numCentroids), numCentroids);
+        numQuery = faiss::gpu::randVal(32, 100);
+        k = std::min(faiss::gpu::randVal(10, 30), numAdd / 40);
+        indicesOpt = faiss::gpu::randSelect(
+                {faiss::gpu::INDICES_CPU,
+                 faiss::gpu::INDICES_32_BIT,
+                 faiss::gpu::INDICES_64_BIT});
+
+        device = faiss::gpu::randVal(0, faiss::gpu::getNumDevices() - 1);
+    }
+
+    std::string toString() const {
+        std::stringstream str;
+        str << "IVFRaBitQ device " << device << " numVecs " << numAdd
+            << " dim " << dim << " numCentroids " << numCentroids
+            << " nprobe " << nprobe << " numQuery " << numQuery << " k " << k
+            << " indicesOpt " << indicesOpt;
+
+        return str.str();
+    }
+
+    int numAdd;
+    int dim;
+    int numCentroids;
+    int numTrain;
+    int nprobe;
+    int numQuery;
+    int k;
+    int device;
+    faiss::gpu::IndicesOptions indicesOpt;
+};
+
+void runCopyFromTest(faiss::MetricType metric, uint8_t qb) {
+    using namespace faiss;
+    using namespace faiss::gpu;
+
+    Options opt;
+    std::vector<float> trainVecs = randVecs(opt.numTrain, opt.dim);
+    std::vector<float> addVecs = randVecs(opt.numAdd, opt.dim);
+
+    IndexFlat cpuQuantizer(opt.dim, metric);
+    IndexIVFRaBitQ cpuIndex(&cpuQuantizer, opt.dim, opt.numCentroids, metric);
+    cpuIndex.nprobe = opt.nprobe;
+    cpuIndex.qb = qb;
+    cpuIndex.train(opt.numTrain, trainVecs.data());
+    cpuIndex.add(opt.numAdd, addVecs.data());
+
+    StandardGpuResources res;
+    res.noTempMemory();
+
+    auto config = GpuIndexIVFRaBitQConfig();
+    config.device = opt.device;
+    config.indicesOptions = opt.indicesOpt;
+
+    // use garbage values to see if we overwrite them
+    GpuIndexIVFRaBitQ gpuIndex(&res, 1, 1, METRIC_L2, config);
+    gpuIndex.nprobe = 1;
+
+    gpuIndex.copyFrom(&cpuIndex);
+
+    EXPECT_EQ(cpuIndex.ntotal, gpuIndex.ntotal);
+    EXPECT_EQ(cpuIndex.d, gpuIndex.d);
+    EXPECT_EQ(cpuIndex.nlist, gpuIndex.getNumLists());
+    EXPECT_EQ(cpuIndex.nprobe, gpuIndex.nprobe);
+    EXPECT_EQ(cpuIndex.qb, gpuIndex.qb);
+
+    compareIndices(
+            cpuIndex,
+            gpuIndex,
+            opt.numQuery,
+            opt.dim,
+            opt.k,
+            opt.toString(),
+            kF32MaxRelErr,
+            0.1f,
+            0.015f);
+}
+
+TEST(TestGpuIndexIVFRaBitQ, CopyFrom_L2) {
+    runCopyFromTest(faiss::METRIC_L2, 0);
+}
+
+TEST(TestGpuIndexIVFRaBitQ, CopyFrom_L2_qb8) {
+    runCopyFromTest(faiss::METRIC_L2, 8);
+}
+
+TEST(TestGpuIndexIVFRaBitQ, CopyFrom_IP) {
+    runCopyFromTest(faiss::METRIC_INNER_PRODUCT, 0);
+}
+
+TEST(TestGpuIndexIVFRaBitQ, CopyFrom_IP_qb4) {
+    runCopyFromTest(faiss::METRIC_INNER_PRODUCT, 4);
+}
+
+TEST(TestGpuIndexIVFRaBitQ, AddAndCopyTo) {
+    using namespace faiss;
+    using namespace faiss::gpu;
+
+    Options opt;
+    std::vector<float> trainVecs = randVecs(opt.numTrain, opt.dim);
+    std::vector<float> addVecs = randVecs(opt.numAdd, opt.dim);
+
+    StandardGpuResources res;
+    res.noTempMemory();
+
+    auto config = GpuIndexIVFRaBitQConfig();
+    config.device = opt.device;
+
+    // the codes are computed on the GPU
+    GpuIndexIVFRaBitQ gpuIndex(
+            &res, opt.dim, opt.numCentroids, METRIC_L2, config);
+    gpuIndex.train(opt.numTrain, trainVecs.data());
+    gpuIndex.add(opt.numAdd, addVecs.data());
+    gpuIndex.nprobe = opt.nprobe;
+
+    std::unique_ptr<Index> cpuIndex(index_gpu_to_cpu(&gpuIndex));
+    auto cpuIVF = dynamic_cast<IndexIVFRaBitQ*>(cpuIndex.get());
+    ASSERT_TRUE(cpuIVF);
+    EXPECT_EQ(cpuIVF->ntotal, opt.numAdd);
+
+    // codes added on the CPU to the same lists are searched the same way
+    IndexIVFRaBitQ cpuRef(cpuIVF->quantizer, opt.dim, opt.numCentroids);
+    cpuRef.nprobe = opt.nprobe;
+    cpuRef.add(opt.numAdd, addVecs.data());
+
+    compareIndices(
+            cpuRef,
+            gpuIndex,
+            opt.numQuery,
+            opt.dim,
+            opt.k,
+            opt.toString(),
+            kF32MaxRelErr,
+            0.1f,
+            0.015f);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // just run with a fixed test seed
+    faiss::gpu::setTestSeed(100);
+
+    return RUN_ALL_TESTS();
+}
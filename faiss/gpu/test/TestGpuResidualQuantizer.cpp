@@ -7,9 +7,11 @@
 
 #include <faiss/IndexFlat.h>
 #include <faiss/gpu/GpuCloner.h>
+#include <faiss/gpu/GpuIcmEncoder.h>
 #include <faiss/gpu/GpuIndexFlat.h>
 #include <faiss/gpu/StandardGpuResources.h>
 #include <faiss/gpu/test/TestUtils.h>
+#include <faiss/impl/LocalSearchQuantizer.h>
 #include <faiss/impl/ResidualQuantizer.h>
 #include <gtest/gtest.h>
 
@@ -60,6 +62,46 @@ TEST(TestGpuResidualQuantizer, TestNcall) {
     ASSERT_TRUE(err_rq1 < 1.1 * err_rq0);
 }
 
+TEST(TestGpuResidualQuantizer, TestSharedResources) {
+    int d = 32;
+    int nt = 3000;
+    int nb = 1000;
+    std::vector<float> xt = faiss::gpu::randVecs(nt, d);
+    std::vector<float> xb = faiss::gpu::randVecs(nb, d);
+
+    faiss::gpu::StandardGpuResources res;
+    std::vector<faiss::gpu::GpuResourcesProvider*> vres = {&res};
+    std::vector<int> devices = {0};
+
+    // RQ k-means and beam search on the shared resources
+    faiss::ResidualQuantizer rq(d, 4, 6);
+    faiss::gpu::GpuProgressiveDimIndexFactory fac(vres, devices);
+    rq.assign_index_factory = &fac;
+    rq.train(nt, xt.data());
+    ASSERT_GT(fac.ncall, 0);
+
+    // LSQ ICM encoding on the same resources, the factory is owned by lsq
+    faiss::LocalSearchQuantizer lsq(d, 4, 6);
+    lsq.train_iters = 4;
+    lsq.icm_encoder_factory =
+            new faiss::gpu::GpuIcmEncoderFactory(vres, devices);
+    lsq.train(nt, xt.data());
+
+    std::vector<uint8_t> codes(lsq.code_size * nb);
+    lsq.compute_codes(xb.data(), codes.data(), nb);
+    std::vector<float> decoded(nb * d);
+    lsq.decode(codes.data(), decoded.data(), nb);
+    float err_lsq = 0;
+    for (int i = 0; i < nb * d; i++) {
+        float diff = xb[i] - decoded[i];
+        err_lsq += diff * diff;
+    }
+    float err_rq = eval_codec(&rq, nb, xb.data());
+    std::cout << "Error RQ: " << err_rq << ", Error LSQ: " << err_lsq
+              << std::endl;
+    ASSERT_TRUE(err_lsq < 1.2 * err_rq);
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
 
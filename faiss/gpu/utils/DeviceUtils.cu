@@ -150,6 +150,35 @@ int getDeviceForAddress(const void* p) {
 #endif
 }
 
+bool isPinnedHostMemory(const void* p) {
+    if (!p) {
+        return false;
+    }
+
+    cudaPointerAttributes att;
+    cudaError_t err = cudaPointerGetAttributes(&att, p);
+    FAISS_ASSERT_FMT(
+            err == cudaSuccess || err == cudaErrorInvalidValue,
+            "unknown error %d",
+            (int)err);
+
+    if (err == cudaErrorInvalidValue) {
+        // Make sure the current thread error status has been reset
+        err = cudaGetLastError();
+        FAISS_ASSERT_FMT(
+                err == cudaErrorInvalidValue, "unknown error %d", (int)err);
+        return false;
+    }
+
+#if USE_AMD_ROCM
+    return att.type == hipMemoryTypeHost;
+#elif CUDA_VERSION < 10000
+    return att.memoryType == cudaMemoryTypeHost;
+#else
+    return att.type == cudaMemoryTypeHost;
+#endif
+}
+
 bool getFullUnifiedMemSupport(int device) {
     const auto& prop = getDeviceProperties(device);
     return (prop.major >= 6);
@@ -197,6 +226,13 @@ size_t getFreeMemoryCurrentDevice() {
     return free;
 }
 
+bool isStreamCapturing(cudaStream_t stream) {
+    cudaStreamCaptureStatus status = cudaStreamCaptureStatusNone;
+    CUDA_VERIFY(cudaStreamIsCapturing(stream, &status));
+
+    return status != cudaStreamCaptureStatusNone;
+}
+
 DeviceScope::DeviceScope(int device) {
     if (device >= 0) {
         int curDevice = getCurrentDevice();
@@ -63,6 +63,10 @@ size_t getMaxSharedMemPerBlockCurrentDevice();
 /// a device (deviceId >= 0) or the host (-1).
 int getDeviceForAddress(const void* p);
 
+/// Is the given pointer in page-locked host memory (cudaHostAlloc or
+/// cudaHostRegister)?
+bool isPinnedHostMemory(const void* p);
+
 /// Does the given device support full unified memory sharing host
 /// memory?
 bool getFullUnifiedMemSupport(int device);
@@ -88,6 +92,9 @@ size_t getFreeMemory(int device);
 /// Equivalent to getFreeMemory(getCurrentDevice())
 size_t getFreeMemoryCurrentDevice();
 
+/// Is the given stream capturing a CUDA graph?
+bool isStreamCapturing(cudaStream_t stream);
+
 /// RAII object to set the current device, and restore the previous
 /// device upon destruction
 class DeviceScope {
@@ -96,7 +96,12 @@ char* StackDeviceMemory::Stack::getAlloc(size_t size, cudaStream_t stream) {
         FAISS_ASSERT(
                 prevUser.start_ <= endAlloc && prevUser.end_ >= startAlloc);
 
-        if (stream != prevUser.stream_) {
+        // A stream capturing a CUDA graph cannot wait on a stream outside of
+        // the capture; GpuIndex only captures once the device is idle, and
+        // the graph replays are ordered on the stream
+        if (stream != prevUser.stream_ &&
+            !(isStreamCapturing(stream) &&
+              !isStreamCapturing(prevUser.stream_))) {
             // Synchronization required
             streamWait({stream}, {prevUser.stream_});
         }
@@ -9,10 +9,14 @@
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
+
+#include <omp.h>
 
 #include <faiss/impl/AuxIndexStructures.h>
 
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/utils.h>
 
 namespace faiss {
 
@@ -38,17 +42,54 @@ void RangeSearchResult::do_allocation() {
     // works only if all the partial results are aggregated
     // simulatenously
     FAISS_THROW_IF_NOT(labels == nullptr && distances == nullptr);
-    size_t ofs = 0;
-    for (int i = 0; i < nq; i++) {
-        size_t n = lims[i];
-        lims[i] = ofs;
-        ofs += n;
-    }
-    lims[nq] = ofs;
+    size_t ofs = counts_to_offsets();
     labels = new idx_t[ofs];
     distances = new float[ofs];
 }
 
+size_t RangeSearchResult::counts_to_offsets() {
+    if (nq < (1 << 16) || omp_get_max_threads() == 1 || omp_in_parallel()) {
+        size_t ofs = 0;
+        for (size_t i = 0; i < nq; i++) {
+            size_t n = lims[i];
+            lims[i] = ofs;
+            ofs += n;
+        }
+        lims[nq] = ofs;
+        return ofs;
+    }
+
+    // each thread sums a slice, then offsets its slice by the sums of the
+    // preceding slices
+    std::vector<size_t> slice_ofs(omp_get_max_threads() + 1);
+#pragma omp parallel
+    {
+        int rank = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        size_t i0 = nq * rank / nt, i1 = nq * (rank + 1) / nt;
+        size_t sum = 0;
+        for (size_t i = i0; i < i1; i++) {
+            sum += lims[i];
+        }
+        slice_ofs[rank + 1] = sum;
+#pragma omp barrier
+#pragma omp single
+        {
+            for (int r = 0; r < nt; r++) {
+                slice_ofs[r + 1] += slice_ofs[r];
+            }
+            lims[nq] = slice_ofs[nt];
+        }
+        size_t ofs = slice_ofs[rank];
+        for (size_t i = i0; i < i1; i++) {
+            size_t n = lims[i];
+            lims[i] = ofs;
+            ofs += n;
+        }
+    }
+    return lims[nq];
+}
+
 RangeSearchResult::~RangeSearchResult() {
     delete[] labels;
     delete[] distances;
@@ -108,6 +149,23 @@ void BufferList::copy_range(
     }
 }
 
+void BufferList::stream_range(
+        size_t ofs,
+        size_t n,
+        idx_t qno,
+        const RangeSearchResultCallback& callback) const {
+    size_t bno = ofs / buffer_size;
+    ofs -= bno * buffer_size;
+    while (n > 0) {
+        size_t ncopy = ofs + n < buffer_size ? n : buffer_size - ofs;
+        const Buffer& buf = buffers[bno];
+        callback(qno, ncopy, buf.ids + ofs, buf.dis + ofs);
+        ofs = 0;
+        bno++;
+        n -= ncopy;
+    }
+}
+
 /***********************************************************************
  * RangeSearchPartialResult
  ***********************************************************************/
@@ -132,7 +190,13 @@ void RangeSearchPartialResult::finalize() {
 #pragma omp barrier
 
 #pragma omp single
-    res->do_allocation();
+    {
+        if (res->result_callback) {
+            res->counts_to_offsets();
+        } else {
+            res->do_allocation();
+        }
+    }
 
 #pragma omp barrier
     copy_result();
@@ -152,11 +216,15 @@ void RangeSearchPartialResult::copy_result(bool incremental) {
     for (int i = 0; i < queries.size(); i++) {
         RangeQueryResult& qres = queries[i];
 
-        copy_range(
-                ofs,
-                qres.nres,
-                res->labels + res->lims[qres.qno],
-                res->distances + res->lims[qres.qno]);
+        if (res->result_callback) {
+            stream_range(ofs, qres.nres, qres.qno, res->result_callback);
+        } else {
+            copy_range(
+                    ofs,
+                    qres.nres,
+                    res->labels + res->lims[qres.qno],
+                    res->distances + res->lims[qres.qno]);
+        }
         if (incremental) {
             res->lims[qres.qno] += qres.nres;
         }
@@ -171,32 +239,65 @@ void RangeSearchPartialResult::merge(
     if (npres == 0)
         return;
     RangeSearchResult* result = partial_results[0]->res;
-    size_t nx = result->nq;
+
+    // The results of a query in a partial result form one segment. The
+    // segments of a query are stored in the order of the partial results.
+    struct Segment {
+        RangeSearchPartialResult* pres;
+        idx_t qno;
+        size_t src_ofs; // offset in the buffers of pres
+        size_t n;
+        size_t dest_ofs; // offset in the results of query qno
+    };
+    std::vector<Segment> segments;
 
     // count
-    for (const RangeSearchPartialResult* pres : partial_results) {
+    for (RangeSearchPartialResult* pres : partial_results) {
         if (!pres)
             continue;
+        size_t ofs = 0;
         for (const RangeQueryResult& qres : pres->queries) {
-            result->lims[qres.qno] += qres.nres;
+            if (qres.nres > 0) {
+                size_t dest_ofs = result->lims[qres.qno];
+                segments.push_back({pres, qres.qno, ofs, qres.nres, dest_ofs});
+                result->lims[qres.qno] += qres.nres;
+            }
+            ofs += qres.nres;
         }
     }
-    result->do_allocation();
-    for (int j = 0; j < npres; j++) {
-        if (!partial_results[j])
-            continue;
-        partial_results[j]->copy_result(true);
-        if (do_delete) {
-            delete partial_results[j];
-            partial_results[j] = nullptr;
+
+    size_t total;
+    if (result->result_callback) {
+        total = result->counts_to_offsets();
+    } else {
+        result->do_allocation();
+        total = result->lims[result->nq];
+    }
+
+    // scatter
+    int64_t nseg = segments.size();
+#pragma omp parallel for schedule(dynamic, 16) if (nseg > 1 && total > 65536)
+    for (int64_t i = 0; i < nseg; i++) {
+        Segment& seg = segments[i];
+        size_t dest_ofs = result->lims[seg.qno] + seg.dest_ofs;
+        if (result->result_callback) {
+            seg.pres->stream_range(
+                    seg.src_ofs, seg.n, seg.qno, result->result_callback);
+        } else {
+            seg.pres->copy_range(
+                    seg.src_ofs,
+                    seg.n,
+                    result->labels + dest_ofs,
+                    result->distances + dest_ofs);
         }
     }
 
-    // reset the limits
-    for (size_t i = nx; i > 0; i--) {
-        result->lims[i] = result->lims[i - 1];
+    if (do_delete) {
+        for (int j = 0; j < npres; j++) {
+            delete partial_results[j];
+            partial_results[j] = nullptr;
+        }
     }
-    result->lims[0] = 0;
 }
 
 /***********************************************************
@@ -261,4 +362,203 @@ void TimeoutCallback::reset(double timeout_in_seconds) {
     tc->set_timeout(timeout_in_seconds);
 }
 
+/***********************************************************************
+ * SearchBudget
+ ***********************************************************************/
+
+void SearchCost::add(const SearchCost& other) {
+    ndis += other.ndis;
+    bytes += other.bytes;
+    fetches += other.fetches;
+    truncated = truncated || other.truncated;
+}
+
+void SearchBudget::set_timeout(double timeout_ms) {
+    deadline = getmillisecs() + timeout_ms;
+}
+
+SearchBudget SearchBudget::query_budget(idx_t i) const {
+    SearchBudget qb = *this;
+    qb.costs = nullptr;
+    if (costs) {
+        qb.spent.add(costs[i]);
+    }
+    return qb;
+}
+
+bool SearchBudget::exhausted(const SearchCost& cost) const {
+    if (max_ndis && spent.ndis + cost.ndis >= max_ndis) {
+        return true;
+    }
+    if (max_bytes && spent.bytes + cost.bytes >= max_bytes) {
+        return true;
+    }
+    if (max_fetches && spent.fetches + cost.fetches >= max_fetches) {
+        return true;
+    }
+    return deadline > 0 && getmillisecs() >= deadline;
+}
+
+void SearchBudget::add_cost(idx_t i, const SearchCost& cost) const {
+    if (costs) {
+        costs[i].add(cost);
+    }
+}
+
+size_t SearchBudget::remaining(size_t limit, size_t used) {
+    if (limit == 0) {
+        return std::numeric_limits<size_t>::max();
+    }
+    return limit > used ? limit - used : 0;
+}
+
+/***********************************************************************
+ * VisitedTable
+ ***********************************************************************/
+
+VisitedTable::VisitedTable(
+        int size,
+        VisitedTableMode mode,
+        size_t nvisit_hint)
+        : mode(mode), size(size), visno(1) {
+    if (mode == VISITED_BYTES) {
+        visited.resize(size);
+    } else if (mode == VISITED_BITSET) {
+        bits.resize((size_t(size) + 63) / 64);
+    } else {
+        size_t capacity = 1024;
+        while (capacity < 2 * nvisit_hint) {
+            capacity *= 2;
+        }
+        hash_keys.resize(capacity, -1);
+    }
+}
+
+void VisitedTable::advance() {
+    if (mode == VISITED_BYTES) {
+        visno++;
+        if (visno == 250) {
+            // 250 rather than 255 because sometimes we use visno and visno+1
+            memset(visited.data(), 0, sizeof(visited[0]) * visited.size());
+            visno = 1;
+        }
+    } else if (mode == VISITED_BITSET) {
+        if (touched_words.size() * 16 > bits.size()) {
+            memset(bits.data(), 0, sizeof(bits[0]) * bits.size());
+        } else {
+            for (size_t w : touched_words) {
+                bits[w] = 0;
+            }
+        }
+        touched_words.clear();
+    } else if (hash_count > 0) {
+        std::fill(hash_keys.begin(), hash_keys.end(), -1);
+        hash_count = 0;
+    }
+}
+
+void VisitedTable::resize(int new_size) {
+    size = new_size;
+    if (mode == VISITED_BYTES) {
+        visited.resize(new_size);
+    } else if (mode == VISITED_BITSET) {
+        bits.resize((size_t(new_size) + 63) / 64);
+    }
+}
+
+size_t VisitedTable::nbytes() const {
+    return visited.size() + bits.size() * sizeof(bits[0]) +
+            touched_words.capacity() * sizeof(touched_words[0]) +
+            hash_keys.size() * sizeof(hash_keys[0]);
+}
+
+VisitedTableMode VisitedTable::auto_mode(size_t size, size_t nvisit) {
+    // up to 16 MB, the byte table is the fastest
+    if (size <= (size_t(1) << 24)) {
+        return VISITED_BYTES;
+    }
+    // the hash set is at most half full, with 4-byte keys
+    if (nvisit * 2 * sizeof(int) < size / 8) {
+        return VISITED_HASH;
+    }
+    return VISITED_BITSET;
+}
+
+void VisitedTable::hash_insert(int no) {
+    if ((hash_count + 1) * 2 > hash_keys.size()) {
+        std::vector<int> old_keys(hash_keys.size() * 2, -1);
+        old_keys.swap(hash_keys);
+        size_t mask = hash_keys.size() - 1;
+        for (int key : old_keys) {
+            if (key != -1) {
+                size_t i = hash_slot(key, mask);
+                while (hash_keys[i] != -1) {
+                    i = (i + 1) & mask;
+                }
+                hash_keys[i] = key;
+            }
+        }
+    }
+    size_t mask = hash_keys.size() - 1;
+    size_t i = hash_slot(no, mask);
+    while (hash_keys[i] != -1) {
+        if (hash_keys[i] == no) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    hash_keys[i] = no;
+    hash_count++;
+}
+
+/***********************************************************************
+ * ThreadVisitedTable
+ ***********************************************************************/
+
+namespace {
+
+std::vector<std::unique_ptr<VisitedTable>>& visited_table_pool() {
+    thread_local std::vector<std::unique_ptr<VisitedTable>> pool;
+    return pool;
+}
+
+} // namespace
+
+size_t ThreadVisitedTable::max_pooled_size = size_t(1) << 30;
+
+ThreadVisitedTable::ThreadVisitedTable(
+        size_t ntotal,
+        VisitedTableMode mode,
+        size_t nvisit_hint) {
+    auto& pool = visited_table_pool();
+    // the most recently returned table of this mode
+    for (size_t i = pool.size(); i-- > 0;) {
+        if (pool[i]->mode == mode) {
+            vt = std::move(pool[i]);
+            pool.erase(pool.begin() + i);
+            break;
+        }
+    }
+    if (!vt) {
+        vt = std::make_unique<VisitedTable>(ntotal, mode, nvisit_hint);
+        return;
+    }
+    // some searches also mark entries with visno + 1
+    vt->advance();
+    vt->advance();
+    if ((size_t)vt->size < ntotal) {
+        vt->resize(ntotal);
+    }
+}
+
+ThreadVisitedTable::~ThreadVisitedTable() {
+    if (vt && vt->nbytes() <= max_pooled_size) {
+        visited_table_pool().push_back(std::move(vt));
+    }
+}
+
+void ThreadVisitedTable::clear_pool() {
+    visited_table_pool().clear();
+}
+
 } // namespace faiss
@@ -14,6 +14,7 @@
 #include <stdint.h>
 
 #include <cstring>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -23,6 +24,13 @@
 
 namespace faiss {
 
+/// receives a contiguous chunk of the results of query qno
+using RangeSearchResultCallback = std::function<void(
+        idx_t qno,
+        size_t n,
+        const idx_t* labels,
+        const float* distances)>;
+
 /** The objective is to have a simple result structure while
  *  minimizing the number of mem copies in the result. The method
  *  do_allocation can be overloaded to allocate the result tables in
@@ -36,6 +44,13 @@ struct RangeSearchResult {
 
     size_t buffer_size; ///< size of the result buffers used
 
+    /** If set, the results assembled from RangeSearchPartialResult's are
+     * streamed to this function instead of being copied to labels and
+     * distances, which stay nullptr. lims is filled in as usual. The
+     * results of a query may come in several chunks, and the function may
+     * be called concurrently from several threads. */
+    RangeSearchResultCallback result_callback;
+
     /// lims must be allocated on input to range_search.
     explicit RangeSearchResult(size_t nq, bool alloc_lims = true);
 
@@ -43,6 +58,10 @@ struct RangeSearchResult {
     /// for each query
     virtual void do_allocation();
 
+    /// replace the nb of results per query in lims with the offsets of the
+    /// results (parallel prefix sum for large nq), returns the total
+    size_t counts_to_offsets();
+
     virtual ~RangeSearchResult();
 };
 
@@ -83,6 +102,13 @@ struct BufferList {
     /// copy elemnts ofs:ofs+n-1 seen as linear data in the buffers to
     /// tables dest_ids, dest_dis
     void copy_range(size_t ofs, size_t n, idx_t* dest_ids, float* dest_dis);
+
+    /// pass elements ofs:ofs+n-1 to the callback as contiguous chunks
+    void stream_range(
+            size_t ofs,
+            size_t n,
+            idx_t qno,
+            const RangeSearchResultCallback& callback) const;
 };
 
 struct RangeSearchPartialResult;
@@ -121,8 +147,11 @@ struct RangeSearchPartialResult : BufferList {
     /// called by range_search after do_allocation
     void copy_result(bool incremental = false);
 
-    /// merge a set of PartialResult's into one RangeSearchResult
-    /// on output the partialresults are empty!
+    /** merge a set of PartialResult's into one RangeSearchResult
+     * on output the partialresults are empty! Several PartialResult's
+     * can contain results of the same query. The per-query counts are
+     * prefix-summed and the results are copied (or streamed) in parallel,
+     * so this should be called from outside of a parallel section. */
     static void merge(
             std::vector<RangeSearchPartialResult*>& partial_results,
             bool do_delete = true);
@@ -169,32 +198,182 @@ struct TimeoutCallback : InterruptCallback {
     static void reset(double timeout_in_seconds);
 };
 
+/***********************************************************
+ * Per-query search budget
+ ***********************************************************/
+
+/// work done by the search of a query
+struct SearchCost {
+    size_t ndis = 0;    ///< distances (or codes) computed
+    size_t bytes = 0;   ///< bytes of codes / neighbor lists read
+    size_t fetches = 0; ///< inverted lists probed, embeddings fetched
+    /// the search stopped because the budget was exhausted
+    bool truncated = false;
+
+    void add(const SearchCost& other);
+};
+
+/** Limits on the work of the search of each query, set in
+ * SearchParameters::budget. Unlike the InterruptCallback, that aborts the
+ * whole search, the search of a query that exhausts its budget stops and
+ * returns the best results found so far. The limits are checked between
+ * units of work (an inverted list, a round of HNSW expansions), so they
+ * can be exceeded by one unit. A limit of 0 is unlimited.
+ */
+struct SearchBudget {
+    size_t max_ndis = 0;
+    size_t max_bytes = 0;
+    size_t max_fetches = 0;
+    /// absolute time in getmillisecs(), 0 = no deadline
+    double deadline = 0;
+
+    /** if non-null, size n: the search adds the cost of query i to
+     * costs[i]. The limits apply to the accumulated costs, so that the
+     * stages of a search (eg. the base search and the refinement of
+     * IndexRefine) share a budget. Not owned. */
+    SearchCost* costs = nullptr;
+
+    /// cost already spent by the query, counted by exhausted(). Set by
+    /// query_budget
+    SearchCost spent;
+
+    /// set the deadline to timeout_ms milliseconds from now
+    void set_timeout(double timeout_ms);
+
+    /// budget of query i: spent = costs[i], without costs
+    SearchBudget query_budget(idx_t i) const;
+
+    /// spent + cost reaches one of the limits, or the deadline passed
+    bool exhausted(const SearchCost& cost) const;
+
+    /// add the cost of query i to costs[i], if set
+    void add_cost(idx_t i, const SearchCost& cost) const;
+
+    /// what remains of limit after used, max size_t if unlimited
+    static size_t remaining(size_t limit, size_t used);
+};
+
+enum VisitedTableMode {
+    /// one byte per node, cleared by incrementing an epoch counter
+    VISITED_BYTES,
+    /// one bit per node, the words that were set are cleared
+    VISITED_BITSET,
+    /// open-addressing hash set of the visited nodes, for the searches
+    /// that visit few nodes of a huge graph
+    VISITED_HASH,
+};
+
 /// set implementation optimized for fast access.
 struct VisitedTable {
+    VisitedTableMode mode;
+    int size; ///< nb of nodes
+
+    // VISITED_BYTES
     std::vector<uint8_t> visited;
     uint8_t visno;
 
-    explicit VisitedTable(int size) : visited(size), visno(1) {}
+    // VISITED_BITSET
+    std::vector<uint64_t> bits;
+    std::vector<size_t> touched_words;
+
+    // VISITED_HASH: -1 marks an empty slot
+    std::vector<int> hash_keys;
+    size_t hash_count = 0;
+
+    /** @param nvisit_hint  expected nb of visited nodes per search, the
+     *                      initial capacity of the hash set */
+    explicit VisitedTable(
+            int size,
+            VisitedTableMode mode = VISITED_BYTES,
+            size_t nvisit_hint = 0);
 
     /// set flag #no to true
     void set(int no) {
-        visited[no] = visno;
+        if (mode == VISITED_BYTES) {
+            visited[no] = visno;
+        } else if (mode == VISITED_BITSET) {
+            uint64_t& w = bits[no >> 6];
+            if (w == 0) {
+                touched_words.push_back(no >> 6);
+            }
+            w |= uint64_t(1) << (no & 63);
+        } else {
+            hash_insert(no);
+        }
     }
 
     /// get flag #no
     bool get(int no) const {
-        return visited[no] == visno;
+        if (mode == VISITED_BYTES) {
+            return visited[no] == visno;
+        } else if (mode == VISITED_BITSET) {
+            return (bits[no >> 6] >> (no & 63)) & 1;
+        } else {
+            return hash_contains(no);
+        }
     }
 
     /// reset all flags to false
-    void advance() {
-        visno++;
-        if (visno == 250) {
-            // 250 rather than 255 because sometimes we use visno and visno+1
-            memset(visited.data(), 0, sizeof(visited[0]) * visited.size());
-            visno = 1;
+    void advance();
+
+    /// make room for size nodes (keeps the flags)
+    void resize(int new_size);
+
+    /// memory used by the table, in bytes
+    size_t nbytes() const;
+
+    /** the mode with the smallest footprint for a graph of size nodes,
+     * when a search visits about nvisit of them: bytes for small graphs,
+     * otherwise a hash set if it is smaller than the bitset. */
+    static VisitedTableMode auto_mode(size_t size, size_t nvisit);
+
+   private:
+    static size_t hash_slot(int no, size_t mask) {
+        uint32_t h = uint32_t(no) * 0x9E3779B1U;
+        return (h ^ (h >> 16)) & mask;
+    }
+
+    bool hash_contains(int no) const {
+        size_t mask = hash_keys.size() - 1;
+        for (size_t i = hash_slot(no, mask);; i = (i + 1) & mask) {
+            if (hash_keys[i] == no) {
+                return true;
+            }
+            if (hash_keys[i] == -1) {
+                return false;
+            }
         }
     }
+
+    void hash_insert(int no);
+};
+
+/** A VisitedTable borrowed from a pool owned by the calling thread, and
+ * returned to it by the destructor. The searches that run many times on
+ * the same index avoid allocating and clearing an ntotal-sized table for
+ * each call: a reused table is cleared with advance(), which only touches
+ * the memory once every 125 reuses. Nested uses on the same thread get
+ * different tables. */
+struct ThreadVisitedTable {
+    std::unique_ptr<VisitedTable> vt;
+
+    /// a table of at least ntotal entries, with all flags false
+    explicit ThreadVisitedTable(
+            size_t ntotal,
+            VisitedTableMode mode = VISITED_BYTES,
+            size_t nvisit_hint = 0);
+
+    VisitedTable& operator*() {
+        return *vt;
+    }
+
+    ~ThreadVisitedTable();
+
+    /// the tables larger than this (in bytes) are not kept in the pool
+    static size_t max_pooled_size;
+
+    /// free the tables in the pool of the calling thread
+    static void clear_pool();
 };
 
 } // namespace faiss
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/BatchedFileReader.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/metrics.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+        defined(__NR_io_uring_register)
+#define FAISS_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+namespace faiss {
+
+BatchedFileReader::BatchedFileReader(unsigned queue_depth) {
+    if (queue_depth > 0) {
+        setup_uring(queue_depth);
+    }
+}
+
+BatchedFileReader::~BatchedFileReader() {
+    teardown_uring();
+    free(staging);
+}
+
+BatchedFileReader& BatchedFileReader::thread_local_reader() {
+    thread_local BatchedFileReader reader;
+    return reader;
+}
+
+size_t BatchedFileReader::get_block_size(int fd) {
+    auto it = block_sizes.find(fd);
+    if (it != block_sizes.end()) {
+        return it->second;
+    }
+    struct stat stat_buf;
+    FAISS_THROW_IF_NOT_FMT(
+            fstat(fd, &stat_buf) == 0,
+            "fstat failed on fd %d: %s",
+            fd,
+            strerror(errno));
+    size_t block_size = stat_buf.st_blksize > 0 ? stat_buf.st_blksize : 4096;
+    block_sizes[fd] = block_size;
+    return block_size;
+}
+
+void BatchedFileReader::reserve_staging(size_t size, size_t alignment) {
+    if (size <= staging_size && alignment <= staging_alignment) {
+        return;
+    }
+    size = std::max(size, 2 * staging_size);
+    alignment = std::max(alignment, staging_alignment);
+#ifdef FAISS_HAVE_IO_URING
+    if (buffers_registered) {
+        syscall(__NR_io_uring_register,
+                ring_fd,
+                IORING_UNREGISTER_BUFFERS,
+                nullptr,
+                0);
+        buffers_registered = false;
+    }
+#endif
+    free(staging);
+    staging = nullptr;
+    staging_size = 0;
+    FAISS_THROW_IF_NOT_MSG(
+            posix_memalign(&staging, alignment, size) == 0,
+            "could not allocate aligned staging buffer");
+    staging_size = size;
+    staging_alignment = alignment;
+#ifdef FAISS_HAVE_IO_URING
+    if (ring_fd >= 0) {
+        // fixed buffers save the page pinning on every read, but they count
+        // against RLIMIT_MEMLOCK: plain reads are used if this fails
+        struct iovec iov = {staging, staging_size};
+        buffers_registered =
+                syscall(__NR_io_uring_register,
+                        ring_fd,
+                        IORING_REGISTER_BUFFERS,
+                        &iov,
+                        1) == 0;
+    }
+#endif
+}
+
+void BatchedFileReader::finish_span_pread(
+        int fd,
+        const Span& span,
+        size_t done) {
+    char* buf = (char*)staging + span.buf_offset;
+    while (done < span.needed) {
+        ssize_t ret =
+                pread(fd, buf + done, span.size - done, span.start + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT_FMT(
+                ret > 0,
+                "read failed on fd %d at offset %ld: %s",
+                fd,
+                (long)(span.start + done),
+                ret == 0 ? "unexpected end of file" : strerror(errno));
+        done += ret;
+    }
+}
+
+void BatchedFileReader::read(int fd, const std::vector<Request>& requests) {
+    if (requests.empty()) {
+        return;
+    }
+    size_t block_size = get_block_size(fd);
+
+    // group the requests into block-aligned spans, requests that share a
+    // block are served by the same span
+    std::vector<size_t> order(requests.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return requests[a].offset < requests[b].offset;
+    });
+    std::vector<Span> spans;
+    std::vector<size_t> span_of(requests.size());
+    size_t total_size = 0;
+    for (size_t i : order) {
+        const Request& req = requests[i];
+        FAISS_THROW_IF_NOT(req.offset >= 0);
+        off_t start = req.offset / block_size * block_size;
+        off_t end = (req.offset + req.size + block_size - 1) / block_size *
+                block_size;
+        if (!spans.empty() &&
+            start <= spans.back().start + (off_t)spans.back().size) {
+            Span& span = spans.back();
+            off_t span_end = std::max(span.start + (off_t)span.size, end);
+            total_size += span_end - span.start - span.size;
+            span.size = span_end - span.start;
+        } else {
+            spans.push_back({start, (size_t)(end - start), 0, total_size});
+            total_size += end - start;
+        }
+        Span& span = spans.back();
+        span.needed =
+                std::max(span.needed, req.offset + req.size - span.start);
+        span_of[i] = spans.size() - 1;
+    }
+    reserve_staging(total_size, block_size);
+    metrics_add(METRIC_BYTES_READ, total_size);
+
+    // a single span costs one syscall either way, pread avoids the ring
+    // round-trip
+    if (ring_fd >= 0 && spans.size() > 1) {
+        read_spans_uring(fd, spans);
+    } else {
+        for (const Span& span : spans) {
+            finish_span_pread(fd, span, 0);
+        }
+    }
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        const Request& req = requests[i];
+        const Span& span = spans[span_of[i]];
+        memcpy(req.dest,
+               (char*)staging + span.buf_offset + (req.offset - span.start),
+               req.size);
+    }
+}
+
+#ifdef FAISS_HAVE_IO_URING
+
+void BatchedFileReader::setup_uring(unsigned queue_depth) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, queue_depth, &p);
+    if (fd < 0) {
+        return; // not supported or not allowed: use pread
+    }
+    ring_fd = fd;
+    sq_entries = p.sq_entries;
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    sq_ring = mmap(nullptr,
+                   sq_ring_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   ring_fd,
+                   IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        teardown_uring();
+        return;
+    }
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr,
+                       cq_ring_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       ring_fd,
+                       IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = nullptr;
+            teardown_uring();
+            return;
+        }
+    }
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(nullptr,
+                sqes_size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                ring_fd,
+                IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = nullptr;
+        teardown_uring();
+        return;
+    }
+
+    char* sq = (char*)sq_ring;
+    sq_head = (unsigned*)(sq + p.sq_off.head);
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    char* cq = (char*)cq_ring;
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = cq + p.cq_off.cqes;
+}
+
+void BatchedFileReader::teardown_uring() {
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    sqes = sq_ring = cq_ring = nullptr;
+    if (ring_fd >= 0) {
+        close(ring_fd); // also drops the registered buffers
+    }
+    ring_fd = -1;
+    buffers_registered = false;
+}
+
+void BatchedFileReader::read_spans_uring(
+        int fd,
+        const std::vector<Span>& spans) {
+    std::vector<struct iovec> iovecs(spans.size());
+    auto* sqe_array = (struct io_uring_sqe*)sqes;
+    auto* cqe_array = (struct io_uring_cqe*)cqes;
+    // bytes read per span, -1 = not completed by the ring
+    std::vector<ssize_t> done(spans.size(), -1);
+    int first_error = 0;
+    off_t error_offset = 0;
+
+    for (size_t i0 = 0; i0 < spans.size() && ring_fd >= 0; i0 += sq_entries) {
+        size_t i1 = std::min(spans.size(), i0 + sq_entries);
+        unsigned n = i1 - i0;
+
+        unsigned tail = *sq_tail;
+        unsigned mask = *sq_mask;
+        for (size_t i = i0; i < i1; i++, tail++) {
+            const Span& span = spans[i];
+            unsigned index = tail & mask;
+            struct io_uring_sqe* sqe = &sqe_array[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->fd = fd;
+            sqe->off = span.start;
+            sqe->user_data = i;
+            void* buf = (char*)staging + span.buf_offset;
+            if (buffers_registered) {
+                sqe->opcode = IORING_OP_READ_FIXED;
+                sqe->addr = (unsigned long)buf;
+                sqe->len = span.size;
+                sqe->buf_index = 0;
+            } else {
+                iovecs[i] = {buf, span.size};
+                sqe->opcode = IORING_OP_READV;
+                sqe->addr = (unsigned long)&iovecs[i];
+                sqe->len = 1;
+            }
+            sq_array[index] = index;
+        }
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+        unsigned to_submit = n;
+        unsigned n_done = 0;
+        while (n_done < n) {
+            int ret = syscall(
+                    __NR_io_uring_enter,
+                    ring_fd,
+                    to_submit,
+                    1,
+                    IORING_ENTER_GETEVENTS,
+                    nullptr,
+                    0);
+            if (ret >= 0) {
+                to_submit -= std::min((unsigned)ret, to_submit);
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                if (n - to_submit == n_done) {
+                    // nothing in flight: give up on the ring, the
+                    // remaining spans are read with pread below
+                    teardown_uring();
+                    break;
+                }
+                // wait for the submitted reads before doing anything else
+                to_submit = 0;
+            }
+
+            unsigned head = *cq_head;
+            unsigned ctail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != ctail; head++) {
+                const struct io_uring_cqe& cqe = cqe_array[head & *cq_mask];
+                size_t i = cqe.user_data;
+                if (cqe.res >= 0) {
+                    done[i] = cqe.res;
+                } else if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                    done[i] = 0;
+                } else if (first_error == 0) {
+                    first_error = -cqe.res;
+                    error_offset = spans[i].start;
+                }
+                n_done++;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    // nothing is in flight anymore, it is safe to throw
+    FAISS_THROW_IF_NOT_FMT(
+            first_error == 0,
+            "io_uring read failed on fd %d at offset %ld: %s",
+            fd,
+            (long)error_offset,
+            strerror(first_error));
+    // short reads, retryable errors and spans left over if the ring failed
+    // are completed synchronously
+    for (size_t i = 0; i < spans.size(); i++) {
+        size_t n_read = done[i] > 0 ? done[i] : 0;
+        if (n_read < spans[i].needed) {
+            finish_span_pread(fd, spans[i], n_read);
+        }
+    }
+}
+
+#else
+
+void BatchedFileReader::setup_uring(unsigned) {}
+
+void BatchedFileReader::teardown_uring() {}
+
+void BatchedFileReader::read_spans_uring(
+        int fd,
+        const std::vector<Span>& spans) {
+    for (const Span& span : spans) {
+        finish_span_pread(fd, span, 0);
+    }
+}
+
+#endif
+
+} // namespace faiss
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <sys/types.h> // For off_t
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace faiss {
+
+/** Reads a batch of unrelated byte ranges of a file at once.
+ *
+ * The ranges are widened to the block size of the file (so that the file
+ * may be opened with O_DIRECT) and read into an aligned staging buffer that
+ * is reused across calls, then the requested bytes are copied out.
+ *
+ * On Linux, the reads of a batch are submitted together through io_uring,
+ * so that the device sees them concurrently. If io_uring is not available
+ * (old kernel, seccomp filter...) the reader falls back to one pread per
+ * range, merging ranges that share a block.
+ *
+ * A reader is not thread-safe: use one per thread (see thread_local_reader).
+ * Different readers can safely read the same fd concurrently.
+ */
+struct BatchedFileReader {
+    struct Request {
+        off_t offset;
+        size_t size;
+        void* dest; ///< any alignment
+    };
+
+    /// max nb of reads in flight in the io_uring queue, 0 = use pread
+    explicit BatchedFileReader(unsigned queue_depth = 64);
+    ~BatchedFileReader();
+
+    /// read all requests from fd, throws on error or short read
+    void read(int fd, const std::vector<Request>& requests);
+
+    /// whether reads go through io_uring
+    bool uses_io_uring() const {
+        return ring_fd >= 0;
+    }
+
+    /// reader of the calling thread
+    static BatchedFileReader& thread_local_reader();
+
+    BatchedFileReader(const BatchedFileReader&) = delete;
+    BatchedFileReader& operator=(const BatchedFileReader&) = delete;
+
+   private:
+    struct Span {
+        off_t start;       ///< aligned file offset
+        size_t size;       ///< aligned size
+        size_t needed;     ///< bytes that must be read (may stop at EOF)
+        size_t buf_offset; ///< offset in the staging buffer
+    };
+
+    size_t get_block_size(int fd);
+    void reserve_staging(size_t size, size_t alignment);
+    void finish_span_pread(int fd, const Span& span, size_t done);
+    void read_spans_uring(int fd, const std::vector<Span>& spans);
+    void setup_uring(unsigned queue_depth);
+    void teardown_uring();
+
+    /// block size per fd, fstat is only called once
+    std::unordered_map<int, size_t> block_sizes;
+
+    void* staging = nullptr;
+    size_t staging_size = 0;
+    size_t staging_alignment = 0;
+    /// staging is registered with the ring (fixed-buffer reads)
+    bool buffers_registered = false;
+
+    // io_uring state, ring_fd == -1 when not in use
+    int ring_fd = -1;
+    unsigned sq_entries = 0;
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    void* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    void* cqes = nullptr;
+};
+
+} // namespace faiss
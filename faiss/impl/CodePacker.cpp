@@ -14,7 +14,8 @@ namespace faiss {
 
 /*********************************************
  * CodePacker
- * default of pack_all / unpack_all loops over the _1 versions
+ * default of pack_all / unpack_all / pack_range / unpack_range loops over
+ * the _1 versions
  */
 
 void CodePacker::pack_all(const uint8_t* flat_codes, uint8_t* block) const {
@@ -29,6 +30,31 @@ void CodePacker::unpack_all(const uint8_t* block, uint8_t* flat_codes) const {
     }
 }
 
+void CodePacker::pack_range(
+        const uint8_t* flat_codes,
+        size_t i0,
+        size_t i1,
+        uint8_t* blocks) const {
+    for (size_t i = i0; i < i1; i++) {
+        pack_1(flat_codes + code_size * (i - i0),
+               i % nvec,
+               blocks + (i / nvec) * block_size);
+    }
+}
+
+void CodePacker::unpack_range(
+        const uint8_t* blocks,
+        size_t i0,
+        size_t i1,
+        uint8_t* flat_codes) const {
+    for (size_t i = i0; i < i1; i++) {
+        unpack_1(
+                blocks + (i / nvec) * block_size,
+                i % nvec,
+                flat_codes + code_size * (i - i0));
+    }
+}
+
 /*********************************************
  * CodePackerFlat
  */
@@ -48,6 +74,22 @@ void CodePackerFlat::unpack_all(const uint8_t* block, uint8_t* flat_codes)
     memcpy(flat_codes, block, code_size);
 }
 
+void CodePackerFlat::pack_range(
+        const uint8_t* flat_codes,
+        size_t i0,
+        size_t i1,
+        uint8_t* blocks) const {
+    memcpy(blocks + i0 * code_size, flat_codes, (i1 - i0) * code_size);
+}
+
+void CodePackerFlat::unpack_range(
+        const uint8_t* blocks,
+        size_t i0,
+        size_t i1,
+        uint8_t* flat_codes) const {
+    memcpy(flat_codes, blocks + i0 * code_size, (i1 - i0) * code_size);
+}
+
 void CodePackerFlat::pack_1(
         const uint8_t* flat_code,
         size_t offset,
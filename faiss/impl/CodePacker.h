@@ -52,6 +52,24 @@ struct CodePacker {
                                 // * code_size)
     ) const;
 
+    // pack the codes of vectors i0..i1 into a sequence of blocks, the
+    // entries of the range must be zero in the blocks
+    virtual void pack_range(
+            const uint8_t* flat_codes, // codes to write, size
+                                       // ((i1 - i0) * code_size)
+            size_t i0,
+            size_t i1,
+            uint8_t* blocks // first block of the sequence
+    ) const;
+
+    // unpack the codes of vectors i0..i1 from a sequence of blocks
+    virtual void unpack_range(
+            const uint8_t* blocks, // first block of the sequence
+            size_t i0,
+            size_t i1,
+            uint8_t* flat_codes // output, size ((i1 - i0) * code_size)
+    ) const;
+
     virtual ~CodePacker() {}
 };
 
@@ -66,6 +84,17 @@ struct CodePackerFlat : CodePacker {
 
     void pack_all(const uint8_t* flat_codes, uint8_t* block) const final;
     void unpack_all(const uint8_t* block, uint8_t* flat_codes) const final;
+
+    void pack_range(
+            const uint8_t* flat_codes,
+            size_t i0,
+            size_t i1,
+            uint8_t* blocks) const final;
+    void unpack_range(
+            const uint8_t* blocks,
+            size_t i0,
+            size_t i1,
+            uint8_t* flat_codes) const final;
 };
 
 } // namespace faiss
@@ -84,6 +84,11 @@ struct DistanceComputer {
     /// compute distance between two stored vectors
     virtual float symmetric_dis(idx_t i, idx_t j) = 0;
 
+    /// hint that the n stored vectors of ids (-1 entries are ignored) are
+    /// about to be accessed, eg. by symmetric_dis. Implementations that
+    /// fetch the vectors remotely read them in one batch. Default: nop
+    virtual void prefetch_vectors(const idx_t* ids, size_t n) {}
+
     /// Get statistics specific to this DistanceComputer instance (e.g., fetch
     /// count).
     virtual size_t get_fetch_count() const {
@@ -112,6 +117,10 @@ struct NegativeDistanceComputer : DistanceComputer {
         basedis->set_query(x);
     }
 
+    const float* get_query() override {
+        return basedis->get_query();
+    }
+
     /// compute distance of vector i to current query
     float operator()(idx_t i) override {
         return -(*basedis)(i);
@@ -137,20 +146,24 @@ struct NegativeDistanceComputer : DistanceComputer {
     /// compute distances of current query to a batch of stored vectors.
     /// DistanceComputer implementations that can fetch data in batches
     /// will benefit significantly from this.
-    // void distances_batch(
-    //         const std::vector<idx_t>& ids,
-    //         std::vector<float>& distances_out) override {
-    //     basedis->distances_batch(ids, distances_out);
-    //     for (float& dis : distances_out) {
-    //         dis = -dis;
-    //     }
-    // }
+    void distances_batch(
+            const std::vector<idx_t>& ids,
+            std::vector<float>& distances_out) override {
+        basedis->distances_batch(ids, distances_out);
+        for (float& dis : distances_out) {
+            dis = -dis;
+        }
+    }
 
     /// compute distance between two stored vectors
     float symmetric_dis(idx_t i, idx_t j) override {
         return -basedis->symmetric_dis(i, j);
     }
 
+    void prefetch_vectors(const idx_t* ids, size_t n) override {
+        basedis->prefetch_vectors(ids, n);
+    }
+
     virtual ~NegativeDistanceComputer() {
         delete basedis;
     }
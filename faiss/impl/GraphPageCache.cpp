@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/GraphPageCache.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/metrics.h>
+
+namespace faiss {
+
+GraphPageCache::GraphPageCache(
+        int fd,
+        size_t capacity_bytes,
+        size_t page_size,
+        size_t n_shards)
+        : page_size(page_size), fd(fd) {
+    FAISS_THROW_IF_NOT_MSG(fd >= 0, "invalid file descriptor");
+    FAISS_THROW_IF_NOT(page_size > 0 && n_shards > 0);
+    struct stat stat_buf;
+    FAISS_THROW_IF_NOT_FMT(
+            fstat(fd, &stat_buf) == 0,
+            "fstat failed on fd %d: %s",
+            fd,
+            strerror(errno));
+    file_size = stat_buf.st_size;
+
+    capacity = capacity_bytes / page_size;
+    n_shards = std::max(std::min(n_shards, capacity), (size_t)1);
+    for (size_t i = 0; i < n_shards; i++) {
+        // the first shards get the remainder
+        size_t nframes = capacity / n_shards + (i < capacity % n_shards);
+        auto shard = std::make_unique<Shard>();
+        shard->frame_pages.resize(nframes, -1);
+        shard->referenced.resize(nframes, 0);
+        shard->data.resize(nframes * page_size);
+        shards.push_back(std::move(shard));
+    }
+}
+
+GraphPageCache::Shard& GraphPageCache::shard_of(int64_t page) const {
+    // consecutive pages go to different shards
+    uint64_t h = (uint64_t)page * 0x9E3779B97F4A7C15ULL;
+    return *shards[(h >> 32) % shards.size()];
+}
+
+size_t GraphPageCache::page_bytes(int64_t page) const {
+    off_t start = (off_t)page * page_size;
+    FAISS_THROW_IF_NOT_FMT(
+            page >= 0 && start < file_size,
+            "page %ld is beyond the end of the file (%ld bytes)",
+            (long)page,
+            (long)file_size);
+    return std::min(page_size, (size_t)(file_size - start));
+}
+
+bool GraphPageCache::lookup(int64_t page, char* dest) {
+    auto it = pinned_slots.find(page);
+    if (it != pinned_slots.end()) {
+        memcpy(dest,
+               pinned_data.data() + it->second * page_size,
+               page_bytes(page));
+        return true;
+    }
+    Shard& shard = shard_of(page);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it2 = shard.slots.find(page);
+    if (it2 == shard.slots.end()) {
+        return false;
+    }
+    memcpy(dest, shard.data.data() + it2->second * page_size, page_bytes(page));
+    shard.referenced[it2->second] = 1;
+    return true;
+}
+
+void GraphPageCache::insert(int64_t page, const char* src) {
+    Shard& shard = shard_of(page);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t nframes = shard.frame_pages.size();
+    if (nframes == 0 || shard.slots.count(page)) {
+        return;
+    }
+    // CLOCK: give a second chance to the pages referenced since the last
+    // pass of the hand
+    while (shard.referenced[shard.hand]) {
+        shard.referenced[shard.hand] = 0;
+        shard.hand = (shard.hand + 1) % nframes;
+    }
+    size_t frame = shard.hand;
+    shard.hand = (shard.hand + 1) % nframes;
+    if (shard.frame_pages[frame] >= 0) {
+        shard.slots.erase(shard.frame_pages[frame]);
+    }
+    shard.frame_pages[frame] = page;
+    shard.slots[page] = frame;
+    shard.referenced[frame] = 1;
+    memcpy(shard.data.data() + frame * page_size, src, page_bytes(page));
+}
+
+size_t GraphPageCache::read(
+        const std::vector<BatchedFileReader::Request>& requests) {
+    thread_local std::vector<int64_t> pages;
+    thread_local std::vector<char> buf;
+    thread_local std::vector<BatchedFileReader::Request> misses;
+    thread_local std::vector<size_t> miss_pages;
+
+    pages.clear();
+    for (const auto& req : requests) {
+        if (req.size == 0) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT(req.offset >= 0);
+        int64_t p0 = req.offset / page_size;
+        int64_t p1 = (req.offset + req.size - 1) / page_size;
+        for (int64_t p = p0; p <= p1; p++) {
+            pages.push_back(p);
+        }
+    }
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    buf.resize(pages.size() * page_size);
+
+    misses.clear();
+    miss_pages.clear();
+    for (size_t i = 0; i < pages.size(); i++) {
+        char* dest = buf.data() + i * page_size;
+        if (!lookup(pages[i], dest)) {
+            misses.push_back(
+                    {(off_t)pages[i] * (off_t)page_size,
+                     page_bytes(pages[i]),
+                     dest});
+            miss_pages.push_back(i);
+        }
+    }
+    n_hits.fetch_add(pages.size() - misses.size(), std::memory_order_relaxed);
+    n_misses.fetch_add(misses.size(), std::memory_order_relaxed);
+    if (metrics_enabled()) {
+        metrics_add_counter(METRIC_CACHE_HITS, pages.size() - misses.size());
+        metrics_add_counter(METRIC_CACHE_MISSES, misses.size());
+    }
+
+    if (!misses.empty()) {
+        BatchedFileReader::thread_local_reader().read(fd, misses);
+        for (size_t i : miss_pages) {
+            insert(pages[i], buf.data() + i * page_size);
+        }
+    }
+
+    for (const auto& req : requests) {
+        size_t done = 0;
+        while (done < req.size) {
+            off_t offset = req.offset + done;
+            int64_t page = offset / page_size;
+            size_t i = std::lower_bound(pages.begin(), pages.end(), page) -
+                    pages.begin();
+            size_t in_page = offset - (off_t)page * page_size;
+            size_t n = std::min(req.size - done, page_size - in_page);
+            memcpy((char*)req.dest + done,
+                   buf.data() + i * page_size + in_page,
+                   n);
+            done += n;
+        }
+    }
+    return misses.size();
+}
+
+size_t GraphPageCache::read(off_t offset, size_t size, void* dest) {
+    return read({{offset, size, dest}});
+}
+
+void GraphPageCache::pin(const std::vector<std::pair<off_t, off_t>>& ranges) {
+    std::vector<int64_t> pages;
+    for (const auto& range : ranges) {
+        if (range.second <= range.first) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT(range.first >= 0);
+        int64_t p0 = range.first / page_size;
+        int64_t p1 = (range.second - 1) / page_size;
+        for (int64_t p = p0; p <= p1; p++) {
+            if (!pinned_slots.count(p)) {
+                pages.push_back(p);
+            }
+        }
+    }
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    size_t slot0 = pinned_slots.size();
+    pinned_data.resize((slot0 + pages.size()) * page_size);
+    std::vector<BatchedFileReader::Request> requests;
+    for (size_t i = 0; i < pages.size(); i++) {
+        requests.push_back(
+                {(off_t)pages[i] * (off_t)page_size,
+                 page_bytes(pages[i]),
+                 pinned_data.data() + (slot0 + i) * page_size});
+    }
+    BatchedFileReader::thread_local_reader().read(fd, requests);
+    for (size_t i = 0; i < pages.size(); i++) {
+        pinned_slots[pages[i]] = slot0 + i;
+    }
+}
+
+size_t GraphPageCache::size() const {
+    size_t n = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        n += shard->slots.size();
+    }
+    return n;
+}
+
+void GraphPageCache::reset() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->slots.clear();
+        std::fill(shard->frame_pages.begin(), shard->frame_pages.end(), -1);
+        std::fill(shard->referenced.begin(), shard->referenced.end(), 0);
+        shard->hand = 0;
+    }
+    n_hits = 0;
+    n_misses = 0;
+}
+
+} // namespace faiss
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <sys/types.h> // For off_t
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <faiss/impl/BatchedFileReader.h>
+
+namespace faiss {
+
+/** Cache of the fixed-size pages of one file, shared by the search threads.
+ *
+ * Used for the neighbor lists of an HNSW graph that stays on disk
+ * (HNSW::neighbors_on_disk), so that hot lists are not read again for every
+ * query.
+ *
+ * There are two kinds of pages:
+ * - pinned pages are loaded once by pin() and never evicted. They are
+ *   stored in a read-only table, so hits on them do not take a lock. pin()
+ *   must not be called concurrently with reads.
+ * - the other pages are stored in n_shards shards protected by one mutex
+ *   each, with CLOCK eviction within a shard.
+ *
+ * Missed pages of a read are fetched from disk together with a
+ * BatchedFileReader. Pinned pages do not count against capacity.
+ */
+struct GraphPageCache {
+    size_t page_size;
+    /// max nb of unpinned pages
+    size_t capacity;
+
+    /// page lookups served from memory / read from the file. Relaxed
+    /// counters, they are only meaningful between searches.
+    std::atomic<size_t> n_hits{0};
+    std::atomic<size_t> n_misses{0};
+
+    /** @param fd            file to cache, it is not owned by the cache
+     *  @param capacity_bytes memory budget for the unpinned pages
+     */
+    GraphPageCache(
+            int fd,
+            size_t capacity_bytes,
+            size_t page_size = 4096,
+            size_t n_shards = 16);
+
+    /** read the byte ranges of requests (offset, size, dest) through the
+     * cache.
+     * @return nb of pages that were read from the file */
+    size_t read(const std::vector<BatchedFileReader::Request>& requests);
+
+    /// same for a single range
+    size_t read(off_t offset, size_t size, void* dest);
+
+    /// load and pin the pages that overlap the byte ranges [begin, end)
+    void pin(const std::vector<std::pair<off_t, off_t>>& ranges);
+
+    size_t n_pinned() const {
+        return pinned_slots.size();
+    }
+
+    /// nb of unpinned pages currently in the cache
+    size_t size() const;
+
+    /// drop the unpinned pages and reset the counters
+    void reset();
+
+    int get_fd() const {
+        return fd;
+    }
+
+    GraphPageCache(const GraphPageCache&) = delete;
+    GraphPageCache& operator=(const GraphPageCache&) = delete;
+
+   private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<int64_t, size_t> slots; ///< page -> frame
+        std::vector<int64_t> frame_pages;          ///< -1 if empty
+        std::vector<uint8_t> referenced;           ///< CLOCK bits
+        std::vector<char> data;
+        size_t hand = 0;
+    };
+
+    int fd;
+    off_t file_size;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::unordered_map<int64_t, size_t> pinned_slots;
+    std::vector<char> pinned_data;
+
+    Shard& shard_of(int64_t page) const;
+    size_t page_bytes(int64_t page) const;
+    bool lookup(int64_t page, char* dest);
+    void insert(int64_t page, const char* src);
+};
+
+} // namespace faiss
@@ -12,7 +12,9 @@
 
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/HNSWTrace.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ProductQuantizer.h>
 #include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/prefetch.h>
 
@@ -26,6 +28,8 @@
 #include <cerrno>
 #include <cmath>
 #include <cstring>
+#include <deque>
+#include <numeric>
 #include "faiss/impl/FaissAssert.h"
 
 #ifdef __AVX2__
@@ -177,6 +181,7 @@ HNSW::HNSW(int M, int M0) : rng(12345) {
     neighbors_start_offset = -1;
     neighbors_mmap_ptr = nullptr;
     neighbors_use_mmap = false;
+    graph_page_cache.reset();
 }
 
 int HNSW::random_level() {
@@ -228,12 +233,15 @@ void HNSW::reset() {
     offsets.push_back(0);
     levels.clear();
     neighbors.clear();
+    deleted.clear();
+    n_deleted = 0;
 
     // Clear compact storage fields
     storage_is_compact = false; // Reset flag to default
     compact_neighbors_data.clear();
     compact_level_ptr.clear();
     compact_node_offsets.clear();
+    compressed_level_ptr.clear();
 
     // Reset disk/mmap access fields
     neighbors_on_disk = false;
@@ -247,6 +255,152 @@ void HNSW::reset() {
     neighbors_use_mmap = false;
 }
 
+std::vector<int32_t> HNSW::get_degrees(int level) const {
+    FAISS_THROW_IF_NOT_FMT(
+            level >= 0 && level <= max_level,
+            "level %d out of range [0, %d]",
+            level,
+            max_level);
+    FAISS_THROW_IF_NOT_MSG(
+            storage_is_compact || neighbors.size() > 0,
+            "neighbors are not loaded");
+    std::vector<int32_t> degrees(levels.size(), 0);
+    for (size_t i = 0; i < levels.size(); i++) {
+        size_t begin, end;
+        neighbor_range(i, level, &begin, &end);
+        if (storage_is_compact) {
+            // compact lists only hold valid neighbors
+            degrees[i] = end - begin;
+            continue;
+        }
+        for (size_t j = begin; j < end && neighbors[j] >= 0; j++) {
+            degrees[i]++;
+        }
+    }
+    return degrees;
+}
+
+void HNSW::convert_to_compact() {
+    if (storage_is_compact) {
+        return;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            !neighbors_on_disk, "cannot convert on-disk neighbors");
+    size_t n = levels.size();
+    std::vector<storage_idx_t> data;
+    std::vector<size_t> level_ptr;
+    std::vector<size_t> node_offsets(n + 1);
+    data.reserve(neighbors.size());
+    for (size_t i = 0; i < n; i++) {
+        node_offsets[i] = level_ptr.size();
+        for (int level = 0; level < levels[i]; level++) {
+            level_ptr.push_back(data.size());
+            size_t begin, end;
+            neighbor_range(i, level, &begin, &end);
+            for (size_t j = begin; j < end && neighbors[j] >= 0; j++) {
+                data.push_back(neighbors[j]);
+            }
+        }
+        level_ptr.push_back(data.size());
+    }
+    node_offsets[n] = level_ptr.size();
+
+    compact_neighbors_data = MaybeOwnedVector<storage_idx_t>(std::move(data));
+    compact_level_ptr = MaybeOwnedVector<size_t>(std::move(level_ptr));
+    compact_node_offsets = MaybeOwnedVector<size_t>(std::move(node_offsets));
+    storage_is_compact = true;
+    offsets.clear();
+    neighbors.clear();
+}
+
+void HNSW::encode_neighbor_list(
+        storage_idx_t* ids,
+        size_t n,
+        std::vector<uint8_t>& out) {
+    if (n == 0) {
+        return;
+    }
+    std::sort(ids, ids + n);
+    uint32_t max_gap = 0;
+    for (size_t i = 1; i < n; i++) {
+        max_gap = std::max(max_gap, uint32_t(ids[i] - ids[i - 1]));
+    }
+    int nbits = 0;
+    while (nbits < 32 && (max_gap >> nbits) != 0) {
+        nbits++;
+    }
+    out.push_back(nbits);
+    uint32_t first = ids[0];
+    const uint8_t* first_bytes = reinterpret_cast<const uint8_t*>(&first);
+    out.insert(out.end(), first_bytes, first_bytes + sizeof(first));
+
+    uint64_t acc = 0;
+    int n_acc = 0;
+    for (size_t i = 1; i < n; i++) {
+        acc |= uint64_t(uint32_t(ids[i] - ids[i - 1])) << n_acc;
+        n_acc += nbits;
+        while (n_acc >= 8) {
+            out.push_back(acc & 0xff);
+            acc >>= 8;
+            n_acc -= 8;
+        }
+    }
+    if (n_acc > 0) {
+        out.push_back(acc & 0xff);
+    }
+}
+
+void HNSW::decode_neighbor_list(
+        const uint8_t* data,
+        size_t n,
+        storage_idx_t* ids) {
+    if (n == 0) {
+        return;
+    }
+    int nbits = data[0];
+    uint32_t v;
+    memcpy(&v, data + 1, sizeof(v));
+    ids[0] = v;
+    const uint8_t* p = data + 1 + sizeof(v);
+    uint64_t mask = (uint64_t(1) << nbits) - 1;
+    uint64_t acc = 0;
+    int n_acc = 0;
+    for (size_t i = 1; i < n; i++) {
+        while (n_acc < nbits) {
+            acc |= uint64_t(*p++) << n_acc;
+            n_acc += 8;
+        }
+        v += acc & mask;
+        acc >>= nbits;
+        n_acc -= nbits;
+        ids[i] = v;
+    }
+}
+
+void HNSW::compress_neighbor_lists(
+        std::vector<uint8_t>& data,
+        std::vector<size_t>& level_ptr) const {
+    FAISS_THROW_IF_NOT_MSG(
+            storage_is_compact && !neighbors_on_disk,
+            "compressing the neighbors requires the compact storage in "
+            "memory");
+    data.clear();
+    level_ptr.resize(compact_level_ptr.size());
+    std::vector<storage_idx_t> list;
+    size_t n_ptr = compact_level_ptr.size();
+    for (size_t j = 0; j < n_ptr; j++) {
+        level_ptr[j] = data.size();
+        // the last entry of a node is the end of its lists, it is also the
+        // start of the next node
+        if (j + 1 < n_ptr && compact_level_ptr[j + 1] > compact_level_ptr[j]) {
+            list.assign(
+                    compact_neighbors_data.begin() + compact_level_ptr[j],
+                    compact_neighbors_data.begin() + compact_level_ptr[j + 1]);
+            encode_neighbor_list(list.data(), list.size(), data);
+        }
+    }
+}
+
 void HNSW::save_degree_distribution(int level, const char* filename) const {
     // Check if level is valid
     if (level < 0 || level >= cum_nneighbor_per_level.size() - 1) {
@@ -491,11 +645,16 @@ void shrink_neighbor_list(
     }
     std::priority_queue<NodeDistFarther> resultSet;
     std::vector<NodeDistFarther> returnlist;
+    std::vector<idx_t> ids;
+    ids.reserve(resultSet1.size());
 
     while (resultSet1.size() > 0) {
         resultSet.emplace(resultSet1.top().d, resultSet1.top().id);
+        ids.push_back(resultSet1.top().id);
         resultSet1.pop();
     }
+    // the pruning computes distances between all pairs of candidates
+    qdis.prefetch_vectors(ids.data(), ids.size());
 
     HNSW::shrink_neighbor_list(
             qdis, resultSet, returnlist, max_size, keep_max_size_level0);
@@ -529,6 +688,12 @@ void add_link(
     }
 
     // otherwise we let them fight out which to keep
+    std::vector<idx_t> ids = {src, dest};
+    ids.insert(
+            ids.end(),
+            hnsw.neighbors.begin() + begin,
+            hnsw.neighbors.begin() + end);
+    qdis.prefetch_vectors(ids.data(), ids.size());
 
     // copy to resultSet...
     std::priority_queue<NodeDistCloser> resultSet;
@@ -628,6 +793,8 @@ void search_neighbors_to_add(
         bool reference_version) {
     // top is nearest candidate
     std::priority_queue<NodeDistFarther> candidates;
+    std::vector<idx_t> batch_ids;
+    std::vector<float> batch_dis;
 
     NodeDistFarther ev(d_entry_point, entry_point);
     candidates.push(ev);
@@ -694,9 +861,10 @@ void search_neighbors_to_add(
                 }
             };
 
-            int n_buffered = 0;
-            storage_idx_t buffered_ids[4];
-
+            // all the unvisited neighbors in one distances_batch, which
+            // the default implementation processes by 4, and remote
+            // distance computers in one request
+            batch_ids.clear();
             for (size_t j = begin; j < end; j++) {
                 storage_idx_t nodeId = hnsw.neighbors[j];
                 if (nodeId < 0)
@@ -705,34 +873,12 @@ void search_neighbors_to_add(
                     continue;
                 }
                 vt.set(nodeId);
-
-                buffered_ids[n_buffered] = nodeId;
-                n_buffered += 1;
-
-                if (n_buffered == 4) {
-                    float dis[4];
-                    qdis.distances_batch_4(
-                            buffered_ids[0],
-                            buffered_ids[1],
-                            buffered_ids[2],
-                            buffered_ids[3],
-                            dis[0],
-                            dis[1],
-                            dis[2],
-                            dis[3]);
-
-                    for (size_t id4 = 0; id4 < 4; id4++) {
-                        update_with_candidate(buffered_ids[id4], dis[id4]);
-                    }
-
-                    n_buffered = 0;
-                }
+                batch_ids.push_back(nodeId);
             }
-
-            // process leftovers
-            for (size_t icnt = 0; icnt < n_buffered; icnt++) {
-                float dis = qdis(buffered_ids[icnt]);
-                update_with_candidate(buffered_ids[icnt], dis);
+            batch_dis.resize(batch_ids.size());
+            qdis.distances_batch(batch_ids, batch_dis);
+            for (size_t i = 0; i < batch_ids.size(); i++) {
+                update_with_candidate(batch_ids[i], batch_dis[i]);
             }
         }
     }
@@ -740,36 +886,56 @@ void search_neighbors_to_add(
     vt.advance();
 }
 
+namespace {
+
+inline void lock_node(omp_lock_t& lock) {
+    omp_set_lock(&lock);
+}
+
+inline void unlock_node(omp_lock_t& lock) {
+    omp_unset_lock(&lock);
+}
+
+inline void lock_node(HNSWSpinLock& lock) {
+    lock.lock();
+}
+
+inline void unlock_node(HNSWSpinLock& lock) {
+    lock.unlock();
+}
+
 /// Finds neighbors and builds links with them, starting from an entry
 /// point. The own neighbor list is assumed to be locked.
-void HNSW::add_links_starting_from(
+template <class Lock>
+void add_links_starting_from_tpl(
+        HNSW& hnsw,
         DistanceComputer& ptdis,
         storage_idx_t pt_id,
         storage_idx_t nearest,
         float d_nearest,
         int level,
-        omp_lock_t* locks,
+        Lock* locks,
         VisitedTable& vt,
         bool keep_max_size_level0) {
     std::priority_queue<NodeDistCloser> link_targets;
 
     search_neighbors_to_add(
-            *this, ptdis, link_targets, nearest, d_nearest, level, vt);
+            hnsw, ptdis, link_targets, nearest, d_nearest, level, vt);
 
     // but we can afford only this many neighbors
-    int M = nb_neighbors(level);
+    int M = hnsw.nb_neighbors(level);
 
     ::faiss::shrink_neighbor_list(
-            ptdis, link_targets, ems[pt_id], keep_max_size_level0);
+            ptdis, link_targets, hnsw.ems[pt_id], keep_max_size_level0);
 
     std::vector<storage_idx_t> neighbors_to_add;
     neighbors_to_add.reserve(link_targets.size());
     bool prune_in_add_link = false;
 
     // Check if we should apply node merging based on distance threshold
-    bool apply_merging = !percentile_thresholds.empty() && level == 0;
+    bool apply_merging = !hnsw.percentile_thresholds.empty() && level == 0;
     float merge_threshold =
-            apply_merging ? get_threshold_for_percentile(50.0f) : 0.0f;
+            apply_merging ? hnsw.get_threshold_for_percentile(50.0f) : 0.0f;
     bool pass_first_node = false;
     bool merged_node = false;
 
@@ -780,9 +946,9 @@ void HNSW::add_links_starting_from(
         // If this is the first node and its distance is below threshold, add it
         // and break
         if (merged_node && apply_merging && !pass_first_node && distance < -1.8) {
-            if (level == 0 && M > ems[pt_id] && prune_in_add_link) {
+            if (level == 0 && M > hnsw.ems[pt_id] && prune_in_add_link) {
                 add_link_pruned(
-                        *this,
+                        hnsw,
                         ptdis,
                         pt_id,
                         other_id,
@@ -790,7 +956,7 @@ void HNSW::add_links_starting_from(
                         keep_max_size_level0);
             } else {
                 add_link(
-                        *this,
+                        hnsw,
                         ptdis,
                         pt_id,
                         other_id,
@@ -806,53 +972,51 @@ void HNSW::add_links_starting_from(
 
         // Normal processing for nodes above threshold or when merging is not
         // applied
-        if (level == 0 && M > ems[pt_id] && prune_in_add_link) {
+        if (level == 0 && M > hnsw.ems[pt_id] && prune_in_add_link) {
             add_link_pruned(
-                    *this, ptdis, pt_id, other_id, level, keep_max_size_level0);
+                    hnsw, ptdis, pt_id, other_id, level, keep_max_size_level0);
         } else {
             add_link(
-                    *this, ptdis, pt_id, other_id, level, keep_max_size_level0);
+                    hnsw, ptdis, pt_id, other_id, level, keep_max_size_level0);
         }
         neighbors_to_add.push_back(other_id);
         link_targets.pop();
     }
 
-    omp_unset_lock(&locks[pt_id]);
+    unlock_node(locks[pt_id]);
     for (storage_idx_t other_id : neighbors_to_add) {
-        omp_set_lock(&locks[other_id]);
-        if (level == 0 && M > ems[other_id] && prune_in_add_link) {
+        lock_node(locks[other_id]);
+        if (level == 0 && M > hnsw.ems[other_id] && prune_in_add_link) {
             add_link_pruned(
-                    *this, ptdis, other_id, pt_id, level, keep_max_size_level0);
+                    hnsw, ptdis, other_id, pt_id, level, keep_max_size_level0);
         } else {
             add_link(
-                    *this, ptdis, other_id, pt_id, level, keep_max_size_level0);
+                    hnsw, ptdis, other_id, pt_id, level, keep_max_size_level0);
         }
-        omp_unset_lock(&locks[other_id]);
+        unlock_node(locks[other_id]);
     }
-    omp_set_lock(&locks[pt_id]);
+    lock_node(locks[pt_id]);
 }
 
-/**************************************************************
- * Building, parallel
- **************************************************************/
-
-void HNSW::add_with_locks(
+template <class Lock>
+void add_with_locks_tpl(
+        HNSW& hnsw,
         DistanceComputer& ptdis,
         int pt_level,
         int pt_id,
-        std::vector<omp_lock_t>& locks,
+        std::vector<Lock>& locks,
         VisitedTable& vt,
         bool keep_max_size_level0) {
     //  greedy search on upper levels
 
-    storage_idx_t nearest;
+    HNSW::storage_idx_t nearest;
 #pragma omp critical
     {
-        nearest = entry_point;
+        nearest = hnsw.entry_point;
 
         if (nearest == -1) {
-            max_level = pt_level;
-            entry_point = pt_id;
+            hnsw.max_level = pt_level;
+            hnsw.entry_point = pt_id;
         }
     }
 
@@ -860,17 +1024,18 @@ void HNSW::add_with_locks(
         return;
     }
 
-    omp_set_lock(&locks[pt_id]);
+    lock_node(locks[pt_id]);
 
-    int level = max_level; // level at which we start adding neighbors
+    int level = hnsw.max_level; // level at which we start adding neighbors
     float d_nearest = ptdis(nearest);
 
     for (; level > pt_level; level--) {
-        greedy_update_nearest(*this, ptdis, level, nearest, d_nearest);
+        greedy_update_nearest(hnsw, ptdis, level, nearest, d_nearest);
     }
 
     for (; level >= 0; level--) {
-        add_links_starting_from(
+        add_links_starting_from_tpl(
+                hnsw,
                 ptdis,
                 pt_id,
                 nearest,
@@ -881,14 +1046,85 @@ void HNSW::add_with_locks(
                 keep_max_size_level0);
     }
 
-    omp_unset_lock(&locks[pt_id]);
+    unlock_node(locks[pt_id]);
 
-    if (pt_level > max_level) {
-        max_level = pt_level;
-        entry_point = pt_id;
+    if (pt_level > hnsw.max_level) {
+        hnsw.max_level = pt_level;
+        hnsw.entry_point = pt_id;
     }
 }
 
+} // namespace
+
+void HNSW::add_links_starting_from(
+        DistanceComputer& ptdis,
+        storage_idx_t pt_id,
+        storage_idx_t nearest,
+        float d_nearest,
+        int level,
+        omp_lock_t* locks,
+        VisitedTable& vt,
+        bool keep_max_size_level0) {
+    add_links_starting_from_tpl(
+            *this,
+            ptdis,
+            pt_id,
+            nearest,
+            d_nearest,
+            level,
+            locks,
+            vt,
+            keep_max_size_level0);
+}
+
+void HNSW::add_links_starting_from(
+        DistanceComputer& ptdis,
+        storage_idx_t pt_id,
+        storage_idx_t nearest,
+        float d_nearest,
+        int level,
+        HNSWSpinLock* locks,
+        VisitedTable& vt,
+        bool keep_max_size_level0) {
+    add_links_starting_from_tpl(
+            *this,
+            ptdis,
+            pt_id,
+            nearest,
+            d_nearest,
+            level,
+            locks,
+            vt,
+            keep_max_size_level0);
+}
+
+/**************************************************************
+ * Building, parallel
+ **************************************************************/
+
+void HNSW::add_with_locks(
+        DistanceComputer& ptdis,
+        int pt_level,
+        int pt_id,
+        std::vector<omp_lock_t>& locks,
+        VisitedTable& vt,
+        bool keep_max_size_level0) {
+    add_with_locks_tpl(
+            *this, ptdis, pt_level, pt_id, locks, vt, keep_max_size_level0);
+}
+
+void HNSW::add_with_locks(
+        DistanceComputer& ptdis,
+        int pt_level,
+        int pt_id,
+        std::vector<HNSWSpinLock>& locks,
+        VisitedTable& vt,
+        bool keep_max_size_level0) {
+    add_with_locks_tpl(
+            *this, ptdis, pt_level, pt_id, locks, vt, keep_max_size_level0);
+}
+
+
 /**************************************************************
  * Searching
  **************************************************************/
@@ -986,7 +1222,7 @@ std::priority_queue<HNSW::Node> search_from_candidate_unbounded(
         }
 
         if (!ids_to_process.empty()) {
-            std::vector<float> batch_distances;
+            std::vector<float> batch_distances(ids_to_process.size());
             qdis.distances_batch(ids_to_process, batch_distances);
 
             for (size_t i = 0; i < ids_to_process.size(); i++) {
@@ -1008,6 +1244,35 @@ std::priority_queue<HNSW::Node> search_from_candidate_unbounded(
     return top_candidates;
 }
 
+namespace {
+
+/// per-thread buffers of greedy_update_nearest, reused across the calls so
+/// that the descent does not allocate
+struct GreedyScratch {
+    std::vector<HNSW::storage_idx_t> neighbors;
+    std::vector<idx_t> ids;
+    std::vector<float> distances;
+    /// nodes whose distance was computed in the current call, sorted
+    std::vector<HNSW::storage_idx_t> evaluated;
+};
+
+/// prefetch the start of the in-memory neighbor list of node at level
+void prefetch_neighbor_list(const HNSW& hnsw, idx_t node, int level) {
+    if (hnsw.neighbors_on_disk) {
+        return;
+    }
+    size_t begin, end;
+    hnsw.neighbor_range(node, level, &begin, &end);
+    if (begin == end) {
+        return;
+    }
+    prefetch_L2(
+            hnsw.storage_is_compact ? hnsw.compact_neighbors_data.data() + begin
+                                    : hnsw.neighbors.data() + begin);
+}
+
+} // namespace
+
 /// greedily update a nearest vector at a given level
 HNSWStats greedy_update_nearest(
         const HNSW& hnsw,
@@ -1016,41 +1281,40 @@ HNSWStats greedy_update_nearest(
         storage_idx_t& nearest,
         float& d_nearest) {
     HNSWStats stats;
+    thread_local GreedyScratch scratch;
+    auto& evaluated = scratch.evaluated;
+    evaluated.assign(1, nearest);
 
-    // printf("greedy_update_nearest level: %d\n", level);
-    int level_neighbors = 0;
-
-    size_t max_degree_at_level = hnsw.nb_neighbors(level);
-    std::vector<HNSW::storage_idx_t> neighbor_read_buffer(max_degree_at_level);
     for (;;) {
         storage_idx_t prev_nearest = nearest;
 
-        size_t ndis = 0;
-        ssize_t neighbors_read_count =
-                hnsw.fetch_neighbors(nearest, level, neighbor_read_buffer);
-        stats.n_ios++;
+        hnsw.fetch_neighbors(nearest, level, scratch.neighbors, &stats.n_ios);
 
-        std::vector<idx_t> neighbors_to_process(neighbors_read_count);
-        size_t valid_neighbor_count = 0;
-        for (ssize_t i = 0; i < neighbors_read_count; ++i) {
-            storage_idx_t v_storage = neighbor_read_buffer[i];
-            assert(v_storage >= 0 && v_storage < hnsw.levels.size());
-            neighbors_to_process[valid_neighbor_count++] =
-                    static_cast<idx_t>(v_storage);
+        // the neighbors already evaluated are farther than d_nearest, so
+        // skipping them does not change the descent
+        scratch.ids.clear();
+        for (storage_idx_t v : scratch.neighbors) {
+            assert(v >= 0 && v < hnsw.levels.size());
+            auto it = std::lower_bound(evaluated.begin(), evaluated.end(), v);
+            if (it != evaluated.end() && *it == v) {
+                continue;
+            }
+            evaluated.insert(it, v);
+            scratch.ids.push_back(v);
         }
-        neighbors_to_process.resize(valid_neighbor_count);
-
-        std::vector<float> batch_distances(valid_neighbor_count);
-        qdis.distances_batch(neighbors_to_process, batch_distances);
-        stats.ndis += valid_neighbor_count;
 
-        for (size_t i = 0; i < valid_neighbor_count; ++i) {
-            idx_t neighbor_id = neighbors_to_process[i];
-            float neighbor_dist = batch_distances[i];
+        size_t n_ids = scratch.ids.size();
+        scratch.distances.resize(n_ids);
+        if (n_ids > 0) {
+            qdis.distances_batch(scratch.ids, scratch.distances);
+        }
+        stats.ndis += n_ids;
 
-            if (neighbor_dist < d_nearest) {
-                d_nearest = neighbor_dist;
-                nearest = static_cast<storage_idx_t>(neighbor_id);
+        for (size_t i = 0; i < n_ids; ++i) {
+            if (scratch.distances[i] < d_nearest) {
+                d_nearest = scratch.distances[i];
+                nearest = static_cast<storage_idx_t>(scratch.ids[i]);
+                prefetch_neighbor_list(hnsw, nearest, level);
             }
         }
 
@@ -1076,80 +1340,277 @@ int extract_k_from_ResultHandler(ResultHandler<C>& res) {
     return 1;
 }
 
-} // namespace
+/** level 0 traversal of a range search. Best-first expansion that goes on
+ * while the closest node of the frontier is within expand_bound or among
+ * the ef closest visited nodes: the first condition collects the whole
+ * ball, the second leads the traversal from the entry points to the ball.
+ * All the visited nodes within the radius (res.threshold) are returned, so
+ * their nb is not bounded by ef. */
+void search_range_from_entries(
+        const HNSW& hnsw,
+        DistanceComputer& qdis,
+        ResultHandler<C>& res,
+        VisitedTable& vt,
+        HNSWStats& stats,
+        int nentry,
+        const storage_idx_t* entry_ids,
+        const float* entry_dis,
+        int ef,
+        float range_slack,
+        const IDSelector* sel) {
+    const float radius = res.threshold;
+    const float expand_bound = radius + range_slack * std::fabs(radius);
+    using MinHeap =
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>>;
+    MinHeap frontier;
+    std::priority_queue<Node> top; // the ef closest visited nodes
+
+    auto visit = [&](storage_idx_t v, float d) {
+        if (d < radius && !hnsw.is_deleted(v) &&
+            (!sel || sel->is_member(v))) {
+            res.add_result(d, v);
+        }
+        bool in_top = top.size() < ef || d < top.top().first;
+        if (in_top) {
+            top.emplace(d, v);
+            if (top.size() > ef) {
+                top.pop();
+            }
+        }
+        if (in_top || d <= expand_bound) {
+            frontier.emplace(d, v);
+        }
+    };
 
-HNSWStats HNSW::search(
+    for (int i = 0; i < nentry; i++) {
+        if (!vt.get(entry_ids[i])) {
+            vt.set(entry_ids[i]);
+            visit(entry_ids[i], entry_dis[i]);
+        }
+    }
+
+    std::vector<storage_idx_t> neighbors;
+    std::vector<idx_t> ids;
+    std::vector<float> dis;
+    while (!frontier.empty()) {
+        Node n0 = frontier.top();
+        if (n0.first > expand_bound && top.size() >= ef &&
+            n0.first > top.top().first) {
+            break;
+        }
+        frontier.pop();
+        hnsw.fetch_neighbors(n0.second, 0, neighbors, &stats.n_ios);
+        ids.clear();
+        for (storage_idx_t v : neighbors) {
+            if (!vt.get(v)) {
+                vt.set(v);
+                ids.push_back(v);
+            }
+        }
+        stats.nhops++;
+        if (ids.empty()) {
+            continue;
+        }
+        // one batch per node, for the distance computers that fetch the
+        // vectors remotely
+        dis.resize(ids.size());
+        qdis.distances_batch(ids, dis);
+        stats.ndis += ids.size();
+        for (size_t j = 0; j < ids.size(); j++) {
+            visit(ids[j], dis[j]);
+        }
+    }
+    stats.n1++;
+}
+
+/// level 0 search of HNSW::search and HNSW::search_from_entry_points,
+/// from nentry entry points with their distances to the query
+void search_level_0_from_entries(
+        const HNSW& hnsw,
         DistanceComputer& qdis,
         ResultHandler<C>& res,
         VisitedTable& vt,
+        HNSWStats& stats,
+        int nentry,
+        const storage_idx_t* entry_ids,
+        const float* entry_dis,
         const SearchParameters* params,
-        const IndexHNSW* hnsw_index) const {
-    HNSWStats stats;
-    if (entry_point == -1) {
-        return stats;
-    }
+        const IndexHNSW* hnsw_index) {
     int k = extract_k_from_ResultHandler(res);
 
-    bool bounded_queue = this->search_bounded_queue;
-    int efSearch = this->efSearch;
+    bool bounded_queue = hnsw.search_bounded_queue;
+    int efSearch = hnsw.efSearch;
+    // FILTER_AUTO is resolved by IndexHNSW::search for all the queries,
+    // and the exhaustive search is done there
+    bool two_hop = false;
+    float range_slack = hnsw.range_slack;
     if (params) {
         if (const SearchParametersHNSW* hnsw_params =
                     dynamic_cast<const SearchParametersHNSW*>(params)) {
             bounded_queue = hnsw_params->bounded_queue;
             efSearch = hnsw_params->efSearch;
+            if (hnsw_params->range_slack >= 0) {
+                range_slack = hnsw_params->range_slack;
+            }
+            two_hop = params->sel &&
+                    (hnsw_params->filter_strategy ==
+                             SearchParametersHNSW::FILTER_TWO_HOP ||
+                     hnsw_params->filter_strategy ==
+                             SearchParametersHNSW::FILTER_BRUTE_FORCE);
         }
     }
 
-    //  greedy search on upper levels
-    storage_idx_t nearest = entry_point;
-    float d_nearest = qdis(nearest);
-
-    // printf("max_level: %d\n", max_level);
-    for (int level = max_level; level >= 1; level--) {
-        HNSWStats local_stats =
-                greedy_update_nearest(*this, qdis, level, nearest, d_nearest);
-        stats.combine(local_stats);
-    }
-    if (hnsw_index) {
-        // printf("initial fetch count: %ld\n", qdis.get_fetch_count());
-    }
-
     int ef = std::max(efSearch, k);
-    if (bounded_queue) { // this is the most common branch
-        MinimaxHeap candidates(ef);
-
-        candidates.push(nearest, d_nearest);
-
-        search_from_candidates(
-                *this,
+    using RangeRH = RangeSearchBlockResultHandler<C>::SingleResultHandler;
+    if (range_slack >= 0 && dynamic_cast<RangeRH*>(&res)) {
+        search_range_from_entries(
+                hnsw,
                 qdis,
                 res,
-                candidates,
                 vt,
                 stats,
-                0,
-                0,
-                params,
-                hnsw_index);
+                nentry,
+                entry_ids,
+                entry_dis,
+                ef,
+                range_slack,
+                params ? params->sel : nullptr);
+    } else if (bounded_queue) { // this is the most common branch
+        MinimaxHeap candidates(ef);
+
+        for (int i = 0; i < nentry; i++) {
+            candidates.push(entry_ids[i], entry_dis[i]);
+        }
+
+        if (two_hop) {
+            search_from_candidates_two_hop(
+                    hnsw, qdis, res, candidates, vt, stats, *params->sel, ef);
+        } else {
+            search_from_candidates(
+                    hnsw,
+                    qdis,
+                    res,
+                    candidates,
+                    vt,
+                    stats,
+                    0,
+                    0,
+                    params,
+                    hnsw_index);
+        }
     } else {
+        // the unbounded search starts from the closest entry point
+        int best = 0;
+        for (int i = 1; i < nentry; i++) {
+            if (entry_dis[i] < entry_dis[best]) {
+                best = i;
+            }
+        }
         std::priority_queue<Node> top_candidates =
                 search_from_candidate_unbounded(
-                        *this, Node(d_nearest, nearest), qdis, ef, &vt, stats);
-
-        while (top_candidates.size() > k) {
+                        hnsw,
+                        Node(entry_dis[best], entry_ids[best]),
+                        qdis,
+                        ef,
+                        &vt,
+                        stats);
+
+        // the deleted nodes are traversed but not returned
+        std::vector<Node> live; // by decreasing distance
+        while (!top_candidates.empty()) {
+            if (!hnsw.is_deleted(top_candidates.top().second)) {
+                live.push_back(top_candidates.top());
+            }
             top_candidates.pop();
         }
 
-        while (!top_candidates.empty()) {
-            float d;
-            storage_idx_t label;
-            std::tie(d, label) = top_candidates.top();
-            res.add_result(d, label);
-            top_candidates.pop();
+        for (size_t i = live.size() > k ? live.size() - k : 0;
+             i < live.size();
+             i++) {
+            res.add_result(live[i].first, live[i].second);
         }
     }
 
     vt.advance();
+}
+
+} // namespace
+
+HNSWStats HNSW::search(
+        DistanceComputer& qdis,
+        ResultHandler<C>& res,
+        VisitedTable& vt,
+        const SearchParameters* params,
+        const IndexHNSW* hnsw_index) const {
+    HNSWStats stats;
+    if (entry_point == -1) {
+        return stats;
+    }
+
+    //  greedy search on upper levels
+    storage_idx_t nearest = entry_point;
+    float d_nearest = qdis(nearest);
+
+    {
+        FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_UPPER_LEVELS);
+        for (int level = max_level; level >= 1; level--) {
+            HNSWStats local_stats = greedy_update_nearest(
+                    *this, qdis, level, nearest, d_nearest);
+            stats.combine(local_stats);
+        }
+    }
+
+    search_level_0_from_entries(
+            *this,
+            qdis,
+            res,
+            vt,
+            stats,
+            1,
+            &nearest,
+            &d_nearest,
+            params,
+            hnsw_index);
+
+    return stats;
+}
+
+HNSWStats HNSW::search_from_entry_points(
+        DistanceComputer& qdis,
+        ResultHandler<C>& res,
+        VisitedTable& vt,
+        int nentry,
+        const storage_idx_t* entry_ids,
+        const SearchParameters* params,
+        const IndexHNSW* hnsw_index) const {
+    HNSWStats stats;
+    // the duplicate and missing entries are dropped
+    std::vector<idx_t> ids;
+    for (int i = 0; i < nentry; i++) {
+        storage_idx_t e = entry_ids[i];
+        if (e >= 0 && std::find(ids.begin(), ids.end(), e) == ids.end()) {
+            ids.push_back(e);
+        }
+    }
+    if (ids.empty()) {
+        return search(qdis, res, vt, params, hnsw_index);
+    }
+    std::vector<float> dis(ids.size());
+    qdis.distances_batch(ids, dis);
+    stats.ndis += ids.size();
+    std::vector<storage_idx_t> ids32(ids.begin(), ids.end());
+
+    search_level_0_from_entries(
+            *this,
+            qdis,
+            res,
+            vt,
+            stats,
+            ids32.size(),
+            ids32.data(),
+            dis.data(),
+            params,
+            hnsw_index);
 
     return stats;
 }
@@ -1224,6 +1685,8 @@ void HNSW::search_level_0(
 }
 
 void HNSW::permute_entries(const idx_t* map) {
+    FAISS_THROW_IF_NOT_MSG(
+            !neighbors_on_disk, "cannot permute neighbors that are on disk");
     // remap levels
     storage_idx_t ntotal = levels.size();
     std::vector<storage_idx_t> imap(ntotal); // inverse mapping
@@ -1237,23 +1700,316 @@ void HNSW::permute_entries(const idx_t* map) {
         entry_point = imap[entry_point];
     }
     std::vector<int> new_levels(ntotal);
-    std::vector<size_t> new_offsets(ntotal + 1);
-    std::vector<storage_idx_t> new_neighbors(neighbors.size());
-    size_t no = 0;
     for (int i = 0; i < ntotal; i++) {
-        storage_idx_t o = map[i]; // corresponding "old" index
-        new_levels[i] = levels[o];
-        for (size_t j = offsets[o]; j < offsets[o + 1]; j++) {
-            storage_idx_t neigh = neighbors[j];
-            new_neighbors[no++] = neigh >= 0 ? imap[neigh] : neigh;
-        }
-        new_offsets[i + 1] = no;
-    }
-    assert(new_offsets[ntotal] == offsets[ntotal]);
-    // swap everyone
-    std::swap(levels, new_levels);
-    std::swap(offsets, new_offsets);
-    neighbors = std::move(new_neighbors);
+        new_levels[i] = levels[map[i]];
+    }
+
+    if (storage_is_compact) {
+        std::vector<storage_idx_t> new_data(compact_neighbors_data.size());
+        std::vector<size_t> new_level_ptr(compact_level_ptr.size());
+        std::vector<size_t> new_node_offsets(ntotal + 1);
+        size_t no = 0, np = 0;
+        for (int i = 0; i < ntotal; i++) {
+            storage_idx_t o = map[i];
+            new_node_offsets[i] = np;
+            for (int level = 0; level < levels[o]; level++) {
+                new_level_ptr[np++] = no;
+                size_t begin, end;
+                neighbor_range(o, level, &begin, &end);
+                for (size_t j = begin; j < end; j++) {
+                    new_data[no++] = imap[compact_neighbors_data[j]];
+                }
+            }
+            new_level_ptr[np++] = no;
+        }
+        new_node_offsets[ntotal] = np;
+        FAISS_ASSERT(np == new_level_ptr.size());
+        compact_neighbors_data =
+                MaybeOwnedVector<storage_idx_t>(std::move(new_data));
+        compact_level_ptr = MaybeOwnedVector<size_t>(std::move(new_level_ptr));
+        compact_node_offsets =
+                MaybeOwnedVector<size_t>(std::move(new_node_offsets));
+    } else {
+        std::vector<size_t> new_offsets(ntotal + 1);
+        std::vector<storage_idx_t> new_neighbors(neighbors.size());
+        size_t no = 0;
+        for (int i = 0; i < ntotal; i++) {
+            storage_idx_t o = map[i]; // corresponding "old" index
+            for (size_t j = offsets[o]; j < offsets[o + 1]; j++) {
+                storage_idx_t neigh = neighbors[j];
+                new_neighbors[no++] = neigh >= 0 ? imap[neigh] : neigh;
+            }
+            new_offsets[i + 1] = no;
+        }
+        assert(new_offsets[ntotal] == offsets[ntotal]);
+        offsets = MaybeOwnedVector<size_t>(std::move(new_offsets));
+        neighbors = std::move(new_neighbors);
+    }
+    levels = MaybeOwnedVector<int>(std::move(new_levels));
+
+    if (!deleted.empty()) {
+        std::vector<uint8_t> new_deleted(ntotal);
+        for (int i = 0; i < ntotal; i++) {
+            new_deleted[i] = deleted[map[i]];
+        }
+        deleted.swap(new_deleted);
+    }
+
+    // the PQ pruning codes are indexed by node
+    if (pq_codes.size() > 0) {
+        FAISS_THROW_IF_NOT(pq_codes.size() == code_size * ntotal);
+        std::vector<uint8_t> new_codes(pq_codes.size());
+        for (int i = 0; i < ntotal; i++) {
+            memcpy(new_codes.data() + i * code_size,
+                   pq_codes.data() + map[i] * code_size,
+                   code_size);
+        }
+        pq_codes = MaybeOwnedVector<uint8_t>(std::move(new_codes));
+    }
+}
+
+bool HNSW::repair_links(
+        DistanceComputer& dis,
+        storage_idx_t node,
+        int level) {
+    FAISS_THROW_IF_NOT_MSG(
+            !storage_is_compact && !neighbors_on_disk,
+            "the graph must be in the default in-memory format");
+    size_t begin, end;
+    neighbor_range(node, level, &begin, &end);
+    bool has_deleted = false;
+    for (size_t j = begin; j < end && neighbors[j] >= 0; j++) {
+        has_deleted |= is_deleted(neighbors[j]) != 0;
+    }
+    if (!has_deleted) {
+        return false;
+    }
+
+    // candidates: the live neighbors of node and of its deleted neighbors
+    std::unordered_set<storage_idx_t> seen;
+    std::priority_queue<NodeDistFarther> candidates;
+    auto add_candidate = [&](storage_idx_t v) {
+        if (v != node && !is_deleted(v) && seen.insert(v).second) {
+            candidates.emplace(dis.symmetric_dis(node, v), v);
+        }
+    };
+    for (size_t j = begin; j < end && neighbors[j] >= 0; j++) {
+        storage_idx_t v = neighbors[j];
+        if (!is_deleted(v)) {
+            add_candidate(v);
+            continue;
+        }
+        size_t begin2, end2;
+        neighbor_range(v, level, &begin2, &end2);
+        for (size_t j2 = begin2; j2 < end2 && neighbors[j2] >= 0; j2++) {
+            add_candidate(neighbors[j2]);
+        }
+    }
+
+    std::vector<NodeDistFarther> selected;
+    shrink_neighbor_list(dis, candidates, selected, end - begin);
+    size_t j = begin;
+    for (const NodeDistFarther& v : selected) {
+        neighbors[j++] = v.id;
+    }
+    while (j < end) {
+        neighbors[j++] = -1;
+    }
+    return true;
+}
+
+void HNSW::update_entry_point_after_delete() {
+    if (entry_point < 0 || !is_deleted(entry_point)) {
+        return;
+    }
+    entry_point = -1;
+    max_level = -1;
+    for (storage_idx_t i = 0; i < levels.size(); i++) {
+        if (!deleted[i] && levels[i] - 1 > max_level) {
+            max_level = levels[i] - 1;
+            entry_point = i;
+        }
+    }
+}
+
+void HNSW::remove_deleted() {
+    FAISS_THROW_IF_NOT_MSG(
+            !storage_is_compact && !neighbors_on_disk,
+            "the graph must be in the default in-memory format");
+    if (n_deleted == 0) {
+        return;
+    }
+    update_entry_point_after_delete();
+    storage_idx_t ntotal = levels.size();
+    // old index -> new index
+    std::vector<storage_idx_t> imap(ntotal, -1);
+    storage_idx_t nnew = 0;
+    for (storage_idx_t i = 0; i < ntotal; i++) {
+        if (!deleted[i]) {
+            imap[i] = nnew++;
+        }
+    }
+
+    std::vector<int> new_levels(nnew);
+    std::vector<size_t> new_offsets(nnew + 1);
+    std::vector<storage_idx_t> new_neighbors;
+    for (storage_idx_t i = 0; i < ntotal; i++) {
+        storage_idx_t ni = imap[i];
+        if (ni < 0) {
+            continue;
+        }
+        new_levels[ni] = levels[i];
+        for (int level = 0; level < levels[i]; level++) {
+            size_t begin, end;
+            neighbor_range(i, level, &begin, &end);
+            size_t n_kept = 0;
+            for (size_t j = begin; j < end && neighbors[j] >= 0; j++) {
+                if (!deleted[neighbors[j]]) {
+                    new_neighbors.push_back(imap[neighbors[j]]);
+                    n_kept++;
+                }
+            }
+            new_neighbors.resize(
+                    new_neighbors.size() + end - begin - n_kept, -1);
+        }
+        new_offsets[ni + 1] = new_neighbors.size();
+    }
+    if (entry_point >= 0) {
+        entry_point = imap[entry_point];
+    }
+
+    // the flat PQ pruning codes are indexed by node
+    if (pq_codes.size() > 0) {
+        FAISS_THROW_IF_NOT_MSG(
+                !(pruning_pq && pruning_pq->nbits == 4),
+                "the 4-bit PQ pruning codes embed the neighbor lists, "
+                "reset them before removing nodes");
+        std::vector<uint8_t> new_codes(nnew * code_size);
+        for (storage_idx_t i = 0; i < ntotal; i++) {
+            if (imap[i] >= 0) {
+                memcpy(new_codes.data() + imap[i] * code_size,
+                       pq_codes.data() + i * code_size,
+                       code_size);
+            }
+        }
+        pq_codes = MaybeOwnedVector<uint8_t>(std::move(new_codes));
+    }
+
+    levels = MaybeOwnedVector<int>(std::move(new_levels));
+    offsets = MaybeOwnedVector<size_t>(std::move(new_offsets));
+    neighbors = MaybeOwnedVector<storage_idx_t>(std::move(new_neighbors));
+    deleted.clear();
+    n_deleted = 0;
+}
+
+std::vector<idx_t> HNSW::locality_order(
+        ReorderType type,
+        const std::unordered_map<idx_t, size_t>* visit_counts) const {
+    FAISS_THROW_IF_NOT_MSG(
+            !neighbors_on_disk, "the neighbors must be loaded in memory");
+    size_t ntotal = levels.size();
+    std::vector<std::vector<storage_idx_t>> lists(ntotal);
+    for (size_t i = 0; i < ntotal; i++) {
+        fetch_neighbors(i, 0, lists[i]);
+    }
+
+    std::vector<idx_t> perm;
+    perm.reserve(ntotal);
+    std::vector<bool> placed(ntotal);
+    std::deque<storage_idx_t> queue;
+    auto seed = [&](storage_idx_t v) {
+        if (!placed[v]) {
+            placed[v] = true;
+            queue.push_back(v);
+        }
+    };
+    // breadth-first traversal from the seeded nodes, in list order or by
+    // increasing degree
+    std::vector<storage_idx_t> next;
+    auto traverse = [&](bool by_degree) {
+        while (!queue.empty()) {
+            storage_idx_t v = queue.front();
+            queue.pop_front();
+            perm.push_back(v);
+            next.clear();
+            for (storage_idx_t v1 : lists[v]) {
+                if (!placed[v1]) {
+                    placed[v1] = true;
+                    next.push_back(v1);
+                }
+            }
+            if (by_degree) {
+                std::stable_sort(
+                        next.begin(),
+                        next.end(),
+                        [&](storage_idx_t a, storage_idx_t b) {
+                            return lists[a].size() < lists[b].size();
+                        });
+            }
+            queue.insert(queue.end(), next.begin(), next.end());
+        }
+    };
+
+    if (type == REORDER_BFS) {
+        if (entry_point >= 0) {
+            seed(entry_point);
+            traverse(false);
+        }
+        for (size_t i = 0; i < ntotal; i++) {
+            seed(i);
+            traverse(false);
+        }
+    } else if (type == REORDER_RCM) {
+        // reverse Cuthill-McKee: each component starts from its node of
+        // lowest degree
+        std::vector<storage_idx_t> by_degree(ntotal);
+        std::iota(by_degree.begin(), by_degree.end(), 0);
+        std::stable_sort(
+                by_degree.begin(),
+                by_degree.end(),
+                [&](storage_idx_t a, storage_idx_t b) {
+                    return lists[a].size() < lists[b].size();
+                });
+        for (storage_idx_t i : by_degree) {
+            seed(i);
+            traverse(true);
+        }
+        std::reverse(perm.begin(), perm.end());
+    } else if (type == REORDER_VISIT_FREQUENCY) {
+        FAISS_THROW_IF_NOT_MSG(visit_counts, "visit counts are required");
+        // visited nodes first, by decreasing frequency
+        std::vector<std::pair<size_t, idx_t>> hot;
+        for (const auto& [id, count] : *visit_counts) {
+            FAISS_THROW_IF_NOT(id >= 0 && (size_t)id < ntotal);
+            if (count > 0) {
+                hot.emplace_back(count, id);
+            }
+        }
+        std::sort(hot.begin(), hot.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first ||
+                    (a.first == b.first && a.second < b.second);
+        });
+        for (const auto& h : hot) {
+            placed[h.second] = true;
+            perm.push_back(h.second);
+        }
+        // then the other nodes in BFS order from the hot ones
+        size_t nhot = perm.size();
+        for (size_t i = 0; i < nhot; i++) {
+            for (storage_idx_t v1 : lists[perm[i]]) {
+                seed(v1);
+            }
+        }
+        traverse(false);
+        for (size_t i = 0; i < ntotal; i++) {
+            seed(i);
+            traverse(false);
+        }
+    } else {
+        FAISS_THROW_FMT("unknown reorder type %d", (int)type);
+    }
+    FAISS_ASSERT(perm.size() == ntotal);
+    return perm;
 }
 
 /**************************************************************
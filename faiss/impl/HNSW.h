@@ -8,6 +8,7 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <queue>
 #include <unordered_map>
@@ -48,6 +49,12 @@ namespace faiss {
 struct VisitedTable;
 struct DistanceComputer; // from AuxIndexStructures
 struct HNSWStats;
+struct ZmqEmbeddingCache;
+struct EmbeddingProvider;
+struct GraphPageCache;
+struct HNSWVisitProfiler;
+struct ProductQuantizer;
+struct SearchEffortPredictor;
 template <class C>
 struct ResultHandler;
 
@@ -69,9 +76,118 @@ struct SearchParametersHNSW : SearchParameters {
     int zmq_port = 5557;
     //     bool cache_distances = false;
 
+    /// Speculative fetch: while the distances of the current beam are being
+    /// added to the heaps, the distances to the unvisited neighbors of the
+    /// pipeline_depth * beam nodes most likely to be expanded next are
+    /// requested asynchronously, so that the recompute round trip overlaps
+    /// with the CPU work. 0 = disabled. Not used with PQ pruning.
+    int pipeline_depth = 0;
+
+    /// In recompute mode, merge the embedding requests of the queries
+    /// searched concurrently by IndexHNSW::search into larger requests
+    /// (see ZmqRequestCoalescer). Distances are then computed locally from
+    /// the fetched embeddings.
+    bool coalesce_requests = false;
+
+    /// In recompute mode, embedding cache shared by the searching threads
+    /// (not owned). Distances are then computed locally from the cached or
+    /// fetched embeddings.
+    ZmqEmbeddingCache* embedding_cache = nullptr;
+
+    /// In recompute mode, have the server compute the distances: the query
+    /// is pinned on the server once per search and only the distances are
+    /// returned (see pin_query_raw). Requires a raw frame endpoint
+    /// (ZmqConnectionPool::set_endpoint). Ignored with an embedding cache,
+    /// coalesced requests or an EmbeddingProvider.
+    bool server_side_distances = false;
+
+    /// Early termination of the level 0 search (see
+    /// HNSW::early_stop_patience). -1 = use the value of the HNSW, 0 =
+    /// disabled.
+    int early_stop_patience = -1;
+
+    /// Counts the level 0 node visits of the (sampled) queries, shared by
+    /// the searching threads (not owned).
+    HNSWVisitProfiler* visit_profiler = nullptr;
+
+    /// Query-adaptive termination: after effort_predictor->nfeatures
+    /// expansion rounds of level 0, the search is capped to the predicted
+    /// nb of expansions (counted in HNSWStats::n_early_stops). Not owned.
+    const SearchEffortPredictor* effort_predictor = nullptr;
+    /// if non-null, size n * effort_predictor->nfeatures (IndexHNSW): the
+    /// features of the queries are stored there, to train the predictor
+    float* effort_features = nullptr;
+
+    /// nb of level 0 entry points selected by IndexHNSW::entry_points
+    /// instead of descending the upper levels. -1 = the nprobe of the
+    /// entry point table, 0 = descend the upper levels.
+    int n_entry_points = -1;
+
+    /// IndexHNSW::search traverses groups of lockstep_queries queries
+    /// together: at each step the union of the frontiers of the group is
+    /// fetched once (embedding server, provider or storage reconstruction)
+    /// and the distances are computed as a query x vector matrix. Pays off
+    /// for batches of similar queries (eg. reformulations of a question)
+    /// whose traversals overlap. The selector is applied as a post-filter.
+    /// 0 or 1 = disabled.
+    int lockstep_queries = 0;
+
+    /** Range search: besides the efSearch closest nodes, the level 0
+     * traversal expands all the nodes within radius + range_slack *
+     * |radius| (in the orientation of HNSW::C), so that the nb of results
+     * is not capped by efSearch. The slack lets the traversal cross the
+     * nodes just outside the ball that lead to other results. < 0 = use
+     * the value of the HNSW, where < 0 selects the kNN traversal of
+     * efSearch nodes, filtered by radius. */
+    float range_slack = -1;
+
+    /// How the selector (sel) is applied
+    enum FilterStrategy {
+        /// pick one of the strategies below from the selectivity
+        /// (IDSelector::estimate_cardinality / ntotal)
+        FILTER_AUTO = 0,
+        /// traverse all nodes, drop the unselected ones from the results
+        FILTER_POST,
+        /// distances only to the selected nodes, the unselected neighbors
+        /// are skipped over to their own neighbors (ACORN-1)
+        FILTER_TWO_HOP,
+        /// exhaustive search of the selected nodes (IndexHNSW only)
+        FILTER_BRUTE_FORCE,
+    };
+    FilterStrategy filter_strategy = FILTER_AUTO;
+    /// FILTER_AUTO thresholds: brute force below filter_brute_force_ratio
+    /// selectivity, two-hop below filter_two_hop_ratio, else post-filter
+    float filter_brute_force_ratio = 0.01;
+    float filter_two_hop_ratio = 0.3;
+
     ~SearchParametersHNSW() {}
 };
 
+/** Per-node lock for concurrent construction. The critical sections of
+ * add_link are a few hundred cycles, so a test-and-test-and-set spinlock
+ * avoids the call overhead of omp_set_lock and takes one byte per node
+ * instead of an omp_lock_t. Readers of the neighbor lists never take it. */
+struct HNSWSpinLock {
+    std::atomic<bool> locked{false};
+
+    void lock() {
+        for (;;) {
+            if (!locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            while (locked.load(std::memory_order_relaxed)) {
+#ifdef __x86_64__
+                __builtin_ia32_pause();
+#endif
+            }
+        }
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
 class IndexHNSW;
 struct HNSW {
     /// internal storage of vectors (32 bits: this is expensive)
@@ -188,11 +304,18 @@ struct HNSW {
     std::vector<int> cum_nneighbor_per_level;
 
     /// level of each vector (base level = 1), size = ntotal
-    std::vector<int> levels;
+    MaybeOwnedVector<int> levels;
+
+    /// deleted[i] != 0 if vector i is a tombstone: it is still traversed by
+    /// the search but it is not returned. Empty if nothing was deleted.
+    std::vector<uint8_t> deleted;
+
+    /// nb of tombstones in deleted
+    size_t n_deleted = 0;
 
     /// offsets[i] is the offset in the neighbors array where vector i is stored
     /// size ntotal + 1
-    std::vector<size_t> offsets;
+    MaybeOwnedVector<size_t> offsets;
 
     /// neighbors[offsets[i]:offsets[i+1]] is the list of neighbors of vector i
     /// for all levels. this is where all storage goes.
@@ -204,6 +327,16 @@ struct HNSW {
     MaybeOwnedVector<size_t> compact_level_ptr;             // CSR indptr part 1
     MaybeOwnedVector<size_t> compact_node_offsets;          // CSR indptr part 2
 
+    /** if set, write_index stores the compact neighbor lists sorted, delta
+     * coded and bit-packed (see encode_neighbor_list) instead of raw
+     * int32. It is set when such an index is read: in memory the lists
+     * are decoded to compact_neighbors_data, when read on demand (mmap or
+     * pread) fetch_neighbors decodes them. */
+    bool compress_neighbors = false;
+    /// byte offsets of the compressed lists on disk, same layout as
+    /// compact_level_ptr. Only set when the neighbors are read on demand
+    MaybeOwnedVector<size_t> compressed_level_ptr;
+
     /// entry point in the search structure (one of the points with maximum
     /// level
     storage_idx_t entry_point = -1;
@@ -219,6 +352,15 @@ struct HNSW {
     /// expansion factor at search time
     int efSearch = 16;
 
+    /** adaptive early termination: the level 0 search stops when the
+     * results have not improved for early_stop_patience consecutive
+     * rounds of expansions. Easy queries converge after few rounds and
+     * stop well before efSearch is exhausted. Set by
+     * calibrate_hnsw_early_stop for a target recall, 0 = disabled. */
+    int early_stop_patience = 0;
+    /// recall targeted by the calibration of early_stop_patience
+    float early_stop_target_recall = 0;
+
     bool neighbors_on_disk = false;
     std::string hnsw_index_filename; // Used for pread
     int graph_fd = -1;               // File descriptor for pread
@@ -228,9 +370,14 @@ struct HNSW {
                                        // mmap: relative offset (debug)
     storage_idx_t* neighbors_mmap_ptr =
             nullptr; // For mmap: pointer to neighbor data in memory
+                     // (bytes if compress_neighbors)
     bool neighbors_use_mmap =
             false; // Whether to use mmap pointer instead of pread
 
+    /// pages of the on-disk neighbor lists kept in memory (pread mode), see
+    /// enable_graph_page_cache
+    std::shared_ptr<GraphPageCache> graph_page_cache;
+
     /// during search: do we check whether the next best distance is good
     /// enough?
     bool check_relative_distance = true;
@@ -259,6 +406,14 @@ struct HNSW {
     void neighbor_range(idx_t no, int layer_no, size_t* begin, size_t* end)
             const;
 
+    /// range of bytes of the list of vertex no at layer_no in the neighbors
+    /// data read on demand (compressed or not)
+    void neighbor_byte_range(
+            idx_t no,
+            int layer_no,
+            size_t* begin,
+            size_t* end) const;
+
     /// only mandatory parameter: nb of neighbors
     explicit HNSW(int M = 32, int M0 = -1);
 
@@ -278,6 +433,17 @@ struct HNSW {
             VisitedTable& vt,
             bool keep_max_size_level0 = false);
 
+    /// same, with spinlocks
+    void add_links_starting_from(
+            DistanceComputer& ptdis,
+            storage_idx_t pt_id,
+            storage_idx_t nearest,
+            float d_nearest,
+            int level,
+            HNSWSpinLock* locks,
+            VisitedTable& vt,
+            bool keep_max_size_level0 = false);
+
     /** add point pt_id on all levels <= pt_level and build the link
      * structure for them. */
     void add_with_locks(
@@ -288,6 +454,15 @@ struct HNSW {
             VisitedTable& vt,
             bool keep_max_size_level0 = false);
 
+    /// same, with spinlocks
+    void add_with_locks(
+            DistanceComputer& ptdis,
+            int pt_level,
+            int pt_id,
+            std::vector<HNSWSpinLock>& locks,
+            VisitedTable& vt,
+            bool keep_max_size_level0 = false);
+
     /// search interface for 1 point, single thread
     HNSWStats search(
             DistanceComputer& qdis,
@@ -296,6 +471,19 @@ struct HNSW {
             const SearchParameters* params = nullptr,
             const IndexHNSW* hnsw = nullptr) const;
 
+    /** same as search, but the level 0 search starts from the given nodes
+     * (eg. selected by HNSWEntryPoints) instead of the node found by the
+     * greedy descent of the upper levels, which are not traversed.
+     * Negative entries are ignored. */
+    HNSWStats search_from_entry_points(
+            DistanceComputer& qdis,
+            ResultHandler<C>& res,
+            VisitedTable& vt,
+            int nentry,
+            const storage_idx_t* entry_ids,
+            const SearchParameters* params = nullptr,
+            const IndexHNSW* hnsw = nullptr) const;
+
     /// search only in level 0 from a given vertex
     void search_level_0(
             DistanceComputer& qdis,
@@ -322,30 +510,179 @@ struct HNSW {
             int max_size,
             bool keep_max_size_level0 = false);
 
+    /// map[new id] = old id. The neighbors must be in memory (either
+    /// storage format), the PQ pruning codes are permuted as well.
     void permute_entries(const idx_t* map);
 
+    bool is_deleted(storage_idx_t i) const {
+        return !deleted.empty() && deleted[i];
+    }
+
+    /** Replace the deleted nodes in the list of node at this level by their
+     * own live neighbors, and select among them with the neighbor pruning
+     * heuristic (FreshDiskANN-style repair). Only the list of node is
+     * modified, so different nodes can be repaired in parallel. Returns
+     * whether the list contained deleted nodes. */
+    bool repair_links(DistanceComputer& dis, storage_idx_t node, int level);
+
+    /// if the entry point is deleted, replace it with a live node
+    void update_entry_point_after_delete();
+
+    /** remove the deleted nodes from the graph, the remaining ones are
+     * renumbered in order. The links to deleted nodes are dropped, so the
+     * graph should be repaired first. */
+    void remove_deleted();
+
+    enum ReorderType {
+        /// breadth-first from the entry point on level 0
+        REORDER_BFS = 0,
+        /// reverse Cuthill-McKee (bandwidth reduction)
+        REORDER_RCM = 1,
+        /// hot nodes first by decreasing visit count (see
+        /// HNSWVisitProfiler::visit_counts), then BFS from them
+        REORDER_VISIT_FREQUENCY = 2,
+    };
+
+    /** Node permutation (new id -> old id, as taken by permute_entries)
+     * that puts nodes that are traversed together next to each other, so
+     * that a neighbor list and the ones of its neighbors tend to share disk
+     * pages once the graph is written in compact format. */
+    std::vector<idx_t> locality_order(
+            ReorderType type,
+            const std::unordered_map<idx_t, size_t>* visit_counts =
+                    nullptr) const;
+
     void save_degree_distribution(int level, const char* filename) const;
 
+    /// nb of neighbors of each vector at level (0 if it is not on level)
+    std::vector<int32_t> get_degrees(int level) const;
+
+    /** convert the graph to the compact CSR storage (only the valid
+     * neighbors are kept), the original storage is freed. The graph cannot
+     * be extended afterwards. */
+    void convert_to_compact();
+
+    /** append the n neighbor ids of a list to out, sorted (in place) and
+     * compressed: bit width of the gaps (1 byte), first id (4 bytes), then
+     * the n - 1 gaps bit-packed */
+    static void encode_neighbor_list(
+            storage_idx_t* ids,
+            size_t n,
+            std::vector<uint8_t>& out);
+
+    /// decode a list of n neighbors written by encode_neighbor_list
+    static void decode_neighbor_list(
+            const uint8_t* data,
+            size_t n,
+            storage_idx_t* ids);
+
+    /** compress all the lists of the compact storage, level_ptr gets the
+     * byte offsets of the lists in data (same layout as compact_level_ptr) */
+    void compress_neighbor_lists(
+            std::vector<uint8_t>& data,
+            std::vector<size_t>& level_ptr) const;
+
+    /// default of SearchParametersHNSW::pq_pruning_ratio for the searches
+    /// without parameters
     float pq_pruning_ratio = 0;
 
+    /// defaults of the SearchParametersHNSW fields of the same names for
+    /// the searches without parameters (not stored in the index file)
+    int beam_size = 1;
+    int batch_size = 0;
+    bool local_prune = false;
+    float send_neigh_times_ratio = 0;
+    float range_slack = 0.1;
+
+    /// DiskANN-style pivots loaded by load_pq_pruning_data
     std::shared_ptr<PQPrunerDataLoader> pq_data_loader;
-    std::vector<uint8_t> pq_codes; // PQ codes of all vectors (N * code_size)
-    size_t code_size = 0;          // number of chunks per vector
 
+    /** PQ codes used for pruning. Flat codes of all vectors (ntotal *
+     * code_size), except with a 4-bit pruning_pq: then each node stores the
+     * codes of its level 0 neighbors packed in blocks of 32 as in
+     * pq4_fast_scan, so the approximate distances of a whole neighbor list
+     * come from one pass of the fast-scan kernel, and code_size is the size
+     * of the blocks of a node. Can be a view of an mmapped index file. */
+    MaybeOwnedVector<uint8_t> pq_codes;
+    size_t code_size = 0;
+
+    /// load DiskANN pq_pivots / pq_compressed bin files (not serialized)
     bool load_pq_pruning_data(
             const std::string& pq_pivots_path,
             const std::string& pq_compressed_path);
 
     bool pq_loaded = false;
 
-    // On-demand neighbor fetch method
+    /// native PQ used for pruning instead of pq_data_loader, serialized
+    /// with the index
+    std::shared_ptr<ProductQuantizer> pruning_pq;
+    MetricType pruning_metric = METRIC_L2;
+
+    /** set up the PQ pruning from a native PQ. With nbits = 4 the neighbor
+     * lists are copied into the codes, so this must be called once the graph
+     * is final (it can still be permuted).
+     * @param pq     trained PQ with nbits = 4 or 8
+     * @param codes  codes of all the vectors, size ntotal * pq.code_size
+     */
+    void set_pq_pruning_codes(
+            const ProductQuantizer& pq,
+            const uint8_t* codes,
+            MetricType metric = METRIC_L2);
+
+    /// distance table of query x for pruning_pq (size M * ksub)
+    void pruning_distance_table(const float* x, float* dis_table) const;
+
+    /** quantized look-up table of query x for a 4-bit pruning_pq
+     * @param lut  output, size 16 * M rounded up to even, 32-byte aligned
+     * @param a    output scaling, the distances are b + accu / a
+     */
+    void pq4_compute_lut(const float* x, uint8_t* lut, float* a, float* b)
+            const;
+
+    /// approximate distances to the n first level 0 neighbors of node
+    void pq4_neighbor_distances(
+            idx_t node,
+            size_t n,
+            const uint8_t* lut,
+            float a,
+            float b,
+            float* dis) const;
+
+    /** On-demand neighbor fetch method
+     * @param n_ios  if not null, incremented by the nb of reads from the
+     *               graph storage: one per list, or the nb of missed pages
+     *               when the graph page cache is enabled
+     */
     size_t fetch_neighbors(
             idx_t node_id,
             int level,
-            std::vector<storage_idx_t>& buffer) const;
+            std::vector<storage_idx_t>& buffer,
+            size_t* n_ios = nullptr) const;
+
+    /** Neighbor lists of n nodes at once. When the neighbors are read from
+     * disk with pread, all the reads are submitted together (see
+     * BatchedFileReader) instead of one syscall per node.
+     * @return nb of reads from the graph storage, as for fetch_neighbors */
+    size_t fetch_neighbors_batch(
+            size_t n,
+            const idx_t* node_ids,
+            int level,
+            std::vector<std::vector<storage_idx_t>>& buffers) const;
 
     void initialize_graph(const std::string& index_filename);
 
+    /** Cache the pages of the on-disk neighbor lists (pread mode) in a
+     * GraphPageCache shared by the search threads. The lists of all levels
+     * > 0 are pinned, as well as the level 0 lists of hot_nodes. By
+     * default, the hot nodes are the ones that appear on levels > 0, ie.
+     * the neighborhood where the level 0 searches start.
+     * capacity_bytes = 0 only keeps the pinned pages. Must be called after
+     * initialize_graph, and not during a search. */
+    void enable_graph_page_cache(
+            size_t capacity_bytes,
+            const std::vector<idx_t>* hot_nodes = nullptr,
+            size_t page_size = 4096);
+
     ~HNSW(); // Close file descriptor
     std::vector<int> ems;
 };
@@ -360,8 +697,15 @@ struct HNSWStats {
     size_t nfetch = 0; /// number of neighbors fetched
     size_t n_ios = 0;  /// number of neighbors fetched on demand
     size_t n_pq_calcs = 0;
-
-    // Track visited node counts
+    size_t nspec = 0;      /// number of distances fetched speculatively
+    size_t nspec_hits = 0; /// speculative distances that were used
+    size_t ncache_hits = 0;   /// embeddings found in the embedding cache
+    size_t ncache_misses = 0; /// embeddings fetched despite the cache
+    size_t n_early_stops = 0; /// searches stopped by early_stop_patience
+    size_t n_budget_stops = 0; /// searches stopped by the search budget
+
+    /// Visited node counts. Not filled by the search, which counts the
+    /// visits with SearchParametersHNSW::visit_profiler instead.
     std::unordered_map<idx_t, size_t> node_visit_counts;
 
     void reset() {
@@ -372,6 +716,12 @@ struct HNSWStats {
         nfetch = 0;
         n_ios = 0;
         n_pq_calcs = 0;
+        nspec = 0;
+        nspec_hits = 0;
+        ncache_hits = 0;
+        ncache_misses = 0;
+        n_early_stops = 0;
+        n_budget_stops = 0;
         // printf("Resetting node visit counts\n");
         // printf("Original size: %zu\n", node_visit_counts.size());
         node_visit_counts.clear();
@@ -386,6 +736,12 @@ struct HNSWStats {
         nfetch += other.nfetch;
         n_ios += other.n_ios;
         n_pq_calcs += other.n_pq_calcs;
+        nspec += other.nspec;
+        nspec_hits += other.nspec_hits;
+        ncache_hits += other.ncache_hits;
+        ncache_misses += other.ncache_misses;
+        n_early_stops += other.n_early_stops;
+        n_budget_stops += other.n_budget_stops;
 
         // Combine node visit counts
         // printf("Two sizes: %zu, %zu\n",
@@ -471,6 +827,26 @@ int search_from_candidates(
         const SearchParameters* params = nullptr,
         const IndexHNSW* hnsw_index = nullptr);
 
+/** Level 0 search with FILTER_TWO_HOP: the distances are computed only to
+ * the selected nodes. The unselected neighbors of an expanded node are
+ * traversed without computing their distance, their own neighbors are
+ * considered instead, up to nb_neighbors(0) per expanded node. */
+int search_from_candidates_two_hop(
+        const HNSW& hnsw,
+        DistanceComputer& qdis,
+        ResultHandler<HNSW::C>& res,
+        HNSW::MinimaxHeap& candidates,
+        VisitedTable& vt,
+        HNSWStats& stats,
+        const IDSelector& sel,
+        int efSearch);
+
+/// strategy for the selector of params on a graph of ntotal nodes, with
+/// FILTER_AUTO resolved. FILTER_POST if there is no selector.
+SearchParametersHNSW::FilterStrategy hnsw_filter_strategy(
+        const SearchParameters* params,
+        idx_t ntotal);
+
 HNSWStats greedy_update_nearest(
         const HNSW& hnsw,
         DistanceComputer& qdis,
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWEntryPoints.h>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+HNSWEntryPoints::HNSWEntryPoints(int d, MetricType metric_type)
+        : d(d), metric_type(metric_type) {
+    FAISS_THROW_IF_NOT(
+            metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT);
+}
+
+void HNSWEntryPoints::add(
+        size_t n,
+        const float* x,
+        const storage_idx_t* nodes_in) {
+    centroids.insert(centroids.end(), x, x + n * d);
+    nodes.insert(nodes.end(), nodes_in, nodes_in + n);
+}
+
+void HNSWEntryPoints::renumber_nodes(const idx_t* new_ids) {
+    for (storage_idx_t& node : nodes) {
+        if (node >= 0) {
+            node = new_ids[node];
+        }
+    }
+}
+
+void HNSWEntryPoints::select(const float* x, int nprobe, storage_idx_t* out)
+        const {
+    FAISS_THROW_IF_NOT(nprobe > 0);
+    // the table is small: a sequential scan with a heap
+    std::vector<float> dis(nprobe);
+    std::vector<idx_t> idx(nprobe);
+    bool is_ip = metric_type == METRIC_INNER_PRODUCT;
+    if (is_ip) {
+        minheap_heapify(nprobe, dis.data(), idx.data());
+    } else {
+        maxheap_heapify(nprobe, dis.data(), idx.data());
+    }
+    for (size_t i = 0; i < size(); i++) {
+        const float* c = centroids.data() + i * d;
+        if (is_ip) {
+            float ip = fvec_inner_product(x, c, d);
+            if (ip > dis[0]) {
+                minheap_replace_top(nprobe, dis.data(), idx.data(), ip, i);
+            }
+        } else {
+            float l2 = fvec_L2sqr(x, c, d);
+            if (l2 < dis[0]) {
+                maxheap_replace_top(nprobe, dis.data(), idx.data(), l2, i);
+            }
+        }
+    }
+    if (is_ip) {
+        minheap_reorder(nprobe, dis.data(), idx.data());
+    } else {
+        maxheap_reorder(nprobe, dis.data(), idx.data());
+    }
+    for (int j = 0; j < nprobe; j++) {
+        out[j] = idx[j] >= 0 ? nodes[idx[j]] : -1;
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <faiss/MetricType.h>
+#include <faiss/impl/HNSW.h>
+
+namespace faiss {
+
+/** Table of level 0 entry points for the HNSW search. The search of a
+ * query starts from the nodes of the nprobe representatives closest to the
+ * query, instead of the node found by the greedy descent of the upper
+ * levels. The representatives are compared to the query in RAM, whereas
+ * in recompute mode each upper level hop costs an embedding fetch.
+ *
+ * The representatives are typically k-means centroids of the database
+ * vectors, each mapped to the graph node closest to it (see
+ * IndexHNSW::train_entry_points). The table is not stored in the index
+ * file.
+ */
+struct HNSWEntryPoints {
+    using storage_idx_t = HNSW::storage_idx_t;
+
+    int d;
+    MetricType metric_type;
+
+    /// representatives, size size() * d
+    std::vector<float> centroids;
+    /// graph node of each representative
+    std::vector<storage_idx_t> nodes;
+
+    /// default nb of entry points per query
+    int nprobe = 4;
+
+    explicit HNSWEntryPoints(int d = 0, MetricType metric_type = METRIC_L2);
+
+    /// append n representatives and their graph nodes
+    void add(size_t n, const float* x, const storage_idx_t* nodes);
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    /// renumber the nodes after the graph is permuted or compacted,
+    /// new_ids[old id] = new id, -1 if the node was removed
+    void renumber_nodes(const idx_t* new_ids);
+
+    /** nodes of the nprobe representatives closest to x (according to
+     * metric_type), in order of increasing distance. Padded with -1 if the
+     * table is smaller than nprobe. */
+    void select(const float* x, int nprobe, storage_idx_t* out) const;
+};
+
+} // namespace faiss
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWNodeBlocks.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/BatchedFileReader.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+namespace {
+
+const char node_blocks_magic[4] = {'F', 'N', 'B', 'K'};
+
+/// header, stored at the start of block 0
+struct NodeBlocksHeader {
+    char magic[4];
+    uint32_t version;
+    int64_t d;
+    int64_t ntotal;
+    int64_t max_degree;
+    int64_t node_size;
+    int64_t block_size;
+    int64_t nodes_per_block;
+    int64_t blocks_per_node;
+};
+
+} // namespace
+
+HNSWNodeBlocks::HNSWNodeBlocks(const char* fname, bool use_direct_io)
+        : fname(fname) {
+#ifdef __linux__
+    if (use_direct_io) {
+        fd = open(fname, O_RDONLY | O_CLOEXEC | O_DIRECT);
+    }
+#endif
+    if (fd < 0) {
+        fd = open(fname, O_RDONLY | O_CLOEXEC);
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0, "cannot open node blocks %s: %s", fname, strerror(errno));
+
+    NodeBlocksHeader header;
+    try {
+        BatchedFileReader::thread_local_reader().read(
+                fd, {{0, sizeof(header), &header}});
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    if (memcmp(header.magic, node_blocks_magic, 4) != 0 ||
+        header.version != 1) {
+        close(fd);
+        FAISS_THROW_FMT("%s is not a node block file", fname);
+    }
+    d = header.d;
+    ntotal = header.ntotal;
+    max_degree = header.max_degree;
+    node_size = header.node_size;
+    block_size = header.block_size;
+    nodes_per_block = header.nodes_per_block;
+    blocks_per_node = header.blocks_per_node;
+}
+
+HNSWNodeBlocks::~HNSWNodeBlocks() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+off_t HNSWNodeBlocks::node_offset(idx_t i) const {
+    FAISS_THROW_IF_NOT_FMT(
+            i >= 0 && i < ntotal,
+            "node %ld out of range [0, %ld)",
+            (long)i,
+            (long)ntotal);
+    if (nodes_per_block > 0) {
+        return (off_t)(1 + i / nodes_per_block) * block_size +
+                (off_t)(i % nodes_per_block) * node_size;
+    }
+    return (off_t)(1 + i * blocks_per_node) * block_size;
+}
+
+void HNSWNodeBlocks::write(
+        const IndexHNSW& index,
+        const char* fname,
+        const float* x,
+        size_t block_size) {
+    const HNSW& hnsw = index.hnsw;
+    FAISS_THROW_IF_NOT_MSG(
+            x || index.storage, "the vectors or the storage are required");
+    FAISS_THROW_IF_NOT(block_size >= sizeof(NodeBlocksHeader));
+
+    NodeBlocksHeader header;
+    memcpy(header.magic, node_blocks_magic, 4);
+    header.version = 1;
+    header.d = index.d;
+    header.ntotal = index.ntotal;
+    header.max_degree = hnsw.nb_neighbors(0);
+    header.node_size = sizeof(storage_idx_t) * (1 + header.max_degree) +
+            sizeof(float) * header.d;
+    header.block_size = block_size;
+    header.nodes_per_block = block_size / header.node_size;
+    header.blocks_per_node = header.nodes_per_block > 0
+            ? 0
+            : (header.node_size + block_size - 1) / block_size;
+
+    FILE* f = fopen(fname, "wb");
+    FAISS_THROW_IF_NOT_FMT(
+            f, "cannot open %s for writing: %s", fname, strerror(errno));
+    std::unique_ptr<FILE, int (*)(FILE*)> f_guard(f, fclose);
+
+    std::vector<char> block(block_size);
+    auto write_block = [&](const char* data, size_t size) {
+        FAISS_THROW_IF_NOT_FMT(
+                fwrite(data, 1, size, f) == size,
+                "write error on %s: %s",
+                fname,
+                strerror(errno));
+    };
+    memcpy(block.data(), &header, sizeof(header));
+    write_block(block.data(), block_size);
+
+    size_t nodes_per_run = std::max(header.nodes_per_block, (int64_t)1);
+    size_t run_size = header.nodes_per_block > 0
+            ? block_size
+            : header.blocks_per_node * block_size;
+    std::vector<char> run(run_size);
+    std::vector<storage_idx_t> list;
+    std::vector<float> vec(index.d);
+    for (idx_t i0 = 0; i0 < index.ntotal; i0 += nodes_per_run) {
+        std::fill(run.begin(), run.end(), 0);
+        idx_t i1 = std::min(i0 + (idx_t)nodes_per_run, index.ntotal);
+        for (idx_t i = i0; i < i1; i++) {
+            char* node = run.data() + (i - i0) * header.node_size;
+            hnsw.fetch_neighbors(i, 0, list);
+            storage_idx_t degree = list.size();
+            list.resize(header.max_degree, -1);
+            memcpy(node, &degree, sizeof(degree));
+            memcpy(node + sizeof(degree),
+                   list.data(),
+                   sizeof(storage_idx_t) * header.max_degree);
+            if (x) {
+                memcpy(vec.data(), x + i * index.d, sizeof(float) * index.d);
+            } else {
+                index.storage->reconstruct(i, vec.data());
+            }
+            memcpy(node + sizeof(storage_idx_t) * (1 + header.max_degree),
+                   vec.data(),
+                   sizeof(float) * index.d);
+        }
+        write_block(run.data(), run.size());
+    }
+}
+
+void HNSWNodeBlocks::read_nodes(
+        size_t n,
+        const idx_t* ids,
+        float* vectors,
+        std::vector<std::vector<storage_idx_t>>* lists) const {
+    thread_local std::vector<char> buf;
+    buf.resize(n * node_size);
+    std::vector<BatchedFileReader::Request> requests(n);
+    for (size_t i = 0; i < n; i++) {
+        requests[i] = {
+                node_offset(ids[i]), node_size, buf.data() + i * node_size};
+    }
+    BatchedFileReader::thread_local_reader().read(fd, requests);
+
+    if (lists) {
+        lists->resize(n);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const char* node = buf.data() + i * node_size;
+        if (lists) {
+            storage_idx_t degree;
+            memcpy(&degree, node, sizeof(degree));
+            FAISS_THROW_IF_NOT_FMT(
+                    degree >= 0 && (size_t)degree <= max_degree,
+                    "corrupted node block for node %ld",
+                    (long)ids[i]);
+            (*lists)[i].resize(degree);
+            memcpy((*lists)[i].data(),
+                   node + sizeof(storage_idx_t),
+                   sizeof(storage_idx_t) * degree);
+        }
+        if (vectors) {
+            memcpy(vectors + i * d,
+                   node + sizeof(storage_idx_t) * (1 + max_degree),
+                   sizeof(float) * d);
+        }
+    }
+}
+
+/*************************************************************
+ * NodeBlockDistanceComputer
+ *************************************************************/
+
+NodeBlockDistanceComputer::NodeBlockDistanceComputer(
+        const HNSWNodeBlocks& blocks,
+        MetricType metric_type)
+        : blocks(blocks), metric_type(metric_type) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT,
+            "node blocks support L2 and inner product only");
+}
+
+void NodeBlockDistanceComputer::set_query(const float* x) {
+    q = x;
+    n_reads = 0;
+    std::lock_guard<std::mutex> lock(lists_mutex);
+    pending_lists.clear();
+}
+
+float NodeBlockDistanceComputer::distance_to(const float* x) const {
+    if (metric_type == METRIC_L2) {
+        return fvec_L2sqr(q, x, blocks.d);
+    }
+    return -fvec_inner_product(q, x, blocks.d);
+}
+
+float NodeBlockDistanceComputer::operator()(idx_t i) {
+    std::vector<float> dis(1);
+    distances_batch({i}, dis);
+    return dis[0];
+}
+
+void NodeBlockDistanceComputer::distances_batch(
+        const std::vector<idx_t>& ids,
+        std::vector<float>& distances_out) {
+    size_t n = ids.size();
+    std::vector<float> vectors(n * blocks.d);
+    std::vector<std::vector<HNSWNodeBlocks::storage_idx_t>> lists;
+    blocks.read_nodes(n, ids.data(), vectors.data(), &lists);
+    n_reads += n;
+    for (size_t i = 0; i < n; i++) {
+        distances_out[i] = distance_to(vectors.data() + i * blocks.d);
+    }
+    std::lock_guard<std::mutex> lock(lists_mutex);
+    for (size_t i = 0; i < n; i++) {
+        pending_lists[ids[i]].swap(lists[i]);
+    }
+}
+
+float NodeBlockDistanceComputer::symmetric_dis(idx_t i, idx_t j) {
+    std::vector<float> vectors(2 * blocks.d);
+    idx_t ids[2] = {i, j};
+    blocks.read_nodes(2, ids, vectors.data(), nullptr);
+    if (metric_type == METRIC_L2) {
+        return fvec_L2sqr(vectors.data(), vectors.data() + blocks.d, blocks.d);
+    }
+    return -fvec_inner_product(
+            vectors.data(), vectors.data() + blocks.d, blocks.d);
+}
+
+size_t NodeBlockDistanceComputer::take_neighbors(
+        size_t n,
+        const idx_t* ids,
+        std::vector<std::vector<HNSWNodeBlocks::storage_idx_t>>& lists) {
+    lists.resize(n);
+    std::vector<idx_t> missing;
+    std::vector<size_t> missing_idx;
+    {
+        std::lock_guard<std::mutex> lock(lists_mutex);
+        for (size_t i = 0; i < n; i++) {
+            auto it = pending_lists.find(ids[i]);
+            if (it != pending_lists.end()) {
+                lists[i].swap(it->second);
+                pending_lists.erase(it);
+            } else {
+                missing.push_back(ids[i]);
+                missing_idx.push_back(i);
+            }
+        }
+    }
+    if (missing.empty()) {
+        return 0;
+    }
+    std::vector<std::vector<HNSWNodeBlocks::storage_idx_t>> missing_lists;
+    blocks.read_nodes(
+            missing.size(), missing.data(), nullptr, &missing_lists);
+    for (size_t i = 0; i < missing.size(); i++) {
+        lists[missing_idx[i]].swap(missing_lists[i]);
+    }
+    return missing.size();
+}
+
+} // namespace faiss
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <sys/types.h> // For off_t
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <faiss/MetricType.h>
+#include <faiss/impl/DistanceComputer.h>
+
+namespace faiss {
+
+struct IndexHNSW;
+
+/** On-disk node blocks of an HNSW graph: each node's vector and level 0
+ * neighbor list are stored together, so that a single read returns both
+ * (as in DiskANN).
+ *
+ * Nodes are packed into blocks of block_size bytes (a multiple of the
+ * sector size, 4096 by default), and never straddle two blocks unless a node
+ * is larger than a block, in which case it gets a run of whole blocks.
+ * Block 0 is the header. A node is stored as its degree (int32), the
+ * max_degree neighbor slots (int32, unused ones are -1) and d floats.
+ *
+ * The upper levels of the graph are not stored in the node blocks.
+ */
+struct HNSWNodeBlocks {
+    typedef int32_t storage_idx_t;
+
+    size_t d = 0;
+    idx_t ntotal = 0;
+    size_t max_degree = 0;
+    size_t node_size = 0;
+    size_t block_size = 0;
+    /// nb of nodes per block, 0 if a node is larger than a block
+    size_t nodes_per_block = 0;
+    /// nb of blocks per node when nodes_per_block == 0
+    size_t blocks_per_node = 0;
+
+    std::string fname;
+
+    /// open a file written by write()
+    explicit HNSWNodeBlocks(const char* fname, bool use_direct_io = true);
+    ~HNSWNodeBlocks();
+
+    /** write the node blocks of index. The vectors are reconstructed from
+     * the storage, unless x (size ntotal * d) is provided, eg. for an index
+     * in recompute mode. */
+    static void write(
+            const IndexHNSW& index,
+            const char* fname,
+            const float* x = nullptr,
+            size_t block_size = 4096);
+
+    /// file offset of node i
+    off_t node_offset(idx_t i) const;
+
+    /** read n nodes with one batch of reads.
+     * @param vectors  output vectors (size n * d), or nullptr
+     * @param lists    output level 0 neighbor lists (size n), or nullptr
+     */
+    void read_nodes(
+            size_t n,
+            const idx_t* ids,
+            float* vectors,
+            std::vector<std::vector<storage_idx_t>>* lists) const;
+
+    HNSWNodeBlocks(const HNSWNodeBlocks&) = delete;
+    HNSWNodeBlocks& operator=(const HNSWNodeBlocks&) = delete;
+
+   private:
+    int fd = -1;
+};
+
+/** Distance computer that reads the vectors from the node blocks. The
+ * neighbor lists that come with them are kept until the node is expanded
+ * (see take_neighbors), so a hop costs a single read. Inner products are
+ * negated, as HNSW search expects. */
+struct NodeBlockDistanceComputer : DistanceComputer {
+    const HNSWNodeBlocks& blocks;
+    MetricType metric_type;
+    const float* q = nullptr;
+
+    /// nb of nodes read to compute distances since set_query
+    size_t n_reads = 0;
+
+    NodeBlockDistanceComputer(
+            const HNSWNodeBlocks& blocks,
+            MetricType metric_type);
+
+    void set_query(const float* x) override;
+
+    const float* get_query() override {
+        return q;
+    }
+
+    float operator()(idx_t i) override;
+
+    void distances_batch(
+            const std::vector<idx_t>& ids,
+            std::vector<float>& distances_out) override;
+
+    float symmetric_dis(idx_t i, idx_t j) override;
+
+    /** level 0 neighbor lists of n nodes, from the lists kept by the
+     * distance computations or read from the blocks otherwise.
+     * @return nb of nodes read */
+    size_t take_neighbors(
+            size_t n,
+            const idx_t* ids,
+            std::vector<std::vector<HNSWNodeBlocks::storage_idx_t>>& lists);
+
+   private:
+    float distance_to(const float* x) const;
+
+    /// distances may be computed in the background (see
+    /// SearchParametersHNSW::pipeline_depth)
+    std::mutex lists_mutex;
+    std::unordered_map<idx_t, std::vector<HNSWNodeBlocks::storage_idx_t>>
+            pending_lists;
+};
+
+} // namespace faiss
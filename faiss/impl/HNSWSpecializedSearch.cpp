@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWSpecializedSearch.h>
+
+#include <algorithm>
+#include <typeinfo>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/platform_macros.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+namespace {
+
+/*************************************************************
+ * Distances. They are plain structs, not DistanceComputers: the calls are
+ * resolved at compile time. Smaller is closer.
+ *************************************************************/
+
+template <bool is_ip>
+struct FlatDistance {
+    const float* xb;
+    size_t d;
+    const float* q = nullptr;
+
+    FlatDistance(const IndexFlat& storage)
+            : xb(storage.get_xb()), d(storage.d) {}
+
+    void set_query(const float* x) {
+        q = x;
+    }
+
+    float operator()(idx_t i) const {
+        if (is_ip) {
+            return -fvec_inner_product(q, xb + i * d, d);
+        } else {
+            return fvec_L2sqr(q, xb + i * d, d);
+        }
+    }
+
+    void distances_batch_4(
+            idx_t i0,
+            idx_t i1,
+            idx_t i2,
+            idx_t i3,
+            float& dis0,
+            float& dis1,
+            float& dis2,
+            float& dis3) const {
+        if (is_ip) {
+            fvec_inner_product_batch_4(
+                    q,
+                    xb + i0 * d,
+                    xb + i1 * d,
+                    xb + i2 * d,
+                    xb + i3 * d,
+                    d,
+                    dis0,
+                    dis1,
+                    dis2,
+                    dis3);
+            dis0 = -dis0;
+            dis1 = -dis1;
+            dis2 = -dis2;
+            dis3 = -dis3;
+        } else {
+            fvec_L2sqr_batch_4(
+                    q,
+                    xb + i0 * d,
+                    xb + i1 * d,
+                    xb + i2 * d,
+                    xb + i3 * d,
+                    d,
+                    dis0,
+                    dis1,
+                    dis2,
+                    dis3);
+        }
+    }
+};
+
+/* 8-bit scalar quantizer: component j decodes to offset[j] + scale[j] *
+ * code[j]. The query is folded into the per-dimension factors so that the
+ * loops over the codes have one multiply-add per component. */
+template <bool is_ip>
+struct SQ8Distance {
+    const uint8_t* codes;
+    size_t d;
+    std::vector<float> offset, scale;
+    // L2: q - offset, IP: q * scale
+    std::vector<float> qa;
+    // IP: <q, offset>
+    float bias = 0;
+
+    SQ8Distance(const IndexScalarQuantizer& storage)
+            : codes(storage.codes.data()),
+              d(storage.d),
+              offset(storage.d),
+              scale(storage.d),
+              qa(storage.d) {
+        const ScalarQuantizer& sq = storage.sq;
+        bool uniform = sq.qtype == ScalarQuantizer::QT_8bit_uniform;
+        const float* vmin = sq.trained.data();
+        const float* vdiff = vmin + (uniform ? 1 : d);
+        for (size_t j = 0; j < d; j++) {
+            float vd = uniform ? vdiff[0] : vdiff[j];
+            scale[j] = vd / 255.0f;
+            offset[j] = (uniform ? vmin[0] : vmin[j]) + 0.5f * scale[j];
+        }
+    }
+
+    void set_query(const float* x) {
+        bias = 0;
+        for (size_t j = 0; j < d; j++) {
+            if (is_ip) {
+                qa[j] = x[j] * scale[j];
+                bias += x[j] * offset[j];
+            } else {
+                qa[j] = x[j] - offset[j];
+            }
+        }
+    }
+
+    FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+    float operator()(idx_t i) const {
+        const uint8_t* c = codes + i * d;
+        const float* a = qa.data();
+        const float* s = scale.data();
+        float accu = 0;
+        FAISS_PRAGMA_IMPRECISE_LOOP
+        for (size_t j = 0; j < d; j++) {
+            if (is_ip) {
+                accu += a[j] * c[j];
+            } else {
+                float diff = a[j] - s[j] * c[j];
+                accu += diff * diff;
+            }
+        }
+        return is_ip ? -(bias + accu) : accu;
+    }
+    FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+    void distances_batch_4(
+            idx_t i0,
+            idx_t i1,
+            idx_t i2,
+            idx_t i3,
+            float& dis0,
+            float& dis1,
+            float& dis2,
+            float& dis3) const {
+        dis0 = (*this)(i0);
+        dis1 = (*this)(i1);
+        dis2 = (*this)(i2);
+        dis3 = (*this)(i3);
+    }
+};
+
+/*************************************************************
+ * Search
+ *************************************************************/
+
+using storage_idx_t = HNSW::storage_idx_t;
+
+int result_handler_k(ResultHandler<HNSW::C>& res) {
+    using RH = HeapBlockResultHandler<HNSW::C>;
+    if (auto hres = dynamic_cast<RH::SingleResultHandler*>(&res)) {
+        return hres->k;
+    }
+    return 1;
+}
+
+template <class Distance>
+struct HNSWSpecializedSearcherTemplate : HNSWSpecializedSearcher {
+    Distance dis;
+    HNSW::MinimaxHeap candidates{0};
+
+    explicit HNSWSpecializedSearcherTemplate(const Distance& dis)
+            : dis(dis) {}
+
+    void set_query(const float* x) override {
+        dis.set_query(x);
+    }
+
+    HNSWStats search(
+            const HNSW& hnsw,
+            ResultHandler<HNSW::C>& res,
+            VisitedTable& vt,
+            int efSearch,
+            bool check_relative_distance,
+            const IDSelector* sel) override {
+        if (sel || !hnsw.deleted.empty()) {
+            return search_t<true>(
+                    hnsw, res, vt, efSearch, check_relative_distance, sel);
+        } else {
+            return search_t<false>(
+                    hnsw, res, vt, efSearch, check_relative_distance, sel);
+        }
+    }
+
+    template <bool has_sel>
+    HNSWStats search_t(
+            const HNSW& hnsw,
+            ResultHandler<HNSW::C>& res,
+            VisitedTable& vt,
+            int efSearch,
+            bool do_dis_check,
+            const IDSelector* sel) {
+        HNSWStats stats;
+        if (hnsw.entry_point == -1) {
+            return stats;
+        }
+        const storage_idx_t* neighbors = hnsw.storage_is_compact
+                ? hnsw.compact_neighbors_data.data()
+                : hnsw.neighbors.data();
+        const uint8_t* tombstones =
+                hnsw.deleted.empty() ? nullptr : hnsw.deleted.data();
+        // whether id i can be returned
+        auto accept = [&](storage_idx_t i) {
+            return !has_sel ||
+                    ((!tombstones || !tombstones[i]) &&
+                     (!sel || sel->is_member(i)));
+        };
+
+        // greedy descent of the upper levels
+        storage_idx_t nearest = hnsw.entry_point;
+        float d_nearest = dis(nearest);
+        for (int level = hnsw.max_level; level >= 1; level--) {
+            for (;;) {
+                storage_idx_t prev_nearest = nearest;
+                size_t begin, end;
+                hnsw.neighbor_range(nearest, level, &begin, &end);
+                size_t j = begin;
+                for (; j + 4 <= end && neighbors[j + 3] >= 0; j += 4) {
+                    float d4[4];
+                    dis.distances_batch_4(
+                            neighbors[j],
+                            neighbors[j + 1],
+                            neighbors[j + 2],
+                            neighbors[j + 3],
+                            d4[0],
+                            d4[1],
+                            d4[2],
+                            d4[3]);
+                    for (int l = 0; l < 4; l++) {
+                        if (d4[l] < d_nearest) {
+                            d_nearest = d4[l];
+                            nearest = neighbors[j + l];
+                        }
+                    }
+                }
+                for (; j < end && neighbors[j] >= 0; j++) {
+                    float d = dis(neighbors[j]);
+                    if (d < d_nearest) {
+                        d_nearest = d;
+                        nearest = neighbors[j];
+                    }
+                }
+                stats.ndis += j - begin;
+                stats.nhops++;
+                if (nearest == prev_nearest) {
+                    break;
+                }
+            }
+        }
+
+        // level 0
+        int ef = std::max(efSearch, result_handler_k(res));
+        if (candidates.n != ef) {
+            candidates = HNSW::MinimaxHeap(ef);
+        } else {
+            candidates.clear();
+        }
+        candidates.push(nearest, d_nearest);
+        vt.set(nearest);
+        float threshold = res.threshold;
+        auto add = [&](storage_idx_t v, float d) {
+            if (d < threshold && accept(v) && res.add_result(d, v)) {
+                threshold = res.threshold;
+            }
+            candidates.push(v, d);
+        };
+        if (d_nearest < threshold && accept(nearest) &&
+            res.add_result(d_nearest, nearest)) {
+            threshold = res.threshold;
+        }
+
+        size_t ndis = 0;
+        int nstep = 0;
+        while (candidates.size() > 0) {
+            float d0 = 0;
+            int v0 = candidates.pop_min(&d0);
+            if (do_dis_check && candidates.count_below(d0) >= efSearch) {
+                break;
+            }
+            size_t begin, end;
+            hnsw.neighbor_range(v0, 0, &begin, &end);
+
+            storage_idx_t saved[4];
+            int nsaved = 0;
+            for (size_t j = begin; j < end; j++) {
+                storage_idx_t v1 = neighbors[j];
+                if (v1 < 0) {
+                    break;
+                }
+                if (vt.get(v1)) {
+                    continue;
+                }
+                vt.set(v1);
+                saved[nsaved++] = v1;
+                if (nsaved == 4) {
+                    float d4[4];
+                    dis.distances_batch_4(
+                            saved[0],
+                            saved[1],
+                            saved[2],
+                            saved[3],
+                            d4[0],
+                            d4[1],
+                            d4[2],
+                            d4[3]);
+                    for (int l = 0; l < 4; l++) {
+                        add(saved[l], d4[l]);
+                    }
+                    ndis += 4;
+                    nsaved = 0;
+                }
+            }
+            for (int l = 0; l < nsaved; l++) {
+                add(saved[l], dis(saved[l]));
+            }
+            ndis += nsaved;
+
+            nstep++;
+            if (!do_dis_check && nstep > efSearch) {
+                break;
+            }
+        }
+
+        stats.n1++;
+        if (candidates.size() == 0) {
+            stats.n2++;
+        }
+        stats.ndis += ndis;
+        stats.nhops += nstep;
+        vt.advance();
+        return stats;
+    }
+};
+
+template <class Distance>
+HNSWSpecializedSearcher* make_searcher(const Distance& dis) {
+    return new HNSWSpecializedSearcherTemplate<Distance>(dis);
+}
+
+} // namespace
+
+HNSWSpecializedSearcher* make_hnsw_specialized_searcher(const Index* storage) {
+    if (!storage) {
+        return nullptr;
+    }
+    MetricType mt = storage->metric_type;
+    if (mt != METRIC_L2 && mt != METRIC_INNER_PRODUCT) {
+        return nullptr;
+    }
+    bool is_ip = mt == METRIC_INNER_PRODUCT;
+    // the subclasses of IndexFlat may compute other distances
+    if (typeid(*storage) == typeid(IndexFlat) ||
+        typeid(*storage) == typeid(IndexFlatL2) ||
+        typeid(*storage) == typeid(IndexFlatIP)) {
+        auto flat = static_cast<const IndexFlat*>(storage);
+        if (is_ip) {
+            return make_searcher(FlatDistance<true>(*flat));
+        } else {
+            return make_searcher(FlatDistance<false>(*flat));
+        }
+    }
+    if (auto sq = dynamic_cast<const IndexScalarQuantizer*>(storage)) {
+        // quantize_query computes other distances
+        if ((sq->sq.qtype != ScalarQuantizer::QT_8bit &&
+             sq->sq.qtype != ScalarQuantizer::QT_8bit_uniform) ||
+            sq->sq.quantize_query) {
+            return nullptr;
+        }
+        if (is_ip) {
+            return make_searcher(SQ8Distance<true>(*sq));
+        } else {
+            return make_searcher(SQ8Distance<false>(*sq));
+        }
+    }
+    return nullptr;
+}
+
+} // namespace faiss
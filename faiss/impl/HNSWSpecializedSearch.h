@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/impl/HNSW.h>
+
+namespace faiss {
+
+struct IDSelector;
+struct Index;
+
+/** HNSW search specialized for an in-memory storage.
+ *
+ * The generic search goes through the virtual DistanceComputer for each
+ * neighbor and checks the selector and the tombstones for each candidate.
+ * The searcher returned by make_hnsw_specialized_searcher is instantiated
+ * for the concrete distance of the storage (the metric is part of it) and
+ * for the presence of a selector: the dispatch happens once per query and
+ * the distance loops are inlined in the graph traversal.
+ *
+ * It runs the classic HNSW search: greedy descent of the upper levels,
+ * then a bounded-queue search of level 0 that expands one node at a time.
+ * It supports none of the extensions of search_from_candidates (beams,
+ * PQ pruning, pipelining, budgets, early stopping, graphs on disk), the
+ * caller checks that they are disabled.
+ */
+struct HNSWSpecializedSearcher {
+    virtual void set_query(const float* x) = 0;
+
+    /** search the current query
+     *
+     * @param efSearch   size of the level 0 candidate queue (at least the
+     *                   nb of results of res)
+     * @param check_relative_distance  see HNSW::check_relative_distance
+     * @param sel        optional selector of the returned ids
+     */
+    virtual HNSWStats search(
+            const HNSW& hnsw,
+            ResultHandler<HNSW::C>& res,
+            VisitedTable& vt,
+            int efSearch,
+            bool check_relative_distance,
+            const IDSelector* sel) = 0;
+
+    virtual ~HNSWSpecializedSearcher() {}
+};
+
+/** searcher for an IndexFlat (L2 or inner product) or an
+ * IndexScalarQuantizer with 8-bit codes (QT_8bit or QT_8bit_uniform, L2 or
+ * inner product). The distances of the inner product are negated as in
+ * IndexHNSW. Returns nullptr for the other storages. */
+HNSWSpecializedSearcher* make_hnsw_specialized_searcher(const Index* storage);
+
+} // namespace faiss
@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWStreamBuilder.h>
+
+#include <omp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexVamana.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/Vamana.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/mapped_io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+namespace {
+
+using storage_idx_t = HNSW::storage_idx_t;
+
+/// temporary file, removed when going out of scope
+struct TmpFile {
+    std::string fname;
+
+    explicit TmpFile(const std::string& dir) {
+        fname = dir + "/faiss_hnsw_stream_XXXXXX";
+        int fd = mkstemp(&fname[0]);
+        FAISS_THROW_IF_NOT_FMT(
+                fd >= 0,
+                "could not create a temporary file in %s: %s",
+                dir.c_str(),
+                strerror(errno));
+        close(fd);
+    }
+
+    ~TmpFile() {
+        unlink(fname.c_str());
+    }
+};
+
+/// read-only view of a temporary file that contains n elements
+template <typename T>
+MaybeOwnedVector<T> map_tmp_file(const TmpFile& tmp, size_t n) {
+    if (n == 0) {
+        return MaybeOwnedVector<T>();
+    }
+    auto owner = std::make_shared<MmappedFileMappingOwner>(tmp.fname);
+    FAISS_THROW_IF_NOT(owner->size() == n * sizeof(T));
+    return MaybeOwnedVector<T>::create_view(owner->data(), n, owner);
+}
+
+template <typename T>
+void write_elements(IOWriter& w, const T* data, size_t n) {
+    if (n > 0) {
+        FAISS_THROW_IF_NOT_MSG(
+                w(data, sizeof(T), n) == n, "write error in temporary file");
+    }
+}
+
+template <typename T>
+void read_elements(IOReader& r, T* data, size_t n) {
+    if (n > 0) {
+        FAISS_THROW_IF_NOT_MSG(
+                r(data, sizeof(T), n) == n, "read error in temporary file");
+    }
+}
+
+/// distance computer where smaller is closer, as HNSW expects
+DistanceComputer* get_hnsw_distance_computer(const IndexFlat& index) {
+    if (is_similarity_metric(index.metric_type)) {
+        return new NegativeDistanceComputer(index.get_distance_computer());
+    }
+    return index.get_distance_computer();
+}
+
+/// IndexFlat that is a view of the n vectors x
+void make_flat_view(IndexFlat& index, idx_t n, const float* x) {
+    index.codes = MaybeOwnedVector<uint8_t>::create_view(
+            const_cast<float*>(x), n * index.d * sizeof(float), nullptr);
+    index.ntotal = n;
+}
+
+/** assigns each vector to its no nearest k-means centroids among ns, the
+ * result has size n * no */
+std::vector<int32_t> assign_to_shards(
+        int d,
+        idx_t n,
+        const float* x,
+        int ns,
+        int no) {
+    std::vector<int32_t> assign(n * no);
+    std::vector<float> centroids(ns * d);
+    size_t n_train = std::min(size_t(n), size_t(ns) * 256);
+    std::vector<float> sample(n_train * d);
+    RandomGenerator rng(1234);
+    for (size_t j = 0; j < n_train; j++) {
+        idx_t i = n_train == n ? j : rng.rand_int64() % n;
+        memcpy(sample.data() + j * d, x + i * d, sizeof(float) * d);
+    }
+    if (ns > 1) {
+        kmeans_clustering(d, n_train, ns, sample.data(), centroids.data());
+    } else {
+        memcpy(centroids.data(), sample.data(), sizeof(float) * d);
+    }
+    IndexFlatL2 quantizer(d);
+    quantizer.add(ns, centroids.data());
+    size_t bs = 65536;
+    std::vector<float> D(bs * no);
+    std::vector<idx_t> I(bs * no);
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min(i0 + idx_t(bs), n);
+        quantizer.search(i1 - i0, x + i0 * d, no, D.data(), I.data());
+        for (size_t j = 0; j < (i1 - i0) * no; j++) {
+            assign[i0 * no + j] = I[j];
+        }
+    }
+    return assign;
+}
+
+/// global ids of the vectors assigned to shard s, in increasing order
+std::vector<storage_idx_t> shard_ids(
+        const std::vector<int32_t>& assign,
+        idx_t n,
+        int no,
+        int s) {
+    std::vector<storage_idx_t> ids;
+    for (idx_t i = 0; i < n; i++) {
+        for (int j = 0; j < no; j++) {
+            if (assign[i * no + j] == s) {
+                ids.push_back(i);
+                break;
+            }
+        }
+    }
+    return ids;
+}
+
+/// one neighbor list of a spilled shard
+void write_list(IOWriter& w, const std::vector<storage_idx_t>& list) {
+    int32_t size = list.size();
+    write_elements(w, &size, 1);
+    write_elements(w, list.data(), list.size());
+}
+
+/// adds the next list of reader r to l, without duplicates
+void read_list_union(
+        IOReader& r,
+        std::vector<storage_idx_t>& buf,
+        std::vector<storage_idx_t>& l) {
+    int32_t size;
+    read_elements(r, &size, 1);
+    buf.resize(size);
+    read_elements(r, buf.data(), size);
+    for (storage_idx_t v : buf) {
+        if (std::find(l.begin(), l.end(), v) == l.end()) {
+            l.push_back(v);
+        }
+    }
+}
+
+/// streams the compact layout of the graph, node by node, to temporary files
+struct CompactGraphWriter {
+    TmpFile neighbors_file, level_ptr_file, node_offsets_file;
+    std::unique_ptr<FileIOWriter> neighbors_w, level_ptr_w, node_offsets_w;
+    size_t n_edges = 0, n_ptr = 0, n_nodes = 0;
+
+    explicit CompactGraphWriter(const std::string& dir)
+            : neighbors_file(dir),
+              level_ptr_file(dir),
+              node_offsets_file(dir),
+              neighbors_w(new FileIOWriter(neighbors_file.fname.c_str())),
+              level_ptr_w(new FileIOWriter(level_ptr_file.fname.c_str())),
+              node_offsets_w(
+                      new FileIOWriter(node_offsets_file.fname.c_str())) {}
+
+    /// lists[level] for the next node
+    void add_node(const std::vector<std::vector<storage_idx_t>>& lists) {
+        write_elements(*node_offsets_w, &n_ptr, 1);
+        for (const auto& l : lists) {
+            write_elements(*level_ptr_w, &n_edges, 1);
+            write_elements(*neighbors_w, l.data(), l.size());
+            n_edges += l.size();
+            n_ptr++;
+        }
+        write_elements(*level_ptr_w, &n_edges, 1);
+        n_ptr++;
+        n_nodes++;
+    }
+
+    /// closes the files and maps them as the compact storage of hnsw
+    void finish(HNSW& hnsw) {
+        write_elements(*node_offsets_w, &n_ptr, 1);
+        neighbors_w.reset();
+        level_ptr_w.reset();
+        node_offsets_w.reset();
+        hnsw.compact_neighbors_data =
+                map_tmp_file<storage_idx_t>(neighbors_file, n_edges);
+        hnsw.compact_level_ptr = map_tmp_file<size_t>(level_ptr_file, n_ptr);
+        hnsw.compact_node_offsets =
+                map_tmp_file<size_t>(node_offsets_file, n_nodes + 1);
+        hnsw.storage_is_compact = true;
+        hnsw.offsets.clear();
+    }
+};
+
+/// writes the index, whose graph is complete, with x as storage
+void write_stream_index(
+        IndexHNSW& index,
+        idx_t n,
+        const float* x,
+        bool write_storage,
+        IOWriter* f) {
+    index.ntotal = n;
+    if (write_storage) {
+        auto storage = dynamic_cast<IndexFlat*>(index.storage);
+        FAISS_THROW_IF_NOT(storage);
+        make_flat_view(*storage, n, x);
+    }
+    write_index(&index, f, write_storage ? 0 : IO_FLAG_SKIP_STORAGE);
+}
+
+} // namespace
+
+HNSWStreamBuilder::HNSWStreamBuilder(int d, int M, MetricType metric)
+        : d(d), M(M), metric(metric) {}
+
+void HNSWStreamBuilder::build(idx_t n, const float* x, IOWriter* f) const {
+    FAISS_THROW_IF_NOT(n > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            n <= std::numeric_limits<storage_idx_t>::max(),
+            "too many vectors for the HNSW storage_idx_t");
+    FAISS_THROW_IF_NOT(nshard > 0 && n_overlap > 0);
+    int ns = std::min(idx_t(nshard), n);
+    int no = std::min(n_overlap, ns);
+    double t0 = getmillisecs();
+
+    // the output index, its HNSW gets the global levels
+    IndexHNSWFlat index(d, M, metric);
+    HNSW& hnsw = index.hnsw;
+    hnsw.efConstruction = efConstruction;
+    hnsw.levels.resize(n);
+    for (idx_t i = 0; i < n; i++) {
+        hnsw.levels[i] = hnsw.random_level() + 1;
+    }
+
+    // view of the input vectors, to compute distances during the merge and
+    // as the storage of the output index
+    IndexFlat xflat(d, metric);
+    make_flat_view(xflat, n, x);
+
+    // partition: shards of each vector, no per vector
+    std::vector<int32_t> assign = assign_to_shards(d, n, x, ns, no);
+    if (verbose) {
+        printf("HNSWStreamBuilder: %" PRId64
+               " vectors in %d shards, overlap %d (%.3f s)\n",
+               n,
+               ns,
+               no,
+               (getmillisecs() - t0) / 1000);
+    }
+
+    // build each shard and spill its neighbor lists with global ids, in
+    // increasing order of the global ids
+    std::vector<std::unique_ptr<TmpFile>> shard_files;
+    for (int s = 0; s < ns; s++) {
+        shard_files.emplace_back(new TmpFile(tmp_dir));
+        std::vector<storage_idx_t> ids = shard_ids(assign, n, no, s);
+        if (ids.empty()) {
+            continue;
+        }
+        std::vector<float> xs(ids.size() * d);
+        IndexHNSWFlat shard_index(d, M, metric);
+        shard_index.hnsw.efConstruction = efConstruction;
+        shard_index.hnsw.levels.resize(ids.size());
+        for (size_t k = 0; k < ids.size(); k++) {
+            memcpy(xs.data() + k * d, x + ids[k] * d, sizeof(float) * d);
+            shard_index.hnsw.levels[k] = hnsw.levels[ids[k]];
+        }
+        shard_index.add(ids.size(), xs.data());
+
+        const HNSW& sh = shard_index.hnsw;
+        FileIOWriter w(shard_files[s]->fname.c_str());
+        std::vector<storage_idx_t> list;
+        for (size_t k = 0; k < ids.size(); k++) {
+            for (int level = 0; level < sh.levels[k]; level++) {
+                size_t begin, end;
+                sh.neighbor_range(k, level, &begin, &end);
+                list.clear();
+                for (size_t j = begin; j < end && sh.neighbors[j] >= 0; j++) {
+                    list.push_back(ids[sh.neighbors[j]]);
+                }
+                write_list(w, list);
+            }
+        }
+        if (verbose) {
+            printf("  shard %d: %zd vectors (%.3f s)\n",
+                   s,
+                   ids.size(),
+                   (getmillisecs() - t0) / 1000);
+        }
+    }
+
+    // merge the lists of the shards node by node and stream the compact
+    // layout to temporary files
+    CompactGraphWriter cw(tmp_dir);
+    {
+        std::vector<std::unique_ptr<FileIOReader>> readers;
+        for (int s = 0; s < ns; s++) {
+            readers.emplace_back(
+                    new FileIOReader(shard_files[s]->fname.c_str()));
+        }
+
+        // lists[node - i0][level]
+        std::vector<std::vector<std::vector<storage_idx_t>>> lists;
+        for (idx_t i0 = 0; i0 < n; i0 += merge_block_size) {
+            idx_t i1 = std::min(i0 + idx_t(merge_block_size), n);
+            lists.resize(i1 - i0);
+            std::vector<storage_idx_t> buf;
+            for (idx_t i = i0; i < i1; i++) {
+                auto& node_lists = lists[i - i0];
+                node_lists.assign(hnsw.levels[i], {});
+                for (int j = 0; j < no; j++) {
+                    IOReader& r = *readers[assign[i * no + j]];
+                    for (int level = 0; level < hnsw.levels[i]; level++) {
+                        read_list_union(r, buf, node_lists[level]);
+                    }
+                }
+            }
+
+#pragma omp parallel
+            {
+                std::unique_ptr<DistanceComputer> dis(
+                        get_hnsw_distance_computer(xflat));
+#pragma omp for schedule(dynamic)
+                for (idx_t i = i0; i < i1; i++) {
+                    auto& node_lists = lists[i - i0];
+                    for (int level = 0; level < node_lists.size(); level++) {
+                        auto& l = node_lists[level];
+                        int max_size = hnsw.nb_neighbors(level);
+                        if (l.size() <= max_size) {
+                            continue;
+                        }
+                        std::priority_queue<HNSW::NodeDistFarther> input;
+                        for (storage_idx_t v : l) {
+                            input.emplace(dis->symmetric_dis(i, v), v);
+                        }
+                        std::vector<HNSW::NodeDistFarther> output;
+                        HNSW::shrink_neighbor_list(
+                                *dis, input, output, max_size);
+                        l.clear();
+                        for (const auto& v : output) {
+                            l.push_back(v.id);
+                        }
+                    }
+                }
+            }
+
+            for (idx_t i = i0; i < i1; i++) {
+                cw.add_node(lists[i - i0]);
+            }
+        }
+    }
+    shard_files.clear();
+
+    cw.finish(hnsw);
+    hnsw.max_level = -1;
+    for (idx_t i = 0; i < n; i++) {
+        if (hnsw.levels[i] - 1 > hnsw.max_level) {
+            hnsw.max_level = hnsw.levels[i] - 1;
+            hnsw.entry_point = i;
+        }
+    }
+    write_stream_index(index, n, x, write_storage, f);
+
+    if (verbose) {
+        printf("HNSWStreamBuilder: %zd edges written (%.3f s)\n",
+               cw.n_edges,
+               (getmillisecs() - t0) / 1000);
+    }
+}
+
+void HNSWStreamBuilder::build(idx_t n, const float* x, const char* fname)
+        const {
+    FileIOWriter writer(fname);
+    build(n, x, &writer);
+}
+
+/*************************************************************
+ * VamanaStreamBuilder
+ *************************************************************/
+
+VamanaStreamBuilder::VamanaStreamBuilder(int d, int R, int L, float alpha)
+        : d(d), R(R), L(L), alpha(alpha) {}
+
+void VamanaStreamBuilder::build(idx_t n, const float* x, IOWriter* f) const {
+    FAISS_THROW_IF_NOT(n > 0);
+    FAISS_THROW_IF_NOT_MSG(
+            n <= std::numeric_limits<storage_idx_t>::max(),
+            "too many vectors for the HNSW storage_idx_t");
+    FAISS_THROW_IF_NOT(nshard > 0 && n_overlap > 0);
+    FAISS_THROW_IF_NOT(R > 0 && L > 0 && alpha >= 1);
+    FAISS_THROW_IF_NOT(batch_size > 0);
+    int ns = std::min(idx_t(nshard), n);
+    int no = std::min(n_overlap, ns);
+    double t0 = getmillisecs();
+
+    IndexVamana index(d, R);
+    index.build_L = L;
+    index.alpha = alpha;
+    index.build_batch_size = batch_size;
+    HNSW& hnsw = index.hnsw;
+    hnsw.levels.resize(n, 1);
+
+    IndexFlatL2 xflat(d);
+    make_flat_view(xflat, n, x);
+
+    std::vector<int32_t> assign = assign_to_shards(d, n, x, ns, no);
+    if (verbose) {
+        printf("VamanaStreamBuilder: %" PRId64
+               " vectors in %d shards, overlap %d (%.3f s)\n",
+               n,
+               ns,
+               no,
+               (getmillisecs() - t0) / 1000);
+    }
+
+    // build the graph of each shard and spill it with global ids
+    std::vector<std::unique_ptr<TmpFile>> shard_files;
+    for (int s = 0; s < ns; s++) {
+        shard_files.emplace_back(new TmpFile(tmp_dir));
+        std::vector<storage_idx_t> ids = shard_ids(assign, n, no, s);
+        if (ids.empty()) {
+            continue;
+        }
+        std::vector<float> xs(ids.size() * d);
+        for (size_t k = 0; k < ids.size(); k++) {
+            memcpy(xs.data() + k * d, x + ids[k] * d, sizeof(float) * d);
+        }
+        IndexFlatL2 shard_index(d);
+        make_flat_view(shard_index, ids.size(), xs.data());
+        std::vector<storage_idx_t> graph(ids.size() * R, -1);
+        vamana::build_graph(
+                shard_index,
+                0,
+                R,
+                L,
+                alpha,
+                batch_size,
+                vamana::find_medoid(shard_index, ids.size(), xs.data()),
+                graph.data());
+
+        FileIOWriter w(shard_files[s]->fname.c_str());
+        std::vector<storage_idx_t> list;
+        for (size_t k = 0; k < ids.size(); k++) {
+            const storage_idx_t* row = graph.data() + k * R;
+            list.clear();
+            for (int r = 0; r < R && row[r] >= 0; r++) {
+                list.push_back(ids[row[r]]);
+            }
+            write_list(w, list);
+        }
+        if (verbose) {
+            printf("  shard %d: %zd vectors (%.3f s)\n",
+                   s,
+                   ids.size(),
+                   (getmillisecs() - t0) / 1000);
+        }
+    }
+
+    // merge the lists of the shards and prune the ones that overflow
+    CompactGraphWriter cw(tmp_dir);
+    {
+        std::vector<std::unique_ptr<FileIOReader>> readers;
+        for (int s = 0; s < ns; s++) {
+            readers.emplace_back(
+                    new FileIOReader(shard_files[s]->fname.c_str()));
+        }
+
+        // lists[node - i0][0]
+        std::vector<std::vector<std::vector<storage_idx_t>>> lists;
+        for (idx_t i0 = 0; i0 < n; i0 += merge_block_size) {
+            idx_t i1 = std::min(i0 + idx_t(merge_block_size), n);
+            lists.resize(i1 - i0);
+            std::vector<storage_idx_t> buf;
+            for (idx_t i = i0; i < i1; i++) {
+                auto& node_lists = lists[i - i0];
+                node_lists.assign(1, {});
+                for (int j = 0; j < no; j++) {
+                    read_list_union(
+                            *readers[assign[i * no + j]], buf, node_lists[0]);
+                }
+            }
+
+#pragma omp parallel
+            {
+                std::unique_ptr<DistanceComputer> dis(
+                        xflat.get_distance_computer());
+                std::vector<vamana::Candidate> cands;
+#pragma omp for schedule(dynamic)
+                for (idx_t i = i0; i < i1; i++) {
+                    auto& l = lists[i - i0][0];
+                    if (l.size() <= R) {
+                        continue;
+                    }
+                    cands.clear();
+                    for (storage_idx_t v : l) {
+                        cands.emplace_back(dis->symmetric_dis(i, v), v);
+                    }
+                    vamana::robust_prune(*dis, i, cands, alpha, R, l);
+                }
+            }
+
+            for (idx_t i = i0; i < i1; i++) {
+                cw.add_node(lists[i - i0]);
+            }
+        }
+    }
+    shard_files.clear();
+
+    cw.finish(hnsw);
+    hnsw.max_level = 0;
+    hnsw.entry_point = vamana::find_medoid(xflat, n, x);
+    write_stream_index(index, n, x, write_storage, f);
+
+    if (verbose) {
+        printf("VamanaStreamBuilder: %zd edges written (%.3f s)\n",
+               cw.n_edges,
+               (getmillisecs() - t0) / 1000);
+    }
+}
+
+void VamanaStreamBuilder::build(idx_t n, const float* x, const char* fname)
+        const {
+    FileIOWriter writer(fname);
+    build(n, x, &writer);
+}
+
+} // namespace faiss
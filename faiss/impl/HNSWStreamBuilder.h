@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+struct IOWriter;
+
+/** Out-of-core construction of an IndexHNSWFlat in the compact CSR format.
+ *
+ * The full-degree neighbor table (with its -1 padding) of the whole dataset
+ * is never materialized. Instead, as in DiskANN, the vectors are partitioned
+ * into nshard overlapping shards by k-means (each vector goes to its
+ * n_overlap nearest centroids). An HNSW graph is built for each shard in
+ * turn (the levels of the vectors are drawn globally beforehand) and its
+ * neighbor lists are spilled to a temporary file. The lists of the shards
+ * are then merged node by node: the union of the lists of a node is pruned
+ * with the usual HNSW heuristic and streamed to temporary files in the
+ * compact layout, that are mmapped to write the final index.
+ *
+ * The peak memory is the graph of one shard plus O(ntotal) for the levels
+ * and the shard assignment. The input vectors can be an mmapped file.
+ */
+struct HNSWStreamBuilder {
+    int d;
+    int M;
+    MetricType metric;
+
+    /// nb of shards built in memory one after the other
+    int nshard = 8;
+    /// nb of shards each vector is inserted in, >= 2 to connect the shards
+    int n_overlap = 2;
+    int efConstruction = 40;
+    /// nb of nodes merged in parallel between two writes
+    size_t merge_block_size = 4096;
+
+    /// where the temporary files are written
+    std::string tmp_dir = "/tmp";
+    /// if false, the index is written without storage (recompute mode)
+    bool write_storage = true;
+    bool verbose = false;
+
+    explicit HNSWStreamBuilder(
+            int d,
+            int M = 32,
+            MetricType metric = METRIC_L2);
+
+    /** build the index over the n vectors x and write it to f, in the same
+     * format as write_index of an IndexHNSWFlat converted to compact
+     * storage */
+    void build(idx_t n, const float* x, IOWriter* f) const;
+
+    void build(idx_t n, const float* x, const char* fname) const;
+};
+
+/** Out-of-core construction of a Vamana graph (NSG with alpha pruning, as in
+ * DiskANN), written as an IndexVamana in the compact CSR format, so that it
+ * is searched with the same in-memory, pread or mmap neighbor fetch path as
+ * a compact HNSW.
+ *
+ * The sharding is the one of HNSWStreamBuilder. The graph of a shard is
+ * built with vamana::build_graph, in parallel batches without locks. The
+ * merged lists have variable degrees <= R and are not padded in the
+ * output.
+ *
+ * The peak memory is the n_shard * R table of one shard plus
+ * batch_size * L candidates. Only METRIC_L2 is supported.
+ */
+struct VamanaStreamBuilder {
+    int d;
+    /// max out-degree
+    int R;
+    /// size of the candidate list of the greedy search during construction
+    int L;
+    /// pruning parameter of the second pass, >= 1
+    float alpha;
+
+    int nshard = 8;
+    int n_overlap = 2;
+    /// max nb of nodes inserted in parallel against the same graph
+    size_t batch_size = 4096;
+    size_t merge_block_size = 4096;
+
+    std::string tmp_dir = "/tmp";
+    bool write_storage = true;
+    bool verbose = false;
+
+    explicit VamanaStreamBuilder(
+            int d,
+            int R = 64,
+            int L = 100,
+            float alpha = 1.2);
+
+    /// build the graph over the n vectors x and write it to f
+    void build(idx_t n, const float* x, IOWriter* f) const;
+
+    void build(idx_t n, const float* x, const char* fname) const;
+};
+
+} // namespace faiss
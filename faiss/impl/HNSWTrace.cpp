@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWTrace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+namespace {
+
+/// ring buffer of the events of one thread, only written by that thread
+struct TraceBuffer {
+    std::vector<HNSWTraceEvent> events;
+    /// nb of events written since the start, the last ones are kept
+    size_t n_written = 0;
+    uint32_t thread;
+    uint64_t generation;
+};
+
+std::atomic<bool> trace_enabled{false};
+/// incremented by each hnsw_trace_start, invalidates the thread buffers
+std::atomic<uint64_t> trace_generation{0};
+size_t trace_capacity = 0;
+std::chrono::steady_clock::time_point trace_t0;
+
+std::mutex trace_mutex;
+/// buffers of the current generation, kept when their thread exits
+std::vector<std::shared_ptr<TraceBuffer>> trace_buffers;
+
+thread_local std::shared_ptr<TraceBuffer> thread_buffer;
+thread_local int64_t thread_query = -1;
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - trace_t0)
+            .count();
+}
+
+void record(HNSWTracePhase phase, uint64_t t_begin, uint64_t t_end) {
+    uint64_t generation = trace_generation.load(std::memory_order_acquire);
+    TraceBuffer* buf = thread_buffer.get();
+    if (!buf || buf->generation != generation) {
+        auto new_buf = std::make_shared<TraceBuffer>();
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        new_buf->events.resize(trace_capacity);
+        new_buf->thread = trace_buffers.size();
+        new_buf->generation = generation;
+        trace_buffers.push_back(new_buf);
+        thread_buffer = new_buf;
+        buf = new_buf.get();
+    }
+    if (buf->events.empty()) {
+        return;
+    }
+    HNSWTraceEvent& e = buf->events[buf->n_written % buf->events.size()];
+    e.t_begin = t_begin;
+    e.duration = t_end - t_begin;
+    e.query = thread_query;
+    e.thread = buf->thread;
+    e.phase = phase;
+    buf->n_written++;
+}
+
+} // namespace
+
+const char* hnsw_trace_phase_name(HNSWTracePhase phase) {
+    switch (phase) {
+        case HNSW_TRACE_QUERY:
+            return "query";
+        case HNSW_TRACE_UPPER_LEVELS:
+            return "upper_levels";
+        case HNSW_TRACE_GRAPH_FETCH:
+            return "graph_fetch";
+        case HNSW_TRACE_DISTANCES:
+            return "distances";
+        case HNSW_TRACE_PQ_PRUNING:
+            return "pq_pruning";
+        case HNSW_TRACE_HEAP:
+            return "heap";
+        case HNSW_TRACE_VISITED:
+            return "visited";
+        default:
+            return "unknown";
+    }
+}
+
+void hnsw_trace_start(size_t events_per_thread) {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_buffers.clear();
+    trace_capacity = events_per_thread;
+    trace_t0 = std::chrono::steady_clock::now();
+    trace_generation.fetch_add(1, std::memory_order_release);
+    trace_enabled.store(true, std::memory_order_release);
+}
+
+void hnsw_trace_stop() {
+    trace_enabled.store(false, std::memory_order_release);
+}
+
+bool hnsw_trace_is_enabled() {
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+std::vector<HNSWTraceEvent> hnsw_trace_collect() {
+    std::vector<HNSWTraceEvent> events;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    for (const auto& buf : trace_buffers) {
+        size_t n = std::min(buf->n_written, buf->events.size());
+        for (size_t i = buf->n_written - n; i < buf->n_written; i++) {
+            events.push_back(buf->events[i % buf->events.size()]);
+        }
+    }
+    std::stable_sort(
+            events.begin(),
+            events.end(),
+            [](const HNSWTraceEvent& a, const HNSWTraceEvent& b) {
+                return a.t_begin < b.t_begin;
+            });
+    return events;
+}
+
+std::string hnsw_trace_to_chrome_json(
+        const std::vector<HNSWTraceEvent>& events) {
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    char buf[256];
+    for (size_t i = 0; i < events.size(); i++) {
+        const HNSWTraceEvent& e = events[i];
+        // timestamps are in microseconds
+        snprintf(
+                buf,
+                sizeof(buf),
+                "%s\n{\"name\":\"%s\",\"cat\":\"hnsw\",\"ph\":\"X\","
+                "\"pid\":0,\"tid\":%" PRIu32 ",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"args\":{\"query\":%" PRId64 "}}",
+                i == 0 ? "" : ",",
+                hnsw_trace_phase_name(e.phase),
+                e.thread,
+                e.t_begin / 1000.0,
+                e.duration / 1000.0,
+                e.query);
+        json += buf;
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+void hnsw_trace_write_chrome(const char* fname) {
+    std::string json = hnsw_trace_to_chrome_json(hnsw_trace_collect());
+    FILE* f = fopen(fname, "w");
+    FAISS_THROW_IF_NOT_FMT(
+            f, "could not open %s for writing: %s", fname, strerror(errno));
+    size_t n_written = fwrite(json.data(), 1, json.size(), f);
+    fclose(f);
+    FAISS_THROW_IF_NOT_FMT(
+            n_written == json.size(), "write error in %s", fname);
+}
+
+std::vector<double> hnsw_trace_breakdown(
+        const std::vector<HNSWTraceEvent>& events,
+        size_t nq) {
+    std::vector<double> breakdown(nq * HNSW_TRACE_N_PHASES);
+    for (const HNSWTraceEvent& e : events) {
+        if (e.query >= 0 && e.query < nq && e.phase < HNSW_TRACE_N_PHASES) {
+            breakdown[e.query * HNSW_TRACE_N_PHASES + e.phase] += e.duration;
+        }
+    }
+    return breakdown;
+}
+
+HNSWTraceScope::HNSWTraceScope(HNSWTracePhase phase)
+        : phase(phase),
+          active(trace_enabled.load(std::memory_order_relaxed)),
+          t_begin(active ? now_ns() : 0) {}
+
+HNSWTraceScope::~HNSWTraceScope() {
+    if (active) {
+        record(phase, t_begin, now_ns());
+    }
+}
+
+HNSWTraceQuery::HNSWTraceQuery(int64_t query) : prev_query(thread_query) {
+    thread_query = query;
+}
+
+HNSWTraceQuery::~HNSWTraceQuery() {
+    thread_query = prev_query;
+}
+
+} // namespace faiss
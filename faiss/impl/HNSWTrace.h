@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace faiss {
+
+/** Per-query tracing of the HNSW search.
+ *
+ * When faiss is compiled with FAISS_HNSW_TRACE (cmake option
+ * FAISS_ENABLE_HNSW_TRACE), the search records the time spent in each of
+ * the phases below. Otherwise the probes compile to nothing. Recording is
+ * started by hnsw_trace_start. Each thread writes its events to its own
+ * ring buffer, so the searching threads do not contend, and the oldest
+ * events of a thread are overwritten when its buffer is full.
+ *
+ * The phases other than HNSW_TRACE_QUERY do not overlap: the remainder of
+ * a query is bookkeeping that is not traced.
+ */
+enum HNSWTracePhase : uint8_t {
+    HNSW_TRACE_QUERY = 0,    ///< whole search of a query
+    HNSW_TRACE_UPPER_LEVELS, ///< greedy descent of the upper levels
+    HNSW_TRACE_GRAPH_FETCH,  ///< reads of the level 0 neighbor lists
+    HNSW_TRACE_DISTANCES,    ///< distances (the recompute requests if any)
+    HNSW_TRACE_PQ_PRUNING,   ///< PQ distances and candidate selection
+    HNSW_TRACE_HEAP,         ///< candidate and result heaps
+    HNSW_TRACE_VISITED,      ///< visited-table filtering of the neighbors
+    HNSW_TRACE_N_PHASES
+};
+
+/// short name of a phase, used in the exported traces
+const char* hnsw_trace_phase_name(HNSWTracePhase phase);
+
+struct HNSWTraceEvent {
+    uint64_t t_begin;  ///< ns since hnsw_trace_start
+    uint64_t duration; ///< ns
+    int64_t query;     ///< query number in its search call, -1 if unknown
+    uint32_t thread;   ///< nb of the recording thread
+    HNSWTracePhase phase;
+};
+
+/** start recording, the previous events are discarded. Must not be called
+ * during a search. */
+void hnsw_trace_start(size_t events_per_thread = 1 << 16);
+
+/// stop recording, the recorded events are kept
+void hnsw_trace_stop();
+
+bool hnsw_trace_is_enabled();
+
+/// events recorded by all threads, by increasing start time. Must not be
+/// called during a search.
+std::vector<HNSWTraceEvent> hnsw_trace_collect();
+
+/// events in the Chrome trace event format (chrome://tracing, Perfetto)
+std::string hnsw_trace_to_chrome_json(
+        const std::vector<HNSWTraceEvent>& events);
+
+/// write hnsw_trace_to_chrome_json(hnsw_trace_collect()) to fname
+void hnsw_trace_write_chrome(const char* fname);
+
+/** time spent by queries 0..nq-1 in each phase, in ns:
+ * breakdown[q * HNSW_TRACE_N_PHASES + phase]. The events of several search
+ * calls are summed by query number. */
+std::vector<double> hnsw_trace_breakdown(
+        const std::vector<HNSWTraceEvent>& events,
+        size_t nq);
+
+/// records the duration of its lifetime as an event of phase
+struct HNSWTraceScope {
+    HNSWTracePhase phase;
+    bool active;
+    uint64_t t_begin;
+
+    explicit HNSWTraceScope(HNSWTracePhase phase);
+    ~HNSWTraceScope();
+};
+
+/// query number of the events recorded by this thread during its lifetime
+struct HNSWTraceQuery {
+    int64_t prev_query;
+
+    explicit HNSWTraceQuery(int64_t query);
+    ~HNSWTraceQuery();
+};
+
+} // namespace faiss
+
+#define FAISS_HNSW_TRACE_CAT_2(a, b) a##b
+#define FAISS_HNSW_TRACE_CAT(a, b) FAISS_HNSW_TRACE_CAT_2(a, b)
+#define FAISS_HNSW_TRACE_VAR FAISS_HNSW_TRACE_CAT(hnsw_trace_, __LINE__)
+
+#ifdef FAISS_HNSW_TRACE
+#define FAISS_HNSW_TRACE_SCOPE(phase) \
+    faiss::HNSWTraceScope FAISS_HNSW_TRACE_VAR(phase)
+#define FAISS_HNSW_TRACE_QUERY(query) \
+    faiss::HNSWTraceQuery FAISS_HNSW_TRACE_VAR(query)
+#else
+#define FAISS_HNSW_TRACE_SCOPE(phase)
+#define FAISS_HNSW_TRACE_QUERY(query)
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWUpperLevels.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+namespace {
+
+/// maps the node ids to the rows of the codec
+struct UpperLevelDistanceComputer : DistanceComputer {
+    const HNSWUpperLevelCodes& codes;
+    std::unique_ptr<DistanceComputer> basedis;
+    float sign;
+    std::vector<idx_t> rows;
+    std::vector<float> row_dis;
+
+    explicit UpperLevelDistanceComputer(const HNSWUpperLevelCodes& codes)
+            : codes(codes),
+              basedis(codes.codec->get_distance_computer()),
+              sign(is_similarity_metric(codes.codec->metric_type) ? -1
+                                                                  : 1) {}
+
+    void set_query(const float* x) override {
+        basedis->set_query(x);
+    }
+
+    const float* get_query() override {
+        return basedis->get_query();
+    }
+
+    float operator()(idx_t i) override {
+        idx_t r = codes.row(i);
+        return r < 0 ? HUGE_VALF : sign * (*basedis)(r);
+    }
+
+    void distances_batch(
+            const std::vector<idx_t>& ids,
+            std::vector<float>& distances_out) override {
+        rows.clear();
+        for (idx_t id : ids) {
+            idx_t r = codes.row(id);
+            if (r >= 0) {
+                rows.push_back(r);
+            }
+        }
+        row_dis.resize(rows.size());
+        if (!rows.empty()) {
+            basedis->distances_batch(rows, row_dis);
+        }
+        for (size_t i = 0, j = 0; i < ids.size(); i++) {
+            distances_out[i] =
+                    codes.row(ids[i]) < 0 ? HUGE_VALF : sign * row_dis[j++];
+        }
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        idx_t ri = codes.row(i), rj = codes.row(j);
+        return ri < 0 || rj < 0 ? HUGE_VALF
+                                : sign * basedis->symmetric_dis(ri, rj);
+    }
+};
+
+} // namespace
+
+HNSWUpperLevelCodes::HNSWUpperLevelCodes(Index* codec) : codec(codec) {}
+
+HNSWUpperLevelCodes::~HNSWUpperLevelCodes() {
+    if (own_fields) {
+        delete codec;
+    }
+}
+
+void HNSWUpperLevelCodes::add(
+        idx_t n,
+        const float* x,
+        const storage_idx_t* nodes_in) {
+    FAISS_THROW_IF_NOT(codec && codec->is_trained);
+    idx_t row0 = codec->ntotal;
+    codec->add(n, x);
+    // merge the new nodes into the sorted table
+    std::vector<std::pair<storage_idx_t, idx_t>> entries(nodes.size() + n);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        entries[i] = {nodes[i], rows[i]};
+    }
+    for (idx_t i = 0; i < n; i++) {
+        entries[nodes.size() + i] = {nodes_in[i], row0 + i};
+    }
+    std::sort(entries.begin(), entries.end());
+    nodes.resize(entries.size());
+    rows.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        nodes[i] = entries[i].first;
+        rows[i] = entries[i].second;
+        FAISS_THROW_IF_NOT_MSG(
+                i == 0 || nodes[i] != nodes[i - 1], "node added twice");
+    }
+}
+
+idx_t HNSWUpperLevelCodes::row(storage_idx_t node) const {
+    auto it = std::lower_bound(nodes.begin(), nodes.end(), node);
+    if (it == nodes.end() || *it != node) {
+        return -1;
+    }
+    return rows[it - nodes.begin()];
+}
+
+void HNSWUpperLevelCodes::renumber_nodes(const idx_t* new_ids) {
+    std::vector<std::pair<storage_idx_t, idx_t>> entries;
+    entries.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        idx_t new_id = new_ids[nodes[i]];
+        // the rows of the removed nodes stay in the codec, unreferenced
+        if (new_id >= 0) {
+            entries.emplace_back(new_id, rows[i]);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    nodes.resize(entries.size());
+    rows.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        nodes[i] = entries[i].first;
+        rows[i] = entries[i].second;
+    }
+}
+
+DistanceComputer* HNSWUpperLevelCodes::get_distance_computer() const {
+    FAISS_THROW_IF_NOT(codec);
+    return new UpperLevelDistanceComputer(*this);
+}
+
+} // namespace faiss
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <faiss/Index.h>
+#include <faiss/impl/HNSW.h>
+
+namespace faiss {
+
+struct DistanceComputer;
+
+/** Compressed vectors of the nodes on the upper levels (>= 1) of an HNSW
+ * graph, kept in RAM to navigate these levels. They are a few percent of
+ * the nodes, so with SQ8 or PQ codes the table is small, while the greedy
+ * descent through the upper levels does not cost a fetch per hop in
+ * recompute mode or a read with an on-disk storage. The level 0 search
+ * still uses the full precision distances, so the final accuracy is the
+ * same as long as the descent ends close to the same node.
+ */
+struct HNSWUpperLevelCodes {
+    using storage_idx_t = HNSW::storage_idx_t;
+
+    /// trained codec that stores the vectors (eg. built by index_factory
+    /// with "SQ8")
+    Index* codec;
+    bool own_fields = true; ///< whether codec is deleted
+
+    /// nodes in the table, sorted
+    std::vector<storage_idx_t> nodes;
+    /// row of each node of nodes in codec
+    std::vector<idx_t> rows;
+
+    explicit HNSWUpperLevelCodes(Index* codec = nullptr);
+
+    HNSWUpperLevelCodes(const HNSWUpperLevelCodes&) = delete;
+    HNSWUpperLevelCodes& operator=(const HNSWUpperLevelCodes&) = delete;
+
+    /// add the vectors x of n nodes (not in the table yet)
+    void add(idx_t n, const float* x, const storage_idx_t* nodes);
+
+    /// row of the node in codec, -1 if it is not in the table
+    idx_t row(storage_idx_t node) const;
+
+    /// renumber the nodes after the graph is permuted or compacted,
+    /// new_ids[old id] = new id, -1 if the node was removed
+    void renumber_nodes(const idx_t* new_ids);
+
+    /** distance computer that takes node ids, with the HNSW convention
+     * that smaller is better (the similarities are negated). The nodes
+     * that are not in the table are at an infinite distance. */
+    DistanceComputer* get_distance_computer() const;
+
+    ~HNSWUpperLevelCodes();
+};
+
+} // namespace faiss
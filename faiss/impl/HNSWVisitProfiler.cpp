@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HNSWVisitProfiler.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+HNSWVisitProfiler::HNSWVisitProfiler(size_t ntotal) {
+    resize(ntotal);
+}
+
+void HNSWVisitProfiler::resize(size_t ntotal) {
+    counts = std::vector<std::atomic<uint16_t>>(ntotal);
+    reset();
+}
+
+void HNSWVisitProfiler::reset() {
+    for (auto& c : counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+    n_queries.store(0, std::memory_order_relaxed);
+    n_sampled_queries.store(0, std::memory_order_relaxed);
+}
+
+size_t HNSWVisitProfiler::n_saturated() const {
+    size_t n = 0;
+    for (const auto& c : counts) {
+        n += c.load(std::memory_order_relaxed) == UINT16_MAX;
+    }
+    return n;
+}
+
+std::vector<std::pair<idx_t, uint32_t>> HNSWVisitProfiler::heavy_hitters(
+        size_t k) const {
+    std::vector<std::pair<idx_t, uint32_t>> res;
+    for (size_t i = 0; i < counts.size(); i++) {
+        uint32_t c = counts[i].load(std::memory_order_relaxed);
+        if (c > 0) {
+            res.emplace_back(i, c);
+        }
+    }
+    auto higher = [](const std::pair<idx_t, uint32_t>& a,
+                     const std::pair<idx_t, uint32_t>& b) {
+        return a.second > b.second ||
+                (a.second == b.second && a.first < b.first);
+    };
+    if (k < res.size()) {
+        std::partial_sort(res.begin(), res.begin() + k, res.end(), higher);
+        res.resize(k);
+    } else {
+        std::sort(res.begin(), res.end(), higher);
+    }
+    return res;
+}
+
+std::vector<idx_t> HNSWVisitProfiler::top_ids(size_t k) const {
+    std::vector<idx_t> ids;
+    for (const auto& hh : heavy_hitters(k)) {
+        ids.push_back(hh.first);
+    }
+    return ids;
+}
+
+std::vector<int32_t> HNSWVisitProfiler::scores() const {
+    std::vector<int32_t> res(counts.size());
+    for (size_t i = 0; i < counts.size(); i++) {
+        res[i] = counts[i].load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+std::unordered_map<idx_t, size_t> HNSWVisitProfiler::visit_counts() const {
+    std::unordered_map<idx_t, size_t> res;
+    for (size_t i = 0; i < counts.size(); i++) {
+        uint32_t c = counts[i].load(std::memory_order_relaxed);
+        if (c > 0) {
+            res[i] = c;
+        }
+    }
+    return res;
+}
+
+void HNSWVisitProfiler::dump(const char* fname) const {
+    FILE* f = fopen(fname, "w");
+    FAISS_THROW_IF_NOT_FMT(
+            f, "could not open %s for writing: %s", fname, strerror(errno));
+    fprintf(f, "node_id,visit_count\n");
+    for (size_t i = 0; i < counts.size(); i++) {
+        uint32_t c = counts[i].load(std::memory_order_relaxed);
+        if (c > 0) {
+            fprintf(f, "%ld,%ld\n", (long)i, (long)c);
+        }
+    }
+    fclose(f);
+}
+
+} // namespace faiss
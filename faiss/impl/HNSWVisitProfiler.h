@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+/** Counts the level 0 node visits of the HNSW searches, to find the hot
+ * nodes without slowing down the search (see
+ * SearchParametersHNSW::visit_profiler).
+ *
+ * The counters are a dense array of saturating uint16_t indexed by
+ * storage id, incremented with relaxed atomics by all the searching
+ * threads, so there is nothing to merge afterwards. Only one query out of
+ * query_sample_period is profiled: the ranking of the hot nodes converges
+ * after a few thousand queries, and the counters saturate later.
+ *
+ * The heavy hitters feed HybridEmbeddingStore::pin_top (scores),
+ * ZmqEmbeddingCache::hot_ids (top_ids) and HNSW::locality_order
+ * (visit_counts).
+ */
+struct HNSWVisitProfiler {
+    /// profile one query out of query_sample_period
+    int query_sample_period = 1;
+
+    explicit HNSWVisitProfiler(size_t ntotal = 0);
+
+    /// set the nb of nodes, the counters are reset
+    void resize(size_t ntotal);
+
+    /// reset the counters and the query counts. Must not be called during
+    /// a search.
+    void reset();
+
+    /// called once per query, true if it should be profiled
+    bool sample_query() {
+        size_t q = n_queries.fetch_add(1, std::memory_order_relaxed);
+        if (query_sample_period > 1 && q % query_sample_period != 0) {
+            return false;
+        }
+        n_sampled_queries.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void add_visit(idx_t id) {
+        if (id < 0 || (size_t)id >= counts.size()) {
+            return;
+        }
+        std::atomic<uint16_t>& c = counts[id];
+        uint16_t v = c.load(std::memory_order_relaxed);
+        while (v != UINT16_MAX &&
+               !c.compare_exchange_weak(
+                       v, v + 1, std::memory_order_relaxed)) {
+        }
+    }
+
+    size_t ntotal() const {
+        return counts.size();
+    }
+
+    uint32_t count(idx_t id) const {
+        return counts[id].load(std::memory_order_relaxed);
+    }
+
+    /// nb of queries seen / profiled
+    size_t n_queries_seen() const {
+        return n_queries.load(std::memory_order_relaxed);
+    }
+    size_t n_queries_sampled() const {
+        return n_sampled_queries.load(std::memory_order_relaxed);
+    }
+
+    /// nb of counters that reached UINT16_MAX
+    size_t n_saturated() const;
+
+    /// the k most visited nodes (id, count) by decreasing count, ties are
+    /// broken by id. Nodes that were not visited are not returned.
+    std::vector<std::pair<idx_t, uint32_t>> heavy_hitters(size_t k) const;
+
+    /// ids of heavy_hitters(k)
+    std::vector<idx_t> top_ids(size_t k) const;
+
+    /// all the counts (size ntotal), as HybridEmbeddingStore::pin_top
+    /// takes them
+    std::vector<int32_t> scores() const;
+
+    /// counts of the visited nodes, as HNSW::locality_order takes them
+    std::unordered_map<idx_t, size_t> visit_counts() const;
+
+    /// write the counts of the visited nodes in the format of
+    /// HNSWStats::dump_node_visit_stats
+    void dump(const char* fname) const;
+
+    HNSWVisitProfiler(const HNSWVisitProfiler&) = delete;
+    HNSWVisitProfiler& operator=(const HNSWVisitProfiler&) = delete;
+
+   private:
+    std::vector<std::atomic<uint16_t>> counts;
+    std::atomic<size_t> n_queries{0};
+    std::atomic<size_t> n_sampled_queries{0};
+};
+
+} // namespace faiss
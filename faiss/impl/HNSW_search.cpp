@@ -11,11 +11,21 @@
 #include "faiss/IndexHNSW.h"
 
 #include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/BatchedFileReader.h>
 #include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/GraphPageCache.h>
+#include <faiss/impl/HNSWNodeBlocks.h>
+#include <faiss/impl/HNSWTrace.h>
+#include <faiss/impl/HNSWVisitProfiler.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ProductQuantizer.h>
 #include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/SearchEffortPredictor.h>
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/AlignedTable.h>
 #include <faiss/utils/distances.h>
 #include <faiss/utils/prefetch.h>
+#include <faiss/utils/quantize_lut.h>
 #include "HNSW_zmq.h"
 
 #include <faiss/impl/platform_macros.h>
@@ -28,83 +38,17 @@
 #include <cerrno>
 #include <cmath>
 #include <cstring>
+#include <fstream>
+#include <future>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <set>
+#include <unordered_map>
 #include "faiss/impl/FaissAssert.h"
 #include "faiss/impl/pq.h"
 
 namespace faiss {
 
-ssize_t read_direct_and_extract(
-        int fd,
-        void* user_buffer,
-        size_t desired_bytes,
-        off_t desired_offset) {
-    struct stat stat_buf;
-
-    // Get block size for alignment
-    if (fstat(fd, &stat_buf) != 0) {
-        return -1; // errno is set by fstat
-    }
-
-    size_t block_size = stat_buf.st_blksize;
-
-    // Calculate aligned offsets
-    off_t aligned_start_offset = (desired_offset / block_size) * block_size;
-    off_t aligned_end_offset =
-            std::ceil((desired_offset + desired_bytes) / (double)block_size) *
-            block_size;
-    size_t bytes_to_read_aligned = aligned_end_offset - aligned_start_offset;
-
-    // Allocate aligned buffer
-    void* temp_buffer = nullptr;
-    if (posix_memalign(&temp_buffer, block_size, bytes_to_read_aligned) != 0) {
-        errno = ENOMEM;
-        return -1;
-    }
-
-    // Seek to the aligned offset
-    if (lseek(fd, aligned_start_offset, SEEK_SET) == -1) {
-        int saved_errno = errno;
-        free(temp_buffer);
-        errno = saved_errno;
-        return -1;
-    }
-
-    // Read aligned data
-    ssize_t actual_bytes_read = read(fd, temp_buffer, bytes_to_read_aligned);
-
-    if (actual_bytes_read < 0) {
-        int saved_errno = errno;
-        free(temp_buffer);
-        errno = saved_errno;
-        return -1;
-    }
-
-    if (actual_bytes_read == 0 && desired_bytes > 0) {
-        // End of file
-        free(temp_buffer);
-        return 0;
-    }
-
-    // Calculate internal offset and bytes to copy
-    size_t internal_offset = desired_offset - aligned_start_offset;
-    size_t bytes_to_copy = std::min(
-            desired_bytes,
-            (size_t)actual_bytes_read > internal_offset
-                    ? (size_t)actual_bytes_read - internal_offset
-                    : 0);
-
-    // Copy the requested portion to user buffer
-    memcpy(user_buffer, (char*)temp_buffer + internal_offset, bytes_to_copy);
-
-    // Free the temporary buffer
-    free(temp_buffer);
-
-    return bytes_to_copy;
-}
-
 HNSW::~HNSW() {
     // Close file descriptor
     if (graph_fd != -1) {
@@ -115,6 +59,8 @@ HNSW::~HNSW() {
 void HNSW::initialize_graph(const std::string& index_filename) {
     assert(neighbors_on_disk);
     this->hnsw_index_filename = index_filename;
+    // the cached pages belong to the previous file
+    graph_page_cache.reset();
     if (this->graph_fd != -1) {
         close(this->graph_fd);
     }
@@ -138,10 +84,54 @@ void HNSW::initialize_graph(const std::string& index_filename) {
            this->graph_fd);
 }
 
+void HNSW::enable_graph_page_cache(
+        size_t capacity_bytes,
+        const std::vector<idx_t>* hot_nodes,
+        size_t page_size) {
+    FAISS_THROW_IF_NOT_MSG(
+            neighbors_on_disk && !neighbors_use_mmap && graph_fd != -1,
+            "the graph page cache requires neighbors read with pread "
+            "(see initialize_graph)");
+    FAISS_THROW_IF_NOT_MSG(
+            storage_is_compact && neighbors_start_offset >= 0,
+            "the graph page cache requires compact storage");
+    auto cache = std::make_shared<GraphPageCache>(
+            graph_fd, capacity_bytes, page_size);
+
+    // byte range of the neighbors of node i at level
+    off_t data_offset = neighbors_start_offset + sizeof(size_t);
+    std::vector<std::pair<off_t, off_t>> ranges;
+    auto add_range = [&](idx_t i, int level) {
+        size_t begin, end;
+        neighbor_byte_range(i, level, &begin, &end);
+        if (end > begin) {
+            ranges.emplace_back(
+                    data_offset + (off_t)begin, data_offset + (off_t)end);
+        }
+    };
+    for (size_t i = 0; i < levels.size(); i++) {
+        for (int level = 1; level < levels[i]; level++) {
+            add_range(i, level);
+        }
+        if (!hot_nodes && levels[i] > 1) {
+            add_range(i, 0);
+        }
+    }
+    if (hot_nodes) {
+        for (idx_t i : *hot_nodes) {
+            FAISS_THROW_IF_NOT(i >= 0 && (size_t)i < levels.size());
+            add_range(i, 0);
+        }
+    }
+    cache->pin(ranges);
+    graph_page_cache = cache;
+}
+
 size_t HNSW::fetch_neighbors(
         idx_t node_id,
         int level,
-        std::vector<storage_idx_t>& buffer) const {
+        std::vector<storage_idx_t>& buffer,
+        size_t* n_ios) const {
     // Basic bounds check for node_id and level
     FAISS_THROW_IF_NOT_FMT(
             node_id >= 0 && (size_t)node_id < levels.size(),
@@ -162,6 +152,12 @@ size_t HNSW::fetch_neighbors(
     if (num_neighbors == 0) {
         return 0;
     }
+    // with the page cache, only the missed pages count
+    bool use_page_cache =
+            neighbors_on_disk && !neighbors_use_mmap && graph_page_cache;
+    if (n_ios && !use_page_cache) {
+        (*n_ios)++;
+    }
 
     if (!neighbors_on_disk) {
         // Case 1: Neighbors are in memory (either compact_neighbors_data or
@@ -189,65 +185,132 @@ size_t HNSW::fetch_neighbors(
                 storage_is_compact,
                 "Disk/mmap neighbors access requires compact storage format");
 
+        size_t byte_begin, byte_end;
+        neighbor_byte_range(node_id, level, &byte_begin, &byte_end);
+        size_t desired_bytes = byte_end - byte_begin;
+
         if (neighbors_use_mmap) {
             // Case 2a: Access via memory-mapped region
             FAISS_THROW_IF_NOT_MSG(
                     neighbors_mmap_ptr != nullptr,
                     "neighbors_use_mmap is true but neighbors_mmap_ptr is null");
+            const uint8_t* src =
+                    reinterpret_cast<const uint8_t*>(neighbors_mmap_ptr) +
+                    byte_begin;
+            if (compress_neighbors) {
+                decode_neighbor_list(src, num_neighbors, buffer.data());
+            } else {
+                memcpy(buffer.data(), src, desired_bytes);
+            }
+            return num_neighbors;
+        }
 
-            // Direct memory copy from mapped region
-            memcpy(buffer.data(),
-                   neighbors_mmap_ptr + begin_idx,
-                   num_neighbors * sizeof(storage_idx_t));
+        // compressed lists are read to a scratch buffer and decoded
+        thread_local std::vector<uint8_t> compressed;
+        void* dest = buffer.data();
+        if (compress_neighbors) {
+            compressed.resize(desired_bytes);
+            dest = compressed.data();
+        }
 
-            return num_neighbors;
-        } else {
-            // Case 2b: Access via pread from disk
-            FAISS_THROW_IF_NOT_MSG(
-                    graph_fd != -1,
-                    "Graph file descriptor is not valid (file not opened?)");
-            FAISS_THROW_IF_NOT_MSG(
-                    neighbors_start_offset >= 0,
-                    "Invalid neighbors_start_offset for pread");
-
-            // Calculate file offsets
-            // neighbors_start_offset points to the size field (uint64_t/size_t)
-            off_t desired_offset = neighbors_start_offset + sizeof(size_t) +
-                    (off_t)(begin_idx * sizeof(storage_idx_t));
-            size_t desired_bytes = num_neighbors * sizeof(storage_idx_t);
-
-            // Note: When using this method in a multi-threaded context, access
-            // to graph_fd should be synchronized since lseek+read is not
-            // thread-safe on the same file descriptor.
-            ssize_t bytes_copied = read_direct_and_extract(
-                    graph_fd, buffer.data(), desired_bytes, desired_offset);
-
-            // Check for errors
-            if (bytes_copied < 0) {
-                int RTERRNO = errno;
-                FAISS_THROW_FMT(
-                        "read_direct_and_extract failed: node %ld, level %d, offset %ld. errno=%d (%s)",
-                        (long)node_id,
-                        level,
-                        (long)desired_offset,
-                        RTERRNO,
-                        strerror(RTERRNO));
-            }
-
-            // Check if we got all the data we expected
-            if ((size_t)bytes_copied != desired_bytes) {
-                FAISS_THROW_FMT(
-                        "Short copy from read_direct_and_extract: node %ld, level %d, offset %ld. Copied %zd bytes, expected %zu",
-                        (long)node_id,
-                        level,
-                        (long)desired_offset,
-                        bytes_copied,
-                        desired_bytes);
+        // Case 2b: Access via pread from disk
+        FAISS_THROW_IF_NOT_MSG(
+                graph_fd != -1,
+                "Graph file descriptor is not valid (file not opened?)");
+        FAISS_THROW_IF_NOT_MSG(
+                neighbors_start_offset >= 0,
+                "Invalid neighbors_start_offset for pread");
+
+        // neighbors_start_offset points to the size field (uint64_t/size_t)
+        off_t desired_offset =
+                neighbors_start_offset + sizeof(size_t) + (off_t)byte_begin;
+
+        // positional read: graph_fd is shared by the search threads
+        if (graph_page_cache) {
+            size_t n_read =
+                    graph_page_cache->read(desired_offset, desired_bytes, dest);
+            if (n_ios) {
+                *n_ios += n_read;
             }
+        } else {
+            BatchedFileReader::thread_local_reader().read(
+                    graph_fd, {{desired_offset, desired_bytes, dest}});
+        }
+        if (compress_neighbors) {
+            decode_neighbor_list(
+                    compressed.data(), num_neighbors, buffer.data());
+        }
+        return num_neighbors;
+    }
+}
 
-            return num_neighbors;
+size_t HNSW::fetch_neighbors_batch(
+        size_t n,
+        const idx_t* node_ids,
+        int level,
+        std::vector<std::vector<storage_idx_t>>& buffers) const {
+    buffers.resize(n);
+    size_t n_ios = 0;
+    if (!neighbors_on_disk || neighbors_use_mmap) {
+        for (size_t i = 0; i < n; i++) {
+            fetch_neighbors(node_ids[i], level, buffers[i], &n_ios);
+        }
+        return n_ios;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            storage_is_compact,
+            "Disk/mmap neighbors access requires compact storage format");
+    FAISS_THROW_IF_NOT_MSG(
+            graph_fd != -1,
+            "Graph file descriptor is not valid (file not opened?)");
+    FAISS_THROW_IF_NOT_MSG(
+            neighbors_start_offset >= 0,
+            "Invalid neighbors_start_offset for pread");
+
+    std::vector<BatchedFileReader::Request> requests;
+    requests.reserve(n);
+    // compressed lists are read to scratch buffers and decoded
+    thread_local std::vector<std::vector<uint8_t>> compressed;
+    if (compress_neighbors && compressed.size() < n) {
+        compressed.resize(n);
+    }
+    for (size_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT_FMT(
+                node_ids[i] >= 0 && (size_t)node_ids[i] < levels.size(),
+                "fetch_neighbors_batch: node_id %ld out of range [0, %zu)",
+                (long)node_ids[i],
+                levels.size());
+        size_t begin_idx, end_idx;
+        neighbor_range(node_ids[i], level, &begin_idx, &end_idx);
+        buffers[i].resize(end_idx - begin_idx);
+        if (end_idx == begin_idx) {
+            continue;
+        }
+        size_t byte_begin, byte_end;
+        neighbor_byte_range(node_ids[i], level, &byte_begin, &byte_end);
+        void* dest = buffers[i].data();
+        if (compress_neighbors) {
+            compressed[i].resize(byte_end - byte_begin);
+            dest = compressed[i].data();
+        }
+        // neighbors_start_offset points to the size field of the vector
+        off_t offset =
+                neighbors_start_offset + sizeof(size_t) + (off_t)byte_begin;
+        requests.push_back({offset, byte_end - byte_begin, dest});
+    }
+    if (graph_page_cache) {
+        n_ios = graph_page_cache->read(requests);
+    } else {
+        BatchedFileReader::thread_local_reader().read(graph_fd, requests);
+        n_ios = requests.size();
+    }
+    if (compress_neighbors) {
+        for (size_t i = 0; i < n; i++) {
+            decode_neighbor_list(
+                    compressed[i].data(), buffers[i].size(), buffers[i].data());
         }
     }
+    return n_ios;
 }
 
 bool HNSW::load_pq_pruning_data(
@@ -264,13 +327,12 @@ bool HNSW::load_pq_pruning_data(
         return false;
     }
 
-    uint8_t* loaded_codes_ptr = nullptr;
-    size_t num_vectors, codes_per_vector;
-    if (!load_simple_bin<uint8_t>(
-                pq_compressed_path,
-                loaded_codes_ptr,
-                num_vectors,
-                codes_per_vector)) {
+    // the codes are read in place, without an intermediate buffer
+    std::ifstream reader(pq_compressed_path, std::ios::binary);
+    uint32_t num_vectors = 0, codes_per_vector = 0;
+    reader.read(reinterpret_cast<char*>(&num_vectors), sizeof(uint32_t));
+    reader.read(reinterpret_cast<char*>(&codes_per_vector), sizeof(uint32_t));
+    if (!reader || num_vectors == 0) {
         std::cerr
                 << "Failed to load PQ compressed codes for pruning. PQ pruning disabled."
                 << std::endl;
@@ -280,15 +342,21 @@ bool HNSW::load_pq_pruning_data(
         std::cerr << "Error: Chunk count mismatch between pivots ("
                   << loader->get_num_chunks() << ") and compressed codes ("
                   << codes_per_vector << "). PQ pruning disabled." << std::endl;
-        delete[] loaded_codes_ptr;
         return false;
     }
 
-    code_size = codes_per_vector;
-    pq_codes.resize(num_vectors * code_size);
-    memcpy(pq_codes.data(), loaded_codes_ptr, num_vectors * code_size);
-    delete[] loaded_codes_ptr;
+    MaybeOwnedVector<uint8_t> codes((size_t)num_vectors * codes_per_vector);
+    reader.read(reinterpret_cast<char*>(codes.data()), codes.size());
+    if (!reader || (size_t)reader.gcount() != codes.size()) {
+        std::cerr
+                << "Failed to load PQ compressed codes for pruning. PQ pruning disabled."
+                << std::endl;
+        return false;
+    }
 
+    code_size = codes_per_vector;
+    pq_codes = std::move(codes);
+    pruning_pq = nullptr;
     pq_data_loader = loader;
     pq_loaded = true;
     std::cout << "Successfully loaded data for PQ pruning: " << num_vectors
@@ -296,6 +364,123 @@ bool HNSW::load_pq_pruning_data(
     return true;
 }
 
+namespace {
+
+/// nb of sub-quantizers as seen by the fast-scan kernels (even)
+size_t pq4_nsq(const ProductQuantizer& pq) {
+    return (pq.M + 1) / 2 * 2;
+}
+
+} // namespace
+
+void HNSW::set_pq_pruning_codes(
+        const ProductQuantizer& pq,
+        const uint8_t* codes,
+        MetricType metric) {
+    FAISS_THROW_IF_NOT_MSG(
+            pq.nbits == 4 || pq.nbits == 8, "4-bit or 8-bit PQ required");
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+            "only L2 and inner product are supported");
+    size_t ntotal = levels.size();
+
+    if (pq.nbits == 8) {
+        pq_codes = MaybeOwnedVector<uint8_t>(std::vector<uint8_t>(
+                codes, codes + ntotal * pq.code_size));
+        code_size = pq.code_size;
+    } else {
+        size_t nsq = pq4_nsq(pq);
+        size_t nb = (nb_neighbors(0) + 31) / 32 * 32;
+
+        std::vector<uint8_t> new_codes(ntotal * nb * nsq / 2);
+#pragma omp parallel
+        {
+            std::vector<storage_idx_t> list;
+            std::vector<uint8_t> list_codes;
+#pragma omp for schedule(dynamic, 256)
+            for (idx_t i = 0; i < ntotal; i++) {
+                fetch_neighbors(i, 0, list);
+                list_codes.resize(list.size() * pq.code_size);
+                for (size_t j = 0; j < list.size(); j++) {
+                    memcpy(list_codes.data() + j * pq.code_size,
+                           codes + list[j] * pq.code_size,
+                           pq.code_size);
+                }
+                pq4_pack_codes(
+                        list_codes.data(),
+                        list.size(),
+                        pq.M,
+                        nb,
+                        32,
+                        nsq,
+                        new_codes.data() + i * nb * nsq / 2);
+            }
+        }
+        pq_codes = MaybeOwnedVector<uint8_t>(std::move(new_codes));
+        code_size = nb * nsq / 2;
+    }
+
+    pq_data_loader = nullptr;
+    pruning_pq = std::make_shared<ProductQuantizer>(pq);
+    pruning_metric = metric;
+    pq_loaded = true;
+}
+
+void HNSW::pruning_distance_table(const float* x, float* dis_table) const {
+    if (pruning_metric == METRIC_L2) {
+        pruning_pq->compute_distance_table(x, dis_table);
+    } else {
+        // HNSW search expects distances to minimize
+        pruning_pq->compute_inner_prod_table(x, dis_table);
+        for (size_t j = 0; j < pruning_pq->M * pruning_pq->ksub; j++) {
+            dis_table[j] = -dis_table[j];
+        }
+    }
+}
+
+void HNSW::pq4_compute_lut(const float* x, uint8_t* lut, float* a, float* b)
+        const {
+    const ProductQuantizer& pq = *pruning_pq;
+    FAISS_THROW_IF_NOT(pq.nbits == 4);
+    size_t nsq = pq4_nsq(pq);
+    std::vector<float> dis_table(pq.M * pq.ksub);
+    pruning_distance_table(x, dis_table.data());
+    quantize_lut::round_uint8_per_column(
+            dis_table.data(), pq.M, pq.ksub, a, b);
+
+    std::vector<uint8_t> lut_u8(nsq * pq.ksub, 0);
+    for (size_t j = 0; j < pq.M * pq.ksub; j++) {
+        lut_u8[j] = int(dis_table[j]);
+    }
+    pq4_pack_LUT(1, nsq, lut_u8.data(), lut);
+}
+
+void HNSW::pq4_neighbor_distances(
+        idx_t node,
+        size_t n,
+        const uint8_t* lut,
+        float a,
+        float b,
+        float* dis) const {
+    size_t nsq = pq4_nsq(*pruning_pq);
+    size_t nb = code_size * 2 / nsq;
+    FAISS_THROW_IF_NOT(n <= nb);
+    const uint8_t* codes = pq_codes.data() + node * code_size;
+    // the kernels use aligned loads
+    thread_local AlignedTable<uint8_t> codes_copy;
+    if (!is_aligned_pointer(codes)) {
+        codes_copy.resize(code_size);
+        memcpy(codes_copy.data(), codes, code_size);
+        codes = codes_copy.data();
+    }
+    thread_local AlignedTable<uint16_t> accu;
+    accu.resize(nb);
+    accumulate_to_mem(1, nb, nsq, codes, lut, accu.data());
+    for (size_t i = 0; i < n; i++) {
+        dis[i] = b + accu[i] / a;
+    }
+}
+
 void HNSW::neighbor_range(idx_t no, int layer_no, size_t* begin, size_t* end)
         const {
     if (storage_is_compact) {
@@ -361,10 +546,167 @@ void HNSW::neighbor_range(idx_t no, int layer_no, size_t* begin, size_t* end)
     }
 }
 
+void HNSW::neighbor_byte_range(
+        idx_t no,
+        int layer_no,
+        size_t* begin,
+        size_t* end) const {
+    if (!compress_neighbors) {
+        neighbor_range(no, layer_no, begin, end);
+        *begin *= sizeof(storage_idx_t);
+        *end *= sizeof(storage_idx_t);
+        return;
+    }
+    FAISS_THROW_IF_NOT(storage_is_compact);
+    FAISS_THROW_IF_NOT_MSG(
+            compressed_level_ptr.size() == compact_level_ptr.size(),
+            "compressed neighbor offsets are not loaded");
+    size_t ptr_start = compact_node_offsets[no];
+    size_t ptr_end = compact_node_offsets[no + 1];
+    if (layer_no < 0 || ptr_start + layer_no + 1 >= ptr_end) {
+        *begin = *end = 0;
+        return;
+    }
+    *begin = compressed_level_ptr[ptr_start + layer_no];
+    *end = compressed_level_ptr[ptr_start + layer_no + 1];
+}
+
 // Candidates: Main Candidate Heap, stored the accurate distance
 using MinimaxHeap = HNSW::MinimaxHeap;
 using Node = HNSW::Node;
 using C = HNSW::C;
+
+namespace {
+
+/** Runs at most one speculative distances_batch call in the background.
+ *
+ * The DistanceComputer is not thread-safe, but it is only ever used by one
+ * thread at a time: compute() waits for the speculative call to finish
+ * before issuing its own request. Speculative distances are exact, so using
+ * them does not change the search results.
+ */
+struct SpeculativeDistanceFetcher {
+    DistanceComputer& qdis;
+    std::future<void> inflight;
+    std::vector<idx_t> inflight_ids;
+    std::vector<float> inflight_dis;
+    std::unordered_map<idx_t, float> prefetched;
+    size_t nspec = 0;
+    size_t nspec_hits = 0;
+
+    explicit SpeculativeDistanceFetcher(DistanceComputer& qdis)
+            : qdis(qdis) {}
+
+    void wait() {
+        if (!inflight.valid()) {
+            return;
+        }
+        inflight.get();
+        for (size_t i = 0; i < inflight_ids.size(); i++) {
+            prefetched[inflight_ids[i]] = inflight_dis[i];
+        }
+        inflight_ids.clear();
+    }
+
+    /// fills distances, using the prefetched values when available
+    void compute(const std::vector<idx_t>& ids, std::vector<float>& distances) {
+        wait();
+        std::vector<idx_t> missing;
+        std::vector<size_t> missing_idx;
+        for (size_t i = 0; i < ids.size(); i++) {
+            auto it = prefetched.find(ids[i]);
+            if (it != prefetched.end()) {
+                distances[i] = it->second;
+                prefetched.erase(it);
+                nspec_hits++;
+            } else {
+                missing.push_back(ids[i]);
+                missing_idx.push_back(i);
+            }
+        }
+        if (missing.empty()) {
+            return;
+        }
+        std::vector<float> missing_dis(missing.size());
+        qdis.distances_batch(missing, missing_dis);
+        for (size_t i = 0; i < missing.size(); i++) {
+            distances[missing_idx[i]] = missing_dis[i];
+        }
+    }
+
+    /// start computing distances for ids in the background
+    void speculate(std::vector<idx_t>&& ids) {
+        FAISS_ASSERT(!inflight.valid());
+        inflight_ids = std::move(ids);
+        if (inflight_ids.empty()) {
+            return;
+        }
+        nspec += inflight_ids.size();
+        inflight_dis.resize(inflight_ids.size());
+        inflight = std::async(std::launch::async, [this]() {
+            qdis.distances_batch(inflight_ids, inflight_dis);
+        });
+    }
+
+    ~SpeculativeDistanceFetcher() {
+        if (inflight.valid()) {
+            inflight.wait();
+        }
+    }
+};
+
+/** Buffers of search_from_candidates, kept by each thread from one query
+ * to the next so that the search loop does not allocate once they have
+ * reached their working size. */
+struct BeamSearchScratch {
+    // per-query buffers
+    std::vector<float> pq_dists_lookup;
+    std::vector<float> query_preprocessed;
+    std::vector<uint8_t> pq_code_scratch;
+    std::vector<float> pq_dists_out;
+    std::vector<float> pq4_list_dis;
+    std::unordered_map<idx_t, float> pq4_dis;
+    std::vector<idx_t> to_fetch;
+    std::vector<std::vector<HNSW::storage_idx_t>> fetched_lists;
+    std::vector<float> effort_features;
+
+    // per-round buffers
+    std::vector<int> beam_nodes;
+    std::vector<float> beam_distances;
+    /// unvisited neighbors of the beam nodes, possibly with duplicates
+    std::vector<idx_t> beam_neighbors;
+    std::vector<int> popped;
+    std::vector<float> popped_distances;
+    std::vector<std::vector<HNSW::storage_idx_t>> popped_lists;
+    std::vector<idx_t> nodes_to_compute;
+    std::vector<float> batch_distances;
+    std::vector<std::pair<float, int>> next_nodes;
+
+    bool in_use = false;
+};
+
+/// the scratch of the calling thread, or a private one if it is in use
+struct BeamSearchScratchRef {
+    std::unique_ptr<BeamSearchScratch> own;
+    BeamSearchScratch* scratch;
+
+    BeamSearchScratchRef() {
+        thread_local BeamSearchScratch tls;
+        if (tls.in_use) {
+            own = std::make_unique<BeamSearchScratch>();
+            scratch = own.get();
+        } else {
+            scratch = &tls;
+        }
+        scratch->in_use = true;
+    }
+
+    ~BeamSearchScratchRef() {
+        scratch->in_use = false;
+    }
+};
+
+} // namespace
 /** Do a BFS on the candidates list */
 int search_from_candidates(
         const HNSW& hnsw,
@@ -384,30 +726,45 @@ int search_from_candidates(
     int nres = nres_in;
     int ndis = 0;
     int nfetch = 0;
+    size_t n_ios = 0;
     int npq = 0;
 
-    int beam_size = 1; // Default beam width
-    int batch_size = 0;
-    bool use_batching = false; // Whether to use batching
+    int beam_size = std::max(hnsw.beam_size, 1);
+    int batch_size = hnsw.batch_size;
+    bool use_batching = batch_size > 0;
     // bool cache_distances = false;
 
     // Original search settings
     bool do_dis_check = hnsw.check_relative_distance;
     int efSearch = hnsw.efSearch;
     const IDSelector* sel = nullptr;
+    // deleted nodes are traversed but not returned
+    const uint8_t* tombstones =
+            hnsw.deleted.empty() ? nullptr : hnsw.deleted.data();
+
+    BeamSearchScratchRef scratch_ref;
+    BeamSearchScratch& scratch = *scratch_ref.scratch;
 
     // PQ pruning setup
-    float pq_select_ratio = 1;
-    std::vector<float> pq_dists_lookup;
-    std::vector<float> query_preprocessed;
-    std::vector<uint8_t> pq_code_scratch;
-    std::vector<float> pq_dists_out;
+    float pq_select_ratio = 1 - hnsw.pq_pruning_ratio;
+    std::vector<float>& pq_dists_lookup = scratch.pq_dists_lookup;
+    std::vector<float>& query_preprocessed = scratch.query_preprocessed;
+    std::vector<uint8_t>& pq_code_scratch = scratch.pq_code_scratch;
+    std::vector<float>& pq_dists_out = scratch.pq_dists_out;
 
-    std::vector<HNSW::storage_idx_t> neighbor_read_buffer; // For pread
     size_t max_deg_l0 = hnsw.nb_neighbors(0);
 
-    bool local_prune = false;
-    float send_neigh_times_ratio = 0;
+    bool local_prune = hnsw.local_prune;
+    float send_neigh_times_ratio = hnsw.send_neigh_times_ratio;
+    int pipeline_depth = 0;
+    int early_stop_patience = hnsw.early_stop_patience;
+    HNSWVisitProfiler* visit_profiler = nullptr;
+    // query-adaptive nb of expansions
+    const SearchEffortPredictor* effort_predictor = nullptr;
+    float* effort_features_out = nullptr;
+    // per-query budget, set by hnsw_search
+    const SearchBudget* budget = nullptr;
+    size_t list_bytes = max_deg_l0 * sizeof(HNSW::storage_idx_t);
 
     if (params) {
         if (const SearchParametersHNSW* hnsw_params =
@@ -433,37 +790,123 @@ int search_from_candidates(
 
             local_prune = hnsw_params->local_prune;
             send_neigh_times_ratio = hnsw_params->send_neigh_times_ratio;
+            pipeline_depth = hnsw_params->pipeline_depth;
+            if (hnsw_params->early_stop_patience >= 0) {
+                early_stop_patience = hnsw_params->early_stop_patience;
+            }
+            visit_profiler = hnsw_params->visit_profiler;
+            if (visit_profiler && !visit_profiler->sample_query()) {
+                visit_profiler = nullptr;
+            }
+            effort_predictor = hnsw_params->effort_predictor;
+            effort_features_out = hnsw_params->effort_features;
 
             // cache_distances = hnsw_params->cache_distances;
         }
         sel = params->sel;
+        budget = params->budget;
     }
 
+    const ProductQuantizer* pruning_pq = hnsw.pruning_pq.get();
+    bool use_pq4 = pruning_pq && pruning_pq->nbits == 4;
+    // the look-up tables are computed from the query vector
     bool perform_pq_pruning =
-            (hnsw.pq_data_loader && hnsw.pq_data_loader->is_initialized() &&
+            ((pruning_pq ||
+              (hnsw.pq_data_loader && hnsw.pq_data_loader->is_initialized())) &&
              (pq_select_ratio < 1 || local_prune ||
-              send_neigh_times_ratio != 0));
+              send_neigh_times_ratio != 0) &&
+             qdis.get_query());
+    // 4-bit PQ: quantized LUT, and the approximate distances of the unvisited
+    // neighbors of the nodes expanded in the current round
+    AlignedTable<uint8_t> pq4_lut;
+    float pq4_a = 1, pq4_b = 0;
+    std::vector<float>& pq4_list_dis = scratch.pq4_list_dis;
+    std::unordered_map<idx_t, float>& pq4_dis = scratch.pq4_dis;
+    pq4_dis.clear();
+    // nb of 8-bit sub-codes per vector
+    size_t pq_n_chunks = 0;
     // Initialize PQ data if needed
-    if (perform_pq_pruning) {
-        size_t dim = hnsw.pq_data_loader->get_dims();
-        size_t n_chunks = hnsw.pq_data_loader->get_num_chunks();
-        const float* original_query = qdis.get_query();
-
-        query_preprocessed.resize(dim);
-        memcpy(query_preprocessed.data(),
-               original_query,
-               (dim - 1) * sizeof(float));
-        query_preprocessed[dim - 1] = 0;
-        hnsw.pq_data_loader->preprocess_query(
-                query_preprocessed.data(), query_preprocessed.data());
-        pq_dists_lookup.resize(256 * n_chunks);
-        hnsw.pq_data_loader->populate_chunk_distances(
-                query_preprocessed.data(), pq_dists_lookup.data());
+    if (perform_pq_pruning && use_pq4) {
+        pq4_lut.resize((pruning_pq->M + 1) / 2 * 2 * 16);
+        hnsw.pq4_compute_lut(qdis.get_query(), pq4_lut.data(), &pq4_a, &pq4_b);
+        pq4_list_dis.resize(max_deg_l0);
+    } else if (perform_pq_pruning) {
+        if (pruning_pq) {
+            // same layout as the DiskANN tables: 256 entries per sub-code
+            pq_n_chunks = pruning_pq->M;
+            pq_dists_lookup.resize(pruning_pq->M * pruning_pq->ksub);
+            hnsw.pruning_distance_table(
+                    qdis.get_query(), pq_dists_lookup.data());
+        } else {
+            size_t dim = hnsw.pq_data_loader->get_dims();
+            pq_n_chunks = hnsw.pq_data_loader->get_num_chunks();
+            const float* original_query = qdis.get_query();
+
+            query_preprocessed.resize(dim);
+            memcpy(query_preprocessed.data(),
+                   original_query,
+                   (dim - 1) * sizeof(float));
+            query_preprocessed[dim - 1] = 0;
+            hnsw.pq_data_loader->preprocess_query(
+                    query_preprocessed.data(), query_preprocessed.data());
+            pq_dists_lookup.resize(256 * pq_n_chunks);
+            hnsw.pq_data_loader->populate_chunk_distances(
+                    query_preprocessed.data(), pq_dists_lookup.data());
+        }
 
         pq_code_scratch.resize(max_deg_l0 * hnsw.code_size);
         pq_dists_out.resize(max_deg_l0);
     }
-    neighbor_read_buffer.resize(max_deg_l0);
+
+    // speculative fetching of the next beam's neighbor distances
+    bool use_pipeline = pipeline_depth > 0 && !perform_pq_pruning;
+    SpeculativeDistanceFetcher fetcher(qdis);
+    // neighbor lists read while speculating, reused when the node is expanded
+    std::unordered_map<idx_t, std::vector<HNSW::storage_idx_t>>
+            spec_neighbor_lists;
+
+    // level 0 neighbor lists of several nodes, read with a single batch
+    std::vector<idx_t>& to_fetch = scratch.to_fetch;
+    std::vector<std::vector<HNSW::storage_idx_t>>& fetched_lists =
+            scratch.fetched_lists;
+    // with node blocks, the lists were read together with the vectors
+    NodeBlockDistanceComputer* block_dis =
+            dynamic_cast<NodeBlockDistanceComputer*>(&qdis);
+    auto read_level0_lists = [&]() {
+        FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_GRAPH_FETCH);
+        nfetch += to_fetch.size();
+        if (block_dis) {
+            n_ios += block_dis->take_neighbors(
+                    to_fetch.size(), to_fetch.data(), fetched_lists);
+        } else {
+            n_ios += hnsw.fetch_neighbors_batch(
+                    to_fetch.size(), to_fetch.data(), 0, fetched_lists);
+        }
+    };
+    auto fetch_level0_neighbors =
+            [&](const std::vector<int>& nodes,
+                std::vector<std::vector<HNSW::storage_idx_t>>& lists) {
+                lists.resize(nodes.size());
+                to_fetch.clear();
+                for (size_t i = 0; i < nodes.size(); i++) {
+                    auto it = spec_neighbor_lists.find(nodes[i]);
+                    if (it != spec_neighbor_lists.end()) {
+                        lists[i].swap(it->second);
+                        spec_neighbor_lists.erase(it);
+                    } else {
+                        to_fetch.push_back(nodes[i]);
+                    }
+                }
+                if (to_fetch.empty()) {
+                    return;
+                }
+                read_level0_lists();
+                for (size_t i = 0, j = 0; i < nodes.size(); i++) {
+                    if (j < to_fetch.size() && to_fetch[j] == nodes[i]) {
+                        lists[i].swap(fetched_lists[j++]);
+                    }
+                }
+            };
 
     // Global PQ candidate queue (min-heap)
     using PQCandidate = std::pair<float, idx_t>; // (pq_distance, node_id)
@@ -479,7 +922,8 @@ int search_from_candidates(
         idx_t v1 = candidates.ids[i];
         float d = candidates.dis[i];
         FAISS_ASSERT(v1 >= 0);
-        if (!sel || sel->is_member(v1)) {
+        if ((!tombstones || !tombstones[v1]) &&
+            (!sel || sel->is_member(v1))) {
             if (d < threshold) {
                 if (res.add_result(d, v1)) {
                     threshold = res.threshold;
@@ -488,9 +932,9 @@ int search_from_candidates(
         }
         vt.set(v1);
 
-        // Track this node visit
-        stats.node_visit_counts[v1]++;
-        // printf("Visted node: %ld\n", v1);
+        if (visit_profiler) {
+            visit_profiler->add_visit(v1);
+        }
 
         // // Add initial candidates to PQ queue if using PQ pruning
         // if (perform_pq_pruning) {
@@ -518,101 +962,148 @@ int search_from_candidates(
     }
 
     int nstep = 0;
+    // nb of consecutive rounds that did not improve the results
+    int n_stagnant = 0;
+
+    // features of the effort prediction: the relative improvements of the
+    // best distance over the first rounds, then the predicted nb of steps
+    int nfeatures = 0;
+    if (effort_predictor || effort_features_out) {
+        FAISS_THROW_IF_NOT_MSG(
+                effort_predictor,
+                "effort_features requires an effort_predictor");
+        nfeatures = effort_predictor->nfeatures;
+    }
+    std::vector<float>& effort_features = scratch.effort_features;
+    effort_features.clear();
+    float entry_dis = std::numeric_limits<float>::max();
+    for (int i = 0; i < candidates.size(); i++) {
+        entry_dis = std::min(entry_dis, candidates.dis[i]);
+    }
+    float best_dis = entry_dis;
+    int predicted_steps = 0;
+    auto end_features = [&]() {
+        // the search ended before nfeatures rounds: repeat the last gap
+        while (effort_features.size() < nfeatures) {
+            effort_features.push_back(
+                    effort_features.empty() ? 0 : effort_features.back());
+        }
+        if (effort_features_out) {
+            std::copy(
+                    effort_features.begin(),
+                    effort_features.end(),
+                    effort_features_out);
+        }
+    };
 
     while (candidates.size() > 0) {
         // Process nodes based on strategy
-        std::vector<int> beam_nodes;
-        std::vector<float> beam_distances;
-        std::map<idx_t, std::vector<idx_t>> beam_fetched_neighbors;
+        std::vector<int>& beam_nodes = scratch.beam_nodes;
+        std::vector<float>& beam_distances = scratch.beam_distances;
+        std::vector<idx_t>& beam_neighbors = scratch.beam_neighbors;
+        beam_nodes.clear();
+        beam_distances.clear();
+        beam_neighbors.clear();
         int total_neighbors = 0;
 
-        // 1. Get all beam nodes - either batch mode or fixed beam mode
-        if (use_batching) {
-            // Batch mode - get nodes until we reach batch_size neighbors
-            while (candidates.size() > 0 &&
-                   (beam_nodes.empty() || total_neighbors < batch_size)) {
-                float d0 = 0;
-                int v0 = candidates.pop_min(&d0);
-                assert(v0 >= 0);
-
-                // Track this node visit
-                stats.node_visit_counts[v0]++;
-                // printf("Visted node: %ld\n", v0);
-                if (do_dis_check) {
-                    // tricky stopping condition: there are more that ef
-                    // distances that are processed already that are smaller
-                    // than d0
-
-                    int n_dis_below = candidates.count_below(d0);
-                    if (n_dis_below >= efSearch) {
-                        break;
-                    }
+        // 1. Get all beam nodes - either batch mode or fixed beam mode. The
+        // nodes are popped in rounds and the neighbor lists of a round are
+        // fetched together.
+        bool stop_popping = false;
+        while (!stop_popping && candidates.size() > 0) {
+            size_t n_pop;
+            if (use_batching) {
+                // Batch mode - get nodes until we reach batch_size neighbors
+                if (!beam_nodes.empty() && total_neighbors >= batch_size) {
+                    break;
                 }
-
-                size_t node_neighbor_count =
-                        hnsw.fetch_neighbors(v0, 0, neighbor_read_buffer);
-                nfetch++;
-
-                std::vector<idx_t> current_node_neighbors;
-                FAISS_ASSERT(node_neighbor_count >= 0);
-                for (size_t i = 0; i < node_neighbor_count; ++i) {
-                    if (!vt.get(neighbor_read_buffer[i])) {
-                        current_node_neighbors.push_back(
-                                static_cast<idx_t>(neighbor_read_buffer[i]));
-                    }
+                // a node adds at most max_deg_l0 * pq_select_ratio
+                // neighbors, so at least that many nodes would be popped
+                // one by one
+                double max_per_node =
+                        std::max(1.0, max_deg_l0 * (double)pq_select_ratio);
+                n_pop = std::max(
+                        1.0,
+                        std::ceil(
+                                (batch_size - total_neighbors) /
+                                max_per_node));
+            } else {
+                n_pop = beam_size - beam_nodes.size();
+                if (n_pop == 0) {
+                    break;
                 }
-
-                beam_nodes.push_back(v0);
-                beam_distances.push_back(d0);
-                total_neighbors +=
-                        current_node_neighbors.size() * pq_select_ratio;
-                beam_fetched_neighbors[v0] = std::move(current_node_neighbors);
             }
-            // printf("get beam_nodes: %d\n", beam_nodes.size());
-            // printf("total_neighbors: %d\n", total_neighbors);
-        } else {
-            for (int b = 0; b < beam_size && candidates.size() > 0; b++) {
-                float d0 = 0;
-                int v0 = candidates.pop_min(&d0);
-                FAISS_ASSERT(v0 >= 0);
-
-                // Track this node visit
-                stats.node_visit_counts[v0]++;
-                // printf("Visted node: %ld\n", v0);
-
-                if (do_dis_check) {
-                    // tricky stopping condition: there are more that ef
-                    // distances that are processed already that are smaller
-                    // than d0
-
-                    int n_dis_below = candidates.count_below(d0);
-                    if (n_dis_below >= efSearch) {
-                        break;
+
+            std::vector<int>& popped = scratch.popped;
+            std::vector<float>& popped_distances = scratch.popped_distances;
+            popped.clear();
+            popped_distances.clear();
+            {
+                FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_HEAP);
+                while (popped.size() < n_pop && candidates.size() > 0) {
+                    float d0 = 0;
+                    int v0 = candidates.pop_min(&d0);
+                    FAISS_ASSERT(v0 >= 0);
+
+                    if (visit_profiler) {
+                        visit_profiler->add_visit(v0);
                     }
-                }
 
-                std::vector<idx_t> current_node_neighbors;
-                size_t node_neighbor_count =
-                        hnsw.fetch_neighbors(v0, 0, neighbor_read_buffer);
-                nfetch++;
+                    if (do_dis_check) {
+                        // tricky stopping condition: there are more that ef
+                        // distances that are processed already that are smaller
+                        // than d0
 
-                FAISS_ASSERT(node_neighbor_count >= 0);
+                        int n_dis_below = candidates.count_below(d0);
+                        if (n_dis_below >= efSearch) {
+                            stop_popping = true;
+                            break;
+                        }
+                    }
+                    popped.push_back(v0);
+                    popped_distances.push_back(d0);
+                }
+            }
 
-                for (size_t i = 0; i < node_neighbor_count; ++i) {
-                    if (!vt.get(neighbor_read_buffer[i])) {
-                        current_node_neighbors.push_back(
-                                static_cast<idx_t>(neighbor_read_buffer[i]));
+            std::vector<std::vector<HNSW::storage_idx_t>>& popped_lists =
+                    scratch.popped_lists;
+            fetch_level0_neighbors(popped, popped_lists);
+
+            for (size_t p = 0; p < popped.size(); p++) {
+                int v0 = popped[p];
+                const auto& list = popped_lists[p];
+                if (perform_pq_pruning && use_pq4) {
+                    FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_PQ_PRUNING);
+                    // one kernel pass for the whole neighbor list
+                    hnsw.pq4_neighbor_distances(
+                            v0,
+                            list.size(),
+                            pq4_lut.data(),
+                            pq4_a,
+                            pq4_b,
+                            pq4_list_dis.data());
+                }
+                size_t n_before = beam_neighbors.size();
+                {
+                    FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_VISITED);
+                    for (size_t j = 0; j < list.size(); j++) {
+                        HNSW::storage_idx_t v1 = list[j];
+                        if (!vt.get(v1)) {
+                            beam_neighbors.push_back(static_cast<idx_t>(v1));
+                            if (perform_pq_pruning && use_pq4) {
+                                pq4_dis[v1] = pq4_list_dis[j];
+                            }
+                        }
                     }
                 }
                 beam_nodes.push_back(v0);
-                beam_distances.push_back(d0);
+                beam_distances.push_back(popped_distances[p]);
                 total_neighbors +=
-                        current_node_neighbors.size() * pq_select_ratio;
-                beam_fetched_neighbors[v0] = std::move(current_node_neighbors);
+                        (beam_neighbors.size() - n_before) * pq_select_ratio;
             }
-            // printf("get beam_nodes: %d\n", beam_nodes.size());
-            // printf("total_neighbors: %d\n", total_neighbors);
         }
+        // printf("get beam_nodes: %d\n", beam_nodes.size());
+        // printf("total_neighbors: %d\n", total_neighbors);
 
         // Continue if we couldn't pop any valid nodes
         if (beam_nodes.empty()) {
@@ -620,47 +1111,54 @@ int search_from_candidates(
         }
 
         threshold = res.threshold;
-        std::set<idx_t> all_new_neighbors_set;
-
-        // 2. Process neighbors of all nodes in the beam
-        for (size_t b = 0; b < beam_nodes.size(); b++) {
-            int v0 = beam_nodes[b];
 
-            const auto& neighbors_of_v0 = beam_fetched_neighbors[v0];
-            for (idx_t v1 : neighbors_of_v0) {
-                assert(v1 >= 0);
-                assert(!vt.get(v1)); // Since the current_node_neighbors is
-                                     // already filtered by vt
-                all_new_neighbors_set.insert(v1);
-            }
+        // 2. Process neighbors of all nodes in the beam: they are already
+        // filtered by vt, sort them and remove the duplicates
+        std::vector<idx_t>& unique_new_neighbors = beam_neighbors;
+        {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_VISITED);
+            std::sort(unique_new_neighbors.begin(), unique_new_neighbors.end());
+            unique_new_neighbors.erase(
+                    std::unique(
+                            unique_new_neighbors.begin(),
+                            unique_new_neighbors.end()),
+                    unique_new_neighbors.end());
         }
-
-        std::vector<idx_t> unique_new_neighbors(
-                all_new_neighbors_set.begin(), all_new_neighbors_set.end());
-        std::vector<idx_t> nodes_to_compute;
+        std::vector<idx_t>& nodes_to_compute = scratch.nodes_to_compute;
+        nodes_to_compute.clear();
         size_t n_new = unique_new_neighbors.size();
 
         // Calculate PQ distances for unvisited neighbors and add to global PQ
         // queue
         if (perform_pq_pruning) {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_PQ_PRUNING);
             pq_code_scratch.resize(n_new * hnsw.code_size);
             pq_dists_out.resize(n_new);
 
-            size_t aggregated_count = aggregate_pq_codes(
-                    unique_new_neighbors.data(),
-                    n_new,
-                    hnsw.pq_codes.data(),
-                    hnsw.levels.size(),
-                    hnsw.code_size,
-                    pq_code_scratch.data());
-
-            FAISS_ASSERT(aggregated_count == unique_new_neighbors.size());
-            pq_distance_lookup(
-                    pq_code_scratch.data(),
-                    aggregated_count,
-                    hnsw.pq_data_loader->get_num_chunks(),
-                    pq_dists_lookup.data(),
-                    pq_dists_out.data());
+            size_t aggregated_count = n_new;
+            if (use_pq4) {
+                // computed when the neighbor lists were fetched
+                for (size_t i = 0; i < n_new; i++) {
+                    pq_dists_out[i] = pq4_dis.at(unique_new_neighbors[i]);
+                }
+                pq4_dis.clear();
+            } else {
+                aggregated_count = aggregate_pq_codes(
+                        unique_new_neighbors.data(),
+                        n_new,
+                        hnsw.pq_codes.data(),
+                        hnsw.levels.size(),
+                        hnsw.code_size,
+                        pq_code_scratch.data());
+
+                FAISS_ASSERT(aggregated_count == unique_new_neighbors.size());
+                pq_distance_lookup(
+                        pq_code_scratch.data(),
+                        aggregated_count,
+                        pq_n_chunks,
+                        pq_dists_lookup.data(),
+                        pq_dists_out.data());
+            }
             npq += aggregated_count;
 
             assert(pq_dists_out.size() == unique_new_neighbors.size());
@@ -749,6 +1247,7 @@ int search_from_candidates(
                 }
             }
         } else {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_VISITED);
             // If not using PQ pruning, process all new neighbors normally
             for (idx_t v1 : unique_new_neighbors) {
                 assert(!vt.get(v1));
@@ -759,23 +1258,85 @@ int search_from_candidates(
             }
         }
 
-        std::vector<float> batch_distances(nodes_to_compute.size());
-        qdis.distances_batch(nodes_to_compute, batch_distances);
+        std::vector<float>& batch_distances = scratch.batch_distances;
+        batch_distances.resize(nodes_to_compute.size());
+        if (use_pipeline) {
+            {
+                FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_DISTANCES);
+                fetcher.compute(nodes_to_compute, batch_distances);
+            }
+
+            // The nodes expanded next are most likely the best ones currently
+            // in the candidate heap: request the distances to their unvisited
+            // neighbors while this batch is being added to the heaps.
+            std::vector<std::pair<float, int>>& next_nodes = scratch.next_nodes;
+            next_nodes.clear();
+            for (int i = 0; i < candidates.k; i++) {
+                if (candidates.ids[i] != -1) {
+                    next_nodes.emplace_back(
+                            candidates.dis[i], candidates.ids[i]);
+                }
+            }
+            size_t n_next = std::min(
+                    next_nodes.size(),
+                    (size_t)pipeline_depth * beam_nodes.size());
+            std::partial_sort(
+                    next_nodes.begin(),
+                    next_nodes.begin() + n_next,
+                    next_nodes.end());
+
+            to_fetch.clear();
+            for (size_t i = 0; i < n_next; i++) {
+                int v = next_nodes[i].second;
+                if (!spec_neighbor_lists.count(v)) {
+                    to_fetch.push_back(v);
+                }
+            }
+            if (!to_fetch.empty()) {
+                read_level0_lists();
+                for (size_t i = 0; i < to_fetch.size(); i++) {
+                    spec_neighbor_lists[to_fetch[i]].swap(fetched_lists[i]);
+                }
+            }
+
+            std::vector<idx_t> spec_ids;
+            std::unordered_set<idx_t> spec_seen;
+            for (size_t i = 0; i < n_next; i++) {
+                int v = next_nodes[i].second;
+                for (HNSW::storage_idx_t v1 : spec_neighbor_lists[v]) {
+                    if (!vt.get(v1) && !fetcher.prefetched.count(v1) &&
+                        spec_seen.insert(v1).second) {
+                        spec_ids.push_back(v1);
+                    }
+                }
+            }
+            fetcher.speculate(std::move(spec_ids));
+        } else {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_DISTANCES);
+            qdis.distances_batch(nodes_to_compute, batch_distances);
+        }
 
+        bool improved = false;
         auto add_to_heap = [&](const size_t idx, const float dis) {
-            if (!sel || sel->is_member(idx)) {
+            if ((!tombstones || !tombstones[idx]) &&
+                (!sel || sel->is_member(idx))) {
                 if (dis < threshold) {
                     if (res.add_result(dis, idx)) {
                         threshold = res.threshold;
                         nres += 1;
+                        improved = true;
                     }
                 }
+                best_dis = std::min(best_dis, dis);
             }
             candidates.push(idx, dis);
         };
 
-        for (size_t i = 0; i < nodes_to_compute.size(); i++) {
-            add_to_heap(nodes_to_compute[i], batch_distances[i]);
+        {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_HEAP);
+            for (size_t i = 0; i < nodes_to_compute.size(); i++) {
+                add_to_heap(nodes_to_compute[i], batch_distances[i]);
+            }
         }
 
         ndis += nodes_to_compute.size();
@@ -785,6 +1346,38 @@ int search_from_candidates(
         if (!do_dis_check && nstep > efSearch) {
             break;
         }
+        n_stagnant = improved ? 0 : n_stagnant + 1;
+        if (early_stop_patience > 0 && n_stagnant >= early_stop_patience) {
+            stats.n_early_stops++;
+            break;
+        }
+        if (nfeatures > 0 && effort_features.size() < nfeatures) {
+            effort_features.push_back(
+                    SearchEffortPredictor::relative_gap(entry_dis, best_dis));
+            if (effort_features.size() == nfeatures) {
+                end_features();
+                predicted_steps = (int)std::lround(
+                        effort_predictor->predict(effort_features.data()));
+            }
+        }
+        if (predicted_steps > 0 && nstep >= predicted_steps) {
+            stats.n_early_stops++;
+            break;
+        }
+        if (budget && candidates.size() > 0) {
+            SearchCost cost;
+            cost.ndis = stats.ndis + ndis;
+            cost.bytes = (stats.n_ios + n_ios) * list_bytes;
+            cost.fetches = qdis.get_fetch_count();
+            if (budget->exhausted(cost)) {
+                stats.n_budget_stops++;
+                break;
+            }
+        }
+    }
+
+    if (effort_features.size() < nfeatures) {
+        end_features();
     }
 
     // printf("fetch_disk_cache_counts: %d\n", fetch_disk_cache_counts);
@@ -797,8 +1390,12 @@ int search_from_candidates(
         }
         stats.ndis += ndis;
         stats.nhops += nstep;
-        stats.n_ios = nfetch;
+        stats.nfetch += nfetch;
+        stats.n_ios += n_ios;
         stats.n_pq_calcs = npq;
+        fetcher.wait();
+        stats.nspec += fetcher.nspec;
+        stats.nspec_hits += fetcher.nspec_hits;
 
         // Periodically dump node visit statistics to a file
         // static const size_t NODE_THRESHOLD =
@@ -848,4 +1445,168 @@ int search_from_candidates(
 
     return nres;
 }
+
+int search_from_candidates_two_hop(
+        const HNSW& hnsw,
+        DistanceComputer& qdis,
+        ResultHandler<HNSW::C>& res,
+        HNSW::MinimaxHeap& candidates,
+        VisitedTable& vt,
+        HNSWStats& stats,
+        const IDSelector& sel,
+        int efSearch) {
+    using storage_idx_t = HNSW::storage_idx_t;
+    // deleted nodes are traversed but not returned
+    const uint8_t* tombstones =
+            hnsw.deleted.empty() ? nullptr : hnsw.deleted.data();
+    int nres = 0;
+    float threshold = res.threshold;
+    auto add_result = [&](storage_idx_t v, float d) {
+        if ((!tombstones || !tombstones[v]) && d < threshold) {
+            if (res.add_result(d, v)) {
+                threshold = res.threshold;
+                nres += 1;
+            }
+        }
+    };
+    for (int i = 0; i < candidates.size(); i++) {
+        storage_idx_t v1 = candidates.ids[i];
+        FAISS_ASSERT(v1 >= 0);
+        if (sel.is_member(v1)) {
+            add_result(v1, candidates.dis[i]);
+        }
+        vt.set(v1);
+    }
+
+    size_t max_expand = hnsw.nb_neighbors(0);
+    std::vector<idx_t> expanded(1), skipped, to_compute, neighbor_ids;
+    std::vector<uint8_t> neighbor_mask;
+    std::vector<std::vector<storage_idx_t>> lists, hop_lists;
+    std::vector<float> distances;
+    size_t ndis = 0, nstep = 0, nfetch = 0, n_ios = 0;
+
+    while (candidates.size() > 0) {
+        float d0 = 0;
+        int v0 = candidates.pop_min(&d0);
+        if (candidates.count_below(d0) >= efSearch) {
+            break;
+        }
+        nstep++;
+
+        to_compute.clear();
+        skipped.clear();
+        {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_GRAPH_FETCH);
+            expanded[0] = v0;
+            n_ios += hnsw.fetch_neighbors_batch(1, expanded.data(), 0, lists);
+            nfetch++;
+        }
+        neighbor_ids.clear();
+        for (storage_idx_t v1 : lists[0]) {
+            if (v1 < 0) {
+                break;
+            }
+            neighbor_ids.push_back(v1);
+        }
+        neighbor_mask.resize(neighbor_ids.size());
+        sel.is_member_batch(
+                neighbor_ids.size(), neighbor_ids.data(), neighbor_mask.data());
+        for (size_t j = 0; j < neighbor_ids.size(); j++) {
+            storage_idx_t v1 = neighbor_ids[j];
+            if (vt.get(v1)) {
+                continue;
+            }
+            if (neighbor_mask[j]) {
+                vt.set(v1);
+                to_compute.push_back(v1);
+            } else {
+                skipped.push_back(v1);
+            }
+        }
+        // skip over the unselected neighbors to their own neighbors
+        if (!skipped.empty() && to_compute.size() < max_expand) {
+            {
+                FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_GRAPH_FETCH);
+                n_ios += hnsw.fetch_neighbors_batch(
+                        skipped.size(), skipped.data(), 0, hop_lists);
+                nfetch += skipped.size();
+            }
+            for (size_t j = 0; j < skipped.size(); j++) {
+                bool complete = true;
+                for (storage_idx_t v2 : hop_lists[j]) {
+                    if (v2 < 0) {
+                        break;
+                    }
+                    if (to_compute.size() >= max_expand) {
+                        complete = false;
+                        break;
+                    }
+                    if (!vt.get(v2) && sel.is_member(v2)) {
+                        vt.set(v2);
+                        to_compute.push_back(v2);
+                    }
+                }
+                if (!complete) {
+                    break;
+                }
+                // the list of an unselected node is only expanded once
+                vt.set(skipped[j]);
+            }
+        }
+        if (to_compute.empty()) {
+            continue;
+        }
+
+        distances.resize(to_compute.size());
+        {
+            FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_DISTANCES);
+            qdis.distances_batch(to_compute, distances);
+        }
+        ndis += to_compute.size();
+        FAISS_HNSW_TRACE_SCOPE(HNSW_TRACE_HEAP);
+        for (size_t j = 0; j < to_compute.size(); j++) {
+            add_result(to_compute[j], distances[j]);
+            candidates.push(to_compute[j], distances[j]);
+        }
+    }
+
+    stats.n1++;
+    if (candidates.size() == 0) {
+        stats.n2++;
+    }
+    stats.ndis += ndis;
+    stats.nhops += nstep;
+    stats.nfetch += nfetch;
+    stats.n_ios += n_ios;
+    return nres;
+}
+
+SearchParametersHNSW::FilterStrategy hnsw_filter_strategy(
+        const SearchParameters* params,
+        idx_t ntotal) {
+    using S = SearchParametersHNSW;
+    if (!params || !params->sel) {
+        return S::FILTER_POST;
+    }
+    const S* hnsw_params = dynamic_cast<const S*>(params);
+    if (!hnsw_params) {
+        return S::FILTER_POST;
+    }
+    if (hnsw_params->filter_strategy != S::FILTER_AUTO) {
+        return hnsw_params->filter_strategy;
+    }
+    if (ntotal <= 0) {
+        return S::FILTER_POST;
+    }
+    double selectivity =
+            params->sel->estimate_cardinality(ntotal) / double(ntotal);
+    if (selectivity <= hnsw_params->filter_brute_force_ratio) {
+        return S::FILTER_BRUTE_FORCE;
+    }
+    if (selectivity <= hnsw_params->filter_two_hop_ratio) {
+        return S::FILTER_TWO_HOP;
+    }
+    return S::FILTER_POST;
+}
+
 } // namespace faiss
\ No newline at end of file
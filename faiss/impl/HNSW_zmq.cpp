@@ -24,8 +24,10 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/fp16.h>
 #include <faiss/utils/random.h>
 #include <faiss/utils/sorting.h>
+#include <faiss/utils/utils.h>
 
 #include <fcntl.h>
 #include <msgpack.hpp>
@@ -42,184 +44,15 @@
 
 #include "HNSW_zmq.h"
 
-namespace faiss {
-
-namespace {
-std::string experimental_disk_storage_path;
-off_t experimental_disk_data_offset;
-int experimental_block_size;
-std::vector<bool> experimental_is_in_top_degree_set;
-} // namespace
-
-void setup_experimental_top_degree_disk_read(
-        const std::string& degree_path,
-        float top_percent,
-        const std::string& storage_path,
-        off_t data_offset,
-        idx_t ntotal) {
-    FAISS_THROW_IF_NOT_FMT(
-            data_offset >= 0, "Data offset (%ld) invalid.", data_offset);
-    FAISS_THROW_IF_NOT_MSG(
-            top_percent >= 0.0f && top_percent <= 100.0f,
-            "top_percent invalid.");
-    FAISS_THROW_IF_NOT_FMT(
-            ntotal > 0, "ntotal (%ld) must be positive.", ntotal);
-
-    // 3. Determine threshold and build the boolean set
-    if (abs(top_percent - 0.0f) <= 1e-6) {
-        return;
-    }
-
-    // 1. Get block size
-    struct stat file_stat;
-    int block_size = 4096;
-    if (stat(storage_path.c_str(), &file_stat) == 0) {
-        block_size = (file_stat.st_blksize > 0) ? file_stat.st_blksize : 4096;
-    } else {
-        // Fail fast on stat error as block size is critical for O_DIRECT
-        FAISS_THROW_FMT(
-                "Setup Error: Cannot stat storage file %s: %s",
-                storage_path.c_str(),
-                strerror(errno));
-    }
-    FAISS_THROW_IF_NOT(block_size > 0);
-
-    // 2. Load degree distribution temporarily
-    std::vector<int> degrees;
-    std::ifstream degree_file(degree_path);
-    if (degree_file.is_open()) {
-        std::string line;
-        if (ntotal > 0)
-            degrees.reserve(ntotal);
-        while (std::getline(degree_file, line)) {
-            if (line.empty())
-                continue;
-            try {
-                degrees.push_back(std::stoi(line));
-            } catch (...) { /* ignore */
-            }
-        }
-        degree_file.close();
-    } else {
-        FAISS_THROW_FMT(
-                "Setup Error: Degree file not found: %s", degree_path.c_str());
-    }
-    FAISS_THROW_IF_NOT_FMT(
-            !degrees.empty(), "Degree file %s empty.", degree_path.c_str());
-    if ((idx_t)degrees.size() != ntotal) {
-        FAISS_THROW_FMT(
-                "Setup Error: Degree file size (%zu) != ntotal (%ld).",
-                degrees.size(),
-                ntotal);
-    }
-
-    std::vector<int> sorted_degrees = degrees;
-    std::sort(
-            sorted_degrees.begin(), sorted_degrees.end(), std::greater<int>());
+#include <faiss/impl/HybridEmbeddingStore.h>
 
-    float percentile = top_percent / 100.0f;
-    size_t threshold_idx = std::min(
-            (size_t)(sorted_degrees.size() * percentile) - 1,
-            sorted_degrees.size() - 1); // Clamp index
-
-    int degree_threshold =
-            sorted_degrees[threshold_idx]; // Store threshold for info
-
-    std::vector<bool> is_in_top_degree_set(ntotal, false);
-    size_t top_node_count = 0;
-    for (idx_t i = 0; i < ntotal; ++i) {
-        if (degrees[i] >= degree_threshold) {
-            is_in_top_degree_set[i] = true;
-            top_node_count++;
-        }
-    }
-    experimental_disk_storage_path = storage_path;
-    experimental_disk_data_offset = data_offset;
-    experimental_block_size = block_size;
-    experimental_is_in_top_degree_set = is_in_top_degree_set;
-
-    printf("ZmqDC Setup: Disk logic Top %.2f%% (deg>=%d). %zu nodes. Offset=%ld, BlkSize=%d\n",
-           top_percent,
-           degree_threshold,
-           top_node_count,
-           data_offset,
-           block_size);
-}
+namespace faiss {
 
 bool fetch_embeddings_zmq(
         const std::vector<uint32_t>& node_ids,
         std::vector<std::vector<float>>& out_embeddings,
         int zmq_port = 5557); // Default port kept
 
-float read_disk_and_compute_local_ip(idx_t i, size_t d, const float* query) {
-    size_t vector_bytes = d * sizeof(float);
-    std::vector<float> vec_buffer(d);
-    void* aligned_buffer = nullptr;
-    size_t block_size = experimental_block_size;
-
-    int fd;
-#ifdef __linux__
-    // O_DIRECT is Linux-specific
-    fd =
-            open(experimental_disk_storage_path.c_str(),
-                 O_RDONLY | O_CLOEXEC | O_DIRECT);
-#else
-    // macOS doesn't have O_DIRECT
-    fd = open(experimental_disk_storage_path.c_str(), O_RDONLY | O_CLOEXEC);
-#endif
-    if (fd == -1) {
-        assert(false);
-    }
-
-    off_t desired_start =
-            experimental_disk_data_offset + (off_t)i * vector_bytes;
-    off_t desired_end = desired_start + vector_bytes;
-    off_t aligned_start = (desired_start / block_size) * block_size;
-    off_t aligned_end =
-            ((desired_end + block_size - 1) / block_size) * block_size;
-    size_t bytes_to_read_aligned = aligned_end - aligned_start;
-
-    assert(bytes_to_read_aligned > 0);
-    if (posix_memalign(&aligned_buffer, block_size, bytes_to_read_aligned) !=
-        0) {
-        assert(false);
-    }
-
-    ssize_t bytes_read =
-            pread(fd, aligned_buffer, bytes_to_read_aligned, aligned_start);
-    close(fd);
-
-    assert(bytes_read == (ssize_t)bytes_to_read_aligned);
-    size_t internal_offset = desired_start - aligned_start;
-    // Check bounds before memcpy
-    assert(internal_offset + vector_bytes <= bytes_to_read_aligned);
-    memcpy(vec_buffer.data(),
-           (char*)aligned_buffer + internal_offset,
-           vector_bytes);
-    // For IP metric, we need to return negative IP
-    // fetch embeddings to check
-    // std::vector<std::vector<float>> out_embeddings;
-    // bool success = fetch_embeddings_zmq(
-    //         std::vector<uint32_t>{(uint32_t)i}, out_embeddings, 5557);
-    // assert(success);
-    // assert(out_embeddings.size() == 1);
-    // assert(out_embeddings[0].size() == d);
-    // for (auto i = 0; i < out_embeddings.size(); i++) {
-    //     for (auto j = 0; j < out_embeddings[i].size(); j++) {
-    //         if (abs(out_embeddings[i][j] - vec_buffer[j]) > 1e-3) {
-    //             printf("ERROR: disk and remote fetched embeddings mismatch
-    //             for id %ld, error: %f\n",
-    //                    i,
-    //                    abs(out_embeddings[i][j] - vec_buffer[j]));
-    //         }
-    //     }
-    //     printf("\n");
-    // }
-    float distance = -fvec_inner_product(query, vec_buffer.data(), d);
-    free(aligned_buffer);
-    return distance;
-}
-
 // --- MessagePack Data Structures (Define simple structs for serialization) ---
 struct EmbeddingRequestMsgpack {
     std::vector<uint32_t> node_ids;
@@ -252,6 +85,529 @@ struct DistanceResponseMsgpack {
     MSGPACK_DEFINE_ARRAY(distances); // [ [distances] ]
 };
 
+/**************************************************************
+ * ZmqConnectionPool
+ **************************************************************/
+
+ZmqConnectionPool& ZmqConnectionPool::instance() {
+    static ZmqConnectionPool pool;
+    return pool;
+}
+
+ZmqConnectionPool::~ZmqConnectionPool() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [port, state] : ports) {
+        for (void* socket : state.idle) {
+            zmq_close(socket);
+        }
+    }
+    ports.clear();
+    // zmq_ctx_term blocks until all sockets are closed, so leave the context
+    // to the OS if some thread still holds a socket at exit
+    if (context && n_checked_out == 0) {
+        zmq_ctx_term(context);
+    }
+    context = nullptr;
+}
+
+int ZmqConnectionPool::pick_replica(
+        int zmq_port,
+        bool stateless,
+        const std::vector<int>& exclude) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::vector<int>& replicas = ports[zmq_port].replicas;
+    if (replicas.empty()) {
+        return zmq_port;
+    }
+    if (!stateless) {
+        return replicas[0];
+    }
+    double now = getmillisecs();
+    int best = -1, best_outstanding = 0;
+    // first pass: skip the excluded and down replicas
+    for (int pass = 0; pass < 2 && best < 0; pass++) {
+        for (int replica : replicas) {
+            const PortState& state = ports[replica];
+            if (pass == 0 &&
+                (state.down_until > now ||
+                 std::find(exclude.begin(), exclude.end(), replica) !=
+                         exclude.end())) {
+                continue;
+            }
+            if (best < 0 || state.n_outstanding < best_outstanding) {
+                best = replica;
+                best_outstanding = state.n_outstanding;
+            }
+        }
+    }
+    return best;
+}
+
+double ZmqConnectionPool::latency_percentile_locked(
+        const PortState& state,
+        double p) {
+    if (state.latencies.empty()) {
+        return -1;
+    }
+    std::vector<float> lat = state.latencies;
+    size_t i = std::min(lat.size() - 1, size_t(p * lat.size()));
+    std::nth_element(lat.begin(), lat.begin() + i, lat.end());
+    return lat[i];
+}
+
+double ZmqConnectionPool::hedge_delay(int zmq_port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const PortState& state = ports[zmq_port];
+    double delay = state.latencies.size() < min_latency_samples
+            ? default_hedge_delay_ms
+            : latency_percentile_locked(state, hedge_percentile);
+    return std::max(delay, double(min_hedge_delay_ms));
+}
+
+double ZmqConnectionPool::latency_percentile(int zmq_port, double p) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return latency_percentile_locked(ports[zmq_port], p);
+}
+
+int ZmqConnectionPool::n_outstanding(int zmq_port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ports[zmq_port].n_outstanding;
+}
+
+void ZmqConnectionPool::set_replicas(
+        int zmq_port,
+        const std::vector<int>& replica_ports) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ports[zmq_port].replicas = replica_ports;
+}
+
+void* ZmqConnectionPool::acquire(int zmq_port) {
+    std::unique_lock<std::mutex> lock(mutex);
+    PortState& state = ports[zmq_port];
+    if (state.down_until > 0) {
+        if (getmillisecs() < state.down_until) {
+            return nullptr;
+        }
+        // back-off expired: let requests probe the server again
+        state.down_until = 0;
+        state.consecutive_failures = 0;
+    }
+    if (!state.idle.empty()) {
+        void* socket = state.idle.back();
+        state.idle.pop_back();
+        n_checked_out++;
+        state.n_outstanding++;
+        return socket;
+    }
+    std::string endpoint = state.endpoint.empty()
+            ? "tcp://127.0.0.1:" + std::to_string(zmq_port)
+            : state.endpoint;
+    if (!context) {
+        context = zmq_ctx_new();
+        if (!context) {
+            return nullptr;
+        }
+    }
+    n_checked_out++;
+    state.n_outstanding++;
+    lock.unlock();
+
+    void* socket = zmq_socket(context, ZMQ_REQ);
+    if (!socket) {
+        lock.lock();
+        n_checked_out--;
+        ports[zmq_port].n_outstanding--;
+        return nullptr;
+    }
+    int timeout = timeout_ms;
+    int linger = 0;
+    zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+    zmq_setsockopt(socket, ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
+    zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+    if (zmq_connect(socket, endpoint.c_str()) != 0) {
+        zmq_close(socket);
+        lock.lock();
+        n_checked_out--;
+        ports[zmq_port].n_outstanding--;
+        return nullptr;
+    }
+    n_connects++;
+    return socket;
+}
+
+void ZmqConnectionPool::release(
+        int zmq_port,
+        void* socket,
+        bool healthy,
+        double latency_ms) {
+    std::unique_lock<std::mutex> lock(mutex);
+    n_checked_out--;
+    PortState& state = ports[zmq_port];
+    state.n_outstanding--;
+    if (latency_ms >= 0 && latency_window > 0) {
+        if (state.latencies.size() < latency_window) {
+            state.latencies.push_back(latency_ms);
+        } else {
+            state.latencies[state.latency_pos % state.latencies.size()] =
+                    latency_ms;
+        }
+        state.latency_pos++;
+    }
+    if (healthy) {
+        state.consecutive_failures = 0;
+        if (state.idle.size() < max_idle_per_port) {
+            state.idle.push_back(socket);
+            return;
+        }
+    } else if (++state.consecutive_failures >= max_consecutive_failures) {
+        state.down_until = getmillisecs() + backoff_ms;
+        // the other idle sockets of this port are likely dead as well
+        for (void* s : state.idle) {
+            zmq_close(s);
+        }
+        state.idle.clear();
+    }
+    lock.unlock();
+    zmq_close(socket);
+}
+
+void ZmqConnectionPool::discard(int zmq_port, void* socket) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_checked_out--;
+        ports[zmq_port].n_outstanding--;
+    }
+    // the REQ socket still waits for its reply, it cannot be reused
+    zmq_close(socket);
+}
+
+bool ZmqConnectionPool::request(
+        int zmq_port,
+        const void* req,
+        size_t req_size,
+        const std::function<bool(const char*, size_t)>& on_reply,
+        bool stateless) {
+    n_requests++;
+    size_t n_replicas;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_replicas = ports[zmq_port].replicas.size();
+    }
+    bool replicated = stateless && n_replicas > 1;
+    // replicas that failed during this request, avoided by the retries
+    std::vector<int> failed;
+    for (int attempt = 0; attempt <= max_retries; attempt++) {
+        int port0 = pick_replica(zmq_port, stateless, failed);
+        void* socket = acquire(port0);
+        if (!socket) {
+            if (!replicated) {
+                break;
+            }
+            failed.push_back(port0);
+            continue;
+        }
+        double t0 = getmillisecs();
+        if (zmq_send(socket, req, req_size, 0) < 0) {
+            release(port0, socket, false);
+            failed.push_back(port0);
+            continue;
+        }
+
+        // hedge the request on another replica if it is slow to reply
+        int port1 = -1;
+        void* socket1 = nullptr;
+        double t1 = 0;
+        if (replicated && hedge_requests) {
+            zmq_pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+            double delay = hedge_delay(port0);
+            if (zmq_poll(&item, 1, long(delay)) == 0) {
+                std::vector<int> exclude = failed;
+                exclude.push_back(port0);
+                port1 = pick_replica(zmq_port, true, exclude);
+                if (port1 != port0) {
+                    socket1 = acquire(port1);
+                }
+                t1 = getmillisecs();
+                if (socket1 && zmq_send(socket1, req, req_size, 0) < 0) {
+                    release(port1, socket1, false);
+                    socket1 = nullptr;
+                }
+                if (socket1) {
+                    n_hedged++;
+                }
+            }
+        }
+
+        // the socket that holds the reply
+        int port_r = port0;
+        void* socket_r = socket;
+        double t_r = t0;
+        if (socket1) {
+            zmq_pollitem_t items[2] = {
+                    {socket, 0, ZMQ_POLLIN, 0}, {socket1, 0, ZMQ_POLLIN, 0}};
+            long remaining = std::max(long(timeout_ms - (t1 - t0)), 0L);
+            if (zmq_poll(items, 2, remaining) <= 0) {
+                release(port0, socket, false);
+                release(port1, socket1, false);
+                failed.push_back(port0);
+                failed.push_back(port1);
+                continue;
+            }
+            if (items[0].revents & ZMQ_POLLIN) {
+                discard(port1, socket1);
+            } else {
+                discard(port0, socket);
+                port_r = port1;
+                socket_r = socket1;
+                t_r = t1;
+                n_hedge_wins++;
+            }
+        }
+
+        zmq_msg_t response;
+        zmq_msg_init(&response);
+        if (zmq_msg_recv(&response, socket_r, 0) < 0) {
+            zmq_msg_close(&response);
+            release(port_r, socket_r, false);
+            failed.push_back(port_r);
+            continue;
+        }
+        // the socket is back in a clean state whatever the reply contains
+        release(port_r, socket_r, true, getmillisecs() - t_r);
+        bool ok = on_reply(
+                static_cast<const char*>(zmq_msg_data(&response)),
+                zmq_msg_size(&response));
+        zmq_msg_close(&response);
+        if (!ok) {
+            n_failures++;
+        }
+        return ok;
+    }
+    n_failures++;
+    return false;
+}
+
+void ZmqConnectionPool::reset(int zmq_port) {
+    std::vector<void*> to_close;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& [port, state] : ports) {
+            if (zmq_port != -1 && port != zmq_port) {
+                continue;
+            }
+            to_close.insert(
+                    to_close.end(), state.idle.begin(), state.idle.end());
+            state.idle.clear();
+            state.consecutive_failures = 0;
+            state.down_until = 0;
+        }
+    }
+    for (void* socket : to_close) {
+        zmq_close(socket);
+    }
+}
+
+bool ZmqConnectionPool::is_down(int zmq_port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ports.find(zmq_port);
+    return it != ports.end() && it->second.down_until > getmillisecs();
+}
+
+void ZmqConnectionPool::set_endpoint(
+        int zmq_port,
+        const std::string& endpoint,
+        bool raw_frames) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PortState& state = ports[zmq_port];
+        state.endpoint = endpoint;
+        state.raw_frames = raw_frames;
+    }
+    // the idle sockets are connected to the previous endpoint
+    reset(zmq_port);
+}
+
+bool ZmqConnectionPool::uses_raw_frames(int zmq_port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ports.find(zmq_port);
+    if (it != ports.end() && !it->second.replicas.empty()) {
+        it = ports.find(it->second.replicas[0]);
+    }
+    return it != ports.end() && it->second.raw_frames;
+}
+
+/**************************************************************
+ * ZmqEmbeddingCache
+ **************************************************************/
+
+namespace {
+// approximate memory used by an entry besides its code: LRU list node,
+// hash table node and vector header
+const size_t embedding_cache_entry_overhead = 96;
+} // namespace
+
+ZmqEmbeddingCache::ZmqEmbeddingCache(
+        size_t d,
+        size_t max_bytes,
+        Codec codec,
+        int n_shards)
+        : d(d), max_bytes(max_bytes), codec(codec) {
+    FAISS_THROW_IF_NOT_MSG(d > 0, "Dimension must be positive");
+    FAISS_THROW_IF_NOT_MSG(n_shards > 0, "need at least one shard");
+    FAISS_THROW_IF_NOT_MSG(
+            codec == CODEC_FP32 || codec == CODEC_FP16 || codec == CODEC_SQ8,
+            "unknown embedding cache codec");
+    max_bytes_per_shard = max_bytes / n_shards;
+    shards.resize(n_shards);
+    for (auto& shard : shards) {
+        shard.reset(new Shard());
+    }
+}
+
+size_t ZmqEmbeddingCache::code_size() const {
+    switch (codec) {
+        case CODEC_FP16:
+            return d * sizeof(uint16_t);
+        case CODEC_SQ8:
+            return 2 * sizeof(float) + d;
+        default:
+            return d * sizeof(float);
+    }
+}
+
+size_t ZmqEmbeddingCache::entry_size() const {
+    return code_size() + embedding_cache_entry_overhead;
+}
+
+void ZmqEmbeddingCache::encode(const float* x, uint8_t* code) const {
+    switch (codec) {
+        case CODEC_FP16:
+            for (size_t i = 0; i < d; i++) {
+                uint16_t h = encode_fp16(x[i]);
+                memcpy(code + i * sizeof(uint16_t), &h, sizeof(h));
+            }
+            break;
+        case CODEC_SQ8: {
+            float vmin = x[0], vmax = x[0];
+            for (size_t i = 1; i < d; i++) {
+                vmin = std::min(vmin, x[i]);
+                vmax = std::max(vmax, x[i]);
+            }
+            float scale = (vmax - vmin) / 255.0f;
+            memcpy(code, &vmin, sizeof(float));
+            memcpy(code + sizeof(float), &scale, sizeof(float));
+            uint8_t* q = code + 2 * sizeof(float);
+            for (size_t i = 0; i < d; i++) {
+                float v = scale > 0 ? (x[i] - vmin) / scale : 0;
+                q[i] = (uint8_t)std::min(255.0f, std::max(0.0f, v + 0.5f));
+            }
+            break;
+        }
+        default:
+            memcpy(code, x, d * sizeof(float));
+    }
+}
+
+void ZmqEmbeddingCache::decode(const uint8_t* code, float* x) const {
+    switch (codec) {
+        case CODEC_FP16:
+            for (size_t i = 0; i < d; i++) {
+                uint16_t h;
+                memcpy(&h, code + i * sizeof(uint16_t), sizeof(h));
+                x[i] = decode_fp16(h);
+            }
+            break;
+        case CODEC_SQ8: {
+            float vmin, scale;
+            memcpy(&vmin, code, sizeof(float));
+            memcpy(&scale, code + sizeof(float), sizeof(float));
+            const uint8_t* q = code + 2 * sizeof(float);
+            for (size_t i = 0; i < d; i++) {
+                x[i] = vmin + q[i] * scale;
+            }
+            break;
+        }
+        default:
+            memcpy(x, code, d * sizeof(float));
+    }
+}
+
+bool ZmqEmbeddingCache::lookup(idx_t id, float* out) {
+    Shard& shard = shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(id);
+    if (it == shard.entries.end()) {
+        n_misses++;
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_pos);
+    decode(it->second.code.data(), out);
+    n_hits++;
+    return true;
+}
+
+void ZmqEmbeddingCache::insert(idx_t id, const float* x, bool force) {
+    size_t esize = entry_size();
+    if (esize > max_bytes_per_shard) {
+        return;
+    }
+    Shard& shard = shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.entries.count(id)) {
+        return;
+    }
+    if (!force && admit_after > 1 && !hot_ids.count(id)) {
+        if (++shard.recent_misses[id] < admit_after) {
+            // bound the miss history to the capacity of the shard
+            if (shard.recent_misses.size() > max_bytes_per_shard / esize) {
+                shard.recent_misses.clear();
+            }
+            return;
+        }
+        shard.recent_misses.erase(id);
+    }
+    while (shard.nbytes + esize > max_bytes_per_shard) {
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+        shard.nbytes -= esize;
+        n_evictions++;
+    }
+    shard.lru.push_front(id);
+    Entry& entry = shard.entries[id];
+    entry.lru_pos = shard.lru.begin();
+    entry.code.resize(code_size());
+    encode(x, entry.code.data());
+    shard.nbytes += esize;
+}
+
+void ZmqEmbeddingCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->lru.clear();
+        shard->entries.clear();
+        shard->recent_misses.clear();
+        shard->nbytes = 0;
+    }
+}
+
+size_t ZmqEmbeddingCache::size() const {
+    size_t n = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        n += shard->entries.size();
+    }
+    return n;
+}
+
+size_t ZmqEmbeddingCache::nbytes() const {
+    size_t n = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        n += shard->nbytes;
+    }
+    return n;
+}
+
 // --- ZMQ Fetch Function (Using MessagePack) ---
 bool fetch_embeddings_zmq(
         const std::vector<uint32_t>& node_ids,
@@ -270,213 +626,421 @@ bool fetch_embeddings_zmq(
     }
     std::string req_str = buffer.str();
 
-    void* context = zmq_ctx_new();
-    if (!context) {
-        // fprintf(stderr,
-        //         "[fetch_zmq] zmq_ctx_new failed: %s\n",
-        //         zmq_strerror(zmq_errno()));
-        return false;
+    auto on_reply = [&](const char* resp_data, size_t resp_size) {
+        EmbeddingResponseMsgpack resp_msgpack;
+        try {
+            msgpack::object_handle oh = msgpack::unpack(resp_data, resp_size);
+            oh.get().convert(resp_msgpack);
+        } catch (const std::exception& e) {
+            std::cerr << "MessagePack unpack failed for embedding response: "
+                      << e.what() << std::endl;
+            return false;
+        }
+
+        if (resp_msgpack.dimensions.size() != 2) {
+            return false;
+        }
+        int batch_size = resp_msgpack.dimensions[0];
+        int embedding_dim = resp_msgpack.dimensions[1];
+
+        // Handle empty response
+        if (batch_size == 0) {
+            out_embeddings.clear();
+            return true; // Successful communication, no data returned
+        }
+
+        size_t expected_floats = (size_t)batch_size * embedding_dim;
+        if (resp_msgpack.embeddings_data.size() != expected_floats) {
+            return false;
+        }
+
+        for (float val : resp_msgpack.embeddings_data) {
+            if (std::isnan(val)) {
+                return false;
+            }
+        }
+
+        out_embeddings.clear();
+        out_embeddings.resize(batch_size);
+        const float* flat_data_ptr = resp_msgpack.embeddings_data.data();
+        for (int i = 0; i < batch_size; i++) {
+            out_embeddings[i].assign(
+                    flat_data_ptr + (size_t)i * embedding_dim,
+                    flat_data_ptr + ((size_t)i + 1) * embedding_dim);
+        }
+        return true;
+    };
+
+    return ZmqConnectionPool::instance().request(
+            zmq_port, req_str.data(), req_str.size(), on_reply);
+}
+
+bool fetch_embeddings_raw(
+        int zmq_port,
+        const uint32_t* ids,
+        size_t n,
+        size_t d,
+        const std::function<bool(const void* data, bool is_fp16)>& on_data) {
+    std::vector<uint32_t> req(n + 2);
+    req[0] = raw_embedding_request_magic;
+    req[1] = n;
+    memcpy(req.data() + 2, ids, n * sizeof(uint32_t));
+
+    auto on_reply = [&](const char* resp_data, size_t resp_size) {
+        uint32_t header[3];
+        if (resp_size < sizeof(header)) {
+            return false;
+        }
+        memcpy(header, resp_data, sizeof(header));
+        if (header[0] != n || header[1] != d || header[2] > 1) {
+            return false;
+        }
+        bool is_fp16 = header[2] == 1;
+        size_t value_size = is_fp16 ? sizeof(uint16_t) : sizeof(float);
+        if (resp_size != sizeof(header) + n * d * value_size) {
+            return false;
+        }
+        // the values are 4-byte aligned in the message
+        return on_data(resp_data + sizeof(header), is_fp16);
+    };
+
+    return ZmqConnectionPool::instance().request(
+            zmq_port, req.data(), req.size() * sizeof(uint32_t), on_reply);
+}
+
+bool fetch_embeddings_zmq_into(
+        const std::vector<uint32_t>& ids,
+        size_t d,
+        float* out,
+        int zmq_port) {
+    if (ZmqConnectionPool::instance().uses_raw_frames(zmq_port)) {
+        return fetch_embeddings_raw(
+                zmq_port,
+                ids.data(),
+                ids.size(),
+                d,
+                [&](const void* data, bool is_fp16) {
+                    size_t nv = ids.size() * d;
+                    if (is_fp16) {
+                        const uint16_t* codes = (const uint16_t*)data;
+                        for (size_t i = 0; i < nv; i++) {
+                            out[i] = decode_fp16(codes[i]);
+                        }
+                    } else {
+                        memcpy(out, data, nv * sizeof(float));
+                    }
+                    return true;
+                });
     }
-    void* socket = zmq_socket(context, ZMQ_REQ);
-    if (!socket) {
-        // fprintf(stderr,
-        //         "[fetch_zmq] zmq_socket failed: %s\n",
-        //         zmq_strerror(zmq_errno()));
-        zmq_ctx_destroy(context);
+    std::vector<std::vector<float>> embeddings;
+    if (!fetch_embeddings_zmq(ids, embeddings, zmq_port) ||
+        embeddings.size() != ids.size()) {
         return false;
     }
-    int timeout = 30000;
-    zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
-    zmq_setsockopt(socket, ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
-    std::string endpoint = "tcp://127.0.0.1:" + std::to_string(zmq_port);
-    if (zmq_connect(socket, endpoint.c_str()) != 0) {
-        // fprintf(stderr,
-        //         "[fetch_zmq] zmq_connect failed: %s\n",
-        //         zmq_strerror(zmq_errno()));
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
+    for (size_t i = 0; i < embeddings.size(); i++) {
+        if (embeddings[i].size() != d) {
+            return false;
+        }
+        memcpy(out + i * d, embeddings[i].data(), d * sizeof(float));
     }
+    return true;
+}
 
-    if (zmq_send(socket, req_str.data(), req_str.size(), 0) < 0) { /*...*/
-        // fprintf(stderr,
-        //         "[fetch_zmq] zmq_msg_recv failed: %s\n",
-        //         zmq_strerror(zmq_errno()));
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
+uint64_t pin_query_raw(
+        int zmq_port,
+        const float* query,
+        size_t d,
+        MetricType metric_type,
+        uint64_t replaced_handle) {
+    std::vector<char> req(3 * sizeof(uint32_t) + sizeof(uint64_t) +
+                          d * sizeof(float));
+    uint32_t header[3] = {
+            raw_query_pin_magic, (uint32_t)d, (uint32_t)metric_type};
+    char* p = req.data();
+    memcpy(p, header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, &replaced_handle, sizeof(replaced_handle));
+    p += sizeof(replaced_handle);
+    memcpy(p, query, d * sizeof(float));
+
+    uint64_t handle = 0;
+    auto on_reply = [&](const char* resp_data, size_t resp_size) {
+        if (resp_size != sizeof(handle)) {
+            return false;
+        }
+        memcpy(&handle, resp_data, sizeof(handle));
+        return true;
+    };
+    if (!ZmqConnectionPool::instance().request(
+                zmq_port, req.data(), req.size(), on_reply, false)) {
+        return 0;
     }
+    return handle;
+}
 
-    zmq_msg_t response;
-    zmq_msg_init(&response);
-    if (zmq_msg_recv(&response, socket, 0) < 0) { /*...*/
-        // fprintf(stderr,
-        //         "[fetch_zmq] zmq_msg_recv failed: %s\n",
-        //         zmq_strerror(zmq_errno()));
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
+bool fetch_distances_raw(
+        int zmq_port,
+        uint64_t handle,
+        const uint32_t* ids,
+        size_t n,
+        float* out) {
+    std::vector<char> req(2 * sizeof(uint32_t) + sizeof(uint64_t) +
+                          n * sizeof(uint32_t));
+    uint32_t header[2] = {raw_distance_request_magic, (uint32_t)n};
+    char* p = req.data();
+    memcpy(p, header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, &handle, sizeof(handle));
+    p += sizeof(handle);
+    memcpy(p, ids, n * sizeof(uint32_t));
+
+    auto on_reply = [&](const char* resp_data, size_t resp_size) {
+        uint32_t nr;
+        if (resp_size != sizeof(nr) + n * sizeof(float)) {
+            return false;
+        }
+        memcpy(&nr, resp_data, sizeof(nr));
+        if (nr != n) {
+            return false;
+        }
+        memcpy(out, resp_data + sizeof(nr), n * sizeof(float));
+        return true;
+    };
+    return ZmqConnectionPool::instance().request(
+            zmq_port, req.data(), req.size(), on_reply, false);
+}
 
-    EmbeddingResponseMsgpack resp_msgpack;
-    const char* resp_data = static_cast<const char*>(zmq_msg_data(&response));
-    size_t resp_size = zmq_msg_size(&response);
-    // printf("[fetch_zmq] Raw response bytes (first %d): ",
-    //        (int)std::min((size_t)64, resp_size));
-
-    msgpack::object_handle oh = msgpack::unpack(resp_data, resp_size);
-    msgpack::object obj = oh.get();
-    obj.convert(resp_msgpack); // Convert msgpack object to our struct
-    // for (size_t k = 0; k < std::min((size_t)64, resp_size); ++k)
-    //     printf("%02x ", (unsigned char)resp_data[k]);
-    // printf("\n");
-
-    // --- Print parsed values BEFORE NaN check ---
-    // printf("[fetch_zmq] Parsed response. Dimensions: %d x %d. Data floats:
-    // %zu\n",
-    //        resp_msgpack.dimensions.empty() ? 0 : resp_msgpack.dimensions[0],
-    //        resp_msgpack.dimensions.size() < 2 ? 0 :
-    //        resp_msgpack.dimensions[1], resp_msgpack.embeddings_data.size());
-    // printf("[fetch_zmq] Parsed embeddings_data (first %d floats): ",
-    //        (int)std::min((size_t)10, resp_msgpack.embeddings_data.size()));
-    // bool parse_contains_nan = false;
-    // for (size_t k = 0;
-    //      k < std::min((size_t)10, resp_msgpack.embeddings_data.size());
-    //      ++k) {
-    //     printf("%.6f ", resp_msgpack.embeddings_data[k]);
-    //     if (std::isnan(resp_msgpack.embeddings_data[k]))
-    //         parse_contains_nan = true;
-    // }
-    // printf("%s\n",
-    //        parse_contains_nan ? "!!! CONTAINS NaN AFTER PARSE !!!"
-    //                           : "(Checked first 10 for NaN)");
-
-    if (resp_msgpack.dimensions.size() != 2) {
-        // std::cerr << "Server response has invalid dimensions size: "
-        //           << resp_msgpack.dimensions.size() << std::endl;
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
-    int batch_size = resp_msgpack.dimensions[0];
-    int embedding_dim = resp_msgpack.dimensions[1];
+bool release_query_raw(int zmq_port, uint64_t handle) {
+    char req[sizeof(uint32_t) + sizeof(uint64_t)];
+    memcpy(req, &raw_query_release_magic, sizeof(uint32_t));
+    memcpy(req + sizeof(uint32_t), &handle, sizeof(handle));
+    return ZmqConnectionPool::instance().request(
+            zmq_port,
+            req,
+            sizeof(req),
+            [](const char*, size_t) { return true; },
+            false);
+}
 
-    // Handle empty response
-    if (batch_size == 0) {
-        out_embeddings.clear();
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return true; // Successful communication, no data returned
+/**************************************************************
+ * ZmqRequestCoalescer
+ **************************************************************/
+
+ZmqRequestCoalescer& ZmqRequestCoalescer::instance() {
+    static ZmqRequestCoalescer coalescer;
+    return coalescer;
+}
+
+void ZmqRequestCoalescer::add_participant() {
+    std::lock_guard<std::mutex> lock(mutex);
+    n_participants++;
+}
+
+void ZmqRequestCoalescer::remove_participant() {
+    std::lock_guard<std::mutex> lock(mutex);
+    n_participants--;
+    // a leader may be waiting for this participant to join
+    cv.notify_all();
+}
+
+bool ZmqRequestCoalescer::fetch_embeddings(
+        int zmq_port,
+        const std::vector<uint32_t>& ids,
+        size_t d,
+        float* out) {
+    if (ids.empty()) {
+        return true;
     }
+    n_requested_ids += ids.size();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    std::shared_ptr<Batch>& slot = open_batches[zmq_port];
+    bool is_leader = false;
+    if (!slot || slot->d != d) {
+        // batches with a different dimension cannot be merged: the
+        // current one is left to its leader, which owns it
+        slot = std::make_shared<Batch>();
+        slot->d = d;
+        is_leader = true;
+    }
+    std::shared_ptr<Batch> batch = slot;
+    std::vector<size_t> rows(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        auto it = batch->id_to_row.emplace(ids[i], batch->ids.size());
+        if (it.second) {
+            batch->ids.push_back(ids[i]);
+        }
+        rows[i] = it.first->second;
+    }
+    batch->n_callers++;
+
+    if (is_leader) {
+        auto deadline = std::chrono::steady_clock::now() +
+                std::chrono::microseconds(window_us);
+        cv.wait_until(lock, deadline, [&] {
+            return batch->ids.size() >= max_batch_size ||
+                    batch->n_callers >= n_participants;
+        });
+        // seal the batch: later callers start a new one
+        auto it = open_batches.find(zmq_port);
+        if (it != open_batches.end() && it->second == batch) {
+            open_batches.erase(it);
+        }
+        lock.unlock();
+
+        batch->data.resize(batch->ids.size() * d);
+        bool ok = fetch_embeddings_zmq_into(
+                batch->ids, d, batch->data.data(), zmq_port);
+        n_batches++;
+        n_sent_ids += batch->ids.size();
+
+        lock.lock();
+        batch->ok = ok;
+        batch->done = true;
+        cv.notify_all();
+    } else {
+        if (batch->ids.size() >= max_batch_size ||
+            batch->n_callers >= n_participants) {
+            cv.notify_all();
+        }
+        cv.wait(lock, [&] { return batch->done; });
+    }
+    lock.unlock();
 
-    size_t expected_floats = (size_t)batch_size * embedding_dim;
-    if (resp_msgpack.embeddings_data.size() != expected_floats) {
-        // std::cerr << "Embedding data size mismatch: Got "
-        //           << resp_msgpack.embeddings_data.size() << " floats,
-        //           expected "
-        //           << expected_floats << " (" << batch_size << "x"
-        //           << embedding_dim << ")" << std::endl;
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
+    if (!batch->ok) {
         return false;
     }
+    for (size_t i = 0; i < ids.size(); i++) {
+        memcpy(out + i * d,
+               batch->data.data() + rows[i] * d,
+               d * sizeof(float));
+    }
+    return true;
+}
 
-    bool received_nan = false;
-    for (float val : resp_msgpack.embeddings_data) {
-        if (std::isnan(val)) {
-            received_nan = true;
-            break;
-        }
+/**************************************************************
+ * IndexEmbeddingProvider
+ **************************************************************/
+
+IndexEmbeddingProvider::IndexEmbeddingProvider(
+        const Index* index,
+        bool serialize_calls)
+        : EmbeddingProvider(index->d),
+          index(index),
+          serialize_calls(serialize_calls) {}
+
+bool IndexEmbeddingProvider::get_embeddings(
+        size_t n,
+        const idx_t* ids,
+        float* out) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (serialize_calls) {
+        lock.lock();
     }
-    if (received_nan) {
-        // fprintf(stderr,
-        //         "!!! [fetch_zmq] ERROR: Final check confirms NaN values in
-        //         parsed embeddings_data! First requested ID: %u !!!\n",
-        //         node_ids.empty() ? 0 : node_ids[0]);
-        return false; // Decide whether to fail here
-    } else {
-        // printf("[fetch_zmq] Final check confirms embeddings data appears
-        // clean (no NaNs checked).\n"); // Can be verbose
+    try {
+        index->reconstruct_batch(n, ids, out);
+    } catch (const FaissException&) {
+        return false;
     }
+    return true;
+}
 
-    out_embeddings.clear();
-    out_embeddings.resize(batch_size);
-    const float* flat_data_ptr = resp_msgpack.embeddings_data.data();
-    for (int i = 0; i < batch_size; i++) {
-        out_embeddings[i].assign(
-                flat_data_ptr + (size_t)i * embedding_dim,
-                flat_data_ptr + ((size_t)i + 1) * embedding_dim);
+ZmqDistanceComputer::~ZmqDistanceComputer() {
+    set_coalescer(nullptr);
+    if (query_handle) {
+        release_query_raw(zmq_port, query_handle);
     }
+}
 
-    zmq_msg_close(&response);
-    zmq_close(socket);
-    zmq_ctx_destroy(context);
+void ZmqDistanceComputer::pin_query() {
+    // the previous query is released by the same round trip
+    query_handle = pin_query_raw(
+            zmq_port, query.data(), d, metric_type, query_handle);
+}
 
-    return true;
+float ZmqDistanceComputer::remote_distance(idx_t id) {
+    std::vector<idx_t> ids = {id};
+    std::vector<float> dis;
+    distances_batch(ids, dis);
+    return dis[0];
 }
 
 const float* ZmqDistanceComputer::get_vector_zmq(idx_t id) {
+    if (hybrid_store && hybrid_store->is_pinned(id)) {
+        hybrid_store->get_embeddings(1, &id, last_fetched_zmq_vector.data());
+        fetch_disk_cache_counts++;
+        return last_fetched_zmq_vector.data();
+    }
     std::vector<uint32_t> ids_to_fetch = {(uint32_t)id};
-    std::vector<std::vector<float>>
-            fetched_embeddings; // fetch_embeddings_zmq expects this
-                                // structure
-
-    if (!fetch_embeddings_zmq(ids_to_fetch, fetched_embeddings, zmq_port)) {
-        // fprintf(stderr,
-        //         "!!! ERROR get_vector_zmq: fetch_embeddings_zmq call
-        //         failed for ID %ld !!!\n", (long)id);
-        // Fill member with NaN to indicate failure?
-        std::fill(
-                last_fetched_zmq_vector.begin(),
-                last_fetched_zmq_vector.end(),
-                std::numeric_limits<float>::quiet_NaN());
-        return nullptr; // Indicate failure upstream
+    bool ok;
+    if (cache) {
+        std::vector<uint8_t> row_ok;
+        get_vectors_cached(
+                ids_to_fetch, last_fetched_zmq_vector.data(), row_ok);
+        ok = row_ok[0];
+    } else {
+        // the embedding is written directly to last_fetched_zmq_vector
+        ok = fetch_embeddings(ids_to_fetch, last_fetched_zmq_vector.data());
     }
-    if (fetched_embeddings.empty() || fetched_embeddings[0].size() != d) {
-        // fprintf(stderr,
-        //         "!!! ERROR get_vector_zmq: fetch_embeddings_zmq returned
-        //         incorrect data for ID %ld !!!\n", (long)id);
+    if (!ok) {
         std::fill(
                 last_fetched_zmq_vector.begin(),
                 last_fetched_zmq_vector.end(),
                 std::numeric_limits<float>::quiet_NaN());
         return nullptr;
     }
+    return last_fetched_zmq_vector.data();
+}
 
-    // --- Copy fetched data to member variable ---
-    // fetched_embeddings[0] contains the vector data
-    FAISS_ASSERT(fetched_embeddings[0].size() == d);
-    memcpy(last_fetched_zmq_vector.data(),
-           fetched_embeddings[0].data(),
-           d * sizeof(float));
-
-    // ---- Addition: Increment fetch count on success ----
-    fetch_count++;
-    // ---- End Addition ----
-
-    // --- Log values RIGHT BEFORE returning pointer ---
-    const float* return_ptr = last_fetched_zmq_vector.data();
-    // bool has_nan_before_return = false;
-    // printf("DEBUG get_vector_zmq: Fetched ID %ld. Values BEFORE return
-    // (ptr %p) [0..%d]: ",
-    //        (long)id,
-    //        (void*)return_ptr,
-    //        (int)std::min((size_t)4, d - 1));
-    // for (size_t k = 0; k < std::min((size_t)5, d); ++k) {
-    //     printf("%.6f ", return_ptr[k]);
-    // if (std::isnan(return_ptr[k]) || std::isinf(return_ptr[k]))
-    //         has_nan_before_return = true;
-    // }
-    // printf("%s\n",
-    //        has_nan_before_return ? "!!! HAS NaN/Inf BEFORE RETURN !!!"
-    //                              : "(OK Before Return)");
-    // -------------------------------------------
-
-    return return_ptr; // Return pointer to member data
+bool ZmqDistanceComputer::fetch_embeddings(
+        const std::vector<uint32_t>& ids,
+        float* out) {
+    bool ok;
+    if (provider) {
+        std::vector<idx_t> keys(ids.begin(), ids.end());
+        ok = provider->get_embeddings(keys.size(), keys.data(), out);
+    } else if (coalescer) {
+        ok = coalescer->fetch_embeddings(zmq_port, ids, d, out);
+    } else {
+        ok = fetch_embeddings_zmq_into(ids, d, out, zmq_port);
+    }
+    if (ok) {
+        fetch_count += ids.size();
+    }
+    return ok;
+}
+
+void ZmqDistanceComputer::get_vectors_cached(
+        const std::vector<uint32_t>& ids,
+        float* out,
+        std::vector<uint8_t>& ok) {
+    ok.assign(ids.size(), 1);
+    std::vector<uint32_t> missing;
+    std::vector<size_t> missing_rows;
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (cache->lookup(ids[i], out + i * d)) {
+            cache_hits++;
+        } else {
+            missing.push_back(ids[i]);
+            missing_rows.push_back(i);
+        }
+    }
+    cache_misses += missing.size();
+    if (missing.empty()) {
+        return;
+    }
+    std::vector<float> fetched(missing.size() * d);
+    if (!fetch_embeddings(missing, fetched.data())) {
+        for (size_t row : missing_rows) {
+            ok[row] = 0;
+        }
+        return;
+    }
+    for (size_t j = 0; j < missing.size(); j++) {
+        const float* x = fetched.data() + j * d;
+        memcpy(out + missing_rows[j] * d, x, d * sizeof(float));
+        cache->insert(missing[j], x);
+    }
 }
 
 // --- ZMQ Distance Calculation Function (Using MessagePack) ---
@@ -505,75 +1069,31 @@ bool fetch_distances_zmq(
     }
     std::string req_str = buffer.str();
 
-    void* context = zmq_ctx_new();
-    if (!context) {
-        return false;
-    }
-    void* socket = zmq_socket(context, ZMQ_REQ);
-    if (!socket) {
-        zmq_ctx_destroy(context);
-        return false;
-    }
-    int timeout = 30000;
-    zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
-    zmq_setsockopt(socket, ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
-    std::string endpoint = "tcp://127.0.0.1:" + std::to_string(zmq_port);
-    if (zmq_connect(socket, endpoint.c_str()) != 0) {
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
-
-    if (zmq_send(socket, req_str.data(), req_str.size(), 0) < 0) {
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
-
-    zmq_msg_t response;
-    zmq_msg_init(&response);
-    if (zmq_msg_recv(&response, socket, 0) < 0) {
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
-
-    DistanceResponseMsgpack resp_msgpack;
-    const char* resp_data = static_cast<const char*>(zmq_msg_data(&response));
-    size_t resp_size = zmq_msg_size(&response);
-
-    try {
-        msgpack::object_handle oh = msgpack::unpack(resp_data, resp_size);
-        msgpack::object obj = oh.get();
-        obj.convert(resp_msgpack); // Convert msgpack object to our struct
-    } catch (const std::exception& e) {
-        std::cerr << "MessagePack unpack failed for distance response: "
-                  << e.what() << std::endl;
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
-
-    if (resp_msgpack.distances.size() != node_ids.size()) {
-        std::cerr << "Distance response size mismatch: Got "
-                  << resp_msgpack.distances.size() << " distances, expected "
-                  << node_ids.size() << std::endl;
-        zmq_msg_close(&response);
-        zmq_close(socket);
-        zmq_ctx_destroy(context);
-        return false;
-    }
+    auto on_reply = [&](const char* resp_data, size_t resp_size) {
+        DistanceResponseMsgpack resp_msgpack;
+        try {
+            msgpack::object_handle oh = msgpack::unpack(resp_data, resp_size);
+            oh.get().convert(resp_msgpack);
+        } catch (const std::exception& e) {
+            std::cerr << "MessagePack unpack failed for distance response: "
+                      << e.what() << std::endl;
+            return false;
+        }
 
-    // Copy distances to output vector
-    out_distances = resp_msgpack.distances;
+        if (resp_msgpack.distances.size() != node_ids.size()) {
+            std::cerr << "Distance response size mismatch: Got "
+                      << resp_msgpack.distances.size()
+                      << " distances, expected " << node_ids.size()
+                      << std::endl;
+            return false;
+        }
 
-    zmq_msg_close(&response);
-    zmq_close(socket);
-    zmq_ctx_destroy(context);
+        out_distances = std::move(resp_msgpack.distances);
+        return true;
+    };
 
-    return true;
+    return ZmqConnectionPool::instance().request(
+            zmq_port, req_str.data(), req_str.size(), on_reply);
 }
 
 void ZmqDistanceComputer::distances_batch(
@@ -582,74 +1102,254 @@ void ZmqDistanceComputer::distances_batch(
     // Resize output vector
     distances_out.resize(ids.size());
 
-    // Separate nodes into disk-read and remote-read groups
+    // Separate nodes into local (pinned in the hybrid store) and
+    // remote-read groups
     std::vector<uint32_t> remote_nodes;
     std::vector<size_t> remote_orig_indices;
-    std::vector<uint32_t> disk_nodes;
+    std::vector<idx_t> disk_nodes;
     std::vector<size_t> disk_orig_indices;
 
     for (size_t j = 0; j < ids.size(); ++j) {
         idx_t id = ids[j];
-        if (experimental_is_in_top_degree_set.empty()) {
+        if (hybrid_store && hybrid_store->is_pinned(id)) {
+            disk_nodes.push_back(id);
+            disk_orig_indices.push_back(j);
+        } else {
             remote_nodes.push_back(id);
             remote_orig_indices.push_back(j);
-        } else {
-            assert(id >= 0 &&
-                   (size_t)id < experimental_is_in_top_degree_set.size());
-            if (experimental_is_in_top_degree_set[id]) {
-                // Mark for disk read
-                disk_nodes.push_back(id);
-                disk_orig_indices.push_back(j);
-            } else {
-                // Mark for remote read
-                remote_nodes.push_back(id);
-                remote_orig_indices.push_back(j);
-            }
         }
     }
 
     // Process remote nodes via ZMQ if any
     if (!remote_nodes.empty()) {
-        // Call the original ZMQ batch function
-        std::vector<float> fetched_distances;
-        bool success = fetch_distances_zmq(
-                remote_nodes, query.data(), d, fetched_distances, zmq_port);
-        assert(success);
-        assert(fetched_distances.size() == remote_nodes.size());
-
-        for (size_t j = 0; j < remote_nodes.size(); ++j) {
-            distances_out[remote_orig_indices[j]] = fetched_distances[j];
-        }
-        fetch_count += remote_nodes.size(); // Count these as fetches
-    }
-
-    // timing
-    std::chrono::steady_clock::time_point disk_start =
-            std::chrono::steady_clock::now();
-
-    // Process disk nodes locally
-    for (size_t j = 0; j < disk_nodes.size(); ++j) {
-        float disk_dist =
-                read_disk_and_compute_local_ip(disk_nodes[j], d, query.data());
-
-        // sanity check with remote fetched ones
-        // if (abs(disk_dist - distances_out[disk_orig_indices[j]]) > 1e-4) {
-        //     printf("ERROR: disk and remote fetched distances mismatch for id
-        //     %ld, error: %f\n",
-        //            disk_nodes[j],
-        //            abs(disk_dist - distances_out[disk_orig_indices[j]]));
-        //     // assert(false);
-        // }
-        distances_out[disk_orig_indices[j]] = disk_dist;
-    }
-    fetch_disk_cache_counts += disk_nodes.size();
-
-    // timing
-    std::chrono::steady_clock::time_point disk_end =
-            std::chrono::steady_clock::now();
-    std::chrono::duration<double> disk_duration = disk_end - disk_start;
-    // printf("ZmqDC Distances Batch Time: %f seconds\n",
-    // disk_duration.count());
+        std::vector<float> embeddings;
+        std::vector<float> remote_distances(remote_nodes.size());
+        if (query_handle &&
+            fetch_distances_raw(
+                    zmq_port,
+                    query_handle,
+                    remote_nodes.data(),
+                    remote_nodes.size(),
+                    remote_distances.data())) {
+            // only the distances were transferred
+            bool is_ip = is_similarity_metric(metric_type);
+            for (size_t j = 0; j < remote_nodes.size(); ++j) {
+                float dis = remote_distances[j];
+                distances_out[remote_orig_indices[j]] = is_ip ? -dis : dis;
+            }
+            fetch_count += remote_nodes.size();
+        } else if (cache) {
+            embeddings.resize(remote_nodes.size() * d);
+            std::vector<uint8_t> row_ok;
+            get_vectors_cached(remote_nodes, embeddings.data(), row_ok);
+            for (size_t j = 0; j < remote_nodes.size(); ++j) {
+                distances_out[remote_orig_indices[j]] = distance_func(
+                        row_ok[j] ? embeddings.data() + j * d : nullptr);
+            }
+        } else if (coalescer || provider) {
+            // computed in process or merged with the requests of the other
+            // threads, the distances are computed here from the embeddings
+            embeddings.resize(remote_nodes.size() * d);
+            bool success = fetch_embeddings(remote_nodes, embeddings.data());
+            for (size_t j = 0; j < remote_nodes.size(); ++j) {
+                distances_out[remote_orig_indices[j]] = distance_func(
+                        success ? embeddings.data() + j * d : nullptr);
+            }
+        } else if (ZmqConnectionPool::instance().uses_raw_frames(zmq_port)) {
+            // the distances are computed from the embeddings in place in
+            // the reply
+            std::vector<float> row(d);
+            bool success = fetch_embeddings_raw(
+                    zmq_port,
+                    remote_nodes.data(),
+                    remote_nodes.size(),
+                    d,
+                    [&](const void* data, bool is_fp16) {
+                        for (size_t j = 0; j < remote_nodes.size(); ++j) {
+                            const float* x;
+                            if (is_fp16) {
+                                const uint16_t* codes =
+                                        (const uint16_t*)data + j * d;
+                                for (size_t l = 0; l < d; l++) {
+                                    row[l] = decode_fp16(codes[l]);
+                                }
+                                x = row.data();
+                            } else {
+                                x = (const float*)data + j * d;
+                            }
+                            distances_out[remote_orig_indices[j]] =
+                                    distance_func(x);
+                        }
+                        return true;
+                    });
+            if (success) {
+                fetch_count += remote_nodes.size();
+            } else {
+                for (size_t j = 0; j < remote_nodes.size(); ++j) {
+                    distances_out[remote_orig_indices[j]] =
+                            distance_func(nullptr);
+                }
+            }
+        } else {
+            // Call the original ZMQ batch function
+            std::vector<float> fetched_distances;
+            bool success = fetch_distances_zmq(
+                    remote_nodes, query.data(), d, fetched_distances, zmq_port);
+            assert(success);
+            assert(fetched_distances.size() == remote_nodes.size());
+
+            for (size_t j = 0; j < remote_nodes.size(); ++j) {
+                distances_out[remote_orig_indices[j]] = fetched_distances[j];
+            }
+            fetch_count += remote_nodes.size(); // Count these as fetches
+        }
+    }
+
+    // Process pinned nodes locally, with one batched read
+    if (!disk_nodes.empty()) {
+        std::vector<float> disk_distances(disk_nodes.size());
+        hybrid_store->compute_distances(
+                disk_nodes.size(),
+                disk_nodes.data(),
+                query.data(),
+                metric_type,
+                disk_distances.data());
+        for (size_t j = 0; j < disk_nodes.size(); ++j) {
+            distances_out[disk_orig_indices[j]] = disk_distances[j];
+        }
+        fetch_disk_cache_counts += disk_nodes.size();
+    }
+}
+
+/**************************************************************
+ * RecomputeBuildDistanceComputer
+ **************************************************************/
+
+RecomputeBuildDistanceComputer::RecomputeBuildDistanceComputer(
+        size_t d,
+        MetricType metric_type,
+        size_t max_buffered,
+        int zmq_port)
+        : d(d),
+          metric_type(metric_type),
+          max_buffered(max_buffered),
+          fetcher(d, metric_type, 0, zmq_port),
+          query(d) {
+    FAISS_THROW_IF_NOT_MSG(max_buffered > 0, "need a non-empty buffer");
+}
+
+void RecomputeBuildDistanceComputer::set_local_vectors(
+        idx_t i0,
+        idx_t n,
+        const float* x) {
+    local_x = x;
+    local0 = i0;
+    local1 = i0 + n;
+}
+
+const float* RecomputeBuildDistanceComputer::find_vector(idx_t id) const {
+    if (is_local(id)) {
+        return local_x + (id - local0) * d;
+    }
+    auto it = rows.find(id);
+    return it == rows.end() ? nullptr : buffer.data() + it->second * d;
+}
+
+void RecomputeBuildDistanceComputer::set_query(const float* x) {
+    memcpy(query.data(), x, d * sizeof(float));
+}
+
+float RecomputeBuildDistanceComputer::distance_to_query(
+        const float* x) const {
+    if (!x) {
+        return max_distance();
+    }
+    return is_similarity_metric(metric_type)
+            ? -fvec_inner_product(query.data(), x, d)
+            : fvec_L2sqr(query.data(), x, d);
+}
+
+float RecomputeBuildDistanceComputer::max_distance() const {
+    return std::numeric_limits<float>::max();
+}
+
+void RecomputeBuildDistanceComputer::clear() {
+    rows.clear();
+    n_buffered = 0;
+}
+
+void RecomputeBuildDistanceComputer::prefetch_vectors(
+        const idx_t* ids,
+        size_t n) {
+    auto collect_missing = [&](std::vector<uint32_t>& missing) {
+        missing.clear();
+        std::unordered_set<idx_t> seen;
+        for (size_t i = 0; i < n; i++) {
+            if (ids[i] >= 0 && !is_local(ids[i]) && !rows.count(ids[i]) &&
+                seen.insert(ids[i]).second) {
+                missing.push_back(ids[i]);
+            }
+        }
+    };
+    std::vector<uint32_t> missing;
+    collect_missing(missing);
+    if (missing.empty()) {
+        return;
+    }
+    if (n_buffered + missing.size() > max_buffered) {
+        // evict everything, the whole batch is then fetched
+        clear();
+        collect_missing(missing);
+    }
+    size_t row0 = n_buffered;
+    if ((row0 + missing.size()) * d > buffer.size()) {
+        buffer.resize(
+                std::max(max_buffered, row0 + missing.size()) * d);
+    }
+    n_fetches++;
+    if (!fetcher.fetch_embeddings(missing, buffer.data() + row0 * d)) {
+        n_failed += missing.size();
+        return;
+    }
+    for (size_t i = 0; i < missing.size(); i++) {
+        rows[missing[i]] = row0 + i;
+    }
+    n_buffered += missing.size();
+}
+
+const float* RecomputeBuildDistanceComputer::get_vector(idx_t id) {
+    const float* x = find_vector(id);
+    if (!x) {
+        prefetch_vectors(&id, 1);
+        x = find_vector(id);
+    }
+    return x;
+}
+
+float RecomputeBuildDistanceComputer::operator()(idx_t i) {
+    return distance_to_query(get_vector(i));
+}
+
+void RecomputeBuildDistanceComputer::distances_batch(
+        const std::vector<idx_t>& ids,
+        std::vector<float>& distances_out) {
+    prefetch_vectors(ids.data(), ids.size());
+    distances_out.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        distances_out[i] = distance_to_query(find_vector(ids[i]));
+    }
+}
+
+float RecomputeBuildDistanceComputer::symmetric_dis(idx_t i, idx_t j) {
+    idx_t ij[2] = {i, j};
+    prefetch_vectors(ij, 2);
+    const float* xi = find_vector(i);
+    const float* xj = find_vector(j);
+    if (!xi || !xj) {
+        return max_distance();
+    }
+    return is_similarity_metric(metric_type) ? -fvec_inner_product(xi, xj, d)
+                                             : fvec_L2sqr(xi, xj, d);
 }
 
 // --- Implementation of new experimental methods ---
@@ -2,9 +2,16 @@
 
 #include <sys/types.h> // For off_t
 #include <cassert>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <faiss/Index.h>
@@ -12,17 +19,419 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/distances.h>
 namespace faiss {
-void setup_experimental_top_degree_disk_read(
-        const std::string& degree_path,
-        float top_percent,
-        const std::string& storage_path,
-        off_t data_offset,
-        idx_t ntotal);
-
-float read_disk_and_compute_local_ip(idx_t i, size_t d, const float* query);
+struct HybridEmbeddingStore;
 
+/// nb of embeddings served by a HybridEmbeddingStore instead of the server
 inline int fetch_disk_cache_counts = 0;
 
+/** Process-wide pool of connected ZMQ REQ sockets to the embedding
+ * servers, keyed by port.
+ *
+ * ZMQ sockets are not thread-safe, so a socket is checked out by a single
+ * thread for the duration of one request/reply and put back on the idle
+ * list afterwards. The OpenMP threads of IndexHNSW::search thus keep
+ * reusing a handful of connections instead of paying for zmq_ctx_new /
+ * zmq_connect / teardown on every fetch.
+ *
+ * A REQ socket whose request failed (timeout, server gone) is stuck in the
+ * "waiting for reply" state, so it is closed rather than returned to the
+ * pool. After max_consecutive_failures failures in a row the port is
+ * marked down for backoff_ms: requests to it fail immediately instead of
+ * every thread waiting out the full timeout, and requests to other ports
+ * are not affected.
+ *
+ * A port can be served by several replicas of the embedding server (see
+ * set_replicas): each request goes to the replica with the fewest
+ * requests in flight, and a request that is slower than the recent
+ * latencies of its replica is hedged on a second replica.
+ */
+struct ZmqConnectionPool {
+    /// send / receive timeout set on new sockets (ms)
+    int timeout_ms = 30000;
+    /// nb of additional attempts on a fresh socket after a failed request
+    int max_retries = 1;
+    /// nb of consecutive failures after which the port is marked down
+    int max_consecutive_failures = 3;
+    /// time during which a port marked down is not contacted (ms)
+    int backoff_ms = 1000;
+    /// max nb of idle sockets kept per port, extra ones are closed
+    size_t max_idle_per_port = 256;
+
+    /// send a duplicate of a request that has not been answered after
+    /// the hedge delay to another replica, the first reply is used
+    bool hedge_requests = true;
+    /// the hedge delay is this percentile of the recent latencies of the
+    /// replica the request was sent to
+    double hedge_percentile = 0.95;
+    /// hedge delay while a replica has less than min_latency_samples
+    /// latency measurements (ms)
+    int default_hedge_delay_ms = 50;
+    /// lower bound of the hedge delay (ms)
+    int min_hedge_delay_ms = 1;
+    size_t min_latency_samples = 20;
+    /// nb of recent latencies kept per port
+    size_t latency_window = 256;
+
+    /// statistics
+    std::atomic<size_t> n_requests{0};
+    std::atomic<size_t> n_connects{0};
+    std::atomic<size_t> n_failures{0};
+    std::atomic<size_t> n_hedged{0};     ///< duplicate requests sent
+    std::atomic<size_t> n_hedge_wins{0}; ///< answered by the duplicate
+
+    /// the pool shared by all ZmqDistanceComputer instances
+    static ZmqConnectionPool& instance();
+
+    /** Send req_size bytes to the server on zmq_port and pass the reply to
+     * on_reply. Returns false if the round trip failed or if on_reply
+     * returned false (malformed reply). Requests that are not stateless
+     * (they refer to state kept by the server, eg. a pinned query) are
+     * always sent to the first replica and are not hedged. */
+    bool request(
+            int zmq_port,
+            const void* req,
+            size_t req_size,
+            const std::function<bool(const char*, size_t)>& on_reply,
+            bool stateless = true);
+
+    /** Serve the requests to zmq_port by the servers of replica_ports,
+     * which may include zmq_port itself. Each replica has its own endpoint
+     * and failure state, and must use the same protocol. Empty = zmq_port
+     * serves its requests. */
+    void set_replicas(int zmq_port, const std::vector<int>& replica_ports);
+
+    /// percentile p in [0, 1] of the recent latencies of the requests
+    /// answered by zmq_port (ms), -1 if there are none
+    double latency_percentile(int zmq_port, double p);
+
+    /// nb of requests in flight to zmq_port
+    int n_outstanding(int zmq_port);
+
+    /// close the idle sockets of zmq_port (all ports if -1) and clear
+    /// their failure state, eg. after an embedding server restart
+    void reset(int zmq_port = -1);
+
+    /// whether zmq_port is currently marked down
+    bool is_down(int zmq_port);
+
+    /** Reach the server of zmq_port through another endpoint than
+     * tcp://127.0.0.1:zmq_port, eg. "ipc:///tmp/embeddings" for a server on
+     * the same host (empty = default). With raw_frames, the embeddings are
+     * requested with the raw frame protocol (see fetch_embeddings_raw)
+     * instead of msgpack. The idle sockets of the port are closed. */
+    void set_endpoint(
+            int zmq_port,
+            const std::string& endpoint,
+            bool raw_frames = false);
+
+    /// whether the server of zmq_port (or its first replica) speaks the
+    /// raw frame protocol
+    bool uses_raw_frames(int zmq_port);
+
+    ZmqConnectionPool(const ZmqConnectionPool&) = delete;
+    ZmqConnectionPool& operator=(const ZmqConnectionPool&) = delete;
+    ~ZmqConnectionPool();
+
+   private:
+    struct PortState {
+        std::string endpoint; ///< empty = tcp://127.0.0.1:port
+        bool raw_frames = false;
+        std::vector<void*> idle;
+        int consecutive_failures = 0;
+        double down_until = 0; ///< getmillisecs() timestamp
+        /// ports that serve the requests to this port (empty = itself)
+        std::vector<int> replicas;
+        /// sockets checked out for this port
+        int n_outstanding = 0;
+        /// ring buffer of the latencies of the last answered requests (ms)
+        std::vector<float> latencies;
+        size_t latency_pos = 0;
+    };
+
+    ZmqConnectionPool() = default;
+
+    /** replica of zmq_port for a request: the one with the fewest
+     * requests in flight among those that are not down and not in
+     * exclude (if possible), or the first one if not stateless */
+    int pick_replica(
+            int zmq_port,
+            bool stateless,
+            const std::vector<int>& exclude);
+    /// hedge delay of a request sent to zmq_port (ms)
+    double hedge_delay(int zmq_port);
+    double latency_percentile_locked(const PortState& state, double p);
+
+    void* acquire(int zmq_port);
+    /// put back a socket after a request, latency_ms >= 0 is recorded
+    void release(
+            int zmq_port,
+            void* socket,
+            bool healthy,
+            double latency_ms = -1);
+    /// close a socket whose request was answered by another replica
+    void discard(int zmq_port, void* socket);
+
+    std::mutex mutex;
+    void* context = nullptr;
+    /// sockets currently checked out, the context is only terminated when 0
+    size_t n_checked_out = 0;
+    std::unordered_map<int, PortState> ports;
+};
+
+/** Raw frame protocol of the embedding servers. A request is one frame
+ *
+ *   uint32 raw_embedding_request_magic, uint32 n, uint32 ids[n]
+ *
+ * and the reply is one frame
+ *
+ *   uint32 n, uint32 d, uint32 dtype (0 = fp32, 1 = fp16), n * d values
+ *
+ * There is no (de)serialization: the values are read in place in the
+ * received ZMQ message. */
+constexpr uint32_t raw_embedding_request_magic = 0x45574152; // "RAWE"
+
+/** Fetch the d-dimensional embeddings of n ids from the server on zmq_port
+ * with the raw frame protocol. on_data is called with the reply values in
+ * place (n * d fp32 values, or fp16 values if is_fp16), it may return
+ * false to reject them. Returns false if the request failed */
+bool fetch_embeddings_raw(
+        int zmq_port,
+        const uint32_t* ids,
+        size_t n,
+        size_t d,
+        const std::function<bool(const void* data, bool is_fp16)>& on_data);
+
+/** Fetch the d-dimensional embeddings of ids from the server on zmq_port
+ * into out (size ids.size() * d), with the protocol of the port */
+bool fetch_embeddings_zmq_into(
+        const std::vector<uint32_t>& ids,
+        size_t d,
+        float* out,
+        int zmq_port);
+
+/** Server-side distances (raw frame protocol). The query is pinned on the
+ * server once per search with
+ *
+ *   uint32 raw_query_pin_magic, uint32 d, uint32 metric_type,
+ *   uint64 replaced_handle (0 = none), float query[d]
+ *
+ * which replies uint64 handle (0 = failure) and releases replaced_handle.
+ * The distances are then requested with
+ *
+ *   uint32 raw_distance_request_magic, uint32 n, uint64 handle,
+ *   uint32 ids[n]
+ *
+ * which replies uint32 n, float distances[n] (squared L2 or inner product),
+ * ie. 4 bytes per node instead of 4 * d. A handle is released with
+ * uint32 raw_query_release_magic, uint64 handle (empty reply). */
+constexpr uint32_t raw_query_pin_magic = 0x51574152;         // "RAWQ"
+constexpr uint32_t raw_distance_request_magic = 0x44574152; // "RAWD"
+constexpr uint32_t raw_query_release_magic = 0x55574152;    // "RAWU"
+
+/// pin a query on the server of zmq_port, returns its handle (0 = failed)
+uint64_t pin_query_raw(
+        int zmq_port,
+        const float* query,
+        size_t d,
+        MetricType metric_type,
+        uint64_t replaced_handle = 0);
+
+/// distances between the pinned query and n ids into out (size n)
+bool fetch_distances_raw(
+        int zmq_port,
+        uint64_t handle,
+        const uint32_t* ids,
+        size_t n,
+        float* out);
+
+/// release a pinned query
+bool release_query_raw(int zmq_port, uint64_t handle);
+
+/** Merges the embedding requests that concurrent searches send to the same
+ * embedding server into one larger request.
+ *
+ * The first thread that submits ids for a port becomes the leader of a new
+ * batch. Threads that submit while the batch is open add their ids to it
+ * (duplicates are sent once). The leader sends the batch when it
+ * holds max_batch_size ids, when every registered participant has
+ * joined, or after window_us. The reply is then shared between all
+ * callers. There is no background thread, and a single searching
+ * thread never waits.
+ */
+struct ZmqRequestCoalescer {
+    /// max time the leader waits for other threads to join (us)
+    int window_us = 500;
+    /// a batch is sent as soon as it holds that many distinct ids
+    size_t max_batch_size = 8192;
+
+    /// statistics
+    std::atomic<size_t> n_batches{0};
+    std::atomic<size_t> n_requested_ids{0}; ///< ids submitted by callers
+    std::atomic<size_t> n_sent_ids{0};      ///< ids sent after merging
+
+    static ZmqRequestCoalescer& instance();
+
+    /** Fetch the d-dimensional embeddings of ids from the server on zmq_port
+     * into out (size ids.size() * d). Returns false if the merged request
+     * failed */
+    bool fetch_embeddings(
+            int zmq_port,
+            const std::vector<uint32_t>& ids,
+            size_t d,
+            float* out);
+
+    /// register / unregister a thread that will submit requests, so that
+    /// the leader knows when nobody else is going to join its batch
+    void add_participant();
+    void remove_participant();
+
+    ZmqRequestCoalescer(const ZmqRequestCoalescer&) = delete;
+    ZmqRequestCoalescer& operator=(const ZmqRequestCoalescer&) = delete;
+
+   private:
+    struct Batch {
+        std::vector<uint32_t> ids;
+        std::unordered_map<uint32_t, size_t> id_to_row;
+        size_t d = 0;
+        int n_callers = 0;
+        std::vector<float> data;
+        bool done = false;
+        bool ok = false;
+    };
+
+    ZmqRequestCoalescer() = default;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int n_participants = 0;
+    /// batch currently accepting ids, per port
+    std::unordered_map<int, std::shared_ptr<Batch>> open_batches;
+};
+
+/** Bounded in-memory cache of recomputed embeddings, shared by the
+ * ZmqDistanceComputers of all searching threads.
+ *
+ * Hub nodes are recomputed by almost every query, so keeping their
+ * embeddings avoids most of the embedding server traffic for them. The
+ * cache is split in n_shards independently locked LRU lists (shard =
+ * id % n_shards) so that threads rarely contend. Vectors can be stored
+ * compressed (fp16, or SQ8 with a per-vector range) to fit more of them
+ * in max_bytes.
+ *
+ * Admission: an id is only inserted after it was missed admit_after
+ * times, which keeps one-off nodes from evicting the hubs. The recent
+ * misses are tracked in a per-shard table of bounded size.
+ */
+struct ZmqEmbeddingCache {
+    enum Codec {
+        CODEC_FP32, ///< exact
+        CODEC_FP16, ///< 2 bytes per component
+        CODEC_SQ8,  ///< 1 byte per component + min / scale
+    };
+
+    size_t d;
+    size_t max_bytes; ///< budget for the stored codes and their overhead
+    Codec codec;
+    /// nb of misses of an id before it is admitted (1 = at first miss)
+    int admit_after = 1;
+    /// ids admitted at their first miss whatever admit_after, eg. the
+    /// HNSWVisitProfiler::top_ids. Must not be modified during a search.
+    std::unordered_set<idx_t> hot_ids;
+
+    /// statistics
+    std::atomic<size_t> n_hits{0};
+    std::atomic<size_t> n_misses{0};
+    std::atomic<size_t> n_evictions{0};
+
+    ZmqEmbeddingCache(
+            size_t d,
+            size_t max_bytes,
+            Codec codec = CODEC_FP32,
+            int n_shards = 64);
+
+    /// decode the embedding of id into out (size d) if it is cached
+    bool lookup(idx_t id, float* out);
+
+    /// offer the embedding of id to the cache, subject to admission unless
+    /// force is set (eg. to prefill the cache, see IndexHNSW::warmup)
+    void insert(idx_t id, const float* x, bool force = false);
+
+    void clear();
+
+    /// nb of cached embeddings / bytes accounted against max_bytes
+    size_t size() const;
+    size_t nbytes() const;
+
+    /// size of a stored code, and accounted bytes per entry
+    size_t code_size() const;
+    size_t entry_size() const;
+
+    ZmqEmbeddingCache(const ZmqEmbeddingCache&) = delete;
+    ZmqEmbeddingCache& operator=(const ZmqEmbeddingCache&) = delete;
+
+   private:
+    struct Entry {
+        std::list<idx_t>::iterator lru_pos;
+        std::vector<uint8_t> code;
+    };
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<idx_t> lru; ///< most recently used first
+        std::unordered_map<idx_t, Entry> entries;
+        std::unordered_map<idx_t, int> recent_misses;
+        size_t nbytes = 0;
+    };
+
+    Shard& shard_of(idx_t id) {
+        return *shards[(size_t)id % shards.size()];
+    }
+    void encode(const float* x, uint8_t* code) const;
+    void decode(const uint8_t* code, float* x) const;
+
+    size_t max_bytes_per_shard;
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+/** In-process source of the embeddings of the recompute mode, eg. an
+ * embedding model that runs in the same process as the search. When it is
+ * set, ZmqDistanceComputer calls it instead of the embedding server: there
+ * is no serialization or network round trip, and the distances are
+ * computed locally from the returned embeddings.
+ *
+ * get_embeddings is called concurrently by the searching threads.
+ */
+struct EmbeddingProvider {
+    size_t d;
+
+    explicit EmbeddingProvider(size_t d) : d(d) {}
+
+    /** compute the embeddings of ids into out (size n * d). Returns false
+     * if they could not be computed */
+    virtual bool get_embeddings(size_t n, const idx_t* ids, float* out) = 0;
+
+    virtual ~EmbeddingProvider() {}
+};
+
+/** Reference EmbeddingProvider that reconstructs the embeddings from an
+ * index. With a GPU index (eg. a GpuIndexFlat holding the embeddings), the
+ * ids of a call are gathered on the GPU with one reconstruct_batch.
+ */
+struct IndexEmbeddingProvider : EmbeddingProvider {
+    const Index* index; ///< not owned
+    /// serialize the calls, for indexes that do not support concurrent
+    /// calls (eg. GPU indexes)
+    bool serialize_calls = false;
+
+    explicit IndexEmbeddingProvider(
+            const Index* index,
+            bool serialize_calls = false);
+
+    bool get_embeddings(size_t n, const idx_t* ids, float* out) override;
+
+   private:
+    std::mutex mutex;
+};
+
 struct ZmqDistanceComputer : DistanceComputer {
     size_t d;
     int zmq_port;
@@ -34,6 +443,35 @@ struct ZmqDistanceComputer : DistanceComputer {
     std::vector<float> query;
 
     std::vector<float> last_fetched_zmq_vector;
+    /// scratch of distances_batch_4, to avoid two allocations per call
+    std::vector<idx_t> batch4_ids;
+    std::vector<float> batch4_distances;
+
+    /// if set, remote distances are computed locally from embeddings
+    /// fetched through this coalescer instead of one distance request per
+    /// call (see set_coalescer)
+    ZmqRequestCoalescer* coalescer = nullptr;
+
+    /// if set, embeddings are looked up in / added to this cache and
+    /// the distances of remote nodes are computed locally
+    ZmqEmbeddingCache* cache = nullptr;
+
+    /// compute the distances of the remote nodes on the server, the query
+    /// being pinned there by set_query (see pin_query_raw). If the query
+    /// cannot be pinned, the embeddings are fetched instead
+    bool server_distances = false;
+    /// handle of the query pinned on the server (0 = none)
+    uint64_t query_handle = 0;
+
+    /// if set, the nodes pinned in this store are served locally
+    const HybridEmbeddingStore* hybrid_store = nullptr;
+
+    /// if set, the embeddings are computed by this provider instead of
+    /// being fetched from the server (not owned)
+    EmbeddingProvider* provider = nullptr;
+    /// cache hits and misses since the last set_query
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
 
     const float* get_query() override {
         return query.data();
@@ -81,7 +519,9 @@ struct ZmqDistanceComputer : DistanceComputer {
     }
 
     float operator()(idx_t i) override {
-        // TODO: should apply disk_cache
+        if (query_handle) {
+            return remote_distance(i);
+        }
         const float* vec_zmq = get_vector_zmq(i);
         if (!vec_zmq)
             return (metric_type == METRIC_INNER_PRODUCT)
@@ -122,9 +562,30 @@ struct ZmqDistanceComputer : DistanceComputer {
 
     void set_query(const float* x) override {
         reset_fetch_count();
+        cache_hits = cache_misses = 0;
         memcpy(query.data(), x, d * sizeof(float));
+        if (server_distances) {
+            pin_query();
+        }
     }
-    ~ZmqDistanceComputer() override = default;
+    /// route remote fetches through coalescer (nullptr to disable)
+    void set_coalescer(ZmqRequestCoalescer* c) {
+        if (coalescer) {
+            coalescer->remove_participant();
+        }
+        coalescer = c;
+        if (coalescer) {
+            coalescer->add_participant();
+        }
+    }
+
+    ~ZmqDistanceComputer() override;
+
+    /// pin the current query on the server (sets query_handle)
+    void pin_query();
+
+    /// distance to a remote node computed by the server
+    float remote_distance(idx_t id);
 
     void distances_batch_4(
             idx_t id0,
@@ -135,21 +596,125 @@ struct ZmqDistanceComputer : DistanceComputer {
             float& dis1,
             float& dis2,
             float& dis3) override {
-        std::vector<idx_t> batch_ids = {id0, id1, id2, id3};
-        std::vector<float> batch_distances;
+        batch4_ids.resize(4);
+        batch4_ids[0] = id0;
+        batch4_ids[1] = id1;
+        batch4_ids[2] = id2;
+        batch4_ids[3] = id3;
 
-        this->distances_batch(batch_ids, batch_distances);
+        this->distances_batch(batch4_ids, batch4_distances);
 
-        dis0 = batch_distances[0];
-        dis1 = batch_distances[1];
-        dis2 = batch_distances[2];
-        dis3 = batch_distances[3];
+        dis0 = batch4_distances[0];
+        dis1 = batch4_distances[1];
+        dis2 = batch4_distances[2];
+        dis3 = batch4_distances[3];
     }
 
     const float* get_vector_zmq(idx_t id);
+
+    /** fetch the embeddings of ids from the provider or the server
+     * (through the coalescer if set) into out, size ids.size() * d */
+    bool fetch_embeddings(const std::vector<uint32_t>& ids, float* out);
+
+    /** n embeddings through the cache: hits are decoded, misses are
+     * fetched and offered to the cache. Rows that could not be fetched are
+     * reported in ok (0) */
+    void get_vectors_cached(
+            const std::vector<uint32_t>& ids,
+            float* out,
+            std::vector<uint8_t>& ok);
     void distances_batch(
             const std::vector<idx_t>& ids,
             std::vector<float>& distances_out) override;
 };
 
+/** Distance computer of the HNSW construction in recompute mode
+ * (IndexHNSW::recompute_build).
+ *
+ * The construction computes distances between the inserted vector and
+ * the candidates, and between pairs of stored vectors when the neighbor
+ * lists are pruned. The embeddings of the vectors being added are read
+ * from their array (set_local_vectors). Those of the vectors already in
+ * the index are fetched in batches (distances_batch, prefetch_vectors)
+ * into a buffer of at most max_buffered vectors, and all the distances
+ * are computed locally. The buffer is emptied when a batch does not
+ * fit.
+ *
+ * As with ZmqDistanceComputer, the distances of similarity metrics are
+ * negated. Embeddings that cannot be fetched get the max distance and are
+ * counted in n_failed.
+ */
+struct RecomputeBuildDistanceComputer : DistanceComputer {
+    size_t d;
+    MetricType metric_type;
+    size_t max_buffered;
+    /// fetches the embeddings from its provider or embedding server
+    ZmqDistanceComputer fetcher;
+
+    std::vector<float> query;
+    /// embeddings of the ids in [local0, local1), not owned
+    const float* local_x = nullptr;
+    idx_t local0 = 0, local1 = 0;
+    /// buffered embeddings, n_buffered rows of size d
+    std::vector<float> buffer;
+    size_t n_buffered = 0;
+    /// row of each buffered id in buffer
+    std::unordered_map<idx_t, size_t> rows;
+
+    /// statistics
+    size_t n_fetches = 0; ///< nb of fetch requests
+    size_t n_failed = 0;  ///< nb of embeddings that could not be fetched
+
+    RecomputeBuildDistanceComputer(
+            size_t d,
+            MetricType metric_type,
+            size_t max_buffered,
+            int zmq_port = 5557);
+
+    /// the embeddings of ids [i0, i0 + n) are x (size n * d)
+    void set_local_vectors(idx_t i0, idx_t n, const float* x);
+
+    void set_query(const float* x) override;
+
+    const float* get_query() override {
+        return query.data();
+    }
+
+    float operator()(idx_t i) override;
+
+    void distances_batch(
+            const std::vector<idx_t>& ids,
+            std::vector<float>& distances_out) override;
+
+    float symmetric_dis(idx_t i, idx_t j) override;
+
+    /// fetch the embeddings of the ids that are not buffered, in one
+    /// request
+    void prefetch_vectors(const idx_t* ids, size_t n) override;
+
+    /// embedding of id, fetched if needed (nullptr if it failed). Valid
+    /// until the next fetch
+    const float* get_vector(idx_t id);
+
+    /// empty the buffer
+    void clear();
+
+    size_t get_fetch_count() const override {
+        return fetcher.get_fetch_count();
+    }
+
+    void reset_fetch_count() override {
+        fetcher.reset_fetch_count();
+    }
+
+   private:
+    bool is_local(idx_t id) const {
+        return id >= local0 && id < local1;
+    }
+    /// buffered or local embedding, nullptr if not available
+    const float* find_vector(idx_t id) const;
+    float distance_to_query(const float* x) const;
+    float max_distance() const;
+};
+
 } // namespace faiss
\ No newline at end of file
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/HybridEmbeddingStore.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+namespace {
+
+/// upper bound on the size of one merged read
+const size_t max_read_size = 8 << 20;
+
+struct AlignedBuffer {
+    void* ptr = nullptr;
+    AlignedBuffer(size_t alignment, size_t size) {
+        FAISS_THROW_IF_NOT_MSG(
+                posix_memalign(&ptr, alignment, size) == 0,
+                "could not allocate aligned read buffer");
+    }
+    ~AlignedBuffer() {
+        free(ptr);
+    }
+};
+
+} // namespace
+
+HybridEmbeddingStore::HybridEmbeddingStore(
+        size_t d,
+        idx_t ntotal,
+        const std::string& storage_path,
+        off_t data_offset,
+        Tier tier)
+        : d(d),
+          ntotal(ntotal),
+          tier(tier),
+          storage_path(storage_path),
+          data_offset(data_offset) {
+    FAISS_THROW_IF_NOT_MSG(d > 0, "Dimension must be positive");
+    FAISS_THROW_IF_NOT_FMT(
+            ntotal > 0, "ntotal (%ld) must be positive", (long)ntotal);
+    FAISS_THROW_IF_NOT_FMT(
+            data_offset >= 0, "data offset (%ld) invalid", (long)data_offset);
+    FAISS_THROW_IF_NOT_MSG(
+            tier == TIER_RAM || tier == TIER_SSD, "unknown storage tier");
+    slots.assign(ntotal, -1);
+}
+
+HybridEmbeddingStore::~HybridEmbeddingStore() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void HybridEmbeddingStore::open_storage() {
+    if (fd >= 0) {
+        return;
+    }
+    struct stat file_stat;
+    FAISS_THROW_IF_NOT_FMT(
+            stat(storage_path.c_str(), &file_stat) == 0,
+            "cannot stat embedding file %s: %s",
+            storage_path.c_str(),
+            strerror(errno));
+    off_t expected_size = data_offset + (off_t)(ntotal * d * sizeof(float));
+    FAISS_THROW_IF_NOT_FMT(
+            file_stat.st_size >= expected_size,
+            "embedding file %s too small: %ld bytes, expected %ld",
+            storage_path.c_str(),
+            (long)file_stat.st_size,
+            (long)expected_size);
+    block_size = file_stat.st_blksize > 0 ? file_stat.st_blksize : 4096;
+
+    direct_io = false;
+#ifdef __linux__
+    // the RAM tier reads the file once, no need to bypass the page cache
+    if (use_direct_io && tier == TIER_SSD) {
+        fd = open(storage_path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        direct_io = fd >= 0;
+    }
+#endif
+    if (fd < 0) {
+        fd = open(storage_path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0,
+            "cannot open embedding file %s: %s",
+            storage_path.c_str(),
+            strerror(errno));
+}
+
+void HybridEmbeddingStore::read_rows(size_t n, const idx_t* ids, float* out)
+        const {
+    if (n == 0) {
+        return;
+    }
+    FAISS_THROW_IF_NOT(fd >= 0);
+    size_t row_bytes = d * sizeof(float);
+    size_t alignment = direct_io ? block_size : 1;
+
+    // visit the rows in file order so that neighboring rows share a read
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return ids[a] < ids[b];
+    });
+
+    size_t i0 = 0;
+    while (i0 < n) {
+        off_t run_start = data_offset + (off_t)ids[order[i0]] * row_bytes;
+        off_t run_end = run_start + row_bytes;
+        size_t i1 = i0 + 1;
+        while (i1 < n) {
+            off_t start = data_offset + (off_t)ids[order[i1]] * row_bytes;
+            if (start > run_end + (off_t)max_merge_gap ||
+                start + (off_t)row_bytes - run_start > (off_t)max_read_size) {
+                break;
+            }
+            run_end = std::max(run_end, start + (off_t)row_bytes);
+            i1++;
+        }
+
+        off_t aligned_start = run_start / alignment * alignment;
+        off_t aligned_end = (run_end + alignment - 1) / alignment * alignment;
+        size_t nbytes = aligned_end - aligned_start;
+        AlignedBuffer buf(std::max(alignment, sizeof(void*)), nbytes);
+
+        // short reads are possible at the end of the file with O_DIRECT
+        size_t done = 0;
+        while (aligned_start + (off_t)done < run_end) {
+            ssize_t ret = pread(
+                    fd,
+                    (char*)buf.ptr + done,
+                    nbytes - done,
+                    aligned_start + done);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            FAISS_THROW_IF_NOT_FMT(
+                    ret > 0,
+                    "read error in %s at offset %ld: %s",
+                    storage_path.c_str(),
+                    (long)(aligned_start + done),
+                    ret == 0 ? "unexpected end of file" : strerror(errno));
+            done += ret;
+        }
+
+        for (size_t i = i0; i < i1; i++) {
+            size_t j = order[i];
+            off_t start = data_offset + (off_t)ids[j] * row_bytes;
+            memcpy(out + j * d,
+                   (char*)buf.ptr + (start - aligned_start),
+                   row_bytes);
+        }
+        i0 = i1;
+    }
+}
+
+void HybridEmbeddingStore::pin(const std::vector<idx_t>& ids) {
+    std::vector<idx_t> sorted_ids = ids;
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(
+            std::unique(sorted_ids.begin(), sorted_ids.end()),
+            sorted_ids.end());
+    for (idx_t id : sorted_ids) {
+        FAISS_THROW_IF_NOT_FMT(
+                id >= 0 && id < ntotal,
+                "pinned id %ld out of range [0, %ld)",
+                (long)id,
+                (long)ntotal);
+    }
+
+    std::fill(slots.begin(), slots.end(), -1);
+    pinned_ids = std::move(sorted_ids);
+    for (size_t i = 0; i < pinned_ids.size(); i++) {
+        slots[pinned_ids[i]] = i;
+    }
+    ram_data.clear();
+    if (pinned_ids.empty()) {
+        return;
+    }
+
+    open_storage();
+    if (tier == TIER_RAM) {
+        ram_data.resize(pinned_ids.size() * d);
+        read_rows(pinned_ids.size(), pinned_ids.data(), ram_data.data());
+        // the file is not needed anymore
+        close(fd);
+        fd = -1;
+    }
+}
+
+void HybridEmbeddingStore::pin_top(
+        const std::vector<int32_t>& scores,
+        float top_percent) {
+    FAISS_THROW_IF_NOT_FMT(
+            scores.size() == (size_t)ntotal,
+            "nb of scores (%zd) != ntotal (%ld)",
+            scores.size(),
+            (long)ntotal);
+    FAISS_THROW_IF_NOT_MSG(
+            top_percent >= 0 && top_percent <= 100, "top_percent invalid");
+    size_t n_top = (size_t)(ntotal * (double)top_percent / 100);
+
+    std::vector<idx_t> ids(ntotal);
+    std::iota(ids.begin(), ids.end(), 0);
+    auto higher = [&](idx_t a, idx_t b) {
+        return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+    };
+    std::nth_element(ids.begin(), ids.begin() + n_top, ids.end(), higher);
+    ids.resize(n_top);
+    pin(ids);
+}
+
+void HybridEmbeddingStore::pin_top_visited(
+        const std::unordered_map<idx_t, size_t>& visit_counts,
+        float top_percent) {
+    std::vector<int32_t> scores(ntotal, 0);
+    for (const auto& [id, count] : visit_counts) {
+        if (id >= 0 && id < ntotal) {
+            scores[id] = (int32_t)std::min(count, (size_t)INT32_MAX);
+        }
+    }
+    pin_top(scores, top_percent);
+}
+
+void HybridEmbeddingStore::get_embeddings(
+        size_t n,
+        const idx_t* ids,
+        float* out) const {
+    for (size_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT_FMT(
+                is_pinned(ids[i]), "id %ld is not pinned", (long)ids[i]);
+    }
+    if (tier == TIER_RAM) {
+        for (size_t i = 0; i < n; i++) {
+            memcpy(out + i * d,
+                   ram_data.data() + (size_t)slots[ids[i]] * d,
+                   d * sizeof(float));
+        }
+    } else {
+        read_rows(n, ids, out);
+    }
+}
+
+void HybridEmbeddingStore::compute_distances(
+        size_t n,
+        const idx_t* ids,
+        const float* query,
+        MetricType metric_type,
+        float* distances) const {
+    std::vector<float> embeddings(n * d);
+    get_embeddings(n, ids, embeddings.data());
+    for (size_t i = 0; i < n; i++) {
+        const float* x = embeddings.data() + i * d;
+        distances[i] = is_similarity_metric(metric_type)
+                ? -fvec_inner_product(query, x, d)
+                : fvec_L2sqr(query, x, d);
+    }
+}
+
+void HybridEmbeddingStore::write(const char* fname) const {
+    FileIOWriter writer(fname);
+    IOWriter* f = &writer;
+    uint32_t h = fourcc("HEst");
+    WRITE1(h);
+    WRITE1(d);
+    WRITE1(ntotal);
+    int tier_i = tier;
+    WRITE1(tier_i);
+    int64_t offset = data_offset;
+    WRITE1(offset);
+    WRITE1(use_direct_io);
+    WRITE1(max_merge_gap);
+    std::vector<char> path(storage_path.begin(), storage_path.end());
+    WRITEVECTOR(path);
+    WRITEVECTOR(pinned_ids);
+}
+
+HybridEmbeddingStore* HybridEmbeddingStore::read(const char* fname) {
+    FileIOReader reader(fname);
+    IOReader* f = &reader;
+    uint32_t h;
+    READ1(h);
+    FAISS_THROW_IF_NOT_FMT(
+            h == fourcc("HEst"),
+            "%s is not a hybrid embedding store file",
+            fname);
+    size_t d;
+    idx_t ntotal;
+    int tier_i;
+    int64_t offset;
+    bool use_direct_io;
+    size_t max_merge_gap;
+    std::vector<char> path;
+    std::vector<idx_t> pinned_ids;
+    READ1(d);
+    READ1(ntotal);
+    READ1(tier_i);
+    READ1(offset);
+    READ1(use_direct_io);
+    READ1(max_merge_gap);
+    READVECTOR(path);
+    READVECTOR(pinned_ids);
+
+    std::unique_ptr<HybridEmbeddingStore> store(new HybridEmbeddingStore(
+            d,
+            ntotal,
+            std::string(path.begin(), path.end()),
+            offset,
+            (Tier)tier_i));
+    store->use_direct_io = use_direct_io;
+    store->max_merge_gap = max_merge_gap;
+    store->pin(pinned_ids);
+    return store.release();
+}
+
+std::vector<int32_t> HybridEmbeddingStore::read_degree_file(
+        const char* fname) {
+    FileIOReader reader(fname);
+    IOReader* f = &reader;
+    std::vector<int32_t> degrees;
+
+    char magic[4];
+    size_t nread = reader(magic, 1, 4);
+    if (nread == 4 && memcmp(magic, "FDEG", 4) == 0) {
+        int64_t n;
+        READ1(n);
+        FAISS_THROW_IF_NOT_FMT(n >= 0, "invalid degree count in %s", fname);
+        degrees.resize(n);
+        READANDCHECK(degrees.data(), (size_t)n);
+        return degrees;
+    }
+
+    // legacy text format, one degree per line
+    std::string text(magic, nread);
+    char chunk[1 << 16];
+    size_t ret;
+    while ((ret = reader(chunk, 1, sizeof(chunk))) > 0) {
+        text.append(chunk, ret);
+    }
+    const char* p = text.c_str();
+    char* end;
+    for (;;) {
+        long v = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        degrees.push_back((int32_t)v);
+        p = end;
+    }
+    FAISS_THROW_IF_NOT_FMT(!degrees.empty(), "degree file %s is empty", fname);
+    return degrees;
+}
+
+void HybridEmbeddingStore::write_degree_file(
+        const char* fname,
+        const std::vector<int32_t>& degrees) {
+    FileIOWriter writer(fname);
+    IOWriter* f = &writer;
+    WRITEANDCHECK("FDEG", 4);
+    int64_t n = degrees.size();
+    WRITE1(n);
+    WRITEANDCHECK(degrees.data(), degrees.size());
+}
+
+off_t HybridEmbeddingStore::flat_storage_data_offset(const char* fname) {
+    FileIOReader reader(fname);
+    IOReader* f = &reader;
+    uint32_t h;
+    READ1(h);
+    FAISS_THROW_IF_NOT_FMT(
+            h == fourcc("IxFI") || h == fourcc("IxF2") || h == fourcc("IxFl"),
+            "%s is not an IndexFlat file",
+            fname);
+    // see write_index_header
+    off_t offset = sizeof(h) + sizeof(int) + 3 * sizeof(idx_t) + sizeof(bool);
+    int d;
+    idx_t ntotal, dummy;
+    bool is_trained;
+    MetricType metric_type;
+    READ1(d);
+    READ1(ntotal);
+    READ1(dummy);
+    READ1(dummy);
+    READ1(is_trained);
+    READ1(metric_type);
+    offset += sizeof(metric_type);
+    if (metric_type > 1) {
+        offset += sizeof(float);
+    }
+    // followed by the size of the codes vector
+    return offset + sizeof(size_t);
+}
+
+} // namespace faiss
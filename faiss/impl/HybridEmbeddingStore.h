@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <sys/types.h> // For off_t
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+/** Local tier of embeddings for an index in recompute mode.
+ *
+ * A subset of the nodes (typically the top-X% by degree, or the ones
+ * visited most often, see HNSWVisitProfiler) is "pinned": their
+ * embeddings are served from RAM or from an embedding file on SSD instead of
+ * being recomputed by the embedding server.
+ *
+ * The embedding file stores ntotal rows of d floats starting at data_offset
+ * (eg. the codes of a serialized IndexFlat, see flat_storage_data_offset).
+ * Batched reads are sorted by offset, and rows that are close on disk are
+ * read with a single pread.
+ *
+ * The store is owned by the index (IndexHNSW::hybrid_store), so several
+ * indexes with different configurations can live in the same process. Only
+ * the configuration and the pinned set are serialized, the embeddings are
+ * read again from the embedding file when the store is loaded.
+ */
+struct HybridEmbeddingStore {
+    enum Tier {
+        TIER_RAM = 0, ///< pinned embeddings are loaded in memory
+        TIER_SSD = 1, ///< pinned embeddings are read from the file on demand
+    };
+
+    size_t d = 0;
+    idx_t ntotal = 0;
+    Tier tier = TIER_SSD;
+
+    std::string storage_path;
+    off_t data_offset = 0;
+
+    /// open the embedding file with O_DIRECT (Linux only) for the SSD tier
+    bool use_direct_io = true;
+
+    /// rows separated by at most this many bytes on disk are fetched by the
+    /// same read (SSD tier)
+    size_t max_merge_gap = 64 * 1024;
+
+    HybridEmbeddingStore(
+            size_t d,
+            idx_t ntotal,
+            const std::string& storage_path,
+            off_t data_offset,
+            Tier tier = TIER_SSD);
+
+    ~HybridEmbeddingStore();
+
+    /// pin an explicit set of ids (replaces the previous set)
+    void pin(const std::vector<idx_t>& ids);
+
+    /** pin the top_percent % nodes with the highest scores (size ntotal),
+     * ties are broken by id */
+    void pin_top(const std::vector<int32_t>& scores, float top_percent);
+
+    /// same, with node visit counts as scores
+    void pin_top_visited(
+            const std::unordered_map<idx_t, size_t>& visit_counts,
+            float top_percent);
+
+    bool is_pinned(idx_t id) const {
+        return id >= 0 && (size_t)id < slots.size() && slots[id] >= 0;
+    }
+
+    size_t n_pinned() const {
+        return pinned_ids.size();
+    }
+
+    const std::vector<idx_t>& get_pinned_ids() const {
+        return pinned_ids;
+    }
+
+    /// embeddings of n pinned ids into out (size n * d)
+    void get_embeddings(size_t n, const idx_t* ids, float* out) const;
+
+    /** distances between query and n pinned ids, with the convention of
+     * HNSW search: similarities are negated */
+    void compute_distances(
+            size_t n,
+            const idx_t* ids,
+            const float* query,
+            MetricType metric_type,
+            float* distances) const;
+
+    /// save the configuration and the pinned set
+    void write(const char* fname) const;
+
+    /// load a store saved with write() and re-read its pinned embeddings
+    static HybridEmbeddingStore* read(const char* fname);
+
+    /** read a degree file. The binary format is the "FDEG" magic, the nb of
+     * entries as int64 and the int32 degrees. Text files with one degree
+     * per line (as written by HNSW::save_degree_distribution) are also
+     * accepted. */
+    static std::vector<int32_t> read_degree_file(const char* fname);
+
+    static void write_degree_file(
+            const char* fname,
+            const std::vector<int32_t>& degrees);
+
+    /// offset of the vector data in a file written by write_index for an
+    /// IndexFlat
+    static off_t flat_storage_data_offset(const char* fname);
+
+    HybridEmbeddingStore(const HybridEmbeddingStore&) = delete;
+    HybridEmbeddingStore& operator=(const HybridEmbeddingStore&) = delete;
+
+   private:
+    /// slot of each id in pinned_ids / ram_data, -1 if not pinned
+    std::vector<int32_t> slots;
+    std::vector<idx_t> pinned_ids;
+    std::vector<float> ram_data;
+
+    int fd = -1;
+    size_t block_size = 4096;
+    bool direct_io = false;
+
+    void open_storage();
+    void read_rows(size_t n, const idx_t* ids, float* out) const;
+};
+
+} // namespace faiss
@@ -7,9 +7,48 @@
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/platform_macros.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace faiss {
 
+/***********************************************************************
+ * IDSelector
+ ***********************************************************************/
+
+size_t IDSelector::estimate_cardinality(idx_t ntotal) const {
+    if (ntotal <= 0) {
+        return 0;
+    }
+    const idx_t n_sample = 4096;
+    if (ntotal <= n_sample) {
+        size_t n = 0;
+        for (idx_t i = 0; i < ntotal; i++) {
+            n += is_member(i);
+        }
+        return n;
+    }
+    // evenly spaced ids, offset to the middle of their interval
+    size_t n = 0;
+    for (idx_t j = 0; j < n_sample; j++) {
+        n += is_member((2 * j + 1) * ntotal / (2 * n_sample));
+    }
+    return (size_t)((double)n * ntotal / n_sample + 0.5);
+}
+
+void IDSelector::is_member_batch(size_t n, const idx_t* ids, uint8_t* mask)
+        const {
+    for (size_t i = 0; i < n; i++) {
+        mask[i] = is_member(ids[i]);
+    }
+}
+
 /***********************************************************************
  * IDSelectorRange
  ***********************************************************************/
@@ -21,6 +60,20 @@ bool IDSelectorRange::is_member(idx_t id) const {
     return id >= imin && id < imax;
 }
 
+size_t IDSelectorRange::estimate_cardinality(idx_t ntotal) const {
+    idx_t i0 = std::max(imin, idx_t(0)), i1 = std::min(imax, ntotal);
+    return i1 > i0 ? i1 - i0 : 0;
+}
+
+void IDSelectorRange::is_member_batch(
+        size_t n,
+        const idx_t* ids,
+        uint8_t* mask) const {
+    for (size_t i = 0; i < n; i++) {
+        mask[i] = ids[i] >= imin && ids[i] < imax;
+    }
+}
+
 void IDSelectorRange::find_sorted_ids_bounds(
         size_t list_size,
         const idx_t* ids,
@@ -77,6 +130,11 @@ bool IDSelectorArray::is_member(idx_t id) const {
     return false;
 }
 
+size_t IDSelectorArray::estimate_cardinality(idx_t ntotal) const {
+    // repeated ids are counted several times
+    return std::min(n, size_t(std::max(ntotal, idx_t(0))));
+}
+
 /***********************************************************************
  * IDSelectorBatch
  ***********************************************************************/
@@ -107,6 +165,23 @@ bool IDSelectorBatch::is_member(idx_t i) const {
     return set.count(i);
 }
 
+void IDSelectorBatch::is_member_batch(
+        size_t n,
+        const idx_t* ids,
+        uint8_t* out) const {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = IDSelectorBatch::is_member(ids[i]);
+    }
+}
+
+size_t IDSelectorBatch::estimate_cardinality(idx_t ntotal) const {
+    size_t n = 0;
+    for (idx_t id : set) {
+        n += id >= 0 && id < ntotal;
+    }
+    return n;
+}
+
 /***********************************************************************
  * IDSelectorBitmap
  ***********************************************************************/
@@ -122,4 +197,58 @@ bool IDSelectorBitmap::is_member(idx_t ii) const {
     return (bitmap[i >> 3] >> (i & 7)) & 1;
 }
 
+void IDSelectorBitmap::is_member_batch(
+        size_t nid,
+        const idx_t* ids,
+        uint8_t* mask) const {
+    size_t i = 0;
+#ifdef __AVX2__
+    // 32-bit words that are entirely within the bitmap, the ids beyond
+    // them are handled by the scalar loop
+    const int* words = (const int*)bitmap;
+    uint64_t limit = (uint64_t)(n / 4) * 32;
+    const __m256i perm = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+    for (; i + 4 <= nid; i += 4) {
+        if ((uint64_t)ids[i] >= limit || (uint64_t)ids[i + 1] >= limit ||
+            (uint64_t)ids[i + 2] >= limit || (uint64_t)ids[i + 3] >= limit) {
+            for (size_t j = i; j < i + 4; j++) {
+                mask[j] = IDSelectorBitmap::is_member(ids[j]);
+            }
+            continue;
+        }
+        __m256i vid = _mm256_loadu_si256((const __m256i*)(ids + i));
+        __m128i w =
+                _mm256_i64gather_epi32(words, _mm256_srli_epi64(vid, 5), 4);
+        __m256i shift = _mm256_permutevar8x32_epi32(
+                _mm256_and_si256(vid, _mm256_set1_epi64x(31)), perm);
+        __m128i bits = _mm_and_si128(
+                _mm_srlv_epi32(w, _mm256_castsi256_si128(shift)),
+                _mm_set1_epi32(1));
+        // one byte per id
+        __m128i bytes = _mm_shuffle_epi8(
+                bits, _mm_setr_epi32(0x0c080400, -1, -1, -1));
+        int32_t packed = _mm_cvtsi128_si32(bytes);
+        memcpy(mask + i, &packed, 4);
+    }
+#endif
+    for (; i < nid; i++) {
+        mask[i] = IDSelectorBitmap::is_member(ids[i]);
+    }
+}
+
+size_t IDSelectorBitmap::estimate_cardinality(idx_t ntotal) const {
+    if (ntotal <= 0) {
+        return 0;
+    }
+    size_t nbytes = std::min(n, size_t(ntotal) / 8);
+    size_t count = 0;
+    for (size_t i = 0; i < nbytes; i++) {
+        count += __builtin_popcount(bitmap[i]);
+    }
+    for (idx_t i = nbytes * 8; i < ntotal && (i >> 3) < n; i++) {
+        count += is_member(i);
+    }
+    return count;
+}
+
 } // namespace faiss
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <unordered_set>
 #include <vector>
 
@@ -20,6 +22,16 @@ namespace faiss {
 /** Encapsulates a set of ids to handle. */
 struct IDSelector {
     virtual bool is_member(idx_t id) const = 0;
+
+    /** estimate of the nb of selected ids in [0, ntotal), to pick a search
+     * strategy. The default tests a sample of evenly spaced ids. */
+    virtual size_t estimate_cardinality(idx_t ntotal) const;
+
+    /** membership of n ids at once: mask[i] = is_member(ids[i]). Saves
+     * the virtual call per id in the scan loops. */
+    virtual void is_member_batch(size_t n, const idx_t* ids, uint8_t* mask)
+            const;
+
     virtual ~IDSelector() {}
 };
 
@@ -35,6 +47,10 @@ struct IDSelectorRange : IDSelector {
 
     bool is_member(idx_t id) const final;
 
+    size_t estimate_cardinality(idx_t ntotal) const override;
+    void is_member_batch(size_t n, const idx_t* ids, uint8_t* mask)
+            const override;
+
     /// for sorted ids, find the range of list indices where the valid ids are
     /// stored
     void find_sorted_ids_bounds(
@@ -63,6 +79,7 @@ struct IDSelectorArray : IDSelector {
      */
     IDSelectorArray(size_t n, const idx_t* ids);
     bool is_member(idx_t id) const final;
+    size_t estimate_cardinality(idx_t ntotal) const override;
     ~IDSelectorArray() override {}
 };
 
@@ -93,10 +110,15 @@ struct IDSelectorBatch : IDSelector {
      */
     IDSelectorBatch(size_t n, const idx_t* indices);
     bool is_member(idx_t id) const final;
+    size_t estimate_cardinality(idx_t ntotal) const override;
+    void is_member_batch(size_t n, const idx_t* ids, uint8_t* mask)
+            const override;
     ~IDSelectorBatch() override {}
 };
 
 /** One bit per element. Constructed with a bitmap, size ceil(n / 8).
+ *
+ * is_member_batch gathers the bitmap words of 4 ids at a time with AVX2.
  */
 struct IDSelectorBitmap : IDSelector {
     size_t n;
@@ -110,6 +132,9 @@ struct IDSelectorBitmap : IDSelector {
      */
     IDSelectorBitmap(size_t n, const uint8_t* bitmap);
     bool is_member(idx_t id) const final;
+    size_t estimate_cardinality(idx_t ntotal) const override;
+    void is_member_batch(size_t n, const idx_t* ids, uint8_t* mask)
+            const override;
     ~IDSelectorBitmap() override {}
 };
 
@@ -120,6 +145,10 @@ struct IDSelectorNot : IDSelector {
     bool is_member(idx_t id) const final {
         return !sel->is_member(id);
     }
+    size_t estimate_cardinality(idx_t ntotal) const override {
+        size_t n = std::max(ntotal, idx_t(0));
+        return n - std::min(sel->estimate_cardinality(ntotal), n);
+    }
     virtual ~IDSelectorNot() {}
 };
 
@@ -128,6 +157,13 @@ struct IDSelectorAll : IDSelector {
     bool is_member(idx_t id) const final {
         return true;
     }
+    size_t estimate_cardinality(idx_t ntotal) const override {
+        return std::max(ntotal, idx_t(0));
+    }
+    void is_member_batch(size_t n, const idx_t*, uint8_t* mask)
+            const override {
+        std::fill(mask, mask + n, 1);
+    }
     virtual ~IDSelectorAll() {}
 };
 
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/IdHashMap.h>
+
+#include <cinttypes>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+namespace {
+
+// finalizer of MurmurHash3, so that sequential ids are spread out
+inline uint64_t hash_id(idx_t key) {
+    uint64_t x = key;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint8_t hash_ctrl(uint64_t h) {
+    return h & 0x7f;
+}
+
+inline size_t hash_slot(uint64_t h, size_t mask) {
+    return (h >> 7) & mask;
+}
+
+inline bool is_full(uint8_t c) {
+    return !(c & 0x80);
+}
+
+template <class T>
+MaybeOwnedVector<T> owned_copy(const MaybeOwnedVector<T>& v) {
+    return MaybeOwnedVector<T>(std::vector<T>(v.data(), v.data() + v.size()));
+}
+
+} // namespace
+
+int64_t IdHashMap::find_slot(idx_t key) const {
+    size_t cap = capacity();
+    if (cap == 0) {
+        return -1;
+    }
+    size_t mask = cap - 1;
+    uint64_t h = hash_id(key);
+    uint8_t c = hash_ctrl(h);
+    // terminates because there is always an empty slot
+    for (size_t i = hash_slot(h, mask);; i = (i + 1) & mask) {
+        uint8_t ci = ctrl[i];
+        if (ci == c && keys[i] == key) {
+            return i;
+        }
+        if (ci == kEmpty) {
+            return -1;
+        }
+    }
+}
+
+void IdHashMap::make_owned() {
+    if (!ctrl.is_owned) {
+        ctrl = owned_copy(ctrl);
+    }
+    if (!keys.is_owned) {
+        keys = owned_copy(keys);
+    }
+    if (!values.is_owned) {
+        values = owned_copy(values);
+    }
+}
+
+void IdHashMap::rehash(size_t new_capacity) {
+    FAISS_THROW_IF_NOT((new_capacity & (new_capacity - 1)) == 0);
+    FAISS_THROW_IF_NOT(nentry * 8 < new_capacity * 7);
+    MaybeOwnedVector<uint8_t> new_ctrl(
+            std::vector<uint8_t>(new_capacity, kEmpty));
+    MaybeOwnedVector<idx_t> new_keys(new_capacity);
+    MaybeOwnedVector<idx_t> new_values(new_capacity);
+    size_t mask = new_capacity - 1;
+    for_each([&](idx_t key, idx_t value) {
+        uint64_t h = hash_id(key);
+        size_t i = hash_slot(h, mask);
+        while (new_ctrl[i] != kEmpty) {
+            i = (i + 1) & mask;
+        }
+        new_ctrl[i] = hash_ctrl(h);
+        new_keys[i] = key;
+        new_values[i] = value;
+    });
+    ctrl = std::move(new_ctrl);
+    keys = std::move(new_keys);
+    values = std::move(new_values);
+    nused = nentry;
+}
+
+void IdHashMap::reserve(size_t n) {
+    size_t cap = 16;
+    while (cap * 7 <= n * 8) {
+        cap *= 2;
+    }
+    if (cap > capacity()) {
+        rehash(cap);
+    }
+}
+
+void IdHashMap::clear() {
+    ctrl = MaybeOwnedVector<uint8_t>();
+    keys = MaybeOwnedVector<idx_t>();
+    values = MaybeOwnedVector<idx_t>();
+    nentry = nused = 0;
+}
+
+void IdHashMap::set(idx_t key, idx_t value) {
+    make_owned();
+    int64_t slot = find_slot(key);
+    if (slot >= 0) {
+        values[slot] = value;
+        return;
+    }
+    if ((nused + 1) * 8 >= capacity() * 7) {
+        // grow, or just purge the deleted slots if there are many
+        if ((nentry + 1) * 2 >= capacity()) {
+            rehash(capacity() == 0 ? 16 : capacity() * 2);
+        } else {
+            rehash(capacity());
+        }
+    }
+    size_t mask = capacity() - 1;
+    uint64_t h = hash_id(key);
+    size_t i = hash_slot(h, mask);
+    while (is_full(ctrl[i])) {
+        i = (i + 1) & mask;
+    }
+    if (ctrl[i] == kEmpty) {
+        nused++;
+    }
+    ctrl[i] = hash_ctrl(h);
+    keys[i] = key;
+    values[i] = value;
+    nentry++;
+}
+
+bool IdHashMap::erase(idx_t key) {
+    int64_t slot = find_slot(key);
+    if (slot < 0) {
+        return false;
+    }
+    make_owned();
+    size_t mask = capacity() - 1;
+    // if the next slot is empty, no probe sequence goes through this one
+    if (ctrl[(slot + 1) & mask] == kEmpty) {
+        ctrl[slot] = kEmpty;
+        nused--;
+    } else {
+        ctrl[slot] = kDeleted;
+    }
+    nentry--;
+    return true;
+}
+
+bool IdHashMap::get(idx_t key, idx_t& value) const {
+    int64_t slot = find_slot(key);
+    if (slot < 0) {
+        return false;
+    }
+    value = values[slot];
+    return true;
+}
+
+idx_t IdHashMap::at(idx_t key) const {
+    int64_t slot = find_slot(key);
+    FAISS_THROW_IF_NOT_FMT(slot >= 0, "key %" PRId64 " not found", key);
+    return values[slot];
+}
+
+void IdHashMap::check_consistency() const {
+    size_t cap = capacity();
+    FAISS_THROW_IF_NOT((cap & (cap - 1)) == 0);
+    FAISS_THROW_IF_NOT(keys.size() == cap && values.size() == cap);
+    FAISS_THROW_IF_NOT(nentry <= nused);
+    FAISS_THROW_IF_NOT(cap == 0 ? nused == 0 : nused < cap);
+    size_t nfull = 0, nnonempty = 0;
+    for (size_t i = 0; i < cap; i++) {
+        uint8_t c = ctrl[i];
+        FAISS_THROW_IF_NOT(is_full(c) || c == kEmpty || c == kDeleted);
+        if (c != kEmpty) {
+            nnonempty++;
+        }
+        if (is_full(c)) {
+            nfull++;
+            FAISS_THROW_IF_NOT(c == hash_ctrl(hash_id(keys[i])));
+            FAISS_THROW_IF_NOT(find_slot(keys[i]) == int64_t(i));
+        }
+    }
+    FAISS_THROW_IF_NOT(nfull == nentry && nnonempty == nused);
+}
+
+} // namespace faiss
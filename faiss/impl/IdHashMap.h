@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <faiss/MetricType.h>
+#include <faiss/impl/maybe_owned_vector.h>
+
+namespace faiss {
+
+/** Compact hash table from ids to int64 values, used as reverse map by
+ * IndexIDMap2 and by the hashtable DirectMap.
+ *
+ * It is an open-addressing table with linear probing, laid out as in Swiss
+ * tables: a control byte per slot (empty, deleted or 7 bits of the hash of
+ * the key) is checked before the key, so most probes touch only the
+ * control array. The table is at most 7/8 full, so it takes 17 bytes per
+ * slot, ie. 19 to 39 bytes per entry, instead of 40 to 60 for a
+ * std::unordered_map.
+ *
+ * The table is serialized as is, so it does not need to be rebuilt when it
+ * is loaded and it can be memory mapped (the arrays are MaybeOwnedVectors).
+ * A mapped table is copied to memory the first time it is modified.
+ */
+struct IdHashMap {
+    static constexpr uint8_t kEmpty = 0x80;
+    static constexpr uint8_t kDeleted = 0xfe;
+
+    /// size capacity, kEmpty, kDeleted or the low 7 bits of the hash
+    MaybeOwnedVector<uint8_t> ctrl;
+    MaybeOwnedVector<idx_t> keys;   ///< size capacity
+    MaybeOwnedVector<idx_t> values; ///< size capacity
+
+    size_t nentry = 0; ///< nb of entries in the table
+    size_t nused = 0;  ///< nb of slots that are not empty (incl. deleted)
+
+    IdHashMap() = default;
+
+    size_t size() const {
+        return nentry;
+    }
+
+    bool empty() const {
+        return nentry == 0;
+    }
+
+    /// nb of slots, 0 or a power of 2
+    size_t capacity() const {
+        return ctrl.size();
+    }
+
+    /// make room for n entries without rehashing
+    void reserve(size_t n);
+
+    /// remove all entries and free the memory
+    void clear();
+
+    /// add an entry or replace the value of an existing one
+    void set(idx_t key, idx_t value);
+
+    /// returns whether the key was found
+    bool erase(idx_t key);
+
+    /// returns whether the key was found and sets value
+    bool get(idx_t key, idx_t& value) const;
+
+    /// returns the value, raises an exception if the key is not found
+    idx_t at(idx_t key) const;
+
+    bool contains(idx_t key) const {
+        return find_slot(key) >= 0;
+    }
+
+    /// call f(key, value) on all entries
+    template <class F>
+    void for_each(F f) const {
+        for (size_t i = 0; i < capacity(); i++) {
+            if (!(ctrl[i] & 0x80)) {
+                f(keys[i], values[i]);
+            }
+        }
+    }
+
+    /// memory used by the arrays, in bytes
+    size_t memory_usage() const {
+        return ctrl.byte_size() + keys.byte_size() + values.byte_size();
+    }
+
+    /// check the table invariants, raise an exception if they are violated
+    void check_consistency() const;
+
+   private:
+    /// slot of the key or -1
+    int64_t find_slot(idx_t key) const;
+    /// copy the arrays to memory if they are a view
+    void make_owned();
+    void rehash(size_t new_capacity);
+};
+
+} // namespace faiss
@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/IndexDelta.h>
+
+#include <cinttypes>
+#include <cstring>
+#include <unordered_map>
+
+#include <faiss/IndexFlatCodes.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+
+namespace faiss {
+
+size_t IndexDelta::nbytes() const {
+    size_t nb = list_nos.size() * sizeof(int64_t);
+    for (size_t i = 0; i < list_nos.size(); i++) {
+        nb += (removed_ids[i].size() + added_ids[i].size()) * sizeof(int64_t);
+        nb += added_codes[i].size();
+    }
+    nb += codes.size() + levels.size() * sizeof(int32_t);
+    nb += (updated_nodes.size() + deleted_ids.size()) * sizeof(int64_t);
+    nb += neighbors.size() * sizeof(HNSW::storage_idx_t);
+    return nb;
+}
+
+namespace {
+
+/*************************************************************
+ * IVF
+ *************************************************************/
+
+void compute_ivf_delta(
+        const IndexIVF* ivf_old,
+        const IndexIVF* ivf_new,
+        IndexDelta& delta) {
+    FAISS_THROW_IF_NOT_MSG(
+            ivf_old->nlist == ivf_new->nlist &&
+                    ivf_old->code_size == ivf_new->code_size,
+            "the IVF versions have different nlist or code_size");
+    const InvertedLists* il_old = ivf_old->invlists;
+    const InvertedLists* il_new = ivf_new->invlists;
+    size_t cs = ivf_old->code_size;
+    delta.type = IndexDelta::TYPE_IVF;
+    delta.code_size = cs;
+
+    for (size_t l = 0; l < ivf_old->nlist; l++) {
+        size_t n_old = il_old->list_size(l), n_new = il_new->list_size(l);
+        if (n_old == 0 && n_new == 0) {
+            continue;
+        }
+        InvertedLists::ScopedIds ids_old(il_old, l), ids_new(il_new, l);
+        InvertedLists::ScopedCodes codes_old(il_old, l),
+                codes_new(il_new, l);
+        // the same id may appear several times in a list
+        std::unordered_multimap<idx_t, size_t> old_entries;
+        for (size_t i = 0; i < n_old; i++) {
+            old_entries.emplace(ids_old[i], i);
+        }
+        std::vector<int64_t> added;
+        std::vector<uint8_t> added_codes;
+        for (size_t i = 0; i < n_new; i++) {
+            const uint8_t* code = codes_new.get() + i * cs;
+            auto range = old_entries.equal_range(ids_new[i]);
+            auto it = range.first;
+            for (; it != range.second; ++it) {
+                if (!memcmp(codes_old.get() + it->second * cs, code, cs)) {
+                    break;
+                }
+            }
+            if (it != range.second) {
+                old_entries.erase(it);
+            } else {
+                added.push_back(ids_new[i]);
+                added_codes.insert(added_codes.end(), code, code + cs);
+            }
+        }
+        if (old_entries.empty() && added.empty()) {
+            continue;
+        }
+        std::vector<int64_t> removed;
+        for (const auto& e : old_entries) {
+            removed.push_back(e.first);
+        }
+        delta.list_nos.push_back(l);
+        delta.removed_ids.push_back(std::move(removed));
+        delta.added_ids.push_back(std::move(added));
+        delta.added_codes.push_back(std::move(added_codes));
+    }
+}
+
+void apply_ivf_delta(IndexIVF* ivf, const IndexDelta& delta) {
+    FAISS_THROW_IF_NOT(delta.code_size == ivf->code_size);
+    FAISS_THROW_IF_NOT_MSG(
+            ivf->direct_map.no(),
+            "apply_index_delta does not update the direct map");
+    InvertedLists* il = ivf->invlists;
+    size_t cs = ivf->code_size;
+    for (size_t i = 0; i < delta.list_nos.size(); i++) {
+        idx_t l = delta.list_nos[i];
+        FAISS_THROW_IF_NOT(l >= 0 && l < ivf->nlist);
+        const std::vector<int64_t>& removed = delta.removed_ids[i];
+        if (!removed.empty()) {
+            std::unordered_map<idx_t, int> to_remove;
+            for (int64_t id : removed) {
+                to_remove[id]++;
+            }
+            // compact the list, keeping the order of the remaining entries
+            size_t n = il->list_size(l);
+            std::vector<idx_t> ids;
+            std::vector<uint8_t> codes;
+            {
+                InvertedLists::ScopedIds list_ids(il, l);
+                InvertedLists::ScopedCodes list_codes(il, l);
+                for (size_t j = 0; j < n; j++) {
+                    auto it = to_remove.find(list_ids[j]);
+                    if (it != to_remove.end() && it->second > 0) {
+                        it->second--;
+                        continue;
+                    }
+                    ids.push_back(list_ids[j]);
+                    const uint8_t* code = list_codes.get() + j * cs;
+                    codes.insert(codes.end(), code, code + cs);
+                }
+            }
+            FAISS_THROW_IF_NOT_FMT(
+                    n - ids.size() == removed.size(),
+                    "list %" PRId64 " does not contain the removed ids",
+                    l);
+            il->resize(l, ids.size());
+            if (!ids.empty()) {
+                il->update_entries(l, 0, ids.size(), ids.data(), codes.data());
+            }
+        }
+        const std::vector<int64_t>& added = delta.added_ids[i];
+        FAISS_THROW_IF_NOT(delta.added_codes[i].size() == added.size() * cs);
+        if (!added.empty()) {
+            il->add_entries(
+                    l, added.size(), added.data(), delta.added_codes[i].data());
+        }
+    }
+}
+
+/*************************************************************
+ * HNSW
+ *************************************************************/
+
+using storage_idx_t = HNSW::storage_idx_t;
+
+const IndexFlatCodes* hnsw_storage(const IndexHNSW* index) {
+    auto storage = dynamic_cast<const IndexFlatCodes*>(index->storage);
+    FAISS_THROW_IF_NOT_MSG(
+            storage, "index delta: the HNSW storage must be IndexFlatCodes");
+    FAISS_THROW_IF_NOT_MSG(
+            !index->hnsw.storage_is_compact,
+            "index delta: compact HNSW graphs are not supported");
+    return storage;
+}
+
+void compute_hnsw_delta(
+        const IndexHNSW* index_old,
+        const IndexHNSW* index_new,
+        IndexDelta& delta) {
+    const IndexFlatCodes* st_old = hnsw_storage(index_old);
+    const IndexFlatCodes* st_new = hnsw_storage(index_new);
+    const HNSW& h_old = index_old->hnsw;
+    const HNSW& h_new = index_new->hnsw;
+    size_t n_old = index_old->ntotal, n_new = index_new->ntotal;
+    size_t cs = st_old->code_size;
+    FAISS_THROW_IF_NOT(st_new->code_size == cs);
+    FAISS_THROW_IF_NOT_MSG(
+            n_new >= n_old &&
+                    !memcmp(st_old->codes.data(),
+                            st_new->codes.data(),
+                            n_old * cs),
+            "the vectors of the old HNSW version were modified or renumbered");
+    FAISS_THROW_IF_NOT(
+            h_old.cum_nneighbor_per_level == h_new.cum_nneighbor_per_level);
+    delta.type = IndexDelta::TYPE_HNSW;
+    delta.code_size = cs;
+
+    delta.codes.assign(
+            st_new->codes.data() + n_old * cs,
+            st_new->codes.data() + n_new * cs);
+    delta.levels.assign(
+            h_new.levels.data() + n_old, h_new.levels.data() + n_new);
+
+    for (size_t i = 0; i < n_new; i++) {
+        size_t b = h_new.offsets[i], e = h_new.offsets[i + 1];
+        const storage_idx_t* nb = h_new.neighbors.data() + b;
+        if (i < n_old) {
+            FAISS_THROW_IF_NOT(h_old.levels[i] == h_new.levels[i]);
+            if (!memcmp(h_old.neighbors.data() + h_old.offsets[i],
+                        nb,
+                        (e - b) * sizeof(storage_idx_t))) {
+                continue;
+            }
+        }
+        delta.updated_nodes.push_back(i);
+        delta.neighbors.insert(delta.neighbors.end(), nb, nb + e - b);
+    }
+
+    for (size_t i = 0; i < n_new; i++) {
+        bool was_deleted = i < n_old && h_old.is_deleted(i);
+        FAISS_THROW_IF_NOT_MSG(
+                !was_deleted || h_new.is_deleted(i),
+                "the tombstones of the old HNSW version were removed");
+        if (!was_deleted && h_new.is_deleted(i)) {
+            delta.deleted_ids.push_back(i);
+        }
+    }
+    delta.entry_point = h_new.entry_point;
+    delta.max_level = h_new.max_level;
+}
+
+void apply_hnsw_delta(IndexHNSW* index, const IndexDelta& delta) {
+    auto storage = const_cast<IndexFlatCodes*>(hnsw_storage(index));
+    FAISS_THROW_IF_NOT(delta.code_size == storage->code_size);
+    HNSW& hnsw = index->hnsw;
+    size_t n_old = delta.ntotal_before, n_new = delta.ntotal_after;
+    FAISS_THROW_IF_NOT(
+            delta.levels.size() == n_new - n_old &&
+            delta.codes.size() == (n_new - n_old) * delta.code_size);
+
+    storage->add_sa_codes(n_new - n_old, delta.codes.data(), nullptr);
+    for (size_t i = 0; i < delta.levels.size(); i++) {
+        hnsw.levels.push_back(delta.levels[i]);
+        hnsw.offsets.push_back(
+                hnsw.offsets.back() + hnsw.cum_nb_neighbors(delta.levels[i]));
+    }
+    hnsw.neighbors.resize(hnsw.offsets.back(), -1);
+
+    size_t pos = 0;
+    for (int64_t node : delta.updated_nodes) {
+        FAISS_THROW_IF_NOT(node >= 0 && node < n_new);
+        size_t b = hnsw.offsets[node], e = hnsw.offsets[node + 1];
+        FAISS_THROW_IF_NOT(pos + e - b <= delta.neighbors.size());
+        memcpy(hnsw.neighbors.data() + b,
+               delta.neighbors.data() + pos,
+               (e - b) * sizeof(storage_idx_t));
+        pos += e - b;
+    }
+    FAISS_THROW_IF_NOT(pos == delta.neighbors.size());
+
+    if (!hnsw.deleted.empty() || !delta.deleted_ids.empty()) {
+        hnsw.deleted.resize(n_new, 0);
+    }
+    for (int64_t id : delta.deleted_ids) {
+        FAISS_THROW_IF_NOT(id >= 0 && id < n_new && !hnsw.deleted[id]);
+        hnsw.deleted[id] = 1;
+        hnsw.n_deleted++;
+    }
+    hnsw.entry_point = delta.entry_point;
+    hnsw.max_level = delta.max_level;
+}
+
+} // namespace
+
+IndexDelta compute_index_delta(const Index* index_old, const Index* index_new) {
+    FAISS_THROW_IF_NOT(index_old->d == index_new->d);
+    IndexDelta delta;
+    delta.d = index_old->d;
+    delta.ntotal_before = index_old->ntotal;
+    delta.ntotal_after = index_new->ntotal;
+    auto ivf_old = dynamic_cast<const IndexIVF*>(index_old);
+    auto ivf_new = dynamic_cast<const IndexIVF*>(index_new);
+    auto hnsw_old = dynamic_cast<const IndexHNSW*>(index_old);
+    auto hnsw_new = dynamic_cast<const IndexHNSW*>(index_new);
+    if (ivf_old && ivf_new) {
+        compute_ivf_delta(ivf_old, ivf_new, delta);
+    } else if (hnsw_old && hnsw_new) {
+        compute_hnsw_delta(hnsw_old, hnsw_new, delta);
+    } else {
+        FAISS_THROW_MSG("index delta: unsupported index types");
+    }
+    return delta;
+}
+
+void apply_index_delta(Index* index, const IndexDelta& delta) {
+    FAISS_THROW_IF_NOT_FMT(
+            index->d == delta.d && index->ntotal == delta.ntotal_before,
+            "the delta applies to an index of d=%" PRId64 " ntotal=%" PRId64,
+            delta.d,
+            delta.ntotal_before);
+    if (delta.type == IndexDelta::TYPE_IVF) {
+        auto ivf = dynamic_cast<IndexIVF*>(index);
+        FAISS_THROW_IF_NOT_MSG(ivf, "the delta applies to an IndexIVF");
+        apply_ivf_delta(ivf, delta);
+    } else if (delta.type == IndexDelta::TYPE_HNSW) {
+        auto hnsw = dynamic_cast<IndexHNSW*>(index);
+        FAISS_THROW_IF_NOT_MSG(hnsw, "the delta applies to an IndexHNSW");
+        apply_hnsw_delta(hnsw, delta);
+    } else {
+        FAISS_THROW_FMT("invalid index delta type %d", delta.type);
+    }
+    index->ntotal = delta.ntotal_after;
+}
+
+/*************************************************************
+ * I/O
+ *************************************************************/
+
+void write_index_delta(const IndexDelta& delta, IOWriter* f) {
+    uint32_t h = fourcc("IxDt");
+    WRITE1(h);
+    WRITE1(delta.type);
+    WRITE1(delta.d);
+    WRITE1(delta.code_size);
+    WRITE1(delta.ntotal_before);
+    WRITE1(delta.ntotal_after);
+    WRITEVECTOR(delta.list_nos);
+    for (size_t i = 0; i < delta.list_nos.size(); i++) {
+        WRITEVECTOR(delta.removed_ids[i]);
+        WRITEVECTOR(delta.added_ids[i]);
+        WRITEVECTOR(delta.added_codes[i]);
+    }
+    WRITEVECTOR(delta.codes);
+    WRITEVECTOR(delta.levels);
+    WRITEVECTOR(delta.updated_nodes);
+    WRITEVECTOR(delta.neighbors);
+    WRITEVECTOR(delta.deleted_ids);
+    WRITE1(delta.entry_point);
+    WRITE1(delta.max_level);
+}
+
+void write_index_delta(const IndexDelta& delta, const char* fname) {
+    FileIOWriter writer(fname);
+    write_index_delta(delta, &writer);
+}
+
+void read_index_delta(IndexDelta& delta, IOReader* f) {
+    uint32_t h;
+    READ1(h);
+    FAISS_THROW_IF_NOT_FMT(
+            h == fourcc("IxDt"),
+            "not an index delta (fourcc %s)",
+            fourcc_inv_printable(h).c_str());
+    READ1(delta.type);
+    READ1(delta.d);
+    READ1(delta.code_size);
+    READ1(delta.ntotal_before);
+    READ1(delta.ntotal_after);
+    READVECTOR(delta.list_nos);
+    size_t n = delta.list_nos.size();
+    delta.removed_ids.resize(n);
+    delta.added_ids.resize(n);
+    delta.added_codes.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        READVECTOR(delta.removed_ids[i]);
+        READVECTOR(delta.added_ids[i]);
+        READVECTOR(delta.added_codes[i]);
+    }
+    READVECTOR(delta.codes);
+    READVECTOR(delta.levels);
+    READVECTOR(delta.updated_nodes);
+    READVECTOR(delta.neighbors);
+    READVECTOR(delta.deleted_ids);
+    READ1(delta.entry_point);
+    READ1(delta.max_level);
+}
+
+void read_index_delta(IndexDelta& delta, const char* fname) {
+    FileIOReader reader(fname);
+    read_index_delta(delta, &reader);
+}
+
+} // namespace faiss
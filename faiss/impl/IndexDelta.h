@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <faiss/impl/HNSW.h>
+
+namespace faiss {
+
+struct Index;
+struct IOReader;
+struct IOWriter;
+
+/** Incremental update between two versions of an index, to ship the
+ * changes of an update to the replicas instead of the whole index file.
+ *
+ * The delta is computed by comparing the old and the new version
+ * (compute_index_delta) and applied in place to a copy of the old version
+ * (apply_index_delta). Supported indexes:
+ *
+ * - IndexIVF: for each modified inverted list, the removed ids and the
+ *   appended entries (ids and codes). The coarse quantizer and the other
+ *   trained parameters must be the same in both versions. The order of
+ *   the entries in a list may differ from the new version after applying,
+ *   which only changes the order of the results with equal distances.
+ *
+ * - IndexHNSW with an IndexFlatCodes storage: the vectors appended to the
+ *   storage, their levels and the neighbor lists of the new nodes and of
+ *   the old nodes whose lists changed, the new tombstones (mark_deleted)
+ *   and the entry point. The old vectors must not have been renumbered
+ *   (no compact_deleted or remove_ids between the versions), and the graph
+ *   must be in RAM in the regular (non-compact) layout.
+ */
+struct IndexDelta {
+    enum Type : int32_t {
+        TYPE_IVF = 1,
+        TYPE_HNSW = 2,
+    };
+    int32_t type = 0;
+
+    /// to check that the delta is applied to the right index version
+    int64_t d = 0;
+    int64_t code_size = 0;
+    int64_t ntotal_before = 0;
+    int64_t ntotal_after = 0;
+
+    /// IVF: the modified lists, with for each of them the removed ids and
+    /// the appended entries (size list_nos.size())
+    std::vector<int64_t> list_nos;
+    std::vector<std::vector<int64_t>> removed_ids;
+    std::vector<std::vector<int64_t>> added_ids;
+    std::vector<std::vector<uint8_t>> added_codes;
+
+    /// HNSW: codes of the added vectors (ntotal_before ... ntotal_after-1)
+    /// and their levels
+    std::vector<uint8_t> codes;
+    std::vector<int32_t> levels;
+    /// HNSW: nodes whose neighbor lists are replaced (the old nodes whose
+    /// lists changed, then all the new nodes) and their lists concatenated,
+    /// for all levels
+    std::vector<int64_t> updated_nodes;
+    std::vector<HNSW::storage_idx_t> neighbors;
+    /// HNSW: nodes tombstoned since the old version
+    std::vector<int64_t> deleted_ids;
+    int64_t entry_point = -1;
+    int32_t max_level = -1;
+
+    /// size of the serialized delta, in bytes (approximately)
+    size_t nbytes() const;
+};
+
+/// delta that turns index_old into index_new
+IndexDelta compute_index_delta(const Index* index_old, const Index* index_new);
+
+/// apply the delta in place to the old version of the index
+void apply_index_delta(Index* index, const IndexDelta& delta);
+
+void write_index_delta(const IndexDelta& delta, IOWriter* f);
+void write_index_delta(const IndexDelta& delta, const char* fname);
+
+void read_index_delta(IndexDelta& delta, IOReader* f);
+void read_index_delta(IndexDelta& delta, const char* fname);
+
+} // namespace faiss
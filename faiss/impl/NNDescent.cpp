@@ -9,11 +9,13 @@
 
 #include <faiss/impl/NNDescent.h>
 
+#include <cstring>
 #include <mutex>
 #include <string>
 
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/DistanceComputer.h>
+#include <faiss/utils/distances.h>
 
 namespace faiss {
 
@@ -55,6 +57,10 @@ Nhood::Nhood(const Nhood& other) {
 /// Insert a point into the candidate pool
 void Nhood::insert(int id, float dist) {
     LockGuard guard(lock);
+    insert_nolock(id, dist);
+}
+
+void Nhood::insert_nolock(int id, float dist) {
     if (dist > pool.front().distance)
         return;
     for (int i = 0; i < pool.size(); i++) {
@@ -153,19 +159,104 @@ NNDescent::NNDescent(const int d, const int K) : K(K), d(d) {
 
 NNDescent::~NNDescent() {}
 
-void NNDescent::join(DistanceComputer& qdis) {
-    idx_t check_period = InterruptCallback::get_period_hint(d * search_L);
+namespace {
+
+/// a candidate for the pool of node target, found by the local join
+struct JoinCandidate {
+    int target;
+    int id;
+    float distance;
+};
+
+} // namespace
+
+void NNDescent::join(DistanceComputer& qdis, const float* x, MetricType metric) {
+    FAISS_THROW_IF_NOT(
+            !x || metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT);
+    int nbucket = omp_get_max_threads();
+    // buffers[t * nbucket + b]: candidates found by thread t for the nodes
+    // of bucket b = target % nbucket
+    std::vector<std::vector<JoinCandidate>> buffers(nbucket * nbucket);
+
+    FAISS_THROW_IF_NOT(join_block_size > 0);
+    idx_t check_period = std::min(
+            InterruptCallback::get_period_hint(d * search_L),
+            size_t(join_block_size));
     for (idx_t i0 = 0; i0 < (idx_t)ntotal; i0 += check_period) {
         idx_t i1 = std::min(i0 + check_period, (idx_t)ntotal);
-#pragma omp parallel for default(shared) schedule(dynamic, 100)
-        for (idx_t n = i0; n < i1; n++) {
-            graph[n].join([&](int i, int j) {
-                if (i != j) {
-                    float dist = qdis.symmetric_dis(i, j);
-                    graph[i].insert(j, dist);
-                    graph[j].insert(i, dist);
+#pragma omp parallel num_threads(nbucket)
+        {
+            int rank = omp_get_thread_num();
+            int nt = omp_get_num_threads();
+            std::vector<JoinCandidate>* buf = buffers.data() + rank * nbucket;
+            std::vector<int> ids;
+            std::vector<float> xs, dis;
+
+            // the pools are not modified during the join, so the pruning
+            // threshold can be read without lock
+            auto add_pair = [&](int i, int j, float dist) {
+                if (dist <= graph[j].pool.front().distance) {
+                    buf[j % nbucket].push_back({j, i, dist});
+                }
+                if (dist <= graph[i].pool.front().distance) {
+                    buf[i % nbucket].push_back({i, j, dist});
+                }
+            };
+
+#pragma omp for schedule(dynamic, 100)
+            for (idx_t n = i0; n < i1; n++) {
+                const Nhood& nhood = graph[n];
+                if (!x) {
+                    nhood.join([&](int i, int j) {
+                        if (i != j) {
+                            add_pair(i, j, qdis.symmetric_dis(i, j));
+                        }
+                    });
+                    continue;
+                }
+                // the new neighbors are compared to the new neighbors after
+                // them and to all the old ones, one row of the block each
+                size_t n_new = nhood.nn_new.size();
+                ids.assign(nhood.nn_new.begin(), nhood.nn_new.end());
+                ids.insert(ids.end(), nhood.nn_old.begin(), nhood.nn_old.end());
+                size_t m = ids.size();
+                xs.resize(m * d);
+                for (size_t j = 0; j < m; j++) {
+                    memcpy(xs.data() + j * d,
+                           x + size_t(ids[j]) * d,
+                           sizeof(float) * d);
                 }
-            });
+                dis.resize(m);
+                for (size_t i = 0; i < n_new; i++) {
+                    size_t ny = m - i - 1;
+                    const float* xi = xs.data() + i * d;
+                    if (metric == METRIC_L2) {
+                        fvec_L2sqr_ny(dis.data(), xi, xi + d, d, ny);
+                    } else {
+                        fvec_inner_products_ny(dis.data(), xi, xi + d, d, ny);
+                        for (size_t j = 0; j < ny; j++) {
+                            dis[j] = -dis[j];
+                        }
+                    }
+                    for (size_t j = 0; j < ny; j++) {
+                        int id_j = ids[i + 1 + j];
+                        if (id_j != ids[i]) {
+                            add_pair(ids[i], id_j, dis[j]);
+                        }
+                    }
+                }
+            }
+
+            // each bucket of pools is updated by a single thread
+            for (int b = rank; b < nbucket; b += nt) {
+                for (int t = 0; t < nbucket; t++) {
+                    auto& cands = buffers[t * nbucket + b];
+                    for (const JoinCandidate& c : cands) {
+                        graph[c.target].insert_nolock(c.id, c.distance);
+                    }
+                    cands.clear();
+                }
+            }
         }
         InterruptCallback::check();
     }
@@ -283,7 +374,11 @@ void NNDescent::update() {
     }
 }
 
-void NNDescent::nndescent(DistanceComputer& qdis, bool verbose) {
+void NNDescent::nndescent(
+        DistanceComputer& qdis,
+        bool verbose,
+        const float* x,
+        MetricType metric) {
     int num_eval_points = std::min(NUM_EVAL_POINTS, ntotal);
     std::vector<int> eval_points(num_eval_points);
     std::vector<std::vector<int>> acc_eval_set(num_eval_points);
@@ -291,7 +386,7 @@ void NNDescent::nndescent(DistanceComputer& qdis, bool verbose) {
     gen_random(rng, eval_points.data(), eval_points.size(), ntotal);
     generate_eval_set(qdis, eval_points, acc_eval_set, ntotal);
     for (int it = 0; it < iter; it++) {
-        join(qdis);
+        join(qdis, x, metric);
         update();
 
         if (verbose) {
@@ -381,7 +476,12 @@ void NNDescent::init_graph(DistanceComputer& qdis) {
     }
 }
 
-void NNDescent::build(DistanceComputer& qdis, const int n, bool verbose) {
+void NNDescent::build(
+        DistanceComputer& qdis,
+        const int n,
+        bool verbose,
+        const float* x,
+        MetricType metric) {
     FAISS_THROW_IF_NOT_MSG(L >= K, "L should be >= K in NNDescent.build");
     FAISS_THROW_IF_NOT_FMT(
             n > NUM_EVAL_POINTS,
@@ -400,7 +500,7 @@ void NNDescent::build(DistanceComputer& qdis, const int n, bool verbose) {
     ntotal = n;
     init_graph(qdis);
     final_graph.resize(uint64_t(ntotal) * K);
-    nndescent(qdis, verbose);
+    nndescent(qdis, verbose, x, metric);
 
     // Store the neighbor link structure into final_graph
     // Clear the old graph
@@ -20,6 +20,7 @@
 
 #include <faiss/Index.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/maybe_owned_vector.h>
 #include <faiss/impl/platform_macros.h>
 #include <faiss/utils/Heap.h>
 #include <faiss/utils/random.h>
@@ -82,6 +83,9 @@ struct Nhood {
 
     void insert(int id, float dist);
 
+    /// insert without taking the lock, when this thread owns the node
+    void insert_nolock(int id, float dist);
+
     template <typename C>
     void join(C callback) const;
 };
@@ -97,7 +101,18 @@ struct NNDescent {
 
     ~NNDescent();
 
-    void build(DistanceComputer& qdis, const int n, bool verbose);
+    /** @param x       if not null, the n vectors that qdis compares with
+     *                  metric (L2 or inner product, negated as in qdis).
+     *                  The local join then computes the distances between
+     *                  the neighbors of a node as a block with the SIMD
+     *                  batched kernels instead of pair by pair.
+     */
+    void build(
+            DistanceComputer& qdis,
+            const int n,
+            bool verbose,
+            const float* x = nullptr,
+            MetricType metric = METRIC_L2);
 
     void search(
             DistanceComputer& qdis,
@@ -112,10 +127,20 @@ struct NNDescent {
     void init_graph(DistanceComputer& qdis);
 
     /// Perform NNDescent algorithm
-    void nndescent(DistanceComputer& qdis, bool verbose);
-
-    /// Perform local join on each node
-    void join(DistanceComputer& qdis);
+    void nndescent(
+            DistanceComputer& qdis,
+            bool verbose,
+            const float* x = nullptr,
+            MetricType metric = METRIC_L2);
+
+    /** Perform local join on each node. The candidates found by the threads
+     * are buffered by destination node and inserted in the pools once the
+     * join of a block of nodes is done, each pool by a single thread, so
+     * the pools are not locked. */
+    void join(
+            DistanceComputer& qdis,
+            const float* x = nullptr,
+            MetricType metric = METRIC_L2);
 
     /// Sample new neighbors for each node to peform local join later
     void update();
@@ -140,6 +165,8 @@ struct NNDescent {
     int iter = 10;          // number of iterations to iterate over
     int search_L = 0;       // size of candidate pool in searching
     int random_seed = 2021; // random seed for generators
+    /// nb of nodes joined between two updates of the candidate pools
+    int join_block_size = 16384;
 
     idx_t K; // K in KNN graph
     int d;   // dimensions
@@ -148,7 +175,7 @@ struct NNDescent {
     int ntotal = 0;
 
     KNNGraph graph;
-    std::vector<int> final_graph;
+    MaybeOwnedVector<int> final_graph;
 };
 
 } // namespace faiss
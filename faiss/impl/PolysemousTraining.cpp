@@ -197,6 +197,9 @@ struct ReproduceWithHammingObjective : PermutationObjective {
     // what would the cost update be if iw and jw were swapped?
     // computed in O(n) instead of O(n^2) for the full re-computation
     double cost_update(const int* perm, int iw, int jw) const override {
+        if (symmetric) {
+            return cost_update_symmetric(perm, iw, jw);
+        }
         double delta_cost = 0;
 
         for (int i = 0; i < n; i++) {
@@ -251,6 +254,41 @@ struct ReproduceWithHammingObjective : PermutationObjective {
         return delta_cost;
     }
 
+    // true if target_dis and weights are symmetric matrices
+    bool symmetric = false;
+    // 2 * weights * target_dis
+    std::vector<double> weighted_target;
+
+    /* With symmetric tables, only the pairs (i, j) with i in {iw, jw} and
+     * j not in {iw, jw} change (the transposed pairs change by the same
+     * amount). With a = h(perm[iw], perm[j]) and b = h(perm[jw], perm[j]),
+     * the change of the terms of j is
+     *
+     *   w_iw,j ((t_iw,j - b)^2 - (t_iw,j - a)^2)
+     * + w_jw,j ((t_jw,j - a)^2 - (t_jw,j - b)^2)
+     * = (a - b) (2 w_iw,j t_iw,j - 2 w_jw,j t_jw,j - (w_iw,j - w_jw,j)(a + b))
+     *
+     * so a single pass over 2 contiguous rows is needed. */
+    double cost_update_symmetric(const int* perm, int iw, int jw) const {
+        const double* wt_i = weighted_target.data() + iw * n;
+        const double* wt_j = weighted_target.data() + jw * n;
+        const double* w_i = weights.data() + iw * n;
+        const double* w_j = weights.data() + jw * n;
+        uint64_t pi = perm[iw], pj = perm[jw];
+        double delta_cost = 0;
+        for (int j = 0; j < n; j++) {
+            double a = hamming_dis(pi, perm[j]);
+            double b = hamming_dis(pj, perm[j]);
+            delta_cost += (a - b) *
+                    (wt_i[j] - wt_j[j] - (w_i[j] - w_j[j]) * (a + b));
+        }
+        // remove the terms of j = iw and j = jw
+        double h = hamming_dis(pi, pj);
+        delta_cost += h * (wt_i[iw] - wt_j[iw] - (w_i[iw] - w_j[iw]) * h);
+        delta_cost -= h * (wt_i[jw] - wt_j[jw] - (w_i[jw] - w_j[jw]) * h);
+        return 2 * delta_cost;
+    }
+
     ReproduceWithHammingObjective(
             int nbits,
             const std::vector<double>& dis_table,
@@ -259,6 +297,21 @@ struct ReproduceWithHammingObjective : PermutationObjective {
         n = 1 << nbits;
         FAISS_THROW_IF_NOT(dis_table.size() == n * n);
         set_affine_target_dis(dis_table);
+
+        symmetric = true;
+        for (int i = 0; i < n && symmetric; i++) {
+            for (int j = 0; j < i; j++) {
+                if (target_dis[i * n + j] != target_dis[j * n + i] ||
+                    weights[i * n + j] != weights[j * n + i]) {
+                    symmetric = false;
+                    break;
+                }
+            }
+        }
+        weighted_target.resize(n * n);
+        for (int i = 0; i < n * n; i++) {
+            weighted_target[i] = 2 * weights[i] * target_dis[i];
+        }
     }
 
     void set_affine_target_dis(const std::vector<double>& dis_table) {
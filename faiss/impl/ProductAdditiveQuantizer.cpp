@@ -14,6 +14,8 @@
 
 #include <algorithm>
 
+#include <omp.h>
+
 #include <faiss/clone_index.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
@@ -149,11 +151,75 @@ void ProductAdditiveQuantizer::compute_codes_add_centroids(
     pack_codes(n, unpacked_codes.data(), codes_out, -1, nullptr, centroids);
 }
 
+namespace {
+
+// unpacked_codes[i][offset_m + m] = codes[i][m]
+void unpack_split_codes(
+        const AdditiveQuantizer& q,
+        const uint8_t* codes,
+        size_t n,
+        size_t M,
+        size_t offset_m,
+        int32_t* unpacked_codes) {
+    for (size_t i = 0; i < n; i++) {
+        BitstringReader bsr(codes + i * q.code_size, q.code_size);
+        for (size_t m = 0; m < q.M; m++) {
+            unpacked_codes[i * M + offset_m + m] = bsr.read(q.nbits[m]);
+        }
+    }
+}
+
+} // namespace
+
 void ProductAdditiveQuantizer::compute_unpacked_codes(
         const float* x,
         int32_t* unpacked_codes,
         size_t n,
         const float* centroids) const {
+    size_t bs = encode_tile_size;
+    bool per_vector = bs > 0;
+    for (const auto q : quantizers) {
+        per_vector = per_vector &&
+                dynamic_cast<const ResidualQuantizer*>(q) != nullptr;
+    }
+    size_t ntile = bs > 0 ? (n + bs - 1) / bs : 0;
+    if (per_vector && ntile * nsplits >= size_t(omp_get_max_threads())) {
+        std::vector<size_t> offsets_d(nsplits + 1), offsets_m(nsplits + 1);
+        for (size_t s = 0; s < nsplits; s++) {
+            offsets_d[s + 1] = offsets_d[s] + quantizers[s]->d;
+            offsets_m[s + 1] = offsets_m[s] + quantizers[s]->M;
+        }
+        // the sub-vectors of a tile are gathered in a per-thread buffer
+        // that stays in cache
+#pragma omp parallel
+        {
+            std::vector<float> xsub;
+            std::vector<uint8_t> codes;
+#pragma omp for schedule(dynamic)
+            for (int64_t t = 0; t < ntile * nsplits; t++) {
+                size_t s = t % nsplits;
+                size_t i0 = t / nsplits * bs, i1 = std::min(n, i0 + bs);
+                const auto q = quantizers[s];
+                xsub.resize(bs * q->d);
+                codes.resize(bs * q->code_size);
+                for (size_t i = i0; i < i1; i++) {
+                    memcpy(xsub.data() + (i - i0) * q->d,
+                           x + i * d + offsets_d[s],
+                           q->d * sizeof(float));
+                }
+                q->compute_codes(xsub.data(), codes.data(), i1 - i0);
+                unpack_split_codes(
+                        *q,
+                        codes.data(),
+                        i1 - i0,
+                        M,
+                        offsets_m[s],
+                        unpacked_codes + i0 * M);
+            }
+        }
+        return;
+    }
+
     /// TODO: actuallly we do not need to unpack and pack
     size_t offset_d = 0, offset_m = 0;
     std::vector<float> xsub;
@@ -176,13 +242,13 @@ void ProductAdditiveQuantizer::compute_unpacked_codes(
         // unpack
 #pragma omp parallel for if (n > 1000)
         for (idx_t i = 0; i < n; i++) {
-            uint8_t* code = codes.data() + i * q->code_size;
-            BitstringReader bsr(code, q->code_size);
-
-            // unpacked_codes[i][s][m] = codes[i][m]
-            for (size_t m = 0; m < q->M; m++) {
-                unpacked_codes[i * M + offset_m + m] = bsr.read(q->nbits[m]);
-            }
+            unpack_split_codes(
+                    *q,
+                    codes.data() + i * q->code_size,
+                    1,
+                    M,
+                    offset_m,
+                    unpacked_codes + i * M);
         }
 
         offset_d += q->d;
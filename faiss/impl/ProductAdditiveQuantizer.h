@@ -30,6 +30,14 @@ struct ProductAdditiveQuantizer : AdditiveQuantizer {
 
     std::vector<AdditiveQuantizer*> quantizers;
 
+    /** Encode by tiles of encode_tile_size vectors, the (tile, split)
+     * pairs are encoded concurrently in a single parallel loop. Only used
+     * when the codes of a vector do not depend on the other vectors
+     * encoded with it (all the sub-quantizers are ResidualQuantizers) and
+     * there are enough tiles to keep the threads busy. Otherwise, and if
+     * 0, the splits are encoded one after the other. Not serialized. */
+    size_t encode_tile_size = 1024;
+
     /** Construct a product additive quantizer.
      *
      * The additive quantizers passed in will be cloned into the
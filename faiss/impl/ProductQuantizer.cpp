@@ -9,13 +9,18 @@
 
 #include <faiss/impl/ProductQuantizer.h>
 
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <string>
 
 #include <algorithm>
 
+#include <omp.h>
+
 #include <faiss/IndexFlat.h>
 #include <faiss/VectorTransform.h>
 #include <faiss/impl/FaissAssert.h>
@@ -122,6 +127,133 @@ static void init_hypercube_pca(
     }
 }
 
+namespace {
+
+// solve A x = b in place for a symmetric positive definite A of size n * n
+// (Cholesky factorization), the solution is stored in b
+void solve_spd(size_t n, double* A, double* b) {
+    for (size_t j = 0; j < n; j++) {
+        double s = A[j * n + j];
+        for (size_t k = 0; k < j; k++) {
+            s -= A[j * n + k] * A[j * n + k];
+        }
+        double ljj = std::sqrt(std::max(s, 1e-20));
+        A[j * n + j] = ljj;
+        for (size_t i = j + 1; i < n; i++) {
+            double t = A[i * n + j];
+            for (size_t k = 0; k < j; k++) {
+                t -= A[i * n + k] * A[j * n + k];
+            }
+            A[i * n + j] = t / ljj;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = 0; k < i; k++) {
+            b[i] -= A[i * n + k] * b[k];
+        }
+        b[i] /= A[i * n + i];
+    }
+    for (size_t i = n; i-- > 0;) {
+        for (size_t k = i + 1; k < n; k++) {
+            b[i] -= A[k * n + i] * b[k];
+        }
+        b[i] /= A[i * n + i];
+    }
+}
+
+/* Alternate between the anisotropic encoding of the training set and the
+ * update of the centroids. With the codes fixed, the loss restricted to
+ * the centroid c of sub-quantizer m is, summed over the vectors i assigned
+ * to it:
+ *
+ *   ||x_i,m - c||^2 + w_i (a_i - <c, x_i,m>)^2
+ *
+ * with w_i = (eta - 1) / ||x_i||^2 and a_i = <r_i, x_i> + <c_i,m, x_i,m>,
+ * which is minimized by solving
+ *
+ *   (sum_i I + w_i x_i,m x_i,m^T) c = sum_i (1 + w_i a_i) x_i,m
+ */
+void train_anisotropic(ProductQuantizer& pq, size_t n, const float* x) {
+    const size_t M = pq.M, dsub = pq.dsub, ksub = pq.ksub, d = pq.d;
+    const float eta = pq.anisotropic_eta;
+    std::vector<uint8_t> codes(n * pq.code_size);
+    std::vector<uint64_t> assign(n * M);
+    std::vector<float> rx(n), weights(n);
+
+    for (int iter = 0; iter < pq.anisotropic_train_niter; iter++) {
+        pq.compute_codes(x, codes.data(), n);
+
+        double loss = 0;
+#pragma omp parallel for reduction(+ : loss) if (n > 1000)
+        for (int64_t i = 0; i < n; i++) {
+            const float* xi = x + i * d;
+            PQDecoderGeneric decoder(codes.data() + i * pq.code_size, pq.nbits);
+            float s = 0, r2 = 0;
+            for (size_t m = 0; m < M; m++) {
+                uint64_t c = decoder.decode();
+                assign[i * M + m] = c;
+                const float* cm = pq.get_centroids(m, c);
+                for (size_t j = 0; j < dsub; j++) {
+                    float r = xi[m * dsub + j] - cm[j];
+                    s += r * xi[m * dsub + j];
+                    r2 += r * r;
+                }
+            }
+            float xnorm2 = fvec_norm_L2sqr(xi, d);
+            rx[i] = s;
+            weights[i] = xnorm2 > 0 ? (eta - 1) / xnorm2 : 0;
+            loss += r2 + weights[i] * s * s;
+        }
+        if (pq.verbose) {
+            printf("  anisotropic PQ iteration %d loss=%g\n",
+                   iter,
+                   loss / std::max(n, size_t(1)));
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t m = 0; m < M; m++) {
+            std::vector<double> A(ksub * dsub * dsub, 0), b(ksub * dsub, 0);
+            std::vector<size_t> count(ksub, 0);
+            for (size_t i = 0; i < n; i++) {
+                uint64_t c = assign[i * M + m];
+                const float* xim = x + i * d + m * dsub;
+                const float* cm = pq.get_centroids(m, c);
+                double w = weights[i];
+                double a = rx[i] + fvec_inner_product(cm, xim, dsub);
+                double* Ac = A.data() + c * dsub * dsub;
+                double* bc = b.data() + c * dsub;
+                for (size_t j = 0; j < dsub; j++) {
+                    for (size_t l = 0; l < dsub; l++) {
+                        Ac[j * dsub + l] += w * xim[j] * xim[l];
+                    }
+                    bc[j] += (1 + w * a) * xim[j];
+                }
+                count[c]++;
+            }
+            for (size_t c = 0; c < ksub; c++) {
+                if (count[c] == 0) {
+                    continue; // keep the centroid of empty clusters
+                }
+                double* Ac = A.data() + c * dsub * dsub;
+                double* bc = b.data() + c * dsub;
+                for (size_t j = 0; j < dsub; j++) {
+                    Ac[j * dsub + j] += count[c];
+                }
+                solve_spd(dsub, Ac, bc);
+                float* cm = pq.get_centroids(m, c);
+                for (size_t j = 0; j < dsub; j++) {
+                    cm[j] = bc[j];
+                }
+            }
+        }
+        if (!pq.transposed_centroids.empty()) {
+            pq.sync_transposed_centroids();
+        }
+    }
+}
+
+} // namespace
+
 void ProductQuantizer::train(size_t n, const float* x) {
     if (train_type != Train_shared) {
         train_type_t final_train_type;
@@ -136,13 +268,8 @@ void ProductQuantizer::train(size_t n, const float* x) {
             }
         }
 
-        std::unique_ptr<float[]> xslice(new float[n * dsub]);
-        for (int m = 0; m < M; m++) {
-            for (int j = 0; j < n; j++)
-                memcpy(xslice.get() + j * dsub,
-                       x + j * d + m * dsub,
-                       dsub * sizeof(float));
-
+        // train sub-quantizer m on its slice of the training set
+        auto train_slice = [&](int m, const float* xslice, bool verbose_m) {
             Clustering clus(dsub, ksub, cp);
 
             // we have some initialization for the centroids
@@ -153,19 +280,11 @@ void ProductQuantizer::train(size_t n, const float* x) {
             switch (final_train_type) {
                 case Train_hypercube:
                     init_hypercube(
-                            dsub,
-                            nbits,
-                            n,
-                            xslice.get(),
-                            clus.centroids.data());
+                            dsub, nbits, n, xslice, clus.centroids.data());
                     break;
                 case Train_hypercube_pca:
                     init_hypercube_pca(
-                            dsub,
-                            nbits,
-                            n,
-                            xslice.get(),
-                            clus.centroids.data());
+                            dsub, nbits, n, xslice, clus.centroids.data());
                     break;
                 case Train_hot_start:
                     memcpy(clus.centroids.data(),
@@ -175,13 +294,57 @@ void ProductQuantizer::train(size_t n, const float* x) {
                 default:;
             }
 
-            if (verbose) {
+            if (verbose_m) {
                 clus.verbose = true;
                 printf("Training PQ slice %d/%zd\n", m, M);
             }
             IndexFlatL2 index(dsub);
-            clus.train(n, xslice.get(), assign_index ? *assign_index : index);
+            clus.train(n, xslice, assign_index ? *assign_index : index);
             set_params(clus.centroids.data(), m);
+        };
+
+        if (train_parallel_subspaces && !assign_index && M > 1) {
+            if (verbose) {
+                printf("Training %zd PQ slices in parallel\n", M);
+            }
+            // gather all the slices in a single pass over x,
+            // layout (M, n, dsub)
+            std::vector<float> xslices(n * d);
+#pragma omp parallel for if (n > 1000)
+            for (int64_t j = 0; j < n; j++) {
+                for (size_t m = 0; m < M; m++) {
+                    memcpy(xslices.data() + (m * n + j) * dsub,
+                           x + j * d + m * dsub,
+                           dsub * sizeof(float));
+                }
+            }
+
+            // the slices are trained concurrently, each k-means runs
+            // single-threaded inside
+            std::mutex exception_mutex;
+            std::string exception_string;
+#pragma omp parallel for schedule(dynamic)
+            for (int m = 0; m < M; m++) {
+                try {
+                    train_slice(m, xslices.data() + m * n * dsub, false);
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    exception_string = e.what();
+                }
+            }
+            if (!exception_string.empty()) {
+                FAISS_THROW_MSG(exception_string.c_str());
+            }
+        } else {
+            std::unique_ptr<float[]> xslice(new float[n * dsub]);
+            for (int m = 0; m < M; m++) {
+                for (int j = 0; j < n; j++)
+                    memcpy(xslice.get() + j * dsub,
+                           x + j * d + m * dsub,
+                           dsub * sizeof(float));
+
+                train_slice(m, xslice.get(), verbose);
+            }
         }
 
     } else {
@@ -199,6 +362,13 @@ void ProductQuantizer::train(size_t n, const float* x) {
             set_params(clus.centroids.data(), m);
         }
     }
+
+    if (anisotropic_eta > 1) {
+        FAISS_THROW_IF_NOT_MSG(
+                train_type != Train_shared,
+                "anisotropic training does not support shared codebooks");
+        train_anisotropic(*this, n, x);
+    }
 }
 
 template <class PQEncoder>
@@ -284,6 +454,68 @@ void ProductQuantizer::compute_code(const float* x, uint8_t* code) const {
             faiss::compute_code<PQEncoderGeneric>(*this, x, code);
             break;
     }
+    if (anisotropic_eta > 1) {
+        refine_code_anisotropic(x, code);
+    }
+}
+
+void ProductQuantizer::refine_code_anisotropic(const float* x, uint8_t* code)
+        const {
+    const float xnorm2 = fvec_norm_L2sqr(x, d);
+    if (anisotropic_eta <= 1 || xnorm2 == 0) {
+        return;
+    }
+    const float w = (anisotropic_eta - 1) / xnorm2;
+
+    std::vector<float> l2_tab(M * ksub), ip_tab(M * ksub), xm_norms(M);
+    std::vector<uint64_t> idx(M);
+    // s = <r, x> where r is the residual of the current code
+    float s = 0;
+    {
+        PQDecoderGeneric decoder(code, nbits);
+        for (size_t m = 0; m < M; m++) {
+            const float* xm = x + m * dsub;
+            const float* cents = get_centroids(m, 0);
+            fvec_L2sqr_ny(l2_tab.data() + m * ksub, xm, cents, dsub, ksub);
+            fvec_inner_products_ny(
+                    ip_tab.data() + m * ksub, xm, cents, dsub, ksub);
+            xm_norms[m] = fvec_norm_L2sqr(xm, dsub);
+            idx[m] = decoder.decode();
+            s += xm_norms[m] - ip_tab[m * ksub + idx[m]];
+        }
+    }
+
+    for (int iter = 0; iter < anisotropic_encode_niter; iter++) {
+        bool changed = false;
+        for (size_t m = 0; m < M; m++) {
+            const float* l2 = l2_tab.data() + m * ksub;
+            const float* ip = ip_tab.data() + m * ksub;
+            // <r, x> = a - ip[j] if centroid j is used for sub-vector m
+            const float a = s + ip[idx[m]];
+            uint64_t best = idx[m];
+            float best_loss = l2[best] + w * (a - ip[best]) * (a - ip[best]);
+            for (size_t j = 0; j < ksub; j++) {
+                float loss = l2[j] + w * (a - ip[j]) * (a - ip[j]);
+                if (loss < best_loss) {
+                    best_loss = loss;
+                    best = j;
+                }
+            }
+            if (best != idx[m]) {
+                s = a - ip[best];
+                idx[m] = best;
+                changed = true;
+            }
+        }
+        if (!changed) {
+            break;
+        }
+    }
+
+    PQEncoderGeneric encoder(code, nbits);
+    for (size_t m = 0; m < M; m++) {
+        encoder.encode(idx[m]);
+    }
 }
 
 template <class PQDecoder>
@@ -422,6 +654,9 @@ void ProductQuantizer::compute_codes(const float* x, uint8_t* codes, size_t n)
             uint8_t* code = codes + i * code_size;
             const float* tab = dis_tables.get() + i * ksub * M;
             compute_code_from_distance_table(tab, code);
+            if (anisotropic_eta > 1) {
+                refine_code_anisotropic(x + i * d, code);
+            }
         }
     }
 }
@@ -676,6 +911,94 @@ void pq_estimators_from_tables_generic(
     }
 }
 
+/* 8-bit codes, same as pq_estimators_from_tables for the codes
+ * j0..j0 + nj, with the same grouping of the sums */
+template <class C>
+void pq_estimators_from_tables_range(
+        size_t M,
+        size_t ksub,
+        const uint8_t* codes,
+        size_t j0,
+        size_t nj,
+        const float* __restrict dis_table,
+        size_t k,
+        float* __restrict heap_dis,
+        int64_t* __restrict heap_ids) {
+    const uint8_t* c = codes + j0 * M;
+    for (size_t j = j0; j < j0 + nj; j++) {
+        float dis = 0;
+        const float* dt = dis_table;
+        if (M % 4 == 0 && M != 4) {
+            for (size_t m = 0; m < M; m += 4) {
+                float dism = dt[*c++];
+                dt += ksub;
+                dism += dt[*c++];
+                dt += ksub;
+                dism += dt[*c++];
+                dt += ksub;
+                dism += dt[*c++];
+                dt += ksub;
+                dis += dism;
+            }
+        } else {
+            for (size_t m = 0; m < M; m++) {
+                dis += dt[*c++];
+                dt += ksub;
+            }
+        }
+        if (C::cmp(heap_dis[0], dis)) {
+            heap_replace_top<C>(k, heap_dis, heap_ids, dis, j);
+        }
+    }
+}
+
+/* 8-bit codes, the codes are scanned by blocks that stay in cache while
+ * they are compared with a block of queries */
+template <class C>
+void pq_knn_search_with_tables_tiled(
+        const ProductQuantizer& pq,
+        size_t qbs,
+        const float* dis_tables,
+        const uint8_t* codes,
+        const size_t ncodes,
+        HeapArray<C>* res,
+        bool init_finalize_heap) {
+    size_t k = res->k, nx = res->nh;
+    size_t ksub = pq.ksub, M = pq.M;
+    size_t bs = pq.search_code_block;
+    size_t nqb = (nx + qbs - 1) / qbs;
+
+#pragma omp parallel for if (nqb > 1)
+    for (int64_t qb = 0; qb < nqb; qb++) {
+        size_t i0 = qb * qbs, i1 = std::min(nx, i0 + qbs);
+        if (init_finalize_heap) {
+            for (size_t i = i0; i < i1; i++) {
+                heap_heapify<C>(k, res->val + i * k, res->ids + i * k);
+            }
+        }
+        for (size_t j0 = 0; j0 < ncodes; j0 += bs) {
+            size_t nj = std::min(bs, ncodes - j0);
+            for (size_t i = i0; i < i1; i++) {
+                pq_estimators_from_tables_range<C>(
+                        M,
+                        ksub,
+                        codes,
+                        j0,
+                        nj,
+                        dis_tables + i * ksub * M,
+                        k,
+                        res->val + i * k,
+                        res->ids + i * k);
+            }
+        }
+        if (init_finalize_heap) {
+            for (size_t i = i0; i < i1; i++) {
+                heap_reorder<C>(k, res->val + i * k, res->ids + i * k);
+            }
+        }
+    }
+}
+
 template <class C>
 void pq_knn_search_with_tables(
         const ProductQuantizer& pq,
@@ -688,6 +1011,23 @@ void pq_knn_search_with_tables(
     size_t k = res->k, nx = res->nh;
     size_t ksub = pq.ksub, M = pq.M;
 
+    if (nbits == 8 && pq.search_code_block > 0) {
+        // queries per block, keep all the threads busy
+        size_t nt = omp_get_max_threads();
+        size_t qbs = std::min(pq.search_query_block, (nx + nt - 1) / nt);
+        if (qbs > 1) {
+            pq_knn_search_with_tables_tiled<C>(
+                    pq,
+                    qbs,
+                    dis_tables,
+                    codes,
+                    ncodes,
+                    res,
+                    init_finalize_heap);
+            return;
+        }
+    }
+
 #pragma omp parallel for if (nx > 1)
     for (int64_t i = 0; i < nx; i++) {
         /* query preparation for asymmetric search: compute look-up tables */
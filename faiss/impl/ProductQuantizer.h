@@ -16,6 +16,7 @@
 
 #include <faiss/Clustering.h>
 #include <faiss/impl/Quantizer.h>
+#include <faiss/impl/maybe_owned_vector.h>
 #include <faiss/impl/platform_macros.h>
 #include <faiss/utils/Heap.h>
 
@@ -51,9 +52,45 @@ struct ProductQuantizer : Quantizer {
     /// d / M)
     Index* assign_index;
 
+    /// train the M sub-quantizers concurrently (one k-means per thread)
+    /// instead of one after the other with a multi-threaded k-means. This
+    /// is faster when ksub and dsub are too small to keep all the threads
+    /// busy. Ignored if assign_index is set.
+    bool train_parallel_subspaces = false;
+
+    /** Anisotropic (score-aware) quantization, for inner product search.
+     * If > 1, the codes minimize
+     *
+     *   ||r||^2 + (eta - 1) * <r, x>^2 / ||x||^2
+     *
+     * where r = x - decode(code), ie. the component of the quantization
+     * error parallel to x is weighted eta times more than the orthogonal
+     * one. This error is the one that affects the inner products with the
+     * queries that score high for x. The codes are obtained by coordinate
+     * descent over the sub-quantizers starting from the L2 codes, and
+     * train() refines the k-means centroids for the same loss.
+     * Not serialized. */
+    float anisotropic_eta = 0;
+
+    /// nb of (encoding, centroid update) rounds of the anisotropic training
+    int anisotropic_train_niter = 5;
+
+    /// max nb of coordinate descent passes over the sub-quantizers per code
+    int anisotropic_encode_niter = 4;
+
+    /** Tiling of the search with 8-bit codes: the codes are scanned by
+     * blocks of search_code_block vectors, and each block is compared
+     * with up to search_query_block queries while it is in cache. This
+     * divides the memory traffic by as much, which helps when the scan is
+     * memory bound (many threads over codes that do not fit in cache).
+     * Disabled if search_query_block <= 1 or if there are too few queries
+     * per thread. Not serialized. */
+    size_t search_code_block = 1024;
+    size_t search_query_block = 0;
+
     /// Centroid table, size M * ksub * dsub.
     /// Layout: (M, ksub, dsub)
-    std::vector<float> centroids;
+    MaybeOwnedVector<float> centroids;
 
     /// Transposed centroid table, size M * ksub * dsub.
     /// Layout: (dsub, M, ksub)
@@ -105,6 +142,11 @@ struct ProductQuantizer : Quantizer {
     void decode(const uint8_t* code, float* x) const;
     void decode(const uint8_t* code, float* x, size_t n) const override;
 
+    /** Refine a code for the anisotropic loss (see anisotropic_eta).
+     * @param x     input vector, size d
+     * @param code  input: initial code, output: refined code */
+    void refine_code_anisotropic(const float* x, uint8_t* code) const;
+
     /// If we happen to have the distance tables precomputed, this is
     /// more efficient to compute the codes.
     void compute_code_from_distance_table(const float* tab, uint8_t* code)
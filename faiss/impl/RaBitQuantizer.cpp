@@ -12,6 +12,7 @@
 #include <cstring>
 #include <limits>
 #include <memory>
+#include <queue>
 #include <vector>
 
 #include <faiss/impl/FaissAssert.h>
@@ -25,6 +26,21 @@ struct FactorsData {
     float dp_multiplier = 0;
 };
 
+// follows the extra bits of the code, for nb_bits > 1
+struct ExFactorsData {
+    // ||or - c|| / <y, (or - c) / ||or - c||>, where y is the vector of the
+    //   multi-bit code values
+    float ex_multiplier = 0;
+    // error bound of the 1-bit estimate of the distance, divided by
+    //   ||qr - c|| and by the confidence parameter (kErrorBoundEpsilon)
+    float error_bound = 0;
+};
+
+// the 1-bit estimates of <or - c, qr - c> are within
+//   kErrorBoundEpsilon * (the bound) of the actual value with high
+//   probability (see the RaBitQ paper, this corresponds to ~99.9%)
+constexpr float kErrorBoundEpsilon = 1.9f;
+
 struct QueryFactorsData {
     float c1 = 0;
     float c2 = 0;
@@ -34,12 +50,127 @@ struct QueryFactorsData {
     float qr_norm_L2sqr = 0;
 };
 
-static size_t get_code_size(const size_t d) {
-    return (d + 7) / 8 + sizeof(FactorsData);
+size_t RaBitQuantizer::get_code_size(size_t d, size_t nb_bits) {
+    size_t size = (d + 7) / 8 + sizeof(FactorsData);
+    if (nb_bits > 1) {
+        size += ((nb_bits - 1) * d + 7) / 8 + sizeof(ExFactorsData);
+    }
+    return size;
+}
+
+size_t RaBitQuantizer::get_nb_bits(size_t d, size_t code_size) {
+    for (size_t nb_bits = 1; nb_bits <= 8; nb_bits++) {
+        if (get_code_size(d, nb_bits) == code_size) {
+            return nb_bits;
+        }
+    }
+    return 0;
+}
+
+RaBitQuantizer::RaBitQuantizer(size_t d, MetricType metric, size_t nb_bits)
+        : Quantizer(d, get_code_size(d, nb_bits)),
+          metric_type{metric},
+          nb_bits{nb_bits} {
+    FAISS_THROW_IF_NOT_FMT(
+            nb_bits >= 1 && nb_bits <= 8,
+            "RaBitQ supports 1 to 8 bits per dimension, not %zd",
+            nb_bits);
 }
 
-RaBitQuantizer::RaBitQuantizer(size_t d, MetricType metric)
-        : Quantizer(d, get_code_size(d)), metric_type{metric} {}
+namespace {
+
+// the ex_bits-bit value of dimension i of the extra bits of a code. Reads 2
+//   bytes, which is safe because the ExFactorsData follow.
+inline uint32_t get_ex_value(const uint8_t* ex_code, size_t i, size_t ex_bits) {
+    const size_t bit = i * ex_bits;
+    const uint32_t v = ex_code[bit / 8] | (uint32_t(ex_code[bit / 8 + 1]) << 8);
+    return (v >> (bit % 8)) & ((1u << ex_bits) - 1);
+}
+
+inline void set_ex_value(
+        uint8_t* ex_code,
+        size_t i,
+        size_t ex_bits,
+        uint32_t value) {
+    const size_t bit = i * ex_bits;
+    const uint32_t v = value << (bit % 8);
+    ex_code[bit / 8] |= v & 0xff;
+    if ((bit % 8) + ex_bits > 8) {
+        ex_code[bit / 8 + 1] |= v >> 8;
+    }
+}
+
+// Computes the extra bits of the code of a residual r = or - c. Dimension i
+//   is represented by the value y[i] = sign(r[i]) * (m[i] + 0.5), with
+//   m[i] = min(floor(t * |r[i]|), 2^ex_bits - 1), and the scaling t is the
+//   one that maximizes the cosine between y and r. The cosine only changes
+//   when one of the m[i] is incremented, so all these critical values of t
+//   are visited in increasing order, until the largest component saturates.
+//   Returns sum_i |r[i]| * (m[i] + 0.5).
+float compute_ex_code(
+        const float* r,
+        size_t d,
+        size_t ex_bits,
+        uint8_t* ex_code) {
+    const uint32_t max_m = (1u << ex_bits) - 1;
+    float max_abs = 0;
+    for (size_t i = 0; i < d; i++) {
+        max_abs = std::max(max_abs, std::abs(r[i]));
+    }
+    if (max_abs == 0) {
+        return 0;
+    }
+    const float t_end = (max_m + 1) / max_abs;
+
+    using Event = std::pair<float, size_t>;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    std::vector<uint32_t> m(d, 0);
+    double sum_xy = 0;
+    double sum_yy = 0.25 * d;
+    for (size_t i = 0; i < d; i++) {
+        const float a = std::abs(r[i]);
+        sum_xy += 0.5 * a;
+        if (a > 0) {
+            events.emplace(1 / a, i);
+        }
+    }
+    double best_cos = sum_xy / std::sqrt(sum_yy);
+    float best_t = 0;
+    while (!events.empty()) {
+        const auto [t, i] = events.top();
+        if (t > t_end) {
+            break;
+        }
+        events.pop();
+        m[i]++;
+        sum_xy += std::abs(r[i]);
+        sum_yy += 2.0 * m[i];
+        const double cos = sum_xy / std::sqrt(sum_yy);
+        if (cos > best_cos) {
+            best_cos = cos;
+            best_t = t;
+        }
+        if (m[i] < max_m) {
+            events.emplace((m[i] + 1) / std::abs(r[i]), i);
+        }
+    }
+
+    float dp = 0;
+    for (size_t i = 0; i < d; i++) {
+        const float a = std::abs(r[i]);
+        // the epsilon compensates the rounding of the critical values
+        const uint32_t mi =
+                std::min(max_m, uint32_t(std::floor(best_t * a * 1.00001f)));
+        dp += a * (mi + 0.5f);
+        // the most significant bit (the 1-bit code) is the sign, the lower
+        //   bits are stored as m for positive values and as max_m - m for
+        //   negative ones, so that the code value is y + (2^nb_bits - 1) / 2
+        set_ex_value(ex_code, i, ex_bits, r[i] > 0 ? mi : max_m - mi);
+    }
+    return dp;
+}
+
+} // namespace
 
 void RaBitQuantizer::train(size_t n, const float* x) {
     // does nothing
@@ -127,6 +258,33 @@ void RaBitQuantizer::compute_codes_core(
         }
 
         fac->dp_multiplier = inv_dp_oO * std::sqrt(norm_L2sqr);
+
+        if (nb_bits > 1) {
+            const size_t ex_bits = nb_bits - 1;
+            uint8_t* ex_code = code + (d + 7) / 8 + sizeof(FactorsData);
+            ExFactorsData* ex_fac = reinterpret_cast<ExFactorsData*>(
+                    ex_code + (ex_bits * d + 7) / 8);
+
+            std::vector<float> or_minus_c(d);
+            for (size_t j = 0; j < d; j++) {
+                or_minus_c[j] = x[i * d + j] -
+                        ((centroid_in == nullptr) ? 0 : centroid_in[j]);
+            }
+            const float dp_ex =
+                    compute_ex_code(or_minus_c.data(), d, ex_bits, ex_code);
+
+            ex_fac->ex_multiplier = (dp_ex == 0) ? 0 : norm_L2sqr / dp_ex;
+
+            // the 1-bit estimate of <(or - c) / ||or - c||, (qr - c)> has
+            //   an error of ||qr - c|| * sqrt((1 - dp_oO^2) / dp_oO^2) /
+            //   sqrt(d - 1), the distance is 2 * ||or - c|| times that
+            const float dp2 = dp_oO * dp_oO;
+            ex_fac->error_bound = (dp2 < std::numeric_limits<float>::epsilon())
+                    ? std::numeric_limits<float>::max()
+                    : 2 * std::sqrt(norm_L2sqr) *
+                            std::sqrt(std::max(0.0f, 1 - dp2) / dp2) /
+                            std::sqrt((float)std::max(d, size_t(2)) - 1);
+        }
     }
 }
 
@@ -153,6 +311,24 @@ void RaBitQuantizer::decode_core(
         const FactorsData* fac =
                 reinterpret_cast<const FactorsData*>(code + (d + 7) / 8);
 
+        if (nb_bits > 1) {
+            // the reconstruction along the multi-bit code values
+            const size_t ex_bits = nb_bits - 1;
+            const uint8_t* ex_code = code + (d + 7) / 8 + sizeof(FactorsData);
+            const ExFactorsData* ex_fac =
+                    reinterpret_cast<const ExFactorsData*>(
+                            ex_code + (ex_bits * d + 7) / 8);
+            const float offset = ((1 << nb_bits) - 1) * 0.5f;
+            for (size_t j = 0; j < d; j++) {
+                const uint32_t bit = (binary_data[j / 8] >> (j % 8)) & 1;
+                const uint32_t u =
+                        (bit << ex_bits) | get_ex_value(ex_code, j, ex_bits);
+                x[i * d + j] = (u - offset) * ex_fac->ex_multiplier +
+                        ((centroid_in == nullptr) ? 0 : centroid_in[j]);
+            }
+            continue;
+        }
+
         //
         for (size_t j = 0; j < d; j++) {
             // extract i-th bit
@@ -166,7 +342,15 @@ void RaBitQuantizer::decode_core(
     }
 }
 
-struct RaBitDistanceComputer : FlatCodesDistanceComputer {
+float RaBitQDistanceComputer::distance_to_code_pruned_with_bit_dot(
+        const uint8_t* code,
+        float bit_dot,
+        float bit_dot_error,
+        float threshold) {
+    FAISS_THROW_MSG("Not implemented for this distance computer");
+}
+
+struct RaBitDistanceComputer : RaBitQDistanceComputer {
     // dimensionality
     size_t d = 0;
     // a centroid to use
@@ -175,9 +359,92 @@ struct RaBitDistanceComputer : FlatCodesDistanceComputer {
     // the metric
     MetricType metric_type = MetricType::METRIC_L2;
 
+    // nb of bits per dimension of the codes
+    size_t nb_bits = 1;
+
+    // some additional numbers for the query
+    QueryFactorsData query_fac;
+
+    // kErrorBoundEpsilon * ||qr - c||, in the units of the output distance
+    float error_scale = 0;
+
     RaBitDistanceComputer();
 
     float symmetric_dis(idx_t i, idx_t j) override;
+
+    float distance_to_code(const uint8_t* code) final {
+        return distance_to_code_pruned(
+                code,
+                metric_type == MetricType::METRIC_L2
+                        ? std::numeric_limits<float>::max()
+                        : std::numeric_limits<float>::lowest());
+    }
+
+    // to be called at the end of set_query
+    void set_error_scale() {
+        error_scale = kErrorBoundEpsilon * std::sqrt(query_fac.qr_to_c_L2sqr);
+        if (metric_type == MetricType::METRIC_INNER_PRODUCT) {
+            error_scale *= 0.5f;
+        }
+    }
+
+    // pre_dist = ||or - c||^2 + ||qr - c||^2 -
+    //     2 * ||or - c|| * ||qr - c|| * <q,o> - (IP ? ||or||^2 : 0)
+    float pre_dist_to_distance(float pre_dist) const {
+        if (metric_type == MetricType::METRIC_L2) {
+            // ||or - q||^ 2
+            return pre_dist;
+        } else {
+            // metric == MetricType::METRIC_INNER_PRODUCT
+
+            // this is ||q||^2
+            const float query_norm_sqr = query_fac.qr_norm_L2sqr;
+
+            // 2 * (or, q) = (||or - q||^2 - ||q||^2 - ||or||^2)
+            return -0.5f * (pre_dist - query_norm_sqr);
+        }
+    }
+
+    // the 1-bit estimate, from the normalized dot product final_dot
+    float distance_1bit(const uint8_t* code, float final_dot) const {
+        const FactorsData* fac =
+                reinterpret_cast<const FactorsData*>(code + (d + 7) / 8);
+        // this is ||or - c||^2 - (IP ? ||or||^2 : 0)
+        const float or_c_l2sqr = fac->or_minus_c_l2sqr;
+        return pre_dist_to_distance(
+                or_c_l2sqr + query_fac.qr_to_c_L2sqr -
+                2 * fac->dp_multiplier * final_dot);
+    }
+
+    // the multi-bit estimate, from the dot product between the multi-bit
+    //   code values y and (qr - c)
+    float distance_ex(const uint8_t* code, float y_dot) const {
+        const FactorsData* fac =
+                reinterpret_cast<const FactorsData*>(code + (d + 7) / 8);
+        return pre_dist_to_distance(
+                fac->or_minus_c_l2sqr + query_fac.qr_to_c_L2sqr -
+                2 * get_ex_factors(code)->ex_multiplier * y_dot);
+    }
+
+    const ExFactorsData* get_ex_factors(const uint8_t* code) const {
+        return reinterpret_cast<const ExFactorsData*>(
+                get_ex_code(code) + ((nb_bits - 1) * d + 7) / 8);
+    }
+
+    const uint8_t* get_ex_code(const uint8_t* code) const {
+        return code + (d + 7) / 8 + sizeof(FactorsData);
+    }
+
+    // whether a distance estimate with this error cannot beat threshold
+    bool is_pruned(float dis, float error, float threshold) const {
+        return metric_type == MetricType::METRIC_L2 ? dis - error > threshold
+                                                    : dis + error < threshold;
+    }
+
+    // error bound of the 1-bit estimate
+    float error_1bit(const uint8_t* code) const {
+        return get_ex_factors(code)->error_bound * error_scale;
+    }
 };
 
 RaBitDistanceComputer::RaBitDistanceComputer() = default;
@@ -189,19 +456,28 @@ float RaBitDistanceComputer::symmetric_dis(idx_t i, idx_t j) {
 struct RaBitDistanceComputerNotQ : RaBitDistanceComputer {
     // the rotated query (qr - c)
     std::vector<float> rotated_q;
-    // some additional numbers for the query
-    QueryFactorsData query_fac;
+    // sum of the components of (qr - c)
+    float sum_rotated_q = 0;
 
     RaBitDistanceComputerNotQ();
 
-    float distance_to_code(const uint8_t* code) override;
+    float distance_to_code_pruned(const uint8_t* code, float threshold)
+            override;
+
+    float distance_to_code_pruned_with_bit_dot(
+            const uint8_t* code,
+            float bit_dot,
+            float bit_dot_error,
+            float threshold) override;
 
     void set_query(const float* x) override;
 };
 
 RaBitDistanceComputerNotQ::RaBitDistanceComputerNotQ() = default;
 
-float RaBitDistanceComputerNotQ::distance_to_code(const uint8_t* code) {
+float RaBitDistanceComputerNotQ::distance_to_code_pruned(
+        const uint8_t* code,
+        float threshold) {
     FAISS_ASSERT(code != nullptr);
     FAISS_ASSERT(
             (metric_type == MetricType::METRIC_L2 ||
@@ -209,8 +485,6 @@ float RaBitDistanceComputerNotQ::distance_to_code(const uint8_t* code) {
 
     // split the code into parts
     const uint8_t* binary_data = code;
-    const FactorsData* fac =
-            reinterpret_cast<const FactorsData*>(code + (d + 7) / 8);
 
     // this is the baseline code
     //
@@ -238,26 +512,44 @@ float RaBitDistanceComputerNotQ::distance_to_code(const uint8_t* code) {
     // normalizer coefficients
     final_dot -= query_fac.c34;
 
-    // this is ||or - c||^2 - (IP ? ||or||^2 : 0)
-    const float or_c_l2sqr = fac->or_minus_c_l2sqr;
-
-    // pre_dist = ||or - c||^2 + ||qr - c||^2 -
-    //     2 * ||or - c|| * ||qr - c|| * <q,o> - (IP ? ||or||^2 : 0)
-    const float pre_dist = or_c_l2sqr + query_fac.qr_to_c_L2sqr -
-            2 * fac->dp_multiplier * final_dot;
+    const float dis_1bit = distance_1bit(code, final_dot);
+    if (nb_bits == 1 || is_pruned(dis_1bit, error_1bit(code), threshold)) {
+        return dis_1bit;
+    }
 
-    if (metric_type == MetricType::METRIC_L2) {
-        // ||or - q||^ 2
-        return pre_dist;
-    } else {
-        // metric == MetricType::METRIC_INNER_PRODUCT
+    // <y, qr - c>, with y = (bit << ex_bits) + ex - (2^nb_bits - 1) / 2
+    const size_t ex_bits = nb_bits - 1;
+    const uint8_t* ex_code = get_ex_code(code);
+    float dot_ex = 0;
+    for (size_t i = 0; i < d; i++) {
+        dot_ex += get_ex_value(ex_code, i, ex_bits) * rotated_q[i];
+    }
+    const float y_dot = dot_qo * (1 << ex_bits) + dot_ex -
+            ((1 << nb_bits) - 1) * 0.5f * sum_rotated_q;
+    return distance_ex(code, y_dot);
+}
 
-        // this is ||q||^2
-        const float query_norm_sqr = query_fac.qr_norm_L2sqr;
+float RaBitDistanceComputerNotQ::distance_to_code_pruned_with_bit_dot(
+        const uint8_t* code,
+        float bit_dot,
+        float bit_dot_error,
+        float threshold) {
+    // query_fac.c2 == 0 for a non-quantized query
+    const float final_dot = query_fac.c1 * bit_dot - query_fac.c34;
+    const float dis_1bit = distance_1bit(code, final_dot);
 
-        // 2 * (or, q) = (||or - q||^2 - ||q||^2 - ||or||^2)
-        return -0.5f * (pre_dist - query_norm_sqr);
+    const FactorsData* fac =
+            reinterpret_cast<const FactorsData*>(code + (d + 7) / 8);
+    float error = 2 * std::abs(fac->dp_multiplier) * query_fac.c1 *
+            bit_dot_error *
+            (metric_type == MetricType::METRIC_L2 ? 1.0f : 0.5f);
+    if (nb_bits > 1) {
+        error += error_1bit(code);
+    }
+    if (is_pruned(dis_1bit, error, threshold)) {
+        return dis_1bit;
     }
+    return distance_to_code(code);
 }
 
 void RaBitDistanceComputerNotQ::set_query(const float* x) {
@@ -287,6 +579,7 @@ void RaBitDistanceComputerNotQ::set_query(const float* x) {
     for (size_t i = 0; i < d; i++) {
         sum_q += rotated_q[i];
     }
+    sum_rotated_q = sum_q;
 
     query_fac.c1 = 2 * inv_d;
     query_fac.c2 = 0;
@@ -296,6 +589,8 @@ void RaBitDistanceComputerNotQ::set_query(const float* x) {
         // precompute if needed
         query_fac.qr_norm_L2sqr = fvec_norm_L2sqr(x, d);
     }
+
+    set_error_scale();
 }
 
 //
@@ -305,24 +600,30 @@ struct RaBitDistanceComputerQ : RaBitDistanceComputer {
     // we're using the proposed relayout-ed scheme from 3.3 that allows
     //    using popcounts for computing the distance.
     std::vector<uint8_t> rearranged_rotated_qq;
-    // some additional numbers for the query
-    QueryFactorsData query_fac;
 
     // the number of bits for SQ quantization of the query (qb > 0)
     uint8_t qb = 8;
     // the smallest value divisible by 8 that is not smaller than dim
     size_t popcount_aligned_dim = 0;
 
+    // (qr - c)[i] ~= v_min + delta * rotated_qq[i]
+    float v_min = 0;
+    float delta = 0;
+    size_t sum_qq = 0;
+
     RaBitDistanceComputerQ();
 
-    float distance_to_code(const uint8_t* code) override;
+    float distance_to_code_pruned(const uint8_t* code, float threshold)
+            override;
 
     void set_query(const float* x) override;
 };
 
 RaBitDistanceComputerQ::RaBitDistanceComputerQ() = default;
 
-float RaBitDistanceComputerQ::distance_to_code(const uint8_t* code) {
+float RaBitDistanceComputerQ::distance_to_code_pruned(
+        const uint8_t* code,
+        float threshold) {
     FAISS_ASSERT(code != nullptr);
     FAISS_ASSERT(
             (metric_type == MetricType::METRIC_L2 ||
@@ -330,8 +631,6 @@ float RaBitDistanceComputerQ::distance_to_code(const uint8_t* code) {
 
     // split the code into parts
     const uint8_t* binary_data = code;
-    const FactorsData* fac =
-            reinterpret_cast<const FactorsData*>(code + (d + 7) / 8);
 
     // // this is the baseline code
     // //
@@ -398,26 +697,28 @@ float RaBitDistanceComputerQ::distance_to_code(const uint8_t* code) {
     // normalizer coefficients
     final_dot -= query_fac.c34;
 
-    // this is ||or - c||^2 - (IP ? ||or||^2 : 0)
-    const float or_c_l2sqr = fac->or_minus_c_l2sqr;
-
-    // pre_dist = ||or - c||^2 + ||qr - c||^2 -
-    //     2 * ||or - c|| * ||qr - c|| * <q,o> - (IP ? ||or||^2 : 0)
-    const float pre_dist = or_c_l2sqr + query_fac.qr_to_c_L2sqr -
-            2 * fac->dp_multiplier * final_dot;
-
-    if (metric_type == MetricType::METRIC_L2) {
-        // ||or - q||^ 2
-        return pre_dist;
-    } else {
-        // metric == MetricType::METRIC_INNER_PRODUCT
-
-        // this is ||q||^2
-        const float query_norm_sqr = query_fac.qr_norm_L2sqr;
+    const float dis_1bit = distance_1bit(code, final_dot);
+    if (nb_bits == 1 || is_pruned(dis_1bit, error_1bit(code), threshold)) {
+        return dis_1bit;
+    }
 
-        // 2 * (or, q) = (||or - q||^2 - ||q||^2 - ||or||^2)
-        return -0.5f * (pre_dist - query_norm_sqr);
+    // <y, qr - c>, with y = (bit << ex_bits) + ex - (2^nb_bits - 1) / 2,
+    //   computed with integers on the quantized query
+    const size_t ex_bits = nb_bits - 1;
+    const uint8_t* ex_code = get_ex_code(code);
+    uint64_t dot_ex = 0;
+    uint64_t sum_ex = 0;
+    for (size_t i = 0; i < d; i++) {
+        const uint32_t ex = get_ex_value(ex_code, i, ex_bits);
+        dot_ex += ex * rotated_qq[i];
+        sum_ex += ex;
     }
+    // sum_i u[i] * qq[i] and sum_i u[i], u = (bit << ex_bits) + ex
+    const float dot_u = (dot_qo << ex_bits) + dot_ex;
+    const float sum_u = (sum_q << ex_bits) + sum_ex;
+    const float y_dot = delta * dot_u + v_min * sum_u -
+            ((1 << nb_bits) - 1) * 0.5f * (delta * sum_qq + d * v_min);
+    return distance_ex(code, y_dot);
 }
 
 void RaBitDistanceComputerQ::set_query(const float* x) {
@@ -446,7 +747,7 @@ void RaBitDistanceComputerQ::set_query(const float* x) {
     const float inv_d = (d == 0) ? 1.0f : (1.0f / std::sqrt((float)d));
 
     // quantize the query. compute min and max
-    float v_min = std::numeric_limits<float>::max();
+    v_min = std::numeric_limits<float>::max();
     float v_max = std::numeric_limits<float>::lowest();
     for (size_t i = 0; i < d; i++) {
         const float v_q = rotated_q[i];
@@ -456,10 +757,10 @@ void RaBitDistanceComputerQ::set_query(const float* x) {
 
     const float pow_2_qb = 1 << qb;
 
-    const float delta = (v_max - v_min) / (pow_2_qb - 1);
+    delta = (v_max - v_min) / (pow_2_qb - 1);
     const float inv_delta = 1.0f / delta;
 
-    size_t sum_qq = 0;
+    sum_qq = 0;
     for (int32_t i = 0; i < d; i++) {
         const float v_q = rotated_q[i];
 
@@ -493,9 +794,11 @@ void RaBitDistanceComputerQ::set_query(const float* x) {
         // precompute if needed
         query_fac.qr_norm_L2sqr = fvec_norm_L2sqr(x, d);
     }
+
+    set_error_scale();
 }
 
-FlatCodesDistanceComputer* RaBitQuantizer::get_distance_computer(
+RaBitQDistanceComputer* RaBitQuantizer::get_distance_computer(
         uint8_t qb,
         const float* centroid_in) const {
     if (qb == 0) {
@@ -503,6 +806,7 @@ FlatCodesDistanceComputer* RaBitQuantizer::get_distance_computer(
         dc->metric_type = metric_type;
         dc->d = d;
         dc->centroid = centroid_in;
+        dc->nb_bits = nb_bits;
 
         return dc.release();
     } else {
@@ -510,6 +814,7 @@ FlatCodesDistanceComputer* RaBitQuantizer::get_distance_computer(
         dc->metric_type = metric_type;
         dc->d = d;
         dc->centroid = centroid_in;
+        dc->nb_bits = nb_bits;
         dc->qb = qb;
 
         return dc.release();
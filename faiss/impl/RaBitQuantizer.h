@@ -21,6 +21,18 @@ namespace faiss {
 //   with a Theoretical Error Bound for Approximate Nearest Neighbor Search".
 //
 // It is assumed that the Random Matrix Rotation is performed externally.
+//
+// With nb_bits > 1, this is the extended RaBitQ of
+//   Jianyang Gao, Yutong Gou, Yuexuan Xu, Yongyi Yang, Cheng Long,
+//   Raymond Chi-Wing Wong, "Practical and Asymptotically Optimal
+//   Quantization of High-Dimensional Vectors in Euclidean Space for
+//   Approximate Nearest Neighbor Search".
+// The 1-bit code is stored first, as for nb_bits = 1, and is followed by
+//   the (nb_bits - 1) lower bits of each dimension and their factors. The
+//   1-bit code gives a first estimate of the distance with an error bound,
+//   the other bits are used only for the vectors that may be in the results.
+struct RaBitQDistanceComputer;
+
 struct RaBitQuantizer : Quantizer {
     // all RaBitQ operations are provided against a centroid, which needs
     //   to be provided Externally (!). Nullptr value implies that the centroid
@@ -37,11 +49,24 @@ struct RaBitQuantizer : Quantizer {
     //   possible. Thus, a quantizer has to introduce a metric.
     MetricType metric_type = MetricType::METRIC_L2;
 
-    RaBitQuantizer(size_t d = 0, MetricType metric = MetricType::METRIC_L2);
+    // nb of bits per dimension, 1 to 8
+    size_t nb_bits = 1;
+
+    RaBitQuantizer(
+            size_t d = 0,
+            MetricType metric = MetricType::METRIC_L2,
+            size_t nb_bits = 1);
+
+    // code size for a given dimension and nb of bits
+    static size_t get_code_size(size_t d, size_t nb_bits);
+
+    // the nb of bits of codes of size code_size, or 0 if there is none
+    static size_t get_nb_bits(size_t d, size_t code_size);
 
     void train(size_t n, const float* x) override;
 
-    // every vector is expected to take (d + 7) / 8 + sizeof(FactorsData) bytes,
+    // every vector is expected to take (d + 7) / 8 + sizeof(FactorsData)
+    //   bytes for nb_bits = 1, see get_code_size
     void compute_codes(const float* x, uint8_t* codes, size_t n) const override;
 
     void compute_codes_core(
@@ -70,9 +95,32 @@ struct RaBitQuantizer : Quantizer {
     // returns the distance computer.
     // specify qb = 0 to get an DC that does not quantize a query
     // specify qb > 0 to have SQ qb-bits query
-    FlatCodesDistanceComputer* get_distance_computer(
+    RaBitQDistanceComputer* get_distance_computer(
             uint8_t qb,
             const float* centroid_in = nullptr) const;
 };
 
+// Distance computer to RaBitQ codes. distance_to_code returns the most
+//   accurate estimate the code allows.
+struct RaBitQDistanceComputer : FlatCodesDistanceComputer {
+    // The estimate of the distance to a code, computed from all the bits of
+    //   the code only if its 1-bit estimate may be better than threshold
+    //   (smaller for L2, larger for IP). Otherwise, the 1-bit estimate is
+    //   returned, which is then worse than threshold with high probability.
+    virtual float distance_to_code_pruned(
+            const uint8_t* code,
+            float threshold) = 0;
+
+    // Same, with the dot product between the query and the 1-bit code
+    //   (sum of the query components for which the bit is set) computed by
+    //   the caller, eg. with the fast-scan kernels, with an error of at most
+    //   bit_dot_error. Here the codes are refined for nb_bits = 1 as well.
+    //   Only for unquantized queries (qb = 0).
+    virtual float distance_to_code_pruned_with_bit_dot(
+            const uint8_t* code,
+            float bit_dot,
+            float bit_dot_error,
+            float threshold);
+};
+
 } // namespace faiss
@@ -18,7 +18,13 @@
 #include <faiss/utils/partitioning.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 namespace faiss {
 
@@ -67,6 +73,37 @@ struct BlockResultHandler {
     }
 };
 
+/** calls f(dis[j], id) for the results of a block that are better than
+ * threshold, with id = ids[j], or id0 + j if ids is nullptr. The block is
+ * filtered by chunks with compare_and_compact, so f typically is called on
+ * a small fraction of the results. f may update threshold, it is re-read
+ * for each chunk. */
+template <class C, class F>
+inline void for_each_better_result(
+        size_t n,
+        const typename C::T* dis,
+        const typename C::TI* ids,
+        typename C::TI id0,
+        const typename C::T& threshold,
+        F f) {
+    constexpr size_t bs = 64;
+    typename C::T bdis[bs];
+    typename C::TI bids[bs];
+    for (size_t j0 = 0; j0 < n; j0 += bs) {
+        size_t nres = compare_and_compact<C>(
+                std::min(bs, n - j0),
+                dis + j0,
+                ids ? ids + j0 : nullptr,
+                id0 + j0,
+                threshold,
+                bdis,
+                bids);
+        for (size_t j = 0; j < nres; j++) {
+            f(bdis[j], bids[j]);
+        }
+    }
+}
+
 // handler for a single query
 template <class C>
 struct ResultHandler {
@@ -76,6 +113,21 @@ struct ResultHandler {
     // return whether threshold was updated
     virtual bool add_result(typename C::T dis, typename C::TI idx) = 0;
 
+    /// add n results with ids ids[j], or id0 + j if ids is nullptr. Only
+    /// the results better than the threshold are passed to add_result
+    virtual void add_results(
+            size_t n,
+            const typename C::T* dis,
+            const typename C::TI* ids,
+            typename C::TI id0 = 0) {
+        for_each_better_result<C>(
+                n, dis, ids, id0, threshold, [&](auto d, auto id) {
+                    if (C::cmp(threshold, d)) {
+                        add_result(d, id);
+                    }
+                });
+    }
+
     virtual ~ResultHandler() {}
 };
 
@@ -132,6 +184,17 @@ struct Top1BlockResultHandler : BlockResultHandler<C, use_sel> {
             return false;
         }
 
+        void add_results(size_t n, const T* dis, const TI* ids, TI id0 = 0)
+                final {
+            for_each_better_result<C>(
+                    n, dis, ids, id0, threshold, [&](T d, TI id) {
+                        if (C::cmp(threshold, d)) {
+                            threshold = d;
+                            min_idx = id;
+                        }
+                    });
+        }
+
         /// series of results for query i is done
         void end() {
             hr.dis_tab[current_idx] = threshold;
@@ -157,14 +220,18 @@ struct Top1BlockResultHandler : BlockResultHandler<C, use_sel> {
             auto& min_distance = this->dis_tab[i];
             auto& min_index = this->ids_tab[i];
 
-            for (size_t j = j0; j < j1; j++) {
-                const T distance = dis_tab_i[j];
-
-                if (C::cmp(min_distance, distance)) {
-                    min_distance = distance;
-                    min_index = j;
-                }
-            }
+            for_each_better_result<C>(
+                    j1 - j0,
+                    dis_tab_i + j0,
+                    nullptr,
+                    j0,
+                    min_distance,
+                    [&](T distance, TI j) {
+                        if (C::cmp(min_distance, distance)) {
+                            min_distance = distance;
+                            min_index = j;
+                        }
+                    });
         }
     }
 
@@ -240,6 +307,20 @@ struct HeapBlockResultHandler : BlockResultHandler<C, use_sel> {
             return false;
         }
 
+        void add_results(size_t n, const T* dis, const TI* ids, TI id0 = 0)
+                final {
+            HeapBuffer<C> heap(k, heap_dis, heap_ids);
+            for_each_better_result<C>(
+                    n, dis, ids, id0, threshold, [&](T d, TI id) {
+                        if (C::cmp(threshold, d)) {
+                            heap.push(d, id);
+                            threshold = heap.threshold;
+                        }
+                    });
+            heap.flush();
+            threshold = heap.threshold;
+        }
+
         /// series of results for query i is done
         void end() {
             heap_reorder<C>(k, heap_dis, heap_ids);
@@ -265,15 +346,17 @@ struct HeapBlockResultHandler : BlockResultHandler<C, use_sel> {
         for (int64_t i = i0; i < i1; i++) {
             T* heap_dis = heap_dis_tab + i * k;
             TI* heap_ids = heap_ids_tab + i * k;
-            const T* dis_tab_i = dis_tab + (j1 - j0) * (i - i0) - j0;
-            T thresh = heap_dis[0];
-            for (size_t j = j0; j < j1; j++) {
-                T dis = dis_tab_i[j];
-                if (C::cmp(thresh, dis)) {
-                    heap_replace_top<C>(k, heap_dis, heap_ids, dis, j);
-                    thresh = heap_dis[0];
-                }
-            }
+            const T* dis_tab_i = dis_tab + (j1 - j0) * (i - i0);
+            HeapBuffer<C> heap(k, heap_dis, heap_ids);
+            T thresh = heap.threshold;
+            for_each_better_result<C>(
+                    j1 - j0, dis_tab_i, nullptr, j0, thresh, [&](T dis, TI j) {
+                        if (C::cmp(thresh, dis)) {
+                            heap.push(dis, j);
+                            thresh = heap.threshold;
+                        }
+                    });
+            heap.flush();
         }
     }
 
@@ -286,6 +369,121 @@ struct HeapBlockResultHandler : BlockResultHandler<C, use_sel> {
     }
 };
 
+/*****************************************************************
+ * Grouped heap result handler
+ *
+ * Keeps the k best groups (eg. the documents of the stored chunks), each
+ * with the distance of its best member, so that a group appears at most
+ * once in the results. group_ids maps the database ids to their group.
+ * The threshold is the distance of the k-th group: the members of groups
+ * that are already in the result do not lower it.
+ *****************************************************************/
+
+template <class C>
+struct GroupedHeapBlockResultHandler : BlockResultHandler<C> {
+    using T = typename C::T;
+    using TI = typename C::TI;
+
+    T* dis_tab;
+    TI* group_tab;
+    TI* best_ids_tab; ///< best member of each group, can be null
+    int64_t k;
+    const TI* group_ids;
+
+    GroupedHeapBlockResultHandler(
+            size_t nq,
+            T* dis_tab,
+            TI* group_tab,
+            TI* best_ids_tab,
+            size_t k,
+            const TI* group_ids)
+            : BlockResultHandler<C>(nq),
+              dis_tab(dis_tab),
+              group_tab(group_tab),
+              best_ids_tab(best_ids_tab),
+              k(k),
+              group_ids(group_ids) {}
+
+    struct SingleResultHandler : ResultHandler<C> {
+        GroupedHeapBlockResultHandler& hr;
+        using ResultHandler<C>::threshold;
+        size_t k;
+        size_t q = 0;
+
+        // unordered slots, the empty ones have a neutral distance
+        std::vector<T> dis;
+        std::vector<TI> groups;
+        std::vector<TI> best_ids;
+
+        explicit SingleResultHandler(GroupedHeapBlockResultHandler& hr)
+                : hr(hr), k(hr.k), dis(hr.k), groups(hr.k), best_ids(hr.k) {}
+
+        /// begin results for query # i
+        void begin(size_t i) {
+            q = i;
+            std::fill(dis.begin(), dis.end(), C::neutral());
+            std::fill(groups.begin(), groups.end(), TI(-1));
+            std::fill(best_ids.begin(), best_ids.end(), TI(-1));
+            threshold = C::neutral();
+        }
+
+        size_t worst_slot() const {
+            size_t w = 0;
+            for (size_t j = 1; j < k; j++) {
+                if (C::cmp(dis[j], dis[w])) {
+                    w = j;
+                }
+            }
+            return w;
+        }
+
+        /// add one result for query i
+        bool add_result(T d, TI idx) final {
+            TI g = hr.group_ids[idx];
+            size_t slot = std::find(groups.begin(), groups.end(), g) -
+                    groups.begin();
+            if (slot < k) {
+                if (!C::cmp(dis[slot], d)) {
+                    return false;
+                }
+            } else {
+                if (!C::cmp(threshold, d)) {
+                    return false;
+                }
+                slot = worst_slot();
+                groups[slot] = g;
+            }
+            dis[slot] = d;
+            best_ids[slot] = idx;
+            T new_threshold = dis[worst_slot()];
+            bool updated = new_threshold != threshold;
+            threshold = new_threshold;
+            return updated;
+        }
+
+        /// series of results for query i is done
+        void end() {
+            std::vector<size_t> order(k);
+            for (size_t j = 0; j < k; j++) {
+                order[j] = j;
+            }
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                return C::cmp(dis[b], dis[a]) ||
+                        (dis[a] == dis[b] &&
+                         uint64_t(groups[a]) < uint64_t(groups[b]));
+            });
+            for (size_t j = 0; j < k; j++) {
+                size_t o = q * k + j;
+                hr.dis_tab[o] = dis[order[j]];
+                hr.group_tab[o] = groups[order[j]];
+                if (hr.best_ids_tab) {
+                    hr.best_ids_tab[o] = best_ids[order[j]];
+                }
+            }
+        }
+    };
+};
+
 /*****************************************************************
  * Reservoir result handler
  *
@@ -335,6 +533,30 @@ struct ReservoirTopN : ResultHandler<C> {
         add_result(val, id);
     }
 
+    /// add n results with ids ids_in[j], or id0 + j if ids_in is nullptr
+    void add_results(
+            size_t n_in,
+            const T* vals_in,
+            const TI* ids_in,
+            TI id0 = 0) final {
+        for (size_t j = 0; j < n_in;) {
+            if (i == capacity) {
+                shrink_fuzzy();
+            }
+            // the compacted results fit in the remaining storage
+            size_t nj = std::min(n_in - j, capacity - i);
+            i += compare_and_compact<C>(
+                    nj,
+                    vals_in + j,
+                    ids_in ? ids_in + j : nullptr,
+                    id0 + j,
+                    threshold,
+                    vals + i,
+                    ids + i);
+            j += nj;
+        }
+    }
+
     // reduce storage from capacity to anything
     // between n and (capacity + n) / 2
     void shrink_fuzzy() {
@@ -349,20 +571,28 @@ struct ReservoirTopN : ResultHandler<C> {
         i = n;
     }
 
-    void to_result(T* heap_dis, TI* heap_ids) const {
-        for (int j = 0; j < std::min(i, n); j++) {
-            heap_push<C>(j + 1, heap_dis, heap_ids, vals[j], ids[j]);
+    /** sorted results (n of them, padded with empty results). The equal
+     * values are ordered by increasing id, so that the output does not
+     * depend on the order in which the results were added. The reservoir
+     * is shrunk to n elements. */
+    void to_result(T* res_dis, TI* res_ids) {
+        if (i > n) {
+            shrink();
         }
-
-        if (i < n) {
-            heap_reorder<C>(i, heap_dis, heap_ids);
-            // add empty results
-            heap_heapify<C>(n - i, heap_dis + i, heap_ids + i);
-        } else {
-            // add remaining elements
-            heap_addn<C>(n, heap_dis, heap_ids, vals + n, ids + n, i - n);
-            heap_reorder<C>(n, heap_dis, heap_ids);
+        std::vector<std::pair<T, TI>> perm(i);
+        for (size_t j = 0; j < i; j++) {
+            perm[j] = {vals[j], ids[j]};
         }
+        std::sort(perm.begin(), perm.end(), [](const auto& a, const auto& b) {
+            return C::cmp(b.first, a.first) ||
+                    (a.first == b.first && a.second < b.second);
+        });
+        for (size_t j = 0; j < i; j++) {
+            res_dis[j] = perm[j].first;
+            res_ids[j] = perm[j].second;
+        }
+        // add empty results
+        heap_heapify<C>(n - i, res_dis + i, res_ids + i);
     }
 };
 
@@ -458,18 +688,15 @@ struct ReservoirBlockResultHandler : BlockResultHandler<C, use_sel> {
 #pragma omp parallel for
         for (int64_t i = i0; i < i1; i++) {
             ReservoirTopN<C>& reservoir = reservoirs[i - i0];
-            const T* dis_tab_i = dis_tab + (j1 - j0) * (i - i0) - j0;
-            for (size_t j = j0; j < j1; j++) {
-                T dis = dis_tab_i[j];
-                reservoir.add_result(dis, j);
-            }
+            const T* dis_tab_i = dis_tab + (j1 - j0) * (i - i0);
+            reservoir.add_results(j1 - j0, dis_tab_i, nullptr, j0);
         }
     }
 
     /// series of results for queries i0..i1 is done
     void end_multiple() final {
-        // maybe parallel for
-        for (size_t i = i0; i < i1; i++) {
+#pragma omp parallel for if (i1 - i0 > 1)
+        for (int64_t i = i0; i < i1; i++) {
             reservoirs[i - i0].to_result(
                     heap_dis_tab + i * k, heap_ids_tab + i * k);
         }
@@ -527,6 +754,14 @@ struct RangeSearchBlockResultHandler : BlockResultHandler<C, use_sel> {
             return false;
         }
 
+        void add_results(size_t n, const T* dis, const TI* ids, TI id0 = 0)
+                final {
+            for_each_better_result<C>(
+                    n, dis, ids, id0, threshold, [&](T d, TI id) {
+                        qr->add(d, id);
+                    });
+        }
+
         /// series of results for query i is done
         void end() {}
 
@@ -584,12 +819,10 @@ struct RangeSearchBlockResultHandler : BlockResultHandler<C, use_sel> {
             const float* ip_line = dis_tab + (i - i0) * (j1 - j0);
             RangeQueryResult& qres = pres->new_result(i);
 
-            for (size_t j = j0; j < j1; j++) {
-                float dis = *ip_line++;
-                if (C::cmp(radius, dis)) {
-                    qres.add(dis, j);
-                }
-            }
+            for_each_better_result<C>(
+                    j1 - j0, ip_line, nullptr, j0, radius, [&](T dis, TI j) {
+                        qres.add(dis, j);
+                    });
         }
     }
 
@@ -607,6 +840,89 @@ struct RangeSearchBlockResultHandler : BlockResultHandler<C, use_sel> {
     }
 };
 
+/*****************************************************************
+ * Result thresholds shared between searches
+ *****************************************************************/
+
+/** Per-query thresholds shared by several searches of the same queries
+ * (eg. the shards of an IndexShards, or the threads that scan the lists of
+ * one query). Once a search has k results for a query, it publishes its
+ * k-th distance: the k-th distance of the merged results is at least as
+ * good, so the other searches can drop the candidates that do not beat it.
+ *
+ * The queries are identified by their address in the query matrix x, so
+ * that the searches of slices of x find their thresholds. The dropped
+ * results are replaced by (threshold, -1) placeholders in the heaps, that
+ * remove_placeholders() turns into empty results. */
+struct SharedThresholds {
+    const float* x; ///< the queries, size n * d
+    idx_t n;
+    size_t d;
+    bool is_similarity;
+    std::unique_ptr<std::atomic<float>[]> thresholds;
+
+    SharedThresholds(const float* x, idx_t n, size_t d, bool is_similarity)
+            : x(x), n(n), d(d), is_similarity(is_similarity),
+              thresholds(new std::atomic<float>[n]) {
+        float init = is_similarity ? std::numeric_limits<float>::lowest()
+                                   : std::numeric_limits<float>::max();
+        for (idx_t i = 0; i < n; i++) {
+            thresholds[i].store(init, std::memory_order_relaxed);
+        }
+    }
+
+    /// number of the query vector xq, -1 if it is not in x
+    idx_t query_no(const float* xq) const {
+        if (xq < x || xq >= x + n * d || (xq - x) % d != 0) {
+            return -1;
+        }
+        return (xq - x) / d;
+    }
+
+    float get(idx_t q) const {
+        return thresholds[q].load(std::memory_order_relaxed);
+    }
+
+    /// keep the best of the current threshold of q and t
+    void update(idx_t q, float t) {
+        std::atomic<float>& a = thresholds[q];
+        float cur = a.load(std::memory_order_relaxed);
+        while ((is_similarity ? t > cur : t < cur) &&
+               !a.compare_exchange_weak(cur, t, std::memory_order_relaxed)) {
+        }
+    }
+
+    /** publish the k-th distance of the result heap of query q, then drop
+     * the results of the heap that do not beat the shared threshold */
+    template <class C>
+    void exchange(idx_t q, size_t k, float* simi, idx_t* idxi) {
+        if (idxi[0] >= 0) {
+            update(q, simi[0]);
+        }
+        float t = get(q);
+        for (size_t j = 0; j < k && C::cmp(simi[0], t); j++) {
+            heap_replace_top<C>(k, simi, idxi, t, -1);
+        }
+    }
+
+    /// turn the placeholders of sorted results into empty results at the end
+    template <class C>
+    static void remove_placeholders(size_t k, float* simi, idx_t* idxi) {
+        size_t j = 0;
+        for (size_t i = 0; i < k; i++) {
+            if (idxi[i] >= 0) {
+                simi[j] = simi[i];
+                idxi[j] = idxi[i];
+                j++;
+            }
+        }
+        for (; j < k; j++) {
+            simi[j] = C::neutral();
+            idxi[j] = -1;
+        }
+    }
+};
+
 /*****************************************************************
  * Dispatcher function to choose the right knn result handler depending on k
  *****************************************************************/
@@ -23,12 +23,15 @@
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/kmeans1d.h>
 #include <faiss/utils/bf16.h>
 #include <faiss/utils/fp16.h>
 #include <faiss/utils/utils.h>
 
 namespace faiss {
 
+bool sq_fixed_dim_distance_computers = true;
+
 /*******************************************************************
  * ScalarQuantizer implementation
  *
@@ -919,6 +922,60 @@ struct Quantizer8bitDirectSigned<8> : Quantizer8bitDirectSigned<1> {
 
 #endif
 
+/*******************************************************************
+ * Codebook quantizers (QT_4bit_nonuniform, QT_8bit_nonuniform): a
+ * component is encoded as the index of the nearest value in the sorted
+ * codebook of its dimension. The same for all SIMD widths.
+ */
+
+template <int NBITS>
+struct QuantizerCodebook : ScalarQuantizer::SQuantizer {
+    static constexpr int ksub = 1 << NBITS;
+    const size_t d;
+    const float* codebooks; ///< size d * ksub
+
+    QuantizerCodebook(size_t d, const std::vector<float>& trained)
+            : d(d), codebooks(trained.data()) {
+        FAISS_THROW_IF_NOT_MSG(
+                trained.size() == d * ksub,
+                "the codebooks of the scalar quantizer are not trained");
+    }
+
+    static FAISS_ALWAYS_INLINE int get_index(const uint8_t* code, size_t i) {
+        if (NBITS == 4) {
+            return (code[i / 2] >> ((i & 1) << 2)) & 0xf;
+        }
+        return code[i];
+    }
+
+    FAISS_ALWAYS_INLINE float reconstruct_component(
+            const uint8_t* code,
+            size_t i) const {
+        return codebooks[i * ksub + get_index(code, i)];
+    }
+
+    void encode_vector(const float* x, uint8_t* code) const final {
+        for (size_t i = 0; i < d; i++) {
+            const float* cb = codebooks + i * ksub;
+            int c = std::lower_bound(cb, cb + ksub, x[i]) - cb;
+            if (c == ksub || (c > 0 && x[i] - cb[c - 1] <= cb[c] - x[i])) {
+                c--;
+            }
+            if (NBITS == 4) {
+                code[i / 2] |= c << ((i & 1) << 2);
+            } else {
+                code[i] = c;
+            }
+        }
+    }
+
+    void decode_vector(const uint8_t* code, float* x) const final {
+        for (size_t i = 0; i < d; i++) {
+            x[i] = reconstruct_component(code, i);
+        }
+    }
+};
+
 template <int SIMDWIDTH>
 ScalarQuantizer::SQuantizer* select_quantizer_1(
         QuantizerType qtype,
@@ -958,6 +1015,10 @@ ScalarQuantizer::SQuantizer* select_quantizer_1(
             return new Quantizer8bitDirect<SIMDWIDTH>(d, trained);
         case ScalarQuantizer::QT_8bit_direct_signed:
             return new Quantizer8bitDirectSigned<SIMDWIDTH>(d, trained);
+        case ScalarQuantizer::QT_4bit_nonuniform:
+            return new QuantizerCodebook<4>(d, trained);
+        case ScalarQuantizer::QT_8bit_nonuniform:
+            return new QuantizerCodebook<8>(d, trained);
     }
     FAISS_THROW_MSG("unknown qtype");
 }
@@ -1132,6 +1193,40 @@ void train_NonUniform(
     }
 }
 
+/* Codebooks of k values per dimension, by 1D k-means on at most
+ * k * codebook_points_per_centroid evenly spaced training vectors (the
+ * memory of kmeans1d is proportional to k * n) */
+const idx_t codebook_points_per_centroid = 32;
+
+void train_Codebook(
+        idx_t n,
+        int d,
+        int k,
+        const float* x,
+        std::vector<float>& trained) {
+    FAISS_THROW_IF_NOT(n > 0);
+    trained.resize((size_t)d * k);
+    idx_t nsample = std::min(n, k * codebook_points_per_centroid);
+#pragma omp parallel for
+    for (int j = 0; j < d; j++) {
+        std::vector<float> xj(nsample);
+        for (idx_t i = 0; i < nsample; i++) {
+            xj[i] = x[(i * n / nsample) * d + j];
+        }
+        float* cb = trained.data() + (size_t)j * k;
+        if (nsample <= k) {
+            // not enough values: the codebook repeats the largest one
+            std::sort(xj.begin(), xj.end());
+            for (int c = 0; c < k; c++) {
+                cb[c] = xj[std::min(idx_t(c), nsample - 1)];
+            }
+        } else {
+            kmeans1d(xj.data(), nsample, k, cb);
+            std::sort(cb, cb + k);
+        }
+    }
+}
+
 /*******************************************************************
  * Similarity: gets vector components and computes a similarity wrt. a
  * query vector stored in the object. The data fields just encapsulate
@@ -1463,11 +1558,13 @@ struct SimilarityIP<8> {
  * code-to-vector or code-to-code comparisons
  *******************************************************************/
 
-template <class Quantizer, class Similarity, int SIMDWIDTH>
+// D > 0 is the dimension fixed at compile time, so that the loops over the
+// components have a constant trip count and can be unrolled
+template <class Quantizer, class Similarity, int SIMDWIDTH, int D = 0>
 struct DCTemplate : SQDistanceComputer {};
 
-template <class Quantizer, class Similarity>
-struct DCTemplate<Quantizer, Similarity, 1> : SQDistanceComputer {
+template <class Quantizer, class Similarity, int D>
+struct DCTemplate<Quantizer, Similarity, 1, D> : SQDistanceComputer {
     using Sim = Similarity;
 
     Quantizer quant;
@@ -1475,10 +1572,14 @@ struct DCTemplate<Quantizer, Similarity, 1> : SQDistanceComputer {
     DCTemplate(size_t d, const std::vector<float>& trained)
             : quant(d, trained) {}
 
+    FAISS_ALWAYS_INLINE size_t dim() const {
+        return D > 0 ? size_t(D) : quant.d;
+    }
+
     float compute_distance(const float* x, const uint8_t* code) const {
         Similarity sim(x);
         sim.begin();
-        for (size_t i = 0; i < quant.d; i++) {
+        for (size_t i = 0; i < dim(); i++) {
             float xi = quant.reconstruct_component(code, i);
             sim.add_component(xi);
         }
@@ -1489,7 +1590,7 @@ struct DCTemplate<Quantizer, Similarity, 1> : SQDistanceComputer {
             const {
         Similarity sim(nullptr);
         sim.begin();
-        for (size_t i = 0; i < quant.d; i++) {
+        for (size_t i = 0; i < dim(); i++) {
             float x1 = quant.reconstruct_component(code1, i);
             float x2 = quant.reconstruct_component(code2, i);
             sim.add_component_2(x1, x2);
@@ -1513,8 +1614,8 @@ struct DCTemplate<Quantizer, Similarity, 1> : SQDistanceComputer {
 
 #if defined(USE_AVX512_F16C)
 
-template <class Quantizer, class Similarity>
-struct DCTemplate<Quantizer, Similarity, 16>
+template <class Quantizer, class Similarity, int D>
+struct DCTemplate<Quantizer, Similarity, 16, D>
         : SQDistanceComputer { // Update to handle 16 lanes
     using Sim = Similarity;
 
@@ -1523,10 +1624,14 @@ struct DCTemplate<Quantizer, Similarity, 16>
     DCTemplate(size_t d, const std::vector<float>& trained)
             : quant(d, trained) {}
 
+    FAISS_ALWAYS_INLINE size_t dim() const {
+        return D > 0 ? size_t(D) : quant.d;
+    }
+
     float compute_distance(const float* x, const uint8_t* code) const {
         Similarity sim(x);
         sim.begin_16();
-        for (size_t i = 0; i < quant.d; i += 16) {
+        for (size_t i = 0; i < dim(); i += 16) {
             __m512 xi = quant.reconstruct_16_components(code, i);
             sim.add_16_components(xi);
         }
@@ -1537,7 +1642,7 @@ struct DCTemplate<Quantizer, Similarity, 16>
             const {
         Similarity sim(nullptr);
         sim.begin_16();
-        for (size_t i = 0; i < quant.d; i += 16) {
+        for (size_t i = 0; i < dim(); i += 16) {
             __m512 x1 = quant.reconstruct_16_components(code1, i);
             __m512 x2 = quant.reconstruct_16_components(code2, i);
             sim.add_16_components_2(x1, x2);
@@ -1561,8 +1666,8 @@ struct DCTemplate<Quantizer, Similarity, 16>
 
 #elif defined(USE_F16C)
 
-template <class Quantizer, class Similarity>
-struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
+template <class Quantizer, class Similarity, int D>
+struct DCTemplate<Quantizer, Similarity, 8, D> : SQDistanceComputer {
     using Sim = Similarity;
 
     Quantizer quant;
@@ -1570,10 +1675,14 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
     DCTemplate(size_t d, const std::vector<float>& trained)
             : quant(d, trained) {}
 
+    FAISS_ALWAYS_INLINE size_t dim() const {
+        return D > 0 ? size_t(D) : quant.d;
+    }
+
     float compute_distance(const float* x, const uint8_t* code) const {
         Similarity sim(x);
         sim.begin_8();
-        for (size_t i = 0; i < quant.d; i += 8) {
+        for (size_t i = 0; i < dim(); i += 8) {
             __m256 xi = quant.reconstruct_8_components(code, i);
             sim.add_8_components(xi);
         }
@@ -1584,7 +1693,7 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
             const {
         Similarity sim(nullptr);
         sim.begin_8();
-        for (size_t i = 0; i < quant.d; i += 8) {
+        for (size_t i = 0; i < dim(); i += 8) {
             __m256 x1 = quant.reconstruct_8_components(code1, i);
             __m256 x2 = quant.reconstruct_8_components(code2, i);
             sim.add_8_components_2(x1, x2);
@@ -1610,18 +1719,22 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
 
 #ifdef USE_NEON
 
-template <class Quantizer, class Similarity>
-struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
+template <class Quantizer, class Similarity, int D>
+struct DCTemplate<Quantizer, Similarity, 8, D> : SQDistanceComputer {
     using Sim = Similarity;
 
     Quantizer quant;
 
     DCTemplate(size_t d, const std::vector<float>& trained)
             : quant(d, trained) {}
+
+    FAISS_ALWAYS_INLINE size_t dim() const {
+        return D > 0 ? size_t(D) : quant.d;
+    }
     float compute_distance(const float* x, const uint8_t* code) const {
         Similarity sim(x);
         sim.begin_8();
-        for (size_t i = 0; i < quant.d; i += 8) {
+        for (size_t i = 0; i < dim(); i += 8) {
             float32x4x2_t xi = quant.reconstruct_8_components(code, i);
             sim.add_8_components(xi);
         }
@@ -1632,7 +1745,7 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
             const {
         Similarity sim(nullptr);
         sim.begin_8();
-        for (size_t i = 0; i < quant.d; i += 8) {
+        for (size_t i = 0; i < dim(); i += 8) {
             float32x4x2_t x1 = quant.reconstruct_8_components(code1, i);
             float32x4x2_t x2 = quant.reconstruct_8_components(code2, i);
             sim.add_8_components_2(x1, x2);
@@ -1837,16 +1950,24 @@ struct DistanceComputerByte<Similarity, 8> : SQDistanceComputer {
 
     int compute_code_distance(const uint8_t* code1, const uint8_t* code2)
             const {
-        int accu = 0;
-        for (int i = 0; i < d; i++) {
-            if (Sim::metric_type == METRIC_INNER_PRODUCT) {
-                accu += int(code1[i]) * code2[i];
-            } else {
-                int diff = int(code1[i]) - code2[i];
-                accu += diff * diff;
+        uint32x4_t accu = vdupq_n_u32(0);
+        for (int i = 0; i < d; i += 16) {
+            uint8x16_t c1 = vld1q_u8(code1 + i);
+            uint8x16_t c2 = vld1q_u8(code2 + i);
+            if (Sim::metric_type != METRIC_INNER_PRODUCT) {
+                // the squares of |c1 - c2| are the ones of c1 - c2
+                c1 = vabdq_u8(c1, c2);
+                c2 = c1;
             }
+#ifdef __ARM_FEATURE_DOTPROD
+            accu = vdotq_u32(accu, c1, c2);
+#else
+            accu = vpadalq_u16(
+                    accu, vmull_u8(vget_low_u8(c1), vget_low_u8(c2)));
+            accu = vpadalq_u16(accu, vmull_high_u8(c1, c2));
+#endif
         }
-        return accu;
+        return vaddvq_u32(accu);
     }
 
     void set_query(const float* x) final {
@@ -1872,11 +1993,352 @@ struct DistanceComputerByte<Similarity, 8> : SQDistanceComputer {
 
 #endif
 
+/*******************************************************************
+ * DCQuantizedQuery8bit: 8-bit codes compared to a query quantized to
+ * integers (ScalarQuantizer::quantize_query)
+ *
+ * Component i of a code c decodes to a[i] + b[i] * c[i]. Then
+ *
+ *   <q, x>     = sum_i q[i] a[i] + sum_i (q[i] b[i]) c[i]
+ *   ||q - x||^2 = sum_i b[i]^2 (u[i] - c[i])^2,  u[i] = (q[i] - a[i]) / b[i]
+ *
+ * q[i] b[i] is rounded to int8 and u[i] to an integer, b[i]^2 to 6 bits,
+ * so that the sums over i are computed with 16-bit integer products.
+ *******************************************************************/
+
+// blocks over which the 32-bit integer accumulators cannot overflow
+constexpr size_t kQQBlock = 128;
+
+// u[i] is clamped so that the products below fit in 16 / 32 bits
+constexpr int kQQUMin = -180;
+constexpr int kQQUMax = 435;
+constexpr int kQQBetaMax = 63;
+
+/// sum_i w[i] * c[i] for i < n <= kQQBlock, w in [-127, 127]
+FAISS_ALWAYS_INLINE int32_t
+qq_dot_block(const int16_t* w, const uint8_t* c, size_t n) {
+    int32_t accu = 0;
+    size_t i = 0;
+#if defined(__AVX512BW__)
+    __m512i accu16 = _mm512_setzero_si512();
+    for (; i + 32 <= n; i += 32) {
+        __m512i ci = _mm512_cvtepu8_epi16(
+                _mm256_loadu_si256((const __m256i*)(c + i)));
+        __m512i wi = _mm512_loadu_si512((const __m512i*)(w + i));
+        accu16 = _mm512_add_epi32(accu16, _mm512_madd_epi16(wi, ci));
+    }
+    accu = _mm512_reduce_add_epi32(accu16);
+#elif defined(__AVX2__)
+    __m256i accu8 = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i ci = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i*)(c + i)));
+        __m256i wi = _mm256_loadu_si256((const __m256i*)(w + i));
+        accu8 = _mm256_add_epi32(accu8, _mm256_madd_epi16(wi, ci));
+    }
+    __m128i sum = _mm_add_epi32(
+            _mm256_castsi256_si128(accu8), _mm256_extracti128_si256(accu8, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    accu = _mm_cvtsi128_si32(sum);
+#elif defined(USE_NEON)
+    int32x4_t accu4 = vdupq_n_s32(0);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t ci = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(c + i)));
+        int16x8_t wi = vld1q_s16(w + i);
+        accu4 = vmlal_s16(accu4, vget_low_s16(wi), vget_low_s16(ci));
+        accu4 = vmlal_high_s16(accu4, wi, ci);
+    }
+    accu = vaddvq_s32(accu4);
+#endif
+    for (; i < n; i++) {
+        accu += int32_t(w[i]) * c[i];
+    }
+    return accu;
+}
+
+/// sum_i beta[i] * (u[i] - c[i])^2 for i < n <= kQQBlock
+FAISS_ALWAYS_INLINE int32_t qq_L2_block(
+        const int16_t* u,
+        const int16_t* beta,
+        const uint8_t* c,
+        size_t n) {
+    int32_t accu = 0;
+    size_t i = 0;
+#if defined(__AVX512BW__)
+    __m512i accu16 = _mm512_setzero_si512();
+    for (; i + 32 <= n; i += 32) {
+        __m512i ci = _mm512_cvtepu8_epi16(
+                _mm256_loadu_si256((const __m256i*)(c + i)));
+        __m512i ei = _mm512_sub_epi16(
+                _mm512_loadu_si512((const __m512i*)(u + i)), ci);
+        __m512i bei = _mm512_mullo_epi16(
+                _mm512_loadu_si512((const __m512i*)(beta + i)), ei);
+        accu16 = _mm512_add_epi32(accu16, _mm512_madd_epi16(bei, ei));
+    }
+    accu = _mm512_reduce_add_epi32(accu16);
+#elif defined(__AVX2__)
+    __m256i accu8 = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i ci = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i*)(c + i)));
+        __m256i ei = _mm256_sub_epi16(
+                _mm256_loadu_si256((const __m256i*)(u + i)), ci);
+        __m256i bei = _mm256_mullo_epi16(
+                _mm256_loadu_si256((const __m256i*)(beta + i)), ei);
+        accu8 = _mm256_add_epi32(accu8, _mm256_madd_epi16(bei, ei));
+    }
+    __m128i sum = _mm_add_epi32(
+            _mm256_castsi256_si128(accu8), _mm256_extracti128_si256(accu8, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    accu = _mm_cvtsi128_si32(sum);
+#elif defined(USE_NEON)
+    int32x4_t accu4 = vdupq_n_s32(0);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t ci = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(c + i)));
+        int16x8_t ei = vsubq_s16(vld1q_s16(u + i), ci);
+        int16x8_t bei = vmulq_s16(vld1q_s16(beta + i), ei);
+        accu4 = vmlal_s16(accu4, vget_low_s16(bei), vget_low_s16(ei));
+        accu4 = vmlal_high_s16(accu4, bei, ei);
+    }
+    accu = vaddvq_s32(accu4);
+#endif
+    for (; i < n; i++) {
+        int32_t e = int32_t(u[i]) - c[i];
+        accu += beta[i] * e * e;
+    }
+    return accu;
+}
+
+template <class Similarity, QuantizerTemplateScaling SCALING>
+struct DCQuantizedQuery8bit : SQDistanceComputer {
+    using Sim = Similarity;
+
+    size_t d;
+    // decoding: a[i] + b[i] * code[i]
+    std::vector<float> a, b;
+
+    // L2: b[i]^2 ~= beta_scale * beta[i]
+    std::vector<int16_t> beta;
+    float beta_scale = 0;
+
+    // query: integer weights (IP) or components (L2), and the scale and
+    // offset to apply to the integer sums
+    std::vector<int16_t> qi;
+    float scale = 0;
+    float bias = 0;
+
+    DCQuantizedQuery8bit(size_t d, const std::vector<float>& trained)
+            : d(d), a(d), b(d), beta(d), qi(d) {
+        for (size_t i = 0; i < d; i++) {
+            bool uniform = SCALING == QuantizerTemplateScaling::UNIFORM;
+            float vmin = uniform ? trained[0] : trained[i];
+            float vdiff = uniform ? trained[1] : trained[d + i];
+            // see Codec8bit::decode_component
+            b[i] = vdiff / 255.0f;
+            a[i] = vmin + 0.5f * b[i];
+        }
+        if (Sim::metric_type == METRIC_L2) {
+            float bmax = 0;
+            for (size_t i = 0; i < d; i++) {
+                bmax = std::max(bmax, std::fabs(b[i]));
+            }
+            float beta_max = bmax * bmax;
+            beta_scale = beta_max / kQQBetaMax;
+            for (size_t i = 0; i < d; i++) {
+                beta[i] = beta_max > 0
+                        ? int16_t(std::lrint(b[i] * b[i] / beta_scale))
+                        : 0;
+            }
+        }
+    }
+
+    void set_query(const float* x) final {
+        q = x;
+        bias = 0;
+        if (Sim::metric_type == METRIC_L2) {
+            scale = beta_scale;
+            for (size_t i = 0; i < d; i++) {
+                float r = x[i] - a[i];
+                if (beta[i] == 0) {
+                    // the component does not depend on the code
+                    bias += r * r;
+                    qi[i] = 0;
+                } else {
+                    float u = std::min(
+                            std::max(r / b[i], float(kQQUMin)),
+                            float(kQQUMax));
+                    qi[i] = int16_t(std::lrint(u));
+                }
+            }
+        } else {
+            float wmax = 0;
+            for (size_t i = 0; i < d; i++) {
+                bias += x[i] * a[i];
+                wmax = std::max(wmax, std::fabs(x[i] * b[i]));
+            }
+            scale = wmax / 127;
+            for (size_t i = 0; i < d; i++) {
+                qi[i] = wmax > 0 ? int16_t(std::lrint(x[i] * b[i] / scale))
+                                 : 0;
+            }
+        }
+    }
+
+    float query_to_code(const uint8_t* code) const final {
+        int64_t accu = 0;
+        for (size_t i0 = 0; i0 < d; i0 += kQQBlock) {
+            size_t n = std::min(kQQBlock, d - i0);
+            if (Sim::metric_type == METRIC_L2) {
+                accu += qq_L2_block(
+                        qi.data() + i0, beta.data() + i0, code + i0, n);
+            } else {
+                accu += qq_dot_block(qi.data() + i0, code + i0, n);
+            }
+        }
+        return bias + scale * accu;
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        const uint8_t* c1 = codes + i * code_size;
+        const uint8_t* c2 = codes + j * code_size;
+        float accu = 0;
+        for (size_t k = 0; k < d; k++) {
+            float x1 = a[k] + b[k] * c1[k];
+            float x2 = a[k] + b[k] * c2[k];
+            if (Sim::metric_type == METRIC_L2) {
+                accu += (x1 - x2) * (x1 - x2);
+            } else {
+                accu += x1 * x2;
+            }
+        }
+        return accu;
+    }
+};
+
+template <class Sim>
+SQDistanceComputer* select_quantized_query_distance_computer(
+        QuantizerType qtype,
+        size_t d,
+        const std::vector<float>& trained) {
+    if (qtype == ScalarQuantizer::QT_8bit_uniform) {
+        return new DCQuantizedQuery8bit<Sim, QuantizerTemplateScaling::UNIFORM>(
+                d, trained);
+    }
+    FAISS_THROW_IF_NOT(qtype == ScalarQuantizer::QT_8bit);
+    return new DCQuantizedQuery8bit<
+            Sim,
+            QuantizerTemplateScaling::NON_UNIFORM>(d, trained);
+}
+
+/*******************************************************************
+ * Distance computer of the codebook quantizers: set_query fills a table
+ * of the similarities between the query components and the codebook
+ * values, so that the distance to a code is a sum of table lookups. With
+ * 4 bits, the tables of the 2 components of a code byte are combined into
+ * one table of 256 entries indexed by the byte, as in the fast-scan
+ * kernels, which halves the nb of lookups.
+ *******************************************************************/
+
+template <int NBITS, class Similarity>
+struct DCCodebook : SQDistanceComputer {
+    using Sim = Similarity;
+    static constexpr int ksub = 1 << NBITS;
+
+    QuantizerCodebook<NBITS> quant;
+    /// one table of 256 entries per code byte
+    std::vector<float> lut;
+
+    DCCodebook(size_t d, const std::vector<float>& trained)
+            : quant(d, trained), lut((NBITS == 4 ? (d + 1) / 2 : d) * 256) {}
+
+    static FAISS_ALWAYS_INLINE float similarity(float a, float b) {
+        return Sim::metric_type == METRIC_L2 ? (a - b) * (a - b) : a * b;
+    }
+
+    void set_query(const float* x) final {
+        q = x;
+        const size_t d = quant.d;
+        const float* cb = quant.codebooks;
+        if (NBITS == 8) {
+            for (size_t i = 0; i < d * ksub; i++) {
+                lut[i] = similarity(x[i / ksub], cb[i]);
+            }
+            return;
+        }
+        float t0[16], t1[16];
+        for (size_t p = 0; p < lut.size() / 256; p++) {
+            size_t i0 = 2 * p, i1 = 2 * p + 1;
+            for (int c = 0; c < 16; c++) {
+                t0[c] = similarity(x[i0], cb[i0 * 16 + c]);
+                // the high half of the last byte is 0 for odd d
+                t1[c] = i1 < d ? similarity(x[i1], cb[i1 * 16 + c]) : 0;
+            }
+            float* l = lut.data() + p * 256;
+            for (int b = 0; b < 256; b++) {
+                l[b] = t0[b & 15] + t1[b >> 4];
+            }
+        }
+    }
+
+    float query_to_code(const uint8_t* code) const final {
+        const size_t nbyte = lut.size() / 256;
+        const float* l = lut.data();
+        float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= nbyte; i += 4) {
+            a0 += l[i * 256 + code[i]];
+            a1 += l[(i + 1) * 256 + code[i + 1]];
+            a2 += l[(i + 2) * 256 + code[i + 2]];
+            a3 += l[(i + 3) * 256 + code[i + 3]];
+        }
+        for (; i < nbyte; i++) {
+            a0 += l[i * 256 + code[i]];
+        }
+        return (a0 + a1) + (a2 + a3);
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        const uint8_t* c1 = codes + i * code_size;
+        const uint8_t* c2 = codes + j * code_size;
+        float accu = 0;
+        for (size_t k = 0; k < quant.d; k++) {
+            accu += similarity(
+                    quant.reconstruct_component(c1, k),
+                    quant.reconstruct_component(c2, k));
+        }
+        return accu;
+    }
+};
+
 /*******************************************************************
  * select_distance_computer: runtime selection of template
  * specialization
  *******************************************************************/
 
+// Common embedding dimensions get a distance computer with a compile-time
+// dimension (see DCTemplate)
+template <class Quantizer, class Sim, int SIMDWIDTH>
+SQDistanceComputer* select_DCTemplate_dim(
+        size_t d,
+        const std::vector<float>& trained) {
+    if (sq_fixed_dim_distance_computers) {
+        switch (d) {
+            case 384:
+                return new DCTemplate<Quantizer, Sim, SIMDWIDTH, 384>(
+                        d, trained);
+            case 768:
+                return new DCTemplate<Quantizer, Sim, SIMDWIDTH, 768>(
+                        d, trained);
+            case 1024:
+                return new DCTemplate<Quantizer, Sim, SIMDWIDTH, 1024>(
+                        d, trained);
+        }
+    }
+    return new DCTemplate<Quantizer, Sim, SIMDWIDTH>(d, trained);
+}
+
 template <class Sim>
 SQDistanceComputer* select_distance_computer(
         QuantizerType qtype,
@@ -1903,7 +2365,7 @@ SQDistanceComputer* select_distance_computer(
                     SIMDWIDTH>(d, trained);
 
         case ScalarQuantizer::QT_8bit:
-            return new DCTemplate<
+            return select_DCTemplate_dim<
                     QuantizerTemplate<
                             Codec8bit,
                             QuantizerTemplateScaling::NON_UNIFORM,
@@ -1921,7 +2383,7 @@ SQDistanceComputer* select_distance_computer(
                     SIMDWIDTH>(d, trained);
 
         case ScalarQuantizer::QT_4bit:
-            return new DCTemplate<
+            return select_DCTemplate_dim<
                     QuantizerTemplate<
                             Codec4bit,
                             QuantizerTemplateScaling::NON_UNIFORM,
@@ -1930,19 +2392,23 @@ SQDistanceComputer* select_distance_computer(
                     SIMDWIDTH>(d, trained);
 
         case ScalarQuantizer::QT_fp16:
-            return new DCTemplate<QuantizerFP16<SIMDWIDTH>, Sim, SIMDWIDTH>(
-                    d, trained);
+            return select_DCTemplate_dim<
+                    QuantizerFP16<SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
 
         case ScalarQuantizer::QT_bf16:
-            return new DCTemplate<QuantizerBF16<SIMDWIDTH>, Sim, SIMDWIDTH>(
-                    d, trained);
+            return select_DCTemplate_dim<
+                    QuantizerBF16<SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
 
         case ScalarQuantizer::QT_8bit_direct:
 #if defined(__AVX512F__)
             if (d % 32 == 0) {
                 return new DistanceComputerByte<Sim, SIMDWIDTH>(d, trained);
             } else
-#elif defined(__AVX2__)
+#elif defined(__AVX2__) || defined(USE_NEON)
             if (d % 16 == 0) {
                 return new DistanceComputerByte<Sim, SIMDWIDTH>(d, trained);
             } else
@@ -1958,6 +2424,10 @@ SQDistanceComputer* select_distance_computer(
                     Quantizer8bitDirectSigned<SIMDWIDTH>,
                     Sim,
                     SIMDWIDTH>(d, trained);
+        case ScalarQuantizer::QT_4bit_nonuniform:
+            return new DCCodebook<4, Sim>(d, trained);
+        case ScalarQuantizer::QT_8bit_nonuniform:
+            return new DCCodebook<8, Sim>(d, trained);
     }
     FAISS_THROW_MSG("unknown qtype");
     return nullptr;
@@ -1994,6 +2464,14 @@ void ScalarQuantizer::set_derived_sizes() {
             code_size = (d * 6 + 7) / 8;
             bits = 6;
             break;
+        case QT_4bit_nonuniform:
+            code_size = (d + 1) / 2;
+            bits = 4;
+            break;
+        case QT_8bit_nonuniform:
+            code_size = d;
+            bits = 8;
+            break;
         case QT_fp16:
             code_size = d * 2;
             bits = 16;
@@ -2036,6 +2514,10 @@ void ScalarQuantizer::train(size_t n, const float* x) {
                     x,
                     trained);
             break;
+        case QT_4bit_nonuniform:
+        case QT_8bit_nonuniform:
+            train_Codebook(n, d, 1 << bits, x, trained);
+            break;
         case QT_fp16:
         case QT_8bit_direct:
         case QT_bf16:
@@ -2081,6 +2563,15 @@ void ScalarQuantizer::decode(const uint8_t* codes, float* x, size_t n) const {
 SQDistanceComputer* ScalarQuantizer::get_distance_computer(
         MetricType metric) const {
     FAISS_THROW_IF_NOT(metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT);
+    if (quantize_query && (qtype == QT_8bit || qtype == QT_8bit_uniform)) {
+        if (metric == METRIC_L2) {
+            return select_quantized_query_distance_computer<SimilarityL2<1>>(
+                    qtype, d, trained);
+        } else {
+            return select_quantized_query_distance_computer<SimilarityIP<1>>(
+                    qtype, d, trained);
+        }
+    }
 #if defined(USE_AVX512_F16C)
     if (d % 16 == 0) {
         if (metric == METRIC_L2) {
@@ -2160,6 +2651,7 @@ struct IVFSQScannerIP : InvertedListScanner {
             idx_t* idxi,
             size_t k) const override {
         size_t nup = 0;
+        HeapBuffer<CMin<float, idx_t>> heap(k, simi, idxi);
 
         for (size_t j = 0; j < list_size; j++, codes += code_size) {
             if (use_sel && !sel->is_member(use_sel == 1 ? ids[j] : j)) {
@@ -2168,12 +2660,13 @@ struct IVFSQScannerIP : InvertedListScanner {
 
             float accu = accu0 + dc.query_to_code(codes);
 
-            if (accu > simi[0]) {
+            if (accu > heap.threshold) {
                 int64_t id = store_pairs ? (list_no << 32 | j) : ids[j];
-                minheap_replace_top(k, simi, idxi, accu, id);
+                heap.push(accu, id);
                 nup++;
             }
         }
+        heap.flush();
         return nup;
     }
 
@@ -2259,6 +2752,7 @@ struct IVFSQScannerL2 : InvertedListScanner {
             idx_t* idxi,
             size_t k) const override {
         size_t nup = 0;
+        HeapBuffer<CMax<float, idx_t>> heap(k, simi, idxi);
         for (size_t j = 0; j < list_size; j++, codes += code_size) {
             if (use_sel && !sel->is_member(use_sel == 1 ? ids[j] : j)) {
                 continue;
@@ -2266,12 +2760,13 @@ struct IVFSQScannerL2 : InvertedListScanner {
 
             float dis = dc.query_to_code(codes);
 
-            if (dis < simi[0]) {
+            if (dis < heap.threshold) {
                 int64_t id = store_pairs ? (list_no << 32 | j) : ids[j];
-                maxheap_replace_top(k, simi, idxi, dis, id);
+                heap.push(dis, id);
                 nup++;
             }
         }
+        heap.flush();
         return nup;
     }
 
@@ -2362,6 +2857,20 @@ InvertedListScanner* sel1_InvertedListScanner(
         const IDSelector* sel,
         bool r) {
     constexpr int SIMDWIDTH = Similarity::simdwidth;
+    if (sq->quantize_query) {
+        if (sq->qtype == ScalarQuantizer::QT_8bit_uniform) {
+            return sel2_InvertedListScanner<DCQuantizedQuery8bit<
+                    Similarity,
+                    QuantizerTemplateScaling::UNIFORM>>(
+                    sq, quantizer, store_pairs, sel, r);
+        } else if (sq->qtype == ScalarQuantizer::QT_8bit) {
+            return sel2_InvertedListScanner<DCQuantizedQuery8bit<
+                    Similarity,
+                    QuantizerTemplateScaling::NON_UNIFORM>>(
+                    sq, quantizer, store_pairs, sel, r);
+        }
+    }
+
     switch (sq->qtype) {
         case ScalarQuantizer::QT_8bit_uniform:
             return sel12_InvertedListScanner<
@@ -2410,7 +2919,7 @@ InvertedListScanner* sel1_InvertedListScanner(
                         DistanceComputerByte<Similarity, SIMDWIDTH>>(
                         sq, quantizer, store_pairs, sel, r);
             } else
-#elif defined(__AVX2__)
+#elif defined(__AVX2__) || defined(USE_NEON)
             if (sq->d % 16 == 0) {
                 return sel2_InvertedListScanner<
                         DistanceComputerByte<Similarity, SIMDWIDTH>>(
@@ -2428,6 +2937,12 @@ InvertedListScanner* sel1_InvertedListScanner(
                     Quantizer8bitDirectSigned<SIMDWIDTH>,
                     Similarity,
                     SIMDWIDTH>>(sq, quantizer, store_pairs, sel, r);
+        case ScalarQuantizer::QT_4bit_nonuniform:
+            return sel2_InvertedListScanner<DCCodebook<4, Similarity>>(
+                    sq, quantizer, store_pairs, sel, r);
+        case ScalarQuantizer::QT_8bit_nonuniform:
+            return sel2_InvertedListScanner<DCCodebook<8, Similarity>>(
+                    sq, quantizer, store_pairs, sel, r);
     }
 
     FAISS_THROW_MSG("unknown qtype");
@@ -35,6 +35,10 @@ struct ScalarQuantizer : Quantizer {
         QT_bf16,
         QT_8bit_direct_signed, ///< fast indexing of signed int8s ranging from
                                ///< [-128 to 127]
+        /// 4 bits per component, with a codebook of 16 values per
+        /// dimension trained by 1D k-means (for heavy-tailed components)
+        QT_4bit_nonuniform,
+        QT_8bit_nonuniform, ///< same with 256 values per dimension
     };
 
     QuantizerType qtype = QT_8bit;
@@ -57,9 +61,15 @@ struct ScalarQuantizer : Quantizer {
     /// bits per scalar code
     size_t bits = 0;
 
-    /// trained values (including the range)
+    /** trained values (including the range). For the nonuniform types,
+     * the sorted codebooks of the dimensions, size d << bits */
     std::vector<float> trained;
 
+    /** For QT_8bit and QT_8bit_uniform: quantize the query to integers
+     * in the code domain and compute the distances with integer
+     * arithmetic. Faster, but approximate. Not serialized. */
+    bool quantize_query = false;
+
     ScalarQuantizer(size_t d, QuantizerType qtype);
     ScalarQuantizer();
 
@@ -120,4 +130,9 @@ struct ScalarQuantizer : Quantizer {
             bool by_residual = false) const;
 };
 
+/// get_distance_computer returns distance computers with a compile-time
+/// dimension for d = 384, 768 and 1024 (QT_8bit, QT_4bit, QT_fp16 and
+/// QT_bf16). Set to false to use the generic ones, e.g. for benchmarking
+FAISS_API extern bool sq_fixed_dim_distance_computers;
+
 } // namespace faiss
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/SearchEffortPredictor.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+SearchEffortPredictor::SearchEffortPredictor(int nfeatures)
+        : nfeatures(nfeatures), weights(nfeatures + 1) {
+    FAISS_THROW_IF_NOT(nfeatures >= 0);
+}
+
+float SearchEffortPredictor::predict(const float* features) const {
+    FAISS_ASSERT(weights.size() == nfeatures + 1);
+    double y = weights[nfeatures];
+    for (int j = 0; j < nfeatures; j++) {
+        y += weights[j] * features[j];
+    }
+    float effort = scale * std::exp(std::min(y, 80.0));
+    return std::min(std::max(effort, min_effort), max_effort);
+}
+
+void SearchEffortPredictor::train(
+        size_t n,
+        const float* features,
+        const float* efforts,
+        float ridge) {
+    FAISS_THROW_IF_NOT(n > 0);
+    int m = nfeatures + 1;
+
+    // normal equations (X^T X + ridge I) w = X^T y, where the last column
+    // of X is 1 (the bias is not regularized)
+    std::vector<double> A(m * m), b(m);
+    std::vector<double> row(m);
+    for (size_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT_MSG(efforts[i] > 0, "efforts must be positive");
+        for (int j = 0; j < nfeatures; j++) {
+            row[j] = features[i * nfeatures + j];
+        }
+        row[nfeatures] = 1;
+        double y = std::log(efforts[i]);
+        for (int j = 0; j < m; j++) {
+            for (int l = 0; l < m; l++) {
+                A[j * m + l] += row[j] * row[l];
+            }
+            b[j] += row[j] * y;
+        }
+    }
+    for (int j = 0; j < nfeatures; j++) {
+        A[j * m + j] += ridge * n;
+    }
+
+    // Gaussian elimination with partial pivoting
+    for (int c = 0; c < m; c++) {
+        int piv = c;
+        for (int r = c + 1; r < m; r++) {
+            if (std::fabs(A[r * m + c]) > std::fabs(A[piv * m + c])) {
+                piv = r;
+            }
+        }
+        if (std::fabs(A[piv * m + c]) < 1e-12) {
+            // degenerate feature: not used
+            continue;
+        }
+        if (piv != c) {
+            for (int l = 0; l < m; l++) {
+                std::swap(A[c * m + l], A[piv * m + l]);
+            }
+            std::swap(b[c], b[piv]);
+        }
+        for (int r = 0; r < m; r++) {
+            if (r == c) {
+                continue;
+            }
+            double f = A[r * m + c] / A[c * m + c];
+            for (int l = c; l < m; l++) {
+                A[r * m + l] -= f * A[c * m + l];
+            }
+            b[r] -= f * b[c];
+        }
+    }
+    weights.resize(m);
+    for (int j = 0; j < m; j++) {
+        weights[j] =
+                std::fabs(A[j * m + j]) < 1e-12 ? 0 : b[j] / A[j * m + j];
+    }
+}
+
+void SearchEffortPredictor::ivf_features(
+        int nfeatures,
+        const idx_t* keys,
+        const float* coarse_dis,
+        float* features) {
+    for (int j = 0; j < nfeatures; j++) {
+        if (keys[0] >= 0 && keys[j + 1] >= 0) {
+            features[j] = relative_gap(coarse_dis[0], coarse_dis[j + 1]);
+        } else {
+            // the missing lists repeat the last gap
+            features[j] = j > 0 ? features[j - 1] : 0;
+        }
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+/** Predicts the search effort of a query from features observed at the
+ * start of its search, to stop the easy queries early and let the hard ones
+ * search longer than a fixed setting would:
+ *
+ * - IVF (SearchParametersIVF::nprobe_predictor): the features are the
+ *   relative gaps between the distance to the nearest centroid and the
+ *   distances to the next nfeatures centroids, the effort is the nprobe of
+ *   the query (at most the nprobe of the search).
+ *
+ * - HNSW (SearchParametersHNSW::effort_predictor): the features are the
+ *   relative improvements of the best distance over the first nfeatures
+ *   expansion rounds of level 0, the effort is the nb of expansions of the
+ *   level 0 search.
+ *
+ * The model is linear in log space, log(effort) = weights . features +
+ * bias, and is trained offline (train_ivf_nprobe_predictor,
+ * train_hnsw_effort_predictor) to reach a recall target per query.
+ */
+struct SearchEffortPredictor {
+    int nfeatures;
+
+    /// nfeatures weights followed by the bias
+    std::vector<float> weights;
+
+    /// the predictions are multiplied by scale, to trade recall for cost
+    /// without retraining
+    float scale = 1;
+
+    /// bounds of the predicted effort
+    float min_effort = 1;
+    float max_effort = 1e9;
+
+    explicit SearchEffortPredictor(int nfeatures = 0);
+
+    /// predicted effort, clamped to [min_effort, max_effort]
+    float predict(const float* features) const;
+
+    /** least squares fit (with a ridge regularization of the weights) of
+     * log(efforts) on the features
+     *
+     * @param features  size n * nfeatures
+     * @param efforts   size n, efforts that reach the target of each
+     *                  training query (> 0)
+     */
+    void train(
+            size_t n,
+            const float* features,
+            const float* efforts,
+            float ridge = 1e-3);
+
+    /** IVF features of a query: the relative gaps between the distance to
+     * the first centroid and to the next nfeatures ones
+     *
+     * @param keys        nfeatures + 1 nearest lists, -1 if missing
+     * @param coarse_dis  corresponding distances
+     * @param features    output, size nfeatures
+     */
+    static void ivf_features(
+            int nfeatures,
+            const idx_t* keys,
+            const float* coarse_dis,
+            float* features);
+
+    /// relative gap between a distance and the distance d0 of the best
+    /// centroid / entry point, that does not depend on the scale of the
+    /// distances
+    static float relative_gap(float d0, float d) {
+        return (d - d0) / (std::fabs(d0) + 1e-20f);
+    }
+};
+
+} // namespace faiss
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/Vamana.h>
+
+#include <omp.h>
+#include <algorithm>
+#include <memory>
+
+#include <faiss/Index.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/random.h>
+
+namespace faiss {
+
+namespace vamana {
+
+void robust_prune(
+        DistanceComputer& dis,
+        storage_idx_t i,
+        std::vector<Candidate>& cands,
+        float alpha,
+        int R,
+        std::vector<storage_idx_t>& out) {
+    std::sort(cands.begin(), cands.end());
+    cands.erase(
+            std::unique(
+                    cands.begin(),
+                    cands.end(),
+                    [](const Candidate& a, const Candidate& b) {
+                        return a.second == b.second;
+                    }),
+            cands.end());
+    out.clear();
+    std::vector<bool> pruned(cands.size());
+    for (size_t a = 0; a < cands.size() && out.size() < R; a++) {
+        storage_idx_t v = cands[a].second;
+        if (pruned[a] || v == i) {
+            continue;
+        }
+        out.push_back(v);
+        for (size_t b = a + 1; b < cands.size(); b++) {
+            if (!pruned[b] &&
+                alpha * dis.symmetric_dis(v, cands[b].second) <=
+                        cands[b].first) {
+                pruned[b] = true;
+            }
+        }
+    }
+}
+
+void greedy_search(
+        DistanceComputer& dis,
+        const storage_idx_t* graph,
+        int R,
+        storage_idx_t entry,
+        int L,
+        VisitedTable& vt,
+        std::vector<Candidate>& expanded) {
+    std::vector<Candidate> beam;
+    std::vector<uint8_t> done;
+    beam.emplace_back(dis(entry), entry);
+    done.push_back(0);
+    vt.set(entry);
+    for (;;) {
+        size_t j = 0;
+        while (j < beam.size() && done[j]) {
+            j++;
+        }
+        if (j == beam.size()) {
+            break;
+        }
+        done[j] = 1;
+        expanded.push_back(beam[j]);
+        const storage_idx_t* row = graph + size_t(beam[j].second) * R;
+        for (int r = 0; r < R && row[r] >= 0; r++) {
+            storage_idx_t u = row[r];
+            if (vt.get(u)) {
+                continue;
+            }
+            vt.set(u);
+            Candidate c(dis(u), u);
+            if (beam.size() >= L && c >= beam.back()) {
+                continue;
+            }
+            size_t pos =
+                    std::upper_bound(beam.begin(), beam.end(), c) - beam.begin();
+            beam.insert(beam.begin() + pos, c);
+            done.insert(done.begin() + pos, 0);
+            if (beam.size() > L) {
+                beam.pop_back();
+                done.pop_back();
+            }
+        }
+    }
+    vt.advance();
+}
+
+storage_idx_t find_medoid(const Index& index, idx_t n, const float* x) {
+    int d = index.d;
+    std::vector<double> sum(d);
+    for (idx_t i = 0; i < n; i++) {
+        for (int j = 0; j < d; j++) {
+            sum[j] += x[i * d + j];
+        }
+    }
+    std::vector<float> mean(d);
+    for (int j = 0; j < d; j++) {
+        mean[j] = sum[j] / n;
+    }
+    float dis;
+    idx_t medoid;
+    index.search(1, mean.data(), 1, &dis, &medoid);
+    return medoid;
+}
+
+void build_graph(
+        const Index& storage,
+        idx_t n0,
+        int R,
+        int L,
+        float alpha,
+        size_t batch_size,
+        storage_idx_t entry,
+        storage_idx_t* graph) {
+    idx_t n = storage.ntotal;
+    int d = storage.d;
+    FAISS_THROW_IF_NOT(n0 >= 0 && n0 <= n);
+    FAISS_THROW_IF_NOT(entry >= 0 && entry < n);
+    FAISS_THROW_IF_NOT(R > 0 && L > 0 && alpha >= 1 && batch_size > 0);
+    if (n0 == n) {
+        return;
+    }
+
+    // insertion order of the new nodes, a first build starts at the entry
+    // point so that the graph is connected
+    std::vector<int> perm(n - n0);
+    rand_perm(perm.data(), n - n0, 1234 + n0);
+    for (int& i : perm) {
+        i += n0;
+    }
+    if (n0 == 0) {
+        std::swap(*std::find(perm.begin(), perm.end(), entry), perm[0]);
+    }
+
+    int npass = n0 == 0 && alpha > 1 ? 2 : 1;
+    std::vector<std::vector<storage_idx_t>> out;
+    std::vector<std::pair<storage_idx_t, storage_idx_t>> rev;
+    std::vector<size_t> groups;
+    for (int pass = 0; pass < npass; pass++) {
+        float pass_alpha = n0 == 0 && pass == 0 ? 1.0f : alpha;
+        size_t bs = n0 == 0 && pass == 0 ? 1 : batch_size;
+        for (size_t k0 = 0; k0 < perm.size();) {
+            size_t k1 = std::min(k0 + bs, perm.size());
+            out.resize(k1 - k0);
+
+            // the candidates of the batch, searched in the frozen graph
+#pragma omp parallel
+            {
+                std::unique_ptr<DistanceComputer> dis(
+                        storage.get_distance_computer());
+                VisitedTable vt(n);
+                std::vector<float> x(d);
+                std::vector<Candidate> cands;
+#pragma omp for schedule(dynamic)
+                for (idx_t k = k0; k < k1; k++) {
+                    storage_idx_t i = perm[k];
+                    storage.reconstruct(i, x.data());
+                    dis->set_query(x.data());
+                    cands.clear();
+                    greedy_search(*dis, graph, R, entry, L, vt, cands);
+                    const storage_idx_t* row = graph + size_t(i) * R;
+                    for (int r = 0; r < R && row[r] >= 0; r++) {
+                        cands.emplace_back((*dis)(row[r]), row[r]);
+                    }
+                    robust_prune(*dis, i, cands, pass_alpha, R, out[k - k0]);
+                }
+            }
+
+            // the out-lists of the batch
+            rev.clear();
+            for (size_t k = k0; k < k1; k++) {
+                storage_idx_t i = perm[k];
+                const auto& l = out[k - k0];
+                storage_idx_t* row = graph + size_t(i) * R;
+                std::copy(l.begin(), l.end(), row);
+                std::fill(row + l.size(), row + R, -1);
+                for (storage_idx_t v : l) {
+                    rev.emplace_back(v, i);
+                }
+            }
+
+            // the reverse edges, grouped by destination
+            std::sort(rev.begin(), rev.end());
+            groups.clear();
+            for (size_t j = 0; j < rev.size(); j++) {
+                if (j == 0 || rev[j].first != rev[j - 1].first) {
+                    groups.push_back(j);
+                }
+            }
+            groups.push_back(rev.size());
+#pragma omp parallel
+            {
+                std::unique_ptr<DistanceComputer> dis(
+                        storage.get_distance_computer());
+                std::vector<Candidate> cands;
+                std::vector<storage_idx_t> l;
+#pragma omp for schedule(dynamic)
+                for (idx_t g = 0; g < idx_t(groups.size()) - 1; g++) {
+                    storage_idx_t v = rev[groups[g]].first;
+                    storage_idx_t* row = graph + size_t(v) * R;
+                    l.clear();
+                    for (int r = 0; r < R && row[r] >= 0; r++) {
+                        l.push_back(row[r]);
+                    }
+                    for (size_t j = groups[g]; j < groups[g + 1]; j++) {
+                        storage_idx_t u = rev[j].second;
+                        if (std::find(l.begin(), l.end(), u) == l.end()) {
+                            l.push_back(u);
+                        }
+                    }
+                    if (l.size() > R) {
+                        cands.clear();
+                        for (storage_idx_t u : l) {
+                            cands.emplace_back(dis->symmetric_dis(v, u), u);
+                        }
+                        robust_prune(*dis, v, cands, pass_alpha, R, l);
+                    }
+                    std::copy(l.begin(), l.end(), row);
+                    std::fill(row + l.size(), row + R, -1);
+                }
+            }
+
+            k0 = k1;
+            if (n0 == 0 && pass == 0) {
+                bs = std::min(2 * bs, batch_size);
+            }
+        }
+    }
+}
+
+} // namespace vamana
+
+} // namespace faiss
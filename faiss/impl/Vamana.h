@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+struct Index;
+struct DistanceComputer;
+struct VisitedTable;
+
+/** Construction of the Vamana graph of DiskANN
+ *
+ * DiskANN: Fast Accurate Billion-point Nearest Neighbor Search on a Single
+ * Node, Subramanya et al., NeurIPS 2019
+ *
+ * The graph is a single layer with out-degrees <= R. It is stored as rows of
+ * R neighbors padded with -1, the layout of level 0 of an HNSW whose levels
+ * are all 1 (see IndexVamana).
+ */
+namespace vamana {
+
+typedef int32_t storage_idx_t;
+
+/// distance to the reference node or query, node id
+typedef std::pair<float, storage_idx_t> Candidate;
+
+/** RobustPrune: keeps the closest candidate, discards the candidates that
+ * are alpha times closer to it than to node i and repeats, until R nodes
+ * are kept. The distances of cands are to node i (L2), cands is sorted and
+ * deduplicated in place. out may be the list the candidates come from. */
+void robust_prune(
+        DistanceComputer& dis,
+        storage_idx_t i,
+        std::vector<Candidate>& cands,
+        float alpha,
+        int R,
+        std::vector<storage_idx_t>& out);
+
+/** beam search of width L from entry, for the query set in dis. Appends
+ * the expanded nodes to expanded. */
+void greedy_search(
+        DistanceComputer& dis,
+        const storage_idx_t* graph,
+        int R,
+        storage_idx_t entry,
+        int L,
+        VisitedTable& vt,
+        std::vector<Candidate>& expanded);
+
+/// the vector closest to the mean of the n vectors x, stored in index
+storage_idx_t find_medoid(const Index& index, idx_t n, const float* x);
+
+/** Links the nodes [n0, ntotal) of storage in the graph, whose nodes < n0
+ * are already linked. The nodes of a batch of at most batch_size nodes
+ * search their candidates from entry in parallel, in the graph as it was
+ * before the batch. Then their out-lists and reverse edges are applied,
+ * grouped by destination node so that each row is written by one thread.
+ *
+ * If n0 == 0, the graph is built in two passes, the first one with
+ * alpha = 1 and batches of doubling size starting at entry, the second one
+ * over all the nodes with alpha. Otherwise the new nodes are inserted in a
+ * single pass with alpha, as in FreshDiskANN.
+ *
+ * @param graph  storage.ntotal rows of R neighbors
+ */
+void build_graph(
+        const Index& storage,
+        idx_t n0,
+        int R,
+        int L,
+        float alpha,
+        size_t batch_size,
+        storage_idx_t entry,
+        storage_idx_t* graph);
+
+} // namespace vamana
+
+} // namespace faiss
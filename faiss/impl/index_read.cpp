@@ -10,6 +10,7 @@
 
 #include <faiss/impl/io_macros.h>
 
+#include <algorithm>
 #include <cstdio> // For ftell, fseek
 #include <cstdlib>
 #include <optional>
@@ -17,14 +18,18 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/io.h>
 #include <faiss/impl/io_macros.h>
+#include <faiss/impl/pq_wide_fast_scan.h>
+#include <faiss/utils/distances_int8.h>
 #include <faiss/utils/hamming.h>
 
 #include <faiss/invlists/InvertedListsIOHook.h>
 
 #include <faiss/Index2Layer.h>
+#include <faiss/IndexAdaptiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatOnDisk.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFAdditiveQuantizer.h>
@@ -35,6 +40,7 @@
 #include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
 #include <faiss/IndexIVFRaBitQ.h>
+#include <faiss/IndexIVFRecompute.h>
 #include <faiss/IndexIVFSpectralHash.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexLattice.h>
@@ -42,11 +48,16 @@
 #include <faiss/IndexNSG.h>
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexPQFastScan.h>
+#include <faiss/IndexAdditiveQuantizerWideFastScan.h>
+#include <faiss/IndexPQWideFastScan.h>
 #include <faiss/IndexPreTransform.h>
+#include <faiss/IndexPrefixRefine.h>
 #include <faiss/IndexRaBitQ.h>
+#include <faiss/IndexRaBitQFastScan.h>
 #include <faiss/IndexRefine.h>
 #include <faiss/IndexRowwiseMinMax.h>
 #include <faiss/IndexScalarQuantizer.h>
+#include <faiss/IndexVamana.h>
 #include <faiss/MetaIndexes.h>
 #include <faiss/VectorTransform.h>
 
@@ -60,6 +71,7 @@
 #include <faiss/impl/maybe_owned_vector.h>
 
 #include <faiss/impl/mapped_io.h>
+#include <faiss/impl/sectioned_io.h>
 #include <faiss/impl/zerocopy_io.h>
 #include <cinttypes>
 
@@ -152,11 +164,48 @@ bool read_vector_base(
 
             return true;
         }
+
+        // is it a mmap-ed sectioned file?
+        SectionedFileIOReader* sr = dynamic_cast<SectionedFileIOReader*>(f);
+        if (sr != nullptr && sr->mmap_owner) {
+            size_t size = 0;
+            if (beforeknown_size.has_value()) {
+                size = beforeknown_size.value();
+            } else {
+                READANDCHECK(&size, 1);
+            }
+            size *= size_multiplier.value_or(1);
+
+            char* address = nullptr;
+            size_t nread = sr->get_view(
+                    (void**)&address,
+                    sizeof(typename VectorT::value_type),
+                    size);
+            FAISS_THROW_IF_NOT_FMT(
+                    nread == size,
+                    "read error in %s: %zd != %zd",
+                    f->name.c_str(),
+                    nread,
+                    size);
+
+            target = VectorT::create_view(address, nread, sr->mmap_owner);
+            return true;
+        }
     }
 
     return false;
 }
 
+/// do the MaybeOwnedVectors read from f become views of the input?
+static bool is_view_reader(IOReader* f) {
+    if (dynamic_cast<MappedFileIOReader*>(f) ||
+        dynamic_cast<ZeroCopyIOReader*>(f)) {
+        return true;
+    }
+    SectionedFileIOReader* sr = dynamic_cast<SectionedFileIOReader*>(f);
+    return sr && sr->mmap_owner;
+}
+
 // a replacement for READANDCHECK for reading data into std::vector
 template <typename VectorT>
 void read_vector_with_known_size(VectorT& target, IOReader* f, size_t size) {
@@ -264,6 +313,12 @@ VectorTransform* read_VectorTransform(IOReader* f) {
         CenteringTransform* ct = new CenteringTransform();
         READVECTOR(ct->mean);
         vt = ct;
+    } else if (h == fourcc("HaRo")) {
+        HadamardRotation* hr = new HadamardRotation();
+        READ1(hr->nrounds);
+        READ1(hr->seed);
+        FAISS_THROW_IF_NOT(hr->nrounds > 0);
+        vt = hr;
     } else if (h == fourcc("Viqt")) {
         ITQTransform* itqt = new ITQTransform();
 
@@ -293,6 +348,10 @@ VectorTransform* read_VectorTransform(IOReader* f) {
     READ1(vt->d_in);
     READ1(vt->d_out);
     READ1(vt->is_trained);
+    if (auto hr = dynamic_cast<HadamardRotation*>(vt)) {
+        // the signs are not stored
+        hr->init();
+    }
     return vt;
 }
 
@@ -340,16 +399,49 @@ InvertedLists* read_InvertedLists(IOReader* f, int io_flags) {
             ails->ids[i].resize(sizes[i]);
             ails->codes[i].resize(sizes[i] * ails->code_size);
         }
-        for (size_t i = 0; i < ails->nlist; i++) {
-            size_t n = ails->ids[i].size();
-            if (n > 0) {
-                read_vector_with_known_size(
-                        ails->codes[i], f, n * ails->code_size);
-                read_vector_with_known_size(ails->ids[i], f, n);
+        if (is_view_reader(f)) {
+            for (size_t i = 0; i < ails->nlist; i++) {
+                size_t n = ails->ids[i].size();
+                if (n > 0) {
+                    read_vector_with_known_size(
+                            ails->codes[i], f, n * ails->code_size);
+                    read_vector_with_known_size(ails->ids[i], f, n);
+                }
+            }
+        } else {
+            // copy all the lists in one batch, that can be read in parallel
+            std::vector<void*> ptrs;
+            std::vector<size_t> nbytes;
+            for (size_t i = 0; i < ails->nlist; i++) {
+                size_t n = ails->ids[i].size();
+                if (n > 0) {
+                    ptrs.push_back(ails->codes[i].data());
+                    nbytes.push_back(ails->codes[i].size());
+                    ptrs.push_back(ails->ids[i].data());
+                    nbytes.push_back(n * sizeof(idx_t));
+                }
             }
+            f->read_batch(ptrs.size(), ptrs.data(), nbytes.data());
         }
         return ails;
 
+    } else if (h == fourcc("ilac")) {
+        // ArrayInvertedLists with compressed ids
+        std::unique_ptr<ArrayInvertedLists> ails(new ArrayInvertedLists(0, 0));
+        READ1(ails->nlist);
+        READ1(ails->code_size);
+        ails->ids.resize(ails->nlist);
+        ails->codes.resize(ails->nlist);
+        ails->compressed_ids.resize(ails->nlist);
+        for (size_t i = 0; i < ails->nlist; i++) {
+            size_t n;
+            READ1(n);
+            ails->codes[i].resize(n * ails->code_size);
+            read_vector_with_known_size(ails->codes[i], f, n * ails->code_size);
+            read_CompressedIDs(ails->compressed_ids[i], f);
+            FAISS_THROW_IF_NOT(ails->compressed_ids[i].size() == n);
+        }
+        return ails.release();
     } else if (h == fourcc("ilar") && (io_flags & IO_FLAG_SKIP_IVF_DATA)) {
         // code is always ilxx where xx is specific to the type of invlists we
         // want so we get the 16 high bits from the io_flag and the 16 low bits
@@ -384,7 +476,7 @@ void read_ProductQuantizer(ProductQuantizer* pq, IOReader* f) {
     READ1(pq->M);
     READ1(pq->nbits);
     pq->set_derived_values();
-    READVECTOR(pq->centroids);
+    read_vector(pq->centroids, f);
 }
 
 static void read_ResidualQuantizer_old(ResidualQuantizer* rq, IOReader* f) {
@@ -506,18 +598,13 @@ void read_ScalarQuantizer(ScalarQuantizer* ivsc, IOReader* f) {
         (count_var) += sizeof(var);               \
     } while (0)
 
-// Modified version of READVECTOR
-#define READVECTOR_AND_COUNT(vec, count_var, reader_f)               \
-    do {                                                             \
-        size_t size;                                                 \
-        READANDCHECK(&size, 1);                                      \
-        (count_var) += sizeof(size_t);                               \
-        FAISS_THROW_IF_NOT(size >= 0 && size < (uint64_t{1} << 40)); \
-        (vec).resize(size);                                          \
-        size_t bytes_to_read =                                       \
-                size * sizeof(typename decltype(vec)::value_type);   \
-        READANDCHECK((vec).data(), size);                            \
-        (count_var) += bytes_to_read;                                \
+// Modified version of READVECTOR, that also counts the bytes. The
+// MaybeOwnedVectors are views of the data for mmap-ed and zero-copy readers
+#define READVECTOR_AND_COUNT(vec, count_var, reader_f)                \
+    do {                                                              \
+        read_vector(vec, reader_f);                                   \
+        size_t elt_size = sizeof(typename decltype(vec)::value_type); \
+        (count_var) += sizeof(size_t) + (vec).size() * elt_size;      \
     } while (0)
 
 static void read_HNSW(
@@ -565,6 +652,10 @@ static void read_HNSW(
         FileIOReader* file_reader_nc = dynamic_cast<FileIOReader*>(f);
         MappedFileIOReader* mmap_reader_nc =
                 dynamic_cast<MappedFileIOReader*>(f);
+        SectionedFileIOReader* sectioned_reader_nc =
+                dynamic_cast<SectionedFileIOReader*>(f);
+        ZeroCopyIOReader* zerocopy_reader_nc =
+                dynamic_cast<ZeroCopyIOReader*>(f);
 
         off_t pos_before_probe = -1;
         if (file_reader_nc) {
@@ -577,6 +668,11 @@ static void read_HNSW(
             }
         } else if (mmap_reader_nc) {
             pos_before_probe = (off_t)mmap_reader_nc->pos;
+        } else if (sectioned_reader_nc) {
+            // the probed byte is in the stream section
+            pos_before_probe = (off_t)sectioned_reader_nc->stream_pos;
+        } else if (zerocopy_reader_nc) {
+            pos_before_probe = (off_t)zerocopy_reader_nc->rp_;
         }
         // else: maybe print warning or throw for unknown reader if rewind is
         // needed
@@ -622,6 +718,10 @@ static void read_HNSW(
             } else if (mmap_reader_nc) {
                 mmap_reader_nc->pos = pos_before_probe;
                 printf("[READ_HNSW] Reset MappedFileIOReader pos to original position.\n");
+            } else if (sectioned_reader_nc) {
+                sectioned_reader_nc->stream_pos = pos_before_probe;
+            } else if (zerocopy_reader_nc) {
+                zerocopy_reader_nc->rp_ = pos_before_probe;
             } else {
                 FAISS_THROW_MSG("Cannot rewind unknown reader type.");
             }
@@ -629,7 +729,7 @@ static void read_HNSW(
         // --- END INSERTED CODE ---
 
         // --- Read Original Storage data ---
-        READVECTOR(hnsw->offsets);
+        read_vector(hnsw->offsets, f);
         // Use the specific read_vector function for MaybeOwnedVector
         read_vector(hnsw->neighbors, f);
         printf("[READ_HNSW] Original Storage sizes: offsets=%zd, neighbors=%zd\n",
@@ -644,8 +744,46 @@ static void read_HNSW(
 
     // hnsw->max_level = 0;
 
-    READ1_DUMMY(int)
-    calculated_offset += sizeof(int);
+    // deprecated upper_beam field, the bits 2, 4 and 8 flag the optional
+    // sections that follow
+    int upper_beam;
+    READ1_AND_COUNT(upper_beam, calculated_offset, f);
+    if (upper_beam & 2) {
+        uint32_t h;
+        READ1(h);
+        FAISS_THROW_IF_NOT_MSG(
+                h == fourcc("HPQp"), "invalid HNSW PQ pruning data");
+        int metric;
+        READ1(metric);
+        hnsw->pruning_metric = (MetricType)metric;
+        hnsw->pruning_pq = std::make_shared<ProductQuantizer>();
+        read_ProductQuantizer(hnsw->pruning_pq.get(), f);
+        READ1(hnsw->code_size);
+        // a view of the file with a MappedFileIOReader
+        read_vector(hnsw->pq_codes, f);
+        FAISS_THROW_IF_NOT(
+                hnsw->pq_codes.size() == hnsw->code_size * hnsw->levels.size());
+        hnsw->pq_loaded = true;
+    }
+    if (upper_beam & 4) {
+        uint32_t h;
+        READ1(h);
+        FAISS_THROW_IF_NOT_MSG(
+                h == fourcc("HESp"), "invalid HNSW early termination data");
+        READ1(hnsw->early_stop_patience);
+        READ1(hnsw->early_stop_target_recall);
+    }
+    if (upper_beam & 8) {
+        uint32_t h;
+        READ1(h);
+        FAISS_THROW_IF_NOT_MSG(h == fourcc("HDLp"), "invalid HNSW tombstones");
+        READVECTOR(hnsw->deleted);
+        FAISS_THROW_IF_NOT(hnsw->deleted.size() == hnsw->levels.size());
+        hnsw->n_deleted = std::count_if(
+                hnsw->deleted.begin(), hnsw->deleted.end(), [](uint8_t v) {
+                    return v != 0;
+                });
+    }
 
     printf("[read_HNSW NL v4] Read entry_point: %ld, max_level: %d\n",
            (long)hnsw->entry_point,
@@ -655,6 +793,23 @@ static void read_HNSW(
         uint32_t storage_fourcc;
         READ1_AND_COUNT(storage_fourcc, calculated_offset, f);
         printf("[read_HNSW NL v4] Read storage fourcc: 0x%x\n", storage_fourcc);
+        FAISS_THROW_IF_NOT_MSG(
+                storage_fourcc == fourcc("CSRn") ||
+                        storage_fourcc == fourcc("CSRz"),
+                "unknown HNSW neighbors storage fourcc");
+        // compressed lists: the byte offsets of the lists precede the data
+        hnsw->compress_neighbors = storage_fourcc == fourcc("CSRz");
+        if (hnsw->compress_neighbors) {
+            READVECTOR_AND_COUNT(
+                    hnsw->compressed_level_ptr, calculated_offset, f);
+            FAISS_THROW_IF_NOT(
+                    hnsw->compressed_level_ptr.size() ==
+                    hnsw->compact_level_ptr.size());
+        }
+        // size of the elements of the neighbors data
+        size_t neighbor_elt_size = hnsw->compress_neighbors
+                ? sizeof(uint8_t)
+                : sizeof(HNSW::storage_idx_t);
 
         // Attempt to determine the reader type
         FileIOReader* file_reader = dynamic_cast<FileIOReader*>(f);
@@ -727,7 +882,7 @@ static void read_HNSW(
 
                 // Calculate bytes to skip
                 size_t neighbors_bytes =
-                        neighbors_size_field * sizeof(HNSW::storage_idx_t);
+                        neighbors_size_field * neighbor_elt_size;
 
                 // Skip past the neighbor data
                 if (fseek(file_reader->f, neighbors_bytes, SEEK_CUR) != 0) {
@@ -773,7 +928,7 @@ static void read_HNSW(
 
                 // Calculate bytes to skip and the end position
                 size_t neighbors_bytes =
-                        neighbors_size_field * sizeof(HNSW::storage_idx_t);
+                        neighbors_size_field * neighbor_elt_size;
                 size_t end_pos = mmap_reader->pos + neighbors_bytes;
 
                 // Check boundary
@@ -803,8 +958,32 @@ static void read_HNSW(
             // Read neighbors into memory as before
             hnsw->neighbors_on_disk = false;
             hnsw->neighbors_use_mmap = false;
-            READVECTOR_AND_COUNT(
-                    hnsw->compact_neighbors_data, calculated_offset, f);
+            if (hnsw->compress_neighbors) {
+                std::vector<uint8_t> data;
+                READVECTOR_AND_COUNT(data, calculated_offset, f);
+                size_t n_ptr = hnsw->compact_level_ptr.size();
+                std::vector<HNSW::storage_idx_t> lists(
+                        n_ptr > 0 ? hnsw->compact_level_ptr[n_ptr - 1] : 0);
+                for (size_t j = 0; j + 1 < n_ptr; j++) {
+                    size_t begin = hnsw->compact_level_ptr[j];
+                    size_t end = hnsw->compact_level_ptr[j + 1];
+                    FAISS_THROW_IF_NOT(
+                            begin <= end && end <= lists.size() &&
+                            hnsw->compressed_level_ptr[j] <=
+                                    hnsw->compressed_level_ptr[j + 1] &&
+                            hnsw->compressed_level_ptr[j + 1] <= data.size());
+                    HNSW::decode_neighbor_list(
+                            data.data() + hnsw->compressed_level_ptr[j],
+                            end - begin,
+                            lists.data() + begin);
+                }
+                hnsw->compact_neighbors_data =
+                        MaybeOwnedVector<HNSW::storage_idx_t>(std::move(lists));
+                hnsw->compressed_level_ptr = MaybeOwnedVector<size_t>();
+            } else {
+                READVECTOR_AND_COUNT(
+                        hnsw->compact_neighbors_data, calculated_offset, f);
+            }
             printf("[read_HNSW NL v4] Read neighbors data, size: %zd\n",
                    hnsw->compact_neighbors_data.size());
         }
@@ -857,7 +1036,7 @@ static void read_NNDescent(NNDescent* nnd, IOReader* f) {
     READ1(nnd->random_seed);
     READ1(nnd->has_built);
 
-    READVECTOR(nnd->final_graph);
+    read_vector(nnd->final_graph, f);
 }
 
 ProductQuantizer* read_ProductQuantizer(const char* fname) {
@@ -878,20 +1057,46 @@ static void read_RaBitQuantizer(RaBitQuantizer* rabitq, IOReader* f) {
     // don't care about rabitq->centroid
     READ1(rabitq->d);
     READ1(rabitq->code_size);
+    // the nb of bits is not serialized, it follows from the code size
+    rabitq->nb_bits = RaBitQuantizer::get_nb_bits(rabitq->d, rabitq->code_size);
+    FAISS_THROW_IF_NOT_FMT(
+            rabitq->nb_bits > 0,
+            "invalid RaBitQ code size %zd for d=%zd",
+            rabitq->code_size,
+            rabitq->d);
+}
+
+static void read_IdHashMap(IdHashMap* map, IOReader* f) {
+    READ1(map->nentry);
+    READ1(map->nused);
+    read_vector(map->ctrl, f);
+    read_vector(map->keys, f);
+    read_vector(map->values, f);
+    size_t cap = map->capacity();
+    FAISS_THROW_IF_NOT_FMT(
+            (cap & (cap - 1)) == 0 && map->keys.size() == cap &&
+                    map->values.size() == cap && map->nentry <= map->nused &&
+                    (cap == 0 ? map->nused == 0 : map->nused < cap),
+            "invalid hash map in %s",
+            f->name.c_str());
 }
 
 void read_direct_map(DirectMap* dm, IOReader* f) {
     char maintain_direct_map;
     READ1(maintain_direct_map);
-    dm->type = (DirectMap::Type)maintain_direct_map;
-    READVECTOR(dm->array);
-    if (dm->type == DirectMap::Hashtable) {
+    // 3 is a hashtable stored as an IdHashMap
+    dm->type = maintain_direct_map == 3 ? DirectMap::Hashtable
+                                        : (DirectMap::Type)maintain_direct_map;
+    read_vector(dm->array, f);
+    if (maintain_direct_map == 3) {
+        read_IdHashMap(&dm->hashtable, f);
+    } else if (dm->type == DirectMap::Hashtable) {
         std::vector<std::pair<idx_t, idx_t>> v;
         READVECTOR(v);
-        std::unordered_map<idx_t, idx_t>& map = dm->hashtable;
+        IdHashMap& map = dm->hashtable;
         map.reserve(v.size());
         for (auto it : v) {
-            map[it.first] = it.second;
+            map.set(it.first, it.second);
         }
     }
 }
@@ -963,7 +1168,7 @@ static IndexIVFPQ* read_ivfpq(IOReader* f, uint32_t h, int io_flags) {
         }
         if (ivfpqr) {
             read_ProductQuantizer(&ivfpqr->refine_pq, f);
-            READVECTOR(ivfpqr->refine_codes);
+            read_vector(ivfpqr->refine_codes, f);
             READ1(ivfpqr->k_factor);
         }
     }
@@ -999,6 +1204,41 @@ Index* read_index(
                 idxf->codes.size() == idxf->ntotal * idxf->code_size);
         // leak!
         idx = idxf;
+    } else if (h == fourcc("IxAQ")) {
+        IndexAdaptiveQuantizer* idxaq = new IndexAdaptiveQuantizer();
+        read_index_header(idxaq, f);
+        idxaq->code_size = idxaq->d * sizeof(float);
+        read_xb_vector(idxaq->codes, f);
+        FAISS_THROW_IF_NOT(
+                idxaq->codes.size() == idxaq->ntotal * idxaq->code_size);
+        int accel_type;
+        READ1(accel_type);
+        idxaq->accel_type = IndexAdaptiveQuantizer::AccelType(accel_type);
+        READ1(idxaq->min_accel_size);
+        READ1(idxaq->hnsw_min_size);
+        READ1(idxaq->hnsw_M);
+        READ1(idxaq->efSearch);
+        READ1(idxaq->k_factor);
+        READ1(idxaq->pq_dsub);
+        READ1(idxaq->batch_size);
+        idxaq->accel = read_index(f, io_flags);
+        idx = idxaq;
+    } else if (h == fourcc("IxFb")) {
+        IndexFlatBF16* idxf = new IndexFlatBF16();
+        read_index_header(idxf, f);
+        idxf->code_size = idxf->d * sizeof(uint16_t);
+        read_vector(idxf->codes, f);
+        FAISS_THROW_IF_NOT(
+                idxf->codes.size() == idxf->ntotal * idxf->code_size);
+        idx = idxf;
+    } else if (h == fourcc("IxF8")) {
+        IndexFlatInt8* idxf = new IndexFlatInt8();
+        read_index_header(idxf, f);
+        idxf->code_size = int8_code_size(idxf->d);
+        read_vector(idxf->codes, f);
+        FAISS_THROW_IF_NOT(
+                idxf->codes.size() == idxf->ntotal * idxf->code_size);
+        idx = idxf;
     } else if (h == fourcc("IxHE") || h == fourcc("IxHe")) {
         IndexLSH* idxl = new IndexLSH();
         read_index_header(idxl, f);
@@ -1319,6 +1559,11 @@ Index* read_index(
         READVECTOR(ivsp->trained);
         read_InvertedLists(ivsp, f, io_flags);
         idx = ivsp;
+    } else if (h == fourcc("IwId")) {
+        IndexIVFIDOnly* ivid = new IndexIVFIDOnly();
+        read_ivf_header(ivid, f);
+        read_InvertedLists(ivid, f, io_flags);
+        idx = ivid;
     } else if (
             h == fourcc("IvPQ") || h == fourcc("IvQR") || h == fourcc("IwPQ") ||
             h == fourcc("IwQR")) {
@@ -1359,6 +1604,30 @@ Index* read_index(
         read_index_header(imiq, f);
         read_ProductQuantizer(&imiq->pq, f);
         idx = imiq;
+    } else if (h == fourcc("IxFD")) {
+        IndexFlatOnDisk header;
+        read_index_header(&header, f);
+        std::vector<char> path;
+        READVECTOR(path);
+        int64_t offset;
+        READ1(offset);
+        std::unique_ptr<IndexFlatOnDisk> idxfd(new IndexFlatOnDisk(
+                header.d,
+                std::string(path.begin(), path.end()),
+                header.metric_type,
+                offset));
+        FAISS_THROW_IF_NOT_FMT(
+                idxfd->ntotal == header.ntotal,
+                "vector file %s holds %" PRId64 " vectors, expected %" PRId64,
+                idxfd->filename.c_str(),
+                idxfd->ntotal,
+                header.ntotal);
+        READ1(idxfd->use_direct_io);
+        READ1(idxfd->search_block_size);
+        std::vector<idx_t> cached_ids;
+        READVECTOR(cached_ids);
+        idxfd->cache_vectors(cached_ids);
+        idx = idxfd.release();
     } else if (h == fourcc("IxRF")) {
         IndexRefine* idxrf = new IndexRefine();
         read_index_header(idxrf, f);
@@ -1375,14 +1644,40 @@ Index* read_index(
         idxrf->own_fields = true;
         idxrf->own_refine_index = true;
         idx = idxrf;
-    } else if (h == fourcc("IxMp") || h == fourcc("IxM2")) {
-        bool is_map2 = h == fourcc("IxM2");
+    } else if (h == fourcc("IxPx")) {
+        IndexPrefixRefine* idxpr = new IndexPrefixRefine();
+        read_index_header(idxpr, f);
+        READ1(idxpr->d_prefix);
+        READ1(idxpr->k_factor);
+        idxpr->base_index = read_index(f, io_flags);
+        idxpr->suffix_index = read_index(f, io_flags);
+        idxpr->own_fields = true;
+        idx = idxpr;
+    } else if (h == fourcc("IxRc")) {
+        IndexIVFRecompute* idxrc = new IndexIVFRecompute();
+        read_index_header(idxrc, f);
+        READ1(idxrc->k_factor);
+        READ1(idxrc->max_rerank);
+        READ1(idxrc->zmq_port);
+        Index* base_index = read_index(f, io_flags);
+        idxrc->base_index = dynamic_cast<IndexIVF*>(base_index);
+        FAISS_THROW_IF_NOT_MSG(
+                idxrc->base_index, "IndexIVFRecompute needs an IndexIVF");
+        idxrc->own_fields = true;
+        idx = idxrc;
+    } else if (
+            h == fourcc("IxMp") || h == fourcc("IxM2") ||
+            h == fourcc("IxMh")) {
+        bool is_map2 = h != fourcc("IxMp");
         IndexIDMap* idxmap = is_map2 ? new IndexIDMap2() : new IndexIDMap();
         read_index_header(idxmap, f);
-        idxmap->index = read_index(f, io_flags);
+        // the wrapped index may be a compact HNSW
+        idxmap->index = read_index(f, io_flags, hnsw_config);
         idxmap->own_fields = true;
-        READVECTOR(idxmap->id_map);
-        if (is_map2) {
+        read_vector(idxmap->id_map, f);
+        if (h == fourcc("IxMh")) {
+            read_IdHashMap(&static_cast<IndexIDMap2*>(idxmap)->rev_map, f);
+        } else if (is_map2) {
             static_cast<IndexIDMap2*>(idxmap)->construct_rev_map();
         }
         idx = idxmap;
@@ -1400,18 +1695,23 @@ Index* read_index(
         idx = idxp;
     } else if (
             h == fourcc("IHNf") || h == fourcc("IHNp") || h == fourcc("IHNs") ||
-            h == fourcc("IHN2") || h == fourcc("IHNc")) {
+            h == fourcc("IHN2") || h == fourcc("IHNc") || h == fourcc("IHNv") ||
+            h == fourcc("IHNq")) {
         IndexHNSW* idxhnsw = nullptr;
         if (h == fourcc("IHNf"))
             idxhnsw = new IndexHNSWFlat();
         if (h == fourcc("IHNp"))
             idxhnsw = new IndexHNSWPQ();
+        if (h == fourcc("IHNq"))
+            idxhnsw = new IndexHNSWPQFastScan();
         if (h == fourcc("IHNs"))
             idxhnsw = new IndexHNSWSQ();
         if (h == fourcc("IHN2"))
             idxhnsw = new IndexHNSW2Level();
         if (h == fourcc("IHNc"))
             idxhnsw = new IndexHNSWCagra();
+        if (h == fourcc("IHNv"))
+            idxhnsw = new IndexVamana();
         read_index_header(idxhnsw, f);
         if (h == fourcc("IHNc")) {
             READ1(idxhnsw->keep_max_size_level0);
@@ -1419,21 +1719,53 @@ Index* read_index(
             READ1(idx_hnsw_cagra->base_level_only);
             READ1(idx_hnsw_cagra->num_base_level_search_entrypoints);
         }
+        if (h == fourcc("IHNv")) {
+            auto idx_vamana = dynamic_cast<IndexVamana*>(idxhnsw);
+            READ1(idx_vamana->build_L);
+            READ1(idx_vamana->alpha);
+            READ1(idx_vamana->build_batch_size);
+            READ1(idx_vamana->pq_m);
+            READ1(idxhnsw->hnsw.pq_pruning_ratio);
+        }
         read_HNSW(&idxhnsw->hnsw, f, hnsw_config);
 
         if (hnsw_config.is_recompute) {
             printf("INFO: Skipping external storage loading, since is_recompute is true.\n");
             idxhnsw->is_recompute = true;
 
-            // even if is_recompute is true, when disk cache is on, we need to
-            // set the offset to the external storage path
-            if (hnsw_config.disk_cache_ratio > 0) {
-                setup_experimental_top_degree_disk_read(
-                        "/opt/dlami/nvme/scaling_out/indices/rpj_wiki/facebook/contriever-msmarco/hnsw/degree_distribution.txt",
-                        hnsw_config.disk_cache_ratio,
+            // even if is_recompute is true, when disk cache is on, the top
+            // degree nodes are served from the external storage
+            if (hnsw_config.hybrid_store_path) {
+                idxhnsw->hybrid_store.reset(HybridEmbeddingStore::read(
+                        hnsw_config.hybrid_store_path));
+                FAISS_THROW_IF_NOT_MSG(
+                        idxhnsw->hybrid_store->d == (size_t)idxhnsw->d &&
+                                idxhnsw->hybrid_store->ntotal ==
+                                        idxhnsw->ntotal,
+                        "hybrid embedding store does not match the index");
+            } else if (hnsw_config.disk_cache_ratio > 0) {
+                FAISS_THROW_IF_NOT_MSG(
+                        hnsw_config.external_storage_path,
+                        "disk_cache_ratio > 0 requires external_storage_path");
+                std::vector<int32_t> degrees = hnsw_config.degree_path
+                        ? HybridEmbeddingStore::read_degree_file(
+                                  hnsw_config.degree_path)
+                        : idxhnsw->hnsw.get_degrees(0);
+                idxhnsw->hybrid_store = std::make_shared<HybridEmbeddingStore>(
+                        idxhnsw->d,
+                        idxhnsw->ntotal,
                         hnsw_config.external_storage_path,
-                        45,
-                        idxhnsw->ntotal);
+                        HybridEmbeddingStore::flat_storage_data_offset(
+                                hnsw_config.external_storage_path),
+                        hnsw_config.hybrid_store_in_ram
+                                ? HybridEmbeddingStore::TIER_RAM
+                                : HybridEmbeddingStore::TIER_SSD);
+                idxhnsw->hybrid_store->pin_top(
+                        degrees, hnsw_config.disk_cache_ratio);
+                printf("INFO: Hybrid embedding store: %zd nodes (top %.2f%% by degree) served from %s\n",
+                       idxhnsw->hybrid_store->n_pinned(),
+                       hnsw_config.disk_cache_ratio,
+                       hnsw_config.external_storage_path);
             }
         } else if (hnsw_config.external_storage_path != nullptr) {
             // Load storage from the external file
@@ -1481,8 +1813,18 @@ Index* read_index(
             idxhnsw->storage = read_index(f, io_flags);
         }
 
+        if (hnsw_config.node_blocks_path) {
+            idxhnsw->node_blocks = std::make_shared<HNSWNodeBlocks>(
+                    hnsw_config.node_blocks_path);
+            FAISS_THROW_IF_NOT_MSG(
+                    idxhnsw->node_blocks->d == (size_t)idxhnsw->d &&
+                            idxhnsw->node_blocks->ntotal == idxhnsw->ntotal,
+                    "node blocks do not match the index");
+        }
+
         idxhnsw->own_fields = idxhnsw->storage != nullptr;
-        if (h == fourcc("IHNp") && !(io_flags & IO_FLAG_PQ_SKIP_SDC_TABLE)) {
+        if ((h == fourcc("IHNp") || h == fourcc("IHNq")) &&
+            !(io_flags & IO_FLAG_PQ_SKIP_SDC_TABLE)) {
             dynamic_cast<IndexPQ*>(idxhnsw->storage)->pq.compute_sdc_table();
         }
         idx = idxhnsw;
@@ -1532,6 +1874,62 @@ Index* read_index(
 
         idx = idxpqfs;
 
+    } else if (h == fourcc("IPwf")) {
+        IndexPQWideFastScan* idxpqwfs = new IndexPQWideFastScan();
+        read_index_header(idxpqwfs, f);
+        read_ProductQuantizer(&idxpqwfs->pq, f);
+        READ1(idxpqwfs->qbs);
+        READ1(idxpqwfs->ntotal2);
+        READVECTOR(idxpqwfs->codes);
+        FAISS_THROW_IF_NOT(
+                idxpqwfs->codes.size() ==
+                idxpqwfs->ntotal2 / pqwide_bbs *
+                        pqwide_block_size(idxpqwfs->pq.M, idxpqwfs->pq.nbits));
+        idx = idxpqwfs;
+
+    } else if (
+            h == fourcc("ILwf") || h == fourcc("IRwf") || h == fourcc("IPLw") ||
+            h == fourcc("IPRw")) {
+        IndexAdditiveQuantizerWideFastScan* idxaqwfs;
+        if (h == fourcc("ILwf")) {
+            idxaqwfs = new IndexLocalSearchQuantizerWideFastScan();
+        } else if (h == fourcc("IRwf")) {
+            idxaqwfs = new IndexResidualQuantizerWideFastScan();
+        } else if (h == fourcc("IPLw")) {
+            idxaqwfs = new IndexProductLocalSearchQuantizerWideFastScan();
+        } else {
+            idxaqwfs = new IndexProductResidualQuantizerWideFastScan();
+        }
+        read_index_header(idxaqwfs, f);
+        idx_t ntotal = idxaqwfs->ntotal;
+        bool is_trained = idxaqwfs->is_trained;
+
+        if (h == fourcc("ILwf")) {
+            read_LocalSearchQuantizer((LocalSearchQuantizer*)idxaqwfs->aq, f);
+        } else if (h == fourcc("IRwf")) {
+            read_ResidualQuantizer(
+                    (ResidualQuantizer*)idxaqwfs->aq, f, io_flags);
+        } else if (h == fourcc("IPLw")) {
+            read_ProductLocalSearchQuantizer(
+                    (ProductLocalSearchQuantizer*)idxaqwfs->aq, f);
+        } else {
+            read_ProductResidualQuantizer(
+                    (ProductResidualQuantizer*)idxaqwfs->aq, f, io_flags);
+        }
+        // init sets M2 and checks the quantizer
+        idxaqwfs->init(idxaqwfs->aq, idxaqwfs->metric_type);
+        idxaqwfs->ntotal = ntotal;
+        idxaqwfs->is_trained = is_trained;
+
+        READ1(idxaqwfs->qbs);
+        READ1(idxaqwfs->ntotal2);
+        READVECTOR(idxaqwfs->codes);
+        FAISS_THROW_IF_NOT(
+                idxaqwfs->codes.size() ==
+                idxaqwfs->ntotal2 / pqwide_bbs *
+                        pqwide_block_size(idxaqwfs->M2, 8));
+        idx = idxaqwfs;
+
     } else if (h == fourcc("IwPf")) {
         IndexIVFPQFastScan* ivpq = new IndexIVFPQFastScan();
         read_ivf_header(ivpq, f);
@@ -1569,19 +1967,25 @@ Index* read_index(
         imm->own_fields = true;
 
         idx = imm;
-    } else if (h == fourcc("Ixrq")) {
-        IndexRaBitQ* idxq = new IndexRaBitQ();
+    } else if (h == fourcc("Ixrq") || h == fourcc("Ixrf")) {
+        IndexRaBitQ* idxq = h == fourcc("Ixrf") ? new IndexRaBitQFastScan()
+                                                : new IndexRaBitQ();
         read_index_header(idxq, f);
         read_RaBitQuantizer(&idxq->rabitq, f);
-        READVECTOR(idxq->codes);
+        idxq->rabitq.metric_type = idxq->metric_type;
+        read_vector(idxq->codes, f);
         READVECTOR(idxq->center);
         READ1(idxq->qb);
         idxq->code_size = idxq->rabitq.code_size;
+        if (auto idxqfs = dynamic_cast<IndexRaBitQFastScan*>(idxq)) {
+            idxqfs->repack();
+        }
         idx = idxq;
     } else if (h == fourcc("Iwrq")) {
         IndexIVFRaBitQ* ivrq = new IndexIVFRaBitQ();
         read_ivf_header(ivrq, f);
         read_RaBitQuantizer(&ivrq->rabitq, f);
+        ivrq->rabitq.metric_type = ivrq->metric_type;
         READ1(ivrq->code_size);
         READ1(ivrq->by_residual);
         READ1(ivrq->qb);
@@ -1613,7 +2017,13 @@ Index* read_index(
         const char* fname,
         int io_flags,
         const HNSWIndexConfig& hnsw_config) {
-    if ((io_flags & IO_FLAG_MMAP_IFC) == IO_FLAG_MMAP_IFC) {
+    bool use_mmap = (io_flags & IO_FLAG_MMAP_IFC) == IO_FLAG_MMAP_IFC;
+    if (is_sectioned_file(fname)) {
+        // the views are not checked, to keep the mapping lazy
+        SectionedFileIOReader reader(fname, use_mmap, !use_mmap);
+        return read_index(&reader, io_flags, hnsw_config);
+    }
+    if (use_mmap) {
         // enable mmap-supporting IOReader
         auto owner = std::make_shared<MmappedFileMappingOwner>(fname);
         MappedFileIOReader reader(owner);
@@ -1718,7 +2128,10 @@ static void read_binary_multi_hash_map(
     }
 }
 
-IndexBinary* read_index_binary(IOReader* f, int io_flags) {
+IndexBinary* read_index_binary(
+        IOReader* f,
+        int io_flags,
+        const HNSWIndexConfig& hnsw_config) {
     IndexBinary* idx = nullptr;
     uint32_t h;
     READ1(h);
@@ -1743,19 +2156,24 @@ IndexBinary* read_index_binary(IOReader* f, int io_flags) {
     } else if (h == fourcc("IBHf")) {
         IndexBinaryHNSW* idxhnsw = new IndexBinaryHNSW();
         read_index_binary_header(idxhnsw, f);
-        read_HNSW(&idxhnsw->hnsw, f);
+        read_HNSW(&idxhnsw->hnsw, f, hnsw_config);
         idxhnsw->storage = read_index_binary(f, io_flags);
         idxhnsw->own_fields = true;
         idx = idxhnsw;
-    } else if (h == fourcc("IBMp") || h == fourcc("IBM2")) {
-        bool is_map2 = h == fourcc("IBM2");
+    } else if (
+            h == fourcc("IBMp") || h == fourcc("IBM2") ||
+            h == fourcc("IBMh")) {
+        bool is_map2 = h != fourcc("IBMp");
         IndexBinaryIDMap* idxmap =
                 is_map2 ? new IndexBinaryIDMap2() : new IndexBinaryIDMap();
         read_index_binary_header(idxmap, f);
-        idxmap->index = read_index_binary(f, io_flags);
+        idxmap->index = read_index_binary(f, io_flags, hnsw_config);
         idxmap->own_fields = true;
-        READVECTOR(idxmap->id_map);
-        if (is_map2) {
+        read_vector(idxmap->id_map, f);
+        if (h == fourcc("IBMh")) {
+            read_IdHashMap(
+                    &static_cast<IndexBinaryIDMap2*>(idxmap)->rev_map, f);
+        } else if (is_map2) {
             static_cast<IndexBinaryIDMap2*>(idxmap)->construct_rev_map();
         }
         idx = idxmap;
@@ -1782,6 +2200,16 @@ IndexBinary* read_index_binary(IOReader* f, int io_flags) {
                     idxmh->maps[i], idxmh->b, idxmh->ntotal, f);
         }
         idx = idxmh;
+    } else if (h == fourcc("IBMI")) {
+        IndexBinaryMIH* idxmih = new IndexBinaryMIH();
+        read_index_binary_header(idxmih, f);
+        READ1(idxmih->nhash);
+        READVECTOR(idxmih->xb);
+        FAISS_THROW_IF_NOT(
+                idxmih->nhash > 0 && idxmih->nhash <= idxmih->d &&
+                idxmih->xb.size() == idxmih->ntotal * idxmih->code_size);
+        idxmih->rebuild_tables();
+        idx = idxmih;
     } else {
         FAISS_THROW_FMT(
                 "Index type %08x (\"%s\") not recognized",
@@ -1792,27 +2220,39 @@ IndexBinary* read_index_binary(IOReader* f, int io_flags) {
     return idx;
 }
 
-IndexBinary* read_index_binary(FILE* f, int io_flags) {
+IndexBinary* read_index_binary(
+        FILE* f,
+        int io_flags,
+        const HNSWIndexConfig& hnsw_config) {
     if ((io_flags & IO_FLAG_MMAP_IFC) == IO_FLAG_MMAP_IFC) {
         // enable mmap-supporting IOReader
         auto owner = std::make_shared<MmappedFileMappingOwner>(f);
         MappedFileIOReader reader(owner);
-        return read_index_binary(&reader, io_flags);
+        return read_index_binary(&reader, io_flags, hnsw_config);
     } else {
         FileIOReader reader(f);
-        return read_index_binary(&reader, io_flags);
+        return read_index_binary(&reader, io_flags, hnsw_config);
     }
 }
 
-IndexBinary* read_index_binary(const char* fname, int io_flags) {
-    if ((io_flags & IO_FLAG_MMAP_IFC) == IO_FLAG_MMAP_IFC) {
+IndexBinary* read_index_binary(
+        const char* fname,
+        int io_flags,
+        const HNSWIndexConfig& hnsw_config) {
+    bool use_mmap = (io_flags & IO_FLAG_MMAP_IFC) == IO_FLAG_MMAP_IFC;
+    if (is_sectioned_file(fname)) {
+        SectionedFileIOReader reader(fname, use_mmap, !use_mmap);
+        return read_index_binary(&reader, io_flags, hnsw_config);
+    }
+    if (use_mmap) {
         // enable mmap-supporting IOReader
         auto owner = std::make_shared<MmappedFileMappingOwner>(fname);
         MappedFileIOReader reader(owner);
-        return read_index_binary(&reader, io_flags);
+        return read_index_binary(&reader, io_flags, hnsw_config);
     } else {
         FileIOReader reader(fname);
-        IndexBinary* idx = read_index_binary(&reader, io_flags);
+        IndexBinary* idx =
+                read_index_binary(&reader, io_flags, hnsw_config);
         return idx;
     }
 }
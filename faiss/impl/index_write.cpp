@@ -9,6 +9,7 @@
 
 #include <faiss/impl/io.h>
 #include <faiss/impl/io_macros.h>
+#include <faiss/impl/sectioned_io.h>
 
 #include <cstdio>
 #include <cstdlib>
@@ -20,9 +21,11 @@
 #include <faiss/utils/hamming.h>
 
 #include <faiss/Index2Layer.h>
+#include <faiss/IndexAdaptiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatOnDisk.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFAdditiveQuantizer.h>
@@ -33,6 +36,7 @@
 #include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
 #include <faiss/IndexIVFRaBitQ.h>
+#include <faiss/IndexIVFRecompute.h>
 #include <faiss/IndexIVFSpectralHash.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexLattice.h>
@@ -40,11 +44,16 @@
 #include <faiss/IndexNSG.h>
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexPQFastScan.h>
+#include <faiss/IndexAdditiveQuantizerWideFastScan.h>
+#include <faiss/IndexPQWideFastScan.h>
 #include <faiss/IndexPreTransform.h>
+#include <faiss/IndexPrefixRefine.h>
 #include <faiss/IndexRaBitQ.h>
+#include <faiss/IndexRaBitQFastScan.h>
 #include <faiss/IndexRefine.h>
 #include <faiss/IndexRowwiseMinMax.h>
 #include <faiss/IndexScalarQuantizer.h>
+#include <faiss/IndexVamana.h>
 #include <faiss/MetaIndexes.h>
 #include <faiss/VectorTransform.h>
 
@@ -137,6 +146,13 @@ void write_VectorTransform(const VectorTransform* vt, IOWriter* f) {
         uint32_t h = fourcc("VCnt");
         WRITE1(h);
         WRITEVECTOR(ct->mean);
+    } else if (
+            const HadamardRotation* hr =
+                    dynamic_cast<const HadamardRotation*>(vt)) {
+        uint32_t h = fourcc("HaRo");
+        WRITE1(h);
+        WRITE1(hr->nrounds);
+        WRITE1(hr->seed);
     } else if (
             const ITQTransform* itqt = dynamic_cast<const ITQTransform*>(vt)) {
         uint32_t h = fourcc("Viqt");
@@ -246,6 +262,24 @@ void write_InvertedLists(const InvertedLists* ils, IOWriter* f) {
     if (ils == nullptr) {
         uint32_t h = fourcc("il00");
         WRITE1(h);
+    } else if (
+            const auto& ails = dynamic_cast<const ArrayInvertedLists*>(ils);
+            ails && ails->has_compressed_ids()) {
+        uint32_t h = fourcc("ilac");
+        WRITE1(h);
+        WRITE1(ails->nlist);
+        WRITE1(ails->code_size);
+        for (size_t i = 0; i < ails->nlist; i++) {
+            size_t n = ails->list_size(i);
+            WRITE1(n);
+            WRITEANDCHECK(ails->codes[i].data(), n * ails->code_size);
+            if (ails->is_compressed(i)) {
+                write_CompressedIDs(ails->compressed_ids[i], f);
+            } else {
+                CompressedIDs cids(n, ails->ids[i].data());
+                write_CompressedIDs(cids, f);
+            }
+        }
     } else if (
             const auto& ails = dynamic_cast<const ArrayInvertedLists*>(ils)) {
         uint32_t h = fourcc("ilar");
@@ -309,11 +343,14 @@ static void write_HNSW(const HNSW* hnsw, IOWriter* f) {
 
     if (hnsw->storage_is_compact) {
         // --- Write Compact Storage ---
-        WRITEVECTOR(hnsw->compact_neighbors_data);
+        // the CSR indices come first, the neighbors are written after the
+        // scalar fields so that they can be skipped or read on demand (see
+        // HNSWIndexConfig::is_skip_neighbors)
+        FAISS_THROW_IF_NOT_MSG(
+                !hnsw->neighbors_on_disk,
+                "cannot write neighbors that are not loaded");
         WRITEVECTOR(hnsw->compact_level_ptr);
         WRITEVECTOR(hnsw->compact_node_offsets);
-        // Write empty original storage vectors for compatibility if needed?
-        // Let's assume reader knows based on flag, don't write empty ones.
     } else {
         // --- Write Original Storage ---
         WRITEVECTOR(hnsw->offsets);
@@ -328,8 +365,55 @@ static void write_HNSW(const HNSW* hnsw, IOWriter* f) {
 
     // // deprecated field
     // WRITE1(hnsw->upper_beam);
-    constexpr int tmp_upper_beam = 1;
+    // the bits 2, 4 and 8 flag the optional sections that follow
+    int tmp_upper_beam = 1;
+    if (hnsw->pruning_pq) {
+        tmp_upper_beam |= 2;
+    }
+    if (hnsw->early_stop_patience > 0) {
+        tmp_upper_beam |= 4;
+    }
+    if (hnsw->n_deleted > 0) {
+        tmp_upper_beam |= 8;
+    }
     WRITE1(tmp_upper_beam);
+
+    if (hnsw->pruning_pq) {
+        uint32_t h = fourcc("HPQp");
+        WRITE1(h);
+        int metric = hnsw->pruning_metric;
+        WRITE1(metric);
+        write_ProductQuantizer(hnsw->pruning_pq.get(), f);
+        WRITE1(hnsw->code_size);
+        WRITEVECTOR(hnsw->pq_codes);
+    }
+    if (hnsw->early_stop_patience > 0) {
+        uint32_t h = fourcc("HESp");
+        WRITE1(h);
+        WRITE1(hnsw->early_stop_patience);
+        WRITE1(hnsw->early_stop_target_recall);
+    }
+    if (hnsw->n_deleted > 0) {
+        uint32_t h = fourcc("HDLp");
+        WRITE1(h);
+        WRITEVECTOR(hnsw->deleted);
+    }
+
+    if (hnsw->storage_is_compact && hnsw->compress_neighbors) {
+        // the byte offsets of the lists come before the data, so that the
+        // data can be read on demand as the raw lists
+        std::vector<uint8_t> data;
+        std::vector<size_t> level_ptr;
+        hnsw->compress_neighbor_lists(data, level_ptr);
+        uint32_t h = fourcc("CSRz");
+        WRITE1(h);
+        WRITEVECTOR(level_ptr);
+        WRITEVECTOR(data);
+    } else if (hnsw->storage_is_compact) {
+        uint32_t h = fourcc("CSRn");
+        WRITE1(h);
+        WRITEVECTOR(hnsw->compact_neighbors_data);
+    }
 }
 
 static void write_NSG(const NSG* nsg, IOWriter* f) {
@@ -387,17 +471,25 @@ static void write_RaBitQuantizer(const RaBitQuantizer* rabitq, IOWriter* f) {
     WRITE1(rabitq->code_size);
 }
 
+static void write_IdHashMap(const IdHashMap* map, IOWriter* f) {
+    WRITE1(map->nentry);
+    WRITE1(map->nused);
+    WRITEVECTOR(map->ctrl);
+    WRITEVECTOR(map->keys);
+    WRITEVECTOR(map->values);
+}
+
 static void write_direct_map(const DirectMap* dm, IOWriter* f) {
     char maintain_direct_map =
             (char)dm->type; // for backwards compatibility with bool
+    if (dm->type == DirectMap::Hashtable) {
+        // the older versions stored the hashtable as a vector of pairs
+        maintain_direct_map = 3;
+    }
     WRITE1(maintain_direct_map);
     WRITEVECTOR(dm->array);
     if (dm->type == DirectMap::Hashtable) {
-        std::vector<std::pair<idx_t, idx_t>> v;
-        const std::unordered_map<idx_t, idx_t>& map = dm->hashtable;
-        v.resize(map.size());
-        std::copy(map.begin(), map.end(), v.begin());
-        WRITEVECTOR(v);
+        write_IdHashMap(&dm->hashtable, f);
     }
 }
 
@@ -416,6 +508,23 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         // eg. for a storage component of HNSW that is set to nullptr
         uint32_t h = fourcc("null");
         WRITE1(h);
+    } else if (
+            const IndexAdaptiveQuantizer* idxaq =
+                    dynamic_cast<const IndexAdaptiveQuantizer*>(idx)) {
+        uint32_t h = fourcc("IxAQ");
+        WRITE1(h);
+        write_index_header(idx, f);
+        WRITEXBVECTOR(idxaq->codes);
+        int accel_type = idxaq->accel_type;
+        WRITE1(accel_type);
+        WRITE1(idxaq->min_accel_size);
+        WRITE1(idxaq->hnsw_min_size);
+        WRITE1(idxaq->hnsw_M);
+        WRITE1(idxaq->efSearch);
+        WRITE1(idxaq->k_factor);
+        WRITE1(idxaq->pq_dsub);
+        WRITE1(idxaq->batch_size);
+        write_index(idxaq->accel, f);
     } else if (const IndexFlat* idxf = dynamic_cast<const IndexFlat*>(idx)) {
         uint32_t h =
                 fourcc(idxf->metric_type == METRIC_INNER_PRODUCT ? "IxFI"
@@ -424,6 +533,20 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         WRITE1(h);
         write_index_header(idx, f);
         WRITEXBVECTOR(idxf->codes);
+    } else if (
+            const IndexFlatBF16* idxf =
+                    dynamic_cast<const IndexFlatBF16*>(idx)) {
+        uint32_t h = fourcc("IxFb");
+        WRITE1(h);
+        write_index_header(idx, f);
+        WRITEVECTOR(idxf->codes);
+    } else if (
+            const IndexFlatInt8* idxf =
+                    dynamic_cast<const IndexFlatInt8*>(idx)) {
+        uint32_t h = fourcc("IxF8");
+        WRITE1(h);
+        write_index_header(idx, f);
+        WRITEVECTOR(idxf->codes);
     } else if (const IndexLSH* idxl = dynamic_cast<const IndexLSH*>(idx)) {
         uint32_t h = fourcc("IxHe");
         WRITE1(h);
@@ -714,6 +837,13 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         WRITE1(ivsp->threshold_type);
         WRITEVECTOR(ivsp->trained);
         write_InvertedLists(ivsp->invlists, f);
+    } else if (
+            const IndexIVFIDOnly* ivid =
+                    dynamic_cast<const IndexIVFIDOnly*>(idx)) {
+        uint32_t h = fourcc("IwId");
+        WRITE1(h);
+        write_ivf_header(ivid, f);
+        write_InvertedLists(ivid->invlists, f);
     } else if (const IndexIVFPQ* ivpq = dynamic_cast<const IndexIVFPQ*>(idx)) {
         const IndexIVFPQR* ivfpqr = dynamic_cast<const IndexIVFPQR*>(idx);
 
@@ -763,6 +893,20 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         WRITE1(h);
         write_index_header(imiq, f);
         write_ProductQuantizer(&imiq->pq, f);
+    } else if (
+            const IndexFlatOnDisk* idxfd =
+                    dynamic_cast<const IndexFlatOnDisk*>(idx)) {
+        // the vectors stay in their file
+        uint32_t h = fourcc("IxFD");
+        WRITE1(h);
+        write_index_header(idxfd, f);
+        std::vector<char> path(idxfd->filename.begin(), idxfd->filename.end());
+        WRITEVECTOR(path);
+        int64_t offset = idxfd->data_offset;
+        WRITE1(offset);
+        WRITE1(idxfd->use_direct_io);
+        WRITE1(idxfd->search_block_size);
+        WRITEVECTOR(idxfd->get_cached_ids());
     } else if (
             const IndexRefine* idxrf = dynamic_cast<const IndexRefine*>(idx)) {
         uint32_t h = fourcc("IxRF");
@@ -771,22 +915,48 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         write_index(idxrf->base_index, f);
         write_index(idxrf->refine_index, f);
         WRITE1(idxrf->k_factor);
+    } else if (
+            const IndexPrefixRefine* idxpr =
+                    dynamic_cast<const IndexPrefixRefine*>(idx)) {
+        uint32_t h = fourcc("IxPx");
+        WRITE1(h);
+        write_index_header(idxpr, f);
+        WRITE1(idxpr->d_prefix);
+        WRITE1(idxpr->k_factor);
+        write_index(idxpr->base_index, f);
+        write_index(idxpr->suffix_index, f);
+    } else if (
+            const IndexIVFRecompute* idxrc =
+                    dynamic_cast<const IndexIVFRecompute*>(idx)) {
+        // the embedding provider and cache are not stored
+        uint32_t h = fourcc("IxRc");
+        WRITE1(h);
+        write_index_header(idxrc, f);
+        WRITE1(idxrc->k_factor);
+        WRITE1(idxrc->max_rerank);
+        WRITE1(idxrc->zmq_port);
+        write_index(idxrc->base_index, f);
     } else if (
             const IndexIDMap* idxmap = dynamic_cast<const IndexIDMap*>(idx)) {
-        uint32_t h = dynamic_cast<const IndexIDMap2*>(idx) ? fourcc("IxM2")
-                                                           : fourcc("IxMp");
-        // no need to store additional info for IndexIDMap2
+        const IndexIDMap2* idxmap2 = dynamic_cast<const IndexIDMap2*>(idx);
+        // IndexIDMap2 stores its rev_map, so that it is not rebuilt at load
+        uint32_t h = idxmap2 ? fourcc("IxMh") : fourcc("IxMp");
         WRITE1(h);
         write_index_header(idxmap, f);
         write_index(idxmap->index, f);
         WRITEVECTOR(idxmap->id_map);
+        if (idxmap2) {
+            write_IdHashMap(&idxmap2->rev_map, f);
+        }
     } else if (const IndexHNSW* idxhnsw = dynamic_cast<const IndexHNSW*>(idx)) {
-        uint32_t h = dynamic_cast<const IndexHNSWFlat*>(idx) ? fourcc("IHNf")
-                : dynamic_cast<const IndexHNSWPQ*>(idx)      ? fourcc("IHNp")
-                : dynamic_cast<const IndexHNSWSQ*>(idx)      ? fourcc("IHNs")
-                : dynamic_cast<const IndexHNSW2Level*>(idx)  ? fourcc("IHN2")
-                : dynamic_cast<const IndexHNSWCagra*>(idx)   ? fourcc("IHNc")
-                                                             : 0;
+        uint32_t h = dynamic_cast<const IndexVamana*>(idx)      ? fourcc("IHNv")
+                : dynamic_cast<const IndexHNSWFlat*>(idx)       ? fourcc("IHNf")
+                : dynamic_cast<const IndexHNSWPQFastScan*>(idx) ? fourcc("IHNq")
+                : dynamic_cast<const IndexHNSWPQ*>(idx)         ? fourcc("IHNp")
+                : dynamic_cast<const IndexHNSWSQ*>(idx)         ? fourcc("IHNs")
+                : dynamic_cast<const IndexHNSW2Level*>(idx)     ? fourcc("IHN2")
+                : dynamic_cast<const IndexHNSWCagra*>(idx)      ? fourcc("IHNc")
+                                                                : 0;
         FAISS_THROW_IF_NOT(h != 0);
         WRITE1(h);
         write_index_header(idxhnsw, f);
@@ -796,6 +966,14 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
             WRITE1(idx_hnsw_cagra->base_level_only);
             WRITE1(idx_hnsw_cagra->num_base_level_search_entrypoints);
         }
+        if (h == fourcc("IHNv")) {
+            auto idx_vamana = dynamic_cast<const IndexVamana*>(idxhnsw);
+            WRITE1(idx_vamana->build_L);
+            WRITE1(idx_vamana->alpha);
+            WRITE1(idx_vamana->build_batch_size);
+            WRITE1(idx_vamana->pq_m);
+            WRITE1(idxhnsw->hnsw.pq_pruning_ratio);
+        }
         write_HNSW(&idxhnsw->hnsw, f);
         if (io_flags & IO_FLAG_SKIP_STORAGE) {
             uint32_t n4 = fourcc("null");
@@ -843,6 +1021,48 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         WRITE1(idxpqfs->ntotal2);
         WRITE1(idxpqfs->M2);
         WRITEVECTOR(idxpqfs->codes);
+    } else if (
+            const IndexPQWideFastScan* idxpqwfs =
+                    dynamic_cast<const IndexPQWideFastScan*>(idx)) {
+        uint32_t h = fourcc("IPwf");
+        WRITE1(h);
+        write_index_header(idxpqwfs, f);
+        write_ProductQuantizer(&idxpqwfs->pq, f);
+        WRITE1(idxpqwfs->qbs);
+        WRITE1(idxpqwfs->ntotal2);
+        WRITEVECTOR(idxpqwfs->codes);
+    } else if (
+            const IndexAdditiveQuantizerWideFastScan* idxaqwfs =
+                    dynamic_cast<const IndexAdditiveQuantizerWideFastScan*>(
+                            idx)) {
+        auto idxlsqwfs =
+                dynamic_cast<const IndexLocalSearchQuantizerWideFastScan*>(idx);
+        auto idxrqwfs =
+                dynamic_cast<const IndexResidualQuantizerWideFastScan*>(idx);
+        auto idxplsqwfs = dynamic_cast<
+                const IndexProductLocalSearchQuantizerWideFastScan*>(idx);
+        auto idxprqwfs = dynamic_cast<
+                const IndexProductResidualQuantizerWideFastScan*>(idx);
+        FAISS_THROW_IF_NOT(idxlsqwfs || idxrqwfs || idxplsqwfs || idxprqwfs);
+
+        uint32_t h = idxlsqwfs ? fourcc("ILwf")
+                : idxrqwfs     ? fourcc("IRwf")
+                : idxplsqwfs   ? fourcc("IPLw")
+                               : fourcc("IPRw");
+        WRITE1(h);
+        write_index_header(idxaqwfs, f);
+        if (idxlsqwfs) {
+            write_LocalSearchQuantizer(&idxlsqwfs->lsq, f);
+        } else if (idxrqwfs) {
+            write_ResidualQuantizer(&idxrqwfs->rq, f);
+        } else if (idxplsqwfs) {
+            write_ProductLocalSearchQuantizer(&idxplsqwfs->plsq, f);
+        } else {
+            write_ProductResidualQuantizer(&idxprqwfs->prq, f);
+        }
+        WRITE1(idxaqwfs->qbs);
+        WRITE1(idxaqwfs->ntotal2);
+        WRITEVECTOR(idxaqwfs->codes);
     } else if (
             const IndexIVFPQFastScan* ivpq_2 =
                     dynamic_cast<const IndexIVFPQFastScan*>(idx)) {
@@ -875,7 +1095,10 @@ void write_index(const Index* idx, IOWriter* f, int io_flags) {
         write_index(imm_2->index, f);
     } else if (
             const IndexRaBitQ* idxq = dynamic_cast<const IndexRaBitQ*>(idx)) {
-        uint32_t h = fourcc("Ixrq");
+        // the packed codes of IndexRaBitQFastScan are rebuilt at load time
+        uint32_t h = dynamic_cast<const IndexRaBitQFastScan*>(idx)
+                ? fourcc("Ixrf")
+                : fourcc("Ixrq");
         WRITE1(h);
         write_index_header(idx, f);
         write_RaBitQuantizer(&idxq->rabitq, f);
@@ -908,6 +1131,17 @@ void write_index(const Index* idx, const char* fname, int io_flags) {
     write_index(idx, &writer, io_flags);
 }
 
+void write_index_sectioned(
+        const Index* idx,
+        const char* fname,
+        size_t alignment,
+        size_t min_section_size,
+        int io_flags) {
+    SectionedFileIOWriter writer(fname, alignment, min_section_size);
+    write_index(idx, &writer, io_flags);
+    writer.close();
+}
+
 void write_VectorTransform(const VectorTransform* vt, const char* fname) {
     FileIOWriter writer(fname);
     write_VectorTransform(vt, &writer);
@@ -1026,14 +1260,16 @@ void write_index_binary(const IndexBinary* idx, IOWriter* f) {
     } else if (
             const IndexBinaryIDMap* idxmap =
                     dynamic_cast<const IndexBinaryIDMap*>(idx)) {
-        uint32_t h = dynamic_cast<const IndexBinaryIDMap2*>(idx)
-                ? fourcc("IBM2")
-                : fourcc("IBMp");
-        // no need to store additional info for IndexIDMap2
+        const IndexBinaryIDMap2* idxmap2 =
+                dynamic_cast<const IndexBinaryIDMap2*>(idx);
+        uint32_t h = idxmap2 ? fourcc("IBMh") : fourcc("IBMp");
         WRITE1(h);
         write_index_binary_header(idxmap, f);
         write_index_binary(idxmap->index, f);
         WRITEVECTOR(idxmap->id_map);
+        if (idxmap2) {
+            write_IdHashMap(&idxmap2->rev_map, f);
+        }
     } else if (
             const IndexBinaryHash* idxh =
                     dynamic_cast<const IndexBinaryHash*>(idx)) {
@@ -1057,6 +1293,15 @@ void write_index_binary(const IndexBinary* idx, IOWriter* f) {
             write_binary_multi_hash_map(
                     idxmh->maps[i], idxmh->b, idxmh->ntotal, f);
         }
+    } else if (
+            const IndexBinaryMIH* idxmih =
+                    dynamic_cast<const IndexBinaryMIH*>(idx)) {
+        // the tables are rebuilt from the codes at read time
+        uint32_t h = fourcc("IBMI");
+        WRITE1(h);
+        write_index_binary_header(idxmih, f);
+        WRITE1(idxmih->nhash);
+        WRITEVECTOR(idxmih->xb);
     } else {
         FAISS_THROW_MSG("don't know how to serialize this type of index");
     }
@@ -1072,4 +1317,14 @@ void write_index_binary(const IndexBinary* idx, const char* fname) {
     write_index_binary(idx, &writer);
 }
 
+void write_index_binary_sectioned(
+        const IndexBinary* idx,
+        const char* fname,
+        size_t alignment,
+        size_t min_section_size) {
+    SectionedFileIOWriter writer(fname, alignment, min_section_size);
+    write_index_binary(idx, &writer);
+    writer.close();
+}
+
 } // namespace faiss
@@ -9,13 +9,88 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/io.h>
 
 namespace faiss {
 
+namespace {
+
+#ifndef _WIN32
+
+/// size of the preads that are run in parallel
+const size_t pread_chunk_size = size_t(1) << 22;
+
+/** read the n buffers stored contiguously from offset0 in the file, by
+ * chunks of at most pread_chunk_size bytes in parallel. Returns false if
+ * the file is not a regular file or is too short. */
+bool pread_parallel(
+        int fd,
+        size_t offset0,
+        size_t n,
+        void* const* ptrs,
+        const size_t* nbytes) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    struct Chunk {
+        char* dst;
+        size_t size;
+        size_t offset;
+    };
+    std::vector<Chunk> chunks;
+    size_t offset = offset0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < nbytes[i]; j += pread_chunk_size) {
+            chunks.push_back(
+                    {(char*)ptrs[i] + j,
+                     std::min(pread_chunk_size, nbytes[i] - j),
+                     offset + j});
+        }
+        offset += nbytes[i];
+    }
+    if (offset > size_t(st.st_size)) {
+        return false;
+    }
+
+    int nerr = 0;
+#pragma omp parallel for schedule(dynamic) if (chunks.size() > 1) \
+        reduction(+ : nerr)
+    for (int64_t c = 0; c < chunks.size(); c++) {
+        const Chunk& chunk = chunks[c];
+        size_t done = 0;
+        while (done < chunk.size) {
+            ssize_t ret = pread(
+                    fd,
+                    chunk.dst + done,
+                    chunk.size - done,
+                    chunk.offset + done);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                nerr++;
+                break;
+            }
+            done += ret;
+        }
+    }
+    return nerr == 0;
+}
+
+#endif
+
+} // namespace
+
 /***********************************************************************
  * IO functions
  ***********************************************************************/
@@ -24,6 +99,22 @@ int IOReader::filedescriptor() {
     FAISS_THROW_MSG("IOReader does not support memory mapping");
 }
 
+void IOReader::read_batch(
+        size_t n,
+        void* const* ptrs,
+        const size_t* nbytes) {
+    for (size_t i = 0; i < n; i++) {
+        size_t ret = (*this)(ptrs[i], 1, nbytes[i]);
+        FAISS_THROW_IF_NOT_FMT(
+                ret == nbytes[i],
+                "read error in %s: %zd != %zd (%s)",
+                name.c_str(),
+                ret,
+                nbytes[i],
+                strerror(errno));
+    }
+}
+
 int IOWriter::filedescriptor() {
     FAISS_THROW_MSG("IOWriter does not support memory mapping");
 }
@@ -82,9 +173,40 @@ FileIOReader::~FileIOReader() {
 }
 
 size_t FileIOReader::operator()(void* ptr, size_t size, size_t nitems) {
+#ifndef _WIN32
+    size_t nbytes = size * nitems;
+    if (nbytes >= parallel_read_min) {
+        long pos = ftell(f);
+        if (pos >= 0 &&
+            pread_parallel(filedescriptor(), pos, 1, &ptr, &nbytes)) {
+            FAISS_THROW_IF_NOT(fseek(f, pos + nbytes, SEEK_SET) == 0);
+            return nitems;
+        }
+        // not a regular file or EOF: the position is unchanged, read
+        // sequentially to get the number of items
+    }
+#endif
     return fread(ptr, size, nitems, f);
 }
 
+void FileIOReader::read_batch(
+        size_t n,
+        void* const* ptrs,
+        const size_t* nbytes) {
+#ifndef _WIN32
+    long pos = ftell(f);
+    if (pos >= 0 && pread_parallel(filedescriptor(), pos, n, ptrs, nbytes)) {
+        size_t total = 0;
+        for (size_t i = 0; i < n; i++) {
+            total += nbytes[i];
+        }
+        FAISS_THROW_IF_NOT(fseek(f, pos + total, SEEK_SET) == 0);
+        return;
+    }
+#endif
+    IOReader::read_batch(n, ptrs, nbytes);
+}
+
 int FileIOReader::filedescriptor() {
 #ifdef _AIX
     return fileno(f);
@@ -159,6 +281,18 @@ size_t BufferedIOReader::operator()(void* ptr, size_t unitsize, size_t nitems) {
     // while we would like to have more data
     while (size > 0) {
         assert(b0 == b1); // buffer empty on input
+        if (size >= bsz) {
+            // large read: bypass the buffer
+            size_t nb2 = (*reader)(dst, 1, size);
+            if (nb2 == 0) {
+                break;
+            }
+            ofs += nb2;
+            nb += nb2;
+            dst += nb2;
+            size -= nb2;
+            continue;
+        }
         // try to read from main reader
         b0 = 0;
         b1 = (*reader)(buffer.data(), 1, bsz);
@@ -181,6 +315,33 @@ size_t BufferedIOReader::operator()(void* ptr, size_t unitsize, size_t nitems) {
     return nb / unitsize;
 }
 
+void BufferedIOReader::read_batch(
+        size_t n,
+        void* const* ptrs,
+        const size_t* nbytes) {
+    // the beginning of the batch may be in the buffer
+    std::vector<void*> ptrs2;
+    std::vector<size_t> nbytes2;
+    size_t total2 = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t nb = std::min(b1 - b0, nbytes[i]);
+        memcpy(ptrs[i], buffer.data() + b0, nb);
+        b0 += nb;
+        ofs2 += nb;
+        if (nb < nbytes[i]) {
+            ptrs2.push_back((char*)ptrs[i] + nb);
+            nbytes2.push_back(nbytes[i] - nb);
+            total2 += nbytes[i] - nb;
+        }
+    }
+    if (!ptrs2.empty()) {
+        // the buffer is empty, the underlying reader is at the right offset
+        reader->read_batch(ptrs2.size(), ptrs2.data(), nbytes2.data());
+        ofs += total2;
+        ofs2 += total2;
+    }
+}
+
 BufferedIOWriter::BufferedIOWriter(IOWriter* writer, size_t bsz)
         : writer(writer), bsz(bsz), ofs2(0), b0(0), buffer(bsz) {}
 
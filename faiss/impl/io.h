@@ -34,6 +34,14 @@ struct IOReader {
     // return a file number that can be memory-mapped
     virtual int filedescriptor();
 
+    /** read n buffers of nbytes[i] bytes into ptrs[i], in the same order
+     * as n successive operator() calls would. The readers that can seek
+     * their input load the buffers in parallel. Throws on short reads. */
+    virtual void read_batch(
+            size_t n,
+            void* const* ptrs,
+            const size_t* nbytes);
+
     virtual ~IOReader() {}
 };
 
@@ -64,6 +72,8 @@ struct VectorIOWriter : IOWriter {
 struct FileIOReader : IOReader {
     FILE* f = nullptr;
     bool need_close = false;
+    /// reads of at least this many bytes are split into parallel preads
+    size_t parallel_read_min = size_t(1) << 24;
 
     FileIOReader(FILE* rf);
 
@@ -73,6 +83,9 @@ struct FileIOReader : IOReader {
 
     size_t operator()(void* ptr, size_t size, size_t nitems) override;
 
+    void read_batch(size_t n, void* const* ptrs, const size_t* nbytes)
+            override;
+
     int filedescriptor() override;
 };
 
@@ -115,6 +128,10 @@ struct BufferedIOReader : IOReader {
     explicit BufferedIOReader(IOReader* reader, size_t bsz = 1024 * 1024);
 
     size_t operator()(void* ptr, size_t size, size_t nitems) override;
+
+    /// serves what is in the buffer, the rest is read by the reader
+    void read_batch(size_t n, void* const* ptrs, const size_t* nbytes)
+            override;
 };
 
 struct BufferedIOWriter : IOWriter {
@@ -545,9 +545,38 @@ uint64_t ZnSphereCodecRec::encode(const float* c) const {
     return encode_centroid(c);
 }
 
+namespace {
+
+/// scratch arrays of the recursive codec, on the stack for the usual
+/// dimensions to avoid heap allocations per encoded / decoded vector
+struct RecScratch {
+    static constexpr int max_stack_dim = 64;
+    uint64_t codes_buf[max_stack_dim];
+    int norm2s_buf[max_stack_dim];
+    std::vector<uint64_t> codes_vec;
+    std::vector<int> norm2s_vec;
+    uint64_t* codes;
+    int* norm2s;
+
+    explicit RecScratch(int dim) {
+        if (dim <= max_stack_dim) {
+            codes = codes_buf;
+            norm2s = norm2s_buf;
+        } else {
+            codes_vec.resize(dim);
+            norm2s_vec.resize(dim);
+            codes = codes_vec.data();
+            norm2s = norm2s_vec.data();
+        }
+    }
+};
+
+} // namespace
+
 uint64_t ZnSphereCodecRec::encode_centroid(const float* c) const {
-    std::vector<uint64_t> codes(dim);
-    std::vector<int> norm2s(dim);
+    RecScratch scratch(dim);
+    uint64_t* codes = scratch.codes;
+    int* norm2s = scratch.norm2s;
     for (int i = 0; i < dim; i++) {
         if (c[i] == 0) {
             codes[i] = 0;
@@ -577,8 +606,9 @@ uint64_t ZnSphereCodecRec::encode_centroid(const float* c) const {
 }
 
 void ZnSphereCodecRec::decode(uint64_t code, float* c) const {
-    std::vector<uint64_t> codes(dim);
-    std::vector<int> norm2s(dim);
+    RecScratch scratch(dim);
+    uint64_t* codes = scratch.codes;
+    int* norm2s = scratch.norm2s;
     codes[0] = code;
     norm2s[0] = r2;
 
@@ -36,6 +36,7 @@
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/mapped_io.h>
+#include <faiss/utils/huge_pages.h>
 
 namespace faiss {
 
@@ -70,6 +71,7 @@ struct MmappedFileMappingOwner::PImpl {
         // btw, fd can be closed here
 
         madvise(address, filesize, MADV_RANDOM);
+        huge_pages_advise(address, filesize);
 
         // save it
         ptr = address;
@@ -93,6 +95,7 @@ struct MmappedFileMappingOwner::PImpl {
         // btw, fd can be closed here
 
         madvise(address, filesize, MADV_RANDOM);
+        huge_pages_advise(address, filesize);
 
         // save it
         ptr = address;
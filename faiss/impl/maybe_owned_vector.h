@@ -13,6 +13,7 @@
 #include <vector>
 
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/huge_pages.h>
 
 namespace faiss {
 
@@ -55,8 +56,7 @@ struct MaybeOwnedVector {
         is_owned = true;
 
         owned_data.resize(initial_size);
-        c_ptr = owned_data.data();
-        c_size = owned_data.size();
+        update_owned(nullptr);
     }
 
     explicit MaybeOwnedVector(const std::vector<T>& vec)
@@ -241,9 +241,9 @@ struct MaybeOwnedVector {
                 is_owned,
                 "This operation cannot be performed on a viewed vector");
 
+        const T* old_ptr = owned_data.data();
         auto result = owned_data.insert(pos, first, last);
-        c_ptr = owned_data.data();
-        c_size = owned_data.size();
+        update_owned(old_ptr);
 
         return result;
     }
@@ -263,9 +263,9 @@ struct MaybeOwnedVector {
                 is_owned,
                 "This operation cannot be performed on a viewed vector");
 
+        const T* old_ptr = owned_data.data();
         owned_data.resize(new_size);
-        c_ptr = owned_data.data();
-        c_size = owned_data.size();
+        update_owned(old_ptr);
     }
 
     void resize(const size_t new_size, const value_type v) {
@@ -273,9 +273,51 @@ struct MaybeOwnedVector {
                 is_owned,
                 "This operation cannot be performed on a viewed vector");
 
+        const T* old_ptr = owned_data.data();
         owned_data.resize(new_size, v);
+        update_owned(old_ptr);
+    }
+
+    void reserve(const size_t new_capacity) {
+        FAISS_ASSERT_MSG(
+                is_owned,
+                "This operation cannot be performed on a viewed vector");
+
+        const T* old_ptr = owned_data.data();
+        owned_data.reserve(new_capacity);
+        update_owned(old_ptr);
+    }
+
+    void push_back(const value_type v) {
+        FAISS_ASSERT_MSG(
+                is_owned,
+                "This operation cannot be performed on a viewed vector");
+
+        const T* old_ptr = owned_data.data();
+        owned_data.push_back(v);
+        update_owned(old_ptr);
+    }
+
+    bool empty() const {
+        return c_size == 0;
+    }
+
+    T& back() {
+        return c_ptr[c_size - 1];
+    }
+
+    const T& back() const {
+        return c_ptr[c_size - 1];
+    }
+
+    // refresh the pointers after a change of the owned data. The huge
+    // pages are advised only when the storage was reallocated
+    void update_owned(const T* old_ptr) {
         c_ptr = owned_data.data();
         c_size = owned_data.size();
+        if (c_ptr != old_ptr) {
+            huge_pages_advise(c_ptr, owned_data.capacity() * sizeof(T));
+        }
     }
 
     friend void swap(self_type& a, self_type& b) {
@@ -136,6 +136,52 @@ void pq4_pack_codes_range(
     }
 }
 
+void pq4_unpack_codes_range(
+        const uint8_t* blocks,
+        size_t M,
+        size_t i0,
+        size_t i1,
+        size_t bbs,
+        size_t nsq,
+        uint8_t* codes) {
+    FAISS_THROW_IF_NOT(bbs % 32 == 0);
+    if (i0 == i1) {
+        return;
+    }
+#ifdef FAISS_BIG_ENDIAN
+    const uint8_t perm0[16] = {
+            8, 0, 9, 1, 10, 2, 11, 3, 12, 4, 13, 5, 14, 6, 15, 7};
+#else
+    const uint8_t perm0[16] = {
+            0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15};
+#endif
+    size_t ncol = (M + 1) / 2;
+
+    // range of the 32-vector groups that contain the codes
+    size_t g0 = i0 / 32, g1 = (i1 + 31) / 32;
+    for (size_t g = g0; g < g1; g++) {
+        size_t b = g * 32 / bbs;
+        const uint8_t* codes2 =
+                blocks + b * bbs * nsq / 2 + (g * 32 - b * bbs);
+        int64_t i_base = int64_t(g * 32) - int64_t(i0);
+        size_t j0 = std::max(int64_t(0), -i_base);
+        size_t j1 = std::min(int64_t(32), int64_t(i1 - i0) - i_base);
+        for (size_t col = 0; col < ncol; col++) {
+            // the 2 sub-quantizers of this column, see pq4_pack_codes
+            const uint8_t* src = codes2 + col * bbs;
+            std::array<uint8_t, 32> c;
+            for (int j = 0; j < 16; j++) {
+                uint8_t d0 = src[j], d1 = src[j + 16];
+                c[perm0[j]] = (d0 & 15) | (d1 << 4);
+                c[perm0[j] + 16] = (d0 >> 4) | (d1 & 0xf0);
+            }
+            for (size_t j = j0; j < j1; j++) {
+                codes[(i_base + j) * ncol + col] = c[j];
+            }
+        }
+    }
+}
+
 namespace {
 
 // get the specific address of the vector inside a block
@@ -247,6 +293,27 @@ void CodePackerPQ4::unpack_1(
     }
 }
 
+void CodePackerPQ4::pack_range(
+        const uint8_t* flat_codes,
+        size_t i0,
+        size_t i1,
+        uint8_t* blocks) const {
+    if (i0 == i1) {
+        return;
+    }
+    pq4_pack_codes_range(
+            flat_codes, nsq, i0, i1, nvec, (nsq + 1) / 2 * 2, blocks);
+}
+
+void CodePackerPQ4::unpack_range(
+        const uint8_t* blocks,
+        size_t i0,
+        size_t i1,
+        uint8_t* flat_codes) const {
+    pq4_unpack_codes_range(
+            blocks, nsq, i0, i1, nvec, (nsq + 1) / 2 * 2, flat_codes);
+}
+
 /***************************************************************
  * Packing functions for Look-Up Tables (LUT)
  ***************************************************************/
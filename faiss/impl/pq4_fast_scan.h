@@ -64,6 +64,20 @@ void pq4_pack_codes_range(
         size_t nsq,
         uint8_t* blocks);
 
+/** Inverse of pq4_pack_codes_range: read the codes i0..i1 from the blocks.
+ *
+ * @param blocks  input array, size at least ceil(i1 / bbs) * bbs * nsq / 2
+ * @param codes   output codes, size (i1 - i0, ceil(M / 2))
+ */
+void pq4_unpack_codes_range(
+        const uint8_t* blocks,
+        size_t M,
+        size_t i0,
+        size_t i1,
+        size_t bbs,
+        size_t nsq,
+        uint8_t* codes);
+
 /** get a single element from a packed codes table
  *
  * @param vector_id        vector id
@@ -99,6 +113,20 @@ struct CodePackerPQ4 : CodePacker {
             const final;
     void unpack_1(const uint8_t* block, size_t offset, uint8_t* flat_code)
             const final;
+
+    /// packs the whole range at once with pq4_pack_codes_range
+    void pack_range(
+            const uint8_t* flat_codes,
+            size_t i0,
+            size_t i1,
+            uint8_t* blocks) const final;
+
+    /// unpacks the whole range at once with pq4_unpack_codes_range
+    void unpack_range(
+            const uint8_t* blocks,
+            size_t i0,
+            size_t i1,
+            uint8_t* flat_codes) const final;
 };
 
 /** Pack Look-up table for consumption by the kernel.
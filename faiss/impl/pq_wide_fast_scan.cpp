@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/pq_wide_fast_scan.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/simd_result_handlers.h>
+#include <faiss/utils/hamming.h>
+
+#if defined(__AVX512VBMI__) && defined(__AVX512BW__)
+#include <immintrin.h>
+#define FAISS_PQWIDE_VBMI
+#endif
+
+namespace faiss {
+
+namespace {
+
+// nb of queries that share the unpacking of a block
+constexpr int QB = 4;
+
+/// codes of sub-quantizer m in a block
+inline const uint8_t* block_stream(
+        const uint8_t* block,
+        size_t nbits,
+        size_t m) {
+    return block + m * nbits * pqwide_bbs / 8;
+}
+
+/// groups of 8 codes are nbits bytes, read into a 64-bit word
+inline uint64_t read_group(const uint8_t* stream, size_t nbits, size_t g) {
+    uint64_t w = 0;
+    memcpy(&w, stream + g * nbits, nbits);
+    return w;
+}
+
+void check_nbits(size_t M, size_t nbits) {
+    FAISS_THROW_IF_NOT_MSG(
+            nbits >= 5 && nbits <= 8, "only 5 to 8-bit codes are supported");
+    FAISS_THROW_IF_NOT_MSG(M <= 256, "too many sub-quantizers for uint16");
+}
+
+void handle_block(
+        SIMDResultHandler& res,
+        int q,
+        const uint16_t* acc /* 64 distances, aligned on 32 bytes */) {
+    res.handle(q, 0, simd16uint16(acc), simd16uint16(acc + 16));
+    res.handle(q, 1, simd16uint16(acc + 32), simd16uint16(acc + 48));
+}
+
+#ifndef FAISS_PQWIDE_VBMI
+
+void accumulate_scalar(
+        int nq,
+        size_t nb,
+        size_t M,
+        size_t nbits,
+        const uint8_t* blocks,
+        const uint8_t* LUT,
+        SIMDResultHandler& res) {
+    size_t bs = pqwide_block_size(M, nbits);
+    size_t stride = pqwide_lut_stride(nbits);
+    uint64_t mask = (1 << nbits) - 1;
+    alignas(64) uint16_t acc[QB][pqwide_bbs];
+    uint8_t idx[pqwide_bbs];
+
+    for (size_t j0 = 0; j0 < nb; j0 += pqwide_bbs) {
+        const uint8_t* block = blocks + j0 / pqwide_bbs * bs;
+        res.set_block_origin(0, j0);
+        for (int q0 = 0; q0 < nq; q0 += QB) {
+            int nq_b = std::min(QB, nq - q0);
+            memset(acc, 0, sizeof(acc));
+            for (size_t m = 0; m < M; m++) {
+                const uint8_t* stream = block_stream(block, nbits, m);
+                for (size_t g = 0; g < pqwide_bbs / 8; g++) {
+                    uint64_t w = read_group(stream, nbits, g);
+                    for (int b = 0; b < 8; b++) {
+                        idx[g * 8 + b] = (w >> (b * nbits)) & mask;
+                    }
+                }
+                for (int q = 0; q < nq_b; q++) {
+                    const uint8_t* lut = LUT + ((q0 + q) * M + m) * stride;
+                    for (size_t j = 0; j < pqwide_bbs; j++) {
+                        acc[q][j] += lut[idx[j]];
+                    }
+                }
+            }
+            for (int q = 0; q < nq_b; q++) {
+                handle_block(res, q0 + q, acc[q]);
+            }
+        }
+    }
+}
+
+#else
+
+/// NQ queries starting at q0, tables of 64 << LUT_LOG2 entries
+template <int NQ, int LUT_LOG2>
+void accumulate_vbmi_q(
+        int q0,
+        size_t nb,
+        size_t M,
+        size_t nbits,
+        const uint8_t* blocks,
+        const uint8_t* LUT,
+        SIMDResultHandler& res) {
+    size_t bs = pqwide_block_size(M, nbits);
+    size_t stride = pqwide_lut_stride(nbits);
+
+    // byte 8 * g + b of a group gathers byte nbits * g + b of the stream,
+    // then code b of the group is at bit nbits * b of the 64-bit word
+    alignas(64) uint8_t perm_tab[64], shift_tab[64];
+    for (int g = 0; g < 8; g++) {
+        for (int b = 0; b < 8; b++) {
+            perm_tab[8 * g + b] = nbits * g + b;
+            shift_tab[8 * g + b] = nbits * b;
+        }
+    }
+    const __m512i perm = _mm512_load_si512(perm_tab);
+    const __m512i shift = _mm512_load_si512(shift_tab);
+    const __m512i mask = _mm512_set1_epi8((1 << nbits) - 1);
+    const __mmask64 load_mask =
+            nbits == 8 ? ~uint64_t(0) : (uint64_t(1) << (8 * nbits)) - 1;
+    alignas(64) uint16_t acc_tab[pqwide_bbs];
+
+    for (size_t j0 = 0; j0 < nb; j0 += pqwide_bbs) {
+        const uint8_t* block = blocks + j0 / pqwide_bbs * bs;
+        __m512i acc[NQ][2];
+        for (int q = 0; q < NQ; q++) {
+            acc[q][0] = acc[q][1] = _mm512_setzero_si512();
+        }
+        const uint8_t* lut = LUT + q0 * M * stride;
+        for (size_t m = 0; m < M; m++) {
+            __m512i c = _mm512_maskz_loadu_epi8(
+                    load_mask, block_stream(block, nbits, m));
+            c = _mm512_permutexvar_epi8(perm, c);
+            c = _mm512_and_si512(_mm512_multishift_epi64_epi8(shift, c), mask);
+            for (int q = 0; q < NQ; q++) {
+                const uint8_t* lut_q = lut + (q * M + m) * stride;
+                __m512i v;
+                if (LUT_LOG2 == 0) {
+                    v = _mm512_permutexvar_epi8(c, _mm512_loadu_si512(lut_q));
+                } else if (LUT_LOG2 == 1) {
+                    v = _mm512_permutex2var_epi8(
+                            _mm512_loadu_si512(lut_q),
+                            c,
+                            _mm512_loadu_si512(lut_q + 64));
+                } else {
+                    // vpermi2b ignores bit 7 of the codes, it selects the half
+                    __m512i lo = _mm512_permutex2var_epi8(
+                            _mm512_loadu_si512(lut_q),
+                            c,
+                            _mm512_loadu_si512(lut_q + 64));
+                    __m512i hi = _mm512_permutex2var_epi8(
+                            _mm512_loadu_si512(lut_q + 128),
+                            c,
+                            _mm512_loadu_si512(lut_q + 192));
+                    v = _mm512_mask_blend_epi8(
+                            _mm512_movepi8_mask(c), lo, hi);
+                }
+                acc[q][0] = _mm512_add_epi16(
+                        acc[q][0],
+                        _mm512_cvtepu8_epi16(_mm512_castsi512_si256(v)));
+                acc[q][1] = _mm512_add_epi16(
+                        acc[q][1],
+                        _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(v, 1)));
+            }
+        }
+        res.set_block_origin(0, j0);
+        for (int q = 0; q < NQ; q++) {
+            _mm512_store_si512(acc_tab, acc[q][0]);
+            _mm512_store_si512(acc_tab + 32, acc[q][1]);
+            handle_block(res, q0 + q, acc_tab);
+        }
+    }
+}
+
+template <int LUT_LOG2>
+void accumulate_vbmi(
+        int nq,
+        size_t nb,
+        size_t M,
+        size_t nbits,
+        const uint8_t* blocks,
+        const uint8_t* LUT,
+        SIMDResultHandler& res) {
+    for (int q0 = 0; q0 < nq; q0 += QB) {
+        switch (std::min(QB, nq - q0)) {
+#define DISPATCH(NQ)                                  \
+    case NQ:                                          \
+        accumulate_vbmi_q<NQ, LUT_LOG2>(              \
+                q0, nb, M, nbits, blocks, LUT, res); \
+        break;
+            DISPATCH(1);
+            DISPATCH(2);
+            DISPATCH(3);
+            DISPATCH(4);
+#undef DISPATCH
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+void pqwide_pack_codes_range(
+        const uint8_t* codes,
+        size_t M,
+        size_t nbits,
+        size_t i0,
+        size_t i1,
+        uint8_t* blocks) {
+    check_nbits(M, nbits);
+    size_t code_size = (M * nbits + 7) / 8;
+    size_t bs = pqwide_block_size(M, nbits);
+    for (size_t i = i0; i < i1; i++) {
+        BitstringReader bsr(codes + (i - i0) * code_size, code_size);
+        uint8_t* block = blocks + i / pqwide_bbs * bs;
+        size_t bit = (i % pqwide_bbs) * nbits;
+        for (size_t m = 0; m < M; m++) {
+            uint8_t* stream = block + m * nbits * pqwide_bbs / 8;
+            // the code spans at most 2 bytes
+            uint16_t c = bsr.read(nbits);
+            uint16_t c_mask = (1 << nbits) - 1;
+            uint8_t* p = stream + bit / 8;
+            int shift = bit % 8;
+            p[0] = (p[0] & ~(c_mask << shift)) | (c << shift);
+            if (shift + nbits > 8) {
+                p[1] = (p[1] & ~(c_mask >> (8 - shift))) | (c >> (8 - shift));
+            }
+        }
+    }
+}
+
+uint8_t pqwide_get_packed_element(
+        const uint8_t* blocks,
+        size_t M,
+        size_t nbits,
+        size_t i,
+        size_t m) {
+    const uint8_t* block =
+            blocks + i / pqwide_bbs * pqwide_block_size(M, nbits);
+    const uint8_t* stream = block_stream(block, nbits, m);
+    size_t j = i % pqwide_bbs;
+    uint64_t w = read_group(stream, nbits, j / 8);
+    return (w >> ((j % 8) * nbits)) & ((1 << nbits) - 1);
+}
+
+bool pqwide_has_simd() {
+#ifdef FAISS_PQWIDE_VBMI
+    return true;
+#else
+    return false;
+#endif
+}
+
+void pqwide_accumulate_loop(
+        int nq,
+        size_t nb,
+        size_t M,
+        size_t nbits,
+        const uint8_t* blocks,
+        const uint8_t* LUT,
+        SIMDResultHandler& res) {
+    check_nbits(M, nbits);
+    FAISS_THROW_IF_NOT(nb % pqwide_bbs == 0);
+#ifdef FAISS_PQWIDE_VBMI
+    if (nbits <= 6) {
+        accumulate_vbmi<0>(nq, nb, M, nbits, blocks, LUT, res);
+    } else if (nbits == 7) {
+        accumulate_vbmi<1>(nq, nb, M, nbits, blocks, LUT, res);
+    } else {
+        accumulate_vbmi<2>(nq, nb, M, nbits, blocks, LUT, res);
+    }
+#else
+    accumulate_scalar(nq, nb, M, nbits, blocks, LUT, res);
+#endif
+}
+
+} // namespace faiss
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace faiss {
+
+struct SIMDResultHandler;
+
+/** Fast-scan kernels for PQ codes of 5 to 8 bits.
+ *
+ * The codes are stored by blocks of pqwide_bbs = 64 vectors. In a block, the
+ * codes of sub-quantizer m are a little-endian bitstream of 64 nbits-bit
+ * codes (8 * nbits bytes), so that a block is 8 * nbits * M bytes, the size
+ * of 64 regular PQ codes.
+ *
+ * The look-up tables are uint8, with pqwide_lut_stride(nbits) entries per
+ * sub-quantizer (64, 128 or 256, the entries after ksub are 0). The
+ * distances are accumulated in uint16, which limits M to 256.
+ *
+ * With AVX512-VBMI, one sub-quantizer of a block is unpacked with
+ * vpermb + vpmultishiftqb and looked up with vpermb (up to 6 bits, one
+ * register per table), vpermi2b (7 bits, two registers) or two vpermi2b
+ * blended on the high bit of the codes (8 bits, four registers). Otherwise
+ * a scalar loop computes the same distances.
+ */
+
+constexpr size_t pqwide_bbs = 64;
+
+/// size in bytes of a block of pqwide_bbs codes
+inline size_t pqwide_block_size(size_t M, size_t nbits) {
+    return M * nbits * pqwide_bbs / 8;
+}
+
+/// nb of entries of a look-up table
+inline size_t pqwide_lut_stride(size_t nbits) {
+    return nbits <= 6 ? 64 : nbits == 7 ? 128 : 256;
+}
+
+/** pack the PQ codes of vectors i0..i1-1 into the blocks
+ *
+ * @param codes   input codes, size (i1 - i0) * ceil(M * nbits / 8)
+ * @param blocks  output blocks, size ceil(i1 / 64) * pqwide_block_size
+ */
+void pqwide_pack_codes_range(
+        const uint8_t* codes,
+        size_t M,
+        size_t nbits,
+        size_t i0,
+        size_t i1,
+        uint8_t* blocks);
+
+/// code of sub-quantizer m of vector i
+uint8_t pqwide_get_packed_element(
+        const uint8_t* blocks,
+        size_t M,
+        size_t nbits,
+        size_t i,
+        size_t m);
+
+/// true if the VBMI kernel is compiled in
+bool pqwide_has_simd();
+
+/** compute the distances of nq queries to the nb (a multiple of 64) vectors
+ * of the blocks, and pass them to the result handler 32 at a time.
+ *
+ * @param LUT  nq * M * pqwide_lut_stride(nbits) quantized table entries
+ */
+void pqwide_accumulate_loop(
+        int nq,
+        size_t nb,
+        size_t M,
+        size_t nbits,
+        const uint8_t* blocks,
+        const uint8_t* LUT,
+        SIMDResultHandler& res);
+
+} // namespace faiss
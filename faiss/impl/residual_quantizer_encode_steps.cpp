@@ -226,6 +226,9 @@ void accum_and_finalize_tab(
  * Single encoding step
  ********************************************************************/
 
+// 8 MiB of distances per tile
+size_t beam_search_tile_nfloat = 1 << 21;
+
 void beam_search_encode_step(
         size_t d,
         size_t K,
@@ -244,14 +247,13 @@ void beam_search_encode_step(
     // we have to fill in the whole output matrix
     FAISS_THROW_IF_NOT(new_beam_size <= beam_size * K);
 
-    std::vector<float> cent_distances;
-    std::vector<idx_t> cent_ids;
+    using C = CMax<float, int>;
 
     if (assign_index) {
         // search beam_size distances per query
         FAISS_THROW_IF_NOT(assign_index->d == d);
-        cent_distances.resize(n * beam_size * new_beam_size);
-        cent_ids.resize(n * beam_size * new_beam_size);
+        std::vector<float> cent_distances(n * beam_size * new_beam_size);
+        std::vector<idx_t> cent_ids(n * beam_size * new_beam_size);
         if (assign_index->ntotal != 0) {
             // then we assume the codebooks are already added to the index
             FAISS_THROW_IF_NOT(assign_index->ntotal == K);
@@ -267,68 +269,99 @@ void beam_search_encode_step(
                 new_beam_size,
                 cent_distances.data(),
                 cent_ids.data());
-    } else {
-        // do one big distance computation
-        cent_distances.resize(n * beam_size * K);
-        pairwise_L2sqr(
-                d, n * beam_size, residuals, K, cent, cent_distances.data());
+        InterruptCallback::check();
+
+#pragma omp parallel if (n > 100)
+        {
+            std::vector<int> perm(new_beam_size);
+#pragma omp for
+            for (int64_t i = 0; i < n; i++) {
+                const int32_t* codes_i = codes + i * m * beam_size;
+                int32_t* new_codes_i = new_codes + i * (m + 1) * new_beam_size;
+                const float* residuals_i = residuals + i * d * beam_size;
+                float* new_residuals_i = new_residuals + i * d * new_beam_size;
+                float* new_distances_i = new_distances + i * new_beam_size;
+
+                const float* cent_distances_i =
+                        cent_distances.data() + i * beam_size * new_beam_size;
+                const idx_t* cent_ids_i =
+                        cent_ids.data() + i * beam_size * new_beam_size;
+
+                // here we could be a tad more efficient by merging sorted
+                // arrays
+                for (int i_2 = 0; i_2 < new_beam_size; i_2++) {
+                    new_distances_i[i_2] = C::neutral();
+                }
+                std::fill(perm.begin(), perm.end(), -1);
+                heap_addn<C>(
+                        new_beam_size,
+                        new_distances_i,
+                        perm.data(),
+                        cent_distances_i,
+                        nullptr,
+                        beam_size * new_beam_size);
+                heap_reorder<C>(new_beam_size, new_distances_i, perm.data());
+
+                for (int j = 0; j < new_beam_size; j++) {
+                    int js = perm[j] / new_beam_size;
+                    int ls = cent_ids_i[perm[j]];
+                    if (m > 0) {
+                        memcpy(new_codes_i,
+                               codes_i + js * m,
+                               sizeof(*codes) * m);
+                    }
+                    new_codes_i[m] = ls;
+                    new_codes_i += m + 1;
+                    fvec_sub(
+                            d,
+                            residuals_i + js * d,
+                            cent + ls * d,
+                            new_residuals_i);
+                    new_residuals_i += d;
+                }
+            }
+        }
+        return;
     }
-    InterruptCallback::check();
-
-#pragma omp parallel for if (n > 100)
-    for (int64_t i = 0; i < n; i++) {
-        const int32_t* codes_i = codes + i * m * beam_size;
-        int32_t* new_codes_i = new_codes + i * (m + 1) * new_beam_size;
-        const float* residuals_i = residuals + i * d * beam_size;
-        float* new_residuals_i = new_residuals + i * d * new_beam_size;
 
-        float* new_distances_i = new_distances + i * new_beam_size;
-        using C = CMax<float, int>;
+    // Exhaustive assignment. The vectors are processed by tiles so that the
+    // (tile, beam_size, K) distance table is still in cache when the top-k
+    // selection reads it, instead of materializing the full (n, beam_size, K)
+    // table.
+    size_t tile_size = std::max(
+            beam_search_tile_nfloat / (beam_size * K), size_t(1));
+    tile_size = std::min(tile_size, n);
+    std::vector<float> cent_distances(tile_size * beam_size * K);
 
-        if (assign_index) {
-            const float* cent_distances_i =
-                    cent_distances.data() + i * beam_size * new_beam_size;
-            const idx_t* cent_ids_i =
-                    cent_ids.data() + i * beam_size * new_beam_size;
+    for (size_t i0 = 0; i0 < n; i0 += tile_size) {
+        size_t i1 = std::min(i0 + tile_size, n);
 
-            // here we could be a tad more efficient by merging sorted arrays
-            for (int i_2 = 0; i_2 < new_beam_size; i_2++) {
-                new_distances_i[i_2] = C::neutral();
-            }
-            std::vector<int> perm(new_beam_size, -1);
-            heap_addn<C>(
-                    new_beam_size,
-                    new_distances_i,
-                    perm.data(),
-                    cent_distances_i,
-                    nullptr,
-                    beam_size * new_beam_size);
-            heap_reorder<C>(new_beam_size, new_distances_i, perm.data());
-
-            for (int j = 0; j < new_beam_size; j++) {
-                int js = perm[j] / new_beam_size;
-                int ls = cent_ids_i[perm[j]];
-                if (m > 0) {
-                    memcpy(new_codes_i, codes_i + js * m, sizeof(*codes) * m);
+        pairwise_L2sqr(
+                d,
+                (i1 - i0) * beam_size,
+                residuals + i0 * beam_size * d,
+                K,
+                cent,
+                cent_distances.data());
+
+#pragma omp parallel if (i1 - i0 > 100)
+        {
+            std::vector<int> perm(new_beam_size);
+#pragma omp for
+            for (int64_t i = i0; i < i1; i++) {
+                const int32_t* codes_i = codes + i * m * beam_size;
+                int32_t* new_codes_i = new_codes + i * (m + 1) * new_beam_size;
+                const float* residuals_i = residuals + i * d * beam_size;
+                float* new_residuals_i = new_residuals + i * d * new_beam_size;
+                float* new_distances_i = new_distances + i * new_beam_size;
+
+                const float* cent_distances_i =
+                        cent_distances.data() + (i - i0) * beam_size * K;
+                // then we have to select the best results
+                for (int i_2 = 0; i_2 < new_beam_size; i_2++) {
+                    new_distances_i[i_2] = C::neutral();
                 }
-                new_codes_i[m] = ls;
-                new_codes_i += m + 1;
-                fvec_sub(
-                        d,
-                        residuals_i + js * d,
-                        cent + ls * d,
-                        new_residuals_i);
-                new_residuals_i += d;
-            }
-
-        } else {
-            const float* cent_distances_i =
-                    cent_distances.data() + i * beam_size * K;
-            // then we have to select the best results
-            for (int i_2 = 0; i_2 < new_beam_size; i_2++) {
-                new_distances_i[i_2] = C::neutral();
-            }
-            std::vector<int> perm(new_beam_size, -1);
+                std::fill(perm.begin(), perm.end(), -1);
 
 #define HANDLE_APPROX(NB, BD)                                  \
     case ApproxTopK_mode_t::APPROX_TOPK_BUCKETS_B##NB##_D##BD: \
@@ -341,40 +374,44 @@ void beam_search_encode_step(
                 perm.data());                                  \
         break;
 
-            switch (approx_topk_mode) {
-                HANDLE_APPROX(8, 3)
-                HANDLE_APPROX(8, 2)
-                HANDLE_APPROX(16, 2)
-                HANDLE_APPROX(32, 2)
-                default:
-                    heap_addn<C>(
-                            new_beam_size,
-                            new_distances_i,
-                            perm.data(),
-                            cent_distances_i,
-                            nullptr,
-                            beam_size * K);
-            }
-            heap_reorder<C>(new_beam_size, new_distances_i, perm.data());
+                switch (approx_topk_mode) {
+                    HANDLE_APPROX(8, 3)
+                    HANDLE_APPROX(8, 2)
+                    HANDLE_APPROX(16, 2)
+                    HANDLE_APPROX(32, 2)
+                    default:
+                        heap_addn<C>(
+                                new_beam_size,
+                                new_distances_i,
+                                perm.data(),
+                                cent_distances_i,
+                                nullptr,
+                                beam_size * K);
+                }
+                heap_reorder<C>(new_beam_size, new_distances_i, perm.data());
 
 #undef HANDLE_APPROX
 
-            for (int j = 0; j < new_beam_size; j++) {
-                int js = perm[j] / K;
-                int ls = perm[j] % K;
-                if (m > 0) {
-                    memcpy(new_codes_i, codes_i + js * m, sizeof(*codes) * m);
+                for (int j = 0; j < new_beam_size; j++) {
+                    int js = perm[j] / K;
+                    int ls = perm[j] % K;
+                    if (m > 0) {
+                        memcpy(new_codes_i,
+                               codes_i + js * m,
+                               sizeof(*codes) * m);
+                    }
+                    new_codes_i[m] = ls;
+                    new_codes_i += m + 1;
+                    fvec_sub(
+                            d,
+                            residuals_i + js * d,
+                            cent + ls * d,
+                            new_residuals_i);
+                    new_residuals_i += d;
                 }
-                new_codes_i[m] = ls;
-                new_codes_i += m + 1;
-                fvec_sub(
-                        d,
-                        residuals_i + js * d,
-                        cent + ls * d,
-                        new_residuals_i);
-                new_residuals_i += d;
             }
         }
+        InterruptCallback::check();
     }
 }
 
@@ -399,51 +436,56 @@ void beam_search_encode_step_tab(
 {
     FAISS_THROW_IF_NOT(ldc >= K);
 
-#pragma omp parallel for if (n > 100) schedule(dynamic)
-    for (int64_t i = 0; i < n; i++) {
+#pragma omp parallel if (n > 100)
+    {
+        // per-thread buffers, reused for all the vectors of the thread
         std::vector<float> cent_distances(beam_size * K);
         std::vector<float> cd_common(K);
+        std::vector<float> dp(K);
+        std::vector<int> perm(new_beam_size);
 
-        const int32_t* codes_i = codes + i * m * beam_size;
-        const float* query_cp_i = query_cp + i * ldqc;
-        const float* distances_i = distances + i * beam_size;
+#pragma omp for schedule(dynamic)
+        for (int64_t i = 0; i < n; i++) {
+            const int32_t* codes_i = codes + i * m * beam_size;
+            const float* query_cp_i = query_cp + i * ldqc;
+            const float* distances_i = distances + i * beam_size;
 
-        for (size_t k = 0; k < K; k++) {
-            cd_common[k] = cent_norms_i[k] - 2 * query_cp_i[k];
-        }
+            for (size_t k = 0; k < K; k++) {
+                cd_common[k] = cent_norms_i[k] - 2 * query_cp_i[k];
+            }
 
-        bool use_baseline_implementation = false;
-
-        // This is the baseline implementation. Its primary flaw
-        //   that it writes way too many info to the temporary buffer
-        //   called dp.
-        //
-        // This baseline code is kept intentionally because it is easy to
-        // understand what an optimized version optimizes exactly.
-        //
-        if (use_baseline_implementation) {
-            for (size_t b = 0; b < beam_size; b++) {
-                std::vector<float> dp(K);
-
-                for (size_t m1 = 0; m1 < m; m1++) {
-                    size_t c = codes_i[b * m + m1];
-                    const float* cb =
-                            &codebook_cross_norms
-                                    [(codebook_offsets[m1] + c) * ldc];
-                    fvec_add(K, cb, dp.data(), dp.data());
-                }
+            bool use_baseline_implementation = false;
+
+            // This is the baseline implementation. Its primary flaw
+            //   that it writes way too many info to the temporary buffer
+            //   called dp.
+            //
+            // This baseline code is kept intentionally because it is easy to
+            // understand what an optimized version optimizes exactly.
+            //
+            if (use_baseline_implementation) {
+                for (size_t b = 0; b < beam_size; b++) {
+                    std::vector<float> dp(K);
+
+                    for (size_t m1 = 0; m1 < m; m1++) {
+                        size_t c = codes_i[b * m + m1];
+                        const float* cb =
+                                &codebook_cross_norms
+                                        [(codebook_offsets[m1] + c) * ldc];
+                        fvec_add(K, cb, dp.data(), dp.data());
+                    }
 
-                for (size_t k = 0; k < K; k++) {
-                    cent_distances[b * K + k] =
-                            distances_i[b] + cd_common[k] + 2 * dp[k];
+                    for (size_t k = 0; k < K; k++) {
+                        cent_distances[b * K + k] =
+                                distances_i[b] + cd_common[k] + 2 * dp[k];
+                    }
                 }
-            }
 
-        } else {
-            // An optimized implementation that avoids using a temporary buffer
-            // and does the accumulation in registers.
+            } else {
+                // An optimized implementation that avoids using a temporary
+                // buffer and does the accumulation in registers.
 
-            // Compute a sum of NK AQ codes.
+                // Compute a sum of NK AQ codes.
 #define ACCUM_AND_FINALIZE_TAB(NK)               \
     case NK:                                     \
         for (size_t b = 0; b < beam_size; b++) { \
@@ -460,52 +502,49 @@ void beam_search_encode_step_tab(
         }                                        \
         break;
 
-            // this version contains many switch-case scenarios, but
-            // they won't affect branch predictor.
-            switch (m) {
-                case 0:
-                    // trivial case
-                    for (size_t b = 0; b < beam_size; b++) {
-                        for (size_t k = 0; k < K; k++) {
-                            cent_distances[b * K + k] =
-                                    distances_i[b] + cd_common[k];
+                // this version contains many switch-case scenarios, but
+                // they won't affect branch predictor.
+                switch (m) {
+                    case 0:
+                        // trivial case
+                        for (size_t b = 0; b < beam_size; b++) {
+                            for (size_t k = 0; k < K; k++) {
+                                cent_distances[b * K + k] =
+                                        distances_i[b] + cd_common[k];
+                            }
                         }
-                    }
-                    break;
-
-                    ACCUM_AND_FINALIZE_TAB(1)
-                    ACCUM_AND_FINALIZE_TAB(2)
-                    ACCUM_AND_FINALIZE_TAB(3)
-                    ACCUM_AND_FINALIZE_TAB(4)
-                    ACCUM_AND_FINALIZE_TAB(5)
-                    ACCUM_AND_FINALIZE_TAB(6)
-                    ACCUM_AND_FINALIZE_TAB(7)
-
-                default: {
-                    // m >= 8 case.
-
-                    // A temporary buffer has to be used due to the lack of
-                    // registers. But we'll try to accumulate up to 8 AQ codes
-                    // in registers and issue a single write operation to the
-                    // buffer, while the baseline does no accumulation. So, the
-                    // number of write operations to the temporary buffer is
-                    // reduced 8x.
-
-                    // allocate a temporary buffer
-                    std::vector<float> dp(K);
-
-                    for (size_t b = 0; b < beam_size; b++) {
-                        // Initialize it. Compute a sum of first 8 AQ codes
-                        // because m >= 8 .
-                        accum_and_store_tab<8, 4>(
-                                m,
-                                codebook_cross_norms,
-                                codebook_offsets,
-                                codes_i,
-                                b,
-                                ldc,
-                                K,
-                                dp.data());
+                        break;
+
+                        ACCUM_AND_FINALIZE_TAB(1)
+                        ACCUM_AND_FINALIZE_TAB(2)
+                        ACCUM_AND_FINALIZE_TAB(3)
+                        ACCUM_AND_FINALIZE_TAB(4)
+                        ACCUM_AND_FINALIZE_TAB(5)
+                        ACCUM_AND_FINALIZE_TAB(6)
+                        ACCUM_AND_FINALIZE_TAB(7)
+
+                    default: {
+                        // m >= 8 case.
+
+                        // A temporary buffer has to be used due to the lack of
+                        // registers. But we'll try to accumulate up to 8 AQ
+                        // codes in registers and issue a single write
+                        // operation to the buffer, while the baseline does no
+                        // accumulation. So, the number of write operations to
+                        // the temporary buffer is reduced 8x.
+
+                        for (size_t b = 0; b < beam_size; b++) {
+                            // Initialize it. Compute a sum of first 8 AQ codes
+                            // because m >= 8 .
+                            accum_and_store_tab<8, 4>(
+                                    m,
+                                    codebook_cross_norms,
+                                    codebook_offsets,
+                                    codes_i,
+                                    b,
+                                    ldc,
+                                    K,
+                                    dp.data());
 
 #define ACCUM_AND_ADD_TAB(NK)          \
     case NK:                           \
@@ -520,48 +559,49 @@ void beam_search_encode_step_tab(
                 dp.data());            \
         break;
 
-                        // accumulate up to 8 additional AQ codes into
-                        // a temporary buffer
-                        for (size_t im = 8; im < ((m + 7) / 8) * 8; im += 8) {
-                            size_t m_left = m - im;
-                            if (m_left > 8) {
-                                m_left = 8;
+                            // accumulate up to 8 additional AQ codes into
+                            // a temporary buffer
+                            for (size_t im = 8; im < ((m + 7) / 8) * 8;
+                                 im += 8) {
+                                size_t m_left = m - im;
+                                if (m_left > 8) {
+                                    m_left = 8;
+                                }
+
+                                switch (m_left) {
+                                    ACCUM_AND_ADD_TAB(1)
+                                    ACCUM_AND_ADD_TAB(2)
+                                    ACCUM_AND_ADD_TAB(3)
+                                    ACCUM_AND_ADD_TAB(4)
+                                    ACCUM_AND_ADD_TAB(5)
+                                    ACCUM_AND_ADD_TAB(6)
+                                    ACCUM_AND_ADD_TAB(7)
+                                    ACCUM_AND_ADD_TAB(8)
+                                }
                             }
 
-                            switch (m_left) {
-                                ACCUM_AND_ADD_TAB(1)
-                                ACCUM_AND_ADD_TAB(2)
-                                ACCUM_AND_ADD_TAB(3)
-                                ACCUM_AND_ADD_TAB(4)
-                                ACCUM_AND_ADD_TAB(5)
-                                ACCUM_AND_ADD_TAB(6)
-                                ACCUM_AND_ADD_TAB(7)
-                                ACCUM_AND_ADD_TAB(8)
+                            // done. finalize the result
+                            for (size_t k = 0; k < K; k++) {
+                                cent_distances[b * K + k] = distances_i[b] +
+                                        cd_common[k] + 2 * dp[k];
                             }
                         }
-
-                        // done. finalize the result
-                        for (size_t k = 0; k < K; k++) {
-                            cent_distances[b * K + k] =
-                                    distances_i[b] + cd_common[k] + 2 * dp[k];
-                        }
                     }
                 }
-            }
 
-            // the optimized implementation ends here
-        }
-        using C = CMax<float, int>;
-        int32_t* new_codes_i = new_codes + i * (m + 1) * new_beam_size;
-        float* new_distances_i = new_distances + i * new_beam_size;
+                // the optimized implementation ends here
+            }
+            using C = CMax<float, int>;
+            int32_t* new_codes_i = new_codes + i * (m + 1) * new_beam_size;
+            float* new_distances_i = new_distances + i * new_beam_size;
 
-        const float* cent_distances_i = cent_distances.data();
+            const float* cent_distances_i = cent_distances.data();
 
-        // then we have to select the best results
-        for (int i_2 = 0; i_2 < new_beam_size; i_2++) {
-            new_distances_i[i_2] = C::neutral();
-        }
-        std::vector<int> perm(new_beam_size, -1);
+            // then we have to select the best results
+            for (int i_2 = 0; i_2 < new_beam_size; i_2++) {
+                new_distances_i[i_2] = C::neutral();
+            }
+            std::fill(perm.begin(), perm.end(), -1);
 
 #define HANDLE_APPROX(NB, BD)                                  \
     case ApproxTopK_mode_t::APPROX_TOPK_BUCKETS_B##NB##_D##BD: \
@@ -574,34 +614,35 @@ void beam_search_encode_step_tab(
                 perm.data());                                  \
         break;
 
-        switch (approx_topk_mode) {
-            HANDLE_APPROX(8, 3)
-            HANDLE_APPROX(8, 2)
-            HANDLE_APPROX(16, 2)
-            HANDLE_APPROX(32, 2)
-            default:
-                heap_addn<C>(
-                        new_beam_size,
-                        new_distances_i,
-                        perm.data(),
-                        cent_distances_i,
-                        nullptr,
-                        beam_size * K);
-                break;
-        }
+            switch (approx_topk_mode) {
+                HANDLE_APPROX(8, 3)
+                HANDLE_APPROX(8, 2)
+                HANDLE_APPROX(16, 2)
+                HANDLE_APPROX(32, 2)
+                default:
+                    heap_addn<C>(
+                            new_beam_size,
+                            new_distances_i,
+                            perm.data(),
+                            cent_distances_i,
+                            nullptr,
+                            beam_size * K);
+                    break;
+            }
 
-        heap_reorder<C>(new_beam_size, new_distances_i, perm.data());
+            heap_reorder<C>(new_beam_size, new_distances_i, perm.data());
 
 #undef HANDLE_APPROX
 
-        for (int j = 0; j < new_beam_size; j++) {
-            int js = perm[j] / K;
-            int ls = perm[j] % K;
-            if (m > 0) {
-                memcpy(new_codes_i, codes_i + js * m, sizeof(*codes) * m);
+            for (int j = 0; j < new_beam_size; j++) {
+                int js = perm[j] / K;
+                int ls = perm[j] % K;
+                if (m > 0) {
+                    memcpy(new_codes_i, codes_i + js * m, sizeof(*codes) * m);
+                }
+                new_codes_i[m] = ls;
+                new_codes_i += m + 1;
             }
-            new_codes_i[m] = ls;
-            new_codes_i += m + 1;
         }
     }
 }
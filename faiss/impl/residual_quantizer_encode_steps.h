@@ -11,6 +11,7 @@
 #include <vector>
 
 #include <faiss/Index.h>
+#include <faiss/impl/platform_macros.h>
 #include <faiss/utils/approx_topk/mode.h>
 
 namespace faiss {
@@ -19,6 +20,11 @@ namespace faiss {
  * Single step of encoding
  ********************************************************************/
 
+/// beam_search_encode_step without assign_index processes the vectors by
+/// tiles whose (tile, beam_size, K) distance table has at most this many
+/// floats, so that the top-k selection reads it from cache
+FAISS_API extern size_t beam_search_tile_nfloat;
+
 /** Encode a residual by sampling from a centroid table.
  *
  * This is a single encoding step the residual quantizer.
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/sa_decode_kernels.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/cppcontrib/SaDecodeKernels.h>
+
+namespace faiss {
+
+bool sa_decode_use_kernels = true;
+
+namespace {
+
+using namespace cppcontrib;
+
+template <int DIM, int DSUB>
+void decode_pq(
+        const float*,
+        const float* fine_centroids,
+        size_t code_offset,
+        idx_t n,
+        const uint8_t* codes,
+        size_t code_stride,
+        float* x) {
+    using Decoder = IndexPQDecoder<DIM, DSUB>;
+#pragma omp parallel for if (n > 100)
+    for (idx_t i = 0; i < n; i++) {
+        Decoder::store(
+                fine_centroids,
+                codes + i * code_stride + code_offset,
+                x + i * DIM);
+    }
+}
+
+/// IVF codes, the centroid of the list is the coarse level
+template <int DIM, int DSUB, int COARSE_BITS>
+void decode_ivfpq(
+        const float* coarse_centroids,
+        const float* fine_centroids,
+        size_t,
+        idx_t n,
+        const uint8_t* codes,
+        size_t code_stride,
+        float* x) {
+    using Decoder = Index2LevelDecoder<DIM, DIM, DSUB, COARSE_BITS>;
+#pragma omp parallel for if (n > 100)
+    for (idx_t i = 0; i < n; i++) {
+        Decoder::store(
+                coarse_centroids,
+                fine_centroids,
+                codes + i * code_stride,
+                x + i * DIM);
+    }
+}
+
+/// coarse_bits = 0: PQ codes only
+template <int DIM, int DSUB>
+SaDecodeKernel::decode_fn_t get_kernel(int coarse_bits) {
+    switch (coarse_bits) {
+        case 0:
+            return decode_pq<DIM, DSUB>;
+        case 8:
+            return decode_ivfpq<DIM, DSUB, 8>;
+        case 16:
+            return decode_ivfpq<DIM, DSUB, 16>;
+        default:
+            return nullptr;
+    }
+}
+
+template <int DIM>
+SaDecodeKernel::decode_fn_t get_kernel(int dsub, int coarse_bits) {
+    switch (dsub) {
+        case 2:
+            return get_kernel<DIM, 2>(coarse_bits);
+        case 4:
+            return get_kernel<DIM, 4>(coarse_bits);
+        case 8:
+            return get_kernel<DIM, 8>(coarse_bits);
+        case 16:
+            return get_kernel<DIM, 16>(coarse_bits);
+        case 32:
+            return get_kernel<DIM, 32>(coarse_bits);
+        default:
+            return nullptr;
+    }
+}
+
+SaDecodeKernel::decode_fn_t get_kernel(
+        const ProductQuantizer& pq,
+        int coarse_bits) {
+    if (pq.nbits != 8) {
+        return nullptr;
+    }
+    int dsub = pq.dsub;
+    switch (pq.d) {
+        case 32:
+            return get_kernel<32>(dsub, coarse_bits);
+        case 64:
+            return get_kernel<64>(dsub, coarse_bits);
+        case 96:
+            return get_kernel<96>(dsub, coarse_bits);
+        case 128:
+            return get_kernel<128>(dsub, coarse_bits);
+        case 192:
+            return get_kernel<192>(dsub, coarse_bits);
+        case 256:
+            return get_kernel<256>(dsub, coarse_bits);
+        case 384:
+            return get_kernel<384>(dsub, coarse_bits);
+        case 512:
+            return get_kernel<512>(dsub, coarse_bits);
+        case 768:
+            return get_kernel<768>(dsub, coarse_bits);
+        default:
+            return nullptr;
+    }
+}
+
+} // namespace
+
+SaDecodeKernel::SaDecodeKernel(const Index* index) {
+    if (!sa_decode_use_kernels || !index) {
+        return;
+    }
+    d = index->d;
+    if (auto ipq = dynamic_cast<const IndexPQ*>(index)) {
+        decode_fn = get_kernel(ipq->pq, 0);
+        fine_centroids = ipq->pq.centroids.data();
+    } else if (auto ivfpq = dynamic_cast<const IndexIVFPQ*>(index)) {
+        size_t coarse_size = ivfpq->coarse_code_size();
+        if (!ivfpq->by_residual) {
+            decode_fn = get_kernel(ivfpq->pq, 0);
+            code_offset = coarse_size;
+        } else {
+            // the centroids must be a contiguous table
+            auto flat = dynamic_cast<const IndexFlat*>(ivfpq->quantizer);
+            if (!flat || flat->ntotal != ivfpq->nlist ||
+                (coarse_size != 1 && coarse_size != 2)) {
+                return;
+            }
+            decode_fn = get_kernel(ivfpq->pq, coarse_size * 8);
+            coarse_centroids = flat->get_xb();
+        }
+        fine_centroids = ivfpq->pq.centroids.data();
+    }
+}
+
+void SaDecodeKernel::decode(
+        idx_t n,
+        const uint8_t* codes,
+        size_t code_stride,
+        float* x) const {
+    decode_fn(
+            coarse_centroids,
+            fine_centroids,
+            code_offset,
+            n,
+            codes,
+            code_stride,
+            x);
+}
+
+} // namespace faiss
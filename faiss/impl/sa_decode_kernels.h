@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <faiss/Index.h>
+#include <faiss/impl/platform_macros.h>
+
+namespace faiss {
+
+/// set to false to always decode with the generic ProductQuantizer code
+FAISS_API extern bool sa_decode_use_kernels;
+
+/** Decoder of the standalone codes of an index with the compile-time
+ * specialized kernels of cppcontrib/SaDecodeKernels.h (AVX2, NEON or
+ * unrolled scalar code, depending on the build).
+ *
+ * Kernels are instantiated for PQ codes with 8-bit centroids, d in
+ * {32, 64, 96, 128, 192, 256, 384, 512, 768} and dsub in {2, 4, 8, 16,
+ * 32}, for:
+ *  - IndexPQ
+ *  - IndexIVFPQ with up to 65536 lists and an IndexFlat quantizer
+ *    (without residual, any quantizer)
+ *
+ * The decoded vectors are the same as with Index::sa_decode.
+ */
+struct SaDecodeKernel {
+    typedef void (*decode_fn_t)(
+            const float* coarse_centroids,
+            const float* fine_centroids,
+            size_t code_offset,
+            idx_t n,
+            const uint8_t* codes,
+            size_t code_stride,
+            float* x);
+
+    /// nullptr if there is no kernel for the index
+    decode_fn_t decode_fn = nullptr;
+    const float* coarse_centroids = nullptr;
+    const float* fine_centroids = nullptr;
+    /// offset of the PQ code when the coarse code is not decoded
+    size_t code_offset = 0;
+    int d = 0;
+
+    /// looks up the kernel for the index, the index must outlive this
+    explicit SaDecodeKernel(const Index* index);
+
+    bool is_available() const {
+        return decode_fn != nullptr;
+    }
+
+    /** decode n codes of sa_code_size() bytes that are code_stride bytes
+     * apart, parallelized over the codes */
+    void decode(idx_t n, const uint8_t* codes, size_t code_stride, float* x)
+            const;
+};
+
+} // namespace faiss
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/impl/sectioned_io.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <omp.h>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/index_io.h>
+
+namespace faiss {
+
+namespace {
+
+const uint32_t sectioned_version = 1;
+
+uint32_t sectioned_magic() {
+    return fourcc("FSec");
+}
+
+/***********************************************************
+ * Checksum: xxHash64-style rounds on 4 lanes, so that the dependency
+ * chains overlap
+ ***********************************************************/
+
+const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+
+const size_t checksum_chunk = 1 << 20;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t round64(uint64_t acc, uint64_t w) {
+    return rotl(acc + w * P2, 31) * P1;
+}
+
+inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P1;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t chunk_checksum(const uint8_t* data, size_t nbytes) {
+    uint64_t lanes[4] = {P1 + P2, P2, 0, 0 - P1};
+    size_t i = 0;
+    for (; i + 32 <= nbytes; i += 32) {
+        uint64_t w[4];
+        memcpy(w, data + i, 32);
+        for (int l = 0; l < 4; l++) {
+            lanes[l] = round64(lanes[l], w[l]);
+        }
+    }
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) +
+            rotl(lanes[3], 18);
+    for (; i + 8 <= nbytes; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = round64(h, w);
+    }
+    for (; i < nbytes; i++) {
+        h = round64(h, data[i]);
+    }
+    return mix64(h + nbytes);
+}
+
+size_t round_up(size_t x, size_t alignment) {
+    return (x + alignment - 1) / alignment * alignment;
+}
+
+/// bytes per pread call when loading a section in parallel
+const size_t read_chunk = 1 << 22;
+
+} // namespace
+
+uint64_t section_checksum(const void* data, size_t nbytes) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t nchunk = (nbytes + checksum_chunk - 1) / checksum_chunk;
+    std::vector<uint64_t> hashes(nchunk);
+#pragma omp parallel for if (nchunk > 1)
+    for (int64_t c = 0; c < nchunk; c++) {
+        size_t i0 = c * checksum_chunk;
+        size_t i1 = std::min(nbytes, i0 + checksum_chunk);
+        hashes[c] = chunk_checksum(bytes + i0, i1 - i0);
+    }
+    uint64_t h = nbytes;
+    for (uint64_t hc : hashes) {
+        h = mix64(h * P1 + hc);
+    }
+    return h;
+}
+
+bool is_sectioned_file(const char* fname) {
+    FILE* f = fopen(fname, "rb");
+    if (!f) {
+        return false;
+    }
+    uint32_t magic = 0;
+    size_t ret = fread(&magic, sizeof(magic), 1, f);
+    fclose(f);
+    return ret == 1 && magic == sectioned_magic();
+}
+
+/***********************************************************
+ * SectionedFileIOWriter
+ ***********************************************************/
+
+SectionedFileIOWriter::SectionedFileIOWriter(
+        const char* fname,
+        size_t alignment,
+        size_t min_section_size) {
+    FAISS_THROW_IF_NOT_MSG(
+            alignment >= 8 && (alignment & (alignment - 1)) == 0,
+            "alignment should be a power of 2 >= 8");
+    FAISS_THROW_IF_NOT(min_section_size > 0);
+    name = fname;
+    memset(&header, 0, sizeof(header));
+    header.magic = sectioned_magic();
+    header.version = sectioned_version;
+    header.alignment = alignment;
+    header.min_section_size = min_section_size;
+
+    f = fopen(fname, "wb");
+    FAISS_THROW_IF_NOT_FMT(
+            f, "could not open %s for writing: %s", fname, strerror(errno));
+    // placeholder, updated by close()
+    FAISS_THROW_IF_NOT(fwrite(&header, sizeof(header), 1, f) == 1);
+    file_size = sizeof(header);
+}
+
+void SectionedFileIOWriter::write_aligned(
+        const void* ptr,
+        size_t nbytes,
+        SectionEntry& entry) {
+    size_t offset = round_up(file_size, header.alignment);
+    if (offset > file_size) {
+        std::vector<uint8_t> padding(offset - file_size);
+        FAISS_THROW_IF_NOT_FMT(
+                fwrite(padding.data(), 1, padding.size(), f) == padding.size(),
+                "write error in %s: %s",
+                name.c_str(),
+                strerror(errno));
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            fwrite(ptr, 1, nbytes, f) == nbytes,
+            "write error in %s: %s",
+            name.c_str(),
+            strerror(errno));
+    entry.offset = offset;
+    entry.size = nbytes;
+    entry.checksum = section_checksum(ptr, nbytes);
+    file_size = offset + nbytes;
+}
+
+size_t SectionedFileIOWriter::operator()(
+        const void* ptr,
+        size_t size,
+        size_t nitems) {
+    FAISS_THROW_IF_NOT_MSG(f, "writing to a closed sectioned file");
+    size_t nbytes = size * nitems;
+    if (nbytes >= header.min_section_size) {
+        SectionEntry entry;
+        write_aligned(ptr, nbytes, entry);
+        sections.push_back(entry);
+    } else if (nbytes > 0) {
+        const uint8_t* bytes = (const uint8_t*)ptr;
+        stream.insert(stream.end(), bytes, bytes + nbytes);
+    }
+    return nitems;
+}
+
+void SectionedFileIOWriter::close() {
+    if (!f) {
+        return;
+    }
+    write_aligned(stream.data(), stream.size(), header.stream);
+    SectionEntry toc;
+    write_aligned(
+            sections.data(), sections.size() * sizeof(SectionEntry), toc);
+    header.toc_offset = toc.offset;
+    header.n_sections = sections.size();
+
+    FAISS_THROW_IF_NOT(fseek(f, 0, SEEK_SET) == 0);
+    FAISS_THROW_IF_NOT_FMT(
+            fwrite(&header, sizeof(header), 1, f) == 1,
+            "write error in %s: %s",
+            name.c_str(),
+            strerror(errno));
+    int ret = fclose(f);
+    f = nullptr;
+    FAISS_THROW_IF_NOT_FMT(
+            ret == 0,
+            "file %s close error: %s",
+            name.c_str(),
+            strerror(errno));
+}
+
+SectionedFileIOWriter::~SectionedFileIOWriter() noexcept(false) {
+    if (!f) {
+        return;
+    }
+    try {
+        close();
+    } catch (const std::exception& e) {
+        // we cannot raise an exception in the destructor
+        fprintf(stderr, "file %s close error: %s", name.c_str(), e.what());
+        if (f) {
+            fclose(f);
+            f = nullptr;
+        }
+    }
+}
+
+/***********************************************************
+ * SectionedFileIOReader
+ ***********************************************************/
+
+SectionedFileIOReader::SectionedFileIOReader(
+        const char* fname,
+        bool use_mmap,
+        bool verify_checksums)
+        : verify_checksums(verify_checksums) {
+    name = fname;
+    f = fopen(fname, "rb");
+    FAISS_THROW_IF_NOT_FMT(
+            f, "could not open %s for reading: %s", fname, strerror(errno));
+
+    read_at(&header, sizeof(header), 0);
+    FAISS_THROW_IF_NOT_FMT(
+            header.magic == sectioned_magic(),
+            "%s is not a sectioned index file",
+            fname);
+    FAISS_THROW_IF_NOT_FMT(
+            header.version == sectioned_version,
+            "unsupported sectioned file version %d in %s",
+            int(header.version),
+            fname);
+
+    FAISS_THROW_IF_NOT(fseek(f, 0, SEEK_END) == 0);
+    size_t file_size = ftell(f);
+    auto check_bounds = [&](const SectionEntry& e) {
+        FAISS_THROW_IF_NOT_FMT(
+                e.offset <= file_size && e.size <= file_size - e.offset,
+                "section out of the bounds of %s, truncated file?",
+                fname);
+    };
+    check_bounds(header.stream);
+    SectionEntry toc = {
+            header.toc_offset, header.n_sections * sizeof(SectionEntry), 0};
+    check_bounds(toc);
+
+    sections.resize(header.n_sections);
+    read_at(sections.data(), toc.size, toc.offset);
+    for (const SectionEntry& e : sections) {
+        check_bounds(e);
+    }
+
+    if (use_mmap) {
+        mmap_owner = std::make_shared<MmappedFileMappingOwner>(f);
+        stream_data = (const uint8_t*)mmap_owner->data() + header.stream.offset;
+    } else {
+        stream_buf.resize(header.stream.size);
+        read_at(stream_buf.data(), stream_buf.size(), header.stream.offset);
+        stream_data = stream_buf.data();
+    }
+    // the stream is small and read anyways, always check it
+    FAISS_THROW_IF_NOT_FMT(
+            section_checksum(stream_data, header.stream.size) ==
+                    header.stream.checksum,
+            "checksum mismatch in the stream section of %s",
+            fname);
+}
+
+void SectionedFileIOReader::read_at(void* ptr, size_t nbytes, size_t offset) {
+    int fd = filedescriptor();
+    size_t nchunk = (nbytes + read_chunk - 1) / read_chunk;
+    int nerr = 0;
+#pragma omp parallel for if (nchunk > 1) reduction(+ : nerr)
+    for (int64_t c = 0; c < nchunk; c++) {
+        size_t i0 = c * read_chunk;
+        size_t i1 = std::min(nbytes, i0 + read_chunk);
+        while (i0 < i1) {
+            ssize_t ret = pread(fd, (char*)ptr + i0, i1 - i0, offset + i0);
+            if (ret <= 0) {
+                if (ret < 0 && errno == EINTR) {
+                    continue;
+                }
+                nerr++;
+                break;
+            }
+            i0 += ret;
+        }
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            nerr == 0,
+            "read error in %s at offset %zd: %s",
+            name.c_str(),
+            offset,
+            strerror(errno));
+}
+
+const SectionEntry& SectionedFileIOReader::get_next_section(size_t nbytes) {
+    FAISS_THROW_IF_NOT_FMT(
+            next_section < sections.size(),
+            "read of %zd bytes past the last section of %s",
+            nbytes,
+            name.c_str());
+    const SectionEntry& e = sections[next_section];
+    FAISS_THROW_IF_NOT_FMT(
+            e.size == nbytes,
+            "read of %zd bytes does not match section %zd of %s "
+            "(%zd bytes): the reads should mirror the writes",
+            nbytes,
+            next_section,
+            name.c_str(),
+            size_t(e.size));
+    next_section++;
+    return e;
+}
+
+size_t SectionedFileIOReader::operator()(
+        void* ptr,
+        size_t size,
+        size_t nitems) {
+    size_t nbytes = size * nitems;
+    if (nbytes >= header.min_section_size) {
+        size_t no = next_section;
+        const SectionEntry& e = get_next_section(nbytes);
+        if (mmap_owner) {
+            memcpy(ptr, (const char*)mmap_owner->data() + e.offset, nbytes);
+        } else {
+            read_at(ptr, nbytes, e.offset);
+        }
+        FAISS_THROW_IF_NOT_FMT(
+                !verify_checksums ||
+                        section_checksum(ptr, nbytes) == e.checksum,
+                "checksum mismatch in section %zd of %s",
+                no,
+                name.c_str());
+        return nitems;
+    }
+    if (nbytes == 0) {
+        return nitems;
+    }
+    // same semantics as VectorIOReader at the end of the stream
+    size_t nremain = (header.stream.size - stream_pos) / size;
+    nitems = std::min(nitems, nremain);
+    memcpy(ptr, stream_data + stream_pos, size * nitems);
+    stream_pos += size * nitems;
+    return nitems;
+}
+
+void SectionedFileIOReader::read_batch(
+        size_t n,
+        void* const* ptrs,
+        const size_t* nbytes) {
+    // assign the buffers to sections in order, the parts of the stream are
+    // copied right away
+    std::vector<std::pair<void*, size_t>> tasks; // (buffer, section no)
+    for (size_t i = 0; i < n; i++) {
+        if (nbytes[i] >= header.min_section_size) {
+            tasks.emplace_back(ptrs[i], next_section);
+            get_next_section(nbytes[i]);
+        } else {
+            size_t ret = (*this)(ptrs[i], 1, nbytes[i]);
+            FAISS_THROW_IF_NOT_FMT(
+                    ret == nbytes[i],
+                    "read error in %s: %zd != %zd",
+                    name.c_str(),
+                    ret,
+                    nbytes[i]);
+        }
+    }
+
+    int nerr_read = 0, nerr_checksum = 0;
+#pragma omp parallel for schedule(dynamic) if (tasks.size() > 1) \
+        reduction(+ : nerr_read, nerr_checksum)
+    for (int64_t t = 0; t < tasks.size(); t++) {
+        void* ptr = tasks[t].first;
+        const SectionEntry& e = sections[tasks[t].second];
+        if (mmap_owner) {
+            memcpy(ptr, (const char*)mmap_owner->data() + e.offset, e.size);
+        } else {
+            try {
+                read_at(ptr, e.size, e.offset);
+            } catch (const std::exception&) {
+                nerr_read++;
+                continue;
+            }
+        }
+        if (verify_checksums && section_checksum(ptr, e.size) != e.checksum) {
+            nerr_checksum++;
+        }
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            nerr_read == 0, "read error in %s", name.c_str());
+    FAISS_THROW_IF_NOT_FMT(
+            nerr_checksum == 0,
+            "checksum mismatch in %d sections of %s",
+            nerr_checksum,
+            name.c_str());
+}
+
+size_t SectionedFileIOReader::get_view(void** ptr, size_t size, size_t nitems) {
+    FAISS_THROW_IF_NOT_MSG(mmap_owner, "views require the mmap mode");
+    size_t nbytes = size * nitems;
+    if (nbytes >= header.min_section_size) {
+        const SectionEntry& e = get_next_section(nbytes);
+        *ptr = (char*)mmap_owner->data() + e.offset;
+        return nitems;
+    }
+    if (nbytes == 0) {
+        *ptr = (void*)(stream_data + stream_pos);
+        return nitems;
+    }
+    size_t nremain = (header.stream.size - stream_pos) / size;
+    nitems = std::min(nitems, nremain);
+    *ptr = (void*)(stream_data + stream_pos);
+    stream_pos += size * nitems;
+    return nitems;
+}
+
+int SectionedFileIOReader::filedescriptor() {
+    return ::fileno(f);
+}
+
+SectionedFileIOReader::~SectionedFileIOReader() {
+    // the mapping stays valid after the file is closed
+    fclose(f);
+}
+
+} // namespace faiss
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/io.h>
+#include <faiss/impl/mapped_io.h>
+
+/***********************************************************
+ * Sectioned index files
+ *
+ * The serialization of an index is a sequence of read / write calls, and
+ * the deserialization mirrors the serialization call by call. The
+ * sectioned format stores each call of at least min_section_size bytes
+ * (the large arrays: codes, inverted lists, graphs, ...) in its own
+ * section, at an offset aligned to `alignment` bytes. The other calls
+ * (headers, sizes, parameters) are concatenated in the "stream" section.
+ * The reader serves the calls in the same order from the same sections.
+ *
+ * File layout:
+ *
+ *   SectionedFileHeader, at offset 0
+ *   the data sections, in write order, each one aligned
+ *   the stream section, aligned
+ *   the table of contents: n_sections SectionEntry, aligned
+ *
+ * Each section has a checksum of its content. The table of contents makes
+ * it possible to mmap the sections directly, to read them in parallel and
+ * to skip parts of the file without computing offsets by hand.
+ ***********************************************************/
+
+namespace faiss {
+
+struct SectionEntry {
+    uint64_t offset;   ///< in bytes from the beginning of the file
+    uint64_t size;     ///< in bytes
+    uint64_t checksum; ///< see section_checksum
+};
+
+struct SectionedFileHeader {
+    uint32_t magic;   ///< fourcc("FSec")
+    uint32_t version; ///< currently 1
+    uint64_t alignment;
+    uint64_t min_section_size;
+    SectionEntry stream;
+    uint64_t toc_offset;
+    uint64_t n_sections; ///< not including the stream
+};
+
+/// 64-bit checksum of a buffer, computed in parallel over 1 MiB chunks
+uint64_t section_checksum(const void* data, size_t nbytes);
+
+/// does the file start with the SectionedFileHeader magic?
+bool is_sectioned_file(const char* fname);
+
+struct SectionedFileIOWriter : IOWriter {
+    FILE* f = nullptr;
+    SectionedFileHeader header;
+    std::vector<SectionEntry> sections;
+    /// the stream section is kept in memory until close()
+    std::vector<uint8_t> stream;
+    size_t file_size = 0;
+
+    /** @param alignment   of the sections, a power of 2 (eg. 4096 for
+     *                     pages or O_DIRECT, 1 << 21 for huge pages)
+     * @param min_section_size  writes of at least this many bytes get
+     *                     their own section */
+    SectionedFileIOWriter(
+            const char* fname,
+            size_t alignment = 4096,
+            size_t min_section_size = 1 << 16);
+
+    size_t operator()(const void* ptr, size_t size, size_t nitems) override;
+
+    /// write the stream and the table of contents, called by the
+    /// destructor if not before
+    void close();
+
+    ~SectionedFileIOWriter() noexcept(false) override;
+
+   private:
+    void write_aligned(const void* ptr, size_t nbytes, SectionEntry& entry);
+};
+
+struct SectionedFileIOReader : IOReader {
+    SectionedFileHeader header;
+    std::vector<SectionEntry> sections;
+    /// next data section to be read
+    size_t next_section = 0;
+
+    /// the stream section and the read position in it
+    const uint8_t* stream_data = nullptr;
+    size_t stream_pos = 0;
+
+    /// set in mmap mode: the sections are views of the mapping
+    std::shared_ptr<MmappedFileMappingOwner> mmap_owner;
+
+    /// verify the checksums of the sections that are copied
+    bool verify_checksums;
+
+    /** @param use_mmap  map the file, so that the MaybeOwnedVectors of the
+     *                   index become views of the sections (see get_view)
+     * @param verify_checksums  check the sections that are copied. The
+     *                   views are not checked, so that the mapped pages
+     *                   are only loaded when accessed */
+    SectionedFileIOReader(
+            const char* fname,
+            bool use_mmap = false,
+            bool verify_checksums = true);
+
+    /// copy the next item(s): a section or a part of the stream
+    size_t operator()(void* ptr, size_t size, size_t nitems) override;
+
+    /** mmap mode only: same as operator() but returns the address of the
+     * data in the mapping, owned by mmap_owner */
+    size_t get_view(void** ptr, size_t size, size_t nitems);
+
+    /// the sections of the batch are loaded in parallel
+    void read_batch(size_t n, void* const* ptrs, const size_t* nbytes)
+            override;
+
+    int filedescriptor() override;
+
+    ~SectionedFileIOReader() override;
+
+   private:
+    FILE* f = nullptr;
+    std::vector<uint8_t> stream_buf;
+
+    const SectionEntry& get_next_section(size_t nbytes);
+    void read_at(void* ptr, size_t nbytes, size_t offset);
+};
+
+} // namespace faiss
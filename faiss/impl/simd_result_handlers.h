@@ -18,6 +18,7 @@
 #include <faiss/impl/IDSelector.h>
 #include <faiss/impl/ResultHandler.h>
 #include <faiss/impl/platform_macros.h>
+#include <faiss/invlists/DirectMap.h>
 #include <faiss/utils/AlignedTable.h>
 #include <faiss/utils/partitioning.h>
 
@@ -53,6 +54,10 @@ struct SIMDResultHandlerToFloat : SIMDResultHandler {
 
     /// these fields are used mainly for the IVF variants (with_id_map=true)
     const idx_t* id_map = nullptr; // map offset in invlist to vector id
+    /// if set, id_map is not used and the ids are returned as
+    /// lo_build(list_no, offset), to be resolved after the search
+    bool lazy_ids = false;
+    int64_t list_no = -1; // list being scanned, for lazy_ids
     const int* q_map = nullptr;    // map q to global query
     const uint16_t* dbias =
             nullptr; // table of biases to add to each query (for IVF L2 search)
@@ -185,7 +190,7 @@ struct ResultHandlerCompare : SIMDResultHandlerToFloat {
     int64_t adjust_id(size_t b, size_t j) {
         int64_t idx = j0 + 32 * b + j;
         if (with_id_map) {
-            idx = id_map[idx];
+            idx = lazy_ids ? lo_build(list_no, idx) : id_map[idx];
         }
         return idx;
     }
@@ -19,6 +19,7 @@
 #include <faiss/utils/random.h>
 
 #include <faiss/Index2Layer.h>
+#include <faiss/IndexAdaptiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
 #include <faiss/IndexFlat.h>
@@ -37,11 +38,15 @@
 #include <faiss/IndexNSG.h>
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexPQFastScan.h>
+#include <faiss/IndexAdditiveQuantizerWideFastScan.h>
+#include <faiss/IndexPQWideFastScan.h>
 #include <faiss/IndexPreTransform.h>
+#include <faiss/IndexPrefixRefine.h>
 #include <faiss/IndexRaBitQ.h>
 #include <faiss/IndexRefine.h>
 #include <faiss/IndexRowwiseMinMax.h>
 #include <faiss/IndexScalarQuantizer.h>
+#include <faiss/IndexVamana.h>
 #include <faiss/MetaIndexes.h>
 #include <faiss/VectorTransform.h>
 
@@ -103,6 +108,10 @@ void find_matching_parentheses(
 
 /// what kind of training does this coarse quantizer require?
 char get_trains_alone(const Index* coarse_quantizer) {
+    // the approximate index would be rebuilt at each k-means iteration
+    if (dynamic_cast<const IndexAdaptiveQuantizer*>(coarse_quantizer)) {
+        return 2;
+    }
     if (dynamic_cast<const IndexFlat*>(coarse_quantizer)) {
         return 0;
     }
@@ -141,9 +150,12 @@ std::map<std::string, ScalarQuantizer::QuantizerType> sq_types = {
         {"SQbf16", ScalarQuantizer::QT_bf16},
         {"SQ8_direct_signed", ScalarQuantizer::QT_8bit_direct_signed},
         {"SQ8_direct", ScalarQuantizer::QT_8bit_direct},
+        {"SQ4_nonuniform", ScalarQuantizer::QT_4bit_nonuniform},
+        {"SQ8_nonuniform", ScalarQuantizer::QT_8bit_nonuniform},
 };
 const std::string sq_pattern =
-        "(SQ4|SQ8|SQ6|SQfp16|SQbf16|SQ8_direct_signed|SQ8_direct)";
+        "(SQ4|SQ8|SQ6|SQfp16|SQbf16|SQ8_direct_signed|SQ8_direct|"
+        "SQ4_nonuniform|SQ8_nonuniform)";
 
 std::map<std::string, AdditiveQuantizer::Search_type_t> aq_search_type = {
         {"_Nfloat", AdditiveQuantizer::ST_norm_float},
@@ -208,6 +220,9 @@ VectorTransform* parse_VectorTransform(const std::string& description, int d) {
     if (match("RR([0-9]+)?")) {
         return new RandomRotationMatrix(d, mres_to_int(sm[1], d));
     }
+    if (match("HR")) {
+        return new HadamardRotation(d);
+    }
     if (match("ITQ([0-9]+)?")) {
         return new ITQTransform(d, mres_to_int(sm[1], d), sm[1].length() > 0);
     }
@@ -271,6 +286,10 @@ Index* parse_coarse_quantizer(
         int hnsw_M = sm[2].length() > 0 ? std::stoi(sm[2]) : 32;
         return new IndexHNSWFlat(d, hnsw_M, mt);
     }
+    if (match("IVF([0-9]+[kM]?)_ADAPT")) {
+        nlist = parse_nlist(sm[1].str());
+        return new IndexAdaptiveQuantizer(d, mt);
+    }
     if (match("IVF([0-9]+[kM]?)_NSG([0-9]+)")) {
         nlist = parse_nlist(sm[1].str());
         int R = std::stoi(sm[2]);
@@ -462,6 +481,10 @@ IndexHNSW* parse_IndexHNSW(
         return new IndexHNSWFlat(d, hnsw_M, mt);
     }
 
+    if (match("PQ([0-9]+)x4fs")) {
+        int M = std::stoi(sm[1].str());
+        return new IndexHNSWPQFastScan(d, M, hnsw_M, mt);
+    }
     if (match("PQ([0-9]+)(x[0-9]+)?(np)?")) {
         int M = std::stoi(sm[1].str());
         int nbit = mres_to_int(sm[2], 8, 1);
@@ -545,6 +568,12 @@ Index* parse_other_indexes(
     if (description == "Flat") {
         return new IndexFlat(d, metric);
     }
+    if (description == "Flatbf16") {
+        return new IndexFlatBF16(d, metric);
+    }
+    if (description == "Flatint8") {
+        return new IndexFlatInt8(d, metric);
+    }
 
     // IndexLSH
     if (match("LSH([0-9]*)(r?)(t?)")) {
@@ -583,6 +612,13 @@ Index* parse_other_indexes(
         return new IndexPQFastScan(d, M, 4, metric, bbs);
     }
 
+    // IndexPQWideFastScan
+    if (match("PQ([0-9]+)x([5-8])fs")) {
+        int M = std::stoi(sm[1].str());
+        int nbit = std::stoi(sm[2].str());
+        return new IndexPQWideFastScan(d, M, nbit, metric);
+    }
+
     // IndexResidualCoarseQuantizer and IndexResidualQuantizer
     std::string pattern = "(RQ|RCQ)" + aq_def_pattern + aq_norm_pattern;
     if (match(pattern)) {
@@ -662,6 +698,37 @@ Index* parse_other_indexes(
         }
     }
 
+    // IndexAdditiveQuantizerWideFastScan, the default norm is cqint8
+    // RQ{M}x8fs_{search_type}, PRQ{nsplits}x{Msub}x8fs_{search_type}
+    auto aq_wide_search_type = [&]() {
+        std::string stok = sm[sm.size() - 1].str();
+        if (stok == "" && metric == METRIC_L2) {
+            return AdditiveQuantizer::ST_norm_cqint8;
+        }
+        return aq_parse_search_type(stok, metric);
+    };
+    if (match("(LSQ|RQ)([0-9]+)x8fs" + aq_norm_pattern)) {
+        int M = std::stoi(sm[2].str());
+        auto st = aq_wide_search_type();
+        if (sm[1].str() == "RQ") {
+            return new IndexResidualQuantizerWideFastScan(d, M, metric, st);
+        } else {
+            return new IndexLocalSearchQuantizerWideFastScan(d, M, metric, st);
+        }
+    }
+    if (match("(PLSQ|PRQ)([0-9]+)x([0-9]+)x8fs" + aq_norm_pattern)) {
+        int nsplits = std::stoi(sm[2].str());
+        int Msub = std::stoi(sm[3].str());
+        auto st = aq_wide_search_type();
+        if (sm[1].str() == "PRQ") {
+            return new IndexProductResidualQuantizerWideFastScan(
+                    d, nsplits, Msub, metric, st);
+        } else {
+            return new IndexProductLocalSearchQuantizerWideFastScan(
+                    d, nsplits, Msub, metric, st);
+        }
+    }
+
     // IndexRaBitQ
     if (match(rabitq_pattern)) {
         return new IndexRaBitQ(d, metric);
@@ -706,6 +773,23 @@ std::unique_ptr<Index> index_factory_sub(
         return std::unique_ptr<Index>(idmap);
     }
 
+    // Matryoshka prefix search: the first d' components are indexed by
+    // the rest of the description, the others stored in an IndexFlat
+    if (re_match(description, "Prefix([0-9]+),(.+)", sm)) {
+        int d_prefix = std::stoi(sm[1].str());
+        FAISS_THROW_IF_NOT_FMT(
+                d_prefix > 0 && d_prefix < d,
+                "invalid prefix dimension %d for d=%d",
+                d_prefix,
+                d);
+        std::unique_ptr<Index> base_index =
+                index_factory_sub(d_prefix, sm[2].str(), metric);
+        IndexPrefixRefine* index_pr = new IndexPrefixRefine(
+                base_index.release(), new IndexFlat(d - d_prefix, metric));
+        index_pr->own_fields = true;
+        return std::unique_ptr<Index>(index_pr);
+    }
+
     // handle refines
     if (re_match(description, "(.+),RFlat", sm) ||
         re_match(description, "(.+),Refine\\((.+)\\)", sm)) {
@@ -835,6 +919,13 @@ std::unique_ptr<Index> index_factory_sub(
         return std::unique_ptr<Index>(index);
     }
 
+    // Vamana64 or Vamana64,Flat: graph only, Vamana64,PQ32: PQ-guided search
+    if (re_match(description, "Vamana([0-9]*)(,Flat|,PQ([0-9]+))?", sm)) {
+        int R = mres_to_int(sm[1], 64);
+        int pq_m = mres_to_int(sm[3], 0);
+        return std::unique_ptr<Index>(new IndexVamana(d, R, pq_m, metric));
+    }
+
     // IndexRowwiseMinMax, fp32 version
     if (description.compare(0, 7, "MinMax,") == 0) {
         size_t comma = description.find(",");
@@ -936,6 +1027,9 @@ IndexBinary* index_binary_factory(int d, const char* description) {
         IndexBinaryHNSW* index_hnsw = new IndexBinaryHNSW(d, M);
         index = index_hnsw;
 
+    } else if (sscanf(description, "BMIH%d", &nhash) == 1) {
+        index = new IndexBinaryMIH(d, nhash);
+
     } else if (sscanf(description, "BHash%dx%d", &nhash, &b) == 2) {
         index = new IndexBinaryMultiHash(d, nhash, b);
 
@@ -44,6 +44,24 @@ void write_index_binary(const IndexBinary* idx, const char* fname);
 void write_index_binary(const IndexBinary* idx, FILE* f);
 void write_index_binary(const IndexBinary* idx, IOWriter* writer);
 
+/** Write the index in the sectioned format (see impl/sectioned_io.h): the
+ * large arrays are stored in sections aligned to `alignment` bytes, with a
+ * table of contents and per-section checksums. read_index(fname) detects
+ * the format. With IO_FLAG_MMAP_IFC the sections are mapped, otherwise
+ * they are loaded in parallel and their checksums are verified.
+ */
+void write_index_sectioned(
+        const Index* idx,
+        const char* fname,
+        size_t alignment = 4096,
+        size_t min_section_size = 1 << 16,
+        int io_flags = 0);
+void write_index_binary_sectioned(
+        const IndexBinary* idx,
+        const char* fname,
+        size_t alignment = 4096,
+        size_t min_section_size = 1 << 16);
+
 // The read_index flags are implemented only for a subset of index types.
 const int IO_FLAG_READ_ONLY = 2;
 // strip directory component from ondisk filename, and assume it's in
@@ -74,6 +92,19 @@ struct HNSWIndexConfig {
     float disk_cache_ratio = 0;
     const char* external_storage_path;
 
+    /// hybrid embedding store used when disk_cache_ratio > 0: the top
+    /// disk_cache_ratio % nodes by degree are served from
+    /// external_storage_path instead of being recomputed. Degrees are read
+    /// from degree_path if set, otherwise computed from the graph.
+    const char* degree_path = nullptr;
+    /// keep the pinned embeddings in RAM instead of reading them from SSD
+    bool hybrid_store_in_ram = false;
+    /// load a store saved with HybridEmbeddingStore::write instead
+    const char* hybrid_store_path = nullptr;
+    /// node blocks written by HNSWNodeBlocks::write, used by search for the
+    /// vectors and the level 0 neighbor lists
+    const char* node_blocks_path = nullptr;
+
     HNSWIndexConfig(
             bool is_compact,
             bool is_skip_neighbors,
@@ -102,9 +133,19 @@ Index* read_index(
         int io_flags = 0,
         const HNSWIndexConfig& hnsw_config = HNSWIndexConfig());
 
-IndexBinary* read_index_binary(const char* fname, int io_flags = 0);
-IndexBinary* read_index_binary(FILE* f, int io_flags = 0);
-IndexBinary* read_index_binary(IOReader* reader, int io_flags = 0);
+/// hnsw_config applies to the IndexBinaryHNSW graphs, as for read_index
+IndexBinary* read_index_binary(
+        const char* fname,
+        int io_flags = 0,
+        const HNSWIndexConfig& hnsw_config = HNSWIndexConfig());
+IndexBinary* read_index_binary(
+        FILE* f,
+        int io_flags = 0,
+        const HNSWIndexConfig& hnsw_config = HNSWIndexConfig());
+IndexBinary* read_index_binary(
+        IOReader* reader,
+        int io_flags = 0,
+        const HNSWIndexConfig& hnsw_config = HNSWIndexConfig());
 
 void write_VectorTransform(const VectorTransform* vt, const char* fname);
 void write_VectorTransform(const VectorTransform* vt, IOWriter* f);
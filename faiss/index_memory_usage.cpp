@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/index_memory_usage.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#include <faiss/IndexAdditiveQuantizer.h>
+#include <faiss/IndexFlatCodes.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexPreTransform.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/IndexReplicas.h>
+#include <faiss/IndexResultCache.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/IndexShards.h>
+#include <faiss/VectorTransform.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/invlists/BlockInvertedLists.h>
+#include <faiss/invlists/DirectMap.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/invlists/OnDiskInvertedLists.h>
+
+namespace faiss {
+
+/***************************************************************
+ * IndexMemoryUsage
+ ***************************************************************/
+
+void IndexMemoryUsage::add(
+        const std::string& name,
+        size_t nbytes,
+        bool owned,
+        bool evictable,
+        bool estimated) {
+    if (nbytes == 0) {
+        return;
+    }
+    MemoryComponent c;
+    c.name = name;
+    c.nbytes = nbytes;
+    c.owned = owned;
+    c.evictable = evictable;
+    c.estimated = estimated;
+    components.push_back(c);
+}
+
+void IndexMemoryUsage::add_sub(
+        const std::string& prefix,
+        const IndexMemoryUsage& sub) {
+    for (const MemoryComponent& c : sub.components) {
+        components.push_back(c);
+        components.back().name = prefix + "." + c.name;
+    }
+}
+
+size_t IndexMemoryUsage::total() const {
+    size_t n = 0;
+    for (const MemoryComponent& c : components) {
+        n += c.nbytes;
+    }
+    return n;
+}
+
+size_t IndexMemoryUsage::owned_bytes() const {
+    size_t n = 0;
+    for (const MemoryComponent& c : components) {
+        n += c.owned ? c.nbytes : 0;
+    }
+    return n;
+}
+
+size_t IndexMemoryUsage::evictable_bytes() const {
+    size_t n = 0;
+    for (const MemoryComponent& c : components) {
+        n += c.owned && c.evictable ? c.nbytes : 0;
+    }
+    return n;
+}
+
+size_t IndexMemoryUsage::get(const std::string& name) const {
+    size_t n = 0;
+    for (const MemoryComponent& c : components) {
+        if (c.name == name ||
+            (c.name.size() > name.size() &&
+             c.name.compare(0, name.size(), name) == 0 &&
+             c.name[name.size()] == '.')) {
+            n += c.nbytes;
+        }
+    }
+    return n;
+}
+
+std::string IndexMemoryUsage::to_string() const {
+    std::string s;
+    char buf[256];
+    for (const MemoryComponent& c : components) {
+        snprintf(
+                buf,
+                sizeof(buf),
+                "%s: %zd bytes%s%s%s\n",
+                c.name.c_str(),
+                c.nbytes,
+                c.owned ? "" : " (not owned)",
+                c.evictable ? " (evictable)" : "",
+                c.estimated ? " (estimated)" : "");
+        s += buf;
+    }
+    snprintf(
+            buf,
+            sizeof(buf),
+            "total: %zd bytes, owned: %zd bytes\n",
+            total(),
+            owned_bytes());
+    s += buf;
+    return s;
+}
+
+namespace {
+
+template <typename T>
+void add_vector(
+        IndexMemoryUsage& usage,
+        const std::string& name,
+        const std::vector<T>& v) {
+    usage.add(name, v.capacity() * sizeof(T));
+}
+
+template <typename T>
+void add_vector(
+        IndexMemoryUsage& usage,
+        const std::string& name,
+        const MaybeOwnedVector<T>& v) {
+    if (v.is_owned) {
+        add_vector(usage, name, v.owned_data);
+    } else {
+        usage.add(name, v.size() * sizeof(T), false);
+    }
+}
+
+template <typename T>
+void add_vector(
+        IndexMemoryUsage& usage,
+        const std::string& name,
+        const AlignedTable<T>& v) {
+    usage.add(name, v.tab.nbytes());
+}
+
+void add_vector_transform(
+        IndexMemoryUsage& usage,
+        const std::string& name,
+        const VectorTransform* vt) {
+    if (auto lt = dynamic_cast<const LinearTransform*>(vt)) {
+        add_vector(usage, name, lt->A);
+        add_vector(usage, name, lt->b);
+    }
+}
+
+void add_additive_quantizer(
+        IndexMemoryUsage& usage,
+        const std::string& name,
+        const AdditiveQuantizer* aq) {
+    if (!aq) {
+        return;
+    }
+    add_vector(usage, name, aq->codebooks);
+    add_vector(usage, name + "_tables", aq->centroid_norms);
+    add_vector(usage, name + "_tables", aq->codebook_cross_products);
+}
+
+void add_hnsw(IndexMemoryUsage& usage, const HNSW& hnsw) {
+    add_vector(usage, "graph.levels", hnsw.levels);
+    add_vector(usage, "graph.offsets", hnsw.offsets);
+    add_vector(usage, "graph.neighbors", hnsw.neighbors);
+    add_vector(usage, "graph.neighbors", hnsw.compact_neighbors_data);
+    add_vector(usage, "graph.offsets", hnsw.compact_level_ptr);
+    add_vector(usage, "graph.offsets", hnsw.compact_node_offsets);
+    add_vector(usage, "graph.offsets", hnsw.compressed_level_ptr);
+    add_vector(usage, "graph.deleted", hnsw.deleted);
+    add_vector(usage, "graph.pq_codes", hnsw.pq_codes);
+}
+
+} // namespace
+
+IndexMemoryUsage get_invlists_memory_usage(const InvertedLists* il) {
+    IndexMemoryUsage usage;
+    if (!il) {
+        return usage;
+    }
+    if (auto ail = dynamic_cast<const ArrayInvertedLists*>(il)) {
+        size_t codes[2] = {0, 0}, ids[2] = {0, 0}; // [not owned, owned]
+        for (size_t l = 0; l < ail->nlist; l++) {
+            const auto& c = ail->codes[l];
+            const auto& i = ail->ids[l];
+            codes[c.is_owned] += c.is_owned ? c.owned_data.capacity()
+                                            : c.size();
+            ids[i.is_owned] +=
+                    (i.is_owned ? i.owned_data.capacity() : i.size()) *
+                    sizeof(idx_t);
+        }
+        usage.add("codes", codes[1]);
+        usage.add("codes", codes[0], false);
+        usage.add("ids", ids[1]);
+        usage.add("ids", ids[0], false);
+        size_t cids = 0;
+        for (const CompressedIDs& c : ail->compressed_ids) {
+            cids += c.nbytes();
+        }
+        usage.add("ids", cids);
+    } else if (auto bil = dynamic_cast<const BlockInvertedLists*>(il)) {
+        size_t codes = 0, ids = 0, cids = 0;
+        for (size_t l = 0; l < bil->nlist; l++) {
+            codes += bil->codes[l].tab.nbytes();
+            ids += bil->ids[l].capacity() * sizeof(idx_t);
+        }
+        for (const CompressedIDs& c : bil->compressed_ids) {
+            cids += c.nbytes();
+        }
+        usage.add("codes", codes);
+        usage.add("ids", ids + cids);
+    } else if (auto odil = dynamic_cast<const OnDiskInvertedLists*>(il)) {
+        // the codes and ids are in the mmapped file
+        usage.add("mmapped", odil->totsize, false);
+        usage.add("lists", odil->lists.capacity() * sizeof(odil->lists[0]));
+    } else {
+        size_t ntotal = il->compute_ntotal();
+        size_t cs = il->code_size == InvertedLists::INVALID_CODE_SIZE
+                ? 0
+                : il->code_size;
+        usage.add("codes", ntotal * cs, true, false, true);
+        usage.add("ids", ntotal * sizeof(idx_t), true, false, true);
+    }
+    return usage;
+}
+
+IndexMemoryUsage get_index_memory_usage(const Index* index) {
+    IndexMemoryUsage usage;
+    if (!index) {
+        return usage;
+    }
+    if (auto rc = dynamic_cast<const IndexResultCache*>(index)) {
+        usage.add_sub("index", get_index_memory_usage(rc->index));
+        usage.add("cache", rc->cache_nbytes(), true, true);
+    } else if (auto ipt = dynamic_cast<const IndexPreTransform*>(index)) {
+        for (size_t i = 0; i < ipt->chain.size(); i++) {
+            add_vector_transform(usage, "transforms", ipt->chain[i]);
+        }
+        usage.add_sub("index", get_index_memory_usage(ipt->index));
+    } else if (auto idmap2 = dynamic_cast<const IndexIDMap2*>(index)) {
+        add_vector(usage, "id_map", idmap2->id_map);
+        usage.add("rev_map", idmap2->rev_map.memory_usage());
+        usage.add_sub("index", get_index_memory_usage(idmap2->index));
+    } else if (auto idmap = dynamic_cast<const IndexIDMap*>(index)) {
+        add_vector(usage, "id_map", idmap->id_map);
+        usage.add_sub("index", get_index_memory_usage(idmap->index));
+    } else if (auto ir = dynamic_cast<const IndexRefine*>(index)) {
+        usage.add_sub("base_index", get_index_memory_usage(ir->base_index));
+        usage.add_sub(
+                "refine_index", get_index_memory_usage(ir->refine_index));
+    } else if (auto sh = dynamic_cast<const IndexShards*>(index)) {
+        for (int i = 0; i < sh->count(); i++) {
+            usage.add_sub(
+                    "shard" + std::to_string(i),
+                    get_index_memory_usage(sh->at(i)));
+        }
+    } else if (auto rep = dynamic_cast<const IndexReplicas*>(index)) {
+        for (int i = 0; i < rep->count(); i++) {
+            usage.add_sub(
+                    "replica" + std::to_string(i),
+                    get_index_memory_usage(rep->at(i)));
+        }
+    } else if (auto hnsw = dynamic_cast<const IndexHNSW*>(index)) {
+        add_hnsw(usage, hnsw->hnsw);
+        usage.add_sub("storage", get_index_memory_usage(hnsw->storage));
+    } else if (auto ivf = dynamic_cast<const IndexIVF*>(index)) {
+        usage.add_sub("quantizer", get_index_memory_usage(ivf->quantizer));
+        for (const MemoryComponent& c :
+             get_invlists_memory_usage(ivf->invlists).components) {
+            usage.components.push_back(c);
+        }
+        const DirectMap& dm = ivf->direct_map;
+        add_vector(usage, "direct_map", dm.array);
+        usage.add("direct_map", dm.hashtable.memory_usage());
+        if (auto ivfpq = dynamic_cast<const IndexIVFPQ*>(index)) {
+            add_vector(usage, "pq", ivfpq->pq.centroids);
+            add_vector(usage, "precomputed_table", ivfpq->precomputed_table);
+            add_vector(
+                    usage,
+                    "precomputed_table",
+                    ivfpq->precomputed_table_fp16);
+        }
+    } else if (auto acq = dynamic_cast<const AdditiveCoarseQuantizer*>(index)) {
+        add_additive_quantizer(usage, "aq", acq->aq);
+        add_vector(usage, "centroid_norms", acq->centroid_norms);
+    } else if (auto ifc = dynamic_cast<const IndexFlatCodes*>(index)) {
+        add_vector(usage, "codes", ifc->codes);
+        if (auto ipq = dynamic_cast<const IndexPQ*>(index)) {
+            add_vector(usage, "pq", ipq->pq.centroids);
+        } else if (
+                auto isq = dynamic_cast<const IndexScalarQuantizer*>(index)) {
+            add_vector(usage, "sq", isq->sq.trained);
+        } else if (
+                auto iaq =
+                        dynamic_cast<const IndexAdditiveQuantizer*>(index)) {
+            add_additive_quantizer(usage, "aq", iaq->aq);
+        }
+    } else {
+        size_t code_size = 0;
+        try {
+            code_size = index->sa_code_size();
+        } catch (const FaissException&) {
+            code_size = index->d * sizeof(float);
+        }
+        usage.add("codes", index->ntotal * code_size, true, false, true);
+    }
+    return usage;
+}
+
+namespace {
+
+void collect_caches(Index* index, std::vector<IndexResultCache*>& caches) {
+    if (auto rc = dynamic_cast<IndexResultCache*>(index)) {
+        caches.push_back(rc);
+        collect_caches(rc->index, caches);
+    } else if (auto ipt = dynamic_cast<IndexPreTransform*>(index)) {
+        collect_caches(ipt->index, caches);
+    } else if (auto idmap = dynamic_cast<IndexIDMap*>(index)) {
+        collect_caches(idmap->index, caches);
+    } else if (auto ir = dynamic_cast<IndexRefine*>(index)) {
+        collect_caches(ir->base_index, caches);
+        collect_caches(ir->refine_index, caches);
+    } else if (auto sh = dynamic_cast<IndexShards*>(index)) {
+        for (int i = 0; i < sh->count(); i++) {
+            collect_caches(sh->at(i), caches);
+        }
+    } else if (auto rep = dynamic_cast<IndexReplicas*>(index)) {
+        for (int i = 0; i < rep->count(); i++) {
+            collect_caches(rep->at(i), caches);
+        }
+    }
+}
+
+} // namespace
+
+size_t enforce_memory_budget(Index* index, size_t budget) {
+    size_t used = get_index_memory_usage(index).owned_bytes();
+    if (used <= budget) {
+        return 0;
+    }
+    std::vector<IndexResultCache*> caches;
+    collect_caches(index, caches);
+    // release the largest caches first
+    std::sort(
+            caches.begin(),
+            caches.end(),
+            [](const IndexResultCache* a, const IndexResultCache* b) {
+                return a->cache_nbytes() > b->cache_nbytes();
+            });
+    size_t released = 0;
+    for (IndexResultCache* rc : caches) {
+        if (used - released <= budget) {
+            break;
+        }
+        size_t nbytes = rc->cache_nbytes();
+        rc->clear_cache();
+        released += nbytes;
+    }
+    return released;
+}
+
+} // namespace faiss
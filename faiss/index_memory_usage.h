@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+// Memory accounting for indexes
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace faiss {
+
+struct Index;
+struct InvertedLists;
+
+/// memory used by one component of an index
+struct MemoryComponent {
+    /// eg. "codes", "ids", "graph.neighbors", "quantizer.codes"
+    std::string name;
+    size_t nbytes = 0;
+    /// false if the data is a view on memory owned elsewhere (eg. a
+    /// memory-mapped file or a MaybeOwnedVector view)
+    bool owned = true;
+    /// a cache that can be dropped without losing data, see
+    /// enforce_memory_budget
+    bool evictable = false;
+    /// computed from ntotal and the code size for an index type that is
+    /// not handled explicitly
+    bool estimated = false;
+};
+
+/// breakdown of the memory used by an index, by component
+struct IndexMemoryUsage {
+    std::vector<MemoryComponent> components;
+
+    void add(
+            const std::string& name,
+            size_t nbytes,
+            bool owned = true,
+            bool evictable = false,
+            bool estimated = false);
+
+    /// add the components of a sub-index, prefixed with "prefix."
+    void add_sub(const std::string& prefix, const IndexMemoryUsage& sub);
+
+    /// all the bytes, owned or not
+    size_t total() const;
+
+    /// bytes that are resident because of the index (owned)
+    size_t owned_bytes() const;
+
+    /// owned bytes that enforce_memory_budget can release
+    size_t evictable_bytes() const;
+
+    /// sum of the components whose name is name or starts with "name."
+    size_t get(const std::string& name) const;
+
+    /// one line per component
+    std::string to_string() const;
+};
+
+/** Memory used by an index and its sub-indexes (quantizer, storage,
+ * shards...), by component. The index types that are not handled
+ * explicitly get an estimate from ntotal * sa_code_size(). Small fixed-size
+ * fields are not counted. */
+IndexMemoryUsage get_index_memory_usage(const Index* index);
+
+/// memory used by the inverted lists (codes, ids, mmapped data)
+IndexMemoryUsage get_invlists_memory_usage(const InvertedLists* invlists);
+
+/** Release the evictable caches in the index tree (eg. the cached queries
+ * of an IndexResultCache) until the owned memory of the index is at most
+ * budget bytes.
+ *
+ * @return the number of bytes released
+ */
+size_t enforce_memory_budget(Index* index, size_t budget);
+
+} // namespace faiss
@@ -7,9 +7,15 @@
 
 #include <faiss/invlists/BlockInvertedLists.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
 #include <faiss/impl/CodePacker.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/utils/utils.h>
 
 #include <faiss/impl/io.h>
 #include <faiss/impl/io_macros.h>
@@ -48,29 +54,96 @@ size_t BlockInvertedLists::add_entries(
         return 0;
     }
     FAISS_THROW_IF_NOT(list_no < nlist);
-    size_t o = ids[list_no].size();
-    ids[list_no].resize(o + n_entry);
+    size_t o = list_size(list_no);
+    resize(list_no, o + n_entry);
     memcpy(&ids[list_no][o], ids_in, sizeof(ids_in[0]) * n_entry);
-    size_t n_block = (o + n_entry + n_per_block - 1) / n_per_block;
-    codes[list_no].resize(n_block * block_size);
-    if (o % block_size == 0) {
+    if (o % n_per_block == 0) {
         // copy whole blocks
-        memcpy(&codes[list_no][o * packer->code_size],
+        size_t n_block = (n_entry + n_per_block - 1) / n_per_block;
+        memcpy(&codes[list_no][o / n_per_block * block_size],
                code,
                n_block * block_size);
     } else {
+        // the entries are packed after the last entry of the list, only
+        // the last block and the new ones are written
         FAISS_THROW_IF_NOT_MSG(packer, "missing code packer");
-        std::vector<uint8_t> buffer(packer->code_size);
-        for (size_t i = 0; i < n_entry; i++) {
-            packer->unpack_1(code, i, buffer.data());
-            packer->pack_1(buffer.data(), i + o, codes[list_no].data());
-        }
+        std::vector<uint8_t> flat_codes(n_entry * packer->code_size);
+        packer->unpack_range(code, 0, n_entry, flat_codes.data());
+        packer->pack_range(
+                flat_codes.data(), o, o + n_entry, codes[list_no].data());
     }
     return o;
 }
 
+void BlockInvertedLists::merge_from_multiple(
+        const InvertedLists** ils,
+        int n_il,
+        bool shift_ids,
+        bool verbose) {
+    FAISS_THROW_IF_NOT_MSG(packer, "missing code packer");
+    std::vector<idx_t> id_offsets(n_il);
+    for (int i = 0; i < n_il; i++) {
+        auto bil = dynamic_cast<const BlockInvertedLists*>(ils[i]);
+        FAISS_THROW_IF_NOT_MSG(
+                bil && bil->nlist == nlist &&
+                        bil->n_per_block == n_per_block &&
+                        bil->block_size == block_size,
+                "can only merge BlockInvertedLists of the same format");
+        if (i + 1 < n_il) {
+            id_offsets[i + 1] = id_offsets[i] + ils[i]->compute_ntotal();
+        }
+    }
+    double t0 = getmillisecs();
+
+#pragma omp parallel for
+    for (idx_t list_no = 0; list_no < nlist; list_no++) {
+        size_t o = list_size(list_no), n_add = 0;
+        for (int i = 0; i < n_il; i++) {
+            n_add += ils[i]->list_size(list_no);
+        }
+        if (n_add == 0) {
+            continue;
+        }
+        // allocate once, the entries of each source are written in place
+        resize(list_no, o + n_add);
+        std::vector<uint8_t> flat_codes;
+        for (int i = 0; i < n_il; i++) {
+            size_t n = ils[i]->list_size(list_no);
+            if (n == 0) {
+                continue;
+            }
+            ScopedIds src_ids(ils[i], list_no);
+            idx_t* dst_ids = ids[list_no].data() + o;
+            for (size_t j = 0; j < n; j++) {
+                dst_ids[j] = src_ids[j] + (shift_ids ? id_offsets[i] : 0);
+            }
+            ScopedCodes src_codes(ils[i], list_no);
+            if (o % n_per_block == 0) {
+                size_t n_block = (n + n_per_block - 1) / n_per_block;
+                memcpy(codes[list_no].data() + o / n_per_block * block_size,
+                       src_codes.get(),
+                       n_block * block_size);
+            } else {
+                flat_codes.resize(n * packer->code_size);
+                packer->unpack_range(src_codes.get(), 0, n, flat_codes.data());
+                packer->pack_range(
+                        flat_codes.data(), o, o + n, codes[list_no].data());
+            }
+            o += n;
+        }
+    }
+    if (verbose) {
+        printf("merged %d inverted lists in %.3f s\n",
+               n_il,
+               (getmillisecs() - t0) / 1000);
+    }
+}
+
 size_t BlockInvertedLists::list_size(size_t list_no) const {
     assert(list_no < nlist);
+    if (is_compressed(list_no)) {
+        return compressed_ids[list_no].size();
+    }
     return ids[list_no].size();
 }
 
@@ -80,23 +153,43 @@ const uint8_t* BlockInvertedLists::get_codes(size_t list_no) const {
 }
 
 size_t BlockInvertedLists::remove_ids(const IDSelector& sel) {
+    FAISS_THROW_IF_NOT_MSG(packer, "missing code packer");
+    size_t cs = packer->code_size;
     idx_t nremove = 0;
-#pragma omp parallel for
+#pragma omp parallel for reduction(+ : nremove)
     for (idx_t i = 0; i < nlist; i++) {
-        std::vector<uint8_t> buffer(packer->code_size);
-        idx_t l = ids[i].size(), j = 0;
-        while (j < l) {
-            if (sel.is_member(ids[i][j])) {
-                l--;
-                ids[i][j] = ids[i][l];
-                packer->unpack_1(codes[i].data(), l, buffer.data());
-                packer->pack_1(buffer.data(), j, codes[i].data());
-            } else {
-                j++;
+        decompress_list(i);
+        size_t l0 = ids[i].size(), j0 = 0;
+        while (j0 < l0 && !sel.is_member(ids[i][j0])) {
+            j0++;
+        }
+        if (j0 == l0) {
+            continue;
+        }
+        // the entries are compacted in order from the block of the first
+        // removed one, the blocks before it are not modified
+        size_t b0 = j0 / n_per_block;
+        size_t i0 = b0 * n_per_block, l = i0;
+        uint8_t* blocks = codes[i].data();
+        std::vector<uint8_t> flat_codes((l0 - i0) * cs);
+        packer->unpack_range(blocks, i0, l0, flat_codes.data());
+        for (size_t j = i0; j < l0; j++) {
+            if (j >= j0 && sel.is_member(ids[i][j])) {
+                continue;
             }
+            if (l != j) {
+                memmove(flat_codes.data() + (l - i0) * cs,
+                        flat_codes.data() + (j - i0) * cs,
+                        cs);
+            }
+            ids[i][l++] = ids[i][j];
         }
+        memset(blocks + b0 * block_size,
+               0,
+               codes[i].size() - b0 * block_size);
+        packer->pack_range(flat_codes.data(), i0, l, blocks);
         resize(i, l);
-        nremove += ids[i].size() - l;
+        nremove += l0 - l;
     }
 
     return nremove;
@@ -104,10 +197,64 @@ size_t BlockInvertedLists::remove_ids(const IDSelector& sel) {
 
 const idx_t* BlockInvertedLists::get_ids(size_t list_no) const {
     assert(list_no < nlist);
+    if (is_compressed(list_no)) {
+        const CompressedIDs& cids = compressed_ids[list_no];
+        idx_t* buf = new idx_t[cids.size()];
+        cids.decode(buf);
+        return buf;
+    }
     return ids[list_no].data();
 }
 
+void BlockInvertedLists::release_ids(size_t list_no, const idx_t* ids_in)
+        const {
+    if (is_compressed(list_no)) {
+        delete[] ids_in;
+    }
+}
+
+idx_t BlockInvertedLists::get_single_id(size_t list_no, size_t offset) const {
+    assert(offset < list_size(list_no));
+    if (is_compressed(list_no)) {
+        return compressed_ids[list_no].get(offset);
+    }
+    return ids[list_no][offset];
+}
+
+bool BlockInvertedLists::has_compressed_ids() const {
+    return !compressed_ids.empty();
+}
+
+void BlockInvertedLists::compress_ids() {
+    compressed_ids.resize(nlist);
+    for (size_t i = 0; i < nlist; i++) {
+        if (ids[i].size() > 0) {
+            compressed_ids[i].encode(ids[i].size(), ids[i].data());
+            std::vector<idx_t>().swap(ids[i]);
+        }
+    }
+}
+
+void BlockInvertedLists::decompress_ids() {
+    for (size_t i = 0; i < compressed_ids.size(); i++) {
+        decompress_list(i);
+    }
+    compressed_ids.clear();
+}
+
+void BlockInvertedLists::decompress_list(size_t list_no) {
+    if (!is_compressed(list_no)) {
+        return;
+    }
+    CompressedIDs& cids = compressed_ids[list_no];
+    ids[list_no].resize(cids.size());
+    cids.decode(ids[list_no].data());
+    cids.clear();
+}
+
 void BlockInvertedLists::resize(size_t list_no, size_t new_size) {
+    decompress_list(list_no);
+    size_t prev_size = ids[list_no].size();
     ids[list_no].resize(new_size);
     size_t prev_nbytes = codes[list_no].size();
     size_t n_block = (new_size + n_per_block - 1) / n_per_block;
@@ -119,6 +266,16 @@ void BlockInvertedLists::resize(size_t list_no, size_t new_size) {
                0,
                new_nbytes - prev_nbytes);
     }
+    if (packer && new_size < prev_size && new_size % n_per_block != 0) {
+        // clear the removed entries of the last block, so that entries
+        // can be packed there again
+        std::vector<uint8_t> zero_code(packer->code_size);
+        uint8_t* last_block = codes[list_no].data() + new_nbytes - block_size;
+        size_t i1 = std::min(prev_size, n_block * n_per_block);
+        for (size_t i = new_size; i < i1; i++) {
+            packer->pack_1(zero_code.data(), i % n_per_block, last_block);
+        }
+    }
 }
 
 void BlockInvertedLists::update_entries(
@@ -143,17 +300,27 @@ BlockInvertedListsIOHook::BlockInvertedListsIOHook()
 
 void BlockInvertedListsIOHook::write(const InvertedLists* ils_in, IOWriter* f)
         const {
-    uint32_t h = fourcc("ilbl");
-    WRITE1(h);
     const BlockInvertedLists* il =
             dynamic_cast<const BlockInvertedLists*>(ils_in);
+    bool compressed = il->has_compressed_ids();
+    uint32_t h = fourcc(compressed ? "ilbc" : "ilbl");
+    WRITE1(h);
     WRITE1(il->nlist);
     WRITE1(il->code_size);
     WRITE1(il->n_per_block);
     WRITE1(il->block_size);
 
     for (size_t i = 0; i < il->nlist; i++) {
-        WRITEVECTOR(il->ids[i]);
+        if (compressed) {
+            if (il->is_compressed(i)) {
+                write_CompressedIDs(il->compressed_ids[i], f);
+            } else {
+                CompressedIDs cids(il->ids[i].size(), il->ids[i].data());
+                write_CompressedIDs(cids, f);
+            }
+        } else {
+            WRITEVECTOR(il->ids[i]);
+        }
         WRITEVECTOR(il->codes[i]);
     }
 }
@@ -177,4 +344,34 @@ InvertedLists* BlockInvertedListsIOHook::read(IOReader* f, int /* io_flags */)
     return il;
 }
 
+BlockInvertedListsCompressedIOHook::BlockInvertedListsCompressedIOHook()
+        : InvertedListsIOHook("ilbc", typeid(BlockInvertedLists).name()) {}
+
+void BlockInvertedListsCompressedIOHook::write(
+        const InvertedLists* ils_in,
+        IOWriter* f) const {
+    BlockInvertedListsIOHook().write(ils_in, f);
+}
+
+InvertedLists* BlockInvertedListsCompressedIOHook::read(
+        IOReader* f,
+        int /* io_flags */) const {
+    std::unique_ptr<BlockInvertedLists> il(new BlockInvertedLists());
+    READ1(il->nlist);
+    READ1(il->code_size);
+    READ1(il->n_per_block);
+    READ1(il->block_size);
+
+    il->ids.resize(il->nlist);
+    il->codes.resize(il->nlist);
+    il->compressed_ids.resize(il->nlist);
+
+    for (size_t i = 0; i < il->nlist; i++) {
+        read_CompressedIDs(il->compressed_ids[i], f);
+        READVECTOR(il->codes[i]);
+    }
+
+    return il.release();
+}
+
 } // namespace faiss
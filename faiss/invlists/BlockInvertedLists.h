@@ -40,6 +40,10 @@ struct BlockInvertedLists : InvertedLists {
     std::vector<AlignedTable<uint8_t>> codes;
     std::vector<std::vector<idx_t>> ids;
 
+    /// ids of the lists compressed by compress_ids, size nlist or empty, as
+    /// in ArrayInvertedLists
+    std::vector<CompressedIDs> compressed_ids;
+
     BlockInvertedLists(size_t nlist, size_t vec_per_block, size_t block_size);
     BlockInvertedLists(size_t nlist, const CodePacker* packer);
 
@@ -48,18 +52,49 @@ struct BlockInvertedLists : InvertedLists {
     size_t list_size(size_t list_no) const override;
     const uint8_t* get_codes(size_t list_no) const override;
     const idx_t* get_ids(size_t list_no) const override;
-    /// remove ids from the InvertedLists
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+    idx_t get_single_id(size_t list_no, size_t offset) const override;
+    bool has_compressed_ids() const override;
+
+    /// compress the ids of all lists
+    void compress_ids();
+
+    /// decompress the ids of all lists
+    void decompress_ids();
+
+    bool is_compressed(size_t list_no) const {
+        return !compressed_ids.empty() && compressed_ids[list_no].size() > 0;
+    }
+
+    /// decompress the ids of a list, before it is modified
+    void decompress_list(size_t list_no);
+    /// remove ids from the InvertedLists. The remaining entries keep their
+    /// order, only the blocks from the first removed entry are repacked
     size_t remove_ids(const IDSelector& sel);
 
-    // works only on empty BlockInvertedLists
     // the codes should be of size ceil(n_entry / n_per_block) * block_size
-    // and padded with 0s
+    // and padded with 0s. When the list does not end on a block boundary,
+    // the entries are packed in place after the last one
     size_t add_entries(
             size_t list_no,
             size_t n_entry,
             const idx_t* ids,
             const uint8_t* code) override;
 
+    /** append the entries of several BlockInvertedLists with the same
+     * packing, in order. Each list is resized once and filled in parallel
+     * over the lists: the sources that start on a block boundary are
+     * copied by blocks, the others are unpacked and repacked in bulk.
+     *
+     * @param shift_ids  offset the ids of ils[i] by the total size of
+     *                   ils[0..i-1]
+     */
+    void merge_from_multiple(
+            const InvertedLists** ils,
+            int n_il,
+            bool shift_ids = false,
+            bool verbose = false);
+
     /// not implemented
     void update_entries(
             size_t list_no,
@@ -68,7 +103,8 @@ struct BlockInvertedLists : InvertedLists {
             const idx_t* ids,
             const uint8_t* code) override;
 
-    // also pads new data with 0s
+    // also pads new data with 0s, and clears the removed entries of the
+    // last block
     void resize(size_t list_no, size_t new_size) override;
 
     ~BlockInvertedLists() override;
@@ -80,4 +116,12 @@ struct BlockInvertedListsIOHook : InvertedListsIOHook {
     InvertedLists* read(IOReader* f, int io_flags) const override;
 };
 
+/// reads the BlockInvertedLists with compressed ids, that
+/// BlockInvertedListsIOHook writes with this key
+struct BlockInvertedListsCompressedIOHook : InvertedListsIOHook {
+    BlockInvertedListsCompressedIOHook();
+    void write(const InvertedLists* ils, IOWriter* f) const override;
+    InvertedLists* read(IOReader* f, int io_flags) const override;
+};
+
 } // namespace faiss
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/invlists/CompressedIDs.h>
+
+#include <algorithm>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+
+namespace faiss {
+
+namespace {
+
+int nbits_of(uint64_t v) {
+    int nb = 0;
+    while (v > 0) {
+        nb++;
+        v >>= 1;
+    }
+    return nb;
+}
+
+/// the nbits-bit value at bit position pos
+inline uint64_t read_bits(const uint64_t* data, uint64_t pos, int nbits) {
+    if (nbits == 0) {
+        return 0;
+    }
+    uint64_t w = pos >> 6;
+    int s = pos & 63;
+    uint64_t v = data[w] >> s;
+    if (s + nbits > 64) {
+        v |= data[w + 1] << (64 - s);
+    }
+    return nbits == 64 ? v : v & ((uint64_t(1) << nbits) - 1);
+}
+
+inline void write_bits(uint64_t* data, uint64_t pos, int nbits, uint64_t v) {
+    if (nbits == 0) {
+        return;
+    }
+    uint64_t w = pos >> 6;
+    int s = pos & 63;
+    data[w] |= v << s;
+    if (s + nbits > 64) {
+        data[w + 1] |= v >> (64 - s);
+    }
+}
+
+} // namespace
+
+CompressedIDs::CompressedIDs(size_t n, const idx_t* ids) {
+    encode(n, ids);
+}
+
+void CompressedIDs::clear() {
+    n = 0;
+    base.clear();
+    min_delta.clear();
+    bit_offset.clear();
+    nbits.clear();
+    is_delta.clear();
+    data.clear();
+}
+
+void CompressedIDs::encode(size_t n_in, const idx_t* ids) {
+    clear();
+    n = n_in;
+    size_t nb = (n + block_size - 1) / block_size;
+    base.resize(nb);
+    min_delta.resize(nb);
+    bit_offset.resize(nb);
+    nbits.resize(nb);
+    is_delta.resize(nb);
+
+    // values to pack, per block
+    std::vector<uint64_t> values(n);
+    uint64_t tot_bits = 0;
+    for (size_t b = 0; b < nb; b++) {
+        size_t j0 = b * block_size, j1 = std::min(n, j0 + block_size);
+        bool sorted = true;
+        for (size_t j = j0 + 1; j < j1; j++) {
+            if (ids[j] < ids[j - 1]) {
+                sorted = false;
+                break;
+            }
+        }
+        uint64_t vmax = 0;
+        if (sorted) {
+            // value j - j0 - 1 is the delta between ids j and j - 1
+            base[b] = ids[j0];
+            uint64_t dmin = 0;
+            for (size_t j = j0 + 1; j < j1; j++) {
+                uint64_t delta = uint64_t(ids[j]) - uint64_t(ids[j - 1]);
+                dmin = j == j0 + 1 ? delta : std::min(dmin, delta);
+            }
+            for (size_t j = j0 + 1; j < j1; j++) {
+                values[j - 1] = uint64_t(ids[j]) - uint64_t(ids[j - 1]) - dmin;
+                vmax = std::max(vmax, values[j - 1]);
+            }
+            min_delta[b] = dmin;
+        } else {
+            base[b] = *std::min_element(ids + j0, ids + j1);
+            for (size_t j = j0; j < j1; j++) {
+                values[j] = uint64_t(ids[j]) - uint64_t(base[b]);
+                vmax = std::max(vmax, values[j]);
+            }
+        }
+        is_delta[b] = sorted;
+        nbits[b] = nbits_of(vmax);
+        bit_offset[b] = tot_bits;
+        tot_bits += uint64_t(nbits[b]) * (j1 - j0 - (sorted ? 1 : 0));
+    }
+
+    data.assign((tot_bits + 63) / 64 + 1, 0);
+    for (size_t b = 0; b < nb; b++) {
+        size_t j0 = b * block_size, j1 = std::min(n, j0 + block_size);
+        // the values of the block start at j0 in both encodings
+        size_t nv = j1 - j0 - (is_delta[b] ? 1 : 0);
+        for (size_t t = 0; t < nv; t++) {
+            write_bits(
+                    data.data(),
+                    bit_offset[b] + t * nbits[b],
+                    nbits[b],
+                    values[j0 + t]);
+        }
+    }
+}
+
+void CompressedIDs::decode(idx_t* ids) const {
+    size_t nb = base.size();
+    for (size_t b = 0; b < nb; b++) {
+        size_t j0 = b * block_size, j1 = std::min(n, j0 + block_size);
+        int nbt = nbits[b];
+        uint64_t pos = bit_offset[b];
+        if (is_delta[b]) {
+            uint64_t v = base[b];
+            ids[j0] = v;
+            for (size_t j = j0 + 1; j < j1; j++) {
+                v += min_delta[b] + read_bits(data.data(), pos, nbt);
+                pos += nbt;
+                ids[j] = v;
+            }
+        } else {
+            for (size_t j = j0; j < j1; j++) {
+                ids[j] = uint64_t(base[b]) + read_bits(data.data(), pos, nbt);
+                pos += nbt;
+            }
+        }
+    }
+}
+
+idx_t CompressedIDs::get(size_t i) const {
+    FAISS_ASSERT(i < n);
+    size_t b = i / block_size, t = i % block_size;
+    int nbt = nbits[b];
+    uint64_t pos = bit_offset[b];
+    if (is_delta[b]) {
+        uint64_t v = uint64_t(base[b]) + t * min_delta[b];
+        for (size_t u = 0; u < t; u++) {
+            v += read_bits(data.data(), pos, nbt);
+            pos += nbt;
+        }
+        return v;
+    }
+    return uint64_t(base[b]) + read_bits(data.data(), pos + t * nbt, nbt);
+}
+
+size_t CompressedIDs::nbytes() const {
+    return base.size() *
+            (sizeof(idx_t) + 2 * sizeof(uint64_t) + 2 * sizeof(uint8_t)) +
+            data.size() * sizeof(uint64_t);
+}
+
+void write_CompressedIDs(const CompressedIDs& cids, IOWriter* f) {
+    WRITE1(cids.n);
+    WRITEVECTOR(cids.base);
+    WRITEVECTOR(cids.min_delta);
+    WRITEVECTOR(cids.bit_offset);
+    WRITEVECTOR(cids.nbits);
+    WRITEVECTOR(cids.is_delta);
+    WRITEVECTOR(cids.data);
+}
+
+void read_CompressedIDs(CompressedIDs& cids, IOReader* f) {
+    READ1(cids.n);
+    READVECTOR(cids.base);
+    READVECTOR(cids.min_delta);
+    READVECTOR(cids.bit_offset);
+    READVECTOR(cids.nbits);
+    READVECTOR(cids.is_delta);
+    READVECTOR(cids.data);
+    size_t nb = (cids.n + CompressedIDs::block_size - 1) /
+            CompressedIDs::block_size;
+    FAISS_THROW_IF_NOT(
+            cids.base.size() == nb && cids.min_delta.size() == nb &&
+            cids.bit_offset.size() == nb && cids.nbits.size() == nb &&
+            cids.is_delta.size() == nb);
+    for (size_t b = 0; b < nb; b++) {
+        size_t nv = std::min(cids.n - b * CompressedIDs::block_size,
+                             CompressedIDs::block_size);
+        FAISS_THROW_IF_NOT(cids.nbits[b] <= 64);
+        FAISS_THROW_IF_NOT(
+                cids.bit_offset[b] + cids.nbits[b] * nv <=
+                cids.data.size() * 64);
+    }
+}
+
+} // namespace faiss
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+struct IOReader;
+struct IOWriter;
+
+/** Compact storage of the ids of an inverted list.
+ *
+ * The ids are encoded by blocks of block_size. The ids of a non-decreasing
+ * block are stored as bit-packed deltas, so that a range of consecutive
+ * ids only costs the block header. Other blocks are stored as bit-packed
+ * offsets from the smallest id of the block (frame of reference). An id
+ * can be decoded without decoding the whole list.
+ */
+struct CompressedIDs {
+    static constexpr size_t block_size = 128;
+
+    size_t n = 0; ///< nb of ids
+
+    /// per block: first id (delta) or smallest id (frame of reference)
+    std::vector<idx_t> base;
+    /// per block: smallest delta of a delta block
+    std::vector<uint64_t> min_delta;
+    /// per block: position of the packed values in data, in bits
+    std::vector<uint64_t> bit_offset;
+    /// per block: nb of bits of the packed values
+    std::vector<uint8_t> nbits;
+    /// per block: 1 for delta, 0 for frame of reference
+    std::vector<uint8_t> is_delta;
+
+    /// the packed values
+    std::vector<uint64_t> data;
+
+    CompressedIDs() = default;
+    CompressedIDs(size_t n, const idx_t* ids);
+
+    void encode(size_t n, const idx_t* ids);
+
+    /// decode all the ids, size n
+    void decode(idx_t* ids) const;
+
+    /// decode id i
+    idx_t get(size_t i) const;
+
+    size_t size() const {
+        return n;
+    }
+
+    void clear();
+
+    /// memory used by the encoded ids, in bytes
+    size_t nbytes() const;
+};
+
+void write_CompressedIDs(const CompressedIDs& cids, IOWriter* f);
+
+void read_CompressedIDs(CompressedIDs& cids, IOReader* f);
+
+} // namespace faiss
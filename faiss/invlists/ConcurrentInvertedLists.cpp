@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/invlists/ConcurrentInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+namespace {
+
+using ListSnapshot = ConcurrentInvertedLists::ListSnapshot;
+using Segment = ConcurrentInvertedLists::Segment;
+
+/// iterates over a snapshot, that remains valid while the iterator exists
+struct SnapshotIterator : InvertedListsIterator {
+    std::shared_ptr<const ListSnapshot> snap;
+    size_t segment_size;
+    size_t code_size;
+    size_t i = 0;
+
+    SnapshotIterator(
+            std::shared_ptr<const ListSnapshot> snap,
+            size_t segment_size,
+            size_t code_size)
+            : snap(std::move(snap)),
+              segment_size(segment_size),
+              code_size(code_size) {}
+
+    bool is_available() const override {
+        return i < snap->size;
+    }
+
+    void next() override {
+        i++;
+    }
+
+    std::pair<idx_t, const uint8_t*> get_id_and_codes() override {
+        const Segment& seg = *snap->segments[i / segment_size];
+        size_t j = i % segment_size;
+        return {seg.ids[j], seg.codes.data() + j * code_size};
+    }
+};
+
+} // namespace
+
+ConcurrentInvertedLists::ConcurrentInvertedLists(
+        size_t nlist,
+        size_t code_size,
+        size_t segment_size)
+        : InvertedLists(nlist, code_size),
+          segment_size(segment_size),
+          lists(nlist),
+          list_mutexes(nlist) {
+    FAISS_THROW_IF_NOT(segment_size > 0);
+    use_iterator = true;
+    auto empty = std::make_shared<const ListSnapshot>();
+    for (size_t i = 0; i < nlist; i++) {
+        lists[i] = empty;
+    }
+}
+
+std::shared_ptr<const ListSnapshot> ConcurrentInvertedLists::get_snapshot(
+        size_t list_no) const {
+    assert(list_no < nlist);
+    return std::atomic_load(&lists[list_no]);
+}
+
+void ConcurrentInvertedLists::publish(
+        size_t list_no,
+        std::shared_ptr<const ListSnapshot> snap) {
+    std::atomic_store(&lists[list_no], std::move(snap));
+}
+
+std::shared_ptr<Segment> ConcurrentInvertedLists::new_segment() const {
+    auto seg = std::make_shared<Segment>();
+    seg->codes.resize(segment_size * code_size);
+    seg->ids.resize(segment_size);
+    return seg;
+}
+
+size_t ConcurrentInvertedLists::list_size(size_t list_no) const {
+    return get_snapshot(list_no)->size;
+}
+
+bool ConcurrentInvertedLists::is_empty(
+        size_t list_no,
+        void* inverted_list_context) const {
+    FAISS_THROW_IF_NOT(inverted_list_context == nullptr);
+    return list_size(list_no) == 0;
+}
+
+InvertedListsIterator* ConcurrentInvertedLists::get_iterator(
+        size_t list_no,
+        void* inverted_list_context) const {
+    FAISS_THROW_IF_NOT(inverted_list_context == nullptr);
+    return new SnapshotIterator(get_snapshot(list_no), segment_size, code_size);
+}
+
+const uint8_t* ConcurrentInvertedLists::get_codes(size_t list_no) const {
+    auto snap = get_snapshot(list_no);
+    uint8_t* codes = new uint8_t[snap->size * code_size];
+    for (size_t i0 = 0; i0 < snap->size; i0 += segment_size) {
+        size_t n = std::min(segment_size, snap->size - i0);
+        memcpy(codes + i0 * code_size,
+               snap->segments[i0 / segment_size]->codes.data(),
+               n * code_size);
+    }
+    return codes;
+}
+
+const idx_t* ConcurrentInvertedLists::get_ids(size_t list_no) const {
+    auto snap = get_snapshot(list_no);
+    idx_t* ids = new idx_t[snap->size];
+    for (size_t i0 = 0; i0 < snap->size; i0 += segment_size) {
+        size_t n = std::min(segment_size, snap->size - i0);
+        memcpy(ids + i0,
+               snap->segments[i0 / segment_size]->ids.data(),
+               n * sizeof(idx_t));
+    }
+    return ids;
+}
+
+void ConcurrentInvertedLists::release_codes(size_t, const uint8_t* codes)
+        const {
+    delete[] codes;
+}
+
+void ConcurrentInvertedLists::release_ids(size_t, const idx_t* ids) const {
+    delete[] ids;
+}
+
+idx_t ConcurrentInvertedLists::get_single_id(size_t list_no, size_t offset)
+        const {
+    auto snap = get_snapshot(list_no);
+    FAISS_THROW_IF_NOT(offset < snap->size);
+    return snap->segments[offset / segment_size]->ids[offset % segment_size];
+}
+
+const uint8_t* ConcurrentInvertedLists::get_single_code(
+        size_t list_no,
+        size_t offset) const {
+    auto snap = get_snapshot(list_no);
+    FAISS_THROW_IF_NOT(offset < snap->size);
+    uint8_t* code = new uint8_t[code_size];
+    memcpy(code,
+           snap->segments[offset / segment_size]->codes.data() +
+                   (offset % segment_size) * code_size,
+           code_size);
+    return code;
+}
+
+size_t ConcurrentInvertedLists::add_entries(
+        size_t list_no,
+        size_t n_entry,
+        const idx_t* ids,
+        const uint8_t* code) {
+    std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+    auto snap = get_snapshot(list_no);
+    size_t o = snap->size;
+    if (n_entry == 0) {
+        return o;
+    }
+    // the slots after snap->size in the last segment are not covered by any
+    // snapshot, so they can be written in place
+    auto new_snap = std::make_shared<ListSnapshot>(*snap);
+    for (size_t i = 0; i < n_entry; i++) {
+        size_t pos = o + i;
+        if (pos / segment_size == new_snap->segments.size()) {
+            new_snap->segments.push_back(new_segment());
+        }
+        Segment& seg = *new_snap->segments[pos / segment_size];
+        size_t j = pos % segment_size;
+        seg.ids[j] = ids[i];
+        memcpy(seg.codes.data() + j * code_size,
+               code + i * code_size,
+               code_size);
+    }
+    new_snap->size = o + n_entry;
+    publish(list_no, std::move(new_snap));
+    return o;
+}
+
+void ConcurrentInvertedLists::update_entries(
+        size_t list_no,
+        size_t offset,
+        size_t n_entry,
+        const idx_t* ids,
+        const uint8_t* code) {
+    std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+    auto snap = get_snapshot(list_no);
+    FAISS_THROW_IF_NOT(offset + n_entry <= snap->size);
+    if (n_entry == 0) {
+        return;
+    }
+    // copy-on-write of the segments that are modified
+    auto new_snap = std::make_shared<ListSnapshot>(*snap);
+    size_t s0 = offset / segment_size;
+    size_t s1 = (offset + n_entry - 1) / segment_size;
+    for (size_t s = s0; s <= s1; s++) {
+        new_snap->segments[s] =
+                std::make_shared<Segment>(*new_snap->segments[s]);
+    }
+    for (size_t i = 0; i < n_entry; i++) {
+        size_t pos = offset + i;
+        Segment& seg = *new_snap->segments[pos / segment_size];
+        size_t j = pos % segment_size;
+        seg.ids[j] = ids[i];
+        memcpy(seg.codes.data() + j * code_size,
+               code + i * code_size,
+               code_size);
+    }
+    publish(list_no, std::move(new_snap));
+}
+
+void ConcurrentInvertedLists::resize(size_t list_no, size_t new_size) {
+    std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+    auto snap = get_snapshot(list_no);
+    auto new_snap = std::make_shared<ListSnapshot>(*snap);
+    size_t nseg = (new_size + segment_size - 1) / segment_size;
+    if (new_size < snap->size) {
+        new_snap->segments.resize(nseg);
+        // the truncated slots are visible in the old snapshot: copy the
+        // last segment so that the next additions do not overwrite them
+        if (new_size % segment_size != 0) {
+            new_snap->segments.back() =
+                    std::make_shared<Segment>(*new_snap->segments.back());
+        }
+    } else if (new_size > snap->size) {
+        // the new entries are zeros, as in ArrayInvertedLists
+        size_t pos = snap->size;
+        if (pos % segment_size != 0) {
+            Segment& seg = *new_snap->segments.back();
+            size_t j = pos % segment_size;
+            size_t n = std::min(segment_size, j + new_size - pos) - j;
+            memset(seg.codes.data() + j * code_size, 0, n * code_size);
+            memset(seg.ids.data() + j, 0, n * sizeof(idx_t));
+        }
+        while (new_snap->segments.size() < nseg) {
+            new_snap->segments.push_back(new_segment());
+        }
+    }
+    new_snap->size = new_size;
+    publish(list_no, std::move(new_snap));
+}
+
+ConcurrentInvertedLists::~ConcurrentInvertedLists() {}
+
+} // namespace faiss
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <faiss/invlists/InvertedLists.h>
+
+namespace faiss {
+
+/** Inverted lists that can be searched while they are being written to.
+ *
+ * Each list is stored as a sequence of fixed-size segments. A list is
+ * published as an immutable snapshot (the segments + the nb of valid
+ * entries) that is replaced atomically by the writers (read-copy-update):
+ *
+ * - add_entries writes the new entries in the free slots of the last
+ *   segment, that no snapshot covers yet, or in new segments, then
+ *   publishes a snapshot with the new size. The existing entries are not
+ *   copied.
+ * - update_entries and resize copy the segments they modify before
+ *   publishing, so that the older snapshots remain valid.
+ *
+ * The searches use the iterator interface (use_iterator = true): an
+ * iterator holds a reference to the snapshot of its list, which is freed
+ * when the last reader or writer drops it. Readers never lock, the
+ * writers of a given list are serialized by a per-list mutex.
+ *
+ * get_codes / get_ids return copies of the current snapshot that are freed
+ * by release_codes / release_ids. They are consistent with list_size only
+ * when there are no concurrent writers, so the searches that do not go
+ * through the iterators (eg. max_codes, store_pairs) are not supported
+ * during updates.
+ */
+struct ConcurrentInvertedLists : InvertedLists {
+    /// nb of entries per segment
+    size_t segment_size;
+
+    struct Segment {
+        std::vector<uint8_t> codes; ///< size segment_size * code_size
+        std::vector<idx_t> ids;     ///< size segment_size
+    };
+
+    /// immutable state of a list
+    struct ListSnapshot {
+        std::vector<std::shared_ptr<Segment>> segments;
+        size_t size = 0;
+    };
+
+    ConcurrentInvertedLists(
+            size_t nlist,
+            size_t code_size,
+            size_t segment_size = 1024);
+
+    /// current snapshot of a list (thread-safe)
+    std::shared_ptr<const ListSnapshot> get_snapshot(size_t list_no) const;
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+    void release_codes(size_t list_no, const uint8_t* codes) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+    idx_t get_single_id(size_t list_no, size_t offset) const override;
+    const uint8_t* get_single_code(size_t list_no, size_t offset)
+            const override;
+
+    bool is_empty(size_t list_no, void* inverted_list_context = nullptr)
+            const override;
+    InvertedListsIterator* get_iterator(
+            size_t list_no,
+            void* inverted_list_context = nullptr) const override;
+
+    size_t add_entries(
+            size_t list_no,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void update_entries(
+            size_t list_no,
+            size_t offset,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void resize(size_t list_no, size_t new_size) override;
+
+    ~ConcurrentInvertedLists() override;
+
+   private:
+    std::vector<std::shared_ptr<const ListSnapshot>> lists;
+    /// serializes the writers of each list
+    mutable std::vector<std::mutex> list_mutexes;
+
+    std::shared_ptr<Segment> new_segment() const;
+    void publish(size_t list_no, std::shared_ptr<const ListSnapshot> snap);
+};
+
+} // namespace faiss
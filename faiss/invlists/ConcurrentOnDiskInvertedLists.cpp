@@ -0,0 +1,592 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/invlists/ConcurrentOnDiskInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <typeinfo>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+#include <faiss/index_io.h>
+
+namespace faiss {
+
+namespace {
+
+using ListSnapshot = ConcurrentOnDiskInvertedLists::ListSnapshot;
+using Extent = ConcurrentOnDiskInvertedLists::Extent;
+
+/// iterates over a snapshot, that remains valid while the iterator exists
+struct ExtentIterator : InvertedListsIterator {
+    const ConcurrentOnDiskInvertedLists* il;
+    std::shared_ptr<const ListSnapshot> snap;
+    size_t i = 0;
+
+    ExtentIterator(
+            const ConcurrentOnDiskInvertedLists* il,
+            std::shared_ptr<const ListSnapshot> snap)
+            : il(il), snap(std::move(snap)) {}
+
+    bool is_available() const override {
+        return i < snap->size;
+    }
+
+    void next() override {
+        i++;
+    }
+
+    std::pair<idx_t, const uint8_t*> get_id_and_codes() override {
+        size_t no = snap->extents[i / il->extent_size]->no;
+        size_t j = i % il->extent_size;
+        return {il->extent_ids(no)[j],
+                il->extent_codes(no) + j * il->code_size};
+    }
+};
+
+} // namespace
+
+/**********************************************
+ * Extents
+ **********************************************/
+
+ConcurrentOnDiskInvertedLists::Extent::Extent(
+        ConcurrentOnDiskInvertedLists* owner,
+        size_t no)
+        : owner(owner), no(no) {}
+
+ConcurrentOnDiskInvertedLists::Extent::~Extent() {
+    owner->release_extent(no);
+}
+
+void ConcurrentOnDiskInvertedLists::release_extent(size_t no) {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    free_extents.insert(no);
+}
+
+void ConcurrentOnDiskInvertedLists::grow_locked(
+        size_t n_extent,
+        bool allocate) {
+    size_t new_nextent = file_nextent + n_extent;
+    FAISS_THROW_IF_NOT_FMT(
+            new_nextent * extent_nbytes <= max_file_size,
+            "file %s would exceed max_file_size=%zd",
+            filename.c_str(),
+            max_file_size);
+    int err;
+    if (allocate) {
+        err = posix_fallocate(
+                fd,
+                file_nextent * extent_nbytes,
+                n_extent * extent_nbytes);
+    } else {
+        err = ftruncate(fd, new_nextent * extent_nbytes) == 0 ? 0 : errno;
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            err == 0,
+            "could not grow %s to %zd bytes: %s",
+            filename.c_str(),
+            new_nextent * extent_nbytes,
+            strerror(err));
+    for (size_t no = file_nextent; no < new_nextent; no++) {
+        free_extents.insert(no);
+    }
+    file_nextent = new_nextent;
+}
+
+std::shared_ptr<Extent> ConcurrentOnDiskInvertedLists::new_extent() {
+    FAISS_THROW_IF_NOT(!read_only);
+    size_t no;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        if (free_extents.empty()) {
+            grow_locked(grow_extents, false);
+        }
+        no = *free_extents.begin();
+        free_extents.erase(free_extents.begin());
+    }
+    return std::make_shared<Extent>(this, no);
+}
+
+std::shared_ptr<Extent> ConcurrentOnDiskInvertedLists::copy_extent(
+        const Extent& src) {
+    auto dst = new_extent();
+    memcpy(ptr + dst->no * extent_nbytes,
+           ptr + src.no * extent_nbytes,
+           extent_nbytes);
+    return dst;
+}
+
+/**********************************************
+ * ConcurrentOnDiskInvertedLists
+ **********************************************/
+
+ConcurrentOnDiskInvertedLists::ConcurrentOnDiskInvertedLists(
+        size_t nlist,
+        size_t code_size,
+        const char* filename,
+        size_t extent_size,
+        size_t max_file_size)
+        : InvertedLists(nlist, code_size),
+          extent_size(extent_size),
+          max_file_size(max_file_size),
+          filename(filename) {
+    FAISS_THROW_IF_NOT(extent_size > 0);
+    set_lists(std::vector<size_t>(nlist), {});
+    open_file(0, true);
+}
+
+ConcurrentOnDiskInvertedLists::ConcurrentOnDiskInvertedLists()
+        : InvertedLists(0, 0) {}
+
+void ConcurrentOnDiskInvertedLists::open_file(size_t nextent, bool create) {
+    use_iterator = true;
+    // the ids are 8-byte aligned
+    ids_offset = (extent_size * code_size + 7) / 8 * 8;
+    extent_nbytes = ids_offset + extent_size * sizeof(idx_t);
+    file_nextent = nextent;
+
+    int flags = read_only ? O_RDONLY : O_RDWR;
+    if (create) {
+        flags |= O_CREAT | O_TRUNC;
+    }
+    fd = open(filename.c_str(), flags, 0644);
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0,
+            "could not open %s: %s",
+            filename.c_str(),
+            strerror(errno));
+    if (!read_only) {
+        FAISS_THROW_IF_NOT_FMT(
+                ftruncate(fd, file_nextent * extent_nbytes) == 0,
+                "could not truncate %s: %s",
+                filename.c_str(),
+                strerror(errno));
+    }
+    // the address range is reserved once, the file grows inside it
+    int prot = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* p = mmap(
+            nullptr, max_file_size, prot, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    FAISS_THROW_IF_NOT_FMT(
+            p != MAP_FAILED,
+            "could not mmap %s: %s",
+            filename.c_str(),
+            strerror(errno));
+    ptr = (uint8_t*)p;
+}
+
+void ConcurrentOnDiskInvertedLists::set_lists(
+        const std::vector<size_t>& sizes,
+        const std::vector<std::vector<size_t>>& extent_nos) {
+    FAISS_THROW_IF_NOT(sizes.size() == nlist);
+    lists.resize(nlist);
+    list_mutexes = std::vector<std::mutex>(nlist);
+    std::vector<bool> used(file_nextent);
+    for (size_t l = 0; l < nlist; l++) {
+        auto snap = std::make_shared<ListSnapshot>();
+        snap->size = sizes[l];
+        if (sizes[l] > 0) {
+            FAISS_THROW_IF_NOT(
+                    extent_nos[l].size() ==
+                    (sizes[l] + extent_size - 1) / extent_size);
+            for (size_t no : extent_nos[l]) {
+                FAISS_THROW_IF_NOT(no < file_nextent && !used[no]);
+                used[no] = true;
+                snap->extents.push_back(std::make_shared<Extent>(this, no));
+            }
+        }
+        lists[l] = std::move(snap);
+    }
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    free_extents.clear();
+    for (size_t no = 0; no < file_nextent; no++) {
+        if (!used[no]) {
+            free_extents.insert(no);
+        }
+    }
+}
+
+std::shared_ptr<const ListSnapshot> ConcurrentOnDiskInvertedLists::
+        get_snapshot(size_t list_no) const {
+    assert(list_no < nlist);
+    return std::atomic_load(&lists[list_no]);
+}
+
+void ConcurrentOnDiskInvertedLists::publish(
+        size_t list_no,
+        std::shared_ptr<const ListSnapshot> snap) {
+    std::atomic_store(&lists[list_no], std::move(snap));
+}
+
+size_t ConcurrentOnDiskInvertedLists::list_size(size_t list_no) const {
+    return get_snapshot(list_no)->size;
+}
+
+bool ConcurrentOnDiskInvertedLists::is_empty(
+        size_t list_no,
+        void* inverted_list_context) const {
+    FAISS_THROW_IF_NOT(inverted_list_context == nullptr);
+    return list_size(list_no) == 0;
+}
+
+InvertedListsIterator* ConcurrentOnDiskInvertedLists::get_iterator(
+        size_t list_no,
+        void* inverted_list_context) const {
+    FAISS_THROW_IF_NOT(inverted_list_context == nullptr);
+    return new ExtentIterator(this, get_snapshot(list_no));
+}
+
+const uint8_t* ConcurrentOnDiskInvertedLists::get_codes(
+        size_t list_no) const {
+    auto snap = get_snapshot(list_no);
+    uint8_t* codes = new uint8_t[snap->size * code_size];
+    for (size_t i0 = 0; i0 < snap->size; i0 += extent_size) {
+        size_t n = std::min(extent_size, snap->size - i0);
+        memcpy(codes + i0 * code_size,
+               extent_codes(snap->extents[i0 / extent_size]->no),
+               n * code_size);
+    }
+    return codes;
+}
+
+const idx_t* ConcurrentOnDiskInvertedLists::get_ids(size_t list_no) const {
+    auto snap = get_snapshot(list_no);
+    idx_t* ids = new idx_t[snap->size];
+    for (size_t i0 = 0; i0 < snap->size; i0 += extent_size) {
+        size_t n = std::min(extent_size, snap->size - i0);
+        memcpy(ids + i0,
+               extent_ids(snap->extents[i0 / extent_size]->no),
+               n * sizeof(idx_t));
+    }
+    return ids;
+}
+
+void ConcurrentOnDiskInvertedLists::release_codes(
+        size_t,
+        const uint8_t* codes) const {
+    delete[] codes;
+}
+
+void ConcurrentOnDiskInvertedLists::release_ids(size_t, const idx_t* ids)
+        const {
+    delete[] ids;
+}
+
+idx_t ConcurrentOnDiskInvertedLists::get_single_id(
+        size_t list_no,
+        size_t offset) const {
+    auto snap = get_snapshot(list_no);
+    FAISS_THROW_IF_NOT(offset < snap->size);
+    return extent_ids(snap->extents[offset / extent_size]->no)
+            [offset % extent_size];
+}
+
+const uint8_t* ConcurrentOnDiskInvertedLists::get_single_code(
+        size_t list_no,
+        size_t offset) const {
+    auto snap = get_snapshot(list_no);
+    FAISS_THROW_IF_NOT(offset < snap->size);
+    uint8_t* code = new uint8_t[code_size];
+    memcpy(code,
+           extent_codes(snap->extents[offset / extent_size]->no) +
+                   (offset % extent_size) * code_size,
+           code_size);
+    return code;
+}
+
+void ConcurrentOnDiskInvertedLists::prefetch_lists(
+        const idx_t* list_nos,
+        int n) const {
+    for (int i = 0; i < n; i++) {
+        if (list_nos[i] < 0) {
+            continue;
+        }
+        auto snap = get_snapshot(list_nos[i]);
+        for (const auto& e : snap->extents) {
+            posix_madvise(
+                    ptr + e->no * extent_nbytes,
+                    extent_nbytes,
+                    POSIX_MADV_WILLNEED);
+        }
+    }
+}
+
+size_t ConcurrentOnDiskInvertedLists::add_entries(
+        size_t list_no,
+        size_t n_entry,
+        const idx_t* ids,
+        const uint8_t* code) {
+    FAISS_THROW_IF_NOT(!read_only);
+    std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+    auto snap = get_snapshot(list_no);
+    size_t o = snap->size;
+    if (n_entry == 0) {
+        return o;
+    }
+    // the slots after snap->size in the last extent are not covered by any
+    // snapshot, so they can be written in place
+    auto new_snap = std::make_shared<ListSnapshot>(*snap);
+    for (size_t i0 = 0; i0 < n_entry;) {
+        size_t pos = o + i0;
+        if (pos / extent_size == new_snap->extents.size()) {
+            new_snap->extents.push_back(new_extent());
+        }
+        size_t no = new_snap->extents[pos / extent_size]->no;
+        size_t j = pos % extent_size;
+        size_t n = std::min(extent_size - j, n_entry - i0);
+        uint8_t* e = ptr + no * extent_nbytes;
+        memcpy(e + j * code_size, code + i0 * code_size, n * code_size);
+        memcpy(e + ids_offset + j * sizeof(idx_t),
+               ids + i0,
+               n * sizeof(idx_t));
+        i0 += n;
+    }
+    new_snap->size = o + n_entry;
+    publish(list_no, std::move(new_snap));
+    return o;
+}
+
+void ConcurrentOnDiskInvertedLists::update_entries(
+        size_t list_no,
+        size_t offset,
+        size_t n_entry,
+        const idx_t* ids,
+        const uint8_t* code) {
+    FAISS_THROW_IF_NOT(!read_only);
+    std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+    auto snap = get_snapshot(list_no);
+    FAISS_THROW_IF_NOT(offset + n_entry <= snap->size);
+    if (n_entry == 0) {
+        return;
+    }
+    // copy-on-write of the extents that are modified
+    auto new_snap = std::make_shared<ListSnapshot>(*snap);
+    size_t e0 = offset / extent_size;
+    size_t e1 = (offset + n_entry - 1) / extent_size;
+    for (size_t e = e0; e <= e1; e++) {
+        new_snap->extents[e] = copy_extent(*new_snap->extents[e]);
+    }
+    for (size_t i = 0; i < n_entry; i++) {
+        size_t pos = offset + i;
+        uint8_t* e = ptr + new_snap->extents[pos / extent_size]->no *
+                        extent_nbytes;
+        size_t j = pos % extent_size;
+        memcpy(e + j * code_size, code + i * code_size, code_size);
+        memcpy(e + ids_offset + j * sizeof(idx_t), ids + i, sizeof(idx_t));
+    }
+    publish(list_no, std::move(new_snap));
+}
+
+void ConcurrentOnDiskInvertedLists::resize(size_t list_no, size_t new_size) {
+    FAISS_THROW_IF_NOT(!read_only);
+    std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+    auto snap = get_snapshot(list_no);
+    auto new_snap = std::make_shared<ListSnapshot>(*snap);
+    size_t next = (new_size + extent_size - 1) / extent_size;
+    if (new_size < snap->size) {
+        new_snap->extents.resize(next);
+        // the truncated slots are visible in the old snapshot: copy the
+        // last extent so that the next additions do not overwrite them
+        if (new_size % extent_size != 0) {
+            new_snap->extents.back() = copy_extent(*new_snap->extents.back());
+        }
+    } else if (new_size > snap->size) {
+        // the new entries are zeros, as in ArrayInvertedLists
+        while (new_snap->extents.size() < next) {
+            new_snap->extents.push_back(new_extent());
+        }
+        for (size_t pos = snap->size; pos < new_size; pos++) {
+            uint8_t* e = ptr + new_snap->extents[pos / extent_size]->no *
+                            extent_nbytes;
+            size_t j = pos % extent_size;
+            memset(e + j * code_size, 0, code_size);
+            memset(e + ids_offset + j * sizeof(idx_t), 0, sizeof(idx_t));
+        }
+    }
+    new_snap->size = new_size;
+    publish(list_no, std::move(new_snap));
+}
+
+void ConcurrentOnDiskInvertedLists::preallocate(size_t n_extent) {
+    FAISS_THROW_IF_NOT(!read_only);
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    if (free_extents.size() < n_extent) {
+        grow_locked(n_extent - free_extents.size(), true);
+    }
+}
+
+size_t ConcurrentOnDiskInvertedLists::compact() {
+    FAISS_THROW_IF_NOT(!read_only);
+    size_t n_used;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        n_used = file_nextent - free_extents.size();
+    }
+    // move the extents beyond n_used to free extents before n_used
+    for (size_t list_no = 0; list_no < nlist; list_no++) {
+        std::lock_guard<std::mutex> lock(list_mutexes[list_no]);
+        auto snap = get_snapshot(list_no);
+        std::shared_ptr<ListSnapshot> new_snap;
+        for (size_t e = 0; e < snap->extents.size(); e++) {
+            const Extent& src = *snap->extents[e];
+            if (src.no < n_used) {
+                continue;
+            }
+            size_t no;
+            {
+                std::lock_guard<std::mutex> lock_2(alloc_mutex);
+                if (free_extents.empty() || *free_extents.begin() >= n_used) {
+                    continue;
+                }
+                no = *free_extents.begin();
+                free_extents.erase(free_extents.begin());
+            }
+            auto dst = std::make_shared<Extent>(this, no);
+            memcpy(ptr + no * extent_nbytes,
+                   ptr + src.no * extent_nbytes,
+                   extent_nbytes);
+            if (!new_snap) {
+                new_snap = std::make_shared<ListSnapshot>(*snap);
+            }
+            new_snap->extents[e] = std::move(dst);
+        }
+        if (new_snap) {
+            publish(list_no, std::move(new_snap));
+        }
+    }
+
+    // the extents that were moved are free unless a reader still holds
+    // them: truncate the free extents at the end of the file
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    size_t old_nextent = file_nextent;
+    while (file_nextent > 0 && free_extents.count(file_nextent - 1)) {
+        free_extents.erase(file_nextent - 1);
+        file_nextent--;
+    }
+    if (file_nextent < old_nextent) {
+        FAISS_THROW_IF_NOT_FMT(
+                ftruncate(fd, file_nextent * extent_nbytes) == 0,
+                "could not truncate %s: %s",
+                filename.c_str(),
+                strerror(errno));
+    }
+    return (old_nextent - file_nextent) * extent_nbytes;
+}
+
+void ConcurrentOnDiskInvertedLists::sync() const {
+    size_t nbytes;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        nbytes = file_nextent * extent_nbytes;
+    }
+    if (nbytes > 0) {
+        FAISS_THROW_IF_NOT_FMT(
+                msync(ptr, nbytes, MS_SYNC) == 0,
+                "msync error: %s",
+                strerror(errno));
+    }
+}
+
+size_t ConcurrentOnDiskInvertedLists::n_extents() const {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    return file_nextent;
+}
+
+size_t ConcurrentOnDiskInvertedLists::n_free_extents() const {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    return free_extents.size();
+}
+
+ConcurrentOnDiskInvertedLists::~ConcurrentOnDiskInvertedLists() {
+    // the extents release themselves to free_extents
+    lists.clear();
+    if (ptr != nullptr) {
+        if (munmap(ptr, max_file_size) != 0) {
+            fprintf(stderr, "munmap error: %s\n", strerror(errno));
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/*******************************************************
+ * I/O support via callbacks
+ *******************************************************/
+
+ConcurrentOnDiskInvertedListsIOHook::ConcurrentOnDiskInvertedListsIOHook()
+        : InvertedListsIOHook(
+                  "ilcd",
+                  typeid(ConcurrentOnDiskInvertedLists).name()) {}
+
+void ConcurrentOnDiskInvertedListsIOHook::write(
+        const InvertedLists* ils,
+        IOWriter* f) const {
+    uint32_t h = fourcc("ilcd");
+    WRITE1(h);
+    WRITE1(ils->nlist);
+    WRITE1(ils->code_size);
+    const ConcurrentOnDiskInvertedLists* od =
+            dynamic_cast<const ConcurrentOnDiskInvertedLists*>(ils);
+    WRITE1(od->extent_size);
+    WRITE1(od->max_file_size);
+    {
+        std::vector<char> x(od->filename.begin(), od->filename.end());
+        WRITEVECTOR(x);
+    }
+    od->sync();
+    size_t nextent = od->n_extents();
+    WRITE1(nextent);
+    for (size_t l = 0; l < od->nlist; l++) {
+        auto snap = od->get_snapshot(l);
+        std::vector<size_t> extent_nos;
+        for (const auto& e : snap->extents) {
+            extent_nos.push_back(e->no);
+        }
+        WRITE1(snap->size);
+        WRITEVECTOR(extent_nos);
+    }
+}
+
+InvertedLists* ConcurrentOnDiskInvertedListsIOHook::read(
+        IOReader* f,
+        int io_flags) const {
+    std::unique_ptr<ConcurrentOnDiskInvertedLists> od(
+            new ConcurrentOnDiskInvertedLists());
+    od->read_only = io_flags & IO_FLAG_READ_ONLY;
+    READ1(od->nlist);
+    READ1(od->code_size);
+    READ1(od->extent_size);
+    READ1(od->max_file_size);
+    {
+        std::vector<char> x;
+        READVECTOR(x);
+        od->filename.assign(x.begin(), x.end());
+    }
+    size_t nextent;
+    READ1(nextent);
+    std::vector<size_t> sizes(od->nlist);
+    std::vector<std::vector<size_t>> extent_nos(od->nlist);
+    for (size_t l = 0; l < od->nlist; l++) {
+        READ1(sizes[l]);
+        READVECTOR(extent_nos[l]);
+    }
+    od->open_file(nextent, false);
+    od->set_lists(sizes, extent_nos);
+    return od.release();
+}
+
+} // namespace faiss
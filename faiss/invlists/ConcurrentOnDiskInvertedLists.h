@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/invlists/InvertedListsIOHook.h>
+
+namespace faiss {
+
+/** On-disk inverted lists that can be searched while they are being
+ * written to, for indexes that are built incrementally and do not fit in
+ * RAM.
+ *
+ * This is the on-disk counterpart of ConcurrentInvertedLists. The file is
+ * split in extents of extent_size entries:
+ *
+ * - uint8_t codes[extent_size * code_size], padded to 8 bytes
+ * - followed by idx_t ids[extent_size]
+ *
+ * and each list is a chain of extents. A list is published as an
+ * immutable snapshot (the extents + the nb of valid entries) that the
+ * writers replace atomically. add_entries writes in the slots of the last
+ * extent that no snapshot covers yet, or in new extents, so the existing
+ * entries are never moved. update_entries and resize copy the extents
+ * they modify. An extent returns to the free extents when the last
+ * snapshot that references it is dropped, so a reader never sees an
+ * extent reused under its feet.
+ *
+ * The whole file is mapped once in an address range of max_file_size
+ * bytes. The file grows by truncation (or preallocate) inside that range
+ * without remapping, so the readers use the mapping without any lock. The
+ * writers of a given list are serialized by a per-list mutex, the
+ * allocation of extents by a global mutex that is not held while copying
+ * data.
+ *
+ * compact() moves the extents at the end of the file to free extents and
+ * shrinks the file. It can run in a background thread, concurrently with
+ * the searches and additions.
+ *
+ * As for ConcurrentInvertedLists, the searches go through the iterators
+ * (use_iterator = true), get_codes / get_ids return copies.
+ */
+struct ConcurrentOnDiskInvertedLists : InvertedLists {
+    /// nb of entries per extent
+    size_t extent_size = 0;
+
+    /// size of an extent in the file, in bytes
+    size_t extent_nbytes = 0;
+
+    /// size of the address range reserved for the file mapping
+    size_t max_file_size = 0;
+
+    /// nb of extents added when the file is full
+    size_t grow_extents = 64;
+
+    std::string filename;
+
+    bool read_only = false;
+
+    /// an extent of the file, freed when the last snapshot releases it
+    struct Extent {
+        ConcurrentOnDiskInvertedLists* owner;
+        size_t no;
+        Extent(ConcurrentOnDiskInvertedLists* owner, size_t no);
+        ~Extent();
+    };
+
+    /// immutable state of a list
+    struct ListSnapshot {
+        std::vector<std::shared_ptr<Extent>> extents;
+        size_t size = 0;
+    };
+
+    /// creates (or truncates) the file
+    ConcurrentOnDiskInvertedLists(
+            size_t nlist,
+            size_t code_size,
+            const char* filename,
+            size_t extent_size = 1024,
+            size_t max_file_size = size_t(1) << 40);
+
+    /// current snapshot of a list (thread-safe)
+    std::shared_ptr<const ListSnapshot> get_snapshot(size_t list_no) const;
+
+    const uint8_t* extent_codes(size_t no) const {
+        return ptr + no * extent_nbytes;
+    }
+
+    const idx_t* extent_ids(size_t no) const {
+        return (const idx_t*)(ptr + no * extent_nbytes + ids_offset);
+    }
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+    void release_codes(size_t list_no, const uint8_t* codes) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+    idx_t get_single_id(size_t list_no, size_t offset) const override;
+    const uint8_t* get_single_code(size_t list_no, size_t offset)
+            const override;
+
+    bool is_empty(size_t list_no, void* inverted_list_context = nullptr)
+            const override;
+    InvertedListsIterator* get_iterator(
+            size_t list_no,
+            void* inverted_list_context = nullptr) const override;
+
+    /// asks the kernel to read the extents of the lists (POSIX_MADV_WILLNEED)
+    void prefetch_lists(const idx_t* list_nos, int nlist) const override;
+
+    size_t add_entries(
+            size_t list_no,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void update_entries(
+            size_t list_no,
+            size_t offset,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void resize(size_t list_no, size_t new_size) override;
+
+    /** grow the file so that at least n_extent extents are free, with
+     * their disk blocks allocated, so that the next additions do not
+     * touch the file size */
+    void preallocate(size_t n_extent);
+
+    /** move the extents at the end of the file to free extents and
+     * truncate the file. The extents that are still referenced by the
+     * snapshot of a reader are released by a later call.
+     *
+     * @return nb of bytes the file shrank by
+     */
+    size_t compact();
+
+    /// write the mapped data to disk (msync)
+    void sync() const;
+
+    /// nb of extents in the file
+    size_t n_extents() const;
+
+    /// nb of extents of the file that are not used by any list
+    size_t n_free_extents() const;
+
+    ~ConcurrentOnDiskInvertedLists() override;
+
+    // private
+
+    /// for the I/O functions, the file is opened by open_file
+    ConcurrentOnDiskInvertedLists();
+
+    /// open filename and map it, with a size of nextent extents
+    void open_file(size_t nextent, bool create);
+
+    /// publish the lists read from a file, the other extents are free
+    void set_lists(
+            const std::vector<size_t>& sizes,
+            const std::vector<std::vector<size_t>>& extent_nos);
+
+   private:
+    uint8_t* ptr = nullptr;
+    int fd = -1;
+    size_t ids_offset = 0;
+
+    std::vector<std::shared_ptr<const ListSnapshot>> lists;
+    /// serializes the writers of each list
+    mutable std::vector<std::mutex> list_mutexes;
+
+    /// protects file_nextent and free_extents
+    mutable std::mutex alloc_mutex;
+    size_t file_nextent = 0;
+    /// sorted, so that the extents at the start of the file are used first
+    std::set<size_t> free_extents;
+
+    std::shared_ptr<Extent> new_extent();
+    std::shared_ptr<Extent> copy_extent(const Extent& src);
+    void release_extent(size_t no);
+    void grow_locked(size_t n_extent, bool allocate);
+    void publish(size_t list_no, std::shared_ptr<const ListSnapshot> snap);
+};
+
+struct ConcurrentOnDiskInvertedListsIOHook : InvertedListsIOHook {
+    ConcurrentOnDiskInvertedListsIOHook();
+    void write(const InvertedLists* ils, IOWriter* f) const override;
+    InvertedLists* read(IOReader* f, int io_flags) const override;
+};
+
+} // namespace faiss
@@ -11,6 +11,8 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstring>
+#include <vector>
 
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
@@ -58,7 +60,7 @@ void DirectMap::set_type(
             }
         } else if (new_type == Hashtable) {
             for (long ofs = 0; ofs < list_size; ofs++) {
-                hashtable[idlist[ofs]] = lo_build(key, ofs);
+                hashtable.set(idlist[ofs], lo_build(key, ofs));
             }
         }
     }
@@ -76,9 +78,9 @@ idx_t DirectMap::get(idx_t key) const {
         FAISS_THROW_IF_NOT_MSG(lo >= 0, "-1 entry in direct_map");
         return lo;
     } else if (type == Hashtable) {
-        auto res = hashtable.find(key);
-        FAISS_THROW_IF_NOT_MSG(res != hashtable.end(), "key not found");
-        return res->second;
+        idx_t lo;
+        FAISS_THROW_IF_NOT_MSG(hashtable.get(key, lo), "key not found");
+        return lo;
     } else {
         FAISS_THROW_MSG("direct map not initialized");
     }
@@ -97,11 +99,21 @@ void DirectMap::add_single_id(idx_t id, idx_t list_no, size_t offset) {
         }
     } else if (type == Hashtable) {
         if (list_no >= 0) {
-            hashtable[id] = lo_build(list_no, offset);
+            hashtable.set(id, lo_build(list_no, offset));
         }
     }
 }
 
+void DirectMap::update_single_id(idx_t id, idx_t list_no, size_t offset) {
+    if (type == Array) {
+        FAISS_THROW_IF_NOT_MSG(
+                0 <= id && id < array.size(), "id to update out of range");
+        array[id] = lo_build(list_no, offset);
+    } else if (type == Hashtable) {
+        hashtable.set(id, lo_build(list_no, offset));
+    }
+}
+
 void DirectMap::check_can_add(const idx_t* ids) {
     if (type == Array && ids) {
         FAISS_THROW_MSG("cannot have array direct map and add with ids");
@@ -119,6 +131,9 @@ DirectMapAdd::DirectMapAdd(DirectMap& direct_map, size_t n, const idx_t* xids)
     } else if (type == DirectMap::Hashtable) {
         // can't parallel update hashtable so use temp array
         all_ofs.resize(n, -1);
+        // sequential ids follow the entries already in the map
+        ntotal = direct_map.hashtable.size();
+        direct_map.hashtable.reserve(direct_map.hashtable.size() + n);
     }
 }
 
@@ -134,7 +149,7 @@ DirectMapAdd::~DirectMapAdd() {
     if (type == DirectMap::Hashtable) {
         for (int i = 0; i < n; i++) {
             idx_t id = xids ? xids[i] : ntotal + i;
-            direct_map.hashtable[id] = all_ofs[i];
+            direct_map.hashtable.set(id, all_ofs[i]);
         }
     }
 }
@@ -159,15 +174,19 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists* invlists) {
 #pragma omp parallel for
         for (idx_t i = 0; i < nlist; i++) {
             idx_t l0 = invlists->list_size(i), l = l0, j = 0;
-            ScopedIds idsi(invlists, i);
+            // local copy: the ids returned by some inverted lists are a
+            // snapshot that update_entry does not modify
+            std::vector<idx_t> idsi(l0);
+            if (l0 > 0) {
+                ScopedIds ids(invlists, i);
+                memcpy(idsi.data(), ids.get(), l0 * sizeof(idx_t));
+            }
             while (j < l) {
                 if (sel.is_member(idsi[j])) {
                     l--;
+                    idsi[j] = idsi[l];
                     invlists->update_entry(
-                            i,
-                            j,
-                            invlists->get_single_id(i, l),
-                            ScopedCodes(invlists, i, l).get());
+                            i, j, idsi[j], ScopedCodes(invlists, i, l).get());
                 } else {
                     j++;
                 }
@@ -183,22 +202,44 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists* invlists) {
             }
         }
     } else if (type == Hashtable) {
-        FAISS_THROW_IF_MSG(
-                block_invlists,
-                "remove with hashtable is not supported with BlockInvertedLists");
         const IDSelectorArray* sela =
                 dynamic_cast<const IDSelectorArray*>(&sel);
         FAISS_THROW_IF_NOT_MSG(
                 sela, "remove with hashtable works only with IDSelectorArray");
 
+        if (block_invlists != nullptr) {
+            // the block lists compact the entries in place, the offsets
+            // of the lists that had removed entries are rebuilt
+            std::vector<bool> modified(nlist);
+            for (idx_t i = 0; i < sela->n; i++) {
+                idx_t lo;
+                if (hashtable.get(sela->ids[i], lo)) {
+                    modified[lo_listno(lo)] = true;
+                    hashtable.erase(sela->ids[i]);
+                }
+            }
+            nremove = block_invlists->remove_ids(sel);
+            for (size_t list_no = 0; list_no < nlist; list_no++) {
+                if (!modified[list_no]) {
+                    continue;
+                }
+                size_t ls = invlists->list_size(list_no);
+                ScopedIds ids(invlists, list_no);
+                for (size_t ofs = 0; ofs < ls; ofs++) {
+                    hashtable.set(ids[ofs], lo_build(list_no, ofs));
+                }
+            }
+            return nremove;
+        }
+
         for (idx_t i = 0; i < sela->n; i++) {
             idx_t id = sela->ids[i];
-            auto res = hashtable.find(id);
-            if (res != hashtable.end()) {
-                size_t list_no = lo_listno(res->second);
-                size_t offset = lo_offset(res->second);
+            idx_t lo;
+            if (hashtable.get(id, lo)) {
+                size_t list_no = lo_listno(lo);
+                size_t offset = lo_offset(lo);
                 idx_t last = invlists->list_size(list_no) - 1;
-                hashtable.erase(res);
+                hashtable.erase(id);
                 if (offset < last) {
                     idx_t last_id = invlists->get_single_id(list_no, last);
                     invlists->update_entry(
@@ -207,7 +248,7 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists* invlists) {
                             last_id,
                             ScopedCodes(invlists, list_no, last).get());
                     // update hash entry for last element
-                    hashtable[last_id] = lo_build(list_no, offset);
+                    hashtable.set(last_id, lo_build(list_no, offset));
                 }
                 invlists->resize(list_no, last);
                 nremove++;
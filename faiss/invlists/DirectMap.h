@@ -10,6 +10,8 @@
 #ifndef FAISS_DIRECT_MAP_H
 #define FAISS_DIRECT_MAP_H
 
+#include <faiss/impl/IdHashMap.h>
+#include <faiss/impl/maybe_owned_vector.h>
 #include <faiss/invlists/InvertedLists.h>
 #include <unordered_map>
 
@@ -44,8 +46,8 @@ struct DirectMap {
     Type type;
 
     /// map for direct access to the elements. Map ids to LO-encoded entries.
-    std::vector<idx_t> array;
-    std::unordered_map<idx_t, idx_t> hashtable;
+    MaybeOwnedVector<idx_t> array;
+    IdHashMap hashtable;
 
     DirectMap();
 
@@ -70,6 +72,9 @@ struct DirectMap {
     /// non thread-safe version
     void add_single_id(idx_t id, idx_t list_no, size_t offset);
 
+    /// set the new location of an id already in the map (non thread-safe)
+    void update_single_id(idx_t id, idx_t list_no, size_t offset);
+
     /// remove all entries
     void clear();
 
@@ -7,8 +7,17 @@
 
 #include <faiss/invlists/InvertedLists.h>
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <thread>
+
+#include <omp.h>
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/utils.h>
@@ -17,6 +26,125 @@ namespace faiss {
 
 InvertedListsIterator::~InvertedListsIterator() {}
 
+InvertedListsFetcher::~InvertedListsFetcher() {}
+
+namespace {
+
+/// reads the lists with the synchronous accessors from a few threads
+struct ThreadedInvertedListsFetcher : InvertedListsFetcher {
+    const InvertedLists* il;
+    std::vector<idx_t> list_nos;
+    std::vector<size_t> ranks;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next_task = 0;
+    std::deque<FetchedList> done;
+    size_t n_returned = 0;
+    std::exception_ptr error;
+    bool stop = false;
+    std::vector<std::thread> threads;
+
+    bool has_current = false;
+    FetchedList current;
+
+    ThreadedInvertedListsFetcher(
+            const InvertedLists* il,
+            const idx_t* in_list_nos,
+            size_t n)
+            : il(il) {
+        for (size_t i = 0; i < n; i++) {
+            if (in_list_nos[i] >= 0) {
+                list_nos.push_back(in_list_nos[i]);
+                ranks.push_back(i);
+            }
+        }
+        int nt = std::min(size_t(std::max(il->fetch_nthread, 1)), n);
+        for (int t = 0; t < nt; t++) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    void run() {
+        for (;;) {
+            size_t task;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stop || next_task >= list_nos.size()) {
+                    return;
+                }
+                task = next_task++;
+            }
+            FetchedList fl{ranks[task], list_nos[task], 0, nullptr, nullptr};
+            std::exception_ptr e;
+            try {
+                fl.list_size = il->list_size(fl.list_no);
+                fl.codes = il->get_codes(fl.list_no);
+                fl.ids = il->get_ids(fl.list_no);
+            } catch (...) {
+                e = std::current_exception();
+                if (fl.codes) {
+                    il->release_codes(fl.list_no, fl.codes);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (e) {
+                error = e;
+                stop = true;
+            } else {
+                done.push_back(fl);
+            }
+            cv.notify_one();
+        }
+    }
+
+    void release(const FetchedList& fl) {
+        il->release_codes(fl.list_no, fl.codes);
+        il->release_ids(fl.list_no, fl.ids);
+    }
+
+    bool next(FetchedList& fl) override {
+        if (has_current) {
+            release(current);
+            has_current = false;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] {
+            return error || !done.empty() || n_returned == list_nos.size();
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (done.empty()) {
+            return false;
+        }
+        current = done.front();
+        done.pop_front();
+        n_returned++;
+        has_current = true;
+        fl = current;
+        return true;
+    }
+
+    ~ThreadedInvertedListsFetcher() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        if (has_current) {
+            release(current);
+        }
+        for (const FetchedList& fl : done) {
+            release(fl);
+        }
+    }
+};
+
+} // namespace
+
 /*****************************************
  * InvertedLists implementation
  ******************************************/
@@ -36,10 +164,37 @@ idx_t InvertedLists::get_single_id(size_t list_no, size_t offset) const {
 
 void InvertedLists::release_codes(size_t, const uint8_t*) const {}
 
+bool InvertedLists::has_compressed_ids() const {
+    return false;
+}
+
 void InvertedLists::release_ids(size_t, const idx_t*) const {}
 
 void InvertedLists::prefetch_lists(const idx_t*, int) const {}
 
+size_t InvertedLists::warmup_list(size_t list_no) const {
+    size_t ls = list_size(list_no);
+    if (ls == 0) {
+        return 0;
+    }
+    size_t nbytes = 0;
+    if (code_size != INVALID_CODE_SIZE) {
+        ScopedCodes codes(this, list_no);
+        nbytes += warmup_memory(codes.get(), ls * code_size);
+    }
+    if (!has_compressed_ids()) {
+        ScopedIds ids(this, list_no);
+        nbytes += warmup_memory(ids.get(), ls * sizeof(idx_t));
+    }
+    return nbytes;
+}
+
+InvertedListsFetcher* InvertedLists::fetch_lists(
+        const idx_t* list_nos,
+        size_t n) const {
+    return new ThreadedInvertedListsFetcher(this, list_nos, n);
+}
+
 const uint8_t* InvertedLists::get_single_code(size_t list_no, size_t offset)
         const {
     assert(offset < list_size(list_no));
@@ -66,6 +221,100 @@ void InvertedLists::reset() {
     for (size_t i = 0; i < nlist; i++) {
         resize(i, 0);
     }
+    if (n_attributes > 0) {
+        enable_attribute_ranges(n_attributes);
+    }
+}
+
+void InvertedLists::enable_attribute_ranges(int n_attributes_2) {
+    FAISS_THROW_IF_NOT(n_attributes_2 > 0);
+    n_attributes = n_attributes_2;
+    attribute_offsets.resize(nlist);
+    for (size_t i = 0; i < nlist; i++) {
+        attribute_offsets[i].assign(n_attributes + 1, list_size(i));
+        attribute_offsets[i][0] = 0;
+    }
+}
+
+void InvertedLists::disable_attribute_ranges() {
+    n_attributes = 0;
+    attribute_offsets.clear();
+}
+
+void InvertedLists::enable_access_counts() {
+    access_counts.assign(nlist, 0);
+}
+
+void InvertedLists::disable_access_counts() {
+    access_counts.clear();
+}
+
+void InvertedLists::count_accesses(const idx_t* list_nos, size_t n) {
+    if (access_counts.empty()) {
+        return;
+    }
+    uint64_t* counts = access_counts.data();
+    for (size_t i = 0; i < n; i++) {
+        if (list_nos[i] >= 0) {
+            // searches may run concurrently
+#pragma omp atomic
+            counts[list_nos[i]]++;
+        }
+    }
+}
+
+void InvertedLists::enable_zone_maps(size_t block_size) {
+    FAISS_THROW_IF_NOT(block_size > 0);
+    zone_map_block_size = block_size;
+    zone_maps.assign(nlist, {});
+    zone_map_sizes.assign(nlist, 0);
+#pragma omp parallel for if (nlist > 100)
+    for (idx_t i = 0; i < nlist; i++) {
+        update_zone_map(i, 0, list_size(i));
+    }
+}
+
+void InvertedLists::disable_zone_maps() {
+    zone_map_block_size = 0;
+    zone_maps.clear();
+    zone_map_sizes.clear();
+}
+
+void InvertedLists::update_zone_map(size_t list_no, size_t offset, size_t n) {
+    if (zone_map_block_size == 0) {
+        return;
+    }
+    size_t bs = zone_map_block_size;
+    size_t ls = list_size(list_no);
+    std::vector<idx_t>& zm = zone_maps[list_no];
+    size_t nb = (ls + bs - 1) / bs;
+    // entries whose blocks must be recomputed: the modified ones, and the
+    // end of the list if its size changed
+    size_t e0 = n > 0 ? offset : ls, e1 = std::min(offset + n, ls);
+    size_t old_size = zone_map_sizes[list_no];
+    if (ls != old_size) {
+        size_t tail = std::min(ls, old_size) / bs * bs;
+        e0 = std::min(e0, tail);
+        e1 = ls;
+    }
+    zm.resize(2 * nb);
+    zone_map_sizes[list_no] = ls;
+    if (e0 >= e1) {
+        return;
+    }
+    size_t b0 = e0 / bs, b1 = (e1 + bs - 1) / bs;
+    ScopedIds sids(this, list_no);
+    const idx_t* ids = sids.get();
+    for (size_t b = b0; b < b1; b++) {
+        idx_t vmin = ids[b * bs], vmax = ids[b * bs];
+        for (size_t j = b * bs + 1; j < std::min((b + 1) * bs, ls); j++) {
+            vmin = std::min(vmin, ids[j]);
+            vmax = std::max(vmax, ids[j]);
+        }
+        zm[2 * b] = vmin;
+        zm[2 * b + 1] = vmax;
+    }
+    release_ids(list_no, ids);
 }
 
 void InvertedLists::merge_from(InvertedLists* oivf, size_t add_id) {
@@ -283,23 +532,28 @@ size_t ArrayInvertedLists::add_entries(
     if (n_entry == 0)
         return 0;
     assert(list_no < nlist);
+    decompress_list(list_no);
     size_t o = ids[list_no].size();
     ids[list_no].resize(o + n_entry);
     memcpy(&ids[list_no][o], ids_in, sizeof(ids_in[0]) * n_entry);
     codes[list_no].resize((o + n_entry) * code_size);
     memcpy(&codes[list_no][o * code_size], code, code_size * n_entry);
+    update_zone_map(list_no, o, n_entry);
     return o;
 }
 
 size_t ArrayInvertedLists::list_size(size_t list_no) const {
     assert(list_no < nlist);
+    if (is_compressed(list_no)) {
+        return compressed_ids[list_no].size();
+    }
     return ids[list_no].size();
 }
 
 bool ArrayInvertedLists::is_empty(size_t list_no, void* inverted_list_context)
         const {
     FAISS_THROW_IF_NOT(inverted_list_context == nullptr);
-    return ids[list_no].size() == 0;
+    return list_size(list_no) == 0;
 }
 
 const uint8_t* ArrayInvertedLists::get_codes(size_t list_no) const {
@@ -309,12 +563,66 @@ const uint8_t* ArrayInvertedLists::get_codes(size_t list_no) const {
 
 const idx_t* ArrayInvertedLists::get_ids(size_t list_no) const {
     assert(list_no < nlist);
+    if (is_compressed(list_no)) {
+        const CompressedIDs& cids = compressed_ids[list_no];
+        idx_t* buf = new idx_t[cids.size()];
+        cids.decode(buf);
+        return buf;
+    }
     return ids[list_no].data();
 }
 
+void ArrayInvertedLists::release_ids(size_t list_no, const idx_t* ids_in)
+        const {
+    if (is_compressed(list_no)) {
+        delete[] ids_in;
+    }
+}
+
+idx_t ArrayInvertedLists::get_single_id(size_t list_no, size_t offset) const {
+    assert(offset < list_size(list_no));
+    if (is_compressed(list_no)) {
+        return compressed_ids[list_no].get(offset);
+    }
+    return ids[list_no][offset];
+}
+
+bool ArrayInvertedLists::has_compressed_ids() const {
+    return !compressed_ids.empty();
+}
+
+void ArrayInvertedLists::compress_ids() {
+    compressed_ids.resize(nlist);
+    for (size_t i = 0; i < nlist; i++) {
+        if (ids[i].size() > 0) {
+            compressed_ids[i].encode(ids[i].size(), ids[i].data());
+            ids[i] = MaybeOwnedVector<idx_t>();
+        }
+    }
+}
+
+void ArrayInvertedLists::decompress_ids() {
+    for (size_t i = 0; i < compressed_ids.size(); i++) {
+        decompress_list(i);
+    }
+    compressed_ids.clear();
+}
+
+void ArrayInvertedLists::decompress_list(size_t list_no) {
+    if (!is_compressed(list_no)) {
+        return;
+    }
+    CompressedIDs& cids = compressed_ids[list_no];
+    ids[list_no].resize(cids.size());
+    cids.decode(ids[list_no].data());
+    cids.clear();
+}
+
 void ArrayInvertedLists::resize(size_t list_no, size_t new_size) {
+    decompress_list(list_no);
     ids[list_no].resize(new_size);
     codes[list_no].resize(new_size * code_size);
+    update_zone_map(list_no, new_size, 0);
 }
 
 void ArrayInvertedLists::update_entries(
@@ -324,9 +632,11 @@ void ArrayInvertedLists::update_entries(
         const idx_t* ids_in,
         const uint8_t* codes_in) {
     assert(list_no < nlist);
+    decompress_list(list_no);
     assert(n_entry + offset <= ids[list_no].size());
     memcpy(&ids[list_no][offset], ids_in, sizeof(ids_in[0]) * n_entry);
     memcpy(&codes[list_no][offset * code_size], codes_in, code_size * n_entry);
+    update_zone_map(list_no, offset, n_entry);
 }
 
 void ArrayInvertedLists::permute_invlists(const idx_t* map) {
@@ -341,6 +651,86 @@ void ArrayInvertedLists::permute_invlists(const idx_t* map) {
     }
     std::swap(codes, new_codes);
     std::swap(ids, new_ids);
+    if (!compressed_ids.empty()) {
+        std::vector<CompressedIDs> new_compressed_ids(nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            std::swap(new_compressed_ids[i], compressed_ids[map[i]]);
+        }
+        std::swap(compressed_ids, new_compressed_ids);
+    }
+    if (!list_node.empty()) {
+        std::vector<int> new_list_node(nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            new_list_node[i] = list_node[map[i]];
+        }
+        std::swap(list_node, new_list_node);
+    }
+    if (zone_map_block_size > 0) {
+        enable_zone_maps(zone_map_block_size);
+    }
+    if (n_attributes > 0) {
+        std::vector<std::vector<size_t>> new_offsets(nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            std::swap(new_offsets[i], attribute_offsets[map[i]]);
+        }
+        std::swap(attribute_offsets, new_offsets);
+    }
+}
+
+void ArrayInvertedLists::place_on_numa_nodes(int n_nodes) {
+    if (n_nodes <= 0) {
+        n_nodes = get_numa_node_count();
+    }
+    n_nodes = std::max(1, std::min(n_nodes, omp_get_max_threads()));
+
+    // largest lists first, each to the least loaded node
+    std::vector<size_t> order(nlist);
+    for (size_t i = 0; i < nlist; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return list_size(a) > list_size(b);
+    });
+    std::vector<size_t> load(n_nodes);
+    list_node.resize(nlist);
+    for (size_t l : order) {
+        int g = std::min_element(load.begin(), load.end()) - load.begin();
+        list_node[l] = g;
+        load[g] += list_size(l) * (code_size + sizeof(idx_t));
+    }
+    numa_n_nodes = n_nodes;
+
+#pragma omp parallel
+    {
+        int rank = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int g = numa_node_of_thread(rank, nt, n_nodes);
+        // threads [r0, r1) are on node g
+        int r0 = rank, r1 = rank + 1;
+        while (r0 > 0 && numa_node_of_thread(r0 - 1, nt, n_nodes) == g) {
+            r0--;
+        }
+        while (r1 < nt && numa_node_of_thread(r1, nt, n_nodes) == g) {
+            r1++;
+        }
+        size_t j = 0; // rank of the list among the lists of node g
+        for (size_t l = 0; l < nlist; l++) {
+            if (list_node[l] != g || j++ % (r1 - r0) != rank - r0) {
+                continue;
+            }
+            if (!codes[l].is_owned || !ids[l].is_owned) {
+                continue;
+            }
+            MaybeOwnedVector<uint8_t> new_codes(codes[l].size());
+            memcpy(new_codes.data(), codes[l].data(), codes[l].size());
+            MaybeOwnedVector<idx_t> new_ids(ids[l].size());
+            memcpy(new_ids.data(),
+                   ids[l].data(),
+                   ids[l].size() * sizeof(idx_t));
+            std::swap(codes[l], new_codes);
+            std::swap(ids[l], new_ids);
+        }
+    }
 }
 
 ArrayInvertedLists::~ArrayInvertedLists() {}
@@ -791,4 +1181,135 @@ void StopWordsInvertedLists::prefetch_lists(const idx_t* list_nos, int nlist)
     il0->prefetch_lists(list0.data(), list0.size());
 }
 
+/*****************************************
+ * TieredInvertedLists implementation
+ ******************************************/
+
+TieredInvertedLists::TieredInvertedLists(
+        const InvertedLists* il,
+        size_t hot_budget,
+        const InvertedLists* cold)
+        : ReadOnlyInvertedLists(il->nlist, il->code_size),
+          cold(cold ? cold : il) {
+    FAISS_THROW_IF_NOT_MSG(
+            il->access_counts.size() == nlist,
+            "the access counts of the lists are needed");
+    FAISS_THROW_IF_NOT(this->cold->nlist == nlist);
+    FAISS_THROW_IF_NOT(this->cold->code_size == code_size);
+    const std::vector<uint64_t>& counts = il->access_counts;
+
+    std::vector<idx_t> order(nlist);
+    for (size_t i = 0; i < nlist; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](idx_t a, idx_t b) {
+        return counts[a] > counts[b];
+    });
+
+    // greedily take the most accessed lists that fit in the budget
+    hot_offsets.assign(nlist, SIZE_MAX);
+    hot_sizes.assign(nlist, 0);
+    size_t tot = 0;
+    for (idx_t list_no : order) {
+        if (counts[list_no] == 0) {
+            break;
+        }
+        size_t size = il->list_size(list_no);
+        size_t nbytes = hot_nbytes(size);
+        if (size == 0 || tot + nbytes > hot_budget) {
+            continue;
+        }
+        hot_lists.push_back(list_no);
+        hot_offsets[list_no] = tot;
+        hot_sizes[list_no] = size;
+        tot += nbytes;
+    }
+
+    hot_data.resize(tot);
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < hot_lists.size(); i++) {
+        idx_t list_no = hot_lists[i];
+        size_t size = hot_sizes[list_no];
+        uint8_t* codes = hot_data.data() + hot_offsets[list_no];
+        memcpy(codes, ScopedCodes(il, list_no).get(), size * code_size);
+        memcpy(codes + hot_nbytes(size) - size * sizeof(idx_t),
+               ScopedIds(il, list_no).get(),
+               size * sizeof(idx_t));
+    }
+    access_counts = counts;
+}
+
+size_t TieredInvertedLists::hot_nbytes(size_t list_size) const {
+    // the ids are 8-byte aligned and the lists start on cache lines
+    size_t codes_nbytes = (list_size * code_size + 7) & ~size_t(7);
+    return (codes_nbytes + list_size * sizeof(idx_t) + 63) & ~size_t(63);
+}
+
+size_t TieredInvertedLists::list_size(size_t list_no) const {
+    return is_hot(list_no) ? hot_sizes[list_no] : cold->list_size(list_no);
+}
+
+const uint8_t* TieredInvertedLists::get_codes(size_t list_no) const {
+    return is_hot(list_no) ? hot_data.data() + hot_offsets[list_no]
+                           : cold->get_codes(list_no);
+}
+
+const idx_t* TieredInvertedLists::get_ids(size_t list_no) const {
+    if (!is_hot(list_no)) {
+        return cold->get_ids(list_no);
+    }
+    size_t size = hot_sizes[list_no];
+    return (const idx_t*)(hot_data.data() + hot_offsets[list_no] +
+                          hot_nbytes(size) - size * sizeof(idx_t));
+}
+
+void TieredInvertedLists::release_codes(size_t list_no, const uint8_t* codes)
+        const {
+    if (!is_hot(list_no)) {
+        cold->release_codes(list_no, codes);
+    }
+}
+
+void TieredInvertedLists::release_ids(size_t list_no, const idx_t* ids) const {
+    if (!is_hot(list_no)) {
+        cold->release_ids(list_no, ids);
+    }
+}
+
+idx_t TieredInvertedLists::get_single_id(size_t list_no, size_t offset) const {
+    if (!is_hot(list_no)) {
+        return cold->get_single_id(list_no, offset);
+    }
+    FAISS_THROW_IF_NOT(offset < hot_sizes[list_no]);
+    return get_ids(list_no)[offset];
+}
+
+const uint8_t* TieredInvertedLists::get_single_code(
+        size_t list_no,
+        size_t offset) const {
+    if (!is_hot(list_no)) {
+        return cold->get_single_code(list_no, offset);
+    }
+    FAISS_THROW_IF_NOT(offset < hot_sizes[list_no]);
+    return get_codes(list_no) + offset * code_size;
+}
+
+void TieredInvertedLists::prefetch_lists(const idx_t* list_nos, int nlist)
+        const {
+    std::vector<idx_t> cold_lists;
+    for (int i = 0; i < nlist; i++) {
+        idx_t list_no = list_nos[i];
+        if (list_no >= 0 && !is_hot(list_no)) {
+            cold_lists.push_back(list_no);
+        }
+    }
+    cold->prefetch_lists(cold_lists.data(), cold_lists.size());
+}
+
+TieredInvertedLists::~TieredInvertedLists() {
+    if (own_cold) {
+        delete cold;
+    }
+}
+
 } // namespace faiss
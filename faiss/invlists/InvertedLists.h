@@ -19,6 +19,8 @@
 
 #include <faiss/MetricType.h>
 #include <faiss/impl/maybe_owned_vector.h>
+#include <faiss/invlists/CompressedIDs.h>
+#include <faiss/utils/AlignedTable.h>
 
 namespace faiss {
 
@@ -29,6 +31,27 @@ struct InvertedListsIterator {
     virtual std::pair<idx_t, const uint8_t*> get_id_and_codes() = 0;
 };
 
+/// a list delivered by an InvertedListsFetcher
+struct FetchedList {
+    size_t rank;          ///< position of the list in the fetch request
+    idx_t list_no;        ///< the list
+    size_t list_size;     ///< its nb of entries
+    const uint8_t* codes; ///< size list_size * code_size
+    const idx_t* ids;     ///< size list_size
+};
+
+/** Lists that are being read, returned in the order in which they are
+ * available rather than in the order of the request. */
+struct InvertedListsFetcher {
+    /** wait for the next available list. It remains valid until the next
+     * call or the destruction of the fetcher.
+     *
+     * @return false if all the lists were returned */
+    virtual bool next(FetchedList& fl) = 0;
+
+    virtual ~InvertedListsFetcher();
+};
+
 /** Table of inverted lists
  * multithreading rules:
  * - concurrent read accesses are allowed
@@ -43,6 +66,13 @@ struct InvertedLists {
     /// request to use iterator rather than get_codes / get_ids
     bool use_iterator = false;
 
+    /// request to read the lists of a query with fetch_lists, for storages
+    /// where reading a list has a high latency (remote, on disk)
+    bool use_fetcher = false;
+
+    /// nb of lists read concurrently by the default fetch_lists
+    int fetch_nthread = 8;
+
     InvertedLists(size_t nlist, size_t code_size);
 
     virtual ~InvertedLists();
@@ -84,10 +114,25 @@ struct InvertedLists {
     /// (should be deallocated with release_codes)
     virtual const uint8_t* get_single_code(size_t list_no, size_t offset) const;
 
+    /// the ids are stored compressed: the search decodes only the ids of
+    /// the results, with get_single_id
+    virtual bool has_compressed_ids() const;
+
     /// prepare the following lists (default does nothing)
     /// a list can be -1 hence the signed long
     virtual void prefetch_lists(const idx_t* list_nos, int nlist) const;
 
+    /** bring the codes and ids of a list into memory (see Index::warmup).
+     * The compressed ids and the codes of a variable size are not warmed.
+     * @return nb of bytes warmed */
+    virtual size_t warmup_list(size_t list_no) const;
+
+    /** start reading n lists, the -1 entries are skipped. The default
+     * implementation calls get_codes and get_ids from fetch_nthread
+     * threads. */
+    virtual InvertedListsFetcher* fetch_lists(const idx_t* list_nos, size_t n)
+            const;
+
     /*****************************************
      * Iterator interface (with context)     */
 
@@ -164,6 +209,80 @@ struct InvertedLists {
             idx_t a1,
             idx_t a2) const;
 
+    /*************************
+     * id range metadata     */
+
+    /** Zone maps: min and max id of each block of zone_map_block_size
+     * consecutive entries of the lists, so that the searches with an
+     * IDSelectorRange skip the blocks (and lists) outside the range.
+     * 0 = disabled. Not serialized. */
+    size_t zone_map_block_size = 0;
+    /// per list: min and max id of each block, interleaved
+    std::vector<std::vector<idx_t>> zone_maps;
+    /// per list: nb of entries described by its zone map
+    std::vector<size_t> zone_map_sizes;
+
+    /** compute the zone maps of all the lists. ArrayInvertedLists keeps
+     * them up to date afterwards. The other implementations do not: the
+     * lists that they grow or shrink are then scanned in full, and
+     * enable_zone_maps must be called again after updates in place. */
+    void enable_zone_maps(size_t block_size = 256);
+
+    void disable_zone_maps();
+
+    /** recompute the blocks of list_no that contain the entries [offset,
+     * offset + n), after they were added or modified, and adjust the zone
+     * map to the current list size. */
+    void update_zone_map(size_t list_no, size_t offset, size_t n);
+
+    /// whether the zone map of list_no describes all its entries
+    bool has_zone_map(size_t list_no) const {
+        return zone_map_block_size > 0 &&
+                zone_map_sizes[list_no] == list_size(list_no);
+    }
+
+    /*************************
+     * attribute ranges      */
+
+    /** Attribute ranges: the entries of each list are sorted by a small
+     * integer attribute in [0, n_attributes) (eg. a language or a
+     * category), so that the searches filtered on one attribute
+     * (SearchParametersIVF::attribute) scan a contiguous range of each
+     * list. The lists are kept sorted by IndexIVF::add_with_attributes.
+     * 0 = disabled. Not serialized. */
+    int n_attributes = 0;
+    /// per list: n_attributes + 1 offsets, the entries with attribute a
+    /// are [attribute_offsets[list_no][a], attribute_offsets[list_no][a + 1])
+    std::vector<std::vector<size_t>> attribute_offsets;
+
+    /// enable the attribute ranges, the entries already in the lists get
+    /// attribute 0
+    void enable_attribute_ranges(int n_attributes);
+
+    void disable_attribute_ranges();
+
+    /// whether the attribute ranges of list_no describe all its entries
+    bool has_attribute_ranges(size_t list_no) const {
+        return n_attributes > 0 &&
+                attribute_offsets[list_no].back() == list_size(list_no);
+    }
+
+    /*************************
+     * access counts         */
+
+    /** nb of times each list was selected by the IVF searches, to order
+     * the storage by access frequency (see TieredInvertedLists). Empty =
+     * not counted. Not serialized. */
+    std::vector<uint64_t> access_counts;
+
+    /// start counting the accesses (resets the counts)
+    void enable_access_counts();
+
+    void disable_access_counts();
+
+    /// count the accesses to the n lists, the -1 entries are skipped
+    void count_accesses(const idx_t* list_nos, size_t n);
+
     /*************************
      * statistics            */
 
@@ -246,11 +365,34 @@ struct ArrayInvertedLists : InvertedLists {
     std::vector<MaybeOwnedVector<uint8_t>> codes; // binary codes, size nlist
     std::vector<MaybeOwnedVector<idx_t>> ids; ///< Inverted lists for indexes
 
+    /** ids of the lists compressed by compress_ids, size nlist or empty. The
+     * ids entry of a compressed list is empty. A list is decompressed when
+     * it is modified. */
+    std::vector<CompressedIDs> compressed_ids;
+
     ArrayInvertedLists(size_t nlist, size_t code_size);
 
     size_t list_size(size_t list_no) const override;
     const uint8_t* get_codes(size_t list_no) const override;
+    /// the ids of a compressed list are decoded to a buffer that is freed
+    /// by release_ids
     const idx_t* get_ids(size_t list_no) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+    idx_t get_single_id(size_t list_no, size_t offset) const override;
+    bool has_compressed_ids() const override;
+
+    /// compress the ids of all lists
+    void compress_ids();
+
+    /// decompress the ids of all lists
+    void decompress_ids();
+
+    bool is_compressed(size_t list_no) const {
+        return !compressed_ids.empty() && compressed_ids[list_no].size() > 0;
+    }
+
+    /// decompress the ids of a list, before it is modified
+    void decompress_list(size_t list_no);
 
     size_t add_entries(
             size_t list_no,
@@ -273,6 +415,26 @@ struct ArrayInvertedLists : InvertedLists {
     bool is_empty(size_t list_no, void* inverted_list_context = nullptr)
             const override;
 
+    /// NUMA node that owns each list, empty if the lists are not placed
+    std::vector<int> list_node;
+    /// nb of nodes the lists are placed on
+    int numa_n_nodes = 0;
+
+    /** Distribute the lists over n_nodes NUMA nodes (0 = the nodes of the
+     * machine) with balanced sizes, and move each list to its node: it is
+     * copied by an OpenMP thread of the node, so that its pages are
+     * allocated there at first touch. The OpenMP threads are assumed to be
+     * bound to the nodes in contiguous groups of thread numbers (eg.
+     * OMP_PLACES=cores OMP_PROC_BIND=close), see numa_node_of_thread.
+     * The lists that are views (eg. mmapped) are not moved. Used by
+     * IndexIVF::parallel_mode 4. */
+    void place_on_numa_nodes(int n_nodes = 0);
+
+    /// node of the OpenMP thread rank out of nt threads
+    static int numa_node_of_thread(int rank, int nt, int n_nodes) {
+        return (int64_t)rank * n_nodes / nt;
+    }
+
     ~ArrayInvertedLists() override;
 };
 
@@ -421,6 +583,54 @@ struct StopWordsInvertedLists : ReadOnlyInvertedLists {
     void prefetch_lists(const idx_t* list_nos, int nlist) const override;
 };
 
+/** Two-tier storage ordered by access frequency. The most accessed lists
+ * of il (according to il->access_counts) that fit in hot_budget bytes are
+ * copied, in decreasing order of access, into a single contiguous buffer
+ * (with huge pages according to huge_pages_mode), so that the hot lists
+ * share pages and TLB entries. The other lists are read from the cold
+ * tier, by default il itself; ivflib's tier_inverted_lists puts them in
+ * an mmapped OnDiskInvertedLists. Not serializable. */
+struct TieredInvertedLists : ReadOnlyInvertedLists {
+    /// the hot lists, by decreasing access count
+    std::vector<idx_t> hot_lists;
+    /// per list: offset of the codes in hot_data (the ids follow), or
+    /// SIZE_MAX for the cold lists
+    std::vector<size_t> hot_offsets;
+    std::vector<size_t> hot_sizes;
+    AlignedTableTightAlloc<uint8_t, 64> hot_data;
+
+    const InvertedLists* cold;
+    bool own_cold = false;
+
+    TieredInvertedLists(
+            const InvertedLists* il,
+            size_t hot_budget,
+            const InvertedLists* cold = nullptr);
+
+    bool is_hot(size_t list_no) const {
+        return hot_offsets[list_no] != SIZE_MAX;
+    }
+
+    /// size of the storage of a list in hot_data
+    size_t hot_nbytes(size_t list_size) const;
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+
+    void release_codes(size_t list_no, const uint8_t* codes) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+
+    idx_t get_single_id(size_t list_no, size_t offset) const override;
+
+    const uint8_t* get_single_code(size_t list_no, size_t offset)
+            const override;
+
+    void prefetch_lists(const idx_t* list_nos, int nlist) const override;
+
+    ~TieredInvertedLists() override;
+};
+
 } // namespace faiss
 
 #endif
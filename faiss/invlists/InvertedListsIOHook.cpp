@@ -14,7 +14,9 @@
 #include <faiss/invlists/BlockInvertedLists.h>
 
 #ifndef _WIN32
+#include <faiss/invlists/ConcurrentOnDiskInvertedLists.h>
 #include <faiss/invlists/OnDiskInvertedLists.h>
+#include <faiss/invlists/RangeInvertedLists.h>
 #endif // !_WIN32
 
 namespace faiss {
@@ -35,8 +37,11 @@ struct IOHookTable : std::vector<InvertedListsIOHook*> {
     IOHookTable() {
 #ifndef _WIN32
         push_back(new OnDiskInvertedListsIOHook());
+        push_back(new RangeInvertedListsIOHook());
+        push_back(new ConcurrentOnDiskInvertedListsIOHook());
 #endif
         push_back(new BlockInvertedListsIOHook());
+        push_back(new BlockInvertedListsCompressedIOHook());
     }
 
     ~IOHookTable() {
@@ -11,8 +11,10 @@
 
 #include <pthread.h>
 
+#include <algorithm>
 #include <unordered_set>
 
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -256,7 +258,44 @@ struct OnDiskInvertedLists::OngoingPrefetch {
 int OnDiskInvertedLists::OngoingPrefetch::global_cs = 0;
 
 void OnDiskInvertedLists::prefetch_lists(const idx_t* list_nos, int n) const {
-    pf->prefetch_lists(list_nos, n);
+    if (prefetch_mode == PREFETCH_THREADS) {
+        pf->prefetch_lists(list_nos, n);
+        return;
+    }
+    // advise the lists in the order of the file so that the reads are
+    // as sequential as possible
+    std::vector<idx_t> lnos;
+    for (int i = 0; i < n; i++) {
+        if (list_nos[i] >= 0) {
+            lnos.push_back(list_nos[i]);
+        }
+    }
+    std::sort(lnos.begin(), lnos.end(), [&](idx_t a, idx_t b) {
+        return lists[a].offset < lists[b].offset;
+    });
+    lnos.erase(std::unique(lnos.begin(), lnos.end()), lnos.end());
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    auto advise = [&](const void* p, size_t nbytes) {
+        uintptr_t begin = (uintptr_t)p & ~(page_size - 1);
+        uintptr_t end = (uintptr_t)p + nbytes;
+        // only a hint, so the errors are ignored
+        posix_madvise((void*)begin, end - begin, POSIX_MADV_WILLNEED);
+    };
+    for (idx_t list_no : lnos) {
+        // the lists of a read-only mapping are not moved
+        if (!read_only) {
+            locks->lock_1(list_no);
+        }
+        size_t size = lists[list_no].size;
+        if (size > 0) {
+            advise(get_codes(list_no), size * code_size);
+            advise(get_ids(list_no), size * sizeof(idx_t));
+        }
+        if (!read_only) {
+            locks->unlock_1(list_no);
+        }
+    }
 }
 
 /**********************************************
@@ -649,12 +688,181 @@ size_t OnDiskInvertedLists::merge_from_multiple(
     return ntotal;
 }
 
+size_t OnDiskInvertedLists::merge_from_multiple_streaming(
+        const InvertedLists** ils,
+        int n_il,
+        bool shift_ids,
+        size_t buffer_size,
+        bool verbose) {
+    FAISS_THROW_IF_NOT_MSG(
+            totsize == 0, "works only on an empty InvertedLists");
+
+    std::vector<size_t> sizes(nlist);
+    std::vector<size_t> shift_id_offsets(n_il);
+    for (int i = 0; i < n_il; i++) {
+        const InvertedLists* il = ils[i];
+        FAISS_THROW_IF_NOT(il->nlist == nlist && il->code_size == code_size);
+
+        for (size_t j = 0; j < nlist; j++) {
+            sizes[j] += il->list_size(j);
+        }
+
+        size_t il_totsize = il->compute_ntotal();
+        shift_id_offsets[i] =
+                (shift_ids && i > 0) ? shift_id_offsets[i - 1] + il_totsize : 0;
+    }
+
+    size_t cums = 0;
+    size_t ntotal = 0;
+    for (size_t j = 0; j < nlist; j++) {
+        ntotal += sizes[j];
+        lists[j].size = sizes[j];
+        lists[j].capacity = sizes[j];
+        lists[j].offset = cums;
+        cums += lists[j].capacity * (sizeof(idx_t) + code_size);
+    }
+
+    update_totsize(cums);
+
+    int fd = open(filename.c_str(), O_WRONLY);
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0,
+            "could not open %s for writing: %s",
+            filename.c_str(),
+            strerror(errno));
+
+    std::vector<uint8_t> buffer;
+    double t0 = getmillisecs();
+    size_t j0 = 0;
+    while (j0 < nlist) {
+        // the block has at least one list
+        size_t j1 = j0 + 1;
+        while (j1 < nlist &&
+               lists[j1].offset + sizes[j1] * (sizeof(idx_t) + code_size) -
+                               lists[j0].offset <=
+                       buffer_size) {
+            j1++;
+        }
+        size_t block_offset = lists[j0].offset;
+        size_t block_size = (j1 < nlist ? lists[j1].offset : cums) -
+                block_offset;
+        buffer.resize(block_size);
+
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t j = j0; j < j1; j++) {
+            const List& l = lists[j];
+            uint8_t* codes = buffer.data() + (l.offset - block_offset);
+            idx_t* ids = (idx_t*)(codes + l.capacity * code_size);
+            for (int i = 0; i < n_il; i++) {
+                const InvertedLists* il = ils[i];
+                size_t n_entry = il->list_size(j);
+                if (n_entry == 0) {
+                    continue;
+                }
+                ScopedCodes sc(il, j);
+                memcpy(codes, sc.get(), n_entry * code_size);
+                ScopedIds si(il, j);
+                for (size_t k = 0; k < n_entry; k++) {
+                    ids[k] = si[k] + shift_id_offsets[i];
+                }
+                codes += n_entry * code_size;
+                ids += n_entry;
+            }
+        }
+
+        size_t written = 0;
+        while (written < block_size) {
+            ssize_t ret = pwrite(
+                    fd,
+                    buffer.data() + written,
+                    block_size - written,
+                    block_offset + written);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                int err = errno;
+                close(fd);
+                FAISS_THROW_FMT(
+                        "write error in %s: %s",
+                        filename.c_str(),
+                        strerror(err));
+            }
+            written += ret;
+        }
+        if (verbose) {
+            printf("merged %zd lists in %.3f s\r",
+                   j1,
+                   (getmillisecs() - t0) / 1000.0);
+            fflush(stdout);
+        }
+        j0 = j1;
+    }
+    if (verbose) {
+        printf("\n");
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            close(fd) == 0,
+            "close error in %s: %s",
+            filename.c_str(),
+            strerror(errno));
+
+    return ntotal;
+}
+
 size_t OnDiskInvertedLists::merge_from_1(
         const InvertedLists* ils,
         bool verbose) {
     return merge_from_multiple(&ils, 1, verbose);
 }
 
+size_t OnDiskInvertedLists::merge_from_1_ordered(
+        const InvertedLists* il,
+        const idx_t* list_order,
+        size_t n_order) {
+    FAISS_THROW_IF_NOT_MSG(
+            totsize == 0, "works only on an empty InvertedLists");
+    FAISS_THROW_IF_NOT(il->nlist == nlist && il->code_size == code_size);
+
+    for (size_t j = 0; j < nlist; j++) {
+        lists[j] = List();
+    }
+    size_t cums = 0;
+    size_t ntotal = 0;
+    for (size_t i = 0; i < n_order; i++) {
+        idx_t j = list_order[i];
+        FAISS_THROW_IF_NOT(j >= 0 && j < nlist);
+        FAISS_THROW_IF_NOT_FMT(
+                lists[j].capacity == 0, "list %zd appears twice", size_t(j));
+        size_t size = il->list_size(j);
+        ntotal += size;
+        lists[j].size = size;
+        lists[j].capacity = size;
+        lists[j].offset = cums;
+        cums += size * (sizeof(idx_t) + code_size);
+    }
+    if (cums == 0) {
+        return 0;
+    }
+
+    update_totsize(cums);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < n_order; i++) {
+        idx_t j = list_order[i];
+        size_t n_entry = lists[j].size;
+        if (n_entry > 0) {
+            update_entries(
+                    j,
+                    0,
+                    n_entry,
+                    ScopedIds(il, j).get(),
+                    ScopedCodes(il, j).get());
+        }
+    }
+    return ntotal;
+}
+
 void OnDiskInvertedLists::crop_invlists(size_t l0, size_t l1) {
     FAISS_THROW_IF_NOT(0 <= l0 && l0 <= l1 && l1 <= nlist);
 
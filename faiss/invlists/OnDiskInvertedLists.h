@@ -55,7 +55,8 @@ struct OnDiskOneList {
  *
  * When it is known that a set of lists will be accessed, it is useful
  * to call prefetch_lists, that launches a set of threads to read the
- * lists in parallel.
+ * lists in parallel, or asks the kernel to read them asynchronously
+ * (prefetch_mode).
  */
 struct OnDiskInvertedLists : InvertedLists {
     using List = OnDiskOneList;
@@ -107,14 +108,43 @@ struct OnDiskInvertedLists : InvertedLists {
             bool shift_ids = false,
             bool verbose = false);
 
+    /** same as merge_from_multiple, but the file is written sequentially by
+     * blocks of consecutive lists of about buffer_size bytes. Each block is
+     * filled in parallel over the lists, then written at once, so the
+     * memory usage is bounded and the disk sees large sequential writes. */
+    size_t merge_from_multiple_streaming(
+            const InvertedLists** ils,
+            int n_il,
+            bool shift_ids = false,
+            size_t buffer_size = size_t(1) << 28,
+            bool verbose = false);
+
     /// same as merge_from for a single invlist
     size_t merge_from_1(const InvertedLists* il, bool verbose = false);
 
+    /** copy the lists list_order[0:n_order] of il into *this, stored
+     * contiguously in that order (eg. by decreasing access frequency, so
+     * that the frequently scanned lists share the pages of the file). The
+     * other lists are left empty. */
+    size_t merge_from_1_ordered(
+            const InvertedLists* il,
+            const idx_t* list_order,
+            size_t n_order);
+
     /// restrict the inverted lists to l0:l1 without touching the mmapped region
     void crop_invlists(size_t l0, size_t l1);
 
     void prefetch_lists(const idx_t* list_nos, int nlist) const override;
 
+    enum PrefetchMode {
+        /// prefetch_nthread threads read the lists
+        PREFETCH_THREADS = 0,
+        /// the pages of the lists are advised with POSIX_MADV_WILLNEED, the
+        /// kernel reads them asynchronously without blocking any thread
+        PREFETCH_MADVISE = 1,
+    };
+    PrefetchMode prefetch_mode = PREFETCH_THREADS;
+
     ~OnDiskInvertedLists() override;
 
     // private
@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/invlists/RangeInvertedLists.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <typeinfo>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io_macros.h>
+
+namespace faiss {
+
+/**********************************************************
+ * RangeReader
+ **********************************************************/
+
+void RangeReader::read_ranges(
+        size_t n,
+        const size_t* offsets,
+        const size_t* nbytes,
+        void* const* dests) const {
+    std::string error;
+#pragma omp parallel for schedule(dynamic) if (n > 1)
+    for (int64_t i = 0; i < n; i++) {
+        try {
+            read(offsets[i], nbytes[i], dests[i]);
+        } catch (const std::exception& e) {
+#pragma omp critical(range_reader_error)
+            error = e.what();
+        }
+    }
+    FAISS_THROW_IF_NOT_FMT(error.empty(), "%s", error.c_str());
+}
+
+void RangeReader::prefetch(size_t, const size_t*, const size_t*) const {}
+
+namespace {
+
+void pread_all(int fd, size_t offset, size_t nbytes, void* dest) {
+    size_t done = 0;
+    while (done < nbytes) {
+        ssize_t ret =
+                pread(fd, (char*)dest + done, nbytes - done, offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT_FMT(
+                ret > 0,
+                "pread of %zd bytes at %zd failed: %s",
+                nbytes - done,
+                offset + done,
+                ret == 0 ? "EOF" : strerror(errno));
+        done += ret;
+    }
+}
+
+void pwrite_all(int fd, size_t offset, size_t nbytes, const void* src) {
+    size_t done = 0;
+    while (done < nbytes) {
+        ssize_t ret = pwrite(
+                fd, (const char*)src + done, nbytes - done, offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT_FMT(
+                ret > 0, "pwrite to the cache failed: %s", strerror(errno));
+        done += ret;
+    }
+}
+
+} // namespace
+
+FileRangeReader::FileRangeReader(const char* fname) : filename(fname) {
+    fd = open(fname, O_RDONLY);
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0, "could not open %s: %s", fname, strerror(errno));
+    struct stat st;
+    FAISS_THROW_IF_NOT(fstat(fd, &st) == 0);
+    file_size = st.st_size;
+}
+
+size_t FileRangeReader::size() const {
+    return file_size;
+}
+
+void FileRangeReader::read(size_t offset, size_t nbytes, void* dest) const {
+    FAISS_THROW_IF_NOT(offset + nbytes <= file_size);
+    pread_all(fd, offset, nbytes, dest);
+}
+
+FileRangeReader::~FileRangeReader() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**********************************************************
+ * CachedRangeReader
+ **********************************************************/
+
+CachedRangeReader::CachedRangeReader(
+        std::shared_ptr<RangeReader> source,
+        const char* cache_filename,
+        size_t block_size,
+        size_t readahead_blocks)
+        : source(source),
+          cache_filename(cache_filename),
+          block_size(block_size),
+          readahead_blocks(readahead_blocks) {
+    FAISS_THROW_IF_NOT(source && block_size > 0);
+    fd = open(cache_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0,
+            "could not open cache file %s: %s",
+            cache_filename,
+            strerror(errno));
+    FAISS_THROW_IF_NOT_FMT(
+            ftruncate(fd, source->size()) == 0,
+            "could not resize cache file %s: %s",
+            cache_filename,
+            strerror(errno));
+    nblocks = (source->size() + block_size - 1) / block_size;
+    cached.reset(new std::atomic<uint8_t>[nblocks]);
+    for (size_t b = 0; b < nblocks; b++) {
+        cached[b] = 0;
+    }
+}
+
+size_t CachedRangeReader::size() const {
+    return source->size();
+}
+
+void CachedRangeReader::fetch_blocks(size_t b0, size_t b1, size_t readahead)
+        const {
+    size_t b_end = std::min(b1 + readahead, nblocks);
+    std::vector<uint8_t> buf;
+    size_t b = b0;
+    while (b < b_end) {
+        if (cached[b].load(std::memory_order_acquire)) {
+            if (b >= b1) {
+                break; // the readahead stops at the first cached block
+            }
+            b++;
+            continue;
+        }
+        size_t r0 = b;
+        while (b < b_end && !cached[b].load(std::memory_order_acquire)) {
+            b++;
+        }
+        size_t offset = r0 * block_size;
+        size_t nbytes = std::min(b * block_size, size()) - offset;
+        buf.resize(nbytes);
+        source->read(offset, nbytes, buf.data());
+        pwrite_all(fd, offset, nbytes, buf.data());
+        for (size_t i = r0; i < b; i++) {
+            cached[i].store(1, std::memory_order_release);
+        }
+        n_fetched_blocks += b - r0;
+        n_fetched_bytes += nbytes;
+    }
+}
+
+void CachedRangeReader::read(size_t offset, size_t nbytes, void* dest) const {
+    if (nbytes == 0) {
+        return;
+    }
+    FAISS_THROW_IF_NOT(offset + nbytes <= size());
+    fetch_blocks(
+            offset / block_size,
+            (offset + nbytes - 1) / block_size + 1,
+            readahead_blocks);
+    pread_all(fd, offset, nbytes, dest);
+}
+
+void CachedRangeReader::prefetch(
+        size_t n,
+        const size_t* offsets,
+        const size_t* nbytes) const {
+    std::string error;
+#pragma omp parallel for schedule(dynamic) if (n > 1)
+    for (int64_t i = 0; i < n; i++) {
+        if (nbytes[i] == 0) {
+            continue;
+        }
+        try {
+            fetch_blocks(
+                    offsets[i] / block_size,
+                    (offsets[i] + nbytes[i] - 1) / block_size + 1,
+                    0);
+        } catch (const std::exception& e) {
+#pragma omp critical(range_reader_error)
+            error = e.what();
+        }
+    }
+    FAISS_THROW_IF_NOT_FMT(error.empty(), "%s", error.c_str());
+}
+
+size_t CachedRangeReader::n_cached_blocks() const {
+    size_t n = 0;
+    for (size_t b = 0; b < nblocks; b++) {
+        n += cached[b].load();
+    }
+    return n;
+}
+
+CachedRangeReader::~CachedRangeReader() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**********************************************************
+ * RangeIOReader
+ **********************************************************/
+
+RangeIOReader::RangeIOReader(
+        std::shared_ptr<RangeReader> reader,
+        size_t buffer_size)
+        : reader(reader), buffer_size(buffer_size) {
+    name = "RangeIOReader";
+}
+
+size_t RangeIOReader::operator()(void* ptr, size_t size, size_t nitems) {
+    if (size == 0 || nitems == 0) {
+        return 0;
+    }
+    size_t avail = reader->size() - std::min(pos, reader->size());
+    nitems = std::min(nitems, avail / size);
+    size_t nbytes = size * nitems;
+    uint8_t* dest = (uint8_t*)ptr;
+    while (nbytes > 0) {
+        if (pos >= buffer_offset && pos < buffer_offset + buffer.size()) {
+            size_t n = std::min(nbytes, buffer_offset + buffer.size() - pos);
+            memcpy(dest, buffer.data() + (pos - buffer_offset), n);
+            dest += n;
+            pos += n;
+            nbytes -= n;
+        } else if (nbytes >= buffer_size) {
+            reader->read(pos, nbytes, dest);
+            pos += nbytes;
+            nbytes = 0;
+        } else {
+            buffer.resize(std::min(buffer_size, reader->size() - pos));
+            buffer_offset = pos;
+            reader->read(pos, buffer.size(), buffer.data());
+        }
+    }
+    return nitems;
+}
+
+void RangeIOReader::read_batch(
+        size_t n,
+        void* const* ptrs,
+        const size_t* nbytes) {
+    std::vector<size_t> offsets, sizes;
+    std::vector<void*> dests;
+    size_t offset = pos;
+    for (size_t i = 0; i < n; i++) {
+        offsets.push_back(offset);
+        sizes.push_back(nbytes[i]);
+        dests.push_back(ptrs[i]);
+        offset += nbytes[i];
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            offset <= reader->size(),
+            "read_batch past the end of the object (%zd > %zd)",
+            offset,
+            reader->size());
+    reader->read_ranges(n, offsets.data(), sizes.data(), dests.data());
+    pos = offset;
+}
+
+void RangeIOReader::skip(size_t nbytes) {
+    pos += nbytes;
+}
+
+/**********************************************************
+ * RangeInvertedLists
+ **********************************************************/
+
+RangeInvertedLists::RangeInvertedLists(
+        std::shared_ptr<RangeReader> reader,
+        size_t nlist,
+        size_t code_size,
+        const std::vector<size_t>& sizes,
+        size_t offset0)
+        : ReadOnlyInvertedLists(nlist, code_size),
+          reader(reader),
+          sizes(sizes),
+          offsets(nlist) {
+    FAISS_THROW_IF_NOT(sizes.size() == nlist);
+    size_t o = offset0;
+    for (size_t i = 0; i < nlist; i++) {
+        offsets[i] = o;
+        o += sizes[i] * (code_size + sizeof(idx_t));
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            o <= reader->size(),
+            "the inverted lists end after the object (%zd > %zd)",
+            o,
+            reader->size());
+}
+
+size_t RangeInvertedLists::list_size(size_t list_no) const {
+    return sizes[list_no];
+}
+
+const uint8_t* RangeInvertedLists::get_codes(size_t list_no) const {
+    size_t nbytes = sizes[list_no] * code_size;
+    uint8_t* codes = new uint8_t[nbytes];
+    try {
+        reader->read(offsets[list_no], nbytes, codes);
+    } catch (...) {
+        delete[] codes;
+        throw;
+    }
+    return codes;
+}
+
+const idx_t* RangeInvertedLists::get_ids(size_t list_no) const {
+    size_t n = sizes[list_no];
+    idx_t* ids = new idx_t[n];
+    try {
+        reader->read(offsets[list_no] + n * code_size, n * sizeof(idx_t), ids);
+    } catch (...) {
+        delete[] ids;
+        throw;
+    }
+    return ids;
+}
+
+void RangeInvertedLists::release_codes(size_t, const uint8_t* codes) const {
+    delete[] codes;
+}
+
+void RangeInvertedLists::release_ids(size_t, const idx_t* ids) const {
+    delete[] ids;
+}
+
+void RangeInvertedLists::prefetch_lists(const idx_t* list_nos, int n) const {
+    std::vector<size_t> offs, nbytes;
+    for (int i = 0; i < n; i++) {
+        idx_t l = list_nos[i];
+        if (l >= 0 && sizes[l] > 0) {
+            offs.push_back(offsets[l]);
+            nbytes.push_back(sizes[l] * (code_size + sizeof(idx_t)));
+        }
+    }
+    reader->prefetch(offs.size(), offs.data(), nbytes.data());
+}
+
+/**********************************************************
+ * RangeInvertedListsIOHook
+ **********************************************************/
+
+RangeInvertedListsIOHook::RangeInvertedListsIOHook()
+        : InvertedListsIOHook("ilrg", typeid(RangeInvertedLists).name()) {}
+
+void RangeInvertedListsIOHook::write(const InvertedLists* ils, IOWriter* f)
+        const {
+    uint32_t h = fourcc("ilar");
+    WRITE1(h);
+    WRITE1(ils->nlist);
+    WRITE1(ils->code_size);
+    uint32_t list_type = fourcc("full");
+    WRITE1(list_type);
+    std::vector<size_t> sizes(ils->nlist);
+    for (size_t i = 0; i < ils->nlist; i++) {
+        sizes[i] = ils->list_size(i);
+    }
+    WRITEVECTOR(sizes);
+    for (size_t i = 0; i < ils->nlist; i++) {
+        if (sizes[i] > 0) {
+            InvertedLists::ScopedCodes codes(ils, i);
+            InvertedLists::ScopedIds ids(ils, i);
+            WRITEANDCHECK(codes.get(), sizes[i] * ils->code_size);
+            WRITEANDCHECK(ids.get(), sizes[i]);
+        }
+    }
+}
+
+InvertedLists* RangeInvertedListsIOHook::read(IOReader*, int) const {
+    FAISS_THROW_MSG(
+            "RangeInvertedLists are stored as ArrayInvertedLists, "
+            "read them with IO_FLAG_RANGE_READ");
+}
+
+InvertedLists* RangeInvertedListsIOHook::read_ArrayInvertedLists(
+        IOReader* f,
+        int /* io_flags */,
+        size_t nlist,
+        size_t code_size,
+        const std::vector<size_t>& sizes) const {
+    RangeIOReader* reader = dynamic_cast<RangeIOReader*>(f);
+    FAISS_THROW_IF_NOT_MSG(
+            reader, "IO_FLAG_RANGE_READ requires a RangeIOReader");
+    auto ils = new RangeInvertedLists(
+            reader->reader, nlist, code_size, sizes, reader->tell());
+    size_t total = 0;
+    for (size_t s : sizes) {
+        total += s * (code_size + sizeof(idx_t));
+    }
+    reader->skip(total);
+    return ils;
+}
+
+} // namespace faiss
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/invlists/InvertedListsIOHook.h>
+
+/***********************************************************
+ * Lazy loading of index files from a byte range source
+ *
+ * Index snapshots kept in an object store (eg. S3-compatible storage) can
+ * be opened without downloading them first:
+ *
+ *   auto src = std::make_shared<MyObjectRangeReader>(...);
+ *   auto cached = std::make_shared<CachedRangeReader>(src, "/ssd/cache");
+ *   RangeIOReader reader(cached);
+ *   Index* index = read_index(&reader, IO_FLAG_RANGE_READ);
+ *
+ * The metadata and the coarse quantizer are read eagerly by read_index.
+ * The inverted lists of an ArrayInvertedLists are not read: they are
+ * replaced by a RangeInvertedLists that fetches each list when it is
+ * scanned.
+ ***********************************************************/
+
+namespace faiss {
+
+/** Source of byte ranges, eg. an object in an object store. Implementations
+ * for a given store issue one range GET per read. All methods may be
+ * called concurrently. */
+struct RangeReader {
+    /// total size of the object in bytes
+    virtual size_t size() const = 0;
+
+    /// read nbytes at offset into dest, throws on error or short read
+    virtual void read(size_t offset, size_t nbytes, void* dest) const = 0;
+
+    /** read n ranges. The default implementation issues the reads in
+     * parallel from several threads. */
+    virtual void read_ranges(
+            size_t n,
+            const size_t* offsets,
+            const size_t* nbytes,
+            void* const* dests) const;
+
+    /// the ranges will be read soon (default does nothing)
+    virtual void prefetch(
+            size_t n,
+            const size_t* offsets,
+            const size_t* nbytes) const;
+
+    virtual ~RangeReader() {}
+};
+
+/// RangeReader of a local file, with pread
+struct FileRangeReader : RangeReader {
+    std::string filename;
+
+    explicit FileRangeReader(const char* fname);
+
+    size_t size() const override;
+    void read(size_t offset, size_t nbytes, void* dest) const override;
+
+    ~FileRangeReader() override;
+
+   private:
+    int fd = -1;
+    size_t file_size = 0;
+};
+
+/** Caches the blocks of a RangeReader in a local file (eg. on SSD).
+ *
+ * The cache file is a sparse file of the size of the object, where each
+ * block is written once it was fetched, so that the object is fetched at
+ * most once. The missing blocks of a read are fetched from the source in
+ * runs of contiguous blocks, extended by up to readahead_blocks blocks that
+ * follow the range. prefetch fetches the missing blocks of the ranges in
+ * parallel.
+ */
+struct CachedRangeReader : RangeReader {
+    std::shared_ptr<RangeReader> source;
+    std::string cache_filename;
+    size_t block_size;
+    size_t readahead_blocks;
+
+    /// statistics
+    mutable std::atomic<size_t> n_fetched_blocks{0};
+    mutable std::atomic<size_t> n_fetched_bytes{0};
+
+    /** @param cache_filename  created or truncated to the size of the
+     *                         source
+     * @param block_size       granularity of the fetches and of the cache */
+    CachedRangeReader(
+            std::shared_ptr<RangeReader> source,
+            const char* cache_filename,
+            size_t block_size = 1 << 20,
+            size_t readahead_blocks = 1);
+
+    size_t size() const override;
+    void read(size_t offset, size_t nbytes, void* dest) const override;
+    void prefetch(size_t n, const size_t* offsets, const size_t* nbytes)
+            const override;
+
+    /// nb of blocks in the cache
+    size_t n_cached_blocks() const;
+
+    ~CachedRangeReader() override;
+
+   private:
+    int fd = -1;
+    /// whether each block is in the cache file
+    std::unique_ptr<std::atomic<uint8_t>[]> cached;
+    size_t nblocks = 0;
+
+    /// fetch the missing blocks of [b0, b1) and readahead blocks after
+    void fetch_blocks(size_t b0, size_t b1, size_t readahead) const;
+};
+
+/** Sequential IOReader over a RangeReader, for read_index. Small reads are
+ * served from a buffer of buffer_size bytes, read_batch reads the buffers
+ * in parallel with RangeReader::read_ranges. */
+struct RangeIOReader : IOReader {
+    std::shared_ptr<RangeReader> reader;
+    size_t buffer_size;
+
+    explicit RangeIOReader(
+            std::shared_ptr<RangeReader> reader,
+            size_t buffer_size = 1 << 20);
+
+    size_t operator()(void* ptr, size_t size, size_t nitems) override;
+
+    void read_batch(size_t n, void* const* ptrs, const size_t* nbytes)
+            override;
+
+    /// position of the next read in the object
+    size_t tell() const {
+        return pos;
+    }
+
+    /// skip nbytes, without reading them
+    void skip(size_t nbytes);
+
+   private:
+    size_t pos = 0;
+    std::vector<uint8_t> buffer;
+    /// object offset of the data in buffer
+    size_t buffer_offset = 0;
+};
+
+/** Inverted lists of an ArrayInvertedLists serialized in an object, read on
+ * demand from a RangeReader: get_codes and get_ids fetch the list.
+ * prefetch_lists passes the ranges of the lists to RangeReader::prefetch,
+ * so that the lists of a query batch are fetched in parallel. */
+struct RangeInvertedLists : ReadOnlyInvertedLists {
+    std::shared_ptr<RangeReader> reader;
+    std::vector<size_t> sizes;
+    /// object offset of the codes of each list, followed by the ids
+    std::vector<size_t> offsets;
+
+    RangeInvertedLists(
+            std::shared_ptr<RangeReader> reader,
+            size_t nlist,
+            size_t code_size,
+            const std::vector<size_t>& sizes,
+            size_t offset0);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+    void release_codes(size_t list_no, const uint8_t* codes) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+    void prefetch_lists(const idx_t* list_nos, int nlist) const override;
+};
+
+/** read_index flag to load the ArrayInvertedLists as RangeInvertedLists.
+ * The IOReader must be a RangeIOReader. */
+const int IO_FLAG_RANGE_READ = IO_FLAG_SKIP_IVF_DATA | 0x67720000;
+
+/** key "ilrg". A RangeInvertedLists is written as an ArrayInvertedLists
+ * (all the lists are fetched). */
+struct RangeInvertedListsIOHook : InvertedListsIOHook {
+    RangeInvertedListsIOHook();
+    void write(const InvertedLists* ils, IOWriter* f) const override;
+    InvertedLists* read(IOReader* f, int io_flags) const override;
+    InvertedLists* read_ArrayInvertedLists(
+            IOReader* f,
+            int io_flags,
+            size_t nlist,
+            size_t code_size,
+            const std::vector<size_t>& sizes) const override;
+};
+
+} // namespace faiss
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/knn_graph.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+/***************************************************************
+ * KnnGraphFileWriter
+ ***************************************************************/
+
+KnnGraphFileWriter::KnnGraphFileWriter(const char* fname, idx_t k) : k(k) {
+    f = fopen(fname, "wb");
+    FAISS_THROW_IF_NOT_FMT(
+            f,
+            "could not open %s for writing: %s",
+            fname,
+            strerror(errno));
+}
+
+void KnnGraphFileWriter::add_results(
+        size_t n,
+        const idx_t* ids,
+        const float* D,
+        const idx_t* I) {
+    for (size_t i = 0; i < n; i++) {
+        bool ok = fwrite(ids + i, sizeof(idx_t), 1, f) == 1 &&
+                fwrite(I + i * k, sizeof(idx_t), k, f) == k &&
+                fwrite(D + i * k, sizeof(float), k, f) == k;
+        FAISS_THROW_IF_NOT_MSG(ok, "write error in KnnGraphFileWriter");
+    }
+}
+
+KnnGraphFileWriter::~KnnGraphFileWriter() {
+    if (f) {
+        fclose(f);
+    }
+}
+
+namespace {
+
+/// stores the results in arrays of size n * k, indexed by id
+struct ArrayHandler : KnnGraphResultHandler {
+    idx_t ntotal, k;
+    float* D;
+    idx_t* I;
+
+    ArrayHandler(idx_t ntotal, idx_t k, float* D, idx_t* I)
+            : ntotal(ntotal), k(k), D(D), I(I) {}
+
+    void add_results(
+            size_t n,
+            const idx_t* ids,
+            const float* Di,
+            const idx_t* Ii) override {
+        for (size_t i = 0; i < n; i++) {
+            idx_t id = ids[i];
+            FAISS_THROW_IF_NOT_FMT(
+                    id >= 0 && id < ntotal,
+                    "id %" PRId64 " out of range, expected 0..%" PRId64,
+                    id,
+                    ntotal - 1);
+            memcpy(D + id * k, Di + i * k, sizeof(float) * k);
+            memcpy(I + id * k, Ii + i * k, sizeof(idx_t) * k);
+        }
+    }
+};
+
+/// access to the vectors of the clusters
+struct ClusterSource {
+    size_t nlist = 0;
+
+    virtual size_t list_size(size_t list_no) const = 0;
+
+    /// copy the vectors (list_size * d) and ids (list_size) of a list
+    virtual void get_list(size_t list_no, float* x, idx_t* ids) const = 0;
+
+    /// copy one vector of a list
+    virtual void get_vector(size_t list_no, size_t offset, float* x)
+            const = 0;
+
+    virtual ~ClusterSource() {}
+};
+
+/// clusters of a flat array of vectors
+struct ArrayClusterSource : ClusterSource {
+    size_t d;
+    const float* x;
+    std::vector<std::vector<idx_t>> lists;
+
+    size_t list_size(size_t list_no) const override {
+        return lists[list_no].size();
+    }
+
+    void get_list(size_t list_no, float* xl, idx_t* ids) const override {
+        const std::vector<idx_t>& list = lists[list_no];
+        for (size_t i = 0; i < list.size(); i++) {
+            memcpy(xl + i * d, x + list[i] * d, sizeof(float) * d);
+        }
+        std::copy(list.begin(), list.end(), ids);
+    }
+
+    void get_vector(size_t list_no, size_t offset, float* xi) const override {
+        memcpy(xi, x + lists[list_no][offset] * d, sizeof(float) * d);
+    }
+};
+
+/// inverted lists of an IndexIVF
+struct IVFClusterSource : ClusterSource {
+    const IndexIVF& index;
+
+    explicit IVFClusterSource(const IndexIVF& index) : index(index) {
+        nlist = index.nlist;
+    }
+
+    size_t list_size(size_t list_no) const override {
+        return index.invlists->list_size(list_no);
+    }
+
+    void get_list(size_t list_no, float* xl, idx_t* ids) const override {
+        size_t ls = list_size(list_no);
+        InvertedLists::ScopedIds list_ids(index.invlists, list_no);
+        for (size_t i = 0; i < ls; i++) {
+            index.reconstruct_from_offset(list_no, i, xl + i * index.d);
+            ids[i] = list_ids[i];
+        }
+    }
+
+    void get_vector(size_t list_no, size_t offset, float* xi) const override {
+        index.reconstruct_from_offset(list_no, offset, xi);
+    }
+};
+
+/** Join the clusters: each vector is compared with the vectors of the
+ * nprobe clusters nearest to it. The join is done list by list on the
+ * database side: the vectors that probe a list are compared with all the
+ * vectors of the list in a single exhaustive search block. */
+void join_clusters(
+        const ClusterSource& src,
+        size_t d,
+        MetricType metric,
+        const Index& quantizer,
+        idx_t k,
+        KnnGraphResultHandler& handler,
+        const KnnGraphParameters& params) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+            "only L2 and inner product are supported");
+    FAISS_THROW_IF_NOT(k > 0);
+    size_t nlist = src.nlist;
+    size_t nprobe = std::min(std::max(params.nprobe, size_t(1)), nlist);
+    double t0 = getmillisecs();
+
+    // the vectors are numbered in list order
+    std::vector<size_t> offsets(nlist + 1);
+    for (size_t l = 0; l < nlist; l++) {
+        offsets[l + 1] = offsets[l] + src.list_size(l);
+    }
+    size_t n = offsets[nlist];
+    if (n == 0) {
+        return;
+    }
+    std::vector<idx_t> ids(n), probes(n * nprobe);
+    std::vector<int32_t> list_of(n);
+    {
+        std::vector<float> xl, dis;
+        for (size_t l = 0; l < nlist; l++) {
+            size_t ls = offsets[l + 1] - offsets[l];
+            if (ls == 0) {
+                continue;
+            }
+            xl.resize(ls * d);
+            dis.resize(ls * nprobe);
+            src.get_list(l, xl.data(), ids.data() + offsets[l]);
+            quantizer.search(
+                    ls,
+                    xl.data(),
+                    nprobe,
+                    dis.data(),
+                    probes.data() + offsets[l] * nprobe);
+            std::fill(
+                    list_of.begin() + offsets[l],
+                    list_of.begin() + offsets[l + 1],
+                    l);
+        }
+    }
+
+    // the vectors that probe each list
+    std::vector<size_t> qoffsets(nlist + 1);
+    for (idx_t p : probes) {
+        if (p >= 0) {
+            qoffsets[p + 1]++;
+        }
+    }
+    for (size_t l = 0; l < nlist; l++) {
+        qoffsets[l + 1] += qoffsets[l];
+    }
+    std::vector<idx_t> qslots(qoffsets[nlist]);
+    {
+        std::vector<size_t> ptr(qoffsets.begin(), qoffsets.end() - 1);
+        for (size_t i = 0; i < n * nprobe; i++) {
+            if (probes[i] >= 0) {
+                qslots[ptr[probes[i]]++] = i / nprobe;
+            }
+        }
+    }
+    probes.clear();
+    probes.shrink_to_fit();
+    if (params.verbose) {
+        printf("  assigned %zd vectors to %zd lists, %.3f s\n",
+               n,
+               nlist,
+               (getmillisecs() - t0) / 1000);
+    }
+
+    // result heaps, in list order
+    bool is_ip = metric == METRIC_INNER_PRODUCT;
+    std::vector<float> D(n * k);
+    std::vector<idx_t> I(n * k);
+    for (size_t i = 0; i < n; i++) {
+        if (is_ip) {
+            minheap_heapify(k, D.data() + i * k, I.data() + i * k);
+        } else {
+            maxheap_heapify(k, D.data() + i * k, I.data() + i * k);
+        }
+    }
+
+    std::vector<float> xb, xq, Dt;
+    std::vector<idx_t> It, idb;
+    for (size_t l = 0; l < nlist; l++) {
+        size_t nb = offsets[l + 1] - offsets[l];
+        size_t nq = qoffsets[l + 1] - qoffsets[l];
+        if (nb == 0 || nq == 0) {
+            continue;
+        }
+        xb.resize(nb * d);
+        idb.resize(nb);
+        src.get_list(l, xb.data(), idb.data());
+        const idx_t* slots = qslots.data() + qoffsets[l];
+        xq.resize(nq * d);
+        for (size_t i = 0; i < nq; i++) {
+            size_t slot = slots[i];
+            size_t ql = list_of[slot];
+            src.get_vector(ql, slot - offsets[ql], xq.data() + i * d);
+        }
+
+        // one more result to drop the vector itself
+        size_t k1 = std::min(size_t(k) + 1, nb);
+        Dt.resize(nq * k1);
+        It.resize(nq * k1);
+        if (is_ip) {
+            knn_inner_product(
+                    xq.data(), xb.data(), d, nq, nb, k1, Dt.data(), It.data());
+        } else {
+            knn_L2sqr(
+                    xq.data(), xb.data(), d, nq, nb, k1, Dt.data(), It.data());
+        }
+
+#pragma omp parallel for if (nq > 1000)
+        for (int64_t i = 0; i < int64_t(nq); i++) {
+            size_t slot = slots[i];
+            float* Di = D.data() + slot * k;
+            idx_t* Ii = I.data() + slot * k;
+            for (size_t j = 0; j < k1; j++) {
+                idx_t pos = It[i * k1 + j];
+                if (pos < 0 || idb[pos] == ids[slot]) {
+                    continue;
+                }
+                float dis = Dt[i * k1 + j];
+                if (is_ip && dis > Di[0]) {
+                    minheap_replace_top(k, Di, Ii, dis, idb[pos]);
+                } else if (!is_ip && dis < Di[0]) {
+                    maxheap_replace_top(k, Di, Ii, dis, idb[pos]);
+                }
+            }
+        }
+        if (params.verbose && (l % 100 == 0 || l == nlist - 1)) {
+            printf("\r  joined %zd/%zd lists, %.3f s",
+                   l + 1,
+                   nlist,
+                   (getmillisecs() - t0) / 1000);
+            fflush(stdout);
+        }
+    }
+    if (params.verbose) {
+        printf("\n");
+    }
+
+    for (size_t l = 0; l < nlist; l++) {
+        size_t i0 = offsets[l], i1 = offsets[l + 1];
+        if (i0 == i1) {
+            continue;
+        }
+        for (size_t i = i0; i < i1; i++) {
+            if (is_ip) {
+                minheap_reorder(k, D.data() + i * k, I.data() + i * k);
+            } else {
+                maxheap_reorder(k, D.data() + i * k, I.data() + i * k);
+            }
+        }
+        handler.add_results(
+                i1 - i0, ids.data() + i0, D.data() + i0 * k, I.data() + i0 * k);
+    }
+}
+
+} // namespace
+
+/***************************************************************
+ * build_knn_graph
+ ***************************************************************/
+
+void build_knn_graph(
+        idx_t n,
+        const float* x,
+        idx_t d,
+        MetricType metric,
+        idx_t k,
+        KnnGraphResultHandler& handler,
+        const KnnGraphParameters* params) {
+    KnnGraphParameters default_params;
+    if (!params) {
+        params = &default_params;
+    }
+    FAISS_THROW_IF_NOT(n > 0);
+    size_t nlist = params->nlist;
+    if (nlist == 0) {
+        nlist = size_t(4 * std::sqrt(double(n)));
+    }
+    nlist = std::max(std::min(nlist, size_t(n)), size_t(1));
+
+    ArrayClusterSource src;
+    src.d = d;
+    src.x = x;
+    IndexFlatL2 quantizer(d);
+    if (nlist <= std::max(params->nprobe, size_t(1))) {
+        // the graph is exact anyways
+        std::vector<float> centroid(d);
+        quantizer.add(1, centroid.data());
+        src.nlist = 1;
+        src.lists.resize(1);
+        for (idx_t i = 0; i < n; i++) {
+            src.lists[0].push_back(i);
+        }
+    } else {
+        ClusteringParameters cp;
+        cp.max_points_per_centroid = params->max_points_per_centroid;
+        cp.verbose = params->verbose;
+        Clustering clus(d, nlist, cp);
+        clus.train(n, x, quantizer);
+        std::vector<idx_t> assign(n);
+        quantizer.assign(n, x, assign.data());
+        src.nlist = nlist;
+        src.lists.resize(nlist);
+        for (idx_t i = 0; i < n; i++) {
+            src.lists[assign[i]].push_back(i);
+        }
+    }
+    join_clusters(src, d, metric, quantizer, k, handler, *params);
+}
+
+void build_knn_graph(
+        idx_t n,
+        const float* x,
+        idx_t d,
+        MetricType metric,
+        idx_t k,
+        float* D,
+        idx_t* I,
+        const KnnGraphParameters* params) {
+    ArrayHandler handler(n, k, D, I);
+    build_knn_graph(n, x, d, metric, k, handler, params);
+}
+
+void build_knn_graph(
+        const IndexIVF& index,
+        idx_t k,
+        KnnGraphResultHandler& handler,
+        const KnnGraphParameters* params) {
+    KnnGraphParameters default_params;
+    if (!params) {
+        params = &default_params;
+    }
+    FAISS_THROW_IF_NOT(index.is_trained);
+    IVFClusterSource src(index);
+    join_clusters(
+            src,
+            index.d,
+            index.metric_type,
+            *index.quantizer,
+            k,
+            handler,
+            *params);
+}
+
+void build_knn_graph(
+        const Index& index,
+        idx_t k,
+        float* D,
+        idx_t* I,
+        const KnnGraphParameters* params) {
+    ArrayHandler handler(index.ntotal, k, D, I);
+    if (auto ivf = dynamic_cast<const IndexIVF*>(&index)) {
+        build_knn_graph(*ivf, k, handler, params);
+        return;
+    }
+    std::vector<float> x(index.ntotal * index.d);
+    index.reconstruct_n(0, index.ntotal, x.data());
+    build_knn_graph(
+            index.ntotal,
+            x.data(),
+            index.d,
+            index.metric_type,
+            k,
+            handler,
+            params);
+}
+
+} // namespace faiss
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdio>
+
+#include <faiss/Index.h>
+
+/** Construction of the approximate k-nearest neighbor graph of a whole
+ * dataset, eg. as input of IndexNSG::build or for deduplication.
+ *
+ * The vectors are partitioned into clusters (the inverted lists of an
+ * IndexIVF) and each vector is compared with the vectors of the nprobe
+ * clusters nearest to it, as in an IVF search of the dataset itself. The
+ * comparisons are blocked by list: the vectors that probe a list are
+ * compared with the vectors of the list in a single exhaustive search (a
+ * GEMM for large lists). With nprobe >= nlist, the graph is exact.
+ *
+ * The neighbors of all vectors (n * k distances and ids) are kept in memory
+ * until the join is done, then passed to a KnnGraphResultHandler.
+ */
+
+namespace faiss {
+
+struct IndexIVF;
+
+struct KnnGraphParameters {
+    /// nb of clusters when the vectors are clustered, 0 = 4 * sqrt(n)
+    size_t nlist = 0;
+
+    /// nb of clusters each vector is compared with
+    size_t nprobe = 8;
+
+    /// training set size per centroid of the k-means
+    int max_points_per_centroid = 256;
+
+    bool verbose = false;
+};
+
+/** Receives the neighbors of the vectors, in an arbitrary order, one
+ * cluster at a time. */
+struct KnnGraphResultHandler {
+    /** @param n      nb of vectors
+     * @param ids     their ids, size n
+     * @param D       distances to their neighbors, size n * k
+     * @param I       ids of their neighbors, size n * k, padded with -1
+     */
+    virtual void add_results(
+            size_t n,
+            const idx_t* ids,
+            const float* D,
+            const idx_t* I) = 0;
+
+    virtual ~KnnGraphResultHandler() {}
+};
+
+/** Streams the graph to a file. For each vector, a record of the id
+ * (int64), its k neighbors (k * int64) and their distances (k * float32)
+ * is appended, in the order the handler receives them. */
+struct KnnGraphFileWriter : KnnGraphResultHandler {
+    idx_t k;
+    FILE* f = nullptr;
+
+    KnnGraphFileWriter(const char* fname, idx_t k);
+
+    void add_results(
+            size_t n,
+            const idx_t* ids,
+            const float* D,
+            const idx_t* I) override;
+
+    ~KnnGraphFileWriter() override;
+};
+
+/** Build the kNN graph of n vectors. The vectors are clustered with
+ * k-means. A vector is not its own neighbor.
+ *
+ * @param metric     METRIC_L2 or METRIC_INNER_PRODUCT
+ * @param handler    receives the neighbors, the ids are 0..n-1
+ */
+void build_knn_graph(
+        idx_t n,
+        const float* x,
+        idx_t d,
+        MetricType metric,
+        idx_t k,
+        KnnGraphResultHandler& handler,
+        const KnnGraphParameters* params = nullptr);
+
+/// same, the results are stored in D and I of size n * k
+void build_knn_graph(
+        idx_t n,
+        const float* x,
+        idx_t d,
+        MetricType metric,
+        idx_t k,
+        float* D,
+        idx_t* I,
+        const KnnGraphParameters* params = nullptr);
+
+/** Build the kNN graph of the vectors stored in an IndexIVF. Its inverted
+ * lists are the clusters (params->nlist is ignored), the vectors are
+ * reconstructed with reconstruct_from_offset and the ids are the ids
+ * stored in the lists. The distances are computed between the
+ * reconstructed vectors, in the metric of the index.
+ */
+void build_knn_graph(
+        const IndexIVF& index,
+        idx_t k,
+        KnnGraphResultHandler& handler,
+        const KnnGraphParameters* params = nullptr);
+
+/** Build the kNN graph of the vectors of an index. An IndexIVF is joined
+ * list by list as above, the vectors of other indexes are reconstructed
+ * and clustered. The ids must be 0..ntotal-1, the results are stored in D
+ * and I of size ntotal * k. */
+void build_knn_graph(
+        const Index& index,
+        idx_t k,
+        float* D,
+        idx_t* I,
+        const KnnGraphParameters* params = nullptr);
+
+} // namespace faiss
@@ -46,6 +46,7 @@ class_wrappers.handle_IDSelectorSubset(IDSelectorBatch, class_owns=True)
 class_wrappers.handle_IDSelectorSubset(IDSelectorArray, class_owns=False)
 class_wrappers.handle_IDSelectorSubset(IDSelectorBitmap, class_owns=False, force_int64=False)
 class_wrappers.handle_CodeSet(CodeSet)
+class_wrappers.handle_SearchIterator(SearchIterator)
 
 class_wrappers.handle_Tensor2D(Tensor2D)
 class_wrappers.handle_Tensor2D(Int32Tensor2D)
@@ -167,6 +168,7 @@ def add_ref_in_function(function_name, parameter_no):
 try:
     add_ref_in_constructor(GpuIndexIVFFlat, 1)
     add_ref_in_constructor(GpuIndexBinaryFlat, 1)
+    add_ref_in_constructor(GpuIndexBinaryIVF, 1)
     add_ref_in_constructor(GpuIndexFlat, 1)
     add_ref_in_constructor(GpuIndexIVFPQ, 1)
     add_ref_in_constructor(GpuIndexIVFScalarQuantizer, 1)
@@ -185,6 +187,7 @@ add_ref_in_constructor(IndexIVFLocalSearchQuantizer, 0)
 add_ref_in_constructor(IndexIVFResidualQuantizerFastScan, 0)
 add_ref_in_constructor(IndexIVFLocalSearchQuantizerFastScan, 0)
 add_ref_in_constructor(IndexIVFSpectralHash, 0)
+add_ref_in_constructor(IndexIVFIDOnly, 0)
 add_ref_in_method_explicit_own(IndexIVFSpectralHash, "replace_vt")
 
 add_ref_in_constructor(Index2Layer, 0)
@@ -195,10 +198,13 @@ add_ref_in_constructor(IndexRowwiseMinMaxFP16, 0)
 add_ref_in_constructor(IndexIDMap, 0)
 add_ref_in_constructor(IndexIDMap2, 0)
 add_ref_in_constructor(IndexHNSW, 0)
+add_ref_in_constructor(IndexBatching, 0)
+add_ref_in_constructor(IndexIVFRecompute, 0)
 add_ref_in_method(IndexShards, 'add_shard', 0)
 add_ref_in_method(IndexBinaryShards, 'add_shard', 0)
 add_ref_in_constructor(IndexRefineFlat, {2: [0], 1: [0]})
 add_ref_in_constructor(IndexRefine, {2: [0, 1]})
+add_ref_in_constructor(IndexPrefixRefine, {2: [0, 1]})
 
 add_ref_in_constructor(IndexBinaryIVF, 0)
 add_ref_in_constructor(IndexBinaryFromFloat, 0)
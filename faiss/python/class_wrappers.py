@@ -43,6 +43,23 @@ def _check_dtype_uint8(codes):
     return np.ascontiguousarray(codes)
 
 
+# Output arrays provided by the caller are filled in place by the C++ code,
+# that runs without the GIL, so they are never converted: a wrong dtype or
+# layout is an error rather than a silent copy.
+
+def _check_output_array(A, shape, dtype, name):
+    if A is None:
+        return np.empty(shape, dtype=dtype)
+    assert A.shape == shape
+    if A.dtype != dtype:
+        raise TypeError("Output argument %s must be ndarray of dtype "
+                        "%s, but found %s" % (name, np.dtype(dtype), A.dtype))
+    if not (A.flags.c_contiguous and A.flags.writeable):
+        raise ValueError("Output argument %s must be a C-contiguous "
+                         "writeable array" % name)
+    return A
+
+
 def replace_method(the_class, name, replacement, ignore_missing=False):
     """ Replaces a method in a class with another version. The old method
     is renamed to method_name_c (because presumably it was implemented in C) """
@@ -274,10 +291,7 @@ def handle_Index(the_class):
         assert d == self.d
         x = np.ascontiguousarray(x, dtype='float32')
 
-        if labels is None:
-            labels = np.empty((n, k), dtype=np.int64)
-        else:
-            assert labels.shape == (n, k)
+        labels = _check_output_array(labels, (n, k), 'int64', 'labels')
 
         self.assign_c(n, swig_ptr(x), swig_ptr(labels), k)
         return labels
@@ -310,9 +324,11 @@ def handle_Index(the_class):
         params : SearchParameters
             Search parameters of the current search (overrides the class-level params)
         D : array_like, optional
-            Distance array to store the result.
+            Distance array to store the result, float32 of shape (n, k),
+            C-contiguous. It is filled in place, without a copy.
         I : array_like, optional
-            Labels array to store the results.
+            Labels array to store the results, int64 of shape (n, k),
+            C-contiguous.
 
         Returns
         -------
@@ -330,15 +346,8 @@ def handle_Index(the_class):
 
         assert k > 0
 
-        if D is None:
-            D = np.empty((n, k), dtype=np.float32)
-        else:
-            assert D.shape == (n, k)
-
-        if I is None:
-            I = np.empty((n, k), dtype=np.int64)
-        else:
-            assert I.shape == (n, k)
+        D = _check_output_array(D, (n, k), 'float32', 'D')
+        I = _check_output_array(I, (n, k), 'int64', 'I')
 
         self.search_c(n, swig_ptr(x), k, swig_ptr(D), swig_ptr(I), params)
         return D, I
@@ -380,20 +389,9 @@ def handle_Index(the_class):
 
         assert k > 0
 
-        if D is None:
-            D = np.empty((n, k), dtype=np.float32)
-        else:
-            assert D.shape == (n, k)
-
-        if I is None:
-            I = np.empty((n, k), dtype=np.int64)
-        else:
-            assert I.shape == (n, k)
-
-        if R is None:
-            R = np.empty((n, k, d), dtype=np.float32)
-        else:
-            assert R.shape == (n, k, d)
+        D = _check_output_array(D, (n, k), 'float32', 'D')
+        I = _check_output_array(I, (n, k), 'int64', 'I')
+        R = _check_output_array(R, (n, k, d), 'float32', 'R')
 
         self.search_and_reconstruct_c(
             n, swig_ptr(x),
@@ -443,24 +441,15 @@ def handle_Index(the_class):
 
         assert k > 0
 
-        if D is None:
-            D = np.empty((n, k), dtype=np.float32)
-        else:
-            assert D.shape == (n, k)
-
-        if I is None:
-            I = np.empty((n, k), dtype=np.int64)
-        else:
-            assert I.shape == (n, k)
+        D = _check_output_array(D, (n, k), 'float32', 'D')
+        I = _check_output_array(I, (n, k), 'int64', 'I')
 
         code_size_1 = self.code_size
         if include_listnos:
             code_size_1 += self.coarse_code_size()
 
-        if codes is None:
-            codes = np.empty((n, k, code_size_1), dtype=np.uint8)
-        else:
-            assert codes.shape == (n, k, code_size_1)
+        codes = _check_output_array(
+            codes, (n, k, code_size_1), 'uint8', 'codes')
 
         self.search_and_return_codes_c(
             n, swig_ptr(x),
@@ -537,10 +526,7 @@ def handle_Index(the_class):
         """
         key = np.ascontiguousarray(key, dtype='int64')
         n, = key.shape
-        if x is None:
-            x = np.empty((n, self.d), dtype=np.float32)
-        else:
-            assert x.shape == (n, self.d)
+        x = _check_output_array(x, (n, self.d), 'float32', 'x')
         self.reconstruct_batch_c(n, swig_ptr(key), swig_ptr(x))
         return x
 
@@ -564,10 +550,7 @@ def handle_Index(the_class):
         """
         if ni == -1:
             ni = self.ntotal - n0
-        if x is None:
-            x = np.empty((ni, self.d), dtype=np.float32)
-        else:
-            assert x.shape == (ni, self.d)
+        x = _check_output_array(x, (ni, self.d), 'float32', 'x')
 
         self.reconstruct_n_c(n0, ni, swig_ptr(x))
         return x
@@ -623,6 +606,31 @@ def handle_Index(the_class):
         I = rev_swig_ptr(res.labels, nd).copy()
         return lims, D, I
 
+    def replacement_search_iterator(self, x, *, params=None):
+        """Start a resumable search of a single query vector.
+
+        Parameters
+        ----------
+        x : array_like
+            Query vector, shape (d, ) or (1, d). `dtype` must be float32.
+        params : SearchParameters
+            Search parameters of the current search (overrides the class-level params)
+
+        Returns
+        -------
+        it : SearchIterator
+            `it.next(k)` returns the distances and labels of the next k
+            results, fewer once the search is exhausted.
+        """
+        x = np.ascontiguousarray(x, dtype='float32').ravel()
+        assert x.shape == (self.d, )
+        it = self.search_iterator_c(swig_ptr(x), params)
+        # the iterator refers to the index and the search parameters
+        add_to_referenced_objects(it, self)
+        if params is not None:
+            add_to_referenced_objects(it, params)
+        return it
+
     def replacement_search_preassigned(self, x, k, Iq, Dq, *, params=None, D=None, I=None):
         """Find the k nearest neighbors of the set of vectors x in an IVF index,
         with precalculated coarse quantization assignment.
@@ -660,15 +668,8 @@ def handle_Index(the_class):
         assert d == self.d
         assert k > 0
 
-        if D is None:
-            D = np.empty((n, k), dtype=np.float32)
-        else:
-            assert D.shape == (n, k)
-
-        if I is None:
-            I = np.empty((n, k), dtype=np.int64)
-        else:
-            assert I.shape == (n, k)
+        D = _check_output_array(D, (n, k), 'float32', 'D')
+        I = _check_output_array(I, (n, k), 'int64', 'I')
 
         Iq = np.ascontiguousarray(Iq, dtype='int64')
         assert params is None, "params not supported"
@@ -763,10 +764,7 @@ def handle_Index(the_class):
         assert cs == self.sa_code_size()
         codes = _check_dtype_uint8(codes)
 
-        if x is None:
-            x = np.empty((n, self.d), dtype=np.float32)
-        else:
-            assert x.shape == (n, self.d)
+        x = _check_output_array(x, (n, self.d), 'float32', 'x')
 
         self.sa_decode_c(n, swig_ptr(codes), swig_ptr(x))
         return x
@@ -798,6 +796,7 @@ def handle_Index(the_class):
                    replacement_reconstruct_batch)
     replace_method(the_class, 'reconstruct_n', replacement_reconstruct_n)
     replace_method(the_class, 'range_search', replacement_range_search)
+    replace_method(the_class, 'search_iterator', replacement_search_iterator)
     replace_method(the_class, 'update_vectors', replacement_update_vectors,
                    ignore_missing=True)
     replace_method(the_class, 'search_and_reconstruct',
@@ -861,21 +860,18 @@ def handle_IndexBinary(the_class):
     def replacement_reconstruct_n(self, n0=0, ni=-1, x=None):
         if ni == -1:
             ni = self.ntotal - n0
-        if x is None:
-            x = np.empty((ni, self.code_size), dtype=np.uint8)
-        else:
-            assert x.shape == (ni, self.code_size)
+        x = _check_output_array(x, (ni, self.code_size), 'uint8', 'x')
 
         self.reconstruct_n_c(n0, ni, swig_ptr(x))
         return x
 
-    def replacement_search(self, x, k, *, params=None):
+    def replacement_search(self, x, k, *, params=None, D=None, I=None):
         x = _check_dtype_uint8(x)
         n, d = x.shape
         assert d == self.code_size
         assert k > 0
-        distances = np.empty((n, k), dtype=np.int32)
-        labels = np.empty((n, k), dtype=np.int64)
+        distances = _check_output_array(D, (n, k), 'int32', 'D')
+        labels = _check_output_array(I, (n, k), 'int64', 'I')
         self.search_c(n, swig_ptr(x),
                       k, swig_ptr(distances),
                       swig_ptr(labels),
@@ -981,10 +977,7 @@ def handle_IndexBinary(the_class):
         assert d == self.code_size
         assert k > 0
 
-        if labels is None:
-            labels = np.empty((n, k), dtype=np.int64)
-        else:
-            assert labels.shape == (n, k)
+        labels = _check_output_array(labels, (n, k), 'int64', 'labels')
 
         self.assign_c(n, swig_ptr(x), swig_ptr(labels), k)
         return labels
@@ -1136,6 +1129,30 @@ def handle_CodePacker(the_class):
     replace_method(the_class, 'pack_1', replacement_pack_1)
     replace_method(the_class, 'unpack_1', replacement_unpack_1)
 
+######################################################
+# SearchIterator interface
+######################################################
+
+
+def handle_SearchIterator(the_class):
+
+    def replacement_next(self, k):
+        """Get the next k results of the search.
+
+        Returns
+        -------
+        D : array_like
+            Distances of the results, shape (nres, ) with nres <= k
+        I : array_like
+            Labels of the results, shape (nres, )
+        """
+        D = np.empty(k, dtype='float32')
+        I = np.empty(k, dtype='int64')
+        nres = self.next_c(k, swig_ptr(D), swig_ptr(I))
+        return D[:nres], I[:nres]
+
+    replace_method(the_class, 'next', replacement_next)
+
 ######################################################
 # MapLong2Long interface
 ######################################################
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/recommend_index.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+#include <faiss/AutoTune.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/MatrixStats.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+namespace {
+
+struct Candidate {
+    std::string key;
+    /// the search cost grows with the log of the nb of vectors
+    bool log_scaling;
+};
+
+std::vector<Candidate> candidate_indexes(int d, idx_t ntotal, idx_t nb) {
+    std::vector<Candidate> candidates;
+    candidates.push_back({"Flat", false});
+    candidates.push_back({"HNSW32", true});
+    candidates.push_back({"HNSW32,SQ8", true});
+
+    // nlist ~ 4 * sqrt(ntotal), with at least 39 training points per
+    // centroid in the sample
+    idx_t nlist = 1;
+    while (nlist * 2 <= 4 * sqrt(double(ntotal)) && nlist * 2 * 39 <= nb) {
+        nlist *= 2;
+    }
+    if (nlist >= 16) {
+        std::string ivf = "IVF" + std::to_string(nlist) + ",";
+        candidates.push_back({ivf + "Flat", false});
+        candidates.push_back({ivf + "SQ8", false});
+        if (d % 2 == 0) {
+            candidates.push_back(
+                    {ivf + "PQ" + std::to_string(d / 2) + "x4fs", false});
+        }
+        if (d % 4 == 0 && nb >= 256 * 39) {
+            candidates.push_back({ivf + "PQ" + std::to_string(d / 4), false});
+        }
+    }
+    return candidates;
+}
+
+double serialized_size(const Index* index) {
+    VectorIOWriter writer;
+    write_index(index, &writer);
+    return writer.data.size();
+}
+
+double p99_latency(const Index* index, idx_t nq, const float* xq, idx_t k) {
+    std::vector<double> latencies(nq);
+    std::vector<float> D(k);
+    std::vector<idx_t> I(k);
+    for (idx_t q = 0; q < nq; q++) {
+        double t0 = getmillisecs();
+        index->search(1, xq + q * index->d, k, D.data(), I.data());
+        latencies[q] = (getmillisecs() - t0) / 1e3;
+    }
+    size_t i = std::min(size_t(nq - 1), size_t(0.99 * nq));
+    std::nth_element(latencies.begin(), latencies.begin() + i, latencies.end());
+    return latencies[i];
+}
+
+/* fits y = a + b * f(n) on the measurements at sizes n0 < n1 and
+ * evaluates it at n. The slope is clamped to >= 0 and the result to
+ * >= y1, to be robust to the measurement noise. */
+double extrapolate(
+        double n0,
+        double y0,
+        double n1,
+        double y1,
+        double n,
+        bool log_scaling) {
+    auto f = [log_scaling](double v) { return log_scaling ? log(v) : v; };
+    double b = std::max(0.0, (y1 - y0) / (f(n1) - f(n0)));
+    return std::max(y1, y1 + b * (f(n) - f(n1)));
+}
+
+} // namespace
+
+IndexRecommendation recommend_index(
+        idx_t n,
+        int d,
+        const float* x,
+        idx_t ntotal,
+        double memory_budget,
+        double latency_target,
+        double recall_target,
+        MetricType metric,
+        std::vector<IndexRecommendation>* evaluated,
+        int verbose) {
+    FAISS_THROW_IF_NOT_MSG(
+            n >= 1000, "the sample should have at least 1000 vectors");
+    FAISS_THROW_IF_NOT(ntotal > 0);
+
+    MatrixStats stats(n, d, x);
+    std::string comments = stats.comments;
+
+    // the last vectors of the sample are the queries
+    const idx_t k = 10;
+    idx_t nq = std::min(idx_t(200), n / 10);
+    idx_t nb = n - nq, nb_half = nb / 2;
+    const float* xq = x + nb * d;
+
+    std::vector<float> gt_D(nq * k);
+    std::vector<idx_t> gt_I(nq * k);
+    {
+        IndexFlat index_gt(d, metric);
+        index_gt.add(nb, x);
+        index_gt.search(nq, xq, k, gt_D.data(), gt_I.data());
+    }
+    IntersectionCriterion crit(nq, k);
+    crit.set_groundtruth(k, gt_D.data(), gt_I.data());
+
+    std::vector<IndexRecommendation> configs;
+    for (const Candidate& cand : candidate_indexes(d, ntotal, nb)) {
+        double t0 = getmillisecs();
+        std::unique_ptr<Index> index, index_half;
+        try {
+            index.reset(index_factory(d, cand.key.c_str(), metric));
+            index->train(nb, x);
+            index_half.reset(clone_index(index.get()));
+            index_half->add(nb_half, x);
+            index->add(nb, x);
+        } catch (const FaissException& e) {
+            comments += cand.key + ": not built: " + e.what() + "\n";
+            continue;
+        }
+        double mem_half = serialized_size(index_half.get());
+        double mem = serialized_size(index.get());
+        double memory = extrapolate(nb_half, mem_half, nb, mem, ntotal, false);
+
+        ParameterSpace ps;
+        ps.verbose = 0;
+        ps.cost = ParameterSpace::COST_P99;
+        ps.n_experiments = 20;
+        ps.initialize(index.get());
+        OperatingPoints ops;
+        ps.explore(index.get(), nq, xq, crit, &ops);
+
+        for (const OperatingPoint& op : ops.optimal_pts) {
+            if (op.cno < 0) { // the default operating point
+                continue;
+            }
+            ps.set_index_parameters(index_half.get(), op.cno);
+            double t_half = p99_latency(index_half.get(), nq, xq, k);
+
+            IndexRecommendation rec;
+            rec.factory_string = cand.key;
+            rec.search_params = op.key;
+            rec.recall = op.perf;
+            rec.latency = extrapolate(
+                    nb_half, t_half, nb, op.t, ntotal, cand.log_scaling);
+            rec.memory = memory;
+            rec.meets_targets = rec.recall >= recall_target &&
+                    (latency_target <= 0 || rec.latency <= latency_target) &&
+                    (memory_budget <= 0 || rec.memory <= memory_budget);
+            configs.push_back(rec);
+        }
+        if (verbose) {
+            printf("recommend_index: %s evaluated in %.3f s, "
+                   "predicted size %.1f MiB\n",
+                   cand.key.c_str(),
+                   (getmillisecs() - t0) / 1000,
+                   memory / (1 << 20));
+        }
+    }
+
+    // fastest config that meets the targets, else the most accurate that
+    // fits the budgets, else the smallest
+    const IndexRecommendation* best = nullptr;
+    auto fits = [&](const IndexRecommendation& c) {
+        return (latency_target <= 0 || c.latency <= latency_target) &&
+                (memory_budget <= 0 || c.memory <= memory_budget);
+    };
+    for (const IndexRecommendation& c : configs) {
+        if (c.meets_targets && (!best || c.latency < best->latency)) {
+            best = &c;
+        }
+    }
+    if (!best) {
+        for (const IndexRecommendation& c : configs) {
+            if (fits(c) && (!best || c.recall > best->recall)) {
+                best = &c;
+            }
+        }
+    }
+    if (!best) {
+        for (const IndexRecommendation& c : configs) {
+            if (!best || c.memory < best->memory) {
+                best = &c;
+            }
+        }
+    }
+
+    char buf[256];
+    for (const IndexRecommendation& c : configs) {
+        snprintf(
+                buf,
+                sizeof(buf),
+                "%s %s: recall %.3f p99 latency %.3f ms size %.1f MiB%s\n",
+                c.factory_string.c_str(),
+                c.search_params.c_str(),
+                c.recall,
+                c.latency * 1000,
+                c.memory / (1 << 20),
+                c.meets_targets ? " (meets targets)" : "");
+        comments += buf;
+    }
+
+    IndexRecommendation result;
+    if (best) {
+        result = *best;
+    }
+    result.comments = comments;
+    if (verbose) {
+        printf("recommend_index: %s %s\n",
+               result.factory_string.c_str(),
+               result.search_params.c_str());
+    }
+    if (evaluated) {
+        *evaluated = std::move(configs);
+    }
+    return result;
+}
+
+} // namespace faiss
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <faiss/MetricType.h>
+
+namespace faiss {
+
+/// an index configuration evaluated by recommend_index
+struct IndexRecommendation {
+    /// string to pass to index_factory (empty if nothing could be built)
+    std::string factory_string;
+    /// search parameters, to pass to ParameterSpace::set_index_parameters
+    std::string search_params;
+
+    /// 10-recall at 10 measured on the sample
+    double recall = 0;
+    /// predicted 99th percentile single-query latency at ntotal (s)
+    double latency = 0;
+    /// predicted size of the index at ntotal (bytes)
+    double memory = 0;
+
+    /// whether the recall, latency and memory targets are met
+    bool meets_targets = false;
+
+    /// comments on the data (from MatrixStats) and on the evaluation
+    std::string comments;
+};
+
+/** Recommends an index for a dataset given resource and accuracy targets.
+ *
+ * The sample is split into queries and a database. A few candidate
+ * factory strings, chosen from d and ntotal (Flat, HNSW, IVF with flat,
+ * scalar quantizer and PQ codes), are built on half and on all of the
+ * database. For each of them the search parameters are explored with
+ * ParameterSpace and the p99 single-query latency of the optimal operating
+ * points is measured at both sizes. The latency and the serialized size of
+ * the index are extrapolated to ntotal with a linear model in the nb of
+ * vectors (logarithmic for the latency of HNSW) fitted on the two
+ * measurements.
+ *
+ * The recall is measured at the sample size, so it is optimistic for a
+ * larger ntotal, and the nlist of the IVF candidates is limited by the
+ * sample size: larger samples give better predictions.
+ *
+ * Among the configurations that meet all the targets, the fastest one is
+ * returned. If there is none, the one with the highest recall among those
+ * that fit the memory and latency targets is returned, and otherwise the
+ * smallest one, with meets_targets = false.
+ *
+ * @param n              nb of vectors in the sample (>= 1000)
+ * @param d              dimension of the vectors
+ * @param x              sample vectors, size n * d
+ * @param ntotal         nb of vectors the index will contain
+ * @param memory_budget  max size of the index (bytes, 0 = no limit)
+ * @param latency_target max p99 single-query latency (s, 0 = no limit)
+ * @param recall_target  min 10-recall at 10
+ * @param metric         metric of the search
+ * @param evaluated      if not null, filled with all the configurations
+ *                       on the Pareto-optimal (recall, latency) curves
+ */
+IndexRecommendation recommend_index(
+        idx_t n,
+        int d,
+        const float* x,
+        idx_t ntotal,
+        double memory_budget,
+        double latency_target,
+        double recall_target,
+        MetricType metric = METRIC_L2,
+        std::vector<IndexRecommendation>* evaluated = nullptr,
+        int verbose = 0);
+
+} // namespace faiss
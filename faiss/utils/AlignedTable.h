@@ -15,6 +15,7 @@
 #include <algorithm>
 
 #include <faiss/impl/platform_macros.h>
+#include <faiss/utils/huge_pages.h>
 
 namespace faiss {
 
@@ -47,10 +48,14 @@ struct AlignedTableTightAlloc {
         }
         T* new_ptr;
         if (n > 0) {
-            int ret = posix_memalign((void**)&new_ptr, A, n * sizeof(T));
+            size_t alignment = huge_pages_alignment(n * sizeof(T), A);
+            int ret = posix_memalign(
+                    (void**)&new_ptr, alignment, n * sizeof(T));
             if (ret != 0) {
                 throw std::bad_alloc();
             }
+            // before the pages are touched
+            huge_pages_advise(new_ptr, n * sizeof(T));
             if (numel > 0) {
                 memcpy(new_ptr, ptr, sizeof(T) * std::min(numel, n));
             }
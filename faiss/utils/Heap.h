@@ -21,6 +21,7 @@
 #ifndef FAISS_Heap_h
 #define FAISS_Heap_h
 
+#include <algorithm>
 #include <climits>
 #include <cmath>
 #include <cstring>
@@ -459,6 +460,98 @@ inline size_t maxheap_reorder(size_t k, T* bh_val, int64_t* bh_ids) {
     return heap_reorder<CMax<T, int64_t>>(k, bh_val, bh_ids);
 }
 
+/*******************************************************************
+ * Buffered additions for small k
+ *******************************************************************/
+
+/** Adds results to a heap of size k <= max_k by batches. The results that
+ * are better than the threshold are appended to a buffer, and the buffer
+ * is merged into the heap when it is full (and by flush()). The merge
+ * leaves the heap sorted from the worst to the best result, which is a
+ * valid heap. The threshold is that of the heap at the last merge, so it
+ * is looser than with heap_replace_top, but the scan loops do no sift:
+ * for k of 10 to 100, sorting and merging a batch is cheaper than the
+ * branchy sifts of the same results.
+ *
+ * For k > max_k, push() calls heap_replace_top. The heap must not be
+ * accessed by other means before flush().
+ */
+template <class C>
+struct HeapBuffer {
+    using T = typename C::T;
+    using TI = typename C::TI;
+
+    static constexpr size_t max_k = 128;
+    static constexpr size_t buffer_size = 64;
+
+    size_t k;
+    T* heap_dis;
+    TI* heap_ids;
+    /// results better than the threshold should be pushed
+    T threshold;
+
+    size_t n = 0;
+    T buf_dis[buffer_size];
+    TI buf_ids[buffer_size];
+    /// whether the heap is sorted from the worst to the best
+    bool sorted = false;
+
+    HeapBuffer(size_t k, T* heap_dis, TI* heap_ids)
+            : k(k),
+              heap_dis(heap_dis),
+              heap_ids(heap_ids),
+              threshold(heap_dis[0]) {}
+
+    /// add a result better than threshold
+    void push(T dis, TI id) {
+        if (k > max_k) {
+            heap_replace_top<C>(k, heap_dis, heap_ids, dis, id);
+            threshold = heap_dis[0];
+            return;
+        }
+        buf_dis[n] = dis;
+        buf_ids[n] = id;
+        if (++n == buffer_size) {
+            flush();
+        }
+    }
+
+    /// merge the buffer into the heap
+    void flush() {
+        if (n == 0) {
+            return;
+        }
+        using P = std::pair<T, TI>;
+        // a is better than b
+        auto better = [](const P& a, const P& b) {
+            return C::cmp2(b.first, a.first, b.second, a.second);
+        };
+        P heap[max_k], buf[buffer_size];
+        // best first
+        for (size_t i = 0; i < k; i++) {
+            heap[i] = P(heap_dis[k - 1 - i], heap_ids[k - 1 - i]);
+        }
+        if (!sorted) {
+            std::sort(heap, heap + k, better);
+            sorted = true;
+        }
+        for (size_t i = 0; i < n; i++) {
+            buf[i] = P(buf_dis[i], buf_ids[i]);
+        }
+        std::sort(buf, buf + n, better);
+        // merge the k best, written from the worst to the best
+        size_t i = 0, j = 0;
+        for (size_t l = k; l-- > 0;) {
+            bool from_buf = j < n && better(buf[j], heap[i]);
+            const P& p = from_buf ? buf[j++] : heap[i++];
+            heap_dis[l] = p.first;
+            heap_ids[l] = p.second;
+        }
+        threshold = heap_dis[0];
+        n = 0;
+    }
+};
+
 /*******************************************************************
  * Operations on heap arrays
  *******************************************************************/
@@ -12,7 +12,9 @@
 #include <cstring>
 
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/bf16.h>
 #include <faiss/utils/distances.h>
+#include <faiss/utils/fp16.h>
 
 /* declare BLAS functions, see http://www.netlib.org/clapack/cblas/ */
 
@@ -92,8 +94,21 @@ Tensor2D Linear::operator()(const Tensor2D& x) const {
     FAISS_THROW_IF_NOT(x.shape[1] == in_features);
     size_t n = x.shape[0];
     Tensor2D output(n, out_features);
+    Workspace ws;
+    forward(n, x.data(), output.data(), ws);
+    return output;
+}
 
-    float one = 1, zero = 0;
+void Linear::forward(
+        size_t n,
+        const float* x,
+        float* y,
+        Workspace& ws,
+        bool accumulate) const {
+    if (n == 0) {
+        return;
+    }
+    float one = 1, beta = accumulate ? 1 : 0;
     FINTEGER nbiti = out_features, ni = n, di = in_features;
 
     sgemm_("Transposed",
@@ -102,24 +117,60 @@ Tensor2D Linear::operator()(const Tensor2D& x) const {
            &ni,
            &di,
            &one,
-           weight.data(),
+           get_weight(ws),
            &di,
-           x.data(),
+           x,
            &di,
-           &zero,
-           output.data(),
+           &beta,
+           y,
            &nbiti);
 
     if (bias.size() > 0) {
         FAISS_THROW_IF_NOT(bias.size() == out_features);
         for (size_t i = 0; i < n; i++) {
             for (size_t j = 0; j < out_features; j++) {
-                output.v[i * out_features + j] += bias[j];
+                y[i * out_features + j] += bias[j];
             }
         }
     }
+}
 
-    return output;
+const float* Linear::get_weight(Workspace& ws) const {
+    if (weight_type == WeightType::FP32) {
+        FAISS_THROW_IF_NOT(weight.size() == in_features * out_features);
+        return weight.data();
+    }
+    FAISS_THROW_IF_NOT(weight_16.size() == in_features * out_features);
+    ws.weight.resize(weight_16.size());
+    for (size_t i = 0; i < weight_16.size(); i++) {
+        ws.weight[i] = weight_type == WeightType::FP16
+                ? decode_fp16(weight_16[i])
+                : decode_bf16(weight_16[i]);
+    }
+    return ws.weight.data();
+}
+
+void Linear::set_weight_type(WeightType new_type) {
+    if (new_type == weight_type) {
+        return;
+    }
+    Workspace ws;
+    const float* w_in = get_weight(ws);
+    std::vector<float> w(w_in, w_in + in_features * out_features);
+    weight_type = new_type;
+    if (new_type == WeightType::FP32) {
+        weight = std::move(w);
+        weight_16.clear();
+        weight_16.shrink_to_fit();
+    } else {
+        weight_16.resize(w.size());
+        for (size_t i = 0; i < w.size(); i++) {
+            weight_16[i] = new_type == WeightType::FP16 ? encode_fp16(w[i])
+                                                        : encode_bf16(w[i]);
+        }
+        weight.clear();
+        weight.shrink_to_fit();
+    }
 }
 
 Embedding::Embedding(size_t num_embeddings, size_t embedding_dim)
@@ -149,21 +200,6 @@ void inplace_relu(Tensor2D& x) {
     }
 }
 
-Tensor2D concatenate_rows(const Tensor2D& x, const Tensor2D& y) {
-    size_t n = x.shape[0], d1 = x.shape[1], d2 = y.shape[1];
-    FAISS_THROW_IF_NOT(n == y.shape[0]);
-    Tensor2D out(n, d1 + d2);
-    for (size_t i = 0; i < n; i++) {
-        memcpy(out.data() + i * (d1 + d2),
-               x.data() + i * d1,
-               sizeof(float) * d1);
-        memcpy(out.data() + i * (d1 + d2) + d1,
-               y.data() + i * d2,
-               sizeof(float) * d2);
-    }
-    return out;
-}
-
 } // anonymous namespace
 
 Tensor2D FFN::operator()(const Tensor2D& x_in) const {
@@ -172,6 +208,16 @@ Tensor2D FFN::operator()(const Tensor2D& x_in) const {
     return linear2(x);
 }
 
+void FFN::forward_residual(size_t n, float* x, Workspace& ws) const {
+    size_t h = linear1.out_features;
+    ws.hidden.resize(n * h);
+    linear1.forward(n, x, ws.hidden.data(), ws);
+    for (float& v : ws.hidden) {
+        v = std::max(0.0f, v);
+    }
+    linear2.forward(n, ws.hidden.data(), x, ws, true);
+}
+
 } // namespace nn
 
 /*************************************************************
@@ -187,103 +233,196 @@ QINCoStep::QINCoStep(int d, int K, int L, int h)
     }
 }
 
-nn::Tensor2D QINCoStep::decode(
-        const nn::Tensor2D& xhat,
-        const nn::Int32Tensor2D& codes) const {
-    size_t n = xhat.shape[0];
-    FAISS_THROW_IF_NOT(n == codes.shape[0]);
-    Tensor2D zqs = codebook(codes);
-    Tensor2D cc = concatenate_rows(zqs, xhat);
-    zqs += MLPconcat(cc);
-    for (int i = 0; i < L; i++) {
-        zqs += residual_blocks[i](zqs);
+namespace {
+
+/// y (n, d) (+)= x (n, d) * W^T, W of size (d, d) with a row stride of ldw
+void project_block(
+        size_t n,
+        size_t d,
+        const float* x,
+        const float* W,
+        size_t ldw,
+        float* y,
+        bool accumulate) {
+    if (n == 0) {
+        return;
     }
-    return zqs;
+    float one = 1, beta = accumulate ? 1 : 0;
+    FINTEGER di = d, ni = n, ldwi = ldw;
+    sgemm_("Transposed",
+           "Not transposed",
+           &di,
+           &ni,
+           &di,
+           &one,
+           W,
+           &ldwi,
+           x,
+           &di,
+           &beta,
+           y,
+           &di);
 }
 
-nn::Int32Tensor2D QINCoStep::encode(
-        const nn::Tensor2D& xhat,
-        const nn::Tensor2D& x,
-        nn::Tensor2D* residuals) const {
-    size_t n = xhat.shape[0];
-    FAISS_THROW_IF_NOT(
-            n == x.shape[0] && xhat.shape[1] == d && x.shape[1] == d);
-
-    // repeated codebook
-    Tensor2D zqs_r(n * K, d);  // size n, K, d
-    Tensor2D cc(n * K, d * 2); // size n, K, d * 2
+} // anonymous namespace
 
-    size_t local_d = this->d;
+void QINCoStep::codebook_projection(float* cb_proj, nn::Workspace& ws) const {
+    const float* W = MLPconcat.get_weight(ws);
+    project_block(K, d, codebook.data(), W, 2 * d, cb_proj, false);
+    for (size_t j = 0; j < K; j++) {
+        float* row = cb_proj + j * d;
+        const float* cb_row = codebook.data() + j * d;
+        for (size_t i = 0; i < d; i++) {
+            row[i] += cb_row[i] +
+                    (MLPconcat.bias.empty() ? 0 : MLPconcat.bias[i]);
+        }
+    }
+}
 
-    auto copy_row =
-            [local_d](Tensor2D& t, size_t i, size_t j, const float* data) {
-                assert(i <= t.shape[0] && j <= t.shape[1]);
-                memcpy(t.data() + i * t.shape[1] + j,
-                       data,
-                       sizeof(float) * local_d);
-            };
+void QINCoStep::decode_batch(
+        size_t n,
+        const float* xhat,
+        const int32_t* codes,
+        size_t codes_stride,
+        const float* cb_proj,
+        float* delta,
+        nn::Workspace& ws) const {
+    for (size_t i = 0; i < n; i++) {
+        memcpy(delta + i * d,
+               cb_proj + (size_t)codes[i * codes_stride] * d,
+               sizeof(float) * d);
+    }
+    // the xhat half of MLPconcat
+    project_block(
+            n, d, xhat, MLPconcat.get_weight(ws) + d, 2 * d, delta, true);
+    for (int l = 0; l < L; l++) {
+        residual_blocks[l].forward_residual(n, delta, ws);
+    }
+}
 
-    // manual broadcasting
+void QINCoStep::encode_batch(
+        size_t n,
+        const float* xhat,
+        const float* x,
+        const float* cb_proj,
+        int32_t* codes,
+        size_t codes_stride,
+        float* delta,
+        nn::Workspace& ws) const {
+    // the xhat half of MLPconcat, once per vector
+    ws.proj.resize(n * d);
+    project_block(
+            n,
+            d,
+            xhat,
+            MLPconcat.get_weight(ws) + d,
+            2 * d,
+            ws.proj.data(),
+            false);
+
+    // the K candidate deltas of each vector, size (n, K, d)
+    ws.rows.resize(n * K * d);
     for (size_t i = 0; i < n; i++) {
+        const float* p = ws.proj.data() + i * d;
         for (size_t j = 0; j < K; j++) {
-            copy_row(zqs_r, i * K + j, 0, codebook.data() + j * d);
-            copy_row(cc, i * K + j, 0, codebook.data() + j * d);
-            copy_row(cc, i * K + j, d, xhat.data() + i * d);
+            float* row = ws.rows.data() + (i * K + j) * d;
+            const float* cb_row = cb_proj + j * d;
+            for (size_t l = 0; l < d; l++) {
+                row[l] = cb_row[l] + p[l];
+            }
         }
     }
-
-    zqs_r += MLPconcat(cc);
-
-    // residual blocks
-    for (int i = 0; i < L; i++) {
-        zqs_r += residual_blocks[i](zqs_r);
+    for (int l = 0; l < L; l++) {
+        residual_blocks[l].forward_residual(n * K, ws.rows.data(), ws);
     }
 
-    // add the xhat
+    // assign x - xhat to the nearest candidate delta
+    ws.dis.resize(K);
     for (size_t i = 0; i < n; i++) {
-        float* zqs_r_row = zqs_r.data() + i * K * d;
-        const float* xhat_row = xhat.data() + i * d;
-        for (size_t l = 0; l < K; l++) {
-            for (size_t j = 0; j < d; j++) {
-                zqs_r_row[j] += xhat_row[j];
-            }
-            zqs_r_row += d;
+        float* r = ws.proj.data() + i * d;
+        for (size_t l = 0; l < d; l++) {
+            r[l] = x[i * d + l] - xhat[i * d + l];
+        }
+        const float* cand = ws.rows.data() + i * K * d;
+        size_t idx = fvec_L2sqr_ny_nearest(ws.dis.data(), r, cand, d, K);
+        codes[i * codes_stride] = idx;
+        if (delta) {
+            memcpy(delta + i * d, cand + idx * d, sizeof(float) * d);
         }
     }
+}
 
-    // perform assignment, finding the nearest
-    nn::Int32Tensor2D codes(n, 1);
+nn::Tensor2D QINCoStep::decode(
+        const nn::Tensor2D& xhat,
+        const nn::Int32Tensor2D& codes) const {
+    size_t n = xhat.shape[0];
+    FAISS_THROW_IF_NOT(n == codes.shape[0] && codes.shape[1] == 1);
+    FAISS_THROW_IF_NOT(xhat.shape[1] == d);
+    for (size_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT(codes.v[i] >= 0 && codes.v[i] < K);
+    }
+    nn::Workspace ws;
+    std::vector<float> cb_proj(K * d);
+    codebook_projection(cb_proj.data(), ws);
+    Tensor2D zqs(n, d);
+    decode_batch(
+            n, xhat.data(), codes.data(), 1, cb_proj.data(), zqs.data(), ws);
+    return zqs;
+}
+
+nn::Int32Tensor2D QINCoStep::encode(
+        const nn::Tensor2D& xhat,
+        const nn::Tensor2D& x,
+        nn::Tensor2D* residuals) const {
+    size_t n = xhat.shape[0];
+    FAISS_THROW_IF_NOT(
+            n == x.shape[0] && xhat.shape[1] == d && x.shape[1] == d);
     float* res = nullptr;
     if (residuals) {
         FAISS_THROW_IF_NOT(
                 residuals->shape[0] == n && residuals->shape[1] == d);
         res = residuals->data();
     }
+    nn::Workspace ws;
+    std::vector<float> cb_proj(K * d);
+    codebook_projection(cb_proj.data(), ws);
+    nn::Int32Tensor2D codes(n, 1);
+    encode_batch(
+            n,
+            xhat.data(),
+            x.data(),
+            cb_proj.data(),
+            codes.data(),
+            1,
+            res,
+            ws);
+    return codes;
+}
 
-    for (size_t i = 0; i < n; i++) {
-        const float* q = x.data() + i * d;
-        const float* db = zqs_r.data() + i * K * d;
-        float dis_min = HUGE_VALF;
-        int64_t idx = -1;
-        for (size_t j = 0; j < K; j++) {
-            float dis = fvec_L2sqr(q, db, d);
-            if (dis < dis_min) {
-                dis_min = dis;
-                idx = j;
-            }
-            db += d;
-        }
-        codes.v[i] = idx;
-        if (res) {
-            const float* xhat_row = xhat.data() + i * d;
-            const float* xhat_next_row = zqs_r.data() + (i * K + idx) * d;
-            for (size_t j = 0; j < d; j++) {
-                res[j] = xhat_next_row[j] - xhat_row[j];
-            }
-            res += d;
-        }
+void QINCoStep::set_weight_type(nn::WeightType weight_type) {
+    MLPconcat.set_weight_type(weight_type);
+    for (auto& block : residual_blocks) {
+        block.linear1.set_weight_type(weight_type);
+        block.linear2.set_weight_type(weight_type);
     }
-    return codes;
+}
+
+/*************************************************************
+ * NeuralNetCodec implementation
+ *************************************************************/
+
+void NeuralNetCodec::decode_codes(size_t n, const int32_t* codes, float* x)
+        const {
+    nn::Int32Tensor2D codes_tensor(n, M, codes);
+    nn::Tensor2D x_tensor = decode(codes_tensor);
+    memcpy(x, x_tensor.data(), sizeof(float) * n * d);
+}
+
+void NeuralNetCodec::encode_vectors(size_t n, const float* x, int32_t* codes)
+        const {
+    nn::Tensor2D x_tensor(n, d, x);
+    nn::Int32Tensor2D codes_tensor = encode(x_tensor);
+    memcpy(codes, codes_tensor.data(), sizeof(int32_t) * n * M);
 }
 
 /*************************************************************
@@ -299,10 +438,9 @@ QINCo::QINCo(int d, int K, int L, int M, int h)
 
 nn::Tensor2D QINCo::decode(const nn::Int32Tensor2D& codes) const {
     FAISS_THROW_IF_NOT(codes.shape[1] == M);
-    Tensor2D xhat = codebook0(codes.column(0));
-    for (int i = 1; i < M; i++) {
-        xhat += steps[i - 1].decode(xhat, codes.column(i));
-    }
+    size_t n = codes.shape[0];
+    Tensor2D xhat(n, d);
+    decode_codes(n, codes.data(), xhat.data());
     return xhat;
 }
 
@@ -310,13 +448,69 @@ nn::Int32Tensor2D QINCo::encode(const nn::Tensor2D& x) const {
     FAISS_THROW_IF_NOT(x.shape[1] == d);
     size_t n = x.shape[0];
     Int32Tensor2D codes(n, M);
-    Tensor2D xhat(n, d);
+    encode_vectors(n, x.data(), codes.data());
+    return codes;
+}
+
+void QINCo::decode_codes(size_t n, const int32_t* codes, float* x) const {
+    // check the codes here, exceptions cannot be thrown in the parallel loop
+    for (size_t i = 0; i < n * M; i++) {
+        FAISS_THROW_IF_NOT_FMT(
+                codes[i] >= 0 && codes[i] < K,
+                "invalid code %d at position %zd",
+                codes[i],
+                i);
+    }
+    std::vector<std::vector<float>> cb_proj(steps.size());
+    {
+        nn::Workspace ws;
+        for (size_t m = 0; m < steps.size(); m++) {
+            cb_proj[m].resize(K * d);
+            steps[m].codebook_projection(cb_proj[m].data(), ws);
+        }
+    }
+
+    size_t bs = std::max(block_size, size_t(1));
+#pragma omp parallel if (n > bs)
+    {
+        nn::Workspace ws;
+        std::vector<float> delta;
+#pragma omp for schedule(dynamic)
+        for (int64_t i0 = 0; i0 < (int64_t)n; i0 += bs) {
+            size_t nb = std::min(bs, n - i0);
+            const int32_t* ci = codes + i0 * M;
+            float* xi = x + i0 * d;
+            for (size_t i = 0; i < nb; i++) {
+                memcpy(xi + i * d,
+                       codebook0.data() + (size_t)ci[i * M] * d,
+                       sizeof(float) * d);
+            }
+            delta.resize(nb * d);
+            for (size_t m = 0; m < steps.size(); m++) {
+                steps[m].decode_batch(
+                        nb,
+                        xi,
+                        ci + m + 1,
+                        M,
+                        cb_proj[m].data(),
+                        delta.data(),
+                        ws);
+                for (size_t j = 0; j < nb * d; j++) {
+                    xi[j] += delta[j];
+                }
+            }
+        }
+    }
+}
+
+void QINCo::encode_vectors(size_t n, const float* x, int32_t* codes) const {
+    std::vector<float> xhat(n * d);
     {
         // assign to first codebook as a batch
         std::vector<float> dis(n);
         std::vector<int64_t> codes64(n);
         knn_L2sqr(
-                x.data(),
+                x,
                 codebook0.data(),
                 d,
                 n,
@@ -325,22 +519,55 @@ nn::Int32Tensor2D QINCo::encode(const nn::Tensor2D& x) const {
                 dis.data(),
                 codes64.data());
         for (size_t i = 0; i < n; i++) {
-            codes.v[i * M] = codes64[i];
+            codes[i * M] = codes64[i];
             memcpy(xhat.data() + i * d,
                    codebook0.data() + codes64[i] * d,
                    sizeof(float) * d);
         }
     }
 
-    Tensor2D toadd(n, d);
-    for (int i = 1; i < M; i++) {
-        Int32Tensor2D ci = steps[i - 1].encode(xhat, x, &toadd);
-        for (size_t j = 0; j < n; j++) {
-            codes.v[j * M + i] = ci.v[j];
+    std::vector<std::vector<float>> cb_proj(steps.size());
+    {
+        nn::Workspace ws;
+        for (size_t m = 0; m < steps.size(); m++) {
+            cb_proj[m].resize(K * d);
+            steps[m].codebook_projection(cb_proj[m].data(), ws);
         }
-        xhat += toadd;
     }
-    return codes;
+
+    // the residual blocks run on bs * K rows
+    size_t bs = std::max(block_size / K, size_t(1));
+#pragma omp parallel if (n > bs)
+    {
+        nn::Workspace ws;
+        std::vector<float> delta;
+#pragma omp for schedule(dynamic)
+        for (int64_t i0 = 0; i0 < (int64_t)n; i0 += bs) {
+            size_t nb = std::min(bs, n - i0);
+            float* xhati = xhat.data() + i0 * d;
+            delta.resize(nb * d);
+            for (size_t m = 0; m < steps.size(); m++) {
+                steps[m].encode_batch(
+                        nb,
+                        xhati,
+                        x + i0 * d,
+                        cb_proj[m].data(),
+                        codes + i0 * M + m + 1,
+                        M,
+                        delta.data(),
+                        ws);
+                for (size_t j = 0; j < nb * d; j++) {
+                    xhati[j] += delta[j];
+                }
+            }
+        }
+    }
+}
+
+void QINCo::set_weight_type(nn::WeightType weight_type) {
+    for (auto& step : steps) {
+        step.set_weight_type(weight_type);
+    }
 }
 
 } // namespace faiss
@@ -45,15 +45,47 @@ struct Tensor2DTemplate {
 using Tensor2D = Tensor2DTemplate<float>;
 using Int32Tensor2D = Tensor2DTemplate<int32_t>;
 
+/// storage type of the weights of a Linear layer
+enum class WeightType { FP32, FP16, BF16 };
+
+/** Buffers of the batched inference functions, that do not allocate once
+ * the buffers are large enough. Not thread-safe: use one per thread. */
+struct Workspace {
+    std::vector<float> weight; ///< decoded 16-bit weights
+    std::vector<float> hidden; ///< hidden activations of a FFN
+    std::vector<float> proj;   ///< projections of the inputs of a layer
+    std::vector<float> rows;   ///< candidate rows of a QINCo step
+    std::vector<float> dis;    ///< distances to the candidates
+};
+
 /// minimal translation of nn.Linear
 struct Linear {
     size_t in_features, out_features;
     std::vector<float> weight;
     std::vector<float> bias;
 
+    /// with FP16 or BF16, the weights are in weight_16 and weight is empty
+    WeightType weight_type = WeightType::FP32;
+    std::vector<uint16_t> weight_16;
+
     Linear(size_t in_features, size_t out_features, bool bias = true);
 
     Tensor2D operator()(const Tensor2D& x) const;
+
+    /** y = x * weight^T + bias for n rows of x, or y += ... if accumulate.
+     * One sgemm call. */
+    void forward(
+            size_t n,
+            const float* x,
+            float* y,
+            Workspace& ws,
+            bool accumulate = false) const;
+
+    /// the weights as floats, decoded into ws.weight if they are 16-bit
+    const float* get_weight(Workspace& ws) const;
+
+    /// convert the stored weights (lossy when converting to 16 bits)
+    void set_weight_type(WeightType new_type);
 };
 
 /// minimal translation of nn.Embedding
@@ -82,6 +114,9 @@ struct FFN {
     FFN(int d, int h) : linear1(d, h, false), linear2(h, d, false) {}
 
     Tensor2D operator()(const Tensor2D& x) const;
+
+    /// x += FFN(x) in place for n rows, the residual add is done by sgemm
+    void forward_residual(size_t n, float* x, Workspace& ws) const;
 };
 
 } // namespace nn
@@ -113,6 +148,39 @@ struct QINCoStep {
     nn::Tensor2D decode(
             const nn::Tensor2D& xhat,
             const nn::Int32Tensor2D& codes) const;
+
+    /* Batched versions. MLPconcat is split into its codebook half, applied
+     * once to the K codebook entries (codebook_projection), and its xhat
+     * half, applied with one sgemm per batch. */
+
+    /** codebook + MLPconcat([codebook, 0]) including the bias, size (K, d).
+     * Computed once per decode or encode call and shared by the batches. */
+    void codebook_projection(float* cb_proj, nn::Workspace& ws) const;
+
+    /** delta (n, d) to add to xhat (n, d) for codes (n), of which
+     * consecutive elements are codes_stride apart */
+    void decode_batch(
+            size_t n,
+            const float* xhat,
+            const int32_t* codes,
+            size_t codes_stride,
+            const float* cb_proj,
+            float* delta,
+            nn::Workspace& ws) const;
+
+    /** encode x (n, d) given xhat (n, d). The K candidates of each vector
+     * are computed together, so the residual blocks run on n * K rows. */
+    void encode_batch(
+            size_t n,
+            const float* xhat,
+            const float* x,
+            const float* cb_proj,
+            int32_t* codes,
+            size_t codes_stride,
+            float* delta,
+            nn::Workspace& ws) const;
+
+    void set_weight_type(nn::WeightType weight_type);
 };
 
 struct NeuralNetCodec {
@@ -123,6 +191,13 @@ struct NeuralNetCodec {
     virtual nn::Tensor2D decode(const nn::Int32Tensor2D& codes) const = 0;
     virtual nn::Int32Tensor2D encode(const nn::Tensor2D& x) const = 0;
 
+    /// decode n codes (n, M) to x (n, d), without intermediate tensors
+    virtual void decode_codes(size_t n, const int32_t* codes, float* x) const;
+
+    /// encode n vectors x (n, d) to codes (n, M)
+    virtual void encode_vectors(size_t n, const float* x, int32_t* codes)
+            const;
+
     virtual ~NeuralNetCodec() {}
 };
 
@@ -131,6 +206,11 @@ struct QINCo : NeuralNetCodec {
     nn::Embedding codebook0;
     std::vector<QINCoStep> steps;
 
+    /** max nb of rows of the intermediate matrices: the vectors are
+     * processed by batches of block_size (decode) or block_size / K
+     * (encode) in parallel */
+    size_t block_size = 4096;
+
     QINCo(int d, int K, int L, int M, int h);
 
     QINCoStep& get_step(int i) {
@@ -141,6 +221,15 @@ struct QINCo : NeuralNetCodec {
 
     nn::Int32Tensor2D encode(const nn::Tensor2D& x) const override;
 
+    void decode_codes(size_t n, const int32_t* codes, float* x)
+            const override;
+
+    void encode_vectors(size_t n, const float* x, int32_t* codes)
+            const override;
+
+    /// store the weights of all the Linear layers as weight_type
+    void set_weight_type(nn::WeightType weight_type);
+
     virtual ~QINCo() {}
 };
 
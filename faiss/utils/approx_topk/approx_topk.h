@@ -79,6 +79,8 @@
 
 #ifdef __AVX2__
 #include <faiss/utils/approx_topk/avx2-inl.h>
+#elif defined(__aarch64__)
+#include <faiss/utils/approx_topk/neon-inl.h>
 #else
 #include <faiss/utils/approx_topk/generic.h>
 #endif
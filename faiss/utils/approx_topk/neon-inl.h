@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <arm_neon.h>
+
+#include <limits>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+
+namespace faiss {
+
+// NEON version of avx2-inl.h: every bucket of 8 is tracked in 2 registers
+// of 4 lanes, the results are the ones of the generic version.
+
+template <typename C, uint32_t NBUCKETS, uint32_t N>
+struct HeapWithBuckets {
+    // this case was not implemented yet.
+};
+
+template <uint32_t NBUCKETS, uint32_t N>
+struct HeapWithBuckets<CMax<float, int>, NBUCKETS, N> {
+    static constexpr uint32_t NBUCKETS_4 = NBUCKETS / 4;
+    static_assert(
+            (NBUCKETS) > 0 && ((NBUCKETS % 8) == 0),
+            "Number of buckets needs to be 8, 16, 24, ...");
+
+    static void addn(
+            // number of elements
+            const uint32_t n,
+            // distances. It is assumed to have n elements.
+            const float* const __restrict distances,
+            // number of best elements to keep
+            const uint32_t k,
+            // output distances
+            float* const __restrict bh_val,
+            // output indices, each being within [0, n) range
+            int32_t* const __restrict bh_ids) {
+        // forward a call to bs_addn with 1 beam
+        bs_addn(1, n, distances, k, bh_val, bh_ids);
+    }
+
+    static void bs_addn(
+            // beam_size parameter of Beam Search algorithm
+            const uint32_t beam_size,
+            // number of elements per beam
+            const uint32_t n_per_beam,
+            // distances. It is assumed to have (n_per_beam * beam_size)
+            // elements.
+            const float* const __restrict distances,
+            // number of best elements to keep
+            const uint32_t k,
+            // output distances
+            float* const __restrict bh_val,
+            // output indices, each being within [0, n_per_beam * beam_size)
+            // range
+            int32_t* const __restrict bh_ids) {
+        using C = CMax<float, int>;
+
+        static const uint32_t lane_indices[4] = {0, 1, 2, 3};
+
+        // main loop
+        for (uint32_t beam_index = 0; beam_index < beam_size; beam_index++) {
+            float32x4_t min_distances_i[NBUCKETS_4][N];
+            uint32x4_t min_indices_i[NBUCKETS_4][N];
+
+            for (uint32_t j = 0; j < NBUCKETS_4; j++) {
+                for (uint32_t p = 0; p < N; p++) {
+                    min_distances_i[j][p] =
+                            vdupq_n_f32(std::numeric_limits<float>::max());
+                    min_indices_i[j][p] = vld1q_u32(lane_indices);
+                }
+            }
+
+            uint32x4_t current_indices = vld1q_u32(lane_indices);
+            const uint32x4_t indices_delta = vdupq_n_u32(NBUCKETS);
+
+            const uint32_t nb = (n_per_beam / NBUCKETS) * NBUCKETS;
+
+            // put the data into buckets
+            for (uint32_t ip = 0; ip < nb; ip += NBUCKETS) {
+                for (uint32_t j = 0; j < NBUCKETS_4; j++) {
+                    float32x4_t distance_candidate = vld1q_f32(
+                            distances + j * 4 + ip + n_per_beam * beam_index);
+                    uint32x4_t indices_candidate = current_indices;
+
+                    // the candidate is swapped with the p-th min if it is
+                    // smaller. Compiler should get rid of unneeded ops
+                    for (uint32_t p = 0; p < N; p++) {
+                        const uint32x4_t comparison = vcleq_f32(
+                                min_distances_i[j][p], distance_candidate);
+
+                        const float32x4_t min_distances_new = vminq_f32(
+                                distance_candidate, min_distances_i[j][p]);
+                        const uint32x4_t min_indices_new = vbslq_u32(
+                                comparison,
+                                min_indices_i[j][p],
+                                indices_candidate);
+
+                        const float32x4_t max_distances_new = vmaxq_f32(
+                                min_distances_i[j][p], distance_candidate);
+                        const uint32x4_t max_indices_new = vbslq_u32(
+                                comparison,
+                                indices_candidate,
+                                min_indices_i[j][p]);
+
+                        distance_candidate = max_distances_new;
+                        indices_candidate = max_indices_new;
+
+                        min_distances_i[j][p] = min_distances_new;
+                        min_indices_i[j][p] = min_indices_new;
+                    }
+                }
+
+                current_indices = vaddq_u32(current_indices, indices_delta);
+            }
+
+            // fix the indices
+            for (uint32_t j = 0; j < NBUCKETS_4; j++) {
+                const uint32x4_t offset =
+                        vdupq_n_u32(n_per_beam * beam_index + j * 4);
+                for (uint32_t p = 0; p < N; p++) {
+                    min_indices_i[j][p] =
+                            vaddq_u32(min_indices_i[j][p], offset);
+                }
+            }
+
+            // merge every bucket into the regular heap
+            for (uint32_t p = 0; p < N; p++) {
+                for (uint32_t j = 0; j < NBUCKETS_4; j++) {
+                    uint32_t min_indices_scalar[4];
+                    float min_distances_scalar[4];
+
+                    vst1q_u32(min_indices_scalar, min_indices_i[j][p]);
+                    vst1q_f32(min_distances_scalar, min_distances_i[j][p]);
+
+                    // this exact way is needed to maintain the order as if the
+                    // input elements were pushed to the heap sequentially
+                    for (size_t j4 = 0; j4 < 4; j4++) {
+                        const auto value = min_distances_scalar[j4];
+                        const int32_t index = min_indices_scalar[j4];
+                        if (C::cmp2(bh_val[0], value, bh_ids[0], index)) {
+                            heap_replace_top<C>(
+                                    k, bh_val, bh_ids, value, index);
+                        }
+                    }
+                }
+            }
+
+            // process leftovers
+            for (uint32_t ip = nb; ip < n_per_beam; ip++) {
+                const int32_t index = ip + n_per_beam * beam_index;
+                const float value = distances[index];
+
+                if (C::cmp(bh_val[0], value)) {
+                    heap_replace_top<C>(k, bh_val, bh_ids, value, index);
+                }
+            }
+        }
+    }
+};
+
+} // namespace faiss
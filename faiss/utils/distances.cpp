@@ -13,6 +13,8 @@
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
+#include <utility>
+#include <vector>
 
 #include <omp.h>
 
@@ -26,6 +28,7 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
 #include <faiss/impl/ResultHandler.h>
+#include <faiss/utils/prefetch.h>
 
 #include <faiss/utils/distances_fused/distances_fused.h>
 
@@ -131,6 +134,47 @@ void fvec_renorm_L2(size_t d, size_t nx, float* __restrict x) {
 
 namespace {
 
+// the sequential searches compute the distances by blocks of this size,
+// that are passed to the result handler at once
+constexpr size_t seq_block_size = 256;
+
+/** distances from x to the vectors j0..j0+n of y, computed with the ny
+ * kernel if there is no selection. Otherwise for the selected vectors
+ * only, whose ids are stored in ids.
+ *
+ * @return number of computed distances
+ */
+template <bool is_ip, class BlockResultHandler>
+size_t distances_block(
+        const BlockResultHandler& res,
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t j0,
+        size_t n,
+        float* dis,
+        int64_t* ids) {
+    if (!res.sel) {
+        if (is_ip) {
+            fvec_inner_products_ny(dis, x, y + j0 * d, d, n);
+        } else {
+            fvec_L2sqr_ny(dis, x, y + j0 * d, d, n);
+        }
+        return n;
+    }
+    size_t nsel = 0;
+    for (size_t j = j0; j < j0 + n; j++) {
+        if (res.is_in_selection(j)) {
+            const float* y_j = y + j * d;
+            dis[nsel] = is_ip ? fvec_inner_product(x, y_j, d)
+                              : fvec_L2sqr(x, y_j, d);
+            ids[nsel] = j;
+            nsel++;
+        }
+    }
+    return nsel;
+}
+
 /* Find the nearest neighbors for nx queries in a set of ny vectors */
 template <class BlockResultHandler>
 void exhaustive_inner_product_seq(
@@ -150,16 +194,16 @@ void exhaustive_inner_product_seq(
 #pragma omp for
         for (int64_t i = 0; i < nx; i++) {
             const float* x_i = x + i * d;
-            const float* y_j = y;
+            float ip[seq_block_size];
+            int64_t ids[seq_block_size];
 
             resi.begin(i);
 
-            for (size_t j = 0; j < ny; j++, y_j += d) {
-                if (!res.is_in_selection(j)) {
-                    continue;
-                }
-                float ip = fvec_inner_product(x_i, y_j, d);
-                resi.add_result(ip, j);
+            for (size_t j0 = 0; j0 < ny; j0 += seq_block_size) {
+                size_t nb = std::min(seq_block_size, ny - j0);
+                size_t n = distances_block<true>(
+                        res, x_i, y, d, j0, nb, ip, ids);
+                resi.add_results(n, ip, res.sel ? ids : nullptr, j0);
             }
             resi.end();
         }
@@ -184,14 +228,14 @@ void exhaustive_L2sqr_seq(
 #pragma omp for
         for (int64_t i = 0; i < nx; i++) {
             const float* x_i = x + i * d;
-            const float* y_j = y;
+            float dis[seq_block_size];
+            int64_t ids[seq_block_size];
             resi.begin(i);
-            for (size_t j = 0; j < ny; j++, y_j += d) {
-                if (!res.is_in_selection(j)) {
-                    continue;
-                }
-                float disij = fvec_L2sqr(x_i, y_j, d);
-                resi.add_result(disij, j);
+            for (size_t j0 = 0; j0 < ny; j0 += seq_block_size) {
+                size_t nb = std::min(seq_block_size, ny - j0);
+                size_t n = distances_block<false>(
+                        res, x_i, y, d, j0, nb, dis, ids);
+                resi.add_results(n, dis, res.sel ? ids : nullptr, j0);
             }
             resi.end();
         }
@@ -200,16 +244,19 @@ void exhaustive_L2sqr_seq(
 
 /** Find the nearest neighbors for nx queries in a set of ny vectors */
 template <class BlockResultHandler>
-void exhaustive_inner_product_blas(
+void exhaustive_inner_product_blas_default_impl(
         const float* x,
         const float* y,
         size_t d,
         size_t nx,
         size_t ny,
         BlockResultHandler& res) {
-    // BLAS does not like empty matrices
-    if (nx == 0 || ny == 0)
+    // BLAS does not like empty matrices, the results are still initialized
+    if (nx == 0 || ny == 0) {
+        res.begin_multiple(0, nx);
+        res.end_multiple();
         return;
+    }
 
     /* block sizes */
     const size_t bs_x = distance_compute_blas_query_bs;
@@ -253,6 +300,34 @@ void exhaustive_inner_product_blas(
     }
 }
 
+template <class BlockResultHandler>
+void exhaustive_inner_product_blas(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        BlockResultHandler& res) {
+    exhaustive_inner_product_blas_default_impl(x, y, d, nx, ny, res);
+}
+
+// an override for the k-nn search with heaps
+template <>
+void exhaustive_inner_product_blas<
+        HeapBlockResultHandler<CMin<float, int64_t>>>(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMin<float, int64_t>>& res) {
+    // use the fused kernel if available
+    if (exhaustive_inner_product_fused_heap(x, y, d, nx, ny, res)) {
+        return;
+    }
+    exhaustive_inner_product_blas_default_impl(x, y, d, nx, ny, res);
+}
+
 // distance correction is an operator that can be applied to transform
 // the distances
 template <class BlockResultHandler>
@@ -264,9 +339,12 @@ void exhaustive_L2sqr_blas_default_impl(
         size_t ny,
         BlockResultHandler& res,
         const float* y_norms = nullptr) {
-    // BLAS does not like empty matrices
-    if (nx == 0 || ny == 0)
+    // BLAS does not like empty matrices, the results are still initialized
+    if (nx == 0 || ny == 0) {
+        res.begin_multiple(0, nx);
+        res.end_multiple();
         return;
+    }
 
     /* block sizes */
     const size_t bs_x = distance_compute_blas_query_bs;
@@ -362,9 +440,12 @@ void exhaustive_L2sqr_blas_cmax_avx2(
         size_t ny,
         Top1BlockResultHandler<CMax<float, int64_t>>& res,
         const float* y_norms) {
-    // BLAS does not like empty matrices
-    if (nx == 0 || ny == 0)
+    // BLAS does not like empty matrices, the results are still initialized
+    if (nx == 0 || ny == 0) {
+        res.begin_multiple(0, nx);
+        res.end_multiple();
         return;
+    }
 
     /* block sizes */
     const size_t bs_x = distance_compute_blas_query_bs;
@@ -568,9 +649,12 @@ void exhaustive_L2sqr_blas_cmax_sve(
         size_t ny,
         Top1BlockResultHandler<CMax<float, int64_t>>& res,
         const float* y_norms) {
-    // BLAS does not like empty matrices
-    if (nx == 0 || ny == 0)
+    // BLAS does not like empty matrices, the results are still initialized
+    if (nx == 0 || ny == 0) {
+        res.begin_multiple(0, nx);
+        res.end_multiple();
         return;
+    }
 
     /* block sizes */
     const size_t bs_x = distance_compute_blas_query_bs;
@@ -787,6 +871,23 @@ void exhaustive_L2sqr_blas<Top1BlockResultHandler<CMax<float, int64_t>>>(
 #endif
 }
 
+// an override for the k-nn search with heaps
+template <>
+void exhaustive_L2sqr_blas<HeapBlockResultHandler<CMax<float, int64_t>>>(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMax<float, int64_t>>& res,
+        const float* y_norms) {
+    // use the fused kernel if available
+    if (exhaustive_L2sqr_fused_heap(x, y, d, nx, ny, res, y_norms)) {
+        return;
+    }
+    exhaustive_L2sqr_blas_default_impl(x, y, d, nx, ny, res, y_norms);
+}
+
 struct Run_search_inner_product {
     using T = void;
     template <class BlockResultHandler>
@@ -969,6 +1070,86 @@ void range_search_inner_product(
  * compute a subset of  distances
  ***************************************************************************/
 
+namespace {
+
+void prefetch_vector(const float* y, size_t d) {
+    const char* p = (const char*)y;
+    for (size_t o = 0; o < d * sizeof(float); o += 64) {
+        prefetch_L2(p + o);
+    }
+}
+
+/* distances between x and the vectors of y with indices ids. The
+ * vectors are visited by increasing index for memory locality, 4 at a
+ * time with the next 4 prefetched. */
+template <bool is_IP>
+void fvec_distances_by_idx_1(
+        float* __restrict dis,
+        const float* x,
+        const float* y,
+        const int64_t* __restrict ids,
+        size_t d,
+        size_t ny,
+        std::vector<std::pair<int64_t, size_t>>& order) {
+    order.clear();
+    for (size_t i = 0; i < ny; i++) {
+        if (ids[i] < 0) {
+            dis[i] = is_IP ? -INFINITY : INFINITY;
+        } else {
+            order.emplace_back(ids[i], i);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t n = order.size();
+    for (size_t i = 0; i < n && i < 4; i++) {
+        prefetch_vector(y + d * order[i].first, d);
+    }
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (size_t j = i + 4; j < n && j < i + 8; j++) {
+            prefetch_vector(y + d * order[j].first, d);
+        }
+        float d0, d1, d2, d3;
+        if (is_IP) {
+            fvec_inner_product_batch_4(
+                    x,
+                    y + d * order[i].first,
+                    y + d * order[i + 1].first,
+                    y + d * order[i + 2].first,
+                    y + d * order[i + 3].first,
+                    d,
+                    d0,
+                    d1,
+                    d2,
+                    d3);
+        } else {
+            fvec_L2sqr_batch_4(
+                    x,
+                    y + d * order[i].first,
+                    y + d * order[i + 1].first,
+                    y + d * order[i + 2].first,
+                    y + d * order[i + 3].first,
+                    d,
+                    d0,
+                    d1,
+                    d2,
+                    d3);
+        }
+        dis[order[i].second] = d0;
+        dis[order[i + 1].second] = d1;
+        dis[order[i + 2].second] = d2;
+        dis[order[i + 3].second] = d3;
+    }
+    for (; i < n; i++) {
+        const float* yi = y + d * order[i].first;
+        dis[order[i].second] =
+                is_IP ? fvec_inner_product(x, yi, d) : fvec_L2sqr(x, yi, d);
+    }
+}
+
+} // anonymous namespace
+
 /* compute the inner product between x and a subset y of ny vectors,
    whose indices are given by idy.  */
 void fvec_inner_products_by_idx(
@@ -979,17 +1160,13 @@ void fvec_inner_products_by_idx(
         size_t d,
         size_t nx,
         size_t ny) {
-#pragma omp parallel for
-    for (int64_t j = 0; j < nx; j++) {
-        const int64_t* __restrict idsj = ids + j * ny;
-        const float* xj = x + j * d;
-        float* __restrict ipj = ip + j * ny;
-        for (size_t i = 0; i < ny; i++) {
-            if (idsj[i] < 0) {
-                ipj[i] = -INFINITY;
-            } else {
-                ipj[i] = fvec_inner_product(xj, y + d * idsj[i], d);
-            }
+#pragma omp parallel
+    {
+        std::vector<std::pair<int64_t, size_t>> order;
+#pragma omp for
+        for (int64_t j = 0; j < nx; j++) {
+            fvec_distances_by_idx_1<true>(
+                    ip + j * ny, x + j * d, y, ids + j * ny, d, ny, order);
         }
     }
 }
@@ -1004,17 +1181,13 @@ void fvec_L2sqr_by_idx(
         size_t d,
         size_t nx,
         size_t ny) {
-#pragma omp parallel for
-    for (int64_t j = 0; j < nx; j++) {
-        const int64_t* __restrict idsj = ids + j * ny;
-        const float* xj = x + j * d;
-        float* __restrict disj = dis + j * ny;
-        for (size_t i = 0; i < ny; i++) {
-            if (idsj[i] < 0) {
-                disj[i] = INFINITY;
-            } else {
-                disj[i] = fvec_L2sqr(xj, y + d * idsj[i], d);
-            }
+#pragma omp parallel
+    {
+        std::vector<std::pair<int64_t, size_t>> order;
+#pragma omp for
+        for (int64_t j = 0; j < nx; j++) {
+            fvec_distances_by_idx_1<false>(
+                    dis + j * ny, x + j * d, y, ids + j * ny, d, ny, order);
         }
     }
 }
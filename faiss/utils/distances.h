@@ -36,6 +36,21 @@ float fvec_L1(const float* x, const float* y, size_t d);
 /// infinity distance
 float fvec_Linf(const float* x, const float* y, size_t d);
 
+/// Lp distance to the power p: sum_i |x_i - y_i|^p
+float fvec_Lp(const float* x, const float* y, size_t d, float p);
+
+/// Canberra distance
+float fvec_Canberra(const float* x, const float* y, size_t d);
+
+/// Bray-Curtis distance
+float fvec_BrayCurtis(const float* x, const float* y, size_t d);
+
+/// weighted Jaccard similarity, defined for non-negative vectors only
+float fvec_Jaccard(const float* x, const float* y, size_t d);
+
+/// sum_i |x_i * y_i|
+float fvec_abs_inner_product(const float* x, const float* y, size_t d);
+
 /// Special version of inner product that computes 4 distances
 /// between x and yi, which is performance oriented.
 void fvec_inner_product_batch_4(
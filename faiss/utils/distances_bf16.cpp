@@ -0,0 +1,536 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/utils/distances_bf16.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/platform_macros.h>
+#include <faiss/utils/bf16.h>
+#include <faiss/utils/distances.h>
+
+#if defined(__AVX512BF16__) && defined(__AVX512BW__)
+#include <immintrin.h>
+#define FAISS_BF16_AVX512
+#if defined(__AMX_TILE__) && defined(__AMX_BF16__) && defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#define FAISS_BF16_AMX
+#endif
+#endif
+
+#ifndef FINTEGER
+#define FINTEGER long
+#endif
+
+#ifndef FAISS_BF16_AVX512
+extern "C" {
+
+/* declare BLAS functions, see http://www.netlib.org/clapack/cblas/ */
+
+int sgemm_(
+        const char* transa,
+        const char* transb,
+        FINTEGER* m,
+        FINTEGER* n,
+        FINTEGER* k,
+        const float* alpha,
+        const float* a,
+        FINTEGER* lda,
+        const float* b,
+        FINTEGER* ldb,
+        float* beta,
+        float* c,
+        FINTEGER* ldc);
+}
+#endif
+
+namespace faiss {
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_inner_product_bf16(const float* x, const uint16_t* y, size_t d) {
+    float res = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        res += x[i] * decode_bf16(y[i]);
+    }
+    return res;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_L2sqr_bf16(const float* x, const uint16_t* y, size_t d) {
+    float res = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        const float tmp = x[i] - decode_bf16(y[i]);
+        res += tmp * tmp;
+    }
+    return res;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+bool bf16_block_kernel_has_simd() {
+#ifdef FAISS_BF16_AVX512
+    return true;
+#else
+    return false;
+#endif
+}
+
+namespace {
+
+#ifdef FAISS_BF16_AVX512
+
+/** ip[a * ldip + j] = <q_a, y_j> for NQ queries and the 16 * NG vectors of
+ * NG packed groups, of which n_valid are stored */
+template <int NQ, int NG>
+void ip_kernel_bf16(
+        const uint32_t* q,
+        size_t d2,
+        const uint32_t* y,
+        float* ip,
+        size_t ldip,
+        size_t n_valid) {
+    __m512 acc[NQ][NG];
+    for (int a = 0; a < NQ; a++) {
+        for (int g = 0; g < NG; g++) {
+            acc[a][g] = _mm512_setzero_ps();
+        }
+    }
+    for (size_t k2 = 0; k2 < d2; k2++) {
+        __m512bh yv[NG];
+        for (int g = 0; g < NG; g++) {
+            yv[g] = (__m512bh)_mm512_loadu_si512(y + (g * d2 + k2) * 16);
+        }
+        for (int a = 0; a < NQ; a++) {
+            __m512bh qv = (__m512bh)_mm512_set1_epi32(q[a * d2 + k2]);
+            for (int g = 0; g < NG; g++) {
+                acc[a][g] = _mm512_dpbf16_ps(acc[a][g], qv, yv[g]);
+            }
+        }
+    }
+    for (int g = 0; g < NG; g++) {
+        size_t n = n_valid > size_t(16 * g) ? n_valid - 16 * g : 0;
+        __mmask16 mask = n >= 16 ? 0xffff : (1u << n) - 1;
+        for (int a = 0; a < NQ; a++) {
+            _mm512_mask_storeu_ps(ip + a * ldip + 16 * g, mask, acc[a][g]);
+        }
+    }
+}
+
+template <int NQ>
+void ip_rows_bf16(
+        const uint32_t* q,
+        size_t d2,
+        const uint32_t* y,
+        size_t ny,
+        float* ip) {
+    size_t j = 0;
+    for (; j + 16 < ny; j += 32) {
+        ip_kernel_bf16<NQ, 2>(q, d2, y + j * d2, ip + j, ny, ny - j);
+    }
+    if (j < ny) {
+        ip_kernel_bf16<NQ, 1>(q, d2, y + j * d2, ip + j, ny, ny - j);
+    }
+}
+
+/// components 2 * k2 and 2 * k2 + 1 of a vector in a 32-bit word
+inline uint32_t bf16_pair(const uint16_t* y, size_t d, size_t k2) {
+    uint32_t lo = y[2 * k2];
+    uint32_t hi = 2 * k2 + 1 < d ? y[2 * k2 + 1] : 0;
+    return lo | hi << 16;
+}
+
+#ifdef FAISS_BF16_AMX
+
+/// the tile data state must be requested from the kernel before use
+bool amx_available() {
+    static const bool ok = syscall(
+                                   SYS_arch_prctl,
+                                   0x1023 /* ARCH_REQ_XCOMP_PERM */,
+                                   18 /* XFEATURE_XTILEDATA */) == 0;
+    return ok;
+}
+
+/// 8 tiles of 16 rows of 64 bytes
+struct TileConfig {
+    uint8_t palette_id = 1;
+    uint8_t start_row = 0;
+    uint8_t reserved[14] = {};
+    uint16_t colsb[16] = {};
+    uint8_t rows[16] = {};
+
+    TileConfig() {
+        for (int t = 0; t < 8; t++) {
+            colsb[t] = 64;
+            rows[t] = 16;
+        }
+    }
+};
+
+/** 32 queries x 32 database vectors per step: tiles 0-3 accumulate, 4-5
+ * hold 16 queries x 32 components and 6-7 16 pairs of components x 16
+ * packed vectors. q and y are padded so that all tiles are full. */
+void ip_rows_amx(
+        const uint32_t* q,
+        size_t nq,
+        size_t d2,
+        const uint32_t* y,
+        size_t ny,
+        float* ip) {
+    alignas(64) float c[4][256];
+    for (size_t j = 0; j < ny; j += 32) {
+        const uint32_t* y0 = y + j * d2;
+        const uint32_t* y1 = y0 + 16 * d2;
+        _tile_zero(0);
+        _tile_zero(1);
+        _tile_zero(2);
+        _tile_zero(3);
+        for (size_t k2 = 0; k2 < d2; k2 += 16) {
+            _tile_loadd(4, q + k2, d2 * 4);
+            _tile_loadd(5, q + 16 * d2 + k2, d2 * 4);
+            _tile_loadd(6, y0 + k2 * 16, 64);
+            _tile_loadd(7, y1 + k2 * 16, 64);
+            _tile_dpbf16ps(0, 4, 6);
+            _tile_dpbf16ps(1, 4, 7);
+            _tile_dpbf16ps(2, 5, 6);
+            _tile_dpbf16ps(3, 5, 7);
+        }
+        _tile_stored(0, c[0], 64);
+        _tile_stored(1, c[1], 64);
+        _tile_stored(2, c[2], 64);
+        _tile_stored(3, c[3], 64);
+        for (int t = 0; t < 4; t++) {
+            size_t i0 = 16 * (t / 2), j0 = j + 16 * (t % 2);
+            if (i0 >= nq || j0 >= ny) {
+                continue;
+            }
+            size_t ni = std::min(nq - i0, size_t(16));
+            size_t nj = std::min(ny - j0, size_t(16));
+            for (size_t i = 0; i < ni; i++) {
+                memcpy(ip + (i0 + i) * ny + j0,
+                       c[t] + i * 16,
+                       nj * sizeof(float));
+            }
+        }
+    }
+}
+
+#endif
+
+/** bf16 queries, multiplied with vdpbf16ps. The database vectors are
+ * packed by groups of 16: the pairs of components k2 of the 16 vectors are
+ * 16 consecutive 32-bit words, so that the accumulators hold the distances
+ * to 16 vectors and no horizontal sums are needed. The query pairs are
+ * broadcast.
+ *
+ * With AMX (compiled in and allowed by the kernel), the same packed groups
+ * are the B tiles of tdpbf16ps. The components are then padded to a
+ * multiple of 32, the queries to a multiple of 32 and the database vectors
+ * to a multiple of 32. */
+struct BlockInnerProducts {
+    size_t d, d2;
+    bool amx = false;
+    std::vector<uint32_t> q;
+    size_t nq = 0;
+    std::vector<uint32_t> y_packed;
+
+    explicit BlockInnerProducts(size_t d) : d(d) {
+#ifdef FAISS_BF16_AMX
+        amx = amx_available();
+#endif
+        d2 = amx ? (d + 31) / 32 * 16 : (d + 1) / 2;
+    }
+
+    void set_queries(const float* x, size_t n) {
+        nq = n;
+        q.assign((amx ? (n + 31) / 32 * 32 : n) * d2, 0);
+        std::vector<uint16_t> xi(d);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t l = 0; l < d; l++) {
+                xi[l] = encode_bf16(x[i * d + l]);
+            }
+            for (size_t k2 = 0; 2 * k2 < d; k2++) {
+                q[i * d2 + k2] = bf16_pair(xi.data(), d, k2);
+            }
+        }
+    }
+
+    void pack_database(const uint16_t* y, size_t ny) {
+        size_t ng = amx ? (ny + 31) / 32 * 2 : (ny + 15) / 16;
+        y_packed.assign(ng * d2 * 16, 0);
+        for (size_t j = 0; j < ny; j++) {
+            uint32_t* dst = y_packed.data() + (j / 16) * d2 * 16 + j % 16;
+            for (size_t k2 = 0; 2 * k2 < d; k2++) {
+                dst[k2 * 16] = bf16_pair(y + j * d, d, k2);
+            }
+        }
+    }
+
+    /// ip[i * ny + j] = <q_i, y_j>
+    void compute(const uint16_t* y, size_t ny, float* ip) {
+        pack_database(y, ny);
+        const uint32_t* yp = y_packed.data();
+#ifdef FAISS_BF16_AMX
+        if (amx) {
+            int64_t nq32 = (nq + 31) / 32;
+#pragma omp parallel if (nq32 > 1)
+            {
+                TileConfig cfg;
+                _tile_loadconfig(&cfg);
+#pragma omp for
+                for (int64_t i = 0; i < nq32; i++) {
+                    ip_rows_amx(
+                            q.data() + i * 32 * d2,
+                            nq - i * 32,
+                            d2,
+                            yp,
+                            ny,
+                            ip + i * 32 * ny);
+                }
+                _tile_release();
+            }
+            return;
+        }
+#endif
+        int64_t nq8 = nq / 8;
+#pragma omp parallel for if (nq8 > 1)
+        for (int64_t i = 0; i < nq8; i++) {
+            ip_rows_bf16<8>(q.data() + i * 8 * d2, d2, yp, ny, ip + i * 8 * ny);
+        }
+        size_t i0 = nq8 * 8;
+        const uint32_t* qi = q.data() + i0 * d2;
+        float* ipi = ip + i0 * ny;
+        switch (nq - i0) {
+#define DISPATCH(NQ)                           \
+    case NQ:                                   \
+        ip_rows_bf16<NQ>(qi, d2, yp, ny, ipi); \
+        break;
+            DISPATCH(1);
+            DISPATCH(2);
+            DISPATCH(3);
+            DISPATCH(4);
+            DISPATCH(5);
+            DISPATCH(6);
+            DISPATCH(7);
+#undef DISPATCH
+        }
+    }
+};
+
+#else
+
+/// float queries, multiplied with sgemm by the decoded database vectors
+struct BlockInnerProducts {
+    size_t d;
+    const float* x = nullptr;
+    size_t nq = 0;
+    std::vector<float> y_decoded;
+
+    explicit BlockInnerProducts(size_t d) : d(d) {}
+
+    void set_queries(const float* x_in, size_t n) {
+        x = x_in;
+        nq = n;
+    }
+
+    void compute(const uint16_t* y, size_t ny, float* ip) {
+        y_decoded.resize(ny * d);
+#pragma omp parallel for if (ny * d > 65536)
+        for (int64_t i = 0; i < ny * d; i++) {
+            y_decoded[i] = decode_bf16(y[i]);
+        }
+        float one = 1, zero = 0;
+        FINTEGER nyi = ny, nxi = nq, di = d;
+        sgemm_("Transpose",
+               "Not transpose",
+               &nyi,
+               &nxi,
+               &di,
+               &one,
+               y_decoded.data(),
+               &di,
+               x,
+               &di,
+               &zero,
+               ip,
+               &nyi);
+    }
+};
+
+#endif
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float bf16_norm_L2sqr(const uint16_t* y, size_t d) {
+    float res = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        const float tmp = decode_bf16(y[i]);
+        res += tmp * tmp;
+    }
+    return res;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+struct Run_search_bf16 {
+    using T = void;
+    template <class BlockResultHandler>
+    void f(BlockResultHandler& res,
+           const float* x,
+           const uint16_t* y,
+           size_t d,
+           size_t nx,
+           size_t ny,
+           bool is_l2) {
+        if (nx == 0 || ny == 0) {
+            return;
+        }
+        const size_t bs_x = distance_compute_blas_query_bs;
+        const size_t bs_y = distance_compute_blas_database_bs;
+        std::unique_ptr<float[]> ip_block(new float[bs_x * bs_y]);
+        std::vector<float> x_norms, y_norms;
+        if (is_l2) {
+            x_norms.resize(nx);
+            fvec_norms_L2sqr(x_norms.data(), x, d, nx);
+            y_norms.resize(bs_y);
+        }
+        // excluded vectors get a distance that is never selected
+        const float excluded = is_l2 ? HUGE_VALF : -HUGE_VALF;
+        BlockInnerProducts bip(d);
+
+        for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
+            size_t i1 = std::min(i0 + bs_x, nx);
+            res.begin_multiple(i0, i1);
+            bip.set_queries(x + i0 * d, i1 - i0);
+
+            for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                size_t j1 = std::min(j0 + bs_y, ny);
+                bip.compute(y + j0 * d, j1 - j0, ip_block.get());
+                if (is_l2) {
+                    for (size_t j = j0; j < j1; j++) {
+                        y_norms[j - j0] = bf16_norm_L2sqr(y + j * d, d);
+                    }
+                }
+                if (is_l2 || res.sel) {
+#pragma omp parallel for if (i1 - i0 > 1)
+                    for (int64_t i = i0; i < i1; i++) {
+                        float* ip_line = ip_block.get() + (i - i0) * (j1 - j0);
+                        for (size_t j = j0; j < j1; j++) {
+                            float dis = ip_line[j - j0];
+                            if (is_l2) {
+                                dis = x_norms[i] + y_norms[j - j0] - 2 * dis;
+                                // negative values can occur for identical
+                                // vectors due to roundoff errors
+                                dis = std::max(dis, 0.0f);
+                            }
+                            if (!res.is_in_selection(j)) {
+                                dis = excluded;
+                            }
+                            ip_line[j - j0] = dis;
+                        }
+                    }
+                }
+                res.add_results(j0, j1, ip_block.get());
+            }
+            res.end_multiple();
+            InterruptCallback::check();
+        }
+    }
+};
+
+} // namespace
+
+void knn_inner_product_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel) {
+    Run_search_bf16 r;
+    dispatch_knn_ResultHandler(
+            nx,
+            distances,
+            labels,
+            k,
+            METRIC_INNER_PRODUCT,
+            sel,
+            r,
+            x,
+            y,
+            d,
+            nx,
+            ny,
+            false);
+}
+
+void knn_L2sqr_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel) {
+    Run_search_bf16 r;
+    dispatch_knn_ResultHandler(
+            nx, distances, labels, k, METRIC_L2, sel, r, x, y, d, nx, ny, true);
+}
+
+void range_search_inner_product_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel) {
+    Run_search_bf16 r;
+    dispatch_range_ResultHandler(
+            result,
+            radius,
+            METRIC_INNER_PRODUCT,
+            sel,
+            r,
+            x,
+            y,
+            d,
+            nx,
+            ny,
+            false);
+}
+
+void range_search_L2sqr_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel) {
+    Run_search_bf16 r;
+    dispatch_range_ResultHandler(
+            result, radius, METRIC_L2, sel, r, x, y, d, nx, ny, true);
+}
+
+} // namespace faiss
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace faiss {
+
+struct IDSelector;
+struct RangeSearchResult;
+
+/*********************************************************
+ * Distances between float queries and vectors stored in bf16
+ *
+ * The exhaustive searches compute blocks of query x database inner
+ * products that are passed to the top-k selection, like the BLAS searches
+ * of distances.h. When compiled with AVX512-BF16 (eg. the avx512_spr
+ * build), the queries are rounded to bf16 and the blocks are computed with
+ * AMX tiles if the kernel allows them, or else with vdpbf16ps, with float
+ * accumulators. Otherwise the database blocks are decoded to float and
+ * multiplied with sgemm.
+ *********************************************************/
+
+/// inner product of a float vector and a bf16 vector
+float fvec_inner_product_bf16(const float* x, const uint16_t* y, size_t d);
+
+/// squared L2 distance between a float vector and a bf16 vector
+float fvec_L2sqr_bf16(const float* x, const uint16_t* y, size_t d);
+
+/// true if the AVX512-BF16 (and possibly AMX) block kernels are compiled in
+bool bf16_block_kernel_has_simd();
+
+/** k nearest neighbors of the nx queries x in the ny bf16 vectors y,
+ * for the inner product (results sorted by decreasing similarity)
+ *
+ * @param distances  output similarities, size nx * k
+ * @param labels     output ids, size nx * k, -1 for missing results
+ */
+void knn_inner_product_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel = nullptr);
+
+/// same as knn_inner_product_bf16 for the squared L2 distance
+void knn_L2sqr_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel = nullptr);
+
+/// results of the bf16 vectors with an inner product > radius
+void range_search_inner_product_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel = nullptr);
+
+/// results of the bf16 vectors with a squared L2 distance < radius
+void range_search_L2sqr_bf16(
+        const float* x,
+        const uint16_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel = nullptr);
+
+} // namespace faiss
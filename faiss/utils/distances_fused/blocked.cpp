@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/distances_fused/blocked.h>
+
+#if defined(__AVX2__) || defined(__aarch64__)
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/utils/distances.h>
+
+#ifdef __AVX512F__
+#include <immintrin.h>
+#else
+#include <faiss/utils/simdlib.h>
+#endif
+
+namespace faiss {
+
+namespace {
+
+#ifdef __AVX512F__
+
+// 8 queries x 32 vectors, 16 accumulators out of 32 registers
+constexpr size_t W = 16;
+constexpr int NQ_MAX = 8;
+
+using vfloat = __m512;
+
+inline vfloat vzero() {
+    return _mm512_setzero_ps();
+}
+
+inline vfloat vload(const float* p) {
+    return _mm512_loadu_ps(p);
+}
+
+inline vfloat vset1(float x) {
+    return _mm512_set1_ps(x);
+}
+
+inline vfloat vfmadd(vfloat a, vfloat b, vfloat c) {
+    return _mm512_fmadd_ps(a, b, c);
+}
+
+inline void vstore(float* p, vfloat v) {
+    _mm512_storeu_ps(p, v);
+}
+
+#else
+
+// 6 queries x 16 vectors, 12 accumulators out of 16 registers
+constexpr size_t W = 8;
+constexpr int NQ_MAX = 6;
+
+using vfloat = simd8float32;
+
+inline vfloat vzero() {
+    return simd8float32(0.0f);
+}
+
+inline vfloat vload(const float* p) {
+    return simd8float32(p);
+}
+
+inline vfloat vset1(float x) {
+    return simd8float32(x);
+}
+
+inline vfloat vfmadd(vfloat a, vfloat b, vfloat c) {
+    return fmadd(a, b, c);
+}
+
+inline void vstore(float* p, vfloat v) {
+    v.storeu(p);
+}
+
+#endif
+
+// number of panels per register tile
+constexpr int NG = 2;
+
+// target size of a packed database block
+constexpr size_t block_bytes = 256 * 1024;
+
+/// pack ny vectors in panels of W: component k of vector p * W + n is
+/// stored at (p * d + k) * W + n. The panels are padded with zeros.
+void pack_panels(const float* y, size_t d, size_t ny, float* packed) {
+    size_t np = (ny + W - 1) / W;
+    for (size_t p = 0; p < np; p++) {
+        float* dst = packed + p * d * W;
+        for (size_t n = 0; n < W; n++) {
+            size_t j = p * W + n;
+            if (j < ny) {
+                const float* yj = y + j * d;
+                for (size_t k = 0; k < d; k++) {
+                    dst[k * W + n] = yj[k];
+                }
+            } else {
+                for (size_t k = 0; k < d; k++) {
+                    dst[k * W + n] = 0;
+                }
+            }
+        }
+    }
+}
+
+/// the state of a tile of NQ query heaps
+template <class C, int NQ>
+struct TileHeaps {
+    size_t k;
+    float* dis[NQ];
+    int64_t* ids[NQ];
+    float x_norms[NQ];
+};
+
+/** dot products of NQ queries with the vectors of NG panels, merged into
+ * the heaps. is_l2: the distance is |x|^2 + |y|^2 - 2 <x, y> */
+template <class C, bool is_l2, int NQ>
+void tile_kernel(
+        const float* x,
+        size_t d,
+        const float* panels,
+        size_t j0,
+        size_t n_valid,
+        const float* y_norms,
+        TileHeaps<C, NQ>& th) {
+    vfloat acc[NQ][NG];
+    for (int a = 0; a < NQ; a++) {
+        for (int g = 0; g < NG; g++) {
+            acc[a][g] = vzero();
+        }
+    }
+    for (size_t k = 0; k < d; k++) {
+        vfloat yv[NG];
+        for (int g = 0; g < NG; g++) {
+            yv[g] = vload(panels + (g * d + k) * W);
+        }
+        for (int a = 0; a < NQ; a++) {
+            vfloat xv = vset1(x[a * d + k]);
+            for (int g = 0; g < NG; g++) {
+                acc[a][g] = vfmadd(xv, yv[g], acc[a][g]);
+            }
+        }
+    }
+
+    // the tile is small enough to stay in L1
+    float tile[NQ][NG * W];
+    for (int a = 0; a < NQ; a++) {
+        for (int g = 0; g < NG; g++) {
+            vstore(tile[a] + g * W, acc[a][g]);
+        }
+    }
+    size_t n = std::min(n_valid, NG * W);
+    for (int a = 0; a < NQ; a++) {
+        float thr = th.dis[a][0];
+        for (size_t jj = 0; jj < n; jj++) {
+            float dis = tile[a][jj];
+            if (is_l2) {
+                dis = th.x_norms[a] + y_norms[jj] - 2 * dis;
+            }
+            if (C::cmp(thr, dis)) {
+                // negative values can occur for identical vectors
+                // due to roundoff errors
+                if (is_l2 && dis < 0) {
+                    dis = 0;
+                }
+                heap_replace_top<C>(
+                        th.k, th.dis[a], th.ids[a], dis, j0 + jj);
+                thr = th.dis[a][0];
+            }
+        }
+    }
+}
+
+/// NQ queries against the packed block of ny vectors starting at j0
+template <class C, bool is_l2, int NQ>
+void query_tile(
+        const float* x,
+        size_t i,
+        size_t d,
+        const float* packed,
+        size_t j0,
+        size_t ny,
+        const float* x_norms,
+        const float* y_norms,
+        HeapBlockResultHandler<C>& res) {
+    TileHeaps<C, NQ> th;
+    th.k = res.k;
+    for (int a = 0; a < NQ; a++) {
+        th.dis[a] = res.heap_dis_tab + (i + a) * res.k;
+        th.ids[a] = res.heap_ids_tab + (i + a) * res.k;
+        th.x_norms[a] = is_l2 ? x_norms[i + a] : 0;
+    }
+    const float* xi = x + i * d;
+    for (size_t j = 0; j < ny; j += NG * W) {
+        tile_kernel<C, is_l2, NQ>(
+                xi,
+                d,
+                packed + j * d,
+                j0 + j,
+                ny - j,
+                is_l2 ? y_norms + j0 + j : nullptr,
+                th);
+    }
+}
+
+template <class C, bool is_l2>
+void exhaustive_fused_heap(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<C>& res,
+        const float* y_norms) {
+    if (nx == 0 || ny == 0) {
+        // the results are still initialized
+        res.begin_multiple(0, nx);
+        res.end_multiple();
+        return;
+    }
+
+    std::vector<float> x_norms, y_norms2;
+    if (is_l2) {
+        x_norms.resize(nx);
+        fvec_norms_L2sqr(x_norms.data(), x, d, nx);
+        if (!y_norms) {
+            y_norms2.resize(ny);
+            fvec_norms_L2sqr(y_norms2.data(), y, d, ny);
+            y_norms = y_norms2.data();
+        }
+    }
+
+    // the block is a multiple of the register tile width
+    size_t bs_y = block_bytes / (d * sizeof(float));
+    bs_y = std::max(bs_y / (NG * W), size_t(1)) * (NG * W);
+    std::unique_ptr<float[]> packed(new float[bs_y * d]);
+
+    const size_t nt = nx / NQ_MAX;
+    const size_t i_tail = nt * NQ_MAX;
+
+    res.begin_multiple(0, nx);
+    for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+        size_t j1 = std::min(j0 + bs_y, ny);
+        pack_panels(y + j0 * d, d, j1 - j0, packed.get());
+
+#pragma omp parallel for if (nt > 1)
+        for (int64_t t = 0; t < nt; t++) {
+            query_tile<C, is_l2, NQ_MAX>(
+                    x,
+                    t * NQ_MAX,
+                    d,
+                    packed.get(),
+                    j0,
+                    j1 - j0,
+                    x_norms.data(),
+                    y_norms,
+                    res);
+        }
+
+        // the remaining queries (at most NQ_MAX - 1 of them)
+        switch (nx - i_tail) {
+#define DISPATCH(NQ)              \
+    case NQ:                      \
+        query_tile<C, is_l2, NQ>( \
+                x,                \
+                i_tail,           \
+                d,                \
+                packed.get(),     \
+                j0,               \
+                j1 - j0,          \
+                x_norms.data(),   \
+                y_norms,          \
+                res);             \
+        break;
+            DISPATCH(1)
+            DISPATCH(2)
+            DISPATCH(3)
+            DISPATCH(4)
+            DISPATCH(5)
+            DISPATCH(6)
+            DISPATCH(7)
+#undef DISPATCH
+        }
+        InterruptCallback::check();
+    }
+    res.end_multiple();
+}
+
+} // namespace
+
+void exhaustive_L2sqr_fused_heap_blocked(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMax<float, int64_t>>& res,
+        const float* y_norms) {
+    exhaustive_fused_heap<CMax<float, int64_t>, true>(
+            x, y, d, nx, ny, res, y_norms);
+}
+
+void exhaustive_inner_product_fused_heap_blocked(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMin<float, int64_t>>& res) {
+    exhaustive_fused_heap<CMin<float, int64_t>, false>(
+            x, y, d, nx, ny, res, nullptr);
+}
+
+} // namespace faiss
+
+#endif
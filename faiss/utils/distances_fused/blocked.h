@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Cache-blocked, register-tiled kernels for any dimensionality. The
+// database is processed by blocks that fit in the L2 cache, packed in
+// panels of simd-width vectors. Each tile of queries x vectors is computed
+// in registers and merged into the result heaps directly, so the
+// nx * ny distance matrix is never stored.
+
+#pragma once
+
+#include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/platform_macros.h>
+
+#include <faiss/utils/Heap.h>
+
+#if defined(__AVX2__) || defined(__aarch64__)
+
+namespace faiss {
+
+void exhaustive_L2sqr_fused_heap_blocked(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMax<float, int64_t>>& res,
+        const float* y_norms);
+
+void exhaustive_inner_product_fused_heap_blocked(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMin<float, int64_t>>& res);
+
+} // namespace faiss
+
+#endif
@@ -10,6 +10,7 @@
 #include <faiss/impl/platform_macros.h>
 
 #include <faiss/utils/distances_fused/avx512.h>
+#include <faiss/utils/distances_fused/blocked.h>
 #include <faiss/utils/distances_fused/simdlib_based.h>
 
 namespace faiss {
@@ -23,7 +24,9 @@ bool exhaustive_L2sqr_fused_cmax(
         Top1BlockResultHandler<CMax<float, int64_t>>& res,
         const float* y_norms) {
     if (nx == 0 || ny == 0) {
-        // nothing to do
+        // nothing to compute, the results are still initialized
+        res.begin_multiple(0, nx);
+        res.end_multiple();
         return true;
     }
 
@@ -39,4 +42,37 @@ bool exhaustive_L2sqr_fused_cmax(
 #endif
 }
 
+bool exhaustive_L2sqr_fused_heap(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMax<float, int64_t>>& res,
+        const float* y_norms) {
+#if defined(__AVX2__) || defined(__aarch64__)
+    exhaustive_L2sqr_fused_heap_blocked(x, y, d, nx, ny, res, y_norms);
+    return true;
+#else
+    // not supported, please use a general-purpose kernel
+    return false;
+#endif
+}
+
+bool exhaustive_inner_product_fused_heap(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMin<float, int64_t>>& res) {
+#if defined(__AVX2__) || defined(__aarch64__)
+    exhaustive_inner_product_fused_heap_blocked(x, y, d, nx, ny, res);
+    return true;
+#else
+    // not supported, please use a general-purpose kernel
+    return false;
+#endif
+}
+
 } // namespace faiss
@@ -14,8 +14,8 @@
 // InterruptCallback::check() is not used, because it is assumed that the
 // kernel takes a little time because of a tiny dimensionality.
 //
-// Later on, similar optimization can be implemented for large size vectors,
-// but a different kernel is needed.
+// The k-nn searches with heaps use a different, cache-blocked kernel for
+// any dimensionality, see blocked.h.
 //
 
 #pragma once
@@ -37,4 +37,26 @@ bool exhaustive_L2sqr_fused_cmax(
         Top1BlockResultHandler<CMax<float, int64_t>>& res,
         const float* y_norms);
 
+// Fused kernels for the k-nearest neighbor searches (1 < k <
+// distance_compute_min_k_reservoir) with any dimensionality: the database
+// is blocked for the cache and the distances of each register tile are
+// merged into the heaps, instead of an sgemm into a distance block
+// followed by a separate pass. Same return value as above.
+bool exhaustive_L2sqr_fused_heap(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMax<float, int64_t>>& res,
+        const float* y_norms);
+
+bool exhaustive_inner_product_fused_heap(
+        const float* x,
+        const float* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        HeapBlockResultHandler<CMin<float, int64_t>>& res);
+
 } // namespace faiss
@@ -0,0 +1,710 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/utils/distances_int8.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ResultHandler.h>
+#include <faiss/impl/platform_macros.h>
+#include <faiss/utils/distances.h>
+
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+#include <immintrin.h>
+#define FAISS_INT8_VNNI
+#if defined(__AMX_TILE__) && defined(__AMX_INT8__) && defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#define FAISS_INT8_AMX
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_DOTPROD)
+#include <arm_neon.h>
+#define FAISS_INT8_SDOT
+#endif
+
+#if defined(FAISS_INT8_VNNI) || defined(FAISS_INT8_SDOT)
+#define FAISS_INT8_SIMD
+#endif
+
+#ifndef FINTEGER
+#define FINTEGER long
+#endif
+
+#ifndef FAISS_INT8_SIMD
+extern "C" {
+
+/* declare BLAS functions, see http://www.netlib.org/clapack/cblas/ */
+
+int sgemm_(
+        const char* transa,
+        const char* transb,
+        FINTEGER* m,
+        FINTEGER* n,
+        FINTEGER* k,
+        const float* alpha,
+        const float* a,
+        FINTEGER* lda,
+        const float* b,
+        FINTEGER* ldb,
+        float* beta,
+        float* c,
+        FINTEGER* ldc);
+}
+#endif
+
+namespace faiss {
+
+namespace {
+
+inline float code_scale(const uint8_t* code, size_t d) {
+    float scale;
+    memcpy(&scale, code + d, sizeof(scale));
+    return scale;
+}
+
+/// quantize one vector, returns the scale
+float quantize_int8(const float* x, size_t d, int8_t* q) {
+    float amax = 0;
+    for (size_t i = 0; i < d; i++) {
+        amax = std::max(amax, std::fabs(x[i]));
+    }
+    float scale = amax / 127;
+    float inv = amax > 0 ? 127 / amax : 0;
+    for (size_t i = 0; i < d; i++) {
+        float v = std::round(x[i] * inv);
+        q[i] = int8_t(std::min(std::max(v, -127.0f), 127.0f));
+    }
+    return scale;
+}
+
+} // namespace
+
+void int8_encode(const float* x, size_t d, size_t n, uint8_t* codes) {
+    size_t cs = int8_code_size(d);
+#pragma omp parallel for if (n > 1000)
+    for (int64_t i = 0; i < n; i++) {
+        uint8_t* code = codes + i * cs;
+        float scale = quantize_int8(x + i * d, d, (int8_t*)code);
+        memcpy(code + d, &scale, sizeof(scale));
+    }
+}
+
+void int8_decode(const uint8_t* codes, size_t d, size_t n, float* x) {
+    size_t cs = int8_code_size(d);
+#pragma omp parallel for if (n > 1000)
+    for (int64_t i = 0; i < n; i++) {
+        const uint8_t* code = codes + i * cs;
+        float scale = code_scale(code, d);
+        for (size_t l = 0; l < d; l++) {
+            x[i * d + l] = scale * int8_t(code[l]);
+        }
+    }
+}
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_inner_product_int8(const float* x, const uint8_t* code, size_t d) {
+    const int8_t* y = (const int8_t*)code;
+    float res = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        res += x[i] * y[i];
+    }
+    return res * code_scale(code, d);
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_L2sqr_int8(const float* x, const uint8_t* code, size_t d) {
+    const int8_t* y = (const int8_t*)code;
+    const float scale = code_scale(code, d);
+    float res = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        const float tmp = x[i] - scale * y[i];
+        res += tmp * tmp;
+    }
+    return res;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+bool int8_block_kernel_has_simd() {
+#ifdef FAISS_INT8_SIMD
+    return true;
+#else
+    return false;
+#endif
+}
+
+namespace {
+
+#ifdef FAISS_INT8_SIMD
+
+/** int8 queries. The database vectors are packed by groups of 16: the
+ * components 4 * k4 .. 4 * k4 + 3 of the 16 vectors are 16 consecutive
+ * 32-bit words, so that the accumulators hold the dot products with 16
+ * vectors and no horizontal sums are needed. The query words are
+ * broadcast. The int32 dot products are converted with the scales of the
+ * query and the database vector. */
+
+/// ip[a * ldip + j] = dot products of NQ queries with n_valid vectors
+struct ScaledOutput {
+    const float* q_scale;
+    const float* y_scale;
+    float* ip;
+    size_t ldip;
+};
+
+#ifdef FAISS_INT8_VNNI
+
+/* vpdpbusd multiplies unsigned by signed bytes, so the database vectors are
+ * stored with an offset of 128 (their sign bit flipped) and
+ * 128 * sum(q) is subtracted from the dot products. */
+
+template <int NQ, int NG>
+void ip_kernel_int8(
+        const uint32_t* q,
+        const int32_t* q_corr,
+        size_t d4,
+        const uint32_t* y,
+        const ScaledOutput& out,
+        size_t n_valid) {
+    __m512i acc[NQ][NG];
+    for (int a = 0; a < NQ; a++) {
+        for (int g = 0; g < NG; g++) {
+            acc[a][g] = _mm512_setzero_si512();
+        }
+    }
+    for (size_t k4 = 0; k4 < d4; k4++) {
+        __m512i yv[NG];
+        for (int g = 0; g < NG; g++) {
+            yv[g] = _mm512_loadu_si512(y + (g * d4 + k4) * 16);
+        }
+        for (int a = 0; a < NQ; a++) {
+            __m512i qv = _mm512_set1_epi32(q[a * d4 + k4]);
+            for (int g = 0; g < NG; g++) {
+                acc[a][g] = _mm512_dpbusd_epi32(acc[a][g], yv[g], qv);
+            }
+        }
+    }
+    for (int g = 0; g < NG; g++) {
+        size_t n = n_valid > size_t(16 * g) ? n_valid - 16 * g : 0;
+        __mmask16 mask = n >= 16 ? 0xffff : (1u << n) - 1;
+        __m512 ys = _mm512_loadu_ps(out.y_scale + 16 * g);
+        for (int a = 0; a < NQ; a++) {
+            __m512i dot =
+                    _mm512_sub_epi32(acc[a][g], _mm512_set1_epi32(q_corr[a]));
+            __m512 v = _mm512_mul_ps(
+                    _mm512_cvtepi32_ps(dot),
+                    _mm512_mul_ps(ys, _mm512_set1_ps(out.q_scale[a])));
+            _mm512_mask_storeu_ps(out.ip + a * out.ldip + 16 * g, mask, v);
+        }
+    }
+}
+
+constexpr uint8_t y_byte_offset = 0x80;
+
+#else
+
+template <int NQ, int NG>
+void ip_kernel_int8(
+        const uint32_t* q,
+        const int32_t* /* q_corr */,
+        size_t d4,
+        const uint32_t* y,
+        const ScaledOutput& out,
+        size_t n_valid) {
+    int32x4_t acc[NQ][NG][4];
+    for (int a = 0; a < NQ; a++) {
+        for (int g = 0; g < NG; g++) {
+            for (int c = 0; c < 4; c++) {
+                acc[a][g][c] = vdupq_n_s32(0);
+            }
+        }
+    }
+    for (size_t k4 = 0; k4 < d4; k4++) {
+        int8x16_t yv[NG][4];
+        for (int g = 0; g < NG; g++) {
+            const int8_t* yg = (const int8_t*)(y + (g * d4 + k4) * 16);
+            for (int c = 0; c < 4; c++) {
+                yv[g][c] = vld1q_s8(yg + 16 * c);
+            }
+        }
+        for (int a = 0; a < NQ; a++) {
+            int8x16_t qv = vreinterpretq_s8_u32(vdupq_n_u32(q[a * d4 + k4]));
+            for (int g = 0; g < NG; g++) {
+                for (int c = 0; c < 4; c++) {
+                    acc[a][g][c] = vdotq_s32(acc[a][g][c], yv[g][c], qv);
+                }
+            }
+        }
+    }
+    for (int g = 0; g < NG; g++) {
+        size_t n = n_valid > size_t(16 * g) ? n_valid - 16 * g : 0;
+        n = std::min(n, size_t(16));
+        for (int a = 0; a < NQ; a++) {
+            float tmp[16];
+            for (int c = 0; c < 4; c++) {
+                float32x4_t ys = vld1q_f32(out.y_scale + 16 * g + 4 * c);
+                vst1q_f32(
+                        tmp + 4 * c,
+                        vmulq_n_f32(
+                                vmulq_f32(vcvtq_f32_s32(acc[a][g][c]), ys),
+                                out.q_scale[a]));
+            }
+            memcpy(out.ip + a * out.ldip + 16 * g, tmp, n * sizeof(float));
+        }
+    }
+}
+
+constexpr uint8_t y_byte_offset = 0;
+
+#endif
+
+template <int NQ>
+void ip_rows_int8(
+        const uint32_t* q,
+        const int32_t* q_corr,
+        size_t d4,
+        const uint32_t* y,
+        size_t ny,
+        ScaledOutput out) {
+    size_t j = 0;
+    for (; j + 16 < ny; j += 32) {
+        ScaledOutput o = {out.q_scale, out.y_scale + j, out.ip + j, out.ldip};
+        ip_kernel_int8<NQ, 2>(q, q_corr, d4, y + j * d4, o, ny - j);
+    }
+    if (j < ny) {
+        ScaledOutput o = {out.q_scale, out.y_scale + j, out.ip + j, out.ldip};
+        ip_kernel_int8<NQ, 1>(q, q_corr, d4, y + j * d4, o, ny - j);
+    }
+}
+
+#ifdef FAISS_INT8_AMX
+
+/// the tile data state must be requested from the kernel before use
+bool amx_available() {
+    static const bool ok = syscall(
+                                   SYS_arch_prctl,
+                                   0x1023 /* ARCH_REQ_XCOMP_PERM */,
+                                   18 /* XFEATURE_XTILEDATA */) == 0;
+    return ok;
+}
+
+/// 8 tiles of 16 rows of 64 bytes
+struct TileConfig {
+    uint8_t palette_id = 1;
+    uint8_t start_row = 0;
+    uint8_t reserved[14] = {};
+    uint16_t colsb[16] = {};
+    uint8_t rows[16] = {};
+
+    TileConfig() {
+        for (int t = 0; t < 8; t++) {
+            colsb[t] = 64;
+            rows[t] = 16;
+        }
+    }
+};
+
+/** 32 queries x 32 database vectors per step: tiles 0-3 accumulate, 4-5
+ * hold 16 queries x 64 components and 6-7 16 words of components x 16
+ * packed vectors. q and y are padded so that all tiles are full. */
+void ip_rows_amx(
+        const uint32_t* q,
+        size_t nq,
+        size_t d4,
+        const uint32_t* y,
+        size_t ny,
+        ScaledOutput out) {
+    alignas(64) int32_t c[4][256];
+    for (size_t j = 0; j < ny; j += 32) {
+        const uint32_t* y0 = y + j * d4;
+        const uint32_t* y1 = y0 + 16 * d4;
+        _tile_zero(0);
+        _tile_zero(1);
+        _tile_zero(2);
+        _tile_zero(3);
+        for (size_t k4 = 0; k4 < d4; k4 += 16) {
+            _tile_loadd(4, q + k4, d4 * 4);
+            _tile_loadd(5, q + 16 * d4 + k4, d4 * 4);
+            _tile_loadd(6, y0 + k4 * 16, 64);
+            _tile_loadd(7, y1 + k4 * 16, 64);
+            _tile_dpbssd(0, 4, 6);
+            _tile_dpbssd(1, 4, 7);
+            _tile_dpbssd(2, 5, 6);
+            _tile_dpbssd(3, 5, 7);
+        }
+        _tile_stored(0, c[0], 64);
+        _tile_stored(1, c[1], 64);
+        _tile_stored(2, c[2], 64);
+        _tile_stored(3, c[3], 64);
+        for (int t = 0; t < 4; t++) {
+            size_t i0 = 16 * (t / 2), j0 = j + 16 * (t % 2);
+            if (i0 >= nq || j0 >= ny) {
+                continue;
+            }
+            size_t ni = std::min(nq - i0, size_t(16));
+            size_t nj = std::min(ny - j0, size_t(16));
+            for (size_t i = 0; i < ni; i++) {
+                float qs = out.q_scale[i0 + i];
+                float* ip_i = out.ip + (i0 + i) * out.ldip + j0;
+                for (size_t jj = 0; jj < nj; jj++) {
+                    ip_i[jj] = c[t][i * 16 + jj] * qs * out.y_scale[j0 + jj];
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+/** With AMX (compiled in and allowed by the kernel), the packed groups are
+ * the B tiles of tdpbssd. The components are then padded to a multiple of
+ * 64, the queries and the database vectors to multiples of 32. */
+struct BlockInnerProducts {
+    size_t d, d4;
+    bool amx = false;
+    std::vector<uint32_t> q;
+    std::vector<float> q_scale;
+    std::vector<int32_t> q_corr;
+    size_t nq = 0;
+    std::vector<uint32_t> y_packed;
+    std::vector<float> y_scale;
+
+    explicit BlockInnerProducts(size_t d) : d(d) {
+#ifdef FAISS_INT8_AMX
+        amx = amx_available();
+#endif
+        d4 = amx ? (d + 63) / 64 * 16 : (d + 3) / 4;
+    }
+
+    void set_queries(const float* x, size_t n) {
+        nq = n;
+        q.assign((amx ? (n + 31) / 32 * 32 : n) * d4, 0);
+        q_scale.resize(n);
+        q_corr.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            int8_t* qi = (int8_t*)(q.data() + i * d4);
+            q_scale[i] = quantize_int8(x + i * d, d, qi);
+            int32_t sum = 0;
+            for (size_t l = 0; l < d; l++) {
+                sum += qi[l];
+            }
+            q_corr[i] = 128 * sum;
+        }
+    }
+
+    void pack_database(const uint8_t* codes, size_t ny) {
+        size_t cs = int8_code_size(d);
+        size_t ng = amx ? (ny + 31) / 32 * 2 : (ny + 15) / 16;
+        y_packed.assign(ng * d4 * 16, 0);
+        y_scale.assign(ng * 16, 0);
+        // tdpbssd multiplies signed bytes, no offset
+        const uint32_t offset = amx ? 0 : y_byte_offset * 0x01010101u;
+        for (size_t j = 0; j < ny; j++) {
+            const uint8_t* code = codes + j * cs;
+            uint32_t* dst = y_packed.data() + (j / 16) * d4 * 16 + j % 16;
+            for (size_t k4 = 0; k4 < d4; k4++) {
+                uint32_t w = 0;
+                if (4 * k4 + 4 <= d) {
+                    memcpy(&w, code + 4 * k4, 4);
+                } else if (4 * k4 < d) {
+                    memcpy(&w, code + 4 * k4, d - 4 * k4);
+                }
+                dst[k4 * 16] = w ^ offset;
+            }
+            y_scale[j] = code_scale(code, d);
+        }
+    }
+
+    /// ip[i * ny + j] = <q_i, y_j>
+    void compute(const uint8_t* codes, size_t ny, float* ip) {
+        pack_database(codes, ny);
+        const uint32_t* yp = y_packed.data();
+#ifdef FAISS_INT8_AMX
+        if (amx) {
+            int64_t nq32 = (nq + 31) / 32;
+#pragma omp parallel if (nq32 > 1)
+            {
+                TileConfig cfg;
+                _tile_loadconfig(&cfg);
+#pragma omp for
+                for (int64_t i = 0; i < nq32; i++) {
+                    ScaledOutput out = {
+                            q_scale.data() + i * 32,
+                            y_scale.data(),
+                            ip + i * 32 * ny,
+                            ny};
+                    ip_rows_amx(
+                            q.data() + i * 32 * d4,
+                            nq - i * 32,
+                            d4,
+                            yp,
+                            ny,
+                            out);
+                }
+                _tile_release();
+            }
+            return;
+        }
+#endif
+        int64_t nq8 = nq / 8;
+#pragma omp parallel for if (nq8 > 1)
+        for (int64_t i = 0; i < nq8; i++) {
+            ScaledOutput out = {
+                    q_scale.data() + i * 8,
+                    y_scale.data(),
+                    ip + i * 8 * ny,
+                    ny};
+            ip_rows_int8<8>(
+                    q.data() + i * 8 * d4,
+                    q_corr.data() + i * 8,
+                    d4,
+                    yp,
+                    ny,
+                    out);
+        }
+        size_t i0 = nq8 * 8;
+        const uint32_t* qi = q.data() + i0 * d4;
+        const int32_t* ci = q_corr.data() + i0;
+        ScaledOutput out = {
+                q_scale.data() + i0, y_scale.data(), ip + i0 * ny, ny};
+        switch (nq - i0) {
+#define DISPATCH(NQ)                               \
+    case NQ:                                       \
+        ip_rows_int8<NQ>(qi, ci, d4, yp, ny, out); \
+        break;
+            DISPATCH(1);
+            DISPATCH(2);
+            DISPATCH(3);
+            DISPATCH(4);
+            DISPATCH(5);
+            DISPATCH(6);
+            DISPATCH(7);
+#undef DISPATCH
+        }
+    }
+};
+
+#else
+
+/// float queries, multiplied with sgemm by the decoded database vectors
+struct BlockInnerProducts {
+    size_t d;
+    const float* x = nullptr;
+    size_t nq = 0;
+    std::vector<float> y_decoded;
+
+    explicit BlockInnerProducts(size_t d) : d(d) {}
+
+    void set_queries(const float* x_in, size_t n) {
+        x = x_in;
+        nq = n;
+    }
+
+    void compute(const uint8_t* codes, size_t ny, float* ip) {
+        y_decoded.resize(ny * d);
+        int8_decode(codes, d, ny, y_decoded.data());
+        float one = 1, zero = 0;
+        FINTEGER nyi = ny, nxi = nq, di = d;
+        sgemm_("Transpose",
+               "Not transpose",
+               &nyi,
+               &nxi,
+               &di,
+               &one,
+               y_decoded.data(),
+               &di,
+               x,
+               &di,
+               &zero,
+               ip,
+               &nyi);
+    }
+};
+
+#endif
+
+float int8_norm_L2sqr(const uint8_t* code, size_t d) {
+    const int8_t* y = (const int8_t*)code;
+    int32_t res = 0;
+    for (size_t i = 0; i < d; i++) {
+        res += int32_t(y[i]) * y[i];
+    }
+    float scale = code_scale(code, d);
+    return res * scale * scale;
+}
+
+struct Run_search_int8 {
+    using T = void;
+    template <class BlockResultHandler>
+    void f(BlockResultHandler& res,
+           const float* x,
+           const uint8_t* codes,
+           size_t d,
+           size_t nx,
+           size_t ny,
+           bool is_l2) {
+        if (nx == 0 || ny == 0) {
+            return;
+        }
+        const size_t cs = int8_code_size(d);
+        const size_t bs_x = distance_compute_blas_query_bs;
+        const size_t bs_y = distance_compute_blas_database_bs;
+        std::unique_ptr<float[]> ip_block(new float[bs_x * bs_y]);
+        std::vector<float> x_norms, y_norms;
+        if (is_l2) {
+            x_norms.resize(nx);
+            fvec_norms_L2sqr(x_norms.data(), x, d, nx);
+            y_norms.resize(bs_y);
+        }
+        // excluded vectors get a distance that is never selected
+        const float excluded = is_l2 ? HUGE_VALF : -HUGE_VALF;
+        BlockInnerProducts bip(d);
+
+        for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
+            size_t i1 = std::min(i0 + bs_x, nx);
+            res.begin_multiple(i0, i1);
+            bip.set_queries(x + i0 * d, i1 - i0);
+
+            for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                size_t j1 = std::min(j0 + bs_y, ny);
+                bip.compute(codes + j0 * cs, j1 - j0, ip_block.get());
+                if (is_l2) {
+                    for (size_t j = j0; j < j1; j++) {
+                        y_norms[j - j0] = int8_norm_L2sqr(codes + j * cs, d);
+                    }
+                }
+                if (is_l2 || res.sel) {
+#pragma omp parallel for if (i1 - i0 > 1)
+                    for (int64_t i = i0; i < i1; i++) {
+                        float* ip_line = ip_block.get() + (i - i0) * (j1 - j0);
+                        for (size_t j = j0; j < j1; j++) {
+                            float dis = ip_line[j - j0];
+                            if (is_l2) {
+                                dis = x_norms[i] + y_norms[j - j0] - 2 * dis;
+                                // negative values can occur for identical
+                                // vectors due to roundoff errors
+                                dis = std::max(dis, 0.0f);
+                            }
+                            if (!res.is_in_selection(j)) {
+                                dis = excluded;
+                            }
+                            ip_line[j - j0] = dis;
+                        }
+                    }
+                }
+                res.add_results(j0, j1, ip_block.get());
+            }
+            res.end_multiple();
+            InterruptCallback::check();
+        }
+    }
+};
+
+} // namespace
+
+void knn_inner_product_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel) {
+    Run_search_int8 r;
+    dispatch_knn_ResultHandler(
+            nx,
+            distances,
+            labels,
+            k,
+            METRIC_INNER_PRODUCT,
+            sel,
+            r,
+            x,
+            codes,
+            d,
+            nx,
+            ny,
+            false);
+}
+
+void knn_L2sqr_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel) {
+    Run_search_int8 r;
+    dispatch_knn_ResultHandler(
+            nx,
+            distances,
+            labels,
+            k,
+            METRIC_L2,
+            sel,
+            r,
+            x,
+            codes,
+            d,
+            nx,
+            ny,
+            true);
+}
+
+void range_search_inner_product_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel) {
+    Run_search_int8 r;
+    dispatch_range_ResultHandler(
+            result,
+            radius,
+            METRIC_INNER_PRODUCT,
+            sel,
+            r,
+            x,
+            codes,
+            d,
+            nx,
+            ny,
+            false);
+}
+
+void range_search_L2sqr_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel) {
+    Run_search_int8 r;
+    dispatch_range_ResultHandler(
+            result, radius, METRIC_L2, sel, r, x, codes, d, nx, ny, true);
+}
+
+} // namespace faiss
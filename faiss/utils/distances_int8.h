@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace faiss {
+
+struct IDSelector;
+struct RangeSearchResult;
+
+/*********************************************************
+ * Distances between float queries and int8 vectors
+ *
+ * The vectors are quantized symmetrically, with one scale per vector: a
+ * code is d int8 components in [-127, 127] followed by the float scale,
+ * and component i decodes to scale * code[i].
+ *
+ * The exhaustive searches quantize the queries in the same way, once, and
+ * compute blocks of int8 x int8 -> int32 dot products that are converted
+ * with the scales and passed to the top-k selection. The block kernel uses
+ * AMX-INT8 tiles if compiled in and allowed by the kernel, or else
+ * AVX512-VNNI (vpdpbusd) or ARM dot product instructions (sdot). Otherwise
+ * the database blocks are decoded to float and multiplied with sgemm.
+ *********************************************************/
+
+inline size_t int8_code_size(size_t d) {
+    return d + sizeof(float);
+}
+
+/// quantize n vectors to int8 codes of size int8_code_size(d)
+void int8_encode(const float* x, size_t d, size_t n, uint8_t* codes);
+
+/// decode n int8 codes
+void int8_decode(const uint8_t* codes, size_t d, size_t n, float* x);
+
+/// inner product of a float vector and an int8 code
+float fvec_inner_product_int8(const float* x, const uint8_t* code, size_t d);
+
+/// squared L2 distance between a float vector and an int8 code
+float fvec_L2sqr_int8(const float* x, const uint8_t* code, size_t d);
+
+/// true if an int8 dot product block kernel is compiled in
+bool int8_block_kernel_has_simd();
+
+/** k nearest neighbors of the nx queries x in the ny int8 codes, for the
+ * inner product (results sorted by decreasing similarity)
+ *
+ * @param distances  output similarities, size nx * k
+ * @param labels     output ids, size nx * k, -1 for missing results
+ */
+void knn_inner_product_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel = nullptr);
+
+/// same as knn_inner_product_int8 for the squared L2 distance
+void knn_L2sqr_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        size_t k,
+        float* distances,
+        int64_t* labels,
+        const IDSelector* sel = nullptr);
+
+/// results of the int8 codes with an inner product > radius
+void range_search_inner_product_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel = nullptr);
+
+/// results of the int8 codes with a squared L2 distance < radius
+void range_search_L2sqr_int8(
+        const float* x,
+        const uint8_t* codes,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        float radius,
+        RangeSearchResult* result,
+        const IDSelector* sel = nullptr);
+
+} // namespace faiss
@@ -17,6 +17,7 @@
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/platform_macros.h>
+#include <faiss/utils/simd_dispatch/distances-inl.h>
 #include <faiss/utils/simdlib.h>
 
 #ifdef __SSE3__
@@ -188,83 +189,87 @@ void fvec_inner_products_ny_ref(
 }
 
 /*********************************************************
- * Autovectorized implementations
+ * Autovectorized implementations, in simd_dispatch/distances-inl.h. With
+ * FAISS_ENABLE_DISPATCH they are called through the kernels of the SIMD
+ * level selected at runtime.
  */
 
-FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+#ifdef FAISS_ENABLE_DISPATCH
+
 float fvec_inner_product(const float* x, const float* y, size_t d) {
-    float res = 0.F;
-    FAISS_PRAGMA_IMPRECISE_LOOP
-    for (size_t i = 0; i != d; ++i) {
-        res += x[i] * y[i];
-    }
-    return res;
+    return get_distance_kernels().inner_product(x, y, d);
 }
-FAISS_PRAGMA_IMPRECISE_FUNCTION_END
 
-FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
 float fvec_norm_L2sqr(const float* x, size_t d) {
-    // the double in the _ref is suspected to be a typo. Some of the manual
-    // implementations this replaces used float.
-    float res = 0;
-    FAISS_PRAGMA_IMPRECISE_LOOP
-    for (size_t i = 0; i != d; ++i) {
-        res += x[i] * x[i];
-    }
+    return get_distance_kernels().norm_L2sqr(x, d);
+}
 
-    return res;
+float fvec_L2sqr(const float* x, const float* y, size_t d) {
+    return get_distance_kernels().L2sqr(x, y, d);
+}
+
+void fvec_inner_product_batch_4(
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
+        const size_t d,
+        float& dis0,
+        float& dis1,
+        float& dis2,
+        float& dis3) {
+    get_distance_kernels().inner_product_batch_4(
+            x, y0, y1, y2, y3, d, dis0, dis1, dis2, dis3);
+}
+
+void fvec_L2sqr_batch_4(
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
+        const size_t d,
+        float& dis0,
+        float& dis1,
+        float& dis2,
+        float& dis3) {
+    get_distance_kernels().L2sqr_batch_4(
+            x, y0, y1, y2, y3, d, dis0, dis1, dis2, dis3);
+}
+
+#else
+
+float fvec_inner_product(const float* x, const float* y, size_t d) {
+    return kernel_inner_product(x, y, d);
+}
+
+float fvec_norm_L2sqr(const float* x, size_t d) {
+    return kernel_norm_L2sqr(x, d);
 }
-FAISS_PRAGMA_IMPRECISE_FUNCTION_END
 
-FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
 float fvec_L2sqr(const float* x, const float* y, size_t d) {
-    size_t i;
-    float res = 0;
-    FAISS_PRAGMA_IMPRECISE_LOOP
-    for (i = 0; i < d; i++) {
-        const float tmp = x[i] - y[i];
-        res += tmp * tmp;
-    }
-    return res;
+    return kernel_L2sqr(x, y, d);
 }
-FAISS_PRAGMA_IMPRECISE_FUNCTION_END
 
 /// Special version of inner product that computes 4 distances
 /// between x and yi
-FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
 void fvec_inner_product_batch_4(
-        const float* __restrict x,
-        const float* __restrict y0,
-        const float* __restrict y1,
-        const float* __restrict y2,
-        const float* __restrict y3,
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
         const size_t d,
         float& dis0,
         float& dis1,
         float& dis2,
         float& dis3) {
-    float d0 = 0;
-    float d1 = 0;
-    float d2 = 0;
-    float d3 = 0;
-    FAISS_PRAGMA_IMPRECISE_LOOP
-    for (size_t i = 0; i < d; ++i) {
-        d0 += x[i] * y0[i];
-        d1 += x[i] * y1[i];
-        d2 += x[i] * y2[i];
-        d3 += x[i] * y3[i];
-    }
-
-    dis0 = d0;
-    dis1 = d1;
-    dis2 = d2;
-    dis3 = d3;
+    kernel_inner_product_batch_4(x, y0, y1, y2, y3, d, dis0, dis1, dis2, dis3);
 }
-FAISS_PRAGMA_IMPRECISE_FUNCTION_END
 
 /// Special version of L2sqr that computes 4 distances
 /// between x and yi, which is performance oriented.
-FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
 void fvec_L2sqr_batch_4(
         const float* x,
         const float* y0,
@@ -276,28 +281,10 @@ void fvec_L2sqr_batch_4(
         float& dis1,
         float& dis2,
         float& dis3) {
-    float d0 = 0;
-    float d1 = 0;
-    float d2 = 0;
-    float d3 = 0;
-    FAISS_PRAGMA_IMPRECISE_LOOP
-    for (size_t i = 0; i < d; ++i) {
-        const float q0 = x[i] - y0[i];
-        const float q1 = x[i] - y1[i];
-        const float q2 = x[i] - y2[i];
-        const float q3 = x[i] - y3[i];
-        d0 += q0 * q0;
-        d1 += q1 * q1;
-        d2 += q2 * q2;
-        d3 += q3 * q3;
-    }
-
-    dis0 = d0;
-    dis1 = d1;
-    dis2 = d2;
-    dis3 = d3;
-}
-FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+    kernel_L2sqr_batch_4(x, y0, y1, y2, y3, d, dis0, dis1, dis2, dis3);
+}
+
+#endif
 
 /*********************************************************
  * SSE and AVX implementations
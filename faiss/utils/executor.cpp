@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/utils/executor.h>
+
+#include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+namespace {
+
+thread_local bool in_task = false;
+
+/// marks the calling thread as running a task, with a single OpenMP
+/// thread for the nested parallel regions
+struct TaskScope {
+    bool prev_in_task;
+    int prev_omp_threads;
+
+    TaskScope() : prev_in_task(in_task), prev_omp_threads(omp_get_max_threads()) {
+        in_task = true;
+        omp_set_num_threads(1);
+    }
+
+    ~TaskScope() {
+        omp_set_num_threads(prev_omp_threads);
+        in_task = prev_in_task;
+    }
+};
+
+/// keeps the first exception thrown by the tasks
+struct FirstException {
+    std::mutex mutex;
+    std::exception_ptr ex;
+
+    void capture() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ex) {
+            ex = std::current_exception();
+        }
+    }
+
+    void rethrow() {
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    }
+};
+
+std::mutex executor_mutex;
+std::shared_ptr<Executor> current_executor;
+
+} // namespace
+
+/***********************************************************
+ * OpenMPExecutor
+ ***********************************************************/
+
+int OpenMPExecutor::max_workers() const {
+    return omp_get_max_threads();
+}
+
+void OpenMPExecutor::run(
+        int nworkers,
+        const std::function<void(int)>& task) {
+    FirstException first;
+#pragma omp parallel num_threads(nworkers)
+    {
+        // the runtime may start fewer threads than requested
+        for (int rank = omp_get_thread_num(); rank < nworkers;
+             rank += omp_get_num_threads()) {
+            TaskScope scope;
+            try {
+                task(rank);
+            } catch (...) {
+                first.capture();
+            }
+        }
+    }
+    first.rethrow();
+}
+
+/***********************************************************
+ * ThreadPoolExecutor
+ ***********************************************************/
+
+struct ThreadPoolExecutor::Job {
+    const std::function<void(int)>& task;
+    int nworkers;
+    std::atomic<int> next_rank{0};
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int ndone = 0;
+    FirstException first;
+
+    Job(const std::function<void(int)>& task, int nworkers)
+            : task(task), nworkers(nworkers) {}
+
+    /// run the next rank that was not picked up, false if there is none.
+    /// task is only accessed while a rank is pending, so the stale queue
+    /// entries of a finished job do not touch it
+    bool run_one() {
+        int rank = next_rank.fetch_add(1);
+        if (rank >= nworkers) {
+            return false;
+        }
+        {
+            TaskScope scope;
+            try {
+                task(rank);
+            } catch (...) {
+                first.capture();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++ndone == nworkers) {
+            cv.notify_all();
+        }
+        return true;
+    }
+};
+
+ThreadPoolExecutor::ThreadPoolExecutor(int nthreads) : nthreads(nthreads) {
+    FAISS_THROW_IF_NOT(nthreads > 0);
+    for (int i = 1; i < nthreads; i++) {
+        threads.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+int ThreadPoolExecutor::max_workers() const {
+    return nthreads;
+}
+
+void ThreadPoolExecutor::worker_loop() {
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stop || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        job->run_one();
+    }
+}
+
+void ThreadPoolExecutor::run(
+        int nworkers,
+        const std::function<void(int)>& task) {
+    auto job = std::make_shared<Job>(task, nworkers);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 1; i < nworkers; i++) {
+            queue.push_back(job);
+        }
+    }
+    if (nworkers > 2) {
+        cv.notify_all();
+    } else if (nworkers == 2) {
+        cv.notify_one();
+    }
+    // the calling thread works on its own job until all ranks are taken
+    while (job->run_one()) {
+    }
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->cv.wait(lock, [&]() { return job->ndone == nworkers; });
+    }
+    job->first.rethrow();
+}
+
+/***********************************************************
+ * Process-wide executor
+ ***********************************************************/
+
+void set_executor(std::shared_ptr<Executor> executor) {
+    std::lock_guard<std::mutex> lock(executor_mutex);
+    current_executor = std::move(executor);
+}
+
+std::shared_ptr<Executor> get_executor() {
+    std::lock_guard<std::mutex> lock(executor_mutex);
+    if (!current_executor) {
+        current_executor = std::make_shared<OpenMPExecutor>();
+    }
+    return current_executor;
+}
+
+bool in_executor_task() {
+    return in_task;
+}
+
+int parallel_workers(size_t n) {
+    if (n <= 1 || in_task || omp_in_parallel()) {
+        return 1;
+    }
+    return (int)std::min(n, (size_t)std::max(get_executor()->max_workers(), 1));
+}
+
+void parallel_run(int nworkers, const std::function<void(int)>& task) {
+    if (nworkers <= 1) {
+        task(0);
+        return;
+    }
+    get_executor()->run(nworkers, task);
+}
+
+void parallel_for(
+        int nworkers,
+        size_t n,
+        const std::function<void(int rank, size_t i)>& f,
+        size_t chunk_size) {
+    if (nworkers <= 1) {
+        for (size_t i = 0; i < n; i++) {
+            f(0, i);
+        }
+        return;
+    }
+    chunk_size = std::max(chunk_size, (size_t)1);
+    std::atomic<size_t> next(0);
+    get_executor()->run(nworkers, [&](int rank) {
+        for (;;) {
+            size_t i0 = next.fetch_add(chunk_size);
+            if (i0 >= n) {
+                break;
+            }
+            size_t i1 = std::min(i0 + chunk_size, n);
+            for (size_t i = i0; i < i1; i++) {
+                f(rank, i);
+            }
+        }
+    });
+}
+
+} // namespace faiss
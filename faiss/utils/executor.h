@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Pluggable parallel executor.
+ *
+ * The parallel loops of the search, add and train hot paths (IndexHNSW,
+ * IndexIVF, Clustering) run their workers through the process-wide
+ * executor instead of opening OpenMP parallel regions directly. By default
+ * it is an OpenMPExecutor, with the same behavior as before. A server that
+ * has its own threads can install a ThreadPoolExecutor, or an Executor
+ * subclass that forwards to its pool, to avoid the oversubscription and
+ * the OpenMP spin-waits between small requests.
+ *
+ * Nested parallelism is managed by the executor: a parallel loop started
+ * from within a task of the executor runs serially on the calling thread,
+ * and the tasks run with a single OpenMP thread. A parallel loop with a
+ * single worker runs inline, without starting a team.
+ */
+
+namespace faiss {
+
+struct Executor {
+    /// nb of workers that a parallel loop uses by default
+    virtual int max_workers() const = 0;
+
+    /** Run task(rank) for rank = 0..nworkers-1 concurrently and return
+     * when all are done. May be called from several threads at the same
+     * time. If tasks throw, the first exception is rethrown. */
+    virtual void run(int nworkers, const std::function<void(int)>& task) = 0;
+
+    virtual ~Executor() {}
+};
+
+/// runs the tasks in an OpenMP parallel region
+struct OpenMPExecutor : Executor {
+    int max_workers() const override;
+    void run(int nworkers, const std::function<void(int)>& task) override;
+};
+
+/** Fixed pool of threads that sleep on a condition variable between
+ * tasks. The calling thread of run() is one of the workers: it runs the
+ * ranks that no pool thread has picked up yet, so concurrent calls from
+ * several threads always make progress. */
+struct ThreadPoolExecutor : Executor {
+    /// nthreads workers, including the calling thread
+    explicit ThreadPoolExecutor(int nthreads);
+    ~ThreadPoolExecutor() override;
+
+    int max_workers() const override;
+    void run(int nworkers, const std::function<void(int)>& task) override;
+
+   private:
+    struct Job;
+
+    int nthreads;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<Job>> queue;
+    bool stop = false;
+
+    void worker_loop();
+};
+
+/// install the process-wide executor, nullptr restores the OpenMP one
+void set_executor(std::shared_ptr<Executor> executor);
+
+std::shared_ptr<Executor> get_executor();
+
+/// true on the threads that run a task of an executor
+bool in_executor_task();
+
+/** nb of workers for a parallel loop over n items: 1 if n <= 1 or when
+ * called from a parallel task or OpenMP region (nested loops run
+ * serially), otherwise min(n, max_workers()) */
+int parallel_workers(size_t n);
+
+/// run task(rank) for rank < nworkers on the executor, or inline on the
+/// calling thread if nworkers <= 1
+void parallel_run(int nworkers, const std::function<void(int)>& task);
+
+/** Call f(rank, i) for i in [0, n) on nworkers workers (typically
+ * parallel_workers(n), that sizes the per-worker accumulators), with the
+ * items handed out dynamically by chunks of chunk_size. */
+void parallel_for(
+        int nworkers,
+        size_t n,
+        const std::function<void(int rank, size_t i)>& f,
+        size_t chunk_size = 1);
+
+} // namespace faiss
@@ -70,37 +70,21 @@ template <>
 inline float VectorDistance<METRIC_Lp>::operator()(
         const float* x,
         const float* y) const {
-    float accu = 0;
-    for (size_t i = 0; i < d; i++) {
-        float diff = fabs(x[i] - y[i]);
-        accu += powf(diff, metric_arg);
-    }
-    return accu;
+    return fvec_Lp(x, y, d, metric_arg);
 }
 
 template <>
 inline float VectorDistance<METRIC_Canberra>::operator()(
         const float* x,
         const float* y) const {
-    float accu = 0;
-    for (size_t i = 0; i < d; i++) {
-        float xi = x[i], yi = y[i];
-        accu += fabs(xi - yi) / (fabs(xi) + fabs(yi));
-    }
-    return accu;
+    return fvec_Canberra(x, y, d);
 }
 
 template <>
 inline float VectorDistance<METRIC_BrayCurtis>::operator()(
         const float* x,
         const float* y) const {
-    float accu_num = 0, accu_den = 0;
-    for (size_t i = 0; i < d; i++) {
-        float xi = x[i], yi = y[i];
-        accu_num += fabs(xi - yi);
-        accu_den += fabs(xi + yi);
-    }
-    return accu_num / accu_den;
+    return fvec_BrayCurtis(x, y, d);
 }
 
 template <>
@@ -124,12 +108,7 @@ inline float VectorDistance<METRIC_Jaccard>::operator()(
         const float* y) const {
     // WARNING: this distance is defined only for positive input vectors.
     // Providing vectors with negative values would lead to incorrect results.
-    float accu_num = 0, accu_den = 0;
-    for (size_t i = 0; i < d; i++) {
-        accu_num += fmin(x[i], y[i]);
-        accu_den += fmax(x[i], y[i]);
-    }
-    return accu_num / accu_den;
+    return fvec_Jaccard(x, y, d);
 }
 
 template <>
@@ -156,11 +135,7 @@ template <>
 inline float VectorDistance<METRIC_ABS_INNER_PRODUCT>::operator()(
         const float* x,
         const float* y) const {
-    float accu = 0;
-    for (size_t i = 0; i < d; i++) {
-        accu += fabs(x[i] * y[i]);
-    }
-    return accu;
+    return fvec_abs_inner_product(x, y, d);
 }
 
 /***************************************************************************
@@ -15,10 +15,85 @@
 
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/platform_macros.h>
+#include <faiss/utils/distances.h>
 #include <faiss/utils/utils.h>
 
 namespace faiss {
 
+/***************************************************************************
+ * Vector distance kernels
+ *
+ * Written as plain loops that the compiler vectorizes: the reductions are
+ * reordered (imprecise function) and the branches are selects.
+ ***************************************************************************/
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_Lp(const float* x, const float* y, size_t d, float p) {
+    if (p == 1) {
+        return fvec_L1(x, y, d);
+    } else if (p == 2) {
+        return fvec_L2sqr(x, y, d);
+    }
+    float accu = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        accu += powf(fabsf(x[i] - y[i]), p);
+    }
+    return accu;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_Canberra(const float* x, const float* y, size_t d) {
+    float accu = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        float xi = x[i], yi = y[i];
+        accu += fabsf(xi - yi) / (fabsf(xi) + fabsf(yi));
+    }
+    return accu;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_BrayCurtis(const float* x, const float* y, size_t d) {
+    float accu_num = 0, accu_den = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        float xi = x[i], yi = y[i];
+        accu_num += fabsf(xi - yi);
+        accu_den += fabsf(xi + yi);
+    }
+    return accu_num / accu_den;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_Jaccard(const float* x, const float* y, size_t d) {
+    float accu_num = 0, accu_den = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        float xi = x[i], yi = y[i];
+        // selects rather than fmin / fmax, that do not vectorize
+        accu_num += xi < yi ? xi : yi;
+        accu_den += xi < yi ? yi : xi;
+    }
+    return accu_num / accu_den;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
+FAISS_PRAGMA_IMPRECISE_FUNCTION_BEGIN
+float fvec_abs_inner_product(const float* x, const float* y, size_t d) {
+    float accu = 0;
+    FAISS_PRAGMA_IMPRECISE_LOOP
+    for (size_t i = 0; i < d; i++) {
+        accu += fabsf(x[i] * y[i]);
+    }
+    return accu;
+}
+FAISS_PRAGMA_IMPRECISE_FUNCTION_END
+
 /***************************************************************************
  * Distance functions (other than L2 and IP)
  ***************************************************************************/
@@ -68,29 +143,44 @@ struct Run_knn_extra_metrics {
         size_t check_period = InterruptCallback::get_period_hint(ny * d);
         check_period *= omp_get_max_threads();
 
+        // the queries x database vectors are processed in tiles: a block of
+        // database vectors stays in cache while it is compared with a
+        // block of queries
+        const int64_t bs_x = 8;
+        const size_t bs_y = std::max(
+                size_t(16), size_t(1 << 16) / (d * sizeof(float) + 1));
+
         for (size_t i0 = 0; i0 < nx; i0 += check_period) {
             size_t i1 = std::min(i0 + check_period, nx);
+            int64_t nblock = (i1 - i0 + bs_x - 1) / bs_x;
 
 #pragma omp parallel for
-            for (int64_t i = i0; i < i1; i++) {
-                const float* x_i = x + i * d;
-                const float* y_j = y;
-                size_t j;
-                float* simi = distances + k * i;
-                int64_t* idxi = labels + k * i;
-
-                // maxheap_heapify(k, simi, idxi);
-                heap_heapify<C>(k, simi, idxi);
-                for (j = 0; j < ny; j++) {
-                    float disij = vd(x_i, y_j);
-
-                    if (C::cmp(simi[0], disij)) {
-                        heap_replace_top<C>(k, simi, idxi, disij, j);
+            for (int64_t b = 0; b < nblock; b++) {
+                size_t ib0 = i0 + b * bs_x;
+                size_t ib1 = std::min(ib0 + bs_x, i1);
+                for (size_t i = ib0; i < ib1; i++) {
+                    heap_heapify<C>(k, distances + k * i, labels + k * i);
+                }
+                for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                    size_t j1 = std::min(j0 + bs_y, ny);
+                    for (size_t i = ib0; i < ib1; i++) {
+                        const float* x_i = x + i * d;
+                        float* simi = distances + k * i;
+                        int64_t* idxi = labels + k * i;
+                        const float* y_j = y + j0 * d;
+                        for (size_t j = j0; j < j1; j++) {
+                            float disij = vd(x_i, y_j);
+                            if (C::cmp(simi[0], disij)) {
+                                heap_replace_top<C>(
+                                        k, simi, idxi, disij, j);
+                            }
+                            y_j += d;
+                        }
                     }
-                    y_j += d;
                 }
-                // maxheap_reorder(k, simi, idxi);
-                heap_reorder<C>(k, simi, idxi);
+                for (size_t i = ib0; i < ib1; i++) {
+                    heap_reorder<C>(k, distances + k * i, labels + k * i);
+                }
             }
             InterruptCallback::check();
         }
@@ -25,9 +25,14 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <vector>
 
+#ifdef __AVX512VPOPCNTDQ__
+#include <immintrin.h>
+#endif
+
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
@@ -233,6 +238,130 @@ void hammings_knn_hc(
         ha->reorder();
 }
 
+/* Tiled version of hammings_knn_hc for codes of NW 64-bit words (512 and
+ * 1024 bits). Each database code is loaded once for a tile of queries, and
+ * the distances are compared with the heap tops of the tile as they are
+ * computed. The database vectors are visited in the same order as in
+ * hammings_knn_hc, so the results are identical. */
+template <int NW>
+struct HammingTile {
+    static constexpr int QT = 8; // nb of queries per tile
+
+    // queries of the tile, padded to QT
+    uint64_t q[QT * NW];
+
+    void set(const uint8_t* a, int nq) {
+        memset(q, 0, sizeof(q));
+        memcpy(q, a, nq * NW * 8);
+    }
+
+    // distances of the QT queries to b
+    inline void distances(const uint8_t* b, hamdis_t* dis) const {
+        uint64_t bw[NW];
+        memcpy(bw, b, NW * 8);
+#ifdef __AVX512VPOPCNTDQ__
+        __m512i vb[NW / 8];
+        for (int w = 0; w < NW / 8; w++) {
+            vb[w] = _mm512_loadu_si512(bw + 8 * w);
+        }
+        __m512i acc[QT];
+        for (int t = 0; t < QT; t++) {
+            acc[t] = _mm512_setzero_si512();
+            for (int w = 0; w < NW / 8; w++) {
+                __m512i vq = _mm512_loadu_si512(q + t * NW + 8 * w);
+                acc[t] = _mm512_add_epi64(
+                        acc[t],
+                        _mm512_popcnt_epi64(_mm512_xor_si512(vq, vb[w])));
+            }
+        }
+        // transpose-and-add the 8 accumulators into one vector of sums
+        __m512i s[4];
+        for (int t = 0; t < 4; t++) {
+            s[t] = _mm512_add_epi64(
+                    _mm512_unpacklo_epi64(acc[2 * t], acc[2 * t + 1]),
+                    _mm512_unpackhi_epi64(acc[2 * t], acc[2 * t + 1]));
+        }
+        __m512i u[2];
+        for (int t = 0; t < 2; t++) {
+            u[t] = _mm512_add_epi64(
+                    _mm512_shuffle_i64x2(s[2 * t], s[2 * t + 1], 0x88),
+                    _mm512_shuffle_i64x2(s[2 * t], s[2 * t + 1], 0xdd));
+        }
+        __m512i v = _mm512_add_epi64(
+                _mm512_shuffle_i64x2(u[0], u[1], 0x88),
+                _mm512_shuffle_i64x2(u[0], u[1], 0xdd));
+        _mm256_storeu_si256((__m256i*)dis, _mm512_cvtepi64_epi32(v));
+#else
+        for (int t = 0; t < QT; t++) {
+            int s = 0;
+            for (int w = 0; w < NW; w++) {
+                s += popcount64(q[t * NW + w] ^ bw[w]);
+            }
+            dis[t] = s;
+        }
+#endif
+    }
+};
+
+template <int NW>
+void hammings_knn_hc_tiled(
+        int_maxheap_array_t* __restrict ha,
+        const uint8_t* __restrict bs1,
+        const uint8_t* __restrict bs2,
+        size_t n2,
+        bool order,
+        const faiss::IDSelector* sel) {
+    using Tile = HammingTile<NW>;
+    const size_t code_size = NW * 8;
+    const size_t k = ha->k;
+    const int64_t nh = ha->nh;
+    const int64_t ntile = (nh + Tile::QT - 1) / Tile::QT;
+    ha->heapify();
+
+    const size_t block_size = hamming_batch_size;
+    for (size_t j0 = 0; j0 < n2; j0 += block_size) {
+        const size_t j1 = std::min(j0 + block_size, n2);
+#pragma omp parallel for
+        for (int64_t ti = 0; ti < ntile; ti++) {
+            const int64_t i0 = ti * Tile::QT;
+            const int nq = std::min(int64_t(Tile::QT), nh - i0);
+            Tile tile;
+            tile.set(bs1 + i0 * code_size, nq);
+            hamdis_t dis[Tile::QT];
+            // heap tops of the tile, 0 for the padding queries
+            hamdis_t thr[Tile::QT] = {};
+            for (int t = 0; t < nq; t++) {
+                thr[t] = ha->val[(i0 + t) * k];
+            }
+            const uint8_t* __restrict b = bs2 + j0 * code_size;
+            for (size_t j = j0; j < j1; j++, b += code_size) {
+                if (sel && !sel->is_member(j)) {
+                    continue;
+                }
+                tile.distances(b, dis);
+                bool any = false;
+                for (int t = 0; t < Tile::QT; t++) {
+                    any |= dis[t] < thr[t];
+                }
+                if (!any) {
+                    continue;
+                }
+                for (int t = 0; t < nq; t++) {
+                    if (dis[t] < thr[t]) {
+                        hamdis_t* __restrict val = ha->val + (i0 + t) * k;
+                        int64_t* __restrict ids = ha->ids + (i0 + t) * k;
+                        maxheap_replace_top<hamdis_t>(k, val, ids, dis[t], j);
+                        thr[t] = val[0];
+                    }
+                }
+            }
+        }
+    }
+    if (order) {
+        ha->reorder();
+    }
+}
+
 /* Return closest neighbors w.r.t Hamming distance, using max count. */
 template <class HammingComputer>
 void hammings_knn_mc(
@@ -502,6 +631,15 @@ void hammings_knn_hc(
         int order,
         ApproxTopK_mode_t approx_topk_mode,
         const faiss::IDSelector* sel) {
+    if (approx_topk_mode == ApproxTopK_mode_t::EXACT_TOPK) {
+        if (ncodes == 64) {
+            hammings_knn_hc_tiled<8>(ha, a, b, nb, order, sel);
+            return;
+        } else if (ncodes == 128) {
+            hammings_knn_hc_tiled<16>(ha, a, b, nb, order, sel);
+            return;
+        }
+    }
     Run_hammings_knn_hc r;
     dispatch_HammingComputer(
             ncodes,
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/huge_pages.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace faiss {
+
+HugePagesMode huge_pages_mode = HUGE_PAGES_OFF;
+
+size_t huge_pages_min_size = size_t(1) << 24;
+
+namespace {
+
+const size_t huge_page_size = size_t(1) << 21;
+
+bool huge_pages_apply(size_t nbytes) {
+    return huge_pages_mode != HUGE_PAGES_OFF && nbytes >= huge_pages_min_size &&
+            nbytes >= huge_page_size;
+}
+
+} // namespace
+
+void huge_pages_advise(void* ptr, size_t nbytes) {
+#ifdef __linux__
+    if (!huge_pages_apply(nbytes)) {
+        return;
+    }
+    uintptr_t begin = ((uintptr_t)ptr + huge_page_size - 1) &
+            ~(uintptr_t)(huge_page_size - 1);
+    uintptr_t end =
+            ((uintptr_t)ptr + nbytes) & ~(uintptr_t)(huge_page_size - 1);
+    if (end <= begin) {
+        return;
+    }
+    // only hints, so the errors (no THP support, file mappings that
+    // cannot use huge pages) are ignored
+    madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+    if (huge_pages_mode == HUGE_PAGES_THP_COLLAPSE) {
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+        madvise((void*)begin, end - begin, MADV_COLLAPSE);
+    }
+#endif
+}
+
+size_t huge_pages_alignment(size_t nbytes, size_t alignment) {
+#ifdef __linux__
+    if (huge_pages_apply(nbytes)) {
+        return std::max(alignment, huge_page_size);
+    }
+#endif
+    return alignment;
+}
+
+} // namespace faiss
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+// Transparent huge pages for the large arrays of the indexes (codes,
+// inverted lists, graphs, mmapped index files), to reduce the TLB misses
+// of scans over large indexes. Linux only, a no-op elsewhere.
+
+#pragma once
+
+#include <cstddef>
+
+#include <faiss/impl/platform_macros.h>
+
+namespace faiss {
+
+enum HugePagesMode {
+    HUGE_PAGES_OFF = 0,
+    /// madvise(MADV_HUGEPAGE) the large arrays. Memory that is advised
+    /// before being touched (AlignedTable) gets huge pages at page fault
+    /// time, the rest is collapsed asynchronously by khugepaged.
+    HUGE_PAGES_THP = 1,
+    /// same, and collapse the pages of the arrays that are already
+    /// populated right away with MADV_COLLAPSE (Linux >= 6.1)
+    HUGE_PAGES_THP_COLLAPSE = 2,
+};
+
+/// default HUGE_PAGES_OFF
+FAISS_API extern HugePagesMode huge_pages_mode;
+
+/// arrays smaller than this (in bytes) are left alone, default 16 MiB
+FAISS_API extern size_t huge_pages_min_size;
+
+/// apply huge_pages_mode to the 2 MiB pages fully inside ptr[0:nbytes]
+void huge_pages_advise(void* ptr, size_t nbytes);
+
+/// alignment to use for an allocation of nbytes: 2 MiB if huge pages
+/// apply to it, otherwise the requested alignment
+size_t huge_pages_alignment(size_t nbytes, size_t alignment);
+
+} // namespace faiss
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/utils/metrics.h>
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+std::atomic<bool> metrics_enabled_flag{false};
+
+namespace {
+
+/// single writer (the owning thread), read by the snapshots
+struct ThreadMetrics {
+    std::atomic<uint64_t> counters[METRIC_N_COUNTERS] = {};
+    struct Histogram {
+        std::atomic<uint64_t> buckets[metrics_n_buckets] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<double> sum{0};
+    } histograms[METRIC_N_HISTOGRAMS];
+
+    void accumulate_to(MetricsSnapshot& snap) const {
+        for (int i = 0; i < METRIC_N_COUNTERS; i++) {
+            snap.counters[i] += counters[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < METRIC_N_HISTOGRAMS; i++) {
+            const Histogram& h = histograms[i];
+            MetricsHistogramSnapshot& sh = snap.histograms[i];
+            for (int j = 0; j < metrics_n_buckets; j++) {
+                sh.buckets[j] += h.buckets[j].load(std::memory_order_relaxed);
+            }
+            sh.count += h.count.load(std::memory_order_relaxed);
+            sh.sum += h.sum.load(std::memory_order_relaxed);
+        }
+    }
+
+    void clear() {
+        for (int i = 0; i < METRIC_N_COUNTERS; i++) {
+            counters[i].store(0, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < METRIC_N_HISTOGRAMS; i++) {
+            Histogram& h = histograms[i];
+            for (int j = 0; j < metrics_n_buckets; j++) {
+                h.buckets[j].store(0, std::memory_order_relaxed);
+            }
+            h.count.store(0, std::memory_order_relaxed);
+            h.sum.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct MetricsRegistry {
+    std::mutex mutex;
+    std::vector<ThreadMetrics*> threads;
+    /// metrics of the threads that exited
+    MetricsSnapshot exited;
+};
+
+// never destroyed, so that it outlives the thread_local metrics
+MetricsRegistry& registry() {
+    static MetricsRegistry* reg = new MetricsRegistry();
+    return *reg;
+}
+
+struct ThreadMetricsRef {
+    ThreadMetrics metrics;
+
+    ThreadMetricsRef() {
+        MetricsRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(&metrics);
+    }
+
+    ~ThreadMetricsRef() {
+        MetricsRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        metrics.accumulate_to(reg.exited);
+        for (size_t i = 0; i < reg.threads.size(); i++) {
+            if (reg.threads[i] == &metrics) {
+                reg.threads[i] = reg.threads.back();
+                reg.threads.pop_back();
+                break;
+            }
+        }
+    }
+};
+
+ThreadMetrics& thread_metrics() {
+    thread_local ThreadMetricsRef ref;
+    return ref.metrics;
+}
+
+template <class T>
+void relaxed_add(std::atomic<T>& a, T v) {
+    a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+const char* counter_names[METRIC_N_COUNTERS] = {
+        "search_queries",
+        "add_vectors",
+        "ndis",
+        "lists_scanned",
+        "bytes_read",
+        "cache_hits",
+        "cache_misses"};
+
+const char* histogram_names[METRIC_N_HISTOGRAMS] = {
+        "search_latency_seconds",
+        "add_latency_seconds",
+        "ndis_per_query"};
+
+const double histogram_units[METRIC_N_HISTOGRAMS] = {1e-6, 1e-6, 1};
+
+/// nesting depth of the MetricsCallTimers of the thread
+thread_local int call_depth = 0;
+
+} // namespace
+
+void metrics_set_enabled(bool enabled) {
+    metrics_enabled_flag.store(enabled, std::memory_order_relaxed);
+}
+
+void metrics_add_counter(MetricCounter counter, uint64_t value) {
+    relaxed_add(thread_metrics().counters[counter], value);
+}
+
+void metrics_observe_value(MetricHistogram histogram, double value) {
+    ThreadMetrics::Histogram& h = thread_metrics().histograms[histogram];
+    double r = value / histogram_units[histogram];
+    int bucket = 0;
+    if (r > 1) {
+        int e;
+        double m = std::frexp(r, &e);
+        bucket = m == 0.5 ? e - 1 : e;
+        if (bucket >= metrics_n_buckets) {
+            bucket = metrics_n_buckets - 1;
+        }
+    }
+    relaxed_add(h.buckets[bucket], uint64_t(1));
+    relaxed_add(h.count, uint64_t(1));
+    relaxed_add(h.sum, value);
+}
+
+void metrics_add_search_counters(uint64_t n, uint64_t ndis, uint64_t nlist) {
+    ThreadMetrics& tm = thread_metrics();
+    relaxed_add(tm.counters[METRIC_NDIS], ndis);
+    relaxed_add(tm.counters[METRIC_LISTS_SCANNED], nlist);
+    if (n > 0) {
+        metrics_observe_value(METRIC_NDIS_PER_QUERY, ndis / double(n));
+    }
+}
+
+MetricsSnapshot metrics_snapshot() {
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    MetricsSnapshot snap = reg.exited;
+    for (const ThreadMetrics* tm : reg.threads) {
+        tm->accumulate_to(snap);
+    }
+    return snap;
+}
+
+void metrics_reset() {
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.exited = MetricsSnapshot();
+    for (ThreadMetrics* tm : reg.threads) {
+        tm->clear();
+    }
+}
+
+const char* metric_counter_name(MetricCounter counter) {
+    return counter_names[counter];
+}
+
+const char* metric_histogram_name(MetricHistogram histogram) {
+    return histogram_names[histogram];
+}
+
+double metric_histogram_unit(MetricHistogram histogram) {
+    return histogram_units[histogram];
+}
+
+void metrics_visit(
+        const std::function<
+                void(const char* name, const char* labels, double value)>&
+                visitor) {
+    MetricsSnapshot snap = metrics_snapshot();
+    std::string name;
+    for (int i = 0; i < METRIC_N_COUNTERS; i++) {
+        name = std::string("faiss_") + counter_names[i] + "_total";
+        visitor(name.c_str(), "", snap.counters[i]);
+    }
+    char labels[64];
+    for (int i = 0; i < METRIC_N_HISTOGRAMS; i++) {
+        const MetricsHistogramSnapshot& h = snap.histograms[i];
+        std::string prefix = std::string("faiss_") + histogram_names[i];
+        name = prefix + "_bucket";
+        uint64_t cum = 0;
+        for (int j = 0; j < metrics_n_buckets - 1; j++) {
+            cum += h.buckets[j];
+            snprintf(
+                    labels,
+                    sizeof(labels),
+                    "le=\"%g\"",
+                    std::ldexp(histogram_units[i], j));
+            visitor(name.c_str(), labels, cum);
+        }
+        visitor(name.c_str(), "le=\"+Inf\"", h.count);
+        name = prefix + "_sum";
+        visitor(name.c_str(), "", h.sum);
+        name = prefix + "_count";
+        visitor(name.c_str(), "", h.count);
+    }
+}
+
+std::string metrics_to_prometheus() {
+    std::string res;
+    char buf[256];
+    metrics_visit([&](const char* name, const char* labels, double value) {
+        if (labels[0]) {
+            snprintf(buf, sizeof(buf), "%s{%s} %.17g\n", name, labels, value);
+        } else {
+            snprintf(buf, sizeof(buf), "%s %.17g\n", name, value);
+        }
+        res += buf;
+    });
+    return res;
+}
+
+MetricsCallTimer::MetricsCallTimer(
+        MetricCounter counter,
+        MetricHistogram latency,
+        uint64_t n)
+        : latency(latency) {
+    if (!metrics_enabled()) {
+        return;
+    }
+    active = true;
+    if (call_depth++ == 0) {
+        metrics_add_counter(counter, n);
+        t0 = getmillisecs();
+    }
+}
+
+MetricsCallTimer::~MetricsCallTimer() {
+    if (!active) {
+        return;
+    }
+    call_depth--;
+    if (t0 >= 0) {
+        metrics_observe_value(latency, (getmillisecs() - t0) / 1e3);
+    }
+}
+
+MetricsNested::MetricsNested(const MetricsCallTimer& outer)
+        : active(outer.active) {
+    if (active) {
+        call_depth++;
+    }
+}
+
+MetricsNested::~MetricsNested() {
+    if (active) {
+        call_depth--;
+    }
+}
+
+} // namespace faiss
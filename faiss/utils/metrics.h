@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <faiss/impl/platform_macros.h>
+
+/** Process-wide metrics of the search and add calls.
+ *
+ * Unlike the per-index-type stats structs (indexIVF_stats, hnsw_stats,
+ * ...), the metrics are recorded in counters and histograms private to the
+ * calling thread, so the recording does not contend between threads. A
+ * snapshot sums the threads on demand. The recording is disabled by
+ * default: then an instrumentation point costs one relaxed atomic load.
+ *
+ * Instrumented: the search and add of IndexFlat, IndexFlatCodes, IndexPQ,
+ * IndexScalarQuantizer, IndexIVF, IndexIVFFastScan and IndexHNSW, the
+ * GraphPageCache lookups and the BatchedFileReader reads.
+ */
+
+namespace faiss {
+
+enum MetricCounter : int {
+    METRIC_SEARCH_QUERIES = 0, ///< nb of queries searched
+    METRIC_ADD_VECTORS,        ///< nb of vectors added
+    METRIC_NDIS,               ///< nb of distances (or codes) computed
+    METRIC_LISTS_SCANNED,      ///< nb of inverted lists scanned
+    METRIC_BYTES_READ,         ///< bytes read from disk
+    METRIC_CACHE_HITS,         ///< graph page / embedding cache hits
+    METRIC_CACHE_MISSES,       ///< graph page / embedding cache misses
+    METRIC_N_COUNTERS
+};
+
+enum MetricHistogram : int {
+    METRIC_SEARCH_LATENCY = 0, ///< duration of the search calls (s)
+    METRIC_ADD_LATENCY,        ///< duration of the add calls (s)
+    /// nb of distances per query, averaged over the queries searched
+    /// together (by a thread)
+    METRIC_NDIS_PER_QUERY,
+    METRIC_N_HISTOGRAMS
+};
+
+/// histogram buckets: bucket i counts the values <= 2^i * unit (and more
+/// than the bound of bucket i - 1), the last bucket is unbounded
+constexpr int metrics_n_buckets = 40;
+
+struct MetricsHistogramSnapshot {
+    uint64_t buckets[metrics_n_buckets] = {};
+    uint64_t count = 0;
+    double sum = 0;
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[METRIC_N_COUNTERS] = {};
+    MetricsHistogramSnapshot histograms[METRIC_N_HISTOGRAMS];
+};
+
+FAISS_API extern std::atomic<bool> metrics_enabled_flag;
+
+inline bool metrics_enabled() {
+    return metrics_enabled_flag.load(std::memory_order_relaxed);
+}
+
+void metrics_set_enabled(bool enabled);
+
+void metrics_add_counter(MetricCounter counter, uint64_t value);
+
+void metrics_observe_value(MetricHistogram histogram, double value);
+
+/// add to a counter if the recording is enabled
+inline void metrics_add(MetricCounter counter, uint64_t value) {
+    if (metrics_enabled()) {
+        metrics_add_counter(counter, value);
+    }
+}
+
+/// record a value in a histogram if the recording is enabled
+inline void metrics_observe(MetricHistogram histogram, double value) {
+    if (metrics_enabled()) {
+        metrics_observe_value(histogram, value);
+    }
+}
+
+void metrics_add_search_counters(uint64_t n, uint64_t ndis, uint64_t nlist);
+
+/// record the nb of distances computed and inverted lists scanned by the
+/// search of n queries
+inline void metrics_add_search(uint64_t n, uint64_t ndis, uint64_t nlist) {
+    if (metrics_enabled()) {
+        metrics_add_search_counters(n, ndis, nlist);
+    }
+}
+
+/// sum of the metrics of all threads since the last reset
+MetricsSnapshot metrics_snapshot();
+
+/// zero all metrics. Values recorded concurrently may be lost.
+void metrics_reset();
+
+/// metric name without the faiss_ prefix, e.g. "search_queries"
+const char* metric_counter_name(MetricCounter counter);
+const char* metric_histogram_name(MetricHistogram histogram);
+
+/// bound of bucket 0 of a histogram (1e-6 s for the latencies)
+double metric_histogram_unit(MetricHistogram histogram);
+
+/** Enumerate the samples of the metrics in Prometheus form: counters are
+ * named faiss_<name>_total, histograms give faiss_<name>_bucket samples
+ * with cumulative counts and an le="<bound>" label, then faiss_<name>_sum
+ * and faiss_<name>_count. labels is empty when there are none.
+ */
+void metrics_visit(
+        const std::function<
+                void(const char* name, const char* labels, double value)>&
+                visitor);
+
+/// text exposition format of all the samples
+std::string metrics_to_prometheus();
+
+/** Records a search or add call: counts its n vectors and, on destruction,
+ * its duration. Does nothing if the recording is disabled at construction.
+ * The calls nested in a recorded call of the same thread (e.g. the coarse
+ * quantizer search of an IndexIVF) are not recorded.
+ */
+struct MetricsCallTimer {
+    MetricHistogram latency;
+    bool active = false; ///< recording was enabled at construction
+    double t0 = -1;      ///< start time (ms), < 0 for a nested call
+
+    MetricsCallTimer(
+            MetricCounter counter,
+            MetricHistogram latency,
+            uint64_t n);
+
+    ~MetricsCallTimer();
+};
+
+/** In a worker thread of a recorded call, makes the calls of the thread
+ * nested in it (so that they are not recorded).
+ */
+struct MetricsNested {
+    bool active;
+
+    explicit MetricsNested(const MetricsCallTimer& outer);
+
+    ~MetricsNested();
+};
+
+} // namespace faiss
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/utils/open_loop_search.h>
+
+#include <omp.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/random.h>
+
+namespace faiss {
+
+OpenLoopSearchStats open_loop_search(
+        const Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        double target_qps,
+        int n_clients,
+        float* distances,
+        idx_t* labels,
+        double* latencies,
+        const SearchParameters* params,
+        int64_t seed) {
+    FAISS_THROW_IF_NOT(n_clients > 0);
+    using clock = std::chrono::steady_clock;
+
+    // exponential inter-arrival times
+    std::vector<double> arrival(n);
+    RandomGenerator rng(seed);
+    double t = 0;
+    for (idx_t i = 0; i < n; i++) {
+        arrival[i] = t;
+        if (target_qps > 0) {
+            t -= std::log(1 - rng.rand_double()) / target_qps;
+        }
+    }
+
+    std::atomic<idx_t> next(0);
+    std::atomic<size_t> n_late(0);
+    std::vector<double> service_time(n);
+    std::exception_ptr ex;
+    std::mutex ex_mutex;
+    clock::time_point t0 = clock::now();
+
+    auto client = [&]() {
+        omp_set_num_threads(1);
+        for (;;) {
+            idx_t i = next++;
+            if (i >= n) {
+                break;
+            }
+            clock::time_point t_arrival = t0 +
+                    std::chrono::duration_cast<clock::duration>(
+                            std::chrono::duration<double>(arrival[i]));
+            std::this_thread::sleep_until(t_arrival);
+            clock::time_point t_start = clock::now();
+            if (t_start - t_arrival > std::chrono::milliseconds(1)) {
+                n_late++;
+            }
+            try {
+                index->search(
+                        1,
+                        x + i * index->d,
+                        k,
+                        distances + i * k,
+                        labels + i * k,
+                        params);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(ex_mutex);
+                ex = std::current_exception();
+                next = n;
+                break;
+            }
+            clock::time_point t_end = clock::now();
+            latencies[i] =
+                    std::chrono::duration<double>(t_end - t_arrival).count();
+            service_time[i] =
+                    std::chrono::duration<double>(t_end - t_start).count();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < n_clients; c++) {
+        threads.emplace_back(client);
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+
+    OpenLoopSearchStats stats;
+    stats.duration = std::chrono::duration<double>(clock::now() - t0).count();
+    stats.achieved_qps = stats.duration > 0 ? n / stats.duration : 0;
+    double tot = 0;
+    for (idx_t i = 0; i < n; i++) {
+        tot += service_time[i];
+    }
+    stats.mean_service_time = n > 0 ? tot / n : 0;
+    stats.n_late = n_late;
+    return stats;
+}
+
+} // namespace faiss
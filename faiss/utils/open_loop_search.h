@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/** Statistics of an open-loop search run. */
+struct OpenLoopSearchStats {
+    double duration = 0; ///< from the first arrival to the last answer (s)
+    double achieved_qps = 0;
+    double mean_service_time = 0; ///< mean time spent in search (s)
+    /// nb of queries that started more than 1 ms after their arrival
+    size_t n_late = 0;
+};
+
+/** Search the queries one at a time, as they would arrive in a service.
+ *
+ * The arrival times follow a Poisson process of rate target_qps (open
+ * loop: the arrivals do not wait for the previous answers). n_clients
+ * threads take the queries in arrival order and call index->search on
+ * one query, with one OpenMP thread each. The latency of a query runs
+ * from its arrival to its answer, so it includes the queueing delay when
+ * the clients cannot keep up. With target_qps <= 0, all queries arrive at
+ * the start and the latencies are the service times only.
+ *
+ * @param x          queries, size n * d
+ * @param distances  output distances, size n * k
+ * @param labels     output labels, size n * k
+ * @param latencies  output latencies in seconds, size n
+ */
+OpenLoopSearchStats open_loop_search(
+        const Index* index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        double target_qps,
+        int n_clients,
+        float* distances,
+        idx_t* labels,
+        double* latencies,
+        const SearchParameters* params = nullptr,
+        int64_t seed = 1234);
+
+} // namespace faiss
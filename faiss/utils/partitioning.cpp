@@ -9,6 +9,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <type_traits>
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/AlignedTable.h>
@@ -17,6 +18,10 @@
 
 #include <faiss/impl/platform_macros.h>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 namespace faiss {
 
 /******************************************************************
@@ -812,6 +817,138 @@ template uint16_t partition_fuzzy<CMax<uint16_t, int>>(
         size_t q_max,
         size_t* q_out);
 
+/******************************************************************
+ * Compare and compact
+ ******************************************************************/
+
+template <class C>
+size_t compare_and_compact(
+        size_t n,
+        const typename C::T* vals,
+        const typename C::TI* ids,
+        typename C::TI id0,
+        typename C::T thresh,
+        typename C::T* out_vals,
+        typename C::TI* out_ids) {
+    size_t j = 0, nout = 0;
+#ifdef __AVX512F__
+    constexpr bool is_float_int64 = std::is_same<typename C::T, float>::value &&
+            std::is_same<typename C::TI, int64_t>::value;
+    if constexpr (is_float_int64) {
+        const __m512 thr = _mm512_set1_ps(thresh);
+        __m512i id_lo = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+        id_lo = _mm512_add_epi64(id_lo, _mm512_set1_epi64(id0));
+        __m512i id_hi = _mm512_add_epi64(id_lo, _mm512_set1_epi64(8));
+        const __m512i id_inc = _mm512_set1_epi64(16);
+        for (; j + 16 <= n; j += 16) {
+            __m512 v = _mm512_loadu_ps(vals + j);
+            // cmp(a, b) is a > b for CMax, a < b for CMin
+            __mmask16 m = C::is_max ? _mm512_cmp_ps_mask(v, thr, _CMP_LT_OQ)
+                                    : _mm512_cmp_ps_mask(v, thr, _CMP_GT_OQ);
+            if (m) {
+                __m512i i0, i1;
+                if (ids) {
+                    i0 = _mm512_loadu_si512(ids + j);
+                    i1 = _mm512_loadu_si512(ids + j + 8);
+                } else {
+                    i0 = id_lo;
+                    i1 = id_hi;
+                }
+                _mm512_mask_compressstoreu_ps(out_vals + nout, m, v);
+                __mmask8 m0 = m & 0xff, m1 = m >> 8;
+                _mm512_mask_compressstoreu_epi64(out_ids + nout, m0, i0);
+                nout += __builtin_popcount(m0);
+                _mm512_mask_compressstoreu_epi64(out_ids + nout, m1, i1);
+                nout += __builtin_popcount(m1);
+            }
+            id_lo = _mm512_add_epi64(id_lo, id_inc);
+            id_hi = _mm512_add_epi64(id_hi, id_inc);
+        }
+    }
+#elif defined(__AVX2__)
+    constexpr bool is_float = std::is_same<typename C::T, float>::value;
+    if constexpr (is_float) {
+        const __m256 thr = _mm256_set1_ps(thresh);
+        for (; j + 8 <= n; j += 8) {
+            __m256 v = _mm256_loadu_ps(vals + j);
+            __m256 c = C::is_max ? _mm256_cmp_ps(v, thr, _CMP_LT_OQ)
+                                 : _mm256_cmp_ps(v, thr, _CMP_GT_OQ);
+            // most elements fail the test, only the others are visited
+            uint32_t m = _mm256_movemask_ps(c);
+            while (m) {
+                int jj = __builtin_ctz(m);
+                m &= m - 1;
+                out_vals[nout] = vals[j + jj];
+                out_ids[nout] = ids ? ids[j + jj] : id0 + j + jj;
+                nout++;
+            }
+        }
+    }
+#endif
+    for (; j < n; j++) {
+        if (C::cmp(thresh, vals[j])) {
+            out_vals[nout] = vals[j];
+            out_ids[nout] = ids ? ids[j] : id0 + j;
+            nout++;
+        }
+    }
+    return nout;
+}
+
+template size_t compare_and_compact<CMin<float, int64_t>>(
+        size_t n,
+        const float* vals,
+        const int64_t* ids,
+        int64_t id0,
+        float thresh,
+        float* out_vals,
+        int64_t* out_ids);
+
+template size_t compare_and_compact<CMax<float, int64_t>>(
+        size_t n,
+        const float* vals,
+        const int64_t* ids,
+        int64_t id0,
+        float thresh,
+        float* out_vals,
+        int64_t* out_ids);
+
+template size_t compare_and_compact<CMin<uint16_t, int64_t>>(
+        size_t n,
+        const uint16_t* vals,
+        const int64_t* ids,
+        int64_t id0,
+        uint16_t thresh,
+        uint16_t* out_vals,
+        int64_t* out_ids);
+
+template size_t compare_and_compact<CMax<uint16_t, int64_t>>(
+        size_t n,
+        const uint16_t* vals,
+        const int64_t* ids,
+        int64_t id0,
+        uint16_t thresh,
+        uint16_t* out_vals,
+        int64_t* out_ids);
+
+template size_t compare_and_compact<CMin<uint16_t, int>>(
+        size_t n,
+        const uint16_t* vals,
+        const int* ids,
+        int id0,
+        uint16_t thresh,
+        uint16_t* out_vals,
+        int* out_ids);
+
+template size_t compare_and_compact<CMax<uint16_t, int>>(
+        size_t n,
+        const uint16_t* vals,
+        const int* ids,
+        int id0,
+        uint16_t thresh,
+        uint16_t* out_vals,
+        int* out_ids);
+
 /******************************************************************
  * Histogram subroutines
  ******************************************************************/
@@ -38,6 +38,23 @@ inline typename C::T partition(
     return partition_fuzzy<C>(vals, ids, n, q, q, nullptr);
 }
 
+/** copies the elements of vals that are strictly better than thresh
+ * (smaller for C = CMax, larger for CMin) to out_vals, keeping their
+ * order, and their ids to out_ids. The ids are ids[j], or id0 + j if ids is
+ * nullptr.
+ *
+ * @return the number of copied elements (<= n)
+ */
+template <class C>
+size_t compare_and_compact(
+        size_t n,
+        const typename C::T* vals,
+        const typename C::TI* ids,
+        typename C::TI id0,
+        typename C::T thresh,
+        typename C::T* out_vals,
+        typename C::TI* out_ids);
+
 /** low level SIMD histogramming functions */
 
 /** 8-bin histogram of (x - min) >> shift
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <faiss/utils/simd_dispatch.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/simd_dispatch/distances-inl.h>
+
+namespace faiss {
+
+const DistanceKernels distance_kernels_generic =
+        make_distance_kernels(SIMD_GENERIC);
+
+namespace {
+
+SIMDLevel detect_simd_level() {
+#ifdef FAISS_ENABLE_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512cd") &&
+        __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx512dq") &&
+        __builtin_cpu_supports("avx512bw")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SIMD_AVX2;
+    }
+#endif
+    return SIMD_GENERIC;
+}
+
+const DistanceKernels* kernels_of_level(SIMDLevel level) {
+    switch (level) {
+#ifdef FAISS_ENABLE_DISPATCH
+        case SIMD_AVX512:
+            return &distance_kernels_avx512;
+        case SIMD_AVX2:
+            return &distance_kernels_avx2;
+#endif
+        default:
+            return &distance_kernels_generic;
+    }
+}
+
+/// level given by FAISS_OPT_LEVEL, capped to the host level
+SIMDLevel initial_simd_level() {
+    SIMDLevel level = simd_level_max();
+    const char* env = getenv("FAISS_OPT_LEVEL");
+    if (env) {
+        for (int l = SIMD_GENERIC; l < level; l++) {
+            if (!strcmp(env, simd_level_name(SIMDLevel(l)))) {
+                return SIMDLevel(l);
+            }
+        }
+    }
+    return level;
+}
+
+std::atomic<const DistanceKernels*> current_kernels{nullptr};
+
+} // namespace
+
+const char* simd_level_name(SIMDLevel level) {
+    switch (level) {
+        case SIMD_GENERIC:
+            return "generic";
+        case SIMD_AVX2:
+            return "avx2";
+        case SIMD_AVX512:
+            return "avx512";
+    }
+    return "unknown";
+}
+
+SIMDLevel simd_level_max() {
+    static const SIMDLevel level = detect_simd_level();
+    return level;
+}
+
+const DistanceKernels& get_distance_kernels() {
+    const DistanceKernels* k = current_kernels.load(std::memory_order_acquire);
+    if (!k) {
+        // concurrent first calls store the same table
+        k = kernels_of_level(initial_simd_level());
+        current_kernels.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+SIMDLevel get_simd_level() {
+    return get_distance_kernels().level;
+}
+
+void set_simd_level(SIMDLevel level) {
+    FAISS_THROW_IF_NOT_FMT(
+            level >= SIMD_GENERIC && level <= simd_level_max(),
+            "SIMD level %d not supported, max is %s",
+            int(level),
+            simd_level_name(simd_level_max()));
+    current_kernels.store(kernels_of_level(level), std::memory_order_release);
+}
+
+} // namespace faiss
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace faiss {
+
+/** Runtime selection of the SIMD level of the float distance kernels.
+ *
+ * When faiss is compiled with FAISS_ENABLE_DISPATCH (cmake option of the
+ * same name, x86-64 with gcc or clang), the generic library also contains
+ * AVX2 and AVX512 versions of fvec_L2sqr, fvec_inner_product,
+ * fvec_norm_L2sqr and their batch_4 variants, each compiled in its own
+ * translation unit. The best version supported by the host is selected at
+ * the first call, so that a single build runs everywhere at full speed.
+ *
+ * The environment variable FAISS_OPT_LEVEL ("generic", "avx2", "avx512"),
+ * also used by the python loader, caps the level. SIMD_GENERIC is the
+ * baseline flags of the library, so in the avx2 build it is AVX2 code.
+ *
+ * Without FAISS_ENABLE_DISPATCH only SIMD_GENERIC is available and the
+ * exported functions call the kernels directly.
+ */
+enum SIMDLevel {
+    SIMD_GENERIC = 0,
+    SIMD_AVX2,
+    SIMD_AVX512, ///< AVX512 F, CD, VL, DQ and BW
+};
+
+/// "generic", "avx2" or "avx512"
+const char* simd_level_name(SIMDLevel level);
+
+/// highest level that is both compiled in and supported by the host
+SIMDLevel simd_level_max();
+
+/// level currently used by the distance kernels
+SIMDLevel get_simd_level();
+
+/** use the kernels of level, which must be <= simd_level_max(). Not
+ * thread-safe with respect to searches running concurrently. */
+void set_simd_level(SIMDLevel level);
+
+/// the distance kernels of one SIMD level
+struct DistanceKernels {
+    SIMDLevel level;
+
+    float (*L2sqr)(const float* x, const float* y, size_t d);
+    float (*inner_product)(const float* x, const float* y, size_t d);
+    float (*norm_L2sqr)(const float* x, size_t d);
+
+    void (*inner_product_batch_4)(
+            const float* x,
+            const float* y0,
+            const float* y1,
+            const float* y2,
+            const float* y3,
+            const size_t d,
+            float& dis0,
+            float& dis1,
+            float& dis2,
+            float& dis3);
+
+    void (*L2sqr_batch_4)(
+            const float* x,
+            const float* y0,
+            const float* y1,
+            const float* y2,
+            const float* y3,
+            const size_t d,
+            float& dis0,
+            float& dis1,
+            float& dis2,
+            float& dis3);
+};
+
+/// kernels of the current level
+const DistanceKernels& get_distance_kernels();
+
+} // namespace faiss
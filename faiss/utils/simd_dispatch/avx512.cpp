@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// compiled with the flags of the faiss_avx512 target when
+// FAISS_ENABLE_DISPATCH is set
+
+#include <faiss/utils/simd_dispatch/distances-inl.h>
+
+namespace faiss {
+
+const DistanceKernels distance_kernels_avx512 =
+        make_distance_kernels(SIMD_AVX512);
+
+} // namespace faiss
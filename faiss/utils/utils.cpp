@@ -22,6 +22,7 @@
 #include <windows.h>
 #undef NOMINMAX
 #else
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <unistd.h>
 #endif // !_MSC_VER
@@ -183,6 +184,19 @@ size_t get_mem_usage_kb() {
     return sz;
 }
 
+int get_numa_node_count() {
+    int n = 0;
+    for (;;) {
+        char fname[256];
+        snprintf(fname, 256, "/sys/devices/system/node/node%d", n);
+        if (access(fname, F_OK) != 0) {
+            break;
+        }
+        n++;
+    }
+    return n > 0 ? n : 1;
+}
+
 #else
 
 size_t get_mem_usage_kb() {
@@ -191,8 +205,42 @@ size_t get_mem_usage_kb() {
     return 0;
 }
 
+int get_numa_node_count() {
+    return 1;
+}
+
 #endif
 
+namespace {
+// the pages are read into this, so that the reads are not optimized out
+volatile uint8_t warmup_sink;
+} // namespace
+
+size_t warmup_memory(const void* data, size_t nbytes, bool advise) {
+    if (!data || nbytes == 0) {
+        return 0;
+    }
+    const size_t page_size = 4096;
+    uintptr_t begin = (uintptr_t)data;
+    uintptr_t end = begin + nbytes;
+    uintptr_t page0 = begin & ~(uintptr_t)(page_size - 1);
+#ifndef _MSC_VER
+    if (advise) {
+        // fails harmlessly on memory that is not mapped from a file
+        madvise((void*)page0, end - page0, MADV_WILLNEED);
+    }
+#endif
+    int64_t npages = (end - page0 + page_size - 1) / page_size;
+    uint8_t accu = 0;
+#pragma omp parallel for reduction(^ : accu) if (npages > 1024)
+    for (int64_t p = 0; p < npages; p++) {
+        uintptr_t addr = std::max(begin, page0 + p * page_size);
+        accu ^= *(const uint8_t*)addr;
+    }
+    warmup_sink = accu;
+    return nbytes;
+}
+
 void reflection(
         const float* __restrict u,
         float* __restrict x,
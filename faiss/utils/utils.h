@@ -46,8 +46,20 @@ double getmillisecs();
 /// get current RSS usage in kB
 size_t get_mem_usage_kb();
 
+/// number of NUMA nodes of the machine (1 if it cannot be determined)
+int get_numa_node_count();
+
 uint64_t get_cycles();
 
+/** bring the pages of [data, data + nbytes) into memory before they are
+ * used: madvise(MADV_WILLNEED) for mmap-ed data (if advise is set, this
+ * is a system call, avoid it for small ranges), then one byte per page
+ * is read, by several threads for large ranges.
+ *
+ * @return nbytes
+ */
+size_t warmup_memory(const void* data, size_t nbytes, bool advise = true);
+
 /***************************************************************************
  * Misc  matrix and vector manipulation functions
  ***************************************************************************/
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gflags/gflags.h>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/approx_topk/approx_topk.h>
+#include <faiss/utils/random.h>
+
+using namespace faiss;
+DEFINE_uint32(n, 4096, "number of distances per beam");
+DEFINE_uint32(beam_size, 4, "number of beams");
+DEFINE_uint32(k, 16, "number of results");
+DEFINE_uint32(iterations, 2000, "iterations");
+
+using C = CMax<float, int>;
+
+static void bench_exact(benchmark::State& state, int n, int k) {
+    std::vector<float> dis(n);
+    float_rand(dis.data(), n, 12345);
+    std::vector<float> bh_val(k);
+    std::vector<int> bh_ids(k);
+
+    for (auto _ : state) {
+        heap_heapify<C>(k, bh_val.data(), bh_ids.data());
+        heap_addn<C>(k, bh_val.data(), bh_ids.data(), dis.data(), nullptr, n);
+        benchmark::DoNotOptimize(bh_val[0]);
+    }
+}
+
+template <uint32_t NBUCKETS, uint32_t N>
+static void bench_approx(
+        benchmark::State& state,
+        int beam_size,
+        int n_per_beam,
+        int k) {
+    std::vector<float> dis(beam_size * n_per_beam);
+    float_rand(dis.data(), dis.size(), 12345);
+    std::vector<float> bh_val(k);
+    std::vector<int> bh_ids(k);
+
+    for (auto _ : state) {
+        heap_heapify<C>(k, bh_val.data(), bh_ids.data());
+        HeapWithBuckets<C, NBUCKETS, N>::bs_addn(
+                beam_size,
+                n_per_beam,
+                dis.data(),
+                k,
+                bh_val.data(),
+                bh_ids.data());
+        benchmark::DoNotOptimize(bh_val[0]);
+    }
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    gflags::AllowCommandLineReparsing();
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    int iterations = FLAGS_iterations;
+    int n = FLAGS_n;
+    int beam_size = FLAGS_beam_size;
+    int k = FLAGS_k;
+
+    benchmark::RegisterBenchmark("EXACT_TOPK", bench_exact, beam_size * n, k)
+            ->Iterations(iterations);
+    benchmark::RegisterBenchmark(
+            "APPROX_TOPK_BUCKETS_B32_D2",
+            bench_approx<32, 2>,
+            beam_size,
+            n,
+            k)
+            ->Iterations(iterations);
+    benchmark::RegisterBenchmark(
+            "APPROX_TOPK_BUCKETS_B8_D3", bench_approx<8, 3>, beam_size, n, k)
+            ->Iterations(iterations);
+    benchmark::RegisterBenchmark(
+            "APPROX_TOPK_BUCKETS_B16_D2",
+            bench_approx<16, 2>,
+            beam_size,
+            n,
+            k)
+            ->Iterations(iterations);
+    benchmark::RegisterBenchmark(
+            "APPROX_TOPK_BUCKETS_B8_D2", bench_approx<8, 2>, beam_size, n, k)
+            ->Iterations(iterations);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
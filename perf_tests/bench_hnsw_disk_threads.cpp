@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Multi-threaded search on a graph whose neighbor lists are read from disk
+// (HNSW::neighbors_on_disk). All threads share the same graph_fd, the
+// results are checked against an in-memory search of the same graph.
+
+#include <omp.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <benchmark/benchmark.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/random.h>
+
+using namespace faiss;
+DEFINE_uint32(d, 64, "dimension");
+DEFINE_uint32(nb, 100000, "database size");
+DEFINE_uint32(nq, 2000, "number of queries");
+DEFINE_uint32(M, 32, "HNSW M");
+DEFINE_uint32(ef_search, 64, "efSearch");
+DEFINE_uint32(k, 10, "k");
+DEFINE_uint32(max_threads, 64, "largest thread count");
+DEFINE_uint32(iterations, 5, "iterations");
+DEFINE_string(graph_file, "", "neighbor file (default: temporary file)");
+
+namespace {
+
+struct DiskGraphFixture {
+    std::unique_ptr<IndexHNSWFlat> index;
+    std::vector<float> xq;
+    std::vector<idx_t> I_ref;
+    std::string filename;
+    bool remove_file = false;
+
+    DiskGraphFixture() {
+        int d = FLAGS_d;
+        std::vector<float> xb((size_t)d * FLAGS_nb);
+        float_rand(xb.data(), xb.size(), 12345);
+        xq.resize((size_t)d * FLAGS_nq);
+        float_rand(xq.data(), xq.size(), 4567);
+
+        index = std::make_unique<IndexHNSWFlat>(d, FLAGS_M);
+        index->add(FLAGS_nb, xb.data());
+        index->hnsw.efSearch = FLAGS_ef_search;
+
+        std::vector<float> D_ref((size_t)FLAGS_k * FLAGS_nq);
+        I_ref.resize(D_ref.size());
+        index->search(
+                FLAGS_nq, xq.data(), FLAGS_k, D_ref.data(), I_ref.data());
+
+        // same layout as the neighbors vector of a compact index file
+        HNSW& hnsw = index->hnsw;
+        hnsw.convert_to_compact();
+        filename = FLAGS_graph_file;
+        if (filename.empty()) {
+            filename = "/tmp/faiss_bench_hnsw_neighbors_XXXXXX";
+            int fd = mkstemp(&filename[0]);
+            FAISS_THROW_IF_NOT_MSG(fd >= 0, "mkstemp failed");
+            close(fd);
+            remove_file = true;
+        }
+        FILE* f = fopen(filename.c_str(), "wb");
+        FAISS_THROW_IF_NOT_FMT(f, "could not open %s", filename.c_str());
+        size_t size = hnsw.compact_neighbors_data.size();
+        fwrite(&size, sizeof(size), 1, f);
+        fwrite(hnsw.compact_neighbors_data.data(),
+               sizeof(HNSW::storage_idx_t),
+               size,
+               f);
+        fclose(f);
+
+        hnsw.compact_neighbors_data.clear();
+        hnsw.neighbors_on_disk = true;
+        hnsw.neighbors_start_offset = 0;
+        hnsw.initialize_graph(filename);
+    }
+
+    ~DiskGraphFixture() {
+        if (remove_file) {
+            unlink(filename.c_str());
+        }
+    }
+};
+
+DiskGraphFixture& get_fixture() {
+    static DiskGraphFixture fixture;
+    return fixture;
+}
+
+} // namespace
+
+static void bench_search_disk(benchmark::State& state, int nt) {
+    DiskGraphFixture& fx = get_fixture();
+    size_t nq = FLAGS_nq;
+    std::vector<float> D((size_t)FLAGS_k * nq);
+    std::vector<idx_t> I(D.size());
+
+    omp_set_num_threads(nt);
+    size_t n_diff = 0;
+    for (auto _ : state) {
+        fx.index->search(nq, fx.xq.data(), FLAGS_k, D.data(), I.data());
+        state.PauseTiming();
+        for (size_t i = 0; i < I.size(); i++) {
+            n_diff += I[i] != fx.I_ref[i];
+        }
+        state.ResumeTiming();
+    }
+    if (n_diff > 0) {
+        state.SkipWithError("results differ from in-memory search");
+    }
+    state.counters["qps"] = benchmark::Counter(
+            nq, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["threads"] = nt;
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    gflags::AllowCommandLineReparsing();
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    int iterations = FLAGS_iterations;
+    for (int nt = 1; nt <= (int)FLAGS_max_threads; nt *= 2) {
+        benchmark::RegisterBenchmark(
+                ("search_disk/threads:" + std::to_string(nt)).c_str(),
+                bench_search_disk,
+                nt)
+                ->Iterations(iterations)
+                ->UseRealTime();
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Search in recompute mode (IndexHNSW::is_recompute) on a graph whose
+// neighbor lists are read from disk, as in the embedding server setup. The
+// server is mocked by an in-process EmbeddingProvider that copies the
+// vectors after a configurable round-trip latency. The benchmark sweeps the
+// beam size, the neighbor batch size, the PQ pruning ratio and the thread
+// count. The queries are searched one at a time, so that the per-query
+// latencies can be reported; the search counters come from an untimed
+// sequential pass, because the global hnsw_stats are not thread-safe.
+
+#include <omp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <benchmark/benchmark.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/impl/ProductQuantizer.h>
+#include <faiss/utils/random.h>
+
+using namespace faiss;
+DEFINE_uint32(d, 64, "dimension");
+DEFINE_uint32(nb, 50000, "database size");
+DEFINE_uint32(nq, 500, "number of queries");
+DEFINE_uint32(M, 32, "HNSW M");
+DEFINE_uint32(ef_search, 64, "efSearch");
+DEFINE_uint32(k, 10, "k");
+DEFINE_uint32(pq_M, 16, "nb of sub-quantizers of the pruning PQ");
+DEFINE_uint32(latency_us, 50, "round-trip latency of the embedding server");
+DEFINE_string(beam_sizes, "1,4", "beam sizes to sweep");
+DEFINE_string(batch_sizes, "0,32", "neighbor batch sizes to sweep");
+DEFINE_string(pq_pruning_ratios, "0,0.5", "PQ pruning ratios to sweep");
+DEFINE_string(threads, "1,4", "thread counts to sweep");
+DEFINE_uint32(iterations, 3, "iterations");
+DEFINE_string(graph_file, "", "neighbor file (default: temporary file)");
+
+namespace {
+
+template <class T>
+std::vector<T> parse_list(const std::string& s) {
+    std::vector<T> res;
+    std::istringstream ss(s);
+    std::string tok;
+    while (std::getline(ss, tok, ',')) {
+        std::istringstream ts(tok);
+        T v;
+        ts >> v;
+        res.push_back(v);
+    }
+    return res;
+}
+
+/// stands for the embedding server: one sleep per request
+struct MockEmbeddingServer : EmbeddingProvider {
+    const float* xb;
+    std::chrono::microseconds latency;
+    std::atomic<size_t> n_requests{0};
+
+    MockEmbeddingServer(size_t d, const float* xb, int latency_us)
+            : EmbeddingProvider(d), xb(xb), latency(latency_us) {}
+
+    bool get_embeddings(size_t n, const idx_t* ids, float* out) override {
+        n_requests++;
+        if (latency.count() > 0) {
+            std::this_thread::sleep_for(latency);
+        }
+        for (size_t i = 0; i < n; i++) {
+            memcpy(out + i * d, xb + ids[i] * d, sizeof(float) * d);
+        }
+        return true;
+    }
+};
+
+struct RecomputeFixture {
+    std::vector<float> xb, xq;
+    std::unique_ptr<IndexHNSWFlat> index;
+    std::shared_ptr<MockEmbeddingServer> server;
+    std::vector<idx_t> I_gt;
+    std::string filename;
+    bool remove_file = false;
+
+    RecomputeFixture() {
+        int d = FLAGS_d;
+        size_t nb = FLAGS_nb;
+        xb.resize(d * nb);
+        rand_smooth_vectors(nb, d, xb.data(), 12345);
+        xq.resize((size_t)d * FLAGS_nq);
+        rand_smooth_vectors(FLAGS_nq, d, xq.data(), 4567);
+
+        IndexFlatL2 index_gt(d);
+        index_gt.add(nb, xb.data());
+        std::vector<float> D_gt((size_t)FLAGS_k * FLAGS_nq);
+        I_gt.resize(D_gt.size());
+        index_gt.search(
+                FLAGS_nq, xq.data(), FLAGS_k, D_gt.data(), I_gt.data());
+
+        index = std::make_unique<IndexHNSWFlat>(d, FLAGS_M);
+        index->add(nb, xb.data());
+        index->hnsw.efSearch = FLAGS_ef_search;
+
+        // 8-bit PQ for the pruning
+        ProductQuantizer pq(d, FLAGS_pq_M, 8);
+        pq.cp.niter = 10;
+        pq.train(std::min(nb, size_t(20000)), xb.data());
+        std::vector<uint8_t> codes(nb * pq.code_size);
+        pq.compute_codes(xb.data(), codes.data(), nb);
+        HNSW& hnsw = index->hnsw;
+        hnsw.set_pq_pruning_codes(pq, codes.data());
+
+        // same layout as the neighbors vector of a compact index file
+        hnsw.convert_to_compact();
+        filename = FLAGS_graph_file;
+        if (filename.empty()) {
+            filename = "/tmp/faiss_bench_hnsw_neighbors_XXXXXX";
+            int fd = mkstemp(&filename[0]);
+            FAISS_THROW_IF_NOT_MSG(fd >= 0, "mkstemp failed");
+            close(fd);
+            remove_file = true;
+        }
+        FILE* f = fopen(filename.c_str(), "wb");
+        FAISS_THROW_IF_NOT_FMT(f, "could not open %s", filename.c_str());
+        size_t size = hnsw.compact_neighbors_data.size();
+        fwrite(&size, sizeof(size), 1, f);
+        fwrite(hnsw.compact_neighbors_data.data(),
+               sizeof(HNSW::storage_idx_t),
+               size,
+               f);
+        fclose(f);
+
+        hnsw.compact_neighbors_data.clear();
+        hnsw.neighbors_on_disk = true;
+        hnsw.neighbors_start_offset = 0;
+        hnsw.initialize_graph(filename);
+
+        // the vectors only come from the server
+        server = std::make_shared<MockEmbeddingServer>(
+                d, xb.data(), FLAGS_latency_us);
+        index->is_recompute = true;
+        index->embedding_provider = server;
+    }
+
+    double recall(const std::vector<idx_t>& I) const {
+        size_t k = FLAGS_k, n_ok = 0;
+        for (size_t q = 0; q < FLAGS_nq; q++) {
+            std::unordered_set<idx_t> gt(
+                    I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+            for (size_t j = 0; j < k; j++) {
+                n_ok += gt.count(I[q * k + j]);
+            }
+        }
+        return n_ok / double(I.size());
+    }
+
+    ~RecomputeFixture() {
+        if (remove_file) {
+            unlink(filename.c_str());
+        }
+    }
+};
+
+RecomputeFixture& get_fixture() {
+    static RecomputeFixture fixture;
+    return fixture;
+}
+
+double percentile(std::vector<double>& v, double p) {
+    size_t i = std::min(v.size() - 1, size_t(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+} // namespace
+
+static void bench_recompute(
+        benchmark::State& state,
+        int beam_size,
+        int batch_size,
+        float pq_pruning_ratio,
+        int nt) {
+    RecomputeFixture& fx = get_fixture();
+    size_t nq = FLAGS_nq, k = FLAGS_k, d = FLAGS_d;
+    SearchParametersHNSW params;
+    params.efSearch = FLAGS_ef_search;
+    params.beam_size = beam_size;
+    params.batch_size = batch_size;
+    params.pq_pruning_ratio = pq_pruning_ratio;
+
+    std::vector<float> D(k * nq);
+    std::vector<idx_t> I(k * nq);
+    std::vector<double> latencies;
+    std::vector<double> lat(nq);
+    size_t n_requests = 0;
+    for (auto _ : state) {
+        size_t r0 = fx.server->n_requests;
+#pragma omp parallel for num_threads(nt) schedule(dynamic)
+        for (idx_t q = 0; q < nq; q++) {
+            auto t0 = std::chrono::steady_clock::now();
+            fx.index->search(
+                    1,
+                    fx.xq.data() + q * d,
+                    k,
+                    D.data() + q * k,
+                    I.data() + q * k,
+                    &params);
+            lat[q] = std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - t0)
+                             .count();
+        }
+        n_requests += fx.server->n_requests - r0;
+        latencies.insert(latencies.end(), lat.begin(), lat.end());
+    }
+
+    // counters of one sequential pass
+    hnsw_stats.reset();
+    omp_set_num_threads(1);
+    fx.index->search(nq, fx.xq.data(), k, D.data(), I.data(), &params);
+    size_t n_fetch = fx.index->get_last_total_fetch_count();
+
+    state.counters["qps"] = benchmark::Counter(
+            nq, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["p50_us"] = percentile(latencies, 0.5);
+    state.counters["p99_us"] = percentile(latencies, 0.99);
+    state.counters["recall"] = fx.recall(I);
+    state.counters["ndis"] = hnsw_stats.ndis / double(nq);
+    state.counters["n_ios"] = hnsw_stats.n_ios / double(nq);
+    state.counters["fetches"] = n_fetch / double(nq);
+    state.counters["requests"] =
+            n_requests / double(nq * state.iterations());
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    gflags::AllowCommandLineReparsing();
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    int iterations = FLAGS_iterations;
+    for (int beam_size : parse_list<int>(FLAGS_beam_sizes)) {
+        for (int batch_size : parse_list<int>(FLAGS_batch_sizes)) {
+            for (float ratio : parse_list<float>(FLAGS_pq_pruning_ratios)) {
+                for (int nt : parse_list<int>(FLAGS_threads)) {
+                    std::string name = "recompute/beam:" +
+                            std::to_string(beam_size) +
+                            "/batch:" + std::to_string(batch_size) +
+                            "/pq_pruning:" + std::to_string(ratio) +
+                            "/threads:" + std::to_string(nt);
+                    benchmark::RegisterBenchmark(
+                            name.c_str(),
+                            bench_recompute,
+                            beam_size,
+                            batch_size,
+                            ratio,
+                            nt)
+                            ->Iterations(iterations)
+                            ->UseRealTime();
+                }
+            }
+        }
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
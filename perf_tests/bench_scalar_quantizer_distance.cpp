@@ -24,7 +24,8 @@ static void bench_distance(
         benchmark::State& state,
         ScalarQuantizer::QuantizerType type,
         int d,
-        int n) {
+        int n,
+        bool fixed_dim) {
     std::vector<float> x(d * n);
 
     float_rand(x.data(), d * n, 12345);
@@ -43,8 +44,10 @@ static void bench_distance(
     std::vector<uint8_t> codes(code_size * n);
     sq.compute_codes(x.data(), codes.data(), n);
 
+    sq_fixed_dim_distance_computers = fixed_dim;
     std::unique_ptr<ScalarQuantizer::SQDistanceComputer> dc(
             sq.get_distance_computer());
+    sq_fixed_dim_distance_computers = true;
     dc->codes = codes.data();
     dc->code_size = sq.code_size;
 
@@ -68,10 +71,29 @@ int main(int argc, char** argv) {
     int n = FLAGS_n;
     auto benchs = ::perf_tests::sq_types();
 
+    // d = 384, 768 and 1024 have distance computers specialized for the
+    // dimension: compare them with the generic ones
+    bool has_fixed_dim = d == 384 || d == 768 || d == 1024;
+
     for (auto& [bench_name, quantizer_type] : benchs) {
         benchmark::RegisterBenchmark(
-                bench_name.c_str(), bench_distance, quantizer_type, d, n)
+                bench_name.c_str(),
+                bench_distance,
+                quantizer_type,
+                d,
+                n,
+                true)
                 ->Iterations(iterations);
+        if (has_fixed_dim) {
+            benchmark::RegisterBenchmark(
+                    (bench_name + "_generic_d").c_str(),
+                    bench_distance,
+                    quantizer_type,
+                    d,
+                    n,
+                    false)
+                    ->Iterations(iterations);
+        }
     }
     benchmark::RunSpecifiedBenchmarks();
     benchmark::Shutdown();
@@ -127,3 +127,44 @@ TEST(RCQCropping, search_params) {
     EXPECT_EQ(I1, I3);
     EXPECT_EQ(D1, D3);
 }
+
+/* The table-based beam search (rq.use_beam_LUT) gives the same results as
+ * the residual-based one, for single queries and batches. */
+TEST(RCQCropping, beam_LUT) {
+    size_t nq = 20, nt = 2000, d = 32;
+
+    std::vector<float> buf((nq + nt) * d);
+    faiss::rand_smooth_vectors(nq + nt, d, buf.data(), 1234);
+    const float* xt = buf.data();
+    const float* xq = xt + nt * d;
+
+    faiss::ResidualCoarseQuantizer rcq(d, {6, 5, 4});
+    rcq.train(nt, xt);
+    rcq.set_beam_factor(4.0);
+
+    int k = 10;
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    std::vector<float> Dref(nq * k), D(nq * k);
+    rcq.search(nq, xq, k, Dref.data(), Iref.data());
+
+    rcq.rq.use_beam_LUT = 1;
+    rcq.search(nq, xq, k, D.data(), I.data());
+    size_t nsame = 0;
+    for (size_t i = 0; i < nq * k; i++) {
+        nsame += I[i] == Iref[i];
+        EXPECT_NEAR(D[i], Dref[i], 1e-3 * (1 + Dref[i]));
+    }
+    // ties may be ordered differently
+    EXPECT_GE(nsame, nq * k * 95 / 100);
+
+    // single queries
+    for (size_t q = 0; q < nq; q++) {
+        std::vector<faiss::idx_t> I1(k);
+        std::vector<float> D1(k);
+        rcq.search(1, xq + q * d, k, D1.data(), I1.data());
+        for (int j = 0; j < k; j++) {
+            EXPECT_EQ(I1[j], I[q * k + j]);
+            EXPECT_NEAR(D1[j], D[q * k + j], 1e-3 * (1 + D[q * k + j]));
+        }
+    }
+}
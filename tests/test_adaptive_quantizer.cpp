@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexAdaptiveQuantizer.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexPQFastScan.h>
+#include <faiss/clone_index.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+
+} // namespace
+
+TEST(AdaptiveQuantizer, accel_types) {
+    int nlist = 10000, n = 2000;
+    std::vector<float> centroids(nlist * d), x(n * d);
+    faiss::rand_smooth_vectors(nlist, d, centroids.data(), 123);
+    faiss::rand_smooth_vectors(n, d, x.data(), 456);
+
+    faiss::IndexAdaptiveQuantizer quantizer(d);
+    quantizer.add(nlist, centroids.data());
+    // below min_accel_size
+    EXPECT_EQ(quantizer.accel, nullptr);
+    EXPECT_EQ(quantizer.assignment_accuracy(n, x.data()), 1.0);
+
+    quantizer.min_accel_size = 1000;
+    quantizer.build_accel();
+    EXPECT_TRUE(dynamic_cast<faiss::IndexPQFastScan*>(quantizer.accel));
+    EXPECT_GT(quantizer.assignment_accuracy(n, x.data()), 0.95);
+
+    quantizer.hnsw_min_size = 5000;
+    quantizer.build_accel();
+    EXPECT_TRUE(dynamic_cast<faiss::IndexHNSWFlat*>(quantizer.accel));
+    EXPECT_GT(quantizer.assignment_accuracy(n, x.data()), 0.95);
+
+    // the results are re-checked with exact distances
+    std::vector<float> D(n * 4);
+    std::vector<faiss::idx_t> I(n * 4);
+    quantizer.search(n, x.data(), 4, D.data(), I.data());
+    for (int i = 0; i < n * 4; i++) {
+        ASSERT_GE(I[i], 0);
+        EXPECT_FLOAT_EQ(
+                D[i],
+                faiss::fvec_L2sqr(
+                        x.data() + (i / 4) * d,
+                        centroids.data() + I[i] * d,
+                        d));
+    }
+
+    quantizer.reset();
+    EXPECT_EQ(quantizer.accel, nullptr);
+}
+
+TEST(AdaptiveQuantizer, ivf) {
+    int nlist = 1024, nt = 20000, nb = 10000, nq = 100, k = 10;
+    std::vector<float> xt(nt * d), xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nt, d, xt.data(), 12);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "IVF1024_ADAPT,Flat"));
+    auto index_ivf = dynamic_cast<faiss::IndexIVFFlat*>(index.get());
+    ASSERT_TRUE(index_ivf);
+    EXPECT_EQ(index_ivf->quantizer_trains_alone, 2);
+    auto quantizer =
+            dynamic_cast<faiss::IndexAdaptiveQuantizer*>(index_ivf->quantizer);
+    ASSERT_TRUE(quantizer);
+    quantizer->min_accel_size = 256;
+    index->train(nt, xt.data());
+    ASSERT_TRUE(quantizer->accel);
+    EXPECT_EQ(quantizer->ntotal, nlist);
+    EXPECT_GT(quantizer->assignment_accuracy(nb, xb.data()), 0.95);
+    index->add(nb, xb.data());
+    index_ivf->nprobe = 16;
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I2(nq * k);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+
+    const char* fname = "/tmp/test_adaptive_quantizer.index";
+    faiss::write_index(index.get(), fname);
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(fname));
+    std::remove(fname);
+    auto quantizer2 = dynamic_cast<faiss::IndexAdaptiveQuantizer*>(
+            dynamic_cast<faiss::IndexIVF*>(index2.get())->quantizer);
+    ASSERT_TRUE(quantizer2);
+    EXPECT_EQ(quantizer2->min_accel_size, 256);
+    ASSERT_TRUE(quantizer2->accel);
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+
+    std::unique_ptr<faiss::Index> index3(faiss::clone_index(index.get()));
+    auto quantizer3 = dynamic_cast<faiss::IndexAdaptiveQuantizer*>(
+            dynamic_cast<faiss::IndexIVF*>(index3.get())->quantizer);
+    ASSERT_TRUE(quantizer3);
+    EXPECT_NE(quantizer3->accel, quantizer->accel);
+    index3->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I, I2);
+}
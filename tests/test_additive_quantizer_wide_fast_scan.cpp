@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexAdditiveQuantizerWideFastScan.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/pq_wide_fast_scan.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const int d = 32;
+const int nb = 3000;
+const int nq = 30;
+const int k = 10;
+
+std::unique_ptr<faiss::IndexAdditiveQuantizerWideFastScan> make_index(
+        const char* key,
+        faiss::MetricType metric,
+        const std::vector<float>& xb) {
+    std::unique_ptr<faiss::IndexAdditiveQuantizerWideFastScan> index(
+            dynamic_cast<faiss::IndexAdditiveQuantizerWideFastScan*>(
+                    faiss::index_factory(d, key, metric)));
+    EXPECT_NE(index, nullptr);
+    // short trainings
+    if (auto lsq = dynamic_cast<faiss::LocalSearchQuantizer*>(index->aq)) {
+        lsq->train_iters = 4;
+    }
+    if (auto paq =
+                dynamic_cast<faiss::ProductAdditiveQuantizer*>(index->aq)) {
+        for (auto q : paq->quantizers) {
+            if (auto lsq = dynamic_cast<faiss::LocalSearchQuantizer*>(q)) {
+                lsq->train_iters = 4;
+            }
+        }
+    }
+    index->train(nb, xb.data());
+    index->add(nb, xb.data());
+    return index;
+}
+
+void test_search(const char* key, faiss::MetricType metric) {
+    SCOPED_TRACE(key);
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+    auto index = make_index(key, metric, xb);
+    size_t M2 = index->M2;
+    EXPECT_EQ(M2, index->aq->M + (metric == faiss::METRIC_L2 ? 1 : 0));
+
+    // the kernel computes the sums of the quantized table entries
+    std::vector<uint8_t> lut(nq * M2 * 256);
+    std::vector<float> normalizers(2 * nq);
+    index->compute_quantized_LUT(nq, xq.data(), lut.data(), normalizers.data());
+    std::vector<float> D(k * nq);
+    std::vector<faiss::idx_t> I(k * nq);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    bool is_max = metric == faiss::METRIC_L2;
+    for (int q = 0; q < nq; q++) {
+        std::vector<int> sums(nb);
+        for (int i = 0; i < nb; i++) {
+            for (size_t m = 0; m < M2; m++) {
+                int c = faiss::pqwide_get_packed_element(
+                        index->codes.get(), M2, 8, i, m);
+                sums[i] += lut[(q * M2 + m) * 256 + c];
+            }
+        }
+        std::vector<int> sorted = sums;
+        if (is_max) {
+            std::sort(sorted.begin(), sorted.end());
+        } else {
+            std::sort(sorted.rbegin(), sorted.rend());
+        }
+        float a = normalizers[2 * q], b = normalizers[2 * q + 1];
+        for (int j = 0; j < k; j++) {
+            EXPECT_EQ(sums[I[q * k + j]], sorted[j]);
+            EXPECT_FLOAT_EQ(D[q * k + j], sorted[j] / a + b);
+        }
+    }
+
+    // exact search in the decoded vectors
+    std::vector<float> recons(nb * d);
+    for (int i = 0; i < nb; i++) {
+        index->reconstruct(i, recons.data() + i * d);
+    }
+    faiss::IndexFlat index_ref(d, metric);
+    index_ref.add(nb, recons.data());
+    std::vector<float> D_ref(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq);
+    index_ref.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    int n_found = 0;
+    for (int q = 0; q < nq; q++) {
+        for (int j = 0; j < k; j++) {
+            n_found += std::count(
+                    I_ref.begin() + q * k,
+                    I_ref.begin() + (q + 1) * k,
+                    I[q * k + j]);
+        }
+        // the L2 distances include the query norm
+        EXPECT_NEAR(D[q * k], D_ref[q * k], 0.1 * std::abs(D_ref[q * k]));
+    }
+    EXPECT_GT(n_found, nq * k * 0.7);
+
+    // the sa codes are the bytes stored in the blocks
+    ASSERT_EQ(index->sa_code_size(), M2);
+    std::vector<uint8_t> codes(10 * M2);
+    for (int i = 0; i < 10; i++) {
+        for (size_t m = 0; m < M2; m++) {
+            codes[i * M2 + m] = faiss::pqwide_get_packed_element(
+                    index->codes.get(), M2, 8, i, m);
+        }
+    }
+    std::vector<float> decoded(10 * d);
+    index->sa_decode(10, codes.data(), decoded.data());
+    for (int i = 0; i < 10 * d; i++) {
+        EXPECT_FLOAT_EQ(decoded[i], recons[i]);
+    }
+
+    Tempfilename tmp;
+    faiss::write_index(index.get(), tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    std::unique_ptr<faiss::Index> index3(faiss::clone_index(index.get()));
+    for (auto idx : {index2.get(), index3.get()}) {
+        std::vector<float> D2(k * nq);
+        std::vector<faiss::idx_t> I2(k * nq);
+        idx->search(nq, xq.data(), k, D2.data(), I2.data());
+        EXPECT_EQ(D2, D);
+        EXPECT_EQ(I2, I);
+    }
+}
+
+} // namespace
+
+TEST(AQWideFastScan, RQ) {
+    test_search("RQ4x8fs", faiss::METRIC_L2);
+    test_search("RQ4x8fs_Nqint8", faiss::METRIC_L2);
+    test_search("RQ4x8fs", faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(AQWideFastScan, LSQ) {
+    test_search("LSQ4x8fs_Nrq2x4", faiss::METRIC_L2);
+    test_search("LSQ4x8fs", faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(AQWideFastScan, PRQ) {
+    test_search("PRQ2x2x8fs", faiss::METRIC_L2);
+    test_search("PLSQ2x2x8fs", faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(AQWideFastScan, bad_search_type) {
+    EXPECT_THROW(
+            faiss::IndexResidualQuantizerWideFastScan(
+                    d, 4, faiss::METRIC_L2, faiss::AdditiveQuantizer::ST_LUT_nonorm),
+            faiss::FaissException);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <faiss/impl/BatchedFileReader.h>
+#include <faiss/impl/FaissException.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+void check_reads(faiss::BatchedFileReader& reader) {
+    Tempfilename tmp;
+    std::mt19937 rng(123);
+    // not a multiple of the block size, to exercise reads at EOF
+    std::vector<char> content(1 << 20 | 123);
+    for (char& c : content) {
+        c = rng();
+    }
+    FILE* f = fopen(tmp.c_str(), "wb");
+    ASSERT_EQ(fwrite(content.data(), 1, content.size(), f), content.size());
+    fclose(f);
+
+    int fd = open(tmp.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    for (int round = 0; round < 5; round++) {
+        // share blocks, overlap and end exactly at EOF
+        size_t n = 1 + rng() % 300;
+        std::vector<std::vector<char>> out(n);
+        std::vector<faiss::BatchedFileReader::Request> requests;
+        for (size_t i = 0; i < n; i++) {
+            size_t size = 1 + rng() % 600;
+            off_t offset = i == 0 ? content.size() - size
+                                  : rng() % (content.size() - size);
+            out[i].resize(size);
+            requests.push_back({offset, size, out[i].data()});
+        }
+        reader.read(fd, requests);
+        for (size_t i = 0; i < n; i++) {
+            ASSERT_EQ(
+                    memcmp(out[i].data(),
+                           content.data() + requests[i].offset,
+                           requests[i].size),
+                    0);
+        }
+    }
+
+    std::vector<char> buf(16);
+    std::vector<faiss::BatchedFileReader::Request> past_eof = {
+            {(off_t)content.size() + 8192, buf.size(), buf.data()}};
+    EXPECT_THROW(reader.read(fd, past_eof), faiss::FaissException);
+    close(fd);
+}
+
+} // namespace
+
+TEST(BatchedFileReader, default_queue) {
+    faiss::BatchedFileReader reader;
+    check_reads(reader);
+}
+
+TEST(BatchedFileReader, pread_fallback) {
+    faiss::BatchedFileReader reader(0);
+    EXPECT_FALSE(reader.uses_io_uring());
+    check_reads(reader);
+}
+
+TEST(BatchedFileReader, small_queue) {
+    // more spans than queue entries
+    faiss::BatchedFileReader reader(4);
+    check_reads(reader);
+}
@@ -198,6 +198,71 @@ class TestKnn(unittest.TestCase):
         self.subtest_result_order(3)
 
 
+class TestMIH(unittest.TestCase):
+    """ IndexBinaryMIH is exact, so it should match IndexBinaryFlat """
+
+    def do_test(self, d, nhash):
+        nq = 50
+        nb = 3000
+
+        (_, xb, xq) = make_binary_dataset(d, 0, nb, nq)
+        # add near-duplicates of the queries so that the small radii
+        # return something
+        rs = np.random.RandomState(123)
+        xb[:nq] = xq ^ (rs.rand(nq, d // 8) < 0.05).astype('uint8')
+
+        index_ref = faiss.IndexBinaryFlat(d)
+        index_ref.add(xb)
+
+        index = faiss.IndexBinaryMIH(d, nhash)
+        index.add(xb[:nb // 2])
+        index.add(xb[nb // 2:])
+        self.assertEqual(index.ntotal, nb)
+
+        for radius in 1, d // 8, d // 3:
+            Lref, Dref, Iref = index_ref.range_search(xq, radius)
+            Lnew, Dnew, Inew = index.range_search(xq, radius)
+            np.testing.assert_array_equal(Lref, Lnew)
+            for i in range(nq):
+                ref = sorted(zip(Iref[Lref[i]:Lref[i + 1]],
+                                 Dref[Lref[i]:Lref[i + 1]]))
+                new = sorted(zip(Inew[Lnew[i]:Lnew[i + 1]],
+                                 Dnew[Lnew[i]:Lnew[i + 1]]))
+                self.assertEqual(ref, new)
+
+        for k in 1, 10, 100:
+            Dref, Iref = index_ref.search(xq, k)
+            Dnew, Inew = index.search(xq, k)
+            # ties may be broken differently
+            np.testing.assert_array_equal(Dref, Dnew)
+            for i in range(nq):
+                dis = np.unpackbits(xq[i] ^ xb[Inew[i]], axis=1).sum(1)
+                np.testing.assert_array_equal(dis, Dnew[i])
+
+        # the tables are rebuilt at deserialization
+        index2 = faiss.deserialize_index_binary(
+            faiss.serialize_index_binary(index))
+        self.assertEqual(index2.hashtable_size(), index.hashtable_size())
+        D2, I2 = index2.search(xq, 10)
+        Dnew, Inew = index.search(xq, 10)
+        np.testing.assert_array_equal(Dnew, D2)
+        np.testing.assert_array_equal(Inew, I2)
+
+    def test_64_4(self):
+        self.do_test(64, 4)
+
+    def test_72_5(self):
+        self.do_test(72, 5)
+
+    def test_256_8(self):
+        self.do_test(256, 8)
+
+    def test_factory(self):
+        index = faiss.index_binary_factory(128, "BMIH4")
+        self.assertEqual(index.nhash, 4)
+        self.assertEqual(index.substring_length(3), 32)
+
+
 
 
 """
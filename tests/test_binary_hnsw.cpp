@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexBinaryFlat.h>
+#include <faiss/IndexBinaryHNSW.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+// 256-bit hashes, the queries are database hashes with a few bits flipped
+const int d = 256, nb = 5000, nq = 100, k = 10;
+
+struct BinaryData {
+    std::vector<uint8_t> xb, xq;
+
+    BinaryData() : xb(nb * d / 8), xq(nq * d / 8) {
+        faiss::byte_rand(xb.data(), xb.size(), 123);
+        faiss::RandomGenerator rng(456);
+        for (int i = 0; i < nq; i++) {
+            int src = rng.rand_int(nb);
+            memcpy(xq.data() + i * d / 8, xb.data() + src * d / 8, d / 8);
+            for (int j = 0; j < 8; j++) {
+                int bit = rng.rand_int(d);
+                xq[i * d / 8 + bit / 8] ^= 1 << (bit % 8);
+            }
+        }
+    }
+};
+
+struct Results {
+    std::vector<int32_t> D;
+    std::vector<faiss::idx_t> I;
+
+    Results() : D(nq * k), I(nq * k) {}
+};
+
+Results search(
+        const faiss::IndexBinary& index,
+        const BinaryData& data,
+        const faiss::SearchParameters* params = nullptr) {
+    Results res;
+    index.search(nq, data.xq.data(), k, res.D.data(), res.I.data(), params);
+    return res;
+}
+
+} // namespace
+
+TEST(IndexBinaryHNSW, search_params) {
+    BinaryData data;
+    faiss::IndexBinaryHNSW index(d, 16);
+    index.add(nb, data.xb.data());
+
+    faiss::IndexBinaryFlat index_gt(d);
+    index_gt.add(nb, data.xb.data());
+    Results gt = search(index_gt, data);
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    Results res = search(index, data, &params);
+    int n_ok = 0;
+    for (int q = 0; q < nq; q++) {
+        n_ok += res.D[q * k] == gt.D[q * k];
+    }
+    EXPECT_GT(n_ok, nq * 0.95);
+
+    // the beam search of the float HNSW applies to the Hamming distances
+    params.beam_size = 4;
+    faiss::hnsw_stats.reset();
+    Results res_beam = search(index, data, &params);
+    EXPECT_GT(faiss::hnsw_stats.ndis, 0);
+    int n_ok_beam = 0;
+    for (int q = 0; q < nq; q++) {
+        n_ok_beam += res_beam.D[q * k] == gt.D[q * k];
+    }
+    EXPECT_GE(n_ok_beam, n_ok - nq / 20);
+
+    faiss::SearchParameters bad_params;
+    EXPECT_THROW(search(index, data, &bad_params), faiss::FaissException);
+}
+
+TEST(IndexBinaryHNSW, compact_on_disk) {
+    BinaryData data;
+    faiss::IndexBinaryHNSW index(d, 16);
+    index.add(nb, data.xb.data());
+    index.hnsw.efSearch = 64;
+    Results ref = search(index, data);
+
+    // the compact graph keeps the neighbor order: same traversal
+    index.hnsw.convert_to_compact();
+    Results res = search(index, data);
+    EXPECT_EQ(res.I, ref.I);
+    EXPECT_EQ(res.D, ref.D);
+    EXPECT_THROW(index.add(1, data.xb.data()), faiss::FaissException);
+
+    Tempfilename tmp;
+    faiss::write_index_binary(&index, tmp.c_str());
+
+    faiss::HNSWIndexConfig config(true, false, false, 0, nullptr);
+    std::unique_ptr<faiss::IndexBinary> index2(
+            faiss::read_index_binary(tmp.c_str(), 0, config));
+    auto index2_hnsw = dynamic_cast<faiss::IndexBinaryHNSW*>(index2.get());
+    ASSERT_NE(index2_hnsw, nullptr);
+    EXPECT_TRUE(index2_hnsw->hnsw.storage_is_compact);
+    EXPECT_EQ(search(*index2, data).I, ref.I);
+
+    // neighbor lists read on demand with pread and from the mapped file
+    faiss::HNSWIndexConfig config_disk(true, true, false, 0, nullptr);
+    for (int io_flags : {0, faiss::IO_FLAG_MMAP_IFC}) {
+        std::unique_ptr<faiss::IndexBinary> index3(
+                faiss::read_index_binary(tmp.c_str(), io_flags, config_disk));
+        auto index3_hnsw =
+                dynamic_cast<faiss::IndexBinaryHNSW*>(index3.get());
+        ASSERT_TRUE(index3_hnsw->hnsw.neighbors_on_disk);
+        if (io_flags == 0) {
+            index3_hnsw->hnsw.initialize_graph(tmp.filename);
+        }
+        Results res3 = search(*index3, data);
+        EXPECT_EQ(res3.I, ref.I);
+        EXPECT_EQ(res3.D, ref.D);
+        EXPECT_THROW(
+                index3->add(1, data.xb.data()), faiss::FaissException);
+    }
+}
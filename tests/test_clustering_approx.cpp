@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, n = 40000, k = 1000;
+
+float objective(const std::vector<float>& x, faiss::Index& index) {
+    std::vector<float> dis(n);
+    std::vector<faiss::idx_t> assign(n);
+    index.search(n, x.data(), 1, dis.data(), assign.data());
+    float obj = 0;
+    for (float v : dis) {
+        obj += v;
+    }
+    return obj;
+}
+
+} // namespace
+
+TEST(ClusteringApprox, objective) {
+    std::vector<float> x(n * d);
+    faiss::float_rand(x.data(), x.size(), 123);
+
+    faiss::Clustering ref(d, k);
+    ref.niter = 10;
+    faiss::IndexFlatL2 index_ref(d);
+    ref.train(n, x.data(), index_ref);
+    EXPECT_EQ(ref.iteration_stats[0].assign_recall, -1);
+
+    faiss::Clustering clus(d, k);
+    clus.niter = 10;
+    clus.approx_assign_min_k = 500;
+    clus.approx_rebuild_period = 3;
+    faiss::IndexFlatL2 index(d);
+    clus.train(n, x.data(), index);
+
+    EXPECT_EQ(index.ntotal, k);
+    EXPECT_LT(objective(x, index), objective(x, index_ref) * 1.02);
+    for (const faiss::ClusteringIterationStats& stats :
+         clus.iteration_stats) {
+        EXPECT_GT(stats.assign_recall, 0.8);
+        EXPECT_LE(stats.assign_recall, 1);
+    }
+}
+
+TEST(ClusteringApprox, adapt_efSearch) {
+    std::vector<float> x(n * d);
+    faiss::float_rand(x.data(), x.size(), 456);
+
+    // start with a very low efSearch, that is increased to reach the recall
+    faiss::Clustering clus(d, k);
+    clus.niter = 8;
+    clus.approx_assign_min_k = 1;
+    clus.approx_hnsw_M = 8;
+    clus.approx_efSearch = 1;
+    clus.approx_min_recall = 0.98;
+    faiss::IndexFlatL2 index(d);
+    clus.train(n, x.data(), index);
+
+    float first = clus.iteration_stats.front().assign_recall;
+    float last = clus.iteration_stats.back().assign_recall;
+    EXPECT_LT(first, 0.98);
+    EXPECT_GT(last, first);
+    EXPECT_GT(last, 0.9);
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/utils.h>
+
+namespace {
+
+const size_t d = 8, n = 30000, nlist = 256;
+
+std::vector<float> make_data() {
+    // mixture of gaussians with very different weights
+    const size_t nc = 32;
+    std::vector<float> centers(nc * d), x(n * d);
+    faiss::float_rand(centers.data(), centers.size(), 123);
+    faiss::float_randn(x.data(), x.size(), 456);
+    faiss::RandomGenerator rng(789);
+    for (size_t i = 0; i < n; i++) {
+        size_t c = rng.rand_int(nc);
+        c = rng.rand_int(c + 1);
+        c = rng.rand_int(c + 1);
+        for (size_t j = 0; j < d; j++) {
+            x[i * d + j] = centers[c * d + j] + 0.1 * x[i * d + j];
+        }
+    }
+    return x;
+}
+
+struct TrainResult {
+    float obj;
+    double imbalance;
+};
+
+TrainResult train_ivf(
+        const std::vector<float>& x,
+        const faiss::ClusteringParameters& cp) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.cp = cp;
+    index.train(n, x.data());
+    EXPECT_EQ(quantizer.ntotal, nlist);
+
+    std::vector<float> dis(n);
+    std::vector<faiss::idx_t> assign(n);
+    quantizer.search(n, x.data(), 1, dis.data(), assign.data());
+    TrainResult res = {0, faiss::imbalance_factor(n, nlist, assign.data())};
+    for (float v : dis) {
+        res.obj += v;
+    }
+    return res;
+}
+
+} // namespace
+
+TEST(ClusteringHierarchical, IVF_train) {
+    std::vector<float> x = make_data();
+    faiss::ClusteringParameters cp;
+    cp.niter = 10;
+    TrainResult ref = train_ivf(x, cp);
+
+    cp.hierarchical_nc1 = 16;
+    TrainResult res = train_ivf(x, cp);
+    EXPECT_LT(res.obj, ref.obj * 1.05);
+    EXPECT_LT(res.imbalance, ref.imbalance);
+}
+
+TEST(ClusteringHierarchical, balance) {
+    std::vector<float> x = make_data();
+    faiss::ClusteringParameters cp;
+    cp.niter = 10;
+    TrainResult ref = train_ivf(x, cp);
+
+    cp.balance_penalty = 0.3;
+    TrainResult res = train_ivf(x, cp);
+    EXPECT_LT(res.imbalance, ref.imbalance);
+    EXPECT_LT(res.obj, ref.obj * 1.05);
+
+    cp.hierarchical_nc1 = 16;
+    TrainResult res2 = train_ivf(x, cp);
+    EXPECT_LT(res2.imbalance, res.imbalance);
+    EXPECT_LT(res2.obj, ref.obj * 1.05);
+}
+
+TEST(ClusteringHierarchical, small_clusters) {
+    // more first level clusters than points per centroid
+    std::vector<float> x = make_data();
+    faiss::Clustering clus(d, 2000);
+    clus.hierarchical_nc1 = 100;
+    clus.niter = 4;
+    faiss::IndexFlatL2 index(d);
+    clus.train(n, x.data(), index);
+    EXPECT_EQ(index.ntotal, 2000);
+    EXPECT_EQ(clus.centroids.size(), 2000 * d);
+}
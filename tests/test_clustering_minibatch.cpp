@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, n = 20000, k = 50;
+
+std::vector<float> make_data() {
+    std::vector<float> x(n * d);
+    faiss::float_rand(x.data(), x.size(), 123);
+    return x;
+}
+
+/// returns the vectors by small irregular chunks
+struct SmallChunksDataSource : faiss::ArrayClusteringDataSource {
+    using ArrayClusteringDataSource::ArrayClusteringDataSource;
+
+    size_t read(size_t nr, float* xr) override {
+        return ArrayClusteringDataSource::read(
+                std::min(nr, 1 + pos % 777), xr);
+    }
+};
+
+float objective(const std::vector<float>& x, faiss::Index& index) {
+    std::vector<float> dis(n);
+    std::vector<faiss::idx_t> assign(n);
+    index.search(n, x.data(), 1, dis.data(), assign.data());
+    float obj = 0;
+    for (float v : dis) {
+        obj += v;
+    }
+    return obj;
+}
+
+} // namespace
+
+TEST(ClusteringMinibatch, objective) {
+    std::vector<float> x = make_data();
+
+    faiss::Clustering ref(d, k);
+    ref.niter = 20;
+    faiss::IndexFlatL2 index_ref(d);
+    ref.train(n, x.data(), index_ref);
+    float obj_ref = objective(x, index_ref);
+
+    faiss::Clustering clus(d, k);
+    clus.minibatch_size = 2000;
+    clus.minibatch_passes = 3;
+    faiss::ArrayClusteringDataSource source(d, n, x.data());
+    faiss::IndexFlatL2 index(d);
+    clus.train_minibatch(source, index);
+
+    EXPECT_EQ(clus.centroids.size(), k * d);
+    EXPECT_EQ(index.ntotal, k);
+    EXPECT_EQ(clus.iteration_stats.size(), 3);
+    float obj = objective(x, index);
+    EXPECT_LT(obj, obj_ref * 1.1);
+    // the passes improve the objective
+    EXPECT_LT(clus.iteration_stats[2].obj, clus.iteration_stats[0].obj);
+}
+
+TEST(ClusteringMinibatch, chunks) {
+    std::vector<float> x = make_data();
+
+    // the result does not depend on how the source splits the reads
+    faiss::Clustering clus1(d, k), clus2(d, k);
+    for (faiss::Clustering* clus : {&clus1, &clus2}) {
+        clus->minibatch_size = 1000;
+        clus->minibatch_passes = 2;
+    }
+    faiss::ArrayClusteringDataSource source1(d, n, x.data());
+    faiss::IndexFlatL2 index1(d);
+    clus1.train_minibatch(source1, index1);
+
+    SmallChunksDataSource source2(d, n, x.data());
+    faiss::IndexFlatL2 index2(d);
+    clus2.train_minibatch(source2, index2);
+
+    float obj1 = objective(x, index1), obj2 = objective(x, index2);
+    EXPECT_LT(obj2, obj1 * 1.05);
+    EXPECT_LT(obj1, obj2 * 1.05);
+}
+
+TEST(ClusteringMinibatch, frozen_spherical) {
+    std::vector<float> x = make_data();
+
+    faiss::Clustering clus(d, k);
+    clus.minibatch_size = 3000;
+    clus.spherical = true;
+    clus.frozen_centroids = true;
+    std::vector<float> input(x.begin() + 100 * d, x.begin() + 110 * d);
+    clus.centroids = input;
+    faiss::ArrayClusteringDataSource source(d, n, x.data());
+    faiss::IndexFlatIP index(d);
+    clus.train_minibatch(source, index);
+
+    // the frozen centroids are only normalized
+    faiss::fvec_renorm_L2(d, 10, input.data());
+    for (size_t i = 0; i < 10 * d; i++) {
+        EXPECT_NEAR(clus.centroids[i], input[i], 1e-6);
+    }
+    for (size_t c = 0; c < k; c++) {
+        float norm2 = faiss::fvec_norm_L2sqr(clus.centroids.data() + c * d, d);
+        EXPECT_NEAR(norm2, 1, 1e-4);
+    }
+}
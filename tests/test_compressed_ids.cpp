@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQFastScan.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/BlockInvertedLists.h>
+#include <faiss/invlists/CompressedIDs.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const int d = 32;
+const int nb = 10000;
+const int nq = 50;
+const int k = 10;
+
+void check_roundtrip(const std::vector<faiss::idx_t>& ids) {
+    faiss::CompressedIDs cids(ids.size(), ids.data());
+    std::vector<faiss::idx_t> decoded(ids.size());
+    cids.decode(decoded.data());
+    EXPECT_EQ(decoded, ids);
+    for (size_t i = 0; i < ids.size(); i++) {
+        ASSERT_EQ(cids.get(i), ids[i]);
+    }
+}
+
+} // namespace
+
+TEST(CompressedIDs, roundtrip) {
+    std::mt19937 rng(123);
+    std::vector<faiss::idx_t> seq(1000), gaps(1000), rnd(1000);
+    faiss::idx_t v = 1234;
+    for (size_t i = 0; i < 1000; i++) {
+        seq[i] = 5000 + i;
+        v += rng() % 100;
+        gaps[i] = v;
+        rnd[i] = int64_t(rng()) << 20 | rng() % 1024;
+    }
+    check_roundtrip(seq);
+    check_roundtrip(gaps);
+    check_roundtrip(rnd);
+    check_roundtrip({});
+    check_roundtrip({-1, 7, -1, 3});
+    check_roundtrip({INT64_MIN, INT64_MAX, 0});
+
+    // consecutive ids cost only the block headers
+    faiss::CompressedIDs cids(seq.size(), seq.data());
+    EXPECT_LT(cids.nbytes(), seq.size());
+}
+
+TEST(CompressedIDs, ivf_flat) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.nprobe = 4;
+    index.train(nb, xb.data());
+    index.add(nb / 2, xb.data());
+
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    auto ails = dynamic_cast<faiss::ArrayInvertedLists*>(index.invlists);
+    ASSERT_NE(ails, nullptr);
+    ails->compress_ids();
+    EXPECT_TRUE(ails->has_compressed_ids());
+    for (size_t l = 0; l < index.nlist; l++) {
+        EXPECT_EQ(ails->ids[l].size(), 0);
+    }
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(I, I_ref);
+
+    // io
+    Tempfilename tmp;
+    faiss::write_index(&index, tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    index2->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(I, I_ref);
+
+    // the lists that are modified are decompressed
+    index.add(nb / 2, xb.data() + d * nb / 2);
+    faiss::IndexIVFFlat index_ref(&quantizer, d, 32);
+    index_ref.nprobe = 4;
+    index_ref.add(nb, xb.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index_ref.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(I, I_ref);
+}
+
+TEST(CompressedIDs, ivf_fast_scan) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQFastScan index(&quantizer, d, 32, 8, 4);
+    index.nprobe = 4;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    auto bil = dynamic_cast<faiss::BlockInvertedLists*>(index.invlists);
+    ASSERT_NE(bil, nullptr);
+    bil->compress_ids();
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(I, I_ref);
+
+    Tempfilename tmp;
+    faiss::write_index(&index, tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    auto index2_ivf = dynamic_cast<faiss::IndexIVF*>(index2.get());
+    ASSERT_NE(index2_ivf, nullptr);
+    EXPECT_TRUE(index2_ivf->invlists->has_compressed_ids());
+    index2->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(I, I_ref);
+}
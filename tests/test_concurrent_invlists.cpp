@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/ConcurrentInvertedLists.h>
+#include <faiss/invlists/ConcurrentOnDiskInvertedLists.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nlist = 16, nt = 2000, nb = 20000, nq = 50, k = 10;
+
+} // namespace
+
+TEST(ConcurrentInvertedLists, search_while_adding) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.train(nt, xb.data());
+    index.replace_invlists(
+            new faiss::ConcurrentInvertedLists(nlist, index.code_size, 100),
+            true);
+    index.nprobe = nlist;
+
+    faiss::IndexIVFFlat ref(&quantizer, d, nlist);
+    ref.is_trained = true;
+    ref.nprobe = nlist;
+    ref.add(nb, xb.data());
+
+    // searches in a background thread, every result must be a vector that
+    // was added with its exact distance
+    std::atomic<bool> done(false);
+    std::atomic<size_t> nsearch(0), nbad(0);
+    std::thread reader([&]() {
+        std::vector<float> D(nq * k);
+        std::vector<faiss::idx_t> I(nq * k);
+        while (!done) {
+            index.search(nq, xq.data(), k, D.data(), I.data());
+            for (size_t i = 0; i < nq * k; i++) {
+                if (I[i] < 0) {
+                    continue;
+                }
+                float dis = faiss::fvec_L2sqr(
+                        xq.data() + (i / k) * d, xb.data() + I[i] * d, d);
+                if (I[i] >= nb || std::abs(dis - D[i]) > 1e-3) {
+                    nbad++;
+                }
+            }
+            nsearch++;
+        }
+    });
+
+    size_t bs = 500;
+    for (size_t i0 = 0; i0 < nb; i0 += bs) {
+        index.add(bs, xb.data() + i0 * d);
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_GT(nsearch, 0);
+    EXPECT_EQ(nbad, 0);
+
+    // final results are the same as with the regular inverted lists
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(I, Iref);
+
+    // removal through the copy-on-write resize and update
+    faiss::IDSelectorRange sel(0, nb / 2);
+    EXPECT_EQ(index.remove_ids(sel), nb / 2);
+    EXPECT_EQ(index.invlists->compute_ntotal(), nb / 2);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (faiss::idx_t id : I) {
+        EXPECT_GE(id, nb / 2);
+    }
+}
+
+TEST(ConcurrentOnDiskInvertedLists, add_compact_and_reload) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    char fname[] = "/tmp/faiss_concurrent_ondisk_XXXXXX";
+    int fd = mkstemp(fname);
+    close(fd);
+    std::string index_fname = std::string(fname) + ".index";
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.train(nt, xb.data());
+    auto il = new faiss::ConcurrentOnDiskInvertedLists(
+            nlist, index.code_size, fname, 100);
+    il->grow_extents = 16;
+    index.replace_invlists(il, true);
+    index.nprobe = nlist;
+    il->preallocate(32);
+    EXPECT_GE(il->n_free_extents(), 32);
+
+    faiss::IndexIVFFlat ref(&quantizer, d, nlist);
+    ref.is_trained = true;
+    ref.nprobe = nlist;
+    ref.add(nb, xb.data());
+
+    // searches and compactions in background threads
+    std::atomic<bool> done(false);
+    std::atomic<size_t> nsearch(0), nbad(0);
+    std::thread reader([&]() {
+        std::vector<float> D(nq * k);
+        std::vector<faiss::idx_t> I(nq * k);
+        while (!done) {
+            index.search(nq, xq.data(), k, D.data(), I.data());
+            for (size_t i = 0; i < nq * k; i++) {
+                if (I[i] < 0) {
+                    continue;
+                }
+                float dis = faiss::fvec_L2sqr(
+                        xq.data() + (i / k) * d, xb.data() + I[i] * d, d);
+                if (I[i] >= nb || std::abs(dis - D[i]) > 1e-3) {
+                    nbad++;
+                }
+            }
+            nsearch++;
+        }
+    });
+    std::thread compactor([&]() {
+        while (!done) {
+            il->compact();
+        }
+    });
+
+    size_t bs = 500;
+    for (size_t i0 = 0; i0 < nb; i0 += bs) {
+        index.add(bs, xb.data() + i0 * d);
+    }
+    // removal through the copy-on-write resize and update
+    faiss::IDSelectorRange sel(0, nb / 2);
+    EXPECT_EQ(index.remove_ids(sel), nb / 2);
+    done = true;
+    reader.join();
+    compactor.join();
+    EXPECT_GT(nsearch, 0);
+    EXPECT_EQ(nbad, 0);
+
+    // the file holds only the extents of the lists
+    il->compact();
+    size_t nused = 0;
+    for (size_t l = 0; l < nlist; l++) {
+        nused += il->get_snapshot(l)->extents.size();
+    }
+    EXPECT_EQ(il->n_extents(), nused);
+    EXPECT_EQ(il->n_free_extents(), 0);
+
+    ref.remove_ids(sel);
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, Iref);
+
+    // reload the index, the lists are still in the file
+    faiss::write_index(&index, index_fname.c_str());
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(index_fname.c_str()));
+    auto ivf2 = dynamic_cast<faiss::IndexIVF*>(index2.get());
+    ASSERT_TRUE(ivf2);
+    ASSERT_TRUE(dynamic_cast<faiss::ConcurrentOnDiskInvertedLists*>(
+            ivf2->invlists));
+    ivf2->nprobe = nlist;
+    index2->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, Iref);
+    index2->add(bs, xb.data());
+    EXPECT_EQ(ivf2->invlists->compute_ntotal(), nb / 2 + bs);
+
+    index2.reset();
+    remove(index_fname.c_str());
+    remove(fname);
+}
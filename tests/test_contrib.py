@@ -773,3 +773,40 @@ class TestMerge(unittest.TestCase):
     def test_ondisk_merge_with_shift_ids(self):
         # verified that recall is same for test_ondisk_merge and
         self.do_test_ondisk_merge(True)
+
+
+@unittest.skipIf(
+    not hasattr(np.ndarray, "__dlpack__"), "numpy does not support DLPack")
+class TestDLPack(unittest.TestCase):
+
+    def test_search(self):
+        from faiss.contrib import dlpack_utils
+        ds = datasets.SyntheticDataset(32, 0, 1000, 20)
+        index = faiss.IndexFlatL2(ds.d)
+        dlpack_utils.add(index, ds.get_database())
+        self.assertEqual(index.ntotal, ds.nb)
+
+        Dref, Iref = index.search(ds.get_queries(), 10)
+        D, I = dlpack_utils.search(index, ds.get_queries(), 10)
+        np.testing.assert_array_equal(I, Iref)
+        np.testing.assert_array_equal(D, Dref)
+
+        # results written to the caller's arrays
+        D = np.zeros((ds.nq, 10), dtype='float32')
+        I = np.zeros((ds.nq, 10), dtype='int64')
+        D2, I2 = dlpack_utils.search(index, ds.get_queries(), 10, D=D, I=I)
+        self.assertIs(I2, I)
+        np.testing.assert_array_equal(I, Iref)
+
+        # no silent copy of non-contiguous arrays
+        xq = np.zeros((ds.nq, 2 * ds.d), dtype='float32')[:, ::2]
+        self.assertRaises(ValueError, dlpack_utils.search, index, xq, 10)
+
+    def test_reconstruct_batch(self):
+        from faiss.contrib import dlpack_utils
+        ds = datasets.SyntheticDataset(32, 0, 1000, 0)
+        index = faiss.IndexFlatL2(ds.d)
+        index.add(ds.get_database())
+        keys = np.array([3, 10, 500], dtype='int64')
+        x = dlpack_utils.reconstruct_batch(index, keys)
+        np.testing.assert_array_equal(x, ds.get_database()[keys])
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <faiss/MetricType.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+/// compare the blocked search (fused when compiled in) with the
+/// sequential one, that computes each distance separately
+void test_knn(faiss::MetricType metric, size_t d, size_t nx, size_t k) {
+    const size_t ny = 3001;
+    std::vector<float> x(nx * d), y(ny * d);
+    faiss::float_rand(x.data(), x.size(), 1234 + d);
+    faiss::float_rand(y.data(), y.size(), 4567 + d);
+
+    std::vector<float> D(nx * k), Dref(nx * k);
+    std::vector<int64_t> I(nx * k), Iref(nx * k);
+
+    auto search = [&](float* dis, int64_t* ids) {
+        if (metric == faiss::METRIC_L2) {
+            faiss::knn_L2sqr(
+                    x.data(), y.data(), d, nx, ny, k, dis, ids, nullptr);
+        } else {
+            faiss::knn_inner_product(
+                    x.data(), y.data(), d, nx, ny, k, dis, ids);
+        }
+    };
+
+    int bak = faiss::distance_compute_blas_threshold;
+    faiss::distance_compute_blas_threshold = nx + 1;
+    search(Dref.data(), Iref.data());
+    faiss::distance_compute_blas_threshold = 0;
+    search(D.data(), I.data());
+    faiss::distance_compute_blas_threshold = bak;
+
+    // the ids may differ for ties, so check that they match the distances
+    for (size_t i = 0; i < nx * k; i++) {
+        EXPECT_NEAR(D[i], Dref[i], 1e-5 * d);
+        ASSERT_GE(I[i], 0);
+        const float* xi = x.data() + i / k * d;
+        const float* yj = y.data() + I[i] * d;
+        float dis = metric == faiss::METRIC_L2
+                ? faiss::fvec_L2sqr(xi, yj, d)
+                : faiss::fvec_inner_product(xi, yj, d);
+        EXPECT_NEAR(D[i], dis, 1e-5 * d);
+    }
+}
+
+} // namespace
+
+TEST(DistancesFused, knn_L2sqr) {
+    for (size_t d : {1, 7, 16, 33, 64, 130, 768}) {
+        test_knn(faiss::METRIC_L2, d, 97, 10);
+    }
+}
+
+TEST(DistancesFused, knn_inner_product) {
+    for (size_t d : {1, 7, 16, 33, 64, 130, 768}) {
+        test_knn(faiss::METRIC_INNER_PRODUCT, d, 97, 10);
+    }
+}
+
+TEST(DistancesFused, query_tails) {
+    // all the numbers of queries that are not a multiple of the tile height
+    for (size_t nx = 1; nx < 17; nx++) {
+        test_knn(faiss::METRIC_L2, 24, nx, 5);
+        test_knn(faiss::METRIC_INNER_PRODUCT, 24, nx, 5);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nb = 2000, nq = 20, k = 10;
+
+} // namespace
+
+TEST(EmbeddingProvider, distance_computer) {
+    std::vector<float> xb(nb * d), xq(d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 flat(d);
+    flat.add(nb, xb.data());
+
+    faiss::IndexEmbeddingProvider provider(&flat);
+    faiss::ZmqDistanceComputer dc(d, faiss::METRIC_L2);
+    dc.provider = &provider;
+    dc.set_query(xq.data());
+
+    EXPECT_FLOAT_EQ(
+            dc(17), faiss::fvec_L2sqr(xq.data(), xb.data() + 17 * d, d));
+    std::vector<faiss::idx_t> ids = {3, 1999, 0, 42, 3};
+    std::vector<float> dis;
+    dc.distances_batch(ids, dis);
+    ASSERT_EQ(dis.size(), ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        EXPECT_FLOAT_EQ(
+                dis[i],
+                faiss::fvec_L2sqr(xq.data(), xb.data() + ids[i] * d, d));
+    }
+    EXPECT_EQ(dc.get_fetch_count(), size_t(6));
+}
+
+TEST(EmbeddingProvider, hnsw_recompute_search) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    // the embeddings are recomputed in process from a copy of the vectors
+    faiss::IndexFlatL2 embeddings(d);
+    embeddings.add(nb, xb.data());
+    index.is_recompute = true;
+    index.embedding_provider =
+            std::make_shared<faiss::IndexEmbeddingProvider>(&embeddings);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    EXPECT_EQ(Iref, I);
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(Dref[i], D[i], 1e-5);
+    }
+}
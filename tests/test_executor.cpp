@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <faiss/Clustering.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/utils/executor.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 2000, nq = 100, k = 5;
+
+/// installs an executor for the scope of the test
+struct ScopedExecutor {
+    explicit ScopedExecutor(std::shared_ptr<faiss::Executor> executor) {
+        faiss::set_executor(executor);
+    }
+    ~ScopedExecutor() {
+        faiss::set_executor(nullptr);
+    }
+};
+
+} // namespace
+
+TEST(Executor, thread_pool) {
+    faiss::ThreadPoolExecutor pool(4);
+    EXPECT_EQ(pool.max_workers(), 4);
+
+    std::vector<int> counts(8);
+    std::atomic<int> nested_workers(0);
+    pool.run(8, [&](int rank) {
+        counts[rank]++;
+        EXPECT_TRUE(faiss::in_executor_task());
+        nested_workers += faiss::parallel_workers(1000);
+    });
+    EXPECT_EQ(counts, std::vector<int>(8, 1));
+    // the nested loops are serial
+    EXPECT_EQ(nested_workers, 8);
+    EXPECT_FALSE(faiss::in_executor_task());
+
+    EXPECT_THROW(
+            pool.run(4,
+                     [](int rank) {
+                         if (rank == 2) {
+                             throw std::runtime_error("rank 2");
+                         }
+                     }),
+            std::runtime_error);
+
+    // concurrent callers share the pool
+    std::vector<std::thread> threads;
+    std::atomic<int> total(0);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&]() {
+            for (int rep = 0; rep < 50; rep++) {
+                pool.run(3, [&](int) { total++; });
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    EXPECT_EQ(total, 4 * 50 * 3);
+}
+
+TEST(Executor, parallel_for) {
+    ScopedExecutor scoped(std::make_shared<faiss::ThreadPoolExecutor>(3));
+    int nw = faiss::parallel_workers(1000);
+    EXPECT_EQ(nw, 3);
+    EXPECT_EQ(faiss::parallel_workers(1), 1);
+    std::vector<int> seen(1000);
+    std::vector<size_t> per_worker(nw);
+    faiss::parallel_for(
+            nw,
+            1000,
+            [&](int rank, size_t i) {
+                seen[i]++;
+                per_worker[rank]++;
+            },
+            16);
+    EXPECT_EQ(seen, std::vector<int>(1000, 1));
+    EXPECT_EQ(per_worker[0] + per_worker[1] + per_worker[2], 1000);
+}
+
+TEST(Executor, indexes) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    // reference results with the default OpenMP executor
+    faiss::IndexHNSWFlat hnsw(d, 16);
+    hnsw.add(nb, xb.data());
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    hnsw.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat ivf(&quantizer, d, 32);
+    ivf.train(nb, xb.data());
+    ivf.add(nb, xb.data());
+    ivf.nprobe = 4;
+    std::vector<float> D_ivf_ref(nq * k);
+    std::vector<faiss::idx_t> I_ivf_ref(nq * k);
+    ivf.search(nq, xq.data(), k, D_ivf_ref.data(), I_ivf_ref.data());
+
+    std::vector<float> centroids_ref(32 * d);
+    faiss::kmeans_clustering(d, nb, 32, xb.data(), centroids_ref.data());
+
+    ScopedExecutor scoped(std::make_shared<faiss::ThreadPoolExecutor>(4));
+
+    hnsw.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+
+    faiss::IndexFlatL2 quantizer2(d);
+    faiss::IndexIVFFlat ivf2(&quantizer2, d, 32);
+    ivf2.train(nb, xb.data());
+    ivf2.add(nb, xb.data());
+    ivf2.nprobe = 4;
+    ivf2.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ivf_ref);
+    EXPECT_EQ(D, D_ivf_ref);
+
+    std::vector<float> centroids(32 * d);
+    faiss::kmeans_clustering(d, nb, 32, xb.data(), centroids.data());
+    for (size_t i = 0; i < centroids.size(); i++) {
+        EXPECT_NEAR(centroids[i], centroids_ref[i], 1e-5);
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/extra_distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 37; // not a multiple of the SIMD width
+const size_t nb = 3000, nq = 30, k = 10;
+
+std::vector<float> rand_vectors(size_t n, int64_t seed) {
+    std::vector<float> x(n * d);
+    faiss::float_rand(x.data(), x.size(), seed);
+    return x;
+}
+
+} // namespace
+
+TEST(ExtraMetrics, kernels) {
+    std::vector<float> x = rand_vectors(2, 123);
+    const float* a = x.data();
+    const float* b = x.data() + d;
+    float lp = 0, canberra = 0, bc_num = 0, bc_den = 0;
+    float jac_num = 0, jac_den = 0, abs_ip = 0;
+    for (int i = 0; i < d; i++) {
+        lp += powf(fabsf(a[i] - b[i]), 3);
+        canberra += fabsf(a[i] - b[i]) / (fabsf(a[i]) + fabsf(b[i]));
+        bc_num += fabsf(a[i] - b[i]);
+        bc_den += fabsf(a[i] + b[i]);
+        jac_num += fmin(a[i], b[i]);
+        jac_den += fmax(a[i], b[i]);
+        abs_ip += fabsf(a[i] * b[i]);
+    }
+    EXPECT_NEAR(lp, faiss::fvec_Lp(a, b, d, 3), 1e-4);
+    EXPECT_NEAR(canberra, faiss::fvec_Canberra(a, b, d), 1e-4);
+    EXPECT_NEAR(bc_num / bc_den, faiss::fvec_BrayCurtis(a, b, d), 1e-5);
+    EXPECT_NEAR(jac_num / jac_den, faiss::fvec_Jaccard(a, b, d), 1e-5);
+    EXPECT_NEAR(abs_ip, faiss::fvec_abs_inner_product(a, b, d), 1e-4);
+    EXPECT_NEAR(
+            faiss::fvec_L1(a, b, d), faiss::fvec_Lp(a, b, d, 1), 1e-5);
+}
+
+TEST(ExtraMetrics, knn_vs_pairwise) {
+    std::vector<float> xb = rand_vectors(nb, 123);
+    std::vector<float> xq = rand_vectors(nq, 456);
+    for (faiss::MetricType mt :
+         {faiss::METRIC_L1,
+          faiss::METRIC_Linf,
+          faiss::METRIC_Lp,
+          faiss::METRIC_Canberra,
+          faiss::METRIC_Jaccard}) {
+        std::vector<float> dis(nq * nb);
+        faiss::pairwise_extra_distances(
+                d, nq, xq.data(), nb, xb.data(), mt, 1.5, dis.data());
+        std::vector<float> D(nq * k);
+        std::vector<faiss::idx_t> I(nq * k);
+        faiss::knn_extra_metrics(
+                xq.data(), xb.data(), d, nq, nb, mt, 1.5, k, D.data(),
+                I.data());
+        bool is_sim = faiss::is_similarity_metric(mt);
+        for (size_t i = 0; i < nq; i++) {
+            // the k-th result bounds all the distances
+            float kth = D[i * k + k - 1];
+            size_t nbetter = 0;
+            for (size_t j = 0; j < nb; j++) {
+                float v = dis[i * nb + j];
+                nbetter += is_sim ? v > kth : v < kth;
+            }
+            EXPECT_LT(nbetter, k) << "metric " << mt;
+            for (size_t l = 0; l < k; l++) {
+                EXPECT_EQ(D[i * k + l], dis[i * nb + I[i * k + l]]);
+            }
+        }
+    }
+}
+
+TEST(ExtraMetrics, ivf_flat_L1) {
+    std::vector<float> xb = rand_vectors(nb, 123);
+    std::vector<float> xq = rand_vectors(nq, 456);
+    faiss::IndexFlat flat(d, faiss::METRIC_L1);
+    flat.add(nb, xb.data());
+
+    faiss::IndexFlat quantizer(d, faiss::METRIC_L1);
+    faiss::IndexIVFFlat ivf(&quantizer, d, 16, faiss::METRIC_L1);
+    ivf.train(nb, xb.data());
+    ivf.add(nb, xb.data());
+    ivf.nprobe = 16;
+
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    flat.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    ivf.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+}
+
+TEST(ExtraMetrics, hnsw_L1) {
+    std::vector<float> xb = rand_vectors(nb, 123);
+    std::vector<float> xq = rand_vectors(nq, 456);
+    faiss::IndexFlat flat(d, faiss::METRIC_L1);
+    flat.add(nb, xb.data());
+    faiss::IndexHNSWFlat hnsw(d, 16, faiss::METRIC_L1);
+    hnsw.add(nb, xb.data());
+    hnsw.hnsw.efSearch = 128;
+
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    flat.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    hnsw.search(nq, xq.data(), k, D.data(), I.data());
+    size_t nok = 0;
+    for (size_t i = 0; i < nq; i++) {
+        nok += I[i * k] == Iref[i * k];
+    }
+    EXPECT_GT(nok, nq * 0.9);
+}
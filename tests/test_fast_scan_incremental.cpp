@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexIVFPQFastScan.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/CodePacker.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_factory.h>
+#include <faiss/invlists/BlockInvertedLists.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nt = 3000, nb = 6000, nq = 20, k = 10;
+
+struct Data {
+    std::vector<float> xt, xb, xq;
+    Data() : xt(nt * d), xb(nb * d), xq(nq * d) {
+        faiss::rand_smooth_vectors(nt, d, xt.data(), 123);
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 456);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 789);
+    }
+};
+
+std::unique_ptr<faiss::Index> make_trained(const Data& data) {
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "IVF16,PQ16x4fs"));
+    index->train(nt, data.xt.data());
+    return index;
+}
+
+void expect_same_search(
+        const faiss::Index& a,
+        const faiss::Index& b,
+        const std::vector<float>& xq) {
+    std::vector<float> Da(nq * k), Db(nq * k);
+    std::vector<faiss::idx_t> Ia(nq * k), Ib(nq * k);
+    a.search(nq, xq.data(), k, Da.data(), Ia.data());
+    b.search(nq, xq.data(), k, Db.data(), Ib.data());
+    EXPECT_EQ(Ia, Ib);
+    EXPECT_EQ(Da, Db);
+}
+
+} // namespace
+
+// entries appended to partially filled blocks are packed in place
+TEST(FastScanIncremental, add_entries) {
+    Data data;
+    std::unique_ptr<faiss::Index> index = make_trained(data);
+    index->add(nb, data.xb.data());
+    auto ivf = faiss::ivflib::extract_index_ivf(index.get());
+    auto bil = dynamic_cast<faiss::BlockInvertedLists*>(ivf->invlists);
+    ASSERT_TRUE(bil);
+    const faiss::CodePacker* packer = bil->packer;
+
+    // copy each list in 3 unaligned pieces to new lists
+    faiss::BlockInvertedLists bil2(ivf->nlist, ivf->get_CodePacker());
+    size_t cs = packer->code_size;
+    for (size_t l = 0; l < ivf->nlist; l++) {
+        size_t ls = bil->list_size(l);
+        std::vector<uint8_t> flat(ls * cs);
+        for (size_t i = 0; i < ls; i++) {
+            packer->unpack_1(bil->get_codes(l), i, flat.data() + i * cs);
+        }
+        size_t cuts[] = {0, ls / 3, ls / 3 + 7, ls};
+        for (int p = 0; p < 3; p++) {
+            size_t i0 = cuts[p], i1 = cuts[p + 1];
+            size_t nblock = (i1 - i0 + packer->nvec - 1) / packer->nvec;
+            std::vector<uint8_t> blocks(nblock * packer->block_size);
+            packer->pack_range(
+                    flat.data() + i0 * cs, 0, i1 - i0, blocks.data());
+            bil2.add_entries(
+                    l, i1 - i0, bil->get_ids(l) + i0, blocks.data());
+        }
+        ASSERT_EQ(bil2.list_size(l), ls);
+        ASSERT_EQ(bil2.codes[l].size(), bil->codes[l].size());
+        EXPECT_EQ(
+                memcmp(bil2.get_codes(l),
+                       bil->get_codes(l),
+                       bil->codes[l].size()),
+                0);
+    }
+}
+
+// removing entries compacts the lists in order and leaves clean blocks to
+// add to
+TEST(FastScanIncremental, remove_then_add) {
+    Data data;
+    std::unique_ptr<faiss::Index> index = make_trained(data);
+    std::unique_ptr<faiss::Index> index_ref(faiss::clone_index(index.get()));
+
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = i;
+    }
+    int nb1 = nb / 2;
+    index->add_with_ids(nb1, data.xb.data(), ids.data());
+
+    // remove 1 vector out of 3
+    std::vector<faiss::idx_t> to_remove;
+    std::vector<float> xkeep;
+    std::vector<faiss::idx_t> ids_keep;
+    for (int i = 0; i < nb1; i++) {
+        if (i % 3 == 1) {
+            to_remove.push_back(i);
+        } else {
+            ids_keep.push_back(i);
+            xkeep.insert(
+                    xkeep.end(),
+                    data.xb.begin() + i * d,
+                    data.xb.begin() + (i + 1) * d);
+        }
+    }
+    faiss::IDSelectorBatch sel(to_remove.size(), to_remove.data());
+    EXPECT_EQ(index->remove_ids(sel), to_remove.size());
+    index_ref->add_with_ids(ids_keep.size(), xkeep.data(), ids_keep.data());
+    EXPECT_EQ(index->ntotal, index_ref->ntotal);
+    expect_same_search(*index, *index_ref, data.xq);
+
+    // small adds after the removal
+    for (int i0 = nb1; i0 < nb; i0 += 101) {
+        int i1 = std::min(nb, i0 + 101);
+        index->add_with_ids(i1 - i0, data.xb.data() + i0 * d, &ids[i0]);
+    }
+    index_ref->add_with_ids(nb - nb1, data.xb.data() + nb1 * d, &ids[nb1]);
+    expect_same_search(*index, *index_ref, data.xq);
+}
+
+TEST(FastScanIncremental, remove_hashtable) {
+    Data data;
+    std::unique_ptr<faiss::Index> index = make_trained(data);
+    auto ivf = faiss::ivflib::extract_index_ivf(index.get());
+    ivf->set_direct_map_type(faiss::DirectMap::Hashtable);
+
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = 1000 + 7 * i;
+    }
+    index->add_with_ids(nb, data.xb.data(), ids.data());
+    std::vector<float> recons_ref(nb * d);
+    for (int i = 0; i < nb; i++) {
+        index->reconstruct(ids[i], recons_ref.data() + i * d);
+    }
+
+    std::vector<faiss::idx_t> to_remove;
+    for (int i = 0; i < nb; i += 5) {
+        to_remove.push_back(ids[i]);
+    }
+    faiss::IDSelectorArray sel(to_remove.size(), to_remove.data());
+    EXPECT_EQ(index->remove_ids(sel), to_remove.size());
+    EXPECT_EQ(index->ntotal, nb - to_remove.size());
+
+    std::vector<float> recons(d);
+    for (int i = 0; i < nb; i++) {
+        if (i % 5 == 0) {
+            EXPECT_THROW(
+                    index->reconstruct(ids[i], recons.data()),
+                    faiss::FaissException);
+        } else {
+            index->reconstruct(ids[i], recons.data());
+            EXPECT_EQ(
+                    memcmp(recons.data(),
+                           recons_ref.data() + i * d,
+                           d * sizeof(float)),
+                    0);
+        }
+    }
+}
+
+TEST(FastScanIncremental, unpack_range) {
+    Data data;
+    std::unique_ptr<faiss::Index> index = make_trained(data);
+    index->add(nb, data.xb.data());
+    auto ivf = faiss::ivflib::extract_index_ivf(index.get());
+    auto bil = dynamic_cast<faiss::BlockInvertedLists*>(ivf->invlists);
+    const faiss::CodePacker* packer = bil->packer;
+    size_t cs = packer->code_size;
+    for (size_t l = 0; l < ivf->nlist; l++) {
+        size_t ls = bil->list_size(l);
+        std::vector<uint8_t> ref(ls * cs);
+        for (size_t i = 0; i < ls; i++) {
+            packer->unpack_1(bil->get_codes(l), i, ref.data() + i * cs);
+        }
+        size_t ranges[][2] = {{0, ls}, {ls / 3, ls / 3 + 45}, {ls - 1, ls}};
+        for (auto& r : ranges) {
+            size_t i0 = r[0], i1 = std::min(r[1], ls);
+            std::vector<uint8_t> flat((i1 - i0) * cs);
+            packer->unpack_range(bil->get_codes(l), i0, i1, flat.data());
+            EXPECT_TRUE(std::equal(
+                    flat.begin(), flat.end(), ref.begin() + i0 * cs));
+        }
+    }
+}
+
+// merging several shards at once is the same as merging them one by one
+TEST(FastScanIncremental, merge_from_multiple) {
+    Data data;
+    std::unique_ptr<faiss::Index> index = make_trained(data);
+    std::unique_ptr<faiss::Index> index_ref(faiss::clone_index(index.get()));
+    const int nshard = 5;
+    std::vector<std::unique_ptr<faiss::Index>> shards;
+    std::vector<const faiss::InvertedLists*> ils;
+    for (int s = 0; s < nshard; s++) {
+        int i0 = s * nb / nshard, i1 = (s + 1) * nb / nshard;
+        shards.emplace_back(faiss::clone_index(index.get()));
+        shards[s]->add(i1 - i0, data.xb.data() + i0 * d);
+        ils.push_back(faiss::ivflib::extract_index_ivf(shards[s].get())
+                              ->invlists);
+        std::unique_ptr<faiss::Index> shard(
+                faiss::clone_index(shards[s].get()));
+        index_ref->merge_from(*shard, i0);
+    }
+
+    auto ivf = faiss::ivflib::extract_index_ivf(index.get());
+    auto bil = dynamic_cast<faiss::BlockInvertedLists*>(ivf->invlists);
+    bil->merge_from_multiple(ils.data(), nshard, true);
+    ivf->ntotal = index->ntotal = nb;
+
+    auto bil_ref = dynamic_cast<faiss::BlockInvertedLists*>(
+            faiss::ivflib::extract_index_ivf(index_ref.get())->invlists);
+    for (size_t l = 0; l < bil->nlist; l++) {
+        ASSERT_EQ(bil->list_size(l), bil_ref->list_size(l));
+        EXPECT_EQ(bil->ids[l], bil_ref->ids[l]);
+        EXPECT_EQ(
+                memcmp(bil->get_codes(l),
+                       bil_ref->get_codes(l),
+                       bil->codes[l].size()),
+                0);
+    }
+    expect_same_search(*index, *index_ref, data.xq);
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <omp.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/GraphPageCache.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+struct PageCacheTest : testing::Test {
+    Tempfilename tmp;
+    std::vector<char> content;
+    int fd = -1;
+
+    void SetUp() override {
+        std::mt19937 rng(123);
+        // 64 pages and a partial one
+        content.resize(64 * 4096 + 100);
+        for (char& c : content) {
+            c = rng();
+        }
+        FILE* f = fopen(tmp.c_str(), "wb");
+        ASSERT_EQ(
+                fwrite(content.data(), 1, content.size(), f), content.size());
+        fclose(f);
+        fd = open(tmp.c_str(), O_RDONLY);
+        ASSERT_GE(fd, 0);
+    }
+
+    void TearDown() override {
+        close(fd);
+    }
+};
+
+} // namespace
+
+TEST_F(PageCacheTest, reads_and_eviction) {
+    faiss::GraphPageCache cache(fd, 8 * 4096, 4096, 2);
+    EXPECT_EQ(cache.capacity, 8);
+    std::mt19937 rng(456);
+    for (int round = 0; round < 50; round++) {
+        size_t n = 1 + rng() % 20;
+        std::vector<std::vector<char>> out(n);
+        std::vector<faiss::BatchedFileReader::Request> requests;
+        for (size_t i = 0; i < n; i++) {
+            // some reads cross pages, the first one ends at EOF
+            size_t size = 1 + rng() % 6000;
+            off_t offset = i == 0 ? content.size() - size
+                                  : rng() % (content.size() - size);
+            out[i].resize(size);
+            requests.push_back({offset, size, out[i].data()});
+        }
+        cache.read(requests);
+        for (size_t i = 0; i < n; i++) {
+            ASSERT_EQ(
+                    memcmp(out[i].data(),
+                           content.data() + requests[i].offset,
+                           requests[i].size),
+                    0);
+        }
+        EXPECT_LE(cache.size(), cache.capacity);
+    }
+
+    // the second read of a page is a hit
+    std::vector<char> buf(100);
+    cache.read(5 * 4096 + 10, buf.size(), buf.data());
+    EXPECT_EQ(cache.read(5 * 4096 + 10, buf.size(), buf.data()), 0);
+    EXPECT_EQ(
+            memcmp(buf.data(), content.data() + 5 * 4096 + 10, buf.size()), 0);
+    EXPECT_GT(cache.n_hits.load(), 0);
+
+    cache.reset();
+    EXPECT_EQ(cache.size(), 0);
+    EXPECT_EQ(cache.n_hits.load(), 0);
+    EXPECT_THROW(
+            cache.read(content.size() + 4096, buf.size(), buf.data()),
+            faiss::FaissException);
+}
+
+TEST_F(PageCacheTest, pinned_pages) {
+    // no room for unpinned pages
+    faiss::GraphPageCache cache(fd, 0);
+    cache.pin({{4096, 3 * 4096}, {64 * 4096 + 10, 64 * 4096 + 20}});
+    EXPECT_EQ(cache.n_pinned(), 3);
+
+    std::vector<char> buf(2 * 4096);
+    EXPECT_EQ(cache.read(4096, buf.size(), buf.data()), 0);
+    EXPECT_EQ(memcmp(buf.data(), content.data() + 4096, buf.size()), 0);
+    EXPECT_EQ(cache.read(64 * 4096, 100, buf.data()), 0);
+    EXPECT_EQ(memcmp(buf.data(), content.data() + 64 * 4096, 100), 0);
+
+    EXPECT_EQ(cache.read(10 * 4096, 100, buf.data()), 1);
+    EXPECT_EQ(cache.read(10 * 4096, 100, buf.data()), 1);
+    EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(GraphPageCache, hnsw_on_disk) {
+    int d = 32, nb = 5000, nq = 100, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    std::vector<float> D(k * nq);
+    index.search(nq, xq.data(), k, D.data(), I_ref.data());
+
+    faiss::HNSW& hnsw = index.hnsw;
+    hnsw.convert_to_compact();
+    Tempfilename tmp;
+    FILE* f = fopen(tmp.c_str(), "wb");
+    size_t size = hnsw.compact_neighbors_data.size();
+    fwrite(&size, sizeof(size), 1, f);
+    fwrite(hnsw.compact_neighbors_data.data(),
+           sizeof(faiss::HNSW::storage_idx_t),
+           size,
+           f);
+    fclose(f);
+    hnsw.compact_neighbors_data.clear();
+    hnsw.neighbors_on_disk = true;
+    hnsw.neighbors_start_offset = 0;
+    hnsw.initialize_graph(tmp.filename);
+
+    omp_set_num_threads(4);
+    faiss::hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    size_t n_ios_uncached = faiss::hnsw_stats.n_ios;
+    EXPECT_GT(n_ios_uncached, 0);
+
+    // the whole graph fits in the cache
+    hnsw.enable_graph_page_cache(size * sizeof(int) + 4096);
+    EXPECT_GT(hnsw.graph_page_cache->n_pinned(), 0);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    faiss::hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(faiss::hnsw_stats.n_ios, 0);
+    EXPECT_GT(hnsw.graph_page_cache->n_hits.load(), 0);
+}
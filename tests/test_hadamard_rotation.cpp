@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexPreTransform.h>
+#include <faiss/VectorTransform.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+TEST(HadamardRotation, orthonormal) {
+    for (int d : {16, 100, 1536}) {
+        size_t n = 20;
+        faiss::HadamardRotation hr(d);
+        EXPECT_EQ(hr.d_out, faiss::HadamardRotation::padded_dim(d));
+        EXPECT_GE(hr.d_out, d);
+        EXPECT_LT(hr.d_out, 2 * d);
+
+        std::vector<float> x(n * d);
+        faiss::float_randn(x.data(), x.size(), 123);
+        std::vector<float> xt(n * hr.d_out);
+        hr.apply_noalloc(n, x.data(), xt.data());
+
+        // norms and distances are preserved
+        for (size_t i = 0; i + 1 < n; i++) {
+            float nx = faiss::fvec_norm_L2sqr(x.data() + i * d, d);
+            float nxt = faiss::fvec_norm_L2sqr(
+                    xt.data() + i * hr.d_out, hr.d_out);
+            EXPECT_NEAR(nxt, nx, 1e-4 * nx);
+            float dx = faiss::fvec_L2sqr(
+                    x.data() + i * d, x.data() + (i + 1) * d, d);
+            float dxt = faiss::fvec_L2sqr(
+                    xt.data() + i * hr.d_out,
+                    xt.data() + (i + 1) * hr.d_out,
+                    hr.d_out);
+            EXPECT_NEAR(dxt, dx, 1e-4 * dx);
+        }
+
+        std::vector<float> x2(n * d);
+        hr.reverse_transform(n, xt.data(), x2.data());
+        for (size_t i = 0; i < n * d; i++) {
+            EXPECT_NEAR(x2[i], x[i], 1e-4);
+        }
+    }
+}
+
+TEST(HadamardRotation, factory_and_io) {
+    int d = 48;
+    size_t nb = 1000, nq = 10, k = 5;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 1234);
+    faiss::float_randn(xq.data(), xq.size(), 4567);
+
+    std::unique_ptr<faiss::Index> index(faiss::index_factory(d, "HR,Flat"));
+    auto pt = dynamic_cast<faiss::IndexPreTransform*>(index.get());
+    ASSERT_TRUE(pt);
+    ASSERT_TRUE(dynamic_cast<faiss::HadamardRotation*>(pt->chain[0]));
+    EXPECT_EQ(pt->index->d, 64);
+    index->add(nb, xb.data());
+
+    // the rotation is exact, so the results are those of a flat index
+    std::unique_ptr<faiss::Index> ref(faiss::index_factory(d, "Flat"));
+    ref->add(nb, xb.data());
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    ref->search(nq, xq.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(I, Iref);
+
+    faiss::VectorIOWriter writer;
+    faiss::write_index(index.get(), &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(&reader));
+    auto pt2 = dynamic_cast<faiss::IndexPreTransform*>(index2.get());
+    ASSERT_TRUE(pt2);
+    pt2->chain[0]->check_identical(*pt->chain[0]);
+    std::vector<float> D2(nq * k);
+    std::vector<faiss::idx_t> I2(nq * k);
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I2, I);
+    EXPECT_EQ(D2, D);
+}
@@ -8,7 +8,9 @@
 #include <gtest/gtest.h>
 
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
 #include <faiss/utils/hamming.h>
+#include <algorithm>
 #include <random>
 
 using namespace ::testing;
@@ -333,3 +335,55 @@ TEST(TestHamming, test_hamming_knn) {
         EXPECT_EQ(dist_gen, *true_bit_distances) << assert_str.str();
     }
 }
+
+TEST(TestHamming, test_hamming_knn_tiled) {
+    // 512 and 1024-bit codes use a tiled kernel, with a number of queries
+    // that is not a multiple of the tile size
+    std::default_random_engine rng(1234);
+    std::uniform_int_distribution<int> uniform(0, 255);
+    const size_t na = 13, nb = 2000, k = 9;
+
+    faiss::IDSelectorRange sel(100, 1500);
+    for (size_t code_size : {64, 128}) {
+        std::vector<uint8_t> a(na * code_size), b(nb * code_size);
+        for (auto& v : a) {
+            v = uniform(rng);
+        }
+        for (auto& v : b) {
+            v = uniform(rng);
+        }
+        for (bool use_sel : {false, true}) {
+            std::vector<int64_t> ids(na * k);
+            std::vector<int> dis(na * k);
+            faiss::int_maxheap_array_t res = {na, k, ids.data(), dis.data()};
+            faiss::hammings_knn_hc(
+                    &res,
+                    a.data(),
+                    b.data(),
+                    nb,
+                    code_size,
+                    true,
+                    ApproxTopK_mode_t::EXACT_TOPK,
+                    use_sel ? &sel : nullptr);
+
+            std::vector<hamdis_t> all(na * nb);
+            faiss::hammings(a.data(), b.data(), na, nb, code_size, all.data());
+            for (size_t i = 0; i < na; i++) {
+                std::vector<int> ref;
+                for (size_t j = 0; j < nb; j++) {
+                    if (!use_sel || sel.is_member(j)) {
+                        ref.push_back(all[i * nb + j]);
+                    }
+                }
+                std::sort(ref.begin(), ref.end());
+                for (size_t l = 0; l < k; l++) {
+                    ASSERT_EQ(dis[i * k + l], ref[l]);
+                    ASSERT_EQ(dis[i * k + l], all[i * nb + ids[i * k + l]]);
+                    if (use_sel) {
+                        ASSERT_TRUE(sel.is_member(ids[i * k + l]));
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFSpectralHash.h>
+#include <faiss/IndexLSH.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_factory.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nt = 5000, nb = 10000, nq = 50, k = 10;
+
+struct Data {
+    std::vector<float> xt, xb, xq;
+    Data() : xt(nt * d), xb(nb * d), xq(nq * d) {
+        faiss::rand_smooth_vectors(nt, d, xt.data(), 123);
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 456);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 789);
+    }
+};
+
+/// fraction of the exact k-NN found in the results I
+double recall(const Data& data, const std::vector<faiss::idx_t>& I) {
+    faiss::IndexFlatL2 index_gt(d);
+    index_gt.add(nb, data.xb.data());
+    std::vector<float> D_gt(nq * k);
+    std::vector<faiss::idx_t> I_gt(nq * k);
+    index_gt.search(nq, data.xq.data(), k, D_gt.data(), I_gt.data());
+    size_t n_ok = 0;
+    for (int q = 0; q < nq; q++) {
+        std::unordered_set<faiss::idx_t> ref(
+                I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_ok += ref.count(I[q * k + j]);
+        }
+    }
+    return n_ok / double(nq * k);
+}
+
+} // namespace
+
+// the block scan of the lists gives the same distances as code-by-code
+// distance computations
+TEST(HammingFirstStage, IVFSpectralHash_block_scan) {
+    Data data;
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "IVF16,ITQ32,SH1.5"));
+    index->train(nt, data.xt.data());
+    index->add(nb, data.xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVFSpectralHash*>(index.get());
+    ASSERT_TRUE(ivf);
+    ivf->nprobe = 4;
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index->search(nq, data.xq.data(), k, D.data(), I.data());
+
+    std::vector<float> coarse_dis(nq * ivf->nprobe);
+    std::vector<faiss::idx_t> coarse_ids(nq * ivf->nprobe);
+    ivf->quantizer->search(
+            nq,
+            data.xq.data(),
+            ivf->nprobe,
+            coarse_dis.data(),
+            coarse_ids.data());
+    std::unique_ptr<faiss::InvertedListScanner> scanner(
+            ivf->get_InvertedListScanner(false, nullptr, nullptr));
+    for (int q = 0; q < nq; q++) {
+        scanner->set_query(data.xq.data() + q * d);
+        std::vector<float> dis;
+        for (size_t p = 0; p < ivf->nprobe; p++) {
+            faiss::idx_t list_no = coarse_ids[q * ivf->nprobe + p];
+            scanner->set_list(list_no, 0);
+            faiss::InvertedLists::ScopedCodes codes(ivf->invlists, list_no);
+            size_t ls = ivf->invlists->list_size(list_no);
+            for (size_t j = 0; j < ls; j++) {
+                dis.push_back(scanner->distance_to_code(
+                        codes.get() + j * ivf->code_size));
+            }
+        }
+        std::sort(dis.begin(), dis.end());
+        for (int j = 0; j < k; j++) {
+            EXPECT_EQ(D[q * k + j], dis[j]);
+        }
+    }
+}
+
+TEST(HammingFirstStage, IVFSpectralHash_selector) {
+    Data data;
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "IVF16,ITQ32,SH1.5"));
+    index->train(nt, data.xt.data());
+    index->add(nb, data.xb.data());
+
+    faiss::IDSelectorRange sel(0, nb / 2);
+    faiss::SearchParametersIVF params;
+    params.sel = &sel;
+    params.nprobe = 4;
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index->search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_LT(I[i], nb / 2);
+    }
+}
+
+TEST(HammingFirstStage, LSH_selector) {
+    Data data;
+    faiss::IndexLSH index(d, 128);
+    index.train(nt, data.xt.data());
+    index.add(nb, data.xb.data());
+
+    std::vector<float> D(nq * k), D_sel(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I_sel(nq * k);
+    index.search(nq, data.xq.data(), k, D.data(), I.data());
+
+    // selecting all the vectors does not change the results
+    faiss::IDSelectorAll sel_all;
+    faiss::SearchParameters params;
+    params.sel = &sel_all;
+    index.search(nq, data.xq.data(), k, D_sel.data(), I_sel.data(), &params);
+    EXPECT_EQ(D, D_sel);
+
+    faiss::IDSelectorRange sel(nb / 2, nb);
+    params.sel = &sel;
+    index.search(nq, data.xq.data(), k, D_sel.data(), I_sel.data(), &params);
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_GE(I_sel[i], nb / 2);
+    }
+}
+
+// the Hamming-ranked candidates re-ranked with float distances
+TEST(HammingFirstStage, LSH_refine) {
+    Data data;
+    faiss::IndexLSH index(d, 128);
+    index.train(nt, data.xt.data());
+    index.add(nb, data.xb.data());
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index.search(nq, data.xq.data(), k, D.data(), I.data());
+    double recall_lsh = recall(data, I);
+
+    faiss::IndexRefineFlat index_refine(&index, data.xb.data());
+    index_refine.k_factor = 8;
+    index_refine.search(nq, data.xq.data(), k, D.data(), I.data());
+    double recall_refine = recall(data, I);
+    EXPECT_GT(recall_refine, recall_lsh + 0.1);
+    EXPECT_GT(recall_refine, 0.7);
+}
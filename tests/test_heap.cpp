@@ -6,6 +6,7 @@
  */
 
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/random.h>
 #include <gtest/gtest.h>
 #include <algorithm>
 #include <numeric>
@@ -52,3 +53,47 @@ TEST(Heap, addn_query_subset_with_ids) {
                 return i == 1;
             }));
 }
+
+// the buffered additions give the results of heap_replace_top, also when
+// they are interleaved with direct heap operations
+template <class C>
+void test_heap_buffer(size_t k) {
+    size_t n = 5000;
+    std::vector<float> x(n);
+    float_randn(x.data(), n, 1234 + k);
+    std::vector<float> ref_dis(k), dis(k);
+    std::vector<int64_t> ref_ids(k), ids(k);
+    heap_heapify<C>(k, ref_dis.data(), ref_ids.data());
+    heap_heapify<C>(k, dis.data(), ids.data());
+
+    for (size_t i = 0; i < n; i++) {
+        if (C::cmp(ref_dis[0], x[i])) {
+            heap_replace_top<C>(k, ref_dis.data(), ref_ids.data(), x[i], i);
+        }
+    }
+    for (size_t i0 = 0; i0 < n; i0 += 1000) {
+        HeapBuffer<C> heap(k, dis.data(), ids.data());
+        for (size_t i = i0; i < i0 + 900; i++) {
+            if (C::cmp(heap.threshold, x[i])) {
+                heap.push(x[i], i);
+            }
+        }
+        heap.flush();
+        for (size_t i = i0 + 900; i < i0 + 1000; i++) {
+            if (C::cmp(dis[0], x[i])) {
+                heap_replace_top<C>(k, dis.data(), ids.data(), x[i], i);
+            }
+        }
+    }
+    heap_reorder<C>(k, ref_dis.data(), ref_ids.data());
+    heap_reorder<C>(k, dis.data(), ids.data());
+    EXPECT_EQ(ref_ids, ids);
+    EXPECT_EQ(ref_dis, dis);
+}
+
+TEST(Heap, buffer) {
+    for (size_t k : {1, 10, 100, 128, 200}) {
+        test_heap_buffer<CMax<float, int64_t>>(k);
+        test_heap_buffer<CMin<float, int64_t>>(k);
+    }
+}
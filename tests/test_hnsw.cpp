@@ -7,13 +7,17 @@
 
 #include <gtest/gtest.h>
 
+#include <unistd.h>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <limits>
 #include <random>
 #include <unordered_set>
 #include <vector>
 
 #include <faiss/IndexHNSW.h>
+#include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/HNSW.h>
 #include <faiss/impl/ResultHandler.h>
 #include <faiss/utils/random.h>
@@ -473,7 +477,8 @@ TEST_F(HNSWTest, TEST_search_from_candidate_unbounded) {
             k,
             &reference_vt,
             reference_stats);
-    EXPECT_EQ(stats.ndis, reference_stats.ndis);
+    // the neighbors evaluated at a previous hop are skipped
+    EXPECT_LE(stats.ndis, reference_stats.ndis);
     EXPECT_EQ(stats.nhops, reference_stats.nhops);
     EXPECT_EQ(stats.n1, reference_stats.n1);
     EXPECT_EQ(stats.n2, reference_stats.n2);
@@ -495,7 +500,8 @@ TEST_F(HNSWTest, TEST_greedy_update_nearest) {
     // reference version
     auto reference_stats = reference_greedy_update_nearest(
             index->hnsw, *dis, 0, reference_nearest, reference_d_nearest);
-    EXPECT_EQ(stats.ndis, reference_stats.ndis);
+    // the neighbors evaluated at a previous hop are skipped
+    EXPECT_LE(stats.ndis, reference_stats.ndis);
     EXPECT_EQ(stats.nhops, reference_stats.nhops);
     EXPECT_EQ(stats.n1, reference_stats.n1);
     EXPECT_EQ(stats.n2, reference_stats.n2);
@@ -655,3 +661,254 @@ TEST_F(HNSWTest, TEST_search_level_0) {
     EXPECT_GT(stats1.n1, stats2.n1);
     EXPECT_GT(stats1.n2, stats2.n2);
 }
+
+TEST_F(HNSWTest, TEST_search_pipeline_depth) {
+    omp_set_num_threads(1);
+    std::vector<faiss::idx_t> I(k * nq), I_pipe(k * nq);
+    std::vector<float> D(k * nq), D_pipe(k * nq);
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 32;
+    index->search(nq, xq->data(), k, D.data(), I.data(), &params);
+
+    faiss::hnsw_stats.reset();
+    params.pipeline_depth = 1;
+    index->search(nq, xq->data(), k, D_pipe.data(), I_pipe.data(), &params);
+
+    // speculative distances are exact, so the results must not change
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_EQ(I[i], I_pipe[i]);
+        EXPECT_FLOAT_EQ(D[i], D_pipe[i]);
+    }
+    EXPECT_GT(faiss::hnsw_stats.nspec, 0);
+    EXPECT_LE(faiss::hnsw_stats.nspec_hits, faiss::hnsw_stats.nspec);
+}
+
+TEST_F(HNSWTest, TEST_search_on_disk_threads) {
+    const int nq_mt = 200;
+    std::vector<float> xq_mt(d * nq_mt);
+    faiss::float_rand(xq_mt.data(), d * nq_mt, 4567);
+    std::vector<faiss::idx_t> I(k * nq_mt), I_disk(k * nq_mt);
+    std::vector<float> D(k * nq_mt), D_disk(k * nq_mt);
+    index->search(nq_mt, xq_mt.data(), k, D.data(), I.data());
+
+    // write the compact neighbor lists like the neighbors vector of a
+    // compact index file: size field followed by the data
+    faiss::HNSW& hnsw = index->hnsw;
+    hnsw.convert_to_compact();
+    std::string filename = "/tmp/faiss_hnsw_neighbors_XXXXXX";
+    int fd = mkstemp(&filename[0]);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    FILE* f = fopen(filename.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    size_t size = hnsw.compact_neighbors_data.size();
+    fwrite(&size, sizeof(size), 1, f);
+    fwrite(hnsw.compact_neighbors_data.data(),
+           sizeof(faiss::HNSW::storage_idx_t),
+           size,
+           f);
+    fclose(f);
+
+    hnsw.compact_neighbors_data.clear();
+    hnsw.neighbors_on_disk = true;
+    hnsw.neighbors_start_offset = 0;
+    hnsw.initialize_graph(filename);
+
+    // concurrent queries read the same graph_fd
+    omp_set_num_threads(8);
+    index->search(nq_mt, xq_mt.data(), k, D_disk.data(), I_disk.data());
+    unlink(filename.c_str());
+
+    for (int i = 0; i < nq_mt * k; i++) {
+        EXPECT_EQ(I[i], I_disk[i]);
+        EXPECT_FLOAT_EQ(D[i], D_disk[i]);
+    }
+}
+
+TEST_F(HNSWTest, TEST_concurrent_add) {
+    int nt = omp_get_max_threads();
+
+    // with a single thread, the graph does not depend on the locks and the
+    // scheduling
+    omp_set_num_threads(1);
+    faiss::IndexHNSWFlat index_ref(d, 16), index_conc(d, 16);
+    index_conc.concurrent_add = true;
+    index_ref.add(nb, xb->data());
+    index_conc.add(nb, xb->data());
+    EXPECT_EQ(index_ref.hnsw.neighbors, index_conc.hnsw.neighbors);
+    EXPECT_EQ(index_ref.hnsw.entry_point, index_conc.hnsw.entry_point);
+
+    // with several threads, the database vectors are still found
+    omp_set_num_threads(8);
+    faiss::IndexHNSWFlat index_mt(d, 16);
+    index_mt.concurrent_add = true;
+    index_mt.add(nb, xb->data());
+    omp_set_num_threads(nt);
+    std::vector<faiss::idx_t> I(nb);
+    std::vector<float> D(nb);
+    index_mt.search(nb, xb->data(), 1, D.data(), I.data());
+    int n_ok = 0;
+    for (int i = 0; i < nb; i++) {
+        n_ok += I[i] == i;
+    }
+    EXPECT_GT(n_ok, nb * 0.95);
+}
+
+TEST_F(HNSWTest, TEST_prune_neighbors) {
+    faiss::IndexHNSWFlat index_ref(d, 16), index_prune(d, 16),
+            index_alpha(d, 16);
+    // same graph for all three
+    index_ref.add(nb, xb->data());
+    for (faiss::IndexHNSWFlat* idx : {&index_prune, &index_alpha}) {
+        idx->storage->add(nb, xb->data());
+        idx->ntotal = nb;
+        idx->hnsw = index_ref.hnsw;
+    }
+    int new_size = 12;
+    index_ref.shrink_level_0_neighbors(new_size);
+    size_t n_removed = index_prune.prune_neighbors(new_size);
+    EXPECT_GT(n_removed, 0);
+
+    // same selection as the scalar version, up to rounding
+    size_t n_same = 0, n_links = 0;
+    for (int i = 0; i < nb; i++) {
+        size_t begin, end;
+        index_ref.hnsw.neighbor_range(i, 0, &begin, &end);
+        std::unordered_set<int> ref(
+                index_ref.hnsw.neighbors.begin() + begin,
+                index_ref.hnsw.neighbors.begin() + end);
+        ref.erase(-1);
+        n_links += ref.size();
+        for (size_t j = begin; j < end; j++) {
+            int v = index_prune.hnsw.neighbors[j];
+            ASSERT_TRUE(j - begin < new_size || v == -1);
+            n_same += v >= 0 && ref.count(v);
+        }
+    }
+    EXPECT_GT(n_same, n_links * 0.99);
+
+    // the alpha-relaxed rule keeps more links
+    size_t n_removed_alpha = index_alpha.prune_neighbors(new_size, 0, 1.2);
+    EXPECT_LT(n_removed_alpha, n_removed);
+}
+
+TEST_F(HNSWTest, TEST_greedy_update_nearest_all_levels) {
+    const faiss::HNSW& hnsw = index->hnsw;
+    for (int q = 0; q < nq; q++) {
+        dis->set_query(xq->data() + q * d);
+        for (int level = hnsw.max_level; level >= 0; level--) {
+            auto nearest = hnsw.entry_point;
+            float d_nearest = (*dis)(nearest);
+            auto reference_nearest = nearest;
+            float reference_d_nearest = d_nearest;
+            auto stats = faiss::greedy_update_nearest(
+                    hnsw, *dis, level, nearest, d_nearest);
+            auto reference_stats = reference_greedy_update_nearest(
+                    hnsw, *dis, level, reference_nearest, reference_d_nearest);
+            EXPECT_EQ(nearest, reference_nearest);
+            EXPECT_EQ(d_nearest, reference_d_nearest);
+            EXPECT_EQ(stats.nhops, reference_stats.nhops);
+            EXPECT_LE(stats.ndis, reference_stats.ndis);
+        }
+    }
+}
+
+TEST(HNSW, Test_ThreadVisitedTable) {
+    faiss::VisitedTable* ptr;
+    {
+        faiss::ThreadVisitedTable tvt(100);
+        ptr = tvt.vt.get();
+        (*tvt).set(10);
+        faiss::ThreadVisitedTable nested(100);
+        EXPECT_NE(nested.vt.get(), ptr);
+        EXPECT_FALSE((*nested).get(10));
+    }
+    faiss::ThreadVisitedTable tvt(200);
+    // the last table returned to the pool, cleared and grown
+    EXPECT_EQ(tvt.vt.get(), ptr);
+    EXPECT_GE(tvt.vt->visited.size(), 200);
+    for (int i = 0; i < 200; i++) {
+        EXPECT_FALSE((*tvt).get(i));
+    }
+}
+
+TEST_F(HNSWTest, TEST_search_reuses_scratch) {
+    omp_set_num_threads(1);
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 32;
+    params.beam_size = 4;
+    std::vector<faiss::idx_t> I(k * nq), I2(k * nq);
+    std::vector<float> D(k * nq), D2(k * nq);
+    index->search(nq, xq->data(), k, D.data(), I.data(), &params);
+
+    // a search on a smaller index in between uses the same scratch
+    faiss::IndexHNSWFlat small(d, M);
+    small.add(nb / 10, xb->data());
+    small.search(nq, xq->data(), k, D2.data(), I2.data(), &params);
+
+    index->search(nq, xq->data(), k, D2.data(), I2.data(), &params);
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+}
+
+TEST(HNSW, Test_VisitedTable_modes) {
+    const int size = 100000;
+    std::mt19937 rng(123);
+    std::uniform_int_distribution<int> node(0, size - 1);
+    for (auto mode :
+         {faiss::VISITED_BYTES, faiss::VISITED_BITSET, faiss::VISITED_HASH}) {
+        faiss::VisitedTable vt(size, mode, 10);
+        for (int round = 0; round < 300; round++) {
+            // some rounds set many nodes, to grow the hash set
+            int nset = round % 50 == 0 ? 5000 : 20;
+            std::unordered_set<int> ref;
+            for (int i = 0; i < nset; i++) {
+                int no = node(rng);
+                vt.set(no);
+                ref.insert(no);
+            }
+            for (int no : ref) {
+                ASSERT_TRUE(vt.get(no));
+            }
+            for (int i = 0; i < 100; i++) {
+                int no = node(rng);
+                ASSERT_EQ(vt.get(no), ref.count(no) > 0);
+            }
+            vt.advance();
+            for (int no : ref) {
+                ASSERT_FALSE(vt.get(no));
+            }
+        }
+    }
+    EXPECT_EQ(faiss::VisitedTable::auto_mode(1000, 100), faiss::VISITED_BYTES);
+    EXPECT_EQ(
+            faiss::VisitedTable::auto_mode(size_t(1) << 31, 10000),
+            faiss::VISITED_HASH);
+    EXPECT_EQ(
+            faiss::VisitedTable::auto_mode(size_t(1) << 26, 1 << 22),
+            faiss::VISITED_BITSET);
+}
+
+TEST_F(HNSWTest, TEST_search_visited_modes) {
+    std::vector<faiss::idx_t> Iref(k * nq);
+    std::vector<float> Dref(k * nq);
+    index->search(nq, xq->data(), k, Dref.data(), Iref.data());
+
+    using RH = faiss::HeapBlockResultHandler<faiss::HNSW::C>;
+    for (auto mode : {faiss::VISITED_BITSET, faiss::VISITED_HASH}) {
+        std::vector<faiss::idx_t> I(k * nq);
+        std::vector<float> D(k * nq);
+        RH bres(nq, D.data(), I.data(), k);
+        RH::SingleResultHandler res(bres);
+        faiss::VisitedTable vt(index->ntotal, mode);
+        for (int q = 0; q < nq; q++) {
+            dis->set_query(xq->data() + q * d);
+            res.begin(q);
+            index->hnsw.search(*dis, res, vt);
+            res.end();
+        }
+        EXPECT_EQ(I, Iref);
+        EXPECT_EQ(D, Dref);
+    }
+}
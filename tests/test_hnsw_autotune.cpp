@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/AutoTune.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/ProductQuantizer.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 2000, nq = 50, k = 10;
+
+struct PrunedHNSW {
+    std::vector<float> xb, xq;
+    faiss::IndexHNSWFlat index;
+
+    PrunedHNSW() : xb(d * nb), xq(d * nq), index(d, 16) {
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        index.add(nb, xb.data());
+        faiss::ProductQuantizer pq(d, 4, 8);
+        pq.cp.niter = 5;
+        pq.train(nb, xb.data());
+        std::vector<uint8_t> codes(nb * pq.code_size);
+        pq.compute_codes(xb.data(), codes.data(), nb);
+        index.hnsw.set_pq_pruning_codes(pq, codes.data());
+    }
+};
+
+bool has_range(const faiss::ParameterSpace& ps, const char* name) {
+    for (const faiss::ParameterRange& pr : ps.parameter_ranges) {
+        if (pr.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+TEST(HNSWAutoTune, ranges) {
+    PrunedHNSW fx;
+    faiss::ParameterSpace ps;
+    ps.initialize(&fx.index);
+    EXPECT_TRUE(has_range(ps, "efSearch"));
+    EXPECT_TRUE(has_range(ps, "pq_pruning_ratio"));
+    EXPECT_TRUE(has_range(ps, "local_prune"));
+    EXPECT_TRUE(has_range(ps, "send_neigh_times_ratio"));
+    EXPECT_FALSE(has_range(ps, "beam_size"));
+
+    fx.index.is_recompute = true;
+    faiss::ParameterSpace ps2;
+    ps2.initialize(&fx.index);
+    EXPECT_TRUE(has_range(ps2, "beam_size"));
+    EXPECT_TRUE(has_range(ps2, "batch_size"));
+}
+
+TEST(HNSWAutoTune, index_defaults) {
+    PrunedHNSW fx;
+    faiss::ParameterSpace ps;
+    ps.set_index_parameters(
+            &fx.index,
+            "efSearch=32,beam_size=4,batch_size=16,pq_pruning_ratio=0.5");
+    EXPECT_EQ(fx.index.hnsw.beam_size, 4);
+    EXPECT_EQ(fx.index.hnsw.batch_size, 16);
+    EXPECT_EQ(fx.index.hnsw.pq_pruning_ratio, 0.5);
+
+    // same results as with the equivalent search parameters
+    std::vector<float> D(nq * k), D_ref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I_ref(nq * k);
+    fx.index.search(nq, fx.xq.data(), k, D.data(), I.data());
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 32;
+    params.beam_size = 4;
+    params.batch_size = 16;
+    params.pq_pruning_ratio = 0.5;
+    fx.index.search(
+            nq, fx.xq.data(), k, D_ref.data(), I_ref.data(), &params);
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+}
+
+TEST(HNSWAutoTune, explore_cost) {
+    PrunedHNSW fx;
+    faiss::IndexFlatL2 index_gt(d);
+    index_gt.add(nb, fx.xb.data());
+    std::vector<float> D_gt(nq * k);
+    std::vector<faiss::idx_t> I_gt(nq * k);
+    index_gt.search(nq, fx.xq.data(), k, D_gt.data(), I_gt.data());
+    faiss::OneRecallAtRCriterion crit(nq, 1);
+    crit.set_groundtruth(k, D_gt.data(), I_gt.data());
+
+    faiss::ParameterSpace ps;
+    ps.verbose = 0;
+    ps.n_experiments = 0;
+    ps.add_range("efSearch").values = {16, 64};
+    ps.add_range("pq_pruning_ratio").values = {0.5, 0};
+
+    // the cost is the nb of distances per query, which grows with efSearch
+    // and decreases with the pruning
+    ps.cost = faiss::ParameterSpace::COST_NDIS;
+    faiss::OperatingPoints ops;
+    ps.explore(&fx.index, nq, fx.xq.data(), crit, &ops);
+    ASSERT_EQ(ops.all_pts.size(), 4);
+    std::vector<double> ndis(4);
+    for (size_t i = 0; i < ops.all_pts.size(); i++) {
+        ndis[ops.all_pts[i].cno] = ops.all_pts[i].t;
+    }
+    EXPECT_GT(ndis[1], ndis[0]); // efSearch=64 vs 16
+    EXPECT_GT(ndis[2], ndis[0]); // no pruning vs 0.5
+    EXPECT_GT(ndis[0], 10);
+
+    // no configuration fits in a 1 ns budget
+    ps.cost = faiss::ParameterSpace::COST_P99;
+    ps.latency_budget = 1e-9;
+    faiss::OperatingPoints ops2;
+    ps.explore(&fx.index, nq, fx.xq.data(), crit, &ops2);
+    EXPECT_EQ(ops2.all_pts.size(), 0);
+
+    ps.latency_budget = 0;
+    ps.explore(&fx.index, nq, fx.xq.data(), crit, &ops2);
+    EXPECT_EQ(ops2.all_pts.size(), 4);
+    for (size_t i = 0; i < ops2.all_pts.size(); i++) {
+        EXPECT_GT(ops2.all_pts[i].t, 0);
+        EXPECT_LT(ops2.all_pts[i].t, 1);
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+using storage_idx_t = faiss::HNSW::storage_idx_t;
+
+} // namespace
+
+TEST(HNSWCompressedNeighbors, encode_decode) {
+    std::mt19937 rng(123);
+    std::vector<uint8_t> data;
+    std::vector<std::vector<storage_idx_t>> lists;
+    std::vector<size_t> offsets;
+    for (int size : {0, 1, 2, 7, 64, 100}) {
+        for (storage_idx_t max_id : {1, 1000, 1 << 20, 0x7fffffff}) {
+            std::uniform_int_distribution<storage_idx_t> u(0, max_id);
+            std::vector<storage_idx_t> list(size);
+            for (auto& v : list) {
+                v = u(rng);
+            }
+            offsets.push_back(data.size());
+            faiss::HNSW::encode_neighbor_list(list.data(), size, data);
+            lists.push_back(list);
+        }
+    }
+    for (size_t i = 0; i < lists.size(); i++) {
+        // the lists are sorted in place by the encoding
+        EXPECT_TRUE(std::is_sorted(lists[i].begin(), lists[i].end()));
+        std::vector<storage_idx_t> decoded(lists[i].size());
+        faiss::HNSW::decode_neighbor_list(
+                data.data() + offsets[i], decoded.size(), decoded.data());
+        EXPECT_EQ(decoded, lists[i]);
+    }
+}
+
+TEST(HNSWCompressedNeighbors, write_read) {
+    const int d = 32, nb = 5000, nq = 50, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    index.hnsw.convert_to_compact();
+    index.hnsw.compress_neighbors = true;
+
+    std::vector<uint8_t> data;
+    std::vector<size_t> level_ptr;
+    index.hnsw.compress_neighbor_lists(data, level_ptr);
+    EXPECT_LT(
+            data.size(),
+            index.hnsw.compact_neighbors_data.size() * sizeof(storage_idx_t) /
+                    2);
+
+    Tempfilename tmp;
+    faiss::write_index(&index, tmp.c_str());
+
+    // read in memory: the lists are decoded, sorted
+    faiss::HNSWIndexConfig config(true, false, false, 0, nullptr);
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(tmp.c_str(), 0, config));
+    const faiss::HNSW& hnsw2 =
+            dynamic_cast<faiss::IndexHNSW*>(index2.get())->hnsw;
+    EXPECT_TRUE(hnsw2.compress_neighbors);
+    EXPECT_EQ(hnsw2.compact_level_ptr, index.hnsw.compact_level_ptr);
+    for (size_t j = 0; j + 1 < hnsw2.compact_level_ptr.size(); j++) {
+        auto begin = index.hnsw.compact_neighbors_data.begin() +
+                index.hnsw.compact_level_ptr[j];
+        auto end = index.hnsw.compact_neighbors_data.begin() +
+                index.hnsw.compact_level_ptr[j + 1];
+        std::vector<storage_idx_t> ref(begin, end), list2;
+        std::sort(ref.begin(), ref.end());
+        list2.assign(
+                hnsw2.compact_neighbors_data.begin() +
+                        hnsw2.compact_level_ptr[j],
+                hnsw2.compact_neighbors_data.begin() +
+                        hnsw2.compact_level_ptr[j + 1]);
+        ASSERT_EQ(list2, ref);
+    }
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    index2->search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    // the lists decoded on demand with pread and from the mapped file give
+    // the same results
+    faiss::HNSWIndexConfig config_disk(true, true, false, 0, nullptr);
+    for (int io_flags : {0, faiss::IO_FLAG_MMAP_IFC}) {
+        std::unique_ptr<faiss::Index> index3(
+                faiss::read_index(tmp.c_str(), io_flags, config_disk));
+        auto index3_hnsw = dynamic_cast<faiss::IndexHNSW*>(index3.get());
+        ASSERT_TRUE(index3_hnsw->hnsw.neighbors_on_disk);
+        ASSERT_TRUE(index3_hnsw->hnsw.compress_neighbors);
+        if (io_flags == 0) {
+            index3_hnsw->hnsw.initialize_graph(tmp.filename);
+        }
+        index3->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(I, I_ref);
+        EXPECT_EQ(D, D_ref);
+        if (io_flags == 0) {
+            // through the graph page cache (byte ranges of the lists)
+            index3_hnsw->hnsw.enable_graph_page_cache(1 << 16);
+            index3->search(nq, xq.data(), k, D.data(), I.data());
+            EXPECT_EQ(I, I_ref);
+        }
+    }
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+struct HNSWDeleteTest : testing::Test {
+    const int d = 32;
+    const int nb = 5000;
+    const int nq = 100;
+    const int k = 10;
+    std::vector<float> xb, xq;
+    std::unique_ptr<faiss::IndexHNSWFlat> index;
+    /// every third vector is deleted
+    std::vector<faiss::idx_t> to_delete;
+
+    void SetUp() override {
+        xb.resize(d * nb);
+        xq.resize(d * nq);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        index = std::make_unique<faiss::IndexHNSWFlat>(d, 16);
+        index->add(nb, xb.data());
+        index->hnsw.efSearch = 64;
+        for (int i = 0; i < nb; i += 3) {
+            to_delete.push_back(i);
+        }
+    }
+
+    /// recall@k of the search results in labels w.r.t. the live vectors
+    double recall(const faiss::idx_t* labels) const {
+        faiss::IndexFlatL2 index_gt(d);
+        std::vector<faiss::idx_t> live_ids;
+        for (int i = 0; i < nb; i++) {
+            if (i % 3 != 0) {
+                index_gt.add(1, xb.data() + i * d);
+                live_ids.push_back(i);
+            }
+        }
+        std::vector<faiss::idx_t> I_gt(k * nq);
+        std::vector<float> D_gt(k * nq);
+        index_gt.search(nq, xq.data(), k, D_gt.data(), I_gt.data());
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::unordered_set<faiss::idx_t> gt;
+            for (int j = 0; j < k; j++) {
+                gt.insert(live_ids[I_gt[q * k + j]]);
+            }
+            for (int j = 0; j < k; j++) {
+                n_found += gt.count(labels[q * k + j]);
+            }
+        }
+        return n_found / double(nq * k);
+    }
+};
+
+} // namespace
+
+TEST_F(HNSWDeleteTest, tombstones) {
+    faiss::IDSelectorBatch sel(to_delete.size(), to_delete.data());
+    EXPECT_EQ(index->mark_deleted(sel), to_delete.size());
+    EXPECT_EQ(index->mark_deleted(sel), 0);
+    EXPECT_EQ(index->ntotal, nb);
+    EXPECT_EQ(index->hnsw.n_deleted, to_delete.size());
+
+    std::vector<faiss::idx_t> I(k * nq);
+    std::vector<float> D(k * nq);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    for (faiss::idx_t i : I) {
+        EXPECT_NE(i % 3, 0);
+    }
+    double recall_tombstones = recall(I.data());
+    EXPECT_GT(recall_tombstones, 0.8);
+
+    // after the repair, no live node links to a deleted node and the
+    // results are of the same quality
+    EXPECT_GT(index->repair_deleted(), 0);
+    const faiss::HNSW& hnsw = index->hnsw;
+    for (int i = 0; i < nb; i++) {
+        if (hnsw.deleted[i]) {
+            continue;
+        }
+        for (int level = 0; level < hnsw.levels[i]; level++) {
+            size_t begin, end;
+            hnsw.neighbor_range(i, level, &begin, &end);
+            for (size_t j = begin; j < end && hnsw.neighbors[j] >= 0; j++) {
+                EXPECT_FALSE(hnsw.deleted[hnsw.neighbors[j]]);
+            }
+        }
+    }
+    EXPECT_FALSE(hnsw.deleted[hnsw.entry_point]);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    for (faiss::idx_t i : I) {
+        EXPECT_NE(i % 3, 0);
+    }
+    EXPECT_GT(recall(I.data()), recall_tombstones - 0.05);
+
+    // the tombstones are stored with the index
+    Tempfilename tmp;
+    faiss::write_index(index.get(), tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    auto index2_hnsw = dynamic_cast<faiss::IndexHNSW*>(index2.get());
+    EXPECT_EQ(index2_hnsw->hnsw.deleted, hnsw.deleted);
+    EXPECT_EQ(index2_hnsw->hnsw.n_deleted, hnsw.n_deleted);
+    std::vector<faiss::idx_t> I2(k * nq);
+    index2->search(nq, xq.data(), k, D.data(), I2.data());
+    EXPECT_EQ(I, I2);
+}
+
+TEST_F(HNSWDeleteTest, remove_ids) {
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = 1000 + i;
+    }
+    faiss::IndexHNSWFlat index_hnsw_flat(d, 16);
+    index_hnsw_flat.hnsw.efSearch = 64;
+    faiss::IndexIDMap index_idmap(&index_hnsw_flat);
+    index_idmap.add_with_ids(nb, xb.data(), ids.data());
+
+    std::vector<faiss::idx_t> ids_to_delete;
+    for (faiss::idx_t i : to_delete) {
+        ids_to_delete.push_back(1000 + i);
+    }
+    faiss::IDSelectorBatch sel(ids_to_delete.size(), ids_to_delete.data());
+    EXPECT_EQ(index_idmap.remove_ids(sel), to_delete.size());
+    EXPECT_EQ(index_idmap.ntotal, nb - to_delete.size());
+    auto index_hnsw = dynamic_cast<faiss::IndexHNSW*>(index_idmap.index);
+    EXPECT_EQ(index_hnsw->hnsw.levels.size(), index_idmap.ntotal);
+    EXPECT_EQ(index_hnsw->hnsw.n_deleted, 0);
+
+    std::vector<faiss::idx_t> I(k * nq);
+    std::vector<float> D(k * nq);
+    index_idmap.search(nq, xq.data(), k, D.data(), I.data());
+    for (faiss::idx_t& i : I) {
+        ASSERT_GE(i, 1000);
+        i -= 1000;
+        EXPECT_NE(i % 3, 0);
+    }
+    EXPECT_GT(recall(I.data()), 0.8);
+
+    // the compacted index can be extended
+    index_idmap.add_with_ids(1, xq.data(), ids.data());
+    index_idmap.search(1, xq.data(), 1, D.data(), I.data());
+    EXPECT_EQ(I[0], ids[0]);
+}
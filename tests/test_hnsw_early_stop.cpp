@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+struct HNSWEarlyStopTest : testing::Test {
+    const int d = 32;
+    const int nb = 5000;
+    const int nt = 200;
+    const int nq = 200;
+    const int k = 10;
+    std::vector<float> xb, xt, xq;
+    std::unique_ptr<faiss::IndexHNSWFlat> index;
+    faiss::SearchParametersHNSW params;
+
+    void SetUp() override {
+        xb.resize(d * nb);
+        xt.resize(d * nt);
+        xq.resize(d * nq);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xt.data(), xt.size(), 456);
+        faiss::float_rand(xq.data(), xq.size(), 789);
+        index = std::make_unique<faiss::IndexHNSWFlat>(d, 16);
+        index->add(nb, xb.data());
+        params.efSearch = 256;
+    }
+
+    /// fraction of the results of I_ref found in I
+    double overlap(
+            const std::vector<faiss::idx_t>& I_ref,
+            const std::vector<faiss::idx_t>& I) const {
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::unordered_set<faiss::idx_t> ref(
+                    I_ref.begin() + q * k, I_ref.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                n_found += ref.count(I[q * k + j]);
+            }
+        }
+        return n_found / double(nq * k);
+    }
+};
+
+} // namespace
+
+TEST_F(HNSWEarlyStopTest, calibrated_search) {
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    std::vector<float> D(k * nq);
+    faiss::hnsw_stats.reset();
+    index->search(nq, xq.data(), k, D.data(), I_ref.data(), &params);
+    size_t ndis_ref = faiss::hnsw_stats.ndis;
+    EXPECT_EQ(faiss::hnsw_stats.n_early_stops, 0);
+
+    int patience = faiss::calibrate_hnsw_early_stop(
+            index.get(), nt, xt.data(), k, 0.95, &params);
+    EXPECT_GT(patience, 0);
+    EXPECT_EQ(index->hnsw.early_stop_patience, patience);
+
+    // the calibration carries over to other queries
+    faiss::hnsw_stats.reset();
+    index->search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_GT(faiss::hnsw_stats.n_early_stops, 0);
+    EXPECT_LT(faiss::hnsw_stats.ndis, ndis_ref);
+    EXPECT_GT(overlap(I_ref, I), 0.9);
+
+    // disabled by the search parameters
+    params.early_stop_patience = 0;
+    index->search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(I, I_ref);
+}
+
+TEST_F(HNSWEarlyStopTest, write_read) {
+    faiss::calibrate_hnsw_early_stop(
+            index.get(), nt, xt.data(), k, 0.9, &params);
+    ASSERT_GT(index->hnsw.early_stop_patience, 0);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    std::vector<float> D(k * nq);
+    index->search(nq, xq.data(), k, D.data(), I_ref.data(), &params);
+
+    Tempfilename tmp;
+    faiss::write_index(index.get(), tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    auto index2_hnsw = dynamic_cast<faiss::IndexHNSW*>(index2.get());
+    EXPECT_EQ(
+            index2_hnsw->hnsw.early_stop_patience,
+            index->hnsw.early_stop_patience);
+    EXPECT_FLOAT_EQ(index2_hnsw->hnsw.early_stop_target_recall, 0.9);
+    index2->search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(I, I_ref);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSWEntryPoints.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nb = 5000, nq = 100, k = 10;
+
+struct EntryPointsData {
+    std::vector<float> xb, xq;
+    std::vector<faiss::idx_t> I_gt;
+
+    EntryPointsData() : xb(nb * d), xq(nq * d), I_gt(nq * k) {
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        faiss::IndexFlatL2 index_gt(d);
+        index_gt.add(nb, xb.data());
+        std::vector<float> D(nq * k);
+        index_gt.search(nq, xq.data(), k, D.data(), I_gt.data());
+    }
+
+    double recall(
+            const faiss::Index& index,
+            const faiss::SearchParameters* params = nullptr) const {
+        std::vector<faiss::idx_t> I(nq * k);
+        std::vector<float> D(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data(), params);
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::unordered_set<faiss::idx_t> gt(
+                    I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                n_found += gt.count(I[q * k + j]);
+            }
+        }
+        return n_found / double(nq * k);
+    }
+};
+
+} // namespace
+
+TEST(HNSWEntryPoints, select) {
+    int n = 50, nprobe = 5;
+    std::vector<float> x(n * d), q(d);
+    faiss::float_rand(x.data(), x.size(), 1);
+    faiss::float_rand(q.data(), d, 2);
+    std::vector<faiss::HNSW::storage_idx_t> nodes(n);
+    for (int i = 0; i < n; i++) {
+        nodes[i] = 1000 + i;
+    }
+    faiss::HNSWEntryPoints table(d);
+    table.add(n, x.data(), nodes.data());
+
+    std::vector<std::pair<float, int>> ref;
+    for (int i = 0; i < n; i++) {
+        ref.emplace_back(faiss::fvec_L2sqr(q.data(), x.data() + i * d, d), i);
+    }
+    std::sort(ref.begin(), ref.end());
+    std::vector<faiss::HNSW::storage_idx_t> out(nprobe);
+    table.select(q.data(), nprobe, out.data());
+    for (int j = 0; j < nprobe; j++) {
+        EXPECT_EQ(out[j], 1000 + ref[j].second);
+    }
+
+    // smaller table than nprobe: padded with -1
+    faiss::HNSWEntryPoints small(d);
+    small.add(2, x.data(), nodes.data());
+    small.select(q.data(), nprobe, out.data());
+    EXPECT_GE(out[1], 0);
+    EXPECT_EQ(out[2], -1);
+}
+
+TEST(HNSWEntryPoints, search) {
+    EntryPointsData data;
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, data.xb.data());
+    index.hnsw.efSearch = 64;
+    double recall_ref = data.recall(index);
+
+    index.train_entry_points(nb, data.xb.data(), 64, 4);
+    ASSERT_TRUE(index.entry_points);
+    EXPECT_EQ(index.entry_points->size(), 64);
+    double recall = data.recall(index);
+    EXPECT_GT(recall, recall_ref - 0.02);
+
+    // the upper levels are not used: the search works without an entry
+    // point
+    faiss::HNSW::storage_idx_t entry_point = index.hnsw.entry_point;
+    index.hnsw.entry_point = -1;
+    EXPECT_EQ(data.recall(index), recall);
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    params.n_entry_points = 0;
+    EXPECT_EQ(data.recall(index, &params), 0);
+    index.hnsw.entry_point = entry_point;
+    EXPECT_EQ(data.recall(index, &params), recall_ref);
+
+    // the table follows the renumbering of the nodes
+    std::vector<faiss::idx_t> perm(nb);
+    for (int i = 0; i < nb; i++) {
+        perm[i] = i;
+    }
+    faiss::RandomGenerator rng(789);
+    for (int i = 0; i + 1 < nb; i++) {
+        std::swap(perm[i], perm[i + rng.rand_int(nb - i)]);
+    }
+    std::vector<faiss::HNSW::storage_idx_t> nodes = index.entry_points->nodes;
+    index.permute_entries(perm.data());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        EXPECT_EQ(perm[index.entry_points->nodes[i]], nodes[i]);
+    }
+}
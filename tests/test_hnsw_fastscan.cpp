@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nb = 5000, nt = 5000, nq = 100, k = 10;
+
+struct FastScanData {
+    std::vector<float> xt, xb, xq;
+    std::vector<faiss::idx_t> I_gt;
+
+    FastScanData() : xt(nt * d), xb(nb * d), xq(nq * d), I_gt(nq * k) {
+        faiss::rand_smooth_vectors(nt, d, xt.data(), 12);
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        faiss::IndexFlatL2 index_gt(d);
+        index_gt.add(nb, xb.data());
+        std::vector<float> D(nq * k);
+        index_gt.search(nq, xq.data(), k, D.data(), I_gt.data());
+    }
+
+    double recall(const std::vector<faiss::idx_t>& I) const {
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::unordered_set<faiss::idx_t> gt(
+                    I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                n_found += gt.count(I[q * k + j]);
+            }
+        }
+        return n_found / double(nq * k);
+    }
+
+    double recall(const faiss::Index& index) const {
+        std::vector<faiss::idx_t> I(nq * k);
+        std::vector<float> D(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        return recall(I);
+    }
+};
+
+} // namespace
+
+TEST(HNSWPQFastScan, search) {
+    FastScanData data;
+    faiss::IndexHNSWPQ index_ref(d, 16, 16, 4);
+    index_ref.train(nt, data.xt.data());
+    index_ref.add(nb, data.xb.data());
+    index_ref.hnsw.efSearch = 64;
+
+    faiss::IndexHNSWPQFastScan index(d, 16, 16);
+    index.train(nt, data.xt.data());
+    index.add(nb, data.xb.data());
+    index.hnsw.efSearch = 64;
+
+    // the 8-bit quantized look-up tables cost little accuracy
+    double recall = data.recall(index);
+    EXPECT_GT(recall, data.recall(index_ref) - 0.05);
+
+    // exact re-ranking
+    faiss::IndexRefineFlat index_refine(&index, data.xb.data());
+    index_refine.k_factor = 4;
+    EXPECT_GT(data.recall(index_refine), 0.9);
+    EXPECT_GT(data.recall(index_refine), recall);
+
+    // the neighbor blocks are stored with the graph
+    const char* fname = "/tmp/test_hnsw_fastscan.index";
+    faiss::write_index(&index, fname);
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(fname));
+    std::remove(fname);
+    ASSERT_TRUE(dynamic_cast<faiss::IndexHNSWPQFastScan*>(index2.get()));
+    std::vector<faiss::idx_t> I(nq * k), I2(nq * k);
+    std::vector<float> D(nq * k), D2(nq * k);
+    index.search(nq, data.xq.data(), k, D.data(), I.data());
+    dynamic_cast<faiss::IndexHNSW*>(index2.get())->hnsw.efSearch = 64;
+    index2->search(nq, data.xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+}
+
+TEST(HNSWPQFastScan, factory) {
+    FastScanData data;
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "HNSW16,PQ16x4fs,RFlat"));
+    auto index_refine = dynamic_cast<faiss::IndexRefineFlat*>(index.get());
+    ASSERT_TRUE(index_refine);
+    auto index_fs =
+            dynamic_cast<faiss::IndexHNSWPQFastScan*>(index_refine->base_index);
+    ASSERT_TRUE(index_fs);
+    index->train(nt, data.xt.data());
+    index->add(nb, data.xb.data());
+    index_fs->hnsw.efSearch = 64;
+    index_refine->k_factor = 4;
+    EXPECT_GT(data.recall(*index), 0.9);
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const int nb = 10000;
+const int nq = 50;
+const int k = 10;
+
+/// selector of the ids that are multiples of step
+std::vector<uint8_t> make_bitmap(int step) {
+    std::vector<uint8_t> bitmap((nb + 7) / 8);
+    for (int i = 0; i < nb; i += step) {
+        bitmap[i >> 3] |= 1 << (i & 7);
+    }
+    return bitmap;
+}
+
+struct FilteredSearch {
+    std::vector<float> xb, xq;
+    faiss::IndexHNSWFlat index;
+    faiss::IndexFlatL2 index_gt;
+
+    FilteredSearch() : xb(d * nb), xq(d * nq), index(d, 16), index_gt(d) {
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        index.add(nb, xb.data());
+        index_gt.add(nb, xb.data());
+    }
+
+    /// recall of the filtered search wrt. the exhaustive filtered search
+    double recall(
+            faiss::IDSelector& sel,
+            faiss::SearchParametersHNSW& params,
+            size_t* ndis = nullptr) {
+        faiss::SearchParameters params_gt;
+        params_gt.sel = &sel;
+        std::vector<float> D(k * nq);
+        std::vector<faiss::idx_t> I_gt(k * nq), I(k * nq);
+        index_gt.search(nq, xq.data(), k, D.data(), I_gt.data(), &params_gt);
+        params.sel = &sel;
+        faiss::hnsw_stats.reset();
+        index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+        if (ndis) {
+            *ndis = faiss::hnsw_stats.ndis;
+        }
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::set<faiss::idx_t> gt(
+                    I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                faiss::idx_t id = I[q * k + j];
+                if (id >= 0) {
+                    EXPECT_TRUE(sel.is_member(id));
+                    n_found += gt.count(id);
+                }
+            }
+        }
+        return n_found / double(nq * k);
+    }
+};
+
+} // namespace
+
+TEST(HNSWFilteredSearch, estimate_cardinality) {
+    faiss::IDSelectorRange range(100, 350);
+    EXPECT_EQ(range.estimate_cardinality(nb), 250);
+    EXPECT_EQ(range.estimate_cardinality(200), 100);
+
+    std::vector<uint8_t> bitmap = make_bitmap(7);
+    faiss::IDSelectorBitmap sel_bitmap(bitmap.size(), bitmap.data());
+    EXPECT_EQ(sel_bitmap.estimate_cardinality(nb), (nb + 6) / 7);
+
+    std::vector<faiss::idx_t> ids;
+    for (int i = 0; i < nb; i += 7) {
+        ids.push_back(i);
+    }
+    faiss::IDSelectorBatch batch(ids.size(), ids.data());
+    EXPECT_EQ(batch.estimate_cardinality(nb), ids.size());
+    faiss::IDSelectorArray array(ids.size(), ids.data());
+    EXPECT_EQ(array.estimate_cardinality(nb), ids.size());
+
+    faiss::IDSelectorNot sel_not(&range);
+    EXPECT_EQ(sel_not.estimate_cardinality(nb), nb - 250);
+    faiss::IDSelectorAll all;
+    EXPECT_EQ(all.estimate_cardinality(nb), nb);
+
+    // sampled estimate
+    faiss::IDSelectorAnd sel_and(&sel_bitmap, &sel_not);
+    size_t exact = 0;
+    for (int i = 0; i < nb; i++) {
+        exact += sel_and.is_member(i);
+    }
+    EXPECT_NEAR(sel_and.estimate_cardinality(nb), exact, exact * 0.1);
+}
+
+TEST(HNSWFilteredSearch, strategies) {
+    FilteredSearch fs;
+    using S = faiss::SearchParametersHNSW;
+
+    // 0.5% selectivity: exhaustive search of the selected ids
+    std::vector<uint8_t> bitmap_200 = make_bitmap(200);
+    faiss::IDSelectorBitmap sel_200(bitmap_200.size(), bitmap_200.data());
+    S params;
+    params.efSearch = 64;
+    EXPECT_EQ(faiss::hnsw_filter_strategy(&params, nb), S::FILTER_POST);
+    params.sel = &sel_200;
+    EXPECT_EQ(faiss::hnsw_filter_strategy(&params, nb), S::FILTER_BRUTE_FORCE);
+    size_t ndis;
+    EXPECT_EQ(fs.recall(sel_200, params, &ndis), 1.0);
+    EXPECT_EQ(ndis, nq * nb / 200);
+
+    // 5% selectivity: two-hop expansion
+    std::vector<uint8_t> bitmap_20 = make_bitmap(20);
+    faiss::IDSelectorBitmap sel_20(bitmap_20.size(), bitmap_20.data());
+    params.sel = &sel_20;
+    EXPECT_EQ(faiss::hnsw_filter_strategy(&params, nb), S::FILTER_TWO_HOP);
+    size_t ndis_two_hop, ndis_post;
+    double recall_two_hop = fs.recall(sel_20, params, &ndis_two_hop);
+    params.filter_strategy = S::FILTER_POST;
+    double recall_post = fs.recall(sel_20, params, &ndis_post);
+    EXPECT_GT(recall_two_hop, 0.9);
+    EXPECT_GT(recall_two_hop, recall_post);
+    EXPECT_LT(ndis_two_hop, ndis_post);
+
+    // 50% selectivity: post-filtering
+    std::vector<uint8_t> bitmap_2 = make_bitmap(2);
+    faiss::IDSelectorBitmap sel_2(bitmap_2.size(), bitmap_2.data());
+    params.filter_strategy = S::FILTER_AUTO;
+    params.sel = &sel_2;
+    EXPECT_EQ(faiss::hnsw_filter_strategy(&params, nb), S::FILTER_POST);
+    EXPECT_GT(fs.recall(sel_2, params), 0.9);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/utils/random.h>
+
+TEST(HNSWGroupedSearch, documents) {
+    int d = 16, nb = 3000, nq = 50, k = 10, chunks_per_doc = 6;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+    std::vector<faiss::idx_t> doc_of(nb);
+    for (int i = 0; i < nb; i++) {
+        doc_of[i] = (i * 7919) % (nb / chunks_per_doc);
+    }
+
+    for (faiss::MetricType metric :
+         {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexHNSWFlat index(d, 16, metric);
+        index.add(nb, xb.data());
+        faiss::SearchParametersHNSW params;
+        params.efSearch = 64;
+
+        std::vector<float> D(k * nq);
+        std::vector<faiss::idx_t> I(k * nq), best(k * nq);
+        index.search_grouped(
+                nq,
+                xq.data(),
+                k,
+                doc_of.data(),
+                D.data(),
+                I.data(),
+                best.data(),
+                &params);
+
+        // ground truth: best distance of each document, exhaustively
+        faiss::IndexFlat index_gt(d, metric);
+        index_gt.add(nb, xb.data());
+        std::vector<float> D_all(nb * nq);
+        std::vector<faiss::idx_t> I_all(nb * nq);
+        index_gt.search(nq, xq.data(), nb, D_all.data(), I_all.data());
+
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::set<faiss::idx_t> gt;
+            for (int j = 0; j < nb && gt.size() < k; j++) {
+                gt.insert(doc_of[I_all[q * nb + j]]);
+            }
+            std::set<faiss::idx_t> docs;
+            for (int j = 0; j < k; j++) {
+                faiss::idx_t doc = I[q * k + j];
+                ASSERT_GE(doc, 0);
+                // each document once, with its best chunk
+                EXPECT_TRUE(docs.insert(doc).second);
+                EXPECT_EQ(doc_of[best[q * k + j]], doc);
+                float ref;
+                index_gt.compute_distance_subset(
+                        1, xq.data() + q * d, 1, &ref, &best[q * k + j]);
+                EXPECT_NEAR(D[q * k + j], ref, 1e-4);
+                if (j > 0) {
+                    if (metric == faiss::METRIC_L2) {
+                        EXPECT_GE(D[q * k + j], D[q * k + j - 1]);
+                    } else {
+                        EXPECT_LE(D[q * k + j], D[q * k + j - 1]);
+                    }
+                }
+                n_found += gt.count(doc);
+            }
+        }
+        EXPECT_GT(n_found / double(nq * k), 0.9);
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nb = 5000, k = 10;
+// groups of reformulations of the same question
+const int nbase = 20, nreform = 8, nq = nbase * nreform;
+
+/// fraction of the results of I found in I_ref
+double overlap(
+        const std::vector<faiss::idx_t>& I_ref,
+        const std::vector<faiss::idx_t>& I) {
+    size_t n_same = 0;
+    for (int q = 0; q < nq; q++) {
+        std::unordered_set<faiss::idx_t> ref(
+                I_ref.begin() + q * k, I_ref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_same += ref.count(I[q * k + j]);
+        }
+    }
+    return n_same / double(nq * k);
+}
+
+} // namespace
+
+TEST(HNSWLockstep, recompute_search) {
+    std::vector<float> xb(nb * d), xq(nq * d), noise(nq * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    std::vector<float> xbase(nbase * d);
+    faiss::rand_smooth_vectors(nbase, d, xbase.data(), 456);
+    faiss::float_randn(noise.data(), noise.size(), 789);
+    for (int q = 0; q < nq; q++) {
+        for (int j = 0; j < d; j++) {
+            xq[q * d + j] =
+                    xbase[q / nreform * d + j] + 0.01 * noise[q * d + j];
+        }
+    }
+
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    faiss::IndexFlatL2 embeddings(d);
+    embeddings.add(nb, xb.data());
+    index.is_recompute = true;
+    index.embedding_provider =
+            std::make_shared<faiss::IndexEmbeddingProvider>(&embeddings);
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+    size_t fetches_ref = index.get_last_total_fetch_count();
+
+    params.lockstep_queries = nreform;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    size_t fetches = index.get_last_total_fetch_count();
+
+    // the traversals of the reformulations overlap: most fetches are shared
+    EXPECT_LT(fetches * 2, fetches_ref);
+    EXPECT_GT(overlap(I_ref, I), 0.95);
+    for (int i = 0; i < nq * k; i++) {
+        if (I[i] == I_ref[i]) {
+            EXPECT_NEAR(D[i], D_ref[i], 1e-4);
+        }
+    }
+
+    // a group of one query is the regular beam search
+    params.lockstep_queries = 1;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(I, I_ref);
+}
+
+TEST(HNSWLockstep, storage_inner_product) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+
+    faiss::IndexHNSWFlat index(d, 16, faiss::METRIC_INNER_PRODUCT);
+    index.add(nb, xb.data());
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+
+    params.lockstep_queries = 16;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_GT(overlap(I_ref, I), 0.95);
+    for (int q = 0; q < nq; q++) {
+        for (int j = 1; j < k; j++) {
+            // similarities in decreasing order
+            EXPECT_GE(D[q * k + j - 1], D[q * k + j]);
+        }
+    }
+
+    // the selector filters the results
+    faiss::IDSelectorRange sel(0, nb / 2);
+    params.sel = &sel;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_LT(I[i], nb / 2);
+    }
+}
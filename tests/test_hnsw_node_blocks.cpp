@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSWNodeBlocks.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+void check_nodes(
+        const faiss::IndexHNSWFlat& index,
+        const float* xb,
+        const char* fname) {
+    faiss::HNSWNodeBlocks blocks(fname);
+    ASSERT_EQ(blocks.d, index.d);
+    ASSERT_EQ(blocks.ntotal, index.ntotal);
+    std::vector<faiss::idx_t> ids = {index.ntotal - 1, 0, 5, 6, 5};
+    std::vector<float> vectors(ids.size() * index.d);
+    std::vector<std::vector<faiss::HNSWNodeBlocks::storage_idx_t>> lists;
+    blocks.read_nodes(ids.size(), ids.data(), vectors.data(), &lists);
+    std::vector<faiss::HNSW::storage_idx_t> ref;
+    for (size_t i = 0; i < ids.size(); i++) {
+        index.hnsw.fetch_neighbors(ids[i], 0, ref);
+        EXPECT_EQ(lists[i], ref);
+        const float* x = xb + ids[i] * index.d;
+        EXPECT_EQ(
+                std::vector<float>(x, x + index.d),
+                std::vector<float>(
+                        vectors.begin() + i * index.d,
+                        vectors.begin() + (i + 1) * index.d));
+    }
+}
+
+} // namespace
+
+TEST(HNSWNodeBlocks, read_nodes) {
+    for (int d : {16, 1500}) {
+        int nb = 500;
+        std::vector<float> xb(d * nb);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::IndexHNSWFlat index(d, 8);
+        index.add(nb, xb.data());
+
+        Tempfilename tmp;
+        faiss::HNSWNodeBlocks::write(index, tmp.c_str());
+        check_nodes(index, xb.data(), tmp.c_str());
+
+        faiss::HNSWNodeBlocks blocks(tmp.c_str());
+        if (d == 16) {
+            // several nodes per block
+            EXPECT_GT(blocks.nodes_per_block, 1);
+        } else {
+            EXPECT_EQ(blocks.nodes_per_block, 0);
+            EXPECT_EQ(blocks.blocks_per_node, 2);
+        }
+        EXPECT_EQ(blocks.node_offset(0) % blocks.block_size, 0);
+    }
+}
+
+TEST(HNSWNodeBlocks, search) {
+    int d = 32, nb = 3000, nq = 50, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexHNSWFlat index(d, 16, metric);
+        index.add(nb, xb.data());
+        std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+        std::vector<float> D_ref(k * nq), D(k * nq);
+        index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+        Tempfilename tmp_blocks, tmp_index;
+        faiss::HNSWNodeBlocks::write(index, tmp_blocks.c_str());
+        faiss::write_index(
+                &index, tmp_index.c_str(), faiss::IO_FLAG_SKIP_STORAGE);
+
+        // the storage is not loaded, the vectors come from the blocks
+        faiss::HNSWIndexConfig config(false, false, false, 0, nullptr);
+        config.node_blocks_path = tmp_blocks.c_str();
+        std::unique_ptr<faiss::Index> index2(faiss::read_index(
+                tmp_index.c_str(), faiss::IO_FLAG_SKIP_STORAGE, config));
+        auto index2_hnsw = dynamic_cast<faiss::IndexHNSW*>(index2.get());
+        ASSERT_EQ(index2_hnsw->storage, nullptr);
+        ASSERT_TRUE(index2_hnsw->node_blocks);
+
+        faiss::hnsw_stats.reset();
+        index2->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(I, I_ref);
+        for (int i = 0; i < k * nq; i++) {
+            EXPECT_FLOAT_EQ(D[i], D_ref[i]);
+        }
+        // separate vector and neighbor reads would cost ndis + nfetch
+        const faiss::HNSWStats& stats = faiss::hnsw_stats;
+        EXPECT_GT(stats.nfetch, 0);
+        EXPECT_LT(stats.n_ios, stats.ndis + stats.nfetch / 2);
+    }
+}
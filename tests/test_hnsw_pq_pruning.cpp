@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/ProductQuantizer.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/AlignedTable.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+int nb = 3000;
+int nq = 50;
+
+std::vector<uint8_t> train_pq(
+        faiss::ProductQuantizer& pq,
+        const std::vector<float>& xb) {
+    pq.train(nb, xb.data());
+    std::vector<uint8_t> codes(nb * pq.code_size);
+    pq.compute_codes(xb.data(), codes.data(), nb);
+    return codes;
+}
+
+} // namespace
+
+TEST(HNSWPQPruning, pq4_neighbor_distances) {
+    for (int M : {3, 8}) {
+        for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+            int d = 24;
+            std::vector<float> xb(d * nb), xq(d * nq);
+            faiss::float_rand(xb.data(), xb.size(), 123);
+            faiss::float_rand(xq.data(), xq.size(), 456);
+            faiss::IndexHNSWFlat index(d, 16);
+            index.add(nb, xb.data());
+
+            faiss::ProductQuantizer pq(d, M, 4);
+            std::vector<uint8_t> codes = train_pq(pq, xb);
+            faiss::HNSW& hnsw = index.hnsw;
+            hnsw.set_pq_pruning_codes(pq, codes.data(), metric);
+            EXPECT_EQ(hnsw.code_size % 32, 0);
+
+            std::vector<float> decoded(d * nb);
+            pq.decode(codes.data(), decoded.data(), nb);
+            faiss::AlignedTable<uint8_t> lut((M + 1) / 2 * 2 * 16);
+            std::vector<faiss::HNSW::storage_idx_t> list;
+            std::vector<float> dis(hnsw.nb_neighbors(0));
+            for (int q = 0; q < nq; q++) {
+                const float* x = xq.data() + q * d;
+                float a, b;
+                hnsw.pq4_compute_lut(x, lut.data(), &a, &b);
+                // rounding error of the quantized LUT
+                float tol = M / a;
+                for (int i = q; i < nb; i += 97) {
+                    hnsw.fetch_neighbors(i, 0, list);
+                    hnsw.pq4_neighbor_distances(
+                            i, list.size(), lut.data(), a, b, dis.data());
+                    for (size_t j = 0; j < list.size(); j++) {
+                        const float* y = decoded.data() + list[j] * d;
+                        float ref = metric == faiss::METRIC_L2
+                                ? faiss::fvec_L2sqr(x, y, d)
+                                : -faiss::fvec_inner_product(x, y, d);
+                        ASSERT_NEAR(dis[j], ref, tol);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(HNSWPQPruning, search) {
+    int d = 32, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 index_flat(d);
+    index_flat.add(nb, xb.data());
+    std::vector<faiss::idx_t> I_gt(k * nq);
+    std::vector<float> D(k * nq);
+    index_flat.search(nq, xq.data(), k, D.data(), I_gt.data());
+
+    auto recall = [&](const std::vector<faiss::idx_t>& I) {
+        int n_ok = 0;
+        for (int q = 0; q < nq; q++) {
+            std::unordered_set<faiss::idx_t> gt(
+                    I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                n_ok += gt.count(I[q * k + j]);
+            }
+        }
+        return n_ok / double(k * nq);
+    };
+
+    for (int nbits : {4, 8}) {
+        faiss::IndexHNSWFlat index(d, 16);
+        index.add(nb, xb.data());
+        faiss::SearchParametersHNSW params;
+        params.efSearch = 64;
+
+        std::vector<faiss::idx_t> I(k * nq);
+        faiss::hnsw_stats.reset();
+        index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+        double recall_ref = recall(I);
+        size_t ndis_ref = faiss::hnsw_stats.ndis;
+
+        faiss::ProductQuantizer pq(d, 16, nbits);
+        std::vector<uint8_t> codes = train_pq(pq, xb);
+        index.hnsw.set_pq_pruning_codes(pq, codes.data());
+        params.pq_pruning_ratio = 0.5;
+        faiss::hnsw_stats.reset();
+        index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+        EXPECT_GT(faiss::hnsw_stats.n_pq_calcs, 0);
+        EXPECT_LT(faiss::hnsw_stats.ndis, ndis_ref);
+        double recall_pq = recall(I);
+        EXPECT_GT(recall_pq, recall_ref - 0.1);
+
+        // the codes follow the nodes when the graph is permuted (the ties
+        // between quantized distances may be broken differently)
+        std::vector<faiss::idx_t> perm = faiss::reorder_hnsw_for_locality(
+                &index, faiss::HNSW::REORDER_BFS);
+        index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+        for (auto& i : I) {
+            i = perm[i];
+        }
+        EXPECT_GT(recall(I), recall_pq - 0.05);
+    }
+}
+
+TEST(HNSWPQPruning, write_read) {
+    int d = 32, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    for (int nbits : {4, 8}) {
+        faiss::IndexHNSWFlat index(d, 16);
+        index.add(nb, xb.data());
+        faiss::ProductQuantizer pq(d, 8, nbits);
+        std::vector<uint8_t> codes = train_pq(pq, xb);
+        index.hnsw.set_pq_pruning_codes(
+                pq, codes.data(), faiss::METRIC_INNER_PRODUCT);
+
+        faiss::SearchParametersHNSW params;
+        params.pq_pruning_ratio = 0.3;
+        std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+        std::vector<float> D_ref(k * nq), D(k * nq);
+        index.search(
+                nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+
+        Tempfilename tmp;
+        faiss::write_index(&index, tmp.c_str());
+        for (int io_flags : {0, faiss::IO_FLAG_MMAP_IFC}) {
+            std::unique_ptr<faiss::Index> index2(
+                    faiss::read_index(tmp.c_str(), io_flags));
+            auto index2_hnsw = dynamic_cast<faiss::IndexHNSW*>(index2.get());
+            const faiss::HNSW& hnsw2 = index2_hnsw->hnsw;
+            ASSERT_TRUE(hnsw2.pruning_pq);
+            EXPECT_EQ(hnsw2.pruning_pq->nbits, nbits);
+            EXPECT_EQ(hnsw2.pruning_metric, faiss::METRIC_INNER_PRODUCT);
+            // the codes are not copied from the mapped file
+            EXPECT_EQ(hnsw2.pq_codes.is_owned, io_flags == 0);
+            index2->search(nq, xq.data(), k, D.data(), I.data(), &params);
+            EXPECT_EQ(I, I_ref);
+            EXPECT_EQ(D, D_ref);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16;
+const int nb = 5000;
+const int nq = 50;
+
+struct HNSWRangeSearchTest : testing::Test {
+    std::vector<float> xb, xq;
+    std::unique_ptr<faiss::IndexHNSWFlat> index;
+    faiss::IndexFlatL2 ref{d};
+    float radius = 0;
+
+    void SetUp() override {
+        xb.resize(d * nb);
+        xq.resize(d * nq);
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        index = std::make_unique<faiss::IndexHNSWFlat>(d, 16);
+        index->hnsw.efSearch = 16;
+        index->add(nb, xb.data());
+        ref.add(nb, xb.data());
+
+        // radius of the 200th neighbor of the first query: the balls hold
+        // many more results than efSearch
+        std::vector<float> D(200);
+        std::vector<faiss::idx_t> I(200);
+        ref.search(1, xq.data(), 200, D.data(), I.data());
+        radius = D[199];
+    }
+
+    /// fraction of the exact results found, checks that there are no false
+    /// positives
+    double recall(const faiss::SearchParameters* params = nullptr) {
+        faiss::RangeSearchResult gt(nq), res(nq);
+        ref.range_search(nq, xq.data(), radius, &gt);
+        index->range_search(nq, xq.data(), radius, &res, params);
+        size_t nfound = 0;
+        for (int q = 0; q < nq; q++) {
+            std::set<faiss::idx_t> expected(
+                    gt.labels + gt.lims[q], gt.labels + gt.lims[q + 1]);
+            for (size_t j = res.lims[q]; j < res.lims[q + 1]; j++) {
+                EXPECT_LT(res.distances[j], radius);
+                EXPECT_TRUE(expected.count(res.labels[j]));
+                nfound += expected.count(res.labels[j]);
+            }
+        }
+        return double(nfound) / gt.lims[nq];
+    }
+};
+
+} // namespace
+
+TEST_F(HNSWRangeSearchTest, not_capped_by_ef) {
+    index->hnsw.range_slack = -1;
+    double recall_knn = recall();
+    index->hnsw.range_slack = 0.1;
+    double recall_range = recall();
+    EXPECT_GT(recall_range, 0.95);
+    EXPECT_GT(recall_range, recall_knn + 0.3);
+
+    // the search parameters override the value of the HNSW
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 16;
+    params.range_slack = 0.1;
+    index->hnsw.range_slack = -1;
+    EXPECT_EQ(recall(&params), recall_range);
+}
+
+TEST_F(HNSWRangeSearchTest, selector) {
+    faiss::IDSelectorRange sel(0, nb / 2);
+    faiss::SearchParametersHNSW params;
+    params.sel = &sel;
+    params.filter_strategy = faiss::SearchParametersHNSW::FILTER_POST;
+    faiss::RangeSearchResult res(nq);
+    index->range_search(nq, xq.data(), radius, &res, &params);
+    ASSERT_GT(res.lims[nq], 0);
+    for (size_t j = 0; j < res.lims[nq]; j++) {
+        EXPECT_LT(res.labels[j], nb / 2);
+    }
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+struct HNSWReorderTest : testing::Test {
+    const int d = 32;
+    const int nb = 3000;
+    const int nq = 50;
+    const int k = 10;
+    std::vector<float> xb, xq;
+
+    void SetUp() override {
+        xb.resize(d * nb);
+        xq.resize(d * nq);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+    }
+
+    /// mean distance between the ids of level 0 neighbors
+    static double mean_edge_span(const faiss::HNSW& hnsw) {
+        double span = 0;
+        size_t n_edges = 0;
+        std::vector<faiss::HNSW::storage_idx_t> list;
+        for (size_t i = 0; i < hnsw.levels.size(); i++) {
+            hnsw.fetch_neighbors(i, 0, list);
+            for (auto j : list) {
+                span += std::abs((long)i - (long)j);
+                n_edges++;
+            }
+        }
+        return span / n_edges;
+    }
+};
+
+void check_permutation(const std::vector<faiss::idx_t>& perm, size_t n) {
+    ASSERT_EQ(perm.size(), n);
+    std::vector<faiss::idx_t> sorted = perm;
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < n; i++) {
+        ASSERT_EQ(sorted[i], (faiss::idx_t)i);
+    }
+}
+
+} // namespace
+
+TEST_F(HNSWReorderTest, orders_are_permutations) {
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    std::unordered_map<faiss::idx_t, size_t> visit_counts;
+    for (int i = 0; i < nb; i += 7) {
+        visit_counts[i] = i % 5;
+    }
+    for (auto type :
+         {faiss::HNSW::REORDER_BFS,
+          faiss::HNSW::REORDER_RCM,
+          faiss::HNSW::REORDER_VISIT_FREQUENCY}) {
+        std::vector<faiss::idx_t> perm =
+                index.hnsw.locality_order(type, &visit_counts);
+        check_permutation(perm, nb);
+    }
+
+    // the most visited nodes come first
+    std::vector<faiss::idx_t> perm = index.hnsw.locality_order(
+            faiss::HNSW::REORDER_VISIT_FREQUENCY, &visit_counts);
+    EXPECT_EQ(visit_counts[perm[0]], 4);
+
+}
+
+TEST_F(HNSWReorderTest, neighbors_get_closer_ids) {
+    // in low dimension the graph is close to a mesh, with a small bandwidth
+    // once reordered
+    int d2 = 2;
+    std::vector<float> x2(d2 * nb);
+    faiss::float_rand(x2.data(), x2.size(), 789);
+    for (auto type : {faiss::HNSW::REORDER_BFS, faiss::HNSW::REORDER_RCM}) {
+        faiss::IndexHNSWFlat index(d2, 8);
+        index.add(nb, x2.data());
+        double span0 = mean_edge_span(index.hnsw);
+        faiss::reorder_hnsw_for_locality(&index, type);
+        EXPECT_LT(mean_edge_span(index.hnsw), span0 / 4);
+    }
+}
+
+TEST_F(HNSWReorderTest, idmap_results_unchanged) {
+    auto index_hnsw = new faiss::IndexHNSWFlat(d, 16);
+    faiss::IndexIDMap2 index(index_hnsw);
+    index.own_fields = true;
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = 1000 + 3 * i;
+    }
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    // fake PQ pruning codes: the code of node i is i
+    faiss::HNSW& hnsw = index_hnsw->hnsw;
+    hnsw.code_size = sizeof(int);
+    hnsw.pq_codes.resize(nb * sizeof(int));
+    for (int i = 0; i < nb; i++) {
+        memcpy(hnsw.pq_codes.data() + i * sizeof(int), &i, sizeof(int));
+    }
+
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    std::vector<faiss::idx_t> perm =
+            faiss::reorder_hnsw_for_locality(&index, faiss::HNSW::REORDER_RCM);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(index.rev_map.at(ids[perm[0]]), 0);
+    for (int i = 0; i < nb; i++) {
+        int code;
+        memcpy(&code, hnsw.pq_codes.data() + i * sizeof(int), sizeof(int));
+        ASSERT_EQ(code, perm[i]);
+    }
+}
+
+TEST_F(HNSWReorderTest, compact_write_read) {
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    std::vector<float> D_ref(k * nq), D(k * nq);
+
+    faiss::reorder_hnsw_for_locality(&index, faiss::HNSW::REORDER_BFS);
+    index.hnsw.convert_to_compact();
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    Tempfilename tmp;
+    faiss::write_index(&index, tmp.c_str());
+
+    faiss::HNSWIndexConfig config(true, false, false, 0, nullptr);
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(tmp.c_str(), 0, config));
+    index2->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+
+    // same with the neighbors read from the file on demand
+    faiss::HNSWIndexConfig config_disk(true, true, false, 0, nullptr);
+    std::unique_ptr<faiss::Index> index3(
+            faiss::read_index(tmp.c_str(), 0, config_disk));
+    auto index3_hnsw = dynamic_cast<faiss::IndexHNSW*>(index3.get());
+    ASSERT_TRUE(index3_hnsw->hnsw.neighbors_on_disk);
+    index3_hnsw->hnsw.initialize_graph(tmp.filename);
+    index3->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/HNSWSpecializedSearch.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nb = 5000, nq = 100, k = 10;
+
+struct Results {
+    std::vector<float> D;
+    std::vector<faiss::idx_t> I;
+};
+
+Results search(
+        const faiss::IndexHNSW& index,
+        const std::vector<float>& xq,
+        bool specialized,
+        const faiss::SearchParameters* params = nullptr) {
+    const_cast<faiss::IndexHNSW&>(index).specialized_search = specialized;
+    Results r;
+    r.D.resize(nq * k);
+    r.I.resize(nq * k);
+    index.search(nq, xq.data(), k, r.D.data(), r.I.data(), params);
+    return r;
+}
+
+// fraction of the results of the generic search that are also returned by
+// the specialized one
+double overlap(const Results& ref, const Results& r) {
+    size_t n = 0, nfound = 0;
+    for (int q = 0; q < nq; q++) {
+        std::set<faiss::idx_t> ids(
+                r.I.begin() + q * k, r.I.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            if (ref.I[q * k + j] >= 0) {
+                n++;
+                nfound += ids.count(ref.I[q * k + j]);
+            }
+        }
+    }
+    return nfound / double(n);
+}
+
+void test_same_results(faiss::IndexHNSW& index) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.hnsw.efSearch = 32;
+
+    std::unique_ptr<faiss::HNSWSpecializedSearcher> searcher(
+            faiss::make_hnsw_specialized_searcher(index.storage));
+    ASSERT_TRUE(searcher);
+
+    Results ref = search(index, xq, false);
+    Results r = search(index, xq, true);
+    EXPECT_GE(overlap(ref, r), 0.98);
+    for (int i = 0; i < nq * k; i++) {
+        if (ref.I[i] == r.I[i]) {
+            EXPECT_NEAR(ref.D[i], r.D[i], 1e-3 * std::abs(ref.D[i]) + 1e-4);
+        }
+    }
+
+    // selector and deleted vectors
+    faiss::IDSelectorRange sel(0, nb / 2);
+    faiss::SearchParametersHNSW params;
+    params.sel = &sel;
+    index.mark_deleted(faiss::IDSelectorRange(0, nb / 10));
+    ref = search(index, xq, false, &params);
+    r = search(index, xq, true, &params);
+    EXPECT_GE(overlap(ref, r), 0.95);
+    for (faiss::idx_t id : r.I) {
+        if (id >= 0) {
+            EXPECT_GE(id, nb / 10);
+            EXPECT_LT(id, nb / 2);
+        }
+    }
+}
+
+} // namespace
+
+TEST(HNSWSpecializedSearch, FlatL2) {
+    faiss::IndexHNSWFlat index(d, 16);
+    test_same_results(index);
+}
+
+TEST(HNSWSpecializedSearch, FlatIP) {
+    faiss::IndexHNSWFlat index(d, 16, faiss::METRIC_INNER_PRODUCT);
+    test_same_results(index);
+}
+
+TEST(HNSWSpecializedSearch, SQ8L2) {
+    faiss::IndexHNSWSQ index(d, faiss::ScalarQuantizer::QT_8bit, 16);
+    test_same_results(index);
+}
+
+TEST(HNSWSpecializedSearch, SQ8UniformIP) {
+    faiss::IndexHNSWSQ index(
+            d,
+            faiss::ScalarQuantizer::QT_8bit_uniform,
+            16,
+            faiss::METRIC_INNER_PRODUCT);
+    test_same_results(index);
+}
+
+TEST(HNSWSpecializedSearch, UnsupportedStorage) {
+    faiss::IndexPQ pq(d, 4, 8);
+    EXPECT_FALSE(faiss::make_hnsw_specialized_searcher(&pq));
+    faiss::IndexScalarQuantizer sq4(d, faiss::ScalarQuantizer::QT_4bit);
+    EXPECT_FALSE(faiss::make_hnsw_specialized_searcher(&sq4));
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <omp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexVamana.h>
+#include <faiss/impl/HNSWStreamBuilder.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const int d = 32;
+const int nb = 8000;
+const int nq = 100;
+const int k = 10;
+
+double recall(
+        faiss::Index& index,
+        const std::vector<float>& xb,
+        const std::vector<float>& xq) {
+    faiss::IndexFlat index_gt(d, index.metric_type);
+    index_gt.add(nb, xb.data());
+    std::vector<faiss::idx_t> I_gt(k * nq), I(k * nq);
+    std::vector<float> D(k * nq);
+    index_gt.search(nq, xq.data(), k, D.data(), I_gt.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    size_t n_found = 0;
+    for (int q = 0; q < nq; q++) {
+        std::unordered_set<faiss::idx_t> gt(
+                I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_found += gt.count(I[q * k + j]);
+        }
+    }
+    return n_found / double(nq * k);
+}
+
+} // namespace
+
+TEST(HNSWStreamBuilder, single_shard) {
+    // with a single shard and a single thread, the graph is the one of a
+    // regular build
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    int nt = omp_get_max_threads();
+    omp_set_num_threads(1);
+    faiss::IndexHNSWFlat index_ref(d, 16);
+    index_ref.add(nb, xb.data());
+    index_ref.hnsw.convert_to_compact();
+
+    faiss::HNSWStreamBuilder builder(d, 16);
+    builder.nshard = 1;
+    builder.write_storage = false;
+    Tempfilename tmp;
+    builder.build(nb, xb.data(), tmp.c_str());
+    omp_set_num_threads(nt);
+
+    faiss::HNSWIndexConfig config(true, false, false, 0, nullptr);
+    std::unique_ptr<faiss::Index> index(
+            faiss::read_index(tmp.c_str(), 0, config));
+    auto index_hnsw = dynamic_cast<faiss::IndexHNSW*>(index.get());
+    ASSERT_NE(index_hnsw, nullptr);
+    EXPECT_EQ(index_hnsw->storage, nullptr);
+    EXPECT_EQ(index_hnsw->ntotal, nb);
+    const faiss::HNSW& hnsw = index_hnsw->hnsw;
+    const faiss::HNSW& hnsw_ref = index_ref.hnsw;
+    EXPECT_TRUE(hnsw.storage_is_compact);
+    EXPECT_EQ(hnsw.max_level, hnsw_ref.max_level);
+    EXPECT_EQ(hnsw.levels[hnsw.entry_point] - 1, hnsw.max_level);
+    EXPECT_EQ(hnsw.levels, hnsw_ref.levels);
+    EXPECT_EQ(hnsw.compact_level_ptr, hnsw_ref.compact_level_ptr);
+    EXPECT_EQ(hnsw.compact_node_offsets, hnsw_ref.compact_node_offsets);
+    EXPECT_EQ(hnsw.compact_neighbors_data, hnsw_ref.compact_neighbors_data);
+}
+
+TEST(HNSWStreamBuilder, sharded) {
+    for (faiss::MetricType metric :
+         {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        std::vector<float> xb(d * nb), xq(d * nq);
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+
+        faiss::IndexHNSWFlat index_ref(d, 16, metric);
+        index_ref.add(nb, xb.data());
+        index_ref.hnsw.efSearch = 64;
+        double recall_ref = recall(index_ref, xb, xq);
+
+        faiss::HNSWStreamBuilder builder(d, 16, metric);
+        builder.nshard = 4;
+        builder.merge_block_size = 1000;
+        Tempfilename tmp;
+        builder.build(nb, xb.data(), tmp.c_str());
+
+        faiss::HNSWIndexConfig config(true, false, false, 0, nullptr);
+        std::unique_ptr<faiss::Index> index(
+                faiss::read_index(tmp.c_str(), 0, config));
+        auto index_hnsw = dynamic_cast<faiss::IndexHNSW*>(index.get());
+        ASSERT_NE(index_hnsw, nullptr);
+        EXPECT_EQ(index_hnsw->metric_type, metric);
+        EXPECT_TRUE(index_hnsw->hnsw.storage_is_compact);
+        index_hnsw->hnsw.efSearch = 64;
+        // the degrees of the merged lists are bounded as in a regular build
+        for (int level = 0; level <= index_hnsw->hnsw.max_level; level++) {
+            for (int degree : index_hnsw->hnsw.get_degrees(level)) {
+                EXPECT_LE(degree, index_hnsw->hnsw.nb_neighbors(level));
+            }
+        }
+        EXPECT_GT(recall(*index, xb, xq), recall_ref - 0.05);
+    }
+}
+
+TEST(VamanaStreamBuilder, sharded) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+
+    faiss::VamanaStreamBuilder builder(d, 32, 64, 1.2);
+    builder.nshard = 3;
+    builder.batch_size = 500;
+    builder.merge_block_size = 1000;
+    Tempfilename tmp;
+    builder.build(nb, xb.data(), tmp.c_str());
+
+    // in memory, then with the neighbor lists read from disk on demand
+    for (bool skip_neighbors : {false, true}) {
+        faiss::HNSWIndexConfig config(
+                true, skip_neighbors, false, 0, nullptr);
+        std::unique_ptr<faiss::Index> index(
+                faiss::read_index(tmp.c_str(), 0, config));
+        auto index_hnsw = dynamic_cast<faiss::IndexVamana*>(index.get());
+        ASSERT_NE(index_hnsw, nullptr);
+        faiss::HNSW& hnsw = index_hnsw->hnsw;
+        EXPECT_TRUE(hnsw.storage_is_compact);
+        EXPECT_EQ(hnsw.neighbors_on_disk, skip_neighbors);
+        EXPECT_EQ(hnsw.max_level, 0);
+        if (skip_neighbors) {
+            hnsw.initialize_graph(tmp.filename);
+        } else {
+            // variable degrees, bounded by R
+            std::vector<int> degrees = hnsw.get_degrees(0);
+            int min_degree = *std::min_element(degrees.begin(), degrees.end());
+            int max_degree = *std::max_element(degrees.begin(), degrees.end());
+            EXPECT_GT(min_degree, 0);
+            EXPECT_LE(max_degree, 32);
+            EXPECT_LT(min_degree, max_degree);
+        }
+        hnsw.efSearch = 64;
+        EXPECT_GT(recall(*index, xb, xq), 0.9);
+    }
+}
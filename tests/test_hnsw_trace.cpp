@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <omp.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSWTrace.h>
+#include <faiss/utils/random.h>
+
+TEST(HNSWTrace, ring_buffers) {
+    faiss::hnsw_trace_start(4);
+    EXPECT_TRUE(faiss::hnsw_trace_is_enabled());
+    for (int q = 0; q < 6; q++) {
+        faiss::HNSWTraceQuery trace_query(q);
+        faiss::HNSWTraceScope scope(faiss::HNSW_TRACE_GRAPH_FETCH);
+    }
+    // only the last events of the thread are kept
+    std::vector<faiss::HNSWTraceEvent> events = faiss::hnsw_trace_collect();
+    ASSERT_EQ(events.size(), 4);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(events[i].query, i + 2);
+        EXPECT_EQ(events[i].phase, faiss::HNSW_TRACE_GRAPH_FETCH);
+        if (i > 0) {
+            EXPECT_GE(events[i].t_begin, events[i - 1].t_begin);
+        }
+    }
+    std::vector<double> breakdown = faiss::hnsw_trace_breakdown(events, 6);
+    EXPECT_EQ(breakdown.size(), 6 * faiss::HNSW_TRACE_N_PHASES);
+    EXPECT_EQ(breakdown[0 * faiss::HNSW_TRACE_N_PHASES +
+                        faiss::HNSW_TRACE_GRAPH_FETCH],
+              0);
+    EXPECT_EQ(
+            breakdown[5 * faiss::HNSW_TRACE_N_PHASES +
+                      faiss::HNSW_TRACE_GRAPH_FETCH],
+            events[3].duration);
+
+    std::string json = faiss::hnsw_trace_to_chrome_json(events);
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"graph_fetch\""), std::string::npos);
+    EXPECT_NE(json.find("\"query\":5"), std::string::npos);
+
+    // one buffer per thread
+    faiss::hnsw_trace_start(16);
+#pragma omp parallel num_threads(4)
+    { faiss::HNSWTraceScope scope(faiss::HNSW_TRACE_HEAP); }
+    events = faiss::hnsw_trace_collect();
+    std::set<uint32_t> threads;
+    for (const auto& e : events) {
+        threads.insert(e.thread);
+        EXPECT_EQ(e.query, -1);
+    }
+    EXPECT_EQ(threads.size(), events.size());
+
+    // nothing is recorded once stopped
+    faiss::hnsw_trace_stop();
+    { faiss::HNSWTraceScope scope(faiss::HNSW_TRACE_HEAP); }
+    EXPECT_EQ(faiss::hnsw_trace_collect().size(), events.size());
+}
+
+#ifdef FAISS_HNSW_TRACE
+
+TEST(HNSWTrace, search) {
+    const int d = 32, nb = 2000, nq = 20, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    std::vector<faiss::idx_t> I(k * nq);
+    std::vector<float> D(k * nq);
+
+    faiss::hnsw_trace_start();
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    faiss::hnsw_trace_stop();
+    std::vector<double> breakdown =
+            faiss::hnsw_trace_breakdown(faiss::hnsw_trace_collect(), nq);
+    for (int q = 0; q < nq; q++) {
+        const double* b = breakdown.data() + q * faiss::HNSW_TRACE_N_PHASES;
+        EXPECT_GT(b[faiss::HNSW_TRACE_QUERY], 0);
+        EXPECT_GT(b[faiss::HNSW_TRACE_DISTANCES], 0);
+        EXPECT_GT(b[faiss::HNSW_TRACE_HEAP], 0);
+        // the other phases are nested in the query and do not overlap
+        double sum = 0;
+        for (int p = 1; p < faiss::HNSW_TRACE_N_PHASES; p++) {
+            sum += b[p];
+        }
+        EXPECT_LE(sum, b[faiss::HNSW_TRACE_QUERY]);
+    }
+}
+
+#endif
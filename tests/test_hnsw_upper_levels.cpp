@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nb = 5000, nq = 100, k = 10;
+
+/// counts the distances computed on the storage, as a stand-in for the
+/// fetches of the recompute mode
+struct CountingDistanceComputer : faiss::DistanceComputer {
+    std::unique_ptr<faiss::DistanceComputer> basedis;
+    std::atomic<size_t>& count;
+
+    CountingDistanceComputer(
+            faiss::DistanceComputer* basedis,
+            std::atomic<size_t>& count)
+            : basedis(basedis), count(count) {}
+
+    void set_query(const float* x) override {
+        basedis->set_query(x);
+    }
+
+    float operator()(faiss::idx_t i) override {
+        count++;
+        return (*basedis)(i);
+    }
+
+    void distances_batch(
+            const std::vector<faiss::idx_t>& ids,
+            std::vector<float>& distances_out) override {
+        count += ids.size();
+        basedis->distances_batch(ids, distances_out);
+    }
+
+    float symmetric_dis(faiss::idx_t i, faiss::idx_t j) override {
+        return basedis->symmetric_dis(i, j);
+    }
+};
+
+struct CountingFlat : faiss::IndexFlatL2 {
+    mutable std::atomic<size_t> count{0};
+
+    explicit CountingFlat(int d) : faiss::IndexFlatL2(d) {}
+
+    faiss::DistanceComputer* get_distance_computer() const override {
+        return new CountingDistanceComputer(
+                faiss::IndexFlatL2::get_distance_computer(), count);
+    }
+};
+
+} // namespace
+
+TEST(HNSWUpperLevelCodes, search) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+
+    CountingFlat storage(d);
+    faiss::IndexHNSW index(&storage, 16);
+    index.add(nb, xb.data());
+    index.hnsw.efSearch = 64;
+
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    storage.count = 0;
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    size_t count_ref = storage.count;
+
+    index.build_upper_level_codes("SQ8");
+    ASSERT_TRUE(index.upper_level_codes);
+    size_t n_upper = 0;
+    for (int i = 0; i < nb; i++) {
+        n_upper += index.hnsw.levels[i] > 1;
+    }
+    EXPECT_EQ(index.upper_level_codes->nodes.size(), n_upper);
+
+    storage.count = 0;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    // only the level 0 search uses the storage
+    EXPECT_LT(storage.count, count_ref);
+
+    // the SQ8 descent ends at the same level 0 entry for most queries, the
+    // results are of the same quality
+    size_t n_same = 0;
+    for (int q = 0; q < nq; q++) {
+        std::unordered_set<faiss::idx_t> ref(
+                I_ref.begin() + q * k, I_ref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_same += ref.count(I[q * k + j]);
+        }
+    }
+    EXPECT_GT(n_same, nq * k * 0.95);
+    // the distances are exact
+    for (int i = 0; i < nq * k; i++) {
+        if (I[i] == I_ref[i]) {
+            EXPECT_EQ(D[i], D_ref[i]);
+        }
+    }
+
+    // the codes follow the renumbering of the nodes
+    std::vector<faiss::idx_t> perm(nb);
+    for (int i = 0; i < nb; i++) {
+        perm[i] = nb - 1 - i;
+    }
+    index.permute_entries(perm.data());
+    for (auto node : index.upper_level_codes->nodes) {
+        EXPECT_GT(index.hnsw.levels[node], 1);
+    }
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    size_t n_same_perm = 0;
+    for (int i = 0; i < nq * k; i++) {
+        n_same_perm += I[i] >= 0 && perm[I[i]] == I_ref[i];
+    }
+    EXPECT_GT(n_same_perm, nq * k * 0.9);
+}
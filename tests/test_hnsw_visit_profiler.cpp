@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSWVisitProfiler.h>
+#include <faiss/utils/random.h>
+
+TEST(HNSWVisitProfiler, counters) {
+    faiss::HNSWVisitProfiler profiler(10);
+    for (int i = 0; i < 70000; i++) {
+        profiler.add_visit(3);
+    }
+    profiler.add_visit(5);
+    profiler.add_visit(5);
+    profiler.add_visit(7);
+    profiler.add_visit(-1);
+    profiler.add_visit(10);
+    // the counters saturate
+    EXPECT_EQ(profiler.count(3), UINT16_MAX);
+    EXPECT_EQ(profiler.n_saturated(), 1);
+
+    auto hh = profiler.heavy_hitters(2);
+    ASSERT_EQ(hh.size(), 2);
+    EXPECT_EQ(hh[0].first, 3);
+    EXPECT_EQ(hh[1].first, 5);
+    EXPECT_EQ(hh[1].second, 2);
+    EXPECT_EQ(profiler.top_ids(10), (std::vector<faiss::idx_t>{3, 5, 7}));
+    EXPECT_EQ(profiler.scores()[7], 1);
+    EXPECT_EQ(profiler.visit_counts().size(), 3);
+
+    profiler.reset();
+    EXPECT_TRUE(profiler.heavy_hitters(10).empty());
+}
+
+TEST(HNSWVisitProfiler, search) {
+    int d = 16, nb = 2000, nq = 100, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    std::vector<float> D(k * nq), D_ref(k * nq);
+    std::vector<faiss::idx_t> I(k * nq), I_ref(k * nq);
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 32;
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+
+    faiss::HNSWVisitProfiler profiler(nb);
+    params.visit_profiler = &profiler;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    // profiling does not change the results
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(profiler.n_queries_seen(), nq);
+    EXPECT_EQ(profiler.n_queries_sampled(), nq);
+    // each query expands at least its entry point on level 0
+    size_t n_visits = 0;
+    for (int32_t c : profiler.scores()) {
+        n_visits += c;
+    }
+    EXPECT_GE(n_visits, nq);
+    auto hh = profiler.heavy_hitters(10);
+    ASSERT_EQ(hh.size(), 10);
+    for (size_t i = 1; i < hh.size(); i++) {
+        EXPECT_GE(hh[i - 1].second, hh[i].second);
+    }
+
+    profiler.reset();
+    profiler.query_sample_period = 4;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(profiler.n_queries_seen(), nq);
+    EXPECT_EQ(profiler.n_queries_sampled(), nq / 4);
+    EXPECT_FALSE(profiler.heavy_hitters(1).empty());
+}
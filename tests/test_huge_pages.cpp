@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/impl/maybe_owned_vector.h>
+#include <faiss/utils/AlignedTable.h>
+#include <faiss/utils/huge_pages.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+/// sets the huge pages mode for the scope
+struct HugePagesScope {
+    faiss::HugePagesMode mode_bak = faiss::huge_pages_mode;
+    size_t min_size_bak = faiss::huge_pages_min_size;
+
+    HugePagesScope(faiss::HugePagesMode mode, size_t min_size) {
+        faiss::huge_pages_mode = mode;
+        faiss::huge_pages_min_size = min_size;
+    }
+
+    ~HugePagesScope() {
+        faiss::huge_pages_mode = mode_bak;
+        faiss::huge_pages_min_size = min_size_bak;
+    }
+};
+
+} // namespace
+
+TEST(HugePages, alignment) {
+    const size_t big = 8 << 20;
+    EXPECT_EQ(faiss::huge_pages_alignment(big, 32), 32);
+    HugePagesScope scope(faiss::HUGE_PAGES_THP, 4 << 20);
+    EXPECT_EQ(faiss::huge_pages_alignment(1 << 20, 32), 32);
+#ifdef __linux__
+    EXPECT_EQ(faiss::huge_pages_alignment(big, 32), 2 << 20);
+
+    faiss::AlignedTable<uint8_t> tab(big);
+    EXPECT_EQ((uintptr_t)tab.get() % (2 << 20), 0);
+#endif
+}
+
+TEST(HugePages, containers) {
+    for (faiss::HugePagesMode mode :
+         {faiss::HUGE_PAGES_THP, faiss::HUGE_PAGES_THP_COLLAPSE}) {
+        HugePagesScope scope(mode, 1 << 20);
+        const size_t n = 3 << 20;
+        faiss::AlignedTable<uint16_t> tab(n);
+        faiss::MaybeOwnedVector<uint16_t> vec;
+        for (size_t i = 0; i < n; i++) {
+            tab[i] = i * 7;
+            vec.push_back(i * 7);
+        }
+        tab.resize(2 * n);
+        vec.resize(2 * n);
+        for (size_t i = 0; i < n; i++) {
+            ASSERT_EQ(tab[i], uint16_t(i * 7));
+            ASSERT_EQ(vec[i], uint16_t(i * 7));
+        }
+    }
+}
+
+TEST(HugePages, index_flat) {
+    const size_t d = 32, nb = 50000, nq = 10, k = 5;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::float_rand(xq.data(), xq.size(), 2);
+
+    faiss::IndexFlatL2 index_ref(d);
+    index_ref.add(nb, xb.data());
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index_ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    HugePagesScope scope(faiss::HUGE_PAGES_THP_COLLAPSE, 1 << 20);
+    faiss::IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, Dref);
+    EXPECT_EQ(I, Iref);
+}
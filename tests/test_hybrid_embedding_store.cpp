@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/impl/HybridEmbeddingStore.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const int d = 16;
+const int nt = 500;
+
+struct HybridStoreTest : testing::Test {
+    Tempfilename storage_file;
+    std::vector<float> xb;
+    std::vector<int32_t> degrees;
+
+    HybridStoreTest() : xb(d * nt), degrees(nt) {
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::IndexFlatIP index(d);
+        index.add(nt, xb.data());
+        faiss::write_index(&index, storage_file.c_str());
+        for (int i = 0; i < nt; i++) {
+            degrees[i] = (i * 7919) % nt;
+        }
+    }
+
+    void check_pinned(const faiss::HybridEmbeddingStore& store) {
+        const std::vector<faiss::idx_t>& ids = store.get_pinned_ids();
+        std::vector<float> out(ids.size() * d);
+        store.get_embeddings(ids.size(), ids.data(), out.data());
+        for (size_t i = 0; i < ids.size(); i++) {
+            for (int j = 0; j < d; j++) {
+                ASSERT_EQ(out[i * d + j], xb[ids[i] * d + j]);
+            }
+        }
+    }
+};
+
+} // namespace
+
+TEST_F(HybridStoreTest, flat_storage_offset) {
+    EXPECT_EQ(
+            faiss::HybridEmbeddingStore::flat_storage_data_offset(
+                    storage_file.c_str()),
+            45);
+}
+
+TEST_F(HybridStoreTest, pin_top_degree) {
+    for (auto tier :
+         {faiss::HybridEmbeddingStore::TIER_RAM,
+          faiss::HybridEmbeddingStore::TIER_SSD}) {
+        faiss::HybridEmbeddingStore store(
+                d,
+                nt,
+                storage_file.c_str(),
+                faiss::HybridEmbeddingStore::flat_storage_data_offset(
+                        storage_file.c_str()),
+                tier);
+        store.pin_top(degrees, 10);
+        EXPECT_EQ(store.n_pinned(), nt / 10);
+        for (faiss::idx_t id : store.get_pinned_ids()) {
+            EXPECT_GE(degrees[id], nt - nt / 10);
+        }
+        check_pinned(store);
+
+        const std::vector<faiss::idx_t>& ids = store.get_pinned_ids();
+        std::vector<float> dis(ids.size());
+        store.compute_distances(
+                ids.size(),
+                ids.data(),
+                xb.data(),
+                faiss::METRIC_INNER_PRODUCT,
+                dis.data());
+        for (size_t i = 0; i < ids.size(); i++) {
+            EXPECT_FLOAT_EQ(
+                    dis[i],
+                    -faiss::fvec_inner_product(
+                            xb.data(), xb.data() + ids[i] * d, d));
+        }
+    }
+}
+
+TEST_F(HybridStoreTest, write_read) {
+    Tempfilename store_file;
+    faiss::HybridEmbeddingStore store(d, nt, storage_file.c_str(), 45);
+    store.pin({3, 1, 400, 3});
+    EXPECT_EQ(store.n_pinned(), 3);
+    store.write(store_file.c_str());
+
+    std::unique_ptr<faiss::HybridEmbeddingStore> store2(
+            faiss::HybridEmbeddingStore::read(store_file.c_str()));
+    EXPECT_EQ(store2->get_pinned_ids(), store.get_pinned_ids());
+    EXPECT_TRUE(store2->is_pinned(400));
+    EXPECT_FALSE(store2->is_pinned(2));
+    check_pinned(*store2);
+}
+
+TEST_F(HybridStoreTest, degree_files) {
+    Tempfilename binary_file, text_file;
+    faiss::HybridEmbeddingStore::write_degree_file(
+            binary_file.c_str(), degrees);
+    EXPECT_EQ(
+            faiss::HybridEmbeddingStore::read_degree_file(binary_file.c_str()),
+            degrees);
+
+    FILE* f = fopen(text_file.c_str(), "w");
+    for (int32_t deg : degrees) {
+        fprintf(f, "%d\n", deg);
+    }
+    fclose(f);
+    EXPECT_EQ(
+            faiss::HybridEmbeddingStore::read_degree_file(text_file.c_str()),
+            degrees);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/IdHashMap.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+TEST(IdHashMap, random_ops) {
+    faiss::IdHashMap map;
+    std::unordered_map<faiss::idx_t, faiss::idx_t> ref;
+    std::mt19937 rng(123);
+    std::uniform_int_distribution<faiss::idx_t> key_distrib(0, 3000);
+
+    for (int i = 0; i < 50000; i++) {
+        faiss::idx_t key = key_distrib(rng);
+        if (rng() % 3 == 0) {
+            EXPECT_EQ(map.erase(key), ref.erase(key) == 1);
+        } else {
+            map.set(key, i);
+            ref[key] = i;
+        }
+    }
+    map.check_consistency();
+    EXPECT_EQ(map.size(), ref.size());
+    for (faiss::idx_t key = 0; key <= 3000; key++) {
+        faiss::idx_t value = -1;
+        bool found = map.get(key, value);
+        auto it = ref.find(key);
+        ASSERT_EQ(found, it != ref.end());
+        if (found) {
+            EXPECT_EQ(value, it->second);
+        }
+    }
+    size_t n = 0;
+    map.for_each([&](faiss::idx_t key, faiss::idx_t value) {
+        EXPECT_EQ(ref.at(key), value);
+        n++;
+    });
+    EXPECT_EQ(n, ref.size());
+    EXPECT_THROW(map.at(-1), faiss::FaissException);
+
+    map.clear();
+    EXPECT_EQ(map.size(), size_t(0));
+    EXPECT_FALSE(map.contains(0));
+}
+
+TEST(IdHashMap, IndexIDMap2_mmap) {
+    size_t d = 8, nb = 1000;
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    std::vector<faiss::idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 12345 + 7 * i;
+    }
+
+    faiss::IndexFlatL2 flat(d);
+    faiss::IndexIDMap2 index(&flat);
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    faiss::VectorIOWriter wr;
+    faiss::write_index(&index, &wr);
+    std::string tmpname = std::tmpnam(nullptr);
+    {
+        std::ofstream ofs(tmpname);
+        ofs.write((const char*)wr.data.data(), wr.data.size());
+    }
+
+    for (int io_flags : {0, faiss::IO_FLAG_MMAP_IFC}) {
+        std::unique_ptr<faiss::IndexIDMap2> index2(
+                dynamic_cast<faiss::IndexIDMap2*>(
+                        faiss::read_index(tmpname.c_str(), io_flags)));
+        ASSERT_NE(index2, nullptr);
+        // the rev_map is loaded as is
+        EXPECT_EQ(index2->rev_map.ctrl.is_owned, io_flags == 0);
+        index2->check_consistency();
+
+        std::vector<float> recons(d);
+        index2->reconstruct(ids[17], recons.data());
+        for (size_t j = 0; j < d; j++) {
+            EXPECT_EQ(recons[j], xb[17 * d + j]);
+        }
+
+        if (io_flags != 0) {
+            // the mapped index is read-only
+            continue;
+        }
+        faiss::IDSelectorRange sel(ids[0], ids[10]);
+        EXPECT_EQ(index2->remove_ids(sel), size_t(10));
+        index2->check_consistency();
+        EXPECT_THROW(
+                index2->reconstruct(ids[3], recons.data()),
+                faiss::FaissException);
+    }
+    std::remove(tmpname.c_str());
+}
+
+TEST(IdHashMap, DirectMap_hashtable_io) {
+    size_t d = 8, nb = 1000, nlist = 10;
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    std::vector<faiss::idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 1000000 + 13 * i;
+    }
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.train(nb, xb.data());
+    index.set_direct_map_type(faiss::DirectMap::Hashtable);
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    faiss::VectorIOWriter wr;
+    faiss::write_index(&index, &wr);
+    faiss::VectorIOReader rd;
+    rd.data = wr.data;
+    std::unique_ptr<faiss::IndexIVF> index2(
+            dynamic_cast<faiss::IndexIVF*>(faiss::read_index(&rd)));
+    ASSERT_NE(index2, nullptr);
+    EXPECT_EQ(index2->direct_map.type, faiss::DirectMap::Hashtable);
+    EXPECT_EQ(index2->direct_map.hashtable.size(), nb);
+
+    std::vector<float> recons(d);
+    for (size_t i = 0; i < nb; i += 97) {
+        index2->reconstruct(ids[i], recons.data());
+        for (size_t j = 0; j < d; j++) {
+            EXPECT_EQ(recons[j], xb[i * d + j]);
+        }
+    }
+}
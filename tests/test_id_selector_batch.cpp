@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+TEST(IDSelectorMemberBatch, is_member_batch) {
+    // 13 bytes: the last bits are not in a full 32-bit word
+    std::vector<uint8_t> bitmap(13);
+    faiss::byte_rand(bitmap.data(), bitmap.size(), 123);
+    std::vector<faiss::idx_t> subset;
+    for (faiss::idx_t i = 0; i < 200; i += 3) {
+        subset.push_back(i);
+    }
+    faiss::IDSelectorBitmap sel_bitmap(bitmap.size(), bitmap.data());
+    faiss::IDSelectorRange sel_range(20, 70);
+    faiss::IDSelectorBatch sel_batch(subset.size(), subset.data());
+    faiss::IDSelectorNot sel_not(&sel_bitmap);
+    faiss::IDSelectorAll sel_all;
+
+    std::vector<faiss::idx_t> ids;
+    for (faiss::idx_t i = -5; i < 120; i++) {
+        ids.push_back(i);
+    }
+    std::vector<int64_t> rand_ids(300);
+    faiss::int64_rand_max(rand_ids.data(), rand_ids.size(), 130, 456);
+    ids.insert(ids.end(), rand_ids.begin(), rand_ids.end());
+    ids.push_back(-1000000);
+    ids.push_back(1LL << 40);
+
+    for (const faiss::IDSelector* sel :
+         std::vector<const faiss::IDSelector*>{
+                 &sel_bitmap, &sel_range, &sel_batch, &sel_not, &sel_all}) {
+        // unaligned starts and tails
+        for (size_t i0 : {0, 1, 3}) {
+            size_t n = ids.size() - i0;
+            std::vector<uint8_t> mask(n, 2);
+            sel->is_member_batch(n, ids.data() + i0, mask.data());
+            for (size_t i = 0; i < n; i++) {
+                EXPECT_EQ(mask[i], sel->is_member(ids[i0 + i]))
+                        << "id " << ids[i0 + i];
+            }
+        }
+    }
+}
+
+TEST(IDSelectorMemberBatch, ivf_scan) {
+    int d = 16, nb = 5000, nq = 20, k = 10;
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 16);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    faiss::IndexFlatL2 index_gt(d);
+    index_gt.add(nb, xb.data());
+
+    std::vector<uint8_t> bitmap((nb + 7) / 8);
+    faiss::byte_rand(bitmap.data(), bitmap.size(), 789);
+    faiss::IDSelectorBitmap sel(bitmap.size(), bitmap.data());
+
+    // all lists are scanned: same results as the exhaustive search
+    faiss::SearchParametersIVF params;
+    params.sel = &sel;
+    params.nprobe = 16;
+    faiss::SearchParameters params_gt;
+    params_gt.sel = &sel;
+    std::vector<float> D(k * nq), D_gt(k * nq);
+    std::vector<faiss::idx_t> I(k * nq), I_gt(k * nq);
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    index_gt.search(nq, xq.data(), k, D_gt.data(), I_gt.data(), &params_gt);
+    EXPECT_EQ(I, I_gt);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include <faiss/IndexBatching.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 2000;
+const int nthread = 8;
+const int nq_per_thread = 25;
+const int k = 5;
+
+/// nthread threads search their queries one by one, the results must be
+/// the same as those of the batched search of the wrapped index
+void test_concurrent_search(faiss::IndexBatching& index) {
+    size_t nq = nthread * nq_per_thread;
+    std::vector<float> xq(nq * d);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    index.index->search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthread; t++) {
+        threads.emplace_back([&, t]() {
+            for (int j = 0; j < nq_per_thread; j++) {
+                size_t q = t * nq_per_thread + j;
+                index.search(
+                        1,
+                        xq.data() + q * d,
+                        k,
+                        D.data() + q * k,
+                        I.data() + q * k);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    EXPECT_EQ(I, Iref);
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(D[i], Dref[i], 1e-4);
+    }
+}
+
+} // namespace
+
+TEST(IndexBatching, flat) {
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::IndexFlatL2 flat(d);
+    faiss::IndexBatching index(&flat, 16);
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    index.adaptive_window = false;
+    index.max_window_us = 2000;
+    test_concurrent_search(index);
+    // the queries were merged
+    EXPECT_LT(index.n_batches, nthread * nq_per_thread);
+    EXPECT_GT(index.average_batch_size(), 1.0);
+}
+
+TEST(IndexBatching, ivf_adaptive) {
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat ivf(&quantizer, d, 16);
+    faiss::IndexBatching index(&ivf);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    ivf.nprobe = 4;
+    test_concurrent_search(index);
+
+    // a single thread never finds company: the window shrinks to its
+    // minimum
+    std::vector<float> D(k);
+    std::vector<faiss::idx_t> I(k);
+    for (int i = 0; i < 20; i++) {
+        index.search(1, xb.data() + i * d, k, D.data(), I.data());
+        EXPECT_EQ(I[0], i);
+    }
+    EXPECT_EQ(index.window_us(), index.min_window_us);
+}
+
+TEST(IndexBatching, errors_are_propagated) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat ivf(&quantizer, d, 16);
+    faiss::IndexBatching index(&ivf);
+    std::vector<float> x(d);
+    std::vector<float> D(k);
+    std::vector<faiss::idx_t> I(k);
+    // the IVF does not accept these parameters
+    faiss::IndexRefineSearchParameters params;
+    EXPECT_THROW(
+            index.search(1, x.data(), k, D.data(), I.data(), &params),
+            faiss::FaissException);
+}
@@ -744,6 +744,13 @@ class TestIndependentQuantizer(unittest.TestCase):
         np.testing.assert_array_equal(Dref, Dnew)
         np.testing.assert_array_equal(Iref, Inew)
 
+        # pipelined search by chunks
+        index2.search_chunk_size = 7
+        Dnew, Inew = index2.search(xq2, 10)
+        np.testing.assert_array_equal(Dref, Dnew)
+        np.testing.assert_array_equal(Iref, Inew)
+        index2.search_chunk_size = 0
+
         # test add
         index2.reset()
         xb2 = np.hstack([ds.get_database()] * 2)
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/IndexDelta.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nb = 4000, nadd = 200, nq = 20, k = 10;
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+// ship the delta between index_old and index_new through a file and apply
+// it to a copy of index_old
+std::unique_ptr<faiss::Index> replicate(
+        const faiss::Index* index_old,
+        const faiss::Index* index_new) {
+    faiss::IndexDelta delta = faiss::compute_index_delta(index_old, index_new);
+    Tempfilename tmp;
+    faiss::write_index_delta(delta, tmp.c_str());
+    faiss::IndexDelta delta2;
+    faiss::read_index_delta(delta2, tmp.c_str());
+    EXPECT_EQ(delta.nbytes(), delta2.nbytes());
+
+    std::unique_ptr<faiss::Index> replica(faiss::clone_index(index_old));
+    faiss::apply_index_delta(replica.get(), delta2);
+    // the delta cannot be applied twice
+    EXPECT_THROW(
+            faiss::apply_index_delta(replica.get(), delta2),
+            faiss::FaissException);
+    return replica;
+}
+
+void expect_same_results(
+        const faiss::Index* index,
+        const faiss::Index* replica,
+        const float* xq) {
+    EXPECT_EQ(index->ntotal, replica->ntotal);
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    index->search(nq, xq, k, Dref.data(), Iref.data());
+    replica->search(nq, xq, k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+}
+
+} // namespace
+
+TEST(IndexDelta, ivf) {
+    std::vector<float> xb((nb + nadd) * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.nprobe = 8;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    std::unique_ptr<faiss::Index> index_old(faiss::clone_index(&index));
+
+    index.add(nadd, xb.data() + nb * d);
+    faiss::IDSelectorRange sel(100, 150);
+    index.remove_ids(sel);
+
+    faiss::IndexDelta delta = faiss::compute_index_delta(
+            index_old.get(), &index);
+    size_t n_removed = 0, n_added = 0;
+    for (size_t i = 0; i < delta.list_nos.size(); i++) {
+        n_removed += delta.removed_ids[i].size();
+        n_added += delta.added_ids[i].size();
+    }
+    EXPECT_EQ(n_removed, 50);
+    EXPECT_EQ(n_added, nadd);
+
+    auto replica = replicate(index_old.get(), &index);
+    expect_same_results(&index, replica.get(), xq.data());
+}
+
+TEST(IndexDelta, hnsw) {
+    std::vector<float> xb((nb + nadd) * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    std::unique_ptr<faiss::Index> index_old(faiss::clone_index(&index));
+
+    index.add(nadd, xb.data() + nb * d);
+    faiss::IDSelectorRange sel(100, 150);
+    index.mark_deleted(sel);
+
+    faiss::IndexDelta delta = faiss::compute_index_delta(
+            index_old.get(), &index);
+    EXPECT_EQ(delta.deleted_ids.size(), 50);
+    EXPECT_EQ(delta.levels.size(), nadd);
+    // only the neighborhoods of the added vectors are updated
+    EXPECT_LT(delta.updated_nodes.size(), nb + nadd);
+    size_t full_size = index.hnsw.neighbors.size() * sizeof(int32_t) +
+            (nb + nadd) * d * sizeof(float);
+    EXPECT_LT(delta.nbytes(), full_size);
+
+    auto replica = replicate(index_old.get(), &index);
+    expect_same_results(&index, replica.get(), xq.data());
+
+    // renumbering the vectors is not supported
+    index.compact_deleted();
+    EXPECT_THROW(
+            faiss::compute_index_delta(index_old.get(), &index),
+            faiss::FaissException);
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances_int8.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+// d is not a multiple of 32 to exercise the masked tails
+const int d = 50;
+const int nb = 2500;
+const int nq = 37;
+const int k = 10;
+
+// the SIMD kernels quantize the queries to int8
+float tolerance(faiss::MetricType metric) {
+    return metric == faiss::METRIC_L2 ? 0.05 : 0.03;
+}
+
+/// search the int8 index and a float index on the decoded vectors
+void compare_with_flat(faiss::MetricType metric, int nq_, int k_) {
+    std::vector<float> xb(nb * d), xq(nq_ * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatInt8 index(d, metric);
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.codes.size(), nb * faiss::int8_code_size(d));
+
+    std::vector<float> decoded(nb * d);
+    index.reconstruct_n(0, nb, decoded.data());
+    faiss::IndexFlat ref(d, metric);
+    ref.add(nb, decoded.data());
+
+    std::vector<float> D(nq_ * k_), Dref(nq_ * k_);
+    std::vector<faiss::idx_t> I(nq_ * k_), Iref(nq_ * k_);
+    index.search(nq_, xq.data(), k_, D.data(), I.data());
+    ref.search(nq_, xq.data(), k_, Dref.data(), Iref.data());
+
+    size_t n_same = 0;
+    for (int q = 0; q < nq_; q++) {
+        for (int i = 0; i < k_; i++) {
+            EXPECT_NEAR(D[q * k_ + i], Dref[q * k_ + i], tolerance(metric));
+            for (int j = 0; j < k_; j++) {
+                n_same += I[q * k_ + i] == Iref[q * k_ + j];
+            }
+        }
+    }
+    EXPECT_GE(n_same, 0.9 * nq_ * k_);
+}
+
+} // namespace
+
+TEST(IndexFlatInt8, encode_decode) {
+    std::vector<float> x(nb * d), x2(nb * d);
+    faiss::float_rand(x.data(), x.size(), 123);
+    std::vector<uint8_t> codes(nb * faiss::int8_code_size(d));
+    faiss::int8_encode(x.data(), d, nb, codes.data());
+    faiss::int8_decode(codes.data(), d, nb, x2.data());
+    // the components are in [0, 1), so the scales are at most 1 / 127
+    for (size_t i = 0; i < x.size(); i++) {
+        EXPECT_NEAR(x[i], x2[i], 0.5 / 127 + 1e-6);
+    }
+}
+
+TEST(IndexFlatInt8, search_L2) {
+    compare_with_flat(faiss::METRIC_L2, nq, k);
+}
+
+TEST(IndexFlatInt8, search_IP) {
+    compare_with_flat(faiss::METRIC_INNER_PRODUCT, nq, k);
+}
+
+TEST(IndexFlatInt8, search_k1_and_reservoir) {
+    compare_with_flat(faiss::METRIC_L2, nq, 1);
+    compare_with_flat(faiss::METRIC_INNER_PRODUCT, 5, 200);
+}
+
+TEST(IndexFlatInt8, selector) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatInt8 index(d);
+    index.add(nb, xb.data());
+
+    faiss::IDSelectorRange sel(100, 200);
+    faiss::SearchParameters params;
+    params.sel = &sel;
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_TRUE(I[i] >= 100 && I[i] < 200);
+    }
+}
+
+TEST(IndexFlatInt8, range_search) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatInt8 index(d);
+    index.add(nb, xb.data());
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    // the k-th distance as radius gives about k results per query
+    faiss::RangeSearchResult res(nq);
+    float radius = D[k - 1] + 1e-3;
+    index.range_search(1, xq.data(), radius, &res);
+    EXPECT_GE(res.lims[1], k - 1);
+    for (size_t i = 0; i < res.lims[1]; i++) {
+        EXPECT_LT(res.distances[i], radius);
+        EXPECT_NEAR(
+                res.distances[i],
+                faiss::fvec_L2sqr_int8(
+                        xq.data(),
+                        index.codes.data() + res.labels[i] * index.code_size,
+                        d),
+                tolerance(faiss::METRIC_L2));
+    }
+}
+
+TEST(IndexFlatInt8, factory_and_io) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "Flatint8", faiss::METRIC_INNER_PRODUCT));
+    ASSERT_NE(dynamic_cast<faiss::IndexFlatInt8*>(index.get()), nullptr);
+    index->add(nb, xb.data());
+
+    Tempfilename tmp;
+    faiss::write_index(index.get(), tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    EXPECT_EQ(index2->metric_type, faiss::METRIC_INNER_PRODUCT);
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I2(nq * k);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+}
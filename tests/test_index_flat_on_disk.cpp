@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatOnDisk.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const size_t d = 32, nb = 3000, nq = 20;
+
+} // namespace
+
+TEST(IndexFlatOnDisk, search_and_reconstruct) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        Tempfilename tmp;
+        // a header before the vectors
+        faiss::IndexFlatOnDisk index(d, tmp.c_str(), metric, 100, true);
+        index.search_block_size = 700;
+        index.add(nb / 2, xb.data());
+        index.add(nb - nb / 2, xb.data() + nb / 2 * d);
+        EXPECT_EQ(index.ntotal, nb);
+
+        faiss::IndexFlat ref(d, metric);
+        ref.add(nb, xb.data());
+
+        size_t k = 10;
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+        EXPECT_EQ(I, Iref);
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_NEAR(D[i], Dref[i], 1e-4);
+        }
+
+        // cached and uncached vectors
+        index.cache_vectors({5, 17, 2999});
+        std::vector<faiss::idx_t> keys = {17, 4, 2999, 0, 5};
+        std::vector<float> recons(keys.size() * d);
+        index.reconstruct_batch(keys.size(), keys.data(), recons.data());
+        for (size_t i = 0; i < keys.size(); i++) {
+            for (size_t j = 0; j < d; j++) {
+                EXPECT_EQ(recons[i * d + j], xb[keys[i] * d + j]);
+            }
+        }
+
+        std::unique_ptr<faiss::DistanceComputer> dc(
+                index.get_distance_computer());
+        dc->set_query(xq.data());
+        std::vector<float> dis(keys.size());
+        dc->distances_batch(keys, dis);
+        // 5, 17 and 2999 are cached
+        EXPECT_EQ(dc->get_fetch_count(), 2);
+        std::unique_ptr<faiss::DistanceComputer> dcref(
+                ref.get_distance_computer());
+        dcref->set_query(xq.data());
+        for (size_t i = 0; i < keys.size(); i++) {
+            EXPECT_NEAR(dis[i], (*dcref)(keys[i]), 1e-4);
+        }
+
+        // re-open the same file
+        faiss::IndexFlatOnDisk index2(d, tmp.c_str(), metric, 100);
+        EXPECT_EQ(index2.ntotal, nb);
+    }
+}
+
+TEST(IndexFlatOnDisk, refine) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1234);
+    faiss::float_rand(xq.data(), xq.size(), 4567);
+
+    Tempfilename tmp, tmp_index;
+    faiss::IndexPQ base(d, 4, 6);
+    base.train(nb, xb.data());
+    faiss::IndexRefine index(
+            &base, new faiss::IndexFlatOnDisk(d, tmp.c_str(), faiss::METRIC_L2));
+    index.own_refine_index = true;
+    index.k_factor = 8;
+    index.add(nb, xb.data());
+
+    faiss::IndexPQ base_ref(d, 4, 6);
+    base_ref.pq = base.pq;
+    base_ref.is_trained = true;
+    faiss::IndexRefineFlat index_ref(&base_ref);
+    index_ref.k_factor = 8;
+    index_ref.add(nb, xb.data());
+
+    size_t k = 5;
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index_ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(I, Iref);
+
+    // only the configuration of the refine index is serialized
+    auto refine = dynamic_cast<faiss::IndexFlatOnDisk*>(index.refine_index);
+    refine->cache_vectors({1, 2, 3});
+    faiss::write_index(&index, tmp_index.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp_index.c_str()));
+    auto index2_rf = dynamic_cast<faiss::IndexRefine*>(index2.get());
+    ASSERT_TRUE(index2_rf);
+    auto refine2 =
+            dynamic_cast<faiss::IndexFlatOnDisk*>(index2_rf->refine_index);
+    ASSERT_TRUE(refine2);
+    EXPECT_EQ(refine2->filename, tmp.filename);
+    EXPECT_EQ(refine2->get_cached_ids(), refine->get_cached_ids());
+
+    std::vector<float> D2(nq * k);
+    std::vector<faiss::idx_t> I2(nq * k);
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I2, I);
+}
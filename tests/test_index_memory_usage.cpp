@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexResultCache.h>
+#include <faiss/index_memory_usage.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 2000;
+
+std::vector<float> make_data(size_t n, int seed) {
+    std::vector<float> x(n * d);
+    faiss::float_rand(x.data(), x.size(), seed);
+    return x;
+}
+
+} // namespace
+
+TEST(IndexMemoryUsage, flat) {
+    std::vector<float> xb = make_data(nb, 123);
+    faiss::IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+    faiss::IndexMemoryUsage usage = faiss::get_index_memory_usage(&index);
+    EXPECT_GE(usage.get("codes"), nb * d * sizeof(float));
+    EXPECT_EQ(usage.total(), usage.owned_bytes());
+    EXPECT_EQ(usage.evictable_bytes(), 0);
+
+    // a view on external memory is not owned
+    faiss::IndexFlatL2 view(d);
+    view.codes = faiss::MaybeOwnedVector<uint8_t>::create_view(
+            index.codes.data(), index.codes.size(), nullptr);
+    view.ntotal = nb;
+    usage = faiss::get_index_memory_usage(&view);
+    EXPECT_EQ(usage.total(), nb * d * sizeof(float));
+    EXPECT_EQ(usage.owned_bytes(), 0);
+}
+
+TEST(IndexMemoryUsage, ivfpq) {
+    std::vector<float> xb = make_data(nb, 123);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ index(&quantizer, d, 16, 8, 6);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.make_direct_map();
+    index.precompute_table();
+
+    faiss::IndexMemoryUsage usage = faiss::get_index_memory_usage(&index);
+    EXPECT_GE(usage.get("codes"), nb * 6);
+    EXPECT_GE(usage.get("ids"), nb * sizeof(faiss::idx_t));
+    EXPECT_EQ(usage.get("quantizer"), 16 * d * sizeof(float));
+    EXPECT_EQ(usage.get("quantizer.codes"), 16 * d * sizeof(float));
+    EXPECT_EQ(usage.get("pq"), d * 64 * sizeof(float));
+    EXPECT_EQ(usage.get("direct_map"), nb * sizeof(faiss::idx_t));
+    EXPECT_GT(usage.get("precomputed_table"), 0);
+    EXPECT_EQ(usage.get("cod"), 0);
+}
+
+TEST(IndexMemoryUsage, hnsw_idmap) {
+    std::vector<float> xb = make_data(nb, 123);
+    faiss::IndexHNSWFlat hnsw(d, 16);
+    faiss::IndexIDMap index(&hnsw);
+    std::vector<faiss::idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 10 * i;
+    }
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    faiss::IndexMemoryUsage usage = faiss::get_index_memory_usage(&index);
+    EXPECT_GE(usage.get("id_map"), nb * sizeof(faiss::idx_t));
+    EXPECT_GE(usage.get("index.graph.neighbors"), nb * 32 * sizeof(int));
+    EXPECT_GE(usage.get("index.storage.codes"), nb * d * sizeof(float));
+    EXPECT_EQ(
+            usage.get("index"),
+            faiss::get_index_memory_usage(&hnsw).total());
+}
+
+TEST(IndexMemoryUsage, budget) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(100, 456);
+    faiss::IndexFlatL2 flat(d);
+    flat.add(nb, xb.data());
+    faiss::IndexResultCache index(&flat, 0.01);
+    index.cache_k = 10;
+
+    size_t k = 10;
+    std::vector<float> D(100 * k);
+    std::vector<faiss::idx_t> I(100 * k);
+    index.search(100, xq.data(), k, D.data(), I.data());
+    ASSERT_EQ(index.cache_size(), 100);
+
+    faiss::IndexMemoryUsage usage = faiss::get_index_memory_usage(&index);
+    size_t cache_nbytes = usage.evictable_bytes();
+    EXPECT_GE(cache_nbytes, 100 * (d * sizeof(float) + k * 12));
+    EXPECT_EQ(usage.get("index"), flat.codes.size());
+
+    // within budget: nothing is released
+    EXPECT_EQ(faiss::enforce_memory_budget(&index, usage.owned_bytes()), 0);
+    EXPECT_EQ(index.cache_size(), 100);
+
+    EXPECT_EQ(faiss::enforce_memory_budget(&index, flat.codes.size()),
+              cache_nbytes);
+    EXPECT_EQ(index.cache_size(), 0);
+    EXPECT_EQ(faiss::get_index_memory_usage(&index).owned_bytes(),
+              flat.codes.size());
+}
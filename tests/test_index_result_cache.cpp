@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexResultCache.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 10000, nq = 40, k = 10, nlist = 64;
+
+struct ResultCacheTest : ::testing::Test {
+    std::vector<float> xb, xq, xq_noisy;
+    faiss::IndexFlatL2 quantizer{d};
+    faiss::IndexIVFFlat ivf{&quantizer, d, nlist};
+    faiss::IndexFlatL2 flat{d};
+
+    void SetUp() override {
+        xb.resize(nb * d);
+        xq.resize(nq * d);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        // near-duplicates of the queries
+        std::vector<float> noise(nq * d);
+        faiss::float_randn(noise.data(), noise.size(), 789);
+        xq_noisy = xq;
+        for (size_t i = 0; i < xq.size(); i++) {
+            xq_noisy[i] += 0.001 * noise[i];
+        }
+        ivf.train(nb, xb.data());
+        ivf.add(nb, xb.data());
+        ivf.nprobe = 16;
+        flat.add(nb, xb.data());
+    }
+};
+
+} // namespace
+
+TEST_F(ResultCacheTest, hits_and_rerank) {
+    faiss::IndexResultCache cache(&ivf, 0.01);
+    cache.cache_k = 50;
+    cache.rerank_index = &flat;
+    cache.verify_fraction = 1;
+
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+
+    // first pass: all misses, the results of the index
+    ivf.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    cache.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(cache.n_hits, 0);
+    EXPECT_EQ(cache.cache_size(), nq);
+
+    // near-duplicates: all hits, re-ranked against the new queries
+    ivf.search(nq, xq_noisy.data(), k, Dref.data(), Iref.data());
+    cache.search(nq, xq_noisy.data(), k, D.data(), I.data());
+    EXPECT_EQ(cache.n_hits, nq);
+    EXPECT_EQ(cache.hit_rate(), 0.5);
+    EXPECT_EQ(cache.n_verified, nq);
+    EXPECT_GT(cache.verified_recall(), 0.95);
+    size_t nok = 0;
+    for (size_t i = 0; i < nq * k; i++) {
+        nok += Iref[i] == I[i];
+    }
+    EXPECT_GT(nok, nq * k * 0.95);
+
+    // adding to the index invalidates the cache
+    cache.add(1, xb.data());
+    EXPECT_EQ(cache.cache_size(), 0);
+    EXPECT_EQ(cache.ntotal, nb + 1);
+}
+
+TEST_F(ResultCacheTest, capacity) {
+    faiss::IndexResultCache cache(&ivf, 0.01);
+    cache.cache_k = k;
+    cache.capacity = 20;
+    cache.cache_index_type = "HNSW16,Flat";
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    cache.search(nq, xq.data(), k, D.data(), I.data());
+    // 2 generations of 10 queries: the last 20 queries are kept
+    EXPECT_EQ(cache.cache_size(), 20);
+    cache.search(20, xq.data() + 20 * d, k, D.data(), I.data());
+    EXPECT_EQ(cache.n_hits, 20);
+    // without rerank_index, the cached results are returned
+    std::vector<float> Dref(20 * k);
+    std::vector<faiss::idx_t> Iref(20 * k);
+    ivf.search(20, xq.data() + 20 * d, k, Dref.data(), Iref.data());
+    EXPECT_EQ(std::vector<faiss::idx_t>(I.begin(), I.begin() + 20 * k), Iref);
+
+    cache.search(1, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(cache.n_hits, 20);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexSegmented.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nb = 5000, nq = 20, k = 10;
+
+void check_same_results(
+        const faiss::Index& ref,
+        const faiss::Index& index,
+        const std::vector<float>& xq) {
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_EQ(Iref[i], I[i]);
+        EXPECT_NEAR(Dref[i], D[i], 1e-4);
+    }
+}
+
+std::unique_ptr<faiss::Index> make_template(const std::vector<float>& xb) {
+    std::unique_ptr<faiss::Index> index(faiss::index_factory(d, "IVF16,Flat"));
+    index->train(nb, xb.data());
+    // exhaustive so that the results can be compared with a flat index
+    faiss::ivflib::extract_index_ivf(index.get())->nprobe = 16;
+    return index;
+}
+
+} // namespace
+
+TEST(IndexSegmented, seal_and_compact) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    auto tmpl = make_template(xb);
+    faiss::IndexSegmented index(tmpl.get(), 300, false);
+    index.max_sealed_segments = 3;
+    faiss::IndexFlatL2 ref(d);
+
+    for (size_t i0 = 0; i0 < nb; i0 += 700) {
+        size_t n = std::min(nb - i0, size_t(700));
+        index.add(n, xb.data() + i0 * d);
+        ref.add(n, xb.data() + i0 * d);
+        EXPECT_LE(index.nb_sealed_segments(), size_t(3));
+        EXPECT_EQ(index.nb_frozen_segments(), size_t(0));
+    }
+    EXPECT_EQ(index.ntotal, nb);
+    check_same_results(ref, index, xq);
+
+    index.flush();
+    EXPECT_EQ(index.ntotal, nb);
+    check_same_results(ref, index, xq);
+}
+
+TEST(IndexSegmented, remove_ids) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    auto tmpl = make_template(xb);
+    faiss::IndexSegmented index(tmpl.get(), 300, false);
+    index.max_sealed_segments = 3;
+    faiss::IndexFlatL2 ref_flat(d);
+    faiss::IndexIDMap ref(&ref_flat);
+
+    std::vector<faiss::idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 1000 + 3 * i;
+    }
+    size_t n1 = nb / 2;
+    index.add_with_ids(n1, xb.data(), ids.data());
+    ref.add_with_ids(n1, xb.data(), ids.data());
+
+    // removes from the mutable and the sealed segments
+    std::vector<faiss::idx_t> to_remove;
+    for (size_t i = 0; i < n1; i += 3) {
+        to_remove.push_back(ids[i]);
+    }
+    faiss::IDSelectorBatch sel_batch(to_remove.size(), to_remove.data());
+    EXPECT_EQ(index.remove_ids(sel_batch), to_remove.size());
+    ref.remove_ids(sel_batch);
+    EXPECT_EQ(index.ntotal, ref.ntotal);
+    EXPECT_GT(index.nb_tombstones(), size_t(0));
+    check_same_results(ref, index, xq);
+
+    // compacting everything purges all the tombstones
+    index.max_sealed_segments = 1;
+    index.add_with_ids(nb - n1, xb.data() + n1 * d, ids.data() + n1);
+    ref.add_with_ids(nb - n1, xb.data() + n1 * d, ids.data() + n1);
+    index.flush();
+    EXPECT_EQ(index.ntotal, ref.ntotal);
+    EXPECT_EQ(index.nb_tombstones(), size_t(0));
+    check_same_results(ref, index, xq);
+}
+
+TEST(IndexSegmented, background) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    std::unique_ptr<faiss::Index> tmpl(faiss::index_factory(d, "Flat"));
+    faiss::IndexSegmented index(tmpl.get(), 200, true);
+    index.max_sealed_segments = 2;
+    faiss::IndexFlatL2 ref(d);
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    for (size_t i0 = 0; i0 < nb; i0 += 250) {
+        index.add(250, xb.data() + i0 * d);
+        ref.add(250, xb.data() + i0 * d);
+        // searches run concurrently with the sealing
+        index.search(nq, xq.data(), k, D.data(), I.data());
+    }
+    index.flush();
+    EXPECT_EQ(index.nb_frozen_segments(), size_t(0));
+    EXPECT_LE(index.nb_sealed_segments(), size_t(2));
+    check_same_results(ref, index, xq);
+}
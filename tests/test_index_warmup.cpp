@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nb = 4000, nq = 20, k = 10;
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+} // namespace
+
+TEST(IndexWarmup, ivf_mmap) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 4;
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    Tempfilename tmp;
+    faiss::write_index(&index, tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(tmp.c_str(), faiss::IO_FLAG_MMAP_IFC));
+
+    // by default only the quantizer is warmed
+    size_t quantizer_bytes = 32 * d * sizeof(float);
+    EXPECT_EQ(index2->warmup(), quantizer_bytes);
+
+    faiss::WarmupPolicy policy;
+    policy.all = true;
+    size_t list_bytes = nb * (d * sizeof(float) + sizeof(faiss::idx_t));
+    EXPECT_EQ(index2->warmup(policy), quantizer_bytes + list_bytes);
+
+    index2->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+}
+
+TEST(IndexWarmup, ivf_hot_lists) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    size_t entry_size = d * sizeof(float) + sizeof(faiss::idx_t);
+    size_t quantizer_bytes = 32 * d * sizeof(float);
+
+    // without access counts, the largest lists are warmed
+    size_t largest = 0;
+    for (size_t i = 0; i < index.nlist; i++) {
+        largest = std::max(largest, index.get_list_size(i));
+    }
+    faiss::WarmupPolicy policy;
+    policy.n_hot_lists = 1;
+    EXPECT_EQ(index.warmup(policy), quantizer_bytes + largest * entry_size);
+
+    // with access counts, the most accessed lists
+    index.invlists->enable_access_counts();
+    index.nprobe = 1;
+    std::vector<float> D(k);
+    std::vector<faiss::idx_t> I(k);
+    index.search(1, xq.data(), k, D.data(), I.data());
+    faiss::idx_t list_no;
+    quantizer.assign(1, xq.data(), &list_no);
+    ASSERT_EQ(index.invlists->access_counts[list_no], 1);
+    EXPECT_EQ(
+            index.warmup(policy),
+            quantizer_bytes + index.get_list_size(list_no) * entry_size);
+}
+
+TEST(IndexWarmup, hnsw_embedding_cache) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    EXPECT_GT(index.warmup(), 0);
+
+    faiss::IndexFlatL2 embeddings(d);
+    embeddings.add(nb, xb.data());
+    index.is_recompute = true;
+    index.embedding_provider =
+            std::make_shared<faiss::IndexEmbeddingProvider>(&embeddings);
+    faiss::ZmqEmbeddingCache cache(d, 1 << 20);
+    cache.admit_after = 3;
+
+    std::vector<faiss::idx_t> hot_ids = {5, 17, 1234, 3999};
+    faiss::WarmupPolicyHNSW policy;
+    policy.embedding_cache = &cache;
+    policy.hot_ids = hot_ids.data();
+    policy.n_hot_ids = hot_ids.size();
+    index.warmup(policy);
+
+    // the hot ids are cached despite the admission policy
+    EXPECT_EQ(cache.size(), hot_ids.size());
+    std::vector<float> x(d);
+    for (faiss::idx_t id : hot_ids) {
+        ASSERT_TRUE(cache.lookup(id, x.data()));
+        for (size_t j = 0; j < d; j++) {
+            EXPECT_EQ(x[j], xb[id * d + j]);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16;
+const int nb = 5000;
+const int nq = 20;
+const int k = 10;
+
+/// lists with a read latency that decreases with the list number, so that
+/// the lists complete in a different order than requested
+struct SlowInvertedLists : faiss::ReadOnlyInvertedLists {
+    const faiss::InvertedLists* il;
+    mutable std::atomic<int> n_get_codes{0}, n_release_codes{0};
+
+    explicit SlowInvertedLists(const faiss::InvertedLists* il)
+            : faiss::ReadOnlyInvertedLists(il->nlist, il->code_size),
+              il(il) {}
+
+    size_t list_size(size_t list_no) const override {
+        return il->list_size(list_no);
+    }
+
+    const uint8_t* get_codes(size_t list_no) const override {
+        std::this_thread::sleep_for(
+                std::chrono::microseconds(100 * (nlist - list_no)));
+        n_get_codes++;
+        return il->get_codes(list_no);
+    }
+
+    const faiss::idx_t* get_ids(size_t list_no) const override {
+        return il->get_ids(list_no);
+    }
+
+    void release_codes(size_t, const uint8_t*) const override {
+        n_release_codes++;
+    }
+};
+
+} // namespace
+
+TEST(InvertedListsFetcher, out_of_order) {
+    faiss::ArrayInvertedLists il(8, 4);
+    std::vector<uint8_t> code(4);
+    for (faiss::idx_t i = 0; i < 8; i++) {
+        il.add_entry(i, i, code.data());
+    }
+    SlowInvertedLists slow(&il);
+    slow.fetch_nthread = 8;
+    std::vector<faiss::idx_t> list_nos = {0, -1, 2, 4, 6, 7};
+    std::vector<size_t> ranks;
+    {
+        std::unique_ptr<faiss::InvertedListsFetcher> fetcher(
+                slow.fetch_lists(list_nos.data(), list_nos.size()));
+        faiss::FetchedList fl;
+        while (fetcher->next(fl)) {
+            EXPECT_EQ(fl.list_no, list_nos[fl.rank]);
+            EXPECT_EQ(fl.list_size, 1);
+            EXPECT_EQ(fl.ids[0], fl.list_no);
+            ranks.push_back(fl.rank);
+        }
+    }
+    std::sort(ranks.begin(), ranks.end());
+    EXPECT_EQ(ranks, std::vector<size_t>({0, 2, 3, 4, 5}));
+    EXPECT_EQ(slow.n_get_codes, 5);
+    EXPECT_EQ(slow.n_release_codes, 5);
+}
+
+TEST(InvertedListsFetcher, search) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 16);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 4;
+
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    SlowInvertedLists slow(index.invlists);
+    slow.use_fetcher = true;
+    faiss::InvertedLists* il0 = index.invlists;
+    index.invlists = &slow;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index.invlists = il0;
+    EXPECT_EQ(D, D_ref);
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(slow.n_get_codes, slow.n_release_codes);
+}
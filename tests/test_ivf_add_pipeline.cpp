@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/clone_index.h>
+#include <faiss/index_factory.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nt = 5000, nb = 10000, nq = 20, k = 10;
+
+// adds with chunks of 1000 and in one go, the inverted lists and the
+// search results must be the same
+void test_chunked_add(const char* factory_string) {
+    std::vector<float> xt(nt * d), xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nt, d, xt.data(), 123);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 456);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 789);
+
+    std::unique_ptr<faiss::Index> index_ref(
+            faiss::index_factory(d, factory_string));
+    index_ref->train(nt, xt.data());
+    std::unique_ptr<faiss::Index> index(faiss::clone_index(index_ref.get()));
+
+    auto ivf_ref = faiss::ivflib::extract_index_ivf(index_ref.get());
+    auto ivf = faiss::ivflib::extract_index_ivf(index.get());
+    ivf_ref->add_chunk_size = 0;
+    ivf->add_chunk_size = 1000;
+    ivf_ref->make_direct_map(true);
+    ivf->make_direct_map(true);
+
+    // 2 adds to check the numbering of the second batch
+    index_ref->add(nb / 2, xb.data());
+    index_ref->add(nb / 2, xb.data() + nb / 2 * d);
+    index->add(nb / 2, xb.data());
+    index->add(nb / 2, xb.data() + nb / 2 * d);
+    ASSERT_EQ(index->ntotal, nb);
+
+    for (size_t l = 0; l < ivf->nlist; l++) {
+        size_t ls = ivf->invlists->list_size(l);
+        ASSERT_EQ(ls, ivf_ref->invlists->list_size(l));
+        faiss::InvertedLists::ScopedIds ids(ivf->invlists, l);
+        faiss::InvertedLists::ScopedIds ids_ref(ivf_ref->invlists, l);
+        for (size_t j = 0; j < ls; j++) {
+            ASSERT_EQ(ids[j], ids_ref[j]);
+        }
+        faiss::InvertedLists::ScopedCodes codes(ivf->invlists, l);
+        faiss::InvertedLists::ScopedCodes codes_ref(ivf_ref->invlists, l);
+        // the block lists of fast-scan have no fixed code size
+        size_t code_size = ivf->invlists->code_size;
+        if (code_size != faiss::InvertedLists::INVALID_CODE_SIZE) {
+            ASSERT_EQ(memcmp(codes.get(), codes_ref.get(), ls * code_size), 0);
+        }
+    }
+
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    index_ref->search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+
+    // the direct map is filled by all the chunks
+    std::vector<float> recons(d), recons_ref(d);
+    for (faiss::idx_t i = 0; i < nb; i += 997) {
+        index->reconstruct(i, recons.data());
+        index_ref->reconstruct(i, recons_ref.data());
+        EXPECT_EQ(recons, recons_ref);
+    }
+}
+
+} // namespace
+
+TEST(IVFAddPipeline, IVFFlat) {
+    test_chunked_add("IVF32,Flat");
+}
+
+TEST(IVFAddPipeline, IVFPQ) {
+    test_chunked_add("IVF32,PQ8x4");
+}
+
+TEST(IVFAddPipeline, IVFSQ) {
+    test_chunked_add("IVF32,SQ8");
+}
+
+TEST(IVFAddPipeline, IVFPQFastScan) {
+    test_chunked_add("IVF32,PQ16x4fs");
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQFastScan.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 10000, nq = 20, k = 10, na = 5;
+
+std::vector<int32_t> make_attributes(int n) {
+    std::vector<int32_t> attributes(n);
+    for (int i = 0; i < n; i++) {
+        attributes[i] = (i * 7 + i / 3) % na;
+    }
+    return attributes;
+}
+
+// adds xb in 2 batches, with ids 100 + i
+void add_2_batches(
+        faiss::IndexIVF& index,
+        const std::vector<float>& xb,
+        const std::vector<int32_t>& attributes) {
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = 100 + i;
+    }
+    index.invlists->enable_attribute_ranges(na);
+    index.add_with_attributes(
+            nb / 3, xb.data(), attributes.data(), ids.data());
+    index.add_with_attributes(
+            nb - nb / 3,
+            xb.data() + nb / 3 * d,
+            attributes.data() + nb / 3,
+            ids.data() + nb / 3);
+}
+
+} // namespace
+
+TEST(IVFAttributes, sorted_lists) {
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    std::vector<int32_t> attributes = make_attributes(nb);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 16);
+    index.train(nb, xb.data());
+    add_2_batches(index, xb, attributes);
+    EXPECT_EQ(index.ntotal, nb);
+
+    const faiss::InvertedLists* il = index.invlists;
+    size_t total = 0;
+    for (size_t l = 0; l < il->nlist; l++) {
+        ASSERT_TRUE(il->has_attribute_ranges(l));
+        const std::vector<size_t>& ofs = il->attribute_offsets[l];
+        const faiss::idx_t* ids = il->get_ids(l);
+        const float* codes = (const float*)il->get_codes(l);
+        for (int a = 0; a < na; a++) {
+            for (size_t j = ofs[a]; j < ofs[a + 1]; j++) {
+                faiss::idx_t i = ids[j] - 100;
+                ASSERT_EQ(attributes[i], a);
+                // the codes follow the ids
+                EXPECT_EQ(codes[j * d], xb[i * d]);
+                // the order of addition is kept within a range
+                if (j > ofs[a]) {
+                    EXPECT_LT(ids[j - 1], ids[j]);
+                }
+            }
+        }
+        total += il->list_size(l);
+    }
+    EXPECT_EQ(total, nb);
+}
+
+TEST(IVFAttributes, filtered_search) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    std::vector<int32_t> attributes = make_attributes(nb);
+
+    for (const char* factory : {"IVF16,Flat", "IVF16,PQ4x4", "IVF16,SQ8"}) {
+        std::unique_ptr<faiss::IndexIVF> index(dynamic_cast<faiss::IndexIVF*>(
+                faiss::index_factory(d, factory)));
+        index->train(nb, xb.data());
+        add_2_batches(*index, xb, attributes);
+
+        for (int a = 0; a < na; a++) {
+            std::vector<faiss::idx_t> sel_ids;
+            for (int i = 0; i < nb; i++) {
+                if (attributes[i] == a) {
+                    sel_ids.push_back(100 + i);
+                }
+            }
+            faiss::IDSelectorBatch sel(sel_ids.size(), sel_ids.data());
+            faiss::SearchParametersIVF params;
+            params.nprobe = 4;
+            params.sel = &sel;
+            std::vector<float> D_ref(k * nq), D(k * nq);
+            std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+            faiss::indexIVF_stats.reset();
+            index->search(
+                    nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+            size_t ndis_ref = faiss::indexIVF_stats.ndis;
+
+            params.sel = nullptr;
+            params.attribute = a;
+            faiss::indexIVF_stats.reset();
+            index->search(nq, xq.data(), k, D.data(), I.data(), &params);
+            // only the range of the attribute is scanned
+            EXPECT_LT(faiss::indexIVF_stats.ndis, ndis_ref / 2);
+            EXPECT_EQ(I, I_ref) << factory;
+            EXPECT_EQ(D, D_ref) << factory;
+        }
+    }
+}
+
+TEST(IVFAttributes, fast_scan) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    std::vector<int32_t> attributes = make_attributes(nb);
+
+    // the blocks of codes are rewritten with the code packer
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQFastScan index(&quantizer, d, 16, 8, 4);
+    index.train(nb, xb.data());
+    std::unique_ptr<faiss::Index> ref(faiss::clone_index(&index));
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = 100 + i;
+    }
+    ref->add_with_ids(nb, xb.data(), ids.data());
+    add_2_batches(index, xb, attributes);
+
+    faiss::SearchParametersIVF params;
+    params.nprobe = 4;
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    ref->search(nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(D, D_ref);
+
+    params.attribute = 1;
+    EXPECT_THROW(
+            index.search(nq, xq.data(), k, D.data(), I.data(), &params),
+            faiss::FaissException);
+}
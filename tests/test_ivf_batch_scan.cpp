@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const int nb = 10000;
+const int nq = 200;
+const int k = 10;
+
+/// search with parallel_mode 6 and compare with parallel_mode 0
+void check_batch_scan(
+        faiss::IndexIVF& index,
+        const faiss::SearchParametersIVF* params = nullptr) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 4;
+
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    index.parallel_mode = 0;
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data(), params);
+    index.parallel_mode = 6;
+    index.search(nq, xq.data(), k, D.data(), I.data(), params);
+
+    size_t n_diff = 0;
+    for (int i = 0; i < k * nq; i++) {
+        n_diff += I[i] != I_ref[i];
+        EXPECT_NEAR(D[i], D_ref[i], 1e-4 * (1 + std::abs(D_ref[i])));
+    }
+    // allow for ties and rounding of the GEMM distances
+    EXPECT_LE(n_diff, k * nq / 100);
+}
+
+} // namespace
+
+TEST(IVFBatchScan, flat_L2) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    check_batch_scan(index);
+}
+
+TEST(IVFBatchScan, flat_IP) {
+    faiss::IndexFlatIP quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32, faiss::METRIC_INNER_PRODUCT);
+    check_batch_scan(index);
+}
+
+TEST(IVFBatchScan, flat_selector) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    faiss::IDSelectorRange sel(1000, 6000);
+    faiss::SearchParametersIVF params;
+    params.sel = &sel;
+    params.nprobe = 4;
+    check_batch_scan(index, &params);
+}
+
+TEST(IVFBatchScan, pq) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ index(&quantizer, d, 32, 8, 6);
+    check_batch_scan(index);
+}
+
+TEST(IVFBatchScan, sq) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFScalarQuantizer index(
+            &quantizer, d, 32, faiss::ScalarQuantizer::QT_8bit);
+    check_batch_scan(index);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFPQFastScan.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const int nb = 5000;
+const int nq = 50;
+const int k = 10;
+
+/// the results may differ on the ties, compare the results that are
+/// strictly closer than the k-th one
+void compare_results(
+        const std::vector<float>& D_ref,
+        const std::vector<faiss::idx_t>& I_ref,
+        const std::vector<float>& D,
+        const std::vector<faiss::idx_t>& I) {
+    ASSERT_EQ(D, D_ref);
+    for (int q = 0; q < nq; q++) {
+        std::set<faiss::idx_t> s_ref, s;
+        for (int j = 0; j < k; j++) {
+            if (D_ref[q * k + j] < D_ref[q * k + k - 1]) {
+                s_ref.insert(I_ref[q * k + j]);
+                s.insert(I[q * k + j]);
+            }
+        }
+        EXPECT_EQ(s, s_ref);
+    }
+}
+
+} // namespace
+
+TEST(IVFFastScanLazyIds, search) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQFastScan index(&quantizer, d, 32, 8, 4);
+    index.nprobe = 8;
+    index.train(nb, xb.data());
+    // ids that are not the sequence numbers
+    std::vector<faiss::idx_t> ids(nb);
+    for (int i = 0; i < nb; i++) {
+        ids[i] = 7 * i + 3;
+    }
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    for (int implem : {0, 10, 11, 12, 13, 14, 15, 110, 112}) {
+        index.implem = implem;
+        std::vector<float> D_ref(k * nq), D(k * nq);
+        std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+        index.lazy_ids = false;
+        index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+        index.lazy_ids = true;
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        SCOPED_TRACE(implem);
+        compare_results(D_ref, I_ref, D, I);
+    }
+}
+
+TEST(IVFFastScanLazyIds, selector) {
+    // the selector disables the lazy ids
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQFastScan index(&quantizer, d, 32, 8, 4);
+    index.nprobe = 8;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.lazy_ids = true;
+
+    faiss::IDSelectorRange sel(0, nb / 2);
+    faiss::IVFSearchParameters params;
+    params.nprobe = 8;
+    params.sel = &sel;
+    std::vector<float> D(k * nq);
+    std::vector<faiss::idx_t> I(k * nq);
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    for (faiss::idx_t id : I) {
+        EXPECT_TRUE(id >= -1 && id < nb / 2);
+    }
+}
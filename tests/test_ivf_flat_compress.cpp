@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nlist = 64, nb = 20000, nq = 100, k = 10;
+
+/// fraction of the k results of the IVFFlat that the compressed index finds
+double compressed_recall(
+        faiss::ScalarQuantizer::QuantizerType qtype,
+        faiss::MetricType metric) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+
+    faiss::IndexFlat quantizer(d, metric);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist, metric);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 8;
+    index.set_direct_map_type(faiss::DirectMap::Array);
+
+    std::unique_ptr<faiss::IndexIVFScalarQuantizer> index_sq(
+            faiss::ivflib::ivf_flat_to_scalar_quantizer(&index, qtype));
+    EXPECT_EQ(index_sq->ntotal, nb);
+    EXPECT_EQ(index_sq->nprobe, 8);
+    for (int l = 0; l < nlist; l++) {
+        EXPECT_EQ(
+                index_sq->invlists->list_size(l),
+                index.invlists->list_size(l));
+    }
+
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    index_sq->search(nq, xq.data(), k, D.data(), I.data());
+
+    size_t n_ok = 0;
+    for (int q = 0; q < nq; q++) {
+        std::unordered_set<faiss::idx_t> ref(
+                I_ref.begin() + q * k, I_ref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_ok += ref.count(I[q * k + j]);
+        }
+    }
+
+    // the direct map is rebuilt, the reconstruction is close
+    std::vector<float> recons(d);
+    for (int i = 0; i < nb; i += 1001) {
+        index_sq->reconstruct(i, recons.data());
+        for (int j = 0; j < d; j++) {
+            EXPECT_NEAR(recons[j], xb[i * d + j], 0.05);
+        }
+    }
+    return n_ok / double(nq * k);
+}
+
+} // namespace
+
+TEST(IVFFlatCompress, fp16_residual) {
+    EXPECT_GT(
+            compressed_recall(
+                    faiss::ScalarQuantizer::QT_fp16, faiss::METRIC_L2),
+            0.99);
+}
+
+TEST(IVFFlatCompress, bf16_residual) {
+    EXPECT_GT(
+            compressed_recall(
+                    faiss::ScalarQuantizer::QT_bf16, faiss::METRIC_L2),
+            0.97);
+}
+
+TEST(IVFFlatCompress, fp16_residual_IP) {
+    EXPECT_GT(
+            compressed_recall(
+                    faiss::ScalarQuantizer::QT_fp16,
+                    faiss::METRIC_INNER_PRODUCT),
+            0.99);
+}
+
+// trained on a sample of the stored vectors
+TEST(IVFFlatCompress, 8bit_residual) {
+    EXPECT_GT(
+            compressed_recall(
+                    faiss::ScalarQuantizer::QT_8bit, faiss::METRIC_L2),
+            0.9);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/utils.h>
+
+namespace {
+
+const int d = 16;
+const int nb = 10000;
+const int nq = 50;
+const int k = 10;
+
+} // namespace
+
+TEST(IVFNuma, placement) {
+    EXPECT_GE(faiss::get_numa_node_count(), 1);
+
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    auto ails = dynamic_cast<faiss::ArrayInvertedLists*>(index.invlists);
+    ASSERT_NE(ails, nullptr);
+    std::vector<std::vector<faiss::idx_t>> ids_ref(index.nlist);
+    for (size_t l = 0; l < index.nlist; l++) {
+        ids_ref[l].assign(
+                ails->get_ids(l), ails->get_ids(l) + ails->list_size(l));
+    }
+
+    ails->place_on_numa_nodes(2);
+    ASSERT_EQ(ails->list_node.size(), index.nlist);
+    for (size_t l = 0; l < index.nlist; l++) {
+        EXPECT_GE(ails->list_node[l], 0);
+        EXPECT_LT(ails->list_node[l], ails->numa_n_nodes);
+        EXPECT_EQ(
+                std::vector<faiss::idx_t>(
+                        ails->get_ids(l),
+                        ails->get_ids(l) + ails->list_size(l)),
+                ids_ref[l]);
+    }
+}
+
+TEST(IVFNuma, search) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.nprobe = 8;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    index.parallel_mode = 4;
+    // the lists must be placed first
+    EXPECT_THROW(
+            index.search(nq, xq.data(), k, D.data(), I.data()),
+            faiss::FaissException);
+
+    auto ails = dynamic_cast<faiss::ArrayInvertedLists*>(index.invlists);
+    ASSERT_NE(ails, nullptr);
+    ails->place_on_numa_nodes(2);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nt = 5000, nlist = 32;
+
+size_t max_list_size(const faiss::IndexIVF* index) {
+    size_t m = 0;
+    for (size_t l = 0; l < index->nlist; l++) {
+        m = std::max(m, index->invlists->list_size(l));
+    }
+    return m;
+}
+
+/// training data uniform in [0, 1]^d, most of the database drifted to a
+/// corner, so that the other lists become tiny
+void make_drifted_data(std::vector<float>& xt, std::vector<float>& xb) {
+    xt.resize(nt * d);
+    faiss::float_rand(xt.data(), xt.size(), 123);
+    size_t nb = 10000;
+    xb.resize(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 456);
+    for (size_t i = nb / 10; i < nb; i++) {
+        for (size_t j = 0; j < d; j++) {
+            xb[i * d + j] *= 0.1;
+        }
+    }
+}
+
+void test_rebalance(const char* factory_string) {
+    std::vector<float> xt, xb;
+    make_drifted_data(xt, xb);
+    size_t nb = xb.size() / d;
+
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, factory_string));
+    index->train(nt, xt.data());
+    faiss::IndexIVF* index_ivf = faiss::ivflib::extract_index_ivf(index.get());
+    index_ivf->set_direct_map_type(faiss::DirectMap::Hashtable);
+    index->add(nb, xb.data());
+
+    size_t max_before = max_list_size(index_ivf);
+    faiss::ivflib::RebalanceListsParameters params;
+    params.max_list_size_factor = 2;
+    faiss::ivflib::RebalanceListsStats stats;
+    for (int iter = 0; iter < 3; iter++) {
+        faiss::ivflib::RebalanceListsStats s =
+                faiss::ivflib::rebalance_lists(index.get(), params);
+        stats.nsplit += s.nsplit;
+        stats.nmoved += s.nmoved;
+    }
+    EXPECT_GT(stats.nsplit, 0);
+    EXPECT_GT(stats.nmoved, 0);
+    EXPECT_LT(max_list_size(index_ivf), max_before);
+
+    // same nb of vectors and lists
+    EXPECT_EQ(index->ntotal, nb);
+    EXPECT_EQ(index_ivf->quantizer->ntotal, nlist);
+    EXPECT_EQ(index_ivf->invlists->compute_ntotal(), nb);
+
+    // direct map and assignment are consistent
+    std::vector<faiss::idx_t> list_nos(nb);
+    index_ivf->quantizer->assign(nb, xb.data(), list_nos.data());
+    size_t nok = 0;
+    std::vector<float> recons(d);
+    for (faiss::idx_t i = 0; i < nb; i++) {
+        faiss::idx_t lo = index_ivf->direct_map.get(i);
+        EXPECT_EQ(index_ivf->invlists->get_single_id(
+                          faiss::lo_listno(lo), faiss::lo_offset(lo)),
+                  i);
+        nok += faiss::lo_listno(lo) == list_nos[i];
+    }
+    // the vectors of untouched lists may not be in their nearest list
+    EXPECT_GT(nok, nb * 0.9);
+
+    // the database vectors find themselves
+    index_ivf->nprobe = 1;
+    size_t nq = 100;
+    std::vector<float> D(nq);
+    std::vector<faiss::idx_t> I(nq);
+    index->search(nq, xb.data() + (nb - nq) * d, 1, D.data(), I.data());
+    size_t nfound = 0;
+    for (size_t i = 0; i < nq; i++) {
+        nfound += I[i] == nb - nq + i;
+    }
+    EXPECT_GT(nfound, nq * 0.9);
+}
+
+} // namespace
+
+TEST(IVFRebalance, IVFFlat) {
+    test_rebalance("IVF32,Flat");
+}
+
+TEST(IVFRebalance, IVFSQ_residual) {
+    test_rebalance("IVF32,SQ8");
+}
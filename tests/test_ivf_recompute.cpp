@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFRecompute.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 4000;
+const size_t nq = 50;
+const int k = 10;
+
+/// the embeddings are computed in process from a flat index
+struct RecomputeFixture {
+    std::vector<float> xb, xq;
+    faiss::IndexFlat flat;
+
+    explicit RecomputeFixture(faiss::MetricType metric)
+            : xb(nb * d), xq(nq * d), flat(d, metric) {
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        flat.add(nb, xb.data());
+    }
+
+    void attach(faiss::IndexIVFRecompute& index) {
+        index.embedding_provider =
+                std::make_shared<faiss::IndexEmbeddingProvider>(&flat);
+    }
+
+    /// fraction of the exact k nearest neighbors found. The distances of
+    /// the recomputed results must be exact
+    double recall(
+            faiss::Index& index,
+            const faiss::SearchParameters* params = nullptr,
+            bool exact_distances = true) {
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+        flat.search(nq, xq.data(), k, Dref.data(), Iref.data());
+        index.search(nq, xq.data(), k, D.data(), I.data(), params);
+        size_t nfound = 0;
+        for (size_t q = 0; q < nq; q++) {
+            std::set<faiss::idx_t> gt(
+                    Iref.begin() + q * k, Iref.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                nfound += gt.count(I[q * k + j]);
+            }
+            // the distances are the exact ones
+            if (exact_distances && I[q * k] == Iref[q * k]) {
+                EXPECT_NEAR(D[q * k], Dref[q * k], 1e-4);
+            }
+        }
+        return double(nfound) / (nq * k);
+    }
+};
+
+} // namespace
+
+TEST(IVFRecompute, id_only) {
+    for (faiss::MetricType metric :
+         {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        RecomputeFixture fx(metric);
+        faiss::IndexFlat quantizer(d, metric);
+        faiss::IndexIVFIDOnly ivf(&quantizer, d, 16, metric);
+        faiss::IndexIVFRecompute index(&ivf);
+        fx.attach(index);
+        index.train(nb, fx.xb.data());
+        index.add(nb, fx.xb.data());
+        EXPECT_EQ(ivf.code_size, 0);
+        EXPECT_EQ(index.ntotal, nb);
+
+        // all the lists are re-ranked: exact search
+        ivf.nprobe = 16;
+        EXPECT_EQ(fx.recall(index), 1.0);
+
+        faiss::IVFSearchParameters ivf_params;
+        ivf_params.nprobe = 4;
+        faiss::IndexRefineSearchParameters params;
+        params.base_index_params = &ivf_params;
+        double r4 = fx.recall(index, &params);
+
+        // same lists and exact distances: same results as an IndexIVFFlat
+        faiss::IndexIVFFlat ivfflat(&quantizer, d, 16, metric);
+        ivfflat.add(nb, fx.xb.data());
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+        ivfflat.search(
+                nq, fx.xq.data(), k, Dref.data(), Iref.data(), &ivf_params);
+        index.search(nq, fx.xq.data(), k, D.data(), I.data(), &params);
+        EXPECT_EQ(I, Iref);
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_NEAR(D[i], Dref[i], 1e-4);
+        }
+
+        // fewer candidates from the same lists
+        index.max_rerank = 200;
+        EXPECT_LE(fx.recall(index, &params), r4);
+
+        // the IVF cannot be searched by itself
+        EXPECT_THROW(
+                ivf.search(1, fx.xq.data(), k, D.data(), I.data()),
+                faiss::FaissException);
+    }
+}
+
+TEST(IVFRecompute, small_codes) {
+    RecomputeFixture fx(faiss::METRIC_L2);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ ivfpq(&quantizer, d, 16, 8, 4);
+    faiss::IndexIVFRecompute index(&ivfpq);
+    fx.attach(index);
+    index.train(nb, fx.xb.data());
+    index.add(nb, fx.xb.data());
+    ivfpq.nprobe = 16;
+
+    // the 4-byte codes alone are poor, re-ranking fixes most of it
+    double r_codes = fx.recall(ivfpq, nullptr, false);
+    index.k_factor = 20;
+    double r_rerank = fx.recall(index);
+    EXPECT_GT(r_rerank, r_codes);
+    EXPECT_GT(r_rerank, 0.9);
+}
+
+TEST(IVFRecompute, io) {
+    RecomputeFixture fx(faiss::METRIC_L2);
+    auto quantizer = new faiss::IndexFlatL2(d);
+    auto ivf = new faiss::IndexIVFIDOnly(quantizer, d, 16);
+    ivf->own_fields = true;
+    faiss::IndexIVFRecompute index(ivf);
+    index.own_fields = true;
+    fx.attach(index);
+    index.train(nb, fx.xb.data());
+    index.add(nb, fx.xb.data());
+    ivf->nprobe = 4;
+    index.max_rerank = 500;
+
+    faiss::VectorIOWriter writer;
+    faiss::write_index(&index, &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(&reader));
+    auto rc2 = dynamic_cast<faiss::IndexIVFRecompute*>(index2.get());
+    ASSERT_TRUE(rc2);
+    EXPECT_EQ(rc2->max_rerank, 500);
+    ASSERT_TRUE(dynamic_cast<faiss::IndexIVFIDOnly*>(rc2->base_index));
+    fx.attach(*rc2);
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I2(nq * k);
+    index.search(nq, fx.xq.data(), k, D.data(), I.data());
+    index2->search(nq, fx.xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+}
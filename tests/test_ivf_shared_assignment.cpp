@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 5000, nq = 50, k = 10, nlist = 32;
+
+} // namespace
+
+TEST(IVFSharedAssignment, same_as_search) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index1(&quantizer, d, nlist);
+    index1.train(nb, xb.data());
+    faiss::IndexIVFPQ index2(&quantizer, d, nlist, 8, 8);
+    index2.train(nb, xb.data());
+    index1.add(nb, xb.data());
+    index2.add(nb / 2, xb.data());
+    index1.nprobe = 4;
+    index2.nprobe = 2;
+
+    std::vector<float> Dref(2 * nq * k), D(2 * nq * k);
+    std::vector<faiss::idx_t> Iref(2 * nq * k), I(2 * nq * k);
+    index1.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index2.search(
+            nq, xq.data(), k, Dref.data() + nq * k, Iref.data() + nq * k);
+
+    const faiss::IndexIVF* indexes[2] = {&index1, &index2};
+    faiss::ivflib::search_preassigned_multi(
+            2, indexes, nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    // the coarse distances of the whole batch are computed with BLAS
+    for (size_t i = 0; i < 2 * nq * k; i++) {
+        EXPECT_NEAR(Dref[i], D[i], 1e-4);
+    }
+
+    // repeated queries are served from the cache
+    faiss::ivflib::CoarseAssignmentCache cache(&quantizer, 100);
+    for (int rep = 0; rep < 2; rep++) {
+        std::fill(I.begin(), I.end(), -1);
+        faiss::ivflib::search_preassigned_multi(
+                2,
+                indexes,
+                nq,
+                xq.data(),
+                k,
+                D.data(),
+                I.data(),
+                nullptr,
+                &cache);
+        EXPECT_EQ(Iref, I);
+    }
+    EXPECT_EQ(cache.n_misses, nq);
+    EXPECT_EQ(cache.n_hits, nq);
+    EXPECT_EQ(cache.size(), nq);
+
+    // a smaller nprobe reuses the entries
+    std::vector<float> Dq(nq * 2);
+    std::vector<faiss::idx_t> Iq(nq * 2), Iqref(nq * 2);
+    quantizer.search(nq, xq.data(), 2, Dq.data(), Iqref.data());
+    cache.assign(nq, xq.data(), 2, Dq.data(), Iq.data());
+    EXPECT_EQ(Iqref, Iq);
+    EXPECT_EQ(cache.n_hits, 2 * nq);
+}
+
+TEST(IVFSharedAssignment, lru_eviction) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 789);
+    faiss::IndexFlatL2 quantizer(d);
+    quantizer.add(nlist, xb.data());
+
+    faiss::ivflib::CoarseAssignmentCache cache(&quantizer, 10);
+    std::vector<float> Dq(nq * 3), Dqref(nq * 3);
+    std::vector<faiss::idx_t> Iq(nq * 3), Iqref(nq * 3);
+    quantizer.search(nq, xq.data(), 3, Dqref.data(), Iqref.data());
+    cache.assign(nq, xq.data(), 3, Dq.data(), Iq.data());
+    EXPECT_EQ(Iqref, Iq);
+    EXPECT_EQ(cache.size(), 10);
+
+    // only the last 10 queries are still cached
+    cache.assign(10, xq.data() + (nq - 10) * d, 3, Dq.data(), Iq.data());
+    EXPECT_EQ(cache.n_hits, 10);
+    cache.assign(1, xq.data(), 3, Dq.data(), Iq.data());
+    EXPECT_EQ(cache.n_hits, 10);
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+}
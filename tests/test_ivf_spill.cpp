@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nlist = 64, nt = 5000, nb = 10000, nq = 200, k = 10;
+
+struct SpillTest {
+    std::vector<float> xb, xq;
+    std::vector<faiss::idx_t> gt;
+    faiss::IndexFlatL2 quantizer;
+
+    SpillTest() : xb(nb * d), xq(nq * d), gt(nq * k), quantizer(d) {
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        faiss::IndexFlatL2 flat(d);
+        flat.add(nb, xb.data());
+        std::vector<float> D(nq * k);
+        flat.search(nq, xq.data(), k, D.data(), gt.data());
+    }
+
+    // 1-recall@k: fraction of the nearest neighbors found in the results
+    double recall(faiss::Index& index) {
+        std::vector<float> D(nq * k);
+        std::vector<faiss::idx_t> I(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        int nfound = 0;
+        for (int q = 0; q < nq; q++) {
+            std::set<faiss::idx_t> ids;
+            for (int j = 0; j < k; j++) {
+                if (I[q * k + j] >= 0) {
+                    EXPECT_TRUE(ids.insert(I[q * k + j]).second)
+                            << "duplicate result for query " << q;
+                }
+            }
+            nfound += ids.count(gt[q * k]);
+        }
+        return nfound / double(nq);
+    }
+};
+
+} // namespace
+
+TEST(IVFSpill, RecallAtLowNprobe) {
+    SpillTest t;
+    faiss::IndexIVFFlat ref(&t.quantizer, d, nlist);
+    ref.train(nt, t.xb.data());
+    ref.add(nb, t.xb.data());
+
+    faiss::IndexIVFFlat spilled(&t.quantizer, d, nlist);
+    spilled.is_trained = true;
+    spilled.n_spill = 1;
+    spilled.add(nb, t.xb.data());
+    EXPECT_EQ(spilled.ntotal, nb);
+    EXPECT_EQ(spilled.invlists->compute_ntotal(), 2 * nb);
+
+    for (int nprobe : {1, 2, 4}) {
+        ref.nprobe = spilled.nprobe = nprobe;
+        double r_ref = t.recall(ref);
+        double r_spilled = t.recall(spilled);
+        EXPECT_GT(r_spilled, r_ref) << "nprobe=" << nprobe;
+    }
+}
+
+TEST(IVFSpill, SecondaryLists) {
+    SpillTest t;
+    faiss::IndexIVFFlat index(&t.quantizer, d, nlist);
+    index.train(nt, t.xb.data());
+    index.n_spill = 2;
+
+    std::vector<faiss::idx_t> lists(nb * 3), primary(nb);
+    index.assign_spilled(nb, t.xb.data(), lists.data());
+    t.quantizer.assign(nb, t.xb.data(), primary.data());
+    for (int i = 0; i < nb; i++) {
+        EXPECT_EQ(lists[i * 3], primary[i]);
+        std::set<faiss::idx_t> s(
+                lists.begin() + i * 3, lists.begin() + i * 3 + 3);
+        EXPECT_EQ(s.size(), 3);
+        EXPECT_EQ(s.count(-1), 0);
+    }
+}
+
+TEST(IVFSpill, RangeSearchAndRemove) {
+    SpillTest t;
+    faiss::IndexIVFPQ index(&t.quantizer, d, nlist, 4, 6);
+    index.train(nt, t.xb.data());
+    index.n_spill = 1;
+    index.add(nb, t.xb.data());
+    index.nprobe = 8;
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index.search(nq, t.xq.data(), k, D.data(), I.data());
+    float radius = 0;
+    for (int q = 0; q < nq; q++) {
+        radius = std::max(radius, D[q * k + k - 1]);
+    }
+
+    faiss::RangeSearchResult res(nq);
+    index.range_search(nq, t.xq.data(), radius, &res);
+    for (int q = 0; q < nq; q++) {
+        std::set<faiss::idx_t> ids;
+        for (size_t j = res.lims[q]; j < res.lims[q + 1]; j++) {
+            EXPECT_TRUE(ids.insert(res.labels[j]).second);
+            EXPECT_LT(res.distances[j], radius);
+        }
+        // the knn results are all within the largest knn radius
+        for (int j = 0; j + 1 < k; j++) {
+            if (D[q * k + j] < radius) {
+                EXPECT_EQ(ids.count(I[q * k + j]), 1);
+            }
+        }
+    }
+
+    // removing an id removes all its copies
+    faiss::IDSelectorRange sel(0, nb / 2);
+    EXPECT_EQ(index.remove_ids(sel), nb / 2);
+    EXPECT_EQ(index.ntotal, nb - nb / 2);
+    EXPECT_EQ(index.invlists->compute_ntotal(), nb);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <omp.h>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16;
+const int nb = 20000;
+const int nq = 30;
+const int k = 10;
+
+struct SkewedIndex {
+    faiss::IndexFlatL2 quantizer;
+    faiss::IndexIVFFlat index;
+    std::vector<float> xq;
+
+    SkewedIndex() : quantizer(d), index(&quantizer, d, 32), xq(d * nq) {
+        // most vectors around a few points: the list sizes are skewed
+        std::vector<float> xb(d * nb);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        for (size_t i = 0; i < nb; i++) {
+            if (i % 10 != 0) {
+                for (int j = 0; j < d; j++) {
+                    xb[i * d + j] = xb[i * d + j] * 0.01 + (i % 3);
+                }
+            }
+        }
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        index.train(nb / 10, xb.data());
+        index.add(nb, xb.data());
+        index.nprobe = 8;
+    }
+
+    void check_same_results(const faiss::SearchParametersIVF* params) {
+        std::vector<float> D_ref(k * nq), D(k * nq);
+        std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+        index.parallel_mode = 0;
+        index.search(nq, xq.data(), k, D_ref.data(), I_ref.data(), params);
+        index.parallel_mode = 5;
+        index.search(nq, xq.data(), k, D.data(), I.data(), params);
+        EXPECT_EQ(D, D_ref);
+        EXPECT_EQ(I, I_ref);
+    }
+};
+
+} // namespace
+
+TEST(IVFWorkStealing, same_results) {
+    SkewedIndex si;
+    int nt = omp_get_max_threads();
+    for (int n_threads : {1, 3, 8}) {
+        omp_set_num_threads(n_threads);
+        si.check_same_results(nullptr);
+    }
+    omp_set_num_threads(nt);
+}
+
+TEST(IVFWorkStealing, sorted_range) {
+    // the IDSelectorRange bounds are found in each section of a list
+    SkewedIndex si;
+    faiss::IDSelectorRange sel(4000, 9000, true);
+    faiss::SearchParametersIVF params;
+    params.sel = &sel;
+    params.nprobe = 8;
+    int nt = omp_get_max_threads();
+    omp_set_num_threads(4);
+    si.check_same_results(&params);
+    omp_set_num_threads(nt);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16;
+const int nb = 20000;
+const int nq = 20;
+const int k = 10;
+
+/// zone maps recomputed from scratch
+std::vector<std::vector<faiss::idx_t>> fresh_zone_maps(
+        const faiss::InvertedLists& invlists) {
+    faiss::ArrayInvertedLists copy(invlists.nlist, invlists.code_size);
+    for (size_t i = 0; i < invlists.nlist; i++) {
+        copy.add_entries(
+                i,
+                invlists.list_size(i),
+                invlists.get_ids(i),
+                invlists.get_codes(i));
+    }
+    copy.enable_zone_maps(invlists.zone_map_block_size);
+    return copy.zone_maps;
+}
+
+} // namespace
+
+TEST(IVFZoneMaps, range_search) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 16);
+    index.train(nb, xb.data());
+    // ids in insertion order, as time stamps
+    index.add(nb, xb.data());
+
+    faiss::IDSelectorRange sel(5000, 6000);
+    faiss::SearchParametersIVF params;
+    params.sel = &sel;
+    params.nprobe = 4;
+    std::vector<float> D_ref(k * nq), D(k * nq);
+    std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data(), &params);
+    size_t ndis_ref = faiss::indexIVF_stats.ndis;
+
+    index.invlists->enable_zone_maps(64);
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    size_t ndis = faiss::indexIVF_stats.ndis;
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+    // the scanned blocks cover about 1000 / 20000 of the lists
+    EXPECT_LT(ndis * 5, ndis_ref);
+
+    // a range outside all the lists
+    faiss::IDSelectorRange sel_out(nb, 2 * nb);
+    params.sel = &sel_out;
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(faiss::indexIVF_stats.ndis, 0);
+    EXPECT_EQ(I[0], -1);
+}
+
+TEST(IVFZoneMaps, maintenance) {
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 8);
+    index.train(nb, xb.data());
+    index.add(nb / 2, xb.data());
+    faiss::InvertedLists& invlists = *index.invlists;
+    invlists.enable_zone_maps(100);
+
+    index.add(nb / 2, xb.data() + d * (nb / 2));
+    EXPECT_EQ(invlists.zone_maps, fresh_zone_maps(invlists));
+
+    // removals move the last entries of the lists and shrink them
+    faiss::IDSelectorRange sel_remove(3000, 12000);
+    index.remove_ids(sel_remove);
+    for (size_t i = 0; i < invlists.nlist; i++) {
+        EXPECT_TRUE(invlists.has_zone_map(i));
+    }
+    EXPECT_EQ(invlists.zone_maps, fresh_zone_maps(invlists));
+
+    invlists.disable_zone_maps();
+    EXPECT_FALSE(invlists.has_zone_map(0));
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 32, nb = 5000, nq = 40, k = 10;
+
+void check_precomputed_table(faiss::MetricType metric) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 123);
+    faiss::float_randn(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlat quantizer(d, metric);
+    faiss::IndexIVFPQ index(&quantizer, d, 32, 8, 8, metric);
+    index.do_polysemous_training = true;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 8;
+
+    for (int ht : {0, 20}) {
+        index.polysemous_ht = ht;
+        index.use_precomputed_table = -1;
+        index.precompute_table();
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+        index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+        index.use_precomputed_table = 1;
+        index.precompute_table();
+        EXPECT_EQ(index.precomputed_table.size(), 32 * 8 * 256);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+
+        size_t ndiff = 0;
+        for (size_t i = 0; i < nq * k; i++) {
+            if (I[i] != Iref[i]) {
+                ndiff++;
+            } else {
+                EXPECT_NEAR(D[i], Dref[i], 1e-3 * (1 + std::abs(Dref[i])));
+            }
+        }
+        // only rounding differences
+        EXPECT_LE(ndiff, nq * k / 100) << "ht=" << ht;
+    }
+}
+
+} // namespace
+
+TEST(IVFPQPrecomputedTable, inner_product) {
+    check_precomputed_table(faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(IVFPQPrecomputedTable, L2) {
+    check_precomputed_table(faiss::METRIC_L2);
+}
+
+TEST(IVFPQPrecomputedTable, fp16) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 123);
+    faiss::float_randn(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ index(&quantizer, d, 32, 8, 8);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 8;
+    EXPECT_EQ(index.use_precomputed_table, 1);
+
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    index.use_precomputed_table = 3;
+    index.precompute_table();
+    EXPECT_EQ(index.precomputed_table.size(), 0);
+    EXPECT_EQ(index.precomputed_table_fp16.size(), 32 * 8 * 256);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    size_t ndiff = 0;
+    for (size_t i = 0; i < nq * k; i++) {
+        if (I[i] != Iref[i]) {
+            ndiff++;
+        } else {
+            EXPECT_NEAR(D[i], Dref[i], 1e-2 * (1 + std::abs(Dref[i])));
+        }
+    }
+    EXPECT_LE(ndiff, nq * k / 10);
+
+    // selected when the float table is too big
+    size_t max_bytes = faiss::precomputed_table_max_bytes;
+    faiss::precomputed_table_max_bytes = 32 * 8 * 256 * 3;
+    index.use_precomputed_table = 0;
+    index.precompute_table();
+    faiss::precomputed_table_max_bytes = max_bytes;
+    EXPECT_EQ(index.use_precomputed_table, 3);
+    EXPECT_EQ(index.precomputed_table_fp16.size(), 32 * 8 * 256);
+}
+
+TEST(IVFPQPrecomputedTable, query_table_blocks) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 123);
+    faiss::float_randn(xq.data(), xq.size(), 456);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexFlat quantizer(d, metric);
+        // dsub = 16: the tables of a block are computed with a GEMM
+        faiss::IndexIVFPQ index(&quantizer, d, 32, 2, 8, metric);
+        index.train(nb, xb.data());
+        index.add(nb, xb.data());
+        index.nprobe = 8;
+
+        size_t max_bytes = faiss::index_ivfpq_query_tables_max_bytes;
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+        // one query at a time
+        faiss::index_ivfpq_query_tables_max_bytes = 0;
+        index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+        // blocks of 7 queries and a single block
+        for (size_t bs : {size_t(7), nq}) {
+            faiss::index_ivfpq_query_tables_max_bytes =
+                    bs * 2 * 256 * sizeof(float);
+            index.search(nq, xq.data(), k, D.data(), I.data());
+            size_t ndiff = 0;
+            for (size_t i = 0; i < nq * k; i++) {
+                if (I[i] != Iref[i]) {
+                    ndiff++;
+                } else {
+                    EXPECT_NEAR(
+                            D[i], Dref[i], 1e-4 * (1 + std::abs(Dref[i])));
+                }
+            }
+            EXPECT_LE(ndiff, nq * k / 100) << "bs=" << bs;
+        }
+        faiss::index_ivfpq_query_tables_max_bytes = max_bytes;
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/knn_graph.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16;
+const size_t n = 4000, k = 8;
+
+struct KnnGraphTest : ::testing::Test {
+    std::vector<float> x;
+    // exact graph, without the vectors themselves
+    std::vector<float> Dref;
+    std::vector<faiss::idx_t> Iref;
+
+    void SetUp() override {
+        x.resize(n * d);
+        faiss::float_rand(x.data(), x.size(), 123);
+        faiss::IndexFlatL2 flat(d);
+        flat.add(n, x.data());
+        std::vector<float> D(n * (k + 1));
+        std::vector<faiss::idx_t> I(n * (k + 1));
+        flat.search(n, x.data(), k + 1, D.data(), I.data());
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < k + 1; j++) {
+                if (I[i * (k + 1) + j] != faiss::idx_t(i) &&
+                    Iref.size() < (i + 1) * k) {
+                    Iref.push_back(I[i * (k + 1) + j]);
+                    Dref.push_back(D[i * (k + 1) + j]);
+                }
+            }
+        }
+    }
+
+    /// fraction of the exact neighbors found
+    double recall(const std::vector<faiss::idx_t>& I) const {
+        size_t nfound = 0;
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < k; j++) {
+                const faiss::idx_t* res = I.data() + i * k;
+                nfound += std::find(res, res + k, Iref[i * k + j]) != res + k;
+            }
+        }
+        return double(nfound) / (n * k);
+    }
+};
+
+} // namespace
+
+TEST_F(KnnGraphTest, exact) {
+    faiss::KnnGraphParameters params;
+    params.nlist = 20;
+    params.nprobe = 20;
+    std::vector<float> D(n * k);
+    std::vector<faiss::idx_t> I(n * k);
+    faiss::build_knn_graph(
+            n, x.data(), d, faiss::METRIC_L2, k, D.data(), I.data(), &params);
+    EXPECT_EQ(recall(I), 1.0);
+    for (size_t i = 0; i < n * k; i++) {
+        EXPECT_NEAR(D[i], Dref[i], 1e-4);
+    }
+}
+
+TEST_F(KnnGraphTest, clustered) {
+    faiss::KnnGraphParameters params;
+    params.nlist = 64;
+    params.nprobe = 8;
+    std::vector<float> D(n * k);
+    std::vector<faiss::idx_t> I(n * k);
+    faiss::build_knn_graph(
+            n, x.data(), d, faiss::METRIC_L2, k, D.data(), I.data(), &params);
+    EXPECT_GT(recall(I), 0.8);
+    for (size_t i = 0; i < n * k; i++) {
+        EXPECT_NE(I[i], faiss::idx_t(i / k));
+    }
+}
+
+TEST_F(KnnGraphTest, ivf_and_file) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat ivf(&quantizer, d, 32);
+    ivf.train(n, x.data());
+    ivf.add(n, x.data());
+    faiss::KnnGraphParameters params;
+    params.nprobe = 8;
+
+    std::vector<float> D(n * k);
+    std::vector<faiss::idx_t> I(n * k);
+    faiss::build_knn_graph(ivf, k, D.data(), I.data(), &params);
+    EXPECT_GT(recall(I), 0.8);
+
+    // same graph streamed to a file
+    char fname[] = "/tmp/faiss_knn_graph_XXXXXX";
+    int fd = mkstemp(fname);
+    close(fd);
+    {
+        faiss::KnnGraphFileWriter writer(fname, k);
+        faiss::build_knn_graph(ivf, k, writer, &params);
+    }
+    FILE* f = fopen(fname, "rb");
+    ASSERT_TRUE(f);
+    size_t nrecord = 0;
+    faiss::idx_t id;
+    std::vector<faiss::idx_t> Ii(k);
+    std::vector<float> Di(k);
+    while (fread(&id, sizeof(id), 1, f) == 1) {
+        ASSERT_EQ(fread(Ii.data(), sizeof(faiss::idx_t), k, f), k);
+        ASSERT_EQ(fread(Di.data(), sizeof(float), k, f), k);
+        ASSERT_TRUE(id >= 0 && id < faiss::idx_t(n));
+        EXPECT_EQ(Ii, std::vector<faiss::idx_t>(
+                              I.begin() + id * k, I.begin() + (id + 1) * k));
+        nrecord++;
+    }
+    fclose(f);
+    remove(fname);
+    EXPECT_EQ(nrecord, n);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexLattice.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nt = 2000, nb = 3000, nq = 20, k = 10;
+
+// the distances computed from the codes match the distances to the
+// decoded vectors
+void test_lattice_search(int nsq, int scale_nbit, int r2, bool use_table) {
+    std::vector<float> xt(nt * d), xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nt, d, xt.data(), 123);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 456);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 789);
+
+    faiss::IndexLattice index(d, nsq, scale_nbit, r2);
+    ASSERT_FALSE(index.decode_table.empty());
+    std::vector<float> decoded_ref(nb * d);
+    index.train(nt, xt.data());
+    index.add(nb, xb.data());
+    index.sa_decode(nb, index.codes.data(), decoded_ref.data());
+    if (!use_table) {
+        index.decode_table.clear();
+    }
+
+    std::vector<float> decoded(nb * d);
+    index.sa_decode(nb, index.codes.data(), decoded.data());
+    EXPECT_EQ(decoded, decoded_ref);
+
+    faiss::IndexFlatL2 index_ref(d);
+    index_ref.add(nb, decoded.data());
+
+    std::vector<float> D(nq * k), D_ref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I_ref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index_ref.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    int n_same = 0;
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(D[i], D_ref[i], 1e-4 * (D_ref[i] + 1));
+        n_same += I[i] == I_ref[i];
+    }
+    // only ties can be ordered differently
+    EXPECT_GT(n_same, nq * k * 9 / 10);
+
+    std::unique_ptr<faiss::FlatCodesDistanceComputer> dc(
+            index.get_FlatCodesDistanceComputer());
+    dc->set_query(xq.data());
+    for (int i = 0; i < nb; i += 101) {
+        float ref = faiss::fvec_L2sqr(xq.data(), decoded.data() + i * d, d);
+        EXPECT_NEAR((*dc)(i), ref, 1e-4 * (ref + 1));
+    }
+
+    faiss::RangeSearchResult res(nq);
+    index.range_search(nq, xq.data(), D_ref[k - 1] * 1.0001, &res);
+    EXPECT_GE(res.lims[1], k);
+}
+
+} // namespace
+
+TEST(LatticeSearch, table) {
+    test_lattice_search(4, 4, 10, true);
+}
+
+TEST(LatticeSearch, no_table) {
+    test_lattice_search(4, 4, 10, false);
+}
+
+// longer sub-vectors with a small radius
+TEST(LatticeSearch, nsq2) {
+    test_lattice_search(2, 6, 4, true);
+}
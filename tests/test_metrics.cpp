@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/utils/metrics.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 2000, nq = 50, k = 5;
+
+struct MetricsEnabled {
+    MetricsEnabled() {
+        faiss::metrics_reset();
+        faiss::metrics_set_enabled(true);
+    }
+    ~MetricsEnabled() {
+        faiss::metrics_set_enabled(false);
+    }
+};
+
+} // namespace
+
+TEST(Metrics, disabled) {
+    faiss::metrics_set_enabled(false);
+    faiss::metrics_reset();
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    faiss::MetricsSnapshot snap = faiss::metrics_snapshot();
+    for (int i = 0; i < faiss::METRIC_N_COUNTERS; i++) {
+        EXPECT_EQ(snap.counters[i], 0);
+    }
+}
+
+TEST(Metrics, ivf) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 20);
+    index.train(nb, xb.data());
+    index.nprobe = 4;
+
+    MetricsEnabled enabled;
+    index.add(nb, xb.data());
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    faiss::MetricsSnapshot snap = faiss::metrics_snapshot();
+    EXPECT_EQ(snap.counters[faiss::METRIC_ADD_VECTORS], nb);
+    // the coarse quantizer search is nested, its queries are not counted
+    EXPECT_EQ(snap.counters[faiss::METRIC_SEARCH_QUERIES], nq);
+    EXPECT_EQ(
+            snap.counters[faiss::METRIC_LISTS_SCANNED],
+            faiss::indexIVF_stats.nlist);
+    // + the distances to the centroids at add and search time
+    EXPECT_EQ(
+            snap.counters[faiss::METRIC_NDIS],
+            faiss::indexIVF_stats.ndis + (nb + nq) * 20);
+    const faiss::MetricsHistogramSnapshot& lat =
+            snap.histograms[faiss::METRIC_SEARCH_LATENCY];
+    EXPECT_EQ(lat.count, 1);
+    EXPECT_GT(lat.sum, 0);
+    uint64_t tot = 0;
+    for (int i = 0; i < faiss::metrics_n_buckets; i++) {
+        tot += lat.buckets[i];
+    }
+    EXPECT_EQ(tot, 1);
+    EXPECT_EQ(snap.histograms[faiss::METRIC_ADD_LATENCY].count, 1);
+    // one per slice of queries
+    EXPECT_GE(snap.histograms[faiss::METRIC_NDIS_PER_QUERY].count, 1);
+}
+
+TEST(Metrics, threads) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    MetricsEnabled enabled;
+    // the metrics of the threads are kept after they exit
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&]() {
+            std::vector<float> D(k);
+            std::vector<faiss::idx_t> I(k);
+            for (int q = 0; q < nq; q++) {
+                index.search(1, xq.data() + q * d, k, D.data(), I.data());
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    faiss::MetricsSnapshot snap = faiss::metrics_snapshot();
+    EXPECT_EQ(snap.counters[faiss::METRIC_SEARCH_QUERIES], 4 * nq);
+    EXPECT_EQ(snap.histograms[faiss::METRIC_SEARCH_LATENCY].count, 4 * nq);
+    EXPECT_GT(snap.counters[faiss::METRIC_NDIS], 4 * nq * k);
+
+    std::string text = faiss::metrics_to_prometheus();
+    EXPECT_NE(text.find("faiss_search_queries_total 200\n"), std::string::npos);
+    EXPECT_NE(
+            text.find("faiss_search_latency_seconds_bucket{le=\"+Inf\"} 200\n"),
+            std::string::npos);
+    EXPECT_NE(
+            text.find("faiss_search_latency_seconds_count 200\n"),
+            std::string::npos);
+
+    faiss::metrics_reset();
+    snap = faiss::metrics_snapshot();
+    EXPECT_EQ(snap.counters[faiss::METRIC_SEARCH_QUERIES], 0);
+}
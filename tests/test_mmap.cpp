@@ -17,6 +17,9 @@
 
 #include <faiss/IndexBinaryFlat.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/IndexIVFPQ.h>
 #include <faiss/impl/io.h>
 #include <faiss/index_io.h>
 
@@ -263,3 +266,61 @@ TEST(TestMmap, mmap_binary_flatcodes) {
     ASSERT_EQ(ref_ids_1, cand_ids_3);
     ASSERT_EQ(ref_dis_1, cand_dis_3);
 }
+
+// the large arrays of the other index types are views of the file as well
+TEST(TestMmap, mmap_views) {
+    const size_t nt = 2000;
+    const size_t nq = 10;
+    const size_t d = 16;
+    const size_t k = 10;
+
+    std::vector<float> xt = make_data(nt, d, 123);
+    std::vector<float> xq = make_data(nq, d, 789);
+    std::vector<faiss::idx_t> ids(nt);
+    for (size_t i = 0; i < nt; i++) {
+        ids[i] = 3 * i + 1;
+    }
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ ivfpq(&quantizer, d, 8, 4, 5);
+    ivfpq.train(nt, xt.data());
+    ivfpq.set_direct_map_type(faiss::DirectMap::Array);
+    faiss::IndexIDMap idmap(&ivfpq);
+    idmap.add_with_ids(nt, xt.data(), ids.data());
+
+    faiss::IndexHNSWFlat hnsw(d, 16);
+    hnsw.add(nt, xt.data());
+
+    for (faiss::Index* index : {(faiss::Index*)&idmap, (faiss::Index*)&hnsw}) {
+        std::vector<float> ref_dis(k * nq), dis(k * nq);
+        std::vector<faiss::idx_t> ref_ids(k * nq), cand_ids(k * nq);
+        index->search(nq, xq.data(), k, ref_dis.data(), ref_ids.data());
+
+        std::string tmpname = std::tmpnam(nullptr);
+        faiss::write_index(index, tmpname.c_str());
+        std::unique_ptr<faiss::Index> index_mm(
+                faiss::read_index(tmpname.c_str(), faiss::IO_FLAG_MMAP_IFC));
+
+        if (auto idmap_mm = dynamic_cast<faiss::IndexIDMap*>(index_mm.get())) {
+            EXPECT_FALSE(idmap_mm->id_map.is_owned);
+            auto ivf_mm = dynamic_cast<faiss::IndexIVFPQ*>(idmap_mm->index);
+            ASSERT_NE(ivf_mm, nullptr);
+            EXPECT_FALSE(ivf_mm->pq.centroids.is_owned);
+            EXPECT_FALSE(ivf_mm->direct_map.array.is_owned);
+            std::vector<float> recons(d), recons_ref(d);
+            ivf_mm->reconstruct(123, recons.data());
+            ivfpq.reconstruct(123, recons_ref.data());
+            EXPECT_EQ(recons, recons_ref);
+        } else {
+            auto hnsw_mm = dynamic_cast<faiss::IndexHNSW*>(index_mm.get());
+            ASSERT_NE(hnsw_mm, nullptr);
+            EXPECT_FALSE(hnsw_mm->hnsw.levels.is_owned);
+            EXPECT_FALSE(hnsw_mm->hnsw.offsets.is_owned);
+        }
+
+        index_mm->search(nq, xq.data(), k, dis.data(), cand_ids.data());
+        EXPECT_EQ(ref_ids, cand_ids);
+        EXPECT_EQ(ref_dis, dis);
+        std::remove(tmpname.c_str());
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <omp.h>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexNNDescent.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/NNDescent.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const int nb = 2000;
+const int K = 10;
+
+/// fraction of the exact K nearest neighbors found in the graph
+double graph_recall(
+        const faiss::NNDescent& nnd,
+        const std::vector<float>& xb,
+        faiss::MetricType metric) {
+    faiss::IndexFlat index(d, metric);
+    index.add(nb, xb.data());
+    std::vector<faiss::idx_t> I((K + 1) * nb);
+    std::vector<float> D((K + 1) * nb);
+    index.search(nb, xb.data(), K + 1, D.data(), I.data());
+    size_t n_found = 0;
+    for (int i = 0; i < nb; i++) {
+        // the first result is the query itself
+        std::unordered_set<faiss::idx_t> gt(
+                I.begin() + i * (K + 1) + 1, I.begin() + (i + 1) * (K + 1));
+        for (int j = 0; j < K; j++) {
+            n_found += gt.count(nnd.final_graph[i * K + j]);
+        }
+    }
+    return n_found / double(nb * K);
+}
+
+} // namespace
+
+TEST(NNDescent, batched_join) {
+    std::vector<float> xb(nb * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 1234);
+
+    for (faiss::MetricType metric :
+         {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexFlat storage(d, metric);
+        storage.add(nb, xb.data());
+        std::unique_ptr<faiss::DistanceComputer> dis(
+                storage.get_distance_computer());
+        if (metric == faiss::METRIC_INNER_PRODUCT) {
+            dis.reset(new faiss::NegativeDistanceComputer(dis.release()));
+        }
+
+        // pair by pair through the distance computer, then by blocks of
+        // vectors, with small join blocks to exercise the pool updates
+        for (bool batched : {false, true}) {
+            faiss::NNDescent nnd(d, K);
+            nnd.S = 10;
+            nnd.R = 32;
+            nnd.L = K + 20;
+            nnd.iter = 5;
+            nnd.join_block_size = 300;
+            if (batched) {
+                nnd.build(*dis, nb, false, xb.data(), metric);
+            } else {
+                nnd.build(*dis, nb, false);
+            }
+            EXPECT_GT(graph_recall(nnd, xb, metric), 0.95);
+        }
+    }
+}
+
+TEST(NNDescent, index_flat) {
+    std::vector<float> xb(nb * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 4321);
+    int nt = omp_get_max_threads();
+    omp_set_num_threads(4);
+    faiss::IndexNNDescentFlat index(d, K);
+    index.nndescent.S = 10;
+    index.nndescent.R = 32;
+    index.nndescent.L = K + 20;
+    index.nndescent.iter = 5;
+    index.add(nb, xb.data());
+    omp_set_num_threads(nt);
+    EXPECT_GT(graph_recall(index.nndescent, xb, faiss::METRIC_L2), 0.95);
+}
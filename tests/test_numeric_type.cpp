@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/utils/bf16.h>
+#include <faiss/utils/fp16.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 24;
+const size_t nb = 2000, nq = 20, k = 5;
+
+struct NumericTypeTest : ::testing::Test {
+    std::vector<float> xb, xq;
+    std::vector<uint16_t> xb16, xq16, xbbf, xqbf;
+
+    void SetUp() override {
+        xb.resize(nb * d);
+        xq.resize(nq * d);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        for (float v : xb) {
+            xb16.push_back(faiss::encode_fp16(v));
+            xbbf.push_back(faiss::encode_bf16(v));
+        }
+        for (float v : xq) {
+            xq16.push_back(faiss::encode_fp16(v));
+            xqbf.push_back(faiss::encode_bf16(v));
+        }
+    }
+
+    /// index1 was filled with the float32 vectors, index2 with _ex
+    void expect_same_results(
+            const faiss::Index& index1,
+            const faiss::Index& index2,
+            const uint16_t* queries,
+            faiss::NumericType numeric_type) {
+        std::vector<float> xqf(nq * d);
+        faiss::numeric_type_to_float(
+                numeric_type, nq * d, queries, xqf.data());
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+        index1.search(nq, xqf.data(), k, Dref.data(), Iref.data());
+        index2.search_ex(nq, queries, numeric_type, k, D.data(), I.data());
+        EXPECT_EQ(Iref, I);
+        EXPECT_EQ(Dref, D);
+    }
+};
+
+} // namespace
+
+TEST_F(NumericTypeTest, sq_fp16_direct) {
+    faiss::IndexScalarQuantizer index1(d, faiss::ScalarQuantizer::QT_fp16);
+    faiss::IndexScalarQuantizer index2(d, faiss::ScalarQuantizer::QT_fp16);
+    index1.add(nb, xb.data());
+    index2.add_ex(nb, xb16.data(), faiss::Float16);
+    // the codes are the fp16 input
+    EXPECT_EQ(index1.codes, index2.codes);
+    size_t nbytes = xb16.size() * sizeof(uint16_t);
+    EXPECT_EQ(0, memcmp(index2.codes.data(), xb16.data(), nbytes));
+    expect_same_results(index1, index2, xq16.data(), faiss::Float16);
+}
+
+TEST_F(NumericTypeTest, flat_bf16_direct) {
+    faiss::IndexFlatBF16 index1(d), index2(d);
+    index1.add(nb, xb.data());
+    index2.add_ex(nb, xbbf.data(), faiss::BFloat16);
+    EXPECT_EQ(index1.codes, index2.codes);
+    expect_same_results(index1, index2, xqbf.data(), faiss::BFloat16);
+}
+
+TEST_F(NumericTypeTest, converted) {
+    // indexes that store float32 get the converted vectors
+    std::vector<float> xbf(nb * d);
+    faiss::numeric_type_to_float(
+            faiss::Float16, nb * d, xb16.data(), xbf.data());
+
+    faiss::IndexFlatL2 quantizer1(d), quantizer2(d);
+    faiss::IndexIVFFlat index1(&quantizer1, d, 16);
+    faiss::IndexIVFFlat index2(&quantizer2, d, 16);
+    index1.train(nb, xbf.data());
+    index1.add(nb, xbf.data());
+    index2.train_ex(nb, xb16.data(), faiss::Float16);
+    index2.add_ex(nb, xb16.data(), faiss::Float16);
+    index1.nprobe = index2.nprobe = 4;
+    expect_same_results(index1, index2, xq16.data(), faiss::Float16);
+
+    // fp16 into a bf16 index is converted
+    faiss::IndexFlatBF16 index3(d);
+    index3.add_ex(nb, xb16.data(), faiss::Float16);
+    EXPECT_EQ(index3.ntotal, nb);
+}
@@ -17,6 +17,7 @@
 #include <gtest/gtest.h>
 
 #include <faiss/IndexFlat.h>
+#include <faiss/IVFlib.h>
 #include <faiss/IndexIVFFlat.h>
 #include <faiss/index_io.h>
 #include <faiss/invlists/OnDiskInvertedLists.h>
@@ -204,3 +205,80 @@ TEST(ONDISK, make_invlists_threaded) {
     }
     EXPECT_EQ(ntot, nadd);
 }
+
+TEST(ONDISK, prefetch_madvise) {
+    int d = 8;
+    int nlist = 30, nq = 200, nb = 1500, k = 10;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    std::vector<float> xq(d * nq);
+    faiss::float_rand(xq.data(), d * nq, 34567);
+
+    Tempfilename filename;
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    faiss::OnDiskInvertedLists ivf(
+            index.nlist, index.code_size, filename.c_str());
+    index.replace_invlists(&ivf);
+    index.add(nb, xb.data());
+    index.nprobe = 4;
+
+    std::vector<float> ref_D(nq * k), new_D(nq * k);
+    std::vector<faiss::idx_t> ref_I(nq * k), new_I(nq * k);
+    index.search(nq, xq.data(), k, ref_D.data(), ref_I.data());
+
+    ivf.prefetch_mode = faiss::OnDiskInvertedLists::PREFETCH_MADVISE;
+    index.search(nq, xq.data(), k, new_D.data(), new_I.data());
+    EXPECT_EQ(ref_D, new_D);
+    EXPECT_EQ(ref_I, new_I);
+}
+
+TEST(ONDISK, merge_ondisk) {
+    int d = 8;
+    int nlist = 30, nq = 100, nb = 3000, k = 10, nshard = 3;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    std::vector<float> xq(d * nq);
+    faiss::float_rand(xq.data(), d * nq, 34567);
+
+    faiss::IndexIVFFlat ref_index(&quantizer, d, nlist);
+    ref_index.add(nb, xb.data());
+    ref_index.nprobe = 4;
+
+    std::vector<Tempfilename> shard_files(nshard);
+    std::vector<std::string> shard_fnames;
+    for (int s = 0; s < nshard; s++) {
+        faiss::IndexIVFFlat shard(&quantizer, d, nlist);
+        int i0 = s * nb / nshard, i1 = (s + 1) * nb / nshard;
+        shard.add(i1 - i0, xb.data() + i0 * d);
+        faiss::write_index(&shard, shard_files[s].c_str());
+        shard_fnames.push_back(shard_files[s].filename);
+    }
+
+    Tempfilename ivfdata;
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    // small buffer, so that the file is written in many blocks
+    size_t ntotal = faiss::ivflib::merge_ondisk(
+            &index, shard_fnames, ivfdata.c_str(), true, 2000);
+    EXPECT_EQ(ntotal, nb);
+    EXPECT_EQ(index.ntotal, nb);
+    index.nprobe = 4;
+
+    std::vector<float> ref_D(nq * k), new_D(nq * k);
+    std::vector<faiss::idx_t> ref_I(nq * k), new_I(nq * k);
+    ref_index.search(nq, xq.data(), k, ref_D.data(), ref_I.data());
+    index.search(nq, xq.data(), k, new_D.data(), new_I.data());
+    EXPECT_EQ(ref_D, new_D);
+    EXPECT_EQ(ref_I, new_I);
+}
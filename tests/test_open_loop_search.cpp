@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/utils/open_loop_search.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nb = 2000, nq = 200, k = 5;
+
+} // namespace
+
+TEST(OpenLoopSearch, same_results) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    for (int n_clients : {1, 3}) {
+        std::vector<double> latencies(nq, -1);
+        faiss::OpenLoopSearchStats stats = faiss::open_loop_search(
+                &index,
+                nq,
+                xq.data(),
+                k,
+                0,
+                n_clients,
+                D.data(),
+                I.data(),
+                latencies.data());
+        EXPECT_EQ(I, I_ref);
+        EXPECT_EQ(D, D_ref);
+        for (double l : latencies) {
+            EXPECT_GE(l, 0);
+        }
+        EXPECT_GT(stats.achieved_qps, 0);
+        EXPECT_GT(stats.mean_service_time, 0);
+    }
+}
+
+TEST(OpenLoopSearch, arrival_rate) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    faiss::IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+
+    // the run cannot be faster than the arrivals: 200 queries at 2000 QPS
+    // take about 0.1 s
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    std::vector<double> latencies(nq);
+    faiss::OpenLoopSearchStats stats = faiss::open_loop_search(
+            &index,
+            nq,
+            xq.data(),
+            k,
+            2000,
+            2,
+            D.data(),
+            I.data(),
+            latencies.data());
+    EXPECT_GT(stats.duration, 0.05);
+    EXPECT_LT(stats.achieved_qps, 4000);
+    for (double l : latencies) {
+        EXPECT_GE(l, 0);
+    }
+}
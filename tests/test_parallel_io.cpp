@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/sectioned_io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct TmpFile {
+    std::string name = std::tmpnam(nullptr);
+
+    ~TmpFile() {
+        remove(name.c_str());
+    }
+};
+
+/// a file with n random bytes
+std::vector<uint8_t> write_random_file(const std::string& fname, size_t n) {
+    std::vector<uint8_t> data(n);
+    faiss::byte_rand(data.data(), n, 123);
+    faiss::FileIOWriter writer(fname.c_str());
+    EXPECT_EQ(writer(data.data(), 1, n), n);
+    return data;
+}
+
+/// buffers of uneven sizes, some of them empty
+std::vector<size_t> batch_sizes() {
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < 50; i++) {
+        sizes.push_back(i % 7 == 0 ? 0 : (i * 7919) % 50000);
+    }
+    return sizes;
+}
+
+/// read 3 bytes, then the batch, then 5 bytes, and compare with the data
+void test_read_batch(
+        faiss::IOReader& reader,
+        const std::vector<uint8_t>& data) {
+    std::vector<size_t> sizes = batch_sizes();
+    std::vector<std::vector<uint8_t>> bufs(sizes.size());
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        bufs[i].resize(sizes[i]);
+        ptrs.push_back(bufs[i].data());
+    }
+    uint8_t head[3], tail[5];
+    ASSERT_EQ(reader(head, 1, 3), 3);
+    reader.read_batch(sizes.size(), ptrs.data(), sizes.data());
+    ASSERT_EQ(reader(tail, 1, 5), 5);
+
+    size_t ofs = 0;
+    EXPECT_TRUE(std::equal(head, head + 3, data.begin()));
+    ofs += 3;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        EXPECT_TRUE(std::equal(
+                bufs[i].begin(), bufs[i].end(), data.begin() + ofs));
+        ofs += sizes[i];
+    }
+    EXPECT_TRUE(std::equal(tail, tail + 5, data.begin() + ofs));
+}
+
+} // namespace
+
+TEST(ParallelIO, file_read_batch) {
+    TmpFile tmp;
+    std::vector<uint8_t> data = write_random_file(tmp.name, 2 << 20);
+    faiss::FileIOReader reader(tmp.name.c_str());
+    test_read_batch(reader, data);
+}
+
+TEST(ParallelIO, buffered_read_batch) {
+    TmpFile tmp;
+    std::vector<uint8_t> data = write_random_file(tmp.name, 2 << 20);
+    faiss::FileIOReader reader(tmp.name.c_str());
+    // part of the batch is served from the buffer
+    faiss::BufferedIOReader breader(&reader, 10000);
+    test_read_batch(breader, data);
+}
+
+TEST(ParallelIO, file_large_read) {
+    TmpFile tmp;
+    const size_t n = 10 << 20;
+    std::vector<uint8_t> data = write_random_file(tmp.name, n);
+    faiss::FileIOReader reader(tmp.name.c_str());
+    reader.parallel_read_min = 1 << 20;
+    std::vector<uint8_t> buf(n);
+    ASSERT_EQ(reader(buf.data(), 1, 7), 7);
+    ASSERT_EQ(reader(buf.data() + 7, 1, n - 7), n - 7);
+    EXPECT_EQ(buf, data);
+    // EOF
+    EXPECT_EQ(reader(buf.data(), 1, 1 << 20), 0);
+}
+
+TEST(ParallelIO, IVF_invlists) {
+    const size_t d = 8, nb = 20000, nq = 10, k = 4;
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 64);
+    index.nprobe = 8;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xb.data(), k, Dref.data(), Iref.data());
+
+    TmpFile tmp, tmp_sectioned;
+    faiss::write_index(&index, tmp.name.c_str());
+    // small sections, so that the lists are sections
+    faiss::write_index_sectioned(&index, tmp_sectioned.name.c_str(), 64, 256);
+    for (const std::string& fname : {tmp.name, tmp_sectioned.name}) {
+        std::unique_ptr<faiss::Index> index2(faiss::read_index(fname.c_str()));
+        index2->search(nq, xb.data(), k, D.data(), I.data());
+        EXPECT_EQ(D, Dref);
+        EXPECT_EQ(I, Iref);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFPQFastScan.h>
+#include <faiss/impl/ProductQuantizer.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 32, nt = 5000;
+
+struct Errors {
+    double parallel = 0; // mean <r, x>^2 / ||x||^2
+    double total = 0;    // mean ||r||^2
+};
+
+Errors quantization_errors(
+        const faiss::ProductQuantizer& pq,
+        const std::vector<float>& x) {
+    size_t n = x.size() / d;
+    std::vector<uint8_t> codes(n * pq.code_size);
+    pq.compute_codes(x.data(), codes.data(), n);
+    std::vector<float> xr(n * d);
+    pq.decode(codes.data(), xr.data(), n);
+    Errors err;
+    for (size_t i = 0; i < n; i++) {
+        const float* xi = x.data() + i * d;
+        float s = 0, r2 = 0;
+        for (size_t j = 0; j < d; j++) {
+            float r = xi[j] - xr[i * d + j];
+            s += r * xi[j];
+            r2 += r * r;
+        }
+        err.parallel += s * s / faiss::fvec_norm_L2sqr(xi, d);
+        err.total += r2;
+    }
+    err.parallel /= n;
+    err.total /= n;
+    return err;
+}
+
+} // namespace
+
+TEST(PQAnisotropic, encoding) {
+    std::vector<float> x(nt * d);
+    faiss::float_randn(x.data(), x.size(), 123);
+
+    faiss::ProductQuantizer pq(d, 8, 4);
+    pq.train(nt, x.data());
+    Errors iso = quantization_errors(pq, x);
+
+    // same centroids, anisotropic encoding only
+    pq.anisotropic_eta = 4;
+    Errors aniso = quantization_errors(pq, x);
+    EXPECT_LT(aniso.parallel, iso.parallel);
+    // the loss that the encoding minimizes
+    EXPECT_LE(
+            aniso.total + 3 * aniso.parallel,
+            (iso.total + 3 * iso.parallel) * 1.001);
+
+    // training for the loss
+    faiss::ProductQuantizer pq2(d, 8, 4);
+    pq2.anisotropic_eta = 4;
+    pq2.train(nt, x.data());
+    Errors aniso2 = quantization_errors(pq2, x);
+    EXPECT_LT(aniso2.parallel, iso.parallel);
+}
+
+TEST(PQAnisotropic, ivfpq_fast_scan) {
+    size_t nb = 10000, nq = 50, k = 10;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 1234);
+    faiss::float_randn(xq.data(), xq.size(), 4567);
+
+    faiss::IndexFlatIP ref(d);
+    ref.add(nb, xb.data());
+    std::vector<float> Dref(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    double recalls[2];
+    for (int aniso = 0; aniso < 2; aniso++) {
+        faiss::IndexFlatIP quantizer(d);
+        faiss::IndexIVFPQFastScan index(
+                &quantizer, d, 16, 8, 4, faiss::METRIC_INNER_PRODUCT);
+        index.by_residual = false;
+        index.nprobe = 16;
+        index.pq.anisotropic_eta = aniso ? 4 : 0;
+        index.train(nb, xb.data());
+        index.add(nb, xb.data());
+        std::vector<float> D(nq * k);
+        std::vector<faiss::idx_t> I(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        size_t found = 0;
+        for (size_t q = 0; q < nq; q++) {
+            for (size_t j = 0; j < k; j++) {
+                for (size_t l = 0; l < k; l++) {
+                    found += I[q * k + j] == Iref[q * k + l];
+                }
+            }
+        }
+        recalls[aniso] = found / double(nq * k);
+    }
+    // all lists are visited, the difference comes from the codes only
+    EXPECT_GT(recalls[1], recalls[0] - 0.02);
+}
@@ -14,6 +14,7 @@
 #include <faiss/IndexPQFastScan.h>
 #include <faiss/impl/ProductQuantizer.h>
 #include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/random.h>
 
 namespace {
 
@@ -143,3 +144,32 @@ TEST(PQFastScan, set_packed_element) {
         }
     }
 }
+
+TEST(PQTrain, parallel_subspaces) {
+    const size_t d = 64, M = 16, nbits = 6, n = 5000;
+    std::vector<float> x(n * d);
+    faiss::float_rand(x.data(), x.size(), 1234);
+
+    faiss::ProductQuantizer pq_ref(d, M, nbits);
+    pq_ref.train(n, x.data());
+
+    faiss::ProductQuantizer pq(d, M, nbits);
+    pq.train_parallel_subspaces = true;
+    pq.train(n, x.data());
+
+    // same seeds for each slice, so the result should be the same up to
+    // floating-point rounding
+    auto error = [&](const faiss::ProductQuantizer& q) {
+        std::vector<uint8_t> codes(q.code_size * n);
+        std::vector<float> decoded(n * d);
+        q.compute_codes(x.data(), codes.data(), n);
+        q.decode(codes.data(), decoded.data(), n);
+        double err = 0;
+        for (size_t i = 0; i < n * d; i++) {
+            err += (x[i] - decoded[i]) * (x[i] - decoded[i]);
+        }
+        return err;
+    };
+    double err_ref = error(pq_ref);
+    EXPECT_NEAR(error(pq), err_ref, err_ref * 1e-3);
+}
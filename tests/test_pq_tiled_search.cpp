@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexPQ.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nt = 3000, nb = 5000, k = 10;
+
+// the search by tiles of codes and queries returns exactly the same
+// results as the scan of all the codes per query
+void test_tiled_search(int M, faiss::MetricType metric, int nq) {
+    std::vector<float> xt(nt * d), xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nt, d, xt.data(), 123);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 456);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 789);
+
+    faiss::IndexPQ index(d, M, 8, metric);
+    index.train(nt, xt.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    index.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+
+    // block sizes that do not divide nb
+    index.pq.search_code_block = 96;
+    index.pq.search_query_block = 7;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+}
+
+} // namespace
+
+TEST(PQTiledSearch, M8_L2) {
+    test_tiled_search(8, faiss::METRIC_L2, 100);
+}
+
+TEST(PQTiledSearch, M4_IP) {
+    test_tiled_search(4, faiss::METRIC_INNER_PRODUCT, 100);
+}
+
+// M not a multiple of 4
+TEST(PQTiledSearch, M2_L2) {
+    test_tiled_search(2, faiss::METRIC_L2, 100);
+}
+
+TEST(PQTiledSearch, M16_few_queries) {
+    test_tiled_search(16, faiss::METRIC_L2, 3);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexPQWideFastScan.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/pq_wide_fast_scan.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const int d = 32;
+const int nb = 3000;
+const int nq = 30;
+const int k = 10;
+
+} // namespace
+
+TEST(PQWideFastScan, pack_codes) {
+    for (int nbits : {5, 6, 7, 8}) {
+        size_t M = 7, n = 150;
+        size_t code_size = (M * nbits + 7) / 8;
+        std::vector<uint8_t> codes(n * code_size);
+        faiss::byte_rand(codes.data(), codes.size(), 123);
+        std::vector<uint8_t> blocks(
+                3 * faiss::pqwide_block_size(M, nbits), 0xff);
+        // pack in two calls
+        faiss::pqwide_pack_codes_range(
+                codes.data(), M, nbits, 0, 70, blocks.data());
+        faiss::pqwide_pack_codes_range(
+                codes.data() + 70 * code_size,
+                M,
+                nbits,
+                70,
+                n,
+                blocks.data());
+        for (size_t i = 0; i < n; i++) {
+            faiss::BitstringReader bsr(codes.data() + i * code_size, code_size);
+            for (size_t m = 0; m < M; m++) {
+                EXPECT_EQ(
+                        faiss::pqwide_get_packed_element(
+                                blocks.data(), M, nbits, i, m),
+                        bsr.read(nbits));
+            }
+        }
+    }
+}
+
+TEST(PQWideFastScan, distances) {
+    // the kernel computes the sums of the quantized table entries
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+    for (int nbits : {5, 6, 7, 8}) {
+        faiss::IndexPQWideFastScan index(d, 8, nbits);
+        index.train(nb, xb.data());
+        index.add(nb, xb.data());
+        size_t stride = faiss::pqwide_lut_stride(nbits);
+        std::vector<uint8_t> lut(nq * 8 * stride);
+        std::vector<float> normalizers(2 * nq);
+        index.compute_quantized_LUT(
+                nq, xq.data(), lut.data(), normalizers.data());
+
+        std::vector<float> D(k * nq);
+        std::vector<faiss::idx_t> I(k * nq);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        for (int q = 0; q < nq; q++) {
+            std::vector<int> sums(nb);
+            for (int i = 0; i < nb; i++) {
+                for (int m = 0; m < 8; m++) {
+                    int c = faiss::pqwide_get_packed_element(
+                            index.codes.get(), 8, nbits, i, m);
+                    sums[i] += lut[(q * 8 + m) * stride + c];
+                }
+            }
+            std::vector<int> sorted = sums;
+            std::sort(sorted.begin(), sorted.end());
+            float a = normalizers[2 * q], b = normalizers[2 * q + 1];
+            for (int j = 0; j < k; j++) {
+                EXPECT_EQ(sums[I[q * k + j]], sorted[j]);
+                EXPECT_FLOAT_EQ(D[q * k + j], sorted[j] / a + b);
+            }
+        }
+    }
+}
+
+TEST(PQWideFastScan, search) {
+    std::vector<float> xb(d * nb), xq(d * nq);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+    for (faiss::MetricType metric :
+         {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        std::unique_ptr<faiss::Index> index(
+                faiss::index_factory(d, "PQ16x6fs", metric));
+        auto index_wfs = dynamic_cast<faiss::IndexPQWideFastScan*>(index.get());
+        ASSERT_NE(index_wfs, nullptr);
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+
+        // same quantizer with the exact distances
+        faiss::IndexPQ index_pq(d, 16, 6, metric);
+        index_pq.pq = index_wfs->pq;
+        index_pq.is_trained = true;
+        index_pq.add(nb, xb.data());
+
+        std::vector<float> D_ref(k * nq), D(k * nq);
+        std::vector<faiss::idx_t> I_ref(k * nq), I(k * nq);
+        index_pq.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+        index->search(nq, xq.data(), k, D.data(), I.data());
+        int n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            for (int j = 0; j < k; j++) {
+                n_found += std::count(
+                        I_ref.begin() + q * k,
+                        I_ref.begin() + (q + 1) * k,
+                        I[q * k + j]);
+            }
+        }
+        EXPECT_GT(n_found, nq * k * 0.8);
+
+        std::vector<float> recons(d), recons_pq(d);
+        index->reconstruct(1234, recons.data());
+        index_pq.reconstruct(1234, recons_pq.data());
+        EXPECT_EQ(recons, recons_pq);
+
+        Tempfilename tmp;
+        faiss::write_index(index.get(), tmp.c_str());
+        std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+        std::vector<float> D2(k * nq);
+        std::vector<faiss::idx_t> I2(k * nq);
+        index2->search(nq, xq.data(), k, D2.data(), I2.data());
+        EXPECT_EQ(D2, D);
+        EXPECT_EQ(I2, I);
+
+        // selector
+        faiss::IDSelectorRange sel(0, nb / 2);
+        faiss::SearchParameters params;
+        params.sel = &sel;
+        index->search(nq, xq.data(), k, D.data(), I.data(), &params);
+        for (faiss::idx_t id : I) {
+            EXPECT_TRUE(id >= 0 && id < nb / 2);
+        }
+    }
+}
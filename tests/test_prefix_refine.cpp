@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexPrefixRefine.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 4000;
+const size_t nq = 50;
+const int k = 10;
+
+/// the variance decreases along the dimensions, as for the embeddings of a
+/// Matryoshka model whose leading components carry most of the signal
+std::vector<float> make_data(size_t n, int seed) {
+    std::vector<float> x(n * d);
+    faiss::float_randn(x.data(), x.size(), seed);
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] *= std::exp(-j / 8.0);
+        }
+    }
+    return x;
+}
+
+/// fraction of the exact k nearest neighbors found
+double recall(
+        faiss::Index& index,
+        faiss::MetricType metric,
+        const std::vector<float>& xb,
+        const std::vector<float>& xq,
+        const faiss::SearchParameters* params = nullptr) {
+    faiss::IndexFlat ref(d, metric);
+    ref.add(nb, xb.data());
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data(), params);
+    size_t nfound = 0;
+    for (size_t q = 0; q < nq; q++) {
+        std::set<faiss::idx_t> gt(
+                Iref.begin() + q * k, Iref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            nfound += gt.count(I[q * k + j]);
+        }
+    }
+    return double(nfound) / (nq * k);
+}
+
+} // namespace
+
+TEST(PrefixRefine, exhaustive) {
+    std::vector<float> xb = make_data(nb, 123), xq = make_data(nq, 456);
+    for (faiss::MetricType metric :
+         {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        std::unique_ptr<faiss::Index> index(
+                faiss::index_factory(d, "Prefix8,Flat", metric));
+        index->add(nb, xb.data());
+        // all the vectors are re-ranked: same results as the full search
+        faiss::IndexRefineSearchParameters params;
+        params.k_factor = nb / k;
+        EXPECT_EQ(recall(*index, metric, xb, xq, &params), 1.0);
+        // the prefixes alone find fewer neighbors
+        EXPECT_LT(recall(*index, metric, xb, xq), 1.0);
+    }
+}
+
+TEST(PrefixRefine, hnsw_ivf) {
+    std::vector<float> xb = make_data(nb, 123), xq = make_data(nq, 456);
+    for (const char* key : {"Prefix16,HNSW32", "Prefix16,IVF16,Flat"}) {
+        SCOPED_TRACE(key);
+        std::unique_ptr<faiss::Index> index(faiss::index_factory(d, key));
+        auto pr = dynamic_cast<faiss::IndexPrefixRefine*>(index.get());
+        ASSERT_TRUE(pr);
+        EXPECT_EQ(pr->base_index->d, 16);
+        EXPECT_EQ(pr->suffix_index->d, d - 16);
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+        pr->k_factor = 8;
+        if (auto ivf = dynamic_cast<faiss::IndexIVF*>(pr->base_index)) {
+            ivf->nprobe = 4;
+        }
+        EXPECT_GT(recall(*index, faiss::METRIC_L2, xb, xq), 0.9);
+    }
+}
+
+TEST(PrefixRefine, io_and_reconstruct) {
+    std::vector<float> xb = make_data(nb, 123), xq = make_data(nq, 456);
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "Prefix12,HNSW16"));
+    index->add(nb, xb.data());
+
+    std::vector<float> recons(d);
+    index->reconstruct(17, recons.data());
+    for (int j = 0; j < d; j++) {
+        EXPECT_EQ(recons[j], xb[17 * d + j]);
+    }
+
+    faiss::VectorIOWriter writer;
+    faiss::write_index(index.get(), &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(&reader));
+    auto pr2 = dynamic_cast<faiss::IndexPrefixRefine*>(index2.get());
+    ASSERT_TRUE(pr2);
+    EXPECT_EQ(pr2->d_prefix, 12);
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I2(nq * k);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+}
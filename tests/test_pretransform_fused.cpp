@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPreTransform.h>
+#include <faiss/VectorTransform.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 32, nb = 4000, nq = 30, k = 10, nlist = 32;
+
+} // namespace
+
+TEST(IndexPreTransform, fused_search) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 123);
+    faiss::float_randn(xq.data(), xq.size(), 456);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        for (bool pq : {false, true}) {
+            faiss::IndexFlat quantizer(d, metric);
+            faiss::IndexIVF* ivf;
+            if (pq) {
+                ivf = new faiss::IndexIVFPQ(&quantizer, d, nlist, 8, 8, metric);
+            } else {
+                ivf = new faiss::IndexIVFFlat(&quantizer, d, nlist, metric);
+            }
+            // the last transform is fused with the coarse quantizer
+            faiss::IndexPreTransform index(
+                    new faiss::RandomRotationMatrix(d, d), ivf);
+            index.own_fields = true;
+            index.prepend_transform(new faiss::PCAMatrix(d, d));
+            index.train(nb, xb.data());
+            EXPECT_FALSE(index.can_use_fused_search());
+
+            // blocked add
+            index.add_block_size = 700;
+            index.add(nb, xb.data());
+            EXPECT_EQ(index.ntotal, nb);
+
+            faiss::IVFSearchParameters params;
+            params.nprobe = 4;
+            std::vector<float> Dref(nq * k), D(nq * k);
+            std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+            index.search(
+                    nq, xq.data(), k, Dref.data(), Iref.data(), &params);
+
+            index.prepare_fused_search();
+            EXPECT_TRUE(index.can_use_fused_search());
+            index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+
+            size_t ndiff = 0;
+            for (size_t i = 0; i < nq * k; i++) {
+                ndiff += I[i] != Iref[i];
+            }
+            // the coarse distances are computed in a different order, so
+            // ties on the probed lists may break differently
+            EXPECT_LE(ndiff, nq * k / 50);
+            for (size_t i = 0; i < nq * k; i++) {
+                if (I[i] == Iref[i]) {
+                    EXPECT_NEAR(D[i], Dref[i], 1e-3 * (1 + std::abs(Dref[i])));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <omp.h>
+
+#include <faiss/impl/ProductAdditiveQuantizer.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, nt = 2000, nb = 5000;
+
+// encoding by tiles of vectors, all the splits concurrently, gives the
+// same codes as encoding the splits one after the other
+void test_tiled_encode(faiss::ProductAdditiveQuantizer& paq, int nthread) {
+    std::vector<float> xt(nt * d), xb(nb * d);
+    faiss::rand_smooth_vectors(nt, d, xt.data(), 123);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 456);
+    paq.train(nt, xt.data());
+
+    int nt_before = omp_get_max_threads();
+    omp_set_num_threads(nthread);
+    std::vector<uint8_t> codes_ref(nb * paq.code_size), codes(codes_ref.size());
+    paq.encode_tile_size = 0;
+    paq.compute_codes(xb.data(), codes_ref.data(), nb);
+    // a tile size that does not divide nb
+    paq.encode_tile_size = 700;
+    paq.compute_codes(xb.data(), codes.data(), nb);
+    omp_set_num_threads(nt_before);
+
+    EXPECT_EQ(codes, codes_ref);
+}
+
+} // namespace
+
+TEST(ProductAQEncode, PRQ) {
+    faiss::ProductResidualQuantizer prq(d, 4, 2, 6);
+    test_tiled_encode(prq, 4);
+}
+
+TEST(ProductAQEncode, PRQ_beam) {
+    faiss::ProductResidualQuantizer prq(d, 2, 3, 5);
+    for (auto q : prq.quantizers) {
+        static_cast<faiss::ResidualQuantizer*>(q)->max_beam_size = 4;
+    }
+    test_tiled_encode(prq, 3);
+}
+
+// LSQ encodings depend on the vectors encoded together, the splits are
+// encoded one after the other
+TEST(ProductAQEncode, PLSQ) {
+    faiss::ProductLocalSearchQuantizer plsq(d, 2, 2, 4);
+    test_tiled_encode(plsq, 4);
+}
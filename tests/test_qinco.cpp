@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexNeuralNetCodec.h>
+#include <faiss/utils/NeuralNet.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, K = 16, L = 2, M = 3, h = 8;
+
+void random_weights(faiss::nn::Linear& linear, int64_t seed) {
+    faiss::float_randn(linear.weight.data(), linear.weight.size(), seed);
+    for (float& w : linear.weight) {
+        w *= 0.3;
+    }
+    if (!linear.bias.empty()) {
+        faiss::float_randn(linear.bias.data(), linear.bias.size(), seed + 1);
+    }
+}
+
+void init_qinco(faiss::QINCo& qinco) {
+    faiss::float_randn(
+            qinco.codebook0.weight.data(), qinco.codebook0.weight.size(), 1);
+    for (int m = 0; m < qinco.M - 1; m++) {
+        faiss::QINCoStep& step = qinco.get_step(m);
+        faiss::float_randn(
+                step.codebook.weight.data(),
+                step.codebook.weight.size(),
+                10 + m);
+        random_weights(step.MLPconcat, 100 + m);
+        for (int l = 0; l < qinco.L; l++) {
+            faiss::nn::FFN& block = step.get_residual_block(l);
+            random_weights(block.linear1, 200 + 10 * m + l);
+            random_weights(block.linear2, 300 + 10 * m + l);
+        }
+    }
+}
+
+std::vector<int32_t> random_codes(size_t n, int64_t seed) {
+    faiss::RandomGenerator rng(seed);
+    std::vector<int32_t> codes(n * M);
+    for (int32_t& c : codes) {
+        c = rng.rand_int(K);
+    }
+    return codes;
+}
+
+// the step decoding written with the layers, as in the Pytorch code
+faiss::nn::Tensor2D reference_step_decode(
+        const faiss::QINCoStep& step,
+        const faiss::nn::Tensor2D& xhat,
+        const faiss::nn::Int32Tensor2D& codes) {
+    size_t n = xhat.shape[0];
+    faiss::nn::Tensor2D zqs = step.codebook(codes);
+    faiss::nn::Tensor2D cc(n, 2 * d);
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < d; j++) {
+            cc.v[i * 2 * d + j] = zqs.v[i * d + j];
+            cc.v[i * 2 * d + d + j] = xhat.v[i * d + j];
+        }
+    }
+    zqs += step.MLPconcat(cc);
+    for (int l = 0; l < step.L; l++) {
+        zqs += step.residual_blocks[l](zqs);
+    }
+    return zqs;
+}
+
+} // namespace
+
+TEST(QINCo, step_decode_encode) {
+    faiss::QINCo qinco(d, K, L, M, h);
+    init_qinco(qinco);
+    const faiss::QINCoStep& step = qinco.get_step(0);
+
+    size_t n = 50;
+    faiss::nn::Tensor2D xhat(n, d), x(n, d);
+    faiss::float_randn(xhat.data(), xhat.numel(), 123);
+    faiss::float_randn(x.data(), x.numel(), 456);
+    faiss::nn::Int32Tensor2D codes(n, 1);
+    std::vector<int32_t> c = random_codes(n, 789);
+    for (size_t i = 0; i < n; i++) {
+        codes.v[i] = c[i * M];
+    }
+
+    faiss::nn::Tensor2D ref = reference_step_decode(step, xhat, codes);
+    faiss::nn::Tensor2D new_decode = step.decode(xhat, codes);
+    for (size_t i = 0; i < ref.numel(); i++) {
+        EXPECT_NEAR(ref.v[i], new_decode.v[i], 1e-4);
+    }
+
+    // the encoding is the code with the nearest decoding
+    faiss::nn::Tensor2D residuals(n, d);
+    faiss::nn::Int32Tensor2D enc = step.encode(xhat, x, &residuals);
+    for (size_t i = 0; i < n; i++) {
+        float best = HUGE_VALF;
+        int best_j = -1;
+        for (int j = 0; j < K; j++) {
+            faiss::nn::Int32Tensor2D cj(1, 1);
+            cj.v[0] = j;
+            faiss::nn::Tensor2D xhat_i(1, d, xhat.data() + i * d);
+            faiss::nn::Tensor2D delta = reference_step_decode(step, xhat_i, cj);
+            delta += xhat_i;
+            float dis = faiss::fvec_L2sqr(delta.data(), x.data() + i * d, d);
+            if (dis < best) {
+                best = dis;
+                best_j = j;
+            }
+        }
+        EXPECT_EQ(enc.v[i], best_j);
+    }
+}
+
+TEST(QINCo, batched_decode_encode) {
+    faiss::QINCo qinco(d, K, L, M, h);
+    init_qinco(qinco);
+
+    size_t n = 1000;
+    std::vector<int32_t> codes = random_codes(n, 123);
+    std::vector<float> x_ref(n * d), x_new(n * d);
+    qinco.block_size = 1 << 20;
+    qinco.decode_codes(n, codes.data(), x_ref.data());
+    // many blocks processed in parallel
+    qinco.block_size = 37;
+    qinco.decode_codes(n, codes.data(), x_new.data());
+    for (size_t i = 0; i < n * d; i++) {
+        EXPECT_NEAR(x_ref[i], x_new[i], 1e-4);
+    }
+
+    std::vector<int32_t> codes_ref(n * M), codes_new(n * M);
+    qinco.block_size = 1 << 20;
+    qinco.encode_vectors(n, x_ref.data(), codes_ref.data());
+    qinco.block_size = 5 * K;
+    qinco.encode_vectors(n, x_ref.data(), codes_new.data());
+    EXPECT_EQ(codes_ref, codes_new);
+}
+
+TEST(QINCo, half_precision_weights) {
+    faiss::QINCo qinco(d, K, L, M, h);
+    init_qinco(qinco);
+
+    size_t n = 200;
+    std::vector<int32_t> codes = random_codes(n, 1234);
+    std::vector<float> x_ref(n * d), x_new(n * d);
+    qinco.decode_codes(n, codes.data(), x_ref.data());
+    float norm = faiss::fvec_norm_L2sqr(x_ref.data(), n * d);
+
+    for (auto weight_type :
+         {faiss::nn::WeightType::FP16, faiss::nn::WeightType::BF16}) {
+        qinco.set_weight_type(weight_type);
+        EXPECT_TRUE(qinco.get_step(0).MLPconcat.weight.empty());
+        qinco.decode_codes(n, codes.data(), x_new.data());
+        float err = faiss::fvec_L2sqr(x_ref.data(), x_new.data(), n * d);
+        EXPECT_GT(err, 0);
+        EXPECT_LT(err / norm, 1e-3);
+        qinco.set_weight_type(faiss::nn::WeightType::FP32);
+    }
+}
+
+TEST(QINCo, index_search) {
+    size_t nb = 2000, nq = 20, k = 5;
+    faiss::IndexQINCo index(d, M, 4, L, h);
+    init_qinco(index.qinco);
+    index.is_trained = true;
+
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 12);
+    faiss::float_randn(xq.data(), xq.size(), 34);
+    index.add(nb, xb.data());
+    index.search_block_size = 300;
+
+    // compare with a search in the decoded vectors
+    std::vector<float> decoded(nb * d);
+    index.sa_decode(nb, index.codes.data(), decoded.data());
+    faiss::IndexFlatL2 ref(d);
+    ref.add(nb, decoded.data());
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(I, Iref);
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(D[i], Dref[i], 1e-3);
+    }
+
+    // batched distance computations
+    std::unique_ptr<faiss::DistanceComputer> dc(index.get_distance_computer());
+    dc->set_query(xq.data());
+    std::vector<faiss::idx_t> ids = {3, 1999, 0, 700, 3};
+    std::vector<float> dis(ids.size());
+    dc->distances_batch(ids, dis);
+    for (size_t i = 0; i < ids.size(); i++) {
+        EXPECT_NEAR(
+                dis[i],
+                faiss::fvec_L2sqr(xq.data(), decoded.data() + ids[i] * d, d),
+                1e-3);
+    }
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFRaBitQ.h>
+#include <faiss/IndexRaBitQ.h>
+#include <faiss/IndexRaBitQFastScan.h>
+#include <faiss/impl/RaBitQuantizer.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 64, nb = 5000, nq = 50, k = 10;
+
+struct Data {
+    std::vector<float> xb, xq;
+    std::vector<float> Dref;
+    std::vector<faiss::idx_t> Iref;
+
+    explicit Data(faiss::MetricType metric) : xb(nb * d), xq(nq * d) {
+        faiss::float_randn(xb.data(), xb.size(), 123);
+        faiss::float_randn(xq.data(), xq.size(), 456);
+        faiss::IndexFlat flat(d, metric);
+        flat.add(nb, xb.data());
+        Dref.resize(nq * k);
+        Iref.resize(nq * k);
+        flat.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    }
+
+    // fraction of the true k nearest neighbors found
+    double recall(const std::vector<faiss::idx_t>& I) const {
+        size_t found = 0;
+        for (size_t q = 0; q < nq; q++) {
+            std::set<faiss::idx_t> ref(
+                    Iref.begin() + q * k, Iref.begin() + (q + 1) * k);
+            for (size_t j = 0; j < k; j++) {
+                found += ref.count(I[q * k + j]);
+            }
+        }
+        return found / double(nq * k);
+    }
+};
+
+// mean relative error of the distance estimates to the first vectors
+double estimate_error(const faiss::IndexRaBitQ& index, const Data& data) {
+    std::unique_ptr<faiss::FlatCodesDistanceComputer> dc(
+            index.get_FlatCodesDistanceComputer());
+    double err = 0;
+    size_t n = 200;
+    for (size_t q = 0; q < nq; q++) {
+        const float* xq = data.xq.data() + q * d;
+        dc->set_query(xq);
+        for (size_t i = 0; i < n; i++) {
+            float ref = faiss::fvec_L2sqr(xq, data.xb.data() + i * d, d);
+            err += std::abs((*dc)(i) - ref) / ref;
+        }
+    }
+    return err / (nq * n);
+}
+
+} // namespace
+
+TEST(RaBitQMultiBit, code_size) {
+    for (size_t nb_bits = 1; nb_bits <= 8; nb_bits++) {
+        faiss::RaBitQuantizer rabitq(d, faiss::METRIC_L2, nb_bits);
+        EXPECT_EQ(
+                rabitq.code_size,
+                faiss::RaBitQuantizer::get_code_size(d, nb_bits));
+        EXPECT_EQ(
+                faiss::RaBitQuantizer::get_nb_bits(d, rabitq.code_size),
+                nb_bits);
+    }
+    EXPECT_EQ(faiss::RaBitQuantizer::get_nb_bits(d, 3), 0);
+}
+
+TEST(RaBitQMultiBit, estimates_improve_with_bits) {
+    Data data(faiss::METRIC_L2);
+    double prev_err = 1e10;
+    for (size_t nb_bits : {1, 2, 4, 6}) {
+        faiss::IndexRaBitQ index(d, faiss::METRIC_L2, nb_bits);
+        index.train(nb, data.xb.data());
+        index.add(nb, data.xb.data());
+        double err = estimate_error(index, data);
+        EXPECT_LT(err, prev_err) << "nb_bits=" << nb_bits;
+        prev_err = err;
+    }
+    // 6 bits per dimension are accurate
+    EXPECT_LT(prev_err, 0.03);
+}
+
+TEST(RaBitQMultiBit, search_recall) {
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        Data data(metric);
+        double recall_1bit = 0;
+        for (size_t nb_bits : {1, 4}) {
+            faiss::IndexRaBitQ index(d, metric, nb_bits);
+            index.train(nb, data.xb.data());
+            index.add(nb, data.xb.data());
+            std::vector<float> D(nq * k);
+            std::vector<faiss::idx_t> I(nq * k);
+            index.search(nq, data.xq.data(), k, D.data(), I.data());
+            double recall = data.recall(I);
+            if (nb_bits == 1) {
+                recall_1bit = recall;
+            } else {
+                EXPECT_GT(recall, recall_1bit + 0.1);
+                EXPECT_GT(recall, 0.8);
+            }
+
+            // the quantized query gives similar results
+            faiss::RaBitQSearchParameters params;
+            params.qb = 8;
+            index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+            EXPECT_GT(data.recall(I), recall - 0.05);
+        }
+    }
+}
+
+TEST(RaBitQMultiBit, ivf_search_recall) {
+    Data data(faiss::METRIC_L2);
+    double recall_1bit = 0;
+    for (size_t nb_bits : {1, 4}) {
+        faiss::IndexFlat quantizer(d);
+        faiss::IndexIVFRaBitQ index(
+                &quantizer, d, 16, faiss::METRIC_L2, nb_bits);
+        index.train(nb, data.xb.data());
+        index.add(nb, data.xb.data());
+        index.nprobe = 16;
+        std::vector<float> D(nq * k);
+        std::vector<faiss::idx_t> I(nq * k);
+        index.search(nq, data.xq.data(), k, D.data(), I.data());
+        double recall = data.recall(I);
+        if (nb_bits == 1) {
+            recall_1bit = recall;
+        } else {
+            EXPECT_GT(recall, recall_1bit + 0.1);
+        }
+    }
+}
+
+TEST(RaBitQMultiBit, fast_scan) {
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        Data data(metric);
+        for (size_t nb_bits : {1, 3}) {
+            faiss::IndexRaBitQ index(d, metric, nb_bits);
+            index.train(nb, data.xb.data());
+            index.add(nb, data.xb.data());
+
+            faiss::IndexRaBitQFastScan index_fs(d, metric, nb_bits);
+            index_fs.train(nb, data.xb.data());
+            // incremental adds
+            index_fs.add(nb / 3, data.xb.data());
+            index_fs.add(nb - nb / 3, data.xb.data() + nb / 3 * d);
+
+            std::vector<float> D(nq * k), Dfs(nq * k);
+            std::vector<faiss::idx_t> I(nq * k), Ifs(nq * k);
+            index.search(nq, data.xq.data(), k, D.data(), I.data());
+            index_fs.search(nq, data.xq.data(), k, Dfs.data(), Ifs.data());
+
+            size_t ndiff = 0;
+            for (size_t i = 0; i < nq * k; i++) {
+                ndiff += I[i] != Ifs[i];
+            }
+            if (nb_bits == 1) {
+                // the pruning is exact
+                EXPECT_EQ(ndiff, 0);
+            } else {
+                EXPECT_LT(ndiff, nq * k / 20);
+            }
+
+            // serialization
+            faiss::VectorIOWriter writer;
+            faiss::write_index(&index_fs, &writer);
+            faiss::VectorIOReader reader;
+            reader.data = writer.data;
+            std::unique_ptr<faiss::Index> index2(faiss::read_index(&reader));
+            auto index2_fs =
+                    dynamic_cast<faiss::IndexRaBitQFastScan*>(index2.get());
+            ASSERT_TRUE(index2_fs);
+            EXPECT_EQ(index2_fs->rabitq.nb_bits, nb_bits);
+            std::vector<float> D2(nq * k);
+            std::vector<faiss::idx_t> I2(nq * k);
+            index2->search(nq, data.xq.data(), k, D2.data(), I2.data());
+            EXPECT_EQ(I2, Ifs);
+        }
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/RangeInvertedLists.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 32, nb = 20000, nq = 10, k = 10, nlist = 64;
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+struct RangeReadTest : ::testing::Test {
+    std::vector<float> xb, xq;
+    std::unique_ptr<faiss::IndexIVFFlat> index;
+    faiss::IndexFlatL2 quantizer{d};
+    Tempfilename index_file, cache_file;
+
+    void SetUp() override {
+        xb.resize(nb * d);
+        xq.resize(nq * d);
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+        index.reset(new faiss::IndexIVFFlat(&quantizer, d, nlist));
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+        index->nprobe = 2;
+        faiss::write_index(index.get(), index_file.c_str());
+    }
+
+    void expect_same_results(const faiss::Index* index2) {
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+        index->search(nq, xq.data(), k, Dref.data(), Iref.data());
+        index2->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(Iref, I);
+        EXPECT_EQ(Dref, D);
+    }
+};
+
+} // namespace
+
+TEST_F(RangeReadTest, lazy_lists) {
+    auto source = std::make_shared<faiss::FileRangeReader>(index_file.c_str());
+    auto cached = std::make_shared<faiss::CachedRangeReader>(
+            source, cache_file.c_str(), 4096, 1);
+    faiss::RangeIOReader reader(cached, 8192);
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(&reader, faiss::IO_FLAG_RANGE_READ));
+    auto ivf2 = dynamic_cast<faiss::IndexIVF*>(index2.get());
+    ASSERT_TRUE(ivf2);
+    auto ils = dynamic_cast<faiss::RangeInvertedLists*>(ivf2->invlists);
+    ASSERT_TRUE(ils);
+    // only the metadata and the quantizer were fetched
+    size_t lists_bytes = nb * (d * sizeof(float) + sizeof(faiss::idx_t));
+    EXPECT_LT(cached->n_fetched_bytes, source->size() - lists_bytes / 2);
+
+    ivf2->nprobe = 2;
+    expect_same_results(index2.get());
+    // the queries only fetched the lists they visited
+    EXPECT_LT(cached->n_fetched_bytes, source->size() / 2);
+
+    // the blocks are fetched once
+    size_t fetched = cached->n_fetched_bytes;
+    expect_same_results(index2.get());
+    EXPECT_EQ(cached->n_fetched_bytes, fetched);
+}
+
+TEST_F(RangeReadTest, write_back) {
+    auto source = std::make_shared<faiss::FileRangeReader>(index_file.c_str());
+    faiss::RangeIOReader reader(source);
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(&reader, faiss::IO_FLAG_RANGE_READ));
+
+    // written as an ArrayInvertedLists
+    Tempfilename tmp;
+    faiss::write_index(index2.get(), tmp.c_str());
+    std::unique_ptr<faiss::Index> index3(faiss::read_index(tmp.c_str()));
+    auto ivf3 = dynamic_cast<faiss::IndexIVF*>(index3.get());
+    ASSERT_TRUE(dynamic_cast<faiss::ArrayInvertedLists*>(ivf3->invlists));
+    ivf3->nprobe = 2;
+    expect_same_results(index3.get());
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <faiss/AutoTune.h>
+#include <faiss/index_factory.h>
+#include <faiss/recommend_index.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32, n = 6000;
+const faiss::idx_t ntotal = 1000000;
+
+std::vector<float> make_sample() {
+    std::vector<float> x(n * d);
+    faiss::rand_smooth_vectors(n, d, x.data(), 1234);
+    return x;
+}
+
+} // namespace
+
+TEST(RecommendIndex, no_budget) {
+    std::vector<float> x = make_sample();
+    std::vector<faiss::IndexRecommendation> evaluated;
+    faiss::IndexRecommendation rec = faiss::recommend_index(
+            n, d, x.data(), ntotal, 0, 0, 0.9, faiss::METRIC_L2, &evaluated);
+    EXPECT_TRUE(rec.meets_targets);
+    EXPECT_GE(rec.recall, 0.9);
+    EXPECT_FALSE(rec.comments.empty());
+
+    // the flat index is exact, its size is the size of the vectors
+    bool has_flat = false;
+    for (const auto& c : evaluated) {
+        EXPECT_GT(c.memory, 0);
+        EXPECT_GT(c.latency, 0);
+        if (c.factory_string == "Flat") {
+            has_flat = true;
+            EXPECT_EQ(c.recall, 1.0);
+            EXPECT_NEAR(c.memory, ntotal * d * 4.0, ntotal * d * 0.04);
+        }
+    }
+    EXPECT_TRUE(has_flat);
+
+    // the recommendation can be instantiated
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, rec.factory_string.c_str()));
+    faiss::ParameterSpace ps;
+    ps.set_index_parameters(index.get(), rec.search_params.c_str());
+}
+
+TEST(RecommendIndex, memory_budget) {
+    std::vector<float> x = make_sample();
+    // a quarter of the size of the raw vectors
+    double budget = ntotal * d * 4.0 / 4;
+    faiss::IndexRecommendation rec = faiss::recommend_index(
+            n, d, x.data(), ntotal, budget, 0, 0.5);
+    EXPECT_TRUE(rec.meets_targets);
+    EXPECT_LE(rec.memory, budget);
+    EXPECT_NE(rec.factory_string, "Flat");
+    EXPECT_NE(rec.factory_string, "HNSW32");
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <omp.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nb = 2000;
+
+/// counts the embedding requests
+struct CountingProvider : faiss::IndexEmbeddingProvider {
+    std::atomic<size_t> n_calls{0}, n_ids{0};
+
+    explicit CountingProvider(const faiss::Index* index)
+            : faiss::IndexEmbeddingProvider(index) {}
+
+    bool get_embeddings(size_t n, const faiss::idx_t* ids, float* out)
+            override {
+        n_calls++;
+        n_ids += n;
+        return faiss::IndexEmbeddingProvider::get_embeddings(n, ids, out);
+    }
+};
+
+// the graph built from the added vectors and the fetched embeddings is the
+// one built from the storage
+void test_recompute_build(faiss::MetricType metric, size_t buffer_size) {
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::IndexFlat flat(d, metric);
+    flat.add(nb, xb.data());
+
+    int nt = omp_get_max_threads();
+    omp_set_num_threads(1);
+    faiss::IndexHNSWFlat index_ref(d, 16, metric);
+    index_ref.add(nb / 2, xb.data());
+    index_ref.add(nb / 2, xb.data() + nb / 2 * d);
+
+    faiss::IndexHNSWFlat index(d, 16, metric);
+    auto provider = std::make_shared<CountingProvider>(&flat);
+    index.embedding_provider = provider;
+    index.is_recompute = true;
+    index.recompute_build = true;
+    index.build_buffer_size = buffer_size;
+    index.add(nb / 2, xb.data());
+    // all the vectors were local
+    EXPECT_EQ(provider->n_calls, 0);
+    index.add(nb / 2, xb.data() + nb / 2 * d);
+    omp_set_num_threads(nt);
+
+    size_t n_same = 0;
+    for (size_t i = 0; i < index.hnsw.neighbors.size(); i++) {
+        n_same += index.hnsw.neighbors[i] == index_ref.hnsw.neighbors[i];
+    }
+    // the batched distances of the storage may be rounded differently
+    EXPECT_GE(n_same, index.hnsw.neighbors.size() * 99 / 100);
+    // the embeddings of the first half are fetched in batches
+    EXPECT_GT(provider->n_calls, 0);
+    EXPECT_GT(provider->n_ids, 2 * provider->n_calls);
+    if (buffer_size >= nb) {
+        EXPECT_LE(provider->n_ids, nb / 2);
+    }
+}
+
+} // namespace
+
+TEST(RecomputeBuild, L2) {
+    test_recompute_build(faiss::METRIC_L2, 1 << 16);
+}
+
+TEST(RecomputeBuild, IP) {
+    test_recompute_build(faiss::METRIC_INNER_PRODUCT, 1 << 16);
+}
+
+// the buffer is emptied many times
+TEST(RecomputeBuild, small_buffer) {
+    test_recompute_build(faiss::METRIC_L2, 300);
+}
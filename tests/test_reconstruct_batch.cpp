@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 3000;
+
+/// reconstruct_batch and reconstruct_n give the same vectors as
+/// reconstruct
+void test_reconstruct(const char* key) {
+    SCOPED_TRACE(key);
+    std::vector<float> xb(nb * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 1234);
+    std::unique_ptr<faiss::Index> index(faiss::index_factory(d, key));
+    index->train(nb, xb.data());
+    index->add(nb, xb.data());
+    if (auto ivf = dynamic_cast<faiss::IndexIVF*>(index.get())) {
+        ivf->make_direct_map();
+    }
+
+    std::vector<float> ref(nb * d);
+    for (size_t i = 0; i < nb; i++) {
+        index->reconstruct(i, ref.data() + i * d);
+    }
+
+    // random keys, with repetitions
+    size_t n = 2 * nb;
+    std::vector<int64_t> keys(n);
+    faiss::int64_rand_max(keys.data(), n, nb, 123);
+    std::vector<float> recons(n * d);
+    index->reconstruct_batch(n, keys.data(), recons.data());
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < d; j++) {
+            float r = ref[keys[i] * d + j];
+            ASSERT_NEAR(recons[i * d + j], r, 1e-5 * (1 + std::fabs(r)));
+        }
+    }
+
+    size_t i0 = 100, ni = nb - 200;
+    recons.resize(ni * d);
+    index->reconstruct_n(i0, ni, recons.data());
+    for (size_t i = 0; i < ni * d; i++) {
+        float r = ref[i0 * d + i];
+        ASSERT_NEAR(recons[i], r, 1e-5 * (1 + std::fabs(r)));
+    }
+}
+
+} // namespace
+
+TEST(ReconstructBatch, flat_codes) {
+    test_reconstruct("Flat");
+    test_reconstruct("PQ8");
+    test_reconstruct("SQ8");
+    test_reconstruct("SQfp16");
+}
+
+TEST(ReconstructBatch, ivf) {
+    test_reconstruct("IVF16,Flat");
+    test_reconstruct("IVF16,PQ8");
+    test_reconstruct("IVF16,PQ8x6");
+    test_reconstruct("IVF16,SQ8");
+    test_reconstruct("IVF16,RQ2x6");
+    test_reconstruct("IVF16,PQ8+8");
+    test_reconstruct("IVF16,PQ8x4fs");
+}
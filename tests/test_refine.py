@@ -121,6 +121,54 @@ class TestIndexRefineSearchParams(unittest.TestCase):
         self.do_test("IVF8,PQ2x4np,Refine(SQ8)")
 
 
+class TestIndexRefineBatched(unittest.TestCase):
+
+    def do_test(self, metric):
+        ds = datasets.SyntheticDataset(32, 1000, 2000, 30, metric)
+        xq = ds.get_queries()
+
+        # the base index returns fewer than k_factor * k results for
+        # some queries, so that the refine stage sees -1 labels
+        base = faiss.index_factory(32, "IVF16,PQ4x4np", metric)
+        base.train(ds.get_train())
+        base.nprobe = 1
+        index_flat = faiss.IndexFlat(32, metric)
+
+        # the generic IndexRefine computes the distances in batches of
+        # sorted ids, IndexRefineFlat with the fvec_*_by_idx functions
+        index_r = faiss.IndexRefine(base, index_flat)
+        index_r.k_factor = 50
+        index_r.add(ds.get_database())
+        Dref, Iref = base.search(xq, 500)
+        D1, I1 = index_r.search(xq, 10)
+
+        index_rf = faiss.IndexRefineFlat(base, faiss.swig_ptr(ds.get_database()))
+        index_rf.k_factor = 50
+        D2, I2 = index_rf.search(xq, 10)
+
+        np.testing.assert_array_equal(I1, I2)
+        np.testing.assert_allclose(D1, D2, rtol=1e-5)
+        self.assertTrue((Iref == -1).any())
+
+        # the refined distances are exact
+        for q in range(ds.nq):
+            for j in range(10):
+                if I1[q, j] < 0:
+                    continue
+                xb = ds.get_database()[I1[q, j]]
+                if metric == faiss.METRIC_L2:
+                    ref = ((xq[q] - xb) ** 2).sum()
+                else:
+                    ref = (xq[q] * xb).sum()
+                self.assertAlmostEqual(D1[q, j], ref, places=3)
+
+    def test_L2(self):
+        self.do_test(faiss.METRIC_L2)
+
+    def test_IP(self):
+        self.do_test(faiss.METRIC_INNER_PRODUCT)
+
+
 class TestIndexRefineRangeSearch(unittest.TestCase):
 
     def do_test(self, factory_string):
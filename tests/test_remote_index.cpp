@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexShards.h>
+#include <faiss/RemoteIndex.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16;
+const size_t nb = 3000, nq = 100, k = 5;
+
+/// calls the server in-process, optionally after a delay
+struct LocalTransport : faiss::RemoteIndexTransport {
+    std::shared_ptr<faiss::Index> index;
+    faiss::RemoteIndexServer server;
+    int delay_ms = 0;
+
+    explicit LocalTransport(std::shared_ptr<faiss::Index> index)
+            : index(index), server(index.get()) {}
+
+    bool request(
+            const void* req,
+            size_t req_size,
+            const std::function<bool(const char*, size_t)>& on_reply)
+            override {
+        if (delay_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        }
+        std::vector<uint8_t> reply;
+        server.handle_request((const char*)req, req_size, reply);
+        return on_reply((const char*)reply.data(), reply.size());
+    }
+};
+
+std::shared_ptr<faiss::Index> make_index(size_t n, int seed) {
+    std::vector<float> xb(n * d);
+    faiss::float_rand(xb.data(), xb.size(), seed);
+    auto index = std::make_shared<faiss::IndexFlatL2>(d);
+    index->add(n, xb.data());
+    return index;
+}
+
+std::vector<float> make_queries() {
+    std::vector<float> xq(nq * d);
+    faiss::float_rand(xq.data(), xq.size(), 1234);
+    return xq;
+}
+
+} // namespace
+
+TEST(RemoteIndex, same_results) {
+    auto index = make_index(nb, 1);
+    auto transport = std::make_shared<LocalTransport>(index);
+    faiss::RemoteIndex remote(transport);
+    EXPECT_EQ(remote.d, d);
+    EXPECT_EQ(remote.ntotal, nb);
+    remote.batch_size = 7; // several requests in flight
+
+    auto xq = make_queries();
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    index->search(nq, xq.data(), k, Dref.data(), Iref.data());
+    remote.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    // small batches are not searched with BLAS
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(Dref[i], D[i], 1e-5);
+    }
+    EXPECT_EQ(remote.n_requests, (nq + 6) / 7);
+
+    std::vector<float> D2(nq * k);
+    std::vector<faiss::idx_t> I2(nq * k);
+    remote.search_async(nq, xq.data(), k, D2.data(), I2.data()).get();
+    EXPECT_EQ(Iref, I2);
+
+    EXPECT_THROW(remote.add(nb, xq.data()), faiss::FaissException);
+}
+
+TEST(RemoteIndex, sharded) {
+    faiss::IndexShards local(d, true, true), coordinator(d, true, true);
+    std::vector<std::shared_ptr<faiss::Index>> shards;
+    for (int i = 0; i < 3; i++) {
+        shards.push_back(make_index(nb, 10 + i));
+        local.add_shard(shards.back().get());
+        coordinator.add_shard(new faiss::RemoteIndex(
+                std::make_shared<LocalTransport>(shards.back())));
+    }
+    coordinator.own_indices = true;
+    coordinator.syncWithSubIndexes();
+    EXPECT_EQ(coordinator.ntotal, 3 * nb);
+
+    auto xq = make_queries();
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    local.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    coordinator.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+}
+
+TEST(RemoteIndex, timeout) {
+    auto fast = std::make_shared<LocalTransport>(make_index(nb, 20));
+    auto slow = std::make_shared<LocalTransport>(make_index(nb, 21));
+
+    faiss::IndexShards coordinator(d, true, true);
+    coordinator.add_shard(new faiss::RemoteIndex(fast));
+    auto slow_remote = new faiss::RemoteIndex(slow);
+    slow_remote->timeout_ms = 50;
+    coordinator.add_shard(slow_remote);
+    coordinator.own_indices = true;
+    slow->delay_ms = 500;
+
+    auto xq = make_queries();
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    fast->index->search(nq, xq.data(), k, Dref.data(), Iref.data());
+    coordinator.search(nq, xq.data(), k, D.data(), I.data());
+    // only the results of the fast shard
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(slow_remote->n_timeouts, 1);
+
+    slow_remote->throw_on_timeout = true;
+    EXPECT_THROW(
+            slow_remote->search(nq, xq.data(), k, D.data(), I.data()),
+            faiss::FaissException);
+
+    // let the late requests finish
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+}
+
+TEST(RemoteIndex, remote_error) {
+    auto transport = std::make_shared<LocalTransport>(make_index(nb, 30));
+    faiss::RemoteIndex remote(transport);
+    // the server rejects queries of the wrong dimension
+    remote.d = d + 1;
+    std::vector<float> xq((d + 1) * 2);
+    std::vector<float> D(2 * k);
+    std::vector<faiss::idx_t> I(2 * k);
+    EXPECT_THROW(
+            remote.search(2, xq.data(), k, D.data(), I.data()),
+            faiss::FaissException);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/partitioning.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+template <class C>
+void test_compare_and_compact(size_t n, bool with_ids) {
+    std::vector<float> vals(n);
+    std::vector<int64_t> ids(n);
+    faiss::float_rand(vals.data(), n, 123 + n);
+    for (size_t j = 0; j < n; j++) {
+        ids[j] = 1000 + 3 * j;
+    }
+    const float thresh = 0.3;
+    const int64_t id0 = 77;
+
+    std::vector<float> out_vals(n);
+    std::vector<int64_t> out_ids(n);
+    size_t nout = faiss::compare_and_compact<C>(
+            n,
+            vals.data(),
+            with_ids ? ids.data() : nullptr,
+            id0,
+            thresh,
+            out_vals.data(),
+            out_ids.data());
+
+    size_t nref = 0;
+    for (size_t j = 0; j < n; j++) {
+        if (C::cmp(thresh, vals[j])) {
+            ASSERT_LT(nref, nout);
+            EXPECT_EQ(out_vals[nref], vals[j]);
+            EXPECT_EQ(out_ids[nref], with_ids ? ids[j] : id0 + j);
+            nref++;
+        }
+    }
+    EXPECT_EQ(nout, nref);
+}
+
+/// check that the results are sorted with the ties ordered by id
+void check_stable_order(
+        bool is_similarity,
+        size_t nq,
+        size_t k,
+        const float* D,
+        const faiss::idx_t* I) {
+    for (size_t i = 0; i < nq; i++) {
+        for (size_t j = 1; j < k; j++) {
+            const float* Di = D + i * k;
+            const faiss::idx_t* Ii = I + i * k;
+            if (Ii[j] < 0) {
+                continue;
+            }
+            if (is_similarity) {
+                ASSERT_GE(Di[j - 1], Di[j]);
+            } else {
+                ASSERT_LE(Di[j - 1], Di[j]);
+            }
+            if (Di[j - 1] == Di[j]) {
+                ASSERT_LT(Ii[j - 1], Ii[j]);
+            }
+        }
+    }
+}
+
+void test_knn(faiss::MetricType metric) {
+    const size_t d = 16, nb = 5000, nq = 30, k = 1000;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1234);
+    faiss::float_rand(xq.data(), xq.size(), 4567);
+    // duplicate vectors, to get ties
+    for (size_t j = 0; j < nb; j += 7) {
+        memcpy(xb.data() + j * d, xb.data(), sizeof(float) * d);
+    }
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<int64_t> I(nq * k), Iref(nq * k);
+    auto search = [&](float* dis, int64_t* ids) {
+        if (metric == faiss::METRIC_L2) {
+            faiss::knn_L2sqr(
+                    xq.data(), xb.data(), d, nq, nb, k, dis, ids, nullptr);
+        } else {
+            faiss::knn_inner_product(
+                    xq.data(), xb.data(), d, nq, nb, k, dis, ids);
+        }
+    };
+
+    int bak = faiss::distance_compute_min_k_reservoir;
+    faiss::distance_compute_min_k_reservoir = k + 1;
+    search(Dref.data(), Iref.data());
+    faiss::distance_compute_min_k_reservoir = 100;
+    search(D.data(), I.data());
+    faiss::distance_compute_min_k_reservoir = bak;
+
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(D[i], Dref[i], 1e-5);
+    }
+    check_stable_order(
+            metric == faiss::METRIC_INNER_PRODUCT, nq, k, D.data(), I.data());
+}
+
+} // namespace
+
+TEST(ReservoirTopK, compare_and_compact) {
+    for (size_t n : {0, 1, 7, 8, 15, 16, 17, 33, 1000}) {
+        for (bool with_ids : {false, true}) {
+            test_compare_and_compact<faiss::CMax<float, int64_t>>(n, with_ids);
+            test_compare_and_compact<faiss::CMin<float, int64_t>>(n, with_ids);
+        }
+    }
+}
+
+TEST(ReservoirTopK, knn_L2sqr) {
+    test_knn(faiss::METRIC_L2);
+}
+
+TEST(ReservoirTopK, knn_inner_product) {
+    test_knn(faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(ReservoirTopK, range_search) {
+    const size_t d = 8, nb = 3000, nq = 10;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 12);
+    faiss::float_rand(xq.data(), xq.size(), 34);
+    const float radius = 0.4;
+
+    faiss::RangeSearchResult res(nq);
+    faiss::range_search_L2sqr(xq.data(), xb.data(), d, nq, nb, radius, &res);
+    for (size_t i = 0; i < nq; i++) {
+        size_t r = res.lims[i];
+        for (size_t j = 0; j < nb; j++) {
+            float dis = faiss::fvec_L2sqr(
+                    xq.data() + i * d, xb.data() + j * d, d);
+            if (dis < radius) {
+                // the results are in increasing id order
+                ASSERT_LT(r, res.lims[i + 1]);
+                EXPECT_EQ(res.labels[r], j);
+                EXPECT_NEAR(res.distances[r], dis, 1e-5);
+                r++;
+            }
+        }
+        EXPECT_EQ(r, res.lims[i + 1]);
+    }
+}
+
+TEST(ReservoirTopK, IVF) {
+    const size_t d = 16, nb = 10000, nq = 20, k = 300;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index_flat(&quantizer, d, 16);
+    faiss::IndexFlatL2 quantizer_pq(d);
+    faiss::IndexIVFPQ index_pq(&quantizer_pq, d, 16, 4, 8);
+    faiss::IDSelectorRange sel(1000, 7000);
+
+    for (faiss::IndexIVF* index :
+         {(faiss::IndexIVF*)&index_flat, (faiss::IndexIVF*)&index_pq}) {
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+        for (bool with_sel : {false, true}) {
+            faiss::SearchParametersIVF params;
+            params.nprobe = 4;
+            params.sel = with_sel ? &sel : nullptr;
+
+            std::vector<float> D(nq * k), Dref(nq * k);
+            std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+            int bak = faiss::distance_compute_min_k_reservoir;
+            faiss::distance_compute_min_k_reservoir = k + 1;
+            index->search(
+                    nq, xq.data(), k, Dref.data(), Iref.data(), &params);
+            faiss::distance_compute_min_k_reservoir = 100;
+            index->search(nq, xq.data(), k, D.data(), I.data(), &params);
+            faiss::distance_compute_min_k_reservoir = bak;
+
+            for (size_t i = 0; i < nq * k; i++) {
+                EXPECT_EQ(D[i], Dref[i]);
+                EXPECT_EQ(I[i] < 0, Iref[i] < 0);
+                if (with_sel && I[i] >= 0) {
+                    EXPECT_TRUE(sel.is_member(I[i]));
+                }
+            }
+            check_stable_order(false, nq, k, D.data(), I.data());
+        }
+    }
+}
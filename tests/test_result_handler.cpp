@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/ResultHandler.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+using C = faiss::CMax<float, int64_t>;
+
+const size_t n = 1000, k = 10;
+
+struct Data {
+    std::vector<float> dis;
+    std::vector<int64_t> ids;
+
+    Data() : dis(n), ids(n) {
+        faiss::float_rand(dis.data(), n, 123);
+        for (size_t j = 0; j < n; j++) {
+            ids[j] = 5 * j + 1;
+        }
+    }
+};
+
+/// fill the results of 2 queries, one result at a time and by blocks
+template <class BlockResultHandler>
+void fill_results(BlockResultHandler& bh, const Data& data, bool with_ids) {
+    typename BlockResultHandler::SingleResultHandler resi(bh);
+    resi.begin(0);
+    for (size_t j = 0; j < n; j++) {
+        resi.add_result(data.dis[j], with_ids ? data.ids[j] : 7 + j);
+    }
+    resi.end();
+    resi.begin(1);
+    // uneven blocks
+    for (size_t j0 = 0; j0 < n; j0 += 97) {
+        size_t nb = std::min(n - j0, size_t(97));
+        resi.add_results(
+                nb,
+                data.dis.data() + j0,
+                with_ids ? data.ids.data() + j0 : nullptr,
+                7 + j0);
+    }
+    resi.end();
+}
+
+} // namespace
+
+TEST(ResultHandler, heap_add_results) {
+    Data data;
+    for (bool with_ids : {false, true}) {
+        std::vector<float> D(2 * k);
+        std::vector<int64_t> I(2 * k);
+        faiss::HeapBlockResultHandler<C> bh(2, D.data(), I.data(), k);
+        fill_results(bh, data, with_ids);
+        for (size_t j = 0; j < k; j++) {
+            EXPECT_EQ(D[j], D[k + j]);
+            EXPECT_EQ(I[j], I[k + j]);
+        }
+    }
+}
+
+TEST(ResultHandler, top1_add_results) {
+    Data data;
+    for (bool with_ids : {false, true}) {
+        std::vector<float> D(2);
+        std::vector<int64_t> I(2);
+        faiss::Top1BlockResultHandler<C> bh(2, D.data(), I.data());
+        fill_results(bh, data, with_ids);
+        EXPECT_EQ(D[0], D[1]);
+        EXPECT_EQ(I[0], I[1]);
+    }
+}
+
+TEST(ResultHandler, range_add_results) {
+    Data data;
+    for (bool with_ids : {false, true}) {
+        faiss::RangeSearchResult res(2);
+        {
+            faiss::RangeSearchBlockResultHandler<C> bh(&res, 0.1);
+            fill_results(bh, data, with_ids);
+        }
+        size_t nres = res.lims[1];
+        EXPECT_GT(nres, 0);
+        EXPECT_EQ(res.lims[2], 2 * nres);
+        for (size_t j = 0; j < nres; j++) {
+            EXPECT_EQ(res.distances[j], res.distances[nres + j]);
+            EXPECT_EQ(res.labels[j], res.labels[nres + j]);
+        }
+    }
+}
+
+namespace {
+
+/// 3 partial results with overlapping queries: partial result j has 2
+/// results for the queries that are multiples of j + 2. Enough queries and
+/// results for the parallel code paths of the merge.
+const size_t merge_nq = 100000;
+
+std::vector<faiss::RangeSearchPartialResult*> make_partial_results(
+        faiss::RangeSearchResult* res) {
+    res->buffer_size = 1000;
+    std::vector<faiss::RangeSearchPartialResult*> pres;
+    for (int j = 0; j < 3; j++) {
+        pres.push_back(new faiss::RangeSearchPartialResult(res));
+        for (size_t q = 0; q < merge_nq; q += j + 2) {
+            faiss::RangeQueryResult& qres = pres[j]->new_result(q);
+            qres.add(q + 0.5, 10 * q + 2 * j);
+            qres.add(q + 0.5, 10 * q + 2 * j + 1);
+        }
+    }
+    return pres;
+}
+
+} // namespace
+
+TEST(ResultHandler, range_merge) {
+    faiss::RangeSearchResult res(merge_nq);
+    auto pres = make_partial_results(&res);
+    faiss::RangeSearchPartialResult::merge(pres);
+    EXPECT_EQ(pres[0], nullptr);
+
+    EXPECT_EQ(res.lims[0], 0);
+    for (size_t q = 0; q < merge_nq; q++) {
+        // the results are in the order of the partial results
+        std::vector<int64_t> expected;
+        for (int j = 0; j < 3; j++) {
+            if (q % (j + 2) == 0) {
+                expected.push_back(10 * q + 2 * j);
+                expected.push_back(10 * q + 2 * j + 1);
+            }
+        }
+        ASSERT_EQ(res.lims[q + 1] - res.lims[q], expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(res.labels[res.lims[q] + i], expected[i]);
+            EXPECT_EQ(res.distances[res.lims[q] + i], q + 0.5);
+        }
+    }
+}
+
+TEST(ResultHandler, range_merge_callback) {
+    faiss::RangeSearchResult ref(merge_nq);
+    auto pres_ref = make_partial_results(&ref);
+    faiss::RangeSearchPartialResult::merge(pres_ref);
+
+    faiss::RangeSearchResult res(merge_nq);
+    std::vector<std::atomic<int64_t>> nres(merge_nq), sum_labels(merge_nq);
+    std::atomic<bool> distances_ok(true);
+    res.result_callback = [&](int64_t qno,
+                              size_t n,
+                              const int64_t* labels,
+                              const float* distances) {
+        nres[qno] += n;
+        for (size_t i = 0; i < n; i++) {
+            sum_labels[qno] += labels[i];
+            if (distances[i] != qno + 0.5) {
+                distances_ok = false;
+            }
+        }
+    };
+    auto pres = make_partial_results(&res);
+    faiss::RangeSearchPartialResult::merge(pres);
+
+    // nothing is materialized, but the limits are set
+    EXPECT_EQ(res.labels, nullptr);
+    EXPECT_EQ(res.distances, nullptr);
+    EXPECT_TRUE(distances_ok);
+    for (size_t q = 0; q <= merge_nq; q++) {
+        ASSERT_EQ(res.lims[q], ref.lims[q]);
+    }
+    for (size_t q = 0; q < merge_nq; q++) {
+        EXPECT_EQ(nres[q], ref.lims[q + 1] - ref.lims[q]);
+        int64_t sum = 0;
+        for (size_t i = ref.lims[q]; i < ref.lims[q + 1]; i++) {
+            sum += ref.labels[i];
+        }
+        EXPECT_EQ(sum_labels[q], sum);
+    }
+}
+
+TEST(ResultHandler, reservoir_add_results) {
+    Data data;
+    const size_t kr = 200;
+    for (bool with_ids : {false, true}) {
+        std::vector<float> D(2 * kr);
+        std::vector<int64_t> I(2 * kr);
+        faiss::ReservoirBlockResultHandler<C> bh(2, D.data(), I.data(), kr);
+        fill_results(bh, data, with_ids);
+        for (size_t j = 0; j < kr; j++) {
+            EXPECT_EQ(D[j], D[kr + j]);
+            EXPECT_EQ(I[j], I[kr + j]);
+        }
+    }
+}
+
+TEST(ResultHandler, knn_seq_selector) {
+    // few queries, so that the sequential search is used
+    const size_t d = 12, nb = 1000, nq = 3;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::float_rand(xq.data(), xq.size(), 2);
+    faiss::IDSelectorRange sel(100, 600);
+
+    std::vector<float> D(nq * k), Dsub(nq * k);
+    std::vector<int64_t> I(nq * k), Isub(nq * k);
+    faiss::knn_L2sqr(
+            xq.data(),
+            xb.data(),
+            d,
+            nq,
+            nb,
+            k,
+            D.data(),
+            I.data(),
+            nullptr,
+            &sel);
+    // the same search on the subset of vectors
+    faiss::knn_L2sqr(
+            xq.data(),
+            xb.data() + 100 * d,
+            d,
+            nq,
+            500,
+            k,
+            Dsub.data(),
+            Isub.data());
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_EQ(I[i], Isub[i] + 100);
+        EXPECT_NEAR(D[i], Dsub[i], 1e-5);
+    }
+}
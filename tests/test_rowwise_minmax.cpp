@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexRowwiseMinMax.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 32;
+const size_t nb = 1000;
+const size_t nq = 10;
+
+/// the distance computer gives the distances to the decoded vectors
+void test_distance_computer(const char* key, faiss::MetricType metric) {
+    SCOPED_TRACE(key);
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_randn(xb.data(), xb.size(), 123);
+    faiss::float_randn(xq.data(), xq.size(), 456);
+    for (size_t i = 0; i < nb * d; i++) {
+        xb[i] = xb[i] * (1 + i / d % 7) + i / d % 5;
+    }
+
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, key, metric));
+    auto minmax = dynamic_cast<faiss::IndexRowwiseMinMaxBase*>(index.get());
+    ASSERT_TRUE(minmax);
+    index->train(nb, xb.data());
+    std::vector<uint8_t> codes(nb * index->sa_code_size());
+    index->sa_encode(nb, xb.data(), codes.data());
+    std::vector<float> decoded(nb * d);
+    index->sa_decode(nb, codes.data(), decoded.data());
+
+    std::unique_ptr<faiss::FlatCodesDistanceComputer> dc(
+            minmax->get_FlatCodesDistanceComputer(codes.data()));
+    for (size_t q = 0; q < nq; q++) {
+        const float* xqi = xq.data() + q * d;
+        dc->set_query(xqi);
+        for (size_t i = 0; i < nb; i++) {
+            const float* y = decoded.data() + i * d;
+            float ref = metric == faiss::METRIC_L2
+                    ? faiss::fvec_L2sqr(xqi, y, d)
+                    : faiss::fvec_inner_product(xqi, y, d);
+            ASSERT_NEAR((*dc)(i), ref, 1e-3 * (1 + std::fabs(ref)));
+        }
+    }
+    float ref = metric == faiss::METRIC_L2
+            ? faiss::fvec_L2sqr(decoded.data() + 3 * d, decoded.data(), d)
+            : faiss::fvec_inner_product(
+                      decoded.data() + 3 * d, decoded.data(), d);
+    EXPECT_NEAR(dc->symmetric_dis(3, 0), ref, 1e-3 * (1 + std::fabs(ref)));
+}
+
+} // namespace
+
+TEST(RowwiseMinMax, distance_computer_L2) {
+    test_distance_computer("MinMax,SQ8", faiss::METRIC_L2);
+    test_distance_computer("MinMaxFP16,SQ8", faiss::METRIC_L2);
+    test_distance_computer("MinMax,PQ8x4", faiss::METRIC_L2);
+    test_distance_computer("MinMaxFP16,SQfp16", faiss::METRIC_L2);
+}
+
+TEST(RowwiseMinMax, distance_computer_IP) {
+    test_distance_computer("MinMax,SQ8", faiss::METRIC_INNER_PRODUCT);
+    test_distance_computer("MinMaxFP16,PQ8x4", faiss::METRIC_INNER_PRODUCT);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/impl/ResidualQuantizer.h>
+#include <faiss/impl/residual_quantizer_encode_steps.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 32, nt = 5000, nb = 2000;
+
+std::vector<uint8_t> encode(
+        const faiss::ResidualQuantizer& rq,
+        const std::vector<float>& xb) {
+    std::vector<uint8_t> codes(rq.code_size * nb);
+    rq.compute_codes(xb.data(), codes.data(), nb);
+    return codes;
+}
+
+} // namespace
+
+// the tiling of the beam search should not change the codes
+TEST(RQEncodeSteps, tiling) {
+    std::vector<float> xt(nt * d), xb(nb * d);
+    faiss::float_rand(xt.data(), xt.size(), 123);
+    faiss::float_rand(xb.data(), xb.size(), 456);
+
+    faiss::ResidualQuantizer rq(d, 4, 6);
+    rq.max_beam_size = 16;
+    rq.train(nt, xt.data());
+
+    size_t tile_nfloat = faiss::beam_search_tile_nfloat;
+    std::vector<uint8_t> ref = encode(rq, xb);
+
+    // one vector per tile
+    faiss::beam_search_tile_nfloat = 1;
+    std::vector<uint8_t> codes1 = encode(rq, xb);
+    // tiles that do not divide nb
+    faiss::beam_search_tile_nfloat = 37 * 16 * 64;
+    std::vector<uint8_t> codes37 = encode(rq, xb);
+    faiss::beam_search_tile_nfloat = tile_nfloat;
+
+    EXPECT_EQ(ref, codes1);
+    EXPECT_EQ(ref, codes37);
+
+    // the LUT-based encoding uses the per-thread buffers
+    rq.use_beam_LUT = 1;
+    rq.compute_codebook_tables();
+    std::vector<uint8_t> codes_lut = encode(rq, xb);
+    size_t ndiff = 0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        ndiff += ref[i] != codes_lut[i];
+    }
+    // may differ on ties because of the different rounding
+    EXPECT_LT(ndiff, ref.size() / 100);
+}
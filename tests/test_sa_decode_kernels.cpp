@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/IndexRowwiseMinMax.h>
+#include <faiss/impl/sa_decode_kernels.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int nt = 2000;
+
+/// few k-means iterations, the codebooks just need to be trained
+void set_niter(faiss::Index* index) {
+    if (auto minmax = dynamic_cast<faiss::IndexRowwiseMinMaxBase*>(index)) {
+        set_niter(minmax->index);
+    } else if (auto refine = dynamic_cast<faiss::IndexRefine*>(index)) {
+        set_niter(refine->base_index);
+        set_niter(refine->refine_index);
+    } else if (auto ipq = dynamic_cast<faiss::IndexPQ*>(index)) {
+        ipq->pq.cp.niter = 4;
+    } else if (auto ivfpq = dynamic_cast<faiss::IndexIVFPQ*>(index)) {
+        ivfpq->cp.niter = 4;
+        ivfpq->pq.cp.niter = 4;
+    }
+}
+
+std::unique_ptr<faiss::Index> make_index(
+        int d,
+        const char* key,
+        bool by_residual = true) {
+    std::vector<float> xt(nt * d);
+    faiss::rand_smooth_vectors(nt, d, xt.data(), 1234);
+    std::unique_ptr<faiss::Index> index(faiss::index_factory(d, key));
+    set_niter(index.get());
+    if (auto ivf = dynamic_cast<faiss::IndexIVF*>(index.get())) {
+        ivf->by_residual = by_residual;
+    }
+    index->train(nt, xt.data());
+    return index;
+}
+
+/// sa_decode with and without the kernels
+void test_sa_decode(
+        int d,
+        const char* key,
+        bool expect_kernel,
+        bool by_residual = true) {
+    SCOPED_TRACE(key);
+    auto index = make_index(d, key, by_residual);
+    const faiss::Index* decoded = index.get();
+    if (auto minmax =
+                dynamic_cast<faiss::IndexRowwiseMinMaxBase*>(index.get())) {
+        decoded = minmax->index;
+    }
+    EXPECT_EQ(faiss::SaDecodeKernel(decoded).is_available(), expect_kernel);
+
+    int n = 500;
+    std::vector<float> x(n * d);
+    faiss::rand_smooth_vectors(n, d, x.data(), 4321);
+    std::vector<uint8_t> codes(n * index->sa_code_size());
+    index->sa_encode(n, x.data(), codes.data());
+
+    std::vector<float> ref(n * d), recons(n * d);
+    faiss::sa_decode_use_kernels = false;
+    index->sa_decode(n, codes.data(), ref.data());
+    faiss::sa_decode_use_kernels = true;
+    index->sa_decode(n, codes.data(), recons.data());
+    for (int i = 0; i < n * d; i++) {
+        ASSERT_NEAR(ref[i], recons[i], 1e-5);
+    }
+}
+
+} // namespace
+
+TEST(SaDecodeKernel, sa_decode) {
+    test_sa_decode(64, "PQ16np", true);
+    test_sa_decode(128, "PQ16np", true);
+    test_sa_decode(96, "IVF256,PQ12np", true);
+    test_sa_decode(64, "IVF1024,PQ8np", true);
+    test_sa_decode(64, "IVF100,PQ16np", true);
+    test_sa_decode(64, "IVF100,PQ16np", true, false);
+    test_sa_decode(64, "MinMax,IVF256,PQ16np", true);
+    test_sa_decode(64, "MinMaxFP16,PQ32np", true);
+    // no kernel: the generic decoder
+    test_sa_decode(40, "PQ20np", false);
+    test_sa_decode(64, "PQ16x4np", false);
+    test_sa_decode(64, "IVF256,PQ64np", false);
+}
+
+TEST(SaDecodeKernel, ivfpq_reconstruct_batch) {
+    int d = 64, nb = 2000;
+    auto index = make_index(d, "IVF64,PQ16np");
+    auto ivfpq = dynamic_cast<faiss::IndexIVFPQ*>(index.get());
+    ivfpq->set_direct_map_type(faiss::DirectMap::Hashtable);
+    std::vector<float> xb(nb * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 345);
+    index->add(nb, xb.data());
+
+    std::vector<faiss::idx_t> keys = {3, 1999, 0, 3, 1024};
+    std::vector<float> recons(keys.size() * d), ref(d);
+    index->reconstruct_batch(keys.size(), keys.data(), recons.data());
+    for (size_t i = 0; i < keys.size(); i++) {
+        index->reconstruct(keys[i], ref.data());
+        for (int j = 0; j < d; j++) {
+            ASSERT_NEAR(ref[j], recons[i * d + j], 1e-5);
+        }
+    }
+}
+
+TEST(SaDecodeKernel, refine) {
+    int d = 64, nb = 2000, nq = 20, k = 10;
+    auto index = make_index(d, "IVF32,PQ8np,Refine(PQ32np)");
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::rand_smooth_vectors(nb, d, xb.data(), 345);
+    faiss::rand_smooth_vectors(nq, d, xq.data(), 678);
+    index->add(nb, xb.data());
+
+    // the distances of the reconstructions instead of the PQ tables
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    faiss::sa_decode_use_kernels = false;
+    index->search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    faiss::sa_decode_use_kernels = true;
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(D_ref[i], D[i], 1e-3 * (1 + D_ref[i]));
+    }
+}
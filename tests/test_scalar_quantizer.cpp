@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/ScalarQuantizer.h>
+#include <faiss/index_factory.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+using faiss::ScalarQuantizer;
+
+// the distance computers with a compile-time dimension must match the
+// generic ones
+void test_fixed_dim(
+        size_t d,
+        ScalarQuantizer::QuantizerType qtype,
+        faiss::MetricType metric) {
+    size_t nb = 200, nq = 10;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    ScalarQuantizer sq(d, qtype);
+    sq.train(nb, xb.data());
+    std::vector<uint8_t> codes(nb * sq.code_size);
+    sq.compute_codes(xb.data(), codes.data(), nb);
+
+    std::unique_ptr<ScalarQuantizer::SQDistanceComputer> dcs[2];
+    for (int fixed = 0; fixed < 2; fixed++) {
+        faiss::sq_fixed_dim_distance_computers = fixed;
+        dcs[fixed].reset(sq.get_distance_computer(metric));
+        dcs[fixed]->codes = codes.data();
+        dcs[fixed]->code_size = sq.code_size;
+    }
+    faiss::sq_fixed_dim_distance_computers = true;
+
+    for (size_t q = 0; q < nq; q++) {
+        dcs[0]->set_query(xq.data() + q * d);
+        dcs[1]->set_query(xq.data() + q * d);
+        for (size_t i = 0; i < nb; i++) {
+            float ref = (*dcs[0])(i);
+            EXPECT_NEAR((*dcs[1])(i), ref, 1e-5 * std::abs(ref) + 1e-5);
+        }
+    }
+    EXPECT_NEAR(
+            dcs[1]->symmetric_dis(3, 7),
+            dcs[0]->symmetric_dis(3, 7),
+            1e-3);
+}
+
+// the integer distances with a quantized query must approximate the
+// float ones
+void test_quantize_query(
+        size_t d,
+        ScalarQuantizer::QuantizerType qtype,
+        faiss::MetricType metric) {
+    size_t nb = 500, nq = 10;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    ScalarQuantizer sq(d, qtype);
+    sq.train(nb, xb.data());
+    std::vector<uint8_t> codes(nb * sq.code_size);
+    sq.compute_codes(xb.data(), codes.data(), nb);
+
+    std::unique_ptr<ScalarQuantizer::SQDistanceComputer> dcs[2];
+    for (int quantize_query = 0; quantize_query < 2; quantize_query++) {
+        sq.quantize_query = quantize_query;
+        dcs[quantize_query].reset(sq.get_distance_computer(metric));
+        dcs[quantize_query]->codes = codes.data();
+        dcs[quantize_query]->code_size = sq.code_size;
+    }
+
+    for (size_t q = 0; q < nq; q++) {
+        dcs[0]->set_query(xq.data() + q * d);
+        dcs[1]->set_query(xq.data() + q * d);
+        for (size_t i = 0; i < nb; i++) {
+            float ref = (*dcs[0])(i);
+            EXPECT_NEAR((*dcs[1])(i), ref, 1e-2 * std::abs(ref) + 1e-2);
+        }
+    }
+}
+
+// the nearest neighbors are mostly the same with a quantized query
+void test_quantize_query_search(
+        faiss::Index& index,
+        faiss::ScalarQuantizer& sq,
+        size_t d) {
+    size_t nb = 2000, nq = 50, k = 10;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1234);
+    faiss::float_rand(xq.data(), xq.size(), 4567);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D[2];
+    std::vector<faiss::idx_t> I[2];
+    for (int quantize_query = 0; quantize_query < 2; quantize_query++) {
+        sq.quantize_query = quantize_query;
+        D[quantize_query].resize(nq * k);
+        I[quantize_query].resize(nq * k);
+        index.search(
+                nq,
+                xq.data(),
+                k,
+                D[quantize_query].data(),
+                I[quantize_query].data());
+    }
+
+    size_t nok = 0;
+    for (size_t q = 0; q < nq; q++) {
+        for (size_t j = 0; j < k; j++) {
+            if (I[1][q * k] == I[0][q * k + j]) {
+                nok++;
+                break;
+            }
+        }
+    }
+    EXPECT_GE(nok, nq * 9 / 10);
+}
+
+} // namespace
+
+TEST(ScalarQuantizer, quantize_query_distances) {
+    for (size_t d : {7, 64, 300}) {
+        for (auto qtype :
+             {ScalarQuantizer::QT_8bit, ScalarQuantizer::QT_8bit_uniform}) {
+            test_quantize_query(d, qtype, faiss::METRIC_L2);
+            test_quantize_query(d, qtype, faiss::METRIC_INNER_PRODUCT);
+        }
+    }
+}
+
+TEST(ScalarQuantizer, quantize_query_search) {
+    size_t d = 32;
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        for (auto qtype :
+             {ScalarQuantizer::QT_8bit, ScalarQuantizer::QT_8bit_uniform}) {
+            faiss::IndexScalarQuantizer index(d, qtype, metric);
+            test_quantize_query_search(index, index.sq, d);
+
+            faiss::IndexFlat quantizer(d, metric);
+            faiss::IndexIVFScalarQuantizer ivf(
+                    &quantizer, d, 16, qtype, metric);
+            ivf.nprobe = 4;
+            test_quantize_query_search(ivf, ivf.sq, d);
+        }
+    }
+}
+
+TEST(ScalarQuantizer, fixed_dim_distance_computers) {
+    for (size_t d : {384, 768, 1024}) {
+        for (auto qtype :
+             {ScalarQuantizer::QT_8bit,
+              ScalarQuantizer::QT_4bit,
+              ScalarQuantizer::QT_fp16,
+              ScalarQuantizer::QT_bf16}) {
+            test_fixed_dim(d, qtype, faiss::METRIC_L2);
+            test_fixed_dim(d, qtype, faiss::METRIC_INNER_PRODUCT);
+        }
+    }
+}
+
+namespace {
+
+/// heavy-tailed components
+std::vector<float> heavy_tailed_data(size_t n, size_t d, int seed) {
+    std::vector<float> x(n * d);
+    faiss::float_randn(x.data(), x.size(), seed);
+    for (float& v : x) {
+        v = v * v * v;
+    }
+    return x;
+}
+
+} // namespace
+
+TEST(ScalarQuantizer, nonuniform_distances) {
+    size_t nb = 300, nq = 5;
+    for (size_t d : {7, 32}) {
+        std::vector<float> xb = heavy_tailed_data(nb, d, 123);
+        std::vector<float> xq = heavy_tailed_data(nq, d, 456);
+        for (auto qtype :
+             {ScalarQuantizer::QT_4bit_nonuniform,
+              ScalarQuantizer::QT_8bit_nonuniform}) {
+            ScalarQuantizer sq(d, qtype);
+            sq.train(nb, xb.data());
+            std::vector<uint8_t> codes(nb * sq.code_size);
+            sq.compute_codes(xb.data(), codes.data(), nb);
+            std::vector<float> decoded(nb * d);
+            sq.decode(codes.data(), decoded.data(), nb);
+
+            // the table-based distances are those of the decoded vectors
+            for (auto metric :
+                 {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+                std::unique_ptr<ScalarQuantizer::SQDistanceComputer> dc(
+                        sq.get_distance_computer(metric));
+                dc->codes = codes.data();
+                dc->code_size = sq.code_size;
+                for (size_t q = 0; q < nq; q++) {
+                    dc->set_query(xq.data() + q * d);
+                    for (size_t i = 0; i < nb; i++) {
+                        const float* y = decoded.data() + i * d;
+                        float ref = metric == faiss::METRIC_L2
+                                ? faiss::fvec_L2sqr(xq.data() + q * d, y, d)
+                                : faiss::fvec_inner_product(
+                                          xq.data() + q * d, y, d);
+                        EXPECT_NEAR(
+                                (*dc)(i), ref, 1e-4 * std::abs(ref) + 1e-4);
+                    }
+                }
+                float ref = metric == faiss::METRIC_L2
+                        ? faiss::fvec_L2sqr(
+                                  decoded.data() + 3 * d,
+                                  decoded.data() + 7 * d,
+                                  d)
+                        : faiss::fvec_inner_product(
+                                  decoded.data() + 3 * d,
+                                  decoded.data() + 7 * d,
+                                  d);
+                EXPECT_NEAR(
+                        dc->symmetric_dis(3, 7),
+                        ref,
+                        1e-4 * std::abs(ref) + 1e-4);
+            }
+        }
+    }
+}
+
+TEST(ScalarQuantizer, nonuniform_4bit_error) {
+    // on heavy-tailed data, the learned codebooks have a lower
+    // reconstruction error than the uniform ranges with the same nb of bits
+    size_t d = 16, nb = 5000;
+    std::vector<float> xb = heavy_tailed_data(nb, d, 123);
+    double err[2];
+    int j = 0;
+    for (auto qtype :
+         {ScalarQuantizer::QT_4bit, ScalarQuantizer::QT_4bit_nonuniform}) {
+        ScalarQuantizer sq(d, qtype);
+        sq.train(nb, xb.data());
+        EXPECT_EQ(sq.code_size, d / 2);
+        std::vector<uint8_t> codes(nb * sq.code_size);
+        sq.compute_codes(xb.data(), codes.data(), nb);
+        std::vector<float> decoded(nb * d);
+        sq.decode(codes.data(), decoded.data(), nb);
+        err[j++] = faiss::fvec_L2sqr(xb.data(), decoded.data(), nb * d);
+    }
+    EXPECT_LT(err[1], err[0] / 2);
+}
+
+TEST(ScalarQuantizer, nonuniform_ivf_search) {
+    size_t d = 32, nb = 3000, nq = 50, k = 10;
+    std::vector<float> xb = heavy_tailed_data(nb, d, 123);
+    std::vector<float> xq = heavy_tailed_data(nq, d, 456);
+    faiss::IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> Iref(nq * k), I(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "IVF16,SQ4_nonuniform"));
+    index->train(nb, xb.data());
+    index->add(nb, xb.data());
+    dynamic_cast<faiss::IndexIVF*>(index.get())->nprobe = 16;
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    size_t n1 = 0;
+    for (size_t q = 0; q < nq; q++) {
+        for (size_t j = 0; j < k; j++) {
+            if (I[q * k + j] == Iref[q * k]) {
+                n1++;
+            }
+        }
+    }
+    EXPECT_GE(n1, nq * 8 / 10);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 4000, nq = 40, k = 5;
+
+struct Data {
+    std::vector<float> xb, xq;
+    Data() : xb(d * nb), xq(d * nq) {
+        faiss::float_rand(xb.data(), xb.size(), 123);
+        faiss::float_rand(xq.data(), xq.size(), 456);
+    }
+};
+
+} // namespace
+
+TEST(SearchBudget, ivf) {
+    Data data;
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 16);
+    index.train(nb, data.xb.data());
+    index.add(nb, data.xb.data());
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    std::vector<faiss::SearchCost> costs(nq);
+    faiss::SearchBudget budget;
+    budget.costs = costs.data();
+    faiss::SearchParametersIVF params;
+    params.nprobe = 8;
+    params.budget = &budget;
+
+    // unlimited budget: same results, the full cost is reported
+    std::vector<float> D_ref(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k);
+    faiss::SearchParametersIVF params_ref;
+    params_ref.nprobe = 8;
+    index.search(
+            nq, data.xq.data(), k, D_ref.data(), I_ref.data(), &params_ref);
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(I, I_ref);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_FALSE(costs[i].truncated);
+        EXPECT_EQ(costs[i].fetches, 8);
+        EXPECT_GT(costs[i].ndis, 0);
+        EXPECT_EQ(costs[i].bytes, costs[i].ndis * index.code_size);
+    }
+
+    // at most 300 codes per query
+    costs.assign(nq, faiss::SearchCost());
+    budget.max_ndis = 300;
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_TRUE(costs[i].truncated);
+        EXPECT_EQ(costs[i].ndis, 300);
+        // best-so-far results
+        EXPECT_GE(I[i * k], 0);
+        EXPECT_GE(D[i * k], D_ref[i * k]);
+    }
+
+    // the budget is spent by the previous search
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_EQ(costs[i].ndis, 300);
+        EXPECT_EQ(I[i * k], -1);
+    }
+
+    // at most 2 lists
+    costs.assign(nq, faiss::SearchCost());
+    budget.max_ndis = 0;
+    budget.max_fetches = 2;
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_TRUE(costs[i].truncated);
+        EXPECT_EQ(costs[i].fetches, 2);
+    }
+
+    // deadline in the past
+    costs.assign(nq, faiss::SearchCost());
+    budget.max_fetches = 0;
+    budget.set_timeout(-1);
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_TRUE(costs[i].truncated);
+        EXPECT_EQ(costs[i].ndis, 0);
+    }
+}
+
+TEST(SearchBudget, hnsw) {
+    Data data;
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, data.xb.data());
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    std::vector<faiss::SearchCost> costs(nq);
+    faiss::SearchBudget budget;
+    budget.costs = costs.data();
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    params.budget = &budget;
+
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    size_t max_ndis = 0;
+    for (int i = 0; i < nq; i++) {
+        EXPECT_FALSE(costs[i].truncated);
+        max_ndis = std::max(max_ndis, costs[i].ndis);
+    }
+    ASSERT_GT(max_ndis, 100);
+
+    costs.assign(nq, faiss::SearchCost());
+    budget.max_ndis = 100;
+    faiss::hnsw_stats.reset();
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    int ntruncated = 0;
+    for (int i = 0; i < nq; i++) {
+        ntruncated += costs[i].truncated;
+        // exceeded by at most one round of expansions
+        EXPECT_LT(costs[i].ndis, 100 + 2 * 16 + 1);
+        EXPECT_GE(I[i * k], 0);
+    }
+    EXPECT_GT(ntruncated, 0);
+    EXPECT_EQ(faiss::hnsw_stats.n_budget_stops, ntruncated);
+
+    // the budget requires HNSW search parameters
+    faiss::SearchParameters plain;
+    plain.budget = &budget;
+    EXPECT_THROW(
+            index.search(nq, data.xq.data(), k, D.data(), I.data(), &plain),
+            faiss::FaissException);
+}
+
+TEST(SearchBudget, refine) {
+    Data data;
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat base(&quantizer, d, 16);
+    faiss::IndexFlatL2 refine_index(d);
+    faiss::IndexRefine index(&base, &refine_index);
+    index.train(nb, data.xb.data());
+    index.add(nb, data.xb.data());
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    std::vector<faiss::SearchCost> costs(nq);
+    faiss::SearchBudget budget;
+    budget.costs = costs.data();
+    faiss::IndexRefineSearchParameters params;
+    params.k_factor = 4;
+    params.budget = &budget;
+
+    // only the refinement has a budget: 4 * k candidates refined
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_EQ(costs[i].ndis, 4 * k);
+        EXPECT_FALSE(costs[i].truncated);
+    }
+
+    // the budget is shared with the base search, that scans all the codes
+    costs.assign(nq, faiss::SearchCost());
+    faiss::SearchParametersIVF base_params;
+    base_params.nprobe = 16;
+    base_params.budget = &budget;
+    params.base_index_params = &base_params;
+    budget.max_ndis = nb + 10;
+    index.search(nq, data.xq.data(), k, D.data(), I.data(), &params);
+    for (int i = 0; i < nq; i++) {
+        EXPECT_EQ(costs[i].ndis, nb + 10);
+        EXPECT_TRUE(costs[i].truncated);
+        EXPECT_GE(I[i * k], 0);
+    }
+}
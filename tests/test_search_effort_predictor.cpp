@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/SearchEffortPredictor.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 5000, nt = 300, nq = 200, k = 10;
+
+// fraction of the reference results found
+float recall(
+        const std::vector<faiss::idx_t>& I,
+        const std::vector<faiss::idx_t>& I_ref) {
+    size_t n_found = 0;
+    for (size_t q = 0; q < I.size() / k; q++) {
+        std::unordered_set<faiss::idx_t> ref(
+                I_ref.begin() + q * k, I_ref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_found += ref.count(I[q * k + j]);
+        }
+    }
+    return float(n_found) / I.size();
+}
+
+} // namespace
+
+TEST(SearchEffortPredictor, train) {
+    // log(effort) = 2 * f0 - f1 + 1
+    size_t n = 500;
+    std::vector<float> features(n * 2), efforts(n);
+    faiss::float_rand(features.data(), features.size(), 123);
+    for (size_t i = 0; i < n; i++) {
+        efforts[i] = std::exp(2 * features[2 * i] - features[2 * i + 1] + 1);
+    }
+    faiss::SearchEffortPredictor predictor(2);
+    predictor.train(n, features.data(), efforts.data(), 0);
+    EXPECT_NEAR(predictor.weights[0], 2, 1e-3);
+    EXPECT_NEAR(predictor.weights[1], -1, 1e-3);
+    EXPECT_NEAR(predictor.weights[2], 1, 1e-3);
+    float f[2] = {0.5, 0.25};
+    EXPECT_NEAR(predictor.predict(f), std::exp(1.75), 1e-2);
+    predictor.max_effort = 2;
+    EXPECT_EQ(predictor.predict(f), 2);
+}
+
+TEST(SearchEffortPredictor, ivf) {
+    std::vector<float> xb(d * nb), xt(d * nt), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::float_rand(xt.data(), xt.size(), 2);
+    faiss::float_rand(xq.data(), xq.size(), 3);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 64);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    faiss::SearchEffortPredictor predictor =
+            faiss::ivflib::train_ivf_nprobe_predictor(
+                    &index, nt, xt.data(), k, 0.9, 32);
+    EXPECT_EQ(predictor.max_effort, 32);
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    faiss::SearchParametersIVF params;
+    params.nprobe = 32;
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I_ref.data(), &params);
+    size_t nlist_ref = faiss::indexIVF_stats.nlist;
+    EXPECT_EQ(nlist_ref, nq * 32);
+
+    params.nprobe_predictor = &predictor;
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    // fewer lists scanned on average, for a recall close to the target
+    EXPECT_LT(faiss::indexIVF_stats.nlist, nlist_ref / 2);
+    EXPECT_GT(recall(I, I_ref), 0.8);
+
+    // the scale trades recall for cost
+    predictor.scale = 2;
+    faiss::indexIVF_stats.reset();
+    std::vector<faiss::idx_t> I2(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I2.data(), &params);
+    EXPECT_GE(recall(I2, I_ref), recall(I, I_ref));
+}
+
+TEST(SearchEffortPredictor, hnsw) {
+    std::vector<float> xb(d * nb), xt(d * nt), xq(d * nq);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::float_rand(xt.data(), xt.size(), 2);
+    faiss::float_rand(xq.data(), xq.size(), 3);
+    faiss::IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 128;
+    faiss::SearchEffortPredictor predictor =
+            faiss::train_hnsw_effort_predictor(
+                    &index, nt, xt.data(), k, 0.9, 4, &params);
+
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    faiss::hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I_ref.data(), &params);
+    size_t ndis_ref = faiss::hnsw_stats.ndis;
+
+    params.effort_predictor = &predictor;
+    std::vector<float> features(nq * 4);
+    params.effort_features = features.data();
+    faiss::hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_GT(faiss::hnsw_stats.n_early_stops, 0);
+    EXPECT_LT(faiss::hnsw_stats.ndis, ndis_ref);
+    EXPECT_GT(recall(I, I_ref), 0.8);
+    // the best distance only improves
+    for (int q = 0; q < nq; q++) {
+        for (int j = 1; j < 4; j++) {
+            EXPECT_LE(features[q * 4 + j], features[q * 4 + j - 1]);
+        }
+    }
+}
@@ -0,0 +1,144 @@
+# Copyright (c) Meta Platforms, Inc. and affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import unittest
+
+import numpy as np
+import faiss
+
+from faiss.contrib.datasets import SyntheticDataset
+
+
+def iterate_pages(index, xq, page_size, npages, params=None):
+    """ collect npages pages of results for each query """
+    Ds, Is = [], []
+    for q in xq:
+        it = index.search_iterator(q, params=params)
+        D = []
+        I = []
+        for _ in range(npages):
+            Dp, Ip = it.next(page_size)
+            D.append(Dp)
+            I.append(Ip)
+        Ds.append(np.hstack(D))
+        Is.append(np.hstack(I))
+    return Ds, Is
+
+
+class TestHNSWIterator(unittest.TestCase):
+
+    def do_test(self, metric):
+        ds = SyntheticDataset(32, 0, 2000, 20)
+        xb = ds.get_database()
+        xq = ds.get_queries()
+        index = faiss.IndexHNSWFlat(ds.d, 16, metric)
+        index.add(xb)
+
+        Ds, Is = iterate_pages(index, xq, 10, 5)
+        _, Igt = faiss.knn(xq, xb, 50, metric=metric)
+        recalls = []
+        for q in range(len(xq)):
+            D, I = Ds[q], Is[q]
+            # no duplicates across the pages
+            self.assertEqual(len(set(I)), 50)
+            # each page is sorted
+            Dp = D.reshape(5, 10)
+            if metric == faiss.METRIC_L2:
+                self.assertTrue(np.all(Dp[:, 1:] >= Dp[:, :-1]))
+                Dref = ((xb[I] - xq[q]) ** 2).sum(1)
+            else:
+                self.assertTrue(np.all(Dp[:, 1:] <= Dp[:, :-1]))
+                Dref = xb[I] @ xq[q]
+            np.testing.assert_allclose(D, Dref, rtol=1e-4, atol=1e-4)
+            recalls.append(len(set(I) & set(Igt[q])) / 50)
+        self.assertGreater(np.mean(recalls), 0.8)
+
+    def test_L2(self):
+        self.do_test(faiss.METRIC_L2)
+
+    def test_IP(self):
+        self.do_test(faiss.METRIC_INNER_PRODUCT)
+
+    def test_exhaust(self):
+        ds = SyntheticDataset(16, 0, 300, 3)
+        index = faiss.IndexHNSWFlat(ds.d, 8)
+        index.add(ds.get_database())
+        it = index.search_iterator(ds.get_queries()[0])
+        D, I = it.next(1000)
+        # all the connected nodes are returned once
+        self.assertLessEqual(len(I), 300)
+        self.assertGreater(len(I), 290)
+        self.assertEqual(len(set(I)), len(I))
+        D, I = it.next(10)
+        self.assertEqual(len(I), 0)
+
+    def test_selector(self):
+        ds = SyntheticDataset(32, 0, 1000, 10)
+        index = faiss.IndexHNSWFlat(ds.d, 16)
+        index.add(ds.get_database())
+        sel = faiss.IDSelectorRange(0, 500)
+        params = faiss.SearchParametersHNSW(sel=sel)
+        Ds, Is = iterate_pages(index, ds.get_queries(), 10, 3, params)
+        for I in Is:
+            self.assertEqual(len(I), 30)
+            self.assertTrue(np.all(I < 500))
+
+
+class TestIVFIterator(unittest.TestCase):
+
+    def test_first_page(self):
+        ds = SyntheticDataset(32, 2000, 5000, 20)
+        index = faiss.index_factory(ds.d, "IVF32,Flat")
+        index.train(ds.get_train())
+        index.add(ds.get_database())
+        index.nprobe = 4
+        xq = ds.get_queries()
+
+        # the first page is the result of search
+        Dref, Iref = index.search(xq, 10)
+        Ds, Is = iterate_pages(index, xq, 10, 1)
+        for q in range(len(xq)):
+            np.testing.assert_allclose(Ds[q], Dref[q], rtol=1e-5)
+            np.testing.assert_array_equal(Is[q], Iref[q])
+
+    def test_pages(self):
+        ds = SyntheticDataset(32, 2000, 5000, 20)
+        index = faiss.index_factory(ds.d, "IVF32,SQ8")
+        index.train(ds.get_train())
+        index.add(ds.get_database())
+        index.nprobe = 2
+        xq = ds.get_queries()
+
+        Ds, Is = iterate_pages(index, xq, 100, 20)
+        for q in range(len(xq)):
+            self.assertEqual(len(Is[q]), 2000)
+            self.assertEqual(len(set(Is[q])), 2000)
+            # each page is sorted
+            for p in range(20):
+                D = Ds[q][p * 100:(p + 1) * 100]
+                self.assertTrue(np.all(D[1:] >= D[:-1]))
+
+        # an exhausted iterator returns nothing
+        it = index.search_iterator(xq[0])
+        D, I = it.next(10000)
+        self.assertEqual(len(I), ds.nb)
+        D, I = it.next(10)
+        self.assertEqual(len(I), 0)
+
+    def test_selector(self):
+        ds = SyntheticDataset(32, 2000, 5000, 10)
+        index = faiss.index_factory(ds.d, "IVF32,Flat")
+        index.train(ds.get_train())
+        index.add(ds.get_database())
+        sel = faiss.IDSelectorRange(1000, 2000)
+        params = faiss.SearchParametersIVF(sel=sel, nprobe=4)
+        Ds, Is = iterate_pages(index, ds.get_queries(), 50, 3, params)
+        for I in Is:
+            self.assertTrue(np.all((I >= 1000) & (I < 2000)))
+
+    def test_not_implemented(self):
+        index = faiss.IndexLSH(16, 32)
+        with self.assertRaises(RuntimeError):
+            index.search_iterator(np.zeros(16, dtype='float32'))
@@ -10,6 +10,8 @@ import unittest
 import sys
 import gc
 
+from multiprocessing.pool import ThreadPool
+
 from faiss.contrib import datasets
 from faiss.contrib.evaluation import sort_range_res_2, check_ref_range_results
 
@@ -281,6 +283,9 @@ class TestSelector(unittest.TestCase):
         sel = faiss.IDSelectorBatch(subset)
         params = faiss.SearchParametersHNSW()
         params.sel = sel
+        # the selected results of the unfiltered search are a prefix of the
+        # filtered ones only when the filter does not change the traversal
+        params.filter_strategy = faiss.SearchParametersHNSW.FILTER_POST
         Dnew, Inew = index.search(ds.get_queries(), k, params=params)
         mask = np.zeros(ds.nb, dtype=bool)
         mask[subset] = True
@@ -471,6 +476,57 @@ class TestSearchParams(unittest.TestCase):
         self.assertTrue(sel2.this.own())
 
 
+class TestPreallocatedOutputs(unittest.TestCase):
+
+    def test_hnsw_params(self):
+        ds = datasets.SyntheticDataset(32, 0, 1000, 40)
+        index = faiss.IndexHNSWFlat(ds.d, 16)
+        index.add(ds.get_database())
+        params = faiss.SearchParametersHNSW(efSearch=32, beam_size=2)
+        Dref, Iref = index.search(ds.get_queries(), 10, params=params)
+
+        D = np.empty((ds.nq, 10), dtype='float32')
+        I = np.empty((ds.nq, 10), dtype='int64')
+        D2, I2 = index.search(ds.get_queries(), 10, params=params, D=D, I=I)
+        # filled in place
+        self.assertIs(D2, D)
+        self.assertIs(I2, I)
+        np.testing.assert_array_equal(I, Iref)
+        np.testing.assert_array_equal(D, Dref)
+
+    def test_wrong_outputs(self):
+        ds = datasets.SyntheticDataset(32, 0, 100, 10)
+        index = faiss.IndexFlatL2(ds.d)
+        index.add(ds.get_database())
+        xq = ds.get_queries()
+        I = np.empty((ds.nq, 5), dtype='int64')
+        with self.assertRaises(TypeError):
+            index.search(xq, 5, D=np.empty((ds.nq, 5)), I=I)
+        with self.assertRaises(ValueError):
+            D = np.empty((5, ds.nq), dtype='float32').T
+            index.search(xq, 5, D=D, I=I)
+
+    def test_threads(self):
+        # the searches release the GIL, so that they run concurrently
+        ds = datasets.SyntheticDataset(32, 0, 2000, 100)
+        index = faiss.IndexHNSWFlat(ds.d, 16)
+        index.add(ds.get_database())
+        xq = ds.get_queries()
+        Dref, Iref = index.search(xq, 10)
+        nt = 4
+        Ds = [np.empty((ds.nq, 10), dtype='float32') for _ in range(nt)]
+        Is = [np.empty((ds.nq, 10), dtype='int64') for _ in range(nt)]
+
+        def search(t):
+            params = faiss.SearchParametersHNSW(efSearch=index.hnsw.efSearch)
+            index.search(xq, 10, params=params, D=Ds[t], I=Is[t])
+
+        with ThreadPool(nt) as pool:
+            pool.map(search, range(nt))
+        for t in range(nt):
+            np.testing.assert_array_equal(Is[t], Iref)
+
+
 class TestSelectorCallback(unittest.TestCase):
 
     def test(self):
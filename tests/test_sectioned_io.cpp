@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <faiss/IndexBinaryFlat.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/sectioned_io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 16, nb = 5000, nq = 10, k = 5;
+
+struct TmpFile {
+    std::string name = std::tmpnam(nullptr);
+
+    ~TmpFile() {
+        remove(name.c_str());
+    }
+};
+
+void check_same_search(
+        faiss::Index& ref,
+        const char* fname,
+        int io_flags,
+        const std::vector<float>& xq) {
+    std::unique_ptr<faiss::Index> index(faiss::read_index(fname, io_flags));
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, Dref);
+    EXPECT_EQ(I, Iref);
+}
+
+void test_roundtrip(faiss::Index& index) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    TmpFile tmp;
+    faiss::write_index_sectioned(&index, tmp.name.c_str());
+    EXPECT_TRUE(faiss::is_sectioned_file(tmp.name.c_str()));
+
+    {
+        faiss::SectionedFileIOReader reader(tmp.name.c_str());
+        EXPECT_GT(reader.sections.size(), 0);
+        for (const faiss::SectionEntry& e : reader.sections) {
+            EXPECT_EQ(e.offset % 4096, 0);
+            EXPECT_GE(e.size, 1 << 16);
+        }
+        EXPECT_EQ(reader.header.stream.offset % 4096, 0);
+    }
+
+    check_same_search(index, tmp.name.c_str(), 0, xq);
+    check_same_search(index, tmp.name.c_str(), faiss::IO_FLAG_MMAP_IFC, xq);
+}
+
+} // namespace
+
+TEST(SectionedIO, flat) {
+    faiss::IndexFlatL2 index(d);
+    test_roundtrip(index);
+}
+
+TEST(SectionedIO, IVFFlat) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 4);
+    index.nprobe = 2;
+    test_roundtrip(index);
+}
+
+TEST(SectionedIO, IDMap_HNSW) {
+    faiss::IndexHNSWFlat hnsw(d, 16);
+    faiss::IndexIDMap index(&hnsw);
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    std::vector<faiss::idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 10 * i + 3;
+    }
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    std::vector<float> xq(nq * d);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+    TmpFile tmp;
+    faiss::write_index_sectioned(&index, tmp.name.c_str(), 1 << 21);
+    check_same_search(index, tmp.name.c_str(), 0, xq);
+    check_same_search(index, tmp.name.c_str(), faiss::IO_FLAG_MMAP_IFC, xq);
+}
+
+TEST(SectionedIO, binary) {
+    const size_t nbits = 256;
+    faiss::IndexBinaryFlat index(nbits);
+    std::vector<uint8_t> xb(nb * nbits / 8);
+    faiss::byte_rand(xb.data(), xb.size(), 12);
+    index.add(nb, xb.data());
+
+    TmpFile tmp;
+    faiss::write_index_binary_sectioned(&index, tmp.name.c_str());
+    std::unique_ptr<faiss::IndexBinary> index2(
+            faiss::read_index_binary(tmp.name.c_str()));
+    std::vector<int32_t> D(nq * k), Dref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xb.data(), k, Dref.data(), Iref.data());
+    index2->search(nq, xb.data(), k, D.data(), I.data());
+    EXPECT_EQ(D, Dref);
+    EXPECT_EQ(I, Iref);
+}
+
+TEST(SectionedIO, corruption) {
+    faiss::IndexFlatL2 index(d);
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    index.add(nb, xb.data());
+
+    TmpFile tmp;
+    faiss::write_index_sectioned(&index, tmp.name.c_str());
+    size_t offset;
+    {
+        faiss::SectionedFileIOReader reader(tmp.name.c_str());
+        ASSERT_EQ(reader.sections.size(), 1);
+        offset = reader.sections[0].offset + 1234;
+    }
+    FILE* f = fopen(tmp.name.c_str(), "r+b");
+    ASSERT_TRUE(f);
+    fseek(f, offset, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ 1, f);
+    fclose(f);
+
+    EXPECT_THROW(faiss::read_index(tmp.name.c_str()), faiss::FaissException);
+    // the views are not verified
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(tmp.name.c_str(), faiss::IO_FLAG_MMAP_IFC));
+    EXPECT_EQ(index2->ntotal, nb);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <faiss/impl/FaissException.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/simd_dispatch.h>
+
+namespace {
+
+// restores the level on exit
+struct SIMDLevelGuard {
+    faiss::SIMDLevel level = faiss::get_simd_level();
+    ~SIMDLevelGuard() {
+        faiss::set_simd_level(level);
+    }
+};
+
+} // namespace
+
+TEST(SIMDDispatch, levels) {
+    SIMDLevelGuard guard;
+    EXPECT_LE(faiss::get_simd_level(), faiss::simd_level_max());
+    for (int l = faiss::SIMD_GENERIC; l <= faiss::simd_level_max(); l++) {
+        faiss::set_simd_level(faiss::SIMDLevel(l));
+        EXPECT_EQ(faiss::get_simd_level(), l);
+        EXPECT_EQ(faiss::get_distance_kernels().level, l);
+    }
+    if (faiss::simd_level_max() < faiss::SIMD_AVX512) {
+        EXPECT_THROW(
+                faiss::set_simd_level(faiss::SIMD_AVX512),
+                faiss::FaissException);
+    }
+    EXPECT_STREQ(faiss::simd_level_name(faiss::SIMD_AVX2), "avx2");
+}
+
+TEST(SIMDDispatch, distances) {
+    SIMDLevelGuard guard;
+    // odd sizes exercise the tails of the vectorized loops
+    for (size_t d : {1, 7, 16, 33, 128, 259}) {
+        std::vector<float> x(5 * d);
+        faiss::float_rand(x.data(), x.size(), 1234 + d);
+        const float* y = x.data() + d;
+
+        std::vector<double> ref_ip(4), ref_l2(4);
+        double ref_norm = 0;
+        for (size_t i = 0; i < d; i++) {
+            ref_norm += double(x[i]) * x[i];
+            for (int j = 0; j < 4; j++) {
+                double yj = y[j * d + i];
+                ref_ip[j] += x[i] * yj;
+                ref_l2[j] += (x[i] - yj) * (x[i] - yj);
+            }
+        }
+
+        for (int l = faiss::SIMD_GENERIC; l <= faiss::simd_level_max(); l++) {
+            faiss::set_simd_level(faiss::SIMDLevel(l));
+            SCOPED_TRACE(faiss::simd_level_name(faiss::SIMDLevel(l)));
+            float tol = 1e-5 * d;
+
+            EXPECT_NEAR(faiss::fvec_norm_L2sqr(x.data(), d), ref_norm, tol);
+            EXPECT_NEAR(faiss::fvec_L2sqr(x.data(), y, d), ref_l2[0], tol);
+            EXPECT_NEAR(
+                    faiss::fvec_inner_product(x.data(), y, d), ref_ip[0], tol);
+
+            float ip[4], l2[4];
+            faiss::fvec_inner_product_batch_4(
+                    x.data(),
+                    y,
+                    y + d,
+                    y + 2 * d,
+                    y + 3 * d,
+                    d,
+                    ip[0],
+                    ip[1],
+                    ip[2],
+                    ip[3]);
+            faiss::fvec_L2sqr_batch_4(
+                    x.data(),
+                    y,
+                    y + d,
+                    y + 2 * d,
+                    y + 3 * d,
+                    d,
+                    l2[0],
+                    l2[1],
+                    l2[2],
+                    l2[3]);
+            for (int j = 0; j < 4; j++) {
+                EXPECT_NEAR(ip[j], ref_ip[j], tol);
+                EXPECT_NEAR(l2[j], ref_l2[j], tol);
+            }
+        }
+    }
+}
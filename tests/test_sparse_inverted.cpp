@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexSparseInverted.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int nterms = 1000, d = 16, nb = 3000, nq = 50, k = 10;
+
+// random sparse vectors with a Zipf-like term distribution
+struct SparseData {
+    std::vector<size_t> lims{0};
+    std::vector<int32_t> terms;
+    std::vector<float> weights;
+
+    SparseData(int n, int nnz, int seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(0, 1);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < nnz; j++) {
+                float r = u(rng);
+                terms.push_back(int(nterms * r * r * r));
+                weights.push_back(u(rng));
+            }
+            lims.push_back(terms.size());
+        }
+    }
+};
+
+} // namespace
+
+TEST(IndexSparseInverted, maxscore_exact) {
+    SparseData xb(nb, 40, 1), xq(nq, 10, 2);
+    faiss::IndexSparseInverted index(nterms);
+    index.block_size = 16;
+    // added in 2 batches to test the incremental block bounds
+    index.add(nb / 2, xb.lims.data(), xb.terms.data(), xb.weights.data());
+    index.add(
+            nb - nb / 2,
+            xb.lims.data() + nb / 2,
+            xb.terms.data(),
+            xb.weights.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    std::vector<float> D_ref(nq * k), D(nq * k);
+    std::vector<faiss::idx_t> I_ref(nq * k), I(nq * k);
+    faiss::SearchParametersSparse params;
+    params.exhaustive = true;
+    faiss::sparse_search_stats.reset();
+    index.search(
+            nq,
+            xq.lims.data(),
+            xq.terms.data(),
+            xq.weights.data(),
+            k,
+            D_ref.data(),
+            I_ref.data(),
+            &params);
+    size_t npostings_ref = faiss::sparse_search_stats.npostings;
+
+    faiss::sparse_search_stats.reset();
+    index.search(
+            nq,
+            xq.lims.data(),
+            xq.terms.data(),
+            xq.weights.data(),
+            k,
+            D.data(),
+            I.data());
+    EXPECT_LT(faiss::sparse_search_stats.npostings, npostings_ref);
+    EXPECT_GT(faiss::sparse_search_stats.nskipped, 0);
+
+    for (int i = 0; i < nq * k; i++) {
+        EXPECT_NEAR(D[i], D_ref[i], 1e-5);
+    }
+    // the scores are the inner products
+    std::vector<float> scores(k);
+    for (int q = 0; q < nq; q++) {
+        index.compute_scores(
+                xq.lims.data(),
+                xq.terms.data(),
+                xq.weights.data(),
+                q,
+                k,
+                I.data() + q * k,
+                scores.data());
+        for (int j = 0; j < k; j++) {
+            EXPECT_NEAR(scores[j], D[q * k + j], 1e-5);
+        }
+    }
+}
+
+TEST(IndexSparseInverted, hybrid) {
+    SparseData sb(nb, 40, 1), sq(nq, 10, 2);
+    faiss::IndexSparseInverted sparse(nterms);
+    sparse.add(nb, sb.lims.data(), sb.terms.data(), sb.weights.data());
+
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 3);
+    faiss::float_rand(xq.data(), xq.size(), 4);
+    faiss::IndexFlatIP dense(d);
+    dense.add(nb, xb.data());
+
+    // reference: exact weighted scores of all the vectors
+    std::vector<faiss::idx_t> all_ids(nb);
+    for (int i = 0; i < nb; i++) {
+        all_ids[i] = i;
+    }
+    std::vector<float> sparse_scores(nb);
+
+    faiss::HybridSearchParameters params;
+    params.fusion = faiss::HYBRID_WEIGHTED;
+    params.dense_weight = 0.1;
+    params.k_dense = params.k_sparse = 4 * k;
+    std::vector<float> D(nq * k);
+    std::vector<faiss::idx_t> I(nq * k);
+    faiss::hybrid_search(
+            dense,
+            sparse,
+            nq,
+            xq.data(),
+            sq.lims.data(),
+            sq.terms.data(),
+            sq.weights.data(),
+            k,
+            D.data(),
+            I.data(),
+            &params);
+
+    int nfound = 0;
+    for (int q = 0; q < nq; q++) {
+        sparse.compute_scores(
+                sq.lims.data(),
+                sq.terms.data(),
+                sq.weights.data(),
+                q,
+                nb,
+                all_ids.data(),
+                sparse_scores.data());
+        std::vector<std::pair<float, faiss::idx_t>> ref;
+        for (int i = 0; i < nb; i++) {
+            float ip = 0;
+            for (int j = 0; j < d; j++) {
+                ip += xq[q * d + j] * xb[i * d + j];
+            }
+            ref.emplace_back(-(0.1f * ip + sparse_scores[i]), i);
+        }
+        std::sort(ref.begin(), ref.end());
+        // the fused scores are exact
+        for (int j = 0; j < k; j++) {
+            faiss::idx_t id = I[q * k + j];
+            ASSERT_GE(id, 0);
+            auto it = std::find_if(ref.begin(), ref.end(), [&](auto& r) {
+                return r.second == id;
+            });
+            EXPECT_NEAR(D[q * k + j], -it->first, 1e-4);
+            for (int l = 0; l < k; l++) {
+                nfound += ref[l].second == id;
+            }
+        }
+    }
+    // the fetched candidates contain most of the true fused top-k
+    EXPECT_GT(nfound, nq * k * 0.9);
+
+    // RRF: a result found by both indexes is ranked first
+    params.fusion = faiss::HYBRID_RRF;
+    params.dense_weight = 1;
+    faiss::HybridFusionHandler handler(params);
+    float dense_s[3] = {3, 2, 1}, sparse_s[3] = {9, 8, 7};
+    faiss::idx_t dense_i[3] = {10, 11, 12}, sparse_i[3] = {20, 21, 12};
+    handler.add_dense_results(3, dense_s, dense_i);
+    handler.add_sparse_results(3, sparse_s, sparse_i);
+    float fD[2];
+    faiss::idx_t fI[2];
+    handler.end(2, fD, fI);
+    EXPECT_EQ(fI[0], 12);
+    EXPECT_NEAR(fD[0], 1 / 63.0 + 1 / 63.0, 1e-6);
+    EXPECT_NEAR(fD[1], 1 / 61.0, 1e-6);
+}
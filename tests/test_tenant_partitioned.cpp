@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIDMap.h>
+#include <faiss/IndexTenantPartitioned.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nb = 4000, nq = 30, k = 5;
+
+// tenant 0 is large, tenants 1..50 are small
+faiss::idx_t tenant_of(int i) {
+    return i % 2 == 0 ? 0 : 1 + (i / 2) % 50;
+}
+
+} // namespace
+
+TEST(IndexTenantPartitioned, routing) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::float_rand(xq.data(), xq.size(), 2);
+    std::vector<faiss::idx_t> tenants(nb), ids(nb);
+    for (int i = 0; i < nb; i++) {
+        tenants[i] = tenant_of(i);
+        ids[i] = 1000 + i;
+    }
+
+    faiss::IndexFlatL2 large_template(d);
+    faiss::IndexTenantPartitioned index(&large_template, 1000);
+    // 2 batches, tenant 0 is promoted in the second one
+    index.add_with_tenants(nb / 4, xb.data(), tenants.data(), ids.data());
+    EXPECT_FALSE(index.is_large_tenant(0));
+    index.add_with_tenants(
+            nb - nb / 4,
+            xb.data() + nb / 4 * d,
+            tenants.data() + nb / 4,
+            ids.data() + nb / 4);
+    EXPECT_EQ(index.ntotal, nb);
+    EXPECT_EQ(index.nb_tenants(), 51);
+    EXPECT_TRUE(index.is_large_tenant(0));
+    EXPECT_FALSE(index.is_large_tenant(1));
+    EXPECT_EQ(index.tenant_size(0), nb / 2);
+
+    // reference: flat index filtered with a selector per tenant
+    faiss::IndexFlatL2 flat(d);
+    faiss::IndexIDMap ref(&flat);
+    ref.add_with_ids(nb, xb.data(), ids.data());
+
+    std::vector<faiss::idx_t> query_tenants(nq);
+    for (int q = 0; q < nq; q++) {
+        query_tenants[q] = q % 3 == 0 ? 0 : 1 + q % 50;
+    }
+    std::vector<float> D(nq * k), D_ref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I_ref(nq * k);
+    faiss::SearchParametersTenant params;
+    params.query_tenants = query_tenants.data();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+
+    for (int q = 0; q < nq; q++) {
+        std::vector<faiss::idx_t> tenant_ids;
+        for (int i = 0; i < nb; i++) {
+            if (tenants[i] == query_tenants[q]) {
+                tenant_ids.push_back(ids[i]);
+            }
+        }
+        faiss::IDSelectorBatch sel(tenant_ids.size(), tenant_ids.data());
+        faiss::SearchParameters ref_params;
+        ref_params.sel = &sel;
+        ref.search(
+                1,
+                xq.data() + q * d,
+                k,
+                D_ref.data(),
+                I_ref.data(),
+                &ref_params);
+        for (int j = 0; j < k; j++) {
+            EXPECT_EQ(I[q * k + j], I_ref[j]);
+            EXPECT_NEAR(D[q * k + j], D_ref[j], 1e-4);
+        }
+    }
+
+    // no tenant: all the vectors
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    EXPECT_EQ(I, I_ref);
+
+    // unknown tenant: no results
+    params.query_tenants = nullptr;
+    params.tenant = 12345;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(I[0], -1);
+}
+
+TEST(IndexTenantPartitioned, sub_params) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1);
+    faiss::float_rand(xq.data(), xq.size(), 2);
+    std::vector<faiss::idx_t> tenants(nb, 7);
+
+    faiss::IndexHNSWFlat large_template(d, 16);
+    faiss::IndexTenantPartitioned index(&large_template, 100);
+    index.add_with_tenants(nb, xb.data(), tenants.data());
+    EXPECT_TRUE(index.is_large_tenant(7));
+
+    faiss::SearchParametersHNSW hnsw_params;
+    hnsw_params.efSearch = 256;
+    faiss::SearchParametersTenant params;
+    params.tenant = 7;
+    params.sub_params = &hnsw_params;
+    std::vector<float> D(nq * k), D_ref(nq * k);
+    std::vector<faiss::idx_t> I(nq * k), I_ref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+
+    faiss::IndexFlatL2 flat(d);
+    flat.add(nb, xb.data());
+    flat.search(nq, xq.data(), k, D_ref.data(), I_ref.data());
+    int n_ok = 0;
+    for (int i = 0; i < nq * k; i++) {
+        n_ok += I[i] == I_ref[i];
+    }
+    EXPECT_GT(n_ok, nq * k * 0.95);
+}
@@ -5,9 +5,13 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
 #include <faiss/IndexReplicas.h>
 #include <faiss/IndexShards.h>
+#include <faiss/IndexShardsIVF.h>
 #include <faiss/impl/ThreadedIndex.h>
+#include <faiss/utils/random.h>
 
 #include <gtest/gtest.h>
 #include <chrono>
@@ -258,3 +262,104 @@ TEST(ThreadedIndex, TestShards) {
         }
     }
 }
+
+TEST(ThreadedIndex, SearchBlocks) {
+    int d = 16, nb = 3000, nq = 100, k = 10, nshard = 5;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexFlat ref(d, metric);
+        ref.add(nb, xb.data());
+        std::vector<float> Dref(nq * k);
+        std::vector<idx_t> Iref(nq * k);
+        ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+        for (bool threaded : {true, false}) {
+            std::vector<std::unique_ptr<faiss::IndexFlat>> idxs;
+            faiss::IndexShards shards(d, threaded);
+            faiss::IndexReplicas replicas(d, threaded);
+            for (int i = 0; i < nshard; i++) {
+                idxs.emplace_back(new faiss::IndexFlat(d, metric));
+                shards.addIndex(idxs.back().get());
+            }
+            for (int i = 0; i < 3; i++) {
+                idxs.emplace_back(new faiss::IndexFlat(ref));
+                replicas.addIndex(idxs.back().get());
+            }
+            shards.add(nb, xb.data());
+            shards.search_block_size = 7;
+            replicas.search_block_size = 7;
+
+            std::vector<float> D(nq * k);
+            std::vector<idx_t> I(nq * k);
+            shards.search(nq, xq.data(), k, D.data(), I.data());
+            EXPECT_EQ(I, Iref);
+            for (int i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(D[i], Dref[i], 1e-5);
+            }
+
+            replicas.search(nq, xq.data(), k, D.data(), I.data());
+            EXPECT_EQ(I, Iref);
+            for (int i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(D[i], Dref[i], 1e-5);
+            }
+        }
+    }
+}
+
+TEST(ThreadedIndex, ShareThresholds) {
+    int d = 16, nb = 20000, nq = 50, k = 10, nshard = 6, nlist = 32;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    faiss::float_rand(xb.data(), xb.size(), 1234);
+    faiss::float_rand(xq.data(), xq.size(), 5678);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat trained(&quantizer, d, nlist);
+    trained.train(nb, xb.data());
+
+    faiss::IndexShardsIVF shards(&quantizer, nlist);
+    std::vector<std::unique_ptr<faiss::IndexIVFFlat>> idxs;
+    for (int i = 0; i < nshard; i++) {
+        idxs.emplace_back(new faiss::IndexIVFFlat(&quantizer, d, nlist));
+        idxs.back()->is_trained = true;
+        idxs.back()->nprobe = 8;
+        shards.addIndex(idxs.back().get());
+    }
+    shards.add(nb, xb.data());
+
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<idx_t> Iref(nq * k), I(nq * k);
+    shards.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    // the plain IndexShards path, with blocks and without
+    faiss::IndexShards plain_shards(d);
+    for (auto& idx : idxs) {
+        plain_shards.addIndex(idx.get());
+    }
+    for (int pmode : {0, 1}) {
+        for (auto& idx : idxs) {
+            idx->parallel_mode = pmode;
+        }
+        faiss::indexIVF_stats.reset();
+        shards.search(nq, xq.data(), k, D.data(), I.data());
+        size_t nheap_ref = faiss::indexIVF_stats.nheap_updates;
+
+        shards.share_thresholds = true;
+        faiss::indexIVF_stats.reset();
+        shards.search(nq, xq.data(), k, D.data(), I.data());
+        shards.share_thresholds = false;
+        EXPECT_EQ(I, Iref);
+        EXPECT_EQ(D, Dref);
+        EXPECT_LT(faiss::indexIVF_stats.nheap_updates, nheap_ref);
+
+        plain_shards.share_thresholds = true;
+        for (idx_t bs : {0, 7}) {
+            plain_shards.search_block_size = bs;
+            plain_shards.search(nq, xq.data(), k, D.data(), I.data());
+            EXPECT_EQ(I, Iref);
+            EXPECT_EQ(D, Dref);
+        }
+    }
+}
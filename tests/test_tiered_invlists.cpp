@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/invlists/OnDiskInvertedLists.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const int d = 16, nlist = 64, nt = 5000, nb = 10000, nq = 200, k = 10;
+
+struct TieredTest {
+    std::vector<float> xb, xq;
+    faiss::IndexFlatL2 quantizer;
+    faiss::IndexIVFFlat index;
+
+    TieredTest()
+            : xb(nb * d), xq(nq * d), quantizer(d), index(&quantizer, d, nlist) {
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        index.train(nt, xb.data());
+        index.add(nb, xb.data());
+        index.nprobe = 4;
+    }
+
+    void search(std::vector<float>& D, std::vector<faiss::idx_t>& I) {
+        D.resize(nq * k);
+        I.resize(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+    }
+};
+
+// the hot lists are the most accessed ones, packed in decreasing order of
+// access
+void check_hot_lists(const faiss::TieredInvertedLists& til, size_t budget) {
+    const std::vector<uint64_t>& counts = til.access_counts;
+    ASSERT_FALSE(til.hot_lists.empty());
+    size_t tot = 0;
+    for (size_t i = 0; i < til.hot_lists.size(); i++) {
+        faiss::idx_t list_no = til.hot_lists[i];
+        EXPECT_EQ(til.hot_offsets[list_no], tot);
+        EXPECT_EQ((const uint8_t*)til.get_codes(list_no),
+                  til.hot_data.data() + tot);
+        tot += til.hot_nbytes(til.list_size(list_no));
+        if (i > 0) {
+            EXPECT_LE(counts[list_no], counts[til.hot_lists[i - 1]]);
+        }
+    }
+    EXPECT_LE(tot, budget);
+    EXPECT_EQ(tot, til.hot_data.size());
+}
+
+} // namespace
+
+TEST(TieredInvlists, access_counts) {
+    TieredTest t;
+    std::vector<float> D;
+    std::vector<faiss::idx_t> I;
+    t.index.invlists->enable_access_counts();
+    t.search(D, I);
+    uint64_t tot = 0;
+    for (uint64_t c : t.index.invlists->access_counts) {
+        tot += c;
+    }
+    EXPECT_EQ(tot, nq * t.index.nprobe);
+}
+
+TEST(TieredInvlists, in_memory) {
+    TieredTest t;
+    std::vector<float> D_ref, D;
+    std::vector<faiss::idx_t> I_ref, I;
+    t.index.invlists->enable_access_counts();
+    t.search(D_ref, I_ref);
+
+    // about a quarter of the lists are hot
+    size_t budget = nb * (d * sizeof(float) + sizeof(faiss::idx_t)) / 4;
+    faiss::TieredInvertedLists* til =
+            faiss::ivflib::tier_inverted_lists(&t.index, budget);
+    check_hot_lists(*til, budget);
+    EXPECT_LT(til->hot_lists.size(), nlist);
+
+    t.search(D, I);
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+}
+
+TEST(TieredInvlists, on_disk) {
+    TieredTest t;
+    std::vector<float> D_ref, D;
+    std::vector<faiss::idx_t> I_ref, I;
+    t.index.invlists->enable_access_counts();
+    t.search(D_ref, I_ref);
+
+    std::string fname = "/tmp/faiss_tmp_XXXXXX";
+    close(mkstemp(&fname[0]));
+    size_t budget = nb * (d * sizeof(float) + sizeof(faiss::idx_t)) / 4;
+    faiss::TieredInvertedLists* til = faiss::ivflib::tier_inverted_lists(
+            &t.index, budget, fname.c_str());
+    check_hot_lists(*til, budget);
+
+    // the cold lists are stored by decreasing access count
+    auto ondisk = dynamic_cast<const faiss::OnDiskInvertedLists*>(til->cold);
+    ASSERT_TRUE(ondisk);
+    const std::vector<uint64_t>& counts = til->access_counts;
+    for (size_t i = 0; i < nlist; i++) {
+        for (size_t j = 0; j < nlist; j++) {
+            if (ondisk->list_size(i) > 0 && ondisk->list_size(j) > 0 &&
+                counts[i] > counts[j]) {
+                EXPECT_LT(ondisk->lists[i].offset, ondisk->lists[j].offset);
+            }
+        }
+        if (til->is_hot(i)) {
+            EXPECT_EQ(ondisk->list_size(i), 0);
+        }
+    }
+
+    t.search(D, I);
+    EXPECT_EQ(I, I_ref);
+    EXPECT_EQ(D, D_ref);
+    unlink(fname.c_str());
+}
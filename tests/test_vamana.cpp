@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexVamana.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+struct Tempfilename {
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+const int d = 32;
+const int nb = 5000;
+const int nq = 100;
+const int k = 10;
+
+struct VamanaData {
+    std::vector<float> xb, xq;
+    std::vector<faiss::idx_t> I_gt;
+
+    VamanaData() : xb(nb * d), xq(nq * d), I_gt(nq * k) {
+        faiss::rand_smooth_vectors(nb, d, xb.data(), 123);
+        faiss::rand_smooth_vectors(nq, d, xq.data(), 456);
+        faiss::IndexFlatL2 index_gt(d);
+        index_gt.add(nb, xb.data());
+        std::vector<float> D(nq * k);
+        index_gt.search(nq, xq.data(), k, D.data(), I_gt.data());
+    }
+
+    double recall(
+            const faiss::Index& index,
+            const faiss::SearchParameters* params = nullptr) const {
+        std::vector<faiss::idx_t> I(nq * k);
+        std::vector<float> D(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data(), params);
+        size_t n_found = 0;
+        for (int q = 0; q < nq; q++) {
+            std::unordered_set<faiss::idx_t> gt(
+                    I_gt.begin() + q * k, I_gt.begin() + (q + 1) * k);
+            for (int j = 0; j < k; j++) {
+                n_found += gt.count(I[q * k + j]);
+            }
+        }
+        return n_found / double(nq * k);
+    }
+};
+
+} // namespace
+
+TEST(IndexVamana, build) {
+    VamanaData data;
+    std::unique_ptr<faiss::Index> index(faiss::index_factory(d, "Vamana32"));
+    auto index_vamana = dynamic_cast<faiss::IndexVamana*>(index.get());
+    ASSERT_NE(index_vamana, nullptr);
+    EXPECT_EQ(index_vamana->hnsw.nb_neighbors(0), 32);
+    index->add(nb, data.xb.data());
+
+    const faiss::HNSW& hnsw = index_vamana->hnsw;
+    EXPECT_EQ(hnsw.max_level, 0);
+    std::vector<int> degrees = hnsw.get_degrees(0);
+    EXPECT_GT(*std::min_element(degrees.begin(), degrees.end()), 0);
+    EXPECT_LE(*std::max_element(degrees.begin(), degrees.end()), 32);
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    EXPECT_GT(data.recall(*index, &params), 0.95);
+}
+
+TEST(IndexVamana, incremental_add) {
+    VamanaData data;
+    faiss::IndexVamana index(d, 32);
+    index.build_batch_size = 256;
+    index.add(nb / 2, data.xb.data());
+    faiss::idx_t entry_point = index.hnsw.entry_point;
+    index.add(nb - nb / 2, data.xb.data() + nb / 2 * d);
+    EXPECT_EQ(index.ntotal, nb);
+    EXPECT_EQ(index.hnsw.entry_point, entry_point);
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 64;
+    EXPECT_GT(data.recall(index, &params), 0.95);
+}
+
+TEST(IndexVamana, pq_guided_search) {
+    VamanaData data;
+    std::unique_ptr<faiss::Index> index(
+            faiss::index_factory(d, "Vamana32,PQ8"));
+    auto index_vamana = dynamic_cast<faiss::IndexVamana*>(index.get());
+    ASSERT_NE(index_vamana, nullptr);
+    EXPECT_FALSE(index->is_trained);
+    index->train(nb, data.xb.data());
+    index->add(nb, data.xb.data());
+    EXPECT_EQ(index_vamana->hnsw.pq_codes.size(), nb * 8);
+
+    // the PQ ranks the neighbors, only the best half get exact distances
+    index_vamana->hnsw.efSearch = 64;
+    faiss::HNSWStats& stats = faiss::hnsw_stats;
+    stats.reset();
+    double recall_ref = data.recall(*index);
+    size_t ndis_ref = stats.ndis;
+    index_vamana->hnsw.pq_pruning_ratio = 0.5;
+    stats.reset();
+    double recall = data.recall(*index);
+    EXPECT_LT(stats.ndis, ndis_ref);
+    EXPECT_GT(stats.n_pq_calcs, 0);
+    EXPECT_GT(recall, recall_ref - 0.1);
+
+    // serialization keeps the build parameters, the PQ and the ratio
+    Tempfilename tmp;
+    faiss::write_index(index.get(), tmp.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(tmp.c_str()));
+    auto index_vamana2 = dynamic_cast<faiss::IndexVamana*>(index2.get());
+    ASSERT_NE(index_vamana2, nullptr);
+    EXPECT_EQ(index_vamana2->pq_m, 8);
+    EXPECT_EQ(index_vamana2->alpha, index_vamana->alpha);
+    EXPECT_EQ(index_vamana2->hnsw.pq_pruning_ratio, 0.5);
+    index_vamana2->hnsw.efSearch = 64;
+    EXPECT_EQ(data.recall(*index2), recall);
+}
+
+TEST(IndexVamana, compact_on_disk) {
+    VamanaData data;
+    faiss::IndexVamana index(d, 32);
+    index.add(nb, data.xb.data());
+    index.hnsw.efSearch = 64;
+    double recall_ref = data.recall(index);
+
+    index.hnsw.convert_to_compact();
+    Tempfilename tmp;
+    faiss::write_index(&index, tmp.c_str());
+
+    // neighbor lists read with pread during search
+    faiss::HNSWIndexConfig config(true, true, false, 0, nullptr);
+    std::unique_ptr<faiss::Index> index2(
+            faiss::read_index(tmp.c_str(), 0, config));
+    auto index_vamana = dynamic_cast<faiss::IndexVamana*>(index2.get());
+    ASSERT_NE(index_vamana, nullptr);
+    EXPECT_TRUE(index_vamana->hnsw.neighbors_on_disk);
+    index_vamana->hnsw.initialize_graph(tmp.filename);
+    index_vamana->hnsw.efSearch = 64;
+    EXPECT_EQ(data.recall(*index2), recall_ref);
+
+    // adding needs the graph in memory
+    EXPECT_THROW(
+            index_vamana->add(1, data.xb.data()), faiss::FaissException);
+}
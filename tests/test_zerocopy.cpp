@@ -14,6 +14,9 @@
 
 #include <faiss/IndexBinaryFlat.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFPQR.h>
+#include <faiss/IndexNNDescent.h>
 #include <faiss/impl/io.h>
 #include <faiss/impl/zerocopy_io.h>
 #include <faiss/index_io.h>
@@ -241,3 +244,55 @@ TEST(TestZeroCopy, zerocopy_binary_flatcodes) {
     ASSERT_EQ(ref_ids_1, cand_ids_3);
     ASSERT_EQ(ref_dis_1, cand_dis_3);
 }
+
+TEST(TestZeroCopy, zerocopy_views) {
+    const size_t nt = 2000, nq = 10, d = 16, k = 5;
+    std::vector<float> xt = make_data(nt, d, 123);
+    std::vector<float> xq = make_data(nq, d, 789);
+
+    faiss::IndexFlatInt8 index_int8(d);
+    faiss::IndexHNSWFlat index_hnsw(d, 16);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQR index_pqr(&quantizer, d, 16, 4, 8, 4, 8);
+    faiss::IndexNNDescentFlat index_nnd(d, 16);
+
+    std::vector<faiss::Index*> indexes = {
+            &index_int8, &index_hnsw, &index_pqr, &index_nnd};
+    for (faiss::Index* index : indexes) {
+        index->train(nt, xt.data());
+        index->add(nt, xt.data());
+
+        faiss::VectorIOWriter wr;
+        faiss::write_index(index, &wr);
+        faiss::ZeroCopyIOReader reader(wr.data.data(), wr.data.size());
+        std::unique_ptr<faiss::Index> index_zc(faiss::read_index(&reader));
+
+        // the large arrays are views of the buffer
+        auto in_buffer = [&](const void* p) {
+            return (const uint8_t*)p >= wr.data.data() &&
+                    (const uint8_t*)p < wr.data.data() + wr.data.size();
+        };
+        if (auto ix = dynamic_cast<faiss::IndexFlatCodes*>(index_zc.get())) {
+            EXPECT_TRUE(in_buffer(ix->codes.data()));
+        }
+        if (auto ix = dynamic_cast<faiss::IndexHNSW*>(index_zc.get())) {
+            EXPECT_TRUE(in_buffer(ix->hnsw.neighbors.data()));
+            EXPECT_TRUE(in_buffer(
+                    dynamic_cast<faiss::IndexFlatCodes*>(ix->storage)
+                            ->codes.data()));
+        }
+        if (auto ix = dynamic_cast<faiss::IndexIVFPQR*>(index_zc.get())) {
+            EXPECT_TRUE(in_buffer(ix->refine_codes.data()));
+        }
+        if (auto ix = dynamic_cast<faiss::IndexNNDescent*>(index_zc.get())) {
+            EXPECT_TRUE(in_buffer(ix->nndescent.final_graph.data()));
+        }
+
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<faiss::idx_t> I(nq * k), Iref(nq * k);
+        index->search(nq, xq.data(), k, Dref.data(), Iref.data());
+        index_zc->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(D, Dref);
+        EXPECT_EQ(I, Iref);
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 32;
+
+std::vector<float> make_vectors(size_t n) {
+    std::vector<float> x(n * d);
+    faiss::float_randn(x.data(), x.size(), 1234);
+    return x;
+}
+
+} // namespace
+
+TEST(ZmqEmbeddingCache, lookup_after_insert) {
+    std::vector<float> x = make_vectors(10);
+    faiss::ZmqEmbeddingCache cache(
+            d, 1 << 20, faiss::ZmqEmbeddingCache::CODEC_FP32, 4);
+
+    std::vector<float> out(d);
+    EXPECT_FALSE(cache.lookup(3, out.data()));
+    cache.insert(3, x.data() + 3 * d);
+    ASSERT_TRUE(cache.lookup(3, out.data()));
+    for (size_t i = 0; i < d; i++) {
+        EXPECT_EQ(out[i], x[3 * d + i]);
+    }
+    EXPECT_EQ(cache.n_hits, 1);
+    EXPECT_EQ(cache.n_misses, 1);
+    EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(ZmqEmbeddingCache, lru_eviction_respects_budget) {
+    std::vector<float> x = make_vectors(10);
+    // one shard that holds exactly 4 entries
+    faiss::ZmqEmbeddingCache probe(
+            d, 0, faiss::ZmqEmbeddingCache::CODEC_FP32, 1);
+    size_t budget = 4 * probe.entry_size();
+    faiss::ZmqEmbeddingCache cache(
+            d, budget, faiss::ZmqEmbeddingCache::CODEC_FP32, 1);
+
+    std::vector<float> out(d);
+    for (int i = 0; i < 4; i++) {
+        cache.insert(i, x.data() + i * d);
+    }
+    // touch 0 so that 1 becomes the least recently used
+    EXPECT_TRUE(cache.lookup(0, out.data()));
+    cache.insert(4, x.data() + 4 * d);
+
+    EXPECT_EQ(cache.size(), 4);
+    EXPECT_LE(cache.nbytes(), budget);
+    EXPECT_EQ(cache.n_evictions, 1);
+    EXPECT_TRUE(cache.lookup(0, out.data()));
+    EXPECT_FALSE(cache.lookup(1, out.data()));
+    EXPECT_TRUE(cache.lookup(4, out.data()));
+}
+
+TEST(ZmqEmbeddingCache, admission_after_misses) {
+    std::vector<float> x = make_vectors(1);
+    faiss::ZmqEmbeddingCache cache(
+            d, 1 << 20, faiss::ZmqEmbeddingCache::CODEC_FP32, 1);
+    cache.admit_after = 2;
+
+    std::vector<float> out(d);
+    cache.insert(7, x.data());
+    EXPECT_FALSE(cache.lookup(7, out.data()));
+    cache.insert(7, x.data());
+    EXPECT_TRUE(cache.lookup(7, out.data()));
+
+    // hot ids are admitted at their first miss
+    cache.hot_ids.insert(8);
+    cache.insert(8, x.data());
+    EXPECT_TRUE(cache.lookup(8, out.data()));
+}
+
+TEST(ZmqEmbeddingCache, compressed_codecs) {
+    std::vector<float> x = make_vectors(1);
+    for (auto codec :
+         {faiss::ZmqEmbeddingCache::CODEC_FP16,
+          faiss::ZmqEmbeddingCache::CODEC_SQ8}) {
+        faiss::ZmqEmbeddingCache cache(d, 1 << 20, codec, 1);
+        EXPECT_LT(cache.code_size(), d * sizeof(float));
+        cache.insert(0, x.data());
+        std::vector<float> out(d);
+        ASSERT_TRUE(cache.lookup(0, out.data()));
+        float vmin = x[0], vmax = x[0];
+        for (size_t i = 0; i < d; i++) {
+            vmin = std::min(vmin, x[i]);
+            vmax = std::max(vmax, x[i]);
+        }
+        float tol = codec == faiss::ZmqEmbeddingCache::CODEC_FP16
+                ? 1e-2
+                : (vmax - vmin) / 255;
+        for (size_t i = 0; i < d; i++) {
+            EXPECT_NEAR(out[i], x[i], tol);
+        }
+    }
+}
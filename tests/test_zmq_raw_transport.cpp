@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <zmq.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <faiss/impl/HNSW_zmq.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/fp16.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+const size_t d = 8, nb = 100;
+const int port = 45713; // only used as a key of the pool
+
+/// serves nreq raw embedding requests from xb, in fp16 if requested,
+/// each reply after delay_ms
+void serve(
+        void* socket,
+        const std::vector<float>& xb,
+        int nreq,
+        bool fp16,
+        int delay_ms) {
+    for (int r = 0; r < nreq; r++) {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        zmq_msg_recv(&msg, socket, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        const uint32_t* req = (const uint32_t*)zmq_msg_data(&msg);
+        EXPECT_EQ(req[0], faiss::raw_embedding_request_magic);
+        uint32_t n = req[1];
+        uint32_t header[3] = {n, (uint32_t)d, fp16 ? 1u : 0u};
+        size_t value_size = fp16 ? 2 : 4;
+        std::vector<char> reply(sizeof(header) + n * d * value_size);
+        memcpy(reply.data(), header, sizeof(header));
+        for (uint32_t i = 0; i < n; i++) {
+            const float* x = xb.data() + req[2 + i] * d;
+            char* dst = reply.data() + sizeof(header) + i * d * value_size;
+            if (fp16) {
+                for (size_t j = 0; j < d; j++) {
+                    ((uint16_t*)dst)[j] = faiss::encode_fp16(x[j]);
+                }
+            } else {
+                memcpy(dst, x, d * sizeof(float));
+            }
+        }
+        zmq_msg_close(&msg);
+        zmq_send(socket, reply.data(), reply.size(), 0);
+    }
+}
+
+/// serves nreq query pin / distance / release requests from xb
+void serve_distances(void* socket, const std::vector<float>& xb, int nreq) {
+    std::vector<float> pinned;
+    uint64_t handle = 0;
+    for (int r = 0; r < nreq; r++) {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        zmq_msg_recv(&msg, socket, 0);
+        const char* data = (const char*)zmq_msg_data(&msg);
+        uint32_t magic;
+        memcpy(&magic, data, sizeof(magic));
+        std::vector<char> reply;
+        if (magic == faiss::raw_query_pin_magic) {
+            uint32_t header[3];
+            memcpy(header, data, sizeof(header));
+            EXPECT_EQ(header[1], d);
+            EXPECT_EQ(header[2], (uint32_t)faiss::METRIC_L2);
+            pinned.resize(d);
+            memcpy(pinned.data(),
+                   data + sizeof(header) + sizeof(uint64_t),
+                   d * sizeof(float));
+            handle++;
+            reply.resize(sizeof(handle));
+            memcpy(reply.data(), &handle, sizeof(handle));
+        } else if (magic == faiss::raw_distance_request_magic) {
+            uint32_t n;
+            uint64_t h;
+            memcpy(&n, data + 4, sizeof(n));
+            memcpy(&h, data + 8, sizeof(h));
+            EXPECT_EQ(h, handle);
+            const uint32_t* ids = (const uint32_t*)(data + 16);
+            reply.resize(sizeof(n) + n * sizeof(float));
+            memcpy(reply.data(), &n, sizeof(n));
+            for (uint32_t i = 0; i < n; i++) {
+                float dis = faiss::fvec_L2sqr(
+                        pinned.data(), xb.data() + ids[i] * d, d);
+                memcpy(reply.data() + sizeof(n) + i * sizeof(float),
+                       &dis,
+                       sizeof(dis));
+            }
+        } else {
+            EXPECT_EQ(magic, faiss::raw_query_release_magic);
+        }
+        zmq_msg_close(&msg);
+        zmq_send(socket, reply.data(), reply.size(), 0);
+    }
+}
+
+} // namespace
+
+TEST(ZmqRawTransport, ipc_fetch) {
+    std::vector<float> xb(nb * d), xq(d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    std::string endpoint =
+            "ipc:///tmp/faiss_test_raw_" + std::to_string(getpid());
+    void* context = zmq_ctx_new();
+    void* socket = zmq_socket(context, ZMQ_REP);
+    ASSERT_EQ(zmq_bind(socket, endpoint.c_str()), 0);
+
+    faiss::ZmqConnectionPool& pool = faiss::ZmqConnectionPool::instance();
+    pool.set_endpoint(port, endpoint, true);
+    EXPECT_TRUE(pool.uses_raw_frames(port));
+
+    for (bool fp16 : {false, true}) {
+        std::thread server(serve, socket, std::cref(xb), 2, fp16, 0);
+
+        std::vector<uint32_t> ids = {5, 99, 0, 5};
+        std::vector<float> out(ids.size() * d);
+        ASSERT_TRUE(faiss::fetch_embeddings_zmq_into(
+                ids, d, out.data(), port));
+        for (size_t i = 0; i < ids.size(); i++) {
+            for (size_t j = 0; j < d; j++) {
+                EXPECT_NEAR(out[i * d + j], xb[ids[i] * d + j], 1e-3);
+            }
+        }
+
+        // the distances are computed in place from the reply
+        faiss::ZmqDistanceComputer dc(d, faiss::METRIC_L2, 0, port);
+        dc.set_query(xq.data());
+        std::vector<faiss::idx_t> ids2 = {7, 3};
+        std::vector<float> dis;
+        dc.distances_batch(ids2, dis);
+        for (size_t i = 0; i < ids2.size(); i++) {
+            float ref =
+                    faiss::fvec_L2sqr(xq.data(), xb.data() + ids2[i] * d, d);
+            EXPECT_NEAR(dis[i], ref, 1e-2);
+        }
+        server.join();
+    }
+
+    pool.set_endpoint(port, "", false);
+    zmq_close(socket);
+    zmq_ctx_term(context);
+}
+
+TEST(ZmqRawTransport, server_side_distances) {
+    std::vector<float> xb(nb * d), xq(d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+    faiss::float_rand(xq.data(), xq.size(), 456);
+
+    std::string endpoint =
+            "ipc:///tmp/faiss_test_rawd_" + std::to_string(getpid());
+    void* context = zmq_ctx_new();
+    void* socket = zmq_socket(context, ZMQ_REP);
+    ASSERT_EQ(zmq_bind(socket, endpoint.c_str()), 0);
+    faiss::ZmqConnectionPool::instance().set_endpoint(port, endpoint, true);
+
+    // pin, 2 distance requests, release
+    std::thread server(serve_distances, socket, std::cref(xb), 4);
+    {
+        faiss::ZmqDistanceComputer dc(d, faiss::METRIC_L2, 0, port);
+        dc.server_distances = true;
+        dc.set_query(xq.data());
+        ASSERT_NE(dc.query_handle, uint64_t(0));
+
+        EXPECT_NEAR(
+                dc(42),
+                faiss::fvec_L2sqr(xq.data(), xb.data() + 42 * d, d),
+                1e-5);
+        std::vector<faiss::idx_t> ids = {7, 3, 99};
+        std::vector<float> dis;
+        dc.distances_batch(ids, dis);
+        for (size_t i = 0; i < ids.size(); i++) {
+            EXPECT_NEAR(
+                    dis[i],
+                    faiss::fvec_L2sqr(xq.data(), xb.data() + ids[i] * d, d),
+                    1e-5);
+        }
+    }
+    server.join();
+
+    faiss::ZmqConnectionPool::instance().set_endpoint(port, "", false);
+    zmq_close(socket);
+    zmq_ctx_term(context);
+}
+
+TEST(ZmqRawTransport, hedged_replicas) {
+    std::vector<float> xb(nb * d);
+    faiss::float_rand(xb.data(), xb.size(), 123);
+
+    // 2 replicas of port, the first one is slow
+    const int port_slow = port + 1, port_fast = port + 2;
+    std::string prefix =
+            "ipc:///tmp/faiss_test_rawh_" + std::to_string(getpid());
+    void* context = zmq_ctx_new();
+    void* socket_slow = zmq_socket(context, ZMQ_REP);
+    void* socket_fast = zmq_socket(context, ZMQ_REP);
+    ASSERT_EQ(zmq_bind(socket_slow, (prefix + "_slow").c_str()), 0);
+    ASSERT_EQ(zmq_bind(socket_fast, (prefix + "_fast").c_str()), 0);
+
+    faiss::ZmqConnectionPool& pool = faiss::ZmqConnectionPool::instance();
+    pool.set_endpoint(port_slow, prefix + "_slow", true);
+    pool.set_endpoint(port_fast, prefix + "_fast", true);
+    pool.set_replicas(port, {port_slow, port_fast});
+    EXPECT_TRUE(pool.uses_raw_frames(port));
+    size_t n_hedge_wins0 = pool.n_hedge_wins;
+
+    // the request goes to the slow replica (no request in flight on
+    // either), it is hedged on the fast one after default_hedge_delay_ms
+    std::thread slow(serve, socket_slow, std::cref(xb), 1, false, 500);
+    std::thread fast(serve, socket_fast, std::cref(xb), 1, false, 0);
+    std::vector<uint32_t> ids = {5, 99, 0};
+    std::vector<float> out(ids.size() * d);
+    ASSERT_TRUE(faiss::fetch_embeddings_zmq_into(ids, d, out.data(), port));
+    for (size_t i = 0; i < ids.size(); i++) {
+        for (size_t j = 0; j < d; j++) {
+            EXPECT_EQ(out[i * d + j], xb[ids[i] * d + j]);
+        }
+    }
+    EXPECT_EQ(pool.n_hedge_wins, n_hedge_wins0 + 1);
+    EXPECT_GE(pool.latency_percentile(port_fast, 0.5), 0);
+    EXPECT_EQ(pool.latency_percentile(port_slow, 0.5), -1);
+    EXPECT_EQ(pool.n_outstanding(port_slow), 0);
+    slow.join();
+    fast.join();
+
+    pool.set_replicas(port, {});
+    pool.set_endpoint(port_slow, "", false);
+    pool.set_endpoint(port_fast, "", false);
+    zmq_close(socket_slow);
+    zmq_close(socket_fast);
+    zmq_ctx_term(context);
+}